@@ -284,6 +284,7 @@ UI_DEFAULT=sdl2
 
 # Parse options
 OPTION_DEBUG=no
+OPTION_LOCK_PROFILING=no
 OPTION_IGNORE_AUDIO=no
 OPTION_AOSP_PREBUILTS_DIR=
 OPTION_OUT_DIR=
@@ -329,6 +330,8 @@ for opt do
 
   --debug) OPTION_DEBUG=yes
   ;;
+  --lock-profiling) OPTION_LOCK_PROFILING=yes
+  ;;
   --mingw) OPTION_MINGW=yes
   ;;
   --cc=*) OPTION_CC="$optarg"
@@ -381,6 +384,7 @@ EOF
     echo "  --mingw                     Build Windows executable on Linux"
     echo "  --verbose                   Verbose configuration"
     echo "  --debug                     Build debug version of the emulator"
+    echo "  --lock-profiling            Record the contention of named locks"
     echo "  --no-pcbios                 Disable copying of PC Bios files"
     echo "  --no-tests                  Don't run unit test suite"
     if [ "$IN_ANDROID_REBUILD_SH" ]; then
@@ -774,6 +778,9 @@ fi
 if [ $OPTION_DEBUG = yes ] ; then
     echo "BUILD_DEBUG_EMULATOR := true" >> $config_mk
 fi
+if [ $OPTION_LOCK_PROFILING = yes ] ; then
+    echo "BUILD_LOCK_PROFILING := true" >> $config_mk
+fi
 echo "EMULATOR_BUILD_EMUGL       := true" >> $config_mk
 echo "EMULATOR_EMUGL_SOURCES_DIR := $GLES_DIR" >> $config_mk
 
@@ -847,6 +854,13 @@ case "$HOST_OS" in
         ;;
 esac
 
+# block/linux-aio.c uses the io_submit() syscalls directly, no libaio needed
+case "$HOST_OS" in
+    linux)
+        echo "#define CONFIG_LINUX_AIO    1" >> $config_h
+        ;;
+esac
+
 case "$HOST_OS" in
     linux|darwin)
         echo "#define CONFIG_MADVISE  1" >> $config_h
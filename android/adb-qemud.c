@@ -23,6 +23,7 @@
 #include "android/utils/debug.h"
 #include "android/adb-server.h"
 #include "android/adb-qemud.h"
+#include "android/governor.h"
 
 #define  E(...)    derror(__VA_ARGS__)
 #define  W(...)    dwarning(__VA_ARGS__)
@@ -37,6 +38,9 @@
 #define DEBUG_SERVICE_NAME  "adb-debug"
 /* Maximum length of the message that can be received from the guest. */
 #define ADB_MAX_MSG_LEN     8
+/* Stop reading host data while the guest has more than this number of
+ * bytes to read. Reading resumes when the guest has read all of them. */
+#define ADB_GUEST_MAX_PENDING   (256 * 1024)
 /* Enumerates ADB client state values. */
 typedef enum AdbClientState {
     /* Waiting on a connection from ADB host. */
@@ -65,6 +69,9 @@ struct AdbClient {
     char            msg_buffer[ADB_MAX_MSG_LEN];
     /* Current position in message buffer. */
     int             msg_cur;
+    /* If not 0, reading from the host is stopped until the guest reads
+     * the pending data. */
+    int             throttled;
 };
 
 /* ADB debugging client descriptor. */
@@ -158,8 +165,17 @@ _adb_on_host_data(void* opaque, void* connection, const void* buff, int size)
       adb_client, adb_client->opaque, connection, size, FHP(tmp, sizeof(tmp), buff, size));
 
     if (adb_client->state == ADBC_STATE_CONNECTED) {
+        android_governor_activity();
         /* Dispatch data down to the guest. */
         qemud_client_send(adb_client->qemud_client, (const uint8_t*)buff, size);
+
+        /* Don't queue more host data than the guest can quickly consume. */
+        if (!adb_client->throttled &&
+            qemud_client_get_pending_bytes(adb_client->qemud_client) >
+                    ADB_GUEST_MAX_PENDING) {
+            adb_client->throttled = 1;
+            adb_server_throttle_host(connection, 1);
+        }
     } else {
         D("Unexpected data from ADB host %p while client %p(o=%p) is in state %d",
           connection, adb_client, adb_client->opaque, adb_client->state);
@@ -216,6 +232,7 @@ _adb_client_recv(void* opaque, uint8_t* msg, int msglen, QemudClient* client)
       adb_client, adb_client->opaque, msglen, FHP(tmp, sizeof(tmp), msg, msglen));
 
     if (adb_client->state == ADBC_STATE_CONNECTED) {
+        android_governor_activity();
         /* Connection is fully established. Dispatch the message to the host. */
         adb_server_on_guest_message(adb_client->opaque, msg, msglen);
         return;
@@ -278,6 +295,20 @@ _adb_client_recv(void* opaque, uint8_t* msg, int msglen, QemudClient* client)
     }
 }
 
+/* A callback that is invoked when ADB guest has read all the data sent to it. */
+static void
+_adb_client_drain(void* opaque)
+{
+    AdbClient* const adb_client = (AdbClient*)opaque;
+
+    if (adb_client->throttled) {
+        adb_client->throttled = 0;
+        if (adb_client->opaque != NULL) {
+            adb_server_throttle_host(adb_client->opaque, 0);
+        }
+    }
+}
+
 /* A callback that is invoked when ADB guest disconnects from the service. */
 static void
 _adb_client_close(void* opaque)
@@ -317,6 +348,7 @@ _adb_service_connect(void*          opaque,
         _adb_client_free(adb_client);
         return NULL;
     }
+    qemud_client_set_drain_callback(adb_client->qemud_client, _adb_client_drain);
 
     return adb_client->qemud_client;
 }
@@ -31,6 +31,10 @@
 #define  FHP(dst, dstLen, src, srcLen)  format_hex_printable2(dst, dstLen, src, (srcLen < 32) ? srcLen : 32)
 #define  FHP_MAX (9*(32/4) + 4 + 9*(32/8)) // format_hex_printable2 output len for 32 src bytes
 
+/* Maximum number of bytes read from the ADB host socket at once. Bulk
+ * transfers (adb push) are forwarded to the guest in chunks of this size. */
+#define  ADB_HOST_READ_SIZE  65536
+
 typedef struct AdbServer    AdbServer;
 typedef struct AdbHost      AdbHost;
 typedef struct AdbGuest     AdbGuest;
@@ -72,10 +76,15 @@ struct AdbHost {
     int         pending_data_size;
     /* Contains data that are pending to be sent to the host. */
     uint8_t*    pending_send_buffer;
+    /* Offset of the first byte pending to be sent in pending_send_buffer. */
+    int         pending_send_data_offset;
     /* Number of bytes that are pending to be sent to the host. */
     int         pending_send_data_size;
     /* Size of the pending_send_buffer */
     int         pending_send_buffer_size;
+    /* If not 0, the guest can't accept more data, so don't read the host
+     * socket. */
+    int         throttled;
 };
 
 /* ADB server descriptor. */
@@ -149,34 +158,54 @@ _adb_host_free(AdbHost* adb_host)
     }
 }
 
+/* Frees the buffer of data pending to be sent to the host. */
+static void
+_adb_host_reset_send_buffer(AdbHost* adb_host)
+{
+    free(adb_host->pending_send_buffer);
+    adb_host->pending_send_buffer = NULL;
+    adb_host->pending_send_buffer_size = 0;
+    adb_host->pending_send_data_size = 0;
+    adb_host->pending_send_data_offset = 0;
+}
+
 static void
 _adb_host_append_message(AdbHost* adb_host, const void* msg, int msglen)
 {
-    printf("Append %d bytes to ADB host buffer.\n", msglen);
-
-    /* Make sure that buffer can contain the appending data. */
-    if (adb_host->pending_send_buffer == NULL) {
-        adb_host->pending_send_buffer = (uint8_t*)malloc(msglen);
-        adb_host->pending_send_buffer_size = msglen;
-    } else if ((adb_host->pending_send_data_size + msglen) >
-               adb_host->pending_send_buffer_size) {
-        adb_host->pending_send_buffer =
-            (uint8_t*)realloc(adb_host->pending_send_buffer,
-                              adb_host->pending_send_data_size + msglen);
-        adb_host->pending_send_buffer_size =
-            adb_host->pending_send_data_size + msglen;
+    const int needed = adb_host->pending_send_data_size + msglen;
+
+    D("Append %d bytes to ADB host buffer.", msglen);
+
+    /* Move pending data to the start of the buffer, and grow it
+     * geometrically if it can't contain the appending data. */
+    if (adb_host->pending_send_data_offset > 0) {
+        memmove(adb_host->pending_send_buffer,
+                adb_host->pending_send_buffer +
+                        adb_host->pending_send_data_offset,
+                adb_host->pending_send_data_size);
+        adb_host->pending_send_data_offset = 0;
     }
-
-    if (adb_host->pending_send_buffer == NULL) {
-        D("Unable to allocate %d bytes for pending ADB host data.",
-          adb_host->pending_send_data_size + msglen);
-        adb_host->pending_send_buffer_size = adb_host->pending_send_data_size = 0;
-        loopIo_dontWantWrite(adb_host->io);
-        return;
+    if (needed > adb_host->pending_send_buffer_size) {
+        int new_size = adb_host->pending_send_buffer_size * 2;
+        uint8_t* new_buffer;
+        if (new_size < needed) {
+            new_size = needed;
+        }
+        new_buffer = (uint8_t*)realloc(adb_host->pending_send_buffer, new_size);
+        if (new_buffer == NULL) {
+            D("Unable to allocate %d bytes for pending ADB host data.",
+              new_size);
+            _adb_host_reset_send_buffer(adb_host);
+            loopIo_dontWantWrite(adb_host->io);
+            return;
+        }
+        adb_host->pending_send_buffer = new_buffer;
+        adb_host->pending_send_buffer_size = new_size;
     }
 
     memcpy(adb_host->pending_send_buffer + adb_host->pending_send_data_size,
            msg, msglen);
+    adb_host->pending_send_data_size = needed;
     loopIo_wantWrite(adb_host->io);
 }
 
@@ -224,7 +253,8 @@ static void
 _on_adb_host_read(AdbHost* adb_host)
 {
     char tmp[FHP_MAX];
-    char buff[4096];
+    /* Host I/O callbacks are only called from the ADB server looper. */
+    static char buff[ADB_HOST_READ_SIZE];
 
     /* Read data from the socket. */
     const int size = socket_recv(adb_host->host_so, buff, sizeof(buff));
@@ -271,7 +301,8 @@ _on_adb_host_write(AdbHost* adb_host)
 {
     while (adb_host->pending_send_data_size && adb_host->pending_send_buffer != NULL) {
         const int sent = socket_send(adb_host->host_so,
-                                     adb_host->pending_send_buffer,
+                                     adb_host->pending_send_buffer +
+                                             adb_host->pending_send_data_offset,
                                      adb_host->pending_send_data_size);
         if (sent < 0) {
             if (errno == EWOULDBLOCK) {
@@ -280,30 +311,23 @@ _on_adb_host_write(AdbHost* adb_host)
             } else {
                 D("Unable to send pending data to the ADB host: %s",
                    strerror(errno));
-                free(adb_host->pending_send_buffer);
-                adb_host->pending_send_buffer = NULL;
-                adb_host->pending_send_buffer_size = 0;
-                adb_host->pending_send_data_size = 0;
+                _adb_host_reset_send_buffer(adb_host);
                 break;
             }
         } else if (sent == 0) {
             /* Disconnect condition. */
-            free(adb_host->pending_send_buffer);
-            adb_host->pending_send_buffer = NULL;
-            adb_host->pending_send_buffer_size = 0;
-            adb_host->pending_send_data_size = 0;
+            _adb_host_reset_send_buffer(adb_host);
             _on_adb_host_disconnected(adb_host);
-            break;
+            return;
         } else if (sent == adb_host->pending_send_data_size) {
-            free(adb_host->pending_send_buffer);
-            adb_host->pending_send_buffer = NULL;
-            adb_host->pending_send_buffer_size = 0;
+            /* Keep the buffer for the next messages. */
             adb_host->pending_send_data_size = 0;
+            adb_host->pending_send_data_offset = 0;
         } else {
+            /* Just skip the sent data, the buffer is compacted when new
+             * data is appended. */
             adb_host->pending_send_data_size -= sent;
-            memmove(adb_host->pending_send_buffer,
-                    adb_host->pending_send_buffer + sent,
-                    adb_host->pending_send_data_size);
+            adb_host->pending_send_data_offset += sent;
             return;
         }
     }
@@ -523,12 +547,14 @@ adb_server_on_guest_message(void* opaque, const uint8_t* msg, int msglen)
         D("Sending %d bytes to the ADB host: %s", msglen, FHP(tmp, sizeof(tmp), msg, msglen));
 
         /* Lets see if we can send the data immediatelly... */
-        if (adb_host->pending_send_buffer == NULL) {
+        if (adb_host->pending_send_data_size == 0) {
             /* There are no data that are pending to be sent to the host. Do the
              * direct send. */
             const int sent = socket_send(adb_host->host_so, msg, msglen);
             if (sent < 0) {
                 if (errno == EWOULDBLOCK) {
+                    /* Schedule write via I/O callback. */
+                    _adb_host_append_message(adb_host, msg, msglen);
                 } else {
                     D("Unable to send data to ADB host: %s", strerror(errno));
                 }
@@ -550,6 +576,27 @@ adb_server_on_guest_message(void* opaque, const uint8_t* msg, int msglen)
     }
 }
 
+void
+adb_server_throttle_host(void* opaque, int throttle)
+{
+    AdbGuest* const adb_guest = (AdbGuest*)opaque;
+    AdbHost* const adb_host = adb_guest->adb_host;
+
+    throttle = (throttle != 0);
+    if (adb_host == NULL || adb_host->throttled == throttle) {
+        return;
+    }
+
+    D("%s reading from ADB host %p(so=%d)",
+      throttle ? "Stop" : "Resume", adb_host, adb_host->host_so);
+    adb_host->throttled = throttle;
+    if (throttle) {
+        loopIo_dontWantRead(adb_host->io);
+    } else {
+        loopIo_wantRead(adb_host->io);
+    }
+}
+
 void
 adb_server_on_guest_closed(void* opaque)
 {
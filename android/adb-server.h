@@ -119,6 +119,15 @@ extern void adb_server_on_guest_message(void* opaque,
                                         const uint8_t* data,
                                         int size);
 
+/* Stops or resumes reading data from the ADB host connected with the guest.
+ * This is used to apply back-pressure on the host while the guest has not
+ * consumed the data sent to it with the 'on_read' callback.
+ * Param:
+ *  opaque - An opaque pointer returned from adb_server_register_guest.
+ *  throttle - If not 0 stop reading host data, otherwise resume reading.
+ */
+extern void adb_server_throttle_host(void* opaque, int throttle);
+
 /* Notifies the ADB server that the guest has closed its connection.
  * Param:
  *  opaque - An opaque pointer returned from adb_server_register_guest.
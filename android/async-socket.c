@@ -22,6 +22,7 @@
 
 #include "android/async-socket-connector.h"
 #include "android/async-socket.h"
+#include "android/sockets.h"
 #include "android/utils/debug.h"
 #include "android/utils/eintr_wrapper.h"
 #include "android/utils/panic.h"
@@ -555,6 +556,99 @@ _async_socket_complete_io(AsyncSocket* as, AsyncSocketIO* asio)
     return asio->on_io(asio->io_opaque, asio, ASIO_STATE_SUCCEEDED);
 }
 
+/* Collects the pending data of the current writer, and of the writers queued
+ * behind it, so it can be sent with a single call.
+ * Param:
+ *  as - Initialized AsyncSocket instance with at least one writer.
+ *  batch - Receives referenced writers. Release them with
+ *      _async_socket_release_writers().
+ *  bufs - Receives the data to send for each writer in |batch|.
+ * Return:
+ *  Number of entries in |batch| and |bufs|.
+ */
+static int
+_async_socket_gather_writers(AsyncSocket* as,
+                             AsyncSocketIO** batch,
+                             SockBuffer* bufs)
+{
+    AsyncSocketIO* asw = as->writers_head;
+    int count = 0;
+
+    /* Only writers that haven't reported any progress yet can be added after
+     * the current one. */
+    while (asw != NULL && count < SOCKET_MAX_BUFFERS &&
+           (count == 0 || asw->state == ASIO_STATE_QUEUED)) {
+        async_socket_io_reference(asw);
+        batch[count] = asw;
+        bufs[count].data = asw->buffer + asw->transferred;
+        bufs[count].size = asw->to_transfer - asw->transferred;
+        count++;
+        asw = asw->next;
+    }
+    return count;
+}
+
+/* Releases writers collected by _async_socket_gather_writers(). */
+static void
+_async_socket_release_writers(AsyncSocketIO** batch, int count)
+{
+    int n;
+    for (n = 0; n < count; n++) {
+        async_socket_io_release(batch[n]);
+    }
+}
+
+/* Accounts for data sent for a batch of writers, and completes the writers
+ * whose data has been entirely sent.
+ * Param:
+ *  as - Initialized AsyncSocket instance.
+ *  batch, count - Writers collected by _async_socket_gather_writers().
+ *  sent - Number of bytes sent for the batch.
+ */
+static void
+_async_socket_complete_writers(AsyncSocket* as,
+                               AsyncSocketIO** batch,
+                               int count,
+                               int sent)
+{
+    int n;
+
+    for (n = 0; n < count; n++) {
+        AsyncSocketIO* const asw = batch[n];
+        uint32_t chunk = asw->to_transfer - asw->transferred;
+
+        /* A callback may have cancelled the remaining writers. */
+        if (asw != as->writers_head) {
+            break;
+        }
+        if (chunk > (uint32_t)sent) {
+            chunk = sent;
+        }
+        if (n > 0) {
+            if (chunk == 0) {
+                break;
+            }
+            /* Data has started flowing for this writer. */
+            asw->state = ASIO_STATE_STARTED;
+            asw->on_io(asw->io_opaque, asw, asw->state);
+            if (asw != as->writers_head) {
+                break;
+            }
+        }
+        asw->transferred += chunk;
+        sent -= chunk;
+        if (asw->transferred != asw->to_transfer) {
+            break;
+        }
+        /* This write is completed. Move on to the next writer. */
+        _async_socket_advance_writer(as);
+
+        /* Notify writer completion. */
+        _async_socket_complete_io(as, asw);
+    }
+    _async_socket_release_writers(batch, count);
+}
+
 /* Timeouts an I/O.
  * Param:
  *  as - Initialized AsyncSocket instance.
@@ -934,11 +1028,15 @@ _on_async_socket_send(AsyncSocket* as)
         return 0;
     }
 
-    /* Write next chunk of data. */
-    int res = HANDLE_EINTR(
-            socket_send(as->fd,
-                        asw->buffer + asw->transferred,
-                        asw->to_transfer - asw->transferred));
+    /* Write next chunk of data, together with the writers queued behind this
+     * one, in a single call. */
+    AsyncSocketIO* batch[SOCKET_MAX_BUFFERS];
+    SockBuffer bufs[SOCKET_MAX_BUFFERS];
+    int count = _async_socket_gather_writers(as, batch, bufs);
+    int res = HANDLE_EINTR(socket_sendv(as->fd, bufs, count));
+    if (res <= 0) {
+        _async_socket_release_writers(batch, count);
+    }
     if (res == 0) {
         /* Socket has been disconnected. */
         errno = ECONNRESET;
@@ -973,15 +1071,8 @@ _on_async_socket_send(AsyncSocket* as)
         return -1;
     }
 
-    /* Update the writer descriptor. */
-    asw->transferred += res;
-    if (asw->transferred == asw->to_transfer) {
-        /* This write is completed. Move on to the next writer. */
-        _async_socket_advance_writer(as);
-
-        /* Notify writer completion. */
-        _async_socket_complete_io(as, asw);
-    }
+    /* Update the writer descriptors. */
+    _async_socket_complete_writers(as, batch, count, res);
 
     /* Lets see if there are still active writers, and enable, or disable write
      * I/O callback accordingly. */
@@ -0,0 +1,518 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#include "android/audio-decoder.h"
+#include "android/utils/debug.h"
+#include "android/utils/dll.h"
+#include "android/utils/system.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define D(...)  VERBOSE_PRINT(audio,__VA_ARGS__)
+
+struct AudioDecoder {
+    void  (*free)  ( AudioDecoder*  dec );
+    int   (*feed)  ( AudioDecoder*  dec, const uint8_t*  data, int  size );
+    int   (*decode)( AudioDecoder*  dec, const int16_t**  pcm, int*  freq, int*  nchannels );
+};
+
+/* Load the first library of 'names' that the host has */
+static ADynamicLibrary*
+audio_decoder_load( const char* const*  names )
+{
+    for ( ; *names != NULL; names++ ) {
+        char*             error = NULL;
+        ADynamicLibrary*  lib   = adynamicLibrary_open(*names, &error);
+
+        if (lib != NULL)
+            return lib;
+
+        D("Could not load %s: %s", *names, error);
+        free(error);
+    }
+    return NULL;
+}
+
+/* Resolve symbol 'name' of 'lib' into the pointer of the same name,
+ * jumping to 'fail' if it is missing. */
+#define RESOLVE_FUNCTION_(name) \
+    do { \
+        char*  error  = NULL; \
+        void*  symbol = adynamicLibrary_findSymbol(lib, #name, &error); \
+        if (symbol == NULL) { \
+            D("Could not find %s: %s", #name, error); \
+            free(error); \
+            goto fail; \
+        } \
+        name = symbol; \
+    } while (0);
+
+/***********************************************************************
+ ***********************************************************************
+ *****
+ *****    M P 3
+ *****
+ *****/
+
+/* The parts of mpg123.h that we use, which are stable across releases.
+ * None of these functions depend on the size of off_t. */
+typedef struct mpg123_handle_struct  mpg123_handle;
+
+#define MPG123_OK              0
+#define MPG123_NEED_MORE     -10
+#define MPG123_NEW_FORMAT    -11
+#define MPG123_DONE          -12
+
+#define MPG123_MONO            1
+#define MPG123_STEREO          2
+#define MPG123_ENC_SIGNED_16   0xd0
+
+#define MPG123_FUNCTIONS_LIST \
+  FUNCTION_(int, mpg123_init, (void)) \
+  FUNCTION_(mpg123_handle*, mpg123_new, (const char* decoder, int* error)) \
+  FUNCTION_(void, mpg123_delete, (mpg123_handle* mh)) \
+  FUNCTION_(int, mpg123_open_feed, (mpg123_handle* mh)) \
+  FUNCTION_(int, mpg123_feed, (mpg123_handle* mh, const unsigned char* in, size_t size)) \
+  FUNCTION_(int, mpg123_decode, (mpg123_handle* mh, const unsigned char* inmemory, size_t inmemsize, unsigned char* outmemory, size_t outmemsize, size_t* done)) \
+  FUNCTION_(int, mpg123_getformat, (mpg123_handle* mh, long* rate, int* channels, int* encoding)) \
+  FUNCTION_(int, mpg123_format_none, (mpg123_handle* mh)) \
+  FUNCTION_(int, mpg123_format, (mpg123_handle* mh, long rate, int channels, int encodings)) \
+  FUNCTION_(void, mpg123_rates, (const long** list, size_t* number)) \
+  FUNCTION_(const char*, mpg123_strerror, (mpg123_handle* mh)) \
+
+#define FUNCTION_(ret, name, sig)  static ret (*name) sig = NULL;
+MPG123_FUNCTIONS_LIST
+#undef FUNCTION_
+
+static const char* const  mpg123_lib_names[] = {
+#ifdef _WIN32
+    "libmpg123-0.dll",
+#elif defined(__APPLE__)
+    "libmpg123.0.dylib",
+    "libmpg123.dylib",
+#else
+    "libmpg123.so.0",
+    "libmpg123.so",
+#endif
+    NULL
+};
+
+/* 0 if not loaded yet, 1 if loaded, -1 if not available */
+static int  mpg123_status;
+
+static int
+mpg123_load( void )
+{
+    ADynamicLibrary*  lib;
+
+    if (mpg123_status != 0)
+        return mpg123_status;
+
+    mpg123_status = -1;
+    lib = audio_decoder_load(mpg123_lib_names);
+    if (lib == NULL)
+        return -1;
+
+#define FUNCTION_(ret, name, sig)  RESOLVE_FUNCTION_(name)
+MPG123_FUNCTIONS_LIST
+#undef FUNCTION_
+
+    if (mpg123_init() != MPG123_OK)
+        goto fail;
+
+    mpg123_status = 1;
+    return 1;
+
+fail:
+    adynamicLibrary_close(lib);
+    return -1;
+}
+
+/* big enough for a few MPEG frames of 1152 stereo samples */
+#define  MPG123_OUTPUT_SIZE  16384
+
+/* don't let the library buffer more than that */
+#define  MPG123_FEED_SIZE    4096
+
+typedef struct {
+    AudioDecoder    common;
+    mpg123_handle*  handle;
+    int             freq;
+    int             nchannels;
+    int16_t         output[MPG123_OUTPUT_SIZE / 2];
+} Mpg123Decoder;
+
+static void
+mpg123Decoder_free( AudioDecoder*  dec )
+{
+    Mpg123Decoder*  mp3 = (Mpg123Decoder*)dec;
+
+    mpg123_delete(mp3->handle);
+    AFREE(mp3);
+}
+
+static int
+mpg123Decoder_feed( AudioDecoder*  dec, const uint8_t*  data, int  size )
+{
+    Mpg123Decoder*  mp3 = (Mpg123Decoder*)dec;
+
+    if (size > MPG123_FEED_SIZE)
+        size = MPG123_FEED_SIZE;
+
+    if (mpg123_feed(mp3->handle, data, size) != MPG123_OK)
+        return 0;
+
+    return size;
+}
+
+static int
+mpg123Decoder_decode( AudioDecoder*  dec, const int16_t**  pcm, int*  freq, int*  nchannels )
+{
+    Mpg123Decoder*  mp3 = (Mpg123Decoder*)dec;
+
+    for (;;) {
+        size_t  done = 0;
+        int     ret  = mpg123_decode(mp3->handle, NULL, 0,
+                                     (unsigned char*)mp3->output,
+                                     sizeof(mp3->output), &done);
+
+        if (ret == MPG123_NEW_FORMAT) {
+            long  rate;
+            int   channels, encoding;
+
+            mpg123_getformat(mp3->handle, &rate, &channels, &encoding);
+            if (encoding != MPG123_ENC_SIGNED_16 || channels <= 0) {
+                D("%s: unsupported output format %d", __FUNCTION__, encoding);
+                return -1;
+            }
+            mp3->freq      = (int)rate;
+            mp3->nchannels = channels;
+            continue;
+        }
+
+        if (ret != MPG123_OK && ret != MPG123_NEED_MORE && ret != MPG123_DONE) {
+            D("%s: %s", __FUNCTION__, mpg123_strerror(mp3->handle));
+            return -1;
+        }
+
+        if (done == 0 || mp3->nchannels == 0)
+            return 0;
+
+        *pcm       = mp3->output;
+        *freq      = mp3->freq;
+        *nchannels = mp3->nchannels;
+        return (int)(done / (2 * mp3->nchannels));
+    }
+}
+
+static AudioDecoder*
+mpg123Decoder_new( void )
+{
+    Mpg123Decoder*  mp3;
+    const long*     rates;
+    size_t          count, nn;
+    int             error;
+
+    if (mpg123_load() < 0)
+        return NULL;
+
+    ANEW0(mp3);
+    mp3->common.free   = mpg123Decoder_free;
+    mp3->common.feed   = mpg123Decoder_feed;
+    mp3->common.decode = mpg123Decoder_decode;
+
+    mp3->handle = mpg123_new(NULL, &error);
+    if (mp3->handle == NULL) {
+        AFREE(mp3);
+        return NULL;
+    }
+
+    /* always decode to 16-bit samples, whatever the library prefers */
+    mpg123_format_none(mp3->handle);
+    mpg123_rates(&rates, &count);
+    for (nn = 0; nn < count; nn++)
+        mpg123_format(mp3->handle, rates[nn], MPG123_MONO | MPG123_STEREO,
+                      MPG123_ENC_SIGNED_16);
+
+    if (mpg123_open_feed(mp3->handle) != MPG123_OK) {
+        mpg123Decoder_free(&mp3->common);
+        return NULL;
+    }
+    return &mp3->common;
+}
+
+/***********************************************************************
+ ***********************************************************************
+ *****
+ *****    A A C
+ *****
+ *****/
+
+/* The parts of neaacdec.h that we use, which are stable across releases */
+typedef void*  NeAACDecHandle;
+
+typedef struct {
+    unsigned char  defObjectType;
+    unsigned long  defSampleRate;
+    unsigned char  outputFormat;
+    unsigned char  downMatrix;
+    unsigned char  useOldADTSFormat;
+    unsigned char  dontUpSampleImplicitSBR;
+} NeAACDecConfiguration;
+
+typedef struct {
+    unsigned long  bytesconsumed;
+    unsigned long  samples;
+    unsigned char  channels;
+    unsigned char  error;
+    unsigned long  samplerate;
+    unsigned char  sbr;
+    unsigned char  object_type;
+    unsigned char  header_type;
+    unsigned char  num_front_channels;
+    unsigned char  num_side_channels;
+    unsigned char  num_back_channels;
+    unsigned char  num_lfe_channels;
+    unsigned char  channel_position[64];
+    unsigned char  ps;
+} NeAACDecFrameInfo;
+
+#define FAAD_FMT_16BIT  1
+
+#define FAAD_FUNCTIONS_LIST \
+  FUNCTION_(NeAACDecHandle, NeAACDecOpen, (void)) \
+  FUNCTION_(NeAACDecConfiguration*, NeAACDecGetCurrentConfiguration, (NeAACDecHandle h)) \
+  FUNCTION_(unsigned char, NeAACDecSetConfiguration, (NeAACDecHandle h, NeAACDecConfiguration* config)) \
+  FUNCTION_(long, NeAACDecInit, (NeAACDecHandle h, unsigned char* buffer, unsigned long size, unsigned long* samplerate, unsigned char* channels)) \
+  FUNCTION_(void*, NeAACDecDecode, (NeAACDecHandle h, NeAACDecFrameInfo* info, unsigned char* buffer, unsigned long size)) \
+  FUNCTION_(char*, NeAACDecGetErrorMessage, (unsigned char error)) \
+  FUNCTION_(void, NeAACDecClose, (NeAACDecHandle h)) \
+
+#define FUNCTION_(ret, name, sig)  static ret (*name) sig = NULL;
+FAAD_FUNCTIONS_LIST
+#undef FUNCTION_
+
+static const char* const  faad_lib_names[] = {
+#ifdef _WIN32
+    "libfaad-2.dll",
+    "libfaad2.dll",
+#elif defined(__APPLE__)
+    "libfaad.2.dylib",
+    "libfaad.dylib",
+#else
+    "libfaad.so.2",
+    "libfaad.so",
+#endif
+    NULL
+};
+
+/* 0 if not loaded yet, 1 if loaded, -1 if not available */
+static int  faad_status;
+
+static int
+faad_load( void )
+{
+    ADynamicLibrary*  lib;
+
+    if (faad_status != 0)
+        return faad_status;
+
+    faad_status = -1;
+    lib = audio_decoder_load(faad_lib_names);
+    if (lib == NULL)
+        return -1;
+
+#define FUNCTION_(ret, name, sig)  RESOLVE_FUNCTION_(name)
+FAAD_FUNCTIONS_LIST
+#undef FUNCTION_
+
+    faad_status = 1;
+    return 1;
+
+fail:
+    adynamicLibrary_close(lib);
+    return -1;
+}
+
+/* an ADTS frame is at most 8191 bytes */
+#define  FAAD_INPUT_SIZE  16384
+
+#define  ADTS_HEADER_SIZE  7
+
+typedef struct {
+    AudioDecoder    common;
+    NeAACDecHandle  handle;
+    int             initialized;
+    int             inputLen;
+    uint8_t         input[FAAD_INPUT_SIZE];
+} FaadDecoder;
+
+static void
+faadDecoder_consume( FaadDecoder*  aac, int  len )
+{
+    aac->inputLen -= len;
+    memmove(aac->input, aac->input + len, aac->inputLen);
+}
+
+static void
+faadDecoder_free( AudioDecoder*  dec )
+{
+    FaadDecoder*  aac = (FaadDecoder*)dec;
+
+    NeAACDecClose(aac->handle);
+    AFREE(aac);
+}
+
+static int
+faadDecoder_feed( AudioDecoder*  dec, const uint8_t*  data, int  size )
+{
+    FaadDecoder*  aac   = (FaadDecoder*)dec;
+    int           avail = FAAD_INPUT_SIZE - aac->inputLen;
+
+    if (size > avail)
+        size = avail;
+
+    memcpy(aac->input + aac->inputLen, data, size);
+    aac->inputLen += size;
+    return size;
+}
+
+static int
+faadDecoder_decode( AudioDecoder*  dec, const int16_t**  pcm, int*  freq, int*  nchannels )
+{
+    FaadDecoder*  aac = (FaadDecoder*)dec;
+
+    /* the library wants whole frames, so only decode the frames that the
+     * ADTS headers say are complete */
+    for (;;) {
+        const uint8_t*     in = aac->input;
+        NeAACDecFrameInfo  info;
+        void*              samples;
+        int                skip, frameLen;
+
+        for (skip = 0; skip + 1 < aac->inputLen; skip++) {
+            if (in[skip] == 0xff && (in[skip + 1] & 0xf6) == 0xf0)
+                break;
+        }
+        if (skip > 0)
+            faadDecoder_consume(aac, skip);
+
+        if (aac->inputLen < ADTS_HEADER_SIZE)
+            return 0;
+
+        frameLen = ((in[3] & 3) << 11) | (in[4] << 3) | (in[5] >> 5);
+        if (frameLen < ADTS_HEADER_SIZE) {
+            faadDecoder_consume(aac, 1);
+            continue;
+        }
+        if (aac->inputLen < frameLen)
+            return 0;
+
+        if (!aac->initialized) {
+            unsigned long  rate;
+            unsigned char  channels;
+
+            if (NeAACDecInit(aac->handle, aac->input, aac->inputLen,
+                             &rate, &channels) < 0) {
+                D("%s: not an AAC stream", __FUNCTION__);
+                return -1;
+            }
+            aac->initialized = 1;
+        }
+
+        samples = NeAACDecDecode(aac->handle, &info, aac->input, frameLen);
+        faadDecoder_consume(aac, frameLen);
+
+        /* just skip corrupted frames */
+        if (info.error) {
+            D("%s: %s", __FUNCTION__, NeAACDecGetErrorMessage(info.error));
+            continue;
+        }
+        if (samples == NULL || info.samples == 0 || info.channels == 0)
+            continue;
+
+        *pcm       = samples;
+        *freq      = (int)info.samplerate;
+        *nchannels = info.channels;
+        return (int)(info.samples / info.channels);
+    }
+}
+
+static AudioDecoder*
+faadDecoder_new( void )
+{
+    FaadDecoder*            aac;
+    NeAACDecConfiguration*  config;
+
+    if (faad_load() < 0)
+        return NULL;
+
+    ANEW0(aac);
+    aac->common.free   = faadDecoder_free;
+    aac->common.feed   = faadDecoder_feed;
+    aac->common.decode = faadDecoder_decode;
+
+    aac->handle = NeAACDecOpen();
+    if (aac->handle == NULL) {
+        AFREE(aac);
+        return NULL;
+    }
+
+    /* 16-bit samples, and multi-channel streams mixed down to stereo */
+    config = NeAACDecGetCurrentConfiguration(aac->handle);
+    config->outputFormat = FAAD_FMT_16BIT;
+    config->downMatrix   = 1;
+    NeAACDecSetConfiguration(aac->handle, config);
+
+    return &aac->common;
+}
+
+/***********************************************************************
+ ***********************************************************************
+ *****
+ *****    D E C O D E R S
+ *****
+ *****/
+
+AudioDecoder*
+audio_decoder_new( AudioCodec  codec )
+{
+    switch (codec) {
+    case AUDIO_CODEC_MP3:
+        return mpg123Decoder_new();
+    case AUDIO_CODEC_AAC_ADTS:
+        return faadDecoder_new();
+    }
+    return NULL;
+}
+
+void
+audio_decoder_free( AudioDecoder*  dec )
+{
+    if (dec != NULL)
+        dec->free(dec);
+}
+
+int
+audio_decoder_feed( AudioDecoder*  dec, const uint8_t*  data, int  size )
+{
+    return dec->feed(dec, data, size);
+}
+
+int
+audio_decoder_decode( AudioDecoder*    dec,
+                      const int16_t**  pcm,
+                      int*             freq,
+                      int*             nchannels )
+{
+    return dec->decode(dec, pcm, freq, nchannels);
+}
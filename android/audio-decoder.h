@@ -0,0 +1,59 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#ifndef _android_audio_decoder_h
+#define _android_audio_decoder_h
+
+#include "qemu-common.h"
+
+/* Decoders for the compressed audio streams that the guest offloads to
+ * the host, see android/hw-audio-offload.h.
+ *
+ * They use the decoding libraries of the host, libmpg123 for MP3 and
+ * libfaad2 for AAC, that are loaded when first needed. A host without
+ * them can't decode the corresponding format, and the guest falls back
+ * to decoding it itself.
+ */
+
+/* Compressed audio formats. The values are part of the offload protocol. */
+typedef enum {
+    AUDIO_CODEC_MP3      = 1,
+    /* AAC with an ADTS header in front of each frame */
+    AUDIO_CODEC_AAC_ADTS = 2,
+} AudioCodec;
+
+typedef struct AudioDecoder  AudioDecoder;
+
+/* Create a decoder for 'codec', returns NULL if the host can't decode it */
+extern AudioDecoder*  audio_decoder_new( AudioCodec  codec );
+
+extern void  audio_decoder_free( AudioDecoder*  dec );
+
+/* Feed up to 'size' bytes of the compressed stream to the decoder, only
+ * when audio_decoder_decode() asks for them. Returns the number of bytes
+ * taken.
+ */
+extern int  audio_decoder_feed( AudioDecoder*  dec, const uint8_t*  data, int  size );
+
+/* Decode the next chunk of the stream into interleaved, native endian
+ * signed 16-bit samples. On success, '*pcm' points to samples owned by
+ * the decoder, valid until its next call, and '*freq' and '*nchannels'
+ * are set to their format.
+ *
+ * Returns the number of frames decoded, 0 if the decoder needs more
+ * input, or -1 if the stream can't be decoded.
+ */
+extern int  audio_decoder_decode( AudioDecoder*    dec,
+                                  const int16_t**  pcm,
+                                  int*             freq,
+                                  int*             nchannels );
+
+#endif /* _android_audio_decoder_h */
@@ -164,6 +164,16 @@ androidHwConfig_getKernelYaffs2Support( AndroidHwConfig* config )
     return -1;
 }
 
+int
+androidHwConfig_getQemudLegacySerial( AndroidHwConfig* config )
+{
+    if (!strcmp(config->hw_qemud_legacySerial, "no"))
+        return 0;
+    if (!strcmp(config->hw_qemud_legacySerial, "yes"))
+        return 1;
+    return -1;
+}
+
 const char* androidHwConfig_getKernelSerialPrefix(AndroidHwConfig* config )
 {
     if (androidHwConfig_getKernelDeviceNaming(config) >= 1) {
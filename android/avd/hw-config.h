@@ -85,6 +85,13 @@ int androidHwConfig_getKernelDeviceNaming( AndroidHwConfig* config );
 //   1 -> does support YAFFS2 partitions.
 int androidHwConfig_getKernelYaffs2Support( AndroidHwConfig* config );
 
+// Return an integer indicating if the guest system needs the legacy qemud
+// multiplexer over a serial port. More specifically:
+//  -1 -> don't know, caller will need to auto-detect.
+//   0 -> all qemud services are accessed through goldfish pipes.
+//   1 -> some qemud services are accessed through the serial port.
+int androidHwConfig_getQemudLegacySerial( AndroidHwConfig* config );
+
 // Return the kernel device prefix for serial ports, depending on
 // kernel.newDeviceNaming.
 const char* androidHwConfig_getKernelSerialPrefix( AndroidHwConfig* config );
@@ -289,34 +289,47 @@ path_getBuildTargetArch(const char* androidOut) {
 }
 
 
-static char*
-_getAvdConfigValue(const char* avdPath,
-                   const char* key,
-                   const char* defaultValue)
+/* Open the config.ini file of a given AVD. Caller must call iniFile_free()
+ * on the result.
+ */
+static IniFile*
+_getAvdConfigIni(const char* avdName)
 {
     IniFile* ini;
-    char* result = NULL;
-    char temp[PATH_MAX], *p = temp, *end = p + sizeof(temp);
+    char*    avdPath = _getAvdContentPath(avdName);
+    char     temp[PATH_MAX], *p = temp, *end = p + sizeof(temp);
+
     p = bufprint(temp, end, "%s" PATH_SEP "config.ini", avdPath);
     if (p >= end) {
         APANIC("AVD path too long: %s\n", avdPath);
     }
+    AFREE(avdPath);
     ini = iniFile_newFromFile(temp);
     if (ini == NULL) {
         APANIC("Could not open AVD config file: %s\n", temp);
     }
-    result = iniFile_getString(ini, key, defaultValue);
-    iniFile_free(ini);
+    return ini;
+}
 
-    return result;
+static char*
+_getAvdGpuMode(IniFile* ini)
+{
+    char* gpuEnabled = iniFile_getString(ini, "hw.gpu.enabled", "no");
+    bool enabled = !strcmp(gpuEnabled, "yes");
+    AFREE(gpuEnabled);
+
+    if (!enabled) {
+        return NULL;
+    }
+    return iniFile_getString(ini, "hw.gpu.mode", "auto");
 }
 
 char*
 path_getAvdTargetArch( const char* avdName )
 {
-    char*  avdPath = _getAvdContentPath(avdName);
-    char*  avdArch = _getAvdConfigValue(avdPath, "hw.cpu.arch", "arm");
-    AFREE(avdPath);
+    IniFile* ini = _getAvdConfigIni(avdName);
+    char*    avdArch = iniFile_getString(ini, "hw.cpu.arch", "arm");
+    iniFile_free(ini);
 
     return avdArch;
 }
@@ -324,19 +337,22 @@ path_getAvdTargetArch( const char* avdName )
 char*
 path_getAvdGpuMode(const char* avdName)
 {
-    char* avdPath = _getAvdContentPath(avdName);
-    char* gpuEnabled = _getAvdConfigValue(avdPath, "hw.gpu.enabled", "no");
-    bool enabled = !strcmp(gpuEnabled, "yes");
-    AFREE(gpuEnabled);
+    IniFile* ini = _getAvdConfigIni(avdName);
+    char*    gpuMode = _getAvdGpuMode(ini);
+    iniFile_free(ini);
 
-    char* gpuMode = NULL;
-    if (enabled) {
-        gpuMode = _getAvdConfigValue(avdPath, "hw.gpu.mode", "auto");
-    }
-    AFREE(avdPath);
     return gpuMode;
 }
 
+void
+path_getAvdLaunchConfig(const char* avdName, char** avdArch, char** gpuMode)
+{
+    IniFile* ini = _getAvdConfigIni(avdName);
+    *avdArch = iniFile_getString(ini, "hw.cpu.arch", "arm");
+    *gpuMode = _getAvdGpuMode(ini);
+    iniFile_free(ini);
+}
+
 const char*
 emulator_getBackendSuffix(const char* targetArch)
 {
@@ -50,6 +50,15 @@ char* path_getAvdTargetArch( const char* avdName );
  */
 char* path_getAvdGpuMode(const char* avdName);
 
+/* Return both the target architecture and the value of hw.gpu.mode for a
+ * given AVD, like path_getAvdTargetArch() and path_getAvdGpuMode(), but
+ * reading its configuration files only once.
+ * Caller must free() both returned strings.
+ */
+void path_getAvdLaunchConfig(const char* avdName,
+                             char** avdArch,
+                             char** gpuMode);
+
 typedef enum {
     RESULT_INVALID   = -1, // key was found but value contained invalid data
     RESULT_FOUND     =  0, // key was found and value parsed correctly
@@ -0,0 +1,482 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/base/AsyncLogWriter.h"
+
+#include "android/base/containers/PodVector.h"
+#include "android/base/synchronization/ConditionVariable.h"
+#include "android/base/synchronization/Lock.h"
+#include "android/base/threads/Thread.h"
+#include "android/base/threads/ThreadStore.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <sched.h>
+#  include <sys/time.h>
+#endif
+
+namespace android {
+namespace base {
+
+namespace {
+
+// Size of each per-thread ring buffer, must be a power of 2.
+const uint32_t kBufferSize = 32768U;
+
+// Records are aligned to this size, which is also the size of their
+// header, so that a padding record always fits at the end of a buffer.
+const uint32_t kRecordAlign = 16U;
+
+// Larger messages are written synchronously.
+const uint32_t kMaxMessageSize = kBufferSize / 4U;
+
+// Maximum number of bytes per fwrite() call from the logger thread.
+const size_t kMaxBatchSize = 65536U;
+
+enum {
+    kStreamPadding = 0,
+    kStreamStdout = 1,
+    kStreamStderr = 2,
+};
+
+struct RecordHeader {
+    uint64_t timestampUs;
+    uint32_t size;
+    uint32_t stream;
+};
+
+uint32_t recordSize(uint32_t messageSize) {
+    return (static_cast<uint32_t>(sizeof(RecordHeader)) + messageSize +
+            kRecordAlign - 1U) & ~(kRecordAlign - 1U);
+}
+
+uint64_t nowUs() {
+#ifdef _WIN32
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return static_cast<uint64_t>(now.QuadPart * 1000000.0 / freq.QuadPart);
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return static_cast<uint64_t>(tv.tv_sec) * 1000000U + tv.tv_usec;
+#endif
+}
+
+void yieldThread() {
+#ifdef _WIN32
+    ::Sleep(0);
+#else
+    ::sched_yield();
+#endif
+}
+
+// A single-producer / single-consumer ring buffer of log records. The
+// owner thread pushes records, and the logger thread consumes them.
+// |mHead| and |mTail| are free-running byte counters.
+class ThreadBuffer {
+public:
+    ThreadBuffer() : next(NULL), orphaned(0), mHead(0U), mTail(0U) {}
+
+    // Next buffer in the logger's list.
+    ThreadBuffer* next;
+    // Set when the owner thread exits.
+    int orphaned;
+
+    bool isEmpty() const {
+        return __atomic_load_n(&mHead, __ATOMIC_SEQ_CST) ==
+               __atomic_load_n(&mTail, __ATOMIC_ACQUIRE);
+    }
+
+    // Called by the owner thread. Return false if there is not enough
+    // room for the message.
+    bool push(uint64_t timestampUs,
+              uint32_t stream,
+              const char* data,
+              uint32_t len) {
+        uint32_t head = mHead;
+        uint32_t tail = __atomic_load_n(&mTail, __ATOMIC_ACQUIRE);
+        uint32_t size = recordSize(len);
+        uint32_t offset = head & (kBufferSize - 1U);
+        uint32_t padding = (kBufferSize - offset < size)
+                ? kBufferSize - offset : 0U;
+        if (kBufferSize - (head - tail) < padding + size) {
+            return false;
+        }
+        if (padding) {
+            RecordHeader* pad = headerAt(offset);
+            pad->size = 0U;
+            pad->stream = kStreamPadding;
+            offset = 0U;
+        }
+        RecordHeader* header = headerAt(offset);
+        header->timestampUs = timestampUs;
+        header->size = len;
+        header->stream = stream;
+        ::memcpy(header + 1, data, len);
+        __atomic_store_n(&mHead, head + padding + size, __ATOMIC_SEQ_CST);
+        return true;
+    }
+
+    // Called by the logger thread. Return the oldest record, or NULL if
+    // the buffer is empty.
+    const RecordHeader* peek() {
+        for (;;) {
+            uint32_t tail = mTail;
+            if (tail == __atomic_load_n(&mHead, __ATOMIC_ACQUIRE)) {
+                return NULL;
+            }
+            uint32_t offset = tail & (kBufferSize - 1U);
+            const RecordHeader* header = headerAt(offset);
+            if (header->stream != kStreamPadding) {
+                return header;
+            }
+            __atomic_store_n(&mTail, tail + (kBufferSize - offset),
+                             __ATOMIC_RELEASE);
+        }
+    }
+
+    // Called by the logger thread to release the record returned by
+    // peek().
+    void pop(const RecordHeader* header) {
+        __atomic_store_n(&mTail, mTail + recordSize(header->size),
+                         __ATOMIC_RELEASE);
+    }
+
+private:
+    RecordHeader* headerAt(uint32_t offset) {
+        return reinterpret_cast<RecordHeader*>(
+                reinterpret_cast<char*>(mData) + offset);
+    }
+
+    uint32_t mHead;
+    uint32_t mTail;
+    uint64_t mData[kBufferSize / sizeof(uint64_t)];
+};
+
+void onThreadExit(void* opaque) {
+    __atomic_store_n(&static_cast<ThreadBuffer*>(opaque)->orphaned, 1,
+                     __ATOMIC_RELEASE);
+}
+
+class LoggerThread;
+
+// Global logger state. Created by the first start() call and never
+// destroyed, since other threads may still be logging on exit.
+struct LoggerState {
+    LoggerState() :
+            buffers(NULL),
+            store(onThreadExit),
+            running(0),
+            sleeping(0),
+            quit(false),
+            flushRequested(0U),
+            flushDone(0U),
+            thread(NULL) {}
+
+    ThreadBuffer* currentBuffer() {
+        ThreadBuffer* buffer = static_cast<ThreadBuffer*>(store.get());
+        if (!buffer) {
+            buffer = new ThreadBuffer();
+            store.set(buffer);
+            buffer->next = __atomic_load_n(&buffers, __ATOMIC_RELAXED);
+            while (!__atomic_compare_exchange_n(&buffers, &buffer->next,
+                                                buffer, true,
+                                                __ATOMIC_RELEASE,
+                                                __ATOMIC_RELAXED)) {}
+        }
+        return buffer;
+    }
+
+    bool hasPendingRecords() const {
+        ThreadBuffer* buffer = __atomic_load_n(&buffers, __ATOMIC_ACQUIRE);
+        for (; buffer; buffer = buffer->next) {
+            if (!buffer->isEmpty()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Wake up the logger thread if it sleeps, or if |force| is true.
+    void wakeLogger(bool force) {
+        if (force || __atomic_load_n(&sleeping, __ATOMIC_SEQ_CST)) {
+            AutoLock autoLock(lock);
+            cond.signal();
+        }
+    }
+
+    // Write all pending records, merged by timestamp. Return the number
+    // of records written.
+    size_t drain();
+
+    void writeBatch(FILE* stream) {
+        if (stream && batch.size()) {
+            ::fwrite(batch.begin(), 1, batch.size(), stream);
+        }
+        batch.resize(0U);
+    }
+
+    // Free the buffers of threads that exited, once they are empty.
+    // The list head is never removed since other threads may be
+    // inserting new buffers concurrently.
+    void removeOrphans() {
+        ThreadBuffer* prev = __atomic_load_n(&buffers, __ATOMIC_ACQUIRE);
+        while (prev && prev->next) {
+            ThreadBuffer* buffer = prev->next;
+            if (__atomic_load_n(&buffer->orphaned, __ATOMIC_ACQUIRE) &&
+                buffer->isEmpty()) {
+                prev->next = buffer->next;
+                delete buffer;
+            } else {
+                prev = buffer;
+            }
+        }
+    }
+
+    void loggerMain();
+
+    ThreadBuffer* buffers;
+    ThreadStoreBase store;
+    int running;
+    int sleeping;
+    // The following fields are protected by |lock|.
+    bool quit;
+    unsigned flushRequested;
+    unsigned flushDone;
+    Lock lock;
+    ConditionVariable cond;
+    ConditionVariable flushCond;
+    // Only one thread calls flush() at a time.
+    Lock flushLock;
+    // Only used by start() and stop().
+    Lock controlLock;
+    LoggerThread* thread;
+    // Only used by the logger thread.
+    PodVector<char> batch;
+};
+
+size_t LoggerState::drain() {
+    size_t count = 0;
+    FILE* current = NULL;
+    bool usedStdout = false;
+    bool usedStderr = false;
+    for (;;) {
+        ThreadBuffer* best = NULL;
+        const RecordHeader* bestRecord = NULL;
+        ThreadBuffer* buffer = __atomic_load_n(&buffers, __ATOMIC_ACQUIRE);
+        for (; buffer; buffer = buffer->next) {
+            const RecordHeader* record = buffer->peek();
+            if (record && (!bestRecord ||
+                           record->timestampUs < bestRecord->timestampUs)) {
+                best = buffer;
+                bestRecord = record;
+            }
+        }
+        if (!best) {
+            break;
+        }
+        FILE* stream;
+        if (bestRecord->stream == kStreamStdout) {
+            stream = stdout;
+            usedStdout = true;
+        } else {
+            stream = stderr;
+            usedStderr = true;
+        }
+        if (stream != current ||
+            batch.size() + bestRecord->size > kMaxBatchSize) {
+            writeBatch(current);
+            current = stream;
+        }
+        size_t pos = batch.size();
+        batch.resize(pos + bestRecord->size);
+        ::memcpy(&batch[pos], bestRecord + 1, bestRecord->size);
+        best->pop(bestRecord);
+        count++;
+    }
+    writeBatch(current);
+    if (usedStdout) {
+        ::fflush(stdout);
+    }
+    if (usedStderr) {
+        ::fflush(stderr);
+    }
+    removeOrphans();
+    return count;
+}
+
+void LoggerState::loggerMain() {
+    for (;;) {
+        if (drain() > 0) {
+            continue;
+        }
+        AutoLock autoLock(lock);
+        // Re-check with the lock held, since a thread may have queued
+        // records before calling flush().
+        if (hasPendingRecords()) {
+            continue;
+        }
+        if (flushDone != flushRequested) {
+            flushDone = flushRequested;
+            flushCond.signal();
+        }
+        if (quit) {
+            break;
+        }
+        __atomic_store_n(&sleeping, 1, __ATOMIC_SEQ_CST);
+        if (!hasPendingRecords()) {
+            cond.wait(&lock);
+        }
+        __atomic_store_n(&sleeping, 0, __ATOMIC_SEQ_CST);
+    }
+}
+
+class LoggerThread : public Thread {
+public:
+    explicit LoggerThread(LoggerState* state) : Thread(), mState(state) {}
+
+    virtual intptr_t main() {
+        mState->loggerMain();
+        return 0;
+    }
+
+private:
+    LoggerState* mState;
+};
+
+LoggerState* sState = NULL;
+
+LoggerState* getRunningState() {
+    LoggerState* state = __atomic_load_n(&sState, __ATOMIC_ACQUIRE);
+    if (!state || !__atomic_load_n(&state->running, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    return state;
+}
+
+void stopAtExit() {
+    AsyncLogWriter::stop();
+}
+
+}  // namespace
+
+// static
+void AsyncLogWriter::start() {
+    LoggerState* state = __atomic_load_n(&sState, __ATOMIC_ACQUIRE);
+    if (!state) {
+        LoggerState* newState = new LoggerState();
+        if (__atomic_compare_exchange_n(&sState, &state, newState, false,
+                                        __ATOMIC_ACQ_REL,
+                                        __ATOMIC_ACQUIRE)) {
+            state = newState;
+            ::atexit(stopAtExit);
+        } else {
+            delete newState;
+        }
+    }
+
+    AutoLock autoLock(state->controlLock);
+    if (state->thread) {
+        return;
+    }
+    state->quit = false;
+    state->thread = new LoggerThread(state);
+    if (!state->thread->start()) {
+        delete state->thread;
+        state->thread = NULL;
+        return;
+    }
+    __atomic_store_n(&state->running, 1, __ATOMIC_RELEASE);
+}
+
+// static
+void AsyncLogWriter::stop() {
+    LoggerState* state = __atomic_load_n(&sState, __ATOMIC_ACQUIRE);
+    if (!state) {
+        return;
+    }
+    AutoLock autoLock(state->controlLock);
+    if (!state->thread) {
+        return;
+    }
+    __atomic_store_n(&state->running, 0, __ATOMIC_RELEASE);
+    state->lock.lock();
+    state->quit = true;
+    state->cond.signal();
+    state->lock.unlock();
+
+    state->thread->wait(NULL);
+    delete state->thread;
+    state->thread = NULL;
+}
+
+// static
+bool AsyncLogWriter::isRunning() {
+    return getRunningState() != NULL;
+}
+
+// static
+bool AsyncLogWriter::write(FILE* stream, const char* data, size_t len) {
+    LoggerState* state = getRunningState();
+    if (!state) {
+        return false;
+    }
+    uint32_t streamId;
+    if (stream == stdout) {
+        streamId = kStreamStdout;
+    } else if (stream == stderr) {
+        streamId = kStreamStderr;
+    } else {
+        return false;
+    }
+    if (len > kMaxMessageSize) {
+        flush();
+        return false;
+    }
+    ThreadBuffer* buffer = state->currentBuffer();
+    uint64_t timestampUs = nowUs();
+    while (!buffer->push(timestampUs, streamId, data,
+                         static_cast<uint32_t>(len))) {
+        // The buffer is full, let the logger catch up.
+        if (!__atomic_load_n(&state->running, __ATOMIC_ACQUIRE)) {
+            return false;
+        }
+        state->wakeLogger(true);
+        yieldThread();
+    }
+    state->wakeLogger(false);
+    return true;
+}
+
+// static
+void AsyncLogWriter::flush() {
+    LoggerState* state = getRunningState();
+    if (!state) {
+        return;
+    }
+    AutoLock flushLock(state->flushLock);
+    AutoLock autoLock(state->lock);
+    unsigned ticket = ++state->flushRequested;
+    state->cond.signal();
+    while (state->flushDone != ticket &&
+           __atomic_load_n(&state->running, __ATOMIC_ACQUIRE)) {
+        state->flushCond.wait(&state->lock);
+    }
+}
+
+}  // namespace base
+}  // namespace android
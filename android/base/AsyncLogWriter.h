@@ -0,0 +1,64 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#ifndef ANDROID_BASE_ASYNC_LOG_WRITER_H
+#define ANDROID_BASE_ASYNC_LOG_WRITER_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+namespace android {
+namespace base {
+
+// AsyncLogWriter moves the cost of writing log messages to a terminal or
+// a file away from the threads that produce them.
+//
+// Once start() is called, write() copies each message, with a binary
+// timestamp, into a ring buffer owned by the calling thread, without
+// taking any lock. A background logger thread drains all buffers, merges
+// their messages in timestamp order, and writes them in batches, with a
+// single fflush() per batch.
+//
+// Typical usage is:
+//
+//     if (!AsyncLogWriter::write(stderr, message, messageLen)) {
+//         ... write |message| synchronously.
+//     }
+//
+// Messages larger than a quarter of a thread buffer are not queued, and
+// write() returns false after flushing the pending ones, so that the
+// caller can write them in order.
+class AsyncLogWriter {
+public:
+    // Start the logger thread. Does nothing if it is already running.
+    // stop() is called automatically on process exit.
+    static void start();
+
+    // Write all pending messages, then stop the logger thread. Later
+    // write() calls will return false.
+    static void stop();
+
+    // Return true iff the logger thread is running.
+    static bool isRunning();
+
+    // Queue |len| bytes from |data| for output to |stream|, which must be
+    // stdout or stderr. Return true on success, or false if the message
+    // was not queued, e.g. because the logger is not running.
+    static bool write(FILE* stream, const char* data, size_t len);
+
+    // Block until all messages queued so far are written and flushed.
+    static void flush();
+};
+
+}  // namespace base
+}  // namespace android
+
+#endif  // ANDROID_BASE_ASYNC_LOG_WRITER_H
@@ -0,0 +1,165 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/base/AsyncLogWriter.h"
+
+#include "android/base/String.h"
+#include "android/base/testing/TestTempDir.h"
+#include "android/base/testing/TestThread.h"
+
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace android {
+namespace base {
+
+namespace {
+
+// Redirects stdout to a temporary file for the lifetime of the instance.
+class StdoutCapture {
+public:
+    StdoutCapture() : mTempDir("async_log_test"), mPath(), mSavedFd(-1) {
+        mPath = mTempDir.makeSubPath("stdout.txt");
+        fflush(stdout);
+        mSavedFd = dup(fileno(stdout));
+        int fd = ::open(mPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        dup2(fd, fileno(stdout));
+        ::close(fd);
+    }
+
+    ~StdoutCapture() {
+        restore();
+    }
+
+    void restore() {
+        if (mSavedFd >= 0) {
+            fflush(stdout);
+            dup2(mSavedFd, fileno(stdout));
+            ::close(mSavedFd);
+            mSavedFd = -1;
+        }
+    }
+
+    // Return the content written to stdout so far.
+    String content() {
+        fflush(stdout);
+        String result;
+        FILE* file = fopen(mPath.c_str(), "rb");
+        if (file) {
+            char buf[4096];
+            size_t len;
+            while ((len = fread(buf, 1, sizeof(buf), file)) > 0) {
+                result.append(buf, len);
+            }
+            fclose(file);
+        }
+        return result;
+    }
+
+private:
+    TestTempDir mTempDir;
+    String mPath;
+    int mSavedFd;
+};
+
+const int kNumThreads = 4;
+const int kNumMessages = 2000;
+
+void* writeMessages(void* param) {
+    int thread = static_cast<int>(reinterpret_cast<intptr_t>(param));
+    for (int n = 0; n < kNumMessages; ++n) {
+        char message[32];
+        int len = snprintf(message, sizeof(message), "%d:%d\n", thread, n);
+        EXPECT_TRUE(AsyncLogWriter::write(stdout, message, len));
+    }
+    return NULL;
+}
+
+}  // namespace
+
+TEST(AsyncLogWriter, NotRunningByDefault) {
+    EXPECT_FALSE(AsyncLogWriter::isRunning());
+    EXPECT_FALSE(AsyncLogWriter::write(stdout, "foo\n", 4));
+    // Must not block.
+    AsyncLogWriter::flush();
+}
+
+TEST(AsyncLogWriter, WriteAndFlush) {
+    StdoutCapture capture;
+    AsyncLogWriter::start();
+    EXPECT_TRUE(AsyncLogWriter::isRunning());
+    EXPECT_TRUE(AsyncLogWriter::write(stdout, "Hello ", 6));
+    EXPECT_TRUE(AsyncLogWriter::write(stdout, "World\n", 6));
+    AsyncLogWriter::flush();
+    EXPECT_STREQ("Hello World\n", capture.content().c_str());
+
+    AsyncLogWriter::stop();
+    EXPECT_FALSE(AsyncLogWriter::isRunning());
+    EXPECT_FALSE(AsyncLogWriter::write(stdout, "foo\n", 4));
+}
+
+TEST(AsyncLogWriter, RejectsOtherStreams) {
+    AsyncLogWriter::start();
+    FILE* file = tmpfile();
+    EXPECT_FALSE(AsyncLogWriter::write(file, "foo\n", 4));
+    fclose(file);
+    AsyncLogWriter::stop();
+}
+
+TEST(AsyncLogWriter, RejectsLargeMessages) {
+    AsyncLogWriter::start();
+    String message;
+    message.resize(100000);
+    EXPECT_FALSE(AsyncLogWriter::write(stdout, message.c_str(),
+                                       message.size()));
+    AsyncLogWriter::stop();
+}
+
+TEST(AsyncLogWriter, MultipleThreadsKeepOrder) {
+    StdoutCapture capture;
+    AsyncLogWriter::start();
+    TestThread* threads[kNumThreads];
+    for (int n = 0; n < kNumThreads; ++n) {
+        threads[n] = new TestThread(writeMessages,
+                                    reinterpret_cast<void*>(n));
+    }
+    for (int n = 0; n < kNumThreads; ++n) {
+        threads[n]->join();
+        delete threads[n];
+    }
+    // stop() writes all pending messages.
+    AsyncLogWriter::stop();
+
+    String content = capture.content();
+    int next[kNumThreads] = { 0 };
+    const char* line = content.c_str();
+    while (*line) {
+        int thread = -1, index = -1;
+        ASSERT_EQ(2, sscanf(line, "%d:%d", &thread, &index)) << line;
+        ASSERT_LE(0, thread);
+        ASSERT_GT(kNumThreads, thread);
+        EXPECT_EQ(next[thread], index);
+        next[thread] = index + 1;
+        line = strchr(line, '\n');
+        ASSERT_TRUE(line);
+        line++;
+    }
+    for (int n = 0; n < kNumThreads; ++n) {
+        EXPECT_EQ(kNumMessages, next[n]);
+    }
+}
+
+}  // namespace base
+}  // namespace android
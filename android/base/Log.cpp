@@ -12,6 +12,8 @@
 #define __STDC_LIMIT_MACROS
 #include "android/base/Log.h"
 
+#include "android/base/AsyncLogWriter.h"
+
 #include <limits.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -42,6 +44,22 @@ const char* severityLevelToString(LogSeverity severity) {
 void defaultLogMessage(const LogParams& params,
                        const char* message,
                        size_t messageLen) {
+    if (params.severity < LOG_FATAL && AsyncLogWriter::isRunning()) {
+        LogString line("%s:%s:%d:%.*s\n",
+                       severityLevelToString(params.severity),
+                       params.file,
+                       params.lineno,
+                       int(messageLen),
+                       message);
+        if (AsyncLogWriter::write(stderr,
+                                  line.string(),
+                                  strlen(line.string()))) {
+            return;
+        }
+    }
+    // Write the message synchronously, after the queued ones.
+    AsyncLogWriter::flush();
+
     fprintf(stderr,
             "%s:%s:%d:%.*s\n",
             severityLevelToString(params.severity),
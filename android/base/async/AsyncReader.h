@@ -14,6 +14,7 @@
 
 #include "android/base/async/AsyncStatus.h"
 #include "android/base/async/Looper.h"
+#include "android/base/sockets/SocketUtils.h"
 
 #include <stdint.h>
 
@@ -44,22 +45,46 @@ namespace base {
 //         // still more data needed to fill the buffer.
 //     }
 //
+// To read into several buffers at once, e.g. a message header and its
+// payload, pass an array of SocketBuffer descriptors to resetV() instead.
+// Each buffer is filled before the next one.
+//
 class AsyncReader {
 public:
     AsyncReader() :
-            mBuffer(NULL),
-            mBufferSize(0U),
-            mPos(0),
-            mFdWatch(NULL) {}
+            mBuffers(NULL),
+            mCount(0U),
+            mIndex(0U),
+            mOffset(0U),
+            mTransferred(0U),
+            mFdWatch(NULL) {
+        mSingle.data = NULL;
+        mSingle.size = 0U;
+    }
 
     void reset(void* buffer, size_t buffSize, Looper::FdWatch* watch);
 
+    // Prepare to fill the |count| buffers described by |buffers| with
+    // data read from |watch|. The descriptors and the data they point to
+    // must remain valid until the operation completes.
+    void resetV(const SocketBuffer* buffers,
+                size_t count,
+                Looper::FdWatch* watch);
+
     AsyncStatus run();
 
+    // Return the number of bytes read since the last reset() or resetV().
+    size_t transferred() const { return mTransferred; }
+
 private:
-    uint8_t* mBuffer;
-    size_t mBufferSize;
-    size_t mPos;
+    void advance(size_t size);
+
+    const SocketBuffer* mBuffers;
+    size_t mCount;
+    size_t mIndex;
+    size_t mOffset;
+    size_t mTransferred;
+    SocketBuffer mSingle;
     Looper::FdWatch* mFdWatch;
 };
 
@@ -9,24 +9,65 @@ namespace base {
 void AsyncWriter::reset(const void* buffer,
                         size_t bufferSize,
                         Looper::FdWatch* watch) {
-    mBuffer = reinterpret_cast<const uint8_t*>(buffer);
-    mBufferSize = bufferSize;
-    mPos = 0;
+    mSingle.data = const_cast<void*>(buffer);
+    mSingle.size = bufferSize;
+    resetV(&mSingle, 1U, watch);
+}
+
+void AsyncWriter::resetV(const SocketBuffer* buffers,
+                         size_t count,
+                         Looper::FdWatch* watch) {
+    mBuffers = buffers;
+    mCount = count;
+    mIndex = 0U;
+    mOffset = 0U;
+    mTransferred = 0U;
     mFdWatch = watch;
-    if (bufferSize > 0) {
+    advance(0U);
+    if (mIndex < mCount) {
         watch->wantWrite();
     }
 }
 
+void AsyncWriter::advance(size_t size) {
+    mTransferred += size;
+    while (mIndex < mCount) {
+        size_t remaining = mBuffers[mIndex].size - mOffset;
+        if (size < remaining) {
+            mOffset += size;
+            return;
+        }
+        size -= remaining;
+        mIndex++;
+        mOffset = 0U;
+    }
+}
+
 AsyncStatus AsyncWriter::run() {
-    if (mPos >= mBufferSize) {
+    if (mIndex >= mCount) {
         return kAsyncCompleted;
     }
 
     do {
-        ssize_t ret = socketSend(mFdWatch->fd(),
-                                 mBuffer + mPos,
-                                 mBufferSize - mPos);
+        ssize_t ret;
+        if (mIndex + 1U == mCount) {
+            ret = socketSend(mFdWatch->fd(),
+                             static_cast<uint8_t*>(mBuffers[mIndex].data) +
+                                     mOffset,
+                             mBuffers[mIndex].size - mOffset);
+        } else {
+            SocketBuffer buffers[kSocketMaxBuffers];
+            size_t count = 0;
+            for (size_t n = mIndex;
+                 n < mCount && count < kSocketMaxBuffers;
+                 ++n, ++count) {
+                size_t offset = (n == mIndex) ? mOffset : 0U;
+                buffers[count].data =
+                        static_cast<uint8_t*>(mBuffers[n].data) + offset;
+                buffers[count].size = mBuffers[n].size - offset;
+            }
+            ret = socketSendV(mFdWatch->fd(), buffers, count);
+        }
         if (ret == 0) {
             // Disconnection!
             errno = ECONNRESET;
@@ -38,8 +79,8 @@ AsyncStatus AsyncWriter::run() {
             }
             return kAsyncError;
         }
-        mPos += static_cast<size_t>(ret);
-    } while (mPos < mBufferSize);
+        advance(static_cast<size_t>(ret));
+    } while (mIndex < mCount);
 
     mFdWatch->dontWantWrite();
     return kAsyncCompleted;
@@ -14,30 +14,57 @@
 
 #include "android/base/async/AsyncStatus.h"
 #include "android/base/async/Looper.h"
+#include "android/base/sockets/SocketUtils.h"
 
 #include <stdint.h>
 
 namespace android {
 namespace base {
 
+// Helper class to write data to a socket asynchronously. This is the
+// counterpart of AsyncReader, see its documentation for usage details.
+//
+// The data can be either a single buffer, or a list of buffers which are
+// sent in order without copying them into a contiguous one first.
 class AsyncWriter {
 public:
     AsyncWriter() :
-            mBuffer(NULL),
-            mBufferSize(0U),
-            mPos(0U),
-            mFdWatch(NULL) {}
+            mBuffers(NULL),
+            mCount(0U),
+            mIndex(0U),
+            mOffset(0U),
+            mTransferred(0U),
+            mFdWatch(NULL) {
+        mSingle.data = NULL;
+        mSingle.size = 0U;
+    }
 
+    // Prepare to send |bufferSize| bytes from |buffer| to |watch|.
     void reset(const void* buffer,
                size_t bufferSize,
                Looper::FdWatch* watch);
 
+    // Prepare to send the content of the |count| buffers described by
+    // |buffers| to |watch|. The descriptors and the data they point to
+    // must remain valid until the operation completes.
+    void resetV(const SocketBuffer* buffers,
+                size_t count,
+                Looper::FdWatch* watch);
+
     AsyncStatus run();
 
+    // Return the number of bytes sent since the last reset() or resetV().
+    size_t transferred() const { return mTransferred; }
+
 private:
-    const uint8_t* mBuffer;
-    size_t mBufferSize;
-    size_t mPos;
+    void advance(size_t size);
+
+    const SocketBuffer* mBuffers;
+    size_t mCount;
+    size_t mIndex;
+    size_t mOffset;
+    size_t mTransferred;
+    SocketBuffer mSingle;
     Looper::FdWatch* mFdWatch;
 };
 
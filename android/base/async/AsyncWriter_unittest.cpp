@@ -0,0 +1,168 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/base/async/AsyncWriter.h"
+
+#include "android/base/async/AsyncReader.h"
+#include "android/base/memory/ScopedPtr.h"
+#include "android/base/sockets/SocketUtils.h"
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+namespace android {
+namespace base {
+
+namespace {
+
+void dummyCallback(void*, int, unsigned) {}
+
+class AsyncWriterTest : public testing::Test {
+public:
+    AsyncWriterTest() : mLooper(Looper::create()), mIn(-1), mOut(-1) {}
+
+    virtual void SetUp() {
+        ASSERT_EQ(0, socketCreatePair(&mIn, &mOut));
+        socketSetNonBlocking(mIn);
+        socketSetNonBlocking(mOut);
+        mInWatch.reset(mLooper->createFdWatch(mIn, dummyCallback, NULL));
+        mOutWatch.reset(mLooper->createFdWatch(mOut, dummyCallback, NULL));
+    }
+
+    virtual void TearDown() {
+        mInWatch.reset(NULL);
+        mOutWatch.reset(NULL);
+        socketClose(mIn);
+        socketClose(mOut);
+    }
+
+    // Run |writer| and |reader| alternatively until both complete.
+    void transfer(AsyncWriter* writer, AsyncReader* reader) {
+        AsyncStatus writeStatus = kAsyncAgain;
+        AsyncStatus readStatus = kAsyncAgain;
+        while (writeStatus != kAsyncCompleted ||
+               readStatus != kAsyncCompleted) {
+            if (writeStatus != kAsyncCompleted) {
+                writeStatus = writer->run();
+                ASSERT_NE(kAsyncError, writeStatus);
+            }
+            if (readStatus != kAsyncCompleted) {
+                readStatus = reader->run();
+                ASSERT_NE(kAsyncError, readStatus);
+            }
+        }
+    }
+
+protected:
+    ScopedPtr<Looper> mLooper;
+    int mIn;
+    int mOut;
+    ScopedPtr<Looper::FdWatch> mInWatch;
+    ScopedPtr<Looper::FdWatch> mOutWatch;
+};
+
+}  // namespace
+
+TEST_F(AsyncWriterTest, SingleBuffer) {
+    const char kMessage[] = "Hello World";
+    char result[sizeof(kMessage)] = { 0 };
+    AsyncWriter writer;
+    AsyncReader reader;
+    writer.reset(kMessage, sizeof(kMessage), mInWatch.get());
+    reader.reset(result, sizeof(result), mOutWatch.get());
+    transfer(&writer, &reader);
+    EXPECT_STREQ(kMessage, result);
+    EXPECT_EQ(sizeof(kMessage), writer.transferred());
+    EXPECT_EQ(sizeof(kMessage), reader.transferred());
+}
+
+TEST_F(AsyncWriterTest, EmptyBuffers) {
+    AsyncWriter writer;
+    writer.reset(NULL, 0U, mInWatch.get());
+    EXPECT_EQ(kAsyncCompleted, writer.run());
+
+    SocketBuffer buffers[2] = { { NULL, 0U }, { NULL, 0U } };
+    AsyncReader reader;
+    reader.resetV(buffers, 2U, mOutWatch.get());
+    EXPECT_EQ(kAsyncCompleted, reader.run());
+    EXPECT_EQ(0U, reader.transferred());
+}
+
+TEST_F(AsyncWriterTest, MultipleBuffers) {
+    // Use buffer boundaries that differ on both sides, with more buffers
+    // than a single system call can process, and an empty one.
+    const size_t kNumBuffers = kSocketMaxBuffers * 3;
+    const size_t kTotalSize = kNumBuffers * (kNumBuffers + 1) / 2;
+    uint8_t* input = new uint8_t[kTotalSize];
+    uint8_t* output = new uint8_t[kTotalSize];
+    for (size_t n = 0; n < kTotalSize; ++n) {
+        input[n] = static_cast<uint8_t>(n * 31);
+    }
+    memset(output, 0, kTotalSize);
+
+    SocketBuffer writeBuffers[kNumBuffers + 1];
+    SocketBuffer readBuffers[kNumBuffers];
+    size_t writePos = 0, readPos = kTotalSize;
+    for (size_t n = 0; n < kNumBuffers; ++n) {
+        // Write buffers grow, read buffers shrink.
+        writeBuffers[n].data = input + writePos;
+        writeBuffers[n].size = n;
+        writePos += n;
+        readPos -= n + 1;
+        readBuffers[kNumBuffers - 1 - n].data = output + readPos;
+        readBuffers[kNumBuffers - 1 - n].size = n + 1;
+    }
+    writeBuffers[kNumBuffers].data = input + writePos;
+    writeBuffers[kNumBuffers].size = kTotalSize - writePos;
+
+    AsyncWriter writer;
+    AsyncReader reader;
+    writer.resetV(writeBuffers, kNumBuffers + 1, mInWatch.get());
+    reader.resetV(readBuffers, kNumBuffers, mOutWatch.get());
+    transfer(&writer, &reader);
+    EXPECT_EQ(kTotalSize, writer.transferred());
+    EXPECT_EQ(kTotalSize, reader.transferred());
+    EXPECT_EQ(0, memcmp(input, output, kTotalSize));
+
+    delete [] output;
+    delete [] input;
+}
+
+TEST_F(AsyncWriterTest, LargeTransfer) {
+    // Large enough to fill the socket buffers, so that both sides
+    // make partial progress.
+    const size_t kSize = 4 * 1024 * 1024;
+    uint8_t* input = new uint8_t[kSize];
+    uint8_t* output = new uint8_t[kSize];
+    for (size_t n = 0; n < kSize; ++n) {
+        input[n] = static_cast<uint8_t>(n ^ (n >> 8));
+    }
+    SocketBuffer writeBuffers[3] = {
+        { input, 1000 }, { input + 1000, kSize / 2 },
+        { input + 1000 + kSize / 2, kSize / 2 - 1000 },
+    };
+    SocketBuffer readBuffers[2] = {
+        { output, 7 }, { output + 7, kSize - 7 },
+    };
+    AsyncWriter writer;
+    AsyncReader reader;
+    writer.resetV(writeBuffers, 3U, mInWatch.get());
+    reader.resetV(readBuffers, 2U, mOutWatch.get());
+    transfer(&writer, &reader);
+    EXPECT_EQ(0, memcmp(input, output, kSize));
+
+    delete [] output;
+    delete [] input;
+}
+
+}  // namespace base
+}  // namespace android
@@ -11,6 +11,8 @@
 
 #include "android/base/async/Looper.h"
 
+#include "android/base/async/LooperTaskQueue.h"
+#include "android/base/containers/PodVector.h"
 #include "android/base/containers/ScopedPointerSet.h"
 #include "android/base/containers/TailQueueList.h"
 #include "android/base/Log.h"
@@ -33,14 +35,27 @@ public:
     GenLooper() :
             Looper(),
             mWaiter(SocketWaiter::create()),
+            mTasks(),
             mFdWatches(),
             mPendingFdWatches(),
             mTimers(),
             mActiveTimers(),
             mPendingTimers(),
-            mForcedExit(false) {}
+            mTimerSequence(0),
+            mForcedExit(false) {
+        if (mTasks.wakeFd() >= 0) {
+            mWaiter->update(mTasks.wakeFd(), SocketWaiter::kEventRead);
+        }
+    }
 
-    virtual ~GenLooper() {}
+    virtual ~GenLooper() {
+        // mTimers deletes the remaining timers after mActiveTimers is
+        // destroyed, so detach them from the heap first.
+        for (size_t n = 0; n < mActiveTimers.size(); ++n) {
+            mActiveTimers[n]->mHeapIndex = Timer::kNotInHeap;
+        }
+        mActiveTimers.resize(0);
+    }
 
     virtual Duration nowMs() {
         struct timeval time_now;
@@ -54,6 +69,10 @@ public:
         mForcedExit = true;
     }
 
+    virtual void postTask(TaskCallback callback, void* opaque) {
+        mTasks.post(callback, opaque);
+    }
+
     //
     //  F D   W A T C H E S
     //
@@ -181,6 +200,8 @@ public:
         Timer(GenLooper* looper, Callback callback, void* opaque) :
                 Looper::Timer(looper, callback, opaque),
                 mDeadline(kDurationInfinite),
+                mSequence(0),
+                mHeapIndex(kNotInHeap),
                 mPending(false),
                 mPendingLink() {
             DCHECK(mCallback);
@@ -192,14 +213,21 @@ public:
         }
 
         virtual ~Timer() {
-            clearPending();
+            stop();
             genLooper()->delTimer(this);
         }
 
-        Timer* next() const { return mPendingLink.next(); }
-
         Duration deadline() const { return mDeadline; }
 
+        // Return true iff this timer expires before |other|. Timers with
+        // the same deadline expire in the order they were started.
+        bool expiresBefore(const Timer* other) const {
+            if (mDeadline != other->mDeadline) {
+                return mDeadline < other->mDeadline;
+            }
+            return mSequence < other->mSequence;
+        }
+
         virtual void startRelative(Duration deadlineMs) {
             if (deadlineMs != kDurationInfinite) {
                 deadlineMs += mLooper->nowMs();
@@ -208,7 +236,10 @@ public:
         }
 
         virtual void startAbsolute(Duration deadlineMs) {
-            if (mDeadline != kDurationInfinite) {
+            if (mPending) {
+                // Expired but not fired yet, don't fire it.
+                clearPending();
+            } else if (mDeadline != kDurationInfinite) {
                 genLooper()->disableTimer(this);
             }
             mDeadline = deadlineMs;
@@ -246,8 +277,14 @@ public:
 
         TAIL_QUEUE_LIST_TRAITS(Traits, Timer, mPendingLink);
 
+        static const size_t kNotInHeap = ~(size_t)0;
+
     private:
+        friend class GenLooper;
+
         Duration mDeadline;
+        uint64_t mSequence;    // Order of enableTimer() calls.
+        size_t mHeapIndex;     // Position in mActiveTimers, or kNotInHeap.
         bool mPending;
         TailQueueLink<Timer> mPendingLink;
     };
@@ -260,22 +297,89 @@ public:
         mTimers.pick(timer);
     }
 
+    // Active timers are kept in a binary min-heap ordered by expiration,
+    // so that arming and disarming a timer is O(log n), and finding the
+    // next one to expire is O(1).
+
     void enableTimer(Timer* timer) {
-        // Find the first timer that expires after this one.
-        Timer* item = mActiveTimers.front();
-        while (item && item->deadline() < timer->deadline()) {
-            item = item->next();
+        DCHECK(timer->mHeapIndex == Timer::kNotInHeap);
+        timer->mSequence = mTimerSequence++;
+        size_t index = mActiveTimers.size();
+        mActiveTimers.append(timer);
+        timer->mHeapIndex = index;
+        siftUpTimer(index);
+    }
+
+    void disableTimer(Timer* timer) {
+        size_t index = timer->mHeapIndex;
+        if (index == Timer::kNotInHeap) {
+            // Already expired, and pending or fired.
+            return;
         }
-        if (item) {
-            mActiveTimers.insertBefore(item, timer);
+        DCHECK(mActiveTimers[index] == timer);
+        timer->mHeapIndex = Timer::kNotInHeap;
+
+        size_t last = mActiveTimers.size() - 1U;
+        if (index != last) {
+            // Move the last timer to the free slot, then restore the heap
+            // property in whichever direction it was broken.
+            Timer* moved = mActiveTimers[last];
+            mActiveTimers[index] = moved;
+            moved->mHeapIndex = index;
+            mActiveTimers.resize(last);
+            if (index > 0 &&
+                moved->expiresBefore(mActiveTimers[(index - 1U) / 2U])) {
+                siftUpTimer(index);
+            } else {
+                siftDownTimer(index);
+            }
         } else {
-            mActiveTimers.insertTail(timer);
+            mActiveTimers.resize(last);
         }
     }
 
-    void disableTimer(Timer* timer) {
-        // Simply remove from the list.
-        mActiveTimers.remove(timer);
+    // Return the active timer that expires first, or NULL.
+    Timer* firstActiveTimer() const {
+        return mActiveTimers.empty() ? NULL : mActiveTimers[0];
+    }
+
+    void setTimerAt(size_t index, Timer* timer) {
+        mActiveTimers[index] = timer;
+        timer->mHeapIndex = index;
+    }
+
+    void siftUpTimer(size_t index) {
+        Timer* timer = mActiveTimers[index];
+        while (index > 0) {
+            size_t parent = (index - 1U) / 2U;
+            if (!timer->expiresBefore(mActiveTimers[parent])) {
+                break;
+            }
+            setTimerAt(index, mActiveTimers[parent]);
+            index = parent;
+        }
+        setTimerAt(index, timer);
+    }
+
+    void siftDownTimer(size_t index) {
+        Timer* timer = mActiveTimers[index];
+        size_t count = mActiveTimers.size();
+        for (;;) {
+            size_t child = 2U * index + 1U;
+            if (child >= count) {
+                break;
+            }
+            if (child + 1U < count &&
+                mActiveTimers[child + 1U]->expiresBefore(mActiveTimers[child])) {
+                child++;
+            }
+            if (!mActiveTimers[child]->expiresBefore(timer)) {
+                break;
+            }
+            setTimerAt(index, mActiveTimers[child]);
+            index = child;
+        }
+        setTimerAt(index, timer);
     }
 
     void addPendingTimer(Timer* timer) {
@@ -300,15 +404,16 @@ public:
 
         while (!mForcedExit) {
             // Return immediately with EWOULDBLOCK if there are no
-            // more timers or watches registered.
-            if (mFdWatches.empty() && mActiveTimers.empty()) {
+            // more timers, watches or tasks registered.
+            if (mFdWatches.empty() && mActiveTimers.empty() &&
+                !mTasks.hasPendingTasks()) {
                 return EWOULDBLOCK;
             }
 
             // Compute next deadline from timers.
             Duration nextDeadline = kDurationInfinite;
 
-            Timer* firstTimer = mActiveTimers.front();
+            Timer* firstTimer = firstActiveTimer();
             if (firstTimer) {
                 nextDeadline = firstTimer->deadline();
             }
@@ -331,6 +436,7 @@ public:
             }
             DCHECK(mPendingFdWatches.empty());
 
+            bool wokenUp = false;
             if (ret > 0) {
                 // Queue pending FdWatch instances.
                 for (;;) {
@@ -339,6 +445,10 @@ public:
                     if (fd < 0) {
                         break;
                     }
+                    if (fd == mTasks.wakeFd()) {
+                        wokenUp = true;
+                        continue;
+                    }
 
                     // Find the FdWatch for this file descriptor.
                     // TODO(digit): Improve efficiency with a map?
@@ -357,16 +467,15 @@ public:
             DCHECK(mPendingTimers.empty());
 
             const Duration kNow = nowMs();
-            Timer* timer = mActiveTimers.front();
-            while (timer) {
-                if (timer->deadline() > kNow) {
+            for (;;) {
+                Timer* timer = firstActiveTimer();
+                if (!timer || timer->deadline() > kNow) {
                     break;
                 }
 
-                // Remove from active list, add to pending list.
-                mActiveTimers.remove(timer);
+                // Remove from active heap, add to pending list.
+                disableTimer(timer);
                 timer->setPending();
-                timer = timer->next();
             }
 
             // Fire the pending timers, this is done in a separate step
@@ -391,6 +500,12 @@ public:
                 watch->fire();
             }
 
+            // Run the tasks posted from other threads, or from the
+            // callbacks above.
+            if (wokenUp || mTasks.hasPendingTasks()) {
+                mTasks.runPending();
+            }
+
             if (ret == 0) {
                 return ETIMEDOUT;
             }
@@ -400,6 +515,7 @@ public:
     }
 
     typedef TailQueueList<Timer> TimerList;
+    typedef PodVector<Timer*, 8> TimerHeap;
     typedef ScopedPointerSet<Timer> TimerSet;
 
     typedef TailQueueList<FdWatch> FdWatchList;
@@ -407,12 +523,14 @@ public:
 
 private:
     ScopedPtr<SocketWaiter> mWaiter;
+    LooperTaskQueue mTasks;        // Tasks posted from any thread.
     FdWatchSet mFdWatches;         // Set of all fd watches.
     FdWatchList mPendingFdWatches;  // Queue of pending fd watches.
 
     TimerSet  mTimers;        // Set of all timers.
-    TimerList mActiveTimers;  // Sorted list of active timers.
+    TimerHeap mActiveTimers;  // Heap of active timers.
     TimerList mPendingTimers; // Sorted list of pending timers.
+    uint64_t mTimerSequence;  // Next Timer::mSequence value.
 
     bool mForcedExit;
 };
@@ -78,6 +78,15 @@ public:
     // return 0.
     virtual void forceQuit() = 0;
 
+    // Type of callback function used with postTask().
+    typedef void (*TaskCallback)(void* opaque);
+
+    // Queue a task to call |callback(opaque)| from the event loop, as soon
+    // as possible. Unlike all other methods, this one can be called from
+    // any thread. Tasks run in the order they were posted. Tasks that did
+    // not run yet when the looper is destroyed are dropped.
+    virtual void postTask(TaskCallback callback, void* opaque) = 0;
+
     // Interface class for timers implemented by a Looper instance.
     // Use createTimer() to create these.
     class Timer {
@@ -0,0 +1,102 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/base/async/LooperTaskQueue.h"
+
+#include "android/base/Log.h"
+#include "android/base/sockets/SocketUtils.h"
+
+#include <stddef.h>
+
+#ifdef _WIN32
+#undef ERROR
+#endif
+
+namespace android {
+namespace base {
+
+LooperTaskQueue::LooperTaskQueue() :
+        mInSocket(-1), mOutSocket(-1), mTasks(NULL), mWakePending(0) {
+    if (socketCreatePair(&mInSocket, &mOutSocket) < 0) {
+        PLOG(ERROR) << "Could not create task queue socket pair";
+        mInSocket = -1;
+        mOutSocket = -1;
+        return;
+    }
+    socketSetNonBlocking(mInSocket);
+    socketSetNonBlocking(mOutSocket);
+}
+
+LooperTaskQueue::~LooperTaskQueue() {
+    Task* task = __atomic_exchange_n(&mTasks, (Task*)NULL, __ATOMIC_ACQUIRE);
+    while (task) {
+        Task* next = task->next;
+        delete task;
+        task = next;
+    }
+    if (mInSocket >= 0) {
+        socketClose(mOutSocket);
+        socketClose(mInSocket);
+    }
+}
+
+bool LooperTaskQueue::hasPendingTasks() const {
+    return __atomic_load_n(&mTasks, __ATOMIC_ACQUIRE) != NULL;
+}
+
+void LooperTaskQueue::post(Looper::TaskCallback callback, void* opaque) {
+    Task* task = new Task();
+    task->callback = callback;
+    task->opaque = opaque;
+    task->next = __atomic_load_n(&mTasks, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&mTasks, &task->next, task, true,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        // |task->next| was updated by the failed exchange.
+    }
+
+    // Only wake up the looper if nobody did since it last drained the
+    // queue. runPending() clears |mWakePending| before taking the tasks,
+    // so a task pushed before seeing the flag set is always picked up.
+    if (!__atomic_exchange_n(&mWakePending, 1, __ATOMIC_SEQ_CST) &&
+        mInSocket >= 0) {
+        char c = 1;
+        socketSend(mInSocket, &c, 1);
+    }
+}
+
+void LooperTaskQueue::runPending() {
+    if (mOutSocket >= 0) {
+        char buf[16];
+        while (socketRecv(mOutSocket, buf, sizeof(buf)) > 0) {}
+    }
+    __atomic_store_n(&mWakePending, 0, __ATOMIC_SEQ_CST);
+
+    Task* task = __atomic_exchange_n(&mTasks, (Task*)NULL, __ATOMIC_SEQ_CST);
+
+    // Reverse the stack to run the tasks in posting order.
+    Task* first = NULL;
+    while (task) {
+        Task* next = task->next;
+        task->next = first;
+        first = task;
+        task = next;
+    }
+
+    while (first) {
+        Task* next = first->next;
+        first->callback(first->opaque);
+        delete first;
+        first = next;
+    }
+}
+
+}  // namespace base
+}  // namespace android
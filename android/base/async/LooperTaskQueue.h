@@ -0,0 +1,73 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#ifndef ANDROID_BASE_ASYNC_LOOPER_TASK_QUEUE_H
+#define ANDROID_BASE_ASYNC_LOOPER_TASK_QUEUE_H
+
+#include "android/base/async/Looper.h"
+#include "android/base/Compiler.h"
+
+namespace android {
+namespace base {
+
+// Helper class used by Looper implementations to support postTask().
+//
+// Any thread can call post() to queue a task, without taking a lock. The
+// looper thread must watch wakeFd() for read events, and call runPending()
+// when it becomes readable.
+//
+// Wake-ups are coalesced: only the first task posted after the looper
+// started draining the queue writes a byte to the socket pair, so a burst
+// of tasks costs a single wake-up.
+class LooperTaskQueue {
+public:
+    LooperTaskQueue();
+
+    // Destructor. Tasks that did not run yet are dropped.
+    ~LooperTaskQueue();
+
+    // Return the file descriptor to watch for read events, or -1 if the
+    // socket pair could not be created.
+    int wakeFd() const { return mOutSocket; }
+
+    // Return true if tasks were posted and did not run yet.
+    bool hasPendingTasks() const;
+
+    // Queue a task to call |callback(opaque)| on the looper thread.
+    // Can be called from any thread.
+    void post(Looper::TaskCallback callback, void* opaque);
+
+    // Run all queued tasks, in the order they were posted. Must be called
+    // from the looper thread. Tasks posted by the callbacks run on the
+    // next call.
+    void runPending();
+
+private:
+    struct Task {
+        Task* next;
+        Looper::TaskCallback callback;
+        void* opaque;
+    };
+
+    int mInSocket;
+    int mOutSocket;
+    // Stack of posted tasks, most recent first.
+    Task* mTasks;
+    // Non-zero if a byte was sent to the socket and not received yet.
+    int mWakePending;
+
+    DISALLOW_COPY_AND_ASSIGN(LooperTaskQueue);
+};
+
+}  // namespace base
+}  // namespace android
+
+#endif  // ANDROID_BASE_ASYNC_LOOPER_TASK_QUEUE_H
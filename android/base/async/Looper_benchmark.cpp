@@ -0,0 +1,94 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Micro-benchmarks of the generic Looper: each operation arms a timer,
+// posts a task, or makes a socket readable, then runs the looper until
+// the callback is called.
+
+#include "android/base/async/Looper.h"
+
+#include "android/base/sockets/SocketUtils.h"
+#include "android/base/testing/Benchmark.h"
+
+using android::base::Looper;
+
+namespace {
+
+void quitCallback(void* opaque) {
+    static_cast<Looper*>(opaque)->forceQuit();
+}
+
+void readCallback(void* opaque, int fd, unsigned events) {
+    char c;
+    android::base::socketRecv(fd, &c, 1);
+    static_cast<Looper*>(opaque)->forceQuit();
+}
+
+class LooperBenchmark : public android::base::Benchmark {
+public:
+    virtual void setUp(int64_t arg) {
+        mLooper = Looper::create();
+        mTimer = mLooper->createTimer(quitCallback, mLooper);
+        mFds[0] = mFds[1] = -1;
+        android::base::socketCreatePair(&mFds[0], &mFds[1]);
+        mWatch = mLooper->createFdWatch(mFds[0], readCallback, mLooper);
+    }
+
+    virtual void tearDown() {
+        delete mWatch;
+        android::base::socketClose(mFds[1]);
+        android::base::socketClose(mFds[0]);
+        delete mTimer;
+        delete mLooper;
+    }
+
+protected:
+    Looper* mLooper;
+    Looper::Timer* mTimer;
+    Looper::FdWatch* mWatch;
+    int mFds[2];
+};
+
+}  // namespace
+
+BENCHMARK_F(LooperBenchmark, TimerStartStop) {
+    for (size_t n = 0; n < state->iterations(); ++n) {
+        mTimer->startRelative(1000);
+        mTimer->stop();
+    }
+}
+
+BENCHMARK_F(LooperBenchmark, TimerFire) {
+    for (size_t n = 0; n < state->iterations(); ++n) {
+        mTimer->startRelative(0);
+        mLooper->runWithTimeoutMs(1000);
+    }
+}
+
+BENCHMARK_F(LooperBenchmark, PostTask) {
+    for (size_t n = 0; n < state->iterations(); ++n) {
+        mLooper->postTask(quitCallback, mLooper);
+        mLooper->runWithTimeoutMs(1000);
+    }
+}
+
+BENCHMARK_F(LooperBenchmark, FdWatchRead) {
+    mWatch->wantRead();
+    for (size_t n = 0; n < state->iterations(); ++n) {
+        char c = 0;
+        android::base::socketSend(mFds[1], &c, 1);
+        mLooper->runWithTimeoutMs(1000);
+    }
+    mWatch->dontWantRead();
+}
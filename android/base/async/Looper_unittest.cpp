@@ -0,0 +1,117 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/base/async/Looper.h"
+
+#include "android/base/memory/ScopedPtr.h"
+#include "android/base/testing/TestThread.h"
+
+#include <gtest/gtest.h>
+
+#include <errno.h>
+
+namespace android {
+namespace base {
+
+namespace {
+
+const size_t kNumTasks = 1000;
+
+struct TaskState {
+    Looper* looper;
+    size_t count;
+    bool inOrder;
+};
+
+struct TaskInfo {
+    TaskState* state;
+    size_t index;
+};
+
+void taskFunction(void* opaque) {
+    TaskInfo* info = static_cast<TaskInfo*>(opaque);
+    TaskState* state = info->state;
+    if (info->index != state->count) {
+        state->inOrder = false;
+    }
+    state->count++;
+    if (state->count == kNumTasks) {
+        state->looper->forceQuit();
+    }
+}
+
+void* postTasksFunction(void* param) {
+    TaskInfo* infos = static_cast<TaskInfo*>(param);
+    for (size_t n = 0; n < kNumTasks; ++n) {
+        infos[0].state->looper->postTask(taskFunction, &infos[n]);
+    }
+    return NULL;
+}
+
+void timerFunction(void* opaque) {
+    static_cast<Looper*>(opaque)->forceQuit();
+}
+
+}  // namespace
+
+TEST(Looper, PostTaskFromLooperThread) {
+    ScopedPtr<Looper> looper(Looper::create());
+    TaskState state = { looper.get(), 0U, true };
+    TaskInfo infos[3];
+    for (size_t n = 0; n < 3U; ++n) {
+        infos[n].state = &state;
+        infos[n].index = n;
+        looper->postTask(taskFunction, &infos[n]);
+    }
+    EXPECT_EQ(0U, state.count);
+
+    // Pending tasks keep the looper running, then it has nothing to do.
+    EXPECT_EQ(EWOULDBLOCK, looper->runWithTimeoutMs(1000));
+    EXPECT_EQ(3U, state.count);
+    EXPECT_TRUE(state.inOrder);
+}
+
+TEST(Looper, PostTaskFromOtherThread) {
+    ScopedPtr<Looper> looper(Looper::create());
+    TaskState state = { looper.get(), 0U, true };
+    TaskInfo* infos = new TaskInfo[kNumTasks];
+    for (size_t n = 0; n < kNumTasks; ++n) {
+        infos[n].state = &state;
+        infos[n].index = n;
+    }
+
+    // Safety timer, in case a task is lost.
+    ScopedPtr<Looper::Timer> timer(
+            looper->createTimer(timerFunction, looper.get()));
+    timer->startRelative(10000);
+
+    TestThread* thread = new TestThread(postTasksFunction, infos);
+    EXPECT_EQ(0, looper->runWithTimeoutMs(20000));
+    thread->join();
+    delete thread;
+
+    EXPECT_EQ(kNumTasks, state.count);
+    EXPECT_TRUE(state.inOrder);
+    delete [] infos;
+}
+
+TEST(Looper, DropsPendingTasksOnDestruction) {
+    TaskState state = { NULL, 0U, true };
+    TaskInfo info = { &state, 0U };
+    Looper* looper = Looper::create();
+    state.looper = looper;
+    looper->postTask(taskFunction, &info);
+    delete looper;
+    EXPECT_EQ(0U, state.count);
+}
+
+}  // namespace base
+}  // namespace android
@@ -0,0 +1,287 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#ifndef ANDROID_BASE_CONTAINERS_HASH_MAP_H
+#define ANDROID_BASE_CONTAINERS_HASH_MAP_H
+
+#include "android/base/Compiler.h"
+#include "android/base/containers/HashUtils.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace android {
+namespace base {
+
+// Default traits for HashMap<K, V>. They work for integer and pointer
+// keys. Provide your own class with the same static methods for other
+// key types.
+template <typename K>
+struct HashMapTraits {
+    static size_t hash(const K& key) { return static_cast<size_t>(key); }
+    static bool equals(const K& a, const K& b) { return a == b; }
+};
+
+template <typename T>
+struct HashMapTraits<T*> {
+    static size_t hash(T* const& key) {
+        return ::android::base::internal::pointerHash(key);
+    }
+    static bool equals(T* const& a, T* const& b) { return a == b; }
+};
+
+// A HashMap<K, V> maps keys of type K to values of type V. Both must be
+// default-constructible and copyable, and are copied with operator=().
+//
+// This is an open-addressing hash table using Robin Hood probing: each
+// slot records how far it is from its preferred position, and insertion
+// displaces entries that are closer to theirs. This keeps probe sequences
+// short, lets lookups of missing keys stop early, and allows removal
+// without tombstones by shifting the following entries back. All entries
+// live in a single array, so lookups touch very few cache lines.
+//
+// Usage example:
+//
+//     HashMap<int, Foo*> map;
+//     map.set(42, foo);
+//     Foo** value = map.find(42);  // NULL if the key is not in the map.
+//     map.remove(42);
+//
+// Iterating over a map:
+//
+//     HashMap<int, Foo*>::Iterator iter(&map);
+//     while (iter.hasNext()) {
+//         iter.next();
+//         ... use iter.key() and iter.value()
+//     }
+//
+// Note that the iterator, and pointers returned by find(), become
+// invalid when entries are added or removed.
+template <typename K, typename V, typename TRAITS = HashMapTraits<K> >
+class HashMap {
+    struct Slot;
+
+public:
+    // Default constructor creates an empty map.
+    HashMap() :
+            mShift(internal::kMinShift),
+            mCount(0U),
+            mSlots(new Slot[1U << internal::kMinShift]) {}
+
+    // Destructor.
+    ~HashMap() { delete [] mSlots; }
+
+    // Return true iff the map is empty.
+    bool empty() const { return mCount == 0U; }
+
+    // Return the number of entries in the map.
+    size_t size() const { return mCount; }
+
+    // Remove all entries from the map.
+    void clear() {
+        delete [] mSlots;
+        mShift = internal::kMinShift;
+        mCount = 0U;
+        mSlots = new Slot[1U << mShift];
+    }
+
+    // Return true iff the map has an entry for |key|.
+    bool contains(const K& key) const {
+        size_t pos;
+        return findSlot(key, &pos);
+    }
+
+    // Return a pointer to the value associated with |key|, or NULL if
+    // there is none.
+    V* find(const K& key) {
+        size_t pos;
+        return findSlot(key, &pos) ? &mSlots[pos].value : NULL;
+    }
+
+    const V* find(const K& key) const {
+        size_t pos;
+        return findSlot(key, &pos) ? &mSlots[pos].value : NULL;
+    }
+
+    // Associate |value| with |key|. Return true if a new entry was
+    // added, or false if the value of an existing one was replaced.
+    bool set(const K& key, const V& value) {
+        size_t pos;
+        if (findSlot(key, &pos)) {
+            mSlots[pos].value = value;
+            return false;
+        }
+        maybeResize(mCount + 1U);
+        insertSlot(key, value);
+        mCount++;
+        return true;
+    }
+
+    // Remove the entry for |key|. Return true if there was one, and
+    // copy its value to |*oldValue| if |oldValue| is not NULL. Return
+    // false otherwise.
+    bool remove(const K& key, V* oldValue = NULL) {
+        size_t pos;
+        if (!findSlot(key, &pos)) {
+            return false;
+        }
+        if (oldValue) {
+            *oldValue = mSlots[pos].value;
+        }
+        // Shift back the following entries until one is empty or at its
+        // preferred position.
+        const size_t kMask = (1U << mShift) - 1U;
+        for (;;) {
+            size_t next = (pos + 1U) & kMask;
+            if (mSlots[next].distance <= 1U) {
+                break;
+            }
+            mSlots[pos].key = mSlots[next].key;
+            mSlots[pos].value = mSlots[next].value;
+            mSlots[pos].distance = mSlots[next].distance - 1U;
+            pos = next;
+        }
+        mSlots[pos] = Slot();
+        mCount--;
+        return true;
+    }
+
+    // Iterator class for this map. See usage example above.
+    class Iterator {
+    public:
+        explicit Iterator(HashMap* map) :
+                mSlots(map->mSlots),
+                mCapacity(1U << map->mShift),
+                mPos(0U),
+                mCurrent(NULL) {
+            skipEmptySlots();
+        }
+
+        // Return true iff there is another entry to visit.
+        bool hasNext() const { return mPos < mCapacity; }
+
+        // Move to the next entry. Only call this if hasNext() is true.
+        void next() {
+            mCurrent = &mSlots[mPos++];
+            skipEmptySlots();
+        }
+
+        // Return the key and value of the current entry. Only call these
+        // after next().
+        const K& key() const { return mCurrent->key; }
+        V& value() const { return mCurrent->value; }
+
+    private:
+        void skipEmptySlots() {
+            while (mPos < mCapacity && !mSlots[mPos].distance) {
+                mPos++;
+            }
+        }
+
+        Slot* mSlots;
+        size_t mCapacity;
+        size_t mPos;
+        Slot* mCurrent;
+
+        DISALLOW_COPY_AND_ASSIGN(Iterator);
+    };
+
+private:
+    struct Slot {
+        Slot() : distance(0U), key(), value() {}
+
+        // 0 for empty slots, otherwise 1 + the distance to the preferred
+        // position of the entry.
+        size_t distance;
+        K key;
+        V value;
+    };
+
+    size_t homeIndex(const K& key) const {
+        return internal::hashIndex(TRAITS::hash(key), mShift);
+    }
+
+    // Look for |key|. On success, set |*pos| to its slot index and
+    // return true.
+    bool findSlot(const K& key, size_t* pos) const {
+        const size_t kMask = (1U << mShift) - 1U;
+        size_t index = homeIndex(key);
+        for (size_t distance = 1U; ; ++distance) {
+            const Slot& slot = mSlots[index];
+            // An entry closer to its preferred position than |key| would
+            // be means that |key| is not in the map. This also handles
+            // empty slots.
+            if (slot.distance < distance) {
+                return false;
+            }
+            if (slot.distance == distance && TRAITS::equals(slot.key, key)) {
+                *pos = index;
+                return true;
+            }
+            index = (index + 1U) & kMask;
+        }
+    }
+
+    // Insert an entry for |key|, which must not be in the map.
+    void insertSlot(const K& key, const V& value) {
+        const size_t kMask = (1U << mShift) - 1U;
+        Slot entry;
+        entry.distance = 1U;
+        entry.key = key;
+        entry.value = value;
+        size_t index = homeIndex(key);
+        for (;;) {
+            Slot& slot = mSlots[index];
+            if (!slot.distance) {
+                slot = entry;
+                return;
+            }
+            if (slot.distance < entry.distance) {
+                // Robin Hood: take the place of the entry that is closer
+                // to its preferred position, and re-insert it instead.
+                Slot tmp = slot;
+                slot = entry;
+                entry = tmp;
+            }
+            index = (index + 1U) & kMask;
+            entry.distance++;
+        }
+    }
+
+    // Resize the slot array, if needed, to hold |count| entries.
+    void maybeResize(size_t count) {
+        size_t newShift = internal::hashShiftAdjust(count, mShift);
+        if (newShift == mShift) {
+            return;
+        }
+        Slot* oldSlots = mSlots;
+        size_t oldCapacity = 1U << mShift;
+        mShift = newShift;
+        mSlots = new Slot[1U << newShift];
+        for (size_t n = 0; n < oldCapacity; ++n) {
+            if (oldSlots[n].distance) {
+                insertSlot(oldSlots[n].key, oldSlots[n].value);
+            }
+        }
+        delete [] oldSlots;
+    }
+
+    size_t mShift;
+    size_t mCount;
+    Slot* mSlots;
+
+    DISALLOW_COPY_AND_ASSIGN(HashMap);
+};
+
+}  // namespace base
+}  // namespace android
+
+#endif  // ANDROID_BASE_CONTAINERS_HASH_MAP_H
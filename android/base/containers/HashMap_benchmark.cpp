@@ -0,0 +1,153 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// A small micro-benchmark comparing HashMap<int, void*> with std::map<>,
+// and with the parallel key/value arrays scanned linearly that the
+// AIntMap implementation used before. For several map sizes, it reports
+// the average time of a lookup, half of them for missing keys.
+//
+// Usage: emulator_hashmap_benchmark [<lookups>]
+
+#include "android/base/containers/HashMap.h"
+
+#include <map>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+using android::base::HashMap;
+
+namespace {
+
+double nowUs() {
+#ifdef _WIN32
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (double)now.QuadPart * 1e6 / (double)freq.QuadPart;
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1e6 + tv.tv_usec;
+#endif
+}
+
+// Keys are spread out, as file descriptors or channel ids would be.
+int keyAt(size_t n) {
+    return static_cast<int>(n * 7U + 3U);
+}
+
+void* valueAt(size_t n) {
+    return reinterpret_cast<void*>(static_cast<uintptr_t>(n + 1U));
+}
+
+// Same layout and lookup as the old AIntMap.
+class LinearMap {
+public:
+    explicit LinearMap(size_t capacity) :
+            mKeys(new int[capacity]), mValues(new void*[capacity]), mSize(0) {}
+
+    ~LinearMap() {
+        delete [] mValues;
+        delete [] mKeys;
+    }
+
+    void set(int key, void* value) {
+        mKeys[mSize] = key;
+        mValues[mSize] = value;
+        mSize++;
+    }
+
+    void* get(int key) const {
+        for (size_t n = 0; n < mSize; ++n) {
+            if (mKeys[n] == key) {
+                return mValues[n];
+            }
+        }
+        return NULL;
+    }
+
+private:
+    int* mKeys;
+    void** mValues;
+    size_t mSize;
+};
+
+// Returns a value that depends on the lookups, so they are not optimized
+// away.
+uintptr_t sSink = 0;
+
+void report(const char* name, size_t size, size_t lookups, double elapsed) {
+    printf("%-10s %6zu items: %8.2f ns/lookup\n", name, size,
+           elapsed * 1000. / lookups);
+}
+
+void runBenchmark(size_t size, size_t lookups) {
+    HashMap<int, void*> hashMap;
+    std::map<int, void*> stdMap;
+    LinearMap linearMap(size);
+    for (size_t n = 0; n < size; ++n) {
+        hashMap.set(keyAt(n), valueAt(n));
+        stdMap[keyAt(n)] = valueAt(n);
+        linearMap.set(keyAt(n), valueAt(n));
+    }
+
+    // Look up keyAt(0) ... keyAt(2 * size - 1) in turn.
+    const size_t kRange = 2U * size;
+
+    double start = nowUs();
+    for (size_t n = 0; n < lookups; ++n) {
+        void* const* value = hashMap.find(keyAt(n % kRange));
+        sSink += value ? reinterpret_cast<uintptr_t>(*value) : 0U;
+    }
+    report("HashMap", size, lookups, nowUs() - start);
+
+    start = nowUs();
+    for (size_t n = 0; n < lookups; ++n) {
+        std::map<int, void*>::const_iterator it =
+                stdMap.find(keyAt(n % kRange));
+        sSink += (it != stdMap.end())
+                ? reinterpret_cast<uintptr_t>(it->second) : 0U;
+    }
+    report("std::map", size, lookups, nowUs() - start);
+
+    start = nowUs();
+    for (size_t n = 0; n < lookups; ++n) {
+        sSink += reinterpret_cast<uintptr_t>(linearMap.get(keyAt(n % kRange)));
+    }
+    report("linear", size, lookups, nowUs() - start);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    size_t lookups = 10000000;
+    if (argc > 1) {
+        lookups = strtoul(argv[1], NULL, 10);
+    }
+    if (lookups == 0) {
+        fprintf(stderr, "Usage: %s [<lookups>]\n", argv[0]);
+        return 1;
+    }
+
+    static const size_t kSizes[] = { 4, 16, 64, 256, 4096 };
+    for (size_t n = 0; n < sizeof(kSizes) / sizeof(kSizes[0]); ++n) {
+        runBenchmark(kSizes[n], lookups);
+    }
+    return (sSink == 42U) ? 1 : 0;
+}
@@ -0,0 +1,154 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/base/containers/HashMap.h"
+
+#include "android/base/String.h"
+
+#include <gtest/gtest.h>
+
+namespace android {
+namespace base {
+
+namespace {
+
+// Traits that make all keys collide, to exercise the probing code.
+struct CollidingTraits {
+    static size_t hash(const int&) { return 7U; }
+    static bool equals(const int& a, const int& b) { return a == b; }
+};
+
+int hashIndex(int n) {
+    return n * 7919 - 100000;
+}
+
+}  // namespace
+
+TEST(HashMap, init) {
+    HashMap<int, int> map;
+    EXPECT_TRUE(map.empty());
+    EXPECT_EQ(0U, map.size());
+    EXPECT_FALSE(map.contains(0));
+    EXPECT_FALSE(map.find(0));
+}
+
+TEST(HashMap, set) {
+    HashMap<int, String> map;
+    EXPECT_TRUE(map.set(1, String("one")));
+    EXPECT_TRUE(map.set(2, String("two")));
+    EXPECT_EQ(2U, map.size());
+    EXPECT_STREQ("one", map.find(1)->c_str());
+    EXPECT_STREQ("two", map.find(2)->c_str());
+
+    // Replacing a value does not add an entry.
+    EXPECT_FALSE(map.set(1, String("uno")));
+    EXPECT_EQ(2U, map.size());
+    EXPECT_STREQ("uno", map.find(1)->c_str());
+}
+
+TEST(HashMap, remove) {
+    HashMap<int, int> map;
+    map.set(1, 10);
+    map.set(2, 20);
+
+    int value = 0;
+    EXPECT_TRUE(map.remove(1, &value));
+    EXPECT_EQ(10, value);
+    EXPECT_FALSE(map.contains(1));
+    EXPECT_FALSE(map.remove(1));
+    EXPECT_TRUE(map.remove(2));
+    EXPECT_TRUE(map.empty());
+}
+
+TEST(HashMap, ManyItems) {
+    HashMap<int, int> map;
+    const int kCount = 10000;
+    for (int n = 0; n < kCount; ++n) {
+        EXPECT_TRUE(map.set(hashIndex(n), n));
+    }
+    EXPECT_EQ(static_cast<size_t>(kCount), map.size());
+    for (int n = 0; n < kCount; ++n) {
+        const int* value = map.find(hashIndex(n));
+        ASSERT_TRUE(value) << "At index " << n;
+        EXPECT_EQ(n, *value);
+    }
+    EXPECT_FALSE(map.contains(hashIndex(kCount)));
+
+    // Remove every other key, the others must still be found.
+    for (int n = 0; n < kCount; n += 2) {
+        EXPECT_TRUE(map.remove(hashIndex(n))) << "At index " << n;
+    }
+    EXPECT_EQ(static_cast<size_t>(kCount / 2), map.size());
+    for (int n = 0; n < kCount; ++n) {
+        EXPECT_EQ((n & 1) != 0, map.contains(hashIndex(n)))
+                << "At index " << n;
+    }
+
+    map.clear();
+    EXPECT_TRUE(map.empty());
+    EXPECT_FALSE(map.contains(hashIndex(1)));
+}
+
+TEST(HashMap, Collisions) {
+    HashMap<int, int, CollidingTraits> map;
+    const int kCount = 50;
+    for (int n = 0; n < kCount; ++n) {
+        map.set(n, -n);
+    }
+    for (int n = 0; n < kCount; n += 3) {
+        EXPECT_TRUE(map.remove(n));
+    }
+    for (int n = 0; n < kCount; ++n) {
+        const int* value = map.find(n);
+        if (n % 3 == 0) {
+            EXPECT_FALSE(value) << "At index " << n;
+        } else {
+            ASSERT_TRUE(value) << "At index " << n;
+            EXPECT_EQ(-n, *value);
+        }
+    }
+}
+
+TEST(HashMap, PointerKeys) {
+    int items[4];
+    HashMap<int*, size_t> map;
+    for (size_t n = 0; n < 4U; ++n) {
+        map.set(&items[n], n);
+    }
+    for (size_t n = 0; n < 4U; ++n) {
+        EXPECT_EQ(n, *map.find(&items[n]));
+    }
+}
+
+TEST(HashMap, Iterator) {
+    HashMap<int, int> map;
+    const int kCount = 100;
+    for (int n = 0; n < kCount; ++n) {
+        map.set(n, n * 2);
+    }
+
+    bool seen[kCount] = {};
+    size_t count = 0;
+    HashMap<int, int>::Iterator iter(&map);
+    while (iter.hasNext()) {
+        iter.next();
+        int key = iter.key();
+        ASSERT_TRUE(key >= 0 && key < kCount);
+        EXPECT_FALSE(seen[key]);
+        EXPECT_EQ(key * 2, iter.value());
+        seen[key] = true;
+        count++;
+    }
+    EXPECT_EQ(static_cast<size_t>(kCount), count);
+}
+
+}  // namespace base
+}  // namespace android
@@ -45,6 +45,18 @@ inline size_t pointerHash(const void* ptr) {
             reinterpret_cast<uintptr_t>(ptr));
 }
 
+// Map |hash| to an index in a table of |1 << shift| items, with
+// Fibonacci hashing: multiplying by 2^32 divided by the golden ratio
+// spreads consecutive or regularly spaced values over the whole table,
+// and is much cheaper than a modulo.
+inline size_t hashIndex(size_t hash, size_t shift) {
+    uint32_t h = static_cast<uint32_t>(hash);
+    if (sizeof(hash) > 4) {
+        h ^= static_cast<uint32_t>(static_cast<uint64_t>(hash) >> 32);
+    }
+    return static_cast<size_t>((h * 2654435769U) >> (32U - shift));
+}
+
 }  // namespace internal
 }  // namespace base
 }  // namespace android
@@ -26,7 +26,27 @@ static inline void swapPointers(char** p1, char** p2) {
     *p2 = tmp;
 }
 
-PodVectorBase::PodVectorBase(const PodVectorBase& other) {
+PodVectorBase::PodVectorBase(const PodVectorBase& other) :
+        mStorage(NULL), mStorageSize(0U) {
+    initFrom(other.begin(), other.byteSize());
+}
+
+PodVectorBase::PodVectorBase(char* storage, size_t storageSize) :
+        mBegin(storage),
+        mEnd(storage),
+        mLimit(storage ? storage + storageSize : NULL),
+        mStorage(storage),
+        mStorageSize(storage ? storageSize : 0U) {
+    if (mStorage) {
+        // Sanity.
+        ::memset(mStorage, 0, mStorageSize);
+    }
+}
+
+PodVectorBase::PodVectorBase(const PodVectorBase& other,
+                             char* storage,
+                             size_t storageSize) :
+        mStorage(storage), mStorageSize(storage ? storageSize : 0U) {
     initFrom(other.begin(), other.byteSize());
 }
 
@@ -36,7 +56,7 @@ PodVectorBase& PodVectorBase::operator=(const PodVectorBase& other) {
 }
 
 PodVectorBase::~PodVectorBase() {
-    if (mBegin) {
+    if (mBegin && !isInline()) {
         // Sanity.
         ::memset(mBegin, 0xee, byteSize());
         ::free(mBegin);
@@ -47,7 +67,15 @@ PodVectorBase::~PodVectorBase() {
 }
 
 void PodVectorBase::initFrom(const void* from, size_t fromLen) {
-    if (!fromLen || !from) {
+    if (mStorage && fromLen <= mStorageSize) {
+        mBegin = mStorage;
+        mEnd = mStorage + fromLen;
+        mLimit = mStorage + mStorageSize;
+        ::memset(mStorage, 0, mStorageSize);
+        if (fromLen) {
+            ::memcpy(mStorage, from, fromLen);
+        }
+    } else if (!fromLen || !from) {
         mBegin = NULL;
         mEnd = NULL;
         mLimit = NULL;
@@ -102,22 +130,38 @@ void PodVectorBase::reserve(size_t newSize, size_t itemSize) {
             newSize,
             kMaxSize);
 
-    if (newSize == 0) {
-        ::free(mBegin);
-        mBegin = NULL;
-        mEnd = NULL;
-        mLimit = NULL;
+    size_t oldByteSize = byteSize();
+    size_t newByteCapacity = newSize * itemSize;
+    if (oldByteSize > newByteCapacity) {
+        // Items past the new capacity are dropped.
+        oldByteSize = newByteCapacity;
+    }
+
+    if (newByteCapacity <= mStorageSize || newSize == 0) {
+        // Move the items back to the in-object storage, if any, and
+        // release the heap block.
+        if (!isInline()) {
+            if (oldByteSize) {
+                ::memcpy(mStorage, mBegin, oldByteSize);
+            }
+            ::free(mBegin);
+        }
+        mBegin = mStorage;
+        mEnd = mStorage ? mStorage + oldByteSize : NULL;
+        mLimit = mStorage ? mStorage + mStorageSize : NULL;
         return;
     }
 
-    size_t oldByteSize = byteSize();
-    size_t newByteCapacity = newSize * itemSize;
-    char* newBegin = static_cast<char*>(::realloc(mBegin, newByteCapacity));
+    char* oldBegin = isInline() ? NULL : mBegin;
+    char* newBegin = static_cast<char*>(::realloc(oldBegin, newByteCapacity));
     PCHECK(newBegin) << LogString(
             "Could not reallocate array from %zd tp %zd items of %zd bytes",
             oldByteSize / itemSize,
             newSize,
             itemSize);
+    if (!oldBegin && oldByteSize) {
+        ::memcpy(newBegin, mStorage, oldByteSize);
+    }
 
     mBegin = newBegin;
     mEnd = newBegin + oldByteSize;
@@ -162,9 +206,43 @@ void* PodVectorBase::insertAt(size_t itemPos, size_t itemSize) {
 }
 
 void PodVectorBase::swapAll(PodVectorBase* other) {
-    swapPointers(&mBegin, &other->mBegin);
-    swapPointers(&mEnd, &other->mEnd);
-    swapPointers(&mLimit, &other->mLimit);
+    DCHECK(mStorageSize == other->mStorageSize);
+    if (!isInline() && !other->isInline()) {
+        swapPointers(&mBegin, &other->mBegin);
+        swapPointers(&mEnd, &other->mEnd);
+        swapPointers(&mLimit, &other->mLimit);
+        return;
+    }
+    if (!isInline()) {
+        other->swapAll(this);
+        return;
+    }
+
+    size_t mySize = byteSize();
+    size_t otherSize = other->byteSize();
+    if (other->isInline()) {
+        // Both use their in-object storage, exchange the contents.
+        for (size_t n = 0; n < mStorageSize; ++n) {
+            char tmp = mStorage[n];
+            mStorage[n] = other->mStorage[n];
+            other->mStorage[n] = tmp;
+        }
+        mEnd = mBegin + otherSize;
+        other->mEnd = other->mBegin + mySize;
+        return;
+    }
+
+    // Move the heap block of |other| to this instance, and copy the
+    // in-object items to |other|.
+    char* otherBegin = other->mBegin;
+    char* otherLimit = other->mLimit;
+    ::memcpy(other->mStorage, mStorage, mySize);
+    other->mBegin = other->mStorage;
+    other->mEnd = other->mStorage + mySize;
+    other->mLimit = other->mStorage + other->mStorageSize;
+    mBegin = otherBegin;
+    mEnd = otherBegin + otherSize;
+    mLimit = otherLimit;
 }
 
 }  // namespace base
@@ -36,17 +36,30 @@ namespace base {
 // The PodVector provides methods that also follow the std::vector<>
 // conventions, i.e. push_back() is an alias for append().
 //
+// PodVector<T, N> stores up to N items inside the object itself, and only
+// allocates heap memory when it grows larger. This is useful for small
+// temporary vectors, which then never call malloc().
+//
 
 // PodVectorBase is a base, non-templated, implementation class that all
 // PodVector instances derive from. This is used to reduce template
 // specialization. Do not use directly, i..e it's an implementation detail.
 class PodVectorBase {
 protected:
-    PodVectorBase() : mBegin(NULL), mEnd(NULL), mLimit(NULL) {}
+    PodVectorBase() :
+            mBegin(NULL), mEnd(NULL), mLimit(NULL),
+            mStorage(NULL), mStorageSize(0U) {}
     explicit PodVectorBase(const PodVectorBase& other);
     PodVectorBase& operator=(const PodVectorBase& other);
     ~PodVectorBase();
 
+    // Constructors used when |storageSize| bytes at |storage| can hold
+    // the items before any heap memory is allocated.
+    PodVectorBase(char* storage, size_t storageSize);
+    PodVectorBase(const PodVectorBase& other,
+                  char* storage,
+                  size_t storageSize);
+
     bool empty() const { return mEnd == mBegin; }
 
     size_t byteSize() const { return mEnd - mBegin; }
@@ -94,12 +107,38 @@ protected:
     void* insertAt(size_t index, size_t itemSize);
     void swapAll(PodVectorBase* other);
 
+    // Return true iff the items are in the in-object storage.
+    bool isInline() const { return mStorage && mBegin == mStorage; }
+
     char* mBegin;
     char* mEnd;
     char* mLimit;
 
 private:
     void initFrom(const void* from, size_t fromLen);
+
+    // In-object storage, or NULL.
+    char* mStorage;
+    size_t mStorageSize;
+};
+
+// Helper class providing the in-object storage of a PodVector<T, N>.
+// Do not use directly.
+template <typename T, size_t N>
+class PodVectorStorage {
+protected:
+    char* storage() { return reinterpret_cast<char*>(mItems); }
+    static size_t storageSize() { return sizeof(mItems); }
+
+private:
+    T mItems[N];
+};
+
+template <typename T>
+class PodVectorStorage<T, 0U> {
+protected:
+    char* storage() { return NULL; }
+    static size_t storageSize() { return 0U; }
 };
 
 
@@ -112,15 +151,25 @@ private:
 // std::vector<> instead, but keep in mind that this implies a non-trivial
 // cost when appending, inserting, removing items in the collection.
 //
-template <typename T>
-class PodVector : public PodVectorBase {
+// |N| is the number of items that can be stored without allocating heap
+// memory. Note that the in-object storage makes swap() a copy of the
+// items, instead of a simple exchange of pointers, when it is used.
+//
+template <typename T, size_t N = 0U>
+class PodVector : private PodVectorStorage<T, N>, public PodVectorBase {
+    typedef PodVectorStorage<T, N> Storage;
+
 public:
     // Default constructor for an empty PodVector<T>
-    PodVector() : PodVectorBase() {}
+    PodVector() : Storage(), PodVectorBase(Storage::storage(),
+                                           Storage::storageSize()) {}
 
     // Copy constructor. This copies all items from |other| into
     // the new instance with ::memmove().
-    PodVector(const PodVector& other) : PodVectorBase(other) {}
+    PodVector(const PodVector& other) :
+            Storage(),
+            PodVectorBase(other, Storage::storage(),
+                          Storage::storageSize()) {}
 
     // Assignment operator.
     PodVector& operator=(const PodVector& other) {
@@ -174,7 +223,7 @@ public:
     // only valid until the next call to any function that changes the
     // size of capacity of the vector.
     const T* begin() const {
-        return reinterpret_cast<T*>(PodVectorBase::begin());
+        return reinterpret_cast<const T*>(PodVectorBase::begin());
     }
 
     // Return a pointer past the last item in the vector. I.e. if the
@@ -188,7 +237,7 @@ public:
     // the result is not NULL, then |result - 1| points to the last item.
     // Can be NULL if the vector is empty.
     const T* end() const {
-        return reinterpret_cast<T*>(PodVectorBase::end());
+        return reinterpret_cast<const T*>(PodVectorBase::end());
     }
 
     // Returns a reference to the item a position |index| in the vector.
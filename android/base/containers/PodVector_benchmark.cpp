@@ -0,0 +1,89 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Micro-benchmarks of PodVector<>. The argument is the number of items,
+// and each operation builds or copies a whole vector.
+
+#include "android/base/containers/PodVector.h"
+
+#include "android/base/testing/Benchmark.h"
+
+using android::base::PodVector;
+
+namespace {
+
+volatile size_t sSink;
+
+}  // namespace
+
+BENCHMARK(PodVector, PushBack) {
+    size_t count = static_cast<size_t>(state->arg());
+    for (size_t n = 0; n < state->iterations(); ++n) {
+        PodVector<int> v;
+        for (size_t i = 0; i < count; ++i) {
+            v.push_back(static_cast<int>(i));
+        }
+        sSink += v.size();
+    }
+}
+BENCHMARK_ARGS(PodVector, PushBack, 4, 64, 4096);
+
+BENCHMARK(PodVector, PushBackReserved) {
+    size_t count = static_cast<size_t>(state->arg());
+    for (size_t n = 0; n < state->iterations(); ++n) {
+        PodVector<int> v;
+        v.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            v.push_back(static_cast<int>(i));
+        }
+        sSink += v.size();
+    }
+}
+BENCHMARK_ARGS(PodVector, PushBackReserved, 4, 64, 4096);
+
+BENCHMARK(PodVector, PushBackInline) {
+    size_t count = static_cast<size_t>(state->arg());
+    for (size_t n = 0; n < state->iterations(); ++n) {
+        PodVector<int, 16> v;
+        for (size_t i = 0; i < count; ++i) {
+            v.push_back(static_cast<int>(i));
+        }
+        sSink += v.size();
+    }
+}
+BENCHMARK_ARGS(PodVector, PushBackInline, 4, 64);
+
+BENCHMARK(PodVector, Copy) {
+    size_t count = static_cast<size_t>(state->arg());
+    PodVector<int> source;
+    source.resize(count);
+    state->setBytesPerOp(count * sizeof(int));
+    for (size_t n = 0; n < state->iterations(); ++n) {
+        PodVector<int> v(source);
+        sSink += v.size();
+    }
+}
+BENCHMARK_ARGS(PodVector, Copy, 64, 4096);
+
+BENCHMARK(PodVector, PrependRemove) {
+    size_t count = static_cast<size_t>(state->arg());
+    PodVector<int> v;
+    v.resize(count);
+    for (size_t n = 0; n < state->iterations(); ++n) {
+        v.prepend(static_cast<int>(n));
+        v.remove(0U);
+    }
+    sSink += v.size();
+}
+BENCHMARK_ARGS(PodVector, PrependRemove, 64, 4096);
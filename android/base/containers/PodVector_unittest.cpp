@@ -20,6 +20,15 @@ static int  hashIndex(size_t n) {
     return static_cast<int>(((n >> 14) * 13773) + (n * 51));
 }
 
+// Return true iff the items of |v| are stored inside the object, i.e.
+// no heap memory was allocated for them.
+template <typename T, size_t N>
+static bool usesInlineStorage(const PodVector<T, N>& v) {
+    const char* items = reinterpret_cast<const char*>(v.begin());
+    const char* object = reinterpret_cast<const char*>(&v);
+    return items >= object && items < object + sizeof(v);
+}
+
 TEST(PodVector, Empty) {
     PodVector<int> v;
     EXPECT_TRUE(v.empty());
@@ -122,5 +131,95 @@ TEST(PodVector, AssignmentOperator) {
     }
 }
 
+TEST(PodVector, InlineStorageAvoidsHeap) {
+    PodVector<int, 8> v;
+    EXPECT_TRUE(v.empty());
+    EXPECT_EQ(8U, v.capacity());
+    for (size_t n = 0; n < 8U; ++n) {
+        v.append(hashIndex(n));
+        EXPECT_TRUE(usesInlineStorage(v)) << "At index " << n;
+    }
+    v.remove(3U);
+    v.insert(3U, hashIndex(3));
+    EXPECT_TRUE(usesInlineStorage(v));
+    for (size_t n = 0; n < 8U; ++n) {
+        EXPECT_EQ(hashIndex(n), v[n]) << "At index " << n;
+    }
+}
+
+TEST(PodVector, InlineStorageGrowsToHeapAndBack) {
+    PodVector<int, 8> v;
+    const size_t kMaxCount = 1000;
+    for (size_t n = 0; n < kMaxCount; ++n) {
+        v.append(hashIndex(n));
+    }
+    EXPECT_FALSE(usesInlineStorage(v));
+    EXPECT_EQ(kMaxCount, v.size());
+    for (size_t n = 0; n < kMaxCount; ++n) {
+        EXPECT_EQ(hashIndex(n), v[n]) << "At index " << n;
+    }
+
+    v.resize(4U);
+    v.reserve(4U);
+    EXPECT_TRUE(usesInlineStorage(v));
+    EXPECT_EQ(4U, v.size());
+    for (size_t n = 0; n < 4U; ++n) {
+        EXPECT_EQ(hashIndex(n), v[n]) << "At index " << n;
+    }
+
+    v.reserve(0U);
+    EXPECT_TRUE(v.empty());
+    EXPECT_TRUE(usesInlineStorage(v));
+}
+
+TEST(PodVector, InlineStorageCopy) {
+    PodVector<int, 4> v1;
+    for (size_t n = 0; n < 3U; ++n) {
+        v1.append(hashIndex(n));
+    }
+    PodVector<int, 4> v2(v1);
+    EXPECT_TRUE(usesInlineStorage(v2));
+    EXPECT_EQ(3U, v2.size());
+
+    PodVector<int, 4> v3;
+    for (size_t n = 0; n < 100U; ++n) {
+        v3.append(hashIndex(n));
+    }
+    v3 = v1;
+    EXPECT_EQ(3U, v3.size());
+    for (size_t n = 0; n < 3U; ++n) {
+        EXPECT_EQ(hashIndex(n), v2[n]) << "At index " << n;
+        EXPECT_EQ(hashIndex(n), v3[n]) << "At index " << n;
+    }
+}
+
+TEST(PodVector, InlineStorageSwap) {
+    const size_t kSizes[] = { 0U, 2U, 4U, 100U };
+    const size_t kNumSizes = sizeof(kSizes) / sizeof(kSizes[0]);
+    for (size_t i = 0; i < kNumSizes; ++i) {
+        for (size_t j = 0; j < kNumSizes; ++j) {
+            PodVector<int, 4> v1;
+            PodVector<int, 4> v2;
+            for (size_t n = 0; n < kSizes[i]; ++n) {
+                v1.append(hashIndex(n));
+            }
+            for (size_t n = 0; n < kSizes[j]; ++n) {
+                v2.append(hashIndex(n + 1000U));
+            }
+            v1.swap(&v2);
+            ASSERT_EQ(kSizes[j], v1.size());
+            ASSERT_EQ(kSizes[i], v2.size());
+            for (size_t n = 0; n < kSizes[j]; ++n) {
+                EXPECT_EQ(hashIndex(n + 1000U), v1[n]) << "At index " << n;
+            }
+            for (size_t n = 0; n < kSizes[i]; ++n) {
+                EXPECT_EQ(hashIndex(n), v2[n]) << "At index " << n;
+            }
+            EXPECT_EQ(kSizes[j] <= 4U, usesInlineStorage(v1));
+            EXPECT_EQ(kSizes[i] <= 4U, usesInlineStorage(v2));
+        }
+    }
+}
+
 }  // namespace base
 }  // namespace android
@@ -0,0 +1,89 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Micro-benchmarks of PointerSet<>. The argument is the number of items
+// in the set.
+
+#include "android/base/containers/PointerSet.h"
+
+#include "android/base/testing/Benchmark.h"
+
+#include <stdlib.h>
+
+using android::base::PointerSet;
+
+namespace {
+
+volatile size_t sSink;
+
+class PointerSetBenchmark : public android::base::Benchmark {
+public:
+    virtual void setUp(int64_t arg) {
+        mCount = static_cast<size_t>(arg);
+        // Pointers into an array, as distinct as heap objects would be.
+        mItems = static_cast<int*>(calloc(mCount * 2, sizeof(int)));
+        for (size_t n = 0; n < mCount; ++n) {
+            mSet.add(&mItems[n]);
+        }
+    }
+
+    virtual void tearDown() {
+        mSet.clear();
+        free(mItems);
+    }
+
+protected:
+    size_t mCount;
+    int* mItems;
+    PointerSet<int> mSet;
+};
+
+}  // namespace
+
+BENCHMARK_F(PointerSetBenchmark, ContainsHit) {
+    for (size_t n = 0; n < state->iterations(); ++n) {
+        sSink += mSet.contains(&mItems[n % mCount]);
+    }
+}
+BENCHMARK_ARGS(PointerSetBenchmark, ContainsHit, 16, 1024, 65536);
+
+BENCHMARK_F(PointerSetBenchmark, ContainsMiss) {
+    for (size_t n = 0; n < state->iterations(); ++n) {
+        sSink += mSet.contains(&mItems[mCount + n % mCount]);
+    }
+}
+BENCHMARK_ARGS(PointerSetBenchmark, ContainsMiss, 16, 1024, 65536);
+
+BENCHMARK_F(PointerSetBenchmark, AddRemove) {
+    for (size_t n = 0; n < state->iterations(); ++n) {
+        int* item = &mItems[mCount + n % mCount];
+        mSet.add(item);
+        mSet.remove(item);
+    }
+}
+BENCHMARK_ARGS(PointerSetBenchmark, AddRemove, 16, 1024, 65536);
+
+BENCHMARK(PointerSet, Fill) {
+    size_t count = static_cast<size_t>(state->arg());
+    int* items = static_cast<int*>(calloc(count, sizeof(int)));
+    for (size_t n = 0; n < state->iterations(); ++n) {
+        PointerSet<int> set;
+        for (size_t i = 0; i < count; ++i) {
+            set.add(&items[i]);
+        }
+        sSink += set.size();
+    }
+    free(items);
+}
+BENCHMARK_ARGS(PointerSet, Fill, 16, 1024);
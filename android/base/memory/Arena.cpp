@@ -0,0 +1,113 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/base/memory/Arena.h"
+
+#include "android/base/Log.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace android {
+namespace base {
+
+namespace {
+
+// Alignment of all allocations, enough for any basic type.
+const size_t kAlignment = 16U;
+
+size_t alignSize(size_t size) {
+    return (size + kAlignment - 1U) & ~(kAlignment - 1U);
+}
+
+// Size of a chunk header, rounded up so the payload stays aligned.
+const size_t kHeaderSize = (sizeof(void*) + kAlignment - 1U) &
+                           ~(kAlignment - 1U);
+
+}  // namespace
+
+Arena::Arena(size_t chunkSize) :
+        mChunkSize(alignSize(chunkSize < 256U ? 256U : chunkSize)),
+        mChunks(NULL),
+        mPos(NULL),
+        mEnd(NULL),
+        mAllocatedSize(0U) {}
+
+Arena::~Arena() {
+    reset();
+}
+
+void* Arena::alloc(size_t size) {
+    mAllocatedSize += size;
+    size = alignSize(size ? size : 1U);
+    if (size <= static_cast<size_t>(mEnd - mPos)) {
+        void* result = mPos;
+        mPos += size;
+        return result;
+    }
+    return allocSlow(size);
+}
+
+void* Arena::allocSlow(size_t size) {
+    // Large allocations get their own chunk, which is inserted after the
+    // current one so that the remaining space of the latter can still be
+    // used by later small allocations.
+    bool large = (size > mChunkSize / 4U);
+    size_t chunkSize = kHeaderSize + (large ? size : mChunkSize);
+    Chunk* chunk = static_cast<Chunk*>(::malloc(chunkSize));
+    if (!chunk) {
+        LOG(FATAL) << "Could not allocate " << chunkSize << " bytes";
+    }
+    char* payload = reinterpret_cast<char*>(chunk) + kHeaderSize;
+
+    if (large && mChunks) {
+        chunk->next = mChunks->next;
+        mChunks->next = chunk;
+        return payload;
+    }
+
+    chunk->next = mChunks;
+    mChunks = chunk;
+    mPos = payload + size;
+    mEnd = reinterpret_cast<char*>(chunk) + chunkSize;
+    return payload;
+}
+
+char* Arena::strdup(const char* str) {
+    return strndup(str, ::strlen(str));
+}
+
+char* Arena::strndup(const char* str, size_t len) {
+    const char* end = static_cast<const char*>(::memchr(str, 0, len));
+    if (end) {
+        len = static_cast<size_t>(end - str);
+    }
+    char* result = static_cast<char*>(alloc(len + 1U));
+    ::memcpy(result, str, len);
+    result[len] = '\0';
+    return result;
+}
+
+void Arena::reset() {
+    Chunk* chunk = mChunks;
+    while (chunk) {
+        Chunk* next = chunk->next;
+        ::free(chunk);
+        chunk = next;
+    }
+    mChunks = NULL;
+    mPos = NULL;
+    mEnd = NULL;
+    mAllocatedSize = 0U;
+}
+
+}  // namespace base
+}  // namespace android
@@ -0,0 +1,86 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#ifndef ANDROID_BASE_MEMORY_ARENA_H
+#define ANDROID_BASE_MEMORY_ARENA_H
+
+#include "android/base/Compiler.h"
+
+#include <stddef.h>
+
+namespace android {
+namespace base {
+
+// An Arena is a simple bump allocator, used to make many small allocations
+// that all have the same lifetime, e.g. the strings of a parsed
+// configuration file. Memory is carved from large heap chunks, and is only
+// released when the arena is reset() or destroyed, all at once.
+//
+// Usage example:
+//
+//     Arena arena;
+//     char* name = arena.strdup("foo");
+//     Foo* foo = static_cast<Foo*>(arena.alloc(sizeof(Foo)));
+//     ...
+//     // Everything is freed when |arena| goes out of scope.
+//
+// Note that destructors of objects placed in the arena are never called.
+class Arena {
+public:
+    // Default size of the chunks allocated by the arena.
+    enum { kDefaultChunkSize = 4096 };
+
+    // Create a new empty arena. |chunkSize| is the size of the heap chunks
+    // used to satisfy small allocations. No memory is allocated until the
+    // first call to alloc().
+    explicit Arena(size_t chunkSize = kDefaultChunkSize);
+
+    // Destructor releases all memory allocated from the arena.
+    ~Arena();
+
+    // Allocate |size| bytes from the arena. The result is suitably aligned
+    // for any basic type, and its content is undefined. Never returns NULL,
+    // even when |size| is 0.
+    void* alloc(size_t size);
+
+    // Allocate a copy of the zero-terminated string |str|.
+    char* strdup(const char* str);
+
+    // Allocate a zero-terminated copy of the first |len| bytes of |str|.
+    char* strndup(const char* str, size_t len);
+
+    // Release all memory allocated from the arena, which can be reused.
+    void reset();
+
+    // Return the total number of bytes requested through alloc() since the
+    // arena was created or last reset. Useful for statistics.
+    size_t allocatedSize() const { return mAllocatedSize; }
+
+private:
+    struct Chunk {
+        Chunk* next;
+    };
+
+    void* allocSlow(size_t size);
+
+    size_t mChunkSize;
+    Chunk* mChunks;
+    char* mPos;
+    char* mEnd;
+    size_t mAllocatedSize;
+
+    DISALLOW_COPY_AND_ASSIGN(Arena);
+};
+
+}  // namespace base
+}  // namespace android
+
+#endif  // ANDROID_BASE_MEMORY_ARENA_H
@@ -0,0 +1,91 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/base/memory/Arena.h"
+
+#include <gtest/gtest.h>
+
+#include <stdint.h>
+#include <string.h>
+
+namespace android {
+namespace base {
+
+TEST(Arena, Empty) {
+    Arena arena;
+    EXPECT_EQ(0U, arena.allocatedSize());
+}
+
+TEST(Arena, AllocIsAligned) {
+    Arena arena;
+    for (size_t n = 0; n < 100; ++n) {
+        void* ptr = arena.alloc(n);
+        EXPECT_TRUE(ptr);
+        EXPECT_EQ(0U, reinterpret_cast<uintptr_t>(ptr) & 15U) << n;
+        memset(ptr, 0x55, n);
+    }
+}
+
+TEST(Arena, AllocDoesNotOverlap) {
+    Arena arena(256);
+    const size_t kCount = 1000;
+    char* ptrs[kCount];
+    for (size_t n = 0; n < kCount; ++n) {
+        ptrs[n] = static_cast<char*>(arena.alloc(24));
+        memset(ptrs[n], static_cast<int>(n & 255), 24);
+    }
+    for (size_t n = 0; n < kCount; ++n) {
+        for (size_t i = 0; i < 24; ++i) {
+            EXPECT_EQ(static_cast<char>(n & 255), ptrs[n][i]);
+        }
+    }
+}
+
+TEST(Arena, LargeAlloc) {
+    Arena arena(256);
+    char* small1 = static_cast<char*>(arena.alloc(16));
+    char* large = static_cast<char*>(arena.alloc(100000));
+    char* small2 = static_cast<char*>(arena.alloc(16));
+    memset(large, 1, 100000);
+    // The large block does not consume the current chunk.
+    EXPECT_EQ(small1 + 16, small2);
+    EXPECT_EQ(100032U, arena.allocatedSize());
+}
+
+TEST(Arena, StrDup) {
+    Arena arena;
+    const char kString[] = "Hello World";
+    char* str = arena.strdup(kString);
+    EXPECT_STREQ(kString, str);
+    EXPECT_NE(kString, str);
+
+    EXPECT_STREQ("", arena.strdup(""));
+}
+
+TEST(Arena, StrNDup) {
+    Arena arena;
+    EXPECT_STREQ("Hello", arena.strndup("Hello World", 5));
+    EXPECT_STREQ("Hi", arena.strndup("Hi", 10));
+    EXPECT_STREQ("", arena.strndup("Hello", 0));
+}
+
+TEST(Arena, Reset) {
+    Arena arena;
+    arena.alloc(100);
+    arena.strdup("foo");
+    EXPECT_EQ(104U, arena.allocatedSize());
+    arena.reset();
+    EXPECT_EQ(0U, arena.allocatedSize());
+    EXPECT_STREQ("bar", arena.strdup("bar"));
+}
+
+}  // namespace base
+}  // namespace android
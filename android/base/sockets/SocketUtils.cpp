@@ -19,6 +19,7 @@
 #include "android/base/sockets/Winsock.h"
 #else
 #  include <sys/socket.h>
+#  include <sys/uio.h>
 #  include <unistd.h>
 #  include <fcntl.h>
 #  include <netinet/in.h>
@@ -304,6 +305,69 @@ ssize_t socketSend(int socket, const void* buffer, size_t bufferLen) {
     return ret;
 }
 
+#ifdef _WIN32
+ssize_t socketRecvV(int socket, const SocketBuffer* buffers, size_t count) {
+    WSABUF wsaBuffers[kSocketMaxBuffers];
+    if (count > kSocketMaxBuffers) {
+        count = kSocketMaxBuffers;
+    }
+    for (size_t n = 0; n < count; ++n) {
+        wsaBuffers[n].buf = reinterpret_cast<char*>(buffers[n].data);
+        wsaBuffers[n].len = static_cast<ULONG>(buffers[n].size);
+    }
+    DWORD received = 0;
+    DWORD flags = 0;
+    int ret = ::WSARecv(socket, wsaBuffers, static_cast<DWORD>(count),
+                        &received, &flags, NULL, NULL);
+    ON_SOCKET_ERROR_RETURN_M1(ret);
+    return static_cast<ssize_t>(received);
+}
+
+ssize_t socketSendV(int socket, const SocketBuffer* buffers, size_t count) {
+    WSABUF wsaBuffers[kSocketMaxBuffers];
+    if (count > kSocketMaxBuffers) {
+        count = kSocketMaxBuffers;
+    }
+    for (size_t n = 0; n < count; ++n) {
+        wsaBuffers[n].buf = reinterpret_cast<char*>(buffers[n].data);
+        wsaBuffers[n].len = static_cast<ULONG>(buffers[n].size);
+    }
+    DWORD sent = 0;
+    int ret = ::WSASend(socket, wsaBuffers, static_cast<DWORD>(count),
+                        &sent, 0, NULL, NULL);
+    ON_SOCKET_ERROR_RETURN_M1(ret);
+    return static_cast<ssize_t>(sent);
+}
+#else  // !_WIN32
+ssize_t socketRecvV(int socket, const SocketBuffer* buffers, size_t count) {
+    struct iovec iov[kSocketMaxBuffers];
+    if (count > kSocketMaxBuffers) {
+        count = kSocketMaxBuffers;
+    }
+    for (size_t n = 0; n < count; ++n) {
+        iov[n].iov_base = buffers[n].data;
+        iov[n].iov_len = buffers[n].size;
+    }
+    ssize_t ret = ::readv(socket, iov, static_cast<int>(count));
+    ON_SOCKET_ERROR_RETURN_M1(ret);
+    return ret;
+}
+
+ssize_t socketSendV(int socket, const SocketBuffer* buffers, size_t count) {
+    struct iovec iov[kSocketMaxBuffers];
+    if (count > kSocketMaxBuffers) {
+        count = kSocketMaxBuffers;
+    }
+    for (size_t n = 0; n < count; ++n) {
+        iov[n].iov_base = buffers[n].data;
+        iov[n].iov_len = buffers[n].size;
+    }
+    ssize_t ret = ::writev(socket, iov, static_cast<int>(count));
+    ON_SOCKET_ERROR_RETURN_M1(ret);
+    return ret;
+}
+#endif  // !_WIN32
+
 void socketShutdownWrites(int socket) {
 #ifdef _WIN32
     ::shutdown(socket, SD_SEND);
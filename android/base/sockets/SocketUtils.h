@@ -33,6 +33,29 @@ ssize_t socketRecv(int socket, void* buffer, size_t bufferLen);
 // a convenience.
 ssize_t socketSend(int socket, const void* buffer, size_t bufferLen);
 
+// Describes one buffer for socketRecvV() and socketSendV(), like the Posix
+// struct iovec.
+struct SocketBuffer {
+    void* data;
+    size_t size;
+};
+
+// Maximum number of buffers that socketRecvV() and socketSendV() will
+// process in a single call. Extra buffers are ignored.
+enum { kSocketMaxBuffers = 16 };
+
+// Try to receive data from |socket| into the |count| buffers described by
+// |buffers|, filling each one before the next. Return the total number of
+// bytes actually read, 0 in case of disconnection, or -1/errno in case of
+// error. Uses readv() on Posix and WSARecv() on Windows.
+ssize_t socketRecvV(int socket, const SocketBuffer* buffers, size_t count);
+
+// Try to send the content of the |count| buffers described by |buffers|
+// to |socket|, in order. Return the total number of bytes actually sent,
+// 0 in case of disconnection, or -1/errno in case of error. Uses writev()
+// on Posix and WSASend() on Windows.
+ssize_t socketSendV(int socket, const SocketBuffer* buffers, size_t count);
+
 // Shutdown all writes to a socket.
 void socketShutdownWrites(int socket);
 
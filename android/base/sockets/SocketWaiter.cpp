@@ -13,18 +13,34 @@
 #include "android/base/Limits.h"
 #include "android/base/sockets/SocketWaiter.h"
 
+#include "android/base/containers/PodVector.h"
 #include "android/base/Log.h"
 #include "android/base/sockets/SocketErrors.h"
+#include "android/base/system/System.h"
 
 #ifdef _WIN32
 #include "android/base/sockets/Winsock.h"
 #else
 #  include <sys/types.h>
 #  include <sys/select.h>
+#  include <fcntl.h>
+#  include <poll.h>
+#  include <unistd.h>
 #endif
 
+#ifdef __linux__
+#  include <sys/epoll.h>
+#  define SOCKET_WAITER_HAS_EPOLL 1
+#endif
+
+#if defined(__APPLE__) || defined(__FreeBSD__)
+#  include <sys/event.h>
+#  include <sys/time.h>
+#  define SOCKET_WAITER_HAS_KQUEUE 1
+#endif
 
 #include <errno.h>
+#include <limits.h>
 #include <string.h>
 
 namespace android {
@@ -249,11 +265,524 @@ private:
     int mPendingFd;
 };
 
+// Base class for the backends that don't use fd_sets. It records the
+// wanted and pending events of each descriptor in tables indexed by
+// descriptor, so that none of its methods depends on the number of
+// watched descriptors, except reset(). Sub-classes tell the system about
+// changes in onUpdate(), and report events in doWait() by calling
+// addPendingEvents().
+class FdTableSocketWaiter : public SocketWaiter {
+public:
+    FdTableSocketWaiter() : SocketWaiter(), mFdCount(0), mPendingPos(0) {}
+
+    virtual ~FdTableSocketWaiter() {}
+
+    virtual void reset() {
+        for (size_t fd = 0; fd < mWanted.size(); ++fd) {
+            if (mWanted[fd]) {
+                onUpdate(static_cast<int>(fd), mWanted[fd], 0);
+            }
+        }
+        mWanted.resize(0);
+        mFdCount = 0;
+        clearPendingEvents();
+    }
+
+    virtual unsigned wantedEventsFor(int fd) const {
+        if (fd < 0 || static_cast<size_t>(fd) >= mWanted.size()) {
+            return 0U;
+        }
+        return mWanted[fd];
+    }
+
+    virtual unsigned pendingEventsFor(int fd) const {
+        if (fd < 0 || static_cast<size_t>(fd) >= mPending.size()) {
+            return 0U;
+        }
+        return mPending[fd];
+    }
+
+    virtual bool hasFds() const {
+        return mFdCount > 0;
+    }
+
+    virtual void update(int fd, unsigned events) {
+        DCHECK(fd >= 0) << "fd " << fd;
+        if (fd < 0) {
+            return;
+        }
+        events &= (kEventRead | kEventWrite);
+
+        unsigned oldEvents = wantedEventsFor(fd);
+        if (events == oldEvents) {
+            return;
+        }
+        if (!onUpdate(fd, oldEvents, events)) {
+            return;
+        }
+        growTable(&mWanted, fd);
+        mWanted[fd] = events;
+        if (oldEvents == 0) {
+            mFdCount++;
+        } else if (events == 0) {
+            mFdCount--;
+        }
+    }
+
+    virtual int wait(int64_t timeout_ms) {
+        clearPendingEvents();
+
+        // Nothing to wait on.
+        if (mFdCount <= 0) {
+            return 0;
+        }
+
+        int ret;
+        do {
+            ret = doWait(timeout_ms);
+        } while (ret < 0 && errno == EINTR);
+
+        if (ret < 0) {
+            LOG(ERROR) << LogString("Error: %s\n", strerror(errno));
+            clearPendingEvents();
+            return ret;
+        }
+        ret = static_cast<int>(mPendingFds.size());
+        if (ret == 0) {
+            errno = ETIMEDOUT;
+        }
+        return ret;
+    }
+
+    virtual int nextPendingFd(unsigned* fdEvents) {
+        if (mPendingPos < mPendingFds.size()) {
+            int fd = mPendingFds[mPendingPos++];
+            *fdEvents = mPending[fd];
+            return fd;
+        }
+        *fdEvents = 0;
+        return -1;
+    }
+
+protected:
+    // Called when the wanted events of |fd| change from |oldEvents| to
+    // |newEvents|, one of them being possibly 0. Return false if the
+    // system rejected the change, in which case nothing is recorded.
+    virtual bool onUpdate(int fd, unsigned oldEvents, unsigned newEvents) = 0;
+
+    // Wait at most |timeout_ms| for events, and report them through
+    // addPendingEvents(). Return -1/errno on error.
+    virtual int doWait(int64_t timeout_ms) = 0;
+
+    // Record that |events| happened on |fd| during the current wait().
+    // Events that are not wanted are ignored.
+    void addPendingEvents(int fd, unsigned events) {
+        events &= wantedEventsFor(fd);
+        if (!events) {
+            return;
+        }
+        growTable(&mPending, fd);
+        if (!mPending[fd]) {
+            mPendingFds.append(fd);
+        }
+        mPending[fd] |= events;
+    }
+
+    // Return the number of watched descriptors.
+    int fdCount() const { return mFdCount; }
+
+    // Convert |timeout_ms| to the millisecond timeout used by poll() and
+    // epoll_wait(), where -1 means infinite.
+    static int toIntTimeout(int64_t timeout_ms) {
+        if (timeout_ms < 0 || timeout_ms == INT64_MAX) {
+            return -1;
+        }
+        if (timeout_ms > INT_MAX) {
+            return INT_MAX;
+        }
+        return static_cast<int>(timeout_ms);
+    }
+
+private:
+    // Ensure that |fd| is a valid index in |*table|, zero-filling new
+    // entries.
+    static void growTable(PodVector<unsigned>* table, int fd) {
+        size_t oldSize = table->size();
+        if (static_cast<size_t>(fd) < oldSize) {
+            return;
+        }
+        table->resize(fd + 1);
+        ::memset(&(*table)[oldSize], 0,
+                 (fd + 1 - oldSize) * sizeof(unsigned));
+    }
+
+    void clearPendingEvents() {
+        for (size_t n = 0; n < mPendingFds.size(); ++n) {
+            mPending[mPendingFds[n]] = 0;
+        }
+        mPendingFds.resize(0);
+        mPendingPos = 0;
+    }
+
+    PodVector<unsigned> mWanted;
+    PodVector<unsigned> mPending;
+    PodVector<int> mPendingFds;
+    int mFdCount;
+    size_t mPendingPos;
+};
+
+#ifndef _WIN32
+
+// A SocketWaiter based on poll(). The pollfd array is kept packed, and
+// each descriptor's position in it is recorded, so that updates are O(1).
+class PollSocketWaiter : public FdTableSocketWaiter {
+public:
+    PollSocketWaiter() : FdTableSocketWaiter() {}
+
+    virtual ~PollSocketWaiter() {}
+
+protected:
+    virtual bool onUpdate(int fd, unsigned oldEvents, unsigned newEvents) {
+        if (oldEvents == 0) {
+            size_t oldSize = mIndices.size();
+            if (static_cast<size_t>(fd) >= oldSize) {
+                mIndices.resize(fd + 1);
+                ::memset(&mIndices[oldSize], 0,
+                         (fd + 1 - oldSize) * sizeof(size_t));
+            }
+            struct pollfd* pfd = mPollFds.emplace(mPollFds.size());
+            pfd->fd = fd;
+            pfd->revents = 0;
+            // Indices are stored off by one, so that 0 means unused.
+            mIndices[fd] = mPollFds.size();
+        }
+
+        size_t index = mIndices[fd] - 1U;
+        if (newEvents == 0) {
+            // Move the last entry to the removed position.
+            size_t last = mPollFds.size() - 1U;
+            if (index != last) {
+                mPollFds[index] = mPollFds[last];
+                mIndices[mPollFds[index].fd] = index + 1U;
+            }
+            mPollFds.resize(last);
+            mIndices[fd] = 0;
+            return true;
+        }
+
+        short pollEvents = 0;
+        if (newEvents & kEventRead) {
+            pollEvents |= POLLIN;
+        }
+        if (newEvents & kEventWrite) {
+            pollEvents |= POLLOUT;
+        }
+        mPollFds[index].events = pollEvents;
+        return true;
+    }
+
+    virtual int doWait(int64_t timeout_ms) {
+        int ret = ::poll(mPollFds.begin(), mPollFds.size(),
+                         toIntTimeout(timeout_ms));
+        for (size_t n = 0; ret > 0 && n < mPollFds.size(); ++n) {
+            short revents = mPollFds[n].revents;
+            if (!revents) {
+                continue;
+            }
+            unsigned events = 0;
+            // Like select(), report errors and hang-ups as both readable
+            // and writable, so that the next i/o operation gets the error.
+            if (revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                events = kEventRead | kEventWrite;
+            }
+            if (revents & POLLIN) {
+                events |= kEventRead;
+            }
+            if (revents & POLLOUT) {
+                events |= kEventWrite;
+            }
+            addPendingEvents(mPollFds[n].fd, events);
+        }
+        return ret;
+    }
+
+private:
+    PodVector<struct pollfd> mPollFds;
+    PodVector<size_t> mIndices;
+};
+
+#endif  // !_WIN32
+
+#ifdef SOCKET_WAITER_HAS_EPOLL
+
+// A SocketWaiter based on Linux's epoll. Note that the kernel removes a
+// descriptor from the epoll set when it is closed, so errors caused by
+// a stale registration are expected and handled in onUpdate().
+class EpollSocketWaiter : public FdTableSocketWaiter {
+public:
+    // Return a new instance, or NULL if epoll is not available.
+    static EpollSocketWaiter* create() {
+        int epollFd = ::epoll_create(1);
+        if (epollFd < 0) {
+            return NULL;
+        }
+        ::fcntl(epollFd, F_SETFD, FD_CLOEXEC);
+        return new EpollSocketWaiter(epollFd);
+    }
+
+    virtual ~EpollSocketWaiter() {
+        ::close(mEpollFd);
+    }
+
+    virtual int fd() const { return mEpollFd; }
+
+protected:
+    virtual bool onUpdate(int fd, unsigned oldEvents, unsigned newEvents) {
+        struct epoll_event ev;
+        ::memset(&ev, 0, sizeof(ev));
+        ev.data.fd = fd;
+        if (newEvents & kEventRead) {
+            ev.events |= EPOLLIN;
+        }
+        if (newEvents & kEventWrite) {
+            ev.events |= EPOLLOUT;
+        }
+
+        if (newEvents == 0) {
+            // Fails if |fd| was already closed, which is fine.
+            ::epoll_ctl(mEpollFd, EPOLL_CTL_DEL, fd, &ev);
+            return true;
+        }
+
+        int op = oldEvents ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        int ret = ::epoll_ctl(mEpollFd, op, fd, &ev);
+        if (ret < 0 && op == EPOLL_CTL_MOD && errno == ENOENT) {
+            // |fd| was closed and its number reused.
+            ret = ::epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &ev);
+        } else if (ret < 0 && op == EPOLL_CTL_ADD && errno == EEXIST) {
+            ret = ::epoll_ctl(mEpollFd, EPOLL_CTL_MOD, fd, &ev);
+        }
+        if (ret < 0) {
+            LOG(ERROR) << LogString("Could not watch fd %d: %s\n",
+                                    fd, strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+    virtual int doWait(int64_t timeout_ms) {
+        mEvents.resize(fdCount());
+        int ret = ::epoll_wait(mEpollFd, mEvents.begin(), fdCount(),
+                               toIntTimeout(timeout_ms));
+        for (int n = 0; n < ret; ++n) {
+            uint32_t revents = mEvents[n].events;
+            unsigned events = 0;
+            if (revents & (EPOLLERR | EPOLLHUP)) {
+                events = kEventRead | kEventWrite;
+            }
+            if (revents & EPOLLIN) {
+                events |= kEventRead;
+            }
+            if (revents & EPOLLOUT) {
+                events |= kEventWrite;
+            }
+            addPendingEvents(mEvents[n].data.fd, events);
+        }
+        return ret;
+    }
+
+private:
+    explicit EpollSocketWaiter(int epollFd) :
+            FdTableSocketWaiter(), mEpollFd(epollFd) {}
+
+    int mEpollFd;
+    PodVector<struct epoll_event> mEvents;
+};
+
+#endif  // SOCKET_WAITER_HAS_EPOLL
+
+#ifdef SOCKET_WAITER_HAS_KQUEUE
+
+// A SocketWaiter based on BSD kqueues, with one filter per event type.
+// As with epoll, closing a descriptor removes its filters.
+class KqueueSocketWaiter : public FdTableSocketWaiter {
+public:
+    // Return a new instance, or NULL if kqueue is not available.
+    static KqueueSocketWaiter* create() {
+        int kqueueFd = ::kqueue();
+        if (kqueueFd < 0) {
+            return NULL;
+        }
+        ::fcntl(kqueueFd, F_SETFD, FD_CLOEXEC);
+        return new KqueueSocketWaiter(kqueueFd);
+    }
+
+    virtual ~KqueueSocketWaiter() {
+        ::close(mKqueueFd);
+    }
+
+    virtual int fd() const { return mKqueueFd; }
+
+protected:
+    virtual bool onUpdate(int fd, unsigned oldEvents, unsigned newEvents) {
+        unsigned changed = oldEvents ^ newEvents;
+        if ((changed & kEventRead) &&
+            !changeFilter(fd, EVFILT_READ, newEvents & kEventRead)) {
+            return false;
+        }
+        if ((changed & kEventWrite) &&
+            !changeFilter(fd, EVFILT_WRITE, newEvents & kEventWrite)) {
+            if (changed & kEventRead) {
+                // Restore the read filter.
+                changeFilter(fd, EVFILT_READ, oldEvents & kEventRead);
+            }
+            return false;
+        }
+        return true;
+    }
+
+    virtual int doWait(int64_t timeout_ms) {
+        struct timespec ts, *tsp = NULL;
+        if (timeout_ms >= 0 && timeout_ms != INT64_MAX) {
+            ts.tv_sec = static_cast<time_t>(timeout_ms / 1000);
+            ts.tv_nsec = static_cast<long>((timeout_ms % 1000) * 1000000);
+            tsp = &ts;
+        }
+        int maxEvents = 2 * fdCount();
+        mEvents.resize(maxEvents);
+        int ret = ::kevent(mKqueueFd, NULL, 0, mEvents.begin(), maxEvents,
+                           tsp);
+        for (int n = 0; n < ret; ++n) {
+            const struct kevent& ev = mEvents[n];
+            int fd = static_cast<int>(ev.ident);
+            unsigned events;
+            if (ev.flags & EV_ERROR) {
+                events = kEventRead | kEventWrite;
+            } else if (ev.filter == EVFILT_READ) {
+                events = kEventRead;
+            } else if (ev.filter == EVFILT_WRITE) {
+                events = kEventWrite;
+            } else {
+                continue;
+            }
+            addPendingEvents(fd, events);
+        }
+        return ret;
+    }
+
+private:
+    explicit KqueueSocketWaiter(int kqueueFd) :
+            FdTableSocketWaiter(), mKqueueFd(kqueueFd) {}
+
+    // Add or remove the |filter| of |fd|. Return true on success.
+    bool changeFilter(int fd, short filter, bool enable) {
+        struct kevent ev;
+        EV_SET(&ev, fd, filter, enable ? EV_ADD : EV_DELETE, 0, 0, NULL);
+        int ret;
+        do {
+            ret = ::kevent(mKqueueFd, &ev, 1, NULL, 0, NULL);
+        } while (ret < 0 && errno == EINTR);
+
+        if (ret < 0 && enable) {
+            LOG(ERROR) << LogString("Could not watch fd %d: %s\n",
+                                    fd, strerror(errno));
+            return false;
+        }
+        // Removing the filters of a closed descriptor fails, which is fine.
+        return true;
+    }
+
+    int mKqueueFd;
+    PodVector<struct kevent> mEvents;
+};
+
+#endif  // SOCKET_WAITER_HAS_KQUEUE
+
+// Return the backend named by the ANDROID_SOCKET_WAITER environment
+// variable, or kBackendDefault.
+SocketWaiter::Backend backendFromEnvironment() {
+    static const struct {
+        const char* name;
+        SocketWaiter::Backend backend;
+    } kBackends[] = {
+        { "select", SocketWaiter::kBackendSelect },
+        { "poll", SocketWaiter::kBackendPoll },
+        { "epoll", SocketWaiter::kBackendEpoll },
+        { "kqueue", SocketWaiter::kBackendKqueue },
+    };
+    const char* env = System::get()->envGet("ANDROID_SOCKET_WAITER");
+    if (!env || !env[0]) {
+        return SocketWaiter::kBackendDefault;
+    }
+    for (size_t n = 0; n < sizeof(kBackends) / sizeof(kBackends[0]); ++n) {
+        if (!strcmp(env, kBackends[n].name)) {
+            return kBackends[n].backend;
+        }
+    }
+    LOG(WARNING) << "Unknown ANDROID_SOCKET_WAITER value: " << env;
+    return SocketWaiter::kBackendDefault;
+}
+
 }  // namespace
 
 // static
 SocketWaiter* SocketWaiter::create() {
-    return new SelectSocketWaiter();
+    SocketWaiter* waiter = NULL;
+    Backend backend = backendFromEnvironment();
+    if (backend != kBackendDefault) {
+        waiter = createWithBackend(backend);
+        if (!waiter) {
+            LOG(WARNING) << "Unsupported ANDROID_SOCKET_WAITER value, "
+                            "using default";
+        }
+    }
+    if (!waiter) {
+        waiter = createWithBackend(kBackendDefault);
+    }
+    return waiter;
+}
+
+// static
+SocketWaiter* SocketWaiter::createWithBackend(Backend backend) {
+    switch (backend) {
+        case kBackendDefault:
+#ifdef SOCKET_WAITER_HAS_EPOLL
+            if (SocketWaiter* waiter = EpollSocketWaiter::create()) {
+                return waiter;
+            }
+#endif
+#ifdef SOCKET_WAITER_HAS_KQUEUE
+            if (SocketWaiter* waiter = KqueueSocketWaiter::create()) {
+                return waiter;
+            }
+#endif
+            return new SelectSocketWaiter();
+
+        case kBackendSelect:
+            return new SelectSocketWaiter();
+
+        case kBackendPoll:
+#ifndef _WIN32
+            return new PollSocketWaiter();
+#else
+            return NULL;
+#endif
+
+        case kBackendEpoll:
+#ifdef SOCKET_WAITER_HAS_EPOLL
+            return EpollSocketWaiter::create();
+#else
+            return NULL;
+#endif
+
+        case kBackendKqueue:
+#ifdef SOCKET_WAITER_HAS_KQUEUE
+            return KqueueSocketWaiter::create();
+#else
+            return NULL;
+#endif
+    }
+    return NULL;
 }
 
 }  // namespace base
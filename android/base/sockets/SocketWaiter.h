@@ -66,9 +66,38 @@ public:
         kEventWrite = (1U << 1),
     };
 
-    // Create new SocketWaiter instance.
+    // The system interfaces that can implement a SocketWaiter. They are
+    // all level-triggered, and only differ in performance:
+    //
+    //   kBackendSelect: select(), available everywhere, but O(n) in the
+    //   largest watched descriptor, and limited to FD_SETSIZE.
+    //
+    //   kBackendPoll: poll(), O(n) in the number of watched descriptors,
+    //   not available on Windows.
+    //
+    //   kBackendEpoll: epoll, only on Linux.
+    //
+    //   kBackendKqueue: kqueue, only on OS X and FreeBSD.
+    //
+    // With the last two, the cost of wait() only depends on the number of
+    // descriptors that have pending events.
+    enum Backend {
+        kBackendDefault = 0,
+        kBackendSelect,
+        kBackendPoll,
+        kBackendEpoll,
+        kBackendKqueue,
+    };
+
+    // Create new SocketWaiter instance, using the best backend for the
+    // host. The ANDROID_SOCKET_WAITER environment variable can be set to
+    // 'select', 'poll', 'epoll' or 'kqueue' to force another one.
     static SocketWaiter* create();
 
+    // Create new SocketWaiter instance using a given |backend|. Return
+    // NULL if it is not supported by the host, or could not be initialized.
+    static SocketWaiter* createWithBackend(Backend backend);
+
     // Destroy the instance.
     virtual ~SocketWaiter() {}
 
@@ -108,6 +137,11 @@ public:
     // event mask.
     virtual int nextPendingFd(unsigned* fdEvents) = 0;
 
+    // Return a descriptor that becomes readable when wait(0) would report
+    // pending events, or -1 if the backend can't provide one. This allows
+    // another event loop to watch all registered descriptors at once.
+    virtual int fd() const { return -1; }
+
 protected:
     SocketWaiter() {}
 
@@ -15,6 +15,10 @@
 
 #include <gtest/gtest.h>
 
+#ifndef _WIN32
+#include <sys/select.h>
+#endif
+
 namespace android {
 namespace base {
 
@@ -121,6 +125,139 @@ TEST(SocketWaiter, waitOnWriteEvent) {
     socketClose(s1);
 }
 
+static const SocketWaiter::Backend kAllBackends[] = {
+    SocketWaiter::kBackendSelect,
+    SocketWaiter::kBackendPoll,
+    SocketWaiter::kBackendEpoll,
+    SocketWaiter::kBackendKqueue,
+};
+
+TEST(SocketWaiter, createWithBackend) {
+    ScopedPtr<SocketWaiter> waiter(
+            SocketWaiter::createWithBackend(SocketWaiter::kBackendDefault));
+    EXPECT_TRUE(waiter.get());
+
+    waiter.reset(SocketWaiter::createWithBackend(SocketWaiter::kBackendSelect));
+    EXPECT_TRUE(waiter.get());
+}
+
+TEST(SocketWaiter, allBackendsWaitOnEvents) {
+    for (size_t n = 0; n < sizeof(kAllBackends) / sizeof(kAllBackends[0]);
+         ++n) {
+        ScopedPtr<SocketWaiter> waiter(
+                SocketWaiter::createWithBackend(kAllBackends[n]));
+        if (!waiter.get()) {
+            // Not supported by this host.
+            continue;
+        }
+        SCOPED_TRACE(::testing::Message() << "backend " << kAllBackends[n]);
+
+        int s1, s2;
+        ASSERT_EQ(0, socketCreatePair(&s1, &s2));
+
+        // Nothing to read yet.
+        waiter->update(s1, SocketWaiter::kEventRead);
+        EXPECT_EQ(0, waiter->wait(0));
+        unsigned events = ~0U;
+        EXPECT_EQ(-1, waiter->nextPendingFd(&events));
+        EXPECT_EQ(0U, events);
+
+        waiter->update(s2, SocketWaiter::kEventWrite);
+        EXPECT_EQ(1, socketSend(s2, "!", 1));
+        EXPECT_EQ(2, waiter->wait(0));
+        EXPECT_EQ(SocketWaiter::kEventRead, waiter->pendingEventsFor(s1));
+        EXPECT_EQ(SocketWaiter::kEventWrite, waiter->pendingEventsFor(s2));
+
+        unsigned events1 = 0, events2 = 0;
+        for (;;) {
+            int fd = waiter->nextPendingFd(&events);
+            if (fd < 0) {
+                break;
+            }
+            if (fd == s1) {
+                events1 |= events;
+            } else if (fd == s2) {
+                events2 |= events;
+            } else {
+                ADD_FAILURE() << "Unexpected fd " << fd;
+            }
+        }
+        EXPECT_EQ(SocketWaiter::kEventRead, events1);
+        EXPECT_EQ(SocketWaiter::kEventWrite, events2);
+
+        // Events are level-triggered: unread data is reported again.
+        waiter->update(s2, 0);
+        EXPECT_EQ(1, waiter->wait(0));
+        EXPECT_EQ(s1, waiter->nextPendingFd(&events));
+        EXPECT_EQ(SocketWaiter::kEventRead, events);
+        EXPECT_EQ(-1, waiter->nextPendingFd(&events));
+
+        // Stop watching |s1| after closing it, then watch a new socket
+        // that may reuse its number.
+        socketClose(s1);
+        waiter->update(s1, 0);
+        EXPECT_FALSE(waiter->hasFds());
+
+        int s3, s4;
+        ASSERT_EQ(0, socketCreatePair(&s3, &s4));
+        waiter->update(s3, SocketWaiter::kEventWrite);
+        EXPECT_EQ(1, waiter->wait(0));
+        EXPECT_EQ(s3, waiter->nextPendingFd(&events));
+        EXPECT_EQ(SocketWaiter::kEventWrite, events);
+
+        waiter->reset();
+        EXPECT_FALSE(waiter->hasFds());
+        EXPECT_EQ(0, waiter->wait(0));
+
+        socketClose(s4);
+        socketClose(s3);
+        socketClose(s2);
+    }
+}
+
+#ifndef _WIN32
+TEST(SocketWaiter, fdBecomesReadableOnEvents) {
+    for (size_t n = 0; n < sizeof(kAllBackends) / sizeof(kAllBackends[0]);
+         ++n) {
+        ScopedPtr<SocketWaiter> waiter(
+                SocketWaiter::createWithBackend(kAllBackends[n]));
+        if (!waiter.get()) {
+            continue;
+        }
+        SCOPED_TRACE(::testing::Message() << "backend " << kAllBackends[n]);
+        int waiterFd = waiter->fd();
+        if (kAllBackends[n] == SocketWaiter::kBackendSelect ||
+            kAllBackends[n] == SocketWaiter::kBackendPoll) {
+            EXPECT_EQ(-1, waiterFd);
+            continue;
+        }
+        ASSERT_GE(waiterFd, 0);
+
+        int s1, s2;
+        ASSERT_EQ(0, socketCreatePair(&s1, &s2));
+        waiter->update(s1, SocketWaiter::kEventRead);
+
+        fd_set fds;
+        struct timeval tv = { 0, 0 };
+        FD_ZERO(&fds);
+        FD_SET(waiterFd, &fds);
+        EXPECT_EQ(0, ::select(waiterFd + 1, &fds, NULL, NULL, &tv));
+
+        EXPECT_EQ(1, socketSend(s2, "!", 1));
+        FD_ZERO(&fds);
+        FD_SET(waiterFd, &fds);
+        tv.tv_sec = 1;
+        EXPECT_EQ(1, ::select(waiterFd + 1, &fds, NULL, NULL, &tv));
+        EXPECT_EQ(1, waiter->wait(0));
+        unsigned events = 0;
+        EXPECT_EQ(s1, waiter->nextPendingFd(&events));
+        EXPECT_EQ(SocketWaiter::kEventRead, events);
+
+        socketClose(s2);
+        socketClose(s1);
+    }
+}
+#endif  // !_WIN32
 
 }  // namespace base
 }  // namespace android
@@ -74,7 +74,19 @@ private:
     }
 
     void wait(Lock* userLock) {
+#if ANDROID_LOCK_PROFILING
+        // The lock isn't held while waiting.
+        if (userLock->mSite) {
+            userLock->mSite->addHold(
+                    LockSite::nowNs() - userLock->mHoldStartNs);
+        }
         pthread_cond_wait(&mCond, &userLock->mLock);
+        if (userLock->mSite) {
+            userLock->mHoldStartNs = LockSite::nowNs();
+        }
+#else
+        pthread_cond_wait(&mCond, &userLock->mLock);
+#endif
     }
 
     void signal() {
@@ -24,19 +24,31 @@
 #  include <pthread.h>
 #endif
 
+#if ANDROID_LOCK_PROFILING
+#  include "android/base/synchronization/LockProfiler.h"
+#endif
+
 namespace android {
 namespace base {
 
 // Simple wrapper class for mutexes.
+//
+// Builds with ANDROID_LOCK_PROFILING defined to 1 record, for each lock
+// created with a name, how often and for how long threads wait for it and
+// hold it, in the LockSite of that name. Locks without a name, and all
+// locks of other builds, aren't instrumented, and the name costs nothing
+// there.
 class Lock {
 public:
     // Constructor.
     Lock() {
-#ifdef _WIN32
-        ::InitializeCriticalSection(&mLock);
-#else
-        ::pthread_mutex_init(&mLock, NULL);
-#endif
+        init(NULL);
+    }
+
+    // Constructor for a lock that is profiled as |name|, which must be a
+    // string literal. Locks with the same name share their statistics.
+    explicit Lock(const char* name) {
+        init(name);
     }
 
     // Destructor.
@@ -50,29 +62,84 @@ public:
 
     // Acquire the lock.
     void lock() {
-#ifdef _WIN32
-      ::EnterCriticalSection(&mLock);
-#else
-      ::pthread_mutex_lock(&mLock);
+#if ANDROID_LOCK_PROFILING
+        if (mSite) {
+            if (rawTryLock()) {
+                mSite->addAcquisition(false, 0);
+                mHoldStartNs = LockSite::nowNs();
+                return;
+            }
+            uint64_t startNs = LockSite::nowNs();
+            rawLock();
+            mHoldStartNs = LockSite::nowNs();
+            mSite->addAcquisition(true, mHoldStartNs - startNs);
+            return;
+        }
 #endif
+        rawLock();
     }
 
     // Release the lock.
     void unlock() {
-#ifdef _WIN32
-       ::LeaveCriticalSection(&mLock);
-#else
-       ::pthread_mutex_unlock(&mLock);
+#if ANDROID_LOCK_PROFILING
+        if (mSite) {
+            mSite->addHold(LockSite::nowNs() - mHoldStartNs);
+        }
 #endif
+        rawUnlock();
     }
 
 private:
     friend class ConditionVariable;
 
+    void init(const char* name) {
+#ifdef _WIN32
+        ::InitializeCriticalSection(&mLock);
+#else
+        ::pthread_mutex_init(&mLock, NULL);
+#endif
+#if ANDROID_LOCK_PROFILING
+        mSite = name ? LockSite::get(name) : NULL;
+        mHoldStartNs = 0;
+#else
+        (void)name;
+#endif
+    }
+
+    void rawLock() {
+#ifdef _WIN32
+        ::EnterCriticalSection(&mLock);
+#else
+        ::pthread_mutex_lock(&mLock);
+#endif
+    }
+
+#if ANDROID_LOCK_PROFILING
+    bool rawTryLock() {
+#ifdef _WIN32
+        return ::TryEnterCriticalSection(&mLock) != 0;
+#else
+        return ::pthread_mutex_trylock(&mLock) == 0;
+#endif
+    }
+#endif
+
+    void rawUnlock() {
+#ifdef _WIN32
+        ::LeaveCriticalSection(&mLock);
+#else
+        ::pthread_mutex_unlock(&mLock);
+#endif
+    }
+
 #ifdef _WIN32
     CRITICAL_SECTION mLock;
 #else
     pthread_mutex_t mLock;
+#endif
+#if ANDROID_LOCK_PROFILING
+    LockSite* mSite;
+    uint64_t mHoldStartNs;
 #endif
     DISALLOW_COPY_AND_ASSIGN(Lock);
 };
@@ -0,0 +1,80 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/base/synchronization/LockFreeMessageChannel.h"
+
+#ifdef _WIN32
+#  define WIN32_LEAN_AND_MEAN 1
+#  include <windows.h>
+#else
+#  include <unistd.h>
+#endif
+
+namespace android {
+namespace base {
+
+namespace {
+
+// Spinning only helps if the thread that makes the condition true can
+// run at the same time, so don't spin on single-CPU hosts.
+int getSpinCount(int maxSpinCount) {
+    static int sSpinCount = -1;
+    if (sSpinCount < 0) {
+#ifdef _WIN32
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        long numCpus = info.dwNumberOfProcessors;
+#else
+        long numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+        sSpinCount = (numCpus > 1) ? maxSpinCount : 0;
+    }
+    return sSpinCount;
+}
+
+}  // namespace
+
+LockFreeChannelWaiter::LockFreeChannelWaiter() :
+        mWaiters(0), mLock(), mCond() {}
+
+void LockFreeChannelWaiter::waitUntil(ReadyFunc ready, const void* opaque) {
+    int spinCount = getSpinCount(kSpinCount);
+    for (int n = 0; n < spinCount; ++n) {
+        if (ready(opaque)) {
+            return;
+        }
+    }
+
+    AutoLock lock(mLock);
+    __atomic_add_fetch(&mWaiters, 1, __ATOMIC_SEQ_CST);
+    // The sequentially-consistent increment above, and the fence in
+    // notify(), ensure that either this thread sees the condition, or the
+    // notifier sees |mWaiters| > 0 and signals us, which it can only do
+    // once we released the lock in wait().
+    while (!ready(opaque)) {
+        mCond.wait(&mLock);
+    }
+    __atomic_sub_fetch(&mWaiters, 1, __ATOMIC_SEQ_CST);
+}
+
+void LockFreeChannelWaiter::notify() {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&mWaiters, __ATOMIC_RELAXED) > 0) {
+        AutoLock lock(mLock);
+        mCond.signal();
+    }
+}
+
+}  // namespace base
+}  // namespace android
@@ -0,0 +1,250 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ANDROID_BASE_SYNCHRONIZATION_LOCK_FREE_MESSAGE_CHANNEL_H
+#define ANDROID_BASE_SYNCHRONIZATION_LOCK_FREE_MESSAGE_CHANNEL_H
+
+#include "android/base/Compiler.h"
+#include "android/base/synchronization/ConditionVariable.h"
+#include "android/base/synchronization/Lock.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace android {
+namespace base {
+
+// Lock-free alternatives to MessageChannel<>, with the same send() and
+// receive() interface, plus non-blocking trySend() and tryReceive():
+//
+//   - SpscMessageChannel<T, CAPACITY> must only be used by one sender
+//     thread and one receiver thread.
+//
+//   - MpscMessageChannel<T, CAPACITY> accepts any number of sender
+//     threads, but still a single receiver thread.
+//
+// Messages are copied without taking any lock. A thread that must block
+// because the channel is full or empty spins for a short while, then
+// sleeps on a condition variable; a lock is only taken when a thread
+// sleeps, or to wake it up.
+//
+// |CAPACITY| should be a power of 2, for faster indexing.
+
+// Helper class used to wait for a condition that other threads make true
+// without holding a lock. One instance is needed per condition.
+class LockFreeChannelWaiter {
+public:
+    typedef bool (*ReadyFunc)(const void* opaque);
+
+    LockFreeChannelWaiter();
+
+    // Return once |ready(opaque)| returns true. Spin for a while, then
+    // block until notify() is called.
+    void waitUntil(ReadyFunc ready, const void* opaque);
+
+    // Call this after making the condition true, to wake up a thread
+    // blocked in waitUntil(), if any. This is cheap when nobody waits.
+    void notify();
+
+private:
+    // Number of times the condition is checked before blocking, on hosts
+    // with several CPUs.
+    static const int kSpinCount = 1000;
+
+    int mWaiters;
+    Lock mLock;
+    ConditionVariable mCond;
+
+    DISALLOW_COPY_AND_ASSIGN(LockFreeChannelWaiter);
+};
+
+// A bounded ring buffer where the sender owns |mHead| and the receiver
+// owns |mTail|. Both are free-running counters.
+template <typename T, size_t CAPACITY>
+class SpscMessageChannel {
+public:
+    SpscMessageChannel() : mHead(0U), mTail(0U) {}
+
+    // Send |msg|, blocking while the channel is full.
+    void send(const T& msg) {
+        while (!trySend(msg)) {
+            mCanWrite.waitUntil(canWrite, this);
+        }
+    }
+
+    // Send |msg| and return true, or return false if the channel is full.
+    bool trySend(const T& msg) {
+        size_t head = mHead;
+        if (head - __atomic_load_n(&mTail, __ATOMIC_ACQUIRE) >= CAPACITY) {
+            return false;
+        }
+        mItems[head % CAPACITY] = msg;
+        __atomic_store_n(&mHead, head + 1U, __ATOMIC_RELEASE);
+        mCanRead.notify();
+        return true;
+    }
+
+    // Receive a message into |*msg|, blocking while the channel is empty.
+    void receive(T* msg) {
+        while (!tryReceive(msg)) {
+            mCanRead.waitUntil(canRead, this);
+        }
+    }
+
+    // Receive a message into |*msg| and return true, or return false if
+    // the channel is empty.
+    bool tryReceive(T* msg) {
+        size_t tail = mTail;
+        if (__atomic_load_n(&mHead, __ATOMIC_ACQUIRE) == tail) {
+            return false;
+        }
+        *msg = mItems[tail % CAPACITY];
+        __atomic_store_n(&mTail, tail + 1U, __ATOMIC_RELEASE);
+        mCanWrite.notify();
+        return true;
+    }
+
+private:
+    static bool canRead(const void* opaque) {
+        const SpscMessageChannel* c =
+                static_cast<const SpscMessageChannel*>(opaque);
+        return __atomic_load_n(&c->mHead, __ATOMIC_ACQUIRE) != c->mTail;
+    }
+
+    static bool canWrite(const void* opaque) {
+        const SpscMessageChannel* c =
+                static_cast<const SpscMessageChannel*>(opaque);
+        return c->mHead - __atomic_load_n(&c->mTail, __ATOMIC_ACQUIRE) <
+               CAPACITY;
+    }
+
+    // Keep the counters on separate cache lines, to avoid false sharing
+    // between the two threads.
+    size_t mHead;
+    char mPadding[64 - sizeof(size_t)];
+    size_t mTail;
+    LockFreeChannelWaiter mCanRead;
+    LockFreeChannelWaiter mCanWrite;
+    T mItems[CAPACITY];
+
+    DISALLOW_COPY_AND_ASSIGN(SpscMessageChannel);
+};
+
+// A bounded queue where each slot carries a sequence number that tells
+// whether it is free for the sender reserving position |pos| (it is then
+// equal to |pos|), or holds the message sent at |pos| (it is |pos + 1|).
+// Senders reserve positions with an atomic compare-and-swap on |mHead|.
+template <typename T, size_t CAPACITY>
+class MpscMessageChannel {
+public:
+    MpscMessageChannel() : mHead(0U), mTail(0U) {
+        for (size_t n = 0; n < CAPACITY; ++n) {
+            mSlots[n].seq = n;
+        }
+    }
+
+    // Send |msg|, blocking while the channel is full.
+    void send(const T& msg) {
+        while (!trySend(msg)) {
+            mCanWrite.waitUntil(canWrite, this);
+        }
+    }
+
+    // Send |msg| and return true, or return false if the channel is full.
+    bool trySend(const T& msg) {
+        size_t pos = __atomic_load_n(&mHead, __ATOMIC_RELAXED);
+        Slot* slot;
+        for (;;) {
+            slot = &mSlots[pos % CAPACITY];
+            size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (__atomic_compare_exchange_n(&mHead, &pos, pos + 1U, true,
+                                                __ATOMIC_RELAXED,
+                                                __ATOMIC_RELAXED)) {
+                    break;
+                }
+                // |pos| was updated by the failed exchange.
+            } else if (diff < 0) {
+                // The slot still holds the message sent CAPACITY
+                // positions ago.
+                return false;
+            } else {
+                pos = __atomic_load_n(&mHead, __ATOMIC_RELAXED);
+            }
+        }
+        slot->item = msg;
+        __atomic_store_n(&slot->seq, pos + 1U, __ATOMIC_RELEASE);
+        mCanRead.notify();
+        return true;
+    }
+
+    // Receive a message into |*msg|, blocking while the channel is empty.
+    void receive(T* msg) {
+        while (!tryReceive(msg)) {
+            mCanRead.waitUntil(canRead, this);
+        }
+    }
+
+    // Receive a message into |*msg| and return true, or return false if
+    // the channel is empty.
+    bool tryReceive(T* msg) {
+        size_t pos = mTail;
+        Slot* slot = &mSlots[pos % CAPACITY];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1U) {
+            return false;
+        }
+        *msg = slot->item;
+        __atomic_store_n(&slot->seq, pos + CAPACITY, __ATOMIC_RELEASE);
+        mTail = pos + 1U;
+        mCanWrite.notify();
+        return true;
+    }
+
+private:
+    struct Slot {
+        size_t seq;
+        T item;
+    };
+
+    static bool canRead(const void* opaque) {
+        const MpscMessageChannel* c =
+                static_cast<const MpscMessageChannel*>(opaque);
+        size_t pos = c->mTail;
+        return __atomic_load_n(&c->mSlots[pos % CAPACITY].seq,
+                               __ATOMIC_ACQUIRE) == pos + 1U;
+    }
+
+    static bool canWrite(const void* opaque) {
+        const MpscMessageChannel* c =
+                static_cast<const MpscMessageChannel*>(opaque);
+        size_t pos = __atomic_load_n(&c->mHead, __ATOMIC_RELAXED);
+        return __atomic_load_n(&c->mSlots[pos % CAPACITY].seq,
+                               __ATOMIC_ACQUIRE) == pos;
+    }
+
+    size_t mHead;
+    char mPadding[64 - sizeof(size_t)];
+    size_t mTail;
+    LockFreeChannelWaiter mCanRead;
+    LockFreeChannelWaiter mCanWrite;
+    Slot mSlots[CAPACITY];
+
+    DISALLOW_COPY_AND_ASSIGN(MpscMessageChannel);
+};
+
+}  // namespace base
+}  // namespace android
+
+#endif  // ANDROID_BASE_SYNCHRONIZATION_LOCK_FREE_MESSAGE_CHANNEL_H
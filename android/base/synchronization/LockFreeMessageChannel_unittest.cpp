@@ -0,0 +1,139 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/base/synchronization/LockFreeMessageChannel.h"
+
+#include "android/base/testing/TestThread.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+namespace android {
+namespace base {
+
+namespace {
+
+const size_t kNumSenders = 4;
+const size_t kMessagesPerSender = 20000;
+
+struct SpscState {
+    SpscMessageChannel<size_t, 4U> channel;
+};
+
+void* spscSenderFunction(void* param) {
+    SpscState* s = static_cast<SpscState*>(param);
+    for (size_t n = 0; n < kMessagesPerSender; ++n) {
+        s->channel.send(n);
+    }
+    return 0;
+}
+
+struct MpscState {
+    MpscMessageChannel<size_t, 8U> channel;
+};
+
+struct MpscSender {
+    MpscState* state;
+    size_t id;
+};
+
+void* mpscSenderFunction(void* param) {
+    MpscSender* sender = static_cast<MpscSender*>(param);
+    for (size_t n = 0; n < kMessagesPerSender; ++n) {
+        // Encode the sender in the low bits of each message.
+        sender->state->channel.send(n * kNumSenders + sender->id);
+    }
+    return 0;
+}
+
+}  // namespace
+
+TEST(SpscMessageChannel, SingleThreadWithStdString) {
+    SpscMessageChannel<std::string, 2U> channel;
+    EXPECT_TRUE(channel.trySend(std::string("foo")));
+    EXPECT_TRUE(channel.trySend(std::string("bar")));
+    EXPECT_FALSE(channel.trySend(std::string("zoo")));
+
+    std::string str;
+    channel.receive(&str);
+    EXPECT_STREQ("foo", str.c_str());
+    channel.send(std::string("zoo"));
+    EXPECT_TRUE(channel.tryReceive(&str));
+    EXPECT_STREQ("bar", str.c_str());
+    EXPECT_TRUE(channel.tryReceive(&str));
+    EXPECT_STREQ("zoo", str.c_str());
+    EXPECT_FALSE(channel.tryReceive(&str));
+}
+
+TEST(SpscMessageChannel, TwoThreads) {
+    SpscState state;
+    TestThread* thread = new TestThread(spscSenderFunction, &state);
+
+    for (size_t n = 0; n < kMessagesPerSender; ++n) {
+        size_t value;
+        state.channel.receive(&value);
+        ASSERT_EQ(n, value);
+    }
+
+    thread->join();
+    delete thread;
+}
+
+TEST(MpscMessageChannel, SingleThreadWithStdString) {
+    MpscMessageChannel<std::string, 2U> channel;
+    EXPECT_TRUE(channel.trySend(std::string("foo")));
+    EXPECT_TRUE(channel.trySend(std::string("bar")));
+    EXPECT_FALSE(channel.trySend(std::string("zoo")));
+
+    std::string str;
+    channel.receive(&str);
+    EXPECT_STREQ("foo", str.c_str());
+    channel.send(std::string("zoo"));
+    EXPECT_TRUE(channel.tryReceive(&str));
+    EXPECT_STREQ("bar", str.c_str());
+    EXPECT_TRUE(channel.tryReceive(&str));
+    EXPECT_STREQ("zoo", str.c_str());
+    EXPECT_FALSE(channel.tryReceive(&str));
+}
+
+TEST(MpscMessageChannel, ManySenders) {
+    MpscState state;
+    MpscSender senders[kNumSenders];
+    TestThread* threads[kNumSenders];
+    for (size_t n = 0; n < kNumSenders; ++n) {
+        senders[n].state = &state;
+        senders[n].id = n;
+        threads[n] = new TestThread(mpscSenderFunction, &senders[n]);
+    }
+
+    // Messages from each sender must arrive in order, without loss.
+    size_t expected[kNumSenders] = {};
+    for (size_t n = 0; n < kNumSenders * kMessagesPerSender; ++n) {
+        size_t value;
+        state.channel.receive(&value);
+        size_t id = value % kNumSenders;
+        ASSERT_EQ(expected[id], value / kNumSenders);
+        expected[id]++;
+    }
+
+    for (size_t n = 0; n < kNumSenders; ++n) {
+        threads[n]->join();
+        delete threads[n];
+        EXPECT_EQ(kMessagesPerSender, expected[n]);
+    }
+}
+
+}  // namespace base
+}  // namespace android
@@ -0,0 +1,215 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/base/synchronization/LockProfiler.h"
+
+#include "android/base/memory/LazyInstance.h"
+#include "android/base/synchronization/Lock.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <time.h>
+#else
+#include <sys/time.h>
+#endif
+
+namespace android {
+namespace base {
+
+// The list of all sites. Its lock has no name, so isn't profiled.
+class LockSiteRegistry {
+public:
+    LockSiteRegistry() : mLock(), mHead(NULL) {}
+
+    LockSite* get(const char* name) {
+        AutoLock lock(mLock);
+        for (LockSite* site = mHead; site; site = site->mNext) {
+            if (!strcmp(site->mName, name)) {
+                return site;
+            }
+        }
+        LockSite* site = new LockSite(name);
+        site->mNext = mHead;
+        mHead = site;
+        return site;
+    }
+
+    std::vector<LockSite*> sites() {
+        AutoLock lock(mLock);
+        std::vector<LockSite*> result;
+        for (LockSite* site = mHead; site; site = site->mNext) {
+            result.push_back(site);
+        }
+        return result;
+    }
+
+private:
+    Lock mLock;
+    LockSite* mHead;
+};
+
+namespace {
+
+LazyInstance<LockSiteRegistry> sRegistry = LAZY_INSTANCE_INIT;
+
+void atomicMax(uint64_t* target, uint64_t value) {
+    uint64_t current = __atomic_load_n(target, __ATOMIC_RELAXED);
+    while (value > current &&
+           !__atomic_compare_exchange_n(target, &current, value, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+struct SiteStats {
+    const char* name;
+    LockSite::Stats stats;
+
+    bool operator<(const SiteStats& other) const {
+        return stats.waitNs > other.stats.waitNs;
+    }
+};
+
+}  // namespace
+
+LockSite::LockSite(const char* name) : mName(name), mNext(NULL) {
+    memset(&mStats, 0, sizeof(mStats));
+}
+
+// static
+LockSite* LockSite::get(const char* name) {
+    return sRegistry->get(name);
+}
+
+void LockSite::addAcquisition(bool contended, uint64_t waitNs) {
+    __atomic_fetch_add(&mStats.acquisitions, 1, __ATOMIC_RELAXED);
+    if (contended) {
+        __atomic_fetch_add(&mStats.contentions, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&mStats.waitNs, waitNs, __ATOMIC_RELAXED);
+        atomicMax(&mStats.maxWaitNs, waitNs);
+    }
+}
+
+void LockSite::addHold(uint64_t holdNs) {
+    __atomic_fetch_add(&mStats.holdNs, holdNs, __ATOMIC_RELAXED);
+    atomicMax(&mStats.maxHoldNs, holdNs);
+}
+
+LockSite::Stats LockSite::stats() const {
+    Stats result;
+    result.acquisitions = __atomic_load_n(&mStats.acquisitions,
+                                          __ATOMIC_RELAXED);
+    result.contentions = __atomic_load_n(&mStats.contentions,
+                                         __ATOMIC_RELAXED);
+    result.waitNs = __atomic_load_n(&mStats.waitNs, __ATOMIC_RELAXED);
+    result.maxWaitNs = __atomic_load_n(&mStats.maxWaitNs, __ATOMIC_RELAXED);
+    result.holdNs = __atomic_load_n(&mStats.holdNs, __ATOMIC_RELAXED);
+    result.maxHoldNs = __atomic_load_n(&mStats.maxHoldNs, __ATOMIC_RELAXED);
+    return result;
+}
+
+void LockSite::reset() {
+    __atomic_store_n(&mStats.acquisitions, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&mStats.contentions, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&mStats.waitNs, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&mStats.maxWaitNs, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&mStats.holdNs, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&mStats.maxHoldNs, 0, __ATOMIC_RELAXED);
+}
+
+// static
+uint64_t LockSite::nowNs() {
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    static bool initialized = false;
+    if (!initialized) {
+        initialized = QueryPerformanceFrequency(&freq) != FALSE;
+    }
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    // Split the conversion to avoid overflowing 64 bits.
+    uint64_t secs = now.QuadPart / freq.QuadPart;
+    uint64_t rem = now.QuadPart % freq.QuadPart;
+    return secs * 1000000000ULL + rem * 1000000000ULL / freq.QuadPart;
+#elif defined(__linux__)
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+#else
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return now.tv_sec * 1000000000ULL + now.tv_usec * 1000ULL;
+#endif
+}
+
+// static
+size_t LockSite::printAll(char* buffer, size_t bufferSize) {
+    std::string out;
+    char line[256];
+#if ANDROID_LOCK_PROFILING
+    std::vector<LockSite*> sites = sRegistry->sites();
+    std::vector<SiteStats> all;
+    for (size_t n = 0; n < sites.size(); ++n) {
+        SiteStats entry = { sites[n]->name(), sites[n]->stats() };
+        all.push_back(entry);
+    }
+    std::sort(all.begin(), all.end());
+
+    snprintf(line, sizeof(line), "%-32s %10s %10s %10s %9s %10s %9s\n",
+             "lock", "acquired", "contended", "wait ms",
+             "max wait", "held ms", "max held");
+    out.append(line);
+    for (size_t n = 0; n < all.size(); ++n) {
+        const Stats& s = all[n].stats;
+        snprintf(line, sizeof(line),
+                 "%-32s %10llu %10llu %10.1f %9.2f %10.1f %9.2f\n",
+                 all[n].name,
+                 (unsigned long long)s.acquisitions,
+                 (unsigned long long)s.contentions,
+                 s.waitNs / 1e6, s.maxWaitNs / 1e6,
+                 s.holdNs / 1e6, s.maxHoldNs / 1e6);
+        out.append(line);
+    }
+#else
+    snprintf(line, sizeof(line),
+             "lock profiling is disabled, rebuild with "
+             "android-configure.sh --lock-profiling\n");
+    out.append(line);
+#endif
+
+    if (bufferSize > 0) {
+        size_t count = std::min(out.size(), bufferSize - 1);
+        memcpy(buffer, out.c_str(), count);
+        buffer[count] = '\0';
+    }
+    return out.size();
+}
+
+// static
+void LockSite::resetAll() {
+    std::vector<LockSite*> sites = sRegistry->sites();
+    for (size_t n = 0; n < sites.size(); ++n) {
+        sites[n]->reset();
+    }
+}
+
+}  // namespace base
+}  // namespace android
@@ -0,0 +1,89 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ANDROID_BASE_SYNCHRONIZATION_LOCK_PROFILER_H
+#define ANDROID_BASE_SYNCHRONIZATION_LOCK_PROFILER_H
+
+#include "android/base/Compiler.h"
+#include "android/base/Limits.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace android {
+namespace base {
+
+// The statistics of all the locks created with the same name, collected
+// by builds with ANDROID_LOCK_PROFILING defined to 1. See Lock.h.
+//
+// A site records how many times its locks were acquired, how many of
+// these acquisitions had to wait for another thread, and for how long, and
+// how long the locks were held. Sites are created on first use and never
+// destroyed, and all their methods are thread-safe.
+class LockSite {
+public:
+    struct Stats {
+        uint64_t acquisitions;
+        uint64_t contentions;
+        uint64_t waitNs;
+        uint64_t maxWaitNs;
+        uint64_t holdNs;
+        uint64_t maxHoldNs;
+    };
+
+    // Return the site named |name|, creating it if needed. |name| must be
+    // a string literal.
+    static LockSite* get(const char* name);
+
+    const char* name() const { return mName; }
+
+    // Record an acquisition, that waited |waitNs| if |contended|.
+    void addAcquisition(bool contended, uint64_t waitNs);
+
+    // Record that a lock was held for |holdNs|.
+    void addHold(uint64_t holdNs);
+
+    // Return the statistics since the creation of the site, or the last
+    // reset().
+    Stats stats() const;
+
+    void reset();
+
+    // Return the current time of the profiler clock.
+    static uint64_t nowNs();
+
+    // Print a line per site to |buffer|, sorted by decreasing total wait
+    // time, and return the size of the full output, which is truncated
+    // if it doesn't fit in |bufferSize|, like snprintf().
+    static size_t printAll(char* buffer, size_t bufferSize);
+
+    // Reset the statistics of all sites.
+    static void resetAll();
+
+private:
+    friend class LockSiteRegistry;
+
+    explicit LockSite(const char* name);
+
+    const char* mName;
+    LockSite* mNext;
+    Stats mStats;
+
+    DISALLOW_COPY_AND_ASSIGN(LockSite);
+};
+
+}  // namespace base
+}  // namespace android
+
+#endif  // ANDROID_BASE_SYNCHRONIZATION_LOCK_PROFILER_H
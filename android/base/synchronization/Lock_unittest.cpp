@@ -33,6 +33,21 @@ TEST(Lock, LockUnlock) {
     lock.unlock();
 }
 
+// Check that a named lock works, and is profiled if enabled.
+TEST(Lock, Named) {
+    Lock lock("LockTest.Named");
+#if ANDROID_LOCK_PROFILING
+    LockSite* site = LockSite::get("LockTest.Named");
+    site->reset();
+#endif
+    lock.lock();
+    lock.unlock();
+#if ANDROID_LOCK_PROFILING
+    EXPECT_EQ(1U, site->stats().acquisitions);
+    EXPECT_EQ(0U, site->stats().contentions);
+#endif
+}
+
 // Check that AutoLock compiles and doesn't crash.
 TEST(Lock, AutoLock) {
     Lock mutex;
@@ -21,7 +21,7 @@ MessageChannelBase::MessageChannelBase(size_t capacity) :
         mPos(0U),
         mCount(0U),
         mCapacity(capacity),
-        mLock(),
+        mLock("MessageChannel::mLock"),
         mCanRead(),
         mCanWrite() {}
 
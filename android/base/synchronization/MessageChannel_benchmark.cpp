@@ -0,0 +1,119 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Micro-benchmarks comparing MessageChannel<> with its lock-free
+// alternatives, SpscMessageChannel<> and MpscMessageChannel<>:
+//
+//   - Throughput: one thread sends messages to another one, each
+//     operation is one message.
+//
+//   - RoundTrip: two threads bounce a message through a pair of
+//     channels, each operation is one round-trip.
+
+#include "android/base/synchronization/LockFreeMessageChannel.h"
+#include "android/base/synchronization/MessageChannel.h"
+#include "android/base/testing/Benchmark.h"
+#include "android/base/threads/Thread.h"
+
+using android::base::BenchmarkState;
+using android::base::MessageChannel;
+using android::base::MpscMessageChannel;
+using android::base::SpscMessageChannel;
+using android::base::Thread;
+
+namespace {
+
+const size_t kCapacity = 64;
+
+// A thread that receives <count> messages from |in|, and forwards them
+// to |out| if it is not NULL.
+template <class CHANNEL>
+class EchoThread : public Thread {
+public:
+    EchoThread(CHANNEL* in, CHANNEL* out, size_t count) :
+            Thread(), mIn(in), mOut(out), mCount(count) {}
+
+    virtual intptr_t main() {
+        for (size_t n = 0; n < mCount; ++n) {
+            size_t value;
+            mIn->receive(&value);
+            if (mOut) {
+                mOut->send(value);
+            }
+        }
+        return 0;
+    }
+
+private:
+    CHANNEL* mIn;
+    CHANNEL* mOut;
+    size_t mCount;
+};
+
+template <class CHANNEL>
+void throughput(BenchmarkState* state) {
+    CHANNEL channel;
+    size_t count = state->iterations();
+    EchoThread<CHANNEL> thread(&channel, NULL, count);
+    thread.start();
+    for (size_t n = 0; n < count; ++n) {
+        channel.send(n);
+    }
+    thread.wait(NULL);
+}
+
+template <class CHANNEL>
+void roundTrip(BenchmarkState* state) {
+    CHANNEL ping;
+    CHANNEL pong;
+    size_t count = state->iterations();
+    EchoThread<CHANNEL> thread(&ping, &pong, count);
+    thread.start();
+    for (size_t n = 0; n < count; ++n) {
+        size_t value;
+        ping.send(n);
+        pong.receive(&value);
+    }
+    thread.wait(NULL);
+}
+
+typedef MessageChannel<size_t, kCapacity> LockedChannel;
+typedef SpscMessageChannel<size_t, kCapacity> SpscChannel;
+typedef MpscMessageChannel<size_t, kCapacity> MpscChannel;
+
+}  // namespace
+
+BENCHMARK(MessageChannel, Throughput) {
+    throughput<LockedChannel>(state);
+}
+
+BENCHMARK(MessageChannel, RoundTrip) {
+    roundTrip<LockedChannel>(state);
+}
+
+BENCHMARK(SpscMessageChannel, Throughput) {
+    throughput<SpscChannel>(state);
+}
+
+BENCHMARK(SpscMessageChannel, RoundTrip) {
+    roundTrip<SpscChannel>(state);
+}
+
+BENCHMARK(MpscMessageChannel, Throughput) {
+    throughput<MpscChannel>(state);
+}
+
+BENCHMARK(MpscMessageChannel, RoundTrip) {
+    roundTrip<MpscChannel>(state);
+}
@@ -0,0 +1,283 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/base/testing/Benchmark.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+namespace android {
+namespace base {
+
+namespace {
+
+const size_t kMaxBenchmarks = 256;
+const size_t kMaxIterations = 1000000000U;
+
+struct Entry {
+    const char* group;
+    const char* name;
+    BenchmarkFactory factory;
+};
+
+struct ArgsEntry {
+    const char* group;
+    const char* name;
+    const int64_t* args;
+    size_t count;
+};
+
+// Filled by static constructors, so plain arrays rather than containers
+// that would need to be constructed first.
+Entry sEntries[kMaxBenchmarks];
+size_t sEntryCount = 0;
+ArgsEntry sArgsEntries[kMaxBenchmarks];
+size_t sArgsEntryCount = 0;
+
+uint64_t sAllocations = 0;
+
+struct Result {
+    char name[128];
+    size_t iterations;
+    double nsPerOp;
+    double allocsPerOp;
+    double bytesPerSecond;
+};
+
+void runPass(Benchmark* benchmark, BenchmarkState* state, int64_t arg) {
+    benchmark->setUp(arg);
+    state->start();
+    benchmark->run(state);
+    state->stop();
+    benchmark->tearDown();
+}
+
+// Run one benchmark with |arg|, and fill |result|.
+void runOne(const Entry& entry, int64_t arg, double minTimeNs,
+            Result* result) {
+    Benchmark* benchmark = entry.factory();
+
+    // Warmup, until a pass lasts at least a tenth of the minimum time,
+    // which also estimates the cost of an operation.
+    size_t iterations = 1;
+    double elapsedNs;
+    for (;;) {
+        BenchmarkState state(iterations, arg);
+        runPass(benchmark, &state, arg);
+        elapsedNs = state.elapsedNs();
+        if (elapsedNs >= minTimeNs / 10 || iterations >= kMaxIterations) {
+            break;
+        }
+        iterations = iterations * 10 > kMaxIterations ? kMaxIterations
+                                                       : iterations * 10;
+    }
+
+    double estimate = minTimeNs * iterations / (elapsedNs > 1 ? elapsedNs : 1);
+    iterations = estimate < 1 ? 1 :
+            (estimate > kMaxIterations ? kMaxIterations : (size_t)estimate);
+
+    BenchmarkState state(iterations, arg);
+    runPass(benchmark, &state, arg);
+    delete benchmark;
+
+    result->iterations = iterations;
+    result->nsPerOp = state.elapsedNs() / iterations;
+    result->allocsPerOp = (double)state.allocations() / iterations;
+    result->bytesPerSecond = state.elapsedNs() > 0 ?
+            state.bytesPerOp() * 1e9 * iterations / state.elapsedNs() : 0.;
+}
+
+const ArgsEntry* findArgs(const Entry& entry) {
+    for (size_t n = 0; n < sArgsEntryCount; ++n) {
+        if (!strcmp(sArgsEntries[n].group, entry.group) &&
+            !strcmp(sArgsEntries[n].name, entry.name)) {
+            return &sArgsEntries[n];
+        }
+    }
+    return NULL;
+}
+
+bool writeJson(const char* path, const Result* results, size_t count) {
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        return false;
+    }
+    fprintf(f, "{\"benchmarks\":[");
+    for (size_t n = 0; n < count; ++n) {
+        const Result& r = results[n];
+        fprintf(f, "%s\n{\"name\":\"%s\",\"iterations\":%zu,"
+                "\"ns_per_op\":%.3f,\"allocs_per_op\":%.3f",
+                n ? "," : "", r.name, r.iterations, r.nsPerOp,
+                r.allocsPerOp);
+        if (r.bytesPerSecond > 0) {
+            fprintf(f, ",\"bytes_per_second\":%.0f", r.bytesPerSecond);
+        }
+        fprintf(f, "}");
+    }
+    fprintf(f, "\n]}\n");
+    return fclose(f) == 0;
+}
+
+}  // namespace
+
+BenchmarkState::BenchmarkState(size_t iterations, int64_t arg) :
+        mIterations(iterations),
+        mArg(arg),
+        mBytesPerOp(0),
+        mRunning(false),
+        mStartNs(0),
+        mStartAllocations(0),
+        mElapsedNs(0),
+        mAllocations(0) {}
+
+void BenchmarkState::pauseTiming() {
+    if (mRunning) {
+        mElapsedNs += Benchmark::nowNs() - mStartNs;
+        mAllocations += Benchmark::allocationCount() - mStartAllocations;
+        mRunning = false;
+    }
+}
+
+void BenchmarkState::resumeTiming() {
+    if (!mRunning) {
+        mRunning = true;
+        mStartAllocations = Benchmark::allocationCount();
+        mStartNs = Benchmark::nowNs();
+    }
+}
+
+void BenchmarkState::start() {
+    mElapsedNs = 0;
+    mAllocations = 0;
+    resumeTiming();
+}
+
+void BenchmarkState::stop() {
+    pauseTiming();
+}
+
+// static
+uint64_t Benchmark::allocationCount() {
+    return __atomic_load_n(&sAllocations, __ATOMIC_RELAXED);
+}
+
+// static
+void Benchmark::countAllocation() {
+    __atomic_fetch_add(&sAllocations, 1, __ATOMIC_RELAXED);
+}
+
+// static
+double Benchmark::nowNs() {
+#ifdef _WIN32
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (double)now.QuadPart * 1e9 / (double)freq.QuadPart;
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1e9 + tv.tv_usec * 1e3;
+#endif
+}
+
+BenchmarkRegistration::BenchmarkRegistration(const char* group,
+                                             const char* name,
+                                             BenchmarkFactory factory) {
+    if (sEntryCount == kMaxBenchmarks) {
+        fprintf(stderr, "Too many benchmarks, ignoring %s.%s\n", group, name);
+        return;
+    }
+    Entry& entry = sEntries[sEntryCount++];
+    entry.group = group;
+    entry.name = name;
+    entry.factory = factory;
+}
+
+BenchmarkArgsRegistration::BenchmarkArgsRegistration(const char* group,
+                                                     const char* name,
+                                                     const int64_t* args,
+                                                     size_t count) {
+    if (sArgsEntryCount == kMaxBenchmarks) {
+        return;
+    }
+    ArgsEntry& entry = sArgsEntries[sArgsEntryCount++];
+    entry.group = group;
+    entry.name = name;
+    entry.args = args;
+    entry.count = count;
+}
+
+int runBenchmarks(const BenchmarkOptions& options) {
+    static const int64_t kNoArg = 0;
+    Result* results = new Result[kMaxBenchmarks * 8];
+    size_t resultCount = 0;
+    const size_t maxResults = kMaxBenchmarks * 8;
+    const double minTimeNs = options.minTimeMs * 1e6;
+
+    if (!options.list) {
+        printf("%-48s %12s %14s %12s %12s\n", "benchmark", "iterations",
+               "ns/op", "allocs/op", "MB/s");
+    }
+    for (size_t n = 0; n < sEntryCount; ++n) {
+        const Entry& entry = sEntries[n];
+        const ArgsEntry* argsEntry = findArgs(entry);
+        const int64_t* args = argsEntry ? argsEntry->args : &kNoArg;
+        size_t argCount = argsEntry ? argsEntry->count : 1;
+
+        for (size_t a = 0; a < argCount && resultCount < maxResults; ++a) {
+            Result& result = results[resultCount];
+            if (argsEntry) {
+                snprintf(result.name, sizeof(result.name), "%s.%s/%lld",
+                         entry.group, entry.name, (long long)args[a]);
+            } else {
+                snprintf(result.name, sizeof(result.name), "%s.%s",
+                         entry.group, entry.name);
+            }
+            if (options.filter && !strstr(result.name, options.filter)) {
+                continue;
+            }
+            if (options.list) {
+                printf("%s\n", result.name);
+                continue;
+            }
+            runOne(entry, args[a], minTimeNs, &result);
+            printf("%-48s %12zu %14.1f %12.2f", result.name,
+                   result.iterations, result.nsPerOp, result.allocsPerOp);
+            if (result.bytesPerSecond > 0) {
+                printf(" %12.1f", result.bytesPerSecond / 1e6);
+            }
+            printf("\n");
+            fflush(stdout);
+            resultCount++;
+        }
+    }
+
+    int ret = 0;
+    if (options.jsonPath && !options.list &&
+        !writeJson(options.jsonPath, results, resultCount)) {
+        fprintf(stderr, "Could not write %s\n", options.jsonPath);
+        ret = 1;
+    }
+    delete [] results;
+    return ret;
+}
+
+}  // namespace base
+}  // namespace android
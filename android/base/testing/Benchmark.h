@@ -0,0 +1,190 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ANDROID_BASE_TESTING_BENCHMARK_H
+#define ANDROID_BASE_TESTING_BENCHMARK_H
+
+#include "android/base/Compiler.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace android {
+namespace base {
+
+// A minimal micro-benchmark harness, used by emulator_benchmarks.
+//
+// Benchmarks are defined like gtest tests, and their body must run
+// |state->iterations()| times the operation being measured:
+//
+//     BENCHMARK(PodVector, PushBack) {
+//         for (size_t n = 0; n < state->iterations(); ++n) {
+//             ...
+//         }
+//     }
+//
+// Benchmarks that need some setup that shouldn't be measured derive a
+// fixture from Benchmark, and override its setUp() and tearDown():
+//
+//     class LooperBenchmark : public Benchmark { ... };
+//
+//     BENCHMARK_F(LooperBenchmark, TimerFire) { ... }
+//
+// A benchmark can also run once for each value of a list of arguments,
+// available as |state->arg()|:
+//
+//     BENCHMARK_ARGS(IpChecksum, Add, 20, 1500, 65536);
+//
+// For each benchmark and argument, the harness first runs a warmup pass
+// that also estimates the cost of an operation, then a pass of about
+// --min-time-ms milliseconds, for which it reports the time and the
+// number of heap allocations per operation.
+//
+// See BenchmarkMain.cpp for the command-line options.
+
+class BenchmarkState {
+public:
+    BenchmarkState(size_t iterations, int64_t arg);
+
+    // Number of operations to run.
+    size_t iterations() const { return mIterations; }
+
+    // Argument of this run, or 0.
+    int64_t arg() const { return mArg; }
+
+    // Set the number of bytes that each operation processes, to report
+    // a throughput too.
+    void setBytesPerOp(uint64_t bytes) { mBytesPerOp = bytes; }
+    uint64_t bytesPerOp() const { return mBytesPerOp; }
+
+    // Stop and restart measuring, around work that must not be counted.
+    void pauseTiming();
+    void resumeTiming();
+
+    // Start and stop a pass, used by the harness.
+    void start();
+    void stop();
+
+    // Results of the pass, once stopped.
+    double elapsedNs() const { return mElapsedNs; }
+    uint64_t allocations() const { return mAllocations; }
+
+private:
+    size_t mIterations;
+    int64_t mArg;
+    uint64_t mBytesPerOp;
+    bool mRunning;
+    double mStartNs;
+    uint64_t mStartAllocations;
+    double mElapsedNs;
+    uint64_t mAllocations;
+};
+
+class Benchmark {
+public:
+    Benchmark() {}
+    virtual ~Benchmark() {}
+
+    // Called before each pass, not measured.
+    virtual void setUp(int64_t /*arg*/) {}
+
+    // Called after each pass, not measured.
+    virtual void tearDown() {}
+
+    // The benchmark body.
+    virtual void run(BenchmarkState* state) = 0;
+
+    // Return the number of heap allocations made by the program so far,
+    // or 0 if they can't be counted.
+    static uint64_t allocationCount();
+
+    // Count one heap allocation, called by the allocator hooks.
+    static void countAllocation();
+
+    // Return the current time in nanoseconds.
+    static double nowNs();
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(Benchmark);
+};
+
+typedef Benchmark* (*BenchmarkFactory)();
+
+// Add a benchmark to the registry, done by the macros below.
+class BenchmarkRegistration {
+public:
+    BenchmarkRegistration(const char* group,
+                          const char* name,
+                          BenchmarkFactory factory);
+};
+
+// Set the arguments of a registered benchmark, done by BENCHMARK_ARGS.
+class BenchmarkArgsRegistration {
+public:
+    BenchmarkArgsRegistration(const char* group,
+                              const char* name,
+                              const int64_t* args,
+                              size_t count);
+};
+
+struct BenchmarkOptions {
+    BenchmarkOptions() :
+            filter(NULL), jsonPath(NULL), minTimeMs(200), list(false) {}
+
+    // Only run the benchmarks whose name contains this string, if any.
+    const char* filter;
+    // Also write the results as JSON to this file, if any.
+    const char* jsonPath;
+    // Minimum duration of the measured pass of each benchmark.
+    int minTimeMs;
+    // Only list the benchmarks.
+    bool list;
+};
+
+// Run all registered benchmarks, return 0 on success.
+int runBenchmarks(const BenchmarkOptions& options);
+
+}  // namespace base
+}  // namespace android
+
+#define BENCHMARK_CLASS_NAME_(group, name)  group##_##name##_Benchmark
+
+#define BENCHMARK_DEFINE_(fixture, group, name) \
+    class BENCHMARK_CLASS_NAME_(group, name) : public fixture { \
+    public: \
+        virtual void run(::android::base::BenchmarkState* state); \
+        static ::android::base::Benchmark* create() { \
+            return new BENCHMARK_CLASS_NAME_(group, name)(); \
+        } \
+    }; \
+    static ::android::base::BenchmarkRegistration \
+            group##_##name##_registration( \
+                    #group, #name, &BENCHMARK_CLASS_NAME_(group, name)::create); \
+    void BENCHMARK_CLASS_NAME_(group, name)::run( \
+            ::android::base::BenchmarkState* state)
+
+#define BENCHMARK(group, name) \
+    BENCHMARK_DEFINE_(::android::base::Benchmark, group, name)
+
+#define BENCHMARK_F(fixture, name) \
+    BENCHMARK_DEFINE_(fixture, fixture, name)
+
+#define BENCHMARK_ARGS(group, name, ...) \
+    static const int64_t group##_##name##_args[] = { __VA_ARGS__ }; \
+    static ::android::base::BenchmarkArgsRegistration \
+            group##_##name##_args_registration( \
+                    #group, #name, group##_##name##_args, \
+                    sizeof(group##_##name##_args) / sizeof(int64_t))
+
+#endif  // ANDROID_BASE_TESTING_BENCHMARK_H
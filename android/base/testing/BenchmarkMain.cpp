@@ -0,0 +1,124 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// The main() of emulator_benchmarks, and the allocator hooks that count
+// heap allocations.
+//
+// Usage: emulator_benchmarks [--filter=<text>] [--json=<file>]
+//                            [--min-time-ms=<ms>] [--list]
+
+#include "android/base/testing/Benchmark.h"
+
+#include <new>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using android::base::Benchmark;
+using android::base::BenchmarkOptions;
+
+#if defined(__linux__) && defined(__GLIBC__)
+
+// Count all allocations, including those of C code, by interposing the
+// malloc() family. operator new() uses malloc() too.
+extern "C" {
+
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+
+void* malloc(size_t size) {
+    Benchmark::countAllocation();
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    Benchmark::countAllocation();
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    Benchmark::countAllocation();
+    return __libc_realloc(ptr, size);
+}
+
+}  // extern "C"
+
+#else  // !__GLIBC__
+
+// Elsewhere, only count the allocations of C++ code.
+void* operator new(size_t size) throw(std::bad_alloc) {
+    Benchmark::countAllocation();
+    void* ptr = malloc(size ? size : 1);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](size_t size) throw(std::bad_alloc) {
+    return operator new(size);
+}
+
+void operator delete(void* ptr) throw() {
+    free(ptr);
+}
+
+void operator delete[](void* ptr) throw() {
+    free(ptr);
+}
+
+#endif  // !__GLIBC__
+
+namespace {
+
+void usage(const char* program) {
+    fprintf(stderr,
+            "Usage: %s [--filter=<text>] [--json=<file>] "
+            "[--min-time-ms=<ms>] [--list]\n\n"
+            "  --filter=<text>     only run benchmarks whose name contains "
+            "<text>\n"
+            "  --json=<file>       also write the results as JSON\n"
+            "  --min-time-ms=<ms>  duration of each measurement, "
+            "default 200\n"
+            "  --list              list the benchmarks\n",
+            program);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    BenchmarkOptions options;
+    for (int n = 1; n < argc; ++n) {
+        const char* arg = argv[n];
+        if (!strncmp(arg, "--filter=", 9)) {
+            options.filter = arg + 9;
+        } else if (!strncmp(arg, "--json=", 7)) {
+            options.jsonPath = arg + 7;
+        } else if (!strncmp(arg, "--min-time-ms=", 14)) {
+            options.minTimeMs = atoi(arg + 14);
+            if (options.minTimeMs <= 0) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (!strcmp(arg, "--list")) {
+            options.list = true;
+        } else {
+            usage(argv[0]);
+            return strcmp(arg, "--help") ? 1 : 0;
+        }
+    }
+    return android::base::runBenchmarks(options);
+}
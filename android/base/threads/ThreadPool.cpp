@@ -0,0 +1,323 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/base/threads/ThreadPool.h"
+
+#include "android/base/Log.h"
+#include "android/base/threads/Thread.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef _WIN32
+#  include <windows.h>
+#  undef ERROR
+#else
+#  include <unistd.h>
+#endif
+
+namespace android {
+namespace base {
+
+class ThreadPool::WorkerThread : public Thread {
+public:
+    WorkerThread(ThreadPool* pool, int index) :
+            Thread(), mPool(pool), mIndex(index) {}
+
+    virtual intptr_t main() {
+        mPool->workerMain(mIndex);
+        return 0;
+    }
+
+private:
+    ThreadPool* mPool;
+    int mIndex;
+};
+
+ThreadPool::Future::Future() : mPending(0), mLock(), mCond() {}
+
+ThreadPool::Future::~Future() {
+    wait();
+}
+
+bool ThreadPool::Future::isDone() const {
+    AutoLock lock(mLock);
+    return mPending == 0;
+}
+
+void ThreadPool::Future::wait() {
+    AutoLock lock(mLock);
+    while (mPending > 0) {
+        mCond.wait(&mLock);
+    }
+}
+
+void ThreadPool::Future::addTask() {
+    AutoLock lock(mLock);
+    mPending++;
+}
+
+void ThreadPool::Future::completeTask() {
+    AutoLock lock(mLock);
+    if (--mPending == 0) {
+        mCond.signal();
+    }
+}
+
+ThreadPool::ThreadPool(int numThreads) :
+        mWorkers(),
+        mQueues(NULL),
+        mCurrentWorker(NULL),
+        mNextQueue(0),
+        mQueuedCount(0),
+        mIdleCount(0),
+        mQuit(false),
+        mLock("ThreadPool::mLock"),
+        mCond() {
+    if (numThreads <= 0) {
+        numThreads = getHostCoreCount();
+    }
+    mQueues = new Queue[numThreads];
+    mWorkers.resize(static_cast<size_t>(numThreads));
+    for (int n = 0; n < numThreads; ++n) {
+        mWorkers[n] = new WorkerThread(this, n);
+    }
+    for (int n = 0; n < numThreads; ++n) {
+        if (!mWorkers[n]->start()) {
+            LOG(FATAL) << "Could not start thread pool worker";
+        }
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    mLock.lock();
+    mQuit = true;
+    for (size_t n = 0; n < mWorkers.size(); ++n) {
+        mCond.signal();
+    }
+    mLock.unlock();
+
+    for (size_t n = 0; n < mWorkers.size(); ++n) {
+        mWorkers[n]->wait(NULL);
+        delete mWorkers[n];
+    }
+    delete [] mQueues;
+}
+
+// static
+int ThreadPool::getHostCoreCount() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    long numCores = info.dwNumberOfProcessors;
+#else
+    long numCores = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return (numCores > 1) ? static_cast<int>(numCores) : 1;
+}
+
+void ThreadPool::post(Callback callback, void* opaque, Future* future) {
+    if (future) {
+        future->addTask();
+    }
+    Task task = { callback, opaque, future };
+    pushTask(task);
+}
+
+void ThreadPool::wait(Future* future) {
+    while (!future->isDone()) {
+        Task task;
+        if (!takeTask(&task)) {
+            // All remaining tasks of |future| are running on other
+            // threads, just block until they complete.
+            future->wait();
+            break;
+        }
+        runTask(task);
+    }
+}
+
+namespace {
+
+struct RangeTask {
+    ThreadPool::RangeCallback callback;
+    void* opaque;
+    size_t begin;
+    size_t end;
+};
+
+void runRangeTask(void* opaque) {
+    RangeTask* task = static_cast<RangeTask*>(opaque);
+    task->callback(task->opaque, task->begin, task->end);
+}
+
+}  // namespace
+
+void ThreadPool::parallelFor(size_t begin,
+                             size_t end,
+                             size_t grainSize,
+                             RangeCallback callback,
+                             void* opaque) {
+    if (begin >= end) {
+        return;
+    }
+    if (!grainSize) {
+        grainSize = 1U;
+    }
+    // A few chunks per thread is enough to balance the load, more only
+    // adds overhead.
+    size_t count = end - begin;
+    size_t numChunks = (count + grainSize - 1U) / grainSize;
+    size_t maxChunks = 4U * (mWorkers.size() + 1U);
+    if (numChunks > maxChunks) {
+        numChunks = maxChunks;
+    }
+    if (numChunks <= 1U) {
+        callback(opaque, begin, end);
+        return;
+    }
+    size_t chunkSize = (count + numChunks - 1U) / numChunks;
+    numChunks = (count + chunkSize - 1U) / chunkSize;
+
+    PodVector<RangeTask> tasks;
+    tasks.resize(numChunks);
+    for (size_t n = 0; n < numChunks; ++n) {
+        tasks[n].callback = callback;
+        tasks[n].opaque = opaque;
+        tasks[n].begin = begin + n * chunkSize;
+        tasks[n].end = (n + 1U == numChunks) ? end
+                                             : tasks[n].begin + chunkSize;
+    }
+
+    // Run the first chunk on the calling thread.
+    Future future;
+    for (size_t n = 1U; n < numChunks; ++n) {
+        post(runRangeTask, &tasks[n], &future);
+    }
+    runRangeTask(&tasks[0]);
+    wait(&future);
+}
+
+int ThreadPool::currentWorker() const {
+    return static_cast<int>(
+            reinterpret_cast<intptr_t>(mCurrentWorker.get())) - 1;
+}
+
+void ThreadPool::pushTask(const Task& task) {
+    int index = currentWorker();
+    if (index < 0) {
+        index = static_cast<int>(
+                static_cast<unsigned>(__atomic_fetch_add(
+                        &mNextQueue, 1, __ATOMIC_RELAXED)) %
+                mWorkers.size());
+    }
+    Queue& queue = mQueues[index];
+    queue.lock.lock();
+    queue.tasks.push_back(task);
+    queue.lock.unlock();
+
+    __atomic_add_fetch(&mQueuedCount, 1, __ATOMIC_SEQ_CST);
+
+    // Workers check |mQueuedCount| with |mLock| held before sleeping, so
+    // taking it here ensures the wake-up can't be lost.
+    AutoLock lock(mLock);
+    if (mIdleCount > 0) {
+        mCond.signal();
+    }
+}
+
+bool ThreadPool::takeTask(Task* task) {
+    if (__atomic_load_n(&mQueuedCount, __ATOMIC_SEQ_CST) <= 0) {
+        return false;
+    }
+    const int numQueues = numThreads();
+    int self = currentWorker();
+
+    // Take the most recent task from our own queue first.
+    if (self >= 0) {
+        Queue& queue = mQueues[self];
+        AutoLock lock(queue.lock);
+        size_t size = queue.tasks.size();
+        if (size > queue.head) {
+            *task = queue.tasks[size - 1U];
+            queue.tasks.resize(size - 1U);
+            if (queue.head == size - 1U) {
+                queue.head = 0U;
+                queue.tasks.resize(0U);
+            }
+            __atomic_sub_fetch(&mQueuedCount, 1, __ATOMIC_SEQ_CST);
+            return true;
+        }
+    }
+
+    // Otherwise, steal the oldest task of another queue.
+    int start = (self >= 0) ? self + 1 : 0;
+    for (int n = 0; n < numQueues; ++n) {
+        int index = (start + n) % numQueues;
+        if (index == self) {
+            continue;
+        }
+        Queue& queue = mQueues[index];
+        AutoLock lock(queue.lock);
+        size_t size = queue.tasks.size();
+        if (size > queue.head) {
+            *task = queue.tasks[queue.head++];
+            if (queue.head == size) {
+                queue.head = 0U;
+                queue.tasks.resize(0U);
+            } else if (queue.head >= 16U && queue.head * 2U > size) {
+                // Compact the queue to reclaim the space of stolen tasks.
+                size_t remaining = size - queue.head;
+                ::memmove(queue.tasks.begin(),
+                          queue.tasks.begin() + queue.head,
+                          remaining * sizeof(Task));
+                queue.tasks.resize(remaining);
+                queue.head = 0U;
+            }
+            __atomic_sub_fetch(&mQueuedCount, 1, __ATOMIC_SEQ_CST);
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::runTask(const Task& task) {
+    task.callback(task.opaque);
+    if (task.future) {
+        task.future->completeTask();
+    }
+}
+
+void ThreadPool::workerMain(int index) {
+    mCurrentWorker.set(reinterpret_cast<void*>(
+            static_cast<intptr_t>(index + 1)));
+    for (;;) {
+        Task task;
+        if (takeTask(&task)) {
+            runTask(task);
+            continue;
+        }
+        AutoLock lock(mLock);
+        if (__atomic_load_n(&mQueuedCount, __ATOMIC_SEQ_CST) > 0) {
+            continue;
+        }
+        if (mQuit) {
+            break;
+        }
+        mIdleCount++;
+        mCond.wait(&mLock);
+        mIdleCount--;
+    }
+    mCurrentWorker.set(NULL);
+}
+
+}  // namespace base
+}  // namespace android
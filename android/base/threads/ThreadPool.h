@@ -0,0 +1,169 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#ifndef ANDROID_BASE_THREADS_THREAD_POOL_H
+#define ANDROID_BASE_THREADS_THREAD_POOL_H
+
+#include "android/base/Compiler.h"
+#include "android/base/containers/PodVector.h"
+#include "android/base/synchronization/ConditionVariable.h"
+#include "android/base/synchronization/Lock.h"
+#include "android/base/threads/ThreadStore.h"
+
+#include <stddef.h>
+
+namespace android {
+namespace base {
+
+// A ThreadPool runs tasks on a fixed set of worker threads.
+//
+// Each worker has its own task queue. Tasks posted from a worker go to
+// the back of its own queue, and the worker picks the most recent one
+// first, which is good for locality. Tasks posted from other threads are
+// distributed round-robin. An idle worker steals the oldest task from
+// the queue of another one, so the load stays balanced.
+//
+// Usage example:
+//
+//     static void doWork(void* opaque) { ... }
+//
+//     ThreadPool pool;  // One worker per host CPU core.
+//     ThreadPool::Future future;
+//     pool.post(doWork, &data1, &future);
+//     pool.post(doWork, &data2, &future);
+//     pool.wait(&future);  // Wait for both tasks to complete.
+//
+// Or, to process a range of items in parallel:
+//
+//     static void processItems(void* opaque, size_t begin, size_t end) {
+//         Item* items = static_cast<Item*>(opaque);
+//         for (size_t n = begin; n < end; ++n) { ... process items[n] }
+//     }
+//
+//     pool.parallelFor(0, numItems, 64, processItems, items);
+//
+class ThreadPool {
+public:
+    // Type of callback functions used with post().
+    typedef void (*Callback)(void* opaque);
+
+    // Type of callback functions used with parallelFor(). Must process
+    // the items in [begin, end).
+    typedef void (*RangeCallback)(void* opaque, size_t begin, size_t end);
+
+    // A Future tracks the completion of one or more tasks. Pass it to
+    // post(), then call ThreadPool::wait() or Future::wait() to block
+    // until all tasks posted with it completed. It can be reused once
+    // it is done. Its destructor waits for pending tasks.
+    class Future {
+    public:
+        Future();
+        ~Future();
+
+        // Return true iff all tasks posted with this future completed.
+        bool isDone() const;
+
+        // Block until isDone() returns true. Only one thread should wait
+        // on a given future at a time. Prefer ThreadPool::wait() when
+        // calling this from a worker thread.
+        void wait();
+
+    private:
+        friend class ThreadPool;
+
+        void addTask();
+        void completeTask();
+
+        int mPending;
+        mutable Lock mLock;
+        ConditionVariable mCond;
+
+        DISALLOW_COPY_AND_ASSIGN(Future);
+    };
+
+    // Create a new pool with |numThreads| workers. If |numThreads| is 0,
+    // use getHostCoreCount() instead.
+    explicit ThreadPool(int numThreads = 0);
+
+    // Destructor runs all queued tasks, then stops the workers.
+    ~ThreadPool();
+
+    // Return the number of CPU cores of the host, at least 1.
+    static int getHostCoreCount();
+
+    // Return the number of worker threads of this pool.
+    int numThreads() const { return static_cast<int>(mWorkers.size()); }
+
+    // Queue a task to call |callback(opaque)| on a worker thread. If
+    // |future| is not NULL, it will track the completion of the task.
+    // Can be called from any thread, including workers.
+    void post(Callback callback, void* opaque, Future* future = NULL);
+
+    // Wait until |future| is done. When called from a worker thread of
+    // this pool, or if there are queued tasks, the calling thread runs
+    // queued tasks while waiting, instead of blocking.
+    void wait(Future* future);
+
+    // Call |callback(opaque, b, e)| for consecutive sub-ranges [b, e) that
+    // cover [begin, end), in parallel on the workers and the calling
+    // thread. Sub-ranges contain at least |grainSize| items, except for
+    // the last one. Return when all of them are processed.
+    void parallelFor(size_t begin,
+                     size_t end,
+                     size_t grainSize,
+                     RangeCallback callback,
+                     void* opaque);
+
+private:
+    class WorkerThread;
+
+    struct Task {
+        Callback callback;
+        void* opaque;
+        Future* future;
+    };
+
+    // A double-ended task queue. The owner pushes and pops at the back,
+    // thieves take from the front.
+    struct Queue {
+        Queue() : head(0U), tasks(), lock("ThreadPool::Queue::lock") {}
+
+        size_t head;
+        PodVector<Task> tasks;
+        Lock lock;
+    };
+
+    void pushTask(const Task& task);
+    bool takeTask(Task* task);
+    void runTask(const Task& task);
+    void workerMain(int index);
+
+    int currentWorker() const;
+
+    PodVector<WorkerThread*> mWorkers;
+    Queue* mQueues;
+    ThreadStoreBase mCurrentWorker;
+    int mNextQueue;
+    // Number of queued tasks.
+    int mQueuedCount;
+    // Number of workers waiting on |mCond|, protected by |mLock|.
+    int mIdleCount;
+    bool mQuit;
+    Lock mLock;
+    ConditionVariable mCond;
+
+    DISALLOW_COPY_AND_ASSIGN(ThreadPool);
+};
+
+}  // namespace base
+}  // namespace android
+
+#endif  // ANDROID_BASE_THREADS_THREAD_POOL_H
@@ -0,0 +1,148 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// A small micro-benchmark for ThreadPool:
+//
+//   - Task overhead: post <count> empty tasks and wait for them, compared
+//     to spawning one Thread per task.
+//
+//   - parallelFor: checksum a buffer of <count> KiB serially, then with
+//     parallelFor() on pools of increasing size.
+//
+// Usage: emulator_thread_pool_benchmark [<count>]
+
+#include "android/base/threads/ThreadPool.h"
+#include "android/base/threads/Thread.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+using android::base::Thread;
+using android::base::ThreadPool;
+
+namespace {
+
+double nowUs() {
+#ifdef _WIN32
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (double)now.QuadPart * 1e6 / (double)freq.QuadPart;
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1e6 + tv.tv_usec;
+#endif
+}
+
+void emptyTask(void*) {}
+
+class EmptyThread : public Thread {
+public:
+    virtual intptr_t main() { return 0; }
+};
+
+struct ChecksumState {
+    const uint8_t* data;
+    uint32_t sums[1024];
+    size_t chunkSize;
+};
+
+// Adler-like checksum of one block of data.
+uint32_t checksum(const uint8_t* data, size_t size) {
+    uint32_t a = 1, b = 0;
+    for (size_t n = 0; n < size; ++n) {
+        a = (a + data[n]) % 65521U;
+        b = (b + a) % 65521U;
+    }
+    return (b << 16) | a;
+}
+
+void checksumRange(void* opaque, size_t begin, size_t end) {
+    ChecksumState* state = static_cast<ChecksumState*>(opaque);
+    for (size_t n = begin; n < end; ++n) {
+        state->sums[n] = checksum(state->data + n * state->chunkSize,
+                                  state->chunkSize);
+    }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    size_t count = 10000;
+    if (argc > 1) {
+        count = static_cast<size_t>(atol(argv[1]));
+    }
+
+    printf("Host cores: %d\n", ThreadPool::getHostCoreCount());
+
+    {
+        ThreadPool pool;
+        ThreadPool::Future future;
+        double start = nowUs();
+        for (size_t n = 0; n < count; ++n) {
+            pool.post(emptyTask, NULL, &future);
+        }
+        pool.wait(&future);
+        double poolUs = (nowUs() - start) / count;
+
+        size_t threadCount = count / 10U + 1U;
+        start = nowUs();
+        for (size_t n = 0; n < threadCount; ++n) {
+            EmptyThread thread;
+            thread.start();
+            thread.wait(NULL);
+        }
+        double threadUs = (nowUs() - start) / threadCount;
+
+        printf("Task overhead: pool %.2f us, new thread %.2f us\n",
+               poolUs, threadUs);
+    }
+
+    const size_t kNumChunks = 1024U;
+    size_t chunkSize = (count * 1024U) / kNumChunks;
+    uint8_t* data = static_cast<uint8_t*>(malloc(kNumChunks * chunkSize));
+    for (size_t n = 0; n < kNumChunks * chunkSize; ++n) {
+        data[n] = static_cast<uint8_t>(n * 7U);
+    }
+    ChecksumState state;
+    state.data = data;
+    state.chunkSize = chunkSize;
+
+    double start = nowUs();
+    checksumRange(&state, 0, kNumChunks);
+    double serialUs = nowUs() - start;
+    uint32_t expected = state.sums[kNumChunks - 1U];
+    printf("Checksum of %lu KiB: serial %.0f us\n",
+           static_cast<unsigned long>(count), serialUs);
+
+    int maxThreads = 2 * ThreadPool::getHostCoreCount();
+    for (int numThreads = 1; numThreads <= maxThreads; numThreads *= 2) {
+        ThreadPool pool(numThreads);
+        memset(state.sums, 0, sizeof(state.sums));
+        start = nowUs();
+        pool.parallelFor(0, kNumChunks, 8, checksumRange, &state);
+        double parallelUs = nowUs() - start;
+        printf("  %d threads: %.0f us (x%.2f)%s\n", numThreads, parallelUs,
+               serialUs / parallelUs,
+               state.sums[kNumChunks - 1U] == expected ? "" : " MISMATCH");
+    }
+    free(data);
+    return 0;
+}
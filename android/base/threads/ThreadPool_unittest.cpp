@@ -0,0 +1,141 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/base/threads/ThreadPool.h"
+
+#include <gtest/gtest.h>
+
+namespace android {
+namespace base {
+
+namespace {
+
+void incrementCounter(void* opaque) {
+    __atomic_add_fetch(static_cast<int*>(opaque), 1, __ATOMIC_SEQ_CST);
+}
+
+struct RangeState {
+    int* marks;
+    int calls;
+};
+
+void markRange(void* opaque, size_t begin, size_t end) {
+    RangeState* state = static_cast<RangeState*>(opaque);
+    __atomic_add_fetch(&state->calls, 1, __ATOMIC_SEQ_CST);
+    for (size_t n = begin; n < end; ++n) {
+        state->marks[n]++;
+    }
+}
+
+struct NestedState {
+    ThreadPool* pool;
+    int counter;
+};
+
+void postNestedTasks(void* opaque) {
+    NestedState* state = static_cast<NestedState*>(opaque);
+    ThreadPool::Future future;
+    for (int n = 0; n < 10; ++n) {
+        state->pool->post(incrementCounter, &state->counter, &future);
+    }
+    state->pool->wait(&future);
+}
+
+}  // namespace
+
+TEST(ThreadPool, HostCoreCount) {
+    EXPECT_LE(1, ThreadPool::getHostCoreCount());
+}
+
+TEST(ThreadPool, DefaultNumThreads) {
+    ThreadPool pool;
+    EXPECT_EQ(ThreadPool::getHostCoreCount(), pool.numThreads());
+}
+
+TEST(ThreadPool, EmptyFutureIsDone) {
+    ThreadPool::Future future;
+    EXPECT_TRUE(future.isDone());
+    future.wait();
+}
+
+TEST(ThreadPool, PostWithFuture) {
+    ThreadPool pool(4);
+    EXPECT_EQ(4, pool.numThreads());
+    ThreadPool::Future future;
+    int counter = 0;
+    const int kCount = 1000;
+    for (int n = 0; n < kCount; ++n) {
+        pool.post(incrementCounter, &counter, &future);
+    }
+    pool.wait(&future);
+    EXPECT_TRUE(future.isDone());
+    EXPECT_EQ(kCount, counter);
+
+    // A future can be reused.
+    pool.post(incrementCounter, &counter, &future);
+    future.wait();
+    EXPECT_EQ(kCount + 1, counter);
+}
+
+TEST(ThreadPool, DestructorRunsPendingTasks) {
+    int counter = 0;
+    {
+        ThreadPool pool(2);
+        for (int n = 0; n < 100; ++n) {
+            pool.post(incrementCounter, &counter);
+        }
+    }
+    EXPECT_EQ(100, counter);
+}
+
+TEST(ThreadPool, NestedPostFromWorker) {
+    // A single worker must not deadlock when a task waits for the tasks
+    // it posted.
+    ThreadPool pool(1);
+    NestedState state = { &pool, 0 };
+    ThreadPool::Future future;
+    pool.post(postNestedTasks, &state, &future);
+    pool.wait(&future);
+    EXPECT_EQ(10, state.counter);
+}
+
+TEST(ThreadPool, ParallelFor) {
+    ThreadPool pool(3);
+    const size_t kCount = 10000;
+    int* marks = new int[kCount]();
+    RangeState state = { marks, 0 };
+    pool.parallelFor(0, kCount, 100, markRange, &state);
+    for (size_t n = 0; n < kCount; ++n) {
+        EXPECT_EQ(1, marks[n]) << n;
+    }
+    EXPECT_LT(1, state.calls);
+    delete [] marks;
+}
+
+TEST(ThreadPool, ParallelForSmallRange) {
+    ThreadPool pool(3);
+    int marks[10] = { 0 };
+    RangeState state = { marks, 0 };
+
+    // Nothing to do for an empty range.
+    pool.parallelFor(5, 5, 1, markRange, &state);
+    EXPECT_EQ(0, state.calls);
+
+    // A range smaller than the grain size is processed in one call.
+    pool.parallelFor(2, 8, 100, markRange, &state);
+    EXPECT_EQ(1, state.calls);
+    for (size_t n = 0; n < 10; ++n) {
+        EXPECT_EQ((n >= 2 && n < 8) ? 1 : 0, marks[n]) << n;
+    }
+}
+
+}  // namespace base
+}  // namespace android
@@ -0,0 +1,272 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#include "android/boot-benchmark.h"
+
+#include "android/globals.h"
+#include "android/looper.h"
+#include "android/utils/debug.h"
+#include "android/utils/startup_trace.h"
+#include "android/utils/system.h"
+#include "sysemu/sysemu.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <dirent.h>
+#endif
+
+static char*      bench_path;
+static char*      bench_accel;
+static int        bench_timeout_sec;
+static int        bench_done;
+static LoopTimer  bench_timer[1];
+
+/* Write |str| as a JSON string. */
+static void
+boot_benchmark_print_string(FILE* f, const char* str)
+{
+    fputc('"', f);
+    for (; *str; str++) {
+        unsigned char  c = *str;
+        if (c == '"' || c == '\\')
+            fprintf(f, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(f, "\\u%04x", c);
+        else
+            fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+typedef struct {
+    FILE*     file;
+    int       count;
+    uint64_t  origin_us;
+    uint64_t  completed_us;
+} MilestoneState;
+
+static void
+boot_benchmark_print_milestone(void* opaque, const char* name, uint64_t timeUs)
+{
+    MilestoneState*  state = opaque;
+
+    if (state->count == 0)
+        state->origin_us = timeUs;
+    if (!strcmp(name, "guest boot completed"))
+        state->completed_us = timeUs;
+
+    fprintf(state->file, "%s\n    {\"name\":", state->count ? "," : "");
+    boot_benchmark_print_string(state->file, name);
+    fprintf(state->file, ",\"time_ms\":%.1f}",
+            (timeUs - state->origin_us) / 1000.);
+    state->count++;
+}
+
+/* The user and system CPU time of the whole process, in milliseconds. */
+static int
+boot_benchmark_process_cpu(double* user_ms, double* system_ms)
+{
+#ifdef _WIN32
+    FILETIME  creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit,
+                         &kernel, &user))
+        return -1;
+    /* FILETIME values are in units of 100 ns. */
+    *user_ms = (((uint64_t)user.dwHighDateTime << 32) |
+                user.dwLowDateTime) / 1e4;
+    *system_ms = (((uint64_t)kernel.dwHighDateTime << 32) |
+                  kernel.dwLowDateTime) / 1e4;
+    return 0;
+#else
+    struct rusage  usage;
+    if (getrusage(RUSAGE_SELF, &usage) < 0)
+        return -1;
+    *user_ms = usage.ru_utime.tv_sec * 1e3 + usage.ru_utime.tv_usec / 1e3;
+    *system_ms = usage.ru_stime.tv_sec * 1e3 + usage.ru_stime.tv_usec / 1e3;
+    return 0;
+#endif
+}
+
+/* The peak resident memory of the process in KB, or -1 if unknown. */
+static long long
+boot_benchmark_peak_rss_kb(void)
+{
+#ifdef _WIN32
+    return -1;
+#else
+    struct rusage  usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) < 0)
+        return -1;
+#  ifdef __APPLE__
+    return usage.ru_maxrss / 1024;  /* bytes on OS X */
+#  else
+    return usage.ru_maxrss;
+#  endif
+#endif
+}
+
+/* Write the CPU time of each thread of the process, only available on
+ * Linux, as a list of JSON objects. */
+static void
+boot_benchmark_print_threads(FILE* f)
+{
+#ifdef __linux__
+    DIR*            dir = opendir("/proc/self/task");
+    struct dirent*  entry;
+    double          tick_ms = 1000. / sysconf(_SC_CLK_TCK);
+    int             count = 0;
+
+    if (!dir)
+        return;
+
+    while ((entry = readdir(dir)) != NULL) {
+        char                stat_path[64];
+        char                line[512];
+        char*               name;
+        char*               end;
+        FILE*               stat;
+        unsigned long long  utime, stime;
+
+        if (entry->d_name[0] == '.')
+            continue;
+
+        snprintf(stat_path, sizeof(stat_path), "/proc/self/task/%s/stat",
+                 entry->d_name);
+        stat = fopen(stat_path, "r");
+        if (!stat)
+            continue;
+        if (!fgets(line, sizeof(line), stat)) {
+            fclose(stat);
+            continue;
+        }
+        fclose(stat);
+
+        /* "<tid> (<name>) <state> ...", where <name> can contain spaces
+         * and parentheses, and utime and stime are the 14th and 15th
+         * fields. */
+        name = strchr(line, '(');
+        end = strrchr(line, ')');
+        if (!name || !end || end < name ||
+            sscanf(end + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u"
+                   " %llu %llu", &utime, &stime) != 2)
+            continue;
+        *end = '\0';
+
+        fprintf(f, "%s\n    {\"tid\":%s,\"name\":", count ? "," : "",
+                entry->d_name);
+        boot_benchmark_print_string(f, name + 1);
+        fprintf(f, ",\"user_ms\":%.0f,\"system_ms\":%.0f}",
+                utime * tick_ms, stime * tick_ms);
+        count++;
+    }
+    closedir(dir);
+#endif
+}
+
+static void
+boot_benchmark_write_report(int completed)
+{
+    FILE*           f;
+    MilestoneState  milestones;
+    double          user_ms, system_ms;
+    const char*     avd = android_avdInfo ? avdInfo_getName(android_avdInfo)
+                                          : NULL;
+
+    f = fopen(bench_path, "w");
+    if (!f) {
+        derror("Could not write the boot benchmark report to %s", bench_path);
+        return;
+    }
+
+    fprintf(f, "{\n  \"avd\":");
+    boot_benchmark_print_string(f, avd ? avd : "");
+    fprintf(f, ",\n  \"accel\":");
+    boot_benchmark_print_string(f, bench_accel);
+    fprintf(f, ",\n  \"gpu\":");
+    boot_benchmark_print_string(f, android_hw->hw_gpu_enabled &&
+                                   android_hw->hw_gpu_mode ?
+                                        android_hw->hw_gpu_mode : "off");
+    fprintf(f, ",\n  \"boot_completed\":%s,\n  \"timeout_sec\":%d,\n",
+            completed ? "true" : "false", bench_timeout_sec);
+
+    memset(&milestones, 0, sizeof(milestones));
+    milestones.file = f;
+    fprintf(f, "  \"milestones\":[");
+    startupTrace_forEach(boot_benchmark_print_milestone, &milestones);
+    fprintf(f, "\n  ],\n");
+    if (milestones.completed_us) {
+        fprintf(f, "  \"boot_time_ms\":%.1f,\n",
+                (milestones.completed_us - milestones.origin_us) / 1000.);
+    }
+
+    if (boot_benchmark_process_cpu(&user_ms, &system_ms) == 0) {
+        fprintf(f, "  \"cpu\":{\"user_ms\":%.0f,\"system_ms\":%.0f},\n",
+                user_ms, system_ms);
+    }
+    fprintf(f, "  \"threads\":[");
+    boot_benchmark_print_threads(f);
+    fprintf(f, "\n  ],\n  \"peak_rss_kb\":%lld\n}\n",
+            boot_benchmark_peak_rss_kb());
+
+    if (fclose(f) != 0)
+        derror("Could not write the boot benchmark report to %s", bench_path);
+}
+
+static void
+boot_benchmark_timeout(void* opaque)
+{
+    if (bench_done)
+        return;
+    bench_done = 1;
+    derror("Guest boot not completed after %d seconds", bench_timeout_sec);
+    boot_benchmark_write_report(0);
+    exit(1);
+}
+
+void
+android_boot_benchmark_start(const char* path,
+                             const char* accel,
+                             int timeout_sec)
+{
+    if (bench_path)
+        return;
+
+    bench_path = ASTRDUP(path);
+    bench_accel = ASTRDUP(accel);
+    bench_timeout_sec = timeout_sec;
+    loopTimer_init(bench_timer, looper_newCore(), boot_benchmark_timeout,
+                   NULL);
+    loopTimer_startRelative(bench_timer, (Duration)timeout_sec * 1000);
+}
+
+void
+android_boot_benchmark_boot_completed(void)
+{
+    if (!bench_path || bench_done)
+        return;
+
+    bench_done = 1;
+    loopTimer_stop(bench_timer);
+    boot_benchmark_write_report(1);
+    qemu_system_shutdown_request();
+}
@@ -0,0 +1,48 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#ifndef ANDROID_BOOT_BENCHMARK_H
+#define ANDROID_BOOT_BENCHMARK_H
+
+#include "android/utils/compiler.h"
+
+ANDROID_BEGIN_HEADER
+
+/* Guest boot benchmark, run with the -benchmark-boot <file> option.
+ *
+ * The emulator boots the guest without a window nor a snapshot, and
+ * exits once the guest reports the end of its boot, or after a timeout.
+ * It then writes to <file> a JSON report with the configuration (AVD,
+ * accelerator, GPU mode), the startup milestones of
+ * android/utils/startup_trace.h, the host CPU time of the process and of
+ * each of its threads, and its peak resident memory.
+ *
+ * The end of the boot is only reported by system images that send the
+ * 'boot-completed' command to the 'boot-properties' service. */
+
+/* Default timeout of the benchmark, in seconds. */
+#define BOOT_BENCHMARK_TIMEOUT_SEC  600
+
+/* Start the benchmark, once the guest is started. |accel| is the name of
+ * the CPU accelerator in use, e.g. "kvm", "hax" or "none". If the guest
+ * doesn't complete its boot within |timeout_sec| seconds, the report is
+ * written anyway and the emulator exits with status 1. */
+void android_boot_benchmark_start(const char* path,
+                                  const char* accel,
+                                  int timeout_sec);
+
+/* Called when the guest reports the end of its boot. If the benchmark
+ * runs, write the report and request the emulator to exit. */
+void android_boot_benchmark_boot_completed(void);
+
+ANDROID_END_HEADER
+
+#endif  /* ANDROID_BOOT_BENCHMARK_H */
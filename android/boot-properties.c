@@ -11,7 +11,9 @@
 */
 
 #include "android/boot-properties.h"
+#include "android/boot-benchmark.h"
 #include "android/utils/debug.h"
+#include "android/utils/startup_trace.h"
 #include "android/utils/system.h"
 #include "android/hw-qemud.h"
 #include "android/globals.h"
@@ -301,6 +303,7 @@ boot_property_client_recv( void*         opaque,
      */
     if (msglen == 4 && !memcmp(msg, "list", 4)) {
         BootProperty*  prop;
+        startupTrace_mark("guest boot properties");
         for (prop = _boot_properties; prop != NULL; prop = prop->next) {
             qemud_client_send(client, (uint8_t*)prop->property, prop->length);
         }
@@ -311,6 +314,15 @@ boot_property_client_recv( void*         opaque,
         return;
     }
 
+    /* the 'boot-completed' command is sent by system images that
+     * report the end of their boot, once sys.boot_completed is set.
+     */
+    if (msglen == 14 && !memcmp(msg, "boot-completed", 14)) {
+        startupTrace_mark("guest boot completed");
+        android_boot_benchmark_boot_completed();
+        return;
+    }
+
     /* unknown command ? */
     D("%s: ignoring unknown command: %.*s", __FUNCTION__, msglen, msg);
 }
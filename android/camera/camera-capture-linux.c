@@ -21,11 +21,14 @@
  */
 
 #include <sys/mman.h>
+#include <sys/select.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
 #include "android/camera/camera-capture.h"
 #include "android/camera/camera-format-converters.h"
+#include "android/camera/camera-jpeg-decoder.h"
 #include "android/utils/eintr_wrapper.h"
+#include "qemu/thread.h"
 
 #define  E(...)    derror(__VA_ARGS__)
 #define  W(...)    dwarning(__VA_ARGS__)
@@ -105,6 +108,33 @@ struct LinuxCameraDevice {
     struct CameraFrameBuffer*   framebuffers;
     /* Actual number of allocated framebuffers. */
     int                         framebuffer_num;
+
+    /*
+     * Capture thread, that dequeues frames as soon as the device produces
+     * them. See _camera_device_capture_thread.
+     */
+
+    QemuThread                  capture_thread;
+    /* Whether the capture thread is running. */
+    int                         capture_started;
+    /* Protects the fields below, shared with the capture thread. */
+    QemuMutex                   frame_lock;
+    /* Set to make the capture thread exit. */
+    int                         capture_quit;
+    /* errno value of the error that has stopped the capture thread, or 0. */
+    int                         capture_error;
+    /* Newest frame dequeued by the capture thread. It is only requeued when a
+     * newer frame replaces it, so that it can be converted at any time. */
+    struct v4l2_buffer          latest_buf;
+    /* Whether 'latest_buf' contains a frame. */
+    int                         latest_valid;
+    /* Whether the frame in 'latest_buf' hasn't been read yet. */
+    int                         latest_fresh;
+    /* Index of the buffer camera_device_read_frame is converting, or -1. */
+    int                         reading_index;
+
+    /* Decoder of the frames, when the device captures MJPEG. */
+    CameraJpegDecoder*          jpeg_decoder;
 };
 
 /* Preferred pixel formats arranged from the most to the least desired.
@@ -134,6 +164,8 @@ static const uint32_t _preferred_formats[] =
     V4L2_PIX_FMT_RGB32,
     V4L2_PIX_FMT_RGB24,
     V4L2_PIX_FMT_RGB565,
+    /* Compressed: frames have to be decoded first. */
+    V4L2_PIX_FMT_MJPEG,
 };
 /* Number of entries in _preferred_formats array. */
 static const int _preferred_format_num =
@@ -184,6 +216,20 @@ _get_format_index(uint32_t fmt, QemuPixelFormat* formats, int size)
     return f < size ? f : -1;
 }
 
+/* Returns the number of pixels in the largest frame of a pixel format. */
+static int
+_get_max_frame_area(const QemuPixelFormat* format)
+{
+    int n, area = 0;
+    for (n = 0; n < format->dim_num; n++) {
+        const int a = format->dims[n].width * format->dims[n].height;
+        if (a > area) {
+            area = a;
+        }
+    }
+    return area;
+}
+
 /*******************************************************************************
  *                     CameraFrameBuffer routines
  ******************************************************************************/
@@ -232,6 +278,241 @@ _free_framebuffers(CameraFrameBuffer* fb, int num, CameraIoType io_type)
     }
 }
 
+/*******************************************************************************
+ *                     Capture thread routines
+ ******************************************************************************/
+
+/* Queues a dequeued buffer back to the device. */
+static void
+_camera_device_requeue(LinuxCameraDevice* cd, struct v4l2_buffer* buf)
+{
+    if (_xioctl(cd->handle, VIDIOC_QBUF, buf) < 0) {
+        W("%s: VIDIOC_QBUF on camera '%s' has failed: %s",
+          __FUNCTION__, cd->device_name, strerror(errno));
+    }
+}
+
+/* Capture thread routine.
+ * Guest frame requests arrive at their own pace, so instead of dequeueing a
+ * buffer when a frame is requested (and waiting for the device), this thread
+ * dequeues frames as soon as they are available, and keeps the newest one in
+ * 'latest_buf'. The frame it replaces is requeued right away, unless it is
+ * being converted, so the device always has buffers to fill.
+ */
+static void*
+_camera_device_capture_thread(void* opaque)
+{
+    LinuxCameraDevice* cd = (LinuxCameraDevice*)opaque;
+
+    for (;;) {
+        struct v4l2_buffer buf;
+        struct timeval tv;
+        fd_set fds;
+        int quit, res;
+
+        qemu_mutex_lock(&cd->frame_lock);
+        quit = cd->capture_quit;
+        qemu_mutex_unlock(&cd->frame_lock);
+        if (quit) {
+            break;
+        }
+
+        /* Wake up periodically to check for the quit request. */
+        FD_ZERO(&fds);
+        FD_SET(cd->handle, &fds);
+        tv.tv_sec = 0;
+        tv.tv_usec = 100000;
+        res = select(cd->handle + 1, &fds, NULL, NULL, &tv);
+        if (res <= 0) {
+            if (res < 0 && errno != EINTR) {
+                E("%s: select on camera '%s' has failed: %s",
+                  __FUNCTION__, cd->device_name, strerror(errno));
+                qemu_mutex_lock(&cd->frame_lock);
+                cd->capture_error = errno;
+                qemu_mutex_unlock(&cd->frame_lock);
+                break;
+            }
+            continue;
+        }
+
+        CLEAR(buf);
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = cd->io_type == CAMERA_IO_MEMMAP ? V4L2_MEMORY_MMAP :
+                                                       V4L2_MEMORY_USERPTR;
+        if (_xioctl(cd->handle, VIDIOC_DQBUF, &buf) < 0) {
+            if (errno == EAGAIN || errno == EIO) {
+                continue;
+            }
+            E("%s: VIDIOC_DQBUF on camera '%s' has failed: %s",
+              __FUNCTION__, cd->device_name, strerror(errno));
+            qemu_mutex_lock(&cd->frame_lock);
+            cd->capture_error = errno;
+            qemu_mutex_unlock(&cd->frame_lock);
+            break;
+        }
+
+        qemu_mutex_lock(&cd->frame_lock);
+        if (cd->latest_valid &&
+            (int)cd->latest_buf.index != cd->reading_index) {
+            _camera_device_requeue(cd, &cd->latest_buf);
+        }
+        cd->latest_buf = buf;
+        cd->latest_valid = 1;
+        cd->latest_fresh = 1;
+        qemu_mutex_unlock(&cd->frame_lock);
+    }
+
+    return NULL;
+}
+
+/* Starts the capture thread, if the device has enough buffers for it: one
+ * for the newest frame, one being converted, and one being filled. */
+static void
+_camera_device_start_thread(LinuxCameraDevice* cd)
+{
+    if (cd->io_type == CAMERA_IO_DIRECT || cd->framebuffer_num < 3) {
+        D("%s: Frames from camera '%s' are read on request",
+          __FUNCTION__, cd->device_name);
+        return;
+    }
+
+    cd->capture_quit = 0;
+    cd->capture_error = 0;
+    cd->latest_valid = 0;
+    cd->latest_fresh = 0;
+    cd->reading_index = -1;
+    qemu_thread_create(&cd->capture_thread, _camera_device_capture_thread, cd,
+                       QEMU_THREAD_JOINABLE);
+    cd->capture_started = 1;
+}
+
+/* Stops the capture thread, if it is running. */
+static void
+_camera_device_stop_thread(LinuxCameraDevice* cd)
+{
+    if (!cd->capture_started) {
+        return;
+    }
+
+    qemu_mutex_lock(&cd->frame_lock);
+    cd->capture_quit = 1;
+    qemu_mutex_unlock(&cd->frame_lock);
+    qemu_thread_join(&cd->capture_thread);
+    cd->capture_started = 0;
+    cd->latest_valid = 0;
+    cd->latest_fresh = 0;
+}
+
+/* Converts a captured frame into the caller's framebuffers. MJPEG frames are
+ * decoded first, no larger than the framebuffers need.
+ * Param:
+ *  frame, size - Captured frame, and its actual size, as reported by the
+ *      driver.
+ * Return:
+ *  0 on success, 1 if the frame can't be decoded, or a negative value on
+ *  failure.
+ */
+static int
+_camera_device_convert_frame(LinuxCameraDevice* cd,
+                             const void* frame,
+                             size_t size,
+                             ClientFrameBuffer* framebuffers,
+                             int fbs_num,
+                             float r_scale,
+                             float g_scale,
+                             float b_scale,
+                             float exp_comp)
+{
+    uint32_t pixel_format = cd->actual_pixel_format.pixelformat;
+    int width = cd->actual_pixel_format.width;
+    int height = cd->actual_pixel_format.height;
+
+    if (pixel_format != V4L2_PIX_FMT_MJPEG) {
+        /* Some drivers don't set the size of uncompressed frames. */
+        size = cd->actual_pixel_format.sizeimage;
+    } else {
+        int min_width = 0;
+        int min_height = 0;
+        int n;
+        for (n = 0; n < fbs_num; n++) {
+            const int w = framebuffers[n].width ? framebuffers[n].width : width;
+            const int h = framebuffers[n].height ? framebuffers[n].height : height;
+            min_width = w > min_width ? w : min_width;
+            min_height = h > min_height ? h : min_height;
+        }
+        if (cd->jpeg_decoder == NULL) {
+            cd->jpeg_decoder = camera_jpeg_decoder_create();
+            if (cd->jpeg_decoder == NULL) {
+                E("%s: Unable to create MJPEG decoder", __FUNCTION__);
+                return -1;
+            }
+        }
+        frame = camera_jpeg_decoder_decode(cd->jpeg_decoder, frame, size,
+                                           min_width, min_height,
+                                           &width, &height);
+        if (frame == NULL) {
+            /* Webcams send corrupted frames from time to time. */
+            D("%s: Unable to decode MJPEG frame from camera '%s'",
+              __FUNCTION__, cd->device_name);
+            return 1;
+        }
+        pixel_format = V4L2_PIX_FMT_YUV420;
+        size = width * height * 3 / 2;
+    }
+
+    return convert_frame(frame, pixel_format, size, width, height,
+                         framebuffers, fbs_num,
+                         r_scale, g_scale, b_scale, exp_comp);
+}
+
+/* Converts the newest frame dequeued by the capture thread.
+ * Return:
+ *  0 on success, 1 if no new frame has been captured since the last call, or
+ *  if it can't be decoded, or a negative value on failure.
+ */
+static int
+_camera_device_read_latest_frame(LinuxCameraDevice* cd,
+                                 ClientFrameBuffer* framebuffers,
+                                 int fbs_num,
+                                 float r_scale,
+                                 float g_scale,
+                                 float b_scale,
+                                 float exp_comp)
+{
+    struct v4l2_buffer buf;
+    int res;
+
+    qemu_mutex_lock(&cd->frame_lock);
+    if (!cd->latest_valid || !cd->latest_fresh) {
+        const int error = cd->capture_error;
+        qemu_mutex_unlock(&cd->frame_lock);
+        if (error) {
+            errno = error;
+            return -1;
+        }
+        return 1;   // Tells the caller to repeat.
+    }
+    buf = cd->latest_buf;
+    cd->latest_fresh = 0;
+    cd->reading_index = buf.index;
+    qemu_mutex_unlock(&cd->frame_lock);
+
+    /* The capture thread doesn't requeue the buffer while it is converted. */
+    res = _camera_device_convert_frame(cd, cd->framebuffers[buf.index].data,
+                                       buf.bytesused, framebuffers, fbs_num,
+                                       r_scale, g_scale, b_scale, exp_comp);
+
+    qemu_mutex_lock(&cd->frame_lock);
+    cd->reading_index = -1;
+    if (!cd->latest_valid || cd->latest_buf.index != buf.index) {
+        /* A newer frame has arrived meanwhile. */
+        _camera_device_requeue(cd, &buf);
+    }
+    qemu_mutex_unlock(&cd->frame_lock);
+
+    return res;
+}
+
 /*******************************************************************************
  *                     CameraDevice routines
  ******************************************************************************/
@@ -251,6 +532,8 @@ _camera_device_alloc(void)
     memset(cd, 0, sizeof(*cd));
     cd->header.opaque = cd;
     cd->handle = -1;
+    cd->reading_index = -1;
+    qemu_mutex_init(&cd->frame_lock);
 
     return cd;
 }
@@ -261,6 +544,7 @@ static void
 _camera_device_free(LinuxCameraDevice* lcd)
 {
     if (lcd != NULL) {
+        _camera_device_stop_thread(lcd);
         /* Closing handle will also disconnect from the driver. */
         if (lcd->handle >= 0) {
             close(lcd->handle);
@@ -273,6 +557,8 @@ _camera_device_free(LinuxCameraDevice* lcd)
                                lcd->io_type);
             free(lcd->framebuffers);
         }
+        camera_jpeg_decoder_free(lcd->jpeg_decoder);
+        qemu_mutex_destroy(&lcd->frame_lock);
         AFREE(lcd);
     } else {
         E("%s: No descriptor", __FUNCTION__);
@@ -289,6 +575,9 @@ _camera_device_reset(LinuxCameraDevice* cd)
     struct v4l2_cropcap cropcap;
     struct v4l2_crop crop;
 
+    /* The capture thread uses the framebuffers, and the handle. */
+    _camera_device_stop_thread(cd);
+
     /* Free capturing framebuffers first. */
     if (cd->framebuffers != NULL) {
         _free_framebuffers(cd->framebuffers, cd->framebuffer_num, cd->io_type);
@@ -771,6 +1060,13 @@ _camera_device_get_info(LinuxCameraDevice* cd, CameraInfo* cis)
          * matter which one we choose. Lets choose the first one. */
         chosen = 0;
     }
+    /* Many webcams only provide their larger frames in MJPEG. Then it's worth
+     * decoding them. */
+    f = _get_format_index(V4L2_PIX_FMT_MJPEG, formats, num_pix_fmts);
+    if (f >= 0 &&
+        _get_max_frame_area(formats + f) > _get_max_frame_area(formats + chosen)) {
+        chosen = f;
+    }
 
     cis->device_name = ASTRDUP(cd->device_name);
     cis->inp_channel = cd->input_channel;
@@ -857,15 +1153,16 @@ camera_device_start_capturing(CameraDevice* ccd,
         _camera_device_reset(cd);
         return -1;
     }
-    /* VIDIOC_S_FMT may has changed some properties of the structure. Make sure
-     * that dimensions didn't change. */
+    /* VIDIOC_S_FMT may has changed some properties of the structure. If the
+     * device picked other dimensions, frames are scaled to the requested ones
+     * when they are converted. */
     if (fmt.fmt.pix.width != frame_width || fmt.fmt.pix.height != frame_height) {
         memcpy(fmt_str, &pixel_format, 4);
         fmt_str[4] = '\0';
-        E("%s: Dimensions %dx%d are wrong for pixel format '%s'",
-          __FUNCTION__, frame_width, frame_height, fmt_str);
-        _camera_device_reset(cd);
-        return -1;
+        D("%s: Dimensions %dx%d are not supported for pixel format '%s', "
+          "capturing %dx%d frames",
+          __FUNCTION__, frame_width, frame_height, fmt_str,
+          fmt.fmt.pix.width, fmt.fmt.pix.height);
     }
     memcpy(&cd->actual_pixel_format, &fmt.fmt.pix, sizeof(struct v4l2_pix_format));
 
@@ -915,6 +1212,7 @@ camera_device_start_capturing(CameraDevice* ccd,
             _camera_device_reset(cd);
             return -1;
         }
+        _camera_device_start_thread(cd);
     }
     return 0;
 }
@@ -943,6 +1241,7 @@ camera_device_stop_capturing(CameraDevice* ccd)
 
         case CAMERA_IO_MEMMAP:
         case CAMERA_IO_USERPTR:
+            _camera_device_stop_thread(cd);
             type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
             if (_xioctl(cd->handle, VIDIOC_STREAMOFF, &type) < 0) {
 	            E("%s: VIDIOC_STREAMOFF on camera '%s' has failed: %s",
@@ -1006,14 +1305,18 @@ camera_device_read_frame(CameraDevice* ccd,
                 }
             }
             total_read_bytes += read_bytes;
-        } while (total_read_bytes < cd->actual_pixel_format.sizeimage);
+            /* Compressed frames are smaller, and come in a single read. */
+        } while (total_read_bytes < cd->actual_pixel_format.sizeimage &&
+                 cd->actual_pixel_format.pixelformat != V4L2_PIX_FMT_MJPEG);
         /* Convert the read frame into the caller's framebuffers. */
-        return convert_frame(buff, cd->actual_pixel_format.pixelformat,
-                             cd->actual_pixel_format.sizeimage,
-                             cd->actual_pixel_format.width,
-                             cd->actual_pixel_format.height,
-                             framebuffers, fbs_num,
-                             r_scale, g_scale, b_scale, exp_comp);
+        return _camera_device_convert_frame(cd, buff, total_read_bytes,
+                                            framebuffers, fbs_num,
+                                            r_scale, g_scale, b_scale,
+                                            exp_comp);
+    } else if (cd->capture_started) {
+        return _camera_device_read_latest_frame(cd, framebuffers, fbs_num,
+                                                r_scale, g_scale, b_scale,
+                                                exp_comp);
     } else {
         /* Dequeue next buffer from the device. */
         struct v4l2_buffer buf;
@@ -1036,13 +1339,9 @@ camera_device_read_frame(CameraDevice* ccd,
         }
 
         /* Convert frame to the receiving buffers. */
-        res = convert_frame(cd->framebuffers[buf.index].data,
-                            cd->actual_pixel_format.pixelformat,
-                            cd->actual_pixel_format.sizeimage,
-                            cd->actual_pixel_format.width,
-                            cd->actual_pixel_format.height,
-                            framebuffers, fbs_num,
-                            r_scale, g_scale, b_scale, exp_comp);
+        res = _camera_device_convert_frame(cd, cd->framebuffers[buf.index].data,
+                                           buf.bytesused, framebuffers, fbs_num,
+                                           r_scale, g_scale, b_scale, exp_comp);
 
         /* Requeue the buffer back to the device. */
         if (_xioctl(cd->handle, VIDIOC_QBUF, &buf) < 0) {
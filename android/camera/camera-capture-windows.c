@@ -85,10 +85,18 @@ struct WndCameraDevice {
     /* Flags whether frame should be captured using clipboard (1), or via frame
      * callback (0) */
     int                 use_clipboard;
-    /* Contains last frame captured via frame callback. */
-    void*               last_frame;
-    /* Byte size of the 'last_frame' buffer. */
-    uint32_t            last_frame_size;
+    /* Framebuffers where the frame callback converts the captured frame, and
+     * the conversion parameters. They are only set while capGrabFrameNoStop
+     * runs, so the frame is converted directly from the driver's buffer. */
+    ClientFrameBuffer*  grab_fbs;
+    int                 grab_fbs_num;
+    float               grab_r_scale;
+    float               grab_g_scale;
+    float               grab_b_scale;
+    float               grab_exp_comp;
+    /* Result of the conversion done by the frame callback, or -1 if no frame
+     * has been captured. */
+    int                 grab_result;
 };
 
 /*******************************************************************************
@@ -148,9 +156,6 @@ _camera_device_free(WndCameraDevice* cd)
         if (cd->framebuffer != NULL) {
             free(cd->framebuffer);
         }
-        if (cd->last_frame != NULL) {
-            free(cd->last_frame);
-        }
         AFREE(cd);
     } else {
         W("%s: No descriptor", __FUNCTION__);
@@ -182,11 +187,6 @@ _camera_device_reset(WndCameraDevice* cd)
             free(cd->framebuffer);
             cd->framebuffer = NULL;
         }
-        if (cd->last_frame != NULL) {
-            free(cd->last_frame);
-            cd->last_frame = NULL;
-        }
-        cd->last_frame_size = 0;
 
         /* Recreate the capturing window. */
         DestroyWindow(cd->cap_window);
@@ -213,18 +213,6 @@ _on_captured_frame(HWND hwnd, LPVIDEOHDR hdr)
     /* Capture window descriptor is saved in window's user data. */
     WndCameraDevice* wcd = (WndCameraDevice*)capGetUserData(hwnd);
 
-    /* Reallocate frame buffer (if needed) */
-    if (wcd->last_frame_size < hdr->dwBytesUsed) {
-        wcd->last_frame_size = hdr->dwBytesUsed;
-        if (wcd->last_frame != NULL) {
-            free(wcd->last_frame);
-        }
-        wcd->last_frame = malloc(wcd->last_frame_size);
-    }
-
-    /* Copy captured frame. */
-    memcpy(wcd->last_frame, hdr->lpData, hdr->dwBytesUsed);
-
     /* If biCompression is set to default (RGB), set correct pixel format
      * for converters. */
     if (wcd->frame_bitmap->bmiHeader.biCompression == BI_RGB) {
@@ -239,6 +227,20 @@ _on_captured_frame(HWND hwnd, LPVIDEOHDR hdr)
         wcd->pixel_format = wcd->frame_bitmap->bmiHeader.biCompression;
     }
 
+    /* Convert the captured frame, unless the callback is invoked outside of
+     * _camera_device_read_frame_callback. The driver's buffer is only valid
+     * during this call. */
+    if (wcd->grab_fbs != NULL) {
+        wcd->grab_result = convert_frame(hdr->lpData,
+                                         wcd->pixel_format,
+                                         hdr->dwBytesUsed,
+                                         wcd->frame_bitmap->bmiHeader.biWidth,
+                                         wcd->frame_bitmap->bmiHeader.biHeight,
+                                         wcd->grab_fbs, wcd->grab_fbs_num,
+                                         wcd->grab_r_scale, wcd->grab_g_scale,
+                                         wcd->grab_b_scale, wcd->grab_exp_comp);
+    }
+
     return (LRESULT)0;
 }
 
@@ -555,22 +557,28 @@ _camera_device_read_frame_callback(WndCameraDevice* wcd,
                                    float b_scale,
                                    float exp_comp)
 {
+    BOOL grabbed;
+
     /* Grab the frame. Note that this call will cause frame callback to be
-     * invoked before capGrabFrameNoStop returns. */
-    if (!capGrabFrameNoStop(wcd->cap_window) || wcd->last_frame == NULL) {
+     * invoked before capGrabFrameNoStop returns, and the callback converts the
+     * frame into the framebuffers. */
+    wcd->grab_fbs = framebuffers;
+    wcd->grab_fbs_num = fbs_num;
+    wcd->grab_r_scale = r_scale;
+    wcd->grab_g_scale = g_scale;
+    wcd->grab_b_scale = b_scale;
+    wcd->grab_exp_comp = exp_comp;
+    wcd->grab_result = -1;
+    grabbed = capGrabFrameNoStop(wcd->cap_window);
+    wcd->grab_fbs = NULL;
+    wcd->grab_fbs_num = 0;
+    if (!grabbed) {
         E("%s: Device '%s' is unable to grab a frame: %d",
           __FUNCTION__, wcd->window_name, GetLastError());
         return -1;
     }
 
-    /* Convert framebuffer. */
-    return convert_frame(wcd->last_frame,
-                         wcd->pixel_format,
-                         wcd->frame_bitmap->bmiHeader.biSizeImage,
-                         wcd->frame_bitmap->bmiHeader.biWidth,
-                         wcd->frame_bitmap->bmiHeader.biHeight,
-                         framebuffers, fbs_num,
-                         r_scale, g_scale, b_scale, exp_comp);
+    return wcd->grab_result;
 }
 
 /* Capture frame using clipboard.
@@ -100,6 +100,11 @@ typedef struct ClientFrameBuffer {
     uint32_t    pixel_format;
     /* Address of the client framebuffer. */
     void*       framebuffer;
+    /* Dimensions of the client framebuffer. If they differ from the ones of
+     * the captured frame, the frame is scaled while it is converted. Zero
+     * values mean the dimensions of the captured frame. */
+    int         width;
+    int         height;
 } ClientFrameBuffer;
 
 /* Describes frame dimensions.
@@ -22,7 +22,8 @@
 #else
 #include <linux/videodev2.h>
 #endif
-#include "android/camera/camera-format-converters.h"
+#include "android/camera/camera-format-converters.h"
+#include "android/camera/camera-format-kernels.h"
 
 #define  E(...)    derror(__VA_ARGS__)
 #define  W(...)    dwarning(__VA_ARGS__)
@@ -420,10 +421,11 @@ _change_white_balance_RGB_b(uint8_t* r,
  * calculated.
  *
  * Performance considerations:
- * Since converters implemented here are intended to work as part of the camera
- * emulation, making the code super performant is not a priority at all. There
- * will be enough loses in other parts of the emultion to overlook any slight
- * inefficiences in the conversion algorithm as neglectable.
+ * The generic converters go through function pointers for each pixel, and
+ * apply white balance and exposure compensation in floating point. For the
+ * pairs of formats that are the most common, convert_frame() uses dedicated
+ * converters from camera-format-kernels.c instead, when white balance and
+ * exposure compensation don't change the colors. See _FastConverters below.
  */
 
 typedef struct RGBDesc RGBDesc;
@@ -1602,6 +1604,202 @@ _get_pixel_format_descriptor(uint32_t pixel_format)
     return NULL;
 }
 
+/********************************************************************************
+ * List of dedicated converters.
+ *******************************************************************************/
+
+/* Prototype for a dedicated converter between two pixel formats. */
+typedef void (*fast_converter_func)(const void* src,
+                                    void* dst,
+                                    int width,
+                                    int height);
+
+static void
+_YUYVToNV21(const void* src, void* dst, int width, int height)
+{
+    camera_convert_YUYV_to_NV21(src, dst, width, height);
+}
+
+static void
+_YU12ToNV21(const void* src, void* dst, int width, int height)
+{
+    camera_convert_YU12_to_NV21(src, dst, width, height);
+}
+
+static void
+_RGB32ToYV12(const void* src, void* dst, int width, int height)
+{
+    camera_convert_RGB32_to_YV12(src, dst, width, height, 0);
+}
+
+static void
+_BGR32ToYV12(const void* src, void* dst, int width, int height)
+{
+    camera_convert_RGB32_to_YV12(src, dst, width, height, 1);
+}
+
+/* Entry in the list of dedicated converters. */
+typedef struct FastConverter {
+    /* "FOURCC" (V4L2_PIX_FMT_XXX) format types to convert from, and to. */
+    uint32_t                from;
+    uint32_t                to;
+    fast_converter_func     convert;
+} FastConverter;
+
+/* Array of dedicated converters. */
+static const FastConverter _FastConverters[] = {
+    /* Webcams on Linux, to the video preview format of the guest. */
+    { V4L2_PIX_FMT_YUYV,    V4L2_PIX_FMT_NV21,      _YUYVToNV21  },
+    { V4L2_PIX_FMT_YUY2,    V4L2_PIX_FMT_NV21,      _YUYVToNV21  },
+    { V4L2_PIX_FMT_YUNV,    V4L2_PIX_FMT_NV21,      _YUYVToNV21  },
+    { V4L2_PIX_FMT_V422,    V4L2_PIX_FMT_NV21,      _YUYVToNV21  },
+    /* Frames decoded from MJPEG. */
+    { V4L2_PIX_FMT_YUV420,  V4L2_PIX_FMT_NV21,      _YU12ToNV21  },
+    /* Webcams on Windows and Mac, to the video recording format. */
+    { V4L2_PIX_FMT_RGB32,   V4L2_PIX_FMT_YVU420,    _RGB32ToYV12 },
+    { V4L2_PIX_FMT_BGR32,   V4L2_PIX_FMT_YVU420,    _BGR32ToYV12 },
+};
+static const int _FastConverters_num =
+    sizeof(_FastConverters) / sizeof(*_FastConverters);
+
+/* Get the dedicated converter between two pixel formats.
+ * Param:
+ *  from, to - "fourcc" pixel formats to convert from, and to.
+ * Return:
+ *  The converter, or NULL if there is none for these formats.
+ */
+static fast_converter_func
+_get_fast_converter(uint32_t from, uint32_t to)
+{
+    int f;
+    for (f = 0; f < _FastConverters_num; f++) {
+        if (_FastConverters[f].from == from && _FastConverters[f].to == to) {
+            return _FastConverters[f].convert;
+        }
+    }
+    return NULL;
+}
+
+/********************************************************************************
+ * Scaling converter
+ *******************************************************************************/
+
+/* Gets the colors of a pixel of a frame in any of the supported formats.
+ * Param:
+ *  desc - Frame pixel format descriptor.
+ *  frame - Beginning of the frame.
+ *  x, y - Coordinates of the pixel inside the frame.
+ *  width, height - Frame dimensions.
+ *  r, g, b - Upon return will contain RGB colors of the pixel.
+ */
+static void
+_get_pixel_RGB(const PIXFormat* desc,
+               const void* frame,
+               int x,
+               int y,
+               int width,
+               int height,
+               uint8_t* r,
+               uint8_t* g,
+               uint8_t* b)
+{
+    if (desc->format_sel == PIX_FMT_RGB) {
+        const RGBDesc* fmt = desc->desc.rgb_desc;
+        /* Lines are aligned to 16 bit, as in the generic converters. */
+        const int line_size = (width * fmt->rgb_inc + 1) & ~1;
+        fmt->load_rgb((const uint8_t*)frame + y * line_size + x * fmt->rgb_inc,
+                      r, g, b);
+    } else if (desc->format_sel == PIX_FMT_YUV) {
+        const YUVDesc* fmt = desc->desc.yuv_desc;
+        const uint8_t* yuv = (const uint8_t*)frame;
+        /* Each line of the frame contains width / 2 pairs of Y samples. */
+        const uint8_t Y = yuv[fmt->Y_offset +
+                              (y * (width / 2) + x / 2) * fmt->Y_next_pair +
+                              (x & 1) * fmt->Y_inc];
+        const uint8_t U = yuv[fmt->u_offset(fmt, y, width, height) +
+                              (x / 2) * fmt->UV_inc];
+        const uint8_t V = yuv[fmt->v_offset(fmt, y, width, height) +
+                              (x / 2) * fmt->UV_inc];
+        YUVToRGBPix(Y, U, V, r, g, b);
+    } else {
+        const BayerDesc* fmt = desc->desc.bayer_desc;
+        int red, green, blue;
+        _get_bayerRGB(fmt, frame, x, y, width, height, &red, &green, &blue);
+        if (fmt->mask == kBayer10) {
+            red >>= 2; green >>= 2; blue >>= 2;
+        } else if (fmt->mask == kBayer12) {
+            red >>= 4; green >>= 4; blue >>= 4;
+        }
+        *r = clamp(red); *g = clamp(green); *b = clamp(blue);
+    }
+}
+
+/* Converts a frame into a framebuffer of different dimensions, sampling the
+ * nearest pixel of the frame for each pixel of the framebuffer. This writes
+ * the framebuffer directly, without converting the entire frame first, so the
+ * cost only depends on the framebuffer dimensions.
+ */
+static void
+_convert_scaled(const PIXFormat* src_desc,
+                const PIXFormat* dst_desc,
+                const void* frame,
+                int width,
+                int height,
+                void* framebuffer,
+                int fb_width,
+                int fb_height,
+                float r_scale,
+                float g_scale,
+                float b_scale,
+                float exp_comp)
+{
+    int y, x;
+    if (dst_desc->format_sel == PIX_FMT_RGB) {
+        const RGBDesc* rgb_fmt = dst_desc->desc.rgb_desc;
+        void* rgb = framebuffer;
+        for (y = 0; y < fb_height; y++) {
+            const int src_y = y * height / fb_height;
+            for (x = 0; x < fb_width; x++) {
+                uint8_t r, g, b;
+                _get_pixel_RGB(src_desc, frame, x * width / fb_width, src_y,
+                               width, height, &r, &g, &b);
+                _change_white_balance_RGB_b(&r, &g, &b, r_scale, g_scale, b_scale);
+                _change_exposure_RGB(&r, &g, &b, exp_comp);
+                rgb = rgb_fmt->save_rgb(rgb, r, g, b);
+            }
+            /* Aling rgb_ptr to 16 bit */
+            if (((uintptr_t)rgb & 1) != 0) rgb = (uint8_t*)rgb + 1;
+        }
+    } else {
+        const YUVDesc* yuv_fmt = dst_desc->desc.yuv_desc;
+        const int Y_Inc = yuv_fmt->Y_inc;
+        const int UV_inc = yuv_fmt->UV_inc;
+        const int Y_next_pair = yuv_fmt->Y_next_pair;
+        uint8_t* pY = (uint8_t*)framebuffer + yuv_fmt->Y_offset;
+        for (y = 0; y < fb_height; y++) {
+            const int src_y = y * height / fb_height;
+            uint8_t* pU = (uint8_t*)framebuffer +
+                          yuv_fmt->u_offset(yuv_fmt, y, fb_width, fb_height);
+            uint8_t* pV = (uint8_t*)framebuffer +
+                          yuv_fmt->v_offset(yuv_fmt, y, fb_width, fb_height);
+            for (x = 0; x < fb_width; x += 2,
+                                      pY += Y_next_pair, pU += UV_inc, pV += UV_inc) {
+                uint8_t r, g, b;
+                _get_pixel_RGB(src_desc, frame, x * width / fb_width, src_y,
+                               width, height, &r, &g, &b);
+                _change_white_balance_RGB_b(&r, &g, &b, r_scale, g_scale, b_scale);
+                _change_exposure_RGB(&r, &g, &b, exp_comp);
+                R8G8B8ToYUV(r, g, b, pY, pU, pV);
+                _get_pixel_RGB(src_desc, frame, (x + 1) * width / fb_width, src_y,
+                               width, height, &r, &g, &b);
+                _change_white_balance_RGB_b(&r, &g, &b, r_scale, g_scale, b_scale);
+                _change_exposure_RGB(&r, &g, &b, exp_comp);
+                pY[Y_Inc] = RGB2Y((int)r, (int)g, (int)b);
+            }
+        }
+    }
+}
+
 /********************************************************************************
  * Public API
  *******************************************************************************/
@@ -1613,6 +1811,11 @@ has_converter(uint32_t from, uint32_t to)
         /* Same format: converter esists. */
         return 1;
     }
+    if (from == V4L2_PIX_FMT_MJPEG) {
+        /* The capture code decodes MJPEG frames into YU12, see
+         * camera-jpeg-decoder.h. */
+        from = V4L2_PIX_FMT_YUV420;
+    }
     return _get_pixel_format_descriptor(from) != NULL &&
            _get_pixel_format_descriptor(to) != NULL;
 }
@@ -1631,6 +1834,10 @@ convert_frame(const void* frame,
               float exp_comp)
 {
     int n;
+    /* The dedicated converters don't apply white balance and exposure
+     * compensation, and work on pairs of pixels in both directions. */
+    const int fast = r_scale == 1.0f && g_scale == 1.0f && b_scale == 1.0f &&
+                     exp_comp == 1.0f && ((width | height) & 1) == 0;
     const PIXFormat* src_desc = _get_pixel_format_descriptor(pixel_format);
     if (src_desc == NULL) {
         E("%s: Source pixel format %.4s is unknown",
@@ -1645,11 +1852,29 @@ convert_frame(const void* frame,
          * thrugh the converters to apply these things. */
         const PIXFormat* dst_desc =
             _get_pixel_format_descriptor(framebuffers[n].pixel_format);
+        const int fb_width =
+            framebuffers[n].width ? framebuffers[n].width : width;
+        const int fb_height =
+            framebuffers[n].height ? framebuffers[n].height : height;
         if (dst_desc == NULL) {
             E("%s: Destination pixel format %.4s is unknown",
               __FUNCTION__, (const char*)&framebuffers[n].pixel_format);
             return -1;
         }
+        if (fb_width != width || fb_height != height) {
+            _convert_scaled(src_desc, dst_desc, frame, width, height,
+                            framebuffers[n].framebuffer, fb_width, fb_height,
+                            r_scale, g_scale, b_scale, exp_comp);
+            continue;
+        }
+        if (fast) {
+            fast_converter_func convert =
+                _get_fast_converter(pixel_format, framebuffers[n].pixel_format);
+            if (convert != NULL) {
+                convert(frame, framebuffers[n].framebuffer, width, height);
+                continue;
+            }
+        }
         switch (src_desc->format_sel) {
             case PIX_FMT_RGB:
                 if (dst_desc->format_sel == PIX_FMT_RGB) {
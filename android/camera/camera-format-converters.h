@@ -51,7 +51,9 @@ extern int has_converter(uint32_t from, uint32_t to);
  *  framebuffers - Array of framebuffers where to convert the frame. Size of this
  *      array is defined by the 'fbs_num' parameter. Note that the caller must
  *      make sure that buffers are large enough to contain entire frame captured
- *      from the device.
+ *      from the device, or the frame scaled to the framebuffer dimensions when
+ *      they are set. Scaled frames are converted in a single pass, directly
+ *      into the framebuffer.
  *  fbs_num - Number of entries in the 'framebuffers' array.
  *  r_scale, g_scale, b_scale - White balance scale.
  *  exp_comp - Expsoure compensation.
@@ -0,0 +1,415 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "android/camera/camera-format-kernels.h"
+
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define KERNELS_USE_SSE2 1
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define KERNELS_USE_NEON 1
+#endif
+
+#if KERNELS_USE_SSE2 || KERNELS_USE_NEON
+#define KERNELS_USE_SIMD 1
+#endif
+
+static int _kernels_simd = 1;
+
+void
+camera_format_kernels_set_simd(int enable)
+{
+    _kernels_simd = enable;
+}
+
+/* Same as the RGB2Y/RGB2U/RGB2V macros of camera-format-converters.c. All
+ * the intermediate values fit in 16 bits, which the vector versions rely
+ * on. */
+#define K_RGB2Y(r, g, b) (uint8_t)(((66 * (r) + 129 * (g) +  25 * (b) + 128) >> 8) +  16)
+#define K_RGB2U(r, g, b) (uint8_t)(((-38 * (r) - 74 * (g) + 112 * (b) + 128) >> 8) + 128)
+#define K_RGB2V(r, g, b) (uint8_t)(((112 * (r) - 94 * (g) -  18 * (b) + 128) >> 8) + 128)
+
+/********************************************************************************
+ * Scalar versions, also used for the ends of the lines.
+ *
+ * Each one converts two lines, from pixel 'x' to the end.
+ *******************************************************************************/
+
+static void
+_YUYV_to_NV21_lines(const uint8_t* src0, const uint8_t* src1,
+                    uint8_t* y0, uint8_t* y1, uint8_t* vu,
+                    int x, int width)
+{
+    for (; x < width; x += 2) {
+        const uint8_t* p0 = src0 + x * 2;
+        const uint8_t* p1 = src1 + x * 2;
+        y0[x] = p0[0]; y0[x + 1] = p0[2];
+        y1[x] = p1[0]; y1[x + 1] = p1[2];
+        vu[x] = (p0[3] + p1[3] + 1) >> 1;
+        vu[x + 1] = (p0[1] + p1[1] + 1) >> 1;
+    }
+}
+
+static void
+_YU12_to_NV21_line(const uint8_t* u, const uint8_t* v, uint8_t* vu,
+                   int x, int width)
+{
+    for (; x < width; x += 2) {
+        vu[x] = v[x / 2];
+        vu[x + 1] = u[x / 2];
+    }
+}
+
+static void
+_RGB32_to_YV12_lines(const uint8_t* src0, const uint8_t* src1,
+                     uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v,
+                     int x, int width, int bgr)
+{
+    const int ri = bgr ? 2 : 0;
+    const int bi = bgr ? 0 : 2;
+    for (; x < width; x += 2) {
+        const uint8_t* p0 = src0 + x * 4;
+        const uint8_t* p1 = src1 + x * 4;
+        int r, g, b;
+        y0[x]     = K_RGB2Y(p0[ri], p0[1], p0[bi]);
+        y0[x + 1] = K_RGB2Y(p0[ri + 4], p0[5], p0[bi + 4]);
+        y1[x]     = K_RGB2Y(p1[ri], p1[1], p1[bi]);
+        y1[x + 1] = K_RGB2Y(p1[ri + 4], p1[5], p1[bi + 4]);
+        r = (p0[ri] + p0[ri + 4] + p1[ri] + p1[ri + 4] + 2) >> 2;
+        g = (p0[1] + p0[5] + p1[1] + p1[5] + 2) >> 2;
+        b = (p0[bi] + p0[bi + 4] + p1[bi] + p1[bi + 4] + 2) >> 2;
+        u[x / 2] = K_RGB2U(r, g, b);
+        v[x / 2] = K_RGB2V(r, g, b);
+    }
+}
+
+/********************************************************************************
+ * Vector versions.
+ *
+ * Each one converts two lines, 16 pixels at a time, and returns the number
+ * of pixels converted.
+ *******************************************************************************/
+
+#if KERNELS_USE_SSE2
+
+static int
+_YUYV_to_NV21_lines_simd(const uint8_t* src0, const uint8_t* src1,
+                         uint8_t* y0, uint8_t* y1, uint8_t* vu, int width)
+{
+    const __m128i mask = _mm_set1_epi16(0xff);
+    int x;
+    for (x = 0; x + 16 <= width; x += 16) {
+        __m128i a0 = _mm_loadu_si128((const __m128i*)(src0 + x * 2));
+        __m128i b0 = _mm_loadu_si128((const __m128i*)(src0 + x * 2 + 16));
+        __m128i a1 = _mm_loadu_si128((const __m128i*)(src1 + x * 2));
+        __m128i b1 = _mm_loadu_si128((const __m128i*)(src1 + x * 2 + 16));
+        __m128i uv0, uv1, uv;
+
+        _mm_storeu_si128((__m128i*)(y0 + x),
+                         _mm_packus_epi16(_mm_and_si128(a0, mask),
+                                          _mm_and_si128(b0, mask)));
+        _mm_storeu_si128((__m128i*)(y1 + x),
+                         _mm_packus_epi16(_mm_and_si128(a1, mask),
+                                          _mm_and_si128(b1, mask)));
+
+        /* U V pairs of each line, averaged, then swapped to V U. */
+        uv0 = _mm_packus_epi16(_mm_srli_epi16(a0, 8), _mm_srli_epi16(b0, 8));
+        uv1 = _mm_packus_epi16(_mm_srli_epi16(a1, 8), _mm_srli_epi16(b1, 8));
+        uv = _mm_avg_epu8(uv0, uv1);
+        _mm_storeu_si128((__m128i*)(vu + x),
+                         _mm_or_si128(_mm_slli_epi16(uv, 8),
+                                      _mm_srli_epi16(uv, 8)));
+    }
+    return x;
+}
+
+static int
+_YU12_to_NV21_line_simd(const uint8_t* u, const uint8_t* v, uint8_t* vu,
+                        int width)
+{
+    int x;
+    for (x = 0; x + 32 <= width; x += 32) {
+        __m128i uu = _mm_loadu_si128((const __m128i*)(u + x / 2));
+        __m128i vv = _mm_loadu_si128((const __m128i*)(v + x / 2));
+        _mm_storeu_si128((__m128i*)(vu + x), _mm_unpacklo_epi8(vv, uu));
+        _mm_storeu_si128((__m128i*)(vu + x + 16), _mm_unpackhi_epi8(vv, uu));
+    }
+    return x;
+}
+
+/* Splits 8 RGB32 pixels into 16-bit R, G, and B values. */
+static __inline__ void
+_load_rgb8(const uint8_t* p, int bgr, __m128i* r, __m128i* g, __m128i* b)
+{
+    const __m128i mask = _mm_set1_epi32(0xff);
+    __m128i lo = _mm_loadu_si128((const __m128i*)p);
+    __m128i hi = _mm_loadu_si128((const __m128i*)(p + 16));
+    __m128i c0 = _mm_packs_epi32(_mm_and_si128(lo, mask),
+                                 _mm_and_si128(hi, mask));
+    __m128i c2 = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 16), mask),
+                                 _mm_and_si128(_mm_srli_epi32(hi, 16), mask));
+    *g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 8), mask),
+                         _mm_and_si128(_mm_srli_epi32(hi, 8), mask));
+    *r = bgr ? c2 : c0;
+    *b = bgr ? c0 : c2;
+}
+
+static __inline__ __m128i
+_rgb_to_y(__m128i r, __m128i g, __m128i b)
+{
+    __m128i y = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(66)),
+                              _mm_mullo_epi16(g, _mm_set1_epi16(129)));
+    y = _mm_add_epi16(y, _mm_mullo_epi16(b, _mm_set1_epi16(25)));
+    y = _mm_srli_epi16(_mm_add_epi16(y, _mm_set1_epi16(128)), 8);
+    return _mm_add_epi16(y, _mm_set1_epi16(16));
+}
+
+static __inline__ __m128i
+_rgb_to_chroma(__m128i r, __m128i g, __m128i b, int cr, int cg, int cb)
+{
+    __m128i c = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(cr)),
+                              _mm_mullo_epi16(g, _mm_set1_epi16(cg)));
+    c = _mm_add_epi16(c, _mm_mullo_epi16(b, _mm_set1_epi16(cb)));
+    c = _mm_srai_epi16(_mm_add_epi16(c, _mm_set1_epi16(128)), 8);
+    return _mm_add_epi16(c, _mm_set1_epi16(128));
+}
+
+/* Returns the sums of the adjacent pairs of 16-bit values in 'a', then 'b'. */
+static __inline__ __m128i
+_pair_sums(__m128i a, __m128i b)
+{
+    const __m128i ones = _mm_set1_epi16(1);
+    return _mm_packs_epi32(_mm_madd_epi16(a, ones), _mm_madd_epi16(b, ones));
+}
+
+static int
+_RGB32_to_YV12_lines_simd(const uint8_t* src0, const uint8_t* src1,
+                          uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v,
+                          int width, int bgr)
+{
+    const __m128i two = _mm_set1_epi16(2);
+    int x;
+    for (x = 0; x + 16 <= width; x += 16) {
+        __m128i ra0, ga0, ba0, rb0, gb0, bb0;
+        __m128i ra1, ga1, ba1, rb1, gb1, bb1;
+        __m128i r, g, b;
+
+        _load_rgb8(src0 + x * 4, bgr, &ra0, &ga0, &ba0);
+        _load_rgb8(src0 + x * 4 + 32, bgr, &rb0, &gb0, &bb0);
+        _load_rgb8(src1 + x * 4, bgr, &ra1, &ga1, &ba1);
+        _load_rgb8(src1 + x * 4 + 32, bgr, &rb1, &gb1, &bb1);
+
+        _mm_storeu_si128((__m128i*)(y0 + x),
+                         _mm_packus_epi16(_rgb_to_y(ra0, ga0, ba0),
+                                          _rgb_to_y(rb0, gb0, bb0)));
+        _mm_storeu_si128((__m128i*)(y1 + x),
+                         _mm_packus_epi16(_rgb_to_y(ra1, ga1, ba1),
+                                          _rgb_to_y(rb1, gb1, bb1)));
+
+        /* 2x2 averages of the 8 squares. */
+        r = _mm_add_epi16(_pair_sums(ra0, rb0), _pair_sums(ra1, rb1));
+        g = _mm_add_epi16(_pair_sums(ga0, gb0), _pair_sums(ga1, gb1));
+        b = _mm_add_epi16(_pair_sums(ba0, bb0), _pair_sums(ba1, bb1));
+        r = _mm_srli_epi16(_mm_add_epi16(r, two), 2);
+        g = _mm_srli_epi16(_mm_add_epi16(g, two), 2);
+        b = _mm_srli_epi16(_mm_add_epi16(b, two), 2);
+
+        _mm_storel_epi64((__m128i*)(u + x / 2),
+                         _mm_packus_epi16(_rgb_to_chroma(r, g, b, -38, -74, 112),
+                                          _mm_setzero_si128()));
+        _mm_storel_epi64((__m128i*)(v + x / 2),
+                         _mm_packus_epi16(_rgb_to_chroma(r, g, b, 112, -94, -18),
+                                          _mm_setzero_si128()));
+    }
+    return x;
+}
+
+#elif KERNELS_USE_NEON
+
+static int
+_YUYV_to_NV21_lines_simd(const uint8_t* src0, const uint8_t* src1,
+                         uint8_t* y0, uint8_t* y1, uint8_t* vu, int width)
+{
+    int x;
+    for (x = 0; x + 16 <= width; x += 16) {
+        /* val[0] has the Y values, val[1] the U V pairs. */
+        uint8x16x2_t p0 = vld2q_u8(src0 + x * 2);
+        uint8x16x2_t p1 = vld2q_u8(src1 + x * 2);
+        vst1q_u8(y0 + x, p0.val[0]);
+        vst1q_u8(y1 + x, p1.val[0]);
+        vst1q_u8(vu + x, vrev16q_u8(vrhaddq_u8(p0.val[1], p1.val[1])));
+    }
+    return x;
+}
+
+static int
+_YU12_to_NV21_line_simd(const uint8_t* u, const uint8_t* v, uint8_t* vu,
+                        int width)
+{
+    int x;
+    for (x = 0; x + 32 <= width; x += 32) {
+        uint8x16x2_t p;
+        p.val[0] = vld1q_u8(v + x / 2);
+        p.val[1] = vld1q_u8(u + x / 2);
+        vst2q_u8(vu + x, p);
+    }
+    return x;
+}
+
+static __inline__ uint8x8_t
+_rgb_to_y(uint8x8_t r, uint8x8_t g, uint8x8_t b)
+{
+    uint16x8_t y = vmull_u8(r, vdup_n_u8(66));
+    y = vmlal_u8(y, g, vdup_n_u8(129));
+    y = vmlal_u8(y, b, vdup_n_u8(25));
+    return vadd_u8(vshrn_n_u16(vaddq_u16(y, vdupq_n_u16(128)), 8),
+                   vdup_n_u8(16));
+}
+
+static __inline__ uint8x8_t
+_rgb_to_chroma(int16x8_t r, int16x8_t g, int16x8_t b, int cr, int cg, int cb)
+{
+    int16x8_t c = vmulq_n_s16(r, cr);
+    c = vmlaq_n_s16(c, g, cg);
+    c = vmlaq_n_s16(c, b, cb);
+    c = vshrq_n_s16(vaddq_s16(c, vdupq_n_s16(128)), 8);
+    return vqmovun_s16(vaddq_s16(c, vdupq_n_s16(128)));
+}
+
+static int
+_RGB32_to_YV12_lines_simd(const uint8_t* src0, const uint8_t* src1,
+                          uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v,
+                          int width, int bgr)
+{
+    const int ri = bgr ? 2 : 0;
+    const int bi = bgr ? 0 : 2;
+    int x;
+    for (x = 0; x + 16 <= width; x += 16) {
+        uint8x16x4_t p0 = vld4q_u8(src0 + x * 4);
+        uint8x16x4_t p1 = vld4q_u8(src1 + x * 4);
+        int16x8_t r, g, b;
+
+        vst1q_u8(y0 + x, vcombine_u8(
+            _rgb_to_y(vget_low_u8(p0.val[ri]), vget_low_u8(p0.val[1]),
+                      vget_low_u8(p0.val[bi])),
+            _rgb_to_y(vget_high_u8(p0.val[ri]), vget_high_u8(p0.val[1]),
+                      vget_high_u8(p0.val[bi]))));
+        vst1q_u8(y1 + x, vcombine_u8(
+            _rgb_to_y(vget_low_u8(p1.val[ri]), vget_low_u8(p1.val[1]),
+                      vget_low_u8(p1.val[bi])),
+            _rgb_to_y(vget_high_u8(p1.val[ri]), vget_high_u8(p1.val[1]),
+                      vget_high_u8(p1.val[bi]))));
+
+        /* 2x2 averages of the 8 squares. */
+        r = vreinterpretq_s16_u16(vrshrq_n_u16(
+                vpadalq_u8(vpaddlq_u8(p0.val[ri]), p1.val[ri]), 2));
+        g = vreinterpretq_s16_u16(vrshrq_n_u16(
+                vpadalq_u8(vpaddlq_u8(p0.val[1]), p1.val[1]), 2));
+        b = vreinterpretq_s16_u16(vrshrq_n_u16(
+                vpadalq_u8(vpaddlq_u8(p0.val[bi]), p1.val[bi]), 2));
+
+        vst1_u8(u + x / 2, _rgb_to_chroma(r, g, b, -38, -74, 112));
+        vst1_u8(v + x / 2, _rgb_to_chroma(r, g, b, 112, -94, -18));
+    }
+    return x;
+}
+
+#endif  /* KERNELS_USE_NEON */
+
+/********************************************************************************
+ * Public API
+ *******************************************************************************/
+
+void
+camera_convert_YUYV_to_NV21(const uint8_t* src,
+                            uint8_t* dst,
+                            int width,
+                            int height)
+{
+    uint8_t* vu_pane = dst + width * height;
+    int y;
+    for (y = 0; y < height; y += 2) {
+        const uint8_t* src0 = src + y * width * 2;
+        const uint8_t* src1 = src0 + width * 2;
+        uint8_t* y0 = dst + y * width;
+        uint8_t* y1 = y0 + width;
+        uint8_t* vu = vu_pane + (y / 2) * width;
+        int x = 0;
+#if KERNELS_USE_SIMD
+        if (_kernels_simd) {
+            x = _YUYV_to_NV21_lines_simd(src0, src1, y0, y1, vu, width);
+        }
+#endif
+        _YUYV_to_NV21_lines(src0, src1, y0, y1, vu, x, width);
+    }
+}
+
+void
+camera_convert_YU12_to_NV21(const uint8_t* src,
+                            uint8_t* dst,
+                            int width,
+                            int height)
+{
+    const int y_size = width * height;
+    const uint8_t* u_pane = src + y_size;
+    const uint8_t* v_pane = src + y_size + y_size / 4;
+    int y;
+
+    memcpy(dst, src, y_size);
+    for (y = 0; y < height / 2; y++) {
+        const uint8_t* u = u_pane + y * width / 2;
+        const uint8_t* v = v_pane + y * width / 2;
+        uint8_t* vu = dst + y_size + y * width;
+        int x = 0;
+#if KERNELS_USE_SIMD
+        if (_kernels_simd) {
+            x = _YU12_to_NV21_line_simd(u, v, vu, width);
+        }
+#endif
+        _YU12_to_NV21_line(u, v, vu, x, width);
+    }
+}
+
+void
+camera_convert_RGB32_to_YV12(const uint8_t* src,
+                             uint8_t* dst,
+                             int width,
+                             int height,
+                             int bgr)
+{
+    const int y_size = width * height;
+    uint8_t* v_pane = dst + y_size;
+    uint8_t* u_pane = dst + y_size + y_size / 4;
+    int y;
+    for (y = 0; y < height; y += 2) {
+        const uint8_t* src0 = src + y * width * 4;
+        const uint8_t* src1 = src0 + width * 4;
+        uint8_t* y0 = dst + y * width;
+        uint8_t* y1 = y0 + width;
+        uint8_t* u = u_pane + (y / 2) * width / 2;
+        uint8_t* v = v_pane + (y / 2) * width / 2;
+        int x = 0;
+#if KERNELS_USE_SIMD
+        if (_kernels_simd) {
+            x = _RGB32_to_YV12_lines_simd(src0, src1, y0, y1, u, v, width, bgr);
+        }
+#endif
+        _RGB32_to_YV12_lines(src0, src1, y0, y1, u, v, x, width, bgr);
+    }
+}
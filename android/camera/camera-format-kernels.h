@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_CAMERA_CAMERA_FORMAT_KERNELS_H
+#define ANDROID_CAMERA_CAMERA_FORMAT_KERNELS_H
+
+/*
+ * Contains declaration of specialized converters for the pixel format pairs
+ * that are the most common in camera emulation. convert_frame() uses them
+ * instead of its generic converters when white balance and exposure
+ * compensation don't change the colors.
+ *
+ * Frames use the layouts of camera-format-converters.c: no padding between
+ * lines, the chroma panes of 4:2:0 frames follow the Y pane, and the lines
+ * of a chroma pane are width / 2 bytes (YV12), or width bytes for the
+ * interleaved pane (NV21). Width and height must be even. Chroma is
+ * subsampled by averaging the pixels of each 2x2 square, rounding up.
+ *
+ * They use SSE2 or NEON when the host supports them at build time.
+ */
+
+#include "android/utils/compiler.h"
+
+#include <stdint.h>
+
+ANDROID_BEGIN_HEADER
+
+/* Converts a YUYV frame (4:2:2, Y0 U Y1 V) into an NV21 frame. */
+extern void camera_convert_YUYV_to_NV21(const uint8_t* src,
+                                        uint8_t* dst,
+                                        int width,
+                                        int height);
+
+/* Converts a YU12 frame (4:2:0, Y pane, then U pane, then V pane), e.g. as
+ * produced by a JPEG decoder, into an NV21 frame. */
+extern void camera_convert_YU12_to_NV21(const uint8_t* src,
+                                        uint8_t* dst,
+                                        int width,
+                                        int height);
+
+/* Converts an RGB32 frame (R G B X bytes), or a BGR32 frame (B G R X) if
+ * 'bgr' is not zero, into a YV12 frame. */
+extern void camera_convert_RGB32_to_YV12(const uint8_t* src,
+                                         uint8_t* dst,
+                                         int width,
+                                         int height,
+                                         int bgr);
+
+/* Enables or disables the vector versions of the converters, for tests and
+ * benchmarks. They are enabled by default. */
+extern void camera_format_kernels_set_simd(int enable);
+
+ANDROID_END_HEADER
+
+#endif  /* ANDROID_CAMERA_CAMERA_FORMAT_KERNELS_H */
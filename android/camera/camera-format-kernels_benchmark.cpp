@@ -0,0 +1,290 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Micro-benchmarks comparing the camera format kernels that
+// convert_frame() uses for the most common pairs of formats with the
+// generic converters that it uses for the other ones, as copied below.
+// Each operation converts a 1920x1080 frame, with the generic converter,
+// or the scalar or vector versions of the kernel.
+
+#include "android/camera/camera-format-kernels.h"
+
+#include "android/base/testing/Benchmark.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+namespace {
+
+const int kWidth = 1920;
+const int kHeight = 1080;
+
+// The per-pixel work of the generic converters of
+// camera-format-converters.c, with neutral white balance and exposure.
+
+int clamp(int x) {
+    return x > 255 ? 255 : (x < 0 ? 0 : x);
+}
+
+#define RGB2Y(r, g, b) (uint8_t)(((66 * (r) + 129 * (g) +  25 * (b) + 128) >> 8) +  16)
+#define RGB2U(r, g, b) (uint8_t)(((-38 * (r) - 74 * (g) + 112 * (b) + 128) >> 8) + 128)
+#define RGB2V(r, g, b) (uint8_t)(((112 * (r) - 94 * (g) -  18 * (b) + 128) >> 8) + 128)
+#define YUV2R(y, u, v) clamp((298 * ((y)-16) + 409 * ((v)-128) + 128) >> 8)
+#define YUV2G(y, u, v) clamp((298 * ((y)-16) - 100 * ((u)-128) - 208 * ((v)-128) + 128) >> 8)
+#define YUV2B(y, u, v) clamp((298 * ((y)-16) + 516 * ((u)-128) + 128) >> 8)
+
+struct YUVDesc;
+typedef int (*OffsetFunc)(const YUVDesc* desc, int line, int width, int height);
+
+struct YUVDesc {
+    int Y_offset;
+    int Y_inc;
+    int Y_next_pair;
+    int UV_inc;
+    int U_offset;
+    int V_offset;
+    OffsetFunc u_offset;
+    OffsetFunc v_offset;
+};
+
+int uOffIntrlYUV(const YUVDesc* desc, int line, int width, int height) {
+    return line * width * 2 + desc->U_offset;
+}
+
+int vOffIntrlYUV(const YUVDesc* desc, int line, int width, int height) {
+    return line * width * 2 + desc->V_offset;
+}
+
+int uOffIntrlUV(const YUVDesc* desc, int line, int width, int height) {
+    return (height + line / 2) * width + desc->U_offset;
+}
+
+int vOffIntrlUV(const YUVDesc* desc, int line, int width, int height) {
+    return (height + line / 2) * width + desc->V_offset;
+}
+
+int uOffSepYUV(const YUVDesc* desc, int line, int width, int height) {
+    const int size = height * width;
+    return desc->U_offset ? size + (line / 2) * width / 2
+                          : size + size / 4 + (line / 2) * width / 2;
+}
+
+int vOffSepYUV(const YUVDesc* desc, int line, int width, int height) {
+    const int size = height * width;
+    return desc->V_offset ? size + (line / 2) * width / 2
+                          : size + size / 4 + (line / 2) * width / 2;
+}
+
+const YUVDesc kYUYV = { 0, 2, 4, 4, 1, 3, uOffIntrlYUV, vOffIntrlYUV };
+const YUVDesc kYU12 = { 0, 1, 2, 1, 1, 0, uOffSepYUV, vOffSepYUV };
+const YUVDesc kYV12 = { 0, 1, 2, 1, 0, 1, uOffSepYUV, vOffSepYUV };
+const YUVDesc kNV21 = { 0, 1, 2, 2, 1, 0, uOffIntrlUV, vOffIntrlUV };
+
+uint8_t changeExposure(uint8_t y, float expComp) {
+    return (uint8_t)clamp((float)y * expComp);
+}
+
+void changeWhiteBalanceYUV(uint8_t* y, uint8_t* u, uint8_t* v, float scale) {
+    int r = (float)(YUV2R((int)*y, (int)*u, (int)*v)) / scale;
+    int g = (float)(YUV2G((int)*y, (int)*u, (int)*v)) / scale;
+    int b = (float)(YUV2B((int)*y, (int)*u, (int)*v)) / scale;
+    *y = RGB2Y(r, g, b);
+    *u = RGB2U(r, g, b);
+    *v = RGB2V(r, g, b);
+}
+
+void changeRGB(uint8_t* r, uint8_t* g, uint8_t* b, float scale,
+               float expComp) {
+    *r = (float)*r / scale;
+    *g = (float)*g / scale;
+    *b = (float)*b / scale;
+    uint8_t y = RGB2Y(*r, *g, *b);
+    int u = RGB2U(*r, *g, *b) - 128;
+    int v = RGB2V(*r, *g, *b) - 128;
+    int c = changeExposure(y, expComp) - 16;
+    *r = (uint8_t)clamp((298 * c + 409 * v + 128) >> 8);
+    *g = (uint8_t)clamp((298 * c - 100 * u - 208 * v + 128) >> 8);
+    *b = (uint8_t)clamp((298 * c + 516 * u + 128) >> 8);
+}
+
+typedef const void* (*LoadFunc)(const void* rgb, uint8_t* r, uint8_t* g,
+                                uint8_t* b);
+
+const void* loadRGB32(const void* rgb, uint8_t* r, uint8_t* g, uint8_t* b) {
+    const uint8_t* p = static_cast<const uint8_t*>(rgb);
+    *r = p[0]; *g = p[1]; *b = p[2];
+    return p + 4;
+}
+
+void genericYUVToYUV(const YUVDesc* src_fmt, const YUVDesc* dst_fmt,
+                     const void* src, void* dst, int width, int height,
+                     float scale, float expComp) {
+    const uint8_t* pYsrc = (const uint8_t*)src + src_fmt->Y_offset;
+    uint8_t* pYdst = (uint8_t*)dst + dst_fmt->Y_offset;
+    for (int y = 0; y < height; y++) {
+        const uint8_t* pUsrc =
+            (const uint8_t*)src + src_fmt->u_offset(src_fmt, y, width, height);
+        const uint8_t* pVsrc =
+            (const uint8_t*)src + src_fmt->v_offset(src_fmt, y, width, height);
+        uint8_t* pUdst =
+            (uint8_t*)dst + dst_fmt->u_offset(dst_fmt, y, width, height);
+        uint8_t* pVdst =
+            (uint8_t*)dst + dst_fmt->v_offset(dst_fmt, y, width, height);
+        for (int x = 0; x < width; x += 2, pYsrc += src_fmt->Y_next_pair,
+                                           pUsrc += src_fmt->UV_inc,
+                                           pVsrc += src_fmt->UV_inc,
+                                           pYdst += dst_fmt->Y_next_pair,
+                                           pUdst += dst_fmt->UV_inc,
+                                           pVdst += dst_fmt->UV_inc) {
+            *pYdst = *pYsrc; *pUdst = *pUsrc; *pVdst = *pVsrc;
+            changeWhiteBalanceYUV(pYdst, pUdst, pVdst, scale);
+            *pYdst = changeExposure(*pYdst, expComp);
+            pYdst[dst_fmt->Y_inc] =
+                    changeExposure(pYsrc[src_fmt->Y_inc], expComp);
+        }
+    }
+}
+
+void genericRGBToYUV(LoadFunc load, const YUVDesc* yuv_fmt, const void* rgb,
+                     void* yuv, int width, int height, float scale,
+                     float expComp) {
+    uint8_t* pY = (uint8_t*)yuv + yuv_fmt->Y_offset;
+    for (int y = 0; y < height; y++) {
+        uint8_t* pU =
+            (uint8_t*)yuv + yuv_fmt->u_offset(yuv_fmt, y, width, height);
+        uint8_t* pV =
+            (uint8_t*)yuv + yuv_fmt->v_offset(yuv_fmt, y, width, height);
+        for (int x = 0; x < width; x += 2, pY += yuv_fmt->Y_next_pair,
+                                           pU += yuv_fmt->UV_inc,
+                                           pV += yuv_fmt->UV_inc) {
+            uint8_t r, g, b;
+            rgb = load(rgb, &r, &g, &b);
+            changeRGB(&r, &g, &b, scale, expComp);
+            *pY = RGB2Y(r, g, b);
+            *pU = RGB2U(r, g, b);
+            *pV = RGB2V(r, g, b);
+            rgb = load(rgb, &r, &g, &b);
+            changeRGB(&r, &g, &b, scale, expComp);
+            pY[yuv_fmt->Y_inc] = RGB2Y(r, g, b);
+        }
+    }
+}
+
+enum Pair { kYUYVToNV21, kYU12ToNV21, kRGB32ToYV12 };
+
+void convertGeneric(Pair pair, const uint8_t* src, uint8_t* dst) {
+    // Volatile, so that the neutral adjustments aren't optimized away.
+    volatile float scale = 1.0f;
+    switch (pair) {
+    case kYUYVToNV21:
+        genericYUVToYUV(&kYUYV, &kNV21, src, dst, kWidth, kHeight, scale,
+                        scale);
+        break;
+    case kYU12ToNV21:
+        genericYUVToYUV(&kYU12, &kNV21, src, dst, kWidth, kHeight, scale,
+                        scale);
+        break;
+    default:
+        genericRGBToYUV(loadRGB32, &kYV12, src, dst, kWidth, kHeight, scale,
+                        scale);
+        break;
+    }
+}
+
+void convertKernel(Pair pair, const uint8_t* src, uint8_t* dst) {
+    switch (pair) {
+    case kYUYVToNV21:
+        camera_convert_YUYV_to_NV21(src, dst, kWidth, kHeight);
+        break;
+    case kYU12ToNV21:
+        camera_convert_YU12_to_NV21(src, dst, kWidth, kHeight);
+        break;
+    default:
+        camera_convert_RGB32_to_YV12(src, dst, kWidth, kHeight, 0);
+        break;
+    }
+}
+
+class CameraFormatBenchmark : public android::base::Benchmark {
+public:
+    virtual void setUp(int64_t arg) {
+        const size_t size = kWidth * kHeight * 4;
+        mSrc = static_cast<uint8_t*>(malloc(size));
+        mDst = static_cast<uint8_t*>(malloc(size));
+        for (size_t n = 0; n < size; ++n) {
+            mSrc[n] = static_cast<uint8_t>(n * 2654435761U >> 24);
+        }
+    }
+
+    virtual void tearDown() {
+        camera_format_kernels_set_simd(1);
+        free(mDst);
+        free(mSrc);
+    }
+
+protected:
+    void generic(android::base::BenchmarkState* state, Pair pair) {
+        for (size_t n = 0; n < state->iterations(); ++n) {
+            convertGeneric(pair, mSrc, mDst);
+        }
+    }
+
+    void kernel(android::base::BenchmarkState* state, Pair pair, int simd) {
+        camera_format_kernels_set_simd(simd);
+        for (size_t n = 0; n < state->iterations(); ++n) {
+            convertKernel(pair, mSrc, mDst);
+        }
+    }
+
+    uint8_t* mSrc;
+    uint8_t* mDst;
+};
+
+}  // namespace
+
+BENCHMARK_F(CameraFormatBenchmark, GenericYuyvToNv21) {
+    generic(state, kYUYVToNV21);
+}
+
+BENCHMARK_F(CameraFormatBenchmark, ScalarYuyvToNv21) {
+    kernel(state, kYUYVToNV21, 0);
+}
+
+BENCHMARK_F(CameraFormatBenchmark, VectorYuyvToNv21) {
+    kernel(state, kYUYVToNV21, 1);
+}
+
+BENCHMARK_F(CameraFormatBenchmark, GenericYu12ToNv21) {
+    generic(state, kYU12ToNV21);
+}
+
+BENCHMARK_F(CameraFormatBenchmark, ScalarYu12ToNv21) {
+    kernel(state, kYU12ToNV21, 0);
+}
+
+BENCHMARK_F(CameraFormatBenchmark, VectorYu12ToNv21) {
+    kernel(state, kYU12ToNV21, 1);
+}
+
+BENCHMARK_F(CameraFormatBenchmark, GenericRgb32ToYv12) {
+    generic(state, kRGB32ToYV12);
+}
+
+BENCHMARK_F(CameraFormatBenchmark, ScalarRgb32ToYv12) {
+    kernel(state, kRGB32ToYV12, 0);
+}
+
+BENCHMARK_F(CameraFormatBenchmark, VectorRgb32ToYv12) {
+    kernel(state, kRGB32ToYV12, 1);
+}
@@ -0,0 +1,179 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/camera/camera-format-kernels.h"
+
+#include <gtest/gtest.h>
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+namespace {
+
+// The sizes cover lines shorter than a vector, and lines that end with
+// a partial one.
+const int kSizes[][2] = {
+    { 2, 2 }, { 14, 4 }, { 16, 2 }, { 30, 6 }, { 32, 4 }, { 34, 2 },
+    { 64, 8 }, { 102, 10 },
+};
+
+std::vector<uint8_t> makeFrame(size_t size, uint32_t seed) {
+    std::vector<uint8_t> frame(size);
+    for (size_t n = 0; n < size; ++n) {
+        seed = seed * 1103515245U + 12345U;
+        frame[n] = static_cast<uint8_t>(seed >> 16);
+    }
+    // Make sure the extreme values are used.
+    frame[0] = 0;
+    frame[size - 1] = 255;
+    return frame;
+}
+
+uint8_t average2(int a, int b) {
+    return static_cast<uint8_t>((a + b + 1) >> 1);
+}
+
+uint8_t average4(int a, int b, int c, int d) {
+    return static_cast<uint8_t>((a + b + c + d + 2) >> 2);
+}
+
+std::vector<uint8_t> referenceYUYVToNV21(const std::vector<uint8_t>& src,
+                                         int w, int h) {
+    std::vector<uint8_t> dst(w * h * 3 / 2);
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            dst[y * w + x] = src[(y * w + x) * 2];
+        }
+    }
+    for (int y = 0; y < h; y += 2) {
+        for (int x = 0; x < w; x += 2) {
+            const uint8_t* p0 = &src[(y * w + x) * 2];
+            const uint8_t* p1 = p0 + w * 2;
+            dst[w * h + (y / 2) * w + x] = average2(p0[3], p1[3]);
+            dst[w * h + (y / 2) * w + x + 1] = average2(p0[1], p1[1]);
+        }
+    }
+    return dst;
+}
+
+std::vector<uint8_t> referenceYU12ToNV21(const std::vector<uint8_t>& src,
+                                         int w, int h) {
+    std::vector<uint8_t> dst(w * h * 3 / 2);
+    memcpy(&dst[0], &src[0], w * h);
+    for (int n = 0; n < w * h / 4; ++n) {
+        dst[w * h + n * 2] = src[w * h + w * h / 4 + n];
+        dst[w * h + n * 2 + 1] = src[w * h + n];
+    }
+    return dst;
+}
+
+std::vector<uint8_t> referenceRGB32ToYV12(const std::vector<uint8_t>& src,
+                                          int w, int h, bool bgr) {
+    const int ri = bgr ? 2 : 0;
+    const int bi = bgr ? 0 : 2;
+    std::vector<uint8_t> dst(w * h * 3 / 2);
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            const uint8_t* p = &src[(y * w + x) * 4];
+            dst[y * w + x] = static_cast<uint8_t>(
+                    ((66 * p[ri] + 129 * p[1] + 25 * p[bi] + 128) >> 8) + 16);
+        }
+    }
+    for (int y = 0; y < h; y += 2) {
+        for (int x = 0; x < w; x += 2) {
+            const uint8_t* p0 = &src[(y * w + x) * 4];
+            const uint8_t* p1 = p0 + w * 4;
+            int r = average4(p0[ri], p0[ri + 4], p1[ri], p1[ri + 4]);
+            int g = average4(p0[1], p0[5], p1[1], p1[5]);
+            int b = average4(p0[bi], p0[bi + 4], p1[bi], p1[bi + 4]);
+            int n = (y / 2) * (w / 2) + x / 2;
+            dst[w * h + n] = static_cast<uint8_t>(
+                    ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+            dst[w * h + w * h / 4 + n] = static_cast<uint8_t>(
+                    ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+        }
+    }
+    return dst;
+}
+
+class CameraFormatKernelsTest : public ::testing::TestWithParam<bool> {
+public:
+    CameraFormatKernelsTest() {
+        camera_format_kernels_set_simd(GetParam());
+    }
+    ~CameraFormatKernelsTest() {
+        camera_format_kernels_set_simd(1);
+    }
+};
+
+}  // namespace
+
+TEST_P(CameraFormatKernelsTest, YUYVToNV21) {
+    for (size_t n = 0; n < sizeof(kSizes) / sizeof(kSizes[0]); ++n) {
+        const int w = kSizes[n][0];
+        const int h = kSizes[n][1];
+        std::vector<uint8_t> src = makeFrame(w * h * 2, n);
+        std::vector<uint8_t> dst(w * h * 3 / 2);
+        camera_convert_YUYV_to_NV21(&src[0], &dst[0], w, h);
+        EXPECT_EQ(referenceYUYVToNV21(src, w, h), dst) << w << "x" << h;
+    }
+}
+
+TEST_P(CameraFormatKernelsTest, YU12ToNV21) {
+    for (size_t n = 0; n < sizeof(kSizes) / sizeof(kSizes[0]); ++n) {
+        const int w = kSizes[n][0];
+        const int h = kSizes[n][1];
+        std::vector<uint8_t> src = makeFrame(w * h * 3 / 2, n);
+        std::vector<uint8_t> dst(w * h * 3 / 2);
+        camera_convert_YU12_to_NV21(&src[0], &dst[0], w, h);
+        EXPECT_EQ(referenceYU12ToNV21(src, w, h), dst) << w << "x" << h;
+    }
+}
+
+TEST_P(CameraFormatKernelsTest, RGB32ToYV12) {
+    for (int bgr = 0; bgr < 2; ++bgr) {
+        for (size_t n = 0; n < sizeof(kSizes) / sizeof(kSizes[0]); ++n) {
+            const int w = kSizes[n][0];
+            const int h = kSizes[n][1];
+            std::vector<uint8_t> src = makeFrame(w * h * 4, n);
+            std::vector<uint8_t> dst(w * h * 3 / 2);
+            camera_convert_RGB32_to_YV12(&src[0], &dst[0], w, h, bgr);
+            EXPECT_EQ(referenceRGB32ToYV12(src, w, h, bgr), dst)
+                    << w << "x" << h << (bgr ? " BGR32" : " RGB32");
+        }
+    }
+}
+
+TEST_P(CameraFormatKernelsTest, ExtremeColors) {
+    // All the combinations of 0 and 255, for the ranges of the vectors.
+    const int w = 16, h = 2;
+    std::vector<uint8_t> src(w * h * 4);
+    for (int n = 0; n < w * h; ++n) {
+        src[n * 4] = (n & 1) ? 255 : 0;
+        src[n * 4 + 1] = (n & 2) ? 255 : 0;
+        src[n * 4 + 2] = (n & 4) ? 255 : 0;
+        src[n * 4 + 3] = 255;
+    }
+    std::vector<uint8_t> dst(w * h * 3 / 2);
+    camera_convert_RGB32_to_YV12(&src[0], &dst[0], w, h, 0);
+    EXPECT_EQ(referenceRGB32ToYV12(src, w, h, false), dst);
+    EXPECT_EQ(16, dst[0]);
+    EXPECT_EQ(235, dst[7]);
+}
+
+INSTANTIATE_TEST_CASE_P(Generic, CameraFormatKernelsTest,
+                        ::testing::Values(false));
+INSTANTIATE_TEST_CASE_P(Vector, CameraFormatKernelsTest,
+                        ::testing::Values(true));
@@ -0,0 +1,493 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Contains the decoder for MJPEG frames of the webcams. See the note in
+ * camera-jpeg-decoder.h about the headers this file can include.
+ */
+
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "camera-jpeg-decoder.h"
+
+/* Most lines a component produces per iMCU row: 2 blocks of 8 lines, since
+ * only sampling factors of 1 and 2 are supported. */
+#define MAX_IMCU_LINES  16
+
+/* Error manager that returns to the decoder instead of exiting. */
+typedef struct DecoderErrorMgr {
+    /* Common error manager header. */
+    struct jpeg_error_mgr   common;
+    /* Where to return on errors. */
+    jmp_buf                 setjmp_buffer;
+} DecoderErrorMgr;
+
+struct CameraJpegDecoder {
+    struct jpeg_decompress_struct   cinfo;
+    DecoderErrorMgr                 err;
+    /* Source manager reading the image from memory. */
+    struct jpeg_source_mgr          src;
+    /* Planes of the three components, as they come out of the IDCT. */
+    uint8_t*                        planes;
+    size_t                          planes_size;
+    /* Decoded YU12 frame. */
+    uint8_t*                        frame;
+    size_t                          frame_size;
+    /* Convert the full range samples of JFIF into the video range samples
+     * that the camera converters expect. */
+    uint8_t                         y_range[256];
+    uint8_t                         c_range[256];
+};
+
+/********************************************************************************
+ *                      jpeglib callbacks.
+ *******************************************************************************/
+
+/* Implements error manager's error_exit routine. */
+static void
+_on_error_exit(j_common_ptr cinfo)
+{
+    DecoderErrorMgr* const err = (DecoderErrorMgr*)cinfo->err;
+    longjmp(err->setjmp_buffer, 1);
+}
+
+/* Implements error manager's output_message routine. Corrupted frames are
+ * common in MJPEG streams, and the warnings about them would flood stderr. */
+static void
+_on_output_message(j_common_ptr cinfo)
+{
+}
+
+/* Implements source manager's init_source routine. */
+static void
+_on_init_source(j_decompress_ptr cinfo)
+{
+}
+
+/* Implements source manager's fill_input_buffer routine. It is only called
+ * past the end of the image, which is entirely in memory. Like jdatasrc.c,
+ * insert an EOI marker, so that truncated frames still decode. */
+static boolean
+_on_fill_input_buffer(j_decompress_ptr cinfo)
+{
+    static const JOCTET eoi[2] = { 0xFF, JPEG_EOI };
+    cinfo->src->next_input_byte = eoi;
+    cinfo->src->bytes_in_buffer = sizeof(eoi);
+    return TRUE;
+}
+
+/* Implements source manager's skip_input_data routine. */
+static void
+_on_skip_input_data(j_decompress_ptr cinfo, long num_bytes)
+{
+    struct jpeg_source_mgr* const src = cinfo->src;
+    if (num_bytes <= 0) {
+        return;
+    }
+    if ((size_t)num_bytes > src->bytes_in_buffer) {
+        _on_fill_input_buffer(cinfo);
+    } else {
+        src->next_input_byte += num_bytes;
+        src->bytes_in_buffer -= num_bytes;
+    }
+}
+
+/* Implements source manager's term_source routine. */
+static void
+_on_term_source(j_decompress_ptr cinfo)
+{
+}
+
+/********************************************************************************
+ *                      Decoder routines.
+ *******************************************************************************/
+
+/* Defines a Huffman table, as jcparam.c does. */
+static void
+_set_huff_table(j_decompress_ptr cinfo,
+                JHUFF_TBL** table,
+                const UINT8* bits,
+                const UINT8* val,
+                int val_num)
+{
+    *table = jpeg_alloc_huff_table((j_common_ptr)cinfo);
+    memcpy((*table)->bits, bits, sizeof((*table)->bits));
+    memcpy((*table)->huffval, val, val_num);
+    (*table)->sent_table = FALSE;
+}
+
+/* MJPEG frames don't contain Huffman tables: they use the ones suggested by
+ * the JPEG standard (section K.3). Sets them up, when the image hasn't
+ * defined its own tables. */
+static void
+_set_std_huff_tables(j_decompress_ptr cinfo)
+{
+    static const UINT8 bits_dc_luminance[17] =
+        { 0, 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+    static const UINT8 val_dc_luminance[] =
+        { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+    static const UINT8 bits_dc_chrominance[17] =
+        { 0, 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+    static const UINT8 val_dc_chrominance[] =
+        { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+    static const UINT8 bits_ac_luminance[17] =
+        { 0, 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+    static const UINT8 val_ac_luminance[] =
+        { 0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12,
+          0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+          0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08,
+          0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+          0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16,
+          0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+          0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39,
+          0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+          0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+          0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+          0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79,
+          0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+          0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98,
+          0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+          0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6,
+          0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+          0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4,
+          0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+          0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea,
+          0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+          0xf9, 0xfa };
+
+    static const UINT8 bits_ac_chrominance[17] =
+        { 0, 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+    static const UINT8 val_ac_chrominance[] =
+        { 0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21,
+          0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+          0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91,
+          0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+          0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34,
+          0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+          0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38,
+          0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+          0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+          0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+          0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78,
+          0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+          0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96,
+          0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+          0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
+          0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+          0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2,
+          0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+          0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9,
+          0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+          0xf9, 0xfa };
+
+    if (cinfo->dc_huff_tbl_ptrs[0] == NULL) {
+        _set_huff_table(cinfo, &cinfo->dc_huff_tbl_ptrs[0], bits_dc_luminance,
+                        val_dc_luminance, sizeof(val_dc_luminance));
+    }
+    if (cinfo->ac_huff_tbl_ptrs[0] == NULL) {
+        _set_huff_table(cinfo, &cinfo->ac_huff_tbl_ptrs[0], bits_ac_luminance,
+                        val_ac_luminance, sizeof(val_ac_luminance));
+    }
+    if (cinfo->dc_huff_tbl_ptrs[1] == NULL) {
+        _set_huff_table(cinfo, &cinfo->dc_huff_tbl_ptrs[1], bits_dc_chrominance,
+                        val_dc_chrominance, sizeof(val_dc_chrominance));
+    }
+    if (cinfo->ac_huff_tbl_ptrs[1] == NULL) {
+        _set_huff_table(cinfo, &cinfo->ac_huff_tbl_ptrs[1], bits_ac_chrominance,
+                        val_ac_chrominance, sizeof(val_ac_chrominance));
+    }
+}
+
+/* Gets the largest IDCT downscaling that keeps the image at least as large as
+ * min_width x min_height. */
+static unsigned int
+_get_scale_denom(j_decompress_ptr cinfo, int min_width, int min_height)
+{
+    unsigned int denom;
+    if (min_width <= 0 || min_height <= 0) {
+        return 1;
+    }
+    for (denom = 8; denom > 1; denom /= 2) {
+        if ((int)((cinfo->image_width + denom - 1) / denom) >= min_width &&
+            (int)((cinfo->image_height + denom - 1) / denom) >= min_height) {
+            break;
+        }
+    }
+    return denom;
+}
+
+/* Gets how many luma samples there are per sample of a component in one
+ * direction, given the sampling factors and the IDCT block sizes. */
+static int
+_get_luma_ratio(int luma_samp, int luma_block, int samp, int block)
+{
+    return (luma_samp * luma_block) / (samp * block);
+}
+
+/* Copies a luma plane into the Y pane, converting it to the video range. */
+static void
+_copy_luma(uint8_t* dst,
+           int width,
+           int height,
+           const uint8_t* src,
+           int stride,
+           const uint8_t* range)
+{
+    int x, y;
+    for (y = 0; y < height; y++, dst += width, src += stride) {
+        for (x = 0; x < width; x++) {
+            dst[x] = range[src[x]];
+        }
+    }
+}
+
+/* Copies a chroma plane into a 4:2:0 pane, converting it to the video range.
+ * 'ratio_x' and 'ratio_y' are the number of luma samples per chroma sample
+ * of the plane in each direction, 1 or 2. Chroma is averaged over the samples
+ * that cover a pixel pair, rounding up, as the camera-format-kernels.c
+ * converters do. */
+static void
+_copy_chroma(uint8_t* dst,
+             int width,
+             int height,
+             const uint8_t* src,
+             int stride,
+             int ratio_x,
+             int ratio_y,
+             const uint8_t* range)
+{
+    /* Offset of the second sample to average, 0 when there is only one. */
+    const int next_x = ratio_x == 1 ? 1 : 0;
+    const int next_y = ratio_y == 1 ? stride : 0;
+    const int step_x = 1 + next_x;
+    const int step_y = stride * (1 + (ratio_y == 1));
+    int x, y;
+    for (y = 0; y < height; y++, dst += width, src += step_y) {
+        const uint8_t* s = src;
+        for (x = 0; x < width; x++, s += step_x) {
+            dst[x] = range[(s[0] + s[next_x] + s[next_y] + s[next_y + next_x] +
+                            2) >> 2];
+        }
+    }
+}
+
+/* Decodes the image which header has been read. Errors go to setjmp_buffer. */
+static const uint8_t*
+_decode(CameraJpegDecoder* dec, int min_width, int min_height,
+        int* width, int* height)
+{
+    j_decompress_ptr const cinfo = &dec->cinfo;
+    jpeg_component_info* const comps = cinfo->comp_info;
+    JSAMPROW rows[3][MAX_IMCU_LINES];
+    JSAMPARRAY image[3];
+    uint8_t* planes[3];
+    int strides[3];
+    int lines[3];
+    size_t planes_size = 0;
+    int ratio_x[3], ratio_y[3];
+    int frame_w, frame_h, c;
+
+    if (cinfo->num_components != 3 || cinfo->jpeg_color_space != JCS_YCbCr) {
+        return NULL;
+    }
+    for (c = 0; c < 3; c++) {
+        if (comps[c].h_samp_factor > 2 || comps[c].v_samp_factor > 2) {
+            return NULL;
+        }
+    }
+
+    _set_std_huff_tables(cinfo);
+    cinfo->raw_data_out = TRUE;
+    /* Uses the SSE2 IDCT on x86 hosts, see jddctmgr.c. */
+    cinfo->dct_method = JDCT_IFAST;
+    cinfo->scale_num = 1;
+    cinfo->scale_denom = _get_scale_denom(cinfo, min_width, min_height);
+    jpeg_calc_output_dimensions(cinfo);
+
+    frame_w = cinfo->output_width & ~1;
+    frame_h = cinfo->output_height & ~1;
+    if (frame_w == 0 || frame_h == 0) {
+        return NULL;
+    }
+
+    /* The IDCT may upsample chroma itself when it downscales: work out the
+     * actual chroma subsampling from the block sizes it picked. */
+    for (c = 0; c < 3; c++) {
+        ratio_x[c] = _get_luma_ratio(comps[0].h_samp_factor,
+                                     comps[0].DCT_scaled_size,
+                                     comps[c].h_samp_factor,
+                                     comps[c].DCT_scaled_size);
+        ratio_y[c] = _get_luma_ratio(comps[0].v_samp_factor,
+                                     comps[0].DCT_scaled_size,
+                                     comps[c].v_samp_factor,
+                                     comps[c].DCT_scaled_size);
+        if (c > 0 && (ratio_x[c] < 1 || ratio_x[c] > 2 ||
+                      ratio_y[c] < 1 || ratio_y[c] > 2)) {
+            return NULL;
+        }
+        lines[c] = comps[c].v_samp_factor * comps[c].DCT_scaled_size;
+        strides[c] = comps[c].width_in_blocks * comps[c].DCT_scaled_size;
+        planes_size += (size_t)strides[c] * lines[c] * cinfo->total_iMCU_rows;
+    }
+    if (ratio_x[0] != 1 || ratio_y[0] != 1) {
+        return NULL;
+    }
+
+    /* Buffers are only reallocated when the frames get larger. */
+    if (planes_size > dec->planes_size) {
+        free(dec->planes);
+        dec->planes = malloc(planes_size);
+        dec->planes_size = dec->planes ? planes_size : 0;
+    }
+    if ((size_t)frame_w * frame_h * 3 / 2 > dec->frame_size) {
+        free(dec->frame);
+        dec->frame = malloc((size_t)frame_w * frame_h * 3 / 2);
+        dec->frame_size = dec->frame ? (size_t)frame_w * frame_h * 3 / 2 : 0;
+    }
+    if (dec->planes == NULL || dec->frame == NULL) {
+        return NULL;
+    }
+    planes[0] = dec->planes;
+    planes[1] = planes[0] + (size_t)strides[0] * lines[0] * cinfo->total_iMCU_rows;
+    planes[2] = planes[1] + (size_t)strides[1] * lines[1] * cinfo->total_iMCU_rows;
+
+    jpeg_start_decompress(cinfo);
+    while (cinfo->output_scanline < cinfo->output_height) {
+        const size_t imcu_row = cinfo->output_scanline /
+            (cinfo->max_v_samp_factor * cinfo->min_DCT_scaled_size);
+        int n;
+        for (c = 0; c < 3; c++) {
+            uint8_t* const first = planes[c] +
+                                   imcu_row * lines[c] * strides[c];
+            for (n = 0; n < lines[c]; n++) {
+                rows[c][n] = first + n * strides[c];
+            }
+            image[c] = rows[c];
+        }
+        if (jpeg_read_raw_data(cinfo, image, MAX_IMCU_LINES) == 0) {
+            break;
+        }
+    }
+    jpeg_finish_decompress(cinfo);
+
+    _copy_luma(dec->frame, frame_w, frame_h, planes[0], strides[0],
+               dec->y_range);
+    for (c = 1; c < 3; c++) {
+        _copy_chroma(dec->frame + frame_w * frame_h +
+                         (c - 1) * (frame_w / 2) * (frame_h / 2),
+                     frame_w / 2, frame_h / 2, planes[c], strides[c],
+                     ratio_x[c], ratio_y[c], dec->c_range);
+    }
+
+    *width = frame_w;
+    *height = frame_h;
+    return dec->frame;
+}
+
+/* Initializes the jpeglib objects of a decoder.
+ * Return:
+ *  0 on success, or -1 if jpeglib can't allocate its memory.
+ */
+static int
+_init_decompress(CameraJpegDecoder* dec)
+{
+    dec->cinfo.err = jpeg_std_error(&dec->err.common);
+    dec->err.common.error_exit = _on_error_exit;
+    dec->err.common.output_message = _on_output_message;
+    if (setjmp(dec->err.setjmp_buffer)) {
+        return -1;
+    }
+    jpeg_create_decompress(&dec->cinfo);
+
+    dec->src.init_source = _on_init_source;
+    dec->src.fill_input_buffer = _on_fill_input_buffer;
+    dec->src.skip_input_data = _on_skip_input_data;
+    dec->src.resync_to_restart = jpeg_resync_to_restart;
+    dec->src.term_source = _on_term_source;
+    dec->cinfo.src = &dec->src;
+    return 0;
+}
+
+/********************************************************************************
+ *                      Decoder API.
+ *******************************************************************************/
+
+CameraJpegDecoder*
+camera_jpeg_decoder_create(void)
+{
+    int n;
+    CameraJpegDecoder* const dec =
+        (CameraJpegDecoder*)calloc(1, sizeof(CameraJpegDecoder));
+    if (dec == NULL) {
+        return NULL;
+    }
+    if (_init_decompress(dec) != 0) {
+        free(dec);
+        return NULL;
+    }
+
+    for (n = 0; n < 256; n++) {
+        dec->y_range[n] = (uint8_t)(16 + (n * 219 + 127) / 255);
+        dec->c_range[n] = (uint8_t)(16 + (n * 224 + 127) / 255);
+    }
+    return dec;
+}
+
+void
+camera_jpeg_decoder_free(CameraJpegDecoder* dec)
+{
+    if (dec != NULL) {
+        jpeg_destroy_decompress(&dec->cinfo);
+        free(dec->planes);
+        free(dec->frame);
+        free(dec);
+    }
+}
+
+const uint8_t*
+camera_jpeg_decoder_decode(CameraJpegDecoder* dec,
+                           const void* jpeg,
+                           size_t size,
+                           int min_width,
+                           int min_height,
+                           int* width,
+                           int* height)
+{
+    const uint8_t* frame;
+
+    if (setjmp(dec->err.setjmp_buffer)) {
+        jpeg_abort_decompress(&dec->cinfo);
+        return NULL;
+    }
+    dec->src.next_input_byte = (const JOCTET*)jpeg;
+    dec->src.bytes_in_buffer = size;
+    if (jpeg_read_header(&dec->cinfo, TRUE) != JPEG_HEADER_OK) {
+        jpeg_abort_decompress(&dec->cinfo);
+        return NULL;
+    }
+
+    frame = _decode(dec, min_width, min_height, width, height);
+    if (frame == NULL) {
+        jpeg_abort_decompress(&dec->cinfo);
+    }
+    return frame;
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_CAMERA_CAMERA_JPEG_DECODER_H
+#define ANDROID_CAMERA_CAMERA_JPEG_DECODER_H
+
+/*
+ * Contains declarations of the decoder for MJPEG frames of the webcams.
+ *
+ * Frames are decoded into YU12, the layout of camera-format-converters.c, so
+ * that convert_frame() can hand them to its dedicated YU12 converter, or to
+ * its scaling converter. The decoder reads the YCbCr samples straight out of
+ * the IDCT: there is no color conversion and no chroma upsampling, and the
+ * IDCT itself downscales the frame when the client needs a smaller one.
+ *
+ * NOTE: This code uses the jpeglib library located in distrib/jpeg-6b, so it
+ * is compiled separately for the same reasons as android/utils/jpeg-compress.c.
+ * This header doesn't depend on jpeglib.
+ */
+
+#include "android/utils/compiler.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+ANDROID_BEGIN_HEADER
+
+/* Declares the descriptor of a decoder. */
+typedef struct CameraJpegDecoder CameraJpegDecoder;
+
+/* Creates a decoder.
+ * Return:
+ *  The decoder, or NULL on failure.
+ */
+extern CameraJpegDecoder* camera_jpeg_decoder_create(void);
+
+/* Destroys a decoder created with camera_jpeg_decoder_create. */
+extern void camera_jpeg_decoder_free(CameraJpegDecoder* dec);
+
+/* Decodes a JPEG image, e.g. a frame of an MJPEG stream, into a YU12 frame.
+ * The image must be in YCbCr, with 4:2:0, 4:2:2, 4:4:0 or 4:4:4 chroma. Its
+ * Huffman tables may be missing, as they are in MJPEG streams, then the
+ * standard ones are used.
+ * Param:
+ *  dec - Decoder.
+ *  jpeg, size - JPEG image.
+ *  min_width, min_height - Smallest dimensions the decoded frame can have.
+ *      The frame is decoded at 1/2, 1/4 or 1/8 of its size when that's still
+ *      enough. 0 decodes it at full size.
+ *  width, height - Upon success, contain the dimensions of the decoded frame.
+ *      They are even: an odd last column or line is dropped.
+ * Return:
+ *  The decoded frame, valid until the next call with this decoder, or NULL if
+ *  the image can't be decoded.
+ */
+extern const uint8_t* camera_jpeg_decoder_decode(CameraJpegDecoder* dec,
+                                                 const void* jpeg,
+                                                 size_t size,
+                                                 int min_width,
+                                                 int min_height,
+                                                 int* width,
+                                                 int* height);
+
+ANDROID_END_HEADER
+
+#endif  /* ANDROID_CAMERA_CAMERA_JPEG_DECODER_H */
@@ -27,6 +27,8 @@
 #include "android/camera/camera-capture.h"
 #include "android/camera/camera-format-converters.h"
 #include "android/camera/camera-service.h"
+#include "android/camera/camera-virtual-scene.h"
+#include "qemu/thread.h"
 
 #define  E(...)    derror(__VA_ARGS__)
 #define  W(...)    dwarning(__VA_ARGS__)
@@ -57,6 +59,11 @@ struct CameraServiceDesc {
     CameraInfo  camera_info[MAX_CAMERA];
     /* Number of camera devices connected to the host. */
     int         camera_count;
+    /* Thread enumerating the web cameras, joined before the first client
+     * connects. */
+    QemuThread  webcam_thread;
+    /* Non-zero while 'webcam_thread' has not been joined yet. */
+    int         webcam_pending;
 };
 
 /* One and only one camera service. */
@@ -307,27 +314,68 @@ _wecam_setup(CameraServiceDesc* csd,
       csd->camera_count++;
 }
 
-/* Initializes camera service descriptor.
+/* Frame dimensions of the virtual scene camera. The camera framework requires
+ * 352x288, 320x240, and 176x144. */
+static const CameraFrameDim _virtual_scene_dims[] =
+{
+    {1280, 720},
+    {640, 480},
+    {352, 288},
+    {320, 240},
+    {176, 144}
+};
+
+/* Initializes virtual scene camera record in camera service descriptor.
+ * Param:
+ *  csd - Camera service descriptor to initialize a record in.
+ *  dir - Direction ('back', or 'front') that emulated camera is facing.
  */
 static void
-_camera_service_init(CameraServiceDesc* csd)
+_virtual_scene_setup(CameraServiceDesc* csd, const char* dir)
 {
-    CameraInfo ci[MAX_CAMERA];
-    int connected_cnt;
-
-    /* Enumerate camera devices connected to the host. */
-    memset(ci, 0, sizeof(CameraInfo) * MAX_CAMERA);
-    memset(csd->camera_info, 0, sizeof(CameraInfo) * MAX_CAMERA);
-    csd->camera_count = 0;
-
-    /* Lets see if HW config uses web cameras. */
-    if (memcmp(android_hw->hw_camera_back, "webcam", 6) &&
-        memcmp(android_hw->hw_camera_front, "webcam", 6)) {
-        /* Web camera emulation is disabled. Skip enumeration of webcameras. */
+    CameraInfo* ci = csd->camera_info + csd->camera_count;
+    char name[64];
+
+    /* Each direction gets its own device, so both can be used at once. */
+    snprintf(name, sizeof(name), "%s-%s", CAMERA_VIRTUAL_SCENE_NAME, dir);
+    ci->display_name = ASTRDUP(CAMERA_VIRTUAL_SCENE_NAME);
+    ci->device_name = ASTRDUP(name);
+    ci->inp_channel = 0;
+    /* The scene is drawn in NV21. */
+    ci->pixel_format = V4L2_PIX_FMT_NV21;
+    ci->direction = ASTRDUP(dir);
+    ci->frame_sizes = (CameraFrameDim*)malloc(sizeof(_virtual_scene_dims));
+    if (ci->frame_sizes == NULL) {
+        E("%s: Unable to allocate dimensions", __FUNCTION__);
         return;
     }
+    memcpy(ci->frame_sizes, _virtual_scene_dims, sizeof(_virtual_scene_dims));
+    ci->frame_sizes_num = sizeof(_virtual_scene_dims) / sizeof(*_virtual_scene_dims);
+    ci->in_use = 0;
+    D("Camera %d '%s' is a virtual scene facing %s",
+      csd->camera_count, ci->device_name, dir);
+    csd->camera_count++;
+}
+
+/* Checks whether a camera device is the virtual scene camera. */
+static int
+_is_virtual_scene(const char* device_name)
+{
+    return !memcmp(device_name, CAMERA_VIRTUAL_SCENE_NAME,
+                   sizeof(CAMERA_VIRTUAL_SCENE_NAME) - 1);
+}
+
+/* Enumerates web cameras connected to the host, and sets up the ones used
+ * by the HW config.
+ */
+static void
+_camera_service_init_webcams(CameraServiceDesc* csd)
+{
+    CameraInfo ci[MAX_CAMERA];
+    int connected_cnt;
 
     /* Enumerate web cameras connected to the host. */
+    memset(ci, 0, sizeof(CameraInfo) * MAX_CAMERA);
     connected_cnt = enumerate_camera_devices(ci, MAX_CAMERA);
     if (connected_cnt <= 0) {
         /* Nothing is connected - nothing to emulate. */
@@ -345,6 +393,60 @@ _camera_service_init(CameraServiceDesc* csd)
     }
 }
 
+static void*
+_camera_service_webcam_thread(void* opaque)
+{
+    _camera_service_init_webcams((CameraServiceDesc*)opaque);
+    return NULL;
+}
+
+/* Initializes camera service descriptor.
+ */
+static void
+_camera_service_init(CameraServiceDesc* csd)
+{
+    memset(csd->camera_info, 0, sizeof(CameraInfo) * MAX_CAMERA);
+    csd->camera_count = 0;
+    csd->webcam_pending = 0;
+
+    /* Set up the virtual scene cameras. They don't depend on the host. */
+    if (!strcmp(android_hw->hw_camera_back, CAMERA_VIRTUAL_SCENE_NAME)) {
+        _virtual_scene_setup(csd, "back");
+    }
+    if (!strcmp(android_hw->hw_camera_front, CAMERA_VIRTUAL_SCENE_NAME)) {
+        _virtual_scene_setup(csd, "front");
+    }
+
+    /* Lets see if HW config uses web cameras. */
+    if (memcmp(android_hw->hw_camera_back, "webcam", 6) &&
+        memcmp(android_hw->hw_camera_front, "webcam", 6)) {
+        /* Web camera emulation is disabled. Skip enumeration of webcameras. */
+        return;
+    }
+
+#ifdef __APPLE__
+    /* QTKit expects an autorelease pool, only set up on the main thread. */
+    _camera_service_init_webcams(csd);
+#else
+    /* Opening and probing each device can take a while, do it while the
+     * rest of the emulator initializes, since nothing needs the cameras
+     * until the guest connects to the service. */
+    qemu_thread_create(&csd->webcam_thread, _camera_service_webcam_thread,
+                       csd, QEMU_THREAD_JOINABLE);
+    csd->webcam_pending = 1;
+#endif
+}
+
+/* Waits for the end of the web cameras enumeration, if needed. */
+static void
+_camera_service_wait_webcams(CameraServiceDesc* csd)
+{
+    if (csd->webcam_pending) {
+        qemu_thread_join(&csd->webcam_thread);
+        csd->webcam_pending = 0;
+    }
+}
+
 /* Gets camera information for the given camera device name.
  * Param:
  *  cs - Initialized camera service descriptor.
@@ -600,6 +702,18 @@ struct CameraClient
     size_t              video_frame_size;
     /* Byte size of the preview frame buffer. */
     size_t              preview_frame_size;
+    /* Memory for the video and preview frames. It is kept when the camera is
+     * stopped, and reused when it is started again if it is large enough. */
+    uint8_t*            frames_memory;
+    /* Byte size of the 'frames_memory' buffer. */
+    size_t              frames_memory_size;
+    /* Set for the virtual scene camera, which has no capture device. */
+    int                 is_virtual_scene;
+    /* Virtual scene frame, drawn when it can't be drawn directly into the video
+     * frame. This address points inside the 'frames_memory' buffer. */
+    uint8_t*            scene_frame;
+    /* Number of the next virtual scene frame. */
+    uint32_t            scene_frame_num;
     /* Pixel format required by the guest. */
     uint32_t            pixel_format;
     /* Frame width. */
@@ -612,6 +726,97 @@ struct CameraClient
     int                 frames_cached;
 };
 
+/* The virtual scene camera has no capture device. This descriptor stands for
+ * one, so that a non-NULL 'camera' still means that the client is connected. */
+static CameraDevice _virtual_scene_device;
+
+/* Opens the camera device of a client. */
+static CameraDevice*
+_camera_client_open_device(CameraClient* cc)
+{
+    if (cc->is_virtual_scene) {
+        return &_virtual_scene_device;
+    }
+    return camera_device_open(cc->device_name, cc->inp_channel);
+}
+
+/* Closes the camera device of a client. */
+static void
+_camera_client_close_device(CameraClient* cc)
+{
+    if (!cc->is_virtual_scene) {
+        camera_device_close(cc->camera);
+    }
+}
+
+/* Starts capturing frames at the client's dimensions. */
+static int
+_camera_client_start_device(CameraClient* cc)
+{
+    if (cc->is_virtual_scene) {
+        cc->scene_frame_num = 0;
+        return 0;
+    }
+    return camera_device_start_capturing(cc->camera,
+                                         cc->camera_info->pixel_format,
+                                         cc->width, cc->height);
+}
+
+/* Stops capturing frames. */
+static int
+_camera_client_stop_device(CameraClient* cc)
+{
+    if (cc->is_virtual_scene) {
+        return 0;
+    }
+    return camera_device_stop_capturing(cc->camera);
+}
+
+/* Reads the next frame into the client framebuffers, see
+ * camera_device_read_frame. The virtual scene is drawn directly into an NV21
+ * framebuffer when its colors don't need adjustments, and then converted for
+ * the other framebuffers. A new frame is always available, so its frame
+ * numbers only depend on the number of frames read since the start. */
+static int
+_camera_client_read_frame(CameraClient* cc,
+                          ClientFrameBuffer* fbs,
+                          int fbs_num,
+                          float r_scale,
+                          float g_scale,
+                          float b_scale,
+                          float exp_comp)
+{
+    uint8_t* scene = cc->scene_frame;
+    int n;
+
+    if (!cc->is_virtual_scene) {
+        return camera_device_read_frame(cc->camera, fbs, fbs_num,
+                                        r_scale, g_scale, b_scale, exp_comp);
+    }
+
+    if (r_scale == 1.0f && g_scale == 1.0f && b_scale == 1.0f &&
+        exp_comp == 1.0f) {
+        for (n = 0; n < fbs_num; n++) {
+            if (fbs[n].pixel_format == V4L2_PIX_FMT_NV21) {
+                scene = fbs[n].framebuffer;
+                break;
+            }
+        }
+    }
+    camera_virtual_scene_draw_NV21(scene, cc->width, cc->height,
+                                   cc->scene_frame_num++);
+
+    for (n = 0; n < fbs_num; n++) {
+        if (fbs[n].framebuffer != scene &&
+            convert_frame(scene, V4L2_PIX_FMT_NV21, (cc->pixel_num * 12) / 8,
+                          cc->width, cc->height, fbs + n, 1,
+                          r_scale, g_scale, b_scale, exp_comp)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
 /* Frees emulated camera client descriptor. */
 static void
 _camera_client_free(CameraClient* cc)
@@ -622,10 +827,10 @@ _camera_client_free(CameraClient* cc)
         ((CameraInfo*)cc->camera_info)->in_use = 0;
     }
     if (cc->camera != NULL) {
-        camera_device_close(cc->camera);
+        _camera_client_close_device(cc);
     }
-    if (cc->video_frame != NULL) {
-        free(cc->video_frame);
+    if (cc->frames_memory != NULL) {
+        free(cc->frames_memory);
     }
     if (cc->device_name != NULL) {
         free(cc->device_name);
@@ -705,6 +910,7 @@ _camera_client_create(CameraServiceDesc* csd, const char* param)
     /* We're done. Set camera in use, and succeed the connection. */
     ci->in_use = 1;
     cc->camera_info = ci;
+    cc->is_virtual_scene = _is_virtual_scene(cc->device_name);
 
     D("%s: Camera service is created for device '%s' using input channel %d",
       __FUNCTION__, cc->device_name, cc->inp_channel);
@@ -733,7 +939,7 @@ _camera_client_query_connect(CameraClient* cc, QemudClient* qc, const char* para
     }
 
     /* Open camera device. */
-    cc->camera = camera_device_open(cc->device_name, cc->inp_channel);
+    cc->camera = _camera_client_open_device(cc);
     if (cc->camera == NULL) {
         E("%s: Unable to open camera device '%s'", __FUNCTION__, cc->device_name);
         _qemu_client_reply_ko(qc, "Unable to open camera device.");
@@ -773,7 +979,7 @@ _camera_client_query_disconnect(CameraClient* cc,
     }
 
     /* Close camera device. */
-    camera_device_close(cc->camera);
+    _camera_client_close_device(cc);
     cc->camera = NULL;
 
     D("Camera device '%s' is now disconnected", cc->device_name);
@@ -798,6 +1004,7 @@ _camera_client_query_start(CameraClient* cc, QemudClient* qc, const char* param)
     char* w;
     char dim[64];
     int width, height, pix_format;
+    size_t scene_size;
 
     /* Sanity check. */
     if (cc->camera == NULL) {
@@ -914,27 +1121,38 @@ _camera_client_query_start(CameraClient* cc, QemudClient* qc, const char* param)
      * changes (if changes). */
     cc->preview_frame_size = cc->pixel_num * 4;
 
-    /* Allocate buffer large enough to contain both, video and preview
-     * framebuffers. */
-    cc->video_frame =
-        (uint8_t*)malloc(cc->video_frame_size + cc->preview_frame_size);
-    if (cc->video_frame == NULL) {
-        E("%s: Not enough memory for framebuffers %d + %d",
-          __FUNCTION__, cc->video_frame_size, cc->preview_frame_size);
-        _qemu_client_reply_ko(qc, "Out of memory");
-        return;
+    /* Get a buffer large enough to contain both, video and preview
+     * framebuffers. Frames are converted directly into it, at the requested
+     * dimensions, so it is the only copy of the frames in the service. The
+     * virtual scene camera also needs an NV21 frame to draw the scene. */
+    scene_size = cc->is_virtual_scene ? (cc->pixel_num * 12) / 8 : 0;
+    if (cc->frames_memory_size <
+            cc->video_frame_size + cc->preview_frame_size + scene_size) {
+        free(cc->frames_memory);
+        cc->frames_memory_size = 0;
+        cc->frames_memory = (uint8_t*)malloc(
+            cc->video_frame_size + cc->preview_frame_size + scene_size);
+        if (cc->frames_memory == NULL) {
+            E("%s: Not enough memory for framebuffers %d + %d",
+              __FUNCTION__, cc->video_frame_size, cc->preview_frame_size);
+            _qemu_client_reply_ko(qc, "Out of memory");
+            return;
+        }
+        cc->frames_memory_size =
+            cc->video_frame_size + cc->preview_frame_size + scene_size;
     }
+    cc->video_frame = cc->frames_memory;
+    cc->scene_frame = cc->is_virtual_scene ?
+        cc->frames_memory + cc->video_frame_size + cc->preview_frame_size : NULL;
 
     /* Set framebuffer pointers. */
     cc->preview_frame = (uint16_t*)(cc->video_frame + cc->video_frame_size);
 
     /* Start the camera. */
-    if (camera_device_start_capturing(cc->camera, cc->camera_info->pixel_format,
-                                      cc->width, cc->height)) {
+    if (_camera_client_start_device(cc)) {
         E("%s: Cannot start camera '%s' for %.4s[%dx%d]: %s",
           __FUNCTION__, cc->device_name, (const char*)&cc->pixel_format,
           cc->width, cc->height, strerror(errno));
-        free(cc->video_frame);
         cc->video_frame = NULL;
         _qemu_client_reply_ko(qc, "Cannot start the camera");
         return;
@@ -964,14 +1182,14 @@ _camera_client_query_stop(CameraClient* cc, QemudClient* qc, const char* param)
     }
 
     /* Stop the camera. */
-    if (camera_device_stop_capturing(cc->camera)) {
+    if (_camera_client_stop_device(cc)) {
         E("%s: Cannot stop camera device '%s': %s",
           __FUNCTION__, cc->device_name, strerror(errno));
         _qemu_client_reply_ko(qc, "Cannot stop camera device");
         return;
     }
 
-    free(cc->video_frame);
+    /* The frames memory is kept for the next start. */
     cc->video_frame = NULL;
 
     D("%s: Camera device '%s' is now stopped.", __FUNCTION__, cc->device_name);
@@ -1058,19 +1276,23 @@ _camera_client_query_frame(CameraClient* cc, QemudClient* qc, const char* param)
     if (video_size) {
         fbs[fbs_num].pixel_format = cc->pixel_format;
         fbs[fbs_num].framebuffer = cc->video_frame;
+        fbs[fbs_num].width = cc->width;
+        fbs[fbs_num].height = cc->height;
         fbs_num++;
     }
     if (preview_size) {
         /* TODO: Watch out for preview format changes! */
         fbs[fbs_num].pixel_format = V4L2_PIX_FMT_RGB32;
         fbs[fbs_num].framebuffer = cc->preview_frame;
+        fbs[fbs_num].width = cc->width;
+        fbs[fbs_num].height = cc->height;
         fbs_num++;
     }
 
     /* Capture new frame. */
     tick = _get_timestamp();
-    repeat = camera_device_read_frame(cc->camera, fbs, fbs_num,
-                                      r_scale, g_scale, b_scale, exp_comp);
+    repeat = _camera_client_read_frame(cc, fbs, fbs_num,
+                                       r_scale, g_scale, b_scale, exp_comp);
 
     /* Note that there is no (known) way how to wait on next frame being
      * available, so we could dequeue frame buffer from the device only when we
@@ -1087,8 +1309,8 @@ _camera_client_query_frame(CameraClient* cc, QemudClient* qc, const char* param)
            (_get_timestamp() - tick) < 2000000LL) {
         /* Sleep for 10 millisec before repeating the attempt. */
         _camera_sleep(10);
-        repeat = camera_device_read_frame(cc->camera, fbs, fbs_num,
-                                          r_scale, g_scale, b_scale, exp_comp);
+        repeat = _camera_client_read_frame(cc, fbs, fbs_num,
+                                           r_scale, g_scale, b_scale, exp_comp);
     }
     if (repeat == 1 && !cc->frames_cached) {
         /* Waited too long for the first frame. */
@@ -1247,6 +1469,7 @@ _camera_service_connect(void*          opaque,
 
     D("%s: Connecting camera client '%s'",
       __FUNCTION__, client_param ? client_param : "Factory");
+    _camera_service_wait_webcams(csd);
     if (client_param == NULL || *client_param == '\0') {
         /* This is an emulated camera factory client. */
         client = qemud_client_new(serv, channel, client_param, csd,
@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Contains the code that draws frames of the virtual scene camera.
+ */
+
+#include "android/camera/camera-virtual-scene.h"
+
+#include <string.h>
+
+/* Y, U, and V values of the color bars, from left to right: white, yellow,
+ * cyan, green, magenta, red, blue, and black. */
+static const uint8_t _bars[8][3] = {
+    { 235, 128, 128 },
+    { 210,  16, 146 },
+    { 170, 166,  16 },
+    { 145,  54,  34 },
+    { 106, 202, 222 },
+    {  81,  90, 240 },
+    {  41, 240, 110 },
+    {  16, 128, 128 },
+};
+
+/* Luminance of the moving square, and of the frame number cells. */
+#define SCENE_BOX_Y     128
+#define SCENE_BIT_ON    235
+#define SCENE_BIT_OFF   16
+
+/* Kinds of lines in the scene. All the lines of a kind are the same. */
+enum {
+    SCENE_LINE_BARS,
+    SCENE_LINE_BOX,
+    SCENE_LINE_STRIP,
+    SCENE_LINE_KINDS
+};
+
+/* Positions of the scene elements in a frame. All of them are even, so that
+ * both lines of each chroma line pair are of the same kind. */
+typedef struct SceneLayout {
+    /* First line of the frame number strip. */
+    int strip_top;
+    /* Side of the moving square. */
+    int box_size;
+    /* Top left corner of the moving square. */
+    int box_x;
+    int box_y;
+} SceneLayout;
+
+static void
+_get_layout(SceneLayout* layout, int width, int height, uint32_t frame)
+{
+    const int range = width - ((height / 4) & ~1);
+
+    layout->strip_top = height - ((height / 8) & ~1);
+    layout->box_size = (height / 4) & ~1;
+    layout->box_x = range > 0 ? (int)((frame * 4U) % (uint32_t)range) : 0;
+    layout->box_y = ((layout->strip_top - layout->box_size) / 2) & ~1;
+}
+
+static int
+_get_line_kind(const SceneLayout* layout, int y)
+{
+    if (y >= layout->strip_top) {
+        return SCENE_LINE_STRIP;
+    }
+    if (y >= layout->box_y && y < layout->box_y + layout->box_size) {
+        return SCENE_LINE_BOX;
+    }
+    return SCENE_LINE_BARS;
+}
+
+/* Draws a line of the given kind. 'vu' is the chroma line to draw, or NULL
+ * for odd lines. */
+static void
+_draw_line(uint8_t* y,
+           uint8_t* vu,
+           int width,
+           int kind,
+           const SceneLayout* layout,
+           uint32_t frame)
+{
+    int n, x;
+
+    if (kind == SCENE_LINE_STRIP) {
+        for (n = 0; n < 32; n++) {
+            const int x0 = (n * width / 32) & ~1;
+            const int x1 = ((n + 1) * width / 32) & ~1;
+            memset(y + x0, (frame >> (31 - n)) & 1 ? SCENE_BIT_ON : SCENE_BIT_OFF,
+                   x1 - x0);
+        }
+        if (vu != NULL) {
+            memset(vu, 128, width);
+        }
+        return;
+    }
+
+    for (n = 0; n < 8; n++) {
+        const int x0 = (n * width / 8) & ~1;
+        const int x1 = ((n + 1) * width / 8) & ~1;
+        memset(y + x0, _bars[n][0], x1 - x0);
+        if (vu != NULL) {
+            for (x = x0; x < x1; x += 2) {
+                vu[x] = _bars[n][2];
+                vu[x + 1] = _bars[n][1];
+            }
+        }
+    }
+
+    if (kind == SCENE_LINE_BOX) {
+        const int size = layout->box_size < width ? layout->box_size : width;
+        memset(y + layout->box_x, SCENE_BOX_Y, size);
+        if (vu != NULL) {
+            memset(vu + layout->box_x, 128, size);
+        }
+    }
+}
+
+void
+camera_virtual_scene_draw_NV21(uint8_t* dst,
+                               int width,
+                               int height,
+                               uint32_t frame)
+{
+    /* First drawn line of each kind, the other ones are copied from it. */
+    const uint8_t* first_y[SCENE_LINE_KINDS] = { NULL };
+    const uint8_t* first_vu[SCENE_LINE_KINDS] = { NULL };
+    uint8_t* const vu_pane = dst + width * height;
+    SceneLayout layout;
+    int y;
+
+    _get_layout(&layout, width, height, frame);
+
+    for (y = 0; y < height; y++) {
+        const int kind = _get_line_kind(&layout, y);
+        uint8_t* const line_y = dst + y * width;
+        uint8_t* const line_vu = (y & 1) ? NULL : vu_pane + (y / 2) * width;
+
+        if (first_y[kind] != NULL &&
+            (line_vu == NULL || first_vu[kind] != NULL)) {
+            memcpy(line_y, first_y[kind], width);
+            if (line_vu != NULL) {
+                memcpy(line_vu, first_vu[kind], width);
+            }
+        } else {
+            _draw_line(line_y, line_vu, width, kind, &layout, frame);
+            first_y[kind] = line_y;
+            if (line_vu != NULL) {
+                first_vu[kind] = line_vu;
+            }
+        }
+    }
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_CAMERA_CAMERA_VIRTUAL_SCENE_H
+#define ANDROID_CAMERA_CAMERA_VIRTUAL_SCENE_H
+
+/*
+ * Contains declarations for the scene drawn by the virtual scene camera, a
+ * camera source that doesn't depend on the host hardware, for tests.
+ *
+ * The scene only depends on the frame number: eight vertical color bars, a
+ * gray square that moves 4 pixels to the right on each frame, and a strip at
+ * the bottom of the frame showing the frame number in binary, as 32 white or
+ * black cells, from the most significant bit on the left.
+ *
+ * Frames are drawn directly in NV21, with the layout of
+ * camera-format-converters.c.
+ */
+
+#include "android/utils/compiler.h"
+
+#include <stdint.h>
+
+ANDROID_BEGIN_HEADER
+
+/* Name of the virtual scene camera, for the hw.camera.back and
+ * hw.camera.front settings. */
+#define CAMERA_VIRTUAL_SCENE_NAME  "virtualscene"
+
+/* Draws a frame of the scene into an NV21 framebuffer.
+ * Param:
+ *  dst - Framebuffer to draw into, width * height * 3 / 2 bytes.
+ *  width, height - Frame dimensions, they must be even.
+ *  frame - Frame number.
+ */
+extern void camera_virtual_scene_draw_NV21(uint8_t* dst,
+                                           int width,
+                                           int height,
+                                           uint32_t frame);
+
+ANDROID_END_HEADER
+
+#endif  /* ANDROID_CAMERA_CAMERA_VIRTUAL_SCENE_H */
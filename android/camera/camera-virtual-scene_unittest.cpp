@@ -0,0 +1,115 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/camera/camera-virtual-scene.h"
+
+#include <gtest/gtest.h>
+
+#include <stdint.h>
+#include <vector>
+
+namespace {
+
+const int kWidth = 352;
+const int kHeight = 288;
+
+std::vector<uint8_t> drawFrame(uint32_t frame,
+                               int width = kWidth,
+                               int height = kHeight) {
+    // One extra byte to check that nothing is written past the frame.
+    std::vector<uint8_t> buffer(width * height * 3 / 2 + 1, 0x55);
+    camera_virtual_scene_draw_NV21(&buffer[0], width, height, frame);
+    EXPECT_EQ(0x55, buffer.back());
+    buffer.pop_back();
+    return buffer;
+}
+
+uint8_t lumaAt(const std::vector<uint8_t>& frame, int x, int y) {
+    return frame[y * kWidth + x];
+}
+
+uint8_t vAt(const std::vector<uint8_t>& frame, int x, int y) {
+    return frame[kWidth * kHeight + (y / 2) * kWidth + (x & ~1)];
+}
+
+uint8_t uAt(const std::vector<uint8_t>& frame, int x, int y) {
+    return frame[kWidth * kHeight + (y / 2) * kWidth + (x & ~1) + 1];
+}
+
+// Finds the leftmost column of the moving square.
+int boxLeft(const std::vector<uint8_t>& frame) {
+    const int y = kHeight / 2;
+    for (int x = 0; x < kWidth; ++x) {
+        if (lumaAt(frame, x, y) == 128) {
+            return x;
+        }
+    }
+    return -1;
+}
+
+// Reads the frame number strip.
+uint32_t stripNumber(const std::vector<uint8_t>& frame) {
+    uint32_t number = 0;
+    for (int n = 0; n < 32; ++n) {
+        const int x = (n * kWidth / 32 + (n + 1) * kWidth / 32) / 2;
+        number = (number << 1) | (lumaAt(frame, x, kHeight - 1) == 235);
+    }
+    return number;
+}
+
+}  // namespace
+
+TEST(CameraVirtualScene, IsDeterministic) {
+    EXPECT_EQ(drawFrame(7), drawFrame(7));
+    EXPECT_NE(drawFrame(7), drawFrame(8));
+}
+
+TEST(CameraVirtualScene, ColorBars) {
+    const std::vector<uint8_t> frame = drawFrame(0);
+    // White, yellow, then black bars, above the moving square.
+    EXPECT_EQ(235, lumaAt(frame, 0, 0));
+    EXPECT_EQ(128, vAt(frame, 0, 0));
+    EXPECT_EQ(128, uAt(frame, 0, 0));
+    EXPECT_EQ(210, lumaAt(frame, kWidth / 8 + 2, 1));
+    EXPECT_EQ(146, vAt(frame, kWidth / 8 + 2, 1));
+    EXPECT_EQ(16, uAt(frame, kWidth / 8 + 2, 1));
+    EXPECT_EQ(16, lumaAt(frame, kWidth - 1, 0));
+}
+
+TEST(CameraVirtualScene, MovingSquare) {
+    EXPECT_EQ(0, boxLeft(drawFrame(0)));
+    EXPECT_EQ(40, boxLeft(drawFrame(10)));
+    // The square wraps around before leaving the frame.
+    const int range = kWidth - kHeight / 4;
+    EXPECT_EQ(4, boxLeft(drawFrame((range + 4) / 4)));
+
+    const std::vector<uint8_t> frame = drawFrame(10);
+    EXPECT_EQ(128, vAt(frame, 40, kHeight / 2));
+    EXPECT_EQ(128, uAt(frame, 40, kHeight / 2));
+}
+
+TEST(CameraVirtualScene, FrameNumber) {
+    EXPECT_EQ(0U, stripNumber(drawFrame(0)));
+    EXPECT_EQ(1U, stripNumber(drawFrame(1)));
+    EXPECT_EQ(0x12345678U, stripNumber(drawFrame(0x12345678U)));
+    EXPECT_EQ(0xffffffffU, stripNumber(drawFrame(0xffffffffU)));
+}
+
+TEST(CameraVirtualScene, SmallFrames) {
+    // Nothing is written out of the frame, whatever its size.
+    drawFrame(123, 2, 2);
+    drawFrame(123, 16, 2);
+    drawFrame(123, 2, 16);
+    drawFrame(123, 176, 144);
+}
@@ -10,9 +10,10 @@
 ** GNU General Public License for more details.
 */
 #include "sysemu/char.h"
-#include "android/cbuffer.h"
 #include "android/qemu-debug.h"
 
+#include <string.h>
+
 #define  xxDEBUG
 
 #ifdef DEBUG
@@ -30,48 +31,141 @@
  * we implement communication through charpipe_poll() which
  * must be called by the main event loop after its call to select()
  *
+ * data that can't be delivered immediately is stored in a
+ * power-of-two sized ring buffer, which only grows when it is full.
+ * charpipe_poll() returns immediately when no buffer has pending data.
  */
 
-#define  BIP_BUFFER_SIZE  512
+#define  CHAR_RING_MIN_SIZE  4096
 
-typedef struct BipBuffer {
-    struct BipBuffer*  next;
-    CBuffer            cb[1];
-    char               buff[ BIP_BUFFER_SIZE ];
-} BipBuffer;
+typedef struct CharRing {
+    uint8_t*  data;
+    unsigned  size;   /* 0 or a power of 2 */
+    unsigned  rpos;   /* read position, modulo 2^32 */
+    unsigned  wpos;   /* write position, modulo 2^32 */
+} CharRing;
 
-static BipBuffer*  _free_bip_buffers;
+/* number of rings with pending data */
+static int  _pending_rings;
 
-static BipBuffer*
-bip_buffer_alloc( void )
+static unsigned
+char_ring_count( const CharRing*  ring )
 {
-    BipBuffer*  bip = _free_bip_buffers;
-    if (bip != NULL) {
-        _free_bip_buffers = bip->next;
-    } else {
-        bip = malloc( sizeof(*bip) );
-        if (bip == NULL) {
-            derror( "%s: not enough memory", __FUNCTION__ );
-            exit(1);
-        }
+    return ring->wpos - ring->rpos;
+}
+
+static void
+char_ring_grow( CharRing*  ring, unsigned  needed )
+{
+    unsigned  count    = char_ring_count(ring);
+    unsigned  new_size = ring->size ? ring->size : CHAR_RING_MIN_SIZE;
+    uint8_t*  data;
+
+    while (new_size < needed)
+        new_size *= 2;
+
+    if (new_size == ring->size)
+        return;
+
+    data = malloc( new_size );
+    if (data == NULL) {
+        derror( "%s: not enough memory", __FUNCTION__ );
+        exit(1);
+    }
+
+    /* copy pending data to the start of the new buffer */
+    if (count > 0) {
+        unsigned  pos   = ring->rpos & (ring->size - 1);
+        unsigned  first = ring->size - pos;
+
+        if (first > count)
+            first = count;
+
+        memcpy( data, ring->data + pos, first );
+        memcpy( data + first, ring->data, count - first );
+    }
+    free( ring->data );
+    ring->data = data;
+    ring->size = new_size;
+    ring->rpos = 0;
+    ring->wpos = count;
+}
+
+/* append all of 'buf' to the ring, growing it if needed */
+static void
+char_ring_write( CharRing*  ring, const uint8_t*  buf, int  len )
+{
+    unsigned  count = char_ring_count(ring);
+    unsigned  pos, first;
+
+    if (len <= 0)
+        return;
+
+    if (count + len > ring->size)
+        char_ring_grow( ring, count + len );
+
+    if (count == 0)
+        _pending_rings++;
+
+    pos   = ring->wpos & (ring->size - 1);
+    first = ring->size - pos;
+    if (first > (unsigned)len)
+        first = len;
+
+    memcpy( ring->data + pos, buf, first );
+    memcpy( ring->data, buf + first, len - first );
+    ring->wpos += len;
+}
+
+/* return the number of contiguous bytes that can be read from the ring,
+ * and set '*pbase' to their address */
+static int
+char_ring_peek( CharRing*  ring, uint8_t**  pbase )
+{
+    unsigned  count = char_ring_count(ring);
+    unsigned  pos, avail;
+
+    if (count == 0)
+        return 0;
+
+    pos   = ring->rpos & (ring->size - 1);
+    avail = ring->size - pos;
+    if (avail > count)
+        avail = count;
+
+    *pbase = ring->data + pos;
+    return avail;
+}
+
+static void
+char_ring_step( CharRing*  ring, int  len )
+{
+    if (len <= 0)
+        return;
+
+    ring->rpos += len;
+    if (ring->rpos == ring->wpos) {
+        _pending_rings--;
+        ring->rpos = ring->wpos = 0;
     }
-    bip->next = NULL;
-    cbuffer_reset( bip->cb, bip->buff, sizeof(bip->buff) );
-    return bip;
 }
 
 static void
-bip_buffer_free( BipBuffer*  bip )
+char_ring_done( CharRing*  ring )
 {
-    bip->next         = _free_bip_buffers;
-    _free_bip_buffers = bip;
+    if (char_ring_count(ring) > 0)
+        _pending_rings--;
+
+    free( ring->data );
+    ring->data = NULL;
+    ring->size = 0;
+    ring->rpos = ring->wpos = 0;
 }
 
 /* this models each half of the charpipe */
 typedef struct CharPipeHalf {
     CharDriverState       cs[1];
-    BipBuffer*            bip_first;
-    BipBuffer*            bip_last;
+    CharRing              ring[1];
     struct CharPipeHalf*  peer;         /* NULL if closed */
 } CharPipeHalf;
 
@@ -82,28 +176,57 @@ charpipehalf_close( CharDriverState*  cs )
 {
     CharPipeHalf*  ph = cs->opaque;
 
-    while (ph->bip_first) {
-        BipBuffer*  bip = ph->bip_first;
-        ph->bip_first = bip->next;
-        bip_buffer_free(bip);
-    }
-    ph->bip_last    = NULL;
+    char_ring_done( ph->ring );
     ph->peer        = NULL;
 }
 
 
+/* send as much buffered data as the peer accepts */
+static void
+charpipehalf_poll( CharPipeHalf*  ph )
+{
+    CharPipeHalf*   peer = ph->peer;
+
+    if (peer == NULL || peer->cs->chr_read == NULL)
+        return;
+
+    for (;;) {
+        uint8_t*  base;
+        int       avail = char_ring_peek( ph->ring, &base );
+
+        if (avail == 0)
+            break;
+
+        if (peer->cs->chr_can_read) {
+            int  size = qemu_chr_can_read(peer->cs);
+
+            if (size == 0)
+                break;
+
+            if (avail > size)
+                avail = size;
+        }
+        D("%s: sending %d bytes from %p: '%s'", __FUNCTION__,
+            avail, ph, quote_bytes( base, avail ));
+
+        qemu_chr_read( peer->cs, base, avail );
+        char_ring_step( ph->ring, avail );
+    }
+}
+
+
 static int
 charpipehalf_write( CharDriverState*  cs, const uint8_t*  buf, int  len )
 {
     CharPipeHalf*  ph   = cs->opaque;
     CharPipeHalf*  peer = ph->peer;
-    BipBuffer*     bip  = ph->bip_last;
-    int            ret  = 0;
+    int            ret  = len;
 
     D("%s: writing %d bytes to %p: '%s'", __FUNCTION__,
       len, ph, quote_bytes( buf, len ));
 
-    if (bip == NULL && peer != NULL && peer->cs->chr_read != NULL) {
+    if (char_ring_count(ph->ring) == 0 && peer != NULL &&
+        peer->cs->chr_read != NULL) {
         /* no buffered data, try to write directly to the peer */
         while (len > 0) {
             int  size;
@@ -121,82 +244,24 @@ charpipehalf_write( CharDriverState*  cs, const uint8_t*  buf, int  len )
             qemu_chr_read( peer->cs, (uint8_t*)buf, size );
             buf += size;
             len -= size;
-            ret += size;
         }
     }
 
-    if (len == 0)
-        return ret;
-
     /* buffer the remaining data */
-    if (bip == NULL) {
-        bip = bip_buffer_alloc();
-        ph->bip_first = ph->bip_last = bip;
-    }
-
-    while (len > 0) {
-        int  len2 = cbuffer_write( bip->cb, buf, len );
-
-        buf += len2;
-        ret += len2;
-        len -= len2;
-        if (len == 0)
-            break;
-
-        /* ok, we need another buffer */
-        ph->bip_last = bip_buffer_alloc();
-        bip->next = ph->bip_last;
-        bip       = ph->bip_last;
-    }
+    char_ring_write( ph->ring, buf, len );
     return  ret;
 }
 
 
+/* called when the peer can accept input again */
 static void
-charpipehalf_poll( CharPipeHalf*  ph )
+charpipehalf_accept_input( CharDriverState*  cs )
 {
-    CharPipeHalf*   peer = ph->peer;
-    int             size;
-
-    if (peer == NULL || peer->cs->chr_read == NULL)
-        return;
-
-    while (1) {
-        BipBuffer*  bip = ph->bip_first;
-        uint8_t*    base;
-        int         avail;
-
-        if (bip == NULL)
-            break;
-
-        size = cbuffer_read_avail(bip->cb);
-        if (size == 0) {
-            ph->bip_first = bip->next;
-            if (ph->bip_first == NULL)
-                ph->bip_last = NULL;
-            bip_buffer_free(bip);
-            continue;
-        }
-
-        if (ph->cs->chr_can_read) {
-            int  size2 = qemu_chr_can_read(peer->cs);
-
-            if (size2 == 0)
-                break;
-
-            if (size > size2)
-                size = size2;
-        }
-
-        avail = cbuffer_read_peek( bip->cb, &base );
-        if (avail > size)
-            avail = size;
-        D("%s: sending %d bytes from %p: '%s'", __FUNCTION__,
-            avail, ph, quote_bytes( base, avail ));
+    CharPipeHalf*  ph = cs->opaque;
 
-        qemu_chr_read( peer->cs, base, avail );
-        cbuffer_read_step( bip->cb, avail );
-    }
+    /* 'cs' is the reader, drain the data buffered by the writer */
+    if (ph->peer != NULL)
+        charpipehalf_poll( ph->peer );
 }
 
 
@@ -205,11 +270,10 @@ charpipehalf_init( CharPipeHalf*  ph, CharPipeHalf*  peer )
 {
     CharDriverState*  cs = ph->cs;
 
-    ph->bip_first   = NULL;
-    ph->bip_last    = NULL;
     ph->peer        = peer;
 
     cs->chr_write            = charpipehalf_write;
+    cs->chr_accept_input     = charpipehalf_accept_input;
     cs->chr_ioctl            = NULL;
     cs->chr_send_event       = NULL;
     cs->chr_close            = charpipehalf_close;
@@ -264,8 +328,7 @@ qemu_chr_open_charpipe( CharDriverState*  *pfirst, CharDriverState*  *psecond )
 
 typedef struct CharBuffer {
     CharDriverState  cs[1];
-    BipBuffer*       bip_first;
-    BipBuffer*       bip_last;
+    CharRing         ring[1];
     CharDriverState* endpoint;  /* NULL if closed */
     char             closing;
 } CharBuffer;
@@ -276,13 +339,7 @@ charbuffer_close( CharDriverState*  cs )
 {
     CharBuffer*  cbuf = cs->opaque;
 
-    while (cbuf->bip_first) {
-        BipBuffer*  bip = cbuf->bip_first;
-        cbuf->bip_first = bip->next;
-        bip_buffer_free(bip);
-    }
-    cbuf->bip_last = NULL;
-    cbuf->endpoint = NULL;
+    char_ring_done( cbuf->ring );
 
     if (cbuf->endpoint != NULL) {
         qemu_chr_close(cbuf->endpoint);
@@ -295,13 +352,12 @@ charbuffer_write( CharDriverState*  cs, const uint8_t*  buf, int  len )
 {
     CharBuffer*       cbuf = cs->opaque;
     CharDriverState*  peer = cbuf->endpoint;
-    BipBuffer*        bip  = cbuf->bip_last;
-    int               ret  = 0;
+    int               ret  = len;
 
     D("%s: writing %d bytes to %p: '%s'", __FUNCTION__,
       len, cbuf, quote_bytes( buf, len ));
 
-    if (bip == NULL && peer != NULL) {
+    if (char_ring_count(cbuf->ring) == 0 && peer != NULL) {
         /* no buffered data, try to write directly to the peer */
         int  size = qemu_chr_write(peer, buf, len);
 
@@ -311,33 +367,11 @@ charbuffer_write( CharDriverState*  cs, const uint8_t*  buf, int  len )
             size = len;
 
         buf += size;
-        ret += size;
         len -= size;
     }
 
-    if (len == 0)
-        return ret;
-
     /* buffer the remaining data */
-    if (bip == NULL) {
-        bip = bip_buffer_alloc();
-        cbuf->bip_first = cbuf->bip_last = bip;
-    }
-
-    while (len > 0) {
-        int  len2 = cbuffer_write( bip->cb, buf, len );
-
-        buf += len2;
-        ret += len2;
-        len -= len2;
-        if (len == 0)
-            break;
-
-        /* ok, we need another buffer */
-        cbuf->bip_last = bip_buffer_alloc();
-        bip->next = cbuf->bip_last;
-        bip       = cbuf->bip_last;
-    }
+    char_ring_write( cbuf->ring, buf, len );
     return  ret;
 }
 
@@ -350,24 +384,14 @@ charbuffer_poll( CharBuffer*  cbuf )
     if (peer == NULL)
         return;
 
-    while (1) {
-        BipBuffer*  bip = cbuf->bip_first;
-        uint8_t*    base;
-        int         avail;
-        int         size;
+    for (;;) {
+        uint8_t*  base;
+        int       avail = char_ring_peek( cbuf->ring, &base );
+        int       size;
 
-        if (bip == NULL)
+        if (avail == 0)
             break;
 
-        avail = cbuffer_read_peek( bip->cb, &base );
-        if (avail == 0) {
-            cbuf->bip_first = bip->next;
-            if (cbuf->bip_first == NULL)
-                cbuf->bip_last = NULL;
-            bip_buffer_free(bip);
-            continue;
-        }
-
         size = qemu_chr_write( peer, base, avail );
 
         if (size < 0)  /* just to be safe */
@@ -375,7 +399,7 @@ charbuffer_poll( CharBuffer*  cbuf )
         else if (size > avail)
             size = avail;
 
-        cbuffer_read_step( bip->cb, size );
+        char_ring_step( cbuf->ring, size );
 
         if (size < avail)
             break;
@@ -401,8 +425,6 @@ charbuffer_init( CharBuffer*  cbuf, CharDriverState*  endpoint )
 {
     CharDriverState*  cs = cbuf->cs;
 
-    cbuf->bip_first   = NULL;
-    cbuf->bip_last    = NULL;
     cbuf->endpoint    = endpoint;
 
     cs->chr_write               = charbuffer_write;
@@ -439,6 +461,12 @@ qemu_chr_open_buffer( CharDriverState*  endpoint )
 }
 
 
+int
+charpipe_has_pending( void )
+{
+    return _pending_rings != 0;
+}
+
 void
 charpipe_poll( void )
 {
@@ -448,22 +476,26 @@ charpipe_poll( void )
     CharBuffer*     cb     = _s_charbuffers;
     CharBuffer*     cb_end = cb + MAX_CHAR_BUFFERS;
 
+    /* nothing to deliver, which is the common case */
+    if (_pending_rings == 0)
+        return;
+
     /* poll the charpipes */
     for ( ; cp < cp_end; cp++ ) {
         CharPipeHalf*  half;
 
         half = cp->a;
-        if (half->peer != NULL)
+        if (half->peer != NULL && char_ring_count(half->ring) > 0)
             charpipehalf_poll(half);
 
         half = cp->b;
-        if (half->peer != NULL)
+        if (half->peer != NULL && char_ring_count(half->ring) > 0)
             charpipehalf_poll(half);
     }
 
     /* poll the charbuffers */
     for ( ; cb < cb_end; cb++ ) {
-        if (cb->endpoint != NULL)
+        if (cb->endpoint != NULL && char_ring_count(cb->ring) > 0)
             charbuffer_poll(cb);
     }
 }
@@ -85,6 +85,7 @@ OPT_FLAG ( no_snapshot_save, "do not auto-save to snapshot on exit: abandon chan
 OPT_FLAG ( no_snapshot_load, "do not auto-start from snapshot: perform a full boot" )
 OPT_FLAG ( snapshot_list,  "show a list of available snapshots" )
 OPT_FLAG ( no_snapshot_update_time, "do not do try to correct snapshot time on restore" )
+OPT_PARAM( snapshot_compress, "<level>", "compress RAM in saved snapshots (zlib level 0-9, default 0)" )
 OPT_FLAG ( wipe_data, "reset the user data image (copy it from initdata)" )
 CFG_PARAM( avd, "<name>", "use a specific android virtual device" )
 CFG_PARAM( skindir, "<dir>", "search skins in <dir> (default <system>/skins)" )
@@ -96,6 +97,7 @@ CFG_PARAM( memory, "<size>", "physical RAM size in MBs" )
 
 OPT_PARAM( accel, "<mode>", "Configure emulation acceleration" )
 OPT_FLAG ( no_accel, "Same as '-accel off'" )
+OPT_FLAG ( accel_reprobe, "Detect emulation acceleration again, ignoring cached results" )
 OPT_FLAG ( ranchu, "Use new emulator backend instead of the classic one" )
 
 OPT_PARAM( netspeed, "<speed>", "maximum network download/upload speeds" )
@@ -103,6 +105,7 @@ OPT_PARAM( netdelay, "<delay>", "network latency emulation" )
 OPT_FLAG ( netfast, "disable network shaping" )
 
 OPT_PARAM( code_profile, "<name>", "enable code profiling" )
+OPT_PARAM( code_profile_rate, "<hz>", "sample the code profile instead of recording every block" )
 OPT_FLAG ( show_kernel, "display kernel messages" )
 OPT_FLAG ( shell, "enable root shell on current terminal" )
 OPT_FLAG ( no_jni, "disable JNI checks in the Dalvik runtime" )
@@ -141,6 +144,7 @@ OPT_PARAM( shell_serial, "<device>", "specific character device for root shell"
 OPT_PARAM( tcpdump, "<file>", "capture network packets to file" )
 
 OPT_PARAM( bootchart, "<timeout>", "enable bootcharting")
+OPT_PARAM( startup_trace, "<file>", "write a timeline of the emulator startup to file")
 
 OPT_PARAM( charmap, "<file>", "use specific key character map")
 
@@ -153,6 +157,9 @@ OPT_PARAM( nand_limits, "<nlimits>", "enforce NAND/Flash read/write thresholds"
 #endif
 
 OPT_PARAM( gpu, "<mode>", "set hardware OpenGLES emulation mode" )
+OPT_PARAM( gpu_record, "<file>", "record the GPU-emulated display to a YUV4MPEG2 file" )
+OPT_PARAM( perf_stats, "<file>", "append the performance counters to a file every 10 seconds" )
+OPT_PARAM( benchmark_boot, "<file>", "boot without a window, write a boot time report to file and exit" )
 
 OPT_PARAM( camera_back, "<mode>", "set emulation mode for a camera facing back" )
 OPT_PARAM( camera_front, "<mode>", "set emulation mode for a camera facing front" )
@@ -27,15 +27,23 @@
 #include "android/android.h"
 #include "cpu.h"
 #include "hw/android/goldfish/device.h"
+#include "hw/android/goldfish/nand.h"
 #include "hw/power_supply.h"
 #include "android/shaper.h"
 #include "modem_driver.h"
 #include "android/gps.h"
+#include "android/gps-replay.h"
 #include "android/globals.h"
+#include "android/governor.h"
+#include "android/opengles.h"
+#include "android/mem-stats.h"
+#include "android/perf-stats.h"
 #include "android/utils/bufprint.h"
 #include "android/utils/debug.h"
 #include "android/utils/eintr_wrapper.h"
+#include "android/utils/frame-stats.h"
 #include "android/utils/http_utils.h"
+#include "android/utils/lock_stats.h"
 #include "android/utils/stralloc.h"
 #include "android/utils/utf8_utils.h"
 #include "android/config/config.h"
@@ -50,6 +58,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include "android/hw-events.h"
+#include "android/multitouch-replay.h"
 #include "android/user-events.h"
 #include "android/hw-fingerprint.h"
 #include "android/hw-sensors.h"
@@ -100,6 +109,12 @@ typedef struct ControlClientRec_
     char                       buff[ 4096 ];
     int                        buff_len;
 
+    /* when 'batching' is set, replies are collected in 'out_buff' and sent
+     * with a single write when all received commands are processed. */
+    char                       batching;
+    char                       out_buff[ 4096 ];
+    int                        out_len;
+
 } ControlClientRec;
 
 
@@ -196,6 +211,8 @@ control_global_del_redir( ControlGlobal  global,
  *
  * NOTE: this does not close the socket.
  */
+static void  control_client_flush( ControlClient  client );  /* forward */
+
 static int
 control_client_detach( ControlClient  client )
 {
@@ -204,6 +221,8 @@ control_client_detach( ControlClient  client )
     if (client->sock < 0)
         return -1;
 
+    control_client_flush( client );
+
     qemu_set_fd_handler( client->sock, NULL, NULL, NULL );
     result = client->sock;
     client->sock = -1;
@@ -265,13 +284,10 @@ control_client_destroy( ControlClient  client )
 
 
 
-static void  control_control_write( ControlClient  client, const char*  buff, int  len )
+static void  control_client_send( ControlClient  client, const char*  buff, int  len )
 {
     int ret;
 
-    if (len < 0)
-        len = strlen(buff);
-
     while (len > 0) {
         ret = HANDLE_EINTR(socket_send( client->sock, buff, len));
         if (ret < 0) {
@@ -284,6 +300,34 @@ static void  control_control_write( ControlClient  client, const char*  buff, in
     }
 }
 
+/* send the replies collected in batching mode */
+static void  control_client_flush( ControlClient  client )
+{
+    int  len = client->out_len;
+
+    client->out_len = 0;
+    if (len > 0 && client->sock >= 0)
+        control_client_send( client, client->out_buff, len );
+}
+
+static void  control_control_write( ControlClient  client, const char*  buff, int  len )
+{
+    if (len < 0)
+        len = strlen(buff);
+
+    if (client->batching) {
+        if (client->out_len + len > (int)sizeof(client->out_buff))
+            control_client_flush( client );
+
+        if (len <= (int)sizeof(client->out_buff)) {
+            memcpy( client->out_buff + client->out_len, buff, len );
+            client->out_len += len;
+            return;
+        }
+    }
+    control_client_send( client, buff, len );
+}
+
 static int  control_vwrite( ControlClient  client, const char*  format, va_list args )
 {
     static char  temp[1024];
@@ -339,6 +383,7 @@ typedef struct CommandDefRec_ {
 } CommandDefRec;
 
 static const CommandDefRec   main_commands[];  /* forward */
+static const CommandDefRec   governor_commands[];  /* forward */
 
 static CommandDef
 find_command( char*  input, CommandDef  commands, char*  *pend, char*  *pargs )
@@ -431,6 +476,10 @@ control_client_do_command( ControlClient  client )
         return;
     }
 
+    /* A supervisor polling the governor doesn't make the instance active */
+    if (cmd->subcommands != governor_commands)
+        android_governor_activity();
+
     for (;;) {
         CommandDef  subcmd;
 
@@ -511,15 +560,31 @@ do_help( ControlClient  client, char*  args )
 }
 
 
+/* process received bytes, running each complete command line */
 static void
-control_client_read_byte( ControlClient  client, unsigned char  ch )
+control_client_read_bytes( ControlClient  client, const unsigned char*  buf, int  size )
 {
-    if (ch == '\r')
-    {
-        /* filter them out */
-    }
-    else if (ch == '\n')
-    {
+    const unsigned char*  end = buf + size;
+
+    while (buf < end && !client->finished) {
+        const unsigned char*  eol = memchr( buf, '\n', end - buf );
+        const unsigned char*  stop = eol ? eol : end;
+
+        /* append the line content, filtering out '\r' */
+        for ( ; buf < stop; buf++ ) {
+            if (*buf == '\r')
+                continue;
+
+            if (client->buff_len >= sizeof(client->buff)-1)
+                client->buff_len = 0;
+
+            client->buff[ client->buff_len++ ] = *buf;
+        }
+
+        if (eol == NULL)
+            break;
+
+        buf = eol + 1;
         client->buff[ client->buff_len ] = 0;
         control_client_do_command( client );
         if (client->finished)
@@ -527,13 +592,6 @@ control_client_read_byte( ControlClient  client, unsigned char  ch )
 
         client->buff_len = 0;
     }
-    else
-    {
-        if (client->buff_len >= sizeof(client->buff)-1)
-            client->buff_len = 0;
-
-        client->buff[ client->buff_len++ ] = ch;
-    }
 }
 
 static void
@@ -558,9 +616,9 @@ control_client_read( void*  _client )
         control_client_destroy( client );
     }
     else {
-        int  nn;
 #ifdef _WIN32
 #  if DEBUG
+        int   nn;
         char  temp[16];
         int   count = size > sizeof(temp)-1 ? sizeof(temp)-1 : size;
         for (nn = 0; nn < count; nn++) {
@@ -578,13 +636,15 @@ control_client_read( void*  _client )
 #else
         D(( "received %.*s\n", size, buf ));
 #endif
-        for (nn = 0; nn < size; nn++) {
-            control_client_read_byte( client, buf[nn] );
-            if (client->finished) {
-                control_client_destroy(client);
-                return;
-            }
+        /* commands sent together are answered with a single write */
+        client->batching = 1;
+        control_client_read_bytes( client, buf, size );
+        client->batching = 0;
+        if (client->finished) {
+            control_client_destroy(client);
+            return;
         }
+        control_client_flush( client );
     }
 }
 
@@ -690,6 +750,18 @@ do_network_status( ControlClient  client, char*  args )
 
     control_write( client, "  minimum latency:  %ld ms\r\n", qemu_net_min_latency );
     control_write( client, "  maximum latency:  %ld ms\r\n", qemu_net_max_latency );
+
+    if (slirp_is_inited()) {
+        SlirpMbufStats  stats;
+
+        slirp_lock();
+        slirp_get_mbuf_stats(&stats);
+        slirp_unlock();
+        control_write( client, "  packet buffers:   %d in use (max %d), %lu hits, %lu misses\r\n",
+                       stats.alloced, stats.max, stats.hits, stats.misses );
+        control_write( client, "  large buffers:    %lu hits, %lu misses\r\n",
+                       stats.ext_hits, stats.ext_misses );
+    }
     return 0;
 }
 
@@ -906,7 +978,7 @@ redir_find( ControlGlobal  global, int  port, int  isudp )
 static int
 do_redir_add( ControlClient  client, char*  args )
 {
-    int       len, host_proto, host_port, guest_port;
+    int       len, host_proto, host_port, guest_port, ret;
     uint32_t  guest_ip;
     Redir     redir;
 
@@ -946,7 +1018,10 @@ do_redir_add( ControlClient  client, char*  args )
         return -1;
     }
 
-    if (slirp_redir(host_proto, host_port, guest_ip, guest_port) < 0) {
+    slirp_lock();
+    ret = slirp_redir(host_proto, host_port, guest_ip, guest_port);
+    slirp_unlock();
+    if (ret < 0) {
         control_write( client, "KO: can't setup redirection, port probably used by another program on host\r\n" );
         control_global_del_redir( client->global, host_port, host_proto );
         return -1;
@@ -979,7 +1054,9 @@ do_redir_del( ControlClient  client, char*  args )
         return -1;
     }
 
+    slirp_lock();
     slirp_unredir( redir->host_udp, redir->host_port );
+    slirp_unlock();
     control_global_del_redir( client->global, port, proto );\
 
     return 0;
@@ -2020,6 +2097,40 @@ do_event_text( ControlClient  client, char*  args )
     return 0;
 }
 
+static int
+do_event_replay( ControlClient  client, char*  args )
+{
+    int  ret;
+
+    if (!args) {
+        control_write( client, "KO: Usage: event replay <trace-file>|stop\r\n" );
+        return -1;
+    }
+
+    if (!androidHwConfig_isScreenMultiTouch(android_hw)) {
+        control_write( client, "KO: multi-touch screen is not enabled\r\n" );
+        return -1;
+    }
+
+    if (!strcmp(args, "stop")) {
+        ret = multitouch_replay_get_pending();
+        multitouch_replay_stop();
+        control_write( client, "%d events not replayed\r\n", ret );
+        return 0;
+    }
+
+    ret = multitouch_replay_start(args);
+    if (ret == -1) {
+        control_write( client, "KO: can't read '%s': %s\r\n", args, errno_str );
+        return -1;
+    }
+    if (ret < 0) {
+        control_write( client, "KO: '%s' is not a multi-touch trace file\r\n", args );
+        return -1;
+    }
+    return 0;
+}
+
 static const CommandDefRec  event_commands[] =
 {
     { "send", "send a series of events to the kernel",
@@ -2041,6 +2152,12 @@ static const CommandDefRec  event_commands[] =
     "according to the current device keyboard. unsupported characters will be discarded\r\n"
     "silently\r\n", NULL, do_event_text, NULL },
 
+    { "replay", "replay a recorded multi-touch gesture trace",
+    "'event replay <trace-file>' injects the multi-touch events recorded in <trace-file>\r\n"
+    "at their recorded times, measured on the emulated system clock. see\r\n"
+    "android/multitouch-replay.h for the file format. 'event replay stop' stops the\r\n"
+    "replay in progress\r\n", NULL, do_event_replay, NULL },
+
     { NULL, NULL, NULL, NULL, NULL, NULL }
 };
 
@@ -2385,6 +2502,85 @@ do_geo_fix( ControlClient  client, char*  args )
     return 0;
 }
 
+static int
+do_geo_replay( ControlClient  client, char*  args )
+{
+    char*  end;
+    int    ret;
+
+    if (!args) {
+        control_write( client, "KO: Usage: geo replay <track-file>|stop|pause|resume|"
+                       "seek <seconds>|speed <factor>|status\r\n" );
+        return -1;
+    }
+
+    if (!strcmp(args, "stop")) {
+        ret = gps_replay_get_pending();
+        gps_replay_stop();
+        control_write( client, "%d fixes not replayed\r\n", ret );
+        return 0;
+    }
+
+    if (!strcmp(args, "status")) {
+        int64_t  pos = gps_replay_get_position();
+        if (pos < 0) {
+            control_write( client, "no replay in progress\r\n" );
+        } else {
+            control_write( client, "%s at %.3f seconds, %d fixes pending\r\n",
+                           gps_replay_is_paused() ? "paused" : "playing",
+                           pos / 1000., gps_replay_get_pending() );
+        }
+        return 0;
+    }
+
+    if (!strcmp(args, "pause") || !strcmp(args, "resume")) {
+        ret = (args[0] == 'p') ? gps_replay_pause() : gps_replay_resume();
+        if (ret < 0) {
+            control_write( client, "KO: no replay in progress\r\n" );
+            return -1;
+        }
+        return 0;
+    }
+
+    if (!strncmp(args, "seek ", 5)) {
+        double  pos = strtod(args + 5, &end);
+        if (end == args + 5 || *end) {
+            control_write( client, "KO: invalid position '%s'\r\n", args + 5 );
+            return -1;
+        }
+        if (gps_replay_seek((int64_t)(pos * 1000)) < 0) {
+            control_write( client, "KO: no replay in progress\r\n" );
+            return -1;
+        }
+        return 0;
+    }
+
+    if (!strncmp(args, "speed ", 6)) {
+        double  speed = strtod(args + 6, &end);
+        if (end == args + 6 || *end || gps_replay_set_speed(speed) < 0) {
+            control_write( client, "KO: invalid speed '%s'\r\n", args + 6 );
+            return -1;
+        }
+        return 0;
+    }
+
+    if (!android_gps_cs) {
+        control_write( client, "KO: no GPS emulation in this virtual device\r\n" );
+        return -1;
+    }
+
+    ret = gps_replay_start(args);
+    if (ret == -1) {
+        control_write( client, "KO: can't read '%s': %s\r\n", args, errno_str );
+        return -1;
+    }
+    if (ret < 0) {
+        control_write( client, "KO: '%s' is not a GPS track file\r\n", args );
+        return -1;
+    }
+    return 0;
+}
+
 static const CommandDefRec  geo_commands[] =
 {
     { "nmea", "send a GPS NMEA sentence",
@@ -2404,6 +2600,18 @@ static const CommandDefRec  geo_commands[] =
     "\r\n",
     NULL, do_geo_fix, NULL },
 
+    { "replay", "replay a pre-compiled GPS track",
+    "'geo replay <track-file>' sends the GPS fixes of <track-file> at their recorded\r\n"
+    "times, following the emulated system's clock. See android/gps-replay.h for the\r\n"
+    "file format. The replay in progress can be controlled with:\r\n\r\n"
+    "  geo replay pause|resume    pause or resume the replay\r\n"
+    "  geo replay seek <seconds>  move to <seconds> from the start of the track\r\n"
+    "  geo replay speed <factor>  replay <factor> times faster than recorded\r\n"
+    "  geo replay status          print the current position\r\n"
+    "  geo replay stop            stop the replay\r\n"
+    "\r\n",
+    NULL, do_geo_replay, NULL },
+
     { NULL, NULL, NULL, NULL, NULL, NULL }
 };
 
@@ -2645,6 +2853,213 @@ static const CommandDefRec fingerprint_commands[] =
     { NULL, NULL, NULL, NULL, NULL, NULL }
 };
 
+/********************************************************************************************/
+/********************************************************************************************/
+/*****                                                                                 ******/
+/*****                             G P U   C O M M A N D S                             ******/
+/*****                                                                                 ******/
+/********************************************************************************************/
+/********************************************************************************************/
+
+/* Write the NUL-terminated |text| with CRLF line endings, as the console
+ * expects them. */
+static void
+control_write_lines( ControlClient  client, const char*  text )
+{
+    const char*  end;
+
+    while ((end = strchr(text, '\n')) != NULL) {
+        control_control_write( client, text, end - text );
+        control_control_write( client, "\r\n", 2 );
+        text = end + 1;
+    }
+}
+
+static int
+do_gpu_stats( ControlClient  client, char*  args )
+{
+    if (args && !strcmp(args, "start")) {
+        if (android_enableOpenglesDecoderStats(1) < 0) {
+            control_write( client, "KO: GPU emulation is not enabled\r\n" );
+            return -1;
+        }
+        return 0;
+    }
+    if (args && !strcmp(args, "stop")) {
+        if (android_enableOpenglesDecoderStats(0) < 0) {
+            control_write( client, "KO: GPU emulation is not enabled\r\n" );
+            return -1;
+        }
+        return 0;
+    }
+    if (args) {
+        control_write( client, "KO: bad argument, try 'gpu stats [start|stop]'\r\n" );
+        return -1;
+    }
+
+    size_t  size = android_getOpenglesDecoderStats(NULL, 0);
+    if (size == 0) {
+        control_write( client, "KO: GPU emulation is not enabled\r\n" );
+        return -1;
+    }
+    char*  stats = malloc(size + 1);
+    if (!stats) {
+        control_write( client, "KO: out of memory\r\n" );
+        return -1;
+    }
+    android_getOpenglesDecoderStats(stats, size + 1);
+    control_write_lines( client, stats );
+    free(stats);
+    return 0;
+}
+
+static int
+do_gpu_frames( ControlClient  client, char*  args )
+{
+    if (args && (!strcmp(args, "start") || !strcmp(args, "stop"))) {
+        int  enable = !strcmp(args, "start");
+
+        /* the UI timings are available without GPU emulation too */
+        android_enableOpenglesFrameStats(enable);
+        frame_stats_enable(enable);
+        return 0;
+    }
+    if (args) {
+        control_write( client, "KO: bad argument, try 'gpu frames [start|stop]'\r\n" );
+        return -1;
+    }
+
+    size_t  gpu_size = android_getOpenglesFrameStats(NULL, 0);
+    size_t  ui_size  = frame_stats_print(NULL, 0);
+    size_t  size     = gpu_size > ui_size ? gpu_size : ui_size;
+    char*   stats    = malloc(size + 1);
+    if (!stats) {
+        control_write( client, "KO: out of memory\r\n" );
+        return -1;
+    }
+    if (gpu_size > 0) {
+        android_getOpenglesFrameStats(stats, size + 1);
+        control_write_lines( client, stats );
+    }
+    frame_stats_print(stats, size + 1);
+    control_write_lines( client, stats );
+    free(stats);
+    return 0;
+}
+
+static int
+do_gpu_record( ControlClient  client, char*  args )
+{
+    char*  p = args ? args : "";
+    while (*p == ' ')
+        p++;
+
+    if (!strcmp(p, "stop")) {
+        uint64_t  written, dropped;
+        if (android_stopOpenglesVideoRecording(&written, &dropped) < 0) {
+            control_write( client, "KO: no recording in progress\r\n" );
+            return -1;
+        }
+        control_write( client, "%llu frames written, %llu dropped\r\n",
+                       (unsigned long long)written,
+                       (unsigned long long)dropped );
+        return 0;
+    }
+
+    if (strncmp(p, "start ", 6) != 0) {
+        control_write( client, "KO: bad argument, try 'gpu record start <file> [<fps>]' or 'gpu record stop'\r\n" );
+        return -1;
+    }
+    p += 6;
+    while (*p == ' ')
+        p++;
+
+    int    fps = 30;
+    char*  end = strchr(p, ' ');
+    if (end) {
+        *end++ = '\0';
+        char*  fpsEnd;
+        fps = strtol(end, &fpsEnd, 10);
+        if (fpsEnd == end || *fpsEnd != '\0' || fps <= 0 || fps > 240) {
+            control_write( client, "KO: invalid frame rate '%s'\r\n", end );
+            return -1;
+        }
+    }
+    if (!*p) {
+        control_write( client, "KO: missing file name\r\n" );
+        return -1;
+    }
+    if (android_startOpenglesVideoRecording(p, fps) < 0) {
+        control_write( client, "KO: could not start recording to %s\r\n", p );
+        return -1;
+    }
+    return 0;
+}
+
+static int
+do_gpu_pool( ControlClient  client, char*  args )
+{
+    uint64_t  hits, misses, pooled, max;
+
+    if (args) {
+        control_write( client, "KO: 'gpu pool' takes no argument\r\n" );
+        return -1;
+    }
+    if (android_getOpenglesColorBufferPoolStats(&hits, &misses,
+                                                &pooled, &max) < 0) {
+        control_write( client, "KO: GPU emulation is not enabled\r\n" );
+        return -1;
+    }
+    control_write( client, "hits: %llu\r\n", (unsigned long long)hits );
+    control_write( client, "misses: %llu\r\n", (unsigned long long)misses );
+    control_write( client, "hit rate: %.1f%%\r\n",
+                   hits + misses ? 100.0 * hits / (hits + misses) : 0.0 );
+    control_write( client, "pooled: %llu KB (max %llu KB)\r\n",
+                   (unsigned long long)(pooled / 1024),
+                   (unsigned long long)(max / 1024) );
+    return 0;
+}
+
+static const CommandDefRec  gpu_commands[] =
+{
+    { "stats", "show statistics of the GL calls decoded by the host",
+    "'gpu stats' shows the number of calls, the bytes received, and the host time spent for\r\n"
+    "each GL and renderControl command decoded by the GPU emulation, sorted by decreasing\r\n"
+    "time.\r\n"
+    "'gpu stats start' resets the statistics and starts collecting them.\r\n"
+    "'gpu stats stop' stops collecting them.\r\n",
+    NULL, do_gpu_stats, NULL },
+
+    { "frames", "show frame pacing and latency statistics",
+    "'gpu frames' shows the count, average, percentiles and maximum, in milliseconds, of:\r\n"
+    "  - the interval between two frames displayed by the GPU emulation, and the time from\r\n"
+    "    the guest posting a frame to the host displaying it,\r\n"
+    "  - the interval between two updates of the emulator window, and the time from a\r\n"
+    "    display change or a touch event to the next window update.\r\n"
+    "'gpu frames start' resets the statistics and starts collecting them.\r\n"
+    "'gpu frames stop' stops collecting them.\r\n",
+    NULL, do_gpu_frames, NULL },
+
+    { "record", "record the GPU-emulated display to a file",
+    "'gpu record start <file> [<fps>]' starts recording the frames displayed by the GPU\r\n"
+    "emulation to <file>, as an uncompressed YUV4MPEG2 (.y4m) stream with a constant rate of\r\n"
+    "<fps> frames per second (30 by default). Frames are converted on the GPU, and <file> can\r\n"
+    "be a named pipe read by an external encoder, which must be started first, e.g.:\r\n"
+    "    mkfifo /tmp/screen.y4m && ffmpeg -i /tmp/screen.y4m -c:v libx264 screen.mp4\r\n"
+    "'gpu record stop' stops the recording, and reports the number of frames written and\r\n"
+    "dropped.\r\n",
+    NULL, do_gpu_record, NULL },
+
+    { "pool", "show statistics of the pool of released color buffers",
+    "'gpu pool' shows how many color buffers created by the guest reused a released buffer\r\n"
+    "of the same size and format instead of allocating new host textures, and the memory\r\n"
+    "held by the pool. Its maximum size is set by the ANDROID_GL_COLORBUFFER_POOL_MB\r\n"
+    "environment variable (64 MB by default, 0 to disable the pool).\r\n",
+    NULL, do_gpu_pool, NULL },
+
+    { NULL, NULL, NULL, NULL, NULL, NULL }
+};
+
 /********************************************************************************************/
 /********************************************************************************************/
 /*****                                                                                 ******/
@@ -2947,6 +3362,211 @@ do_kill( ControlClient  client, char*  args )
     exit(0);
 }
 
+static int
+do_lockstats( ControlClient  client, char*  args )
+{
+    if (args && !strcmp(args, "reset")) {
+        lockStats_reset();
+        android_resetOpenglesLockStats();
+        return 0;
+    }
+    if (args) {
+        control_write( client, "KO: bad argument, try 'lockstats [reset]'\r\n" );
+        return -1;
+    }
+
+    size_t  core_size = lockStats_print(NULL, 0);
+    size_t  gpu_size  = android_getOpenglesLockStats(NULL, 0);
+    size_t  size      = core_size > gpu_size ? core_size : gpu_size;
+    char*   stats     = malloc(size + 1);
+    if (!stats) {
+        control_write( client, "KO: out of memory\r\n" );
+        return -1;
+    }
+    lockStats_print(stats, size + 1);
+    control_write_lines( client, stats );
+    if (gpu_size > 0) {
+        android_getOpenglesLockStats(stats, size + 1);
+        control_write_lines( client, stats );
+    }
+    free(stats);
+    return 0;
+}
+
+static int
+do_memstats( ControlClient  client, char*  args )
+{
+    STRALLOC_DEFINE(out);
+
+    if (args) {
+        control_write( client, "KO: 'memstats' takes no argument\r\n" );
+        return -1;
+    }
+    android_mem_stats_report(out);
+    control_write_lines( client, stralloc_cstr(out) );
+    stralloc_reset(out);
+    return 0;
+}
+
+static int
+do_perfstats( ControlClient  client, char*  args )
+{
+    STRALLOC_DEFINE(out);
+
+    if (args) {
+        control_write( client, "KO: 'perfstats' takes no argument\r\n" );
+        return -1;
+    }
+    android_perf_stats_report(out);
+    control_write_lines( client, stralloc_cstr(out) );
+    stralloc_reset(out);
+    return 0;
+}
+
+/* Parse the space-separated integers of |args| into |values|, and return
+ * their number, or -1 on error. */
+static int
+governor_parse_ints( char*  args, int*  values, int  max_values )
+{
+    int  count = 0;
+
+    while (args && *args) {
+        char*  end;
+        long   value;
+
+        while (*args == ' ')
+            args++;
+        if (!*args)
+            break;
+        if (count == max_values)
+            return -1;
+        value = strtol(args, &end, 10);
+        if (end == args || (*end && *end != ' ') || value < 0 || value > 1000000)
+            return -1;
+        values[count++] = (int)value;
+        args = end;
+    }
+    return count;
+}
+
+static int
+do_governor_status( ControlClient  client, char*  args )
+{
+    STRALLOC_DEFINE(out);
+
+    if (args) {
+        control_write( client, "KO: 'governor status' takes no argument\r\n" );
+        return -1;
+    }
+    android_governor_report(out);
+    control_write_lines( client, stralloc_cstr(out) );
+    stralloc_reset(out);
+    return 0;
+}
+
+static int
+do_governor_priority( ControlClient  client, char*  args )
+{
+    int  priority;
+
+    if (governor_parse_ints(args, &priority, 1) != 1 ||
+        priority > GOVERNOR_MAX_PRIORITY) {
+        control_write( client, "KO: try 'governor priority <0-%d>'\r\n",
+                       GOVERNOR_MAX_PRIORITY );
+        return -1;
+    }
+    if (android_governor_set_vcpu_priority(priority) < 0) {
+        control_write( client, "KO: could not change the vCPU thread priority\r\n" );
+        return -1;
+    }
+    return 0;
+}
+
+static int
+do_governor_fps( ControlClient  client, char*  args )
+{
+    int  fps;
+
+    if (governor_parse_ints(args, &fps, 1) != 1) {
+        control_write( client, "KO: try 'governor fps <fps>'\r\n" );
+        return -1;
+    }
+    android_governor_set_fps_limit(fps);
+    return 0;
+}
+
+#ifdef CONFIG_NAND_LIMITS
+static int
+do_governor_nand( ControlClient  client, char*  args )
+{
+    int  rates[2];
+
+    if (governor_parse_ints(args, rates, 2) != 2) {
+        control_write( client, "KO: try 'governor nand <read KB/s> <write KB/s>'\r\n" );
+        return -1;
+    }
+    nand_set_rate_limits((uint64_t)rates[0] << 10, (uint64_t)rates[1] << 10);
+    return 0;
+}
+#endif
+
+static int
+do_governor_idle( ControlClient  client, char*  args )
+{
+    int  values[3] = { 0, GOVERNOR_MAX_PRIORITY, 1 };
+    int  count = governor_parse_ints(args, values, 3);
+    int  ret = -1;
+
+    if (count == 1 || count == 3)
+        ret = android_governor_set_idle(values[0], values[1], values[2]);
+    if (ret == -2) {
+        control_write( client, "KO: the vCPU thread priority could not be restored after the idle mode,\r\n"
+                               "use the current priority or raise RLIMIT_NICE\r\n" );
+        return -1;
+    }
+    if (ret < 0) {
+        control_write( client, "KO: try 'governor idle <seconds> [<priority> <fps>]'\r\n" );
+        return -1;
+    }
+    return 0;
+}
+
+static const CommandDefRec  governor_commands[] =
+{
+    { "status", "show the resource limits of this emulator",
+    "'governor status' shows the vCPU thread priority, the GPU frame rate limit, the NAND\r\n"
+    "rate limits, and the idle mode settings and state.\r\n",
+    NULL, do_governor_status, NULL },
+
+    { "priority", "change the priority of the vCPU threads",
+    "'governor priority <priority>' sets the nice value of the vCPU threads, from 0 (the\r\n"
+    "default) to 19 (the lowest priority). Raising it back may require privileges.\r\n",
+    NULL, do_governor_priority, NULL },
+
+    { "fps", "limit the frame rate of the GPU emulation",
+    "'governor fps <fps>' displays at most <fps> frames per second through the GPU\r\n"
+    "emulation, dropping the other ones. 'governor fps 0' removes the limit.\r\n",
+    NULL, do_governor_fps, NULL },
+
+#ifdef CONFIG_NAND_LIMITS
+    { "nand", "limit the NAND read and write rates",
+    "'governor nand <read> <write>' limits the guest NAND reads and writes to <read> and\r\n"
+    "<write> KB per second, 0 meaning no limit, see -help-nand-limits. only guests that\r\n"
+    "support asynchronous NAND commands are limited.\r\n",
+    NULL, do_governor_nand, NULL },
+#endif
+
+    { "idle", "throttle the emulator when it is not used",
+    "'governor idle <seconds> [<priority> <fps>]' switches the emulator to the vCPU thread\r\n"
+    "priority <priority> (19 by default) and the frame rate limit <fps> (1 by default)\r\n"
+    "after <seconds> without user input, console command or ADB traffic, until the next\r\n"
+    "one. 'governor idle 0' disables it. On Linux, the priority can only be changed if it\r\n"
+    "can be restored afterwards, which may require privileges or a higher RLIMIT_NICE.\r\n",
+    NULL, do_governor_idle, NULL },
+
+    { NULL, NULL, NULL, NULL, NULL, NULL }
+};
+
 static const CommandDefRec   main_commands[] =
 {
     { "help|h|?", "print a list of commands", NULL, NULL, do_help, NULL },
@@ -3012,6 +3632,33 @@ static const CommandDefRec   main_commands[] =
       "allows you to touch the emulator finger print sensor\r\n", NULL,
       NULL, fingerprint_commands},
 
+    { "gpu", "GPU emulation commands",
+      "allows you to inspect the GPU emulation\r\n", NULL,
+      NULL, gpu_commands },
+
+    { "perfstats", "show the performance counters",
+      "'perfstats' shows the value of each performance counter of the emulator, and its\r\n"
+      "rate per second since the previous 'perfstats' command.\r\n", NULL,
+      do_perfstats, NULL },
+
+    { "lockstats", "show the contention of the emulator locks",
+      "'lockstats' shows, for each named lock of the emulator and of the GPU emulation, how many\r\n"
+      "times it was acquired, how many of these acquisitions had to wait for another thread,\r\n"
+      "and the total and maximum wait and hold times in milliseconds, sorted by decreasing\r\n"
+      "wait time. Locks are only profiled by builds configured with --lock-profiling.\r\n"
+      "'lockstats reset' resets the statistics.\r\n", NULL,
+      do_lockstats, NULL },
+
+    { "governor", "limit the host resources used by the emulator",
+      "allows a host running many emulators to share its CPU, GPU and disk between them\r\n", NULL,
+      NULL, governor_commands },
+
+    { "memstats", "show the host memory used by each subsystem",
+      "'memstats' shows the current and peak host memory used by each subsystem of the\r\n"
+      "emulator, their total, and the resident memory of the process. Sizes of mappings,\r\n"
+      "like the guest RAM, are reserved sizes, of which only a part can be resident.\r\n", NULL,
+      do_memstats, NULL },
+
     { NULL, NULL, NULL, NULL, NULL, NULL }
 };
 
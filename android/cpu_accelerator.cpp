@@ -30,3 +30,7 @@ extern "C" bool android_hasCpuAcceleration(char** status_p) {
 
     return accel != android::CPU_ACCELERATOR_NONE;
 }
+
+extern "C" void android_forceCpuAccelerationReprobe(void) {
+    android::ForceCpuAcceleratorReprobe();
+}
@@ -24,6 +24,10 @@ ANDROID_BEGIN_HEADER
 // to be freed by the caller.
 bool android_hasCpuAcceleration(char** status);
 
+// Probe CPU acceleration again in android_hasCpuAcceleration(), instead
+// of using the status remembered by previous launches.
+void android_forceCpuAccelerationReprobe(void);
+
 ANDROID_END_HEADER
 
 #endif  // ANDROID_CPU_ACCELERATOR_H
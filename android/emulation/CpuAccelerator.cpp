@@ -23,8 +23,10 @@
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "android/utils/path.h"
+#include "android/utils/probe_cache.h"
 
 #include "android/base/Compiler.h"
 #include "android/base/files/ScopedFd.h"
@@ -59,11 +61,12 @@ namespace {
 struct GlobalState {
     bool probed;
     bool testing;
+    bool reprobe;
     CpuAccelerator accel;
     char status[256];
 };
 
-GlobalState gGlobals = { false, false, CPU_ACCELERATOR_NONE, { '\0' } };
+GlobalState gGlobals = { false, false, false, CPU_ACCELERATOR_NONE, { '\0' } };
 
 /////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////
@@ -297,6 +300,61 @@ bool ProbeHAX(String* status) {
 
 #endif  // HAVE_HAX
 
+/////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////
+/////
+/////  Probe cache.
+/////
+/////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////
+
+// On Windows, the HAX device has no path that can be checked cheaply,
+// so it is probed on every launch.
+#ifndef _WIN32
+
+#if HAVE_KVM
+const char kAccelDevicePath[] = "/dev/kvm";
+const CpuAccelerator kAccelDeviceType = CPU_ACCELERATOR_KVM;
+#else
+const char kAccelDevicePath[] = "/dev/HAX";
+const CpuAccelerator kAccelDeviceType = CPU_ACCELERATOR_HAX;
+#endif
+
+const char kProbeCacheKind[] = "cpu-accelerator";
+
+// Load the status found by a previous launch. Only successful probes are
+// stored, and the entry remains valid until the device node is created
+// again, i.e. until the driver is reloaded. Its permissions are checked
+// again since they depend on the current user.
+bool LoadCachedStatus(GlobalState* g) {
+    if (::access(kAccelDevicePath, R_OK | W_OK)) {
+        return false;
+    }
+    size_t size = 0;
+    char* data = probeCache_load(kProbeCacheKind, kAccelDevicePath, &size);
+    if (!data) {
+        return false;
+    }
+    char* end;
+    long accel = ::strtol(data, &end, 10);
+    bool ok = (end != data && *end == '\n' && accel == kAccelDeviceType);
+    if (ok) {
+        g->accel = kAccelDeviceType;
+        ::snprintf(g->status, sizeof(g->status), "%s", end + 1);
+    }
+    ::free(data);
+    return ok;
+}
+
+void StoreCachedStatus(const GlobalState* g) {
+    String data;
+    StringAppendFormat(&data, "%d\n%s", g->accel, g->status);
+    probeCache_store(kProbeCacheKind, kAccelDevicePath, data.c_str(),
+                     data.size());
+}
+
+#endif  // !_WIN32
+
 }  // namespace
 
 CpuAccelerator GetCurrentCpuAccelerator() {
@@ -306,6 +364,13 @@ CpuAccelerator GetCurrentCpuAccelerator() {
         return g->accel;
     }
 
+#ifndef _WIN32
+    if (!g->reprobe && LoadCachedStatus(g)) {
+        g->probed = true;
+        return g->accel;
+    }
+#endif
+
     String status;
 #if HAVE_KVM
     if (ProbeKVM(&status)) {
@@ -320,6 +385,12 @@ CpuAccelerator GetCurrentCpuAccelerator() {
 #endif
     ::snprintf(g->status, sizeof(g->status), "%s", status.c_str());
 
+#ifndef _WIN32
+    if (g->accel != CPU_ACCELERATOR_NONE) {
+        StoreCachedStatus(g);
+    }
+#endif
+
     g->probed = true;
     return g->accel;
 }
@@ -335,6 +406,10 @@ String GetCurrentCpuAcceleratorStatus() {
     return String(g->status);
 }
 
+void ForceCpuAcceleratorReprobe() {
+    gGlobals.reprobe = true;
+}
+
 void SetCurrentCpuAcceleratorForTesting(CpuAccelerator accel,
                                         const char* status) {
     GlobalState *g = &gGlobals;
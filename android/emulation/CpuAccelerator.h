@@ -40,6 +40,8 @@ enum CpuAccelerator {
 // This only returns CPU_ACCELERATOR_KVM or CPU_ACCELERATOR_HAX if the
 // corresponding accelerator can be used properly. Otherwise it will
 // return CPU_ACCELERATOR_NONE.
+// On Linux and OS X, a usable accelerator is remembered across launches
+// in the probe cache, until its device node is created again.
 CpuAccelerator  GetCurrentCpuAccelerator();
 
 // Return an ASCII string describing the state of the current CPU
@@ -48,6 +50,10 @@ CpuAccelerator  GetCurrentCpuAccelerator();
 // the accelerator cannot be used.
 String GetCurrentCpuAcceleratorStatus();
 
+// Ignore the status remembered by previous launches, and probe the
+// accelerator again. Must be called before GetCurrentCpuAccelerator().
+void ForceCpuAcceleratorReprobe();
+
 // For unit testing/debugging purpose only, must be called before
 // GetCurrentCpuAccelerator().
 void SetCurrentCpuAcceleratorForTesting(CpuAccelerator accel,
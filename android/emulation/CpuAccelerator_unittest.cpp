@@ -11,6 +11,8 @@
 
 #include "android/emulation/CpuAccelerator.h"
 
+#include "android/utils/probe_cache.h"
+
 #include <stdio.h>
 
 #include <gtest/gtest.h>
@@ -20,6 +22,8 @@ namespace android {
 class CpuAcceleratorTest : public ::testing::Test {
 public:
     CpuAcceleratorTest() {
+        // Don't remember the status of the test machine.
+        probeCache_setDir(NULL);
         saved_accel_ = GetCurrentCpuAccelerator();
         saved_status_ = GetCurrentCpuAcceleratorStatus();
     }
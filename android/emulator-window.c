@@ -135,6 +135,30 @@ static void emulator_window_opengles_redraw_window(void) {
     }
 }
 
+static int emulator_window_opengles_set_layer(
+    int id, const void* pixels, int w, int h, int x, int y,
+    int dst_w, int dst_h) {
+    if (s_use_emugl_subwindow) {
+        return android_setOpenglesSkinLayer(id, pixels, w, h, x, y,
+                                            dst_w, dst_h);
+    } else {
+        return -1;
+    }
+}
+
+static void emulator_window_opengles_show_layer(int id, int visible) {
+    if (s_use_emugl_subwindow) {
+        android_showOpenglesSkinLayer(id, visible);
+    }
+}
+
+static void emulator_window_opengles_set_display_rect(
+    int x, int y, int w, int h) {
+    if (s_use_emugl_subwindow) {
+        android_setOpenglesSkinDisplayRect(x, y, w, h);
+    }
+}
+
 // Used as an emugl callback to get each frame of GPU display.
 static void _emulator_window_on_gpu_frame(void* context,
                                           int width,
@@ -158,6 +182,10 @@ emulator_window_setup( EmulatorWindow*  emulator )
         .opengles_hide = &emulator_window_opengles_hide_window,
         .opengles_redraw = &emulator_window_opengles_redraw_window,
         .opengles_free = &android_stopOpenglesRenderer,
+        .opengles_set_layer = &emulator_window_opengles_set_layer,
+        .opengles_show_layer = &emulator_window_opengles_show_layer,
+        .opengles_set_display_rect =
+                &emulator_window_opengles_set_display_rect,
     };
 
     static const SkinTrackBallParameters my_trackball_params = {
@@ -242,7 +270,7 @@ emulator_window_setup( EmulatorWindow*  emulator )
 }
 
 static void
-emulator_window_fb_update( void*   _emulator, int  x, int  y, int  w, int  h )
+emulator_window_fb_update( void*   _emulator, SkinRegion*  region )
 {
     EmulatorWindow*  emulator = _emulator;
 
@@ -253,7 +281,7 @@ emulator_window_fb_update( void*   _emulator, int  x, int  y, int  w, int  h )
     if (!emulator->ui) {
         emulator_window_setup(emulator);
     }
-    skin_ui_update_display(emulator->ui, x, y, w, h);
+    skin_ui_update_display_region(emulator->ui, region);
 }
 
 static void
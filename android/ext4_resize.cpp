@@ -28,6 +28,7 @@ using android::base::Win32Utils;
 
 #include "android/base/String.h"
 #include "android/ext4_resize.h"
+#include "android/filesystems/ext4_utils.h"
 #include "android/utils/path.h"
 #include "base/system/System.h"
 #include "main-common.h"
@@ -63,6 +64,11 @@ int resizeExt4Partition (const char * partitionPath, int64_t newByteSize) {
         return -1;
     }
 
+    // Most images can be grown in place without spawning resize2fs.
+    if (android_growExt4Image(partitionPath, newByteSize) == 0) {
+        return 0;
+    }
+
     // format common arguments once
     String executable = System::get()->findBundledExecutable("resize2fs");
     if(executable.empty()) {
@@ -30,6 +30,9 @@ ANDROID_BEGIN_HEADER
 // is below the minimum allowed for the specified partition, resize2fs will
 // still fail and the error code will be returned to the user
 //
+// Images are grown in place when android_growExt4Image() supports them,
+// and with the bundled resize2fs otherwise.
+//
 // Returns:
 // 		 0 - indicating the resize was successful
 //		-1 - indicating that formatting the arguments failed
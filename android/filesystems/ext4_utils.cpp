@@ -12,11 +12,14 @@
 #include "android/filesystems/ext4_utils.h"
 
 #include "android/base/Log.h"
+#include "android/base/containers/PodVector.h"
 #include "android/base/files/ScopedStdioFile.h"
 
 #include "make_ext4fs.h"
 
+#include <errno.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <string.h>
 
 #define DEBUG_EXT4  0
@@ -76,3 +79,663 @@ int android_createEmptyExt4Image(const char *filePath,
         EXT4_ERROR << "Failed to create ext4 image at: " << filePath;
     return ret;
 }
+
+namespace {
+
+using android::base::PodVector;
+
+// Offsets of the superblock fields used to grow an image. See
+// Documentation/filesystems/ext4/ondisk in the Linux sources.
+struct Ext4Superblock {
+    static const off_t kOffset = 1024;
+    static const size_t kSize = 1024;
+
+    static const size_t kInodesCount = 0x00;
+    static const size_t kBlocksCount = 0x04;
+    static const size_t kReservedBlocksCount = 0x08;
+    static const size_t kFreeBlocksCount = 0x0c;
+    static const size_t kFreeInodesCount = 0x10;
+    static const size_t kFirstDataBlock = 0x14;
+    static const size_t kLogBlockSize = 0x18;
+    static const size_t kLogClusterSize = 0x1c;
+    static const size_t kBlocksPerGroup = 0x20;
+    static const size_t kInodesPerGroup = 0x28;
+    static const size_t kMagic = 0x38;
+    static const size_t kState = 0x3a;
+    static const size_t kRevLevel = 0x4c;
+    static const size_t kInodeSize = 0x58;
+    static const size_t kBlockGroupNr = 0x5a;
+    static const size_t kFeatureCompat = 0x5c;
+    static const size_t kFeatureIncompat = 0x60;
+    static const size_t kFeatureRoCompat = 0x64;
+    static const size_t kUuid = 0x68;
+    static const size_t kReservedGdtBlocks = 0xce;
+
+    static const uint16_t kMagicValue = 0xef53;
+    static const uint16_t kStateValid = 0x0001;
+    static const uint16_t kStateErrors = 0x0002;
+
+    static const uint32_t kCompatHasJournal = 0x0004;
+    static const uint32_t kCompatResizeInode = 0x0010;
+    // Features that don't change the layout of block groups.
+    static const uint32_t kCompatSupported = 0x0001 | 0x0002 | 0x0004 |
+                                             0x0008 | 0x0010 | 0x0020;
+    static const uint32_t kIncompatSupported = 0x0002 | 0x0040;
+    static const uint32_t kRoCompatSparseSuper = 0x0001;
+    static const uint32_t kRoCompatHugeFile = 0x0008;
+    static const uint32_t kRoCompatGdtCsum = 0x0010;
+    static const uint32_t kRoCompatSupported = 0x0001 | 0x0002 | 0x0008 |
+                                               0x0010 | 0x0020 | 0x0040;
+};
+
+// Offsets of the fields of 32 bytes group descriptors.
+struct Ext4GroupDesc {
+    static const size_t kSize = 32;
+
+    static const size_t kBlockBitmap = 0x00;
+    static const size_t kInodeBitmap = 0x04;
+    static const size_t kInodeTable = 0x08;
+    static const size_t kFreeBlocksCount = 0x0c;
+    static const size_t kFreeInodesCount = 0x0e;
+    static const size_t kUsedDirsCount = 0x10;
+    static const size_t kFlags = 0x12;
+    static const size_t kItableUnused = 0x1c;
+    static const size_t kChecksum = 0x1e;
+
+    static const uint16_t kInodeUninit = 0x0001;
+    static const uint16_t kBlockUninit = 0x0002;
+    static const uint16_t kInodeZeroed = 0x0004;
+};
+
+// Offsets of the inode fields used to update the resize inode.
+struct Ext4Inode {
+    static const uint32_t kResizeInode = 7;
+
+    static const size_t kSize = 0x04;
+    static const size_t kBlocks = 0x1c;
+    static const size_t kFlags = 0x20;
+    static const size_t kDoubleIndirectBlock = 0x28 + 13 * 4;
+    static const size_t kSizeHigh = 0x6c;
+
+    static const uint32_t kDirectBlocks = 12;
+
+    static const uint32_t kHugeFileFlag = 0x40000;
+};
+
+// Don't add a last block group that would have less free blocks.
+const uint32_t kMinLastGroupFreeBlocks = 50;
+
+uint16_t get16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+uint32_t get32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void put16(uint8_t* p, uint32_t value) {
+    p[0] = static_cast<uint8_t>(value);
+    p[1] = static_cast<uint8_t>(value >> 8);
+}
+
+void put32(uint8_t* p, uint32_t value) {
+    put16(p, value);
+    put16(p + 2, value >> 16);
+}
+
+// The CRC16 of group descriptor checksums, with the 0x8005 polynomial.
+uint16_t crc16(uint16_t crc, const uint8_t* data, size_t size) {
+    while (size--) {
+        crc ^= *data++;
+        for (int n = 0; n < 8; ++n) {
+            crc = (crc >> 1) ^ ((crc & 1) ? 0xa001 : 0);
+        }
+    }
+    return crc;
+}
+
+void setBits(uint8_t* bitmap, uint32_t from, uint32_t to) {
+    for (uint32_t n = from; n < to; ++n) {
+        bitmap[n / 8] |= static_cast<uint8_t>(1 << (n % 8));
+    }
+}
+
+void clearBits(uint8_t* bitmap, uint32_t from, uint32_t to) {
+    for (uint32_t n = from; n < to; ++n) {
+        bitmap[n / 8] &= static_cast<uint8_t>(~(1 << (n % 8)));
+    }
+}
+
+// Helper class used to grow an ext4 image in place. It adds block groups
+// after the last one, like resize2fs does when the group descriptors of
+// the new groups fit in the existing descriptor blocks, so that no data
+// has to be moved.
+class Ext4Grower {
+public:
+    explicit Ext4Grower(FILE* file) : mFile(file) {}
+
+    int grow(uint64_t newSize);
+
+private:
+    bool readAt(uint64_t offset, void* buffer, size_t size) {
+        return seekTo(offset) && ::fread(buffer, size, 1, mFile) == 1;
+    }
+
+    bool writeAt(uint64_t offset, const void* buffer, size_t size) {
+        return seekTo(offset) && ::fwrite(buffer, size, 1, mFile) == 1;
+    }
+
+    bool seekTo(uint64_t offset) {
+#ifdef _WIN32
+        return ::fseeko64(mFile, offset, SEEK_SET) == 0;
+#else
+        return ::fseeko(mFile, offset, SEEK_SET) == 0;
+#endif
+    }
+
+    uint64_t blockOffset(uint32_t block) const {
+        return static_cast<uint64_t>(block) * mBlockSize;
+    }
+
+    uint32_t groupStart(uint32_t group) const {
+        return mFirstDataBlock + group * mBlocksPerGroup;
+    }
+
+    // Return true if |group| has a backup of the superblock and of the
+    // group descriptors.
+    bool groupHasSuper(uint32_t group) const {
+        if (group <= 1 || !mSparseSuper) {
+            return true;
+        }
+        if (!(group & 1)) {
+            return false;
+        }
+        static const uint32_t kPrimes[] = { 3, 5, 7 };
+        for (size_t n = 0; n < 3; ++n) {
+            uint32_t power = kPrimes[n];
+            while (power < group) {
+                power *= kPrimes[n];
+            }
+            if (power == group) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Number of blocks used by the superblock, the group descriptors and
+    // the reserved group descriptors at the start of |group|.
+    uint32_t superBlocks(uint32_t group) const {
+        return groupHasSuper(group) ? 1U + mDescBlocks + mReservedGdtBlocks
+                                    : 0U;
+    }
+
+    uint8_t* desc(uint32_t group) {
+        return &mGdt[group * Ext4GroupDesc::kSize];
+    }
+
+    void setChecksum(uint32_t group) {
+        if (!mGdtCsum) {
+            return;
+        }
+        uint8_t le32[4];
+        put32(le32, group);
+        uint16_t crc = crc16(0xffff, &mSb[Ext4Superblock::kUuid], 16);
+        crc = crc16(crc, le32, sizeof(le32));
+        crc = crc16(crc, desc(group), Ext4GroupDesc::kChecksum);
+        put16(desc(group) + Ext4GroupDesc::kChecksum, crc);
+    }
+
+    // Write |count| zero blocks starting at |block|.
+    bool writeZeroBlocks(uint32_t block, uint32_t count) {
+        PodVector<uint8_t> zeroes;
+        zeroes.resize(mBlockSize);
+        ::memset(zeroes.begin(), 0, mBlockSize);
+        for (uint32_t n = 0; n < count; ++n) {
+            if (!writeAt(blockOffset(block + n), zeroes.begin(), mBlockSize)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool initGroup(uint32_t group, uint32_t groupBlocks, bool isLast);
+    bool loadResizeInode(uint32_t oldGroups, uint32_t newGroups);
+    bool writeResizeInode();
+
+    FILE* mFile;
+    uint8_t mSb[Ext4Superblock::kSize];
+    PodVector<uint8_t> mGdt;
+    uint32_t mBlockSize;
+    uint32_t mFirstDataBlock;
+    uint32_t mBlocksPerGroup;
+    uint32_t mInodesPerGroup;
+    uint32_t mInodeTableBlocks;
+    uint32_t mDescBlocks;
+    uint32_t mReservedGdtBlocks;
+    uint32_t mInodeSize;
+    bool mSparseSuper;
+    bool mGdtCsum;
+    // Offset of the end of the file before growing it, the data after it
+    // is known to be zeroes.
+    uint64_t mZeroedOffset;
+    // The resize inode and the indirect blocks it lists, once updated.
+    uint8_t mResizeInode[128];
+    uint64_t mResizeInodeOffset;
+    PodVector<uint32_t> mResizeIndBlocks;
+    PodVector<uint8_t> mResizeInd;
+};
+
+// Initialize the bitmaps and the descriptor of a new group |group| of
+// |groupBlocks| blocks. The backups of the superblock and descriptors are
+// written later.
+bool Ext4Grower::initGroup(uint32_t group, uint32_t groupBlocks, bool isLast) {
+    uint32_t start = groupStart(group);
+    uint32_t blockBitmap = start + superBlocks(group);
+    uint32_t inodeBitmap = blockBitmap + 1U;
+    uint32_t inodeTable = blockBitmap + 2U;
+    uint32_t overhead = superBlocks(group) + 2U + mInodeTableBlocks;
+
+    PodVector<uint8_t> bitmap;
+    bitmap.resize(mBlockSize);
+    ::memset(bitmap.begin(), 0, mBlockSize);
+    setBits(bitmap.begin(), 0, overhead);
+    setBits(bitmap.begin(), groupBlocks, mBlockSize * 8U);
+    if (!writeAt(blockOffset(blockBitmap), bitmap.begin(), mBlockSize)) {
+        return false;
+    }
+    ::memset(bitmap.begin(), 0, mBlockSize);
+    setBits(bitmap.begin(), mInodesPerGroup, mBlockSize * 8U);
+    if (!writeAt(blockOffset(inodeBitmap), bitmap.begin(), mBlockSize)) {
+        return false;
+    }
+
+    // The inode table must only be zeroed when the kernel can't do it
+    // lazily, if it isn't already.
+    bool zeroed = blockOffset(inodeTable) >= mZeroedOffset;
+    if (!zeroed && !mGdtCsum) {
+        if (!writeZeroBlocks(inodeTable, mInodeTableBlocks)) {
+            return false;
+        }
+        zeroed = true;
+    }
+
+    uint16_t flags = 0;
+    if (mGdtCsum) {
+        flags = Ext4GroupDesc::kInodeUninit;
+        if (zeroed) {
+            flags |= Ext4GroupDesc::kInodeZeroed;
+        }
+        if (!isLast) {
+            flags |= Ext4GroupDesc::kBlockUninit;
+        }
+    }
+
+    uint8_t* d = desc(group);
+    ::memset(d, 0, Ext4GroupDesc::kSize);
+    put32(d + Ext4GroupDesc::kBlockBitmap, blockBitmap);
+    put32(d + Ext4GroupDesc::kInodeBitmap, inodeBitmap);
+    put32(d + Ext4GroupDesc::kInodeTable, inodeTable);
+    put16(d + Ext4GroupDesc::kFreeBlocksCount, groupBlocks - overhead);
+    put16(d + Ext4GroupDesc::kFreeInodesCount, mInodesPerGroup);
+    put16(d + Ext4GroupDesc::kFlags, flags);
+    put16(d + Ext4GroupDesc::kItableUnused, mGdtCsum ? mInodesPerGroup : 0);
+    setChecksum(group);
+    return true;
+}
+
+// The resize inode reserves the blocks used to add group descriptor
+// blocks later. Its double indirect block lists the reserved blocks of
+// the primary descriptors, and each of them lists the matching reserved
+// blocks in the groups that have backups. Add the new groups with
+// backups to these lists, like mke2fs does. Everything is read and
+// checked before anything is written.
+bool Ext4Grower::loadResizeInode(uint32_t oldGroups, uint32_t newGroups) {
+    uint32_t inodeTable = get32(desc(0) + Ext4GroupDesc::kInodeTable);
+    mResizeInodeOffset = blockOffset(inodeTable) +
+            (Ext4Inode::kResizeInode - 1U) * mInodeSize;
+    if (!readAt(mResizeInodeOffset, mResizeInode, sizeof(mResizeInode))) {
+        return false;
+    }
+
+    uint32_t dindBlock = get32(mResizeInode + Ext4Inode::kDoubleIndirectBlock);
+    uint32_t addrPerBlock = mBlockSize / 4U;
+    uint32_t firstReserved = mFirstDataBlock + 1U + mDescBlocks;
+    PodVector<uint8_t> dind;
+    dind.resize(mBlockSize);
+    if (!dindBlock || !readAt(blockOffset(dindBlock), dind.begin(),
+                              mBlockSize)) {
+        return false;
+    }
+
+    // make_ext4fs doesn't put the blocks at the index expected by the
+    // kernel, so just update all the listed ones.
+    mResizeIndBlocks.resize(0);
+    mResizeInd.resize(mReservedGdtBlocks * mBlockSize);
+    uint32_t added = 0;
+    uint64_t size = get32(mResizeInode + Ext4Inode::kSize) |
+            (static_cast<uint64_t>(get32(mResizeInode + Ext4Inode::kSizeHigh))
+             << 32);
+    for (uint32_t n = 0; n < addrPerBlock; ++n) {
+        uint32_t primary = get32(&dind[n * 4U]);
+        if (!primary) {
+            continue;
+        }
+        if (primary < firstReserved ||
+            primary >= firstReserved + mReservedGdtBlocks) {
+            EXT4_ERROR << "Unexpected resize inode layout";
+            return false;
+        }
+        size_t listed = 0;
+        while (listed < mResizeIndBlocks.size() &&
+               mResizeIndBlocks[listed] != primary) {
+            listed++;
+        }
+        uint8_t* ind = &mResizeInd[listed * mBlockSize];
+        bool revisit = listed < mResizeIndBlocks.size();
+        if (!revisit) {
+            if (!readAt(blockOffset(primary), ind, mBlockSize)) {
+                return false;
+            }
+            mResizeIndBlocks.push_back(primary);
+        }
+
+        // A block listed twice is updated once, but counted twice.
+        uint32_t index = 0;
+        for (uint32_t group = 1; group < newGroups; ++group) {
+            if (!groupHasSuper(group)) {
+                continue;
+            }
+            if (index >= addrPerBlock) {
+                break;
+            }
+            uint32_t backup = primary + group * mBlocksPerGroup;
+            uint32_t current = get32(&ind[index * 4U]);
+            if (group < oldGroups) {
+                if (current && current != backup) {
+                    EXT4_ERROR << "Unexpected resize inode layout";
+                    return false;
+                }
+            } else {
+                if (current != (revisit ? backup : 0U)) {
+                    EXT4_ERROR << "Unexpected resize inode layout";
+                    return false;
+                }
+                put32(&ind[index * 4U], backup);
+                added++;
+            }
+            index++;
+        }
+
+        // The size covers the last block listed.
+        uint64_t lastSize = (static_cast<uint64_t>(Ext4Inode::kDirectBlocks) +
+                             addrPerBlock + n * addrPerBlock + index) *
+                            mBlockSize;
+        if (lastSize > size) {
+            size = lastSize;
+        }
+    }
+
+    // Account for the new blocks, in 512 bytes sectors unless the inode
+    // counts them in blocks.
+    bool hugeFile = (get32(&mSb[Ext4Superblock::kFeatureRoCompat]) &
+                     Ext4Superblock::kRoCompatHugeFile) &&
+                    (get32(mResizeInode + Ext4Inode::kFlags) &
+                     Ext4Inode::kHugeFileFlag);
+    uint32_t unit = hugeFile ? 1U : mBlockSize / 512U;
+    put32(mResizeInode + Ext4Inode::kBlocks,
+          get32(mResizeInode + Ext4Inode::kBlocks) + added * unit);
+    put32(mResizeInode + Ext4Inode::kSize, static_cast<uint32_t>(size));
+    put32(mResizeInode + Ext4Inode::kSizeHigh,
+          static_cast<uint32_t>(size >> 32));
+    return true;
+}
+
+bool Ext4Grower::writeResizeInode() {
+    for (size_t n = 0; n < mResizeIndBlocks.size(); ++n) {
+        if (!writeAt(blockOffset(mResizeIndBlocks[n]),
+                     &mResizeInd[n * mBlockSize], mBlockSize)) {
+            return false;
+        }
+    }
+    return writeAt(mResizeInodeOffset, mResizeInode, sizeof(mResizeInode));
+}
+
+int Ext4Grower::grow(uint64_t newSize) {
+    if (!readAt(Ext4Superblock::kOffset, mSb, sizeof(mSb))) {
+        EXT4_PERROR << "Could not read superblock";
+        return -EIO;
+    }
+    uint32_t compat = get32(&mSb[Ext4Superblock::kFeatureCompat]);
+    uint32_t incompat = get32(&mSb[Ext4Superblock::kFeatureIncompat]);
+    uint32_t roCompat = get32(&mSb[Ext4Superblock::kFeatureRoCompat]);
+    uint16_t state = get16(&mSb[Ext4Superblock::kState]);
+    uint32_t logBlockSize = get32(&mSb[Ext4Superblock::kLogBlockSize]);
+
+    if (get16(&mSb[Ext4Superblock::kMagic]) != Ext4Superblock::kMagicValue ||
+        get32(&mSb[Ext4Superblock::kRevLevel]) < 1 ||
+        logBlockSize > 6 ||
+        get32(&mSb[Ext4Superblock::kLogClusterSize]) != logBlockSize) {
+        EXT4_ERROR << "Unsupported ext4 image";
+        return -EINVAL;
+    }
+    if ((compat & ~Ext4Superblock::kCompatSupported) ||
+        (incompat & ~Ext4Superblock::kIncompatSupported) ||
+        (roCompat & ~Ext4Superblock::kRoCompatSupported)) {
+        EXT4_LOG << "Unsupported ext4 features, compat " << compat
+                 << " incompat " << incompat << " ro_compat " << roCompat;
+        return -EINVAL;
+    }
+    if (!(state & Ext4Superblock::kStateValid) ||
+        (state & Ext4Superblock::kStateErrors)) {
+        EXT4_ERROR << "The ext4 image must be checked first";
+        return -EINVAL;
+    }
+
+    mBlockSize = 1024U << logBlockSize;
+    mFirstDataBlock = get32(&mSb[Ext4Superblock::kFirstDataBlock]);
+    mBlocksPerGroup = get32(&mSb[Ext4Superblock::kBlocksPerGroup]);
+    mInodesPerGroup = get32(&mSb[Ext4Superblock::kInodesPerGroup]);
+    mInodeSize = get16(&mSb[Ext4Superblock::kInodeSize]);
+    mReservedGdtBlocks = (compat & Ext4Superblock::kCompatResizeInode) ?
+            get16(&mSb[Ext4Superblock::kReservedGdtBlocks]) : 0U;
+    mSparseSuper = (roCompat & Ext4Superblock::kRoCompatSparseSuper) != 0;
+    mGdtCsum = (roCompat & Ext4Superblock::kRoCompatGdtCsum) != 0;
+    if (!mBlocksPerGroup || mBlocksPerGroup > mBlockSize * 8U ||
+        !mInodesPerGroup || mInodesPerGroup > mBlockSize * 8U ||
+        mInodeSize < 128 || mInodeSize > mBlockSize) {
+        EXT4_ERROR << "Invalid ext4 superblock";
+        return -EINVAL;
+    }
+    mInodeTableBlocks =
+            (mInodesPerGroup * mInodeSize + mBlockSize - 1U) / mBlockSize;
+
+    uint32_t oldBlocks = get32(&mSb[Ext4Superblock::kBlocksCount]);
+    if (oldBlocks <= mFirstDataBlock) {
+        return -EINVAL;
+    }
+    uint64_t newBlocks64 = newSize / mBlockSize;
+    if (newBlocks64 < oldBlocks) {
+        EXT4_LOG << "Shrinking is not supported";
+        return -EINVAL;
+    }
+    if (newBlocks64 > 0xffffffffULL) {
+        return -EINVAL;
+    }
+    uint32_t newBlocks = static_cast<uint32_t>(newBlocks64);
+
+    uint32_t descPerBlock = mBlockSize / Ext4GroupDesc::kSize;
+    uint32_t oldGroups = (oldBlocks - mFirstDataBlock + mBlocksPerGroup - 1U) /
+                         mBlocksPerGroup;
+    mDescBlocks = (oldGroups + descPerBlock - 1U) / descPerBlock;
+    uint32_t newGroups = (newBlocks - mFirstDataBlock + mBlocksPerGroup - 1U) /
+                         mBlocksPerGroup;
+
+    // Don't add a last group that's too small to be useful.
+    if (newGroups > oldGroups) {
+        uint32_t lastBlocks = newBlocks - groupStart(newGroups - 1U);
+        if (lastBlocks < superBlocks(newGroups - 1U) + 2U +
+                         mInodeTableBlocks + kMinLastGroupFreeBlocks) {
+            newGroups--;
+            newBlocks = groupStart(newGroups);
+        }
+    }
+    if (newBlocks <= oldBlocks) {
+        return 0;
+    }
+    if ((newGroups + descPerBlock - 1U) / descPerBlock > mDescBlocks) {
+        EXT4_LOG << "Growing to " << newGroups << " block groups requires "
+                 << "new group descriptor blocks";
+        return -EINVAL;
+    }
+    if (static_cast<uint64_t>(newGroups) * mInodesPerGroup > 0xffffffffULL) {
+        return -EINVAL;
+    }
+
+    mGdt.resize(mDescBlocks * mBlockSize);
+    if (!readAt(blockOffset(mFirstDataBlock + 1U), mGdt.begin(),
+                mGdt.size())) {
+        EXT4_PERROR << "Could not read group descriptors";
+        return -EIO;
+    }
+
+    if (mReservedGdtBlocks > 0 && !loadResizeInode(oldGroups, newGroups)) {
+        return -EINVAL;
+    }
+
+    // Extend the file first, the added blocks read as zeroes.
+#ifdef _WIN32
+    if (::fseeko64(mFile, 0, SEEK_END) != 0) {
+        return -errno;
+    }
+    mZeroedOffset = ::ftello64(mFile);
+#else
+    if (::fseeko(mFile, 0, SEEK_END) != 0) {
+        return -errno;
+    }
+    mZeroedOffset = ::ftello(mFile);
+#endif
+    uint64_t newEnd = blockOffset(newBlocks);
+    if (mZeroedOffset < newEnd) {
+        static const uint8_t kZero = 0;
+        if (!writeAt(newEnd - 1U, &kZero, 1U)) {
+            EXT4_PERROR << "Could not extend image";
+            return -errno;
+        }
+    }
+
+    // Extend the last group to a full one, if needed.
+    uint32_t addedFreeBlocks = 0;
+    uint32_t lastGroup = oldGroups - 1U;
+    uint32_t oldLastBlocks = oldBlocks - groupStart(lastGroup);
+    uint32_t newLastBlocks = newBlocks - groupStart(lastGroup);
+    if (newLastBlocks > mBlocksPerGroup) {
+        newLastBlocks = mBlocksPerGroup;
+    }
+    if (newLastBlocks > oldLastBlocks) {
+        uint8_t* d = desc(lastGroup);
+        if (!(get16(d + Ext4GroupDesc::kFlags) &
+              Ext4GroupDesc::kBlockUninit)) {
+            uint32_t bitmapBlock = get32(d + Ext4GroupDesc::kBlockBitmap);
+            PodVector<uint8_t> bitmap;
+            bitmap.resize(mBlockSize);
+            if (!readAt(blockOffset(bitmapBlock), bitmap.begin(),
+                        mBlockSize)) {
+                return -EIO;
+            }
+            clearBits(bitmap.begin(), oldLastBlocks, newLastBlocks);
+            if (!writeAt(blockOffset(bitmapBlock), bitmap.begin(),
+                         mBlockSize)) {
+                return -EIO;
+            }
+        }
+        put16(d + Ext4GroupDesc::kFreeBlocksCount,
+              get16(d + Ext4GroupDesc::kFreeBlocksCount) +
+              newLastBlocks - oldLastBlocks);
+        setChecksum(lastGroup);
+        addedFreeBlocks += newLastBlocks - oldLastBlocks;
+    }
+
+    for (uint32_t group = oldGroups; group < newGroups; ++group) {
+        uint32_t groupBlocks = newBlocks - groupStart(group);
+        if (groupBlocks > mBlocksPerGroup) {
+            groupBlocks = mBlocksPerGroup;
+        }
+        if (!initGroup(group, groupBlocks, group + 1U == newGroups)) {
+            EXT4_PERROR << "Could not initialize block group " << group;
+            return -EIO;
+        }
+        addedFreeBlocks +=
+                get16(desc(group) + Ext4GroupDesc::kFreeBlocksCount);
+    }
+
+    if (mReservedGdtBlocks > 0 && !writeResizeInode()) {
+        EXT4_PERROR << "Could not update resize inode";
+        return -EIO;
+    }
+
+    // Update the superblock.
+    uint32_t addedInodes = (newGroups - oldGroups) * mInodesPerGroup;
+    uint64_t reservedBlocks =
+            static_cast<uint64_t>(
+                    get32(&mSb[Ext4Superblock::kReservedBlocksCount])) *
+            newBlocks / oldBlocks;
+    put32(&mSb[Ext4Superblock::kBlocksCount], newBlocks);
+    put32(&mSb[Ext4Superblock::kReservedBlocksCount],
+          static_cast<uint32_t>(reservedBlocks));
+    put32(&mSb[Ext4Superblock::kFreeBlocksCount],
+          get32(&mSb[Ext4Superblock::kFreeBlocksCount]) + addedFreeBlocks);
+    put32(&mSb[Ext4Superblock::kInodesCount],
+          get32(&mSb[Ext4Superblock::kInodesCount]) + addedInodes);
+    put32(&mSb[Ext4Superblock::kFreeInodesCount],
+          get32(&mSb[Ext4Superblock::kFreeInodesCount]) + addedInodes);
+
+    // Write the backups first, then the primary copies, so that the
+    // image keeps its old size if anything fails before.
+    for (uint32_t group = 1; group < newGroups; ++group) {
+        if (!groupHasSuper(group)) {
+            continue;
+        }
+        put16(&mSb[Ext4Superblock::kBlockGroupNr], group);
+        if (!writeAt(blockOffset(groupStart(group)), mSb, sizeof(mSb)) ||
+            !writeAt(blockOffset(groupStart(group) + 1U), mGdt.begin(),
+                     mGdt.size())) {
+            EXT4_PERROR << "Could not write backups of block group " << group;
+            return -EIO;
+        }
+    }
+    put16(&mSb[Ext4Superblock::kBlockGroupNr], 0);
+    if (!writeAt(blockOffset(mFirstDataBlock + 1U), mGdt.begin(),
+                 mGdt.size()) ||
+        !writeAt(Ext4Superblock::kOffset, mSb, sizeof(mSb)) ||
+        ::fflush(mFile) != 0) {
+        EXT4_PERROR << "Could not write superblock";
+        return -EIO;
+    }
+
+    EXT4_LOG << "Grew ext4 image from " << oldBlocks << " to " << newBlocks
+             << " blocks";
+    return 0;
+}
+
+}  // namespace
+
+int android_growExt4Image(const char* filePath, uint64_t newSize) {
+    if (!filePath) {
+        EXT4_ERROR << "NULL path parameter";
+        return -EINVAL;
+    }
+
+    android::base::ScopedStdioFile file(::fopen(filePath, "r+b"));
+    if (!file.get()) {
+        EXT4_PERROR << "Could not open file: " << filePath;
+        return -errno;
+    }
+
+    Ext4Grower grower(file.get());
+    int ret = grower.grow(newSize);
+    if (::fclose(file.release()) != 0 && ret == 0) {
+        ret = -errno;
+    }
+    return ret;
+}
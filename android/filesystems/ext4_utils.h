@@ -30,6 +30,17 @@ int android_createEmptyExt4Image(const char *filePath,
 // Returns true iff the file at |filePath| is an actual EXT4 partition image.
 bool android_pathIsExt4PartitionImage(const char* filePath);
 
+// Grow the EXT4 partition image file at |filePath| to |newSize| bytes,
+// extending the file if needed, by adding block groups in place. The new
+// block groups are lazily initialized when the filesystem supports it,
+// i.e. their inode tables are only zeroed by the kernel once mounted.
+// Only layouts where the new group descriptors fit in the existing
+// descriptor blocks, without flex_bg, meta_bg or 64bit, are supported,
+// which covers the images created by make_ext4fs.
+// Returns 0 on success, -EINVAL if the image can't be grown this way,
+// in which case resize2fs should be used, or -errno on failure.
+int android_growExt4Image(const char* filePath, uint64_t newSize);
+
 
 ANDROID_END_HEADER
 
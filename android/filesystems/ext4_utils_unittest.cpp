@@ -21,6 +21,7 @@
 
 #include <string>
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -108,3 +109,59 @@ TEST_F(Ext4UtilsTest, android_createEmptyExt4Partition) {
     EXPECT_EQ(0, ret);
     EXPECT_TRUE(android_pathIsExt4PartitionImage(tempPath));
 }
+
+// Return the block count of the ext4 image at |path|, or 0 on error.
+static uint32_t getExt4BlockCount(const char* path) {
+    ScopedStdioFile file(fopen(path, "rb"));
+    uint8_t count[4];
+    if (!file.get() || ::fseek(file.get(), 1024 + 4, SEEK_SET) != 0 ||
+        ::fread(count, sizeof(count), 1, file.get()) != 1) {
+        return 0;
+    }
+    return count[0] | (count[1] << 8) | (count[2] << 16) |
+           ((uint32_t)count[3] << 24);
+}
+
+TEST_F(Ext4UtilsTest, android_growExt4Image) {
+    const char* tempPath = createTempPath();
+    uint64_t kSize = 32 * 1024 * 1024;
+    uint64_t kNewSize = 200 * 1024 * 1024;
+    EXPECT_EQ(0, android_createEmptyExt4Image(tempPath, kSize, "cache"));
+    uint32_t blockCount = getExt4BlockCount(tempPath);
+    ASSERT_LT(0U, blockCount);
+
+    EXPECT_EQ(0, android_growExt4Image(tempPath, kNewSize));
+    EXPECT_TRUE(android_pathIsExt4PartitionImage(tempPath));
+    // The block size is 4096 bytes.
+    EXPECT_EQ(kNewSize / 4096U, getExt4BlockCount(tempPath));
+
+    ScopedStdioFile file(fopen(tempPath, "rb"));
+    ASSERT_TRUE(file.get());
+    ASSERT_EQ(0, ::fseek(file.get(), 0, SEEK_END));
+    EXPECT_EQ(kNewSize, static_cast<uint64_t>(::ftell(file.get())));
+}
+
+TEST_F(Ext4UtilsTest, android_growExt4ImageSameSize) {
+    const char* tempPath = createTempPath();
+    uint64_t kSize = 32 * 1024 * 1024;
+    EXPECT_EQ(0, android_createEmptyExt4Image(tempPath, kSize, "cache"));
+    uint32_t blockCount = getExt4BlockCount(tempPath);
+
+    EXPECT_EQ(0, android_growExt4Image(tempPath, kSize));
+    EXPECT_EQ(blockCount, getExt4BlockCount(tempPath));
+}
+
+TEST_F(Ext4UtilsTest, android_growExt4ImageShrink) {
+    const char* tempPath = createTempPath();
+    uint64_t kSize = 32 * 1024 * 1024;
+    EXPECT_EQ(0, android_createEmptyExt4Image(tempPath, kSize, "cache"));
+    uint32_t blockCount = getExt4BlockCount(tempPath);
+
+    EXPECT_EQ(-EINVAL, android_growExt4Image(tempPath, kSize / 2U));
+    EXPECT_EQ(blockCount, getExt4BlockCount(tempPath));
+}
+
+TEST_F(Ext4UtilsTest, android_growExt4ImageNotExt4) {
+    const char* path = createTempFile(kTestExt4ImageHeaderSize - 2U);
+    EXPECT_GT(0, android_growExt4Image(path, 1024 * 1024));
+}
@@ -0,0 +1,361 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/filesystems/nand_block_map.h"
+
+#include "android/base/EintrWrapper.h"
+#include "android/utils/debug.h"
+#include "android/utils/path.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+namespace {
+
+const struct {
+    const char* suffix;
+    const char* magic;
+} kTypes[] = {
+    { ".erased", "NANDERS3" },
+    { ".cow", "NANDCOW2" },
+};
+
+const size_t kTypesSize = sizeof(kTypes) / sizeof(kTypes[0]);
+
+// Header: magic, erase size, block count, key, then the identity of the
+// image, and whether the bitmap is open.
+const size_t kIdentityOffset = 24;
+const size_t kHeaderSize = 56;
+
+enum {
+    kStateClosed = 0,
+    kStateOpen = 1,
+};
+
+struct ImageIdentity {
+    uint64_t size;
+    uint64_t mtimeNs;
+    uint64_t inode;
+};
+
+bool getImageIdentity(const char* path, ImageIdentity* id) {
+#ifdef _WIN32
+    struct _stati64 st;
+    if (_stati64(path, &st) < 0) {
+        return false;
+    }
+    id->mtimeNs = (uint64_t)st.st_mtime * 1000000000ULL;
+    id->inode = 0;
+#else
+    struct stat st;
+    if (HANDLE_EINTR(stat(path, &st)) < 0) {
+        return false;
+    }
+#ifdef __APPLE__
+    id->mtimeNs = (uint64_t)st.st_mtimespec.tv_sec * 1000000000ULL +
+                  st.st_mtimespec.tv_nsec;
+#else
+    id->mtimeNs = (uint64_t)st.st_mtim.tv_sec * 1000000000ULL +
+                  st.st_mtim.tv_nsec;
+#endif
+    id->inode = st.st_ino;
+#endif
+    id->size = st.st_size;
+    return true;
+}
+
+ssize_t readAt(int fd, void* buf, size_t size, uint64_t offset) {
+#ifdef _WIN32
+    if (_lseeki64(fd, offset, SEEK_SET) != (int64_t)offset) {
+        return -1;
+    }
+    return HANDLE_EINTR(read(fd, buf, size));
+#else
+    return HANDLE_EINTR(pread(fd, buf, size, offset));
+#endif
+}
+
+ssize_t writeAt(int fd, const void* buf, size_t size, uint64_t offset) {
+#ifdef _WIN32
+    if (_lseeki64(fd, offset, SEEK_SET) != (int64_t)offset) {
+        return -1;
+    }
+    return HANDLE_EINTR(write(fd, buf, size));
+#else
+    return HANDLE_EINTR(pwrite(fd, buf, size, offset));
+#endif
+}
+
+int truncateFile(int fd) {
+#ifdef _WIN32
+    return _chsize_s(fd, 0) ? -1 : 0;
+#else
+    return HANDLE_EINTR(ftruncate(fd, 0));
+#endif
+}
+
+void putLe32(uint8_t* p, uint32_t value) {
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+    p[3] = (uint8_t)(value >> 24);
+}
+
+uint32_t getLe32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void putLe64(uint8_t* p, uint64_t value) {
+    putLe32(p, (uint32_t)value);
+    putLe32(p + 4, (uint32_t)(value >> 32));
+}
+
+uint64_t getLe64(const uint8_t* p) {
+    return getLe32(p) | ((uint64_t)getLe32(p + 4) << 32);
+}
+
+void putIdentity(uint8_t* p, const ImageIdentity& id, uint32_t state) {
+    putLe64(p, id.size);
+    putLe64(p + 8, id.mtimeNs);
+    putLe64(p + 16, id.inode);
+    putLe32(p + 24, state);
+    putLe32(p + 28, 0);
+}
+
+char* companionPath(const char* imagePath, NandBlockMapType type) {
+    const char* suffix = kTypes[type].suffix;
+    char* path = static_cast<char*>(malloc(strlen(imagePath) +
+                                           strlen(suffix) + 1));
+    if (path) {
+        strcpy(path, imagePath);
+        strcat(path, suffix);
+    }
+    return path;
+}
+
+void writeBits(NandBlockMap* map, size_t offset, size_t size) {
+    if (map->fd < 0) {
+        return;
+    }
+    if (writeAt(map->fd, map->bits + offset, size,
+                kHeaderSize + offset) != (ssize_t)size) {
+        derror("could not update the block map of %s: %s", map->imagePath,
+               strerror(errno));
+    }
+}
+
+void recount(NandBlockMap* map) {
+    map->count = 0;
+    for (uint32_t block = 0; block < map->blockCount; ++block) {
+        map->count += nandBlockMap_get(map, block);
+    }
+}
+
+}  // namespace
+
+int nandBlockMap_init(NandBlockMap* map, uint32_t blockCount) {
+    map->blockCount = blockCount;
+    map->bits = static_cast<uint8_t*>(calloc((blockCount + 7) / 8 + 1, 1));
+    map->count = 0;
+    map->fd = -1;
+    map->imagePath = NULL;
+    return map->bits ? 0 : -1;
+}
+
+void nandBlockMap_done(NandBlockMap* map) {
+    if (map->fd >= 0) {
+        close(map->fd);
+        map->fd = -1;
+    }
+    free(map->imagePath);
+    map->imagePath = NULL;
+    free(map->bits);
+    map->bits = NULL;
+}
+
+size_t nandBlockMap_size(const NandBlockMap* map) {
+    return (map->blockCount + 7) / 8;
+}
+
+void nandBlockMap_set(NandBlockMap* map, uint32_t block, int value) {
+    uint8_t mask = 1 << (block & 7);
+    if (!!(map->bits[block >> 3] & mask) == !!value) {
+        return;
+    }
+    if (value) {
+        map->bits[block >> 3] |= mask;
+        map->count++;
+    } else {
+        map->bits[block >> 3] &= ~mask;
+        map->count--;
+    }
+    writeBits(map, block >> 3, 1);
+}
+
+void nandBlockMap_fill(NandBlockMap* map, int value) {
+    size_t size = nandBlockMap_size(map);
+    memset(map->bits, value ? 0xff : 0, size);
+    if (value && (map->blockCount & 7)) {
+        map->bits[size - 1] = (1 << (map->blockCount & 7)) - 1;
+    }
+    map->count = value ? map->blockCount : 0;
+    writeBits(map, 0, size);
+}
+
+void nandBlockMap_update(NandBlockMap* map) {
+    recount(map);
+    writeBits(map, 0, nandBlockMap_size(map));
+}
+
+int nandBlockMap_open(NandBlockMap* map,
+                      NandBlockMapType type,
+                      const char* imagePath,
+                      uint32_t eraseSize,
+                      uint64_t key,
+                      int reset,
+                      int readOnly) {
+    size_t size = nandBlockMap_size(map);
+    char* path = companionPath(imagePath, type);
+    if (!path) {
+        return 0;
+    }
+
+    int fd = HANDLE_EINTR(open(path, O_BINARY | (readOnly ? O_RDONLY
+                                                          : O_RDWR | O_CREAT),
+                               0666));
+    if (fd < 0) {
+        if (!readOnly) {
+            derror("could not open file %s, %s", path, strerror(errno));
+        }
+        free(path);
+        return 0;
+    }
+
+    ImageIdentity id = {};
+    bool hasId = getImageIdentity(imagePath, &id);
+    uint8_t header[kHeaderSize];
+    ssize_t headerSize = reset ? 0 : readAt(fd, header, sizeof(header), 0);
+    bool loaded = false;
+    // Files with another magic, including older formats, are reset.
+    if (headerSize == (ssize_t)kHeaderSize &&
+        !memcmp(header, kTypes[type].magic, 8) &&
+        getLe32(header + 8) == eraseSize &&
+        getLe32(header + 12) == map->blockCount &&
+        getLe64(header + 16) == key) {
+        const uint8_t* stored = header + kIdentityOffset;
+        bool sameInode = getLe64(stored + 16) == id.inode;
+        if (getLe32(stored + 24) == kStateOpen) {
+            // Not closed properly, the image was being modified.
+            loaded = hasId && sameInode;
+        } else {
+            loaded = hasId && sameInode &&
+                     getLe64(stored) == id.size &&
+                     getLe64(stored + 8) == id.mtimeNs;
+        }
+    }
+    if (loaded) {
+        loaded = readAt(fd, map->bits, size, kHeaderSize) == (ssize_t)size;
+    }
+    if (!loaded) {
+        if (headerSize > 0) {
+            dwarning("ignoring outdated block map %s", path);
+        }
+        memset(map->bits, 0, size);
+    }
+
+    if (readOnly) {
+        close(fd);
+    } else {
+        // Mark the bitmap as open until nandBlockMap_close() records the
+        // new identity of the image.
+        memcpy(header, kTypes[type].magic, 8);
+        putLe32(header + 8, eraseSize);
+        putLe32(header + 12, map->blockCount);
+        putLe64(header + 16, key);
+        putIdentity(header + kIdentityOffset, id, kStateOpen);
+        if (!loaded) {
+            truncateFile(fd);
+        }
+        if (writeAt(fd, header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+            derror("could not write file %s, %s", path, strerror(errno));
+        }
+        map->fd = fd;
+        free(map->imagePath);
+        map->imagePath = strdup(imagePath);
+        if (!loaded) {
+            writeBits(map, 0, size);
+        }
+    }
+    recount(map);
+    free(path);
+    return loaded;
+}
+
+void nandBlockMap_close(NandBlockMap* map) {
+    if (map->fd < 0) {
+        return;
+    }
+    ImageIdentity id;
+    uint8_t identity[kHeaderSize - kIdentityOffset];
+    if (getImageIdentity(map->imagePath, &id)) {
+        putIdentity(identity, id, kStateClosed);
+        if (writeAt(map->fd, identity, sizeof(identity),
+                    kIdentityOffset) != (ssize_t)sizeof(identity)) {
+            derror("could not close the block map of %s: %s",
+                   map->imagePath, strerror(errno));
+        }
+    }
+    close(map->fd);
+    map->fd = -1;
+}
+
+uint64_t nandBlockMap_imageKey(const char* imagePath) {
+    ImageIdentity id;
+    if (!getImageIdentity(imagePath, &id)) {
+        return 0;
+    }
+    // FNV-1a over the identity fields.
+    const uint64_t fields[] = { id.size, id.mtimeNs, id.inode };
+    uint64_t key = 14695981039346656037ULL;
+    for (size_t n = 0; n < sizeof(fields) / sizeof(fields[0]); ++n) {
+        for (int shift = 0; shift < 64; shift += 8) {
+            key ^= (fields[n] >> shift) & 0xff;
+            key *= 1099511628211ULL;
+        }
+    }
+    return key ? key : 1;
+}
+
+void nandBlockMap_forgetImage(const char* imagePath) {
+    for (size_t n = 0; n < kTypesSize; ++n) {
+        char* path = companionPath(imagePath, static_cast<NandBlockMapType>(n));
+        if (path) {
+            if (path_exists(path)) {
+                path_delete_file(path);
+            }
+            free(path);
+        }
+    }
+}
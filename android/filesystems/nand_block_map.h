@@ -0,0 +1,106 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#ifndef ANDROID_FILESYSTEMS_NAND_BLOCK_MAP_H
+#define ANDROID_FILESYSTEMS_NAND_BLOCK_MAP_H
+
+#include "android/utils/compiler.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+ANDROID_BEGIN_HEADER
+
+// A bitmap with one bit per erase block of an emulated NAND device, see
+// hw/android/goldfish/nand.c. Since the image file alone doesn't describe
+// the content of the device, the bitmaps of persistent images are kept up
+// to date in companion files, named after the image with a suffix that
+// depends on the type of the bitmap.
+//
+// A companion file starts with a header that records the geometry of the
+// device, a type-specific key, and the identity of the image (its size,
+// modification time and inode) when the bitmap was last closed. The bitmap
+// is only loaded again if the image still has the same identity, so that
+// an image that was replaced or rewritten by another program doesn't
+// inherit stale bits. After a crash, the identity couldn't be recorded,
+// and only the inode is checked.
+
+typedef enum {
+    // Erase blocks which read as 0xff whatever the image holds.
+    NAND_BLOCK_MAP_ERASED = 0,
+    // With a base image, erase blocks whose content is in the image.
+    NAND_BLOCK_MAP_COW,
+} NandBlockMapType;
+
+typedef struct {
+    uint8_t* bits;
+    uint32_t count;          // number of bits set.
+    uint32_t blockCount;
+    int fd;                  // companion file, or -1.
+    char* imagePath;         // image described by the companion file.
+} NandBlockMap;
+
+// Allocate an empty bitmap of |blockCount| bits that isn't persisted.
+// Return 0 on success, or -1 on failure.
+int nandBlockMap_init(NandBlockMap* map, uint32_t blockCount);
+
+// Close the companion file, if any, and release the bitmap.
+void nandBlockMap_done(NandBlockMap* map);
+
+// Size of the bitmap in bytes.
+size_t nandBlockMap_size(const NandBlockMap* map);
+
+static inline int nandBlockMap_get(const NandBlockMap* map, uint32_t block) {
+    return (map->bits[block >> 3] >> (block & 7)) & 1;
+}
+
+// Set or clear the bit of |block|, and update the companion file.
+void nandBlockMap_set(NandBlockMap* map, uint32_t block, int value);
+
+// Set or clear all bits, and update the companion file.
+void nandBlockMap_fill(NandBlockMap* map, int value);
+
+// Recount the bits after |map->bits| was modified directly, e.g. loaded
+// from a snapshot, and update the companion file.
+void nandBlockMap_update(NandBlockMap* map);
+
+// Open the companion file of type |type| for the image at |imagePath|, for
+// a device with |blockCount| erase blocks of |eraseSize| bytes, and load
+// it. If |reset| is true, or the header doesn't match the device, |key| or
+// the image, start with an empty bitmap. A read-only bitmap is loaded but
+// never written. Return 1 if the bitmap was loaded, or 0.
+int nandBlockMap_open(NandBlockMap* map,
+                      NandBlockMapType type,
+                      const char* imagePath,
+                      uint32_t eraseSize,
+                      uint64_t key,
+                      int reset,
+                      int readOnly);
+
+// Record the current identity of the image in the companion file, once
+// the image won't be modified anymore, and close it. The bits stay
+// available.
+void nandBlockMap_close(NandBlockMap* map);
+
+// Return a key that identifies the current content of the image at
+// |imagePath| from its size, modification time and inode, to tie a bitmap
+// to another image, e.g. the COW bitmap of a device to its base image.
+// Return 0 if the image can't be accessed.
+uint64_t nandBlockMap_imageKey(const char* imagePath);
+
+// Delete all the companion files of the image at |imagePath|. This must
+// be called after an image is created or rewritten outside of the NAND
+// code, e.g. when it is wiped.
+void nandBlockMap_forgetImage(const char* imagePath);
+
+ANDROID_END_HEADER
+
+#endif  // ANDROID_FILESYSTEMS_NAND_BLOCK_MAP_H
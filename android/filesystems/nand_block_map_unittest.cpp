@@ -0,0 +1,319 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/filesystems/nand_block_map.h"
+
+#include "android/base/String.h"
+#include "android/base/testing/TestTempDir.h"
+#include "android/utils/path.h"
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+#ifdef _WIN32
+#include <sys/utime.h>
+#else
+#include <utime.h>
+#endif
+
+using android::base::String;
+using android::base::TestTempDir;
+
+namespace {
+
+const uint32_t kEraseSize = 4096;
+const uint32_t kBlockCount = 100;
+
+class NandBlockMapTest : public testing::Test {
+protected:
+    NandBlockMapTest() : mDir("nand_block_map_test") {
+        mImagePath = mDir.makeSubPath("image");
+        writeImage(0);
+    }
+
+    // Write an image made of erase blocks filled with |value|.
+    void writeImage(char value) {
+        FILE* file = fopen(mImagePath.c_str(), "wb");
+        ASSERT_TRUE(file);
+        char block[kEraseSize];
+        memset(block, value, sizeof(block));
+        for (uint32_t n = 0; n < kBlockCount; ++n) {
+            ASSERT_EQ(1U, fwrite(block, sizeof(block), 1, file));
+        }
+        fclose(file);
+    }
+
+    // Read erase block |block| of the device, like hw/android/goldfish/nand.c.
+    char readBlock(const NandBlockMap* map, uint32_t block) {
+        if (nandBlockMap_get(map, block)) {
+            return (char)0xff;
+        }
+        char value = 0;
+        FILE* file = fopen(mImagePath.c_str(), "rb");
+        EXPECT_TRUE(file);
+        if (file) {
+            fseek(file, (long)block * kEraseSize, SEEK_SET);
+            EXPECT_EQ(1U, fread(&value, 1, 1, file));
+            fclose(file);
+        }
+        return value;
+    }
+
+    // Move the modification time of the image, like another program that
+    // rewrites it would.
+    void touchImage(int seconds) {
+        struct utimbuf times;
+        times.actime = times.modtime = time(NULL) + seconds;
+        ASSERT_EQ(0, utime(mImagePath.c_str(), &times));
+    }
+
+    int open(NandBlockMap* map, NandBlockMapType type, uint64_t key = 0,
+             int reset = 0) {
+        EXPECT_EQ(0, nandBlockMap_init(map, kBlockCount));
+        return nandBlockMap_open(map, type, mImagePath.c_str(), kEraseSize,
+                                 key, reset, 0);
+    }
+
+    TestTempDir mDir;
+    String mImagePath;
+};
+
+}  // namespace
+
+TEST_F(NandBlockMapTest, PersistsBits) {
+    NandBlockMap map;
+    EXPECT_EQ(0, open(&map, NAND_BLOCK_MAP_ERASED));
+    EXPECT_EQ(0U, map.count);
+    nandBlockMap_set(&map, 3, 1);
+    nandBlockMap_set(&map, 99, 1);
+    nandBlockMap_set(&map, 3, 0);
+    nandBlockMap_set(&map, 42, 1);
+    nandBlockMap_close(&map);
+    nandBlockMap_done(&map);
+
+    EXPECT_EQ(1, open(&map, NAND_BLOCK_MAP_ERASED));
+    EXPECT_EQ(2U, map.count);
+    EXPECT_EQ(0, nandBlockMap_get(&map, 3));
+    EXPECT_EQ(1, nandBlockMap_get(&map, 42));
+    EXPECT_EQ(1, nandBlockMap_get(&map, 99));
+    nandBlockMap_done(&map);
+
+    // Each type has its own file.
+    EXPECT_EQ(0, open(&map, NAND_BLOCK_MAP_COW));
+    EXPECT_EQ(0U, map.count);
+    nandBlockMap_done(&map);
+}
+
+TEST_F(NandBlockMapTest, FillAndUpdate) {
+    NandBlockMap map;
+    open(&map, NAND_BLOCK_MAP_COW);
+    nandBlockMap_fill(&map, 1);
+    EXPECT_EQ(kBlockCount, map.count);
+    map.bits[0] = 0;
+    nandBlockMap_update(&map);
+    EXPECT_EQ(kBlockCount - 8, map.count);
+    nandBlockMap_close(&map);
+    nandBlockMap_done(&map);
+
+    EXPECT_EQ(1, open(&map, NAND_BLOCK_MAP_COW));
+    EXPECT_EQ(kBlockCount - 8, map.count);
+    nandBlockMap_done(&map);
+}
+
+TEST_F(NandBlockMapTest, IgnoresOtherDevicesAndKeys) {
+    NandBlockMap map;
+    open(&map, NAND_BLOCK_MAP_COW, 1234);
+    nandBlockMap_set(&map, 1, 1);
+    nandBlockMap_close(&map);
+    nandBlockMap_done(&map);
+
+    EXPECT_EQ(0, open(&map, NAND_BLOCK_MAP_COW, 5678));
+    EXPECT_EQ(0U, map.count);
+    nandBlockMap_set(&map, 1, 1);
+    nandBlockMap_close(&map);
+    nandBlockMap_done(&map);
+
+    ASSERT_EQ(0, nandBlockMap_init(&map, kBlockCount));
+    EXPECT_EQ(0, nandBlockMap_open(&map, NAND_BLOCK_MAP_COW,
+                                   mImagePath.c_str(), kEraseSize * 2, 5678,
+                                   0, 0));
+    nandBlockMap_done(&map);
+}
+
+TEST_F(NandBlockMapTest, Reset) {
+    NandBlockMap map;
+    open(&map, NAND_BLOCK_MAP_ERASED);
+    nandBlockMap_set(&map, 1, 1);
+    nandBlockMap_close(&map);
+    nandBlockMap_done(&map);
+
+    EXPECT_EQ(0, open(&map, NAND_BLOCK_MAP_ERASED, 0, 1));
+    EXPECT_EQ(0U, map.count);
+    nandBlockMap_close(&map);
+    nandBlockMap_done(&map);
+
+    EXPECT_EQ(1, open(&map, NAND_BLOCK_MAP_ERASED));
+    EXPECT_EQ(0U, map.count);
+    nandBlockMap_done(&map);
+}
+
+TEST_F(NandBlockMapTest, IgnoresImageChangedAfterClose) {
+    NandBlockMap map;
+    open(&map, NAND_BLOCK_MAP_ERASED);
+    nandBlockMap_set(&map, 5, 1);
+    // The changes made while the bitmap is open are fine.
+    touchImage(-10);
+    nandBlockMap_close(&map);
+    nandBlockMap_done(&map);
+
+    touchImage(10);
+    EXPECT_EQ(0, open(&map, NAND_BLOCK_MAP_ERASED));
+    EXPECT_EQ(0U, map.count);
+    nandBlockMap_done(&map);
+}
+
+TEST_F(NandBlockMapTest, IgnoresImageResizedAfterClose) {
+    NandBlockMap map;
+    open(&map, NAND_BLOCK_MAP_ERASED);
+    nandBlockMap_set(&map, 5, 1);
+    nandBlockMap_close(&map);
+    nandBlockMap_done(&map);
+
+    FILE* file = fopen(mImagePath.c_str(), "ab");
+    ASSERT_TRUE(file);
+    fputc(0, file);
+    fclose(file);
+    EXPECT_EQ(0, open(&map, NAND_BLOCK_MAP_ERASED));
+    nandBlockMap_done(&map);
+}
+
+TEST_F(NandBlockMapTest, KeepsBitsAfterCrash) {
+    NandBlockMap map;
+    open(&map, NAND_BLOCK_MAP_ERASED);
+    nandBlockMap_set(&map, 7, 1);
+    touchImage(10);
+    // No nandBlockMap_close(), the image identity isn't recorded.
+    nandBlockMap_done(&map);
+
+    EXPECT_EQ(1, open(&map, NAND_BLOCK_MAP_ERASED));
+    EXPECT_EQ(1, nandBlockMap_get(&map, 7));
+    nandBlockMap_done(&map);
+}
+
+TEST_F(NandBlockMapTest, ResetsOlderFormats) {
+    // The header of an older format, without the identity of the image.
+    String path = mDir.makeSubPath("image.erased");
+    uint8_t header[24] = { 'N', 'A', 'N', 'D', 'E', 'R', 'S', '2' };
+    header[9] = kEraseSize >> 8;
+    header[12] = kBlockCount;
+    uint8_t bits[(kBlockCount + 7) / 8] = { 0x81 };
+    FILE* file = fopen(path.c_str(), "wb");
+    ASSERT_TRUE(file);
+    fwrite(header, sizeof(header), 1, file);
+    fwrite(bits, sizeof(bits), 1, file);
+    fclose(file);
+
+    NandBlockMap map;
+    EXPECT_EQ(0, open(&map, NAND_BLOCK_MAP_ERASED));
+    EXPECT_EQ(0U, map.count);
+    nandBlockMap_set(&map, 3, 1);
+    nandBlockMap_close(&map);
+    nandBlockMap_done(&map);
+
+    EXPECT_EQ(1, open(&map, NAND_BLOCK_MAP_ERASED));
+    EXPECT_EQ(1U, map.count);
+    EXPECT_EQ(1, nandBlockMap_get(&map, 3));
+    nandBlockMap_done(&map);
+}
+
+TEST_F(NandBlockMapTest, IgnoresCowOfChangedBase) {
+    // A base image of the same size as the device, rewritten in place.
+    String basePath = mDir.makeSubPath("base");
+    FILE* file = fopen(basePath.c_str(), "wb");
+    ASSERT_TRUE(file);
+    ASSERT_EQ(0, fseek(file, (long)kBlockCount * kEraseSize - 1, SEEK_SET));
+    fputc(0, file);
+    fclose(file);
+
+    uint64_t key = nandBlockMap_imageKey(basePath.c_str());
+    EXPECT_NE(0U, key);
+    EXPECT_EQ(key, nandBlockMap_imageKey(basePath.c_str()));
+    EXPECT_EQ(0U, nandBlockMap_imageKey(mDir.makeSubPath("none").c_str()));
+
+    NandBlockMap map;
+    open(&map, NAND_BLOCK_MAP_COW, key);
+    nandBlockMap_set(&map, 2, 1);
+    nandBlockMap_close(&map);
+    nandBlockMap_done(&map);
+
+    EXPECT_EQ(1, open(&map, NAND_BLOCK_MAP_COW,
+                      nandBlockMap_imageKey(basePath.c_str())));
+    EXPECT_EQ(1, nandBlockMap_get(&map, 2));
+    nandBlockMap_close(&map);
+    nandBlockMap_done(&map);
+
+    struct utimbuf times;
+    times.actime = times.modtime = time(NULL) + 10;
+    ASSERT_EQ(0, utime(basePath.c_str(), &times));
+    EXPECT_NE(key, nandBlockMap_imageKey(basePath.c_str()));
+    EXPECT_EQ(0, open(&map, NAND_BLOCK_MAP_COW,
+                      nandBlockMap_imageKey(basePath.c_str())));
+    EXPECT_EQ(0U, map.count);
+    nandBlockMap_done(&map);
+}
+
+TEST_F(NandBlockMapTest, ForgetImage) {
+    NandBlockMap map;
+    open(&map, NAND_BLOCK_MAP_ERASED);
+    nandBlockMap_close(&map);
+    nandBlockMap_done(&map);
+    open(&map, NAND_BLOCK_MAP_COW);
+    nandBlockMap_close(&map);
+    nandBlockMap_done(&map);
+
+    nandBlockMap_forgetImage(mImagePath.c_str());
+    EXPECT_FALSE(path_exists(mDir.makeSubPath("image.erased").c_str()));
+    EXPECT_FALSE(path_exists(mDir.makeSubPath("image.cow").c_str()));
+    EXPECT_TRUE(path_exists(mImagePath.c_str()));
+}
+
+// Like -wipe-data, which copies the initial image in the background, see
+// vl-android.c.
+TEST_F(NandBlockMapTest, WipeImage) {
+    String initPath = mDir.makeSubPath("init");
+    ASSERT_EQ(0, path_copy_file(initPath.c_str(), mImagePath.c_str()));
+
+    for (int pass = 0; pass < 2; ++pass) {
+        ASSERT_EQ(0, path_copy_file(mImagePath.c_str(), initPath.c_str()));
+        nandBlockMap_forgetImage(mImagePath.c_str());
+
+        NandBlockMap map;
+        EXPECT_EQ(0, open(&map, NAND_BLOCK_MAP_ERASED));
+        for (uint32_t block = 0; block < kBlockCount; ++block) {
+            EXPECT_EQ(0, readBlock(&map, block)) << "block " << block;
+        }
+
+        // Write block 2, erase block 3.
+        FILE* file = fopen(mImagePath.c_str(), "r+b");
+        ASSERT_TRUE(file);
+        fseek(file, 2 * kEraseSize, SEEK_SET);
+        fputc('x', file);
+        fclose(file);
+        nandBlockMap_set(&map, 3, 1);
+        EXPECT_EQ('x', readBlock(&map, 2));
+        EXPECT_EQ((char)0xff, readBlock(&map, 3));
+        // The emulator is killed, only the inode of the image is checked.
+        nandBlockMap_done(&map);
+    }
+}
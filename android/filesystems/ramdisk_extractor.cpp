@@ -14,11 +14,20 @@
 #include "android/base/Compiler.h"
 #include "android/base/Log.h"
 #include "android/base/String.h"
-
+#include "android/base/StringFormat.h"
+#include "android/base/containers/PodVector.h"
+#include "android/base/containers/StringVector.h"
+#include "android/base/memory/LazyInstance.h"
+#include "android/base/memory/ScopedPtr.h"
+#include "android/base/synchronization/Lock.h"
+#include "android/utils/probe_cache.h"
+
+#include <errno.h>
 #include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <zlib.h>
 
 #define DEBUG 0
@@ -37,7 +46,9 @@
 
 namespace {
 
-// Helper class used to implement a gzip-based input stream.
+// Helper class used to implement a gzip-based input stream, whose state
+// can be saved to a checkpoint to resume reading from the same position
+// later. Like gzread(), it also reads files that are not compressed.
 // Usage is as follows:
 //
 //     GZipInputStream input(filePath);
@@ -53,30 +64,82 @@ namespace {
 //      .. stream is closed automatically on scope exit.
 class GZipInputStream {
 public:
+    // A saved state of the stream. This includes the last 32 KiB of
+    // uncompressed data when decompressing, which is why checkpoints
+    // should not be too close to each other.
+    class Checkpoint {
+    public:
+        Checkpoint() : mPosition(0), mFileOffset(0), mInflating(false) {}
+
+        ~Checkpoint() {
+            if (mInflating) {
+                inflateEnd(&mStream);
+            }
+        }
+
+        // Return the position of the checkpoint in the uncompressed data.
+        uint64_t position() const { return mPosition; }
+
+    private:
+        friend class GZipInputStream;
+
+        DISALLOW_COPY_AND_ASSIGN(Checkpoint);
+
+        uint64_t mPosition;
+        uint64_t mFileOffset;
+        bool mInflating;
+        z_stream mStream;
+    };
+
     // Open a new input stream to read from file |filePath|.
     // The constructor can never fail, so call error() after
     // this to see if an error occured.
-    explicit GZipInputStream(const char* filePath) {
-        mFile = gzopen(filePath, "rb");
-        if (mFile == Z_NULL) {
-            mFile = NULL;
+    explicit GZipInputStream(const char* filePath) :
+            mFile(::fopen(filePath, "rb")),
+            mError(0),
+            mInflating(false),
+            mEnd(false),
+            mPosition(0) {
+        ::memset(&mStream, 0, sizeof(mStream));
+        if (!mFile) {
             mError = errno;
-        } else {
-            mError = 0;
+            return;
+        }
+
+        // Only decompress files that start with the gzip magic.
+        size_t count = ::fread(mInput, 1, 2, mFile);
+        mStream.next_in = mInput;
+        mStream.avail_in = count;
+        if (count == 2 && mInput[0] == 0x1f && mInput[1] == 0x8b) {
+            // magic number from gz_read
+            const int kGzipWindowBits = 15 + 16;
+            if (inflateInit2(&mStream, kGzipWindowBits) != Z_OK) {
+                mError = ENOMEM;
+                return;
+            }
+            mInflating = true;
         }
     }
 
     // Return the last error that occured on this stream,
     // or 0 if everything's well. Note that as soon as an
-    // error occurs, the stream cannot be used anymore.
+    // error occurs, the stream cannot be used anymore,
+    // unless restore() is called.
     int error() const { return mError; }
 
+    // Return the current position in the uncompressed data.
+    uint64_t position() const { return mPosition; }
+
     // Close the stream, note that this is called automatically
     // from the destructor, but clients might want to do this
     // before.
     void close() {
+        if (mInflating) {
+            inflateEnd(&mStream);
+            mInflating = false;
+        }
         if (mFile) {
-            gzclose(mFile);
+            ::fclose(mFile);
             mFile = NULL;
         }
     }
@@ -85,81 +148,150 @@ public:
         close();
     }
 
-    // Try to read up to |len| bytes of data from the input
-    // stream into |buffer|. On success, return true and sets
-    // |*readBytes| to the number of bytes that were read.
-    // On failure, return false and set error().
-    bool tryRead(void* buffer, size_t len, size_t* readBytes) {
-        *readBytes = 0;
-
-        if (mError) {
+    // Read exactly |len| bytes of data into |buffer|. On success,
+    // return true, on failure, return false and set error().
+    bool doRead(void* buffer, size_t len) {
+        if (readSome(reinterpret_cast<uint8_t*>(buffer), len) < len) {
+            if (!mError) {
+                mError = EIO;
+            }
             return false;
         }
+        return true;
+    }
 
-        if (len == 0) {
-            return true;
-        }
-
-        // Warning, gzread() takes an unsigned int parameter for
-        // the length, but will return an error if its value
-        // exceeds INT_MAX anyway.
-        char* buff = reinterpret_cast<char*>(buffer);
-
+    bool doSkip(size_t len) {
+        uint8_t buffer[4096];
         while (len > 0) {
-            size_t avail = len;
-            if (avail > INT_MAX)
-                avail = INT_MAX;
-
-            int ret = gzread(mFile, buff, static_cast<unsigned int>(avail));
-            if (ret < 0) {
-                gzerror(mFile, &mError);
-                break;
-            }
-            if (ret == 0) {
-                if (gzeof(mFile)) {
-                    break;
-                }
-                gzerror(mFile, &mError);
-                break;
+            size_t avail = len < sizeof(buffer) ? len : sizeof(buffer);
+            if (!doRead(buffer, avail)) {
+                return false;
             }
-            len -= ret;
-            buff += ret;
-            *readBytes += ret;
+            len -= avail;
         }
-
-        return (!mError && *readBytes > 0);
+        return true;
     }
 
-    // Read exactly |len| bytes of data into |buffer|. On success,
-    // return true, on failure, return false and set error().
-    bool doRead(void* buffer, size_t len) {
-        size_t readCount = 0;
-        if (!tryRead(buffer, len, &readCount)) {
+    // Save the state of the stream to |*checkpoint|. Return true on
+    // success.
+    bool save(Checkpoint* checkpoint) {
+        if (mError || !mFile) {
             return false;
         }
-        if (readCount < len) {
-            mError = EIO;
-            return false;
+        if (checkpoint->mInflating) {
+            inflateEnd(&checkpoint->mStream);
+            checkpoint->mInflating = false;
         }
+        if (mInflating) {
+            if (inflateCopy(&checkpoint->mStream, &mStream) != Z_OK) {
+                return false;
+            }
+            checkpoint->mInflating = true;
+        }
+        checkpoint->mPosition = mPosition;
+        checkpoint->mFileOffset = fileOffset();
         return true;
     }
 
-    bool doSkip(size_t len) {
-        if (mError) {
+    // Restore the state of the stream from |checkpoint|, which must have
+    // been saved by a stream reading the same file. On failure, return
+    // false and set error().
+    bool restore(const Checkpoint& checkpoint) {
+        if (!mFile) {
             return false;
         }
-        if (gzseek(mFile, len, SEEK_CUR) < 0) {
-            gzerror(mFile, &mError);
+        if (mInflating) {
+            inflateEnd(&mStream);
+            mInflating = false;
+        }
+        if (checkpoint.mInflating) {
+            if (inflateCopy(&mStream,
+                            const_cast<z_stream*>(&checkpoint.mStream))
+                    != Z_OK) {
+                mError = ENOMEM;
+                return false;
+            }
+            mInflating = true;
+        }
+        if (::fseek(mFile, static_cast<long>(checkpoint.mFileOffset),
+                    SEEK_SET) < 0) {
+            mError = errno;
             return false;
         }
+        mStream.next_in = mInput;
+        mStream.avail_in = 0;
+        mPosition = checkpoint.mPosition;
+        mError = 0;
+        mEnd = false;
         return true;
     }
 
 private:
     DISALLOW_COPY_AND_ASSIGN(GZipInputStream);
 
-    gzFile mFile;
+    // Return the offset in the file of the first input byte that wasn't
+    // consumed yet.
+    uint64_t fileOffset() const {
+        if (mInflating) {
+            return mStream.total_in;
+        }
+        return mPosition;
+    }
+
+    // Try to read up to |len| bytes of data into |buffer|, and return
+    // the number of bytes that were read, which is only less than |len|
+    // at the end of the stream or on error.
+    size_t readSome(uint8_t* buffer, size_t len) {
+        size_t count = 0;
+        while (count < len && !mError && !mEnd) {
+            if (mStream.avail_in == 0) {
+                size_t ret = ::fread(mInput, 1, sizeof(mInput), mFile);
+                if (ret == 0) {
+                    if (::ferror(mFile)) {
+                        mError = EIO;
+                    }
+                    // A truncated gzip stream is an error.
+                    if (mInflating) {
+                        mError = EIO;
+                    }
+                    mEnd = true;
+                    break;
+                }
+                mStream.next_in = mInput;
+                mStream.avail_in = ret;
+            }
+            if (!mInflating) {
+                size_t avail = len - count;
+                if (avail > mStream.avail_in) {
+                    avail = mStream.avail_in;
+                }
+                ::memcpy(buffer + count, mStream.next_in, avail);
+                mStream.next_in += avail;
+                mStream.avail_in -= avail;
+                count += avail;
+                continue;
+            }
+            mStream.next_out = buffer + count;
+            mStream.avail_out = len - count;
+            int ret = inflate(&mStream, Z_NO_FLUSH);
+            count = len - mStream.avail_out;
+            if (ret == Z_STREAM_END) {
+                mEnd = true;
+            } else if (ret != Z_OK) {
+                mError = (ret == Z_MEM_ERROR) ? ENOMEM : EINVAL;
+            }
+        }
+        mPosition += count;
+        return count;
+    }
+
+    FILE* mFile;
     int mError;
+    bool mInflating;
+    bool mEnd;
+    uint64_t mPosition;
+    z_stream mStream;
+    uint8_t mInput[16384];
 };
 
 // Parse an hexadecimal string of 8 characters. On success,
@@ -186,48 +318,194 @@ bool parse_hex8(const char* input, uint32_t* value) {
     return true;
 }
 
-}  // namespace
+// Type of cpio new ASCII header.
+struct cpio_newc_header {
+    char c_magic[6];
+    char c_ino[8];
+    char c_mode[8];
+    char c_uid[8];
+    char c_gid[8];
+    char c_nlink[8];
+    char c_mtime[8];
+    char c_filesize[8];
+    char c_devmajor[8];
+    char c_devminor[8];
+    char c_rdevmajor[8];
+    char c_rdevminor[8];
+    char c_namesize[8];
+    char c_check[8];
+};
 
-bool android_extractRamdiskFile(const char* ramdiskPath,
-                                const char* fileName,
-                                char** out,
-                                size_t* outSize) {
-    *out = NULL;
-    *outSize = 0;
+// Minimum distance between two checkpoints of the index, in bytes of
+// uncompressed data.
+const uint64_t kCheckpointInterval = 512 * 1024;
 
-    GZipInputStream input(ramdiskPath);
-    if (input.error()) {
-        errno = input.error();
+// An index of the files of a ramdisk image, built while reading it, with
+// checkpoints of the decompression at regular intervals, so that reading
+// a file that was indexed only decompresses the data since the closest
+// checkpoint, and reading a file that wasn't resumes indexing where it
+// stopped.
+class RamdiskIndex {
+public:
+    // An indexed file, |offset| is the position of its content in the
+    // uncompressed data.
+    struct Entry {
+        uint64_t offset;
+        uint32_t size;
+    };
+
+    RamdiskIndex(const char* path, const struct stat& st) :
+            mPath(path),
+            mFileSize(st.st_size),
+            mFileMtime(st.st_mtime),
+            mNames(),
+            mEntries(),
+            mCheckpoints(),
+            mScanPosition(0),
+            mComplete(false) {}
+
+    ~RamdiskIndex() {
+        for (size_t n = 0; n < mCheckpoints.size(); ++n) {
+            delete mCheckpoints[n];
+        }
+    }
+
+    // Return true if the index is the one of |path|, with |st| as its
+    // current status.
+    bool matches(const char* path, const struct stat& st) const {
+        return !strcmp(mPath.c_str(), path) &&
+               mFileSize == static_cast<uint64_t>(st.st_size) &&
+               mFileMtime == static_cast<int64_t>(st.st_mtime);
+    }
+
+    // Return the entry of the first file named |name|, or NULL if none
+    // was indexed yet.
+    const Entry* find(const char* name) const {
+        for (size_t n = 0; n < mNames.size(); ++n) {
+            if (!strcmp(mNames[n].c_str(), name)) {
+                return &mEntries[n];
+            }
+        }
+        return NULL;
+    }
+
+    void add(const android::base::String& name, const Entry& entry) {
+        mNames.push_back(name);
+        mEntries.push_back(entry);
+    }
+
+    // Save a new checkpoint of |input| if the last one is far enough.
+    void maybeSaveCheckpoint(GZipInputStream* input) {
+        if (!mCheckpoints.empty() &&
+            input->position() <
+                    mCheckpoints[mCheckpoints.size() - 1U]->position() +
+                    kCheckpointInterval) {
+            return;
+        }
+        GZipInputStream::Checkpoint* checkpoint =
+                new GZipInputStream::Checkpoint();
+        if (!input->save(checkpoint)) {
+            delete checkpoint;
+            return;
+        }
+        mCheckpoints.push_back(checkpoint);
+    }
+
+    // Move |input| to |position| in the uncompressed data, restoring the
+    // closest checkpoint before it unless that is behind the current
+    // position of |input|. Return true on success.
+    bool seek(GZipInputStream* input, uint64_t position) const {
+        const GZipInputStream::Checkpoint* best = NULL;
+        for (size_t n = 0; n < mCheckpoints.size(); ++n) {
+            if (mCheckpoints[n]->position() > position) {
+                break;
+            }
+            best = mCheckpoints[n];
+        }
+        if (position < input->position() ||
+            (best && best->position() > input->position())) {
+            if (!best || !input->restore(*best)) {
+                return false;
+            }
+        }
+        D("Seek to %" PRIu64 " from %" PRIu64 "\n",
+          position, input->position());
+        return input->doSkip(position - input->position());
+    }
+
+    // Position of the first cpio header that wasn't indexed yet.
+    uint64_t scanPosition() const { return mScanPosition; }
+    void setScanPosition(uint64_t position) { mScanPosition = position; }
+
+    // True once the whole archive has been indexed.
+    bool complete() const { return mComplete; }
+    void setComplete() { mComplete = true; }
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(RamdiskIndex);
+
+    android::base::String mPath;
+    uint64_t mFileSize;
+    int64_t mFileMtime;
+    android::base::StringVector mNames;
+    android::base::PodVector<Entry> mEntries;
+    android::base::PodVector<GZipInputStream::Checkpoint*> mCheckpoints;
+    uint64_t mScanPosition;
+    bool mComplete;
+};
+
+// The index of the last ramdisk image that was read, emulators only use
+// one of them.
+struct RamdiskIndexStore {
+    RamdiskIndexStore() : lock(), index() {}
+
+    android::base::Lock lock;
+    android::base::ScopedPtr<RamdiskIndex> index;
+};
+
+android::base::LazyInstance<RamdiskIndexStore> sIndexStore =
+        LAZY_INSTANCE_INIT;
+
+// Read a file content of |size| bytes from |input| into a heap-allocated
+// buffer, then set |*out| and |*outSize|. Return true on success.
+bool readRamdiskFile(GZipInputStream* input,
+                     uint32_t size,
+                     char** out,
+                     size_t* outSize) {
+    char* data = reinterpret_cast<char*>(malloc(size ? size : 1U));
+    if (!data || !input->doRead(data, size)) {
+        free(data);
         return false;
     }
+    *out = data;
+    *outSize = size;
+    return true;
+}
 
-    // Type of cpio new ASCII header.
-    struct cpio_newc_header {
-        char c_magic[6];
-        char c_ino[8];
-        char c_mode[8];
-        char c_uid[8];
-        char c_gid[8];
-        char c_nlink[8];
-        char c_mtime[8];
-        char c_filesize[8];
-        char c_devmajor[8];
-        char c_devminor[8];
-        char c_rdevmajor[8];
-        char c_rdevminor[8];
-        char c_namesize[8];
-        char c_check[8];
-    };
+// Index the ramdisk read by |input| from where |index| stopped, until all
+// the files in |fileNames| for which |out| is NULL have been found, or the
+// end of the archive. Return true on success.
+bool scanRamdisk(GZipInputStream* input,
+                 RamdiskIndex* index,
+                 const char* ramdiskPath,
+                 const char* const* fileNames,
+                 size_t count,
+                 size_t missing,
+                 char** out,
+                 size_t* outSize) {
+    if (!index->seek(input, index->scanPosition())) {
+        D("Could not resume indexing ramdisk image at %s\n", ramdiskPath);
+        return false;
+    }
 
-    size_t fileNameLen = strlen(fileName);
+    while (missing > 0) {
+        index->maybeSaveCheckpoint(input);
 
-    for (;;) {
         // Read the header then check it.
         cpio_newc_header header;
-        if (!input.doRead(&header, sizeof header)) {
+        if (!input->doRead(&header, sizeof header)) {
             // Assume end of input here.
-            D("Could not find %s in ramdisk image at %s\n",
-              fileName, ramdiskPath);
+            D("Could not read ramdisk image at %s\n", ramdiskPath);
             return false;
         }
 
@@ -238,77 +516,186 @@ bool android_extractRamdiskFile(const char* ramdiskPath,
             return false;
         }
 
-        // Compare file names, note that files with a size of 0 are
-        // hard links and should be ignored.
         uint32_t nameSize;
         uint32_t entrySize;
         if (!parse_hex8(header.c_namesize, &nameSize) ||
-            !parse_hex8(header.c_filesize, &entrySize)) {
+            !parse_hex8(header.c_filesize, &entrySize) ||
+            nameSize == 0) {
             D("Could not parse ramdisk file entry header!");
-            break;
+            errno = EINVAL;
+            return false;
         }
 
         D("---- %d nameSize=%d entrySize=%d\n", __LINE__, nameSize, entrySize);
 
         // The header is followed by the name, followed by 4-byte padding
-        // with NUL bytes. Compute the number of bytes to skip over the
-        // name.
+        // with NUL bytes. The file data is 4-byte padded with NUL bytes
+        // too.
         size_t skipName =
                 ((sizeof header + nameSize + 3) & ~3) - sizeof header;
-
-        // The file data is 4-byte padded with NUL bytes too.
         size_t skipFile = (entrySize + 3) & ~3;
-        size_t skipCount = skipName + skipFile;
+
+        // Read the name, without its terminating NUL byte.
+        nameSize -= 1U;
+        android::base::String entryName;
+        entryName.resize(nameSize);
+        if (!input->doRead(&entryName[0], nameSize) ||
+            !input->doSkip(skipName - nameSize)) {
+            D("Could not read ramdisk file entry name!");
+            return false;
+        }
 
         // Last record is named 'TRAILER!!!' and indicates end of archive.
-        static const char kTrailer[] = "TRAILER!!!";
-        static const size_t kTrailerSize = sizeof(kTrailer) - 1U;
-
-        if ((entrySize == 0 || nameSize != fileNameLen + 1U) &&
-            nameSize != kTrailerSize + 1U) {
-            D("---- %d Skipping\n", __LINE__);
-        } else {
-            // Read the name and compare it.
-            nameSize -= 1U;
-            android::base::String entryName;
-            entryName.resize(nameSize);
-            if (!input.doRead(&entryName[0], nameSize)) {
-                D("Could not read ramdisk file entry name!");
+        if (!strcmp(entryName.c_str(), "TRAILER!!!")) {
+            D("End of archive reached in ramdisk image at %s\n",
+              ramdiskPath);
+            index->setComplete();
+            return true;
+        }
+
+        D("---- %d Name=[%s]\n", __LINE__, entryName.c_str());
+
+        // Files with a size of 0 are hard links and should be ignored.
+        RamdiskIndex::Entry entry;
+        entry.offset = input->position();
+        entry.size = entrySize;
+        if (entrySize > 0 && !index->find(entryName.c_str())) {
+            for (size_t n = 0; n < count; ++n) {
+                if (out[n] || strcmp(fileNames[n], entryName.c_str())) {
+                    continue;
+                }
+                // Found it !!
+                if (!readRamdiskFile(input, entrySize, &out[n],
+                                     &outSize[n])) {
+                    D("Could not read ramdisk file entry!");
+                    return false;
+                }
+                skipFile -= entrySize;
+                missing--;
                 break;
             }
-            D("---- %d Name=[%s]\n", __LINE__, entryName.c_str());
-            skipCount -= nameSize;
-
-            // Check for last entry.
-            if (nameSize == kTrailerSize &&
-                !strcmp(entryName.c_str(), kTrailer)) {
-                D("End of archive reached. Could not find %s in ramdisk image at %s",
-                  fileName, ramdiskPath);
-                return false;
-            }
+        }
+        if (!input->doSkip(skipFile)) {
+            D("Could not skip ramdisk entry!");
+            return false;
+        }
+        if (entrySize > 0) {
+            index->add(entryName, entry);
+        }
+        index->setScanPosition(input->position());
+    }
+    return true;
+}
 
-            // Check for the search file name.
-            if (nameSize == entryName.size() &&
-                !strcmp(entryName.c_str(), fileName)) {
-                // Found it !! Skip over padding.
-                if (!input.doSkip(skipName - nameSize)) {
-                    D("Could not skip ramdisk name entry!");
-                    break;
-                }
+}  // namespace
 
-                // Then read data into head-allocated buffer.
-                *out = reinterpret_cast<char*>(malloc(entrySize));
-                *outSize = entrySize;
+bool android_extractRamdiskFiles(const char* ramdiskPath,
+                                 const char* const* fileNames,
+                                 size_t count,
+                                 char** out,
+                                 size_t* outSize) {
+    for (size_t n = 0; n < count; ++n) {
+        out[n] = NULL;
+        outSize[n] = 0;
+    }
 
-                return input.doRead(*out, entrySize);
-            }
+    struct stat st;
+    if (stat(ramdiskPath, &st) < 0) {
+        return false;
+    }
+    GZipInputStream input(ramdiskPath);
+    if (input.error()) {
+        errno = input.error();
+        return false;
+    }
+
+    RamdiskIndexStore* store = sIndexStore.ptr();
+    android::base::AutoLock lock(store->lock);
+    if (!store->index.get() || !store->index->matches(ramdiskPath, st)) {
+        store->index.reset(new RamdiskIndex(ramdiskPath, st));
+    }
+    RamdiskIndex* index = store->index.get();
+
+    // First read the files that were already indexed.
+    size_t missing = 0;
+    bool ok = true;
+    for (size_t n = 0; n < count && ok; ++n) {
+        const RamdiskIndex::Entry* entry = index->find(fileNames[n]);
+        if (!entry) {
+            missing++;
+            continue;
         }
-        if (!input.doSkip(skipCount)) {
-            D("Could not skip ramdisk entry!");
-            break;
+        D("Found %s in the index of ramdisk image at %s\n",
+          fileNames[n], ramdiskPath);
+        ok = index->seek(&input, entry->offset) &&
+             readRamdiskFile(&input, entry->size, &out[n], &outSize[n]);
+    }
+
+    // Then index the rest of the archive until the other ones are found.
+    if (ok && missing > 0 && !index->complete()) {
+        ok = scanRamdisk(&input, index, ramdiskPath, fileNames, count,
+                         missing, out, outSize);
+    }
+
+    if (!ok) {
+        int savedErrno = input.error() ? input.error() : errno;
+        for (size_t n = 0; n < count; ++n) {
+            free(out[n]);
+            out[n] = NULL;
+            outSize[n] = 0;
+        }
+        errno = savedErrno;
+        return false;
+    }
+    return true;
+}
+
+bool android_extractRamdiskFile(const char* ramdiskPath,
+                                const char* fileName,
+                                char** out,
+                                size_t* outSize) {
+    *out = NULL;
+    *outSize = 0;
+
+    // The result is also cached across launches: a '1' followed by the
+    // file content, or a '0' when it isn't there.
+    android::base::String kind =
+            android::base::StringFormat("ramdisk-file:%s", fileName);
+    size_t cachedSize = 0;
+    char* cached = probeCache_load(kind.c_str(), ramdiskPath, &cachedSize);
+    if (cached) {
+        if (cachedSize > 0 && cached[0] == '1') {
+            memmove(cached, cached + 1, cachedSize - 1U);
+            *out = cached;
+            *outSize = cachedSize - 1U;
+            return true;
+        }
+        bool cachedAbsent = (cachedSize == 1U && cached[0] == '0');
+        free(cached);
+        if (cachedAbsent) {
+            D("Cached: no %s in ramdisk image at %s\n",
+              fileName, ramdiskPath);
+            return false;
         }
     }
 
-    errno = input.error();
-    return false;
+    if (!android_extractRamdiskFiles(ramdiskPath, &fileName, 1U,
+                                     out, outSize)) {
+        return false;
+    }
+    if (!*out) {
+        D("Could not find %s in ramdisk image at %s\n",
+          fileName, ramdiskPath);
+        probeCache_store(kind.c_str(), ramdiskPath, "0", 1U);
+        return false;
+    }
+
+    char* entry = reinterpret_cast<char*>(malloc(*outSize + 1U));
+    if (entry) {
+        entry[0] = '1';
+        memcpy(entry + 1, *out, *outSize);
+        probeCache_store(kind.c_str(), ramdiskPath, entry, *outSize + 1U);
+        free(entry);
+    }
+    return true;
 }
@@ -30,6 +30,22 @@ bool android_extractRamdiskFile(const char* ramdisk_path,
                                 char** out,
                                 size_t* out_size);
 
+// Extract the content of the |count| files whose paths within the ramdisk
+// are listed in |file_paths|, which must be distinct, in a single pass.
+// On success, returns true and sets |out[n]| and |out_size[n]| like
+// android_extractRamdiskFile() for each file, or to NULL and 0 if the
+// ramdisk has no such file. On failure, return false and set all of them
+// to NULL and 0.
+//
+// The entries of a ramdisk are indexed the first time it is read, so that
+// the following extractions of any file from it resume decompression close
+// to it instead of from the start of the image.
+bool android_extractRamdiskFiles(const char* ramdisk_path,
+                                 const char* const* file_paths,
+                                 size_t count,
+                                 char** out,
+                                 size_t* out_size);
+
 ANDROID_END_HEADER
 
 #endif  // ANDROID_FILESYSTEMS_RAMDISK_EXTRACTOR_H
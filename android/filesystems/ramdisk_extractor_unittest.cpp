@@ -17,6 +17,8 @@
 #include <gtest/gtest.h>
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 namespace {
 
@@ -100,3 +102,61 @@ TEST_F(RamdiskExtractorTest, MissingFile) {
     EXPECT_TRUE(fillData(kTestRamdiskImage, kTestRamdiskImageSize));
     EXPECT_FALSE(android_extractRamdiskFile(path(), "zoolander", &out, &outSize));
 }
+
+TEST_F(RamdiskExtractorTest, FindSeveralFiles) {
+    static const char* const kFileNames[] = {
+        "zoo", "zoolander", "foo", "bar2",
+    };
+    static const size_t kCount = sizeof(kFileNames) / sizeof(kFileNames[0]);
+    static const char* const kExpected[kCount] = {
+        "Meow!!\n", NULL, "Hello World!\n",
+        "La vie est un long fleuve tranquille\n",
+    };
+    char* out[kCount];
+    size_t outSize[kCount];
+    EXPECT_TRUE(fillData(kTestRamdiskImage, kTestRamdiskImageSize));
+
+    // Twice, the second time from the index of the ramdisk.
+    for (int pass = 0; pass < 2; ++pass) {
+        EXPECT_TRUE(android_extractRamdiskFiles(path(), kFileNames, kCount,
+                                                out, outSize));
+        for (size_t n = 0; n < kCount; ++n) {
+            if (!kExpected[n]) {
+                EXPECT_FALSE(out[n]);
+                EXPECT_EQ(0U, outSize[n]);
+                continue;
+            }
+            EXPECT_EQ(strlen(kExpected[n]), outSize[n]);
+            ASSERT_TRUE(out[n]);
+            EXPECT_TRUE(!memcmp(out[n], kExpected[n], outSize[n]));
+            free(out[n]);
+        }
+    }
+}
+
+TEST_F(RamdiskExtractorTest, FindFilesInAnyOrder) {
+    static const char* const kFileNames[] = { "zoo", "foo", "zoo", "bar2" };
+    EXPECT_TRUE(fillData(kTestRamdiskImage, kTestRamdiskImageSize));
+
+    for (size_t n = 0; n < sizeof(kFileNames) / sizeof(kFileNames[0]); ++n) {
+        char* out = NULL;
+        size_t outSize = 0;
+        EXPECT_TRUE(android_extractRamdiskFile(path(), kFileNames[n],
+                                               &out, &outSize));
+        EXPECT_TRUE(out);
+        free(out);
+    }
+}
+
+TEST_F(RamdiskExtractorTest, ModifiedImage) {
+    char* out = NULL;
+    size_t outSize = 0;
+    EXPECT_TRUE(fillData(kTestRamdiskImage, kTestRamdiskImageSize));
+    EXPECT_TRUE(android_extractRamdiskFile(path(), "zoo", &out, &outSize));
+    free(out);
+
+    // The index of the previous image must not be used.
+    EXPECT_TRUE(fillData(kTestRamdiskImage, kTestRamdiskImageSize / 2));
+    EXPECT_FALSE(android_extractRamdiskFile(path(), "zoo", &out, &outSize));
+    EXPECT_FALSE(out);
+}
@@ -27,6 +27,10 @@ typedef struct {
     QFrameBufferInvalidateFunc   pr_invalidate;
     QFrameBufferDetachFunc       pr_detach;
 
+    /* updates accumulated during a Producer::CheckUpdate call */
+    int                          pr_checking;
+    SkinRegion                   pending;
+
 } QFrameBufferExtra;
 
 
@@ -109,6 +113,7 @@ qframebuffer_init( QFrameBuffer*       qfbuff,
         free( qfbuff->extra );
         return -1;
     }
+    skin_region_init_empty( &((QFrameBufferExtra*)qfbuff->extra)->pending );
 
     qfbuff->width  = width;
     qfbuff->height = height;
@@ -147,13 +152,46 @@ qframebuffer_set_mm( QFrameBuffer*   qfbuff,
     qfbuff->phys_height_mm = height_mm;
 }
 
+/* send the accumulated updates to the client, if any */
+static void
+_flush_updates( QFrameBuffer*  qfbuff )
+{
+    QFrameBufferExtra*  extra = qfbuff->extra;
+
+    if (skin_region_is_empty( &extra->pending ))
+        return;
+
+    if (extra->fb_update)
+        extra->fb_update( extra->fb_opaque, &extra->pending );
+
+    skin_region_reset( &extra->pending );
+}
+
 void
 qframebuffer_update( QFrameBuffer*  qfbuff, int  x, int  y, int  w, int  h )
 {
     QFrameBufferExtra*  extra = qfbuff->extra;
+    SkinRect            rect;
 
-    if (extra->fb_update)
-        extra->fb_update( extra->fb_opaque, x, y, w, h );
+    if (w <= 0 || h <= 0)
+        return;
+
+    skin_rect_init( &rect, x, y, w, h );
+    skin_region_union_rect( &extra->pending, &rect );
+
+    if (!extra->pr_checking)
+        _flush_updates( qfbuff );
+}
+
+void
+qframebuffer_update_region( QFrameBuffer*  qfbuff, SkinRegion*  region )
+{
+    QFrameBufferExtra*  extra = qfbuff->extra;
+
+    skin_region_union( &extra->pending, region );
+
+    if (!extra->pr_checking)
+        _flush_updates( qfbuff );
 }
 
 
@@ -195,6 +233,9 @@ qframebuffer_rotate( QFrameBuffer*  qfbuff, int  rotation )
 {
     QFrameBufferExtra*  extra = qfbuff->extra;
 
+    /* pending updates use the previous geometry */
+    _flush_updates( qfbuff );
+
     if ((rotation ^ qfbuff->rotation) & 1) {
         /* swap width and height if new rotation requires it */
         int  temp = qfbuff->width;
@@ -233,6 +274,8 @@ qframebuffer_done( QFrameBuffer*   qfbuff )
 
         if (extra->fb_done)
             extra->fb_done( extra->fb_opaque );
+
+        skin_region_reset( &extra->pending );
     }
 
     free( qfbuff->pixels );
@@ -275,8 +318,12 @@ qframebuffer_check_updates( void )
         QFrameBuffer*       q     = framebuffer_fifo[nn];
         QFrameBufferExtra*  extra = q->extra;
 
-        if (extra->pr_check)
+        if (extra->pr_check) {
+            extra->pr_checking = 1;
             extra->pr_check( extra->pr_opaque );
+            extra->pr_checking = 0;
+            _flush_updates( q );
+        }
     }
 }
 
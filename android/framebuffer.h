@@ -12,6 +12,8 @@
 #ifndef _ANDROID_FRAMEBUFFER_H_
 #define _ANDROID_FRAMEBUFFER_H_
 
+#include "android/skin/region.h"
+
 /* A simple abstract interface to framebuffer displays. this is used to
  * de-couple hardware emulation from final display.
  *
@@ -94,11 +96,10 @@ qframebuffer_set_mm( QFrameBuffer*   qfbuff,
                      int             height_mm );
 
 /* the Client::Update method is called to instruct a client that a given
- * rectangle of the framebuffer pixels was updated and needs to be
- * redrawn.
+ * region of the framebuffer pixels was updated and needs to be redrawn.
+ * the region is in framebuffer coordinates, and only valid during the call.
  */
-typedef void (*QFrameBufferUpdateFunc)( void*  opaque, int  x, int  y,
-                                                       int  w, int  h );
+typedef void (*QFrameBufferUpdateFunc)( void*  opaque, SkinRegion*  region );
 
 /* the Client::Rotate method is called to instruct the client that a
  * framebuffer's internal rotation has changed. This is the rotation
@@ -162,10 +163,18 @@ qframebuffer_set_producer( QFrameBuffer*                qfbuff,
 
 /* tell a client that a rectangle region has been updated in the framebuffer
  * pixel buffer this is typically called from a Producer::CheckUpdate method
+ *
+ * when called from a Producer::CheckUpdate method, the rectangles are
+ * accumulated and sent to the client as a single region once the method
+ * returns, so that it can redraw them all at once.
  */
 extern void
 qframebuffer_update( QFrameBuffer*  qfbuff, int  x, int  y, int  w, int  h );
 
+/* same as qframebuffer_update(), for a whole region */
+extern void
+qframebuffer_update_region( QFrameBuffer*  qfbuff, SkinRegion*  region );
+
 /* rotate the framebuffer (may swap width/height), and tell all clients.
  * Should be called from a Producer::CheckUpdate method
  */
@@ -0,0 +1,265 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#include "android/governor.h"
+
+#include "android/config/config.h"
+#include "android/looper.h"
+#include "android/opengles.h"
+#include "android/utils/debug.h"
+#include "hw/android/goldfish/nand.h"
+#include "qemu/osdep.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#define  D(...)  VERBOSE_PRINT(init,__VA_ARGS__)
+
+/* All the state below is only used with the global QEMU mutex held: the
+ * vCPU threads register with it, and the console and UI events run in the
+ * main loop. */
+
+#define  GOVERNOR_MAX_VCPUS  64
+
+#ifdef _WIN32
+static HANDLE     vcpu_threads[GOVERNOR_MAX_VCPUS];
+#else
+static int        vcpu_threads[GOVERNOR_MAX_VCPUS];
+#endif
+static int        vcpu_count;
+
+/* The regular settings, and the idle mode ones. */
+static int        gov_priority;
+static int        gov_fps;
+static int        gov_idle_timeout_sec;
+static int        gov_idle_priority;
+static int        gov_idle_fps;
+
+static int        gov_idle;
+static int        gov_applied_priority;
+static Looper*    gov_looper;
+static LoopTimer  gov_idle_timer[1];
+static Duration   gov_last_input_ms;
+
+static int
+governor_set_thread_priority(int index, int priority)
+{
+#ifdef _WIN32
+    int  level = THREAD_PRIORITY_NORMAL;
+    if (priority >= 10)
+        level = THREAD_PRIORITY_LOWEST;
+    else if (priority > 0)
+        level = THREAD_PRIORITY_BELOW_NORMAL;
+    return SetThreadPriority(vcpu_threads[index], level) ? 0 : -1;
+#elif defined(__linux__)
+    /* Linux applies nice values to individual threads. */
+    return setpriority(PRIO_PROCESS, vcpu_threads[index], priority);
+#else
+    return -1;
+#endif
+}
+
+static int
+governor_apply_priority(int priority)
+{
+    int  nn, ret = 0;
+
+    for (nn = 0; nn < vcpu_count; nn++) {
+        if (governor_set_thread_priority(nn, priority) < 0)
+            ret = -1;
+    }
+    if (ret == 0)
+        gov_applied_priority = priority;
+    return ret;
+}
+
+/* Return true iff the vCPU threads can be switched to |priority|, and
+ * back to any higher nice value. Linux doesn't let unprivileged processes
+ * lower their nice value below 20 - RLIMIT_NICE, which is 20 by default,
+ * so an unprivileged instance couldn't leave an idle mode that raised it. */
+static int
+governor_can_set_priority(int priority)
+{
+#ifdef _WIN32
+    return 1;
+#elif defined(__linux__)
+    struct rlimit  limit;
+
+    if (geteuid() == 0)
+        return 1;
+    if (getrlimit(RLIMIT_NICE, &limit) < 0)
+        return 0;
+    if (limit.rlim_cur == RLIM_INFINITY)
+        return 1;
+    return priority >= 20 - (int)limit.rlim_cur;
+#else
+    return 0;
+#endif
+}
+
+/* Apply the regular or idle settings, depending on |gov_idle|. */
+static void
+governor_apply(void)
+{
+    int  priority = gov_idle ? gov_idle_priority : gov_priority;
+    int  fps = gov_idle ? gov_idle_fps : gov_fps;
+
+    if (priority != gov_applied_priority &&
+        governor_apply_priority(priority) < 0) {
+        dwarning("could not change the vCPU thread priority to %d", priority);
+    }
+    android_setOpenglesFrameRateLimit(fps);
+}
+
+void
+android_governor_register_vcpu_thread(void)
+{
+    if (vcpu_count == GOVERNOR_MAX_VCPUS)
+        return;
+
+#ifdef _WIN32
+    vcpu_threads[vcpu_count] = OpenThread(THREAD_SET_INFORMATION, FALSE,
+                                          GetCurrentThreadId());
+    if (!vcpu_threads[vcpu_count])
+        return;
+#else
+    vcpu_threads[vcpu_count] = qemu_get_thread_id();
+#endif
+    if (gov_applied_priority)
+        governor_set_thread_priority(vcpu_count, gov_applied_priority);
+    vcpu_count++;
+}
+
+int
+android_governor_set_vcpu_priority(int priority)
+{
+    if (priority < 0 || priority > GOVERNOR_MAX_PRIORITY)
+        return -1;
+
+    /* Don't make the idle mode impossible to leave. */
+    if (gov_idle_timeout_sec && priority != gov_idle_priority &&
+        !governor_can_set_priority(priority < gov_idle_priority
+                                   ? priority : gov_idle_priority))
+        return -1;
+
+    gov_priority = priority;
+    if (gov_idle)
+        return 0;
+    return governor_apply_priority(priority);
+}
+
+void
+android_governor_set_fps_limit(int fps)
+{
+    gov_fps = fps > 0 ? fps : 0;
+    if (!gov_idle)
+        android_setOpenglesFrameRateLimit(gov_fps);
+}
+
+static void
+governor_idle_check(void* opaque)
+{
+    Duration  elapsed = looper_now(gov_looper) - gov_last_input_ms;
+    Duration  timeout = (Duration)gov_idle_timeout_sec * 1000;
+
+    if (elapsed < timeout) {
+        loopTimer_startRelative(gov_idle_timer, timeout - elapsed);
+        return;
+    }
+    D("%s: no activity for %d seconds, entering idle mode", __FUNCTION__,
+      gov_idle_timeout_sec);
+    gov_idle = 1;
+    governor_apply();
+}
+
+int
+android_governor_set_idle(int timeout_sec, int priority, int fps)
+{
+    if (timeout_sec < 0 || priority < 0 || priority > GOVERNOR_MAX_PRIORITY)
+        return -1;
+
+    /* Leaving the idle mode must restore the regular priority. */
+    if (timeout_sec > 0 && priority != gov_priority &&
+        !governor_can_set_priority(priority < gov_priority ? priority
+                                                           : gov_priority))
+        return -2;
+
+    if (!gov_looper) {
+        gov_looper = looper_newCore();
+        loopTimer_init(gov_idle_timer, gov_looper, governor_idle_check, NULL);
+    }
+
+    gov_idle_timeout_sec = timeout_sec;
+    gov_idle_priority = priority;
+    gov_idle_fps = fps > 0 ? fps : 0;
+    gov_last_input_ms = looper_now(gov_looper);
+    gov_idle = 0;
+    governor_apply();
+
+    if (timeout_sec > 0)
+        loopTimer_startRelative(gov_idle_timer, (Duration)timeout_sec * 1000);
+    else
+        loopTimer_stop(gov_idle_timer);
+    return 0;
+}
+
+void
+android_governor_activity(void)
+{
+    if (!gov_idle_timeout_sec)
+        return;
+
+    gov_last_input_ms = looper_now(gov_looper);
+    if (gov_idle) {
+        D("%s: activity, leaving idle mode", __FUNCTION__);
+        gov_idle = 0;
+        governor_apply();
+        loopTimer_startRelative(gov_idle_timer,
+                                (Duration)gov_idle_timeout_sec * 1000);
+    }
+}
+
+void
+android_governor_report(stralloc_t* out)
+{
+    stralloc_add_format(out, "state: %s\n", gov_idle ? "idle" : "active");
+    stralloc_add_format(out, "vcpu threads: %d\n", vcpu_count);
+    stralloc_add_format(out, "priority: %d (applied: %d)\n",
+                        gov_priority, gov_applied_priority);
+    if (gov_fps)
+        stralloc_add_format(out, "fps limit: %d\n", gov_fps);
+    else
+        stralloc_add_str(out, "fps limit: none\n");
+#ifdef CONFIG_NAND_LIMITS
+    {
+        uint64_t  read_rate, write_rate;
+        nand_get_rate_limits(&read_rate, &write_rate);
+        stralloc_add_format(out, "nand read rate: %llu bytes/s\n",
+                            (unsigned long long)read_rate);
+        stralloc_add_format(out, "nand write rate: %llu bytes/s\n",
+                            (unsigned long long)write_rate);
+    }
+#endif
+    if (gov_idle_timeout_sec) {
+        stralloc_add_format(out, "idle: after %d s, priority %d, fps limit %d\n",
+                            gov_idle_timeout_sec, gov_idle_priority,
+                            gov_idle_fps);
+    } else {
+        stralloc_add_str(out, "idle: disabled\n");
+    }
+}
@@ -0,0 +1,68 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#ifndef ANDROID_GOVERNOR_H
+#define ANDROID_GOVERNOR_H
+
+#include "android/utils/compiler.h"
+#include "android/utils/stralloc.h"
+
+ANDROID_BEGIN_HEADER
+
+/* Resource governor of the emulator instance.
+ *
+ * When many emulators run on the same host, they compete for its CPU, GPU
+ * and disk. The governor groups the knobs that limit the share of one
+ * instance, so that a host-wide supervisor can balance them through the
+ * 'governor' console command:
+ *
+ *   - the scheduling priority of the vCPU threads,
+ *   - the number of frames per second displayed by the GPU emulation,
+ *   - the NAND read and write rates, see nand_set_rate_limits(),
+ *   - an idle mode, entered after a period without activity, which
+ *     switches the instance to a lower priority and frame rate until the
+ *     next activity. User input, console commands other than the
+ *     'governor' ones, and ADB traffic all count as activity. */
+
+/* Highest nice value, i.e. the lowest priority, of the vCPU threads. */
+#define GOVERNOR_MAX_PRIORITY  19
+
+/* Called by each vCPU thread when it starts, so that the governor can
+ * change its priority. */
+void android_governor_register_vcpu_thread(void);
+
+/* Set the nice value of all vCPU threads, from 0 (the default) to
+ * GOVERNOR_MAX_PRIORITY. Return 0 on success, or -1 if it is out of range
+ * or not supported on this host, or if the idle mode couldn't be left
+ * anymore. Raising the priority back may require privileges on Linux. */
+int android_governor_set_vcpu_priority(int priority);
+
+/* Limit the frames per second displayed by the GPU emulation, or remove
+ * the limit if 0. This is the limit outside of the idle mode. */
+void android_governor_set_fps_limit(int fps);
+
+/* Enter the idle mode after |timeout_sec| seconds without activity, and
+ * then use |priority| and |fps| instead of the regular settings. Disable
+ * the idle mode if |timeout_sec| is 0. Return -1 on invalid values, or -2
+ * if the regular priority couldn't be restored when leaving the idle mode,
+ * e.g. because lowering the nice value requires privileges on Linux. */
+int android_governor_set_idle(int timeout_sec, int priority, int fps);
+
+/* Called for every user input event, console command or ADB transfer,
+ * which leaves the idle mode. */
+void android_governor_activity(void);
+
+/* Append the current settings and state of the governor to |out|. */
+void android_governor_report(stralloc_t* out);
+
+ANDROID_END_HEADER
+
+#endif  /* ANDROID_GOVERNOR_H */
@@ -0,0 +1,338 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#include "android/gps-replay.h"
+
+#include "android/gps.h"
+#include "android/utils/debug.h"
+#include "android/utils/path.h"
+#include "android/utils/system.h"
+#include "qemu/timer.h"
+#include "sysemu/char.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define  D(...)  VERBOSE_PRINT(gps,__VA_ARGS__)
+
+#define  GTR_MAGIC         "GTR1"
+#define  GTR_HEADER_SIZE   4
+#define  GTR_RECORD_SIZE   16
+
+/* a decoded track record */
+typedef struct {
+    int64_t  time_ms;    /* offset from the start of the track */
+    int32_t  latitude;   /* 1e-7 degrees */
+    int32_t  longitude;  /* 1e-7 degrees */
+    int32_t  altitude;   /* centimeters */
+} GTRFix;
+
+typedef struct {
+    GTRFix*     fixes;
+    int         count;
+    int         next;      /* index of the next fix to send */
+    QEMUTimer*  timer;
+    int         paused;
+    double      speed;
+    /* the track position was 'base_ms' at virtual time 'base_ns' */
+    int64_t     base_ms;
+    int64_t     base_ns;
+    /* wall clock time at the start of the track, for NMEA timestamps */
+    int64_t     wall_ms;
+} GTRState;
+
+static GTRState  _gtr_state = { .speed = 1.0 };
+
+static uint32_t
+_get_le32( const uint8_t*  p )
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* format a coordinate as NMEA (d)ddmm.mmmm,H */
+static int
+_gtr_format_coord( char*  p, int32_t  value, int  deg_digits,
+                   char  pos_hemi, char  neg_hemi )
+{
+    char      hemi = pos_hemi;
+    int64_t   v = value;
+    int       deg, min_e4;
+
+    if (v < 0) {
+        hemi = neg_hemi;
+        v    = -v;
+    }
+    deg    = (int)(v / 10000000);
+    min_e4 = (int)((v % 10000000) * 60 / 1000);
+
+    return sprintf( p, ",%0*d%02d.%04d,%c", deg_digits, deg,
+                    min_e4 / 10000, min_e4 % 10000, hemi );
+}
+
+/* send a $GPGGA sentence for a given fix */
+static void
+_gtr_send_fix( GTRState*  gtr, const GTRFix*  fix )
+{
+    char      sentence[128];
+    char*     p = sentence;
+    int64_t   day_ms = (gtr->wall_ms + fix->time_ms) % (24 * 3600 * 1000);
+    int32_t   alt = fix->altitude;
+    unsigned  sum = 0;
+    char*     q;
+
+    p += sprintf( p, "$GPGGA,%02d%02d%02d.%02d",
+                  (int)(day_ms / 3600000), (int)(day_ms / 60000 % 60),
+                  (int)(day_ms / 1000 % 60), (int)(day_ms % 1000 / 10) );
+    p += _gtr_format_coord( p, fix->latitude, 2, 'N', 'S' );
+    p += _gtr_format_coord( p, fix->longitude, 3, 'E', 'W' );
+    p += sprintf( p, ",1,08,1.0,%s%d.%02d,M,0.0,M,,",
+                  alt < 0 ? "-" : "", abs(alt) / 100, abs(alt) % 100 );
+
+    /* the checksum covers everything between '$' and '*' */
+    for (q = sentence + 1; q < p; q++)
+        sum ^= (unsigned char)*q;
+    p += sprintf( p, "*%02X\n", sum );
+
+    D("sending '%.*s'", (int)(p - sentence - 1), sentence);
+    qemu_chr_write( android_gps_cs, (const uint8_t*)sentence, p - sentence );
+}
+
+static int64_t
+_gtr_position( GTRState*  gtr, int64_t  now_ns )
+{
+    if (gtr->paused)
+        return gtr->base_ms;
+
+    return gtr->base_ms + (int64_t)((now_ns - gtr->base_ns) * gtr->speed / 1e6);
+}
+
+/* make the current position the new base, before changing the speed or
+ * pausing */
+static void
+_gtr_rebase( GTRState*  gtr )
+{
+    int64_t  now_ns = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+
+    gtr->base_ms = _gtr_position(gtr, now_ns);
+    gtr->base_ns = now_ns;
+}
+
+static void
+_gtr_free_fixes( GTRState*  gtr )
+{
+    AFREE(gtr->fixes);
+    gtr->fixes = NULL;
+    gtr->count = 0;
+    gtr->next  = 0;
+}
+
+/* send all fixes that are due, and re-arm the timer for the next one */
+static void
+_gtr_tick( void*  opaque )
+{
+    GTRState*  gtr = opaque;
+    int64_t    now_ns = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    int64_t    pos_ms = _gtr_position(gtr, now_ns);
+
+    if (gtr->paused)
+        return;
+
+    while (gtr->next < gtr->count) {
+        const GTRFix*  fix = &gtr->fixes[gtr->next];
+
+        if (fix->time_ms > pos_ms) {
+            /* deadlines are computed from the base, so that timer latency
+             * doesn't accumulate over the track */
+            timer_mod( gtr->timer, gtr->base_ns +
+                       (int64_t)((fix->time_ms - gtr->base_ms) * 1e6 / gtr->speed) );
+            return;
+        }
+        if (android_gps_cs != NULL)
+            _gtr_send_fix(gtr, fix);
+        gtr->next++;
+    }
+
+    /* keep the track, so that it can be replayed again with a seek */
+    D("GPS track replay completed: %d fixes", gtr->count);
+}
+
+int
+gps_replay_start( const char*  path )
+{
+    GTRState*  gtr  = &_gtr_state;
+    size_t     size = 0;
+    uint8_t*   data = path_load_file(path, &size);
+    int64_t    time_ms = 0;
+    struct timeval  tv;
+    int        count, nn;
+
+    if (data == NULL)
+        return -1;
+
+    if (size < GTR_HEADER_SIZE || memcmp(data, GTR_MAGIC, GTR_HEADER_SIZE) ||
+        (size - GTR_HEADER_SIZE) % GTR_RECORD_SIZE != 0) {
+        free(data);
+        return -2;
+    }
+
+    gps_replay_stop();
+
+    count = (size - GTR_HEADER_SIZE) / GTR_RECORD_SIZE;
+    if (count > 0)
+        AARRAY_NEW(gtr->fixes, count);
+
+    for (nn = 0; nn < count; nn++) {
+        const uint8_t*  p   = data + GTR_HEADER_SIZE + nn * GTR_RECORD_SIZE;
+        GTRFix*         fix = &gtr->fixes[nn];
+
+        time_ms       += _get_le32(p);
+        fix->time_ms   = time_ms;
+        fix->latitude  = (int32_t)_get_le32(p + 4);
+        fix->longitude = (int32_t)_get_le32(p + 8);
+        fix->altitude  = (int32_t)_get_le32(p + 12);
+    }
+    free(data);
+
+    gettimeofday(&tv, NULL);
+    gtr->wall_ms = (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+
+    gtr->count   = count;
+    gtr->next    = 0;
+    gtr->paused  = 0;
+    gtr->base_ms = 0;
+    gtr->base_ns = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    if (gtr->timer == NULL)
+        gtr->timer = timer_new(QEMU_CLOCK_VIRTUAL, SCALE_NS, _gtr_tick, gtr);
+
+    D("Starting GPS track replay of '%s': %d fixes", path, count);
+    _gtr_tick(gtr);
+    return 0;
+}
+
+void
+gps_replay_stop( void )
+{
+    GTRState*  gtr = &_gtr_state;
+
+    if (gtr->timer != NULL)
+        timer_del(gtr->timer);
+
+    _gtr_free_fixes(gtr);
+    gtr->paused = 0;
+}
+
+int
+gps_replay_pause( void )
+{
+    GTRState*  gtr = &_gtr_state;
+
+    if (gtr->fixes == NULL)
+        return -1;
+
+    if (!gtr->paused) {
+        _gtr_rebase(gtr);
+        gtr->paused = 1;
+        timer_del(gtr->timer);
+    }
+    return 0;
+}
+
+int
+gps_replay_resume( void )
+{
+    GTRState*  gtr = &_gtr_state;
+
+    if (gtr->fixes == NULL)
+        return -1;
+
+    if (gtr->paused) {
+        gtr->paused  = 0;
+        gtr->base_ns = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+        _gtr_tick(gtr);
+    }
+    return 0;
+}
+
+int
+gps_replay_seek( int64_t  position_ms )
+{
+    GTRState*  gtr = &_gtr_state;
+    int        lo, hi;
+
+    if (gtr->fixes == NULL)
+        return -1;
+
+    if (position_ms < 0)
+        position_ms = 0;
+
+    /* find the first fix at or after the new position */
+    lo = 0;
+    hi = gtr->count;
+    while (lo < hi) {
+        int  mid = lo + (hi - lo) / 2;
+        if (gtr->fixes[mid].time_ms < position_ms)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    gtr->next    = lo;
+    gtr->base_ms = position_ms;
+    gtr->base_ns = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+
+    if (!gtr->paused)
+        _gtr_tick(gtr);
+    return 0;
+}
+
+int
+gps_replay_set_speed( double  speed )
+{
+    GTRState*  gtr = &_gtr_state;
+
+    if (!(speed > 0))
+        return -1;
+
+    if (gtr->fixes != NULL)
+        _gtr_rebase(gtr);
+
+    gtr->speed = speed;
+
+    if (gtr->fixes != NULL && !gtr->paused)
+        _gtr_tick(gtr);
+    return 0;
+}
+
+int64_t
+gps_replay_get_position( void )
+{
+    GTRState*  gtr = &_gtr_state;
+
+    if (gtr->fixes == NULL)
+        return -1;
+
+    return _gtr_position(gtr, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL));
+}
+
+int
+gps_replay_get_pending( void )
+{
+    GTRState*  gtr = &_gtr_state;
+
+    return gtr->count - gtr->next;
+}
+
+int
+gps_replay_is_paused( void )
+{
+    return _gtr_state.paused;
+}
@@ -0,0 +1,68 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#ifndef _android_gps_replay_h
+#define _android_gps_replay_h
+
+#include <stdint.h>
+
+/* Replays a pre-compiled GPS track through the emulated GPS unit. Fixes
+ * are sent from a virtual clock timer, at their recorded offsets from the
+ * start of the track, scaled by the replay speed. The NMEA sentences are
+ * formatted directly from binary values, without going through the
+ * console command parser.
+ *
+ * A track file is made of a 4-byte "GTR1" magic header, followed by
+ * 16-byte records, all values being little-endian:
+ *
+ *      uint32  delay_ms    Delay since the previous fix, in milliseconds.
+ *      int32   latitude    Latitude, in 1e-7 degrees.
+ *      int32   longitude   Longitude, in 1e-7 degrees.
+ *      int32   altitude    Altitude, in centimeters.
+ *
+ * android/tools/gen-gps-track.py converts GPX and KML files to this format.
+ */
+
+/* Start replaying the track in file 'path'. A replay in progress is
+ * stopped. Return 0 on success, -1 if the file can't be read (errno is
+ * set), or -2 if it is not a valid track file. */
+extern int      gps_replay_start( const char*  path );
+
+/* Stop the replay in progress, if any. A replay stays in progress after
+ * its last fix is sent, until it is stopped, so that it can be rewound
+ * with gps_replay_seek(). */
+extern void     gps_replay_stop( void );
+
+/* Pause or resume the replay in progress. Return -1 if there is none. */
+extern int      gps_replay_pause( void );
+extern int      gps_replay_resume( void );
+
+/* Move the replay to 'position_ms' milliseconds from the start of the
+ * track. The next fix sent is the first one at or after that position.
+ * Return -1 if there is no replay in progress. */
+extern int      gps_replay_seek( int64_t  position_ms );
+
+/* Set the replay speed, 1.0 being the recorded one. Return -1 if 'speed'
+ * is not positive. The speed is kept for the next replays. */
+extern int      gps_replay_set_speed( double  speed );
+
+/* Return the current position in the track, in milliseconds, or -1 if
+ * there is no replay in progress. */
+extern int64_t  gps_replay_get_position( void );
+
+/* Return the number of fixes that are still to be sent, 0 if there is no
+ * replay in progress. */
+extern int      gps_replay_get_pending( void );
+
+/* Return 1 if the replay in progress is paused, 0 otherwise. */
+extern int      gps_replay_is_paused( void );
+
+#endif /* _android_gps_replay_h */
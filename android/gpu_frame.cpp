@@ -39,20 +39,28 @@ static void onNewGpuFrame(void* opaque,
                           int ydir,
                           int format,
                           int type,
-                          unsigned char* pixels) {
+                          unsigned char* pixels,
+                          int damageX,
+                          int damageY,
+                          int damageWidth,
+                          int damageHeight) {
     DCHECK(ydir == -1);
     DCHECK(format == GL_RGBA);
     DCHECK(type == GL_UNSIGNED_BYTE);
 
     GpuFrameBridge* bridge = reinterpret_cast<GpuFrameBridge*>(opaque);
-    bridge->postFrame(width, height, pixels);
+    bridge->postDamagedFrame(width, height, pixels,
+                             damageX, damageY, damageWidth, damageHeight);
 }
 
 void gpu_frame_set_post_callback(
         Looper* looper,
         void* context,
         void (*callback)(void*, int, int, const void*)) {
-    DCHECK(!sBridge);
+    if (sBridge) {
+        LOG(WARNING) << "GPU frames already have a consumer";
+        return;
+    }
 
     sBridge = android::opengl::GpuFrameBridge::create(
             android::internal::toBaseLooper(looper), callback, context);
@@ -60,3 +68,19 @@ void gpu_frame_set_post_callback(
 
     android_setPostCallback(onNewGpuFrame, sBridge);
 }
+
+void gpu_frame_set_damage_post_callback(
+        Looper* looper,
+        void* context,
+        void (*callback)(void*, int, int, const void*, int, int, int, int)) {
+    if (sBridge) {
+        LOG(WARNING) << "GPU frames already have a consumer";
+        return;
+    }
+
+    sBridge = android::opengl::GpuFrameBridge::createWithDamage(
+            android::internal::toBaseLooper(looper), callback, context);
+    CHECK(sBridge);
+
+    android_setPostCallback(onNewGpuFrame, sBridge);
+}
@@ -32,6 +32,24 @@ void gpu_frame_set_post_callback(
                          int height,
                          const void* pixels));
 
+// Same as gpu_frame_set_post_callback(), but |callback| also receives the
+// area of the frame that changed since the previously delivered one. Its
+// rows are row indices in |pixels|, which are stored bottom-up.
+//
+// There can be a single consumer of GPU frames: only the first call to
+// either function has an effect.
+void gpu_frame_set_damage_post_callback(
+        Looper* looper,
+        void* context,
+        void (*callback)(void* context,
+                         int width,
+                         int height,
+                         const void* pixels,
+                         int damageX,
+                         int damageY,
+                         int damageWidth,
+                         int damageHeight));
+
 ANDROID_END_HEADER
 
 #endif  // ANDROID_GPU_FRAME_H
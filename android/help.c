@@ -9,6 +9,7 @@
 #include "android/skin/keyset.h"
 #endif
 #include "android/android.h"
+#include "android/boot-benchmark.h"
 #include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
@@ -739,6 +740,21 @@ help_no_snapshot_update_time(stralloc_t*  out)
     );
 }
 
+static void
+help_snapshot_compress(stralloc_t*  out)
+{
+    PRINTF(
+    "  Use '-snapshot-compress <level>' to compress guest RAM when saving state\n"
+    "  snapshots, with a zlib compression level between 1 (fastest) and 9\n"
+    "  (smallest). Pages are compressed by several threads in parallel. The\n"
+    "  default, 0, stores RAM uncompressed. Snapshots saved with any level\n"
+    "  can be loaded regardless of this option.\n\n"
+
+    "  The duration and throughput of the last save and load are shown by\n"
+    "  the 'avd snapshot list' console command.\n\n"
+    );
+}
+
 static void
 help_snapshot_list(stralloc_t*  out)
 {
@@ -787,6 +803,16 @@ help_no_accel(stralloc_t* out)
     );
 }
 
+static void
+help_accel_reprobe(stralloc_t* out)
+{
+    PRINTF(
+        "  Once KVM or HAXM has been found usable, the emulator remembers it\n"
+        "  until the driver is reloaded, instead of probing it on each launch.\n"
+        "  Use '-accel-reprobe' to probe it again anyway.\n"
+    );
+}
+
 static void
 help_ranchu(stralloc_t* out)
 {
@@ -999,6 +1025,20 @@ help_code_profile(stralloc_t*  out)
     );
 }
 
+static void
+help_code_profile_rate(stralloc_t*  out)
+{
+    PRINTF(
+    "  use '-code-profile-rate <hz>' with '-code-profile <name>' to sample the pc of\n"
+    "  the guest <hz> times per second, instead of recording every basic block.\n"
+    "  This is much cheaper, and is enough to find the hot spots of applications.\n\n"
+    "  Each process gets its own 'samples-<pid>-<n>.prof' file in directory <name>,\n"
+    "  a CPU profile followed by the mappings of the process, which pprof can\n"
+    "  symbolize with the unstripped guest binaries, e.g.:\n\n"
+    "    PPROF_BINARY_PATH=$ANDROID_PRODUCT_OUT/symbols/system/lib pprof -top <file>\n\n"
+    );
+}
+
 static void
 help_show_kernel(stralloc_t*  out)
 {
@@ -1361,6 +1401,13 @@ help_nand_limits(stralloc_t*  out)
     "  target signal. the read and/or write threshold'reads' are a number optionally\n"
     "  followed by a K, M or G suffix, corresponding to the number of bytes to be\n"
     "  read or written before the signal is sent.\n\n"
+
+    "  <limits> can also contain 'read-rate=<rate>' and/or 'write-rate=<rate>'\n"
+    "  items, which don't need 'pid' nor 'signal', to limit the guest NAND\n"
+    "  reads and writes to <rate> bytes per second, with the same suffixes,\n"
+    "  e.g. '-nand-limits read-rate=20M,write-rate=5M'. the rates can be\n"
+    "  changed at runtime with the 'governor nand' console command. they only\n"
+    "  apply to guest kernels that support asynchronous NAND commands.\n\n"
     );
 }
 #endif /* CONFIG_NAND_LIMITS */
@@ -1380,6 +1427,26 @@ help_bootchart(stralloc_t  *out)
     );
 }
 
+static void
+help_startup_trace(stralloc_t  *out)
+{
+    PRINTF(
+    "  use '-startup-trace <file>' to write a timeline of the emulator startup\n"
+    "  to <file>, from the launcher to the end of the guest boot. Each step,\n"
+    "  like parsing the configuration or starting the renderer, appears as a\n"
+    "  slice that ends when the step was reached. The file is updated after\n"
+    "  each step, and uses the Chrome trace format, open it with the\n"
+    "  chrome://tracing page of the Chrome browser.\n\n"
+
+    "  with -wipe-data, the data partition image is copied, and resized, while\n"
+    "  the other steps run, so the 'userdata image copied' and 'userdata image\n"
+    "  resized' steps can end before the ones that precede them.\n\n"
+
+    "  the end of the guest boot is only reported by system images that send\n"
+    "  the 'boot-completed' command to the 'boot-properties' service.\n\n"
+    );
+}
+
 static void
 help_tcpdump(stralloc_t  *out)
 {
@@ -1452,7 +1519,9 @@ help_gpu(stralloc_t* out)
     "     off      -> disable GPU emulation\n"
     "     auto     -> use the setting from the AVD\n"
     "     enabled  -> same as 'on'\n"
-    "     disabled -> same as 'off'\n\n"
+    "     disabled -> same as 'off'\n"
+    "     headless -> render with the host GPU through EGL, without any\n"
+    "                 window system (Linux only, use with -no-window)\n\n"
 
     "  Note that enabling GPU emulation if the system image does not support it\n"
     "  will prevent the proper display of the emulated framebuffer.\n\n"
@@ -1471,6 +1540,71 @@ help_gpu(stralloc_t* out)
     );
 }
 
+static void
+help_gpu_record(stralloc_t* out)
+{
+    PRINTF(
+    "  Use -gpu-record <file> to record the frames displayed by the hardware\n"
+    "  OpenGL ES emulation to <file>, as an uncompressed YUV4MPEG2 (.y4m)\n"
+    "  stream at 30 frames per second, from startup until the emulator exits.\n"
+    "  This requires GPU emulation to be enabled.\n\n"
+
+    "  Frames are converted on the GPU, and <file> can be a named pipe read by\n"
+    "  an external encoder, which must be started first, e.g.:\n\n"
+
+    "    mkfifo /tmp/screen.y4m\n"
+    "    ffmpeg -i /tmp/screen.y4m -c:v libx264 screen.mp4 &\n"
+    "    emulator -avd <name> -gpu on -gpu-record /tmp/screen.y4m\n\n"
+
+    "  Recording can also be started and stopped at runtime with the\n"
+    "  'gpu record' console command.\n\n"
+    );
+}
+
+static void
+help_perf_stats(stralloc_t* out)
+{
+    PRINTF(
+    "  Use -perf-stats <file> to append the values of the emulator's performance\n"
+    "  counters to <file> every 10 seconds, and when the emulator exits. Each line\n"
+    "  is a JSON object, e.g.:\n\n"
+
+    "    {\"time_ms\":1439817263042,\"counters\":{\"pipe.commands\":1093,...}}\n\n"
+
+    "  where 'time_ms' is the host time in milliseconds since the epoch. The\n"
+    "  counters are the ones shown by the 'perfstats' console command, like\n"
+    "  the number of pipe commands, the bytes of GL commands, the translated\n"
+    "  blocks, the TLB flushes, the network packets, the NAND bytes and the\n"
+    "  audio underruns.\n\n"
+    );
+}
+
+static void
+help_benchmark_boot(stralloc_t* out)
+{
+    PRINTF(
+    "  Use -benchmark-boot <file> to measure the boot of the guest. The emulator\n"
+    "  starts without a window and without loading a snapshot, waits for the end\n"
+    "  of the guest boot, writes a JSON report to <file>, then exits. The report\n"
+    "  contains:\n\n"
+
+    "    - the AVD name, the CPU accelerator and the GPU emulation mode,\n"
+    "    - the startup milestones, in milliseconds since the first one, as\n"
+    "      recorded by '-startup-trace', e.g. 'guest kernel start',\n"
+    "      'guest boot properties', 'guest system server' and\n"
+    "      'guest boot completed', and their total as 'boot_time_ms',\n"
+    "    - the host CPU time of the emulator process, and of each of its\n"
+    "      threads on Linux,\n"
+    "    - the peak resident memory of the emulator, except on Windows.\n\n"
+
+    "  The end of the boot is only reported by system images that send the\n"
+    "  'boot-completed' command to the 'boot-properties' service. If it isn't\n"
+    "  reported within %d seconds, the report is written with\n"
+    "  \"boot_completed\":false and the emulator exits with status 1.\n\n",
+    BOOT_BENCHMARK_TIMEOUT_SEC
+    );
+}
+
 static void
 help_camera_back(stralloc_t* out)
 {
@@ -1478,9 +1612,10 @@ help_camera_back(stralloc_t* out)
     "  Use -camera-back <mode> to control emulation of a camera facing back.\n"
     "  Valid values for <mode> are:\n\n"
 
-    "     emulated  -> camera will be emulated using software ('fake') camera emulation\n"
-    "     webcam<N> -> camera will be emulated using a webcamera connected to the host\n"
-    "     none      -> camera emulation will be disabled\n\n"
+    "     emulated     -> camera will be emulated using software ('fake') camera emulation\n"
+    "     webcam<N>    -> camera will be emulated using a webcamera connected to the host\n"
+    "     virtualscene -> camera will show a deterministic test scene, drawn by the emulator\n"
+    "     none         -> camera emulation will be disabled\n\n"
     );
 }
 
@@ -1491,9 +1626,10 @@ help_camera_front(stralloc_t* out)
     "  Use -camera-front <mode> to control emulation of a camera facing front.\n"
     "  Valid values for <mode> are:\n\n"
 
-    "     emulated  -> camera will be emulated using software ('fake') camera emulation\n"
-    "     webcam<N> -> camera will be emulated using a webcamera connected to the host\n"
-    "     none      -> camera emulation will be disabled\n\n"
+    "     emulated     -> camera will be emulated using software ('fake') camera emulation\n"
+    "     webcam<N>    -> camera will be emulated using a webcamera connected to the host\n"
+    "     virtualscene -> camera will show a deterministic test scene, drawn by the emulator\n"
+    "     none         -> camera emulation will be disabled\n\n"
     );
 }
 
@@ -0,0 +1,544 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+
+/* This file implements the 'audio-offload' goldfish pipe type, see
+ * android/hw-audio-offload.h for the protocol.
+ */
+
+#include "android/hw-audio-offload.h"
+#include "android/audio-decoder.h"
+#include "android/utils/debug.h"
+#include "android/utils/system.h"
+#include "audio/audio.h"
+#include "hw/android/goldfish/pipe.h"
+
+#include <string.h>
+
+#define D(...)  VERBOSE_PRINT(audio,__VA_ARGS__)
+
+enum {
+    OFFLOAD_CMD_OPEN     = 1,
+    OFFLOAD_CMD_WRITE    = 2,
+    OFFLOAD_CMD_DRAIN    = 3,
+    OFFLOAD_CMD_PAUSE    = 4,
+    OFFLOAD_CMD_RESUME   = 5,
+    OFFLOAD_CMD_FLUSH    = 6,
+    OFFLOAD_CMD_POSITION = 7,
+    OFFLOAD_CMD_VOLUME   = 8,
+};
+
+#define  OFFLOAD_STATUS_OK      0
+#define  OFFLOAD_STATUS_ERROR  -1
+
+#define  OFFLOAD_HEADER_SIZE   8
+#define  OFFLOAD_REPLY_SIZE    16
+#define  OFFLOAD_MAX_ARGS      8
+#define  OFFLOAD_MAX_REPLIES   8
+
+/* compressed data buffered on the host, a couple of seconds of MP3, and
+ * a tenth of that for the worst AAC streams */
+#define  OFFLOAD_INPUT_SIZE    32768
+
+typedef struct {
+    void*           hwpipe;
+    unsigned        wanted;
+
+    /* the message being received */
+    uint8_t         header[OFFLOAD_HEADER_SIZE];
+    int             headerLen;
+    uint32_t        command;
+    uint32_t        remaining;
+    uint8_t         args[OFFLOAD_MAX_ARGS];
+    int             argsLen;
+
+    /* the stream, NULL before OPEN or if the codec isn't supported */
+    AudioDecoder*   decoder;
+    AudioCodec      codec;
+    int             failed;
+    uint8_t         input[OFFLOAD_INPUT_SIZE];
+    int             inputStart;
+    int             inputEnd;
+
+    /* decoded samples not sent to the voice yet */
+    const int16_t*  pcm;
+    int             pcmBytes;
+    int             pcmFreq;
+    int             pcmChannels;
+
+    SWVoiceOut*     voice;
+    int             freq;
+    int             nchannels;
+    /* reopens the voice when the format changes, from outside of its
+     * callback */
+    QEMUBH*         reopen;
+
+    int             paused;
+    int             draining;
+    uint64_t        played;
+    uint8_t         lvol;
+    uint8_t         rvol;
+
+    uint8_t         replies[OFFLOAD_MAX_REPLIES * OFFLOAD_REPLY_SIZE];
+    int             repliesLen;
+} OffloadPipe;
+
+static QEMUSoundCard  offload_card;
+static int            offload_card_registered;
+
+static uint32_t
+offload_get_le32( const uint8_t*  p )
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void
+offload_put_le32( uint8_t*  p, uint32_t  val )
+{
+    p[0] = (uint8_t) val;
+    p[1] = (uint8_t)(val >> 8);
+    p[2] = (uint8_t)(val >> 16);
+    p[3] = (uint8_t)(val >> 24);
+}
+
+static void
+offload_reply( OffloadPipe*  p, uint32_t  command, int  status, uint64_t  value )
+{
+    uint8_t*  reply = p->replies + p->repliesLen;
+
+    if (p->repliesLen + OFFLOAD_REPLY_SIZE > (int)sizeof(p->replies)) {
+        D("%s: dropping reply to command %d", __FUNCTION__, command);
+        return;
+    }
+    offload_put_le32(reply,      command);
+    offload_put_le32(reply + 4,  (uint32_t)status);
+    offload_put_le32(reply + 8,  (uint32_t)value);
+    offload_put_le32(reply + 12, (uint32_t)(value >> 32));
+    p->repliesLen += OFFLOAD_REPLY_SIZE;
+
+    if (p->wanted & PIPE_WAKE_READ) {
+        p->wanted &= ~PIPE_WAKE_READ;
+        goldfish_pipe_wake(p->hwpipe, PIPE_WAKE_READ);
+    }
+}
+
+static int
+offload_status( OffloadPipe*  p )
+{
+    return (p->decoder == NULL || p->failed) ? OFFLOAD_STATUS_ERROR
+                                             : OFFLOAD_STATUS_OK;
+}
+
+/* drop everything that wasn't played, and start the stream over */
+static void
+offload_reset( OffloadPipe*  p )
+{
+    if (p->draining) {
+        p->draining = 0;
+        offload_reply(p, OFFLOAD_CMD_DRAIN, offload_status(p), p->played);
+    }
+    audio_decoder_free(p->decoder);
+    p->decoder    = NULL;
+    p->failed     = 0;
+    p->inputStart = p->inputEnd = 0;
+    p->pcm        = NULL;
+    p->pcmBytes   = 0;
+    p->played     = 0;
+}
+
+/* queue as much of the compressed data as possible, returns the number
+ * of bytes taken */
+static int
+offload_queue( OffloadPipe*  p, const uint8_t*  data, int  len )
+{
+    int  avail;
+
+    /* drop the data that can't be played */
+    if (p->decoder == NULL || p->failed)
+        return len;
+
+    if (p->inputStart > 0 && p->inputEnd + len > OFFLOAD_INPUT_SIZE) {
+        memmove(p->input, p->input + p->inputStart, p->inputEnd - p->inputStart);
+        p->inputEnd  -= p->inputStart;
+        p->inputStart = 0;
+    }
+    avail = OFFLOAD_INPUT_SIZE - p->inputEnd;
+    if (len > avail)
+        len = avail;
+
+    memcpy(p->input + p->inputEnd, data, len);
+    p->inputEnd += len;
+    return len;
+}
+
+/* make sure that there are decoded samples to play, feeding the decoder
+ * as it needs. returns 0 if there is nothing left to decode */
+static int
+offload_decode( OffloadPipe*  p )
+{
+    if (p->pcmBytes > 0)
+        return 1;
+
+    if (p->decoder == NULL || p->failed)
+        return 0;
+
+    for (;;) {
+        const int16_t*  pcm;
+        int             freq, nchannels, taken;
+        int             frames = audio_decoder_decode(p->decoder, &pcm, &freq, &nchannels);
+
+        if (frames > 0 && nchannels <= 2) {
+            p->pcm         = pcm;
+            p->pcmBytes    = frames * nchannels * 2;
+            p->pcmFreq     = freq;
+            p->pcmChannels = nchannels;
+            return 1;
+        }
+        if (frames != 0) {
+            D("%s: can't decode the stream", __FUNCTION__);
+            p->failed     = 1;
+            p->inputStart = p->inputEnd = 0;
+            return 0;
+        }
+
+        if (p->inputStart == p->inputEnd)
+            return 0;
+
+        taken = audio_decoder_feed(p->decoder, p->input + p->inputStart,
+                                   p->inputEnd - p->inputStart);
+        if (taken == 0)
+            return 0;
+        p->inputStart += taken;
+    }
+}
+
+static void
+offload_check_drained( OffloadPipe*  p )
+{
+    if (p->draining && p->pcmBytes == 0 && p->inputStart == p->inputEnd) {
+        p->draining = 0;
+        offload_reply(p, OFFLOAD_CMD_DRAIN, offload_status(p), p->played);
+    }
+}
+
+static void
+offload_wake_writer( OffloadPipe*  p )
+{
+    if ((p->wanted & PIPE_WAKE_WRITE) && p->inputEnd - p->inputStart < OFFLOAD_INPUT_SIZE) {
+        p->wanted &= ~PIPE_WAKE_WRITE;
+        goldfish_pipe_wake(p->hwpipe, PIPE_WAKE_WRITE);
+    }
+}
+
+static void
+offload_callback( void*  opaque, int  free )
+{
+    OffloadPipe*  p = opaque;
+    int           more;
+
+    while ((more = offload_decode(p)) != 0 && free > 0) {
+        int  len = p->pcmBytes;
+        int  written;
+
+        /* the voice can't be reopened from its own callback */
+        if (p->pcmFreq != p->freq || p->pcmChannels != p->nchannels) {
+            qemu_bh_schedule(p->reopen);
+            break;
+        }
+
+        if (len > free)
+            len = free;
+
+        written = AUD_write(p->voice, (void*)p->pcm, len);
+        if (!written)
+            break;
+
+        p->pcm       = (const int16_t*)((const uint8_t*)p->pcm + written);
+        p->pcmBytes -= written;
+        p->played   += written / (2 * p->nchannels);
+        free        -= written;
+    }
+
+    offload_wake_writer(p);
+    if (!more)
+        offload_check_drained(p);
+}
+
+/* decode the beginning of the stream outside of the voice callback, to
+ * open the voice with the right format */
+static void
+offload_pump( OffloadPipe*  p )
+{
+    struct audsettings  as;
+
+    if (!offload_decode(p)) {
+        offload_check_drained(p);
+        return;
+    }
+    if (p->voice != NULL && p->pcmFreq == p->freq && p->pcmChannels == p->nchannels)
+        return;
+
+    D("%s: playing %d Hz, %d channels", __FUNCTION__, p->pcmFreq, p->pcmChannels);
+    as.freq       = p->pcmFreq;
+    as.nchannels  = p->pcmChannels;
+    as.fmt        = AUD_FMT_S16;
+    as.endianness = AUDIO_HOST_ENDIANNESS;
+
+    p->voice = AUD_open_out(&offload_card, p->voice, "audio-offload", p,
+                            offload_callback, &as);
+    if (p->voice == NULL) {
+        D("%s: can't open the voice", __FUNCTION__);
+        p->failed     = 1;
+        p->inputStart = p->inputEnd = 0;
+        p->pcmBytes   = 0;
+        offload_check_drained(p);
+        return;
+    }
+    p->freq      = p->pcmFreq;
+    p->nchannels = p->pcmChannels;
+    AUD_set_volume_out(p->voice, 0, p->lvol, p->rvol);
+    AUD_set_active_out(p->voice, !p->paused);
+}
+
+static void
+offload_reopen( void*  opaque )
+{
+    offload_pump(opaque);
+}
+
+static void
+offload_command( OffloadPipe*  p )
+{
+    switch (p->command) {
+    case OFFLOAD_CMD_OPEN:
+        offload_reset(p);
+        p->paused = 0;
+        if (p->argsLen >= 4) {
+            p->codec   = offload_get_le32(p->args);
+            p->decoder = audio_decoder_new(p->codec);
+        }
+        D("%s: codec %d %s", __FUNCTION__, p->codec,
+          p->decoder ? "offloaded" : "not supported");
+        offload_reply(p, OFFLOAD_CMD_OPEN, offload_status(p), 0);
+        break;
+
+    case OFFLOAD_CMD_WRITE:
+        offload_pump(p);
+        break;
+
+    case OFFLOAD_CMD_DRAIN:
+        /* replies right away if everything was played, otherwise from
+         * the voice callback */
+        p->draining = 1;
+        offload_pump(p);
+        break;
+
+    case OFFLOAD_CMD_PAUSE:
+    case OFFLOAD_CMD_RESUME:
+        p->paused = (p->command == OFFLOAD_CMD_PAUSE);
+        if (p->voice != NULL)
+            AUD_set_active_out(p->voice, !p->paused);
+        break;
+
+    case OFFLOAD_CMD_FLUSH:
+        if (p->decoder != NULL) {
+            AudioCodec  codec = p->codec;
+
+            offload_reset(p);
+            p->decoder = audio_decoder_new(codec);
+        }
+        offload_wake_writer(p);
+        break;
+
+    case OFFLOAD_CMD_POSITION:
+        offload_reply(p, OFFLOAD_CMD_POSITION, offload_status(p), p->played);
+        break;
+
+    case OFFLOAD_CMD_VOLUME:
+        if (p->argsLen >= 8) {
+            uint32_t  lvol = offload_get_le32(p->args);
+            uint32_t  rvol = offload_get_le32(p->args + 4);
+
+            p->lvol = lvol > 255 ? 255 : lvol;
+            p->rvol = rvol > 255 ? 255 : rvol;
+            if (p->voice != NULL)
+                AUD_set_volume_out(p->voice, 0, p->lvol, p->rvol);
+        }
+        break;
+
+    default:
+        D("%s: unknown command %d", __FUNCTION__, p->command);
+        offload_reply(p, p->command, OFFLOAD_STATUS_ERROR, 0);
+        break;
+    }
+}
+
+static void*
+offloadPipe_init( void* hwpipe, void* svcOpaque, const char* args )
+{
+    OffloadPipe*  p;
+
+    if (!offload_card_registered) {
+        AUD_register_card("audio-offload", &offload_card);
+        offload_card_registered = 1;
+    }
+
+    ANEW0(p);
+    p->hwpipe = hwpipe;
+    p->lvol   = 255;
+    p->rvol   = 255;
+    p->reopen = qemu_bh_new(offload_reopen, p);
+    return p;
+}
+
+static void
+offloadPipe_close( void* opaque )
+{
+    OffloadPipe*  p = opaque;
+
+    if (p->voice != NULL)
+        AUD_close_out(&offload_card, p->voice);
+    audio_decoder_free(p->decoder);
+    qemu_bh_delete(p->reopen);
+    AFREE(p);
+}
+
+static int
+offloadPipe_sendBuffers( void* opaque, const GoldfishPipeBuffer* buffers, int numBuffers )
+{
+    OffloadPipe*  p = opaque;
+    int           ret = 0;
+    int           full = 0;
+
+    for ( ; numBuffers > 0 && !full; numBuffers--, buffers++ ) {
+        const uint8_t*  data = buffers->data;
+        int             size = buffers->size;
+
+        while (size > 0) {
+            int  len;
+
+            if (p->headerLen < OFFLOAD_HEADER_SIZE) {
+                len = OFFLOAD_HEADER_SIZE - p->headerLen;
+                if (len > size)
+                    len = size;
+                memcpy(p->header + p->headerLen, data, len);
+                p->headerLen += len;
+                if (p->headerLen == OFFLOAD_HEADER_SIZE) {
+                    p->command   = offload_get_le32(p->header);
+                    p->remaining = offload_get_le32(p->header + 4);
+                    p->argsLen   = 0;
+                }
+            } else {
+                len = size;
+                if ((uint32_t)len > p->remaining)
+                    len = p->remaining;
+
+                if (p->command == OFFLOAD_CMD_WRITE) {
+                    len = offload_queue(p, data, len);
+                    if (len == 0) {
+                        full = 1;
+                        break;
+                    }
+                } else {
+                    int  avail = OFFLOAD_MAX_ARGS - p->argsLen;
+                    memcpy(p->args + p->argsLen, data, len < avail ? len : avail);
+                    p->argsLen += len < avail ? len : avail;
+                }
+                p->remaining -= len;
+            }
+            data += len;
+            size -= len;
+            ret  += len;
+
+            if (p->headerLen == OFFLOAD_HEADER_SIZE && p->remaining == 0) {
+                offload_command(p);
+                p->headerLen = 0;
+            }
+        }
+    }
+
+    /* start decoding the data of a message that isn't complete yet */
+    if (p->headerLen == OFFLOAD_HEADER_SIZE && p->command == OFFLOAD_CMD_WRITE)
+        offload_pump(p);
+
+    if (ret == 0)
+        ret = PIPE_ERROR_AGAIN;
+
+    return ret;
+}
+
+static int
+offloadPipe_recvBuffers( void* opaque, GoldfishPipeBuffer* buffers, int numBuffers )
+{
+    OffloadPipe*  p = opaque;
+    int           ret = 0;
+
+    for ( ; numBuffers > 0 && ret < p->repliesLen; numBuffers--, buffers++ ) {
+        int  len = p->repliesLen - ret;
+
+        if (len > (int)buffers->size)
+            len = buffers->size;
+        memcpy(buffers->data, p->replies + ret, len);
+        ret += len;
+    }
+
+    if (ret == 0)
+        return PIPE_ERROR_AGAIN;
+
+    p->repliesLen -= ret;
+    memmove(p->replies, p->replies + ret, p->repliesLen);
+    return ret;
+}
+
+static unsigned
+offloadPipe_poll( void* opaque )
+{
+    OffloadPipe*  p = opaque;
+    unsigned      ret = 0;
+
+    if (p->repliesLen > 0)
+        ret |= PIPE_POLL_IN;
+
+    if (p->headerLen < OFFLOAD_HEADER_SIZE || p->command != OFFLOAD_CMD_WRITE ||
+        p->inputEnd - p->inputStart < OFFLOAD_INPUT_SIZE)
+        ret |= PIPE_POLL_OUT;
+
+    return ret;
+}
+
+static void
+offloadPipe_wakeOn( void* opaque, int flags )
+{
+    OffloadPipe*  p = opaque;
+
+    p->wanted |= (unsigned)flags;
+
+    if ((p->wanted & PIPE_WAKE_READ) && p->repliesLen > 0) {
+        p->wanted &= ~PIPE_WAKE_READ;
+        goldfish_pipe_wake(p->hwpipe, PIPE_WAKE_READ);
+    }
+    offload_wake_writer(p);
+}
+
+static const GoldfishPipeFuncs  offloadPipe_funcs = {
+    offloadPipe_init,
+    offloadPipe_close,
+    offloadPipe_sendBuffers,
+    offloadPipe_recvBuffers,
+    offloadPipe_poll,
+    offloadPipe_wakeOn,
+};
+
+void
+android_audio_offload_init( void )
+{
+    goldfish_pipe_add_type("audio-offload", NULL, &offloadPipe_funcs);
+}
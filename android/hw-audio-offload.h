@@ -0,0 +1,48 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#ifndef _android_hw_audio_offload_h
+#define _android_hw_audio_offload_h
+
+/* The 'audio-offload' pipe service lets the audio HAL of the guest send
+ * compressed streams to the host, which decodes and plays them, instead
+ * of decoding them on the emulated CPU and playing the samples through
+ * the goldfish audio device.
+ *
+ * Each connection plays one stream. The guest writes messages made of
+ * two little-endian 32-bit words, a command and the size of the payload
+ * that follows, and some commands are answered with a 16 bytes reply
+ * that the guest reads: the command as a 32-bit word, a signed 32-bit
+ * status that is 0 on success, and a 64-bit value.
+ *
+ *   1 OPEN      payload: the codec as a 32-bit word, 1 for MP3 or 2 for
+ *               AAC with ADTS headers. Starts a new stream, and replies
+ *               with a negative status if the host can't decode it, in
+ *               which case the guest should decode it itself.
+ *   2 WRITE     payload: compressed data. The pipe blocks once the host
+ *               has buffered enough of it.
+ *   3 DRAIN     replies once all the data written before has been
+ *               decoded and sent to the mixer, with the position.
+ *   4 PAUSE
+ *   5 RESUME
+ *   6 FLUSH     drops the data that hasn't been played yet, and resets
+ *               the position.
+ *   7 POSITION  replies with the number of frames played.
+ *   8 VOLUME    payload: the left and right volumes as 32-bit words,
+ *               from 0 to 255.
+ *
+ * The status of DRAIN and POSITION is negative if the stream couldn't be
+ * decoded. The connections are closed when loading a snapshot, and the
+ * guest should reopen them.
+ */
+extern void  android_audio_offload_init( void );
+
+#endif /* _android_hw_audio_offload_h */
@@ -20,12 +20,16 @@
 
 #include "android/sockets.h"
 #include "android/utils/assert.h"
+#include "android/utils/debug.h"
 #include "android/utils/panic.h"
+#include "android/utils/perf_counters.h"
+#include "android/utils/startup_trace.h"
 #include "android/utils/system.h"
 #include "android/async-utils.h"
 #include "android/opengles.h"
 #include "android/looper.h"
 #include "hw/android/goldfish/pipe.h"
+#include "qemu/atomic.h"
 
 /* Implement the OpenGL fast-pipe */
 
@@ -69,13 +73,41 @@ typedef struct {
     int             wakeWanted;
     LoopIo          io[1];
     AsyncConnector  connector[1];
+    Looper*         looper;
+    /* Throughput counters, printed with -debug-socket on close */
+    Duration        startTime;
+    uint64_t        bytesSent;
+    uint64_t        bytesReceived;
+    unsigned        sendCalls;
+    unsigned        recvCalls;
 } NetPipe;
 
+static void
+netPipe_printStats( NetPipe*  pipe )
+{
+    Duration  elapsed = looper_now(pipe->looper) - pipe->startTime;
+    double    seconds = elapsed > 0 ? elapsed / 1000. : 1e-3;
+
+    VERBOSE_PRINT(socket,
+                  "net pipe %p: sent %llu bytes in %u calls (%.1f KB/s), "
+                  "received %llu bytes in %u calls (%.1f KB/s), "
+                  "over %.1f s",
+                  pipe,
+                  (unsigned long long)pipe->bytesSent, pipe->sendCalls,
+                  pipe->bytesSent / 1024. / seconds,
+                  (unsigned long long)pipe->bytesReceived, pipe->recvCalls,
+                  pipe->bytesReceived / 1024. / seconds,
+                  seconds);
+}
+
 static void
 netPipe_free( NetPipe*  pipe )
 {
     int  fd;
 
+    if (pipe->looper != NULL && VERBOSE_CHECK(socket))
+        netPipe_printStats(pipe);
+
     /* Close the socket */
     fd = pipe->io->fd;
     loopIo_done(pipe->io);
@@ -192,6 +224,8 @@ netPipe_initFromAddress( void* hwpipe, const SockAddress*  address, Looper* loop
 
     pipe->hwpipe = hwpipe;
     pipe->state  = STATE_INIT;
+    pipe->looper = looper;
+    pipe->startTime = looper_now(looper);
 
     {
         AsyncStatus  status;
@@ -245,6 +279,51 @@ static int netPipeReadySend(NetPipe *pipe)
         return PIPE_ERROR_IO;
 }
 
+/* Fill 'bufs' with up to SOCKET_MAX_BUFFERS descriptors covering the
+ * pipe buffers from 'buff' + 'buffStart' to 'buffEnd', without any copy.
+ * Returns the number of descriptors. */
+static int
+netPipe_fillSockBuffers( SockBuffer*                bufs,
+                         const GoldfishPipeBuffer*  buff,
+                         const GoldfishPipeBuffer*  buffEnd,
+                         size_t                     buffStart )
+{
+    int  count = 0;
+
+    for (; buff < buffEnd && count < SOCKET_MAX_BUFFERS; buff++) {
+        if (buff->size > buffStart) {
+            bufs[count].data = buff->data + buffStart;
+            bufs[count].size = buff->size - buffStart;
+            count++;
+        }
+        buffStart = 0;
+    }
+    return count;
+}
+
+/* Advance ('*pbuff', '*pbuffStart') by 'len' bytes */
+static void
+netPipe_skipBytes( const GoldfishPipeBuffer**  pbuff,
+                   size_t*                     pbuffStart,
+                   size_t                      len )
+{
+    const GoldfishPipeBuffer*  buff = *pbuff;
+    size_t                     buffStart = *pbuffStart;
+
+    while (len > 0) {
+        size_t  avail = buff->size - buffStart;
+        if (len < avail) {
+            buffStart += len;
+            break;
+        }
+        len -= avail;
+        buff++;
+        buffStart = 0;
+    }
+    *pbuff = buff;
+    *pbuffStart = buffStart;
+}
+
 static int
 netPipe_sendBuffers( void* opaque, const GoldfishPipeBuffer* buffers, int numBuffers )
 {
@@ -264,18 +343,18 @@ netPipe_sendBuffers( void* opaque, const GoldfishPipeBuffer* buffers, int numBuf
 
     buff = buffers;
     while (count > 0) {
-        int  avail = buff->size - buffStart;
-        int  len = socket_send(pipe->io->fd, buff->data + buffStart, avail);
+        SockBuffer  bufs[SOCKET_MAX_BUFFERS];
+        int  numBufs = netPipe_fillSockBuffers(bufs, buff, buffEnd, buffStart);
+        int  len = socket_sendv(pipe->io->fd, bufs, numBufs);
+
+        pipe->sendCalls++;
 
         /* the write succeeded */
         if (len > 0) {
-            buffStart += len;
-            if (buffStart >= buff->size) {
-                buff++;
-                buffStart = 0;
-            }
+            netPipe_skipBytes(&buff, &buffStart, len);
             count -= len;
             ret   += len;
+            pipe->bytesSent += len;
             continue;
         }
 
@@ -310,26 +389,26 @@ netPipe_recvBuffers( void* opaque, GoldfishPipeBuffer*  buffers, int  numBuffers
     int       count = 0;
     int       ret   = 0;
     size_t    buffStart = 0;
-    GoldfishPipeBuffer* buff = buffers;
-    GoldfishPipeBuffer* buffEnd = buff + numBuffers;
+    const GoldfishPipeBuffer* buff = buffers;
+    const GoldfishPipeBuffer* buffEnd = buff + numBuffers;
 
     for (; buff < buffEnd; buff++)
         count += buff->size;
 
     buff = buffers;
     while (count > 0) {
-        int  avail = buff->size - buffStart;
-        int  len = socket_recv(pipe->io->fd, buff->data + buffStart, avail);
+        SockBuffer  bufs[SOCKET_MAX_BUFFERS];
+        int  numBufs = netPipe_fillSockBuffers(bufs, buff, buffEnd, buffStart);
+        int  len = socket_recvv(pipe->io->fd, bufs, numBufs);
+
+        pipe->recvCalls++;
 
         /* the read succeeded */
         if (len > 0) {
-            buffStart += len;
-            if (buffStart >= buff->size) {
-                buff++;
-                buffStart = 0;
-            }
+            netPipe_skipBytes(&buff, &buffStart, len);
             count -= len;
             ret   += len;
+            pipe->bytesReceived += len;
             continue;
         }
 
@@ -479,6 +558,239 @@ static const GoldfishPipeFuncs  netPipeUnix_funcs = {
  */
 static int  _opengles_init;
 
+/**********************************************************************
+ **********************************************************************
+ *****
+ *****  R E N D E R   C H A N N E L   P I P E S
+ *****
+ *****/
+
+/* When android_gles_shmem_pipes is set, the 'opengles' pipe talks to the
+ * renderer through an in-process render channel (see android/opengles.h).
+ * Guest buffers are copied straight into the channel's ring buffers by
+ * sendBuffers() and recvBuffers(), without going through a socket.
+ *
+ * The channel's wake callback is invoked from a renderer thread with the
+ * events that happened. It records them in the pipe's |pendingEvents|, then
+ * wakes up the looper, which calls goldfish_pipe_wake() from the main
+ * thread. A single socket pair is shared by all channel pipes for this
+ * purpose, and it is only written to when the looper is not already
+ * signaled, so there is no per-pipe file descriptor or readiness polling.
+ */
+typedef struct ChannelPipe {
+    void*                hwpipe;
+    void*                channel;
+    int                  wakeWanted;
+    unsigned             pendingEvents;  /* set from renderer threads */
+    struct ChannelPipe*  next;
+    struct ChannelPipe*  prev;
+} ChannelPipe;
+
+/* sendBuffers() and recvBuffers() pass GoldfishPipeBuffer arrays as is. */
+QEMU_BUILD_BUG_ON(sizeof(GoldfishPipeBuffer) !=
+                  sizeof(AndroidGlesChannelBuffer));
+
+static struct {
+    ChannelPipe*  pipes;      /* list of all channel pipes */
+    int           wakeFd;     /* written to by channelPipe_onWake() */
+    int           signaled;   /* 1 if a wake byte is pending */
+    LoopIo        io[1];      /* watches the other end of the socket pair */
+} _channel_pipes;
+
+static void
+channelPipe_onWake( void* opaque, unsigned events )
+{
+    ChannelPipe*  pipe = opaque;
+    char          c = 1;
+
+    atomic_or(&pipe->pendingEvents, events);
+    if (atomic_xchg(&_channel_pipes.signaled, 1) == 0) {
+        socket_send(_channel_pipes.wakeFd, &c, 1);
+    }
+}
+
+static void
+channelPipe_io_func( void* opaque, int fd, unsigned events )
+{
+    char          buf[16];
+    ChannelPipe*  pipe;
+
+    /* Drain the socket pair before processing events, a concurrent
+     * channelPipe_onWake() will send another byte. */
+    while (socket_recv(fd, buf, sizeof(buf)) > 0) {
+    }
+    atomic_xchg(&_channel_pipes.signaled, 0);
+
+    for (pipe = _channel_pipes.pipes; pipe != NULL; pipe = pipe->next) {
+        unsigned  state = atomic_xchg(&pipe->pendingEvents, 0);
+        int       wakeFlags = 0;
+
+        if (state == 0 || pipe->hwpipe == NULL) {
+            continue;
+        }
+        if (state & ANDROID_GLES_CHANNEL_CLOSED) {
+            /* The render thread exited. */
+            goldfish_pipe_close(pipe->hwpipe);
+            pipe->hwpipe = NULL;
+            continue;
+        }
+        if (state & ANDROID_GLES_CHANNEL_CAN_READ)
+            wakeFlags |= PIPE_WAKE_READ;
+        if (state & ANDROID_GLES_CHANNEL_CAN_WRITE)
+            wakeFlags |= PIPE_WAKE_WRITE;
+
+        wakeFlags &= pipe->wakeWanted;
+        if (wakeFlags != 0) {
+            goldfish_pipe_wake(pipe->hwpipe, wakeFlags);
+            pipe->wakeWanted &= ~wakeFlags;
+        }
+    }
+}
+
+/* Create the shared wake socket pair on first use. */
+static int
+channelPipe_initWake( Looper* looper )
+{
+    int  fds[2];
+
+    if (_channel_pipes.wakeFd > 0) {
+        return 0;
+    }
+    if (socket_pair(&fds[0], &fds[1]) < 0) {
+        D("%s: Could not create socket pair: %s", __FUNCTION__, errno_str);
+        return -1;
+    }
+    socket_set_nonblock(fds[0]);
+    socket_set_nonblock(fds[1]);
+    _channel_pipes.wakeFd = fds[1];
+    loopIo_init(_channel_pipes.io, looper, fds[0], channelPipe_io_func, NULL);
+    loopIo_wantRead(_channel_pipes.io);
+    return 0;
+}
+
+static void
+channelPipe_free( ChannelPipe* pipe )
+{
+    /* Close the channel first, to ensure the wake callback is not
+     * called anymore. */
+    if (pipe->channel) {
+        android_gles_channel_close(pipe->channel);
+    }
+    if (pipe->prev) {
+        pipe->prev->next = pipe->next;
+    } else if (_channel_pipes.pipes == pipe) {
+        _channel_pipes.pipes = pipe->next;
+    }
+    if (pipe->next) {
+        pipe->next->prev = pipe->prev;
+    }
+    AFREE(pipe);
+}
+
+static void*
+channelPipe_init( void* hwpipe, void* _looper )
+{
+    ChannelPipe*  pipe;
+
+    if (channelPipe_initWake((Looper*)_looper) < 0) {
+        return NULL;
+    }
+
+    ANEW0(pipe);
+    pipe->hwpipe = hwpipe;
+    pipe->next = _channel_pipes.pipes;
+    if (pipe->next) {
+        pipe->next->prev = pipe;
+    }
+    _channel_pipes.pipes = pipe;
+
+    pipe->channel = android_gles_channel_open(channelPipe_onWake, pipe);
+    if (pipe->channel == NULL) {
+        D("%s: Could not open render channel", __FUNCTION__);
+        channelPipe_free(pipe);
+        return NULL;
+    }
+    return pipe;
+}
+
+static void
+channelPipe_closeFromGuest( void* opaque )
+{
+    channelPipe_free(opaque);
+}
+
+static int
+channelPipe_sendBuffers( void* opaque, const GoldfishPipeBuffer* buffers, int numBuffers )
+{
+    ChannelPipe*  pipe = opaque;
+    int           ret;
+
+    ret = android_gles_channel_write(pipe->channel,
+                                     (const AndroidGlesChannelBuffer*)buffers,
+                                     numBuffers);
+    if (ret < 0) {
+        /* The render thread exited. */
+        return PIPE_ERROR_IO;
+    }
+    return (ret > 0) ? ret : PIPE_ERROR_AGAIN;
+}
+
+static int
+channelPipe_recvBuffers( void* opaque, GoldfishPipeBuffer* buffers, int numBuffers )
+{
+    ChannelPipe*  pipe = opaque;
+    int           ret;
+
+    ret = android_gles_channel_read(pipe->channel,
+                                    (const AndroidGlesChannelBuffer*)buffers,
+                                    numBuffers);
+    if (ret < 0) {
+        return PIPE_ERROR_IO;
+    }
+    return (ret > 0) ? ret : PIPE_ERROR_AGAIN;
+}
+
+static unsigned
+channelPipe_poll( void* opaque )
+{
+    ChannelPipe*  pipe = opaque;
+    unsigned      state = android_gles_channel_poll(pipe->channel);
+    unsigned      ret = 0;
+
+    if (state & ANDROID_GLES_CHANNEL_CAN_READ)
+        ret |= PIPE_POLL_IN;
+    if (state & ANDROID_GLES_CHANNEL_CAN_WRITE)
+        ret |= PIPE_POLL_OUT;
+    if (state & ANDROID_GLES_CHANNEL_CLOSED)
+        ret |= PIPE_POLL_HUP;
+
+    return ret;
+}
+
+static void
+channelPipe_wakeOn( void* opaque, int flags )
+{
+    ChannelPipe*  pipe = opaque;
+    unsigned      events = 0;
+
+    DD("%s: flags=%d", __FUNCTION__, flags);
+
+    pipe->wakeWanted |= flags;
+    if (flags & PIPE_WAKE_READ)
+        events |= ANDROID_GLES_CHANNEL_CAN_READ;
+    if (flags & PIPE_WAKE_WRITE)
+        events |= ANDROID_GLES_CHANNEL_CAN_WRITE;
+
+    android_gles_channel_wake_on(pipe->channel, events);
+}
+
+/**********************************************************************
+ **********************************************************************
+ *****
+ *****  O P E N G L E S   P I P E S
+ *****
+ *****/
+
 static void*
 openglesPipe_init( void* hwpipe, void* _looper, const char* args )
 {
@@ -491,6 +803,14 @@ openglesPipe_init( void* hwpipe, void* _looper, const char* args )
         return NULL;
     }
 
+    /* The guest's first GL connection comes from SurfaceFlinger. */
+    startupTrace_mark("guest GL connection");
+
+    if (android_gles_shmem_pipes) {
+        D("Creating render channel OpenGLES pipe for GPU emulation");
+        return channelPipe_init(hwpipe, _looper);
+    }
+
     char server_addr[PATH_MAX];
     android_gles_server_path(server_addr, sizeof(server_addr));
 #ifndef _WIN32
@@ -526,13 +846,75 @@ openglesPipe_init( void* hwpipe, void* _looper, const char* args )
     return pipe;
 }
 
+/* The transport is selected once by android_initOpenglesEmulation(), before
+ * any guest connection, so use android_gles_shmem_pipes to dispatch to the
+ * right implementation. */
+static void
+openglesPipe_closeFromGuest( void* opaque )
+{
+    if (android_gles_shmem_pipes)
+        channelPipe_closeFromGuest(opaque);
+    else
+        netPipe_closeFromGuest(opaque);
+}
+
+static PerfCounter  opengles_bytes_from_guest_counter =
+        PERF_COUNTER_INIT("gles.bytes_from_guest", "bytes");
+static PerfCounter  opengles_bytes_to_guest_counter =
+        PERF_COUNTER_INIT("gles.bytes_to_guest", "bytes");
+
+static int
+openglesPipe_sendBuffers( void* opaque, const GoldfishPipeBuffer* buffers, int numBuffers )
+{
+    int  ret;
+
+    if (android_gles_shmem_pipes)
+        ret = channelPipe_sendBuffers(opaque, buffers, numBuffers);
+    else
+        ret = netPipe_sendBuffers(opaque, buffers, numBuffers);
+    if (ret > 0)
+        perfCounter_add(&opengles_bytes_from_guest_counter, ret);
+    return ret;
+}
+
+static int
+openglesPipe_recvBuffers( void* opaque, GoldfishPipeBuffer* buffers, int numBuffers )
+{
+    int  ret;
+
+    if (android_gles_shmem_pipes)
+        ret = channelPipe_recvBuffers(opaque, buffers, numBuffers);
+    else
+        ret = netPipe_recvBuffers(opaque, buffers, numBuffers);
+    if (ret > 0)
+        perfCounter_add(&opengles_bytes_to_guest_counter, ret);
+    return ret;
+}
+
+static unsigned
+openglesPipe_poll( void* opaque )
+{
+    if (android_gles_shmem_pipes)
+        return channelPipe_poll(opaque);
+    return netPipe_poll(opaque);
+}
+
+static void
+openglesPipe_wakeOn( void* opaque, int flags )
+{
+    if (android_gles_shmem_pipes)
+        channelPipe_wakeOn(opaque, flags);
+    else
+        netPipe_wakeOn(opaque, flags);
+}
+
 static const GoldfishPipeFuncs  openglesPipe_funcs = {
     openglesPipe_init,
-    netPipe_closeFromGuest,
-    netPipe_sendBuffers,
-    netPipe_recvBuffers,
-    netPipe_poll,
-    netPipe_wakeOn,
+    openglesPipe_closeFromGuest,
+    openglesPipe_sendBuffers,
+    openglesPipe_recvBuffers,
+    openglesPipe_poll,
+    openglesPipe_wakeOn,
     NULL,  /* we can't save these */
     NULL,  /* we can't load these */
 };
@@ -11,6 +11,7 @@
 */
 #include "android/hw-qemud.h"
 #include "android/utils/debug.h"
+#include "android/utils/intmap.h"
 #include "android/utils/misc.h"
 #include "android/utils/system.h"
 #include "android/utils/bufprint.h"
@@ -43,6 +44,11 @@
  */
 #define  MAX_FRAME_PAYLOAD  65535
 
+/* max number of bytes queued for a pipe client before host producers
+ * using qemud_client_get_credits() should pause.
+ */
+#define  QEMUD_CLIENT_MAX_PENDING  16384
+
 /* Version number of snapshots code. Increment whenever the data saved
  * or the layout in which it is saved is changed.
  */
@@ -241,6 +247,9 @@ typedef struct QemudSerial {
     /* receiver */
     QemudSerialReceive  recv_func;    /* receiver callback */
     void*               recv_opaque;  /* receiver user-specific data */
+
+    /* serial clients, indexed by channel id */
+    AIntMap*            clients;
 } QemudSerial;
 
 
@@ -493,6 +502,8 @@ qemud_serial_init( QemudSerial*        s,
     s->cs           = cs;
     s->recv_func    = recv_func;
     s->recv_opaque  = recv_opaque;
+    if (s->clients == NULL)
+        s->clients  = aintMap_new();
     s->need_header  = 1;
     s->overflow     = 0;
 
@@ -675,6 +686,10 @@ struct QemudClient {
         struct {
             QemudPipe*          qemud_pipe;
             QemudPipeMessage*   messages;
+            /* Total number of bytes in 'messages' not read by the guest. */
+            int                 pending_bytes;
+            /* Called when the guest has read all pending messages. */
+            QemudClientDrain    clie_drain;
         } Pipe;
     } ProtocolSelector;
 };
@@ -711,6 +726,17 @@ qemud_client_prepend( QemudClient*  c, QemudClient** plist )
         c->next->pref = &c->next;
 }
 
+/* remove a serial QemudClient from its serial port's channel index */
+static void
+qemud_client_unindex( QemudClient*  c )
+{
+    QemudSerial*  s       = c->ProtocolSelector.Serial.serial;
+    int           channel = c->ProtocolSelector.Serial.channel;
+
+    if (channel >= 0 && aintMap_get(s->clients, channel) == c)
+        aintMap_del(s->clients, channel);
+}
+
 /* receive a new message from a client, and dispatch it to
  * the real service implementation.
  */
@@ -858,6 +884,8 @@ qemud_client_disconnect( void*  opaque, int guest_close )
 
     /* remove from current list */
     qemud_client_remove(c);
+    if (!_is_pipe_client(c))
+        qemud_client_unindex(c);
 
     if (_is_pipe_client(c)) {
         /* We must NULL the client reference in the QemuPipe for this connection,
@@ -912,11 +940,14 @@ qemud_client_alloc( int               channel_id,
         c->protocol = QEMUD_PROTOCOL_PIPE;
         c->ProtocolSelector.Pipe.messages   = NULL;
         c->ProtocolSelector.Pipe.qemud_pipe = NULL;
+        c->ProtocolSelector.Pipe.pending_bytes = 0;
+        c->ProtocolSelector.Pipe.clie_drain = NULL;
     } else {
         /* Allocating a serial client. */
         c->protocol = QEMUD_PROTOCOL_SERIAL;
         c->ProtocolSelector.Serial.serial   = serial;
         c->ProtocolSelector.Serial.channel  = channel_id;
+        aintMap_set(serial->clients, channel_id, c);
     }
     c->param       = client_param ? ASTRDUP(client_param) : NULL;
     c->clie_opaque = clie_opaque;
@@ -1305,17 +1336,15 @@ qemud_multiplexer_serial_recv( void*     opaque,
                                int       msglen )
 {
     QemudMultiplexer*  m = opaque;
-    QemudClient*       c = m->clients;
+    QemudClient*       c = aintMap_get(m->serial->clients, channel);
 
     /* dispatch to an existing client if possible
      * note that channel 0 is handled by a special
      * QemudClient that is setup in qemud_multiplexer_init()
      */
-    for ( ; c != NULL; c = c->next ) {
-        if (!_is_pipe_client(c) && c->ProtocolSelector.Serial.channel == channel) {
-            qemud_client_recv(c, msg, msglen);
-            return;
-        }
+    if (c != NULL) {
+        qemud_client_recv(c, msg, msglen);
+        return;
     }
 
     D("%s: ignoring %d bytes for unknown channel %d",
@@ -1361,17 +1390,17 @@ qemud_multiplexer_disconnect( QemudMultiplexer*  m,
     QemudClient*  c;
 
     /* find the client by its channel id, then disconnect it */
-    for (c = m->clients; c; c = c->next) {
-        if (!_is_pipe_client(c) && c->ProtocolSelector.Serial.channel == channel) {
-            D("%s: disconnecting client %d",
-              __FUNCTION__, channel);
-            /* note thatt this removes the client from
-             * m->clients automatically.
-             */
-            c->ProtocolSelector.Serial.channel = -1; /* no need to send disconnect:<id> */
-            qemud_client_disconnect(c, 0);
-            return;
-        }
+    c = aintMap_get(m->serial->clients, channel);
+    if (c != NULL) {
+        D("%s: disconnecting client %d",
+          __FUNCTION__, channel);
+        /* note thatt this removes the client from
+         * m->clients automatically.
+         */
+        qemud_client_unindex(c);
+        c->ProtocolSelector.Serial.channel = -1; /* no need to send disconnect:<id> */
+        qemud_client_disconnect(c, 0);
+        return;
     }
     D("%s: disconnecting unknown channel %d",
       __FUNCTION__, channel);
@@ -1398,6 +1427,7 @@ qemud_multiplexer_disconnect_noncontrol( QemudMultiplexer*  m )
               __FUNCTION__, c->ProtocolSelector.Serial.channel);
             D("%s: disconnecting client %d\n",
               __FUNCTION__, c->ProtocolSelector.Serial.channel);
+            qemud_client_unindex(c);
             c->ProtocolSelector.Serial.channel = -1; /* do not send disconnect:<id> */
             qemud_client_disconnect(c, 0);
         }
@@ -1626,6 +1656,7 @@ _qemud_pipe_cache_buffer(QemudClient* client, const uint8_t*  msg, int  msglen)
             ins_at = &(*ins_at)->next;
         }
         *ins_at = buf;
+        client->ProtocolSelector.Pipe.pending_bytes += msglen;
         /* Notify the pipe that there is data to read. */
         goldfish_pipe_wake(client->ProtocolSelector.Pipe.qemud_pipe->hwpipe,
                            PIPE_WAKE_READ);
@@ -1638,8 +1669,7 @@ static void
 _qemud_pipe_send(QemudClient*  client, const uint8_t*  msg, int  msglen)
 {
     uint8_t   frame[FRAME_HEADER_SIZE];
-    int       avail, len = msglen;
-    int framing = client->framing;
+    int       framing = client->framing;
 
     if (msglen <= 0)
         return;
@@ -1647,33 +1677,18 @@ _qemud_pipe_send(QemudClient*  client, const uint8_t*  msg, int  msglen)
     D("%s: len=%3d '%s'",
       __FUNCTION__, msglen, quote_bytes((const void*)msg, msglen));
 
+    /* Unlike the serial port, pipes have no MTU, so queue the whole
+     * payload as a single message. This keeps the number of queued
+     * messages low for bulk transfers, e.g. adb push / pull. */
     if (framing) {
-        len += FRAME_HEADER_SIZE;
+        int2hex(frame, FRAME_HEADER_SIZE, msglen);
+        T("%s: '%.*s'", __FUNCTION__, FRAME_HEADER_SIZE, frame);
+        _qemud_pipe_cache_buffer(client, frame, FRAME_HEADER_SIZE);
     }
 
-    /* packetize the payload for the serial MTU */
-    while (len > 0)
-    {
-        avail = len;
-        if (avail > MAX_SERIAL_PAYLOAD)
-            avail = MAX_SERIAL_PAYLOAD;
-
-        /* insert frame header when needed */
-        if (framing) {
-            int2hex(frame, FRAME_HEADER_SIZE, msglen);
-            T("%s: '%.*s'", __FUNCTION__, FRAME_HEADER_SIZE, frame);
-            _qemud_pipe_cache_buffer(client, frame, FRAME_HEADER_SIZE);
-            avail  -= FRAME_HEADER_SIZE;
-            len    -= FRAME_HEADER_SIZE;
-            framing = 0;
-        }
-
-        /* write message content */
-        T("%s: '%.*s'", __FUNCTION__, avail, msg);
-        _qemud_pipe_cache_buffer(client, msg, avail);
-        msg += avail;
-        len -= avail;
-    }
+    /* write message content */
+    T("%s: '%.*s'", __FUNCTION__, msglen, msg);
+    _qemud_pipe_cache_buffer(client, msg, msglen);
 }
 
 /* this can be used by a service implementation to send an answer
@@ -1708,6 +1723,34 @@ qemud_client_set_framing( QemudClient*  client, int  framing )
     client->framing = !!framing;
 }
 
+int
+qemud_client_get_pending_bytes( QemudClient*  client )
+{
+    if (!_is_pipe_client(client))
+        return 0;
+
+    return client->ProtocolSelector.Pipe.pending_bytes;
+}
+
+int
+qemud_client_get_credits( QemudClient*  client )
+{
+    int  credits;
+
+    if (!_is_pipe_client(client))
+        return QEMUD_CLIENT_MAX_PENDING;
+
+    credits = QEMUD_CLIENT_MAX_PENDING - client->ProtocolSelector.Pipe.pending_bytes;
+    return (credits > 0) ? credits : 0;
+}
+
+void
+qemud_client_set_drain_callback( QemudClient*  client, QemudClientDrain  clie_drain )
+{
+    if (_is_pipe_client(client))
+        client->ProtocolSelector.Pipe.clie_drain = clie_drain;
+}
+
 /* this can be used by a service implementation to close a
  * specific client connection.
  */
@@ -2062,6 +2105,11 @@ _qemudPipe_recvBuffers(void* opaque, GoldfishPipeBuffer* buffers, int numBuffers
 
     D("%s: -> %u (of %u)", __FUNCTION__, sent_bytes, buffers->size);
 
+    client->ProtocolSelector.Pipe.pending_bytes -= sent_bytes;
+    if (*msg_list == NULL && client->ProtocolSelector.Pipe.clie_drain != NULL) {
+        client->ProtocolSelector.Pipe.clie_drain(client->clie_opaque);
+    }
+
     return sent_bytes;
 }
 
@@ -2152,6 +2200,13 @@ _qemudPipe_load(void* hwpipe, void* pipeOpaque, const char* args, QEMUFile* f)
 
     /* Load pending messages. */
     c->ProtocolSelector.Pipe.messages = _load_pipe_message(f);
+    {
+        QemudPipeMessage* msg = c->ProtocolSelector.Pipe.messages;
+        c->ProtocolSelector.Pipe.pending_bytes = 0;
+        for (; msg != NULL; msg = msg->next) {
+            c->ProtocolSelector.Pipe.pending_bytes += msg->size - msg->offset;
+        }
+    }
 
     /* load client-specific state */
     if (c->clie_load && c->clie_load(f, c, c->clie_opaque)) {
@@ -2400,14 +2455,35 @@ _qemud_char_client_close( void*  opaque )
 }
 
 
+/* called when a pipe client has read all its pending messages.
+ * this lets the charpipe resume sending data that it kept while the
+ * client was out of credits.
+ */
+static void
+_qemud_char_client_drain( void*  opaque )
+{
+    CharDriverState*  cs = opaque;
+    qemu_chr_accept_input(cs);
+}
+
 /* called by the charpipe to know how much data can be read from
- * the user. Since we send everything directly to the serial port
- * we can return an arbitrary number.
+ * the user. Data is sent to all clients, so this is the smallest
+ * number of credits among them. The charpipe keeps the rest until
+ * the clients catch up.
  */
 static int
 _qemud_char_service_can_read( void*  opaque )
 {
-    return 8192;  /* whatever */
+    QemudService*  sv      = opaque;
+    QemudClient*   c;
+    int            credits = QEMUD_CLIENT_MAX_PENDING;
+
+    for (c = sv->clients; c; c = c->next_serv) {
+        int  n = qemud_client_get_credits(c);
+        if (n < credits)
+            credits = n;
+    }
+    return credits;
 }
 
 /* called to read data from the charpipe and send it to the client.
@@ -2438,6 +2514,8 @@ _qemud_char_service_connect(void*          opaque,
                                               _qemud_char_client_close,
                                               NULL, NULL );
 
+    qemud_client_set_drain_callback(c, _qemud_char_client_drain);
+
     /* now we can open the gates :-) */
     qemu_chr_add_handlers( cs,
                            _qemud_char_service_can_read,
@@ -82,6 +82,11 @@ typedef void (*QemudClientSave) ( QEMUFile*  f, QemudClient*  client, void*  opa
  */
 typedef int (*QemudClientLoad) ( QEMUFile*  f, QemudClient*  client, void*  opaque );
 
+/* A function that will be called when the client running in the emulated
+ * system has read all the messages sent to it with qemud_client_send().
+ */
+typedef void (*QemudClientDrain)( void*  opaque );
+
 /* Register a new client for a given service.
  * 'clie_opaque' will be sent as the first argument to 'clie_recv' and 'clie_close'
  * 'clie_recv' and 'clie_close' are both optional and may be NULL.
@@ -106,6 +111,26 @@ extern void           qemud_client_set_framing( QemudClient*  client, int  enabl
  */
 extern void   qemud_client_send ( QemudClient*  client, const uint8_t*  msg, int  msglen );
 
+/* Return the number of bytes sent with qemud_client_send() that the client
+ * has not read yet. This is always 0 for serial clients, whose messages
+ * are written immediately.
+ */
+extern int    qemud_client_get_pending_bytes( QemudClient*  client );
+
+/* Return the number of bytes that can be sent to a given client before
+ * its queue is considered full. Host producers that stream data should
+ * pause when this reaches 0, and resume from the drain callback below,
+ * instead of queuing more messages. Serial clients always have credits.
+ */
+extern int    qemud_client_get_credits( QemudClient*  client );
+
+/* Set a callback to be invoked with 'clie_opaque' each time the client has
+ * read all pending messages. Can be used by services that stream data to
+ * apply back-pressure on their source. Ignored for serial clients.
+ */
+extern void   qemud_client_set_drain_callback( QemudClient*  client,
+                                               QemudClientDrain  clie_drain );
+
 /* Force-close the connection to a given qemud client.
  */
 extern void   qemud_client_close( QemudClient*  client );
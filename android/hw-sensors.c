@@ -14,6 +14,7 @@
 #include "android/hw-sensors.h"
 #include "android/utils/debug.h"
 #include "android/utils/misc.h"
+#include "android/utils/startup_trace.h"
 #include "android/utils/system.h"
 #include "android/hw-qemud.h"
 #include "android/globals.h"
@@ -162,10 +163,43 @@ typedef struct {
  *   was "taken" by this code. This is adjusted by the HAL module to
  *   emulated system time (using the first sync: to compute an adjustment
  *   offset).
+ *
+ * - the HAL module can send "set-batch:1" to receive binary batched
+ *   reports instead of the text lines above. This code answers with
+ *   "batch:1". An older emulator ignores the command, so the HAL module
+ *   should send "wake" right after it, and keep using text reports if
+ *   "wake" comes back first. "set-batch:0" restores text reports.
+ *
+ *   In batched mode, all enabled sensors of a tick are sent in a single
+ *   message. If the HAL module didn't read the previous reports yet when
+ *   a tick happens, the new report is queued and sent with the next ones
+ *   when it does, up to SENSORS_BATCH_MAX_TICKS reports per message.
+ *   All values are little-endian:
+ *
+ *      "bsr1"                          4 bytes magic
+ *      <count>                         uint16, number of reports
+ *      then <count> times:
+ *          <time_us>                   uint64, as in sync:<time_us>
+ *          <samples>                   uint16, number of samples
+ *          then <samples> times:
+ *              <sensor> <values> 0 0   uint8 sensor id, uint8 number of
+ *                                      values (1 to 3), 2 padding bytes
+ *              <v0> <v1> <v2>          float32 values, unused ones are 0
+ *
+ *   The HAL module must still accept text reports, e.g. after a snapshot
+ *   is restored, since the batching mode is not saved.
  */
 #define  HEADER_SIZE  4
 #define  BUFFER_SIZE  512
 
+#define  SENSORS_BATCH_MAX_TICKS    16
+#define  SENSORS_BATCH_HEADER_SIZE  6
+#define  SENSORS_BATCH_TICK_SIZE    10
+#define  SENSORS_BATCH_SAMPLE_SIZE  16
+#define  SENSORS_BATCH_MAX_SIZE     (SENSORS_BATCH_HEADER_SIZE + \
+    SENSORS_BATCH_MAX_TICKS * (SENSORS_BATCH_TICK_SIZE + \
+                               MAX_SENSORS * SENSORS_BATCH_SAMPLE_SIZE))
+
 typedef struct HwSensorClient   HwSensorClient;
 
 typedef struct {
@@ -182,6 +216,11 @@ struct HwSensorClient {
     QEMUTimer*       timer;
     uint32_t         enabledMask;
     int32_t          delay_ms;
+    /* Batched reports mode, see "set-batch" above. */
+    int              batch;
+    int              batchTicks;
+    int              batchLen;
+    uint8_t          batchBuffer[SENSORS_BATCH_MAX_SIZE];
 };
 
 static void
@@ -232,6 +271,8 @@ _hwSensorClient_new( HwSensors*  sensors )
     cl->sensors     = sensors;
     cl->enabledMask = 0;
     cl->delay_ms    = 800;
+    cl->batchLen    = SENSORS_BATCH_HEADER_SIZE;
+    memcpy(cl->batchBuffer, "bsr1", 4);
     cl->timer       = timer_new(QEMU_CLOCK_VIRTUAL, SCALE_NS, _hwSensorClient_tick, cl);
 
     cl->next         = sensors->clients;
@@ -281,6 +322,100 @@ _hwSensorClient_enabled( HwSensorClient*  cl, int  sensorId )
     return (cl->enabledMask & (1 << sensorId)) != 0;
 }
 
+static uint8_t*
+_put_le16( uint8_t*  p, uint32_t  v )
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    return p + 2;
+}
+
+static uint8_t*
+_put_le32( uint8_t*  p, uint32_t  v )
+{
+    p = _put_le16(p, v);
+    return _put_le16(p, v >> 16);
+}
+
+static uint8_t*
+_put_le64( uint8_t*  p, uint64_t  v )
+{
+    p = _put_le32(p, (uint32_t)v);
+    return _put_le32(p, (uint32_t)(v >> 32));
+}
+
+static uint8_t*
+_put_float( uint8_t*  p, float  f )
+{
+    union { float f; uint32_t u; } v;
+    v.f = f;
+    return _put_le32(p, v.u);
+}
+
+/* send all queued batched reports */
+static void
+_hwSensorClient_flushBatch( HwSensorClient*  cl )
+{
+    if (cl->batchTicks == 0)
+        return;
+
+    _put_le16(cl->batchBuffer + 4, cl->batchTicks);
+    qemud_client_send(cl->client, cl->batchBuffer, cl->batchLen);
+    cl->batchTicks = 0;
+    cl->batchLen   = SENSORS_BATCH_HEADER_SIZE;
+}
+
+/* queue the batched report of the current tick, and send it unless the HAL
+ * module didn't read the previous ones yet */
+static void
+_hwSensorClient_sendBatch( HwSensorClient*  cl, int64_t  now_ns )
+{
+    HwSensors*  hw    = cl->sensors;
+    uint8_t*    p     = cl->batchBuffer + cl->batchLen;
+    uint8_t*    count = p + 8;
+    int         samples = 0;
+    int         nn;
+
+    p = _put_le64(p, now_ns / 1000);
+    p += 2;
+    for (nn = 0; nn < MAX_SENSORS; nn++) {
+        const SensorValues*  v = &hw->sensors[nn].u.value;
+        int  numValues = 3;
+
+        if (!_hwSensorClient_enabled(cl, nn))
+            continue;
+
+        if (nn == ANDROID_SENSOR_TEMPERATURE || nn == ANDROID_SENSOR_PROXIMITY)
+            numValues = 1;
+
+        p[0] = (uint8_t)nn;
+        p[1] = (uint8_t)numValues;
+        p[2] = p[3] = 0;
+        p = _put_float(p + 4, v->a);
+        p = _put_float(p, numValues > 1 ? v->b : 0.f);
+        p = _put_float(p, numValues > 2 ? v->c : 0.f);
+        samples++;
+    }
+    _put_le16(count, samples);
+    cl->batchLen = p - cl->batchBuffer;
+    cl->batchTicks++;
+
+    if (cl->batchTicks == SENSORS_BATCH_MAX_TICKS ||
+        qemud_client_get_pending_bytes(cl->client) == 0) {
+        _hwSensorClient_flushBatch(cl);
+    }
+}
+
+/* called when the HAL module has read all reports sent to it */
+static void
+_hwSensorClient_drain( void*  opaque )
+{
+    HwSensorClient*  cl = opaque;
+
+    if (cl->batch)
+        _hwSensorClient_flushBatch(cl);
+}
+
 /* this function is called periodically to send sensor reports
  * to the HAL module, and re-arm the timer if necessary
  */
@@ -295,6 +430,12 @@ _hwSensorClient_tick( void*  opaque )
     Sensor*          sensor;
     char             buffer[128];
 
+    if (cl->batch) {
+        now_ns = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+        _hwSensorClient_sendBatch(cl, now_ns);
+        goto REARM;
+    }
+
     if (_hwSensorClient_enabled(cl, ANDROID_SENSOR_ACCELERATION)) {
         sensor = &hw->sensors[ANDROID_SENSOR_ACCELERATION];
         snprintf(buffer, sizeof buffer, "acceleration:%g:%g:%g",
@@ -342,6 +483,7 @@ _hwSensorClient_tick( void*  opaque )
     snprintf(buffer, sizeof buffer, "sync:%" PRId64, now_ns/1000);
     _hwSensorClient_send(cl, (uint8_t*)buffer, strlen(buffer));
 
+REARM:
     /* rearm timer, use a minimum delay of 20 ms, just to
      * be safe.
      */
@@ -390,6 +532,19 @@ _hwSensorClient_receive( HwSensorClient*  cl, uint8_t*  msg, int  msglen )
         return;
     }
 
+    /* "set-batch:<flag>" is used to switch between batched binary
+     * reports and text reports.
+     */
+    if (msglen == 11 && !memcmp(msg, "set-batch:", 10)) {
+        int  batch = (msg[10] == '1');
+
+        _hwSensorClient_flushBatch(cl);
+        cl->batch = batch;
+        if (batch)
+            _hwSensorClient_send(cl, (const uint8_t*)"batch:1", 7);
+        return;
+    }
+
     /* "set-delay:<delay>" is used to set the delay in milliseconds
      * between sensor events
      */
@@ -491,8 +646,13 @@ _hwSensors_connect( void*  opaque,
                                                 _hwSensorClient_save,
                                                 _hwSensorClient_load );
     qemud_client_set_framing(client, 1);
+    qemud_client_set_drain_callback(client, _hwSensorClient_drain);
     cl->client = client;
 
+    /* The sensor service of the system server is the first client, once
+     * zygote started it. */
+    startupTrace_mark("guest system server");
+
     return client;
 }
 
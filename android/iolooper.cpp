@@ -39,8 +39,11 @@ void iolooper_reset(IoLooper*  iol) {
     asWaiter(iol)->reset();
 }
 
-void iolooper_modify(IoLooper* iol, int fd, int oldflags, int newflags) {
-    asWaiter(iol)->update(fd, toWaiterEvents(newflags));
+int iolooper_modify(IoLooper* iol, int fd, int oldflags, int newflags) {
+    SocketWaiter* waiter = asWaiter(iol);
+    unsigned events = toWaiterEvents(newflags);
+    waiter->update(fd, events);
+    return (waiter->wantedEventsFor(fd) == events) ? 0 : -1;
 }
 
 void iolooper_add_read(IoLooper* iol, int fd) {
@@ -83,6 +86,23 @@ int iolooper_has_operations(IoLooper* iol) {
     return asWaiter(iol)->hasFds();
 }
 
+int iolooper_next_pending(IoLooper* iol, int* flags) {
+    unsigned events = 0;
+    int fd = asWaiter(iol)->nextPendingFd(&events);
+    *flags = 0;
+    if (events & SocketWaiter::kEventRead) {
+        *flags |= IOLOOPER_READ;
+    }
+    if (events & SocketWaiter::kEventWrite) {
+        *flags |= IOLOOPER_WRITE;
+    }
+    return fd;
+}
+
+int iolooper_fd(IoLooper* iol) {
+    return asWaiter(iol)->fd();
+}
+
 int64_t iolooper_now(void) {
     struct timeval time_now;
     return gettimeofday(&time_now, NULL) ? -1 : (int64_t)time_now.tv_sec * 1000LL +
@@ -16,14 +16,15 @@
 #include "android/kernel/kernel_utils_testing.h"
 #include "android/utils/file_data.h"
 #include "android/utils/path.h"
+#include "android/utils/probe_cache.h"
 #include "android/utils/string.h"
-#include "android/utils/uncompress.h"
 
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <zlib.h>
 
 #define DEBUG_KERNEL  0
 
@@ -67,6 +68,107 @@ const void* memmem(const void* haystack, size_t haystackLen,
 }
 #endif
 
+namespace {
+
+// Copy the NUL-terminated string at |src| to |dst| like strlcpy(), without
+// reading more than |srcLen| bytes from |src|.
+void copyBoundedString(char* dst, size_t dstLen,
+                       const char* src, size_t srcLen) {
+    if (dstLen == 0) {
+        return;
+    }
+    const char* end = (const char*)memchr(src, 0, srcLen);
+    size_t len = end ? (size_t)(end - src) : srcLen;
+    if (len >= dstLen) {
+        len = dstLen - 1U;
+    }
+    memcpy(dst, src, len);
+    dst[len] = 0;
+}
+
+// Inflate the gzip stream at |compressed| chunk by chunk, looking for the
+// Linux version string as the data is produced, and stop as soon as it
+// has been found. Only a bounded window of the uncompressed data is kept
+// in memory. On success, copy the string to |dst| and return true.
+bool probeGzipKernelVersionString(const uint8_t* compressed,
+                                  size_t compressedLen,
+                                  char* dst,
+                                  size_t dstLen) {
+    // Longest version string that is returned, the strings of the
+    // prebuilt kernels are less than 200 bytes long.
+    const size_t kMaxVersionLen = 1024;
+    const size_t kChunkSize = 64 * 1024;
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    stream.next_in = (Bytef*)compressed;
+    stream.avail_in = compressedLen;
+
+    // magic number from gz_read
+    const int kGzipWindowBits = 15 + 16;
+    if (inflateInit2(&stream, kGzipWindowBits) != Z_OK) {
+        KERNEL_ERROR << "Could not initialize kernel decompression";
+        return false;
+    }
+
+    // |window| holds the bytes that may still be part of the version
+    // string, followed by the data of the current chunk.
+    PodVector<uint8_t> window;
+    window.resize(kMaxVersionLen + kChunkSize);
+    size_t windowLen = 0;
+    bool result = false;
+
+    for (;;) {
+        stream.next_out = window.begin() + windowLen;
+        stream.avail_out = kChunkSize;
+        int ret = inflate(&stream, Z_NO_FLUSH);
+        windowLen += kChunkSize - stream.avail_out;
+
+        // Z_BUF_ERROR means that no progress was possible, because the
+        // input was truncated.
+        bool done = (ret != Z_OK);
+        if (done && ret != Z_STREAM_END) {
+            KERNEL_ERROR << "Kernel decompression error";
+            // it may have been partially decompressed, so we're going to
+            // try to find the version string anyway
+        }
+
+        const uint8_t* start = (const uint8_t*)memmem(
+                window.begin(),
+                windowLen,
+                kLinuxVersionStringPrefix,
+                kLinuxVersionStringPrefixLen);
+        if (start) {
+            size_t len = window.begin() + windowLen - start;
+            if (done || len >= kMaxVersionLen || memchr(start, 0, len)) {
+                copyBoundedString(dst, dstLen, (const char*)start,
+                                  len < kMaxVersionLen ? len : kMaxVersionLen);
+                result = true;
+                break;
+            }
+            // Inflate more data to get the end of the string.
+            memmove(window.begin(), start, len);
+            windowLen = len;
+        } else if (done) {
+            break;
+        } else if (windowLen >= kLinuxVersionStringPrefixLen) {
+            // Keep the bytes that may be the start of a prefix cut by the
+            // end of the chunk.
+            size_t keep = kLinuxVersionStringPrefixLen - 1U;
+            memmove(window.begin(), window.begin() + windowLen - keep, keep);
+            windowLen = keep;
+        }
+    }
+
+    inflateEnd(&stream);
+    if (!result) {
+        KERNEL_ERROR << "Could not find 'Linux version ' in kernel!";
+    }
+    return result;
+}
+
+}  // namespace
+
 
 bool android_parseLinuxVersionString(const char* versionString,
                                      KernelVersion* kernelVersion) {
@@ -113,8 +215,6 @@ bool android_imageProbeKernelVersionString(const uint8_t* kernelFileData,
                                            size_t kernelFileSize,
                                            char* dst/*[dstLen]*/,
                                            size_t dstLen) {
-    PodVector<uint8_t> uncompressed;
-
     const uint8_t* uncompressedKernel = NULL;
     size_t uncompressedKernelLen = 0;
 
@@ -156,23 +256,10 @@ bool android_imageProbeKernelVersionString(const uint8_t* kernelFileData,
         if (!versionStringStart) {
             size_t compressedKernelLen = kernelFileSize -
                 (compressedKernel - kernelFileData);
-
-            // inflate ratios for all prebuilt kernels on 2014-07-14 is 1.9:1 ~
-            // 3.43:1 not sure how big the uncompressed size is, so make an
-            // absurdly large buffer
-            uncompressedKernelLen = compressedKernelLen * 10;
-            uncompressed.resize(uncompressedKernelLen);
-            uncompressedKernel = uncompressed.begin();
-
-            bool zOk = uncompress_gzipStream(uncompressed.begin(),
-                                            &uncompressedKernelLen,
-                                            compressedKernel,
-                                            compressedKernelLen);
-            if (!zOk) {
-                KERNEL_ERROR << "Kernel decompression error";
-                // it may have been partially decompressed, so we're going to
-                // try to find the version string anyway
-            }
+            return probeGzipKernelVersionString(compressedKernel,
+                                                compressedKernelLen,
+                                                dst,
+                                                dstLen);
         }
     }
 
@@ -197,14 +284,35 @@ bool android_imageProbeKernelVersionString(const uint8_t* kernelFileData,
 bool android_pathProbeKernelVersionString(const char* kernelPath,
                                           char* dst/*[dstLen]*/,
                                           size_t dstLen) {
+    // Probing requires reading the kernel image and uncompressing it until
+    // the version string, so cache the string across launches.
+    static const char kProbeKind[] = "kernel-version";
+    size_t cachedSize = 0;
+    char* cached = probeCache_load(kProbeKind, kernelPath, &cachedSize);
+    if (cached) {
+        KERNEL_LOG << "Cached kernel version: " << cached;
+        strlcpy(dst, cached, dstLen);
+        free(cached);
+        return true;
+    }
+
     FileData kernelFileData;
     if (fileData_initFromFile(&kernelFileData, kernelPath) < 0) {
         KERNEL_ERROR << "Could not open kernel file!";
         return false;
     }
 
-    return android_imageProbeKernelVersionString(kernelFileData.data,
-                                                 kernelFileData.size,
-                                                 dst,
-                                                 dstLen);
+    // Always store the complete string, whatever the size of |dst|.
+    char version[1024];
+    bool result = android_imageProbeKernelVersionString(kernelFileData.data,
+                                                        kernelFileData.size,
+                                                        version,
+                                                        sizeof(version));
+    fileData_done(&kernelFileData);
+    if (!result) {
+        return false;
+    }
+    probeCache_store(kProbeKind, kernelPath, version, strlen(version));
+    strlcpy(dst, version, dstLen);
+    return true;
 }
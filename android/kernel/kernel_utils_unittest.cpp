@@ -15,6 +15,8 @@
 
 #include <gtest/gtest.h>
 
+#include <string>
+
 namespace android {
 namespace kernel {
 
@@ -149,6 +151,62 @@ TEST(KernelUtils, ProbeKernelVersionString) {
     EXPECT_EQ(127, kernelVersionString[0]);
 }
 
+// Return a gzip stream holding |data| in deflate blocks that store it
+// without compression. The trailer is wrong, since the probe stops before
+// reading it.
+static std::string makeStoredGzipStream(const std::string& data) {
+    std::string stream("\x1f\x8b\x08\x00\0\0\0\0\0\x03", 10);
+    size_t pos = 0;
+    do {
+        size_t len = data.size() - pos;
+        if (len > 0xffff) {
+            len = 0xffff;
+        }
+        stream += (char)(pos + len == data.size() ? 1 : 0);
+        stream += (char)(len & 0xff);
+        stream += (char)(len >> 8);
+        stream += (char)(~len & 0xff);
+        stream += (char)((~len >> 8) & 0xff);
+        stream.append(data, pos, len);
+        pos += len;
+    } while (pos < data.size());
+    stream.append(8, '\0');
+    return stream;
+}
+
+TEST(KernelUtils, ProbeKernelVersionStringAcrossChunks) {
+    static const char kMockKernelVersion[] = "Linux version 3.10.0+ (a@b)";
+
+    // Kernel images whose version string is cut by the end of the first,
+    // then the second, 64 KiB of uncompressed data.
+    for (size_t n = 1; n <= 2; ++n) {
+        std::string data(n * 65536 - 5, 'x');
+        data += kMockKernelVersion;
+        data += '\0';
+        data.append(60000, 'y');
+        std::string kernel("0123456789");
+        kernel += makeStoredGzipStream(data);
+
+        char kernelVersionString[256];
+        kernelVersionString[0] = 0;
+        EXPECT_TRUE(android_imageProbeKernelVersionString(
+            (const uint8_t*)kernel.c_str(),
+            kernel.size(),
+            kernelVersionString,
+            sizeof(kernelVersionString)));
+        EXPECT_STREQ(kMockKernelVersion, kernelVersionString);
+
+        // The same image truncated before the version string.
+        kernelVersionString[0] = 127;
+        EXPECT_FALSE(android_imageProbeKernelVersionString(
+            (const uint8_t*)kernel.c_str(),
+            kernel.size() - 60000 - sizeof(kMockKernelVersion) - 8 - 5,
+            kernelVersionString,
+            sizeof(kernelVersionString)));
+        EXPECT_EQ(127, kernelVersionString[0]);
+    }
+}
+
 void ParseKernelVersionString(const char* versionString,
                               KernelVersion expectedVersion) {
     KernelVersion actualVersion;
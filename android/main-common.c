@@ -17,6 +17,7 @@
 #include "android/utils/eintr_wrapper.h"
 #include "android/utils/path.h"
 #include "android/utils/dirscanner.h"
+#include "android/utils/startup_trace.h"
 #include "android/utils/x86_cpuid.h"
 #include "android/cpu_accelerator.h"
 #include "android/main-common.h"
@@ -583,6 +584,20 @@ void handleCommonEmulatorOptions(AndroidOptions* opts,
         reassign_string(&hw->kernel_supportsYaffs2, newYaffs2Support);
     }
 
+    // Auto-detect the need for the legacy qemud serial port if needed.
+    if (androidHwConfig_getQemudLegacySerial(hw) < 0) {
+        // System images for API level 21 and above connect to all qemud
+        // services through goldfish pipes.
+        const char* legacySerial = "no";
+        if (avdInfo_getApiLevel(avd) < 21) {
+            legacySerial = "yes";
+            D("Auto-detect: Guest system requires legacy qemud serial port.");
+        } else {
+            D("Auto-detect: Guest system only uses qemud pipes.");
+        }
+        reassign_string(&hw->hw_qemud_legacySerial, legacySerial);
+    }
+
     /* opts->ramdisk is never NULL (see createAVD) here */
     if (opts->ramdisk) {
         reassign_string(&hw->disk_ramdisk_path, opts->ramdisk);
@@ -975,7 +990,11 @@ bool handleCpuAcceleration(AndroidOptions* opts, AvdInfo* avd,
         }
     }
 
+    if (opts->accel_reprobe) {
+        android_forceCpuAccelerationReprobe();
+    }
     bool accel_ok = android_hasCpuAcceleration(&accel_status);
+    startupTrace_mark("accelerator probed");
     // Dump CPU acceleration status.
     if (VERBOSE_CHECK(init)) {
         const char* accel_str = "DISABLED";
@@ -28,6 +28,7 @@
 #include <android/utils/host_bitness.h>
 #include <android/utils/panic.h>
 #include <android/utils/path.h>
+#include <android/utils/startup_trace.h>
 #include <android/utils/bufprint.h>
 #include <android/utils/win32_cmdline_quote.h>
 #include <android/opengl/emugl_config.h>
@@ -85,10 +86,14 @@ int main(int argc, char** argv)
 {
     const char* avdName = NULL;
     char*       avdArch = NULL;
+    char*       gpuMode = NULL;
     const char* gpu = NULL;
     char*       emulatorPath;
     int         force_32bit = 0;
     bool        no_window = false;
+    bool        startup_trace = false;
+
+    startupTrace_mark("launcher start");
 
     /* Define ANDROID_EMULATOR_DEBUG to 1 in your environment if you want to
      * see the debug messages from this launcher program.
@@ -139,6 +144,11 @@ int main(int argc, char** argv)
             continue;
         }
 
+        if (!strcmp(opt,"-startup-trace")) {
+            startup_trace = true;
+            continue;
+        }
+
         if (!strcmp(opt,"-list-avds")) {
             AvdScanner* scanner = avdScanner_new(NULL);
             for (;;) {
@@ -195,11 +205,11 @@ int main(int argc, char** argv)
 #endif
 
     /* If there is an AVD name, we're going to extract its target architecture
-     * by looking at its config.ini
+     * and GPU mode by looking at its config.ini
      */
     if (avdName != NULL) {
         D("Found AVD name '%s'\n", avdName);
-        avdArch = path_getAvdTargetArch(avdName);
+        path_getAvdLaunchConfig(avdName, &avdArch, &gpuMode);
         D("Found AVD target architecture: %s\n", avdArch);
     } else {
         /* Otherwise, using the ANDROID_PRODUCT_OUT directory */
@@ -245,13 +255,7 @@ int main(int argc, char** argv)
     /* We need to find the location of the GLES emulation shared libraries
      * and modify either LD_LIBRARY_PATH or PATH accordingly
      */
-    bool gpuEnabled = false;
-    const char* gpuMode = NULL;
-
-    if (avdName) {
-        gpuMode = path_getAvdGpuMode(avdName);
-        gpuEnabled = (gpuMode != NULL);
-    }
+    bool gpuEnabled = (gpuMode != NULL);
 
     EmuglConfig config;
     int bitness = is_64bit ? 64 : 32;
@@ -301,6 +305,12 @@ int main(int argc, char** argv)
         printf("\n");
     }
 
+    // Pass the launcher's share of the startup timeline to the engine.
+    if (startup_trace) {
+        startupTrace_mark("launcher exec");
+        startupTrace_exportToEnv();
+    }
+
     // Launch it with the same set of options !
     // Note that on Windows, the first argument must _not_ be quoted or
     // Windows will fail to find the program.
@@ -38,6 +38,7 @@
 
 #include "math.h"
 
+#include "android/camera/camera-virtual-scene.h"
 #include "android/config/config.h"
 
 #include "android/kernel/kernel_utils.h"
@@ -45,12 +46,14 @@
 #include "android/user-config.h"
 
 #include "android/utils/aconfig-file.h"
+#include "android/utils/async_log.h"
 #include "android/utils/bufprint.h"
 #include "android/utils/debug.h"
 #include "android/utils/filelock.h"
 #include "android/utils/lineinput.h"
 #include "android/utils/path.h"
 #include "android/utils/property_file.h"
+#include "android/utils/startup_trace.h"
 #include "android/utils/tempfile.h"
 
 #include "android/main-common.h"
@@ -193,12 +196,29 @@ int main(int argc, char **argv) {
     char boot_prop_ip[64];
     boot_prop_ip[0] = '\0';
 
+    startupTrace_mark("engine start");
+
     args[0] = argv[0];
 
     if ( android_parse_options( &argc, &argv, opts ) < 0 ) {
         exit(1);
     }
 
+    if (opts->startup_trace) {
+        startupTrace_init(opts->startup_trace);
+    }
+
+    /* A boot benchmark measures a cold boot, without a window. */
+    if (opts->benchmark_boot) {
+        opts->no_window = 1;
+        opts->no_snapshot_load = 1;
+    }
+
+    /* Verbose debug output can be heavy, so write it from a separate
+     * thread instead of blocking the vCPU and render threads on it. */
+    if (android_verbose)
+        async_log_start();
+
 #ifdef _WIN32
     socket_init();
 #endif
@@ -366,6 +386,7 @@ int main(int argc, char **argv) {
         derror("could not read hardware configuration ?");
         exit(1);
     }
+    startupTrace_mark("config parsed");
 
     SkinKeyset* keyset = NULL;
     if (opts->keyset) {
@@ -410,6 +431,7 @@ int main(int argc, char **argv) {
     user_config_init();
     parse_skin_files(opts->skindir, opts->skin, opts, hw,
                      &skinConfig, &skinPath);
+    startupTrace_mark("skin loaded");
 
     if (!opts->netspeed && skin_network_speed) {
         D("skin network speed: '%s'", skin_network_speed);
@@ -583,6 +605,11 @@ int main(int argc, char **argv) {
         if (opts->no_snapshot_update_time) {
             args[n++] = "-snapshot-no-time-update";
         }
+
+        if (opts->snapshot_compress) {
+            args[n++] = "-snapshot-compress";
+            args[n++] = opts->snapshot_compress;
+        }
     }
 
     if (!opts->logcat || opts->logcat[0] == 0) {
@@ -655,6 +682,28 @@ int main(int argc, char **argv) {
     if (opts->code_profile) {
         args[n++] = "-code-profile";
         args[n++] = opts->code_profile;
+        if (opts->code_profile_rate) {
+            args[n++] = "-code-profile-rate";
+            args[n++] = opts->code_profile_rate;
+        }
+    } else if (opts->code_profile_rate) {
+        derror("-code-profile-rate requires -code-profile");
+        exit(1);
+    }
+
+    if (opts->gpu_record) {
+        args[n++] = "-gpu-record";
+        args[n++] = opts->gpu_record;
+    }
+
+    if (opts->perf_stats) {
+        args[n++] = "-perf-stats";
+        args[n++] = opts->perf_stats;
+    }
+
+    if (opts->benchmark_boot) {
+        args[n++] = "-benchmark-boot";
+        args[n++] = opts->benchmark_boot;
     }
 
     /* Pass boot properties to the core. First, those from boot.prop,
@@ -822,9 +871,11 @@ int main(int argc, char **argv) {
         /* Validate parameter. */
         if (memcmp(opts->camera_back, "webcam", 6) &&
             strcmp(opts->camera_back, "emulated") &&
+            strcmp(opts->camera_back, CAMERA_VIRTUAL_SCENE_NAME) &&
             strcmp(opts->camera_back, "none")) {
             derror("Invalid value for -camera-back <mode> parameter: %s\n"
-                   "Valid values are: 'emulated', 'webcam<N>', or 'none'\n",
+                   "Valid values are: 'emulated', 'webcam<N>', '"
+                   CAMERA_VIRTUAL_SCENE_NAME "', or 'none'\n",
                    opts->camera_back);
             exit(1);
         }
@@ -835,9 +886,11 @@ int main(int argc, char **argv) {
         /* Validate parameter. */
         if (memcmp(opts->camera_front, "webcam", 6) &&
             strcmp(opts->camera_front, "emulated") &&
+            strcmp(opts->camera_front, CAMERA_VIRTUAL_SCENE_NAME) &&
             strcmp(opts->camera_front, "none")) {
             derror("Invalid value for -camera-front <mode> parameter: %s\n"
-                   "Valid values are: 'emulated', 'webcam<N>', or 'none'\n",
+                   "Valid values are: 'emulated', 'webcam<N>', '"
+                   CAMERA_VIRTUAL_SCENE_NAME "', or 'none'\n",
                    opts->camera_front);
             exit(1);
         }
@@ -0,0 +1,123 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#include "android/mem-stats.h"
+
+#include "android/opengles.h"
+#include "android/utils/mem_categories.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#include <sys/resource.h>
+#else
+#include <sys/resource.h>
+#endif
+
+typedef struct {
+    stralloc_t*  out;
+    int64_t      total;
+} ReportState;
+
+static void
+mem_stats_report_line(stralloc_t* out, const char* name,
+                      long long live_kb, long long peak_kb)
+{
+    if (peak_kb < 0)
+        stralloc_add_format(out, "%-32s %12lld KB\n", name, live_kb);
+    else
+        stralloc_add_format(out, "%-32s %12lld KB %12lld KB peak\n",
+                            name, live_kb, peak_kb);
+}
+
+static void
+mem_stats_report_category(void* opaque, const MemCategory* category)
+{
+    ReportState*  state = opaque;
+    int64_t       live = memCategory_live(category);
+
+    state->total += live;
+    mem_stats_report_line(state->out, category->name, live / 1024,
+                          memCategory_peak(category) / 1024);
+}
+
+/* Get the current and peak resident sizes of the process in KB, set to
+ * -1 when unknown. */
+static void
+mem_stats_get_rss(long long* rss_kb, long long* peak_kb)
+{
+    *rss_kb = -1;
+    *peak_kb = -1;
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS  counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters,
+                             sizeof(counters))) {
+        *rss_kb = counters.WorkingSetSize / 1024;
+        *peak_kb = counters.PeakWorkingSetSize / 1024;
+    }
+#elif defined(__APPLE__)
+    struct mach_task_basic_info  info;
+    mach_msg_type_number_t       count = MACH_TASK_BASIC_INFO_COUNT;
+    struct rusage                usage;
+
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO,
+                  (task_info_t)&info, &count) == KERN_SUCCESS)
+        *rss_kb = info.resident_size / 1024;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+        *peak_kb = usage.ru_maxrss / 1024;  /* bytes on OS X */
+#else
+    FILE*  f = fopen("/proc/self/status", "r");
+    char   line[128];
+
+    if (f) {
+        while (fgets(line, sizeof(line), f)) {
+            if (!strncmp(line, "VmRSS:", 6))
+                *rss_kb = strtoll(line + 6, NULL, 10);
+            else if (!strncmp(line, "VmHWM:", 6))
+                *peak_kb = strtoll(line + 6, NULL, 10);
+        }
+        fclose(f);
+    } else {
+        struct rusage  usage;
+        if (getrusage(RUSAGE_SELF, &usage) == 0)
+            *peak_kb = usage.ru_maxrss;
+    }
+#endif
+}
+
+void
+android_mem_stats_report(stralloc_t* out)
+{
+    ReportState  state;
+    int64_t      readback = android_getOpenglesReadbackMemory();
+    long long    rss_kb, peak_kb;
+
+    state.out = out;
+    state.total = 0;
+    memCategories_forEach(mem_stats_report_category, &state);
+
+    if (readback > 0) {
+        state.total += readback;
+        mem_stats_report_line(out, "gpu.readback_image", readback / 1024, -1);
+    }
+    mem_stats_report_line(out, "total accounted", state.total / 1024, -1);
+
+    mem_stats_get_rss(&rss_kb, &peak_kb);
+    if (rss_kb >= 0 || peak_kb >= 0)
+        mem_stats_report_line(out, "process resident",
+                              rss_kb >= 0 ? rss_kb : 0, peak_kb);
+}
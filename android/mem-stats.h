@@ -0,0 +1,30 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#ifndef ANDROID_MEM_STATS_H
+#define ANDROID_MEM_STATS_H
+
+#include "android/utils/compiler.h"
+#include "android/utils/stralloc.h"
+
+ANDROID_BEGIN_HEADER
+
+/* Reports of the memory categories of android/utils/mem_categories.h */
+
+/* Append to |out| a line per memory category with its live and peak
+ * sizes, a line for the frames read back by the GPU emulation, and the
+ * current and peak resident sizes of the process when known, to compare
+ * them with the accounted total. */
+void android_mem_stats_report(stralloc_t* out);
+
+ANDROID_END_HEADER
+
+#endif  /* ANDROID_MEM_STATS_H */
@@ -45,6 +45,10 @@
 /* Timeout (millisec) to use when communicating with SDK controller. */
 #define SDKCTL_MT_TIMEOUT      3000
 
+/* Minimum number of unchanged lines between two bands of changed lines for
+ * them to be sent in separate framebuffer updates. */
+#define MTFB_BAND_GAP          32
+
 /*
  * Message types used in multi-touch emulation.
  */
@@ -76,6 +80,13 @@ struct AndroidMTSPort {
     AJPEGDesc*          jpeg_compressor;
     /* Direct packet descriptor for framebuffer updates. */
     SDKCtlDirectPacket* fb_packet;
+    /* Copy of the framebuffer as of the last update sent to the device, with
+     * lines in top-down order, or NULL if there is none. */
+    uint8_t*            shadow_fb;
+    /* Size of the framebuffer lines in 'shadow_fb'. */
+    int                 shadow_bpl;
+    /* Number of lines in 'shadow_fb'. */
+    int                 shadow_height;
 };
 
 /* Data sent with SDKCTL_MT_QUERY_START */
@@ -118,6 +129,7 @@ _mts_port_free(AndroidMTSPort* mtsp)
         if (mtsp->sdkctl != NULL) {
             sdkctl_socket_release(mtsp->sdkctl);
         }
+        AFREE(mtsp->shadow_fb);
         AFREE(mtsp);
     }
 }
@@ -247,6 +259,8 @@ _on_multitouch_port_connection(void* opaque,
                                SDKCtlSocket* sdkctl,
                                SdkCtlPortStatus status)
 {
+    AndroidMTSPort* const mtsp = (AndroidMTSPort*)opaque;
+
     switch (status) {
         case SDKCTL_PORT_CONNECTED:
             D("Multi-touch: SDK Controller is connected");
@@ -262,6 +276,9 @@ _on_multitouch_port_connection(void* opaque,
 
         case SDKCTL_PORT_ENABLED:
             D("Multi-touch: SDK Controller port is enabled.");
+            /* The device screen must be sent in full again. */
+            AFREE(mtsp->shadow_fb);
+            mtsp->shadow_fb = NULL;
             // Enable OpenGLES framebuffer updates.
             if (android_hw->hw_gpu_enabled) {
                 android_setPostCallback(multitouch_opengles_fb_update, NULL);
@@ -424,6 +441,126 @@ _fb_compress(const AndroidMTSPort* mtsp,
                                 fb, jpeg_quality, ydir);
 }
 
+/* Returns the address of a line in the framebuffer.
+ * Param:
+ *  fmt Descriptor for the framebuffer.
+ *  fb Beginning of the framebuffer.
+ *  y Index of the line, counted from the top of the display.
+ *  ydir Direction in which lines are arranged in the framebuffer.
+ */
+static const uint8_t*
+_fb_line(const MTFrameHeader* fmt, const uint8_t* fb, int y, int ydir)
+{
+    if (ydir < 0) {
+        y = fmt->disp_height - y - 1;
+    }
+    return fb + y * fmt->bpl;
+}
+
+/* Shrinks the updated region of a framebuffer to the pixels that differ from
+ * the last update sent to the device, and saves them in the shadow
+ * framebuffer.
+ * When the changes are separated by more than MTFB_BAND_GAP unchanged lines,
+ * only the first band of changed lines is selected, so that small distant
+ * changes are not sent as one large region. The rest is left for later
+ * updates.
+ * Param:
+ *  mtsp - Multi-touch port descriptor.
+ *  fmt Descriptor for framebuffer region to send. Updated on exit.
+ *  fb Beginning of the framebuffer.
+ *  ydir Direction in which lines are arranged in the framebuffer.
+ *  rest Receives the region starting at the next band of changed lines, or
+ *      an empty region.
+ * Return:
+ *  Boolean: 1 if there is something to send, or 0 if the region is unchanged.
+ */
+static int
+_fb_trim_update(AndroidMTSPort* mtsp,
+                MTFrameHeader* fmt,
+                const uint8_t* fb,
+                int ydir,
+                MTFrameHeader* rest)
+{
+    const int bpp = fmt->bpp;
+    const int row_size = fmt->w * bpp;
+    const int x_shift = fmt->x * bpp;
+    const int end = fmt->y + fmt->h;
+    int top = -1, bottom = -1;
+    int left = row_size, right = 0;
+    int y;
+
+    rest->x = rest->y = rest->w = rest->h = 0;
+
+    if (mtsp->shadow_fb == NULL || mtsp->shadow_bpl != fmt->bpl ||
+        mtsp->shadow_height != fmt->disp_height) {
+        /* Nothing to compare with, send the update as is. */
+        AFREE(mtsp->shadow_fb);
+        mtsp->shadow_bpl = fmt->bpl;
+        mtsp->shadow_height = fmt->disp_height;
+        mtsp->shadow_fb = malloc(fmt->bpl * fmt->disp_height);
+        if (mtsp->shadow_fb == NULL) {
+            APANIC("Multi-touch: Unable to allocate %d bytes shadow framebuffer",
+                   fmt->bpl * fmt->disp_height);
+        }
+        for (y = 0; y < fmt->disp_height; y++) {
+            memcpy(mtsp->shadow_fb + y * fmt->bpl, _fb_line(fmt, fb, y, ydir),
+                   fmt->bpl);
+        }
+        return 1;
+    }
+
+    for (y = fmt->y; y < end; y++) {
+        const uint8_t* const line = _fb_line(fmt, fb, y, ydir) + x_shift;
+        const uint8_t* const shadow = mtsp->shadow_fb + y * fmt->bpl + x_shift;
+        int first, last;
+
+        if (!memcmp(line, shadow, row_size)) {
+            continue;
+        }
+        if (bottom >= 0 && y - bottom > MTFB_BAND_GAP) {
+            /* Start of another band, leave it for later. */
+            *rest = *fmt;
+            rest->y = y;
+            rest->h = end - y;
+            break;
+        }
+        for (first = 0; line[first] == shadow[first]; first++) {
+        }
+        for (last = row_size - 1; line[last] == shadow[last]; last--) {
+        }
+        if (top < 0) {
+            top = y;
+        }
+        bottom = y;
+        if (left > first) {
+            left = first;
+        }
+        if (right < last + 1) {
+            right = last + 1;
+        }
+    }
+
+    if (top < 0) {
+        return 0;
+    }
+
+    /* Convert byte offsets to pixels. */
+    left /= bpp;
+    right = (right + bpp - 1) / bpp;
+
+    fmt->x += left;
+    fmt->w = right - left;
+    fmt->y = top;
+    fmt->h = bottom - top + 1;
+
+    /* Save the lines that are going to be sent. */
+    for (y = top; y <= bottom; y++) {
+        memcpy(mtsp->shadow_fb + y * fmt->bpl + fmt->x * bpp,
+               _fb_line(fmt, fb, y, ydir) + fmt->x * bpp, fmt->w * bpp);
+    }
+    return 1;
+}
+
 int
 mts_port_send_frame(AndroidMTSPort* mtsp,
                     MTFrameHeader* fmt,
@@ -437,6 +574,14 @@ mts_port_send_frame(AndroidMTSPort* mtsp,
         return -1;
     }
 
+    /* Only send the pixels that have changed since the last update. */
+    MTFrameHeader rest;
+    if (!_fb_trim_update(mtsp, fmt, fb, ydir, &rest)) {
+        T("Multi-touch: Skipping unchanged framebuffer update");
+        fmt->x = fmt->y = fmt->w = fmt->h = 0;
+        return 1;
+    }
+
     /* Compress framebuffer region. 10% quality seems to be sufficient. */
     fmt->format = MTFB_JPEG;
     _fb_compress(mtsp, fmt, fb, 10, ydir);
@@ -458,9 +603,12 @@ mts_port_send_frame(AndroidMTSPort* mtsp,
     /* Compression rate... */
     const float comp_rate = ((float)jpeg_compressor_get_jpeg_size(mtsp->jpeg_compressor) / (fmt->w * fmt->h * fmt->bpp)) * 100;
 
-    /* Zeroing the rectangle in the update header we indicate that it contains
-     * no updates. */
-    fmt->x = fmt->y = fmt->w = fmt->h = 0;
+    /* Leave the part of the region that hasn't been sent in the update header.
+     * Zeroing the rectangle we indicate that it contains no updates. */
+    fmt->x = rest.x;
+    fmt->y = rest.y;
+    fmt->w = rest.w;
+    fmt->h = rest.h;
 
     /* Send update to the device. */
     sdkctl_direct_packet_send(mtsp->fb_packet, msg, cb, cb_opaque);
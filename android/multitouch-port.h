@@ -98,8 +98,13 @@ extern void mts_port_destroy(AndroidMTSPort* amtp);
  *  ydir - Indicates direction in which lines are arranged in the framebuffer. If
  *      this value is negative, lines are arranged in bottom-up format (i.e. the
  *      bottom line is at the beginning of the buffer).
+ * Only the pixels of the region that have changed since the previous update
+ * are sent. When the changes are far apart, only the first band of changed
+ * lines is sent, and the region in 'fmt' is set to the part that remains to
+ * be sent. Otherwise it is zeroed, including when the region contains no
+ * changes, in which case 'cb' is not invoked.
  * Return:
- *  0 on success, or != 0 on failure.
+ *  0 on success, or != 0 if nothing has been sent.
  */
 extern int mts_port_send_frame(AndroidMTSPort* mtsp,
                                MTFrameHeader* fmt,
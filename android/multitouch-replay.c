@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "android/multitouch-replay.h"
+
+#include "android/multitouch-screen.h"
+#include "android/utils/debug.h"
+#include "android/utils/path.h"
+#include "android/utils/system.h"
+
+#include "qemu-common.h"
+#include "qemu/timer.h"
+
+#define  D(...)    VERBOSE_PRINT(mtscreen,__VA_ARGS__)
+
+#define MTR_MAGIC           "MTR1"
+#define MTR_HEADER_SIZE     4
+#define MTR_RECORD_SIZE     12
+
+/* Maximum number of pointers tracked to release them on stop. */
+#define MTR_MAX_POINTERS    16
+
+/* A decoded trace record. */
+typedef struct MTRRecord {
+    /* Offset from the start of the replay, in nanoseconds. */
+    int64_t     time_ns;
+    int         tracking_id;
+    int         x;
+    int         y;
+    int         pressure;
+} MTRRecord;
+
+/* Replay state. */
+typedef struct MTRState {
+    MTRRecord*  records;
+    int         count;
+    /* Index of the next record to inject. */
+    int         next;
+    /* Virtual clock time at the start of the replay. */
+    int64_t     start_ns;
+    QEMUTimer*  timer;
+    /* Tracking IDs of the pointers that are currently down. */
+    int         down_ids[MTR_MAX_POINTERS];
+    int         down_count;
+} MTRState;
+
+static MTRState _MTRState;
+
+static uint32_t
+_get_le16(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t
+_get_le32(const uint8_t* p)
+{
+    return _get_le16(p) | (_get_le16(p + 2) << 16);
+}
+
+/* Keeps track of the pointers that are down. */
+static void
+_mtr_track_pointer(MTRState* mtr, int tracking_id, int pressure)
+{
+    int nn;
+
+    for (nn = 0; nn < mtr->down_count; nn++) {
+        if (mtr->down_ids[nn] == tracking_id) {
+            if (pressure == 0) {
+                mtr->down_ids[nn] = mtr->down_ids[--mtr->down_count];
+            }
+            return;
+        }
+    }
+    if (pressure != 0 && mtr->down_count < MTR_MAX_POINTERS) {
+        mtr->down_ids[mtr->down_count++] = tracking_id;
+    }
+}
+
+static void
+_mtr_free_records(MTRState* mtr)
+{
+    AFREE(mtr->records);
+    mtr->records = NULL;
+    mtr->count = 0;
+    mtr->next = 0;
+}
+
+/* Injects all records that are due, and re-arms the timer for the next one. */
+static void
+_mtr_tick(void* opaque)
+{
+    MTRState* const mtr = opaque;
+    const int64_t now_ns = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+
+    while (mtr->next < mtr->count) {
+        const MTRRecord* rec = &mtr->records[mtr->next];
+        if (mtr->start_ns + rec->time_ns > now_ns) {
+            /* Deadlines are computed from the start time, so that timer
+             * latency doesn't accumulate over the trace. */
+            timer_mod(mtr->timer, mtr->start_ns + rec->time_ns);
+            return;
+        }
+        _mtr_track_pointer(mtr, rec->tracking_id, rec->pressure);
+        multitouch_update_pointer(MTES_DEVICE, rec->tracking_id,
+                                  rec->x, rec->y, rec->pressure);
+        mtr->next++;
+    }
+
+    D("Multi-touch replay completed: %d records", mtr->count);
+    _mtr_free_records(mtr);
+}
+
+int
+multitouch_replay_start(const char* path)
+{
+    MTRState* const mtr = &_MTRState;
+    size_t size = 0;
+    uint8_t* data = path_load_file(path, &size);
+    int64_t time_ns = 0;
+    int count, nn;
+
+    if (data == NULL) {
+        return -1;
+    }
+    if (size < MTR_HEADER_SIZE || memcmp(data, MTR_MAGIC, MTR_HEADER_SIZE) ||
+        (size - MTR_HEADER_SIZE) % MTR_RECORD_SIZE != 0) {
+        free(data);
+        return -2;
+    }
+
+    multitouch_replay_stop();
+
+    count = (size - MTR_HEADER_SIZE) / MTR_RECORD_SIZE;
+    if (count > 0) {
+        AARRAY_NEW(mtr->records, count);
+    }
+    for (nn = 0; nn < count; nn++) {
+        const uint8_t* p = data + MTR_HEADER_SIZE + nn * MTR_RECORD_SIZE;
+        MTRRecord* rec = &mtr->records[nn];
+
+        time_ns += (int64_t)_get_le32(p) * 1000;
+        rec->time_ns = time_ns;
+        rec->tracking_id = (int16_t)_get_le16(p + 4);
+        rec->x = _get_le16(p + 6);
+        rec->y = _get_le16(p + 8);
+        rec->pressure = _get_le16(p + 10);
+    }
+    free(data);
+
+    mtr->count = count;
+    mtr->next = 0;
+    if (mtr->timer == NULL) {
+        mtr->timer = timer_new(QEMU_CLOCK_VIRTUAL, SCALE_NS, _mtr_tick, mtr);
+    }
+    mtr->start_ns = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    D("Starting multi-touch replay of '%s': %d records", path, count);
+    _mtr_tick(mtr);
+
+    return 0;
+}
+
+void
+multitouch_replay_stop(void)
+{
+    MTRState* const mtr = &_MTRState;
+
+    if (mtr->timer != NULL) {
+        timer_del(mtr->timer);
+    }
+    _mtr_free_records(mtr);
+
+    /* Release the pointers that are still down. */
+    while (mtr->down_count > 0) {
+        const int tracking_id = mtr->down_ids[--mtr->down_count];
+        multitouch_update_pointer(MTES_DEVICE, tracking_id, 0, 0, 0);
+    }
+}
+
+int
+multitouch_replay_get_pending(void)
+{
+    MTRState* const mtr = &_MTRState;
+
+    return mtr->count - mtr->next;
+}
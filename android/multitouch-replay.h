@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_MULTITOUCH_REPLAY_H_
+#define ANDROID_MULTITOUCH_REPLAY_H_
+
+/*
+ * Replays a recorded multi-touch gesture trace through the multi-touch screen
+ * emulation. Events are injected from a virtual clock timer, at their recorded
+ * offsets from the start of the replay, so the guest sees the same timing on
+ * every run, however busy the host is.
+ *
+ * A trace file is made of a 4-byte "MTR1" magic header, followed by 12-byte
+ * records, all values being little-endian:
+ *
+ *      uint32  delay_us     Delay since the previous record, in microseconds.
+ *      int16   tracking_id  Pointer tracking ID.
+ *      uint16  x            X coordinate of the pointer.
+ *      uint16  y            Y coordinate of the pointer.
+ *      uint16  pressure     Pointer pressure, 0 for a "pointer up" event.
+ *
+ * The first record of a pointer with a non-zero pressure is a "pointer down",
+ * the following ones are "pointer move" events, until a record with a zero
+ * pressure.
+ */
+
+/* Starts replaying the trace in file 'path'. A replay in progress is stopped.
+ * Return:
+ *  0 on success, -1 if the file can't be read (errno is set), or -2 if it is
+ *  not a valid trace file.
+ */
+extern int multitouch_replay_start(const char* path);
+
+/* Stops the replay in progress, if any. Pointers that are still down are
+ * released. */
+extern void multitouch_replay_stop(void);
+
+/* Returns the number of trace records that are still to be injected, 0 if
+ * there is no replay in progress. */
+extern int multitouch_replay_get_pending(void);
+
+#endif  /* ANDROID_MULTITOUCH_REPLAY_H_ */
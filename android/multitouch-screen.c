@@ -354,7 +354,9 @@ void
 multitouch_opengles_fb_update(void* context,
                               int w, int h, int ydir,
                               int format, int type,
-                              unsigned char* pixels)
+                              unsigned char* pixels,
+                              int damageX, int damageY,
+                              int damageWidth, int damageHeight)
 {
     MTSState* const mts_state = &_MTSState;
 
@@ -363,7 +365,15 @@ multitouch_opengles_fb_update(void* context,
         return;
     }
 
-    T("Multi-touch: openGLES framebuffer update: 0:0 -> %dx%d", w, h);
+    /* The damage rectangle uses row indices in |pixels|, while the
+     * rectangles passed to _mt_fb_common_update() have a top-left origin. */
+    int y = damageY;
+    if (ydir < 0) {
+        y = h - damageY - damageHeight;
+    }
+
+    T("Multi-touch: openGLES framebuffer update: %d:%d -> %dx%d",
+      damageX, y, damageWidth, damageHeight);
 
     /* GLES format is always RGBA8888 */
     mts_state->fb_header.bpp = 4;
@@ -373,8 +383,7 @@ multitouch_opengles_fb_update(void* context,
     mts_state->current_fb = pixels;
     mts_state->ydir = ydir;
 
-    /* GLES emulator alwas update the entire framebuffer. */
-    _mt_fb_common_update(mts_state, 0, 0, w, h);
+    _mt_fb_common_update(mts_state, damageX, y, damageWidth, damageHeight);
 }
 
 void
@@ -18,6 +18,10 @@
 #include "android/base/misc/StringUtils.h"
 
 #include "android/utils/path.h"
+#include "android/utils/probe_cache.h"
+
+#include <stdlib.h>
+#include <string.h>
 
 namespace android {
 namespace opengl {
@@ -42,6 +46,27 @@ StringVector EmuglBackendScanner::scanDir(const char* execDir,
     const char* subdir = (hostBitness == 64) ? "lib64" : "lib";
     String subDir = StringFormat("%s/%s/", execDir, subdir);
 
+    // The list only changes when entries are added to or removed from the
+    // directory, which changes its modification time, so it is cached
+    // across launches as the names separated by newlines.
+    static const char kProbeKind[] = "gles-backends";
+    String cacheKey = StringFormat("%s/%s", execDir, subdir);
+    size_t cachedSize = 0;
+    char* cached = probeCache_load(kProbeKind, cacheKey.c_str(), &cachedSize);
+    if (cached) {
+        const char* name = cached;
+        while (*name) {
+            const char* end = strchr(name, '\n');
+            if (!end) {
+                end = name + strlen(name);
+            }
+            names.push_back(String(name, end - name));
+            name = *end ? end + 1 : end;
+        }
+        free(cached);
+        return names;
+    }
+
     StringVector entries = System::get()->scanDirEntries(subDir.c_str());
 
     static const char kBackendPrefix[] = "gles_";
@@ -65,6 +90,16 @@ StringVector EmuglBackendScanner::scanDir(const char* execDir,
     // Need to sort the backends in consistent order.
     sortStringVector(&names);
 
+    String cachedNames;
+    for (size_t n = 0; n < names.size(); ++n) {
+        if (n > 0) {
+            cachedNames += '\n';
+        }
+        cachedNames += names[n];
+    }
+    probeCache_store(kProbeKind, cacheKey.c_str(),
+                     cachedNames.c_str(), cachedNames.size());
+
     return names;
 }
 
@@ -18,7 +18,8 @@
 #include "android/base/Log.h"
 #include "android/base/synchronization/Lock.h"
 #include "android/base/sockets/SocketUtils.h"
-#include "android/base/synchronization/MessageChannel.h"
+
+#include <algorithm>
 
 #include <stdlib.h>
 #include <string.h>
@@ -30,41 +31,122 @@
 namespace android {
 namespace opengl {
 
+using android::base::AutoLock;
+using android::base::Lock;
 using android::base::Looper;
-using android::base::MessageChannel;
 
 namespace {
 
-// A small structure to model a single frame of the GPU display,
-// as passed between the EmuGL and main loop thread.
+// A rectangle of damaged pixels, empty unless |width| and |height| are
+// positive.
+struct DamageRect {
+    int x;
+    int y;
+    int width;
+    int height;
+
+    DamageRect() : x(0), y(0), width(0), height(0) {}
+
+    DamageRect(int x, int y, int width, int height) :
+            x(x), y(y), width(width), height(height) {}
+
+    bool empty() const { return width <= 0 || height <= 0; }
+
+    // Grow the rectangle to the bounding box of itself and |other|.
+    void add(const DamageRect& other) {
+        if (other.empty()) {
+            return;
+        }
+        if (empty()) {
+            *this = other;
+            return;
+        }
+        int x0 = std::min(x, other.x);
+        int y0 = std::min(y, other.y);
+        int x1 = std::max(x + width, other.x + other.width);
+        int y1 = std::max(y + height, other.y + other.height);
+        x = x0;
+        y = y0;
+        width = x1 - x0;
+        height = y1 - y0;
+    }
+
+    // Restrict the rectangle to a frame of |w| x |h| pixels.
+    void clip(int w, int h) {
+        int x0 = std::max(x, 0);
+        int y0 = std::max(y, 0);
+        int x1 = std::min(x + width, w);
+        int y1 = std::min(y + height, h);
+        if (x1 <= x0 || y1 <= y0) {
+            *this = DamageRect();
+            return;
+        }
+        x = x0;
+        y = y0;
+        width = x1 - x0;
+        height = y1 - y0;
+    }
+};
+
+// A single frame of the GPU display, as passed between the EmuGL and main
+// loop thread. Instances are reused, and |pixels| only grows.
 struct Frame {
     int width;
     int height;
+    DamageRect damage;
     void* pixels;
+    size_t capacity;
 
-    Frame(int w, int h, const void* pixels) :
-            width(w), height(h), pixels(NULL) {
-        this->pixels = ::calloc(w * 4, h);
-        ::memcpy(this->pixels, pixels, w * 4 * h);
-    }
+    Frame() : width(0), height(0), damage(), pixels(NULL), capacity(0) {}
 
     ~Frame() {
         ::free(pixels);
     }
+
+    // Copy |w| x |h| RGBA pixels into the frame. Return false on failure.
+    bool copyFrom(int w, int h, const void* src) {
+        size_t size = static_cast<size_t>(w) * 4 * h;
+        if (w < 0 || h < 0 || (h > 0 && size / 4 / h != (size_t)w)) {
+            return false;
+        }
+        if (size > capacity) {
+            void* newPixels = ::realloc(pixels, size);
+            if (!newPixels) {
+                return false;
+            }
+            pixels = newPixels;
+            capacity = size;
+        }
+        ::memcpy(pixels, src, size);
+        width = w;
+        height = h;
+        return true;
+    }
 };
 
 // Real implementation of GpuFrameBridge interface.
 class Bridge : public GpuFrameBridge {
 public:
-    // Constructor.
-    Bridge(Looper* looper, Callback* callback, void* callbackOpaque) :
+    // Constructor. Only one of |callback| and |damageCallback| is not NULL.
+    Bridge(Looper* looper,
+           Callback* callback,
+           DamageCallback* damageCallback,
+           void* callbackOpaque) :
             GpuFrameBridge(),
             mLooper(looper),
             mInSocket(-1),
             mOutSocket(-1),
             mFdWatch(NULL),
-            mFrames(),
+            mLock("GpuFrameBridge::mLock"),
+            mPending(-1),
+            mDelivering(-1),
+            mSignaled(false),
+            mLastWidth(0),
+            mLastHeight(0),
+            mLostDamage(),
+            mStats(),
             mCallback(callback),
+            mDamageCallback(damageCallback),
             mCallbackOpaque(callbackOpaque) {
         if (::android::base::socketCreatePair(&mInSocket, &mOutSocket) < 0) {
             PLOG(ERROR) << "Could not create socket pair";
@@ -94,19 +176,82 @@ public:
     // Implementation of the GpuFrameBridge::postFrame() method, must be
     // called from the EmuGL thread.
     virtual void postFrame(int width, int height, const void* pixels) {
+        postDamagedFrame(width, height, pixels, 0, 0, width, height);
+    }
+
+    virtual void postDamagedFrame(int width,
+                                  int height,
+                                  const void* pixels,
+                                  int damageX,
+                                  int damageY,
+                                  int damageWidth,
+                                  int damageHeight) {
         if (mInSocket < 0) {
             return;
         }
-        Frame* frame = new Frame(width, height, pixels);
-        ::memcpy(frame->pixels, pixels, width * 4 * height);
-        mFrames.send(frame);
-        char c = 1;
-        android::base::socketSend(mInSocket, &c, 1);
+
+        // There is always a free frame, since at most one is pending and
+        // one is being delivered. Nobody else touches it until it is
+        // published below, so it is filled without holding the lock.
+        int index;
+        {
+            AutoLock lock(mLock);
+            mStats.postedFrames++;
+            for (index = 0; index < kPoolSize; ++index) {
+                if (index != mPending && index != mDelivering) {
+                    break;
+                }
+            }
+            DCHECK(index < kPoolSize);
+        }
+        Frame* frame = &mFrames[index];
+        DamageRect damage(damageX, damageY, damageWidth, damageHeight);
+        if (!frame->copyFrom(width, height, pixels)) {
+            LOG(ERROR) << "Could not allocate GPU frame";
+            AutoLock lock(mLock);
+            // The next frame must still repaint what this one changed.
+            mLostDamage.add(damage);
+            mStats.droppedFrames++;
+            return;
+        }
+        frame->damage = damage;
+
+        bool signal;
+        {
+            AutoLock lock(mLock);
+            frame->damage.add(mLostDamage);
+            mLostDamage = DamageRect();
+            if (mPending >= 0) {
+                // Latest wins: drop the frame that was never delivered, but
+                // keep its damage.
+                frame->damage.add(mFrames[mPending].damage);
+                mStats.droppedFrames++;
+            }
+            if (width != mLastWidth || height != mLastHeight) {
+                // The receiver's previous content doesn't fit anymore.
+                frame->damage = DamageRect(0, 0, width, height);
+                mLastWidth = width;
+                mLastHeight = height;
+            }
+            frame->damage.clip(width, height);
+            mPending = index;
+            signal = !mSignaled;
+            mSignaled = true;
+        }
+        if (signal) {
+            char c = 1;
+            android::base::socketSend(mInSocket, &c, 1);
+        }
+    }
+
+    virtual void getStats(Stats* stats) {
+        AutoLock lock(mLock);
+        *stats = mStats;
     }
 
 private:
     enum {
-        kMaxFrames = 16
+        kPoolSize = 3
     };
 
     // Called from the looper thread when a new Frame instance is available.
@@ -115,24 +260,61 @@ private:
         if (events & Looper::FdWatch::kEventRead) {
             char c = 0;
             android::base::socketRecv(bridge->mOutSocket, &c, 1);
-            Frame* frame = NULL;
-            bridge->mFrames.receive(&frame);
-            if (frame) {
-                bridge->mCallback(bridge->mCallbackOpaque,
-                                  frame->width,
-                                  frame->height,
-                                  frame->pixels);
-                delete frame;
-            }
+            bridge->deliverPendingFrame();
+        }
+    }
+
+    void deliverPendingFrame() {
+        int index;
+        {
+            AutoLock lock(mLock);
+            mSignaled = false;
+            index = mPending;
+            mPending = -1;
+            mDelivering = index;
         }
+        if (index < 0) {
+            return;
+        }
+        const Frame& frame = mFrames[index];
+        if (mDamageCallback) {
+            mDamageCallback(mCallbackOpaque,
+                            frame.width,
+                            frame.height,
+                            frame.pixels,
+                            frame.damage.x,
+                            frame.damage.y,
+                            frame.damage.width,
+                            frame.damage.height);
+        } else {
+            mCallback(mCallbackOpaque, frame.width, frame.height,
+                      frame.pixels);
+        }
+        AutoLock lock(mLock);
+        mDelivering = -1;
+        mStats.deliveredFrames++;
     }
 
     Looper* mLooper;
     int mInSocket;
     int mOutSocket;
     Looper::FdWatch* mFdWatch;
-    MessageChannel<Frame*, kMaxFrames> mFrames;
+    Frame mFrames[kPoolSize];
+    Lock mLock;
+    // Indices in |mFrames| of the frame waiting for delivery, and of the
+    // one being delivered, or -1.
+    int mPending;
+    int mDelivering;
+    // True if a byte was sent to the socket, and not received yet.
+    bool mSignaled;
+    // Size of the last frame passed to the looper thread.
+    int mLastWidth;
+    int mLastHeight;
+    // Damage of the frames dropped because they couldn't be copied.
+    DamageRect mLostDamage;
+    Stats mStats;
     Callback* mCallback;
+    DamageCallback* mDamageCallback;
     void* mCallbackOpaque;
 };
 
@@ -142,7 +324,14 @@ private:
 GpuFrameBridge* GpuFrameBridge::create(android::base::Looper* looper,
                                        Callback* callback,
                                        void* callbackOpaque) {
-    return new Bridge(looper, callback, callbackOpaque);
+    return new Bridge(looper, callback, NULL, callbackOpaque);
+}
+
+// static
+GpuFrameBridge* GpuFrameBridge::createWithDamage(android::base::Looper* looper,
+                                                 DamageCallback* callback,
+                                                 void* callbackOpaque) {
+    return new Bridge(looper, NULL, callback, callbackOpaque);
 }
 
 }  // namespace opengl
@@ -15,6 +15,8 @@
 #ifndef ANDROID_OPENGL_GPU_FRAME_BRIDGE_H
 #define ANDROID_OPENGL_GPU_FRAME_BRIDGE_H
 
+#include <stdint.h>
+
 namespace android {
 
 namespace base {
@@ -38,6 +40,11 @@ namespace opengl {
 //  2) In the EmuGL callback, which runs in its own EmuGL thread, call the
 //     postFrame() method.
 //
+// Frames are copied into a small fixed pool of buffers that are reused. If
+// the main loop falls behind, only the latest posted frame is delivered,
+// and the intermediate ones are dropped without ever being seen by the
+// client.
+//
 class GpuFrameBridge {
 public:
     // Type of function that is called to transfer the content of a new
@@ -50,6 +57,25 @@ public:
                             int height,
                             const void* pixels);
 
+    // Same as Callback, but also receives the area of the frame that
+    // changed since the previously delivered one, in pixels. This includes
+    // the changes of all dropped frames.
+    typedef void (DamageCallback)(void* opaque,
+                                  int width,
+                                  int height,
+                                  const void* pixels,
+                                  int damageX,
+                                  int damageY,
+                                  int damageWidth,
+                                  int damageHeight);
+
+    // Frame delivery statistics, see getStats().
+    struct Stats {
+        uint64_t postedFrames;
+        uint64_t deliveredFrames;
+        uint64_t droppedFrames;
+    };
+
     // Create a new GpuFrameBridge instance. |looper| is a handle to the main
     // loop's Looper instance, and |callback| is a function that will be
     // called, from the looper thread, to send the frame data to the client.
@@ -57,12 +83,33 @@ public:
                                   Callback* callback,
                                   void* callbackOpaque);
 
+    // Same as create(), for clients that need the damaged area of frames.
+    static GpuFrameBridge* createWithDamage(android::base::Looper* looper,
+                                            DamageCallback* callback,
+                                            void* callbackOpaque);
+
     // Destructor
     virtual ~GpuFrameBridge() {}
 
-    // Post a new frame from the EmuGL thread.
+    // Post a new frame from the EmuGL thread. The whole frame is considered
+    // damaged. Calls must not overlap.
     virtual void postFrame(int width, int height, const void* pixels) = 0;
 
+    // Same as postFrame(), but only the area at (|damageX|, |damageY|) of
+    // |damageWidth| x |damageHeight| pixels changed since the previous
+    // frame. The whole frame is still reported as damaged if its size
+    // differs from the previous one.
+    virtual void postDamagedFrame(int width,
+                                  int height,
+                                  const void* pixels,
+                                  int damageX,
+                                  int damageY,
+                                  int damageWidth,
+                                  int damageHeight) = 0;
+
+    // Retrieve the delivery statistics. Can be called from any thread.
+    virtual void getStats(Stats* stats) = 0;
+
 protected:
     GpuFrameBridge() {}
     GpuFrameBridge(const GpuFrameBridge& other);
@@ -126,5 +126,191 @@ TEST(GpuFrameBridge, postFrameWithinSingleThread) {
     }
 }
 
+TEST(GpuFrameBridge, postFramesCoalescesIntoLatest) {
+    ScopedPtr<Looper> looper(Looper::create());
+    ASSERT_TRUE(looper.get());
+
+    FrameList list;
+    ScopedPtr<GpuFrameBridge> bridge(
+            GpuFrameBridge::create(looper.get(), FrameList::add, &list));
+    ASSERT_TRUE(bridge.get());
+
+    // Post several frames before the looper runs, only the last one
+    // must be delivered.
+    const int kCount = 10;
+    for (int n = 0; n < kCount; ++n) {
+        unsigned char pixels[4] = { (unsigned char)n, 0, 0, 0xff };
+        bridge->postFrame(1, 1, pixels);
+    }
+
+    EXPECT_EQ(ETIMEDOUT, looper->runWithTimeoutMs(100));
+
+    EXPECT_EQ(1, list.count());
+    ScopedPtr<Frame> frame(list.popFront());
+    ASSERT_TRUE(frame.get());
+    EXPECT_EQ(kCount - 1,
+              reinterpret_cast<unsigned char*>(frame->pixels)[0]);
+
+    GpuFrameBridge::Stats stats;
+    bridge->getStats(&stats);
+    EXPECT_EQ((uint64_t)kCount, stats.postedFrames);
+    EXPECT_EQ(1U, stats.deliveredFrames);
+    EXPECT_EQ((uint64_t)kCount - 1, stats.droppedFrames);
+
+    // Frames posted later, and with a different size, are delivered too.
+    static const unsigned char kFrame1[8] = {
+        1, 2, 3, 4, 5, 6, 7, 8,
+    };
+    bridge->postFrame(2, 1, kFrame1);
+
+    EXPECT_EQ(ETIMEDOUT, looper->runWithTimeoutMs(100));
+
+    EXPECT_EQ(1, list.count());
+    frame.reset(list.popFront());
+    ASSERT_TRUE(frame.get());
+    EXPECT_EQ(2, frame->width);
+    EXPECT_EQ(1, frame->height);
+    EXPECT_EQ(0, ::memcmp(kFrame1, frame->pixels, sizeof(kFrame1)));
+
+    bridge->getStats(&stats);
+    EXPECT_EQ((uint64_t)kCount + 1, stats.postedFrames);
+    EXPECT_EQ(2U, stats.deliveredFrames);
+    EXPECT_EQ((uint64_t)kCount - 1, stats.droppedFrames);
+}
+
+namespace {
+
+struct DamageRecord {
+    int count;
+    int x;
+    int y;
+    int width;
+    int height;
+
+    static void add(void* context, int w, int h, const void* pixels,
+                    int damageX, int damageY,
+                    int damageWidth, int damageHeight) {
+        DamageRecord* record = reinterpret_cast<DamageRecord*>(context);
+        record->count++;
+        record->x = damageX;
+        record->y = damageY;
+        record->width = damageWidth;
+        record->height = damageHeight;
+    }
+};
+
+}  // namespace
+
+TEST(GpuFrameBridge, droppedFramesDamageIsMerged) {
+    ScopedPtr<Looper> looper(Looper::create());
+    ASSERT_TRUE(looper.get());
+
+    DamageRecord record = {};
+    ScopedPtr<GpuFrameBridge> bridge(GpuFrameBridge::createWithDamage(
+            looper.get(), DamageRecord::add, &record));
+    ASSERT_TRUE(bridge.get());
+
+    unsigned char pixels[16 * 16 * 4] = {};
+    // The first frame is always fully damaged.
+    bridge->postDamagedFrame(16, 16, pixels, 1, 1, 1, 1);
+
+    EXPECT_EQ(ETIMEDOUT, looper->runWithTimeoutMs(100));
+
+    EXPECT_EQ(1, record.count);
+    EXPECT_EQ(0, record.x);
+    EXPECT_EQ(0, record.y);
+    EXPECT_EQ(16, record.width);
+    EXPECT_EQ(16, record.height);
+
+    bridge->postDamagedFrame(16, 16, pixels, 2, 3, 4, 5);
+    bridge->postDamagedFrame(16, 16, pixels, 0, 0, 0, 0);
+    bridge->postDamagedFrame(16, 16, pixels, 8, 1, 2, 2);
+
+    EXPECT_EQ(ETIMEDOUT, looper->runWithTimeoutMs(100));
+
+    EXPECT_EQ(2, record.count);
+    EXPECT_EQ(2, record.x);
+    EXPECT_EQ(1, record.y);
+    EXPECT_EQ(8, record.width);
+    EXPECT_EQ(7, record.height);
+
+    // Whole frames are fully damaged.
+    bridge->postFrame(16, 16, pixels);
+
+    EXPECT_EQ(ETIMEDOUT, looper->runWithTimeoutMs(100));
+
+    EXPECT_EQ(3, record.count);
+    EXPECT_EQ(0, record.x);
+    EXPECT_EQ(0, record.y);
+    EXPECT_EQ(16, record.width);
+    EXPECT_EQ(16, record.height);
+}
+
+TEST(GpuFrameBridge, resizedFrameIsFullyDamaged) {
+    ScopedPtr<Looper> looper(Looper::create());
+    ASSERT_TRUE(looper.get());
+
+    DamageRecord record = {};
+    ScopedPtr<GpuFrameBridge> bridge(GpuFrameBridge::createWithDamage(
+            looper.get(), DamageRecord::add, &record));
+    ASSERT_TRUE(bridge.get());
+
+    unsigned char pixels[16 * 16 * 4] = {};
+    bridge->postFrame(16, 16, pixels);
+    EXPECT_EQ(ETIMEDOUT, looper->runWithTimeoutMs(100));
+
+    bridge->postDamagedFrame(8, 16, pixels, 1, 2, 3, 4);
+    EXPECT_EQ(ETIMEDOUT, looper->runWithTimeoutMs(100));
+
+    EXPECT_EQ(2, record.count);
+    EXPECT_EQ(0, record.x);
+    EXPECT_EQ(0, record.y);
+    EXPECT_EQ(8, record.width);
+    EXPECT_EQ(16, record.height);
+
+    // The damage of a dropped frame of another size is kept in bounds.
+    bridge->postDamagedFrame(16, 16, pixels, 0, 0, 16, 16);
+    bridge->postDamagedFrame(8, 16, pixels, 1, 2, 3, 4);
+    EXPECT_EQ(ETIMEDOUT, looper->runWithTimeoutMs(100));
+
+    EXPECT_EQ(3, record.count);
+    EXPECT_EQ(0, record.x);
+    EXPECT_EQ(0, record.y);
+    EXPECT_EQ(8, record.width);
+    EXPECT_EQ(16, record.height);
+}
+
+TEST(GpuFrameBridge, uncopiedFrameDamageIsKept) {
+    ScopedPtr<Looper> looper(Looper::create());
+    ASSERT_TRUE(looper.get());
+
+    DamageRecord record = {};
+    ScopedPtr<GpuFrameBridge> bridge(GpuFrameBridge::createWithDamage(
+            looper.get(), DamageRecord::add, &record));
+    ASSERT_TRUE(bridge.get());
+
+    unsigned char pixels[16 * 16 * 4] = {};
+    bridge->postFrame(16, 16, pixels);
+    EXPECT_EQ(ETIMEDOUT, looper->runWithTimeoutMs(100));
+
+    // A frame too large to be copied is dropped, the next one repaints
+    // its damage.
+    bridge->postDamagedFrame(1 << 30, 1 << 30, pixels, 2, 3, 4, 5);
+    bridge->postDamagedFrame(16, 16, pixels, 8, 1, 2, 2);
+    EXPECT_EQ(ETIMEDOUT, looper->runWithTimeoutMs(100));
+
+    EXPECT_EQ(2, record.count);
+    EXPECT_EQ(2, record.x);
+    EXPECT_EQ(1, record.y);
+    EXPECT_EQ(8, record.width);
+    EXPECT_EQ(7, record.height);
+
+    GpuFrameBridge::Stats stats;
+    bridge->getStats(&stats);
+    EXPECT_EQ(3U, stats.postedFrames);
+    EXPECT_EQ(2U, stats.deliveredFrames);
+    EXPECT_EQ(1U, stats.droppedFrames);
+}
+
 }  // namespace opengl
 }  // namespace android
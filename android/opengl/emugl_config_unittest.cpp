@@ -240,8 +240,37 @@ TEST(EmuglConfig, initNoWindowWithoutMesa) {
                  config.status);
 }
 
+TEST(EmuglConfig, initHeadless) {
+    TestSystem testSys("foo", System::kProgramBitness);
+    TestTempDir* myDir = testSys.getTempRoot();
+    myDir->makeSubDir(System::get()->getProgramDirectory().c_str());
+    makeLibSubDir(myDir, "");
+
+    EmuglConfig config;
+    EXPECT_TRUE(emuglConfig_init(
+            &config, false, "host", "headless", 0, true));
+    EXPECT_TRUE(config.enabled);
+    EXPECT_STREQ("headless", config.backend);
+    EXPECT_STREQ("GPU emulation enabled using 'headless' mode",
+                 config.status);
+}
+
 TEST(EmuglConfig, setupEnv) {
 }
 
+TEST(EmuglConfig, setupEnvHeadless) {
+    TestSystem testSys("foo", System::kProgramBitness);
+    TestTempDir* myDir = testSys.getTempRoot();
+    myDir->makeSubDir(System::get()->getProgramDirectory().c_str());
+    makeLibSubDir(myDir, "");
+
+    EmuglConfig config;
+    EXPECT_TRUE(emuglConfig_init(
+            &config, true, "headless", NULL, 0, true));
+    emuglConfig_setupEnv(&config);
+    EXPECT_STREQ("1", testSys.envGet("ANDROID_GL_HEADLESS"));
+    EXPECT_FALSE(testSys.envGet("ANDROID_GL_LIB"));
+}
+
 }  // namespace base
 }  // namespace android
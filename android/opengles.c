@@ -16,12 +16,14 @@
 
 /* Declared in "android/globals.h" */
 int  android_gles_fast_pipes = 1;
+int  android_gles_shmem_pipes = 0;
 
 #include "android/globals.h"
 #include <android/utils/debug.h>
 #include <android/utils/path.h>
 #include <android/utils/bufprint.h>
 #include <android/utils/dll.h>
+#include <android/utils/setenv.h>
 
 // NOTE: The declarations below should be equivalent to those in
 // <libOpenglRender/render_api_platform_types.h>
@@ -47,10 +49,15 @@ typedef void* FBNativeWindowType;
 #define STREAM_MODE_TCP       1
 #define STREAM_MODE_UNIX      2
 #define STREAM_MODE_PIPE      3
+#define STREAM_MODE_SHMEM     4
+
+typedef AndroidGlesChannelCallback RenderChannelCallback;
+typedef AndroidGlesChannelBuffer RenderChannelBuffer;
 
 #define RENDERER_FUNCTIONS_LIST \
   FUNCTION_(int, initLibrary, (void), ()) \
   FUNCTION_(int, setStreamMode, (int mode), (mode)) \
+  FUNCTION_VOID_(setOpenGLConfigCachePath, (const char* path), (path)) \
   FUNCTION_(int, initOpenGLRenderer, (int width, int height, bool useSubWindow, char* addr, size_t addrLen), (width, height, addr, addrLen)) \
   FUNCTION_VOID_(getHardwareStrings, (const char** vendors, const char** renderer, const char** version), (vendors, renderer, version)) \
   FUNCTION_VOID_(setPostCallback, (OnPostFunc onPost, void* onPostContext), (onPost, onPostContext)) \
@@ -58,6 +65,28 @@ typedef void* FBNativeWindowType;
   FUNCTION_(bool, destroyOpenGLSubwindow, (void), ()) \
   FUNCTION_VOID_(setOpenGLDisplayRotation, (float zRot), (zRot)) \
   FUNCTION_VOID_(repaintOpenGLDisplay, (void), ()) \
+  FUNCTION_VOID_(setOpenGLSkinLayer, (int id, const void* pixels, int width, int height, int x, int y, int dstWidth, int dstHeight), (id, pixels, width, height, x, y, dstWidth, dstHeight)) \
+  FUNCTION_VOID_(showOpenGLSkinLayer, (int id, bool visible), (id, visible)) \
+  FUNCTION_VOID_(setOpenGLSkinDisplayRect, (int x, int y, int width, int height), (x, y, width, height)) \
+  FUNCTION_(bool, startOpenGLVideoRecording, (const char* path, int fps), (path, fps)) \
+  FUNCTION_(bool, stopOpenGLVideoRecording, (uint64_t* writtenFrames, uint64_t* droppedFrames), (writtenFrames, droppedFrames)) \
+  FUNCTION_VOID_(enableOpenGLDecoderStats, (bool enable), (enable)) \
+  FUNCTION_(size_t, getOpenGLDecoderStats, (char* buffer, size_t bufferSize), (buffer, bufferSize)) \
+  FUNCTION_VOID_(enableOpenGLFrameStats, (bool enable), (enable)) \
+  FUNCTION_(size_t, getOpenGLFrameStats, (char* buffer, size_t bufferSize), (buffer, bufferSize)) \
+  FUNCTION_(size_t, getOpenGLLockStats, (char* buffer, size_t bufferSize), (buffer, bufferSize)) \
+  FUNCTION_VOID_(resetOpenGLLockStats, (void), ()) \
+  FUNCTION_(uint64_t, getOpenGLReadbackMemory, (void), ()) \
+  FUNCTION_VOID_(getOpenGLColorBufferPoolStats, (uint64_t* hits, uint64_t* misses, uint64_t* pooledBytes, uint64_t* maxBytes), (hits, misses, pooledBytes, maxBytes)) \
+  FUNCTION_(int, createOpenGLDisplay, (int width, int height), (width, height)) \
+  FUNCTION_(bool, setOpenGLDisplayPostCallback, (int display, OnPostFunc onPost, void* onPostContext), (display, onPost, onPostContext)) \
+  FUNCTION_VOID_(setOpenGLFrameRateLimit, (int fps), (fps)) \
+  FUNCTION_(void*, openRenderChannel, (RenderChannelCallback callback, void* opaque), (callback, opaque)) \
+  FUNCTION_(int, writeRenderChannel, (void* channel, const RenderChannelBuffer* buffers, int numBuffers), (channel, buffers, numBuffers)) \
+  FUNCTION_(int, readRenderChannel, (void* channel, const RenderChannelBuffer* buffers, int numBuffers), (channel, buffers, numBuffers)) \
+  FUNCTION_(unsigned, pollRenderChannel, (void* channel), (channel)) \
+  FUNCTION_VOID_(wakeOnRenderChannel, (void* channel, unsigned events), (channel, events)) \
+  FUNCTION_VOID_(closeRenderChannel, (void* channel), (channel)) \
   FUNCTION_(int, stopOpenGLRenderer, (void), ()) \
 
 #include <stdio.h>
@@ -154,7 +183,12 @@ android_initOpenglesEmulation(void)
         rendererUsesSubWindow = false;
     }
 
-    if (android_gles_fast_pipes) {
+    env = getenv("ANDROID_GL_SHMEM_PIPES");
+    if (env && env[0] != '\0' && env[0] != '0' &&
+        setStreamMode(STREAM_MODE_SHMEM)) {
+        D("Using in-process render channels for GPU emulation");
+        android_gles_shmem_pipes = 1;
+    } else if (android_gles_fast_pipes) {
 #ifdef _WIN32
         /* XXX: NEED Win32 pipe implementation */
         setStreamMode(STREAM_MODE_TCP);
@@ -185,6 +219,19 @@ android_startOpenglesRenderer(int width, int height)
         return 0;
     }
 
+    /* Cache the host GPU configuration in the user's config directory. */
+    char cachePath[PATH_MAX], *end = cachePath + sizeof(cachePath);
+    if (bufprint_config_file(cachePath, end, "emugl-config.cache") < end) {
+        setOpenGLConfigCachePath(cachePath);
+    }
+    /* And the host program binaries, see ProgramBinaryCache.h, unless the
+     * user set ANDROID_GL_PROGRAM_CACHE, possibly to an empty string to
+     * disable it. */
+    if (!getenv("ANDROID_GL_PROGRAM_CACHE") &&
+        bufprint_config_file(cachePath, end, "emugl-programs.cache") < end) {
+        setenv("ANDROID_GL_PROGRAM_CACHE", cachePath, 1);
+    }
+
     if (!initOpenGLRenderer(width,
                             height,
                             rendererUsesSubWindow,
@@ -206,6 +253,36 @@ android_setPostCallback(OnPostFunc onPost, void* onPostContext)
     }
 }
 
+int
+android_createOpenglesDisplay(int width, int height)
+{
+    if (!rendererStarted) {
+        return 0;
+    }
+    return createOpenGLDisplay(width, height);
+}
+
+int
+android_setDisplayPostCallback(int display, OnPostFunc onPost,
+                               void* onPostContext)
+{
+    if (!rendererStarted) {
+        return -1;
+    }
+    return setOpenGLDisplayPostCallback(display, onPost, onPostContext) ? 0
+                                                                       : -1;
+}
+
+int
+android_setOpenglesFrameRateLimit(int fps)
+{
+    if (!rendererStarted) {
+        return -1;
+    }
+    setOpenGLFrameRateLimit(fps);
+    return 0;
+}
+
 static void strncpy_safe(char* dst, const char* src, size_t n)
 {
     strncpy(dst, src, n);
@@ -313,6 +390,180 @@ android_redrawOpenglesWindow(void)
     }
 }
 
+int
+android_setOpenglesSkinLayer(int id, const void* pixels, int width, int height,
+                             int x, int y, int dstWidth, int dstHeight)
+{
+    if (!rendererStarted) {
+        return -1;
+    }
+    setOpenGLSkinLayer(id, pixels, width, height, x, y, dstWidth, dstHeight);
+    return 0;
+}
+
+void
+android_showOpenglesSkinLayer(int id, int visible)
+{
+    if (rendererStarted) {
+        showOpenGLSkinLayer(id, visible != 0);
+    }
+}
+
+void
+android_setOpenglesSkinDisplayRect(int x, int y, int width, int height)
+{
+    if (rendererStarted) {
+        setOpenGLSkinDisplayRect(x, y, width, height);
+    }
+}
+
+int
+android_startOpenglesVideoRecording(const char* path, int fps)
+{
+    if (!rendererStarted) {
+        return -1;
+    }
+    return startOpenGLVideoRecording(path, fps) ? 0 : -1;
+}
+
+int
+android_stopOpenglesVideoRecording(uint64_t* writtenFrames,
+                                   uint64_t* droppedFrames)
+{
+    if (!rendererStarted) {
+        return -1;
+    }
+    return stopOpenGLVideoRecording(writtenFrames, droppedFrames) ? 0 : -1;
+}
+
+int
+android_enableOpenglesDecoderStats(int enable)
+{
+    if (!rendererStarted) {
+        return -1;
+    }
+    enableOpenGLDecoderStats(enable != 0);
+    return 0;
+}
+
+size_t
+android_getOpenglesDecoderStats(char* buffer, size_t bufferSize)
+{
+    if (!rendererStarted) {
+        if (bufferSize > 0) {
+            buffer[0] = '\0';
+        }
+        return 0;
+    }
+    return getOpenGLDecoderStats(buffer, bufferSize);
+}
+
+int
+android_enableOpenglesFrameStats(int enable)
+{
+    if (!rendererStarted) {
+        return -1;
+    }
+    enableOpenGLFrameStats(enable != 0);
+    return 0;
+}
+
+size_t
+android_getOpenglesFrameStats(char* buffer, size_t bufferSize)
+{
+    if (!rendererStarted) {
+        if (bufferSize > 0) {
+            buffer[0] = '\0';
+        }
+        return 0;
+    }
+    return getOpenGLFrameStats(buffer, bufferSize);
+}
+
+size_t
+android_getOpenglesLockStats(char* buffer, size_t bufferSize)
+{
+    if (!rendererStarted) {
+        if (bufferSize > 0) {
+            buffer[0] = '\0';
+        }
+        return 0;
+    }
+    return getOpenGLLockStats(buffer, bufferSize);
+}
+
+void
+android_resetOpenglesLockStats(void)
+{
+    if (rendererStarted) {
+        resetOpenGLLockStats();
+    }
+}
+
+uint64_t
+android_getOpenglesReadbackMemory(void)
+{
+    if (!rendererStarted) {
+        return 0;
+    }
+    return getOpenGLReadbackMemory();
+}
+
+int
+android_getOpenglesColorBufferPoolStats(uint64_t* hits, uint64_t* misses,
+                                        uint64_t* pooledBytes,
+                                        uint64_t* maxBytes)
+{
+    if (!rendererStarted) {
+        return -1;
+    }
+    getOpenGLColorBufferPoolStats(hits, misses, pooledBytes, maxBytes);
+    return 0;
+}
+
+void*
+android_gles_channel_open(AndroidGlesChannelCallback callback, void* opaque)
+{
+    if (!rendererStarted || !android_gles_shmem_pipes) {
+        return NULL;
+    }
+    return openRenderChannel(callback, opaque);
+}
+
+int
+android_gles_channel_write(void* channel,
+                           const AndroidGlesChannelBuffer* buffers,
+                           int numBuffers)
+{
+    return writeRenderChannel(channel, buffers, numBuffers);
+}
+
+int
+android_gles_channel_read(void* channel,
+                          const AndroidGlesChannelBuffer* buffers,
+                          int numBuffers)
+{
+    return readRenderChannel(channel, buffers, numBuffers);
+}
+
+unsigned
+android_gles_channel_poll(void* channel)
+{
+    return pollRenderChannel(channel);
+}
+
+void
+android_gles_channel_wake_on(void* channel, unsigned events)
+{
+    wakeOnRenderChannel(channel, events);
+}
+
+void
+android_gles_channel_close(void* channel)
+{
+    closeRenderChannel(channel);
+}
+
 void
 android_gles_server_path(char* buff, size_t buffsize)
 {
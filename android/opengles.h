@@ -13,6 +13,7 @@
 #define ANDROID_OPENGLES_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include "android/utils/compiler.h"
 
@@ -32,9 +33,25 @@ int android_startOpenglesRenderer(int width, int height);
 
 /* See the description in render_api.h. */
 typedef void (*OnPostFunc)(void* context, int width, int height, int ydir,
-                           int format, int type, unsigned char* pixels);
+                           int format, int type, unsigned char* pixels,
+                           int damageX, int damageY,
+                           int damageWidth, int damageHeight);
 void android_setPostCallback(OnPostFunc onPost, void* onPostContext);
 
+/* Add a secondary display of |width| x |height| pixels to the renderer,
+ * and return its number (from 1), or 0 on failure or if the renderer is
+ * not started. Frames the guest posts to it are only read back once a
+ * callback is set with android_setDisplayPostCallback(), which returns 0
+ * on success, or -1 if |display| doesn't exist. Display 0 is the main
+ * display. */
+int android_createOpenglesDisplay(int width, int height);
+int android_setDisplayPostCallback(int display, OnPostFunc onPost,
+                                   void* onPostContext);
+
+/* Display at most |fps| frames per second in the GPU sub-window, or remove
+ * the limit if |fps| is 0. Return -1 if the renderer is not started. */
+int android_setOpenglesFrameRateLimit(int fps);
+
 /* Retrieve the Vendor/Renderer/Version strings describing the underlying GL
  * implementation. The call only works while the renderer is started.
  *
@@ -53,6 +70,96 @@ int android_hideOpenglesWindow(void);
 
 void android_redrawOpenglesWindow(void);
 
+/* Add or replace the skin layer |id| that the renderer draws in the window
+ * created by android_showOpenglesWindow(): a |width| x |height| image of
+ * RGBA |pixels|, stretched to |dstWidth| x |dstHeight| at |x|, |y| in the
+ * window, with a top-left origin. If |pixels| is NULL, the layer is removed
+ * instead. Layers are alpha-blended in increasing |id| order, those with a
+ * negative |id| below the GPU display, the others above it. When there are
+ * layers, the window should cover the whole skin, and the GPU display is
+ * drawn in the rectangle set by android_setOpenglesSkinDisplayRect().
+ * Returns 0 on success, or -1 if the renderer is not started.
+ */
+int android_setOpenglesSkinLayer(int id, const void* pixels,
+                                 int width, int height, int x, int y,
+                                 int dstWidth, int dstHeight);
+
+/* Show or hide the skin layer |id|. */
+void android_showOpenglesSkinLayer(int id, int visible);
+
+/* Set the window rectangle of the GPU display when there are skin layers,
+ * with a top-left origin. A |width| or |height| of 0 means the whole window.
+ */
+void android_setOpenglesSkinDisplayRect(int x, int y, int width, int height);
+
+/* Start recording the frames displayed by the renderer to |path| as an
+ * uncompressed YUV4MPEG2 stream at |fps| frames per second, which external
+ * encoders can read. |path| can be a named pipe, in which case this blocks
+ * until a reader opens it. Returns 0 on success, or -1 on failure, if the
+ * renderer is not started, or if a recording is already in progress.
+ */
+int android_startOpenglesVideoRecording(const char* path, int fps);
+
+/* Stop the recording, and wait until the last frames are written. On
+ * success, returns 0 and sets |*writtenFrames| and |*droppedFrames| to the
+ * number of frames that were written and dropped. Returns -1 if the renderer
+ * is not started, or if no recording was in progress.
+ */
+int android_stopOpenglesVideoRecording(uint64_t* writtenFrames,
+                                       uint64_t* droppedFrames);
+
+/* Start (if |enable| is not 0) or stop collecting per-opcode statistics in
+ * the renderer's decoders. Starting resets them. Returns 0 on success, or -1
+ * if the renderer is not started.
+ */
+int android_enableOpenglesDecoderStats(int enable);
+
+/* Print the statistics collected since they were last started into |buffer|,
+ * as a NUL-terminated table with one opcode per line. Returns the length of
+ * the whole table, which is truncated if it doesn't fit in |bufferSize|
+ * bytes, or 0 if the renderer is not started.
+ */
+size_t android_getOpenglesDecoderStats(char* buffer, size_t bufferSize);
+
+/* Start (if |enable| is not 0) or stop collecting the frame times of the
+ * renderer, and the time between each guest post and the display of the
+ * frame. Starting resets them. Returns 0 on success, or -1 if the renderer
+ * is not started.
+ */
+int android_enableOpenglesFrameStats(int enable);
+
+/* Print the frame statistics collected since they were last started into
+ * |buffer|, as a NUL-terminated table with one line per measured time.
+ * Returns the length of the whole table, which is truncated if it doesn't
+ * fit in |bufferSize| bytes, or 0 if the renderer is not started.
+ */
+size_t android_getOpenglesFrameStats(char* buffer, size_t bufferSize);
+
+/* Print the contention statistics of the renderer mutexes into |buffer|,
+ * as a NUL-terminated table with one line per mutex name. They are only
+ * collected by EMUGL_LOCK_PROFILING builds of the renderer. Returns the
+ * length of the whole table, which is truncated if it doesn't fit in
+ * |bufferSize| bytes, or 0 if the renderer is not started.
+ */
+size_t android_getOpenglesLockStats(char* buffer, size_t bufferSize);
+
+/* Reset the statistics printed by android_getOpenglesLockStats(). */
+void android_resetOpenglesLockStats(void);
+
+/* Return the number of bytes of host memory used by the renderer to hold
+ * the frames read back from the GPU, or 0 if the renderer is not started.
+ */
+uint64_t android_getOpenglesReadbackMemory(void);
+
+/* Retrieve the statistics of the renderer's pool of released color buffers:
+ * the number of buffer creations that reused a pooled buffer or allocated a
+ * new one, and the current and maximum size of the pool in bytes. Returns 0
+ * on success, or -1 if the renderer is not started.
+ */
+int android_getOpenglesColorBufferPoolStats(uint64_t* hits, uint64_t* misses,
+                                            uint64_t* pooledBytes,
+                                            uint64_t* maxBytes);
+
 /* Stop the renderer process */
 void android_stopOpenglesRenderer(void);
 
@@ -61,6 +168,40 @@ void android_stopOpenglesRenderer(void);
  */
 extern int  android_gles_fast_pipes;
 
+/* Set to 1 by android_initOpenglesEmulation() if the ANDROID_GL_SHMEM_PIPES
+ * environment variable is defined, and the renderer library supports it. In
+ * this case, the 'opengles' pipe service talks to the renderer through the
+ * in-process render channels below, instead of a socket.
+ */
+extern int  android_gles_shmem_pipes;
+
+/* In-process render channels, only usable when android_gles_shmem_pipes is 1.
+ * See the description of openRenderChannel() in render_api.entries. */
+#define ANDROID_GLES_CHANNEL_CAN_READ   (1 << 0)
+#define ANDROID_GLES_CHANNEL_CAN_WRITE  (1 << 1)
+#define ANDROID_GLES_CHANNEL_CLOSED     (1 << 2)
+
+typedef void (*AndroidGlesChannelCallback)(void* opaque, unsigned events);
+
+/* Buffer descriptor for scatter/gather transfers, same layout as
+ * GoldfishPipeBuffer. */
+typedef struct {
+    void*   data;
+    size_t  size;
+} AndroidGlesChannelBuffer;
+
+void* android_gles_channel_open(AndroidGlesChannelCallback callback,
+                                void* opaque);
+int android_gles_channel_write(void* channel,
+                               const AndroidGlesChannelBuffer* buffers,
+                               int numBuffers);
+int android_gles_channel_read(void* channel,
+                              const AndroidGlesChannelBuffer* buffers,
+                              int numBuffers);
+unsigned android_gles_channel_poll(void* channel);
+void android_gles_channel_wake_on(void* channel, unsigned events);
+void android_gles_channel_close(void* channel);
+
 /* Get the address of the socket that clients should connect to to access GLES.
  * For TCP this is just the port number (as a string) on the loopback address.
  * For UNIX and Win32 pipes it is the full pathname of the pipe.
@@ -0,0 +1,157 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#include "android/perf-stats.h"
+
+#include "android/looper.h"
+#include "android/utils/perf_counters.h"
+#include "android/utils/system.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+/* The values of the counters at the previous report, to compute rates. */
+typedef struct {
+    const PerfCounter*  counter;
+    uint64_t            value;
+} CounterSnapshot;
+
+static CounterSnapshot*  report_snapshots;
+static int               report_count;
+static int               report_capacity;
+static uint64_t          report_time_us;
+
+static FILE*      dump_file;
+static LoopTimer  dump_timer[1];
+static int        dump_interval_ms;
+
+static uint64_t
+perf_stats_now_us(void)
+{
+    struct timeval  tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+typedef struct {
+    stralloc_t*  out;
+    double       seconds;
+} ReportState;
+
+static void
+perf_stats_report_counter(void* opaque, const PerfCounter* counter)
+{
+    ReportState*  state = opaque;
+    uint64_t      value = perfCounter_get(counter);
+    uint64_t      previous = 0;
+    int           nn;
+
+    for (nn = 0; nn < report_count; nn++) {
+        if (report_snapshots[nn].counter == counter)
+            break;
+    }
+    if (nn == report_count) {
+        if (report_count == report_capacity) {
+            report_capacity = report_capacity ? 2 * report_capacity : 32;
+            AARRAY_RENEW(report_snapshots, report_capacity);
+        }
+        report_snapshots[nn].counter = counter;
+        report_count++;
+    } else {
+        previous = report_snapshots[nn].value;
+    }
+    report_snapshots[nn].value = value;
+
+    stralloc_add_format(state->out, "%-32s %14llu %-8s %12.1f/s\n",
+                        counter->name, (unsigned long long)value,
+                        counter->unit,
+                        state->seconds > 0 ?
+                            (value - previous) / state->seconds : 0.);
+}
+
+void
+android_perf_stats_report(stralloc_t* out)
+{
+    uint64_t     now = perf_stats_now_us();
+    ReportState  state;
+
+    /* Before the first report, rates are averages since the counters
+     * were created, close enough to the emulator start. */
+    if (report_time_us == 0)
+        report_time_us = now - 1000000;
+
+    state.out = out;
+    state.seconds = (now - report_time_us) / 1e6;
+    report_time_us = now;
+    perfCounters_forEach(perf_stats_report_counter, &state);
+}
+
+typedef struct {
+    int  first;
+} DumpState;
+
+static void
+perf_stats_dump_counter(void* opaque, const PerfCounter* counter)
+{
+    DumpState*  state = opaque;
+
+    fprintf(dump_file, "%s\"%s\":%llu", state->first ? "" : ",",
+            counter->name, (unsigned long long)perfCounter_get(counter));
+    state->first = 0;
+}
+
+static void
+perf_stats_dump_line(void)
+{
+    DumpState  state;
+
+    state.first = 1;
+    fprintf(dump_file, "{\"time_ms\":%llu,\"counters\":{",
+            (unsigned long long)(perf_stats_now_us() / 1000));
+    perfCounters_forEach(perf_stats_dump_counter, &state);
+    fprintf(dump_file, "}}\n");
+    fflush(dump_file);
+}
+
+static void
+perf_stats_dump(void* opaque)
+{
+    perf_stats_dump_line();
+    loopTimer_startRelative(dump_timer, dump_interval_ms);
+}
+
+static void
+perf_stats_at_exit(void)
+{
+    if (dump_file) {
+        perf_stats_dump_line();
+        fclose(dump_file);
+        dump_file = NULL;
+    }
+}
+
+int
+android_perf_stats_start_dump(const char* path, int interval_ms)
+{
+    if (dump_file)
+        return 0;
+
+    dump_file = fopen(path, "a");
+    if (!dump_file)
+        return -1;
+
+    dump_interval_ms = interval_ms;
+    loopTimer_init(dump_timer, looper_newCore(), perf_stats_dump, NULL);
+    loopTimer_startRelative(dump_timer, dump_interval_ms);
+    atexit(perf_stats_at_exit);
+    return 0;
+}
@@ -0,0 +1,33 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#ifndef ANDROID_PERF_STATS_H
+#define ANDROID_PERF_STATS_H
+
+#include "android/utils/compiler.h"
+#include "android/utils/stralloc.h"
+
+ANDROID_BEGIN_HEADER
+
+/* Reports of the performance counters of android/utils/perf_counters.h */
+
+/* Append a line per counter to |out|, with its value and its rate since
+ * the previous call, or since the emulator started. */
+void android_perf_stats_report(stralloc_t* out);
+
+/* Append a line with the values of all counters to |path| every
+ * |interval_ms| milliseconds, as a JSON object. Return 0 on success, or
+ * -1 if the file can't be opened. */
+int android_perf_stats_start_dump(const char* path, int interval_ms);
+
+ANDROID_END_HEADER
+
+#endif  /* ANDROID_PERF_STATS_H */
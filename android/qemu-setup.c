@@ -14,6 +14,7 @@
 #include "qemu-common.h"
 #include "sysemu/sysemu.h"
 #include "modem_driver.h"
+#include "net/net.h"
 #include "proxy_http.h"
 
 #include "android/android.h"
@@ -287,14 +288,18 @@ void  android_emulation_setup( void )
         // Set up redirect from host to guest system. adbd on the guest listens
         // on 5555.
         if (legacy_adb) {
+            slirp_lock();
             slirp_redir( 0, adb_port, guest_ip, 5555 );
+            slirp_unlock();
         } else {
             adb_server_init(adb_port);
             android_adb_service_init();
         }
         if ( control_console_start( console_port ) < 0 ) {
             if (legacy_adb) {
+                slirp_lock();
                 slirp_unredir( 0, adb_port );
+                slirp_unlock();
             }
         }
 
@@ -323,7 +328,12 @@ void  android_emulation_setup( void )
             /* setup first redirection for ADB, the Android Debug Bridge */
             adb_port = base_port + 1;
             if (legacy_adb) {
-                if ( slirp_redir( 0, adb_port, guest_ip, 5555 ) < 0 )
+                int ret;
+
+                slirp_lock();
+                ret = slirp_redir( 0, adb_port, guest_ip, 5555 );
+                slirp_unlock();
+                if ( ret < 0 )
                     continue;
             } else {
                 if (adb_server_init(adb_port))
@@ -334,7 +344,9 @@ void  android_emulation_setup( void )
             /* setup second redirection for the emulator console */
             if ( control_console_start( base_port ) < 0 ) {
                 if (legacy_adb) {
+                    slirp_lock();
                     slirp_unredir( 0, adb_port );
+                    slirp_unlock();
                 }
                 continue;
             }
@@ -11,6 +11,7 @@
 
 #include "android/qemu/base/async/Looper.h"
 
+#include "android/base/async/LooperTaskQueue.h"
 #include "android/base/Log.h"
 #include "android/base/containers/TailQueueList.h"
 #include "android/base/containers/ScopedPointerSet.h"
@@ -54,13 +55,21 @@ public:
     QemuLooper() :
             Looper(),
             mQemuBh(NULL),
+            mTasks(),
             mFdWatches(),
             mPendingFdWatches(),
             mTimers() {
         mQemuBh = qemu_bh_new(handleBottomHalf, this);
+        if (mTasks.wakeFd() >= 0) {
+            qemu_set_fd_handler(mTasks.wakeFd(), handleTaskWakeUp, NULL,
+                                this);
+        }
     }
 
     virtual ~QemuLooper() {
+        if (mTasks.wakeFd() >= 0) {
+            qemu_set_fd_handler(mTasks.wakeFd(), NULL, NULL, NULL);
+        }
         qemu_bh_delete(mQemuBh);
     }
 
@@ -237,6 +246,10 @@ public:
         qemu_system_shutdown_request();
     }
 
+    virtual void postTask(TaskCallback callback, void* opaque) {
+        mTasks.post(callback, opaque);
+    }
+
 private:
 
     typedef ::android::base::TailQueueList<QemuLooper::FdWatch> FdWatchList;
@@ -296,7 +309,14 @@ private:
         }
     }
 
+    // Called by QEMU when another thread posted tasks.
+    static void handleTaskWakeUp(void* opaque) {
+        QemuLooper* looper = reinterpret_cast<QemuLooper*>(opaque);
+        looper->mTasks.runPending();
+    }
+
     QEMUBH* mQemuBh;
+    ::android::base::LooperTaskQueue mTasks;
 
     FdWatchSet mFdWatches;
     FdWatchList mPendingFdWatches;
@@ -39,69 +39,48 @@ _packet_is_internal( const uint8_t*  data, size_t  size )
 }
 
 /* here's how we implement network shaping. we want to limit the network
- * rate to a given constant MAX_RATE expressed as bits/second. this means
- * that it takes 1/MAX_RATE seconds to send a single bit, and count*8/MAX_RATE
- * seconds to send 'count' bytes.
+ * rate to a given constant MAX_RATE expressed as bits/second.
  *
- * we're going to implement a scheme where, when we send a packet of
- * 'count' bytes, no other packet will go through in the same direction for
- * at least 'count*8/MAX_RATE' seconds. any successive packet that is "sent"
- * in this interval is placed in a queue, associated to a timer
+ * each shaper is a token bucket: it earns MAX_RATE/8 bytes of credit per
+ * second, up to SHAPER_BURST_BYTES. a packet can be sent as soon as the
+ * credit is not negative, and its size is then subtracted from the credit.
+ * any packet that is "sent" while the credit is negative is placed in a
+ * FIFO queue, which is drained by a timer when enough credit is earned.
+ *
+ * the queue is a ring of slots that own their data buffer. both are only
+ * allocated when the ring grows, or when a larger packet than before is
+ * copied into a slot, so there is no allocation per packet in the steady
+ * state.
  *
  * there are different (queue/timer/rate) values for the input and output
  * direction of the user vlan.
  */
-typedef struct QueuedPacketRec_ {
-    int64_t                    expiration;
-    struct QueuedPacketRec_*   next;
-    size_t                     size;
-    void*                      opaque;
-    void*                      data;
-} QueuedPacketRec, *QueuedPacket;
-
-
-static QueuedPacket
-queued_packet_create( const void*   data,
-                      size_t        size,
-                      void*         opaque,
-                      int           do_copy )
-{
-    QueuedPacket   packet;
-    size_t         packet_size = sizeof(*packet);
 
-    if (do_copy)
-        packet_size += size;
+/* maximum credit of a shaper, this allows small bursts of packets to go
+ * through without waiting for the timer, which only has a 1ms resolution */
+#define  SHAPER_BURST_BYTES   1514
 
-    packet = g_malloc(packet_size);
-    packet->next       = NULL;
-    packet->expiration = 0;
-    packet->size       = (size_t)size;
-    packet->opaque     = opaque;
-
-    if (do_copy) {
-        packet->data = (void*)(packet+1);
-        memcpy( (char*)packet->data, (char*)data, packet->size );
-    } else {
-        packet->data = (void*)data;
-    }
-    return packet;
-}
+/* initial number of slots of a shaper queue, must be a power of 2 */
+#define  SHAPER_QUEUE_MIN     64
 
-static void
-queued_packet_free( QueuedPacket  packet )
-{
-    if (packet) {
-        g_free( packet );
-    }
-}
+typedef struct {
+    void*     data;      /* packet data, or 'buffer' when copied */
+    size_t    size;
+    void*     opaque;
+    void*     buffer;    /* data buffer owned by this slot */
+    size_t    capacity;  /* size of 'buffer' */
+} ShaperSlot;
 
 typedef struct NetShaperRec_ {
-    QueuedPacket   packets;   /* list of queued packets, ordered by expiration date */
+    ShaperSlot*    slots;      /* ring of queued packets */
+    unsigned       capacity;   /* number of slots, a power of 2 */
+    unsigned       head;       /* index of the first queued packet */
     int            num_packets;
     int            active;    /* is this shaper active ? */
-    int64_t        block_until;
-    double         max_rate;  /* max rate expressed in bytes/second */
-    double         inv_rate;  /* inverse of max rate                */
+    double         max_rate;  /* max rate expressed in bits/second */
+    double         byte_rate; /* credit earned per ms, in bytes */
+    double         credit;    /* current credit, in bytes */
+    int64_t        last_time; /* time of the last credit update */
     QEMUTimer*     timer;     /* QEMU timer */
 
     int                do_copy;
@@ -114,14 +93,13 @@ void
 netshaper_destroy( NetShaper  shaper )
 {
     if (shaper) {
+        unsigned  n;
+
         shaper->active = 0;
 
-        while (shaper->packets) {
-            QueuedPacket  packet = shaper->packets;
-            shaper->packets = packet->next;
-            packet->next    = NULL;
-            queued_packet_free(packet);
-        }
+        for (n = 0; n < shaper->capacity; n++)
+            g_free(shaper->slots[n].buffer);
+        g_free(shaper->slots);
 
         timer_del(shaper->timer);
         timer_free(shaper->timer);
@@ -130,31 +108,101 @@ netshaper_destroy( NetShaper  shaper )
     }
 }
 
+/* add the credit earned since the last update */
+static void
+netshaper_update_credit( NetShaper  shaper, int64_t  now )
+{
+    if (now > shaper->last_time) {
+        shaper->credit += (now - shaper->last_time) * shaper->byte_rate;
+        if (shaper->credit > SHAPER_BURST_BYTES)
+            shaper->credit = SHAPER_BURST_BYTES;
+    }
+    shaper->last_time = now;
+}
+
+/* double the size of the queue ring, keeping the packets in order */
+static void
+netshaper_grow_queue( NetShaper  shaper )
+{
+    unsigned     capacity = shaper->capacity ? 2*shaper->capacity
+                                             : SHAPER_QUEUE_MIN;
+    ShaperSlot*  slots    = g_malloc0(capacity * sizeof(*slots));
+    unsigned     n;
+
+    for (n = 0; n < shaper->capacity; n++) {
+        slots[n] = shaper->slots[(shaper->head + n) & (shaper->capacity - 1)];
+    }
+    g_free(shaper->slots);
+    shaper->slots    = slots;
+    shaper->capacity = capacity;
+    shaper->head     = 0;
+}
+
+static void
+netshaper_queue_packet( NetShaper  shaper,
+                        void*      data,
+                        size_t     size,
+                        void*      opaque )
+{
+    ShaperSlot*  slot;
+
+    if ((unsigned)shaper->num_packets == shaper->capacity)
+        netshaper_grow_queue(shaper);
+
+    slot = &shaper->slots[(shaper->head + shaper->num_packets) & (shaper->capacity - 1)];
+    slot->size   = size;
+    slot->opaque = opaque;
+
+    if (shaper->do_copy) {
+        if (slot->capacity < size) {
+            g_free(slot->buffer);
+            slot->buffer   = g_malloc(size);
+            slot->capacity = size;
+        }
+        memcpy(slot->buffer, data, size);
+        slot->data = slot->buffer;
+    } else {
+        slot->data = data;
+    }
+    shaper->num_packets++;
+}
+
+/* send the packets at the head of the queue while there is credit for them */
+static void
+netshaper_send_queued( NetShaper  shaper, int  all )
+{
+    while (shaper->num_packets > 0 && (all || shaper->credit >= 0)) {
+        ShaperSlot*  slot = &shaper->slots[shaper->head];
+
+        shaper->head = (shaper->head + 1) & (shaper->capacity - 1);
+        shaper->num_packets--;
+        shaper->credit -= slot->size;
+        shaper->send_func( slot->data, slot->size, slot->opaque );
+    }
+}
+
+/* program the timer for when the credit is back to zero */
+static void
+netshaper_arm_timer( NetShaper  shaper )
+{
+    int64_t  delay = 1;
+
+    if (shaper->credit < 0 && shaper->byte_rate > 0)
+        delay = (int64_t)(-shaper->credit / shaper->byte_rate) + 1;
+
+    timer_mod( shaper->timer, shaper->last_time + delay );
+}
+
 /* this function is called when the shaper's timer expires */
 static void
 netshaper_expires( NetShaper  shaper )
 {
-    QueuedPacket  packet;
-
-    while ((packet = shaper->packets) != NULL) {
-        int64_t   now = qemu_clock_get_ms( SHAPER_CLOCK );
-
-       if (packet->expiration > now)
-           break;
-
-       shaper->packets = packet->next;
-       shaper->send_func( packet->data, packet->size, packet->opaque );
-       queued_packet_free(packet);
-       shaper->num_packets--;
-   }
-
-   /* reprogram timer if needed */
-   if (shaper->packets) {
-       shaper->block_until = shaper->packets->expiration;
-       timer_mod( shaper->timer, shaper->block_until );
-   } else {
-       shaper->block_until = -1;
-   }
+    netshaper_update_credit(shaper, qemu_clock_get_ms( SHAPER_CLOCK ));
+    netshaper_send_queued(shaper, 0);
+
+    /* reprogram timer if needed */
+    if (shaper->num_packets > 0)
+        netshaper_arm_timer(shaper);
 }
 
 
@@ -165,16 +213,19 @@ netshaper_create( int                do_copy,
     NetShaper  shaper = g_malloc(sizeof(*shaper));
 
     shaper->active = 0;
-    shaper->packets = NULL;
+    shaper->slots = NULL;
+    shaper->capacity = 0;
+    shaper->head = 0;
     shaper->num_packets = 0;
     shaper->timer   = timer_new( SHAPER_CLOCK, SCALE_MS,
                                  (QEMUTimerCB*) netshaper_expires,
                                  shaper );
+    shaper->do_copy   = do_copy;
     shaper->send_func = send_func;
     shaper->max_rate  = 1e6;
-    shaper->inv_rate  = 0.;
-
-    shaper->block_until = -1; /* magic value, means to not block */
+    shaper->byte_rate = 0.;
+    shaper->credit    = SHAPER_BURST_BYTES;
+    shaper->last_time = 0;
 
     return shaper;
 }
@@ -184,23 +235,19 @@ netshaper_set_rate( NetShaper  shaper,
                     double     rate )
 {
     /* send all current packets when changing the rate */
-    while (shaper->packets) {
-        QueuedPacket  packet = shaper->packets;
-        shaper->packets = packet->next;
-        shaper->send_func(packet->data, packet->size, packet->opaque);
-        g_free(packet);
-        shaper->num_packets = 0;
-    }
+    netshaper_send_queued(shaper, 1);
+    timer_del(shaper->timer);
 
     shaper->max_rate = rate;
     if (rate > 1.) {
-        shaper->inv_rate = (8.*SHAPER_CLOCK_UNIT)/rate;  /* qemu_get_clock returns time in ms */
-        shaper->active   = 1;                            /* for the real-time clock           */
+        shaper->byte_rate = rate/(8.*SHAPER_CLOCK_UNIT);  /* qemu_get_clock returns time in ms */
+        shaper->active    = 1;                            /* for the real-time clock           */
     } else {
         shaper->active = 0;
     }
 
-    shaper->block_until = -1;
+    shaper->credit    = SHAPER_BURST_BYTES;
+    shaper->last_time = qemu_clock_get_ms( SHAPER_CLOCK );
 }
 
 void
@@ -209,49 +256,22 @@ netshaper_send_aux( NetShaper  shaper,
                     size_t     size,
                     void*      opaque )
 {
-    int64_t   now;
-
     if (!shaper->active || _packet_is_internal(data, size)) {
         shaper->send_func( data, size, opaque );
         return;
     }
 
-    now = qemu_clock_get_ms( SHAPER_CLOCK );
-    if (now >= shaper->block_until) {
+    netshaper_update_credit(shaper, qemu_clock_get_ms( SHAPER_CLOCK ));
+    if (shaper->num_packets == 0 && shaper->credit >= 0) {
+        shaper->credit -= size;
         shaper->send_func( data, size, opaque );
-        shaper->block_until = now + size*shaper->inv_rate;
-        //fprintf(stderr, "NETSHAPER: block for %.2fms\n", (shaper->block_until - now)*1.0 );
         return;
     }
 
-    /* create new packet, add it to the queue */
-    {
-        QueuedPacket   packet;
-
-        packet = queued_packet_create( data, size, opaque, shaper->do_copy );
-
-        packet->expiration = shaper->block_until;
-
-        {
-            QueuedPacket  *pnode, node;
-
-            pnode = &shaper->packets;
-            for (;;) {
-                node = *pnode;
-                if (node == NULL || node->expiration > packet->expiration )
-                    break;
-                pnode = &node->next;
-            }
-            packet->next = *pnode;
-            *pnode       = packet;
-
-            if (packet == shaper->packets)
-                timer_mod( shaper->timer, packet->expiration );
-        }
-        shaper->num_packets += 1;
-    }
-    shaper->block_until += size*shaper->inv_rate;
-    //fprintf(stderr, "NETSHAPER: block2 for %.2fms\n", (shaper->block_until - now)*1.0 );
+    /* add the packet to the queue */
+    netshaper_queue_packet(shaper, data, size, opaque);
+    if (shaper->num_packets == 1)
+        netshaper_arm_timer(shaper);
 }
 
 void
@@ -266,16 +286,14 @@ netshaper_send( NetShaper  shaper,
 int
 netshaper_can_send( NetShaper  shaper )
 {
-    int64_t  now;
-
-    if (!shaper->active || shaper->block_until < 0)
+    if (!shaper->active)
         return 1;
 
-    if (shaper->packets)
+    if (shaper->num_packets > 0)
         return 0;
 
-    now = qemu_clock_get_ms( SHAPER_CLOCK );
-    return (now >= shaper->block_until);
+    netshaper_update_credit(shaper, qemu_clock_get_ms( SHAPER_CLOCK ));
+    return (shaper->credit >= 0);
 }
 
 
@@ -284,37 +302,34 @@ netshaper_can_send( NetShaper  shaper )
 
 
 /* this type is used to model a session connection/state
- * if session->packet is != NULL, then the connection is delayed
+ * if session->pending is set, then the connection is delayed, and
+ * the session holds a copy of its SYN packet.
+ *
+ * sessions are stored in a hash table indexed by their address/port
+ * tuple, and freed sessions are kept for reuse with their data buffer.
  */
 typedef struct SessionRec_ {
     int64_t               expiration;
-    struct SessionRec_*   next;
+    struct SessionRec_*   next;          /* next in hash bucket or free list */
+    struct SessionRec_*   next_pending;  /* next delayed session */
     unsigned              src_ip;
     unsigned              dst_ip;
     unsigned short        src_port;
     unsigned short        dst_port;
     uint8_t               protocol;
-    QueuedPacket          packet;
+    int                   pending;
+    void*                 packet_data;
+    size_t                packet_size;
+    size_t                packet_capacity;
+    void*                 packet_opaque;
 
 } SessionRec, *Session;
 
 #define  _PROTOCOL_TCP   6
 #define  _PROTOCOL_UDP   17
 
-
-
-static void
-session_free( Session  session )
-{
-    if (session) {
-        if (session->packet) {
-            queued_packet_free(session->packet);
-            session->packet = NULL;
-        }
-        g_free( session );
-    }
-}
-
+/* initial number of hash buckets, must be a power of 2 */
+#define  NETDELAY_MIN_BUCKETS   64
 
 #if 0  /* useful for debugging */
 static const char*
@@ -382,7 +397,10 @@ _packet_SYN_flags( const void*  _data, size_t   size, Session  info )
 
 typedef struct NetDelayRec_
 {
-    Session     sessions;
+    Session*    buckets;       /* hash table of sessions */
+    unsigned    num_buckets;   /* a power of 2 */
+    Session     pending;       /* list of delayed sessions */
+    Session     free_sessions; /* list of sessions available for reuse */
     int         num_sessions;
     QEMUTimer*  timer;
     int         active;
@@ -394,10 +412,22 @@ typedef struct NetDelayRec_
 } NetDelayRec;
 
 
+static unsigned
+session_hash( Session  info )
+{
+    unsigned  h = info->src_ip * 0x9e3779b1U;
+
+    h ^= info->dst_ip + 0x7f4a7c15U + (h << 6) + (h >> 2);
+    h ^= ((unsigned)info->src_port << 16 | info->dst_port) + (h << 6) + (h >> 2);
+    h ^= info->protocol;
+    h *= 0x85ebca6bU;
+    return h ^ (h >> 16);
+}
+
 static Session*
 netdelay_lookup_session( NetDelay  delay, Session  info )
 {
-    Session*  pnode = &delay->sessions;
+    Session*  pnode = &delay->buckets[session_hash(info) & (delay->num_buckets - 1)];
     Session   node;
 
     for (;;) {
@@ -417,30 +447,128 @@ netdelay_lookup_session( NetDelay  delay, Session  info )
     return pnode;
 }
 
+/* double the number of hash buckets */
+static void
+netdelay_grow_buckets( NetDelay  delay )
+{
+    unsigned   old_count = delay->num_buckets;
+    Session*   old_buckets = delay->buckets;
+    unsigned   n;
+
+    delay->num_buckets = 2*old_count;
+    delay->buckets     = g_malloc0(delay->num_buckets * sizeof(Session));
+
+    for (n = 0; n < old_count; n++) {
+        Session  session = old_buckets[n];
+        while (session != NULL) {
+            Session   next   = session->next;
+            Session*  bucket = &delay->buckets[session_hash(session) & (delay->num_buckets - 1)];
+            session->next = *bucket;
+            *bucket       = session;
+            session       = next;
+        }
+    }
+    g_free(old_buckets);
+}
+
+/* remove a session from the pending list */
+static void
+netdelay_unlink_pending( NetDelay  delay, Session  session )
+{
+    Session*  pnode = &delay->pending;
+
+    while (*pnode != NULL) {
+        if (*pnode == session) {
+            *pnode = session->next_pending;
+            break;
+        }
+        pnode = &(*pnode)->next_pending;
+    }
+    session->next_pending = NULL;
+    session->pending      = 0;
+}
+
+/* remove the session at '*lookup' from the table */
+static void
+netdelay_remove_session( NetDelay  delay, Session*  lookup )
+{
+    Session  session = *lookup;
+
+    *lookup = session->next;
+    if (session->pending)
+        netdelay_unlink_pending(delay, session);
+
+    session->next        = delay->free_sessions;
+    delay->free_sessions = session;
+    delay->num_sessions -= 1;
+}
+
+static Session
+netdelay_new_session( NetDelay  delay )
+{
+    Session  session = delay->free_sessions;
+
+    if (session != NULL) {
+        delay->free_sessions = session->next;
+    } else {
+        session = g_malloc0( sizeof(*session) );
+    }
+    return session;
+}
+
+static void
+session_free( Session  session )
+{
+    if (session) {
+        g_free( session->packet_data );
+        g_free( session );
+    }
+}
+
+/* free all sessions, optionally sending their delayed packets first */
+static void
+netdelay_clear_sessions( NetDelay  delay, int  send_pending )
+{
+    unsigned  n;
+
+    while (delay->pending) {
+        Session  session = delay->pending;
+        delay->pending = session->next_pending;
+        session->next_pending = NULL;
+        session->pending      = 0;
+        if (send_pending)
+            delay->send_func( session->packet_data, session->packet_size,
+                              session->packet_opaque );
+    }
+
+    for (n = 0; n < delay->num_buckets; n++) {
+        while (delay->buckets[n] != NULL)
+            netdelay_remove_session(delay, &delay->buckets[n]);
+    }
+}
 
 
 /* called by the delay's timer on expiration */
 static void
 netdelay_expires( NetDelay  delay )
 {
-    Session  session;
-    int64_t  now = qemu_clock_get_ms(SHAPER_CLOCK);
-    int      rearm = 0;
-    int64_t  rearm_time = 0;
+    Session*  pnode = &delay->pending;
+    int64_t   now = qemu_clock_get_ms(SHAPER_CLOCK);
+    int       rearm = 0;
+    int64_t   rearm_time = 0;
 
-    for (session = delay->sessions; session != NULL; session = session->next)
+    while (*pnode != NULL)
     {
-        QueuedPacket  packet = session->packet;
-
-        if (packet == NULL)
-            continue;
+        Session  session = *pnode;
 
         if (session->expiration <= now) {
             /* send the SYN packet now */
+            *pnode = session->next_pending;
+            session->next_pending = NULL;
+            session->pending      = 0;
                     //fprintf(stderr, "NetDelay:RST: sending creation for %s\n", session_to_string(session) );
-            delay->send_func( packet->data, packet->size, packet->opaque );
-            session->packet = NULL;
-            queued_packet_free( packet );
+            delay->send_func( session->packet_data, session->packet_size,
+                              session->packet_opaque );
         } else {
             if (!rearm) {
                 rearm      = 1;
@@ -448,6 +576,7 @@ netdelay_expires( NetDelay  delay )
             }
             else if ( session->expiration < rearm_time )
                 rearm_time = session->expiration;
+            pnode = &session->next_pending;
         }
     }
 
@@ -461,8 +590,11 @@ netdelay_create( NetShaperSendFunc  send_func )
 {
     NetDelay  delay = g_malloc(sizeof(*delay));
 
-    delay->sessions     = NULL;
-    delay->num_sessions = 0;
+    delay->num_buckets   = NETDELAY_MIN_BUCKETS;
+    delay->buckets       = g_malloc0(delay->num_buckets * sizeof(Session));
+    delay->pending       = NULL;
+    delay->free_sessions = NULL;
+    delay->num_sessions  = 0;
     delay->timer        = timer_new( SHAPER_CLOCK, SCALE_MS,
                                      (QEMUTimerCB*) netdelay_expires,
                                      delay );
@@ -480,17 +612,7 @@ void
 netdelay_set_latency( NetDelay  delay, int  min_ms, int  max_ms )
 {
     /* when changing the latency, accept all sessions */
-    while (delay->sessions) {
-        Session  session = delay->sessions;
-        delay->sessions = session->next;
-        session->next = NULL;
-        if (session->packet) {
-            QueuedPacket  packet = session->packet;
-            delay->send_func( packet->data, packet->size, packet->opaque );
-        }
-        session_free(session);
-        delay->num_sessions--;
-    }
+    netdelay_clear_sessions(delay, 1);
 
     delay->min_ms = min_ms;
     delay->max_ms = max_ms;
@@ -515,13 +637,9 @@ netdelay_send_aux( NetDelay  delay, const void*  data, size_t  size, void* opaqu
         if ((flags & 0x05) != 0)
         {  /* FIN or RST: drop connection */
             Session*  lookup  = netdelay_lookup_session( delay, info );
-            Session   session = *lookup;
-            if (session != NULL) {
+            if (*lookup != NULL) {
                 //fprintf(stderr, "NetDelay:RST: dropping %s\n", session_to_string(info) );
-
-                *lookup = session->next;
-                session_free( session );
-                delay->num_sessions -= 1;
+                netdelay_remove_session( delay, lookup );
             }
         }
         else if ((flags & 0x12) == 0x02)
@@ -531,7 +649,7 @@ netdelay_send_aux( NetDelay  delay, const void*  data, size_t  size, void* opaqu
             Session   session = *lookup;
 
             if (session != NULL) {
-                if (session->packet != NULL) {
+                if (session->pending) {
                    /* this is a SYN re-transmission, since we didn't
                     * send the original SYN packet yet, just eat this one
                     */
@@ -542,16 +660,16 @@ netdelay_send_aux( NetDelay  delay, const void*  data, size_t  size, void* opaqu
                 /* establish a new session slightly in the future */
                 int   latency = delay->min_ms;
                 int   range   = delay->max_ms - delay->min_ms;
+                Session*  bucket;
 
                  if (range > 0)
                     latency += rand() % range;
 
                     //fprintf(stderr, "NetDelay:RST: delay creation for %s\n", session_to_string(info) );
-                session = g_malloc( sizeof(*session) );
+                if ((unsigned)delay->num_sessions >= delay->num_buckets)
+                    netdelay_grow_buckets(delay);
 
-                session->next        = delay->sessions;
-                delay->sessions      = session;
-                delay->num_sessions += 1;
+                session = netdelay_new_session(delay);
 
                 session->expiration = qemu_clock_get_ms(SHAPER_CLOCK) + latency;
 
@@ -561,7 +679,23 @@ netdelay_send_aux( NetDelay  delay, const void*  data, size_t  size, void* opaqu
                 session->dst_port = info->dst_port;
                 session->protocol = info->protocol;
 
-                session->packet = queued_packet_create( data, size, opaque, 1 );
+                bucket = &delay->buckets[session_hash(session) & (delay->num_buckets - 1)];
+                session->next = *bucket;
+                *bucket       = session;
+                delay->num_sessions += 1;
+
+                if (session->packet_capacity < size) {
+                    g_free(session->packet_data);
+                    session->packet_data     = g_malloc(size);
+                    session->packet_capacity = size;
+                }
+                memcpy(session->packet_data, data, size);
+                session->packet_size   = size;
+                session->packet_opaque = opaque;
+
+                session->pending      = 1;
+                session->next_pending = delay->pending;
+                delay->pending        = session;
 
                 netdelay_expires(delay);
                 return;
@@ -577,14 +711,16 @@ void
 netdelay_destroy( NetDelay  delay )
 {
     if (delay) {
-        while (delay->sessions) {
-            Session  session = delay->sessions;
-            delay->sessions = session->next;
+        netdelay_clear_sessions(delay, 0);
+        while (delay->free_sessions) {
+            Session  session = delay->free_sessions;
+            delay->free_sessions = session->next;
             session_free(session);
-            delay->num_sessions -= 1;
         }
+        g_free(delay->buckets);
+        timer_del(delay->timer);
+        timer_free(delay->timer);
         delay->active = 0;
         g_free( delay );
     }
 }
-
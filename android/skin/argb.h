@@ -214,6 +214,12 @@ typedef uint32_t    argb_t;
 #define   ARGB_READ(x,p)      ARGB_UNPACK(x,*(uint32_t*)(p))
 #define   ARGB_WRITE(x,p)     *(uint32_t*)(p) = ARGB_PACK(x)
 
+/* called by the scaling functions after each destination line, e.g. to
+ * convert it while it's still in the cache */
+#ifndef ARGB_SCALE_LINE_DONE
+#define   ARGB_SCALE_LINE_DONE(op,line)   ((void)0)
+#endif
+
 #endif /* !ARGB_T_DEFINED */
 
 
@@ -299,6 +305,7 @@ ARGB_SCALE_GENERIC( ScaleOp*   op )
         src_line += (sy >> 16)*src_pitch;
         sy       &= 0xffff;
 
+        ARGB_SCALE_LINE_DONE(op, dst_line);
         dst_line += dst_pitch;
     }
     ARGB_DONE;
@@ -445,6 +452,7 @@ scale_05_to_10( ScaleOp*   op )
         src_line += (sy >> 16)*src_pitch;
         sy       &= 0xffff;
 
+        ARGB_SCALE_LINE_DONE(op, dst_line);
         dst_line += dst_pitch;
     }
     ARGB_DONE;
@@ -533,6 +541,7 @@ scale_up_bilinear( ScaleOp*  op )
         }
 
         sy       += iy;
+        ARGB_SCALE_LINE_DONE(op, dst_line);
         dst_line += dst_pitch;
     }
     ARGB_DONE;
@@ -785,6 +794,7 @@ ARGB_SCALE_UP_QUICK_4x4( ScaleOp*  op )
         }
 
         sy       += iy;
+        ARGB_SCALE_LINE_DONE(op, dst_line);
         dst_line += dst_pitch;
     }
     ARGB_DONE;
@@ -855,6 +865,7 @@ ARGB_SCALE_NEAREST( ScaleOp*  op )
         }
 
         sy       += iy;
+        ARGB_SCALE_LINE_DONE(op, dst_line);
         dst_line += dst_pitch;
     }
 }
@@ -0,0 +1,135 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/skin/display-worker.h"
+
+#include "android/base/Compiler.h"
+#include "android/base/synchronization/LockFreeMessageChannel.h"
+#include "android/base/threads/Thread.h"
+
+#include <new>
+
+namespace {
+
+using android::base::SpscMessageChannel;
+using android::base::Thread;
+
+class DisplayWorker : public Thread {
+public:
+    DisplayWorker(SkinDisplayWorkerFunc func, void* opaque)
+        : Thread(), mFunc(func), mOpaque(opaque), mPending(0) {}
+
+    virtual intptr_t main() {
+        for (;;) {
+            Message msg;
+            mRequests.receive(&msg);
+            if (msg.quit) {
+                break;
+            }
+            mFunc(mOpaque, &msg.rect);
+            mResults.send(msg);
+        }
+        return 0;
+    }
+
+    bool post(const SkinRect* rect) {
+        if (mPending >= SKIN_DISPLAY_WORKER_CAPACITY) {
+            return false;
+        }
+        Message msg;
+        msg.rect = *rect;
+        msg.quit = false;
+        // Cannot fail, since at most |mPending| messages are in the
+        // channels.
+        mRequests.send(msg);
+        mPending++;
+        return true;
+    }
+
+    bool collect(SkinRect* rect, bool wait) {
+        Message msg;
+        if (!mResults.tryReceive(&msg)) {
+            if (!wait || mPending == 0) {
+                return false;
+            }
+            mResults.receive(&msg);
+        }
+        mPending--;
+        *rect = msg.rect;
+        return true;
+    }
+
+    bool busy() const { return mPending > 0; }
+
+    void stop() {
+        SkinRect rect;
+        while (collect(&rect, true)) {
+        }
+        Message msg;
+        msg.quit = true;
+        mRequests.send(msg);
+        wait(NULL);
+    }
+
+private:
+    struct Message {
+        SkinRect rect;
+        bool quit;
+    };
+
+    SkinDisplayWorkerFunc mFunc;
+    void* mOpaque;
+    // Number of posted messages not collected yet. Only used by the
+    // thread that owns the worker.
+    int mPending;
+    SpscMessageChannel<Message, SKIN_DISPLAY_WORKER_CAPACITY> mRequests;
+    SpscMessageChannel<Message, SKIN_DISPLAY_WORKER_CAPACITY> mResults;
+
+    DISALLOW_COPY_AND_ASSIGN(DisplayWorker);
+};
+
+DisplayWorker* asWorker(SkinDisplayWorker* worker) {
+    return reinterpret_cast<DisplayWorker*>(worker);
+}
+
+}  // namespace
+
+SkinDisplayWorker* skin_display_worker_new(SkinDisplayWorkerFunc func,
+                                           void* opaque) {
+    DisplayWorker* worker = new (std::nothrow) DisplayWorker(func, opaque);
+    if (worker && !worker->start()) {
+        delete worker;
+        worker = NULL;
+    }
+    return reinterpret_cast<SkinDisplayWorker*>(worker);
+}
+
+void skin_display_worker_free(SkinDisplayWorker* worker) {
+    if (worker) {
+        asWorker(worker)->stop();
+        delete asWorker(worker);
+    }
+}
+
+bool skin_display_worker_post(SkinDisplayWorker* worker,
+                              const SkinRect* rect) {
+    return asWorker(worker)->post(rect);
+}
+
+bool skin_display_worker_collect(SkinDisplayWorker* worker,
+                                 SkinRect* rect,
+                                 bool wait) {
+    return asWorker(worker)->collect(rect, wait);
+}
+
+bool skin_display_worker_busy(SkinDisplayWorker* worker) {
+    return asWorker(worker)->busy();
+}
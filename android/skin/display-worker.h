@@ -0,0 +1,65 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#ifndef _ANDROID_SKIN_DISPLAY_WORKER_H
+#define _ANDROID_SKIN_DISPLAY_WORKER_H
+
+#include "android/skin/rect.h"
+#include "android/utils/compiler.h"
+
+#include <stdbool.h>
+
+ANDROID_BEGIN_HEADER
+
+/* A SkinDisplayWorker is a thread that processes the damaged rectangles
+ * of an emulated display, i.e. converts and rotates the framebuffer pixels
+ * into a staging buffer, so that the thread updating the display only has
+ * to upload and present the result.
+ *
+ * Rectangles are posted and collected by a single thread, through two
+ * lock-free channels that the worker thread reads from and writes to. They
+ * are processed in order. */
+typedef struct SkinDisplayWorker  SkinDisplayWorker;
+
+/* Called on the worker thread to process |rect| */
+typedef void (*SkinDisplayWorkerFunc)(void* opaque, const SkinRect* rect);
+
+/* Maximum number of rectangles that can be posted and not yet collected */
+#define  SKIN_DISPLAY_WORKER_CAPACITY  64
+
+/* Start a worker thread calling |func(opaque, rect)|. Returns NULL if the
+ * thread could not be started. */
+extern SkinDisplayWorker*  skin_display_worker_new( SkinDisplayWorkerFunc  func,
+                                                    void*                  opaque );
+
+/* Wait for the pending rectangles to be processed, discard them, then stop
+ * the thread and free |worker|. */
+extern void  skin_display_worker_free( SkinDisplayWorker*  worker );
+
+/* Queue |rect| for processing. Returns false, without blocking, if there
+ * are already SKIN_DISPLAY_WORKER_CAPACITY rectangles that have not been
+ * collected. */
+extern bool  skin_display_worker_post( SkinDisplayWorker*  worker,
+                                       const SkinRect*     rect );
+
+/* Collect the next processed rectangle into |*rect| and return true. If
+ * none is ready, return false, unless |wait| is true and some rectangles
+ * are still pending, in which case this blocks until the next one is. */
+extern bool  skin_display_worker_collect( SkinDisplayWorker*  worker,
+                                          SkinRect*           rect,
+                                          bool                wait );
+
+/* Return true if some posted rectangles have not been collected yet */
+extern bool  skin_display_worker_busy( SkinDisplayWorker*  worker );
+
+ANDROID_END_HEADER
+
+#endif /* _ANDROID_SKIN_DISPLAY_WORKER_H */
@@ -0,0 +1,97 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/skin/display-worker.h"
+
+#include <gtest/gtest.h>
+
+namespace android_skin {
+
+namespace {
+
+// Records the width of each processed rectangle.
+struct Recorder {
+    int count;
+    int widths[SKIN_DISPLAY_WORKER_CAPACITY * 2];
+};
+
+void recordRect(void* opaque, const SkinRect* rect) {
+    Recorder* recorder = static_cast<Recorder*>(opaque);
+    recorder->widths[recorder->count++] = rect->size.w;
+}
+
+SkinRect makeRect(int w) {
+    SkinRect rect = { { 0, 0 }, { w, 10 } };
+    return rect;
+}
+
+}  // namespace
+
+TEST(SkinDisplayWorker, Empty) {
+    Recorder recorder = {};
+    SkinDisplayWorker* worker = skin_display_worker_new(recordRect, &recorder);
+    ASSERT_TRUE(worker);
+    SkinRect rect;
+    EXPECT_FALSE(skin_display_worker_busy(worker));
+    EXPECT_FALSE(skin_display_worker_collect(worker, &rect, false));
+    EXPECT_FALSE(skin_display_worker_collect(worker, &rect, true));
+    skin_display_worker_free(worker);
+    EXPECT_EQ(0, recorder.count);
+}
+
+TEST(SkinDisplayWorker, ProcessInOrder) {
+    Recorder recorder = {};
+    SkinDisplayWorker* worker = skin_display_worker_new(recordRect, &recorder);
+    ASSERT_TRUE(worker);
+
+    const int kCount = 10;
+    for (int n = 1; n <= kCount; ++n) {
+        SkinRect rect = makeRect(n);
+        EXPECT_TRUE(skin_display_worker_post(worker, &rect));
+    }
+    EXPECT_TRUE(skin_display_worker_busy(worker));
+
+    for (int n = 1; n <= kCount; ++n) {
+        SkinRect rect;
+        EXPECT_TRUE(skin_display_worker_collect(worker, &rect, true));
+        EXPECT_EQ(n, rect.size.w);
+    }
+    EXPECT_FALSE(skin_display_worker_busy(worker));
+
+    skin_display_worker_free(worker);
+    ASSERT_EQ(kCount, recorder.count);
+    for (int n = 0; n < kCount; ++n) {
+        EXPECT_EQ(n + 1, recorder.widths[n]);
+    }
+}
+
+TEST(SkinDisplayWorker, Capacity) {
+    Recorder recorder = {};
+    SkinDisplayWorker* worker = skin_display_worker_new(recordRect, &recorder);
+    ASSERT_TRUE(worker);
+
+    SkinRect rect = makeRect(1);
+    for (int n = 0; n < SKIN_DISPLAY_WORKER_CAPACITY; ++n) {
+        EXPECT_TRUE(skin_display_worker_post(worker, &rect));
+    }
+    EXPECT_FALSE(skin_display_worker_post(worker, &rect));
+
+    // Collecting a rectangle makes room for another one.
+    EXPECT_TRUE(skin_display_worker_collect(worker, &rect, true));
+    EXPECT_TRUE(skin_display_worker_post(worker, &rect));
+    EXPECT_FALSE(skin_display_worker_post(worker, &rect));
+
+    // Freeing the worker waits for the pending rectangles.
+    skin_display_worker_free(worker);
+    EXPECT_EQ(SKIN_DISPLAY_WORKER_CAPACITY + 1, recorder.count);
+}
+
+}  // namespace android_skin
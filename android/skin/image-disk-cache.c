@@ -0,0 +1,242 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#include "android/skin/image-disk-cache.h"
+
+#include "android/utils/bufprint.h"
+#include "android/utils/mapfile.h"
+#include "android/utils/path.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+#ifndef PATH_MAX
+#define PATH_MAX  1024
+#endif
+
+#define  DEBUG  0
+
+#if DEBUG
+#define  D(...)  fprintf(stderr, __VA_ARGS__)
+#else
+#define  D(...)  do{}while(0)
+#endif
+
+/* An entry is a file named after a hash of the image path, made of a
+ * header, the image path, padding to a multiple of 4 bytes, and the
+ * pixels. It uses the host byte order, the magic doesn't match on a
+ * host with another one.
+ */
+#define  CACHE_MAGIC    0x43494b53  /* 'SKIC' */
+#define  CACHE_VERSION  1
+
+typedef struct {
+    uint32_t  magic;
+    uint32_t  version;
+    uint64_t  file_size;
+    int64_t   file_mtime;
+    uint32_t  width;
+    uint32_t  height;
+    uint32_t  path_len;
+    uint32_t  reserved;
+} CacheHeader;
+
+static char  cache_dir[PATH_MAX];
+static int   cache_dir_set;
+
+void
+skin_image_disk_cache_set_dir( const char*  dir )
+{
+    cache_dir_set = 1;
+    if (dir == NULL || strlen(dir) >= sizeof(cache_dir)) {
+        cache_dir[0] = 0;
+        return;
+    }
+    strcpy(cache_dir, dir);
+}
+
+static const char*
+cache_get_dir( void )
+{
+    if (!cache_dir_set) {
+        char*  end = cache_dir + sizeof(cache_dir);
+        char*  p   = bufprint_config_file(cache_dir, end, "skin-cache");
+
+        cache_dir_set = 1;
+        if (p >= end)
+            cache_dir[0] = 0;
+    }
+    return cache_dir[0] ? cache_dir : NULL;
+}
+
+/* Print the path of the entry of |path| into |buff|, return NULL if the
+ * cache is disabled. */
+static char*
+cache_get_entry( const char*  path, char*  buff, char*  end )
+{
+    const char*  dir  = cache_get_dir();
+    uint64_t     hash = 14695981039346656037ULL;
+    char*        p;
+
+    if (dir == NULL)
+        return NULL;
+
+    /* FNV-1a */
+    for ( ; *path; path++ ) {
+        hash ^= (unsigned char)*path;
+        hash *= 1099511628211ULL;
+    }
+    p = bufprint(buff, end, "%s%c%08x%08x.img", dir, PATH_SEP_C,
+                 (unsigned)(hash >> 32), (unsigned)hash);
+    return p < end ? buff : NULL;
+}
+
+static size_t
+cache_pixels_offset( size_t  path_len )
+{
+    return (sizeof(CacheHeader) + path_len + 3) & ~(size_t)3;
+}
+
+uint32_t*
+skin_image_disk_cache_load( const char*  path, unsigned*  w, unsigned*  h )
+{
+    char               entry[PATH_MAX];
+    struct stat        st, est;
+    MapFile*           file;
+    void*              base;
+    void*              data;
+    size_t             mapped;
+    const CacheHeader* header;
+    size_t             path_len = strlen(path);
+    size_t             offset   = cache_pixels_offset(path_len);
+    uint64_t           size;
+    uint32_t*          pixels   = NULL;
+
+    if (cache_get_entry(path, entry, entry + sizeof(entry)) == NULL)
+        return NULL;
+
+    if (stat(path, &st) < 0 || stat(entry, &est) < 0)
+        return NULL;
+    if ((uint64_t)est.st_size < offset)
+        return NULL;
+
+    file = mapfile_open(entry, O_RDONLY, 0);
+    if (!mapfile_is_valid(file))
+        return NULL;
+
+    base = mapfile_map(file, 0, est.st_size, PROT_READ, &data, &mapped);
+    if (base == NULL) {
+        mapfile_close(file);
+        return NULL;
+    }
+
+    header = data;
+    size   = (uint64_t)header->width * header->height * 4;
+    if (header->magic != CACHE_MAGIC ||
+        header->version != CACHE_VERSION ||
+        header->file_size != (uint64_t)st.st_size ||
+        header->file_mtime != (int64_t)st.st_mtime ||
+        header->path_len != path_len ||
+        memcmp(header + 1, path, path_len) != 0 ||
+        size == 0 ||
+        offset + size != (uint64_t)est.st_size)
+    {
+        D("skin image cache: no valid entry for '%s'\n", path);
+    }
+    else
+    {
+        pixels = malloc(size);
+        if (pixels != NULL) {
+            /* the skin surfaces reference the pixels of their image, and
+             * rotated or blended clones are computed from them, so they
+             * are copied out of the read-only mapping */
+            memcpy(pixels, (const char*)data + offset, size);
+            *w = header->width;
+            *h = header->height;
+            D("skin image cache: loaded '%s' (%ux%u)\n", path, *w, *h);
+        }
+    }
+
+    mapfile_unmap(base, mapped);
+    mapfile_close(file);
+    return pixels;
+}
+
+void
+skin_image_disk_cache_store( const char*      path,
+                             const uint32_t*  pixels,
+                             unsigned         w,
+                             unsigned         h )
+{
+    char         entry[PATH_MAX];
+    char         temp[PATH_MAX];
+    char*        end = temp + sizeof(temp);
+    static const char  padding[4];
+    CacheHeader  header;
+    struct stat  st;
+    size_t       path_len = strlen(path);
+    size_t       pad      = cache_pixels_offset(path_len) - sizeof(header) - path_len;
+    size_t       size     = (size_t)w * h * 4;
+    FILE*        f;
+    int          ok;
+
+    if (w == 0 || h == 0)
+        return;
+    if (cache_get_entry(path, entry, entry + sizeof(entry)) == NULL)
+        return;
+    if (stat(path, &st) < 0)
+        return;
+    if (path_mkdir_if_needed(cache_get_dir(), 0755) < 0)
+        return;
+
+    /* write a temporary file then rename it, so that concurrent emulators
+     * never see a partial entry */
+    if (bufprint(temp, end, "%s.%d.tmp", entry, (int)getpid()) >= end)
+        return;
+
+    f = fopen(temp, "wb");
+    if (f == NULL)
+        return;
+
+    memset(&header, 0, sizeof(header));
+    header.magic      = CACHE_MAGIC;
+    header.version    = CACHE_VERSION;
+    header.file_size  = st.st_size;
+    header.file_mtime = st.st_mtime;
+    header.width      = w;
+    header.height     = h;
+    header.path_len   = path_len;
+
+    ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+         fwrite(path, 1, path_len, f) == path_len &&
+         fwrite(padding, 1, pad, f) == pad &&
+         fwrite(pixels, 1, size, f) == size;
+    if (fclose(f) != 0)
+        ok = 0;
+
+#ifdef _WIN32
+    /* rename() doesn't replace an existing file on Windows */
+    if (ok)
+        unlink(entry);
+#endif
+    if (!ok || rename(temp, entry) < 0) {
+        D("skin image cache: could not store '%s'\n", path);
+        unlink(temp);
+    }
+}
@@ -0,0 +1,54 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#ifndef _ANDROID_SKIN_IMAGE_DISK_CACHE_H
+#define _ANDROID_SKIN_IMAGE_DISK_CACHE_H
+
+#include "android/utils/compiler.h"
+
+#include <stdint.h>
+
+ANDROID_BEGIN_HEADER
+
+/* A cache of decoded skin images, kept on disk across emulator launches
+ * so that the PNG files don't have to be decoded each time.
+ *
+ * Each entry holds the 32-bit ARGB pixels of one image file, as used by
+ * skin_image_load(), and is only valid for the path, size and modification
+ * time of the file it was decoded from. Any error just results in a cache
+ * miss.
+ */
+
+/* Set the directory of the cache, NULL disables the cache. By default, it
+ * is the 'skin-cache' directory of the user's configuration directory,
+ * created when needed.
+ */
+extern void  skin_image_disk_cache_set_dir( const char*  dir );
+
+/* Return the pixels of the image file |path| from the cache, as a buffer
+ * to be released with free(), and set |*w| and |*h| to its size. Return
+ * NULL if the cache has no valid entry for the file.
+ */
+extern uint32_t*  skin_image_disk_cache_load( const char*  path,
+                                              unsigned*    w,
+                                              unsigned*    h );
+
+/* Store the |w| x |h| ARGB |pixels| decoded from the image file |path|
+ * into the cache.
+ */
+extern void  skin_image_disk_cache_store( const char*      path,
+                                          const uint32_t*  pixels,
+                                          unsigned         w,
+                                          unsigned         h );
+
+ANDROID_END_HEADER
+
+#endif /* _ANDROID_SKIN_IMAGE_DISK_CACHE_H */
@@ -0,0 +1,148 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/skin/image-disk-cache.h"
+
+#include "android/base/String.h"
+#include "android/base/testing/TestTempDir.h"
+
+#include <gtest/gtest.h>
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <utime.h>
+
+namespace android_skin {
+
+using android::base::String;
+using android::base::TestTempDir;
+
+namespace {
+
+class ImageDiskCacheTest : public ::testing::Test {
+public:
+    ImageDiskCacheTest() : mTempDir("skin_image_disk_cache") {
+        mCacheDir = mTempDir.pathString();
+        mCacheDir += "/cache";
+        mImage = mTempDir.pathString();
+        mImage += "/image.png";
+        skin_image_disk_cache_set_dir(mCacheDir.c_str());
+        writeFile(mImage.c_str(), "not really a png");
+        for (unsigned i = 0; i < sizeof(mPixels) / sizeof(mPixels[0]); ++i) {
+            mPixels[i] = 0xff000000 | (i * 0x010203);
+        }
+    }
+
+    ~ImageDiskCacheTest() {
+        skin_image_disk_cache_set_dir(NULL);
+    }
+
+    static void writeFile(const char* path, const char* content) {
+        FILE* f = fopen(path, "wb");
+        ASSERT_TRUE(f);
+        fputs(content, f);
+        fclose(f);
+    }
+
+protected:
+    TestTempDir mTempDir;
+    String mCacheDir;
+    String mImage;
+    uint32_t mPixels[4 * 3];
+};
+
+}  // namespace
+
+TEST_F(ImageDiskCacheTest, MissingEntry) {
+    unsigned w = 0, h = 0;
+    EXPECT_FALSE(skin_image_disk_cache_load(mImage.c_str(), &w, &h));
+}
+
+TEST_F(ImageDiskCacheTest, StoreAndLoad) {
+    skin_image_disk_cache_store(mImage.c_str(), mPixels, 4, 3);
+
+    unsigned w = 0, h = 0;
+    uint32_t* pixels = skin_image_disk_cache_load(mImage.c_str(), &w, &h);
+    ASSERT_TRUE(pixels);
+    EXPECT_EQ(4U, w);
+    EXPECT_EQ(3U, h);
+    EXPECT_EQ(0, memcmp(mPixels, pixels, sizeof(mPixels)));
+    free(pixels);
+}
+
+TEST_F(ImageDiskCacheTest, OtherPath) {
+    String other = mTempDir.pathString();
+    other += "/other.png";
+    writeFile(other.c_str(), "not really a png");
+    skin_image_disk_cache_store(mImage.c_str(), mPixels, 4, 3);
+
+    unsigned w = 0, h = 0;
+    EXPECT_FALSE(skin_image_disk_cache_load(other.c_str(), &w, &h));
+}
+
+TEST_F(ImageDiskCacheTest, ModifiedFile) {
+    skin_image_disk_cache_store(mImage.c_str(), mPixels, 4, 3);
+
+    // Change the modification time.
+    struct stat st;
+    ASSERT_EQ(0, stat(mImage.c_str(), &st));
+    struct utimbuf times;
+    times.actime = st.st_atime;
+    times.modtime = st.st_mtime - 10;
+    ASSERT_EQ(0, utime(mImage.c_str(), &times));
+
+    unsigned w = 0, h = 0;
+    EXPECT_FALSE(skin_image_disk_cache_load(mImage.c_str(), &w, &h));
+
+    // Then the size.
+    skin_image_disk_cache_store(mImage.c_str(), mPixels, 4, 3);
+    ASSERT_EQ(0, utime(mImage.c_str(), &times));
+    writeFile(mImage.c_str(), "a png of another size");
+    ASSERT_EQ(0, utime(mImage.c_str(), &times));
+    EXPECT_FALSE(skin_image_disk_cache_load(mImage.c_str(), &w, &h));
+}
+
+TEST_F(ImageDiskCacheTest, TruncatedEntry) {
+    skin_image_disk_cache_store(mImage.c_str(), mPixels, 4, 3);
+
+    // Replace the only entry of the cache with a truncated one.
+    String entry;
+    DIR* dir = opendir(mCacheDir.c_str());
+    ASSERT_TRUE(dir);
+    while (struct dirent* d = readdir(dir)) {
+        if (d->d_name[0] != '.') {
+            entry = mCacheDir;
+            entry += "/";
+            entry += d->d_name;
+        }
+    }
+    closedir(dir);
+    ASSERT_TRUE(entry.size());
+    writeFile(entry.c_str(), "SKIC");
+
+    unsigned w = 0, h = 0;
+    EXPECT_FALSE(skin_image_disk_cache_load(mImage.c_str(), &w, &h));
+}
+
+TEST_F(ImageDiskCacheTest, Disabled) {
+    skin_image_disk_cache_set_dir(NULL);
+    skin_image_disk_cache_store(mImage.c_str(), mPixels, 4, 3);
+
+    struct stat st;
+    EXPECT_NE(0, stat(mCacheDir.c_str(), &st));
+    unsigned w = 0, h = 0;
+    EXPECT_FALSE(skin_image_disk_cache_load(mImage.c_str(), &w, &h));
+}
+
+}  // namespace android_skin
@@ -10,6 +10,7 @@
 ** GNU General Public License for more details.
 */
 #include "android/skin/image.h"
+#include "android/skin/image-disk-cache.h"
 #include "android/skin/resource.h"
 
 #include <assert.h>
@@ -311,6 +312,12 @@ skin_image_load( SkinImage*  image )
             return -1;
         }
     } else {
+        /* the pixels of the image files are cached on disk in their final
+         * ARGB layout */
+        data = skin_image_disk_cache_load(path, &w, &h);
+        if (data != NULL)
+            goto done;
+
         data = loadpng(path, &w, &h);
         if (data == NULL) {
             fprintf(stderr, "failed to load image file '%s'\n", path );
@@ -339,6 +346,10 @@ skin_image_load( SkinImage*  image )
         }
     }
 
+    if (path[0] != ':')
+        skin_image_disk_cache_store(path, data, w, h);
+
+done:
     image->pixels = data;
     image->w      = w;
     image->h      = h;
@@ -722,6 +733,12 @@ skin_image_h( SkinImage*  image )
     return  image ? image->h : 0;
 }
 
+const uint32_t*
+skin_image_pixels( SkinImage*  image )
+{
+    return  image ? image->pixels : NULL;
+}
+
 int
 skin_image_org_w( SkinImage*  image )
 {
@@ -41,6 +41,9 @@ extern SkinImage*    SKIN_IMAGE_NONE;
 extern SkinSurface*  skin_image_surface( SkinImage*  image );
 extern int           skin_image_w      ( SkinImage*  image );
 extern int           skin_image_h      ( SkinImage*  image );
+/* return the 32-bit ARGB pixels of a given skin image, w*h words without
+ * padding, or NULL for SKIN_IMAGE_NONE */
+extern const uint32_t*  skin_image_pixels( SkinImage*  image );
 extern int           skin_image_org_w  ( SkinImage*  image );
 extern int           skin_image_org_h  ( SkinImage*  image );
 
@@ -110,12 +110,25 @@ void EmulatorWindow::mouseReleaseEvent(QMouseEvent *event)
     handleEvent(kEventMouseButtonUp, event);
 }
 
-void EmulatorWindow::paintEvent(QPaintEvent *)
+void EmulatorWindow::paintEvent(QPaintEvent *event)
 {
     if (backing_surface) {
         QPainter painter(this);
-        QRect r(0, 0, backing_surface->w, backing_surface->h);
-        painter.drawImage(r, *backing_surface->bitmap);
+        const QImage &bitmap = *backing_surface->bitmap;
+        QRect r = event->rect() & QRect(0, 0, backing_surface->w, backing_surface->h);
+        if (r.isEmpty()) {
+            return;
+        }
+        // Only draw the damaged part of the bitmap, without scaling it
+        // when the window has the size of the skin.
+        if (backing_surface->w == bitmap.width() && backing_surface->h == bitmap.height()) {
+            painter.drawImage(r.topLeft(), bitmap, r);
+        } else {
+            qreal sx = (qreal)bitmap.width() / backing_surface->w;
+            qreal sy = (qreal)bitmap.height() / backing_surface->h;
+            QRectF source(r.x() * sx, r.y() * sy, r.width() * sx, r.height() * sy);
+            painter.drawImage(QRectF(r), bitmap, source);
+        }
     } else {
         D("Painting emulator window, but no backing bitmap");
     }
@@ -147,6 +160,35 @@ void EmulatorWindow::wheelEvent(QWheelEvent *event)
 
 void EmulatorWindow::slot_blit(QImage *src, QRect *srcRect, QImage *dst, QPoint *dstPos, QPainter::CompositionMode *op, QSemaphore *semaphore)
 {
+    if (*op == QPainter::CompositionMode_Source && src->format() == dst->format()) {
+        // Plain copy between bitmaps of the same format (e.g. the display
+        // into the window): move the rows instead of going through QPainter.
+        QPoint offset = *dstPos - srcRect->topLeft();
+        QRect d = (*srcRect & src->rect()).translated(offset) & dst->rect();
+        QRect s = d.translated(-offset);
+        if (!d.isEmpty()) {
+            int bpp = src->depth() / 8;
+            int s_pitch = src->bytesPerLine();
+            int d_pitch = dst->bytesPerLine();
+            const uchar *s_line = src->constBits() + s.y() * s_pitch + s.x() * bpp;
+            uchar *d_line = dst->bits() + d.y() * d_pitch + d.x() * bpp;
+            if (src == dst && d.y() > s.y()) {
+                // Overlapping rows, copy from the bottom.
+                s_line += (d.height() - 1) * s_pitch;
+                d_line += (d.height() - 1) * d_pitch;
+                s_pitch = -s_pitch;
+                d_pitch = -d_pitch;
+            }
+            for (int y = 0; y < d.height(); y++) {
+                memmove(d_line, s_line, d.width() * bpp);
+                s_line += s_pitch;
+                d_line += d_pitch;
+            }
+        }
+        if (semaphore != NULL) semaphore->release();
+        return;
+    }
+
     QPainter painter(dst);
     painter.setCompositionMode(*op);
     painter.drawImage(*dstPos, *src, *srcRect);
@@ -239,6 +281,22 @@ void EmulatorWindow::slot_pollEvent(SkinEvent *event, bool *hasEvent, QSemaphore
 
 void EmulatorWindow::slot_queueEvent(SkinEvent *event, QSemaphore *semaphore)
 {
+    // The UI loop polls the events once per frame. Coalesce the motion
+    // events received in between, so that the guest only gets the last
+    // position instead of every sample of a high-rate mouse or trackpad.
+    if (event->type == kEventMouseMotion && !event_queue.isEmpty()) {
+        SkinEvent *last = event_queue.last();
+        if (last->type == kEventMouseMotion &&
+            last->u.mouse.button == event->u.mouse.button) {
+            last->u.mouse.x = event->u.mouse.x;
+            last->u.mouse.y = event->u.mouse.y;
+            last->u.mouse.xrel += event->u.mouse.xrel;
+            last->u.mouse.yrel += event->u.mouse.yrel;
+            delete event;
+            if (semaphore != NULL) semaphore->release();
+            return;
+        }
+    }
     event_queue.enqueue(event);
     if (semaphore != NULL) semaphore->release();
 }
@@ -222,16 +222,22 @@ extern void skin_surface_upload(SkinSurface *surface, SkinRect *rect, const void
 #if 0
     D("skin_surface_upload %d: %d,%d,%d,%d", surface->id, rect->pos.x, rect->pos.y, rect->size.w, rect->size.h);
 #endif
-    uint32_t *src = ((uint32_t*)pixels);
-    uint32_t *dst = ((uint32_t*)surface->bitmap->bits()) + surface->w * rect->pos.y;
-    int num = 0;
-    for (int y = rect->pos.y; y < rect->pos.y + rect->size.h; y++) {
-        for (int x = rect->pos.x; x < rect->pos.x + rect->size.w; x++) {
-            *(dst + x) = *(src + x -rect->pos.x);
-            num++;
-        }
-        src += pitch / sizeof(uint32_t);
-        dst += surface->w;
+    QImage *bitmap = surface->bitmap;
+    QRect r(0, 0, bitmap->width(), bitmap->height());
+    if (rect) {
+        r = r.intersected(QRect(rect->pos.x, rect->pos.y, rect->size.w, rect->size.h));
+    }
+    if (r.isEmpty()) {
+        return;
+    }
+    // Copy whole rows, using the stride of the bitmap.
+    const uint8_t *src = (const uint8_t*)pixels;
+    int dst_pitch = bitmap->bytesPerLine();
+    uint8_t *dst = bitmap->bits() + r.y() * dst_pitch + r.x() * 4;
+    for (int y = 0; y < r.height(); y++) {
+        memcpy(dst, src, r.width() * 4);
+        src += pitch;
+        dst += dst_pitch;
     }
 }
 
@@ -10,37 +10,10 @@
 ** GNU General Public License for more details.
 */
 #include "android/skin/region.h"
-#include <limits.h>
-#include <string.h>
-#include <stdlib.h>  /* malloc/free */
-
-/*************************************************************************
- *************************************************************************
- ****
- ****  ASSERTION SUPPORT
- ****
- ****
- ****/
-
-#ifdef UNIT_TEST
-#include <stdlib.h>
-#include <stdio.h>
-static void
-_rpanic(void)
-{
-    *((char*)(void*)0) = 1;  /* should SEGFAULT */
-    /* put a breakpoint here */
-    exit(1);
-}
-
-#define  RASSERT(cond)   \
-  ({ if (!(cond)) { fprintf(stderr, "%s:%d:%s: assertion failed: %s", \
-      __FILE__, __LINE__,  __FUNCTION__, #cond ); _rpanic(); } })
 
-#else
-#define  RASSERT(cond)  ((void)0)
-#endif
+#include "android/utils/system.h"
 
+#include <string.h>
 
 /*************************************************************************
  *************************************************************************
@@ -50,298 +23,436 @@ _rpanic(void)
  ****
  ****/
 
-/* this implementation of regions encodes the the region's spans with the
-   following format:
+/* this implementation of regions follows the one of the X server and
+   Pixman: a region is an array of boxes in y-x banded order (see region.h),
+   and all set operations are performed by region_op(), which walks the
+   bands of both operands from top to bottom, and calls an operator-specific
+   function on each pair of overlapping bands.
 
-   region   ::= yband+ YSENTINEL
-   yband    ::= YTOP YBOTTOM scanline
-   scanline ::= span+  XSENTINEL
-   span     ::= XLEFT XRIGHT
+   the result of region_op() is always in canonical form, i.e. the boxes
+   of a band never touch, and identical bands that touch vertically are
+   coalesced. this allows comparing regions with a single memcmp().
 
-   XSENTINEL ::= 0x7fff
-   YSENTINEL :=  0x7fff
-
-   all values are sorted in increasing order, which means that:
-
-    - YTOP1 < YBOTTOM1 <= YTOP2 < YBOTTOM2 <= .... < YSENTINEL
-    - XLEFT1 < XRIGHT1 < XLEFT2 < XRIGHT2 < .... < XSENTINEL
-      (in a given scanline)
-*/
+   a few common cases, like adding a rectangle below the current region,
+   which is what damage tracking mostly does, are handled in place. */
 
-/* convenience shortbuts */
-typedef SkinRegionRun   Run;
-typedef SkinRegion      Region;
+typedef SkinRegion  Region;
+typedef SkinBox     Box;
 
-#define  RUNS_RECT_COUNT  6   /* YTOP YBOT XLEFT XRIGHT XSENTINEL YSENTINEL */
+#define  MIN(a,b)  ((a) < (b) ? (a) : (b))
+#define  MAX(a,b)  ((a) > (b) ? (a) : (b))
 
-#define  XSENTINEL  SKIN_REGION_SENTINEL
-#define  YSENTINEL  SKIN_REGION_SENTINEL
-
-#define  RUNS_EMPTY   ((Run*)(void*)(-1))
-#define  RUNS_RECT    ((Run*)(void*)(0))
+static __inline__ Box*
+region_boxes( const Region*  r )
+{
+    return r->boxes ? r->boxes : (Box*) r->inline_boxes;
+}
 
-static __inline__ bool
-region_isEmpty(const Region*  r) {
-    return r->runs == RUNS_EMPTY;
+static __inline__ int
+region_capacity( const Region*  r )
+{
+    return r->boxes ? r->capacity : SKIN_REGION_INLINE_BOXES;
 }
 
 static __inline__ bool
-region_isRect(const Region* r) {
-    return r->runs == RUNS_RECT;
+box_contains_box( const Box*  a, const Box*  b )
+{
+    return (b->x1 >= a->x1 && b->x2 <= a->x2 &&
+            b->y1 >= a->y1 && b->y2 <= a->y2);
 }
 
 static __inline__ bool
-region_isComplex(const Region* r) {
-    return r->runs != RUNS_EMPTY && r->runs != RUNS_RECT;
+box_intersects_box( const Box*  a, const Box*  b )
+{
+    return (a->x1 < b->x2 && b->x1 < a->x2 &&
+            a->y1 < b->y2 && b->y1 < a->y2);
 }
 
-/**  RunStore: ref-counted storage for runs
- **/
+/* make sure |r| can hold |count| boxes, keeping the current ones */
+static Box*
+region_reserve( Region*  r, int  count )
+{
+    int  capacity = region_capacity(r);
 
-typedef struct {
-    int  refcount;
-    int  count;
-} RunStore;
+    if (count > capacity) {
+        while (capacity < count)
+            capacity *= 2;
 
-static void
-runstore_free( RunStore*  s )
-{
-    free(s);
+        if (r->boxes == NULL) {
+            AARRAY_NEW(r->boxes, capacity);
+            AARRAY_COPY(r->boxes, r->inline_boxes, r->num_boxes);
+        } else {
+            AARRAY_RENEW(r->boxes, capacity);
+        }
+        r->capacity = capacity;
+    }
+    return region_boxes(r);
 }
 
-static RunStore*
-runstore_alloc( int   count )
+/* move the boxes of |r| back to the inline storage if they fit */
+static void
+region_compact( Region*  r )
 {
-    RunStore*  s = malloc( sizeof(*s) + sizeof(Run)*count );
-    RASSERT(s != NULL);
-    s->count    = count;
-    s->refcount = 1;
-    return s;
+    if (r->boxes != NULL && r->num_boxes <= SKIN_REGION_INLINE_BOXES) {
+        AARRAY_COPY(r->inline_boxes, r->boxes, r->num_boxes);
+        AFREE(r->boxes);
+        r->boxes    = NULL;
+        r->capacity = 0;
+    }
 }
 
-static RunStore*
-runstore_edit( RunStore*  s )
+static __inline__ void
+region_append( Region*  r, int  x1, int  y1, int  x2, int  y2 )
 {
-    RunStore*  s2;
+    Box*  b;
 
-    if (s->refcount == 1)
-        return s;
+    if (r->num_boxes >= region_capacity(r))
+        region_reserve(r, r->num_boxes + 1);
 
-    s2 = runstore_alloc( s->count );
-    if (s2) {
-        memcpy( s2, s, sizeof(*s) + s->count*sizeof(Run) );
-        s->refcount -= 1;
-        s2->refcount = 1;
-    }
-    return s2;
+    b = region_boxes(r) + r->num_boxes++;
+    b->x1 = x1;
+    b->y1 = y1;
+    b->x2 = x2;
+    b->y2 = y2;
 }
 
+/* replace the boxes of |r| with the single box |b|, keeping its storage */
 static void
-runstore_unrefp( RunStore*  *ps )
+region_set_box( Region*  r, const Box*  b )
 {
-    RunStore*  s = *ps;
-    if (s != NULL) {
-        if (s->refcount <= 0)
-            runstore_free(s);
-        *ps = NULL;
-    }
+    region_boxes(r)[0] = *b;
+    r->num_boxes = 1;
+    r->extents   = *b;
 }
 
-static RunStore*
-runstore_ref( RunStore*  s )
+static void
+region_update_extents( Region*  r )
 {
-    if (s) s->refcount += 1;
-    return s;
-}
+    const Box*  b   = region_boxes(r);
+    const Box*  end = b + r->num_boxes;
 
-static __inline__ RunStore*
-runstore_from_runs(const Run* runs) {
-    RASSERT(runs != RUNS_EMPTY);
-    RASSERT(runs != RUNS_RECT);
-    return (RunStore*)runs - 1;
+    if (b == end) {
+        r->extents.x1 = r->extents.y1 = 0;
+        r->extents.x2 = r->extents.y2 = 0;
+        return;
+    }
+    r->extents.y1 = b[0].y1;
+    r->extents.y2 = end[-1].y2;
+    r->extents.x1 = b[0].x1;
+    r->extents.x2 = b[0].x2;
+    for (b++; b < end; b++) {
+        if (b->x1 < r->extents.x1) r->extents.x1 = b->x1;
+        if (b->x2 > r->extents.x2) r->extents.x2 = b->x2;
+    }
 }
 
-static __inline__ Run*
-runstore_to_runs( RunStore*  s )
+/* return the end of the band that starts at |b| */
+static __inline__ const Box*
+band_end( const Box*  b, const Box*  end )
 {
-    RASSERT(s != NULL);
-    return (Run*)(s + 1);
+    int  y1 = b->y1;
+
+    do { b++; } while (b < end && b->y1 == y1);
+    return b;
 }
 
-static Run*
-region_edit( Region*  r )
+/* if the band of |r| in [prev, cur) and the one in [cur, end) touch and
+   have the same boxes, extend the first one and remove the second one.
+   returns the start of the band that now ends at |end| or before it */
+static int
+region_coalesce( Region*  r, int  prev, int  cur, int  end )
 {
-    RunStore*  s;
+    Box*  boxes = region_boxes(r);
+    int   count = cur - prev;
+    int   n;
 
-    RASSERT(region_isComplex(r));
+    if (count == 0 || count != end - cur)
+        return cur;
 
-    s = runstore_from_runs(r->runs);
-    s = runstore_edit(s);
-    r->runs = runstore_to_runs(s);
-    return r->runs;
-}
+    if (boxes[prev].y2 != boxes[cur].y1)
+        return cur;
 
-/** Run parsing
- **/
+    for (n = 0; n < count; n++) {
+        if (boxes[prev + n].x1 != boxes[cur + n].x1 ||
+            boxes[prev + n].x2 != boxes[cur + n].x2)
+            return cur;
+    }
+
+    for (n = 0; n < count; n++)
+        boxes[prev + n].y2 = boxes[cur].y2;
+
+    AARRAY_MOVE(boxes + cur, boxes + end, r->num_boxes - end);
+    r->num_boxes -= count;
+    return prev;
+}
 
-static Run*
-runs_next_scanline( Run*  runs )
+/* append the boxes in [b, end) to |r|, clipped to [y1, y2) */
+static void
+region_append_band( Region*  r, const Box*  b, const Box*  end,
+                    int  y1, int  y2 )
 {
-    RASSERT(runs[0] != YSENTINEL && runs[1] != YSENTINEL );
-    runs += 2;
-    do { runs += 1; } while (runs[-1] != XSENTINEL);
-    return runs;
+    for ( ; b < end; b++)
+        region_append(r, b->x1, y1, b->x2, y2);
 }
 
-static Run*
-runs_find_y( Run*  runs, int  y )
+/* append the boxes of |r2| to |r|, which must be above it */
+static void
+region_append_region( Region*  r, const Region*  r2 )
 {
-    do {
-        int  ybot, ytop = runs[0];
+    const Box*  boxes2 = region_boxes(r2);
+    Box*        boxes  = region_reserve(r, r->num_boxes + r2->num_boxes);
+    int         cur    = r->num_boxes;
+    int         prev   = cur;
 
-        if (y < ytop)
-            return NULL;
+    /* find the start of the last band */
+    while (prev > 0 && boxes[prev - 1].y1 == boxes[cur - 1].y1)
+        prev--;
 
-        ybot = runs[1];
-        if (y < ybot)
-            return runs;
+    AARRAY_COPY(boxes + cur, boxes2, r2->num_boxes);
+    r->num_boxes += r2->num_boxes;
 
-        runs = runs_next_scanline( runs );
-    } while (runs[0] != YSENTINEL);
+    region_coalesce(r, prev, cur,
+                    band_end(boxes2, boxes2 + r2->num_boxes) - boxes2 + cur);
 
-    return NULL;
+    r->extents.x1 = MIN(r->extents.x1, r2->extents.x1);
+    r->extents.x2 = MAX(r->extents.x2, r2->extents.x2);
+    r->extents.y2 = r2->extents.y2;
 }
 
-static void runs_set_rect(Run* runs, const SkinRect* rect) {
-    runs[0] = rect->pos.y;
-    runs[1] = rect->pos.y + rect->size.h;
-    runs[2] = rect->pos.x;
-    runs[3] = rect->pos.x + rect->size.w;
-    runs[4] = XSENTINEL;
-    runs[5] = YSENTINEL;
-}
+/** Band operators
+ **/
 
-static Run* runs_copy_scanline(Run* dst, const Run* src) {
-    RASSERT(src[0] != YSENTINEL);
-    RASSERT(src[1] != YSENTINEL);
-    dst[0] = src[0];
-    dst[1] = src[1];
-    src += 2;
-    dst += 2;
-    do { *dst++ = *src++; } while (src[-1] != XSENTINEL);
-    return dst;
-}
+/* append to |r| the result of an operation on the band [b1, e1) of the
+   first region and [b2, e2) of the second one, in the rows [y1, y2) */
+typedef void (*OverlapFunc)( Region*     r,
+                             const Box*  b1,
+                             const Box*  e1,
+                             const Box*  b2,
+                             const Box*  e2,
+                             int         y1,
+                             int         y2 );
 
-static Run* runs_copy_scanline_adj(Run* dst, const Run* src, int ytop, int ybot ) {
-    Run*  runs2 = runs_copy_scanline( dst, src );
-    dst[0] = (Run) ytop;
-    dst[1] = (Run) ybot;
-    return runs2;
-}
+static void
+union_o( Region*     r,
+         const Box*  b1,
+         const Box*  e1,
+         const Box*  b2,
+         const Box*  e2,
+         int         y1,
+         int         y2 )
+{
+    int  x1, x2;
+
+    /* merge the spans of both bands in increasing x1 order, merging the
+       ones that overlap or touch */
+    if (b1->x1 < b2->x1) {
+        x1 = b1->x1;
+        x2 = b1->x2;
+        b1++;
+    } else {
+        x1 = b2->x1;
+        x2 = b2->x2;
+        b2++;
+    }
 
-static __inline__ Run*
-runs_add_span( Run*  dst, int  left, int  right )
-{
-    dst[0] = (Run) left;
-    dst[1] = (Run) right;
-    return dst + 2;
-}
+    while (b1 != e1 || b2 != e2) {
+        const Box*  b;
 
-static __inline__ int runs_get_count(const Run* runs) {
-    RunStore*  s = runstore_from_runs(runs);
-    return s->count;
-}
+        if (b2 == e2 || (b1 != e1 && b1->x1 < b2->x1))
+            b = b1++;
+        else
+            b = b2++;
 
+        if (b->x1 <= x2) {
+            if (b->x2 > x2)
+                x2 = b->x2;
+        } else {
+            region_append(r, x1, y1, x2, y2);
+            x1 = b->x1;
+            x2 = b->x2;
+        }
+    }
+    region_append(r, x1, y1, x2, y2);
+}
 
 static void
-runs_coalesce_band( Run*  *psrc_spans, Run*  *pdst_spans, SkinBox*  minmax )
+intersect_o( Region*     r,
+             const Box*  b1,
+             const Box*  e1,
+             const Box*  b2,
+             const Box*  e2,
+             int         y1,
+             int         y2 )
 {
-    Run*  sspan  = *psrc_spans;
-    Run*  dspan  = *pdst_spans;
-    int   pleft  = sspan[0];
-    int   pright = sspan[1];
-    int   xleft, xright;
+    while (b1 != e1 && b2 != e2) {
+        int  x1 = MAX(b1->x1, b2->x1);
+        int  x2 = MIN(b1->x2, b2->x2);
 
-    RASSERT(pleft != XSENTINEL);
-    RASSERT(pright != XSENTINEL);
-    RASSERT(pleft < pright);
+        if (x1 < x2)
+            region_append(r, x1, y1, x2, y2);
 
-    if (pleft < minmax->x1) minmax->x1 = pleft;
-
-    sspan += 2;
-    xleft  = sspan[0];
-
-    while (xleft != XSENTINEL)
-    {
-        xright = sspan[1];
-        RASSERT(xright != XSENTINEL);
-        RASSERT(xleft < xright);
+        /* advance the span(s) that end first */
+        if (b1->x2 == x2)
+            b1++;
+        if (b2->x2 == x2)
+            b2++;
+    }
+}
 
-        if (xleft == pright) {
-            pright = xright;
+static void
+subtract_o( Region*     r,
+            const Box*  b1,
+            const Box*  e1,
+            const Box*  b2,
+            const Box*  e2,
+            int         y1,
+            int         y2 )
+{
+    /* |x1| is the left edge of what remains of the minuend span |b1| */
+    int  x1 = b1->x1;
+
+    while (b1 != e1 && b2 != e2) {
+        if (b2->x2 <= x1) {
+            /* subtrahend entirely to the left */
+            b2++;
+        } else if (b2->x1 <= x1) {
+            /* subtrahend covers the left part of the minuend */
+            x1 = b2->x2;
+            if (x1 >= b1->x2) {
+                b1++;
+                if (b1 != e1)
+                    x1 = b1->x1;
+            } else {
+                b2++;
+            }
+        } else if (b2->x1 < b1->x2) {
+            /* subtrahend splits the minuend */
+            region_append(r, x1, y1, b2->x1, y2);
+            x1 = b2->x2;
+            if (x1 >= b1->x2) {
+                b1++;
+                if (b1 != e1)
+                    x1 = b1->x1;
+            } else {
+                b2++;
+            }
         } else {
-            dspan[0] = (Run) pleft;
-            dspan[1] = (Run) pright;
-            dspan   += 2;
+            /* minuend entirely to the left */
+            if (b1->x2 > x1)
+                region_append(r, x1, y1, b1->x2, y2);
+            b1++;
+            if (b1 != e1)
+                x1 = b1->x1;
         }
-        sspan += 2;
-        xleft = sspan[0];
     }
-    dspan[0] = (Run) pleft;
-    dspan[1] = (Run) pright;
-    dspan[2] = XSENTINEL;
-    dspan   += 3;
-    sspan   += 1;  /* skip XSENTINEL */
-
-    if (pright > minmax->x2) minmax->x2 = pright;
 
-    *psrc_spans = sspan;
-    *pdst_spans = dspan;
+    while (b1 != e1) {
+        region_append(r, x1, y1, b1->x2, y2);
+        b1++;
+        if (b1 != e1)
+            x1 = b1->x1;
+    }
 }
 
-
-static int
-runs_coalesce( Run*  dst, Run*  src, SkinBox*  minmax )
-{
-    Run*  prev = NULL;
-    Run*  dst0 = dst;
-    int   ytop = src[0];
-    int   ybot;
-
-    while (ytop != YSENTINEL)
-    {
-        Run*  sspan = src + 2;
-        Run*  dspan = dst + 2;
-
-        ybot = src[1];
-        RASSERT( ytop < ybot );
-        RASSERT( ybot != YSENTINEL );
-        RASSERT( src[2] != XSENTINEL );
-
-        if (ytop < minmax->y1) minmax->y1 = ytop;
-        if (ybot > minmax->y2) minmax->y2 = ybot;
-
-        dst[0] = (Run) ytop;
-        dst[1] = (Run) ybot;
-
-        runs_coalesce_band( &sspan, &dspan, minmax );
-
-        if (prev && prev[1] == dst[0] && (dst-prev) == (dspan-dst) &&
-            !memcmp(prev+2, dst+2, (dspan-dst-2)*sizeof(Run)))
-        {
-            /* coalesce two identical bands */
-            prev[1] = dst[1];
+/* compute into the empty region |result| an operation on the non-empty
+   regions |r1| and |r2|. |overlap| is called on the rows covered by both
+   of them, and the rows covered by |r1| (resp. |r2|) only are copied if
+   |append1| (resp. |append2|) is true. */
+static void
+region_op( Region*        result,
+           const Region*  r1,
+           const Region*  r2,
+           OverlapFunc    overlap,
+           bool           append1,
+           bool           append2 )
+{
+    const Box*  b1 = region_boxes(r1);
+    const Box*  e1 = b1 + r1->num_boxes;
+    const Box*  b2 = region_boxes(r2);
+    const Box*  e2 = b2 + r2->num_boxes;
+    int         prev = 0;
+    int         cur;
+    int         ytop, ybot;
+
+    region_reserve(result, 2 * MAX(r1->num_boxes, r2->num_boxes));
+
+    /* |ybot| is the bottom of the rows already processed */
+    ybot = MIN(b1->y1, b2->y1);
+    do {
+        const Box*  be1 = band_end(b1, e1);
+        const Box*  be2 = band_end(b2, e2);
+
+        /* rows covered by one band only, above the other one */
+        if (b1->y1 < b2->y1) {
+            if (append1) {
+                int  top = MAX(b1->y1, ybot);
+                int  bot = MIN(b1->y2, b2->y1);
+                if (top != bot) {
+                    cur = result->num_boxes;
+                    region_append_band(result, b1, be1, top, bot);
+                    prev = region_coalesce(result, prev, cur,
+                                           result->num_boxes);
+                }
+            }
+            ytop = b2->y1;
+        } else if (b2->y1 < b1->y1) {
+            if (append2) {
+                int  top = MAX(b2->y1, ybot);
+                int  bot = MIN(b2->y2, b1->y1);
+                if (top != bot) {
+                    cur = result->num_boxes;
+                    region_append_band(result, b2, be2, top, bot);
+                    prev = region_coalesce(result, prev, cur,
+                                           result->num_boxes);
+                }
+            }
+            ytop = b1->y1;
+        } else {
+            ytop = b1->y1;
         }
-        else
-        {
-            prev = dst;
-            dst  = dspan;
+
+        /* rows covered by both bands */
+        ybot = MIN(b1->y2, b2->y2);
+        if (ybot > ytop) {
+            cur = result->num_boxes;
+            overlap(result, b1, be1, b2, be2, ytop, ybot);
+            prev = region_coalesce(result, prev, cur, result->num_boxes);
         }
-        src  = sspan;
-        ytop = src[0];
+
+        if (b1->y2 == ybot)
+            b1 = be1;
+        if (b2->y2 == ybot)
+            b2 = be2;
+    } while (b1 != e1 && b2 != e2);
+
+    /* rows below the other region; only the first band can be clipped */
+    if (b1 != e1 && append1) {
+        const Box*  be1 = band_end(b1, e1);
+
+        cur = result->num_boxes;
+        region_append_band(result, b1, be1, MAX(b1->y1, ybot), b1->y2);
+        region_coalesce(result, prev, cur, result->num_boxes);
+        for (b1 = be1; b1 != e1; b1++)
+            region_append(result, b1->x1, b1->y1, b1->x2, b1->y2);
+    } else if (b2 != e2 && append2) {
+        const Box*  be2 = band_end(b2, e2);
+
+        cur = result->num_boxes;
+        region_append_band(result, b2, be2, MAX(b2->y1, ybot), b2->y2);
+        region_coalesce(result, prev, cur, result->num_boxes);
+        for (b2 = be2; b2 != e2; b2++)
+            region_append(result, b2->x1, b2->y1, b2->x2, b2->y2);
     }
-    dst[0] = YSENTINEL;
-    return (dst + 1 - dst0);
+}
+
+/* replace |r| with the result of region_op() */
+static void
+region_finish_op( Region*  r, Region*  result )
+{
+    region_update_extents(result);
+    region_compact(result);
+    skin_region_swap(r, result);
+    skin_region_reset(result);
 }
 
 /*************************************************************************
@@ -353,142 +464,110 @@ runs_coalesce( Run*  dst, Run*  src, SkinBox*  minmax )
 
 void skin_region_init_empty(SkinRegion* r) {
     /* empty region */
-    r->bounds.pos.x  = r->bounds.pos.y = 0;
-    r->bounds.size.w = r->bounds.size.h = 0;
-    r->runs = RUNS_EMPTY;
+    r->extents.x1 = r->extents.y1 = 0;
+    r->extents.x2 = r->extents.y2 = 0;
+    r->num_boxes = 0;
+    r->capacity  = 0;
+    r->boxes     = NULL;
 }
 
 void skin_region_init(SkinRegion* r, int x1, int y1, int x2, int y2) {
-    if (x1 >= x2 || y1 >= y2) {
-        skin_region_init_empty(r);
+    Box  b;
+
+    skin_region_init_empty(r);
+    if (x1 >= x2 || y1 >= y2)
         return;
-    }
-    r->bounds.pos.x  = x1;
-    r->bounds.pos.y  = y1;
-    r->bounds.size.w = x2 - x1;
-    r->bounds.size.h = y2 - y1;
-    r->runs = RUNS_RECT;
+
+    b.x1 = x1;
+    b.y1 = y1;
+    b.x2 = x2;
+    b.y2 = y2;
+    region_set_box(r, &b);
 }
 
 void skin_region_init_rect(SkinRegion* r, const SkinRect* rect) {
-    if (rect == NULL || rect->size.w <= 0 || rect->size.h <= 0) {
+    if (rect == NULL) {
         skin_region_init_empty(r);
         return;
     }
-    r->bounds = rect[0];
-    r->runs   = RUNS_RECT;
+    skin_region_init(r, rect->pos.x, rect->pos.y,
+                     rect->pos.x + rect->size.w,
+                     rect->pos.y + rect->size.h);
 }
 
 void skin_region_init_box(SkinRegion* r, const SkinBox* box) {
-    if (box == NULL || box->x1 >= box->x2 || box->y1 >= box->y2) {
+    if (box == NULL) {
         skin_region_init_empty(r);
         return;
     }
-    r->bounds.pos.x  = box->x1;
-    r->bounds.pos.y  = box->y1;
-    r->bounds.size.w = box->x2 - box->x1;
-    r->bounds.size.h = box->y2 - box->y1;
-    r->runs = RUNS_RECT;
+    skin_region_init(r, box->x1, box->y1, box->x2, box->y2);
 }
 
 void skin_region_init_copy(SkinRegion* r, const SkinRegion* src) {
-    if (src == NULL || region_isEmpty(src))
-        skin_region_init_empty(r);
-    else {
-        r[0] = src[0];
-        if (region_isComplex(src)) {
-            RunStore*  s = runstore_from_runs(r->runs);
-            runstore_ref(s);
-        }
-    }
+    skin_region_init_empty(r);
+    if (src != NULL)
+        skin_region_copy(r, src);
 }
 
-
 void skin_region_reset(SkinRegion* r) {
     if (r != NULL) {
-        if (region_isComplex(r)) {
-            RunStore*  s = runstore_from_runs(r->runs);
-            runstore_unrefp( &s );
-        }
+        AFREE(r->boxes);
         skin_region_init_empty(r);
     }
 }
 
+void skin_region_copy(SkinRegion* r, const SkinRegion* src) {
+    Box*  boxes;
 
+    if (r == src)
+        return;
 
-void skin_region_copy(SkinRegion* r, const SkinRegion* src) {
-    skin_region_reset(r);
-    skin_region_init_copy(r, src);
+    /* keep the storage of |r| if it is large enough */
+    r->num_boxes = 0;
+    boxes = region_reserve(r, src->num_boxes);
+    AARRAY_COPY(boxes, region_boxes(src), src->num_boxes);
+    r->num_boxes = src->num_boxes;
+    r->extents   = src->extents;
 }
 
-
 bool skin_region_equals(const SkinRegion*  r1, const SkinRegion*  r2) {
-    Run       *runs1, *runs2;
-    RunStore  *store1, *store2;
-
     if (r1 == r2)
         return 1;
 
-    if (!skin_rect_equals( &r1->bounds, &r2->bounds ))
+    /* regions have a single representation */
+    if (r1->num_boxes != r2->num_boxes)
         return 0;
 
-    runs1 = r1->runs;
-    runs2 = r2->runs;
-
-    if (runs1 == runs2)  /* empties and rects */
-        return 1;
-
-    if ( !region_isComplex(r1) || !region_isComplex(r2) )
-        return 0;
-
-    store1 = runstore_from_runs(runs1);
-    store2 = runstore_from_runs(runs2);
-
-    if (store1->count == store2->count &&
-        !memcmp( (char*)runs1, (char*)runs2, store1->count*sizeof(Run) ) )
-        return 1;
-
-    return 0;
+    return !memcmp(region_boxes(r1), region_boxes(r2),
+                   r1->num_boxes * sizeof(Box));
 }
 
 void
 skin_region_translate( SkinRegion*  r, int  dx, int  dy )
 {
-    Run*  runs;
+    Box*  b   = region_boxes(r);
+    Box*  end = b + r->num_boxes;
 
-    if (region_isEmpty(r))
+    if (b == end)
         return;
 
-    skin_rect_translate( &r->bounds, dx, dy );
-    if (region_isRect(r))
-        return;
-
-    runs = region_edit(r);
-    while (runs[0] != YSENTINEL) {
-        int  ytop = runs[0];
-        int  ybot = runs[1];
-
-        RASSERT(ybot != YSENTINEL);
-        runs[0] = (Run)(ytop + dy);
-        runs[1] = (Run)(ybot + dy);
-        runs += 2;
-        while (runs[0] != XSENTINEL) {
-            int  xleft  = runs[0];
-            int  xright = runs[1];
-            RASSERT(xright != YSENTINEL);
-            runs[0] = (Run)(xleft + dx);
-            runs[1] = (Run)(xright + dx);
-            runs += 2;
-        }
-        runs += 1;
+    for ( ; b < end; b++) {
+        b->x1 += dx;
+        b->y1 += dy;
+        b->x2 += dx;
+        b->y2 += dy;
     }
+    r->extents.x1 += dx;
+    r->extents.y1 += dy;
+    r->extents.x2 += dx;
+    r->extents.y2 += dy;
 }
 
 void
 skin_region_get_bounds( SkinRegion*  r, SkinRect*  bounds )
 {
     if (r != NULL) {
-        bounds[0] = r->bounds;
+        skin_box_to_rect(&r->extents, bounds);
     } else {
         bounds->pos.x  = bounds->pos.y  = 0;
         bounds->size.w = bounds->size.h = 0;
@@ -498,69 +577,82 @@ skin_region_get_bounds( SkinRegion*  r, SkinRect*  bounds )
 int
 skin_region_is_empty( SkinRegion*  r )
 {
-    return region_isEmpty(r);
+    return r->num_boxes == 0;
 }
 
 int
 skin_region_is_rect( SkinRegion*  r )
 {
-    return region_isRect(r);
+    return r->num_boxes == 1;
 }
 
 int
 skin_region_is_complex( SkinRegion*  r )
 {
-    return region_isComplex(r);
+    return r->num_boxes > 1;
 }
 
 void
 skin_region_swap( SkinRegion*  r, SkinRegion*  r2 )
 {
     SkinRegion  tmp;
+
+    /* this works with inline boxes, since they are found through
+       a NULL |boxes| pointer */
     tmp   = r[0];
     r[0]   = r2[0];
     r2[0]  = tmp;
 }
 
-
 SkinOverlap
 skin_region_contains( SkinRegion*  r, int  x, int  y )
 {
-    if (region_isEmpty(r))
+    const Box*  boxes = region_boxes(r);
+    const Box*  end   = boxes + r->num_boxes;
+    const Box*  b;
+    int         lo, hi, y1;
+
+    if (r->num_boxes == 0 ||
+        x < r->extents.x1 || x >= r->extents.x2 ||
+        y < r->extents.y1 || y >= r->extents.y2)
         return SKIN_OUTSIDE;
-    if (region_isRect(r)) {
-        return skin_rect_contains(&r->bounds,x,y);
-    } else {
-        Run*  runs = runs_find_y( r->runs, y );
-        if (runs != NULL) {
-            runs += 2;
-            do {
-                int  xright, xleft = runs[0];
-
-                if (x < xleft)  // also x < xleft == XSENTINEL
-                    break;
-                xright = runs[1];
-                if (xright == XSENTINEL)
-                    break;
-                if (x < xright)
-                    return SKIN_INSIDE;
-                runs += 2;
-            } while (runs[0] != XSENTINEL);
-        }
+
+    if (r->num_boxes == 1)
+        return SKIN_INSIDE;
+
+    /* find the first box that ends below |y| */
+    lo = 0;
+    hi = r->num_boxes;
+    while (lo < hi) {
+        int  mid = (lo + hi) / 2;
+        if (boxes[mid].y2 <= y)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    b = boxes + lo;
+    if (b == end || b->y1 > y)
         return SKIN_OUTSIDE;
+
+    for (y1 = b->y1; b < end && b->y1 == y1; b++) {
+        if (x < b->x1)
+            break;
+        if (x < b->x2)
+            return SKIN_INSIDE;
     }
+    return SKIN_OUTSIDE;
 }
 
-
 SkinOverlap
 skin_region_contains_rect( SkinRegion*  r, SkinRect*  rect )
 {
     SkinRegion  r2[1];
+
     skin_region_init_rect( r2, rect );
     return skin_region_test_intersect( r, r2 );
 }
 
-
 SkinOverlap
 skin_region_contains_box( SkinRegion*  r, SkinBox*  b )
 {
@@ -570,467 +662,79 @@ skin_region_contains_box( SkinRegion*  r, SkinBox*  b )
     return skin_region_test_intersect( r, r2 );
 }
 
-
-
-#define FLAG_REGION_1     (1 << 0)
-#define FLAG_REGION_2     (1 << 1)
-#define FLAG_REGION_BOTH  (1 << 2)
-
 SkinOverlap
 skin_region_test_intersect( SkinRegion*  r1,
                             SkinRegion*  r2 )
 {
-    Run  *runs1, *runs2;
-    Run   run2_tmp[ RUNS_RECT_COUNT ];
-    SkinRect  r;
+    SkinRegion   tmp[1];
+    SkinOverlap  result;
 
-    if (region_isEmpty(r1) || region_isEmpty(r2))
+    if (r1->num_boxes == 0 || r2->num_boxes == 0)
         return SKIN_OUTSIDE;
 
-    if ( !skin_rect_intersect( &r, &r1->bounds, &r2->bounds) )
+    if (!box_intersects_box(&r1->extents, &r2->extents))
         return SKIN_OUTSIDE;
 
-    if (region_isRect(r1)) {
-        if (region_isRect(r2)) {
-            return skin_rect_contains_rect(&r1->bounds, &r2->bounds);
-        } else {
-            SkinRegion*  tmp = r1;
-            r1 = r2;
-            r2 = tmp;
-        }
-    }
-    /* here r1 is guaranteed to be complex, r2 is either rect of complex */
-    runs1 = r1->runs;
-    if (region_isRect(r2)) {
-        runs2 = run2_tmp;
-        runs_set_rect(runs2, &r2->bounds);
-    }
-    else {
-        runs2 = r2->runs;
-    }
-
-    {
-        int   flags = 0;
-
-        while (runs1[0] != YSENTINEL && runs2[0] != YSENTINEL)
-        {
-            int  ytop1 = runs1[0];
-            int  ybot1 = runs1[1];
-            int  ytop2 = runs2[0];
-            int  ybot2 = runs2[1];
-
-            if (ybot1 <= ytop2)
-            {
-                /* band1 over band2 */
-                flags |= FLAG_REGION_1;
-                runs1 = runs_next_scanline( runs1 );
-            }
-            else if (ybot2 <= ytop1)
-            {
-                /* band2 over band1 */
-                flags |= FLAG_REGION_2;
-                runs2  = runs_next_scanline( runs2 );
-            }
-            else  /* band1 and band2 overlap */
-            {
-                Run*  span1;
-                Run*  span2;
-                int   ybot;
-
-                if (ytop1 < ytop2) {
-                    flags |= FLAG_REGION_1;
-                    ytop1 = ytop2;
-                } else if (ytop2 < ytop1) {
-                    flags |= FLAG_REGION_2;
-                    ytop2 = ytop1;
-                }
-
-                ybot = (ybot1 < ybot2) ? ybot1 : ybot2;
-
-                span1 = runs1 + 2;
-                span2 = runs2 + 2;
-
-                while (span1[0] != XSENTINEL && span2[0] != XSENTINEL)
-                {
-                    int  xleft1  = span1[0];
-                    int  xright1 = span1[1];
-                    int  xleft2  = span2[0];
-                    int  xright2 = span2[1];
-
-                    RASSERT(xright1 != XSENTINEL);
-                    RASSERT(xright2 != XSENTINEL);
-
-                    if (xright1 <= xleft2) {
-                        flags |= FLAG_REGION_1;
-                        span1 += 2;
-                    }
-                    else if (xright2 <= xleft1) {
-                        flags |= FLAG_REGION_2;
-                        span2 += 2;
-                    }
-                    else {
-                        int  xright;
-
-                        if (xleft1 < xleft2) {
-                            flags |= FLAG_REGION_1;
-                            xleft1 = xleft2;
-                        } else if (xleft2 < xleft1) {
-                            flags |= FLAG_REGION_2;
-                            xleft2 = xleft1;
-                        }
-
-                        xright = (xright1 < xright2) ? xright1 : xright2;
-
-                        flags |= FLAG_REGION_BOTH;
-
-                        if (xright == xright1)
-                            span1 += 2;
-                        if (xright == xright2)
-                            span2 += 2;
-                    }
-                }
-
-                if (span1[0] != XSENTINEL) {
-                    flags |= FLAG_REGION_1;
-                }
-
-                if (span2[0] != XSENTINEL) {
-                    flags |= FLAG_REGION_2;
-                }
-
-                if (ybot == ybot1)
-                    runs1 = runs_next_scanline( runs1 );
-
-                if (ybot == ybot2)
-                    runs2 = runs_next_scanline( runs2 );
-            }
-        }
-
-        if (runs1[0] != YSENTINEL) {
-            flags |= FLAG_REGION_1;
-        }
-
-        if (runs2[0] != YSENTINEL) {
-            flags |= FLAG_REGION_2;
-        }
-
-        if ( !(flags & FLAG_REGION_BOTH) ) {
-            /* no intersection at all */
-            return SKIN_OUTSIDE;
-        }
-
-        if ( (flags & FLAG_REGION_2) != 0 ) {
-            /* intersection + overlap */
+    if (r1->num_boxes == 1) {
+        if (box_contains_box(&r1->extents, &r2->extents))
+            return SKIN_INSIDE;
+        if (r2->num_boxes == 1)
             return SKIN_OVERLAP;
-        }
-
-        return SKIN_INSIDE;
     }
-}
-
-typedef struct {
-    Run*       runs1;
-    Run*       runs2;
-    Run*       runs_base;
-    Run*       runs;
-    RunStore*  store;
-    Region     result[1];
-    Run        runs1_rect[ RUNS_RECT_COUNT ];
-    Run        runs2_rect[ RUNS_RECT_COUNT ];
-} RegionOperator;
-
 
-static void
-region_operator_init( RegionOperator*  o,
-                      Region*          r1,
-                      Region*          r2 )
-{
-    int  run1_count, run2_count;
-    int  maxruns;
-
-    RASSERT( !region_isEmpty(r1) );
-    RASSERT( !region_isEmpty(r2) );
-
-    if (region_isRect(r1)) {
-        run1_count = RUNS_RECT_COUNT;
-        o->runs1   = o->runs1_rect;
-        runs_set_rect( o->runs1, &r1->bounds );
-    } else {
-        o->runs1   = r1->runs;
-        run1_count = runs_get_count(r1->runs);
-    }
-
-    if (region_isRect(r2)) {
-        run2_count = RUNS_RECT_COUNT;
-        o->runs2   = o->runs2_rect;
-        runs_set_rect( o->runs2, &r2->bounds );
-    } else {
-        o->runs2   = r2->runs;
-        run2_count = runs_get_count(r2->runs);
-    }
-
-    maxruns  = run1_count < run2_count ? run2_count : run1_count;
-    o->store = runstore_alloc( 3*maxruns );
-    o->runs_base = runstore_to_runs(o->store);
+    /* r2 is inside r1 iff (intersect r1 r2) == r2 */
+    skin_region_init_copy(tmp, r2);
+    if (!skin_region_intersect(tmp, r1))
+        result = SKIN_OUTSIDE;
+    else if (skin_region_equals(tmp, r2))
+        result = SKIN_INSIDE;
+    else
+        result = SKIN_OVERLAP;
+    skin_region_reset(tmp);
+    return result;
 }
 
-
-static void
-region_operator_do( RegionOperator*  o, int  wanted )
+int
+skin_region_intersect( SkinRegion*  r, SkinRegion*  r2 )
 {
-    Run*  runs1 = o->runs1;
-    Run*  runs2 = o->runs2;
-    Run*  runs  = o->runs_base;
-    int   ytop1 = runs1[0];
-    int   ytop2 = runs2[0];
-
-    if (ytop1 != YSENTINEL && ytop2 != YSENTINEL)
-    {
-        int  ybot1, ybot2;
-
-        while (ytop1 != YSENTINEL && ytop2 != YSENTINEL)
-        {
-            int  ybot;
-
-            ybot1 = runs1[1];
-            ybot2 = runs2[1];
-
-            RASSERT(ybot1 != YSENTINEL);
-            RASSERT(ybot2 != YSENTINEL);
-
-            if (ybot1 <= ytop2) {
-                if (wanted & FLAG_REGION_1)
-                    runs = runs_copy_scanline_adj( runs, runs1, ytop1, ybot1 );
-                runs1   = runs_next_scanline( runs1 );
-                ytop1   = runs1[0];
-                continue;
-            }
+    SkinRegion  result[1];
 
-            if (ybot2 <= ytop1) {
-                if (wanted & FLAG_REGION_2)
-                    runs = runs_copy_scanline_adj( runs, runs2, ytop2, ybot2 );
-                runs2 = runs_next_scanline(runs2);
-                ytop2 = runs2[0];
-                continue;
-            }
+    if (r->num_boxes == 0 || r == r2)
+        return r->num_boxes != 0;
 
-            if (ytop1 < ytop2) {
-                if (wanted & FLAG_REGION_1)
-                    runs = runs_copy_scanline_adj( runs, runs1, ytop1, ytop2 );
-                ytop1 = ytop2;
-            }
-            else if (ytop2 < ytop1) {
-                if (wanted & FLAG_REGION_2)
-                    runs = runs_copy_scanline_adj( runs, runs2, ytop2, ytop1 );
-                ytop2 = ytop1;
-            }
-
-            ybot  = (ybot1 <= ybot2) ? ybot1 : ybot2;
-
-            runs[0] = (Run) ytop1;
-            runs[1] = (Run) ybot;
-
-            /* do the common band */
-            {
-                Run*  span1 = runs1 + 2;
-                Run*  span2 = runs2 + 2;
-                Run*  span  = runs + 2;
-                int   xleft1 = span1[0];
-                int   xleft2 = span2[0];
-                int   xright1, xright2;
-
-                while (xleft1 != XSENTINEL && xleft2 != XSENTINEL)
-                {
-                    int  xright;
-
-                    xright1 = span1[1];
-                    xright2 = span2[1];
-
-                    RASSERT(xright1 != XSENTINEL);
-                    RASSERT(xright2 != XSENTINEL);
-
-                    if (xright1 <= xleft2) {
-                        if (wanted & FLAG_REGION_1)
-                            span = runs_add_span( span, xleft1, xright1 );
-                        span1 += 2;
-                        xleft1 = span1[0];
-                        continue;
-                    }
-
-                    if (xright2 <= xleft1) {
-                        if (wanted & FLAG_REGION_2)
-                            span = runs_add_span( span, xleft2, xright2 );
-                        span2 += 2;
-                        xleft2 = span2[0];
-                        continue;
-                    }
-
-                    if (xleft1 < xleft2) {
-                        if (wanted & FLAG_REGION_1)
-                            span = runs_add_span( span, xleft1, xleft2 );
-                        xleft1 = xleft2;
-                    }
-
-                    else if (xleft2 < xleft1) {
-                        if (wanted & FLAG_REGION_2)
-                            span = runs_add_span( span, xleft2, xleft1 );
-                        xleft2 = xleft1;
-                    }
-
-                    xright = (xright1 <= xright2) ? xright1 : xright2;
-
-                    if (wanted & FLAG_REGION_BOTH)
-                        span = runs_add_span( span, xleft1, xright );
-
-                    xleft1 = xleft2 = xright;
-
-                    if (xright == xright1) {
-                        span1 += 2;
-                        xleft1 = span1[0];
-                    }
-                    if (xright == xright2) {
-                        span2 += 2;
-                        xleft2 = span2[0];
-                    }
-                }
-
-                if (wanted & FLAG_REGION_1) {
-                    while (xleft1 != XSENTINEL) {
-                        RASSERT(span1[1] != XSENTINEL);
-                        span[0] = (Run) xleft1;
-                        span[1] = span1[1];
-                        span   += 2;
-                        span1  += 2;
-                        xleft1  = span1[0];
-                    }
-                }
-
-                if (wanted & FLAG_REGION_2) {
-                    while (xleft2 != XSENTINEL) {
-                        RASSERT(span2[1] != XSENTINEL);
-                        span[0] = (Run) xleft2;
-                        span[1] = span2[1];
-                        span   += 2;
-                        span2  += 2;
-                        xleft2  = span2[0];
-                    }
-                }
-
-                if (span > runs + 2) {
-                    span[0] = XSENTINEL;
-                    runs    = span + 1;
-                }
-            }
-
-            ytop1 = ytop2 = ybot;
-
-            if (ybot == ybot1) {
-                runs1 = runs_next_scanline( runs1 );
-                ytop1 = runs1[0];
-            }
-            if (ybot == ybot2) {
-                runs2 = runs_next_scanline( runs2 );
-                ytop2 = runs2[0];
-            }
-        }
-    }
-
-    if ((wanted & FLAG_REGION_1) != 0) {
-        while (ytop1 != YSENTINEL) {
-            runs = runs_copy_scanline_adj( runs, runs1, ytop1, runs1[1] );
-            runs1 = runs_next_scanline(runs1);
-            ytop1 = runs1[0];
-        }
-    }
-
-    if ((wanted & FLAG_REGION_2) != 0) {
-        while (ytop2 != YSENTINEL) {
-            runs = runs_copy_scanline_adj( runs, runs2, ytop2, runs2[1] );
-            runs2 = runs_next_scanline(runs2);
-            ytop2 = runs2[0];
-        }
-    }
-
-    runs[0] = YSENTINEL;
-    o->runs = runs + 1;
-}
-
-/* returns 1 if the result is not empty */
-static int
-region_operator_done( RegionOperator*  o )
-{
-    Run*       src = o->runs;
-    int        count;
-    SkinBox    minmax;
-    RunStore*  store;
-
-    if (src <= o->runs_base + 1) {
-        /* result is empty */
-        skin_region_init_empty( o->result );
+    if (r2->num_boxes == 0 ||
+        !box_intersects_box(&r->extents, &r2->extents)) {
+        r->num_boxes = 0;
+        region_update_extents(r);
         return 0;
     }
 
-    /* coalesce the temp runs in-place and compute the corresponding bounds */
-    minmax.x1 = minmax.y1 = INT_MAX;
-    minmax.x2 = minmax.y2 = INT_MIN;
+    if (r2->num_boxes == 1) {
+        if (box_contains_box(&r2->extents, &r->extents))
+            return 1;
 
-    count = runs_coalesce( o->runs_base, o->runs_base, &minmax );
-    if (count == 1) {
-        /* result is empty */
-        skin_region_init_empty( o->result );
-    }
-    else
-    {
-        skin_box_to_rect( &minmax, &o->result->bounds );
-        if (count == RUNS_RECT_COUNT) {
-            o->result->runs = RUNS_RECT;
-        }
-        else
-        {
-            /* result is complex */
-            store = runstore_alloc( count );
-            o->result->runs = runstore_to_runs(store);
-            memcpy( o->result->runs, o->runs_base, count*sizeof(Run) );
+        if (r->num_boxes == 1) {
+            Box  b;
+            b.x1 = MAX(r->extents.x1, r2->extents.x1);
+            b.y1 = MAX(r->extents.y1, r2->extents.y1);
+            b.x2 = MIN(r->extents.x2, r2->extents.x2);
+            b.y2 = MIN(r->extents.y2, r2->extents.y2);
+            region_set_box(r, &b);
+            return 1;
         }
     }
 
-    /* release temporary runstore */
-    runstore_unrefp( &o->store );
-
-    return region_isEmpty(o->result);
-}
-
-
-
-int
-skin_region_intersect( SkinRegion*  r, SkinRegion*  r2 )
-{
-    RegionOperator  oper[1];
-
-    if (region_isEmpty(r))
-        return 0;
-
-    if (region_isEmpty(r2))
+    if (r->num_boxes == 1 && box_contains_box(&r->extents, &r2->extents)) {
+        skin_region_copy(r, r2);
         return 1;
-
-    if ( skin_rect_contains_rect( &r->bounds, &r2->bounds ) == SKIN_OUTSIDE ) {
-        skin_region_init_empty(r);
-        return 0;
     }
 
-    region_operator_init( oper, r, r2 );
-    region_operator_do( oper, FLAG_REGION_BOTH );
-    region_operator_done( oper );
-
-    skin_region_swap( r, oper->result );
-    skin_region_reset( oper->result );
-
-    return region_isEmpty( r );
+    skin_region_init_empty(result);
+    region_op(result, r, r2, intersect_o, false, false);
+    region_finish_op(r, result);
+    return r->num_boxes != 0;
 }
 
-
-/* performs r = (intersect r (region+_from_rect rect)), returns true iff
-   the resulting region is not empty */
 int
 skin_region_intersect_rect( SkinRegion*  r, SkinRect*  rect )
 {
@@ -1040,26 +744,36 @@ skin_region_intersect_rect( SkinRegion*  r, SkinRect*  rect )
     return skin_region_intersect( r, r2 );
 }
 
-/* performs r = (union r r2) */
 void
 skin_region_union( SkinRegion*  r, SkinRegion*  r2 )
 {
-    RegionOperator  oper[1];
+    SkinRegion  result[1];
 
-    if (region_isEmpty(r)) {
+    if (r2->num_boxes == 0 || r == r2)
+        return;
+
+    if (r->num_boxes == 0) {
         skin_region_copy(r, r2);
         return;
     }
 
-    if (region_isEmpty(r2))
+    if (r->num_boxes == 1 && box_contains_box(&r->extents, &r2->extents))
         return;
 
-    region_operator_init( oper, r, r2 );
-    region_operator_do( oper, FLAG_REGION_1|FLAG_REGION_2|FLAG_REGION_BOTH );
-    region_operator_done( oper );
+    if (r2->num_boxes == 1 && box_contains_box(&r2->extents, &r->extents)) {
+        region_set_box(r, &r2->extents);
+        return;
+    }
 
-    skin_region_swap( r, oper->result );
-    skin_region_reset( oper->result );
+    /* damage is mostly added from top to bottom */
+    if (r2->extents.y1 >= r->extents.y2) {
+        region_append_region(r, r2);
+        return;
+    }
+
+    skin_region_init_empty(result);
+    region_op(result, r, r2, union_o, true, true);
+    region_finish_op(r, result);
 }
 
 void
@@ -1068,29 +782,28 @@ skin_region_union_rect( SkinRegion*  r, SkinRect*  rect )
     Region  r2[1];
 
     skin_region_init_rect(r2, rect);
-    return skin_region_union( r, r2 );
+    skin_region_union( r, r2 );
 }
 
-/* performs r = (difference r r2) */
 void
 skin_region_substract( SkinRegion*  r, SkinRegion*  r2 )
 {
-    RegionOperator  oper[1];
+    SkinRegion  result[1];
 
-    if (region_isEmpty(r) || region_isEmpty(r2))
+    if (r->num_boxes == 0 || r2->num_boxes == 0 ||
+        !box_intersects_box(&r->extents, &r2->extents))
         return;
 
-    if ( skin_rect_contains_rect( &r->bounds, &r2->bounds ) == SKIN_OUTSIDE ) {
-        skin_region_init_empty(r);
+    if (r == r2 ||
+        (r2->num_boxes == 1 && box_contains_box(&r2->extents, &r->extents))) {
+        r->num_boxes = 0;
+        region_update_extents(r);
         return;
     }
 
-    region_operator_init( oper, r, r2 );
-    region_operator_do( oper, FLAG_REGION_1 );
-    region_operator_done( oper );
-
-    skin_region_swap( r, oper->result );
-    skin_region_reset( oper->result );
+    skin_region_init_empty(result);
+    region_op(result, r, r2, subtract_o, true, false);
+    region_finish_op(r, result);
 }
 
 void
@@ -1099,322 +812,56 @@ skin_region_substract_rect( SkinRegion*  r, SkinRect*  rect )
     Region  r2[1];
 
     skin_region_init_rect(r2, rect);
-    return skin_region_substract( r, r2 );
+    skin_region_substract( r, r2 );
 }
 
-/* performs r = (xor r r2) */
 void
 skin_region_xor( SkinRegion*  r, SkinRegion*  r2 )
 {
-    RegionOperator  oper[1];
-
-    if (region_isEmpty(r)) {
-        skin_region_copy(r, r2);
-        return;
-    }
+    SkinRegion  tmp[1];
 
-    if (region_isEmpty(r2))
-        return;
-
-    if ( skin_rect_contains_rect( &r->bounds, &r2->bounds ) == SKIN_OUTSIDE ) {
-        skin_region_init_empty(r);
+    if (r == r2) {
+        r->num_boxes = 0;
+        region_update_extents(r);
         return;
     }
 
-    region_operator_init( oper, r, r2 );
-    region_operator_do( oper, FLAG_REGION_1 );
-    region_operator_done( oper );
-
-    skin_region_swap( r, oper->result );
-    skin_region_reset( oper->result );
+    /* (r - r2) + (r2 - r) */
+    skin_region_init_copy(tmp, r2);
+    skin_region_substract(tmp, r);
+    skin_region_substract(r, r2);
+    skin_region_union(r, tmp);
+    skin_region_reset(tmp);
 }
 
-
 void
 skin_region_iterator_init( SkinRegionIterator*  iter,
                            SkinRegion*          region )
 {
     iter->region = region;
-    iter->band   = NULL;
-    iter->span   = NULL;
+    iter->index  = 0;
 }
 
 int
 skin_region_iterator_next( SkinRegionIterator*  iter, SkinRect  *rect )
 {
-    static const Run dummy[ 2 ] = { XSENTINEL, YSENTINEL };
-
-    Run*  span = iter->span;
-    Run*  band = iter->band;
-
-    if (span == NULL) {
-        Region*  r = iter->region;
-        if (region_isEmpty(r))
-            return 0;
-        if (region_isRect(r)) {
-            rect[0] = r->bounds;
-            iter->span = (Run*) dummy;
-            return 1;
-        }
-        iter->band = band = r->runs;
-        iter->span = span = r->runs + 2;
-    }
-    else if (band == NULL)
-        return 0;
+    SkinBox  box;
 
-    while (span[0] == XSENTINEL) {
-        band = span + 1;
-        if (band[0] == YSENTINEL || band[1] == YSENTINEL)
-            return 0;
-
-        iter->band = band;
-        iter->span = span = band + 2;
-    }
-
-    if (span[1] == XSENTINEL)
+    if (!skin_region_iterator_next_box(iter, &box))
         return 0;
 
-    rect->pos.y  = band[0];
-    rect->pos.x  = span[0];
-    rect->size.h = band[1] - band[0];
-    rect->size.w = span[1] - span[0];
-
-    iter->span = span + 2;
+    skin_box_to_rect(&box, rect);
     return 1;
 }
 
 int
 skin_region_iterator_next_box( SkinRegionIterator*  iter, SkinBox  *box )
 {
-    SkinRect  rect;
-    int       result = skin_region_iterator_next( iter, &rect );
-
-    if (result)
-        skin_box_from_rect( box, &rect );
-
-    return result;
-}
-
-#ifdef UNIT_TEST
-
-#include <stdio.h>
-#include <stdlib.h>
-#include "skin_rect.c"
-
-static void
-panic(void)
-{
-    *((char*)0) = 1;
-    exit(0);
-}
-
-static void
-_expectCompare( Region*  r, const SkinBox*  boxes, int  count )
-{
-    if (count == 0) {
-        if ( !skin_region_is_empty(r) ) {
-            printf( " result is not empty\n" );
-            panic();
-        }
-    }
-    else if (count == 1) {
-        SkinRect  rect1, rect2;
-        if ( !skin_region_is_rect(r) ) {
-            printf( " result is not a rectangle\n" );
-            panic();
-        }
-        skin_region_get_bounds( r, &rect1 );
-        skin_box_to_rect( (SkinBox*)boxes, &rect2 );
-        if ( !skin_rect_equals( &rect1, &rect2 ) ) {
-            printf( " result is (%d,%d,%d,%d), expected (%d,%d,%d,%d)\n",
-                    rect1.pos.x, rect1.pos.y,
-                    rect1.pos.x + rect1.size.w, rect1.pos.y + rect1.size.h,
-                    rect2.pos.x, rect2.pos.y,
-                    rect2.pos.x + rect2.size.w, rect2.pos.y + rect2.size.h );
-            panic();
-        }
-    }
-    else {
-        SkinRegionIterator  iter;
-        SkinBox             b;
-        int                 n;
-
-        skin_region_iterator_init( &iter, r );
-        n = 0;
-        while (n < count) {
-            if ( !skin_region_iterator_next_box( &iter, &b ) ) {
-                printf( "missing region box (%d, %d, %d, %d)\n",
-                        boxes->x1, boxes->y1, boxes->x2, boxes->y2 );
-                panic();
-            }
-
-            if (b.x1 != boxes->x1 || b.x2 != boxes->x2||
-                b.y1 != boxes->y1 || b.y2 != boxes->y2)
-            {
-                printf( "invalid region box (%d,%d,%d,%d) expecting (%d,%d,%d,%d)\n",
-                        b.x1, b.y1, b.x2, b.y2,
-                        boxes->x1, boxes->y1, boxes->x2, boxes->y2 );
-                panic();
-            }
-            boxes += 1;
-            n += 1;
-        }
-
-        if ( skin_region_iterator_next_box( &iter, &b ) ) {
-            printf( "excess region box (%d,%d,%d,%d)\n",
-                    b.x1, b.y1, b.x2, b.y2 );
-            panic();
-        }
-    }
-}
-
-
-static void
-expectEmptyRegion( Region*  r )
-{
-    printf( "expectEmptyRegion: " );
-    if (!skin_region_is_empty(r)) {
-        printf( "region not empty !!\n" );
-        panic();
-    }
-    printf( "ok\n" );
-}
-
-static void
-expectTestIntersect( Region*  r1, Region*  r2, SkinOverlap  overlap )
-{
-    SkinOverlap  result;
-    printf( "expectTestIntersect(%d): ", overlap );
-    result = skin_region_test_intersect(r1, r2);
-    if (result != overlap) {
-        printf( "bad result %d, expected %d\n", result, overlap );
-        panic();
-    }
-    printf( "ok\n" );
-}
-
-static void
-expectRectRegion( Region*  r, int  x1, int  y1, int  x2, int  y2 )
-{
-    SkinRect  rect;
-    SkinBox   b;
-
-    printf( "expectRectRegion(%d,%d,%d,%d): ",x1,y1,x2,y2 );
-    if (!skin_region_is_rect(r)) {
-        printf( "region not rect !!\n" );
-        panic();
-    }
-
-    skin_region_get_bounds( r, &rect );
-    skin_box_from_rect( &b, &rect );
-
-    if (b.x1 != x1 || b.x2 != x2 || b.y1 != y1 || b.y2 != y2) {
-        printf( "rect region bounds are (%d,%d,%d,%d), expecting (%d,%d,%d,%d)\n",
-               b.x1, b.y1, b.x2, b.y2, x1, y1, x2, y2 );
-        panic();
-    }
-    printf( "ok\n" );
-}
-
-static void
-expectComplexRegion( Region* r, const SkinBox*  boxes, int  count )
-{
-    SkinRegionIterator  iter;
-    SkinBox             b;
-    int                 n;
-
-    printf( "expectComplexRegion(): " );
-    if (!skin_region_is_complex(r)) {
-        printf( "region is not complex !!\n" );
-        panic();
-    }
-    _expectCompare( r, boxes, count );
-    printf( "ok\n" );
-}
-
-static void
-expectIntersect( Region*  r1, Region*  r2, const SkinBox*  boxes, int  count )
-{
-    SkinRegion  r[1];
+    SkinRegion*  r = iter->region;
 
-    printf( "expectIntersect(%d): ", count );
-    skin_region_init_copy( r, r1 );
-    skin_region_intersect( r, r2 );
-    _expectCompare( r, boxes, count );
-    printf( "ok\n" );
-}
-
-static void
-expectUnion( Region*  r1, Region*  r2, const SkinBox*  boxes, int  count )
-{
-    SkinRegion  r[1];
-
-    printf( "expectUnion(%d): ", count );
-    skin_region_init_copy( r, r1 );
-    skin_region_union( r, r2 );
-    _expectCompare( r, boxes, count );
-    printf( "ok\n" );
-}
-
-
-static void
-expectSubstract( Region*  r1, Region*  r2, const SkinBox*  boxes, int  count )
-{
-    SkinRegion  r[1];
-
-    printf( "expectSubstract(%d): ", count );
-    skin_region_init_copy( r, r1 );
-    skin_region_substract( r, r2 );
-    _expectCompare( r, boxes, count );
-    printf( "ok\n" );
-}
-
-
-int main( void )
-{
-    SkinRegion  r[1], r2[1];
-
-    skin_region_init_empty( r );
-    expectEmptyRegion( r );
-
-    skin_region_init( r, 10, 20, 110, 120 );
-    expectRectRegion( r, 10, 20, 110, 120 );
-
-    skin_region_translate( r, 50, 80 );
-    expectRectRegion( r, 60, 100, 160, 200 );
-
-    skin_region_init( r, 10, 10, 40, 40 );
-    skin_region_init( r2, 20, 20, 50, 50 );
-    expectTestIntersect( r, r2, SKIN_OVERLAP );
-
-    skin_region_translate(r2, +20, + 20 );
-    expectTestIntersect( r, r2, SKIN_OUTSIDE );
-
-    skin_region_translate(r2, -30, -30 );
-    expectTestIntersect( r, r2, SKIN_INSIDE );
-
-    {
-        static const SkinBox  result1[1] = {
-            { 20, 20, 40, 40 }
-        };
-        static const SkinBox  result2[3] = {
-            { 10, 10, 40, 20 },
-            { 10, 20, 50, 40 },
-            { 20, 40, 50, 50 },
-        };
-        static const SkinBox  result3[2] = {
-            { 10, 10, 40, 20 },
-            { 10, 20, 20, 40 },
-        };
-
-        skin_region_init( r, 10, 10, 40, 40 );
-        skin_region_init( r2, 20, 20, 50, 50 );
-        expectIntersect( r, r2, result1, 1 );
-        expectUnion( r, r2, result2, 3 );
-        expectSubstract( r, r2, result3, 2 );
-    }
+    if (iter->index >= r->num_boxes)
+        return 0;
 
-    return 0;
+    *box = region_boxes(r)[iter->index++];
+    return 1;
 }
-
-#endif /* UNIT_TEST */
@@ -56,14 +56,11 @@ extern SkinOverlap  skin_region_contains_box( SkinRegion*  r, SkinBox*  b );
 extern  SkinOverlap  skin_region_test_intersect( SkinRegion*  r1,
                                                  SkinRegion*  r2 );
 
-/* performs r = (intersect r r2), returns true if the resulting region
+/* performs r = (intersect r r2), returns true iff the resulting region
    is not empty */
 extern int  skin_region_intersect     ( SkinRegion*  r, SkinRegion*  r2 );
 extern int  skin_region_intersect_rect( SkinRegion*  r, SkinRect*    rect );
 
-/* performs r = (intersect r (region+_from_rect rect)), returns true iff
-   the resulting region is not empty */
-
 /* performs r = (union r r2) */
 extern void skin_region_union     ( SkinRegion*  r, SkinRegion*  r2 );
 extern void skin_region_union_rect( SkinRegion*  r, SkinRect*  rect );
@@ -84,26 +81,35 @@ extern void  skin_region_iterator_init( SkinRegionIterator*  iter,
 extern int   skin_region_iterator_next( SkinRegionIterator*  iter,
                                         SkinRect            *rect );
 
-extern int   skin_rection_iterator_next_box( SkinRegionIterator*  iter,
-                                             SkinBox             *box );
+extern int   skin_region_iterator_next_box( SkinRegionIterator*  iter,
+                                            SkinBox             *box );
 
 /* the following should be considered private definitions. they're only here
    to allow clients to allocate SkinRegion objects themselves... */
 
-typedef signed short   SkinRegionRun;
-#define SKIN_REGION_SENTINEL  0x7fff
+/* a region is a list of non-overlapping boxes, sorted in y-x banded order:
+   boxes are grouped into bands that share the same y1 and y2, bands are
+   sorted from top to bottom, and boxes inside a band from left to right.
+   boxes of a band never touch, and two vertically adjacent bands never
+   have the same boxes, so that a region has a single representation.
+
+   regions with up to SKIN_REGION_INLINE_BOXES boxes don't allocate memory */
+
+#define  SKIN_REGION_INLINE_BOXES  4
 
 struct SkinRegion
 {
-    SkinRect        bounds;
-    SkinRegionRun*  runs;
+    SkinBox    extents;     /* bounding box, all zeroes if empty */
+    int        num_boxes;   /* 0 if empty, 1 if rectangle */
+    int        capacity;    /* size of |boxes|, or 0 */
+    SkinBox*   boxes;       /* heap storage, NULL when using |inline_boxes| */
+    SkinBox    inline_boxes[ SKIN_REGION_INLINE_BOXES ];
 };
 
 struct SkinRegionIterator
 {
-    SkinRegion*     region;
-    SkinRegionRun*  band;
-    SkinRegionRun*  span;
+    SkinRegion*  region;
+    int          index;
 };
 
 ANDROID_END_HEADER
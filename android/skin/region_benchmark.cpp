@@ -0,0 +1,153 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// A small micro-benchmark of the SkinRegion operations, on the patterns
+// used by the UI: accumulating framebuffer damage from top to bottom,
+// merging scattered damage rectangles, clipping them, and hit-testing a
+// complex region. For each one, it reports the number of operations per
+// second.
+//
+// Usage: emulator_skin_region_benchmark [<iterations>]
+
+#include "android/skin/region.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+namespace {
+
+const int kWidth = 1440;
+const int kHeight = 2560;
+
+double nowUs() {
+#ifdef _WIN32
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (double)now.QuadPart * 1e6 / (double)freq.QuadPart;
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1e6 + tv.tv_usec;
+#endif
+}
+
+// Union of the rows of a full frame, sent one by one as the goldfish
+// framebuffer does.
+void unionRows(int /* n */) {
+    SkinRegion r;
+    skin_region_init_empty(&r);
+    for (int y = 0; y < kHeight; y += 16) {
+        SkinRect rect = { { 0, y }, { kWidth, 16 } };
+        skin_region_union_rect(&r, &rect);
+    }
+    skin_region_reset(&r);
+}
+
+// Union of 32 small scattered rectangles, e.g. a blinking cursor and a
+// few animated views.
+void unionScattered(int n) {
+    SkinRegion r;
+    skin_region_init_empty(&r);
+    srand(n);
+    for (int i = 0; i < 32; ++i) {
+        SkinRect rect = { { rand() % kWidth, rand() % kHeight },
+                          { 16 + rand() % 128, 16 + rand() % 128 } };
+        skin_region_union_rect(&r, &rect);
+    }
+    skin_region_reset(&r);
+}
+
+SkinRegion sComplex;
+
+void buildComplex() {
+    skin_region_init_empty(&sComplex);
+    srand(0);
+    for (int i = 0; i < 64; ++i) {
+        SkinRect rect = { { rand() % kWidth, rand() % kHeight },
+                          { 16 + rand() % 256, 16 + rand() % 256 } };
+        skin_region_union_rect(&sComplex, &rect);
+    }
+}
+
+// Clip a complex region to a rectangle, like the visible display area.
+void intersectRect(int n) {
+    SkinRegion r;
+    SkinRect rect = { { n % 64, n % 128 }, { kWidth / 2, kHeight / 2 } };
+    skin_region_init_copy(&r, &sComplex);
+    skin_region_intersect_rect(&r, &rect);
+    skin_region_reset(&r);
+}
+
+// Remove an area from a complex region.
+void substractRect(int n) {
+    SkinRegion r;
+    SkinRect rect = { { 100 + n % 64, 200 }, { 600, 900 } };
+    skin_region_init_copy(&r, &sComplex);
+    skin_region_substract_rect(&r, &rect);
+    skin_region_reset(&r);
+}
+
+// Hit-test 256 points of a complex region.
+void containsPoints(int n) {
+    int inside = 0;
+    for (int i = 0; i < 256; ++i) {
+        int x = (i * 7919 + n) % kWidth;
+        int y = (i * 104729 + n) % kHeight;
+        inside += skin_region_contains(&sComplex, x, y) == SKIN_INSIDE;
+    }
+    if (inside < 0) {
+        abort();
+    }
+}
+
+struct Benchmark {
+    const char* name;
+    void (*func)(int n);
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    int iterations = 10000;
+    if (argc > 1) {
+        iterations = atoi(argv[1]);
+    }
+
+    static const Benchmark kBenchmarks[] = {
+        { "union rows", unionRows },
+        { "union scattered", unionScattered },
+        { "intersect rect", intersectRect },
+        { "substract rect", substractRect },
+        { "contains x256", containsPoints },
+    };
+
+    buildComplex();
+
+    printf("%-16s %14s\n", "operation", "ops/s");
+    for (size_t b = 0; b < sizeof(kBenchmarks) / sizeof(kBenchmarks[0]); ++b) {
+        double start = nowUs();
+        for (int n = 0; n < iterations; ++n) {
+            kBenchmarks[b].func(n);
+        }
+        printf("%-16s %14.1f\n", kBenchmarks[b].name,
+               iterations * 1e6 / (nowUs() - start));
+    }
+
+    skin_region_reset(&sComplex);
+    return 0;
+}
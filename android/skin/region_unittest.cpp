@@ -14,8 +14,133 @@
 
 #include <gtest/gtest.h>
 
+#include <stdlib.h>
+#include <string.h>
+
 namespace android_skin {
 
+namespace {
+
+// A reference implementation of regions, as a bitmap of kSize x kSize
+// pixels, used to check the results of the region operations.
+const int kSize = 64;
+
+struct Bitmap {
+    bool pixels[kSize][kSize];
+
+    Bitmap() { memset(pixels, 0, sizeof(pixels)); }
+
+    void fill(const SkinBox& b, bool value) {
+        for (int y = b.y1; y < b.y2; ++y) {
+            for (int x = b.x1; x < b.x2; ++x) {
+                pixels[y][x] = value;
+            }
+        }
+    }
+
+    bool empty() const {
+        for (int y = 0; y < kSize; ++y) {
+            for (int x = 0; x < kSize; ++x) {
+                if (pixels[y][x]) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+};
+
+// Check that |r| is a valid banded region that covers the same pixels
+// as |bitmap|.
+void expectRegionEquals(const Bitmap& bitmap, SkinRegion* r) {
+    Bitmap drawn;
+    SkinRegionIterator iter;
+    SkinBox box, prev;
+    bool first = true;
+    int count = 0;
+
+    skin_region_iterator_init(&iter, r);
+    while (skin_region_iterator_next_box(&iter, &box)) {
+        ASSERT_LT(box.x1, box.x2);
+        ASSERT_LT(box.y1, box.y2);
+        if (!first) {
+            if (box.y1 == prev.y1) {
+                // Same band: same height, sorted, not touching.
+                EXPECT_EQ(prev.y2, box.y2);
+                EXPECT_LT(prev.x2, box.x1);
+            } else {
+                EXPECT_LE(prev.y2, box.y1);
+            }
+        }
+        drawn.fill(box, true);
+        prev = box;
+        first = false;
+        count++;
+    }
+    EXPECT_EQ(0, memcmp(bitmap.pixels, drawn.pixels, sizeof(drawn.pixels)));
+
+    // Rebuild the region from the spans of each row, from top to bottom:
+    // regions have a single representation.
+    SkinRegion rows;
+    skin_region_init_empty(&rows);
+    for (int y = 0; y < kSize; ++y) {
+        for (int x = 0; x < kSize; ++x) {
+            if (bitmap.pixels[y][x]) {
+                SkinBox span = { x, y, x + 1, y + 1 };
+                while (span.x2 < kSize && bitmap.pixels[y][span.x2]) {
+                    span.x2++;
+                }
+                SkinRegion r2;
+                skin_region_init_box(&r2, &span);
+                skin_region_union(&rows, &r2);
+                x = span.x2;
+            }
+        }
+    }
+    EXPECT_TRUE(skin_region_equals(&rows, r));
+    skin_region_reset(&rows);
+
+    EXPECT_EQ(bitmap.empty(), skin_region_is_empty(r) != 0);
+    EXPECT_EQ(count == 1, skin_region_is_rect(r) != 0);
+    EXPECT_EQ(count > 1, skin_region_is_complex(r) != 0);
+
+    for (int y = 0; y < kSize; ++y) {
+        for (int x = 0; x < kSize; ++x) {
+            EXPECT_EQ(bitmap.pixels[y][x] ? SKIN_INSIDE : SKIN_OUTSIDE,
+                      skin_region_contains(r, x, y));
+        }
+    }
+}
+
+SkinBox randomBox() {
+    SkinBox b;
+    b.x1 = rand() % (kSize - 1);
+    b.y1 = rand() % (kSize - 1);
+    b.x2 = b.x1 + 1 + rand() % (kSize - b.x1 - 1);
+    b.y2 = b.y1 + 1 + rand() % (kSize - b.y1 - 1);
+    return b;
+}
+
+// Build a random region of up to |count| boxes in |r| and |bitmap|.
+void randomRegion(SkinRegion* r, Bitmap* bitmap, int count) {
+    skin_region_init_empty(r);
+    for (int n = 0; n < count; ++n) {
+        SkinBox b = randomBox();
+        SkinRegion r2;
+        skin_region_init_box(&r2, &b);
+        if (rand() % 4 != 0) {
+            skin_region_union(r, &r2);
+            bitmap->fill(b, true);
+        } else {
+            skin_region_substract(r, &r2);
+            bitmap->fill(b, false);
+        }
+        skin_region_reset(&r2);
+    }
+}
+
+}  // namespace
+
 TEST(region, skin_region_init_empty) {
     SkinRegion r[1];
     skin_region_init_empty(r);
@@ -69,4 +194,168 @@ TEST(region, skin_region_translate) {
     EXPECT_EQ(100, bounds.size.h);
 }
 
+TEST(region, skin_region_union_rect) {
+    SkinRegion r;
+    skin_region_init_empty(&r);
+
+    // Two rectangles side by side are merged.
+    SkinRect rect1 = {{0, 0}, {10, 10}};
+    SkinRect rect2 = {{10, 0}, {10, 10}};
+    skin_region_union_rect(&r, &rect1);
+    skin_region_union_rect(&r, &rect2);
+    EXPECT_TRUE(skin_region_is_rect(&r));
+
+    // And so are the ones that touch vertically.
+    SkinRect rect3 = {{0, 10}, {20, 5}};
+    skin_region_union_rect(&r, &rect3);
+    EXPECT_TRUE(skin_region_is_rect(&r));
+
+    SkinRect bounds;
+    skin_region_get_bounds(&r, &bounds);
+    EXPECT_EQ(0, bounds.pos.x);
+    EXPECT_EQ(0, bounds.pos.y);
+    EXPECT_EQ(20, bounds.size.w);
+    EXPECT_EQ(15, bounds.size.h);
+
+    // A disjoint rectangle makes the region complex.
+    SkinRect rect4 = {{30, 30}, {5, 5}};
+    skin_region_union_rect(&r, &rect4);
+    EXPECT_TRUE(skin_region_is_complex(&r));
+
+    skin_region_get_bounds(&r, &bounds);
+    EXPECT_EQ(35, bounds.size.w);
+    EXPECT_EQ(35, bounds.size.h);
+
+    skin_region_reset(&r);
+    EXPECT_TRUE(skin_region_is_empty(&r));
+}
+
+TEST(region, skin_region_iterator) {
+    SkinRegion r;
+    SkinRect rect1 = {{0, 0}, {10, 10}};
+    SkinRect rect2 = {{20, 0}, {10, 20}};
+    skin_region_init_rect(&r, &rect1);
+    skin_region_union_rect(&r, &rect2);
+
+    // The bands are split where the rectangles start or end.
+    static const SkinRect kExpected[] = {
+        {{0, 0}, {10, 10}},
+        {{20, 0}, {10, 10}},
+        {{20, 10}, {10, 10}},
+    };
+    SkinRegionIterator iter;
+    SkinRect rect;
+    skin_region_iterator_init(&iter, &r);
+    for (size_t n = 0; n < sizeof(kExpected) / sizeof(kExpected[0]); ++n) {
+        ASSERT_TRUE(skin_region_iterator_next(&iter, &rect));
+        EXPECT_TRUE(skin_rect_equals(&kExpected[n], &rect));
+    }
+    EXPECT_FALSE(skin_region_iterator_next(&iter, &rect));
+    skin_region_reset(&r);
+}
+
+TEST(region, skin_region_test_intersect) {
+    SkinRegion r, r2;
+    skin_region_init(&r, 0, 0, 10, 10);
+    SkinRect rect = {{20, 20}, {10, 10}};
+    skin_region_union_rect(&r, &rect);
+
+    skin_region_init(&r2, 2, 2, 8, 8);
+    EXPECT_EQ(SKIN_INSIDE, skin_region_test_intersect(&r, &r2));
+    skin_region_union_rect(&r2, &rect);
+    EXPECT_EQ(SKIN_INSIDE, skin_region_test_intersect(&r, &r2));
+
+    SkinRect outside = {{12, 12}, {4, 4}};
+    EXPECT_EQ(SKIN_OUTSIDE, skin_region_contains_rect(&r, &outside));
+
+    SkinRect overlap = {{5, 5}, {20, 20}};
+    EXPECT_EQ(SKIN_OVERLAP, skin_region_contains_rect(&r, &overlap));
+
+    // |r2| is not a rectangle, but is inside one.
+    SkinRegion big;
+    skin_region_init(&big, 0, 0, 40, 40);
+    EXPECT_EQ(SKIN_INSIDE, skin_region_test_intersect(&big, &r2));
+    EXPECT_EQ(SKIN_OVERLAP, skin_region_test_intersect(&r2, &big));
+
+    skin_region_reset(&big);
+    skin_region_reset(&r2);
+    skin_region_reset(&r);
+}
+
+TEST(region, skin_region_equals) {
+    SkinRegion r1, r2;
+    skin_region_init(&r1, 0, 0, 10, 20);
+    skin_region_init(&r2, 0, 0, 10, 10);
+    EXPECT_FALSE(skin_region_equals(&r1, &r2));
+
+    // The same region built differently has the same representation.
+    SkinRect rect = {{0, 10}, {10, 10}};
+    skin_region_union_rect(&r2, &rect);
+    EXPECT_TRUE(skin_region_equals(&r1, &r2));
+
+    skin_region_reset(&r1);
+    skin_region_reset(&r2);
+}
+
+TEST(region, RandomOperations) {
+    srand(1);
+    for (int iteration = 0; iteration < 200; ++iteration) {
+        // Use more boxes than fit inline half of the time.
+        int count = 1 + rand() % (iteration % 2 ? 3 : 20);
+        SkinRegion r1, r2;
+        Bitmap b1, b2;
+        randomRegion(&r1, &b1, count);
+        randomRegion(&r2, &b2, count);
+        expectRegionEquals(b1, &r1);
+        expectRegionEquals(b2, &r2);
+
+        Bitmap expected[4];
+        for (int y = 0; y < kSize; ++y) {
+            for (int x = 0; x < kSize; ++x) {
+                bool p1 = b1.pixels[y][x];
+                bool p2 = b2.pixels[y][x];
+                expected[0].pixels[y][x] = p1 || p2;
+                expected[1].pixels[y][x] = p1 && p2;
+                expected[2].pixels[y][x] = p1 && !p2;
+                expected[3].pixels[y][x] = p1 != p2;
+            }
+        }
+
+        SkinRegion r;
+        skin_region_init_copy(&r, &r1);
+        skin_region_union(&r, &r2);
+        expectRegionEquals(expected[0], &r);
+
+        skin_region_copy(&r, &r1);
+        EXPECT_EQ(!expected[1].empty(), skin_region_intersect(&r, &r2) != 0);
+        expectRegionEquals(expected[1], &r);
+
+        skin_region_copy(&r, &r1);
+        skin_region_substract(&r, &r2);
+        expectRegionEquals(expected[2], &r);
+
+        skin_region_copy(&r, &r1);
+        skin_region_xor(&r, &r2);
+        expectRegionEquals(expected[3], &r);
+
+        SkinOverlap overlap = skin_region_test_intersect(&r1, &r2);
+        if (expected[1].empty()) {
+            EXPECT_EQ(SKIN_OUTSIDE, overlap);
+        } else if (!memcmp(expected[1].pixels, b2.pixels,
+                           sizeof(b2.pixels))) {
+            EXPECT_EQ(SKIN_INSIDE, overlap);
+        } else {
+            EXPECT_EQ(SKIN_OVERLAP, overlap);
+        }
+
+        skin_region_reset(&r);
+        skin_region_reset(&r2);
+        skin_region_reset(&r1);
+
+        if (HasFailure()) {
+            break;
+        }
+    }
+}
+
 }  // namespace android_skin
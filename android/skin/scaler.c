@@ -12,15 +12,32 @@
 #include "android/skin/scaler.h"
 
 #include <stdint.h>
+#include <stdlib.h>
 #include <math.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define SCALER_USE_SSE2 1
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SCALER_USE_NEON 1
+#endif
+
+#if SCALER_USE_SSE2 || SCALER_USE_NEON
+#define SCALER_USE_SIMD 1
+#endif
+
 struct SkinScaler {
     double  scale;
     double  xdisp, ydisp;
     double  invscale;
     int     valid;
+    void*   buffer;     /* scratch memory of the bilinear scaler */
+    size_t  buffer_size;
 };
 
+static int  _scaler_simd = 1;
+
 static SkinScaler  _scaler0;
 
 SkinScaler*
@@ -56,7 +73,28 @@ skin_scaler_set( SkinScaler*  scaler, double  scale, double xdisp, double ydisp
 void
 skin_scaler_free( SkinScaler*  scaler )
 {
-    (void)scaler;
+    free(scaler->buffer);
+    scaler->buffer = NULL;
+    scaler->buffer_size = 0;
+}
+
+void
+skin_scaler_set_simd( int  enable )
+{
+    _scaler_simd = enable;
+}
+
+static void*
+skin_scaler_get_buffer( SkinScaler*  scaler, size_t  size )
+{
+    if (size > scaler->buffer_size) {
+        void*  buffer = realloc(scaler->buffer, size);
+        if (buffer == NULL)
+            return NULL;
+        scaler->buffer      = buffer;
+        scaler->buffer_size = size;
+    }
+    return scaler->buffer;
 }
 
 typedef struct {
@@ -70,8 +108,38 @@ typedef struct {
     uint8_t*    dst_line;
     uint8_t*    src_line;
     double      scale;
+    int         reorder;    /* destination isn't ARGB */
+    uint32_t    r_shift, g_shift, b_shift, a_shift, a_mask;
 } ScaleOp;
 
+/* The scaling functions compute ARGB pixels, which are converted to the
+ * destination format before they are stored, or right after each line
+ * in the generic versions from argb.h. */
+static inline uint32_t
+scale_reorder_pixel( const ScaleOp*  op, uint32_t  pix )
+{
+    uint32_t r = (pix & 0x00ff0000) >> 16;
+    uint32_t g = (pix & 0x0000ff00) >>  8;
+    uint32_t b = (pix & 0x000000ff) >>  0;
+    uint32_t a = (pix & 0xff000000) >> 24;
+
+    return (r << op->r_shift) | (g << op->g_shift) | (b << op->b_shift) |
+           ((a << op->a_shift) & op->a_mask);
+}
+
+static void
+scale_reorder_line( const ScaleOp*  op, uint8_t*  dst_line )
+{
+    uint32_t*  line = (uint32_t*)dst_line;
+    int        x;
+
+    if (!op->reorder)
+        return;
+    for (x = 0; x < op->rd.size.w; x++)
+        line[x] = scale_reorder_pixel(op, line[x]);
+}
+
+#define  ARGB_SCALE_LINE_DONE(op,line)   scale_reorder_line(op,line)
 
 #define  ARGB_SCALE_GENERIC       scale_generic
 #define  ARGB_SCALE_05_TO_10      scale_05_to_10
@@ -80,6 +148,300 @@ typedef struct {
 
 #include "android/skin/argb.h"
 
+#if SCALER_USE_SIMD
+/* The vector versions below produce exactly the same pixels as the
+ * generic ones, but only handle the most common cases:
+ *
+ *   - scale_half: a scale of exactly 0.5 on pixel boundaries, where
+ *     scale_05_to_10() averages 2x2 source pixels.
+ *
+ *   - scale_up_bilinear_rows: scale_up_bilinear() is separable, and a
+ *     source line is interpolated horizontally only once for all the
+ *     destination lines that use it.
+ */
+
+/* the channels of 4 ARGB pixels, 8 bits each */
+#if SCALER_USE_SSE2
+typedef __m128i     vec_t;
+#else
+typedef uint32x4_t  vec_t;
+#endif
+
+static inline vec_t
+vec_reorder( const ScaleOp*  op, vec_t  pix )
+{
+#if SCALER_USE_SSE2
+    const __m128i  mask = _mm_set1_epi32(0xff);
+    __m128i  r, g, b, a;
+
+    if (!op->reorder)
+        return pix;
+    r = _mm_and_si128(_mm_srli_epi32(pix, 16), mask);
+    g = _mm_and_si128(_mm_srli_epi32(pix,  8), mask);
+    b = _mm_and_si128(pix, mask);
+    a = _mm_srli_epi32(pix, 24);
+    r = _mm_sll_epi32(r, _mm_cvtsi32_si128(op->r_shift));
+    g = _mm_sll_epi32(g, _mm_cvtsi32_si128(op->g_shift));
+    b = _mm_sll_epi32(b, _mm_cvtsi32_si128(op->b_shift));
+    a = _mm_and_si128(_mm_sll_epi32(a, _mm_cvtsi32_si128(op->a_shift)),
+                      _mm_set1_epi32(op->a_mask));
+    return _mm_or_si128(_mm_or_si128(r, g), _mm_or_si128(b, a));
+#else
+    const uint32x4_t  mask = vdupq_n_u32(0xff);
+    uint32x4_t  r, g, b, a;
+
+    if (!op->reorder)
+        return pix;
+    r = vandq_u32(vshrq_n_u32(pix, 16), mask);
+    g = vandq_u32(vshrq_n_u32(pix,  8), mask);
+    b = vandq_u32(pix, mask);
+    a = vshrq_n_u32(pix, 24);
+    r = vshlq_u32(r, vdupq_n_s32(op->r_shift));
+    g = vshlq_u32(g, vdupq_n_s32(op->g_shift));
+    b = vshlq_u32(b, vdupq_n_s32(op->b_shift));
+    a = vandq_u32(vshlq_u32(a, vdupq_n_s32(op->a_shift)),
+                  vdupq_n_u32(op->a_mask));
+    return vorrq_u32(vorrq_u32(r, g), vorrq_u32(b, a));
+#endif
+}
+
+static inline void
+vec_store( const ScaleOp*  op, uint8_t*  dst, vec_t  pix )
+{
+    pix = vec_reorder(op, pix);
+#if SCALER_USE_SSE2
+    _mm_storeu_si128((__m128i*)dst, pix);
+#else
+    vst1q_u32((uint32_t*)dst, pix);
+#endif
+}
+
+/* the average of 2 pixels on line |s0| and 2 pixels on line |s1| */
+static inline uint32_t
+scale_half_pixel( const uint8_t*  s0, const uint8_t*  s1 )
+{
+    const uint32_t*  p0 = (const uint32_t*)s0;
+    const uint32_t*  p1 = (const uint32_t*)s1;
+    uint32_t  ag = ((p0[0] >> 8) & 0xff00ff) + ((p0[1] >> 8) & 0xff00ff) +
+                   ((p1[0] >> 8) & 0xff00ff) + ((p1[1] >> 8) & 0xff00ff);
+    uint32_t  rb = (p0[0] & 0xff00ff) + (p0[1] & 0xff00ff) +
+                   (p1[0] & 0xff00ff) + (p1[1] & 0xff00ff);
+
+    return (((ag >> 2) & 0xff00ff) << 8) | ((rb >> 2) & 0xff00ff);
+}
+
+static void
+scale_half( ScaleOp*  op )
+{
+    int        src_pitch = op->src_pitch;
+    uint8_t*   src_line  = op->src_line + (op->sx >> 16)*4 +
+                           (op->sy >> 16)*src_pitch;
+    uint8_t*   dst_line  = op->dst_line;
+    int        w = op->rd.size.w;
+    int        h;
+
+    for ( h = op->rd.size.h; h > 0; h-- ) {
+        const uint8_t*  s0 = src_line;
+        const uint8_t*  s1 = src_line + src_pitch;
+        uint8_t*        dst = dst_line;
+        int             x = 0;
+
+        for ( ; x + 4 <= w; x += 4, s0 += 32, s1 += 32, dst += 16 ) {
+#if SCALER_USE_SSE2
+            const __m128i  zero = _mm_setzero_si128();
+            __m128i  a0 = _mm_loadu_si128((const __m128i*)s0);
+            __m128i  b0 = _mm_loadu_si128((const __m128i*)(s0 + 16));
+            __m128i  a1 = _mm_loadu_si128((const __m128i*)s1);
+            __m128i  b1 = _mm_loadu_si128((const __m128i*)(s1 + 16));
+            /* vertical sums of source pixels 0-1, 2-3, 4-5 and 6-7 */
+            __m128i  v01 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero),
+                                         _mm_unpacklo_epi8(a1, zero));
+            __m128i  v23 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero),
+                                         _mm_unpackhi_epi8(a1, zero));
+            __m128i  v45 = _mm_add_epi16(_mm_unpacklo_epi8(b0, zero),
+                                         _mm_unpacklo_epi8(b1, zero));
+            __m128i  v67 = _mm_add_epi16(_mm_unpackhi_epi8(b0, zero),
+                                         _mm_unpackhi_epi8(b1, zero));
+            /* horizontal sums, i.e. destination pixels 0-1 and 2-3 */
+            __m128i  d01 = _mm_add_epi16(_mm_unpacklo_epi64(v01, v23),
+                                         _mm_unpackhi_epi64(v01, v23));
+            __m128i  d23 = _mm_add_epi16(_mm_unpacklo_epi64(v45, v67),
+                                         _mm_unpackhi_epi64(v45, v67));
+
+            vec_store(op, dst, _mm_packus_epi16(_mm_srli_epi16(d01, 2),
+                                                _mm_srli_epi16(d23, 2)));
+#else
+            /* even and odd source pixels */
+            uint32x4x2_t  p0 = vld2q_u32((const uint32_t*)s0);
+            uint32x4x2_t  p1 = vld2q_u32((const uint32_t*)s1);
+            uint8x16_t    e0 = vreinterpretq_u8_u32(p0.val[0]);
+            uint8x16_t    o0 = vreinterpretq_u8_u32(p0.val[1]);
+            uint8x16_t    e1 = vreinterpretq_u8_u32(p1.val[0]);
+            uint8x16_t    o1 = vreinterpretq_u8_u32(p1.val[1]);
+            uint16x8_t    lo = vaddq_u16(vaddl_u8(vget_low_u8(e0), vget_low_u8(o0)),
+                                         vaddl_u8(vget_low_u8(e1), vget_low_u8(o1)));
+            uint16x8_t    hi = vaddq_u16(vaddl_u8(vget_high_u8(e0), vget_high_u8(o0)),
+                                         vaddl_u8(vget_high_u8(e1), vget_high_u8(o1)));
+
+            vec_store(op, dst, vreinterpretq_u32_u8(
+                    vcombine_u8(vshrn_n_u16(lo, 2), vshrn_n_u16(hi, 2))));
+#endif
+        }
+        for ( ; x < w; x++, s0 += 8, s1 += 8, dst += 4 ) {
+            uint32_t  pix = scale_half_pixel(s0, s1);
+            *(uint32_t*)dst = op->reorder ? scale_reorder_pixel(op, pix) : pix;
+        }
+
+        src_line += 2*src_pitch;
+        dst_line += op->dst_pitch;
+    }
+}
+
+/* the ARGB_INTERP255() of scale_up_bilinear() */
+static inline uint32_t
+scale_interp_pixel( uint32_t  p1, uint32_t  p2, int  alpha )
+{
+    int       ialpha = 256 - alpha;
+    uint32_t  ag = (((p1 >> 8) & 0xff00ff)*ialpha +
+                    ((p2 >> 8) & 0xff00ff)*alpha) >> 8;
+    uint32_t  rb = ((p1 & 0xff00ff)*ialpha + (p2 & 0xff00ff)*alpha) >> 8;
+
+    return ((ag & 0xff00ff) << 8) | (rb & 0xff00ff);
+}
+
+/* the horizontal position of a destination pixel */
+typedef struct {
+    int  x1, x2;    /* offsets of the source pixels */
+    int  alpha;
+} ScaleColumn;
+
+static void
+scale_up_bilinear_line( const ScaleOp*  op, const ScaleColumn*  cols,
+                        int  y, uint32_t*  out )
+{
+    const uint8_t*  src = op->src_line + y*op->src_pitch;
+    int             x;
+
+    for (x = 0; x < op->rd.size.w; x++) {
+        out[x] = scale_interp_pixel(*(const uint32_t*)(src + cols[x].x1),
+                                    *(const uint32_t*)(src + cols[x].x2),
+                                    cols[x].alpha);
+    }
+}
+
+/* Returns 0 on success, or -1 if the scratch memory can't be allocated */
+static int
+scale_up_bilinear_rows( SkinScaler*  scaler, ScaleOp*  op )
+{
+    int           w = op->rd.size.w;
+    int           sx = op->sx + op->ix/2 - 32768;
+    int           sy = op->sy + op->iy/2 - 32768;
+    int           xlimit = op->src_w - 1;
+    int           ylimit = op->src_h - 1;
+    uint8_t*      dst_line = op->dst_line;
+    ScaleColumn*  cols;
+    uint32_t*     lines[2];
+    int           line_y[2] = { -1, -1 };
+    int           x, h;
+
+    /* lines rounded up to 4 pixels */
+    size_t  stride = (size_t)((w + 3) & ~3);
+
+    cols = skin_scaler_get_buffer(scaler, stride*(sizeof(*cols) + 8));
+    if (cols == NULL)
+        return -1;
+    lines[0] = (uint32_t*)(cols + stride);
+    lines[1] = lines[0] + stride;
+
+    for (x = 0; x < w; x++, sx += op->ix) {
+        int  ex1 = sx >> 16;
+        int  ex2 = (sx + 65535) >> 16;
+
+        if (ex1 < 0) ex1 = 0; else if (ex1 > xlimit) ex1 = xlimit;
+        if (ex2 < 0) ex2 = 0; else if (ex2 > xlimit) ex2 = xlimit;
+
+        cols[x].x1    = ex1*4;
+        cols[x].x2    = ex2*4;
+        cols[x].alpha = (sx >> 8) & 0xff;
+    }
+
+    for ( h = op->rd.size.h; h > 0; h--, sy += op->iy ) {
+        int        ey1 = sy >> 16;
+        int        ey2 = (sy + 65535) >> 16;
+        int        alpha = (sy >> 8) & 0xff;
+        uint32_t*  l1;
+        uint32_t*  l2;
+        uint8_t*   dst = dst_line;
+
+        if (ey1 < 0) ey1 = 0; else if (ey1 > ylimit) ey1 = ylimit;
+        if (ey2 < 0) ey2 = 0; else if (ey2 > ylimit) ey2 = ylimit;
+
+        /* the lines move down, so line 1 often becomes line 0 */
+        if (line_y[0] != ey1 && line_y[1] == ey1) {
+            uint32_t*  tmp = lines[0];
+            lines[0]  = lines[1];
+            lines[1]  = tmp;
+            line_y[0] = ey1;
+            line_y[1] = -1;
+        }
+        if (line_y[0] != ey1) {
+            scale_up_bilinear_line(op, cols, ey1, lines[0]);
+            line_y[0] = ey1;
+        }
+        l1 = l2 = lines[0];
+        if (ey2 != ey1) {
+            if (line_y[1] != ey2) {
+                scale_up_bilinear_line(op, cols, ey2, lines[1]);
+                line_y[1] = ey2;
+            }
+            l2 = lines[1];
+        }
+
+        for (x = 0; x + 4 <= w; x += 4, dst += 16) {
+#if SCALER_USE_SSE2
+            const __m128i  zero = _mm_setzero_si128();
+            const __m128i  m1 = _mm_set1_epi16(256 - alpha);
+            const __m128i  m2 = _mm_set1_epi16(alpha);
+            __m128i  p1 = _mm_loadu_si128((const __m128i*)(l1 + x));
+            __m128i  p2 = _mm_loadu_si128((const __m128i*)(l2 + x));
+            /* at most 255*256 per channel, it can't overflow */
+            __m128i  lo = _mm_add_epi16(
+                    _mm_mullo_epi16(_mm_unpacklo_epi8(p1, zero), m1),
+                    _mm_mullo_epi16(_mm_unpacklo_epi8(p2, zero), m2));
+            __m128i  hi = _mm_add_epi16(
+                    _mm_mullo_epi16(_mm_unpackhi_epi8(p1, zero), m1),
+                    _mm_mullo_epi16(_mm_unpackhi_epi8(p2, zero), m2));
+
+            vec_store(op, dst, _mm_packus_epi16(_mm_srli_epi16(lo, 8),
+                                                _mm_srli_epi16(hi, 8)));
+#else
+            const uint8x8_t  m1 = vdup_n_u8((uint8_t)(255 - alpha));
+            const uint8x8_t  m2 = vdup_n_u8((uint8_t)alpha);
+            uint8x16_t  p1 = vld1q_u8((const uint8_t*)(l1 + x));
+            uint8x16_t  p2 = vld1q_u8((const uint8_t*)(l2 + x));
+            /* p1*(256-alpha) is p1*(255-alpha) + p1 */
+            uint16x8_t  lo = vmlal_u8(vmlal_u8(vmovl_u8(vget_low_u8(p1)),
+                                               vget_low_u8(p1), m1),
+                                      vget_low_u8(p2), m2);
+            uint16x8_t  hi = vmlal_u8(vmlal_u8(vmovl_u8(vget_high_u8(p1)),
+                                               vget_high_u8(p1), m1),
+                                      vget_high_u8(p2), m2);
+
+            vec_store(op, dst, vreinterpretq_u32_u8(
+                    vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8))));
+#endif
+        }
+        for ( ; x < w; x++, dst += 4) {
+            uint32_t  pix = scale_interp_pixel(l1[x], l2[x], alpha);
+            *(uint32_t*)dst = op->reorder ? scale_reorder_pixel(op, pix) : pix;
+        }
+
+        dst_line += op->dst_pitch;
+    }
+    return 0;
+}
+#endif  /* SCALER_USE_SIMD */
+
 
 void
 skin_scaler_reverse_map(SkinScaler* scaler,
@@ -134,6 +496,17 @@ skin_scaler_scale( SkinScaler*   scaler,
         op.dst_pitch = dst_pix->pitch;
         op.dst_line  = (uint8_t*)dst_pix->pixels;
 
+        /* The optimized scale functions compute ARGB pixels. If that's not
+         * the destination format, they do a channel reorder on the way. */
+        op.reorder = (dst_format->r_shift != 16 ||
+                      dst_format->g_shift !=  8 ||
+                      dst_format->b_shift !=  0);
+        op.r_shift = dst_format->r_shift;
+        op.g_shift = dst_format->g_shift;
+        op.b_shift = dst_format->b_shift;
+        op.a_shift = dst_format->a_shift;
+        op.a_mask  = dst_format->a_mask; // may be 0x00
+
         /* compute the destination rectangle */
         skin_scaler_get_scaled_rect(scaler, src_rect, &op.rd);
 
@@ -147,6 +520,17 @@ skin_scaler_scale( SkinScaler*   scaler,
 
         op.dst_line += op.rd.pos.x * 4 + op.rd.pos.y * op.dst_pitch;
 
+#if SCALER_USE_SIMD
+        if (_scaler_simd) {
+            if (op.scale == 0.5 &&
+                (op.sx & 0xffff) == 0 && (op.sy & 0xffff) == 0) {
+                scale_half( &op );
+                return;
+            }
+            if (op.scale > 1.0 && scale_up_bilinear_rows( scaler, &op ) == 0)
+                return;
+        }
+#endif
         if (op.scale >= 0.5 && op.scale <= 1.0)
             scale_05_to_10( &op );
         else if (op.scale > 1.0)
@@ -154,31 +538,4 @@ skin_scaler_scale( SkinScaler*   scaler,
         else
             scale_generic( &op );
     }
-
-    // The optimized scale functions in argb.h assume the destination is ARGB.
-    // If that's not the case, do a channel reorder now.
-    if (dst_format->r_shift != 16 ||
-        dst_format->g_shift !=  8 ||
-        dst_format->b_shift !=  0)
-    {
-        uint32_t rshift = dst_format->r_shift;
-        uint32_t gshift = dst_format->g_shift;
-        uint32_t bshift = dst_format->b_shift;
-        uint32_t ashift = dst_format->a_shift;
-        uint32_t amask  = dst_format->a_mask; // may be 0x00
-        int x, y;
-
-        for (y = 0; y < op.rd.size.h; y++)
-        {
-            uint32_t* line = (uint32_t*)(op.dst_line + y*op.dst_pitch);
-            for (x = 0; x < op.rd.size.w; x++) {
-                uint32_t r = (line[x] & 0x00ff0000) >> 16;
-                uint32_t g = (line[x] & 0x0000ff00) >>  8;
-                uint32_t b = (line[x] & 0x000000ff) >>  0;
-                uint32_t a = (line[x] & 0xff000000) >> 24;
-                line[x] = (r << rshift) | (g << gshift) | (b << bshift) |
-                          ((a << ashift) & amask);
-            }
-        }
-    }
 }
@@ -14,6 +14,9 @@
 
 #include "android/skin/image.h"
 #include "android/skin/surface.h"
+#include "android/utils/compiler.h"
+
+ANDROID_BEGIN_HEADER
 
 typedef struct SkinScaler   SkinScaler;
 
@@ -60,4 +63,11 @@ extern void         skin_scaler_scale( SkinScaler* scaler,
                                        const SkinSurfacePixels* src_pix,
                                        const SkinRect* src_rect);
 
+/* Use the vector versions of the scaling functions (the default), or only
+ * the generic ones, which produce the same pixels. For tests and benchmarks.
+ */
+extern void         skin_scaler_set_simd( int  enable );
+
+ANDROID_END_HEADER
+
 #endif /* _ANDROID_SKIN_SCALER_H */
@@ -0,0 +1,96 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// Micro-benchmarks of skin_scaler_scale(), which scale a 1440x2560
+// framebuffer into an ARGB or an ABGR window surface, with the generic
+// and vector versions of the scaling functions. The argument is the
+// scale, in percent.
+
+#include "android/skin/scaler.h"
+
+#include "android/base/testing/Benchmark.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+namespace {
+
+const int kWidth = 1440;
+const int kHeight = 2560;
+
+const SkinSurfacePixelFormat kArgb =
+        { 16, 0x00ff0000, 8, 0x0000ff00, 0, 0x000000ff, 24, 0xff000000 };
+const SkinSurfacePixelFormat kAbgr =
+        { 0, 0x000000ff, 8, 0x0000ff00, 16, 0x00ff0000, 24, 0xff000000 };
+
+class SkinScalerBenchmark : public android::base::Benchmark {
+public:
+    virtual void setUp(int64_t arg) {
+        mSrc.w = kWidth;
+        mSrc.h = kHeight;
+        mSrc.pitch = kWidth * 4;
+        mSrc.pixels = static_cast<uint32_t*>(malloc(mSrc.pitch * mSrc.h));
+        for (int n = 0; n < kWidth * kHeight; ++n) {
+            mSrc.pixels[n] = static_cast<uint32_t>(n) * 2654435761U;
+        }
+        mDst.w = (int)(kWidth * arg / 100) + 2;
+        mDst.h = (int)(kHeight * arg / 100) + 2;
+        mDst.pitch = mDst.w * 4;
+        mDst.pixels = static_cast<uint32_t*>(calloc(mDst.pitch, mDst.h));
+        mScaler = skin_scaler_create();
+        skin_scaler_set(mScaler, arg / 100., 0., 0.);
+    }
+
+    virtual void tearDown() {
+        skin_scaler_set_simd(1);
+        skin_scaler_free(mScaler);
+        free(mDst.pixels);
+        free(mSrc.pixels);
+    }
+
+protected:
+    // Scale |state->iterations()| frames.
+    void scale(android::base::BenchmarkState* state, bool simd,
+               const SkinSurfacePixelFormat& format) {
+        SkinRect rect = { { 0, 0 }, { mSrc.w, mSrc.h } };
+        skin_scaler_set_simd(simd);
+        state->setBytesPerOp(mSrc.pitch * mSrc.h);
+        for (size_t n = 0; n < state->iterations(); ++n) {
+            skin_scaler_scale(mScaler, &mDst, &format, &mSrc, &rect);
+        }
+    }
+
+    SkinSurfacePixels mSrc;
+    SkinSurfacePixels mDst;
+    SkinScaler* mScaler;
+};
+
+}  // namespace
+
+BENCHMARK_F(SkinScalerBenchmark, GenericArgb) {
+    scale(state, false, kArgb);
+}
+BENCHMARK_ARGS(SkinScalerBenchmark, GenericArgb, 50, 75, 150);
+
+BENCHMARK_F(SkinScalerBenchmark, VectorArgb) {
+    scale(state, true, kArgb);
+}
+BENCHMARK_ARGS(SkinScalerBenchmark, VectorArgb, 50, 75, 150);
+
+BENCHMARK_F(SkinScalerBenchmark, GenericAbgr) {
+    scale(state, false, kAbgr);
+}
+BENCHMARK_ARGS(SkinScalerBenchmark, GenericAbgr, 50, 75, 150);
+
+BENCHMARK_F(SkinScalerBenchmark, VectorAbgr) {
+    scale(state, true, kAbgr);
+}
+BENCHMARK_ARGS(SkinScalerBenchmark, VectorAbgr, 50, 75, 150);
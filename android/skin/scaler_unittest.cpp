@@ -0,0 +1,157 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/skin/scaler.h"
+
+#include <gtest/gtest.h>
+
+#include <stdint.h>
+#include <string.h>
+
+namespace android_skin {
+
+namespace {
+
+const int kSrcWidth = 67;
+const int kSrcHeight = 45;
+const int kDstWidth = 420;
+const int kDstHeight = 300;
+
+const SkinSurfacePixelFormat kArgbFormat = {
+    16, 0x00ff0000, 8, 0x0000ff00, 0, 0x000000ff, 24, 0xff000000
+};
+
+const SkinSurfacePixelFormat kAbgrFormat = {
+    0, 0x000000ff, 8, 0x0000ff00, 16, 0x00ff0000, 24, 0xff000000
+};
+
+// No alpha channel in the destination.
+const SkinSurfacePixelFormat kBgrxFormat = {
+    8, 0x0000ff00, 16, 0x00ff0000, 24, 0xff000000, 0, 0
+};
+
+class ScalerTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        uint32_t seed = 1;
+        for (int n = 0; n < kSrcWidth * kSrcHeight; ++n) {
+            seed = seed * 1103515245U + 12345U;
+            mSrc[n] = seed ^ (seed >> 16);
+        }
+        mSrcPix.w = kSrcWidth;
+        mSrcPix.h = kSrcHeight;
+        mSrcPix.pitch = kSrcWidth * 4;
+        mSrcPix.pixels = mSrc;
+
+        mScaler = skin_scaler_create();
+    }
+
+    virtual void TearDown() {
+        skin_scaler_set_simd(1);
+        skin_scaler_free(mScaler);
+    }
+
+    // Scale |rect| of the source into |dst|, with or without the vector
+    // versions of the scaling functions.
+    void scaleInto(bool simd, double scale, double xdisp, double ydisp,
+                   const SkinRect& rect, const SkinSurfacePixelFormat& format,
+                   uint32_t* dst) {
+        SkinSurfacePixels dstPix;
+        dstPix.w = kDstWidth;
+        dstPix.h = kDstHeight;
+        dstPix.pitch = kDstWidth * 4;
+        dstPix.pixels = dst;
+        memset(dst, 0x55, sizeof(mDst1));
+
+        skin_scaler_set_simd(simd);
+        skin_scaler_set(mScaler, scale, xdisp, ydisp);
+        skin_scaler_scale(mScaler, &dstPix, &format, &mSrcPix, &rect);
+    }
+
+    // Check that the vector and generic versions produce the same pixels.
+    void expectSame(double scale, double xdisp, double ydisp,
+                    const SkinRect& rect,
+                    const SkinSurfacePixelFormat& format) {
+        scaleInto(false, scale, xdisp, ydisp, rect, format, mDst1);
+        scaleInto(true, scale, xdisp, ydisp, rect, format, mDst2);
+        for (int n = 0; n < kDstWidth * kDstHeight; ++n) {
+            if (mDst1[n] != mDst2[n]) {
+                ADD_FAILURE() << "scale " << scale << " rect "
+                              << rect.pos.x << "," << rect.pos.y << " "
+                              << rect.size.w << "x" << rect.size.h
+                              << ": pixel (" << n % kDstWidth << ","
+                              << n / kDstWidth << ") is " << std::hex
+                              << mDst2[n] << " instead of " << mDst1[n];
+                return;
+            }
+        }
+    }
+
+    uint32_t mSrc[kSrcWidth * kSrcHeight];
+    uint32_t mDst1[kDstWidth * kDstHeight];
+    uint32_t mDst2[kDstWidth * kDstHeight];
+    SkinSurfacePixels mSrcPix;
+    SkinScaler* mScaler;
+};
+
+}  // namespace
+
+TEST_F(ScalerTest, HalfAveragesSquares) {
+    SkinRect rect = { { 0, 0 }, { 4, 2 } };
+    mSrc[0] = 0x10203040;
+    mSrc[1] = 0x20304050;
+    mSrc[kSrcWidth] = 0x30405060;
+    mSrc[kSrcWidth + 1] = 0xfffefdfc;
+    mSrc[2] = mSrc[3] = mSrc[kSrcWidth + 2] = mSrc[kSrcWidth + 3] =
+            0x01020304;
+
+    scaleInto(true, 0.5, 0., 0., rect, kArgbFormat, mDst1);
+    EXPECT_EQ(0x57636f7bU, mDst1[0]);
+    EXPECT_EQ(0x01020304U, mDst1[1]);
+    EXPECT_EQ(0x55555555U, mDst1[2]);
+    EXPECT_EQ(0x55555555U, mDst1[kDstWidth]);
+
+    scaleInto(true, 0.5, 0., 0., rect, kAbgrFormat, mDst1);
+    EXPECT_EQ(0x577b6f63U, mDst1[0]);
+}
+
+TEST_F(ScalerTest, SameAsGeneric) {
+    static const double kScales[] = {
+        0.5, 0.6, 0.75, 1.0, 1.25, 2.0, 3.3, 6.0
+    };
+    static const SkinRect kRects[] = {
+        { { 0, 0 }, { kSrcWidth, kSrcHeight } },
+        { { 2, 4 }, { 33, 17 } },
+        { { 5, 3 }, { 7, 1 } },
+        { { 40, 20 }, { 1, 9 } },
+    };
+    static const SkinSurfacePixelFormat* const kFormats[] = {
+        &kArgbFormat, &kAbgrFormat, &kBgrxFormat,
+    };
+
+    for (size_t s = 0; s < sizeof(kScales) / sizeof(kScales[0]); ++s) {
+        for (size_t r = 0; r < sizeof(kRects) / sizeof(kRects[0]); ++r) {
+            // Only scale what fits in the destination.
+            const SkinRect& rect = kRects[r];
+            if ((rect.pos.x + rect.size.w) * kScales[s] + 2 > kDstWidth ||
+                (rect.pos.y + rect.size.h) * kScales[s] + 2 > kDstHeight) {
+                continue;
+            }
+            for (size_t f = 0; f < sizeof(kFormats) / sizeof(kFormats[0]);
+                 ++f) {
+                expectSame(kScales[s], 0., 0., rect, *kFormats[f]);
+                expectSame(kScales[s], 1., 2., rect, *kFormats[f]);
+            }
+        }
+    }
+}
+
+}  // namespace android_skin
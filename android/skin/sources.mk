@@ -7,9 +7,11 @@ ANDROID_SKIN_QT_RESOURCES :=
 
 ANDROID_SKIN_SOURCES := \
     android/skin/charmap.c \
+    android/skin/display-worker.cpp \
     android/skin/rect.c \
     android/skin/region.c \
     android/skin/image.c \
+    android/skin/image-disk-cache.c \
     android/skin/trackball.c \
     android/skin/keyboard.c \
     android/skin/keycode.c \
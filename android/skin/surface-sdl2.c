@@ -12,6 +12,7 @@
 #include "android/skin/surface.h"
 #include "android/skin/argb.h"
 #include "android/skin/scaler.h"
+#include "android/utils/mem_categories.h"
 #include "android/utils/setenv.h"
 #include <SDL.h>
 
@@ -160,20 +161,26 @@ extern void skin_winsys_set_window(SDL_Window* window);
 // content, even after window resizes.
 // |texture| is an SDL_Texture in GPU memory, its content gets erased when
 // the window is resized.
+// |pixel_bytes| is the size of the pixels of |surface| allocated by SDL,
+// accounted in |skin_surface_memory|.
 struct SkinSurface {
     int refcount;
     int w;
     int h;
     SDL_Surface* surface;
     SDL_Texture* texture;
+    int64_t pixel_bytes;
 };
 
+static MemCategory skin_surface_memory = MEM_CATEGORY_INIT("skin.surfaces");
+
 // Destroy a given SkinSurface instance |s|.
 static void skin_surface_free(SkinSurface*  s) {
     if (!s) {
         return;
     }
     globals_remove_surface(s);
+    memCategory_add(&skin_surface_memory, -s->pixel_bytes);
 
     if (s->surface) {
         SDL_FreeSurface(s->surface);
@@ -234,6 +241,10 @@ static SkinSurface* _skin_surface_create(SDL_Surface* surface,
     s->texture = texture;
     s->w = w;
     s->h = h;
+    // Pixels given to SDL_CreateRGBSurfaceFrom() belong to the caller.
+    s->pixel_bytes = (surface && !(surface->flags & SDL_PREALLOC)) ?
+            (int64_t)surface->pitch * surface->h : 0;
+    memCategory_add(&skin_surface_memory, s->pixel_bytes);
 
     globals_add_surface(s);
     return  s;
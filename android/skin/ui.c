@@ -388,6 +388,11 @@ bool skin_ui_process_events(SkinUI* ui) {
     }
 #endif  // _WIN32
 
+    // Present the display updates converted since the last call.
+    if (ui->window) {
+        skin_window_flush_display(ui->window);
+    }
+
     while(skin_event_poll(&ev)) {
         switch(ev.type) {
         case kEventVideoExpose:
@@ -470,6 +475,12 @@ void skin_ui_update_display(SkinUI* ui, int x, int y, int w, int h) {
     }
 }
 
+void skin_ui_update_display_region(SkinUI* ui, SkinRegion* region) {
+    if (ui->window) {
+        skin_window_update_display_region(ui->window, region);
+    }
+}
+
 void skin_ui_update_gpu_frame(SkinUI* ui, int w, int h, const void* pixels) {
     if (ui->window) {
         skin_window_update_gpu_frame(ui->window, w, h, pixels);
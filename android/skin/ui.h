@@ -14,6 +14,7 @@
 #define ANDROID_SKIN_USER_INTERFACE_H
 
 #include "android/skin/rect.h"
+#include "android/skin/region.h"
 #include "android/skin/keyboard.h"
 #include "android/skin/keycode-buffer.h"
 
@@ -117,6 +118,10 @@ void skin_ui_set_scale(SkinUI* ui, double scale);
 
 void skin_ui_update_display(SkinUI* ui, int x, int y, int w, int h);
 
+// Redraw all rectangles of |region|, in framebuffer coordinates, and
+// present the window once.
+void skin_ui_update_display_region(SkinUI* ui, SkinRegion* region);
+
 void skin_ui_update_gpu_frame(SkinUI* ui, int w, int h, const void* pixels);
 
 // Return the current SkinLayout used by the user interface.
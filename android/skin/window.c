@@ -12,11 +12,13 @@
 #include "android/skin/window.h"
 
 #include "android/skin/charmap.h"
+#include "android/skin/display-worker.h"
 #include "android/skin/event.h"
 #include "android/skin/image.h"
 #include "android/skin/scaler.h"
 #include "android/skin/winsys.h"
 #include "android/utils/debug.h"
+#include "android/utils/frame-stats.h"
 #include "android/utils/setenv.h"
 #include "android/utils/system.h"
 #include "android/utils/duff.h"
@@ -95,9 +97,17 @@ typedef struct ADisplay {
     int            brightness;
     void*          gpu_frame;   /* GL_RGBA, datasize.w * datasize.h * 4 bytes */
     SkinSurface*   surface;     /* displayed surface after rotation + onion */
+    uint32_t*      staging;     /* converted pixels, rect.size.w * rect.size.h */
+    SkinDisplayWorker*  worker; /* converts damaged rects into |staging| */
 } ADisplay;
 
 static void adisplay_done(ADisplay* disp) {
+    /* stop the worker before freeing what it reads */
+    skin_display_worker_free(disp->worker);
+    disp->worker = NULL;
+    free(disp->staging);
+    disp->staging = NULL;
+
     if (disp->gpu_frame) {
         free(disp->gpu_frame);
         disp->gpu_frame = NULL;
@@ -108,6 +118,8 @@ static void adisplay_done(ADisplay* disp) {
     skin_image_unref(&disp->onion);
 }
 
+static void adisplay_convert(void* opaque, const SkinRect* rect);
+
 static int adisplay_init(ADisplay* disp,
                          SkinDisplay* sdisp,
                          SkinLocation* loc,
@@ -162,6 +174,16 @@ static int adisplay_init(ADisplay* disp,
     disp->surface = skin_surface_create_slow(disp->rect.size.w,
                                              disp->rect.size.h);
 
+    /* without a worker thread, damaged rects are converted synchronously */
+    disp->staging = NULL;
+    disp->worker = NULL;
+    if (disp->rect.size.w > 0 && disp->rect.size.h > 0) {
+        disp->staging = calloc((size_t)disp->rect.size.w * 4,
+                               disp->rect.size.h);
+        if (disp->staging != NULL)
+            disp->worker = skin_display_worker_new(adisplay_convert, disp);
+    }
+
     return (disp->data == NULL) ? -1 : 0;
 }
 
@@ -551,102 +573,70 @@ static void adisplay_update_surface_pixels_32(ADisplay* disp,
     }
 }
 
-// Update the content of the display surface from the framebuffer content.
-// |disp| is the target ADisplay instance.
-// |rect| is the rectangle to update, in coordinates relative to the
-// display surface, i.e. (0,0) is always the top-left corner.
-static void adisplay_update_surface(ADisplay* disp,
-                                    SkinRect* rect) {
-    int x = rect->pos.x;
-    int y = rect->pos.y;
-    int w = rect->size.w;
-    int h = rect->size.h;
-
-    // Clip update rectangle for sanity.
-    int delta = (x + w) - disp->rect.size.w;
-    if (delta > 0) {
-        w -= delta;
-    }
-    if (x < 0) {
-        w += x;
-        x = 0;
-    }
-    delta = (y + h) - disp->rect.size.h;
-    if (delta > 0) {
-        h -= delta;
-    }
-    if (y < 0) {
-        h += delta;
-        y = 0;
-    }
-    if (w <= 0 || h <= 0) {
-        return;  // nothing to do.
-    }
-
-    // Allocate a temporary buffer to get the potentially rotated / converted
-    // content.
-    int sz = disp->datasize.h > disp->datasize.w ? disp->datasize.h : disp->datasize.w;
-    int dst_pitch = 4 * sz;
-    uint8_t* dst_pixels = calloc(sz, dst_pitch);
-
-    SkinRect dst_r = {
-        .pos.x = x,
-        .pos.y = y,
-        .size.w = w,
-        .size.h = h };
+// Convert the part of the framebuffer that is displayed in |rect| into
+// |disp->staging|, applying rotation and brightness. |rect| is relative to
+// the display surface, i.e. (0,0) is always the top-left corner, and must
+// be within its bounds. This is called on the display worker thread, or on
+// the UI thread when there is no worker or it is idle.
+static void adisplay_convert(void* opaque, const SkinRect* rect) {
+    ADisplay* disp = opaque;
+    SkinRect  r = *rect;
+    int       dst_pitch = 4 * disp->rect.size.w;
+    uint8_t*  dst_pixels = (uint8_t*)disp->staging +
+                           r.pos.y * dst_pitch + r.pos.x * 4;
 
     if (disp->gpu_frame) {
         // Content comes from the emulated GPU.
         adisplay_update_surface_pixels_32(
-                disp, &dst_r, dst_pixels, dst_pitch, disp->gpu_frame);
+                disp, &r, dst_pixels, dst_pitch, disp->gpu_frame);
     } else {
         // Content comes from the emulated framebuffer.
         if (disp->bits_per_pixel == 32) {
             adisplay_update_surface_pixels_32(
-                    disp, &dst_r, dst_pixels, dst_pitch, disp->data);
+                    disp, &r, dst_pixels, dst_pitch, disp->data);
         } else {
             adisplay_update_surface_pixels_16(
-                    disp, &dst_r, dst_pixels, dst_pitch);
+                    disp, &r, dst_pixels, dst_pitch);
         }
     }
 
     // Apply brightness modulation.
     lcd_brightness_argb32((uint32_t*)dst_pixels,
-                          disp->datasize.w,
-                          disp->datasize.h,
+                          r.size.w,
+                          r.size.h,
                           dst_pitch,
                           disp->brightness);
+}
 
-    // Update the display surface content
-    skin_surface_upload(disp->surface, &dst_r, dst_pixels, dst_pitch);
-    free(dst_pixels);
+/* Clip |*rect|, relative to the display surface, for sanity. Return false
+ * if nothing is left. */
+static bool adisplay_clip(ADisplay* disp, SkinRect* rect) {
+    SkinRect  bounds;
 
-    // Done
+    bounds.pos.x = bounds.pos.y = 0;
+    bounds.size = disp->rect.size;
+    return skin_rect_intersect(rect, rect, &bounds);
 }
 
-static void adisplay_redraw(ADisplay* disp,
-                            SkinRect* rect,
-                            SkinSurface* surface) {
-    SkinRect  r;
-
-    if (!skin_rect_intersect(&r, rect, &disp->rect)) {
-        return;
-    }
+/* Upload the converted pixels of |src_r|, relative to the display surface,
+ * then draw them into |surface| with the onion skin, without presenting
+ * them. Set |*drawn| to the rectangle that was drawn in |surface|. */
+static void adisplay_compose(ADisplay* disp,
+                             SkinRect* src_r,
+                             SkinSurface* surface,
+                             SkinRect* drawn) {
+    int       pitch = 4 * disp->rect.size.w;
+    SkinRect  r = *src_r;
 
-#if 0
-        fprintf(stderr, "--- display redraw r.pos(%d,%d) r.size(%d,%d) "
-                        "disp.pos(%d,%d) disp.size(%d,%d) datasize(%d,%d) rect.pos(%d,%d) rect.size(%d,%d)\n",
-                        r.pos.x - disp->rect.pos.x, r.pos.y - disp->rect.pos.y,
-                        r.size.w, r.size.h, disp->rect.pos.x, disp->rect.pos.y,
-                        disp->rect.size.w, disp->rect.size.h, disp->datasize.w, disp->datasize.h,
-                        rect->pos.x, rect->pos.y, rect->size.w, rect->size.h );
-#endif
+    // Update the display surface content
+    skin_surface_upload(disp->surface,
+                        src_r,
+                        (uint8_t*)disp->staging +
+                                src_r->pos.y * pitch + src_r->pos.x * 4,
+                        pitch);
 
-    // Update the content of the display surface.
-    SkinRect src_r = r;
-    src_r.pos.x -= disp->rect.pos.x;
-    src_r.pos.y -= disp->rect.pos.y;
-    adisplay_update_surface(disp, &src_r);
+    r.pos.x += disp->rect.pos.x;
+    r.pos.y += disp->rect.pos.y;
 
     if (disp->brightness == LCD_BRIGHTNESS_OFF) {
         // Fill window surface with solid black.
@@ -655,7 +645,7 @@ static void adisplay_redraw(ADisplay* disp,
         skin_surface_blit(surface,
                           &r.pos,
                           disp->surface,
-                          &src_r,
+                          src_r,
                           SKIN_BLIT_COPY);
     }
 
@@ -677,7 +667,109 @@ static void adisplay_redraw(ADisplay* disp,
         }
     }
 
-    skin_surface_update(surface, &r);
+    *drawn = r;
+}
+
+/* Compose the rects that the worker thread has converted into |surface|,
+ * then present them. If |wait| is true, wait for all the pending ones,
+ * so that the worker doesn't touch |disp->staging| anymore on return. */
+static void adisplay_flush(ADisplay* disp,
+                           SkinSurface* surface,
+                           bool wait) {
+    SkinRect  src_r, drawn;
+    SkinBox   bounds;
+
+    if (disp->worker == NULL)
+        return;
+
+    skin_box_minmax_init(&bounds);
+    while (skin_display_worker_collect(disp->worker, &src_r, wait)) {
+        if (surface != NULL) {
+            adisplay_compose(disp, &src_r, surface, &drawn);
+            skin_box_minmax_update(&bounds, &drawn);
+        }
+    }
+    if (surface != NULL && skin_box_minmax_to_rect(&bounds, &drawn)) {
+        skin_surface_update(surface, &drawn);
+        frame_stats_on_present();
+    }
+}
+
+/* Draw the part of |disp| that intersects |rect| into |surface|, without
+ * presenting it. Return true and set |*drawn| to the rectangle that was
+ * drawn, or return false if there was nothing to draw. The conversion is
+ * done synchronously. */
+static bool adisplay_draw(ADisplay* disp,
+                          SkinRect* rect,
+                          SkinSurface* surface,
+                          SkinRect* drawn) {
+    SkinRect  r;
+
+    if (!skin_rect_intersect(&r, rect, &disp->rect) || !disp->staging) {
+        return false;
+    }
+
+#if 0
+        fprintf(stderr, "--- display redraw r.pos(%d,%d) r.size(%d,%d) "
+                        "disp.pos(%d,%d) disp.size(%d,%d) datasize(%d,%d) rect.pos(%d,%d) rect.size(%d,%d)\n",
+                        r.pos.x - disp->rect.pos.x, r.pos.y - disp->rect.pos.y,
+                        r.size.w, r.size.h, disp->rect.pos.x, disp->rect.pos.y,
+                        disp->rect.size.w, disp->rect.size.h, disp->datasize.w, disp->datasize.h,
+                        rect->pos.x, rect->pos.y, rect->size.w, rect->size.h );
+#endif
+
+    // The worker must be idle before |disp->staging| is written here.
+    adisplay_flush(disp, surface, true);
+
+    // Update the content of the display surface.
+    SkinRect src_r = r;
+    src_r.pos.x -= disp->rect.pos.x;
+    src_r.pos.y -= disp->rect.pos.y;
+    if (!adisplay_clip(disp, &src_r)) {
+        return false;
+    }
+    adisplay_convert(disp, &src_r);
+    adisplay_compose(disp, &src_r, surface, drawn);
+    return true;
+}
+
+/* Queue the part of |disp| that intersects |rect| for conversion by the
+ * worker thread. The result is drawn and presented by a later call to
+ * adisplay_flush(). Falls back to adisplay_draw() without a worker. Return
+ * true and set |*drawn| if something was drawn synchronously. */
+static bool adisplay_post(ADisplay* disp,
+                          SkinRect* rect,
+                          SkinSurface* surface,
+                          SkinRect* drawn) {
+    SkinRect  src_r;
+
+    if (disp->worker == NULL)
+        return adisplay_draw(disp, rect, surface, drawn);
+
+    if (!skin_rect_intersect(&src_r, rect, &disp->rect))
+        return false;
+
+    src_r.pos.x -= disp->rect.pos.x;
+    src_r.pos.y -= disp->rect.pos.y;
+    if (!adisplay_clip(disp, &src_r))
+        return false;
+
+    while (!skin_display_worker_post(disp->worker, &src_r)) {
+        // Too many rects in flight, make room.
+        adisplay_flush(disp, surface, true);
+    }
+    return false;
+}
+
+static void adisplay_redraw(ADisplay* disp,
+                            SkinRect* rect,
+                            SkinSurface* surface) {
+    SkinRect  r;
+
+    if (adisplay_draw(disp, rect, surface, &r)) {
+        skin_surface_update(surface, &r);
+        frame_stats_on_present();
+    }
 }
 
 
@@ -688,6 +780,7 @@ typedef struct Button {
     Background*      background;
     unsigned         keycode;
     int              down;
+    int              gl_down;  /* whether the GPU layer is shown */
 } Button;
 
 static void
@@ -706,6 +799,7 @@ button_init( Button*  button, SkinButton*  sbutton, SkinLocation*  loc, Backgrou
     button->background = back;
     button->keycode    = sbutton->keycode;
     button->down       = 0;
+    button->gl_down    = 0;
 
     if (slayout->has_dpad_rotation) {
         /* Dpad keys must be rotated if the skin provides a 'dpad-rotation' field.
@@ -810,21 +904,27 @@ ball_state_redraw(BallState* state, SkinRect* rect, SkinSurface* surface)
         skin_trackball_draw(state->ball, 0, 0, surface);
 }
 
+static void  skin_window_reset_opengles( SkinWindow*  window );
+
 static void
 ball_state_show( BallState*  state, int  enable )
 {
+    /* the trackball is only drawn in software, see
+     * skin_window_show_opengles() */
     if (enable) {
         if ( !state->tracking ) {
             state->tracking = 1;
             skin_winsys_set_relative_mouse_mode(true);
             skin_trackball_refresh( state->ball );
-            skin_window_redraw( state->window, &state->rect );
+            skin_window_reset_opengles( state->window );
+            skin_window_redraw( state->window, NULL );
         }
     } else {
         if ( state->tracking ) {
             state->tracking = 0;
             skin_winsys_set_relative_mouse_mode(false);
-            skin_window_redraw( state->window, &state->rect );
+            skin_window_reset_opengles( state->window );
+            skin_window_redraw( state->window, NULL );
         }
     }
 }
@@ -1006,6 +1106,12 @@ struct SkinWindow {
     int           y_pos;
 
     double        scale;
+
+    /* set when the GPU sub-window covers the whole window and draws the
+     * skin, with the number of background and button layers given to it */
+    char          gpu_skin;
+    int           gl_num_backgrounds;
+    int           gl_num_buttons;
 };
 
 static void
@@ -1016,6 +1122,7 @@ add_finger_event(SkinWindow* window,
 {
     //fprintf(stderr, "::: finger %d,%d %d\n", x, y, state);
 
+    frame_stats_on_input();
     window->win_funcs->mouse_event(x, y, state);
 }
 
@@ -1191,18 +1298,204 @@ skin_window_show_trackball( SkinWindow*  window, int  enable )
     }
 }
 
+/* Ids of the layers of the GPU sub-window when it draws the whole skin.
+ * The negative ones are drawn below the display. */
+#define  GL_LAYER_COLOR          (-0x10000)
+#define  GL_LAYER_BACKGROUND(n)  (GL_LAYER_COLOR + 1 + (n))
+#define  GL_LAYER_ONION          0
+#define  GL_LAYER_BUTTON(n)      (1 + (n))
+
+/* Give |image| to the GPU sub-window as the layer |id|, at the layout
+ * position |pos|. |wrect| is the sub-window rectangle. Returns -1 on
+ * failure, and 0 on success or if there is nothing to draw. */
+static int
+skin_window_set_gl_image( SkinWindow*     window,
+                          int             id,
+                          SkinImage*      image,
+                          const SkinPos*  pos,
+                          const SkinRect* wrect )
+{
+    const uint32_t*  src = skin_image_pixels(image);
+    int              w   = skin_image_w(image);
+    int              h   = skin_image_h(image);
+    uint8_t*         rgba;
+    uint8_t*         dst;
+    SkinRect         r;
+    int              n, ret;
+
+    if (image == SKIN_IMAGE_NONE || src == NULL || w <= 0 || h <= 0)
+        return 0;
+
+    rgba = malloc(4 * w * h);
+    if (rgba == NULL)
+        return -1;
+
+    /* from 32-bit ARGB to GL_RGBA bytes */
+    for (n = 0, dst = rgba; n < w * h; n++, dst += 4) {
+        uint32_t  pix = src[n];
+        dst[0] = (uint8_t)(pix >> 16);
+        dst[1] = (uint8_t)(pix >> 8);
+        dst[2] = (uint8_t)pix;
+        dst[3] = (uint8_t)(pix >> 24);
+    }
+
+    r.pos    = *pos;
+    r.size.w = w;
+    r.size.h = h;
+    skin_surface_get_scaled_rect(window->surface, &r, &r);
+
+    ret = window->win_funcs->opengles_set_layer(id, rgba, w, h,
+                                                r.pos.x - wrect->pos.x,
+                                                r.pos.y - wrect->pos.y,
+                                                r.size.w, r.size.h);
+    free(rgba);
+    return ret;
+}
+
+/* Show the pressed buttons in the GPU sub-window, and hide the others */
+static void
+skin_window_update_gl_buttons( SkinWindow*  window )
+{
+    Layout*  layout = &window->layout;
+    int      nn;
+
+    for (nn = 0; nn < layout->num_buttons && nn < window->gl_num_buttons; nn++) {
+        Button*  button = &layout->buttons[nn];
+        int      down   = button->down > 0;
+
+        if (down != button->gl_down) {
+            button->gl_down = down;
+            window->win_funcs->opengles_show_layer(GL_LAYER_BUTTON(nn), down);
+        }
+    }
+}
+
+/* Remove all the layers given to the GPU sub-window */
+static void
+skin_window_remove_gl_skin( SkinWindow*  window )
+{
+    const SkinWindowFuncs*  funcs = window->win_funcs;
+    int                     nn;
+
+    if (!window->gpu_skin)
+        return;
+
+    funcs->opengles_set_layer(GL_LAYER_COLOR, NULL, 0, 0, 0, 0, 0, 0);
+    for (nn = 0; nn < window->gl_num_backgrounds; nn++)
+        funcs->opengles_set_layer(GL_LAYER_BACKGROUND(nn),
+                                  NULL, 0, 0, 0, 0, 0, 0);
+    funcs->opengles_set_layer(GL_LAYER_ONION, NULL, 0, 0, 0, 0, 0, 0);
+    for (nn = 0; nn < window->gl_num_buttons; nn++)
+        funcs->opengles_set_layer(GL_LAYER_BUTTON(nn),
+                                  NULL, 0, 0, 0, 0, 0, 0);
+    funcs->opengles_set_display_rect(0, 0, 0, 0);
+
+    window->gpu_skin           = 0;
+    window->gl_num_backgrounds = 0;
+    window->gl_num_buttons     = 0;
+}
+
+/* Give the skin of the current layout to the GPU sub-window, which covers
+ * |wrect|: the layout color, backgrounds, onion image and buttons become
+ * textured layers, and the display is drawn directly from the renderer's
+ * color buffer. Returns -1 if this is not supported. */
+static int
+skin_window_upload_gl_skin( SkinWindow*  window, const SkinRect*  wrect )
+{
+    const SkinWindowFuncs*  funcs  = window->win_funcs;
+    Layout*                 layout = &window->layout;
+    ADisplay*               disp   = layout->displays;
+    uint32_t                color  = layout->color;
+    uint8_t                 rgba[4];
+    SkinRect                drect;
+    int                     nn;
+
+    rgba[0] = (uint8_t)(color >> 16);
+    rgba[1] = (uint8_t)(color >> 8);
+    rgba[2] = (uint8_t)color;
+    rgba[3] = (uint8_t)(color >> 24);
+    if (funcs->opengles_set_layer(GL_LAYER_COLOR, rgba, 1, 1, 0, 0,
+                                  wrect->size.w, wrect->size.h) < 0)
+        return -1;
+
+    window->gpu_skin = 1;
+
+    for (nn = 0; nn < layout->num_backgrounds; nn++) {
+        Background*  back = &layout->backgrounds[nn];
+
+        window->gl_num_backgrounds = nn + 1;
+        if (skin_window_set_gl_image(window, GL_LAYER_BACKGROUND(nn),
+                                     back->image, &back->origin, wrect) < 0)
+            goto Fail;
+    }
+
+    if (disp->onion != NULL &&
+        skin_window_set_gl_image(window, GL_LAYER_ONION, disp->onion,
+                                 &disp->onion_rect.pos, wrect) < 0)
+        goto Fail;
+
+    for (nn = 0; nn < layout->num_buttons; nn++) {
+        Button*  button = &layout->buttons[nn];
+
+        window->gl_num_buttons = nn + 1;
+        if (skin_window_set_gl_image(window, GL_LAYER_BUTTON(nn),
+                                     button->image, &button->origin,
+                                     wrect) < 0)
+            goto Fail;
+        button->gl_down = 1;
+    }
+    skin_window_update_gl_buttons(window);
+
+    skin_surface_get_scaled_rect(window->surface, &disp->rect, &drect);
+    funcs->opengles_set_display_rect(drect.pos.x - wrect->pos.x,
+                                     drect.pos.y - wrect->pos.y,
+                                     drect.size.w,
+                                     drect.size.h);
+    return 0;
+
+Fail:
+    skin_window_remove_gl_skin(window);
+    return -1;
+}
+
 /* Hide the OpenGL ES framebuffer */
 static void
 skin_window_hide_opengles( SkinWindow* window )
 {
+    skin_window_remove_gl_skin(window);
     window->win_funcs->opengles_hide();
     //android_hideOpenglesWindow();
 }
 
-/* Show the OpenGL ES framebuffer window */
+/* Show the OpenGL ES framebuffer window. If possible, it covers the whole
+ * window and draws the skin too, except while the trackball is shown,
+ * since it can only be drawn in software */
 static void
 skin_window_show_opengles( SkinWindow* window )
 {
+    if (window->win_funcs->opengles_set_layer != NULL &&
+        window->surface != NULL &&
+        window->layout.displays != NULL &&
+        !window->ball.tracking)
+    {
+        ADisplay* disp = window->layout.displays;
+        SkinRect  wrect = window->layout.rect;
+        void*     winhandle = skin_winsys_get_window_handle();
+
+        skin_surface_get_scaled_rect(window->surface, &wrect, &wrect);
+
+        if (window->win_funcs->opengles_show(winhandle,
+                                             wrect.pos.x,
+                                             wrect.pos.y,
+                                             wrect.size.w,
+                                             wrect.size.h,
+                                             disp->rotation * -90.) == 0) {
+            if (skin_window_upload_gl_skin(window, &wrect) == 0)
+                return;
+            window->win_funcs->opengles_hide();
+        }
+    }
+
     {
         ADisplay* disp = window->layout.displays;
         SkinRect drect = disp->rect;
@@ -1226,6 +1519,17 @@ skin_window_redraw_opengles( SkinWindow* window )
     //android_redrawOpenglesWindow();
 }
 
+/* Show the OpenGL ES framebuffer window again, after the trackball was
+ * shown or hidden */
+static void
+skin_window_reset_opengles( SkinWindow*  window )
+{
+    if (window->surface != NULL && !window->no_display) {
+        skin_window_hide_opengles(window);
+        skin_window_show_opengles(window);
+    }
+}
+
 static int  skin_window_reset_internal (SkinWindow*, SkinLayout*);
 
 SkinWindow*
@@ -1465,6 +1769,7 @@ skin_window_set_lcd_brightness( SkinWindow*  window, int  brightness )
     ADisplay*  disp = window->layout.displays;
 
     if (disp != NULL) {
+        adisplay_flush(disp, window->surface, true);
         disp->brightness = brightness;
         skin_window_redraw( window, NULL );
     }
@@ -1504,8 +1809,11 @@ skin_window_set_onion( SkinWindow*   window,
 
     disp = window->layout.displays;
 
-    if (disp != NULL)
+    if (disp != NULL) {
         adisplay_set_onion(disp, window->onion, onion_rotation, onion_alpha);
+        if (window->gpu_skin)
+            skin_window_reset_opengles(window);
+    }
 }
 
 void
@@ -1520,6 +1828,13 @@ skin_window_set_scale(SkinWindow* window, double scale)
 void
 skin_window_redraw( SkinWindow*  window, SkinRect*  rect )
 {
+    if (window != NULL && window->gpu_skin) {
+        /* only the pressed buttons can change */
+        skin_window_update_gl_buttons( window );
+        skin_window_redraw_opengles( window );
+        return;
+    }
+
     if (window != NULL && window->surface != NULL) {
         Layout*  layout = &window->layout;
 
@@ -1724,7 +2039,8 @@ skin_window_update_display( SkinWindow*  window, int  x, int  y, int  w, int  h
 {
     ADisplay*  disp = skin_window_display(window);
 
-    if ( !window->surface )
+    /* the GPU sub-window hides the display surface */
+    if ( !window->surface || window->gpu_skin )
         return;
 
     if (disp != NULL) {
@@ -1738,10 +2054,53 @@ skin_window_update_display( SkinWindow*  window, int  x, int  y, int  w, int  h
         r.pos.x += disp->origin.x;
         r.pos.y += disp->origin.y;
 
+        frame_stats_on_damage();
         adisplay_redraw(disp, &r, window->surface);
     }
 }
 
+void
+skin_window_update_display_region( SkinWindow*  window, SkinRegion*  region )
+{
+    ADisplay*           disp = skin_window_display(window);
+    SkinRegionIterator  iter;
+    SkinRect            r, drawn;
+    SkinBox             bounds;
+
+    if ( !window->surface || disp == NULL || window->gpu_skin )
+        return;
+
+    frame_stats_on_damage();
+
+    /* the rectangles are converted by the display worker thread, and
+     * presented by skin_window_flush_display(). without a worker, draw
+     * them all first, then present the surface only once */
+    skin_box_minmax_init( &bounds );
+    skin_region_iterator_init( &iter, region );
+    while ( skin_region_iterator_next( &iter, &r ) ) {
+        skin_rect_rotate( &r, &r, disp->rotation );
+        r.pos.x += disp->origin.x;
+        r.pos.y += disp->origin.y;
+
+        if ( adisplay_post(disp, &r, window->surface, &drawn) )
+            skin_box_minmax_update( &bounds, &drawn );
+    }
+
+    if ( skin_box_minmax_to_rect( &bounds, &r ) ) {
+        skin_surface_update(window->surface, &r);
+        frame_stats_on_present();
+    }
+}
+
+void
+skin_window_flush_display( SkinWindow*  window )
+{
+    ADisplay*  disp = skin_window_display(window);
+
+    if ( window->surface && disp != NULL && !window->gpu_skin )
+        adisplay_flush(disp, window->surface, false);
+}
+
 
 void skin_window_update_gpu_frame(SkinWindow* window,
                                   int w,
@@ -1757,6 +2116,9 @@ void skin_window_update_gpu_frame(SkinWindow* window,
         return;
     }
 
+    // The worker may be reading the previous frame.
+    adisplay_flush(disp, window->surface, true);
+
     if (!disp->gpu_frame) {
         disp->gpu_frame = calloc(w * 4, h);
         if (!disp->gpu_frame) {
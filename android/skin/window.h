@@ -14,6 +14,7 @@
 
 #include "android/skin/event.h"
 #include "android/skin/file.h"
+#include "android/skin/region.h"
 #include "android/skin/trackball.h"
 
 typedef struct SkinWindow  SkinWindow;
@@ -31,6 +32,20 @@ typedef struct SkinWindowFuncs {
     int (*opengles_hide)(void);
     void (*opengles_redraw)(void);
     void (*opengles_free)(void);
+    /* Optional, used to let the GPU sub-window draw the whole skin, see
+     * android_setOpenglesSkinLayer(). opengles_set_layer() returns -1 if
+     * this is not supported, in which case the skin is drawn in software
+     * around a sub-window that only covers the display. */
+    int (*opengles_set_layer)(int id,
+                              const void* rgba_pixels,
+                              int width,
+                              int height,
+                              int x,
+                              int y,
+                              int dst_width,
+                              int dst_height);
+    void (*opengles_show_layer)(int id, int visible);
+    void (*opengles_set_display_rect)(int x, int y, int width, int height);
 } SkinWindowFuncs;
 
 /* Note: if scale is <= 0, we interpret this as 'auto-detect'.
@@ -82,6 +97,12 @@ typedef struct {
 
 extern void             skin_window_get_display( SkinWindow*  window, ADisplayInfo  *info );
 extern void             skin_window_update_display( SkinWindow*  window, int  x, int  y, int  w, int  h );
+/* same as skin_window_update_display(), but the rectangles are converted by
+ * a worker thread, and only presented by skin_window_flush_display() */
+extern void             skin_window_update_display_region( SkinWindow*  window, SkinRegion*  region );
+/* draw and present the rectangles converted since the last call, without
+ * waiting for the others. Call this periodically from the UI thread. */
+extern void             skin_window_flush_display( SkinWindow*  window );
 
 extern void skin_window_update_gpu_frame(SkinWindow* window, int w, int h, const void* pixels);
 
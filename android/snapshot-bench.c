@@ -0,0 +1,334 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#include "android/snapshot-bench.h"
+
+#include "android/utils/bufprint.h"
+#include "android/utils/path.h"
+#include "block/block.h"
+#include "migration/migration.h"
+#include "migration/qemu-file.h"
+#include "qemu/sockets.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+#include "sysemu/sysemu.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <sys/socket.h>
+#endif
+
+#define  BENCH_SEED      0x5eed1234
+#define  BENCH_SCRAMBLE  0x0badf00d
+
+#define  BENCH_SNAPSHOT  "snapshot-bench"
+
+/* the measures of one save or load */
+typedef struct {
+    int64_t           ns;        /* whole VM state, not only RAM */
+    int64_t           size;      /* bytes of saved state, -1 if unknown */
+    RamSnapshotStats  ram;
+    int64_t           peak_kb;   /* peak resident memory after the run */
+} BenchRun;
+
+static int64_t
+_bench_peak_kb( void )
+{
+#ifdef _WIN32
+    return -1;
+#else
+    struct rusage  usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) < 0)
+        return -1;
+#  ifdef __APPLE__
+    return usage.ru_maxrss / 1024;  /* bytes on OS X */
+#  else
+    return usage.ru_maxrss;
+#  endif
+#endif
+}
+
+static void
+_bench_begin( BenchRun*  run )
+{
+    memset(run, 0, sizeof(*run));
+    run->size = -1;
+    run->ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+}
+
+static void
+_bench_end( BenchRun*  run, int  load )
+{
+    run->ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - run->ns;
+    if (load)
+        ram_get_snapshot_stats(NULL, &run->ram);
+    else
+        ram_get_snapshot_stats(&run->ram, NULL);
+    run->peak_kb = _bench_peak_kb();
+}
+
+static void
+_bench_print( const char*  backend, const char*  what, const BenchRun*  run )
+{
+    double  seconds = run->ns > 0 ? run->ns / 1e9 : 1e-9;
+    double  ram_mb  = run->ram.ram_bytes / 1048576.;
+
+    printf("%-7s %-5s %8.1f MB in %6.0f ms  %7.1f MB/s  stream %7.1f MB",
+           backend, what, ram_mb, run->ns / 1e6, ram_mb / seconds,
+           run->ram.stream_bytes / 1048576.);
+    if (run->size >= 0)
+        printf("  file %7.1f MB", run->size / 1048576.);
+    printf("\n        pages %" PRIu64 " zero, %" PRIu64 " filled, %" PRIu64
+           " raw", run->ram.zero_pages, run->ram.fill_pages,
+           run->ram.raw_pages);
+    if (run->ram.incremental)
+        printf(", %" PRIu64 " unchanged", run->ram.clean_pages);
+    if (run->ram.threads > 0)
+        printf(", %d threads", run->ram.threads);
+    if (run->peak_kb >= 0)
+        printf("  peak RSS %" PRId64 " MB", run->peak_kb / 1024);
+    printf("\n");
+}
+
+/* scramble RAM before a load, and check that the load restored it */
+static int
+_bench_check( const char*  backend, int  ret, uint32_t  checksum )
+{
+    if (ret < 0) {
+        printf("%-7s FAILED: error %d\n", backend, ret);
+        return 1;
+    }
+    if (ram_bench_checksum() != checksum) {
+        printf("%-7s FAILED: RAM differs after load\n", backend);
+        return 1;
+    }
+    return 0;
+}
+
+static int
+_bench_file( const char*  dir, uint32_t  checksum )
+{
+    char       path[PATH_MAX], *p = path, *end = p + sizeof(path);
+    BenchRun   save, load;
+    QEMUFile*  f;
+    int        ret;
+
+    p = bufprint(p, end, "%s" PATH_SEP "snapshot-bench.vmstate", dir);
+    if (p >= end) {
+        printf("file    FAILED: path too long\n");
+        return 1;
+    }
+
+    _bench_begin(&save);
+    f = qemu_fopen(path, "wb");
+    if (f == NULL) {
+        printf("file    FAILED: can't create %s\n", path);
+        return 1;
+    }
+    ret = qemu_savevm_state(f);
+    save.size = qemu_ftell(f);
+    qemu_fclose(f);
+    _bench_end(&save, 0);
+    if (ret < 0) {
+        printf("file    FAILED: error %d while saving\n", ret);
+        path_delete_file(path);
+        return 1;
+    }
+    _bench_print("file", "save", &save);
+
+    ram_bench_fill(BENCH_SCRAMBLE);
+    _bench_begin(&load);
+    f = qemu_fopen(path, "rb");
+    ret = f ? qemu_loadvm_state(f) : -ENOENT;
+    if (f)
+        qemu_fclose(f);
+    _bench_end(&load, 1);
+    load.size = save.size;
+    path_delete_file(path);
+
+    if (_bench_check("file", ret, checksum))
+        return 1;
+    _bench_print("file", "load", &load);
+    return 0;
+}
+
+#ifndef _WIN32
+/* the other end of the socket pair, copying the stream to or from memory */
+typedef struct {
+    int       fd;
+    int       sending;
+    uint8_t*  data;
+    size_t    size;
+    size_t    capacity;
+} BenchPeer;
+
+static void*
+_bench_peer_thread( void*  opaque )
+{
+    BenchPeer*  peer = opaque;
+
+    if (peer->sending) {
+        size_t  pos = 0;
+
+        while (pos < peer->size) {
+            ssize_t  n = send(peer->fd, peer->data + pos, peer->size - pos, 0);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                break;
+            pos += n;
+        }
+    } else {
+        for (;;) {
+            ssize_t  n;
+
+            if (peer->size == peer->capacity) {
+                peer->capacity = peer->capacity ? 2 * peer->capacity : 1 << 20;
+                peer->data = g_realloc(peer->data, peer->capacity);
+            }
+            n = recv(peer->fd, peer->data + peer->size,
+                     peer->capacity - peer->size, 0);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                break;
+            peer->size += n;
+        }
+    }
+    close(peer->fd);
+    return NULL;
+}
+
+static int
+_bench_socket( uint32_t  checksum )
+{
+    BenchPeer   peer;
+    QemuThread  thread;
+    BenchRun    save, load;
+    QEMUFile*   f;
+    int         fds[2];
+    int         ret;
+
+    memset(&peer, 0, sizeof(peer));
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+        printf("socket  FAILED: socketpair: %s\n", strerror(errno));
+        return 1;
+    }
+    peer.fd = fds[1];
+    qemu_thread_create(&thread, _bench_peer_thread, &peer,
+                       QEMU_THREAD_JOINABLE);
+
+    _bench_begin(&save);
+    f = qemu_fopen_socket(fds[0], "wb");
+    ret = qemu_savevm_state(f);
+    save.size = qemu_ftell(f);
+    qemu_fclose(f);  /* closes fds[0], the peer sees the end of stream */
+    qemu_thread_join(&thread);
+    _bench_end(&save, 0);
+    if (ret < 0) {
+        printf("socket  FAILED: error %d while saving\n", ret);
+        g_free(peer.data);
+        return 1;
+    }
+    _bench_print("socket", "save", &save);
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+        printf("socket  FAILED: socketpair: %s\n", strerror(errno));
+        g_free(peer.data);
+        return 1;
+    }
+    peer.fd = fds[1];
+    peer.sending = 1;
+
+    ram_bench_fill(BENCH_SCRAMBLE);
+    _bench_begin(&load);
+    qemu_thread_create(&thread, _bench_peer_thread, &peer,
+                       QEMU_THREAD_JOINABLE);
+    f = qemu_fopen_socket(fds[0], "rb");
+    ret = qemu_loadvm_state(f);
+    qemu_fclose(f);  /* unblocks the peer if the load stopped early */
+    qemu_thread_join(&thread);
+    _bench_end(&load, 1);
+    load.size = save.size;
+    g_free(peer.data);
+
+    if (_bench_check("socket", ret, checksum))
+        return 1;
+    _bench_print("socket", "load", &load);
+    return 0;
+}
+#endif  /* !_WIN32 */
+
+static int
+_bench_qcow2( uint32_t  checksum )
+{
+    BenchRun  save, load;
+    int       pass;
+
+    if (bdrv_snapshots() == NULL) {
+        printf("qcow2   skipped: no snapshot storage image\n");
+        return 0;
+    }
+
+    /* the second save only rewrites the pages changed since the load */
+    for (pass = 0; pass < 2; pass++) {
+        const char*  what = pass ? "resave" : "save";
+
+        _bench_begin(&save);
+        do_savevm(NULL, BENCH_SNAPSHOT);
+        _bench_end(&save, 0);
+        _bench_print("qcow2", what, &save);
+
+        ram_bench_fill(BENCH_SCRAMBLE);
+        _bench_begin(&load);
+        do_loadvm(NULL, BENCH_SNAPSHOT);
+        _bench_end(&load, 1);
+
+        /* errors are reported to the monitor, the checksum tells */
+        if (_bench_check("qcow2", 0, checksum)) {
+            do_delvm(NULL, BENCH_SNAPSHOT);
+            return 1;
+        }
+        _bench_print("qcow2", "load", &load);
+    }
+    do_delvm(NULL, BENCH_SNAPSHOT);
+    return 0;
+}
+
+int
+android_snapshot_bench( const char*  dir )
+{
+    uint32_t  checksum;
+    int       failures = 0;
+
+    printf("Snapshot benchmark, %" PRIu64 " MB of RAM, compression level %d\n",
+           ram_bytes_total() >> 20, ram_compress_level);
+
+    ram_bench_fill(BENCH_SEED);
+    checksum = ram_bench_checksum();
+
+    failures += _bench_file(dir, checksum);
+#ifndef _WIN32
+    ram_bench_fill(BENCH_SEED);
+    failures += _bench_socket(checksum);
+#endif
+    ram_bench_fill(BENCH_SEED);
+    failures += _bench_qcow2(checksum);
+
+    printf("%s\n", failures ? "FAILED" : "PASSED");
+    fflush(stdout);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,35 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#ifndef _android_snapshot_bench_h
+#define _android_snapshot_bench_h
+
+/* Snapshot save/load benchmark, run with the -snapshot-bench <dir> option
+ * instead of starting the guest.
+ *
+ * Guest RAM is filled with synthetic pages, then the whole VM state is
+ * saved and loaded back with qemu_savevm_state() and qemu_loadvm_state()
+ * through each QEMUFile backend:
+ *
+ *      file     a stdio file in 'dir'
+ *      socket   a Unix socket pair, drained by a thread (not on Windows)
+ *      qcow2    the snapshot storage image, if any, saved twice so that
+ *               the second save is incremental
+ *
+ * RAM is scrambled before each load and its checksum compared with the
+ * saved one afterwards. For each backend, the save and load throughput,
+ * the number of pages of each type, the size of the saved state and the
+ * peak memory usage of the process are printed to stdout.
+ *
+ * Return 0 if all the loads restored RAM, 1 otherwise. */
+extern int  android_snapshot_bench( const char*  dir );
+
+#endif /* _android_snapshot_bench_h */
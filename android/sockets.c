@@ -38,6 +38,10 @@
 #else /* !_WIN32 */
 #  include <sys/ioctl.h>
 #  include <sys/socket.h>
+#  ifdef __linux__
+#    include <sys/syscall.h>
+#    include <unistd.h>
+#  endif
 #  include <netinet/in.h>
 #  include <netinet/tcp.h>
 #  include <netdb.h>
@@ -992,6 +996,275 @@ socket_recv(int  fd, void*  buf, int  len)
     SOCKET_CALL(recv(fd, buf, len, 0));
 }
 
+#ifdef _WIN32
+static int
+socket_transferv(int  fd, const SockBuffer*  buffers, int  count, int  do_send)
+{
+    WSABUF  bufs[SOCKET_MAX_BUFFERS];
+    DWORD   transferred = 0;
+    DWORD   flags = 0;
+    int     n, ret;
+
+    if (count < 0 || count > SOCKET_MAX_BUFFERS) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (n = 0; n < count; n++) {
+        bufs[n].buf = buffers[n].data;
+        bufs[n].len = (u_long)buffers[n].size;
+    }
+    if (do_send)
+        ret = WSASend(fd, bufs, count, &transferred, 0, NULL, NULL);
+    else
+        ret = WSARecv(fd, bufs, count, &transferred, &flags, NULL, NULL);
+
+    if (ret == SOCKET_ERROR)
+        return fix_errno();
+
+    return (int)transferred;
+}
+#else /* !_WIN32 */
+static int
+socket_transferv(int  fd, const SockBuffer*  buffers, int  count, int  do_send)
+{
+    struct iovec   iov[SOCKET_MAX_BUFFERS];
+    struct msghdr  msg;
+    int            n, ret;
+
+    if (count < 0 || count > SOCKET_MAX_BUFFERS) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (n = 0; n < count; n++) {
+        iov[n].iov_base = buffers[n].data;
+        iov[n].iov_len  = buffers[n].size;
+    }
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov    = iov;
+    msg.msg_iovlen = count;
+
+    if (do_send) {
+        QSOCKET_CALL(ret, sendmsg(fd, &msg, 0));
+    } else {
+        QSOCKET_CALL(ret, recvmsg(fd, &msg, 0));
+    }
+    if (ret < 0)
+        return fix_errno();
+
+    return ret;
+}
+#endif /* !_WIN32 */
+
+int
+socket_sendv(int  fd, const SockBuffer*  buffers, int  count)
+{
+    return socket_transferv(fd, buffers, count, 1);
+}
+
+int
+socket_recvv(int  fd, const SockBuffer*  buffers, int  count)
+{
+    return socket_transferv(fd, buffers, count, 0);
+}
+
+#ifdef _WIN32
+static int
+socket_transfer_datagram(int  fd, SockDatagram*  d, int  do_send)
+{
+    WSABUF            bufs[SOCKET_MAX_BUFFERS];
+    sockaddr_storage  sa;
+    socklen_t         salen = sizeof(sa);
+    DWORD             transferred = 0;
+    DWORD             flags = 0;
+    int               n, ret;
+
+    if (d->count < 0 || d->count > SOCKET_MAX_BUFFERS)
+        return set_errno(EINVAL);
+
+    for (n = 0; n < d->count; n++) {
+        bufs[n].buf = d->buffers[n].data;
+        bufs[n].len = (u_long)d->buffers[n].size;
+    }
+    d->truncated = 0;
+    if (do_send) {
+        if (sock_address_to_bsd(&d->address, &sa, &salen) < 0)
+            return -1;
+        ret = WSASendTo(fd, bufs, d->count, &transferred, 0, sa.sa, salen,
+                        NULL, NULL);
+    } else {
+        ret = WSARecvFrom(fd, bufs, d->count, &transferred, &flags, sa.sa,
+                          &salen, NULL, NULL);
+        if (ret == SOCKET_ERROR && WSAGetLastError() == WSAEMSGSIZE) {
+            /* the buffers were filled, and the rest was discarded */
+            transferred = 0;
+            for (n = 0; n < d->count; n++)
+                transferred += (DWORD)d->buffers[n].size;
+            d->truncated = 1;
+            ret = 0;
+        }
+    }
+    if (ret == SOCKET_ERROR)
+        return fix_errno();
+
+    if (!do_send && sock_address_from_bsd(&d->address, &sa, salen) < 0)
+        return -1;
+
+    d->size = (int)transferred;
+    return 0;
+}
+
+static int
+socket_transfer_batch(int  fd, SockDatagram*  datagrams, int  count, int  do_send)
+{
+    int  n;
+
+    if (count < 0 || count > SOCKET_MAX_DATAGRAMS)
+        return set_errno(EINVAL);
+
+    for (n = 0; n < count; n++) {
+        /* only wait for the first datagram */
+        if (n > 0 && !do_send && socket_can_read(fd) <= 0)
+            break;
+        if (socket_transfer_datagram(fd, &datagrams[n], do_send) < 0)
+            break;
+    }
+    return (n > 0 || count == 0) ? n : -1;
+}
+#else /* !_WIN32 */
+static int
+socket_datagram_to_msghdr(SockDatagram*      d,
+                          struct msghdr*     msg,
+                          struct iovec*      iov,
+                          sockaddr_storage*  sa,
+                          int                do_send)
+{
+    socklen_t  salen = sizeof(*sa);
+    int        n;
+
+    if (d->count < 0 || d->count > SOCKET_MAX_BUFFERS)
+        return set_errno(EINVAL);
+
+    if (do_send && sock_address_to_bsd(&d->address, sa, &salen) < 0)
+        return -1;
+
+    for (n = 0; n < d->count; n++) {
+        iov[n].iov_base = d->buffers[n].data;
+        iov[n].iov_len  = d->buffers[n].size;
+    }
+    memset(msg, 0, sizeof(*msg));
+    msg->msg_name    = sa->sa;
+    msg->msg_namelen = salen;
+    msg->msg_iov     = iov;
+    msg->msg_iovlen  = d->count;
+    return 0;
+}
+
+static int
+socket_datagram_from_msghdr(SockDatagram*         d,
+                            const struct msghdr*  msg,
+                            int                   size,
+                            int                   do_send)
+{
+    d->size      = size;
+    d->truncated = !do_send && (msg->msg_flags & MSG_TRUNC) != 0;
+
+    if (!do_send &&
+        sock_address_from_bsd(&d->address, msg->msg_name, msg->msg_namelen) < 0)
+        return -1;
+
+    return 0;
+}
+
+#if defined(__linux__) && defined(MSG_WAITFORONE) && \
+    defined(__NR_sendmmsg) && defined(__NR_recvmmsg)
+#  define  HAVE_MMSG  1
+
+/* the system calls are used directly, since sendmmsg() only appeared in
+ * glibc 2.14. This is set when the kernel doesn't implement them. */
+static int  mmsg_unsupported;
+
+static int
+socket_transfer_mmsg(int  fd, SockDatagram*  datagrams, int  count, int  do_send)
+{
+    struct mmsghdr    msgs[SOCKET_MAX_DATAGRAMS];
+    struct iovec      iov[SOCKET_MAX_DATAGRAMS][SOCKET_MAX_BUFFERS];
+    sockaddr_storage  sa[SOCKET_MAX_DATAGRAMS];
+    int               n, ret;
+
+    for (n = 0; n < count; n++) {
+        if (socket_datagram_to_msghdr(&datagrams[n], &msgs[n].msg_hdr,
+                                      iov[n], &sa[n], do_send) < 0)
+            return -1;
+        msgs[n].msg_len = 0;
+    }
+    if (do_send) {
+        QSOCKET_CALL(ret, syscall(__NR_sendmmsg, fd, msgs, count, 0));
+    } else {
+        QSOCKET_CALL(ret, syscall(__NR_recvmmsg, fd, msgs, count,
+                                  MSG_WAITFORONE, NULL));
+    }
+    if (ret < 0)
+        return -1;
+
+    for (n = 0; n < ret; n++) {
+        if (socket_datagram_from_msghdr(&datagrams[n], &msgs[n].msg_hdr,
+                                        msgs[n].msg_len, do_send) < 0)
+            return n > 0 ? n : -1;
+    }
+    return ret;
+}
+#endif /* __linux__ */
+
+static int
+socket_transfer_batch(int  fd, SockDatagram*  datagrams, int  count, int  do_send)
+{
+    struct iovec      iov[SOCKET_MAX_BUFFERS];
+    struct msghdr     msg;
+    sockaddr_storage  sa;
+    int               n, ret;
+
+    if (count < 0 || count > SOCKET_MAX_DATAGRAMS)
+        return set_errno(EINVAL);
+
+#ifdef HAVE_MMSG
+    if (count > 1 && !mmsg_unsupported) {
+        ret = socket_transfer_mmsg(fd, datagrams, count, do_send);
+        if (ret >= 0 || errno != ENOSYS)
+            return ret;
+        mmsg_unsupported = 1;
+    }
+#endif
+
+    for (n = 0; n < count; n++) {
+        if (socket_datagram_to_msghdr(&datagrams[n], &msg, iov, &sa,
+                                      do_send) < 0)
+            break;
+        if (do_send) {
+            QSOCKET_CALL(ret, sendmsg(fd, &msg, 0));
+        } else {
+            /* only wait for the first datagram */
+            QSOCKET_CALL(ret, recvmsg(fd, &msg, n > 0 ? MSG_DONTWAIT : 0));
+        }
+        if (ret < 0 ||
+            socket_datagram_from_msghdr(&datagrams[n], &msg, ret, do_send) < 0)
+            break;
+    }
+    return (n > 0 || count == 0) ? n : -1;
+}
+#endif /* !_WIN32 */
+
+int
+socket_send_batch(int  fd, SockDatagram*  datagrams, int  count)
+{
+    return socket_transfer_batch(fd, datagrams, count, 1);
+}
+
+int
+socket_recv_batch(int  fd, SockDatagram*  datagrams, int  count)
+{
+    return socket_transfer_batch(fd, datagrams, count, 0);
+}
+
 int
 socket_recvfrom(int  fd, void*  buf, int  len, SockAddress*  from)
 {
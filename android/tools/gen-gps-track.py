@@ -0,0 +1,103 @@
+#!/usr/bin/env python
+#
+# This software is licensed under the terms of the GNU General Public
+# License version 2, as published by the Free Software Foundation, and
+# may be copied, distributed, and modified under those terms.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# this script converts a GPX or KML track into the binary track format
+# replayed by the 'geo replay' console command, see android/gps-replay.h
+#
+# usage: gen-gps-track.py [--interval <seconds>] <input.gpx|input.kml> <output>
+#
+# GPX track points and KML <gx:Track> elements use their own timestamps.
+# Points of plain KML <coordinates> lists are spaced by --interval seconds.
+#
+import  sys, struct, calendar, re
+import  xml.etree.ElementTree as ElementTree
+
+def localName(tag):
+    """strip the namespace of an element tag"""
+    return tag.rsplit('}', 1)[-1]
+
+def parseTime(text):
+    """parse an ISO 8601 UTC timestamp into seconds since the epoch"""
+    m = re.match(r'(\d+)-(\d+)-(\d+)T(\d+):(\d+):(\d+)(\.\d+)?', text.strip())
+    if not m:
+        raise ValueError("invalid timestamp '%s'" % text)
+    fields = [int(x) for x in m.groups()[:6]]
+    seconds = calendar.timegm(fields + [0, 0, 0])
+    if m.group(7):
+        seconds += float(m.group(7))
+    return seconds
+
+def readGpx(root):
+    """return a list of (time, latitude, longitude, altitude) tuples"""
+    points = []
+    for pt in root.iter():
+        if localName(pt.tag) not in ('trkpt', 'rtept', 'wpt'):
+            continue
+        time, alt = None, 0.
+        for child in pt:
+            name = localName(child.tag)
+            if name == 'time':
+                time = parseTime(child.text)
+            elif name == 'ele':
+                alt = float(child.text)
+        points.append((time, float(pt.get('lat')), float(pt.get('lon')), alt))
+    return points
+
+def readKml(root):
+    """return a list of (time, latitude, longitude, altitude) tuples"""
+    points = []
+    for elem in root.iter():
+        name = localName(elem.tag)
+        if name == 'Track':
+            whens = [parseTime(e.text) for e in elem if localName(e.tag) == 'when']
+            coords = [e.text.split() for e in elem if localName(e.tag) == 'coord']
+            for when, coord in zip(whens, coords):
+                alt = float(coord[2]) if len(coord) > 2 else 0.
+                points.append((when, float(coord[1]), float(coord[0]), alt))
+        elif name == 'coordinates':
+            for tup in elem.text.split():
+                coord = tup.split(',')
+                alt = float(coord[2]) if len(coord) > 2 else 0.
+                points.append((None, float(coord[1]), float(coord[0]), alt))
+    return points
+
+def main(args):
+    interval = 1.
+    if len(args) > 2 and args[0] == '--interval':
+        interval = float(args[1])
+        args = args[2:]
+    if len(args) != 2:
+        sys.stderr.write("usage: gen-gps-track.py [--interval <seconds>] "
+                         "<input.gpx|input.kml> <output>\n")
+        return 1
+
+    root = ElementTree.parse(args[0]).getroot()
+    if localName(root.tag) == 'gpx':
+        points = readGpx(root)
+    else:
+        points = readKml(root)
+
+    out = open(args[1], 'wb')
+    out.write(b'GTR1')
+    prevTime = None
+    for time, lat, lon, alt in points:
+        if time is None:
+            time = (prevTime + interval) if prevTime is not None else 0.
+        delay = 0 if prevTime is None else max(0, int(round((time - prevTime) * 1000)))
+        prevTime = time
+        out.write(struct.pack('<Iiii', delay, int(round(lat * 1e7)),
+                              int(round(lon * 1e7)), int(round(alt * 100))))
+    out.close()
+    print("%d fixes written to %s" % (len(points), args[1]))
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
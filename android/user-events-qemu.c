@@ -10,6 +10,7 @@
 ** GNU General Public License for more details.
 */
 #include "android/user-events.h"
+#include "android/governor.h"
 #include "android/utils/debug.h"
 #include "ui/console.h"
 #include <stdio.h>
@@ -25,6 +26,8 @@ user_event_keycodes(int *kcodes, int count)
 void
 user_event_keycode(int  kcode)
 {
+    android_governor_activity();
+    gui_notify_activity();
     kbd_put_keycode(kcode);
 }
 
@@ -44,6 +47,8 @@ user_event_key(unsigned code, unsigned down)
 void
 user_event_mouse(int dx, int dy, int dz, unsigned buttons_state)
 {
+    android_governor_activity();
+    gui_notify_activity();
     kbd_mouse_event(dx, dy, dz, buttons_state);
 }
 
@@ -59,6 +64,8 @@ void  user_event_register_generic(void* opaque, QEMUPutGenericEvent *callback)
 void
 user_event_generic(int type, int code, int value)
 {
+    android_governor_activity();
+    gui_notify_activity();
     if (generic_event_callback)
         generic_event_callback(generic_event_opaque, type, code, value);
 }
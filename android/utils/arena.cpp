@@ -0,0 +1,54 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#include "android/utils/arena.h"
+
+#include "android/base/memory/Arena.h"
+
+struct AArena {
+    android::base::Arena arena;
+};
+
+AArena*
+aarena_new(void)
+{
+    return new AArena();
+}
+
+void
+aarena_free( AArena*  arena )
+{
+    delete arena;
+}
+
+void
+aarena_reset( AArena*  arena )
+{
+    arena->arena.reset();
+}
+
+void*
+aarena_alloc( AArena*  arena, size_t  size )
+{
+    return arena->arena.alloc(size);
+}
+
+char*
+aarena_strdup( AArena*  arena, const char*  str )
+{
+    return arena->arena.strdup(str);
+}
+
+char*
+aarena_strndup( AArena*  arena, const char*  str, size_t  len )
+{
+    return arena->arena.strndup(str, len);
+}
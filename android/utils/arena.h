@@ -0,0 +1,50 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#ifndef _ANDROID_UTILS_ARENA_H
+#define _ANDROID_UTILS_ARENA_H
+
+#include "android/utils/compiler.h"
+
+#include <stddef.h>
+
+ANDROID_BEGIN_HEADER
+
+/* An AArena is a bump allocator for many small allocations that share
+ * the same lifetime, e.g. the strings of a parsed configuration file.
+ * Individual allocations cannot be freed, everything is released at once
+ * by aarena_free() or aarena_reset().
+ */
+typedef struct AArena  AArena;
+
+/* Create a new empty arena */
+AArena*  aarena_new(void);
+
+/* Release all memory allocated from an arena, then the arena itself */
+void     aarena_free( AArena*  arena );
+
+/* Release all memory allocated from an arena, which can be reused */
+void     aarena_reset( AArena*  arena );
+
+/* Allocate 'size' bytes from an arena. The result is suitably aligned
+ * for any basic type and its content is undefined. Never returns NULL.
+ */
+void*    aarena_alloc( AArena*  arena, size_t  size );
+
+/* Allocate a copy of the zero-terminated string 'str' from an arena */
+char*    aarena_strdup( AArena*  arena, const char*  str );
+
+/* Allocate a zero-terminated copy of the first 'len' bytes of 'str' */
+char*    aarena_strndup( AArena*  arena, const char*  str, size_t  len );
+
+ANDROID_END_HEADER
+
+#endif /* _ANDROID_UTILS_ARENA_H */
@@ -0,0 +1,46 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#include "android/utils/async_log.h"
+
+#include "android/base/AsyncLogWriter.h"
+
+using android::base::AsyncLogWriter;
+
+void
+async_log_start(void)
+{
+    AsyncLogWriter::start();
+}
+
+void
+async_log_stop(void)
+{
+    AsyncLogWriter::stop();
+}
+
+int
+async_log_is_running(void)
+{
+    return AsyncLogWriter::isRunning() ? 1 : 0;
+}
+
+void
+async_log_flush(void)
+{
+    AsyncLogWriter::flush();
+}
+
+int
+async_log_write( FILE*  stream, const char*  data, size_t  len )
+{
+    return AsyncLogWriter::write(stream, data, len) ? 1 : 0;
+}
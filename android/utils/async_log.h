@@ -0,0 +1,50 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#ifndef _ANDROID_UTILS_ASYNC_LOG_H
+#define _ANDROID_UTILS_ASYNC_LOG_H
+
+#include "android/utils/compiler.h"
+
+#include <stddef.h>
+#include <stdio.h>
+
+ANDROID_BEGIN_HEADER
+
+/* Asynchronous log output, see android/base/AsyncLogWriter.h.
+ *
+ * Once async_log_start() is called, dprint() and friends, as well as the
+ * LOG() messages of android::base, are queued by the calling thread and
+ * written by a background logger thread, so that threads which log a lot
+ * don't block on terminal I/O.
+ */
+
+/* Start the logger thread. Pending messages are written on exit. */
+void  async_log_start(void);
+
+/* Write all pending messages, then stop the logger thread */
+void  async_log_stop(void);
+
+/* Returns 1 iff the logger thread is running */
+int   async_log_is_running(void);
+
+/* Block until all messages queued so far are written */
+void  async_log_flush(void);
+
+/* Queue 'len' bytes from 'data' for output to 'stream', which must be
+ * stdout or stderr. Returns 1 on success, or 0 if the message was not
+ * queued and must be written synchronously by the caller.
+ */
+int   async_log_write( FILE*  stream, const char*  data, size_t  len );
+
+ANDROID_END_HEADER
+
+#endif /* _ANDROID_UTILS_ASYNC_LOG_H */
@@ -10,20 +10,71 @@
 ** GNU General Public License for more details.
 */
 #include "android/utils/debug.h"
+#include "android/utils/async_log.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
 
 unsigned long android_verbose = 0;
 
+/* Print a message made of 'prefix', the formatted message and 'suffix'
+ * to stdout. When the asynchronous logger is running, the whole message
+ * is queued as a single record, so that messages from other threads are
+ * never inserted in the middle of it.
+ */
+static void
+dprint_output( const char*  prefix, const char*  format, va_list  args,
+               const char*  suffix )
+{
+    char     temp[512];
+    char*    message = temp;
+    size_t   prefixLen, suffixLen, capacity = sizeof(temp);
+    int      ret;
+    va_list  args2;
+
+    if (!async_log_is_running()) {
+        fputs(prefix, stdout);
+        vfprintf(stdout, format, args);
+        fputs(suffix, stdout);
+        return;
+    }
+
+    prefixLen = strlen(prefix);
+    suffixLen = strlen(suffix);
+    for (;;) {
+        if (prefixLen + suffixLen < capacity) {
+            va_copy(args2, args);
+            ret = vsnprintf(message + prefixLen,
+                            capacity - prefixLen - suffixLen, format, args2);
+            va_end(args2);
+            if (ret >= 0 && prefixLen + ret + suffixLen < capacity)
+                break;
+        }
+        capacity *= 2;
+        if (message != temp)
+            free(message);
+        message = malloc(capacity);
+        if (message == NULL)
+            return;
+    }
+    memcpy(message, prefix, prefixLen);
+    memcpy(message + prefixLen + ret, suffix, suffixLen);
+
+    if (!async_log_write(stdout, message, prefixLen + ret + suffixLen))
+        fwrite(message, 1, prefixLen + ret + suffixLen, stdout);
+
+    if (message != temp)
+        free(message);
+}
+
 void
 dprint( const char*  format,  ... )
 {
     va_list  args;
     va_start( args, format );
-    fprintf( stdout, "emulator: ");
-    vfprintf( stdout, format, args );
-    fprintf( stdout, "\n" );
+    dprint_output( "emulator: ", format, args, "\n" );
     va_end( args );
 }
 
@@ -32,14 +83,14 @@ dprintn( const char*  format, ... )
 {
     va_list  args;
     va_start( args, format );
-    vfprintf( stdout, format, args );
+    dprint_output( "", format, args, "" );
     va_end( args );
 }
 
 void
 dprintnv( const char*  format, va_list args )
 {
-    vfprintf( stdout, format, args );
+    dprint_output( "", format, args, "" );
 }
 
 
@@ -48,9 +99,7 @@ dwarning( const char*  format, ... )
 {
     va_list  args;
     va_start( args, format );
-    dprintn( "emulator: WARNING: " );
-    dprintnv( format, args );
-    dprintn( "\n" );
+    dprint_output( "emulator: WARNING: ", format, args, "\n" );
     va_end( args );
 }
 
@@ -60,9 +109,7 @@ derror( const char*  format, ... )
 {
     va_list  args;
     va_start( args, format );
-    dprintn( "emulator: ERROR: " );
-    dprintnv( format, args );
-    dprintn( "\n" );
+    dprint_output( "emulator: ERROR: ", format, args, "\n" );
     va_end( args );
 }
 
@@ -82,6 +129,7 @@ stdio_disable( void )
 {
     if (++stdio_disable_count == 1) {
         int  null_fd, out_fd, err_fd;
+        async_log_flush();
         fflush(stdout);
         out_fd = _fileno(stdout);
         err_fd = _fileno(stderr);
@@ -99,6 +147,7 @@ stdio_enable( void )
 {
     if (--stdio_disable_count == 0) {
         int  out_fd, err_fd;
+        async_log_flush();
         fflush(stdout);
         out_fd = _fileno(stdout);
         err_fd = _fileno(stderr);
@@ -114,6 +163,7 @@ stdio_disable( void )
 {
     if (++stdio_disable_count == 1) {
         int  null_fd, out_fd, err_fd;
+        async_log_flush();
         fflush(stdout);
         out_fd = fileno(stdout);
         err_fd = fileno(stderr);
@@ -131,6 +181,7 @@ stdio_enable( void )
 {
     if (--stdio_disable_count == 0) {
         int  out_fd, err_fd;
+        async_log_flush();
         fflush(stdout);
         out_fd = fileno(stdout);
         err_fd = fileno(stderr);
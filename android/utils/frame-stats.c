@@ -0,0 +1,230 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#include "android/utils/frame-stats.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+/* A histogram of durations in microseconds: values below 8 have their own
+ * bucket, and each power of two above is split into 8 buckets, so that the
+ * percentiles are within 12.5% of the recorded values. */
+#define  SUB_BITS      3
+#define  SUB_COUNT     (1 << SUB_BITS)
+#define  BUCKET_COUNT  ((64 - SUB_BITS + 1) << SUB_BITS)
+
+typedef struct {
+    uint64_t  buckets[BUCKET_COUNT];
+    uint64_t  count;
+    uint64_t  sum;
+    uint64_t  max;
+} Histogram;
+
+static int
+histogram_index( uint64_t  value )
+{
+    int  exp = SUB_BITS;
+
+    if (value < SUB_COUNT)
+        return (int)value;
+
+    while (exp < 63 && (value >> (exp + 1)))
+        exp++;
+
+    return ((exp - SUB_BITS + 1) << SUB_BITS) +
+           (int)((value >> (exp - SUB_BITS)) & (SUB_COUNT - 1));
+}
+
+static uint64_t
+histogram_limit( int  index )
+{
+    int  shift;
+
+    if (index < SUB_COUNT)
+        return index;
+
+    shift = (index >> SUB_BITS) - 1;
+    return ((uint64_t)(SUB_COUNT + (index & (SUB_COUNT - 1))) << shift) +
+           ((1ULL << shift) - 1);
+}
+
+static void
+histogram_add( Histogram*  h, uint64_t  value )
+{
+    h->buckets[histogram_index(value)]++;
+    h->count++;
+    h->sum += value;
+    if (value > h->max)
+        h->max = value;
+}
+
+/* Return an upper bound of the |percent| percentile, at most the max. */
+static uint64_t
+histogram_percentile( const Histogram*  h, double  percent )
+{
+    uint64_t  rank, seen = 0;
+    int       n;
+
+    if (!h->count)
+        return 0;
+
+    rank = (uint64_t)(percent * h->count / 100.);
+    if (rank * 100. < percent * h->count)
+        rank++;
+    if (rank < 1)
+        rank = 1;
+
+    for (n = 0; n < BUCKET_COUNT; n++) {
+        seen += h->buckets[n];
+        if (seen >= rank) {
+            uint64_t  limit = histogram_limit(n);
+            return limit < h->max ? limit : h->max;
+        }
+    }
+    return h->max;
+}
+
+enum {
+    STAT_PRESENT_INTERVAL = 0,
+    STAT_DAMAGE_TO_PRESENT,
+    STAT_INPUT_TO_PRESENT,
+    STAT_COUNT
+};
+
+static const char* const  stat_names[STAT_COUNT] = {
+    "present interval",
+    "damage to present",
+    "touch to present",
+};
+
+static struct {
+    int        enabled;
+    uint64_t   last_present;
+    uint64_t   first_damage;
+    uint64_t   first_input;
+    Histogram  stats[STAT_COUNT];
+} frame_stats;
+
+static uint64_t
+default_clock( void )
+{
+#ifdef _WIN32
+    LARGE_INTEGER  freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (uint64_t)(now.QuadPart * 1000000.0 / freq.QuadPart);
+#else
+    struct timeval  tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000000U + tv.tv_usec;
+#endif
+}
+
+static uint64_t (*frame_stats_clock)(void) = default_clock;
+
+void
+frame_stats_set_clock( uint64_t (*clock)(void) )
+{
+    frame_stats_clock = clock ? clock : default_clock;
+}
+
+void
+frame_stats_enable( int  enable )
+{
+    if (enable)
+        memset(&frame_stats, 0, sizeof(frame_stats));
+    frame_stats.enabled = (enable != 0);
+}
+
+void
+frame_stats_on_damage( void )
+{
+    if (frame_stats.enabled && !frame_stats.first_damage)
+        frame_stats.first_damage = frame_stats_clock();
+}
+
+void
+frame_stats_on_input( void )
+{
+    if (frame_stats.enabled && !frame_stats.first_input)
+        frame_stats.first_input = frame_stats_clock();
+}
+
+void
+frame_stats_on_present( void )
+{
+    uint64_t  now;
+
+    if (!frame_stats.enabled)
+        return;
+
+    now = frame_stats_clock();
+    if (frame_stats.last_present)
+        histogram_add(&frame_stats.stats[STAT_PRESENT_INTERVAL],
+                      now - frame_stats.last_present);
+    if (frame_stats.first_damage)
+        histogram_add(&frame_stats.stats[STAT_DAMAGE_TO_PRESENT],
+                      now - frame_stats.first_damage);
+    if (frame_stats.first_input)
+        histogram_add(&frame_stats.stats[STAT_INPUT_TO_PRESENT],
+                      now - frame_stats.first_input);
+
+    frame_stats.last_present = now;
+    frame_stats.first_damage = 0;
+    frame_stats.first_input  = 0;
+}
+
+size_t
+frame_stats_print( char*  buffer, size_t  bufferSize )
+{
+    char    line[256];
+    size_t  len = 0;
+    int     n;
+
+    if (bufferSize > 0)
+        buffer[0] = '\0';
+
+    for (n = -1; n < STAT_COUNT; n++) {
+        size_t  line_len;
+
+        if (n < 0) {
+            snprintf(line, sizeof(line), "%-24s %8s %8s %8s %8s %8s %8s\n",
+                     "ui (ms)", "count", "avg", "p50", "p90", "p99", "max");
+        } else {
+            const Histogram*  h = &frame_stats.stats[n];
+            snprintf(line, sizeof(line),
+                     "%-24s %8llu %8.2f %8.2f %8.2f %8.2f %8.2f\n",
+                     stat_names[n],
+                     (unsigned long long)h->count,
+                     h->count ? (double)h->sum / h->count / 1e3 : 0.,
+                     histogram_percentile(h, 50.) / 1e3,
+                     histogram_percentile(h, 90.) / 1e3,
+                     histogram_percentile(h, 99.) / 1e3,
+                     h->max / 1e3);
+        }
+
+        line_len = strlen(line);
+        if (len + 1 < bufferSize) {
+            size_t  avail = bufferSize - 1 - len;
+            size_t  count = line_len < avail ? line_len : avail;
+            memcpy(buffer + len, line, count);
+            buffer[len + count] = '\0';
+        }
+        len += line_len;
+    }
+    return len;
+}
@@ -0,0 +1,59 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#ifndef _ANDROID_UTILS_FRAME_STATS_H
+#define _ANDROID_UTILS_FRAME_STATS_H
+
+#include "android/utils/compiler.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+ANDROID_BEGIN_HEADER
+
+/* Timings of the emulator UI, reported by the 'gpu frames' console
+ * command along with the ones of the renderer:
+ *
+ *  - the time between two presents of the display by the skin,
+ *  - the time from the first damage of the display, i.e. a framebuffer
+ *    update or a new GPU frame, to the present that shows it,
+ *  - the time from the first touch event sent to the guest to the next
+ *    present, which includes the time the guest takes to react.
+ *
+ * Collection is disabled by default. All functions must be called from
+ * the UI thread.
+ */
+
+/* Start (if |enable| is not 0) or stop collecting. Starting resets the
+ * statistics. */
+void frame_stats_enable( int  enable );
+
+/* Record that the display was damaged. */
+void frame_stats_on_damage( void );
+
+/* Record that a touch event was sent to the guest. */
+void frame_stats_on_input( void );
+
+/* Record that the skin presented the display. */
+void frame_stats_on_present( void );
+
+/* Print the statistics into |buffer| as a NUL-terminated table, with times
+ * in milliseconds. Return the length of the whole table, which is truncated
+ * if it doesn't fit in |bufferSize| bytes. */
+size_t frame_stats_print( char*  buffer, size_t  bufferSize );
+
+/* Replace the clock, returning microseconds, for unit tests. NULL restores
+ * the default one. */
+void frame_stats_set_clock( uint64_t (*clock)(void) );
+
+ANDROID_END_HEADER
+
+#endif /* _ANDROID_UTILS_FRAME_STATS_H */
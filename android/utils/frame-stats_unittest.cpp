@@ -0,0 +1,123 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/utils/frame-stats.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include <string.h>
+
+namespace {
+
+uint64_t sFakeTimeUs = 0;
+
+uint64_t fakeClock() {
+    return sFakeTimeUs;
+}
+
+class FrameStatsTest : public ::testing::Test {
+public:
+    FrameStatsTest() {
+        sFakeTimeUs = 1000000;
+        frame_stats_set_clock(fakeClock);
+        frame_stats_enable(1);
+    }
+
+    ~FrameStatsTest() {
+        frame_stats_enable(0);
+        frame_stats_set_clock(NULL);
+    }
+
+    // Return the line of |name| in the printed stats.
+    static std::string line(const char* name) {
+        char buffer[1024];
+        frame_stats_print(buffer, sizeof(buffer));
+        const char* p = strstr(buffer, name);
+        if (!p) {
+            return std::string();
+        }
+        const char* end = strchr(p, '\n');
+        return std::string(p, end ? end - p : strlen(p));
+    }
+};
+
+}  // namespace
+
+TEST_F(FrameStatsTest, Empty) {
+    EXPECT_EQ(
+        "present interval                0     0.00     0.00     0.00     0.00     0.00",
+        line("present interval"));
+}
+
+TEST_F(FrameStatsTest, PresentInterval) {
+    for (int n = 0; n < 4; ++n) {
+        frame_stats_on_present();
+        sFakeTimeUs += 16000;
+    }
+    EXPECT_EQ(
+        "present interval                3    16.00    16.00    16.00    16.00    16.00",
+        line("present interval"));
+    EXPECT_EQ(
+        "damage to present               0     0.00     0.00     0.00     0.00     0.00",
+        line("damage to present"));
+}
+
+TEST_F(FrameStatsTest, FirstDamageAndInput) {
+    frame_stats_on_input();
+    sFakeTimeUs += 2000;
+    frame_stats_on_damage();
+    sFakeTimeUs += 1000;
+    // Later events of the same frame don't count.
+    frame_stats_on_input();
+    frame_stats_on_damage();
+    sFakeTimeUs += 1000;
+    frame_stats_on_present();
+
+    EXPECT_EQ(
+        "damage to present               1     2.00     2.00     2.00     2.00     2.00",
+        line("damage to present"));
+    EXPECT_EQ(
+        "touch to present                1     4.00     4.00     4.00     4.00     4.00",
+        line("touch to present"));
+
+    // A present without input doesn't count.
+    sFakeTimeUs += 1000;
+    frame_stats_on_present();
+    EXPECT_EQ(
+        "touch to present                1     4.00     4.00     4.00     4.00     4.00",
+        line("touch to present"));
+}
+
+TEST_F(FrameStatsTest, Disabled) {
+    frame_stats_enable(0);
+    frame_stats_on_input();
+    frame_stats_on_present();
+    sFakeTimeUs += 1000;
+    frame_stats_on_present();
+    EXPECT_EQ(
+        "touch to present                0     0.00     0.00     0.00     0.00     0.00",
+        line("touch to present"));
+
+    // Enabling again resets the stats.
+    frame_stats_enable(1);
+    EXPECT_EQ(
+        "present interval                0     0.00     0.00     0.00     0.00     0.00",
+        line("present interval"));
+}
+
+TEST_F(FrameStatsTest, Truncation) {
+    char buffer[8];
+    size_t len = frame_stats_print(buffer, sizeof(buffer));
+    EXPECT_STREQ("ui (ms)", buffer);
+    EXPECT_LT(sizeof(buffer), len);
+}
@@ -15,6 +15,7 @@
 #include <string.h>
 #include <limits.h>
 #include <errno.h>
+#include "android/utils/arena.h"
 #include "android/utils/debug.h"
 #include "android/utils/system.h" /* for ASTRDUP */
 #include "android/utils/bufprint.h"
@@ -33,21 +34,20 @@ typedef struct {
     char*  value;
 } IniPair;
 
+/* All key and value strings are allocated from |strings|, and released
+ * at once by iniFile_free(), instead of one heap block per pair.
+ */
 struct IniFile {
     int       numPairs;
     int       maxPairs;
     IniPair*  pairs;
+    AArena*   strings;
 };
 
 void
 iniFile_free( IniFile*  i )
 {
-    int  nn;
-    for (nn = 0; nn < i->numPairs; nn++) {
-        AFREE(i->pairs[nn].key);
-        i->pairs[nn].key   = NULL;
-        i->pairs[nn].value = NULL;
-    }
+    aarena_free(i->strings);
     AFREE(i->pairs);
     AFREE(i);
 }
@@ -58,14 +58,15 @@ iniFile_alloc( void )
     IniFile*  i;
 
     ANEW0(i);
+    i->strings = aarena_new();
     return i;
 }
 
 static void
-iniPair_init( IniPair* pair, const char* key, int keyLen,
-                             const char* value, int valueLen )
+iniPair_init( IniFile* i, IniPair* pair, const char* key, int keyLen,
+                                         const char* value, int valueLen )
 {
-    AARRAY_NEW(pair->key, keyLen + valueLen + 2);
+    pair->key = aarena_alloc(i->strings, keyLen + valueLen + 2);
     memcpy(pair->key, key, keyLen);
     pair->key[keyLen] = 0;
 
@@ -74,15 +75,13 @@ iniPair_init( IniPair* pair, const char* key, int keyLen,
     pair->value[valueLen] = 0;
 }
 
+/* The old value stays in the arena until the file is freed. This is fine
+ * since values are rarely replaced more than once.
+ */
 static void
-iniPair_replaceValue( IniPair* pair, const char* value )
+iniPair_replaceValue( IniFile* i, IniPair* pair, const char* value )
 {
-    char* key      = pair->key;
-    int   keyLen   = strlen(key);
-    int   valueLen = strlen(value);
-
-    iniPair_init(pair, key, keyLen, value, valueLen);
-    AFREE(key);
+    pair->value = aarena_strdup(i->strings, value);
 }
 
 static void
@@ -101,7 +100,7 @@ iniFile_addPair( IniFile*  i,
     }
 
     pair = i->pairs + i->numPairs;
-    iniPair_init(pair, key, keyLen, value, valueLen);
+    iniPair_init(i, pair, key, keyLen, value, valueLen);
 
     i->numPairs += 1;
 }
@@ -478,7 +477,7 @@ iniFile_setValue( IniFile* f, const char* key, const char* value )
 
     pair = iniFile_getPair(f, key);
     if (pair != NULL) {
-        iniPair_replaceValue(pair, value);
+        iniPair_replaceValue(f, pair, value);
     } else {
         iniFile_addPair(f, key, strlen(key), value, strlen(value));
     }
@@ -0,0 +1,120 @@
+/* Copyright (C) 2011 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#include "android/utils/intmap.h"
+
+#include "android/base/containers/HashMap.h"
+
+#include <stddef.h>
+#include <string.h>
+
+typedef android::base::HashMap<int, void*> IntMap;
+
+/* The map is a thin wrapper around a HashMap<int, void*>, which makes
+ * lookups O(1) instead of a linear scan of all keys.
+ */
+struct AIntMap {
+    IntMap map;
+};
+
+AIntMap*
+aintMap_new(void)
+{
+    return new AIntMap();
+}
+
+void
+aintMap_free( AIntMap*  map )
+{
+    delete map;
+}
+
+int
+aintMap_getCount( AIntMap* map )
+{
+    return static_cast<int>(map->map.size());
+}
+
+int
+aintMap_has( AIntMap*  map, int key )
+{
+    return map->map.contains(key);
+}
+
+void*
+aintMap_get( AIntMap*  map, int  key )
+{
+    return aintMap_getWithDefault(map, key, NULL);
+}
+
+void*
+aintMap_getWithDefault( AIntMap*  map, int key, void*  def )
+{
+    void** value = map->map.find(key);
+    return value ? *value : def;
+}
+
+void*
+aintMap_set( AIntMap* map, int key, void* value )
+{
+    void** oldValue = map->map.find(key);
+    if (oldValue) {
+        void* result = *oldValue;
+        *oldValue = value;
+        return result;
+    }
+    map->map.set(key, value);
+    return NULL;
+}
+
+void*
+aintMap_del( AIntMap* map, int key )
+{
+    void* result = NULL;
+    map->map.remove(key, &result);
+    return result;
+}
+
+
+#define ITER_MAGIC  ((void*)(ptrdiff_t)0x17e8af1c)
+
+void
+aintMapIterator_init( AIntMapIterator* iter, AIntMap* map )
+{
+    memset(iter, 0, sizeof(*iter));
+    iter->magic[0] = ITER_MAGIC;
+    iter->magic[1] = new IntMap::Iterator(&map->map);
+}
+
+int
+aintMapIterator_next( AIntMapIterator* iter )
+{
+    if (iter == NULL || iter->magic[0] != ITER_MAGIC)
+        return 0;
+
+    IntMap::Iterator* it = static_cast<IntMap::Iterator*>(iter->magic[1]);
+    if (!it->hasNext()) {
+        aintMapIterator_done(iter);
+        return 0;
+    }
+    it->next();
+    iter->key   = it->key();
+    iter->value = it->value();
+    return 1;
+}
+
+void
+aintMapIterator_done( AIntMapIterator* iter )
+{
+    if (iter->magic[0] == ITER_MAGIC)
+        delete static_cast<IntMap::Iterator*>(iter->magic[1]);
+    memset(iter, 0, sizeof(*iter));
+}
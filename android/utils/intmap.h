@@ -27,12 +27,12 @@ typedef struct AIntMap  AIntMap;
 AIntMap*  aintMap_new(void);
 
 /* Returns the number of keys stored in the map */
-int       aintmap_getCount( AIntMap* map );
+int       aintMap_getCount( AIntMap* map );
 
 /* Returns TRUE if the map has a value for the 'key'. Necessary because
  * NULL is a valid value for the map.
  */
-int       aintmap_has( AIntMap*  map, int key );
+int       aintMap_has( AIntMap*  map, int key );
 
 /* Get the value associated with a 'key', or NULL if not in map */
 void*     aintMap_get( AIntMap*  map, int  key );
@@ -67,21 +67,20 @@ typedef struct AIntMapIterator {
     void*  magic[4];
 } AIntMapIterator;
 
-/* Initialize iterator. Returns -1 if the map is empty, or 0 otherwise
- * On success, the first (key,value) pair can be read from the iterator
- * directly.
+/* Initialize iterator. Call aintMapIterator_next() to read the first
+ * (key,value) pair, if any.
  */
 void aintMapIterator_init( AIntMapIterator* iter, AIntMap* map );
 
-/* Read the next (key,value) pair with an iterator, returns -1 when
- * there isn't anything more, or 0 otherwise. On success, the key and
- * value can be read directly from the iterator.
+/* Read the next (key,value) pair with an iterator, returns 0 when
+ * there isn't anything more, or 1 otherwise. On success, the key and
+ * value can be read directly from the iterator. Adding or removing keys
+ * invalidates the iterator.
  */
 int  aintMapIterator_next( AIntMapIterator* iter );
 
 /* Finalize an iterator. This only needs to be called if you stop
- * the iteration before aintMapIterator_init() or aintMapIterator_next()
- * return -1.
+ * the iteration before aintMapIterator_next() returns 0.
  */
 void aintMapIterator_done( AIntMapIterator* iter );
 
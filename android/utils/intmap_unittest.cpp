@@ -0,0 +1,76 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/utils/intmap.h"
+
+#include <gtest/gtest.h>
+
+#include <stdint.h>
+
+namespace android {
+namespace utils {
+
+static void* intToPtr(intptr_t value) {
+    return reinterpret_cast<void*>(value);
+}
+
+TEST(IntMap, SetGetDel) {
+    AIntMap* map = aintMap_new();
+    EXPECT_EQ(0, aintMap_getCount(map));
+
+    EXPECT_EQ(NULL, aintMap_set(map, 1, intToPtr(10)));
+    EXPECT_EQ(NULL, aintMap_set(map, -1, NULL));
+    EXPECT_EQ(2, aintMap_getCount(map));
+
+    EXPECT_EQ(intToPtr(10), aintMap_get(map, 1));
+    EXPECT_TRUE(aintMap_has(map, -1));
+    EXPECT_EQ(NULL, aintMap_get(map, -1));
+    EXPECT_FALSE(aintMap_has(map, 2));
+    EXPECT_EQ(intToPtr(3), aintMap_getWithDefault(map, 2, intToPtr(3)));
+
+    EXPECT_EQ(intToPtr(10), aintMap_set(map, 1, intToPtr(11)));
+    EXPECT_EQ(intToPtr(11), aintMap_del(map, 1));
+    EXPECT_EQ(NULL, aintMap_del(map, 1));
+    EXPECT_EQ(1, aintMap_getCount(map));
+
+    aintMap_free(map);
+}
+
+TEST(IntMap, Iterator) {
+    AIntMap* map = aintMap_new();
+    const int kCount = 100;
+    for (int n = 0; n < kCount; ++n) {
+        aintMap_set(map, n, intToPtr(n + 1000));
+    }
+
+    bool seen[kCount] = {};
+    int count = 0;
+    AIntMapIterator iter[1];
+    aintMapIterator_init(iter, map);
+    while (aintMapIterator_next(iter)) {
+        ASSERT_TRUE(iter->key >= 0 && iter->key < kCount);
+        EXPECT_FALSE(seen[iter->key]);
+        EXPECT_EQ(intToPtr(iter->key + 1000), iter->value);
+        seen[iter->key] = true;
+        count++;
+    }
+    EXPECT_EQ(kCount, count);
+
+    // Stopping early requires aintMapIterator_done().
+    aintMapIterator_init(iter, map);
+    EXPECT_TRUE(aintMapIterator_next(iter));
+    aintMapIterator_done(iter);
+
+    aintMap_free(map);
+}
+
+}  // namespace utils
+}  // namespace android
@@ -0,0 +1,127 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#include "android/utils/ip_checksum.h"
+
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define IP_CHECKSUM_USE_NEON 1
+#endif
+
+/* Since 2^16 == 1 modulo 0xffff, the one's complement sum of 16-bit words
+ * is the same as the sum of wider words, folded down to 16 bits. The
+ * loops below add 32-bit words into 64-bit accumulators, which cannot
+ * overflow for any realistic length, and only fold at the end.
+ *
+ * Words are loaded in host byte order, so the 16-bit result is swapped
+ * at the end on little-endian hosts, which is also correct for modular
+ * sums (RFC 1071, section 2.B).
+ */
+
+static uint64_t
+sum_words( const uint8_t*  p, size_t  len, uint64_t  sum )
+{
+    uint32_t  w;
+
+    while (len >= 4) {
+        memcpy(&w, p, 4);
+        sum += w;
+        p   += 4;
+        len -= 4;
+    }
+    if (len > 0) {
+        /* Pad the trailing bytes with zeros, as if they were followed by
+         * a zero byte in memory. */
+        w = 0;
+        memcpy(&w, p, len);
+        sum += w;
+    }
+    return sum;
+}
+
+static uint64_t
+sum_bulk( const uint8_t*  p, size_t  len, size_t*  done )
+{
+#if defined(__SSE2__)
+    const __m128i  zero = _mm_setzero_si128();
+    __m128i        acc0 = zero;
+    __m128i        acc1 = zero;
+    uint64_t       lanes[2];
+    size_t         n;
+
+    for (n = 0; n + 32 <= len; n += 32) {
+        __m128i  v0 = _mm_loadu_si128((const __m128i*)(p + n));
+        __m128i  v1 = _mm_loadu_si128((const __m128i*)(p + n + 16));
+        acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v0, zero));
+        acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v0, zero));
+        acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v1, zero));
+        acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v1, zero));
+    }
+    _mm_storeu_si128((__m128i*)lanes, _mm_add_epi64(acc0, acc1));
+    *done = n;
+    return lanes[0] + lanes[1];
+#elif IP_CHECKSUM_USE_NEON
+    uint64x2_t  acc0 = vdupq_n_u64(0);
+    uint64x2_t  acc1 = vdupq_n_u64(0);
+    uint64x2_t  acc;
+    size_t      n;
+
+    for (n = 0; n + 32 <= len; n += 32) {
+        uint32x4_t  v0 = vreinterpretq_u32_u8(vld1q_u8(p + n));
+        uint32x4_t  v1 = vreinterpretq_u32_u8(vld1q_u8(p + n + 16));
+        acc0 = vpadalq_u32(acc0, v0);
+        acc1 = vpadalq_u32(acc1, v1);
+    }
+    acc = vaddq_u64(acc0, acc1);
+    *done = n;
+    return vgetq_lane_u64(acc, 0) + vgetq_lane_u64(acc, 1);
+#else
+    uint64_t  sum = 0;
+    uint32_t  w[8];
+    size_t    n;
+
+    for (n = 0; n + 32 <= len; n += 32) {
+        memcpy(w, p + n, 32);
+        sum += (uint64_t)w[0] + w[1] + w[2] + w[3];
+        sum += (uint64_t)w[4] + w[5] + w[6] + w[7];
+    }
+    *done = n;
+    return sum;
+#endif
+}
+
+uint16_t
+ip_checksum_add( const void*  data, size_t  len )
+{
+    const uint8_t*  p    = (const uint8_t*)data;
+    size_t          done = 0;
+    uint64_t        sum;
+    uint16_t        result;
+
+    sum = sum_bulk(p, len, &done);
+    sum = sum_words(p + done, len - done, sum);
+
+    sum = (sum & 0xffffffffU) + (sum >> 32);
+    sum = (sum & 0xffffffffU) + (sum >> 32);
+    sum = (sum & 0xffffU) + (sum >> 16);
+    sum = (sum & 0xffffU) + (sum >> 16);
+    sum = (sum & 0xffffU) + (sum >> 16);
+    result = (uint16_t)sum;
+
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    result = (uint16_t)((result << 8) | (result >> 8));
+#endif
+    return result;
+}
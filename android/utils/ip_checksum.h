@@ -0,0 +1,35 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#ifndef _ANDROID_UTILS_IP_CHECKSUM_H
+#define _ANDROID_UTILS_IP_CHECKSUM_H
+
+#include "android/utils/compiler.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+ANDROID_BEGIN_HEADER
+
+/* Return the 16-bit one's complement sum used by the IP, TCP and UDP
+ * checksums (RFC 1071) of the 'len' bytes at 'data', which need not be
+ * aligned. The bytes are taken as big-endian 16-bit words, and an odd
+ * trailing byte is padded with a zero, so the result is in host byte
+ * order, ready to be added to other partial sums. The checksum itself is
+ * the complement of the final sum.
+ *
+ * This uses SSE2 or NEON when the host supports them at build time.
+ */
+uint16_t  ip_checksum_add( const void*  data, size_t  len );
+
+ANDROID_END_HEADER
+
+#endif /* _ANDROID_UTILS_IP_CHECKSUM_H */
@@ -0,0 +1,86 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// Micro-benchmarks comparing ip_checksum_add() with the classic BSD loop
+// that slirp's cksum() used before, for several packet sizes.
+
+#include "android/utils/ip_checksum.h"
+
+#include "android/base/testing/Benchmark.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+namespace {
+
+// 16 bits at a time, unrolled, as in the BSD in_cksum().
+uint16_t bsdSum(const uint8_t* data, size_t len) {
+    const uint16_t* w = reinterpret_cast<const uint16_t*>(data);
+    uint32_t sum = 0;
+    int mlen = static_cast<int>(len);
+    while ((mlen -= 32) >= 0) {
+        sum += w[0]; sum += w[1]; sum += w[2]; sum += w[3];
+        sum += w[4]; sum += w[5]; sum += w[6]; sum += w[7];
+        sum += w[8]; sum += w[9]; sum += w[10]; sum += w[11];
+        sum += w[12]; sum += w[13]; sum += w[14]; sum += w[15];
+        w += 16;
+    }
+    mlen += 32;
+    while ((mlen -= 2) >= 0) {
+        sum += *w++;
+    }
+    if (mlen == -1) {
+        sum += *reinterpret_cast<const uint8_t*>(w);
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return static_cast<uint16_t>(sum);
+}
+
+volatile uint32_t sSink;
+
+class IpChecksum : public android::base::Benchmark {
+public:
+    virtual void setUp(int64_t arg) {
+        mData = static_cast<uint8_t*>(malloc(arg));
+        for (int64_t n = 0; n < arg; ++n) {
+            mData[n] = static_cast<uint8_t>(n * 31U + 7U);
+        }
+    }
+
+    virtual void tearDown() {
+        free(mData);
+    }
+
+protected:
+    uint8_t* mData;
+};
+
+}  // namespace
+
+BENCHMARK_F(IpChecksum, Bsd) {
+    size_t size = static_cast<size_t>(state->arg());
+    state->setBytesPerOp(size);
+    for (size_t n = 0; n < state->iterations(); ++n) {
+        sSink += bsdSum(mData, size);
+    }
+}
+BENCHMARK_ARGS(IpChecksum, Bsd, 20, 64, 576, 1500, 9000, 65535);
+
+BENCHMARK_F(IpChecksum, Add) {
+    size_t size = static_cast<size_t>(state->arg());
+    state->setBytesPerOp(size);
+    for (size_t n = 0; n < state->iterations(); ++n) {
+        sSink += ip_checksum_add(mData, size);
+    }
+}
+BENCHMARK_ARGS(IpChecksum, Add, 20, 64, 576, 1500, 9000, 65535);
@@ -0,0 +1,77 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/utils/ip_checksum.h"
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+namespace {
+
+// The straightforward implementation, one big-endian word at a time.
+uint16_t referenceSum(const uint8_t* data, size_t len) {
+    uint32_t sum = 0;
+    for (size_t n = 0; n < len; ++n) {
+        sum += (n & 1) ? data[n] : (uint32_t)data[n] << 8;
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return (uint16_t)sum;
+}
+
+}  // namespace
+
+TEST(ip_checksum, Empty) {
+    EXPECT_EQ(0U, ip_checksum_add(NULL, 0));
+}
+
+TEST(ip_checksum, Rfc1071Example) {
+    static const uint8_t kData[] = {
+        0x00, 0x01, 0xf2, 0x03, 0xf4, 0xf5, 0xf6, 0xf7
+    };
+    EXPECT_EQ(0xddf2U, ip_checksum_add(kData, sizeof(kData)));
+}
+
+TEST(ip_checksum, OddLength) {
+    static const uint8_t kData[] = { 0x12, 0x34, 0x56 };
+    EXPECT_EQ(0x6834U, ip_checksum_add(kData, sizeof(kData)));
+}
+
+TEST(ip_checksum, Carries) {
+    // 64 KiB of 0xff bytes exercise all carry paths.
+    const size_t kSize = 65536;
+    uint8_t* data = new uint8_t[kSize + 1];
+    memset(data, 0xff, kSize + 1);
+    EXPECT_EQ(0xffffU, ip_checksum_add(data, kSize));
+    EXPECT_EQ(referenceSum(data, kSize + 1),
+              ip_checksum_add(data, kSize + 1));
+    delete [] data;
+}
+
+TEST(ip_checksum, MatchesReference) {
+    const size_t kMaxLen = 300;
+    const size_t kMaxOffset = 16;
+    uint8_t data[kMaxLen + kMaxOffset];
+    uint32_t seed = 12345;
+    for (size_t n = 0; n < sizeof(data); ++n) {
+        seed = seed * 1103515245U + 12345U;
+        data[n] = (uint8_t)(seed >> 16);
+    }
+    for (size_t offset = 0; offset < kMaxOffset; ++offset) {
+        for (size_t len = 0; len <= kMaxLen; ++len) {
+            EXPECT_EQ(referenceSum(data + offset, len),
+                      ip_checksum_add(data + offset, len))
+                    << "offset " << offset << " len " << len;
+        }
+    }
+}
@@ -0,0 +1,221 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#include "android/utils/ip_rules.h"
+
+#include "android/base/containers/HashMap.h"
+#include "android/base/containers/PodVector.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+using android::base::HashMap;
+using android::base::PodVector;
+
+namespace {
+
+/* Port ranges up to this size are expanded into one hash entry per port.
+ * Larger ones are added to a list for each block of 1024 ports that they
+ * overlap, so at most 64 lists.
+ */
+const int kMaxExpandedPorts = 64;
+const int kPortBlockShift = 10;
+
+const uint32_t kNoRule = 0xffffffffU;
+
+/* Keys are (masked address << 16) | port or port block, mix the high
+ * bits into the hash, since they would be lost on 32-bit hosts.
+ */
+struct RuleKeyTraits {
+    static size_t hash(const uint64_t& key) {
+        return static_cast<size_t>(key ^ (key >> 29));
+    }
+    static bool equals(const uint64_t& a, const uint64_t& b) {
+        return a == b;
+    }
+};
+
+struct PortRange {
+    uint32_t rule;  /* index of the rule */
+    uint32_t next;  /* next range for the same key, or kNoRule */
+    int lport;
+    int hport;
+};
+
+/* All the rules using the same mask */
+struct MaskGroup {
+    explicit MaskGroup(uint32_t m) :
+            mask(m), ports(), rangeHeads(), rangeTails(), ranges() {}
+
+    uint32_t mask;
+    /* Maps (address << 16 | port) to the first matching rule */
+    HashMap<uint64_t, uint32_t, RuleKeyTraits> ports;
+    /* Map (address << 16 | port block) to the first and last items of
+     * its list of port ranges in |ranges| */
+    HashMap<uint64_t, uint32_t, RuleKeyTraits> rangeHeads;
+    HashMap<uint64_t, uint32_t, RuleKeyTraits> rangeTails;
+    PodVector<PortRange> ranges;
+};
+
+uint64_t portKey(uint32_t addr, int port) {
+    return (static_cast<uint64_t>(addr) << 16) | static_cast<uint32_t>(port);
+}
+
+}  // namespace
+
+struct AIpRuleSet {
+    AIpRuleSet() : groups(), values() {}
+
+    ~AIpRuleSet() {
+        for (size_t n = 0; n < groups.size(); ++n) {
+            delete groups[n];
+        }
+    }
+
+    MaskGroup* getGroup(uint32_t mask) {
+        for (size_t n = 0; n < groups.size(); ++n) {
+            if (groups[n]->mask == mask) {
+                return groups[n];
+            }
+        }
+        MaskGroup* group = new MaskGroup(mask);
+        groups.push_back(group);
+        return group;
+    }
+
+    PodVector<MaskGroup*> groups;
+    PodVector<void*> values;
+};
+
+AIpRuleSet*
+aipRuleSet_new(void)
+{
+    return new AIpRuleSet();
+}
+
+void
+aipRuleSet_free( AIpRuleSet*  set )
+{
+    delete set;
+}
+
+int
+aipRuleSet_getCount( AIpRuleSet*  set )
+{
+    return static_cast<int>(set->values.size());
+}
+
+void
+aipRuleSet_add( AIpRuleSet*  set,
+                uint32_t     addr,
+                uint32_t     mask,
+                int          lport,
+                int          hport,
+                void*        value )
+{
+    uint32_t rule = static_cast<uint32_t>(set->values.size());
+    set->values.push_back(value);
+
+    if (lport < 0) {
+        lport = 0;
+    }
+    if (hport > 65535) {
+        hport = 65535;
+    }
+    if (lport > hport) {
+        return;  /* Never matches */
+    }
+
+    MaskGroup* group = set->getGroup(mask);
+    addr &= mask;
+
+    /* Since rules are added in order, an existing entry always has
+     * precedence over the new one.
+     */
+    if (hport - lport < kMaxExpandedPorts) {
+        for (int port = lport; port <= hport; ++port) {
+            uint64_t key = portKey(addr, port);
+            if (!group->ports.contains(key)) {
+                group->ports.set(key, rule);
+            }
+        }
+        return;
+    }
+
+    for (int block = lport >> kPortBlockShift;
+         block <= (hport >> kPortBlockShift); ++block) {
+        PortRange range;
+        range.rule = rule;
+        range.next = kNoRule;
+        range.lport = lport;
+        range.hport = hport;
+        uint32_t index = static_cast<uint32_t>(group->ranges.size());
+        group->ranges.push_back(range);
+
+        /* Append to the list to keep it sorted by rule index */
+        uint64_t key = portKey(addr, block);
+        uint32_t* tail = group->rangeTails.find(key);
+        if (tail) {
+            group->ranges[*tail].next = index;
+            *tail = index;
+        } else {
+            group->rangeHeads.set(key, index);
+            group->rangeTails.set(key, index);
+        }
+    }
+}
+
+int
+aipRuleSet_find( AIpRuleSet*  set,
+                 uint32_t     addr,
+                 int          port,
+                 void**       value )
+{
+    uint32_t best = kNoRule;
+
+    if (port < 0 || port > 65535) {
+        return 0;
+    }
+    for (size_t n = 0; n < set->groups.size(); ++n) {
+        MaskGroup* group = set->groups[n];
+        uint32_t key = addr & group->mask;
+
+        const uint32_t* rule = group->ports.find(portKey(key, port));
+        if (rule && *rule < best) {
+            best = *rule;
+        }
+
+        const uint32_t* head =
+                group->rangeHeads.find(portKey(key, port >> kPortBlockShift));
+        if (head) {
+            uint32_t pos = *head;
+            while (pos != kNoRule) {
+                const PortRange& range = group->ranges[pos];
+                if (range.rule >= best) {
+                    break;
+                }
+                if (range.lport <= port && port <= range.hport) {
+                    best = range.rule;
+                    break;
+                }
+                pos = range.next;
+            }
+        }
+    }
+
+    if (best == kNoRule) {
+        return 0;
+    }
+    if (value) {
+        *value = set->values[best];
+    }
+    return 1;
+}
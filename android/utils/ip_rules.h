@@ -0,0 +1,63 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#ifndef _ANDROID_UTILS_IP_RULES_H
+#define _ANDROID_UTILS_IP_RULES_H
+
+#include "android/utils/compiler.h"
+
+#include <stdint.h>
+
+ANDROID_BEGIN_HEADER
+
+/* An ordered set of rules matching IPv4 destinations, used to implement
+ * firewall and forwarding filters. Each rule matches the addresses 'a'
+ * such that (a & mask) == (addr & mask), and the ports in a given range.
+ *
+ * Rules are indexed per mask, and hashed on the masked address and the
+ * port, so that a lookup only costs a few hash probes per distinct mask,
+ * whatever the number of rules.
+ */
+
+typedef struct AIpRuleSet  AIpRuleSet;
+
+/* Create a new empty rule set */
+AIpRuleSet*  aipRuleSet_new(void);
+
+/* Returns the number of rules in the set */
+int          aipRuleSet_getCount( AIpRuleSet*  set );
+
+/* Append a rule matching 'addr' under 'mask', and the ports from 'lport'
+ * to 'hport' inclusive. 'value' is returned by aipRuleSet_find(). Ports
+ * outside of [0..65535] are clamped. All values are in host byte order.
+ */
+void         aipRuleSet_add( AIpRuleSet*  set,
+                             uint32_t     addr,
+                             uint32_t     mask,
+                             int          lport,
+                             int          hport,
+                             void*        value );
+
+/* Look for the first rule, in the order they were added, that matches
+ * 'addr' and 'port'. Returns 1 and sets '*value' (if not NULL) to the
+ * value of the rule if there is one, or returns 0 otherwise.
+ */
+int          aipRuleSet_find( AIpRuleSet*  set,
+                              uint32_t     addr,
+                              int          port,
+                              void**       value );
+
+/* Destroy a given rule set */
+void         aipRuleSet_free( AIpRuleSet*  set );
+
+ANDROID_END_HEADER
+
+#endif /* _ANDROID_UTILS_IP_RULES_H */
@@ -0,0 +1,124 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// A small micro-benchmark comparing aipRuleSet_find() with the linear
+// scan of the allow list that slirp_should_drop() used before. It
+// reports the average time of a lookup with 10, 100, 1000 and <count>
+// rules.
+//
+// Usage: emulator_ip_rules_benchmark [<count>]
+
+#include "android/utils/ip_rules.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+namespace {
+
+double nowUs() {
+#ifdef _WIN32
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (double)now.QuadPart * 1e6 / (double)freq.QuadPart;
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1e6 + tv.tv_usec;
+#endif
+}
+
+// Same layout and matching logic as the old fw_allow_entry list.
+struct AllowEntry {
+    AllowEntry* next;
+    unsigned long dst_addr;
+    unsigned short dst_lport;
+    unsigned short dst_hport;
+};
+
+bool linearAllowed(const AllowEntry* entry, unsigned long addr, int port) {
+    for (; entry; entry = entry->next) {
+        if (entry->dst_lport <= port && port <= entry->dst_hport &&
+            (entry->dst_addr == 0 || entry->dst_addr == addr)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+volatile int sSink;
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    int maxCount = 10000;
+    if (argc > 1) {
+        maxCount = atoi(argv[1]);
+    }
+    const int kLookups = 200000;
+    int counts[] = { 10, 100, 1000, maxCount };
+
+    printf("%8s %14s %14s\n", "rules", "linear ns/op", "hashed ns/op");
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c) {
+        int count = counts[c];
+        srand(1);
+        AllowEntry* entries = new AllowEntry[count];
+        AIpRuleSet* set = aipRuleSet_new();
+        for (int n = 0; n < count; ++n) {
+            AllowEntry& e = entries[n];
+            e.next = (n + 1 < count) ? &entries[n + 1] : NULL;
+            // Mostly single hosts and ports, some wildcards and ranges.
+            e.dst_addr = (n % 16 == 0) ? 0 : 0x0a000000UL + rand() % 65536;
+            e.dst_lport = 1 + rand() % 60000;
+            e.dst_hport = e.dst_lport + ((n % 8 == 0) ? rand() % 200 : 0);
+            aipRuleSet_add(set, e.dst_addr, e.dst_addr ? 0xffffffff : 0,
+                           e.dst_lport, e.dst_hport, NULL);
+        }
+
+        uint32_t* addrs = new uint32_t[kLookups];
+        int* ports = new int[kLookups];
+        for (int n = 0; n < kLookups; ++n) {
+            const AllowEntry& e = entries[rand() % count];
+            bool hit = (n & 1) != 0;
+            addrs[n] = hit && e.dst_addr ? e.dst_addr
+                                         : 0x0a000000UL + rand() % 65536;
+            ports[n] = hit ? e.dst_lport : 1 + rand() % 65535;
+        }
+
+        double start = nowUs();
+        for (int n = 0; n < kLookups; ++n) {
+            sSink += linearAllowed(entries, addrs[n], ports[n]);
+        }
+        double linearUs = nowUs() - start;
+
+        start = nowUs();
+        for (int n = 0; n < kLookups; ++n) {
+            sSink += aipRuleSet_find(set, addrs[n], ports[n], NULL);
+        }
+        double hashedUs = nowUs() - start;
+
+        printf("%8d %14.1f %14.1f\n", count, linearUs * 1e3 / kLookups,
+               hashedUs * 1e3 / kLookups);
+
+        aipRuleSet_free(set);
+        delete [] ports;
+        delete [] addrs;
+        delete [] entries;
+    }
+    return 0;
+}
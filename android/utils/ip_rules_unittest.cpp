@@ -0,0 +1,131 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/utils/ip_rules.h"
+
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+
+namespace {
+
+struct Rule {
+    uint32_t addr;
+    uint32_t mask;
+    int lport;
+    int hport;
+};
+
+// The straightforward implementation, a linear scan of all rules.
+int referenceFind(const Rule* rules, int count, uint32_t addr, int port) {
+    for (int n = 0; n < count; ++n) {
+        if ((rules[n].addr & rules[n].mask) == (addr & rules[n].mask) &&
+            rules[n].lport <= port && port <= rules[n].hport) {
+            return n;
+        }
+    }
+    return -1;
+}
+
+int find(AIpRuleSet* set, uint32_t addr, int port) {
+    void* value = NULL;
+    if (!aipRuleSet_find(set, addr, port, &value)) {
+        return -1;
+    }
+    return static_cast<int>(reinterpret_cast<intptr_t>(value));
+}
+
+void* toValue(int n) {
+    return reinterpret_cast<void*>(static_cast<intptr_t>(n));
+}
+
+}  // namespace
+
+TEST(IpRules, Empty) {
+    AIpRuleSet* set = aipRuleSet_new();
+    EXPECT_EQ(0, aipRuleSet_getCount(set));
+    EXPECT_FALSE(aipRuleSet_find(set, 0x0a000202, 80, NULL));
+    aipRuleSet_free(set);
+}
+
+TEST(IpRules, ExactAndAnyAddress) {
+    AIpRuleSet* set = aipRuleSet_new();
+    aipRuleSet_add(set, 0x0a000202, 0xffffffff, 80, 80, toValue(0));
+    aipRuleSet_add(set, 0, 0, 53, 53, toValue(1));
+    EXPECT_EQ(2, aipRuleSet_getCount(set));
+
+    EXPECT_EQ(0, find(set, 0x0a000202, 80));
+    EXPECT_EQ(-1, find(set, 0x0a000203, 80));
+    EXPECT_EQ(-1, find(set, 0x0a000202, 81));
+    EXPECT_EQ(1, find(set, 0x0a000202, 53));
+    EXPECT_EQ(1, find(set, 0x08080808, 53));
+    aipRuleSet_free(set);
+}
+
+TEST(IpRules, FirstRuleWins) {
+    AIpRuleSet* set = aipRuleSet_new();
+    aipRuleSet_add(set, 0x0a000000, 0xff000000, 1, 65535, toValue(0));
+    aipRuleSet_add(set, 0x0a000202, 0xffffffff, 80, 80, toValue(1));
+    aipRuleSet_add(set, 0x0a000202, 0xffffffff, 8000, 9000, toValue(2));
+    aipRuleSet_add(set, 0x0b000202, 0xffffffff, 8000, 9000, toValue(3));
+
+    EXPECT_EQ(0, find(set, 0x0a000202, 80));
+    EXPECT_EQ(0, find(set, 0x0a000202, 8080));
+    EXPECT_EQ(3, find(set, 0x0b000202, 8080));
+    EXPECT_EQ(-1, find(set, 0x0b000202, 80));
+    EXPECT_EQ(-1, find(set, 0x0a000202, 0));
+    aipRuleSet_free(set);
+}
+
+TEST(IpRules, PortClamping) {
+    AIpRuleSet* set = aipRuleSet_new();
+    aipRuleSet_add(set, 0, 0, -10, 100000, toValue(0));
+    aipRuleSet_add(set, 0, 0, 20, 10, toValue(1));
+    EXPECT_EQ(2, aipRuleSet_getCount(set));
+    EXPECT_EQ(0, find(set, 1, 0));
+    EXPECT_EQ(0, find(set, 1, 65535));
+    EXPECT_EQ(-1, find(set, 1, 65536));
+    EXPECT_EQ(-1, find(set, 1, -1));
+    aipRuleSet_free(set);
+}
+
+TEST(IpRules, MatchesLinearScan) {
+    static const uint32_t kMasks[] = {
+        0xffffffff, 0xffffff00, 0xffff0000, 0, 0xff00ff00,
+    };
+    const int kCount = 2000;
+    Rule rules[kCount];
+    AIpRuleSet* set = aipRuleSet_new();
+    srand(42);
+    for (int n = 0; n < kCount; ++n) {
+        Rule& r = rules[n];
+        r.addr = 0x0a000000 | (rand() & 0x3ff);
+        r.mask = kMasks[rand() % 5];
+        r.lport = rand() % 1024;
+        switch (rand() % 3) {
+        case 0: r.hport = r.lport; break;
+        case 1: r.hport = r.lport + rand() % 64; break;
+        default: r.hport = r.lport + rand() % 2000; break;
+        }
+        aipRuleSet_add(set, r.addr, r.mask, r.lport, r.hport, toValue(n));
+    }
+    for (int n = 0; n < 100000; ++n) {
+        uint32_t addr = 0x0a000000 | (rand() & 0x7ff);
+        if (rand() & 1) {
+            addr ^= 0x01000000;
+        }
+        int port = rand() % 3100;
+        ASSERT_EQ(referenceFind(rules, kCount, addr, port),
+                  find(set, addr, port))
+                << "addr " << addr << " port " << port;
+    }
+    aipRuleSet_free(set);
+}
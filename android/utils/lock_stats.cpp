@@ -0,0 +1,24 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/utils/lock_stats.h"
+
+#include "android/base/synchronization/LockProfiler.h"
+
+using android::base::LockSite;
+
+size_t lockStats_print(char* buffer, size_t bufferSize) {
+    return LockSite::printAll(buffer, bufferSize);
+}
+
+void lockStats_reset(void) {
+    LockSite::resetAll();
+}
@@ -0,0 +1,36 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#ifndef ANDROID_UTILS_LOCK_STATS_H
+#define ANDROID_UTILS_LOCK_STATS_H
+
+#include "android/utils/compiler.h"
+
+#include <stddef.h>
+
+ANDROID_BEGIN_HEADER
+
+// C access to the contention statistics of the named android::base::Lock
+// instances, only collected by builds configured with --lock-profiling.
+// See android/base/synchronization/Lock.h.
+
+// Print a line per lock name into |buffer|, with the number of
+// acquisitions and contended ones, and the total and maximum wait and
+// hold times, sorted by decreasing wait time. Return the length of the
+// whole table, which is truncated if it doesn't fit in |bufferSize| bytes.
+size_t lockStats_print(char* buffer, size_t bufferSize);
+
+// Reset the statistics of all locks.
+void lockStats_reset(void);
+
+ANDROID_END_HEADER
+
+#endif  // ANDROID_UTILS_LOCK_STATS_H
@@ -221,7 +221,7 @@ mapfile_map(MapFile* handle,
     }
 #else   // WIN32
     mapped_at =
-        mmap(0, map_size, PROT_READ, MAP_SHARED, (int)(ptrdiff_t)handle, map_offset);
+        mmap(0, map_size, prot, MAP_SHARED, (int)(ptrdiff_t)handle, map_offset);
     if (mapped_at == MAP_FAILED) {
         return NULL;
     }
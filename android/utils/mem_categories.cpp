@@ -0,0 +1,110 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/utils/mem_categories.h"
+
+#include "android/base/memory/LazyInstance.h"
+#include "android/base/memory/MallocUsableSize.h"
+#include "android/base/synchronization/Lock.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace {
+
+using android::base::AutoLock;
+using android::base::LazyInstance;
+using android::base::Lock;
+
+// The registered categories, sorted by name. Categories are never removed,
+// and only the registration takes the lock.
+struct Registry {
+    Registry() : lock(), head(NULL) {}
+
+    Lock lock;
+    MemCategory* head;
+};
+
+LazyInstance<Registry> sRegistry = LAZY_INSTANCE_INIT;
+
+// Return the size of the heap block |ptr|, or 0 if unknown.
+int64_t blockSize(void* ptr) {
+    if (!ptr) {
+        return 0;
+    }
+#if USE_MALLOC_USABLE_SIZE
+    return static_cast<int64_t>(malloc_usable_size(ptr));
+#elif defined(_WIN32)
+    return static_cast<int64_t>(_msize(ptr));
+#else
+    return 0;
+#endif
+}
+
+}  // namespace
+
+void memCategory_register(MemCategory* category) {
+    Registry* registry = sRegistry.ptr();
+    AutoLock lock(registry->lock);
+    if (category->registered) {
+        return;
+    }
+    MemCategory** link = &registry->head;
+    while (*link && strcmp((*link)->name, category->name) < 0) {
+        link = &(*link)->next;
+    }
+    category->next = *link;
+    *link = category;
+    __atomic_store_n(&category->registered, 1, __ATOMIC_RELEASE);
+}
+
+void* memCategory_malloc(MemCategory* category, size_t size) {
+    void* ptr = malloc(size);
+    memCategory_add(category, blockSize(ptr));
+    return ptr;
+}
+
+void* memCategory_calloc(MemCategory* category, size_t count, size_t size) {
+    void* ptr = calloc(count, size);
+    memCategory_add(category, blockSize(ptr));
+    return ptr;
+}
+
+void* memCategory_realloc(MemCategory* category, void* ptr, size_t size) {
+    int64_t oldSize = blockSize(ptr);
+    void* newPtr = realloc(ptr, size);
+    if (!newPtr && size) {
+        // The old block is still allocated.
+        return NULL;
+    }
+    memCategory_add(category, blockSize(newPtr) - oldSize);
+    return newPtr;
+}
+
+void memCategory_free(MemCategory* category, void* ptr) {
+    if (ptr) {
+        memCategory_add(category, -blockSize(ptr));
+        free(ptr);
+    }
+}
+
+void memCategories_forEach(MemCategoryVisitor visitor, void* opaque) {
+    Registry* registry = sRegistry.ptr();
+    AutoLock lock(registry->lock);
+    for (const MemCategory* category = registry->head; category;
+         category = category->next) {
+        visitor(opaque, category);
+    }
+}
@@ -0,0 +1,101 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#ifndef ANDROID_UTILS_MEM_CATEGORIES_H
+#define ANDROID_UTILS_MEM_CATEGORIES_H
+
+#include "android/utils/compiler.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+ANDROID_BEGIN_HEADER
+
+// Categories of host memory, to know which subsystems use it. All of them
+// are listed with their live and peak sizes by the 'memstats' console
+// command.
+//
+// Like a PerfCounter, a category is a static variable that registers
+// itself the first time it is used:
+//
+//     static MemCategory sMbufMemory = MEM_CATEGORY_INIT("slirp.mbufs");
+//
+// Subsystems either allocate their heap blocks through the category:
+//
+//     m = memCategory_malloc(&sMbufMemory, size);
+//     ...
+//     memCategory_free(&sMbufMemory, m);
+//
+// which accounts for the usable size of each block, or report the size of
+// their other allocations, e.g. mappings, with memCategory_add(). Sizes
+// of mappings are reserved sizes, of which only a part can be resident.
+//
+// Accounting is a relaxed atomic addition, so all functions can be used
+// from any thread. Blocks must be freed with the category that allocated
+// them.
+
+typedef struct MemCategory MemCategory;
+
+struct MemCategory {
+    int64_t live;
+    int64_t peak;
+    // Dotted name, the prefix being the subsystem, e.g. 'tcg.code_buffer'.
+    const char* name;
+    // Private, the registry.
+    int registered;
+    MemCategory* next;
+};
+
+#define MEM_CATEGORY_INIT(name)  { 0, 0, (name), 0, NULL }
+
+// Add |category| to the registry, done on its first use.
+void memCategory_register(MemCategory* category);
+
+// Add |delta| bytes, which can be negative, to the live size of
+// |category|, and update its peak.
+static inline void memCategory_add(MemCategory* category, int64_t delta) {
+    if (!__atomic_load_n(&category->registered, __ATOMIC_ACQUIRE)) {
+        memCategory_register(category);
+    }
+    int64_t live = __atomic_add_fetch(&category->live, delta,
+                                      __ATOMIC_RELAXED);
+    int64_t peak = __atomic_load_n(&category->peak, __ATOMIC_RELAXED);
+    while (live > peak &&
+           !__atomic_compare_exchange_n(&category->peak, &peak, live, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+// Return the current and the largest sizes of |category|, in bytes.
+static inline int64_t memCategory_live(const MemCategory* category) {
+    return __atomic_load_n(&category->live, __ATOMIC_RELAXED);
+}
+
+static inline int64_t memCategory_peak(const MemCategory* category) {
+    return __atomic_load_n(&category->peak, __ATOMIC_RELAXED);
+}
+
+// Same as malloc(), calloc(), realloc() and free(), accounting for the
+// blocks in |category|. Where the C library can't tell the size of a
+// block, blocks aren't accounted for.
+void* memCategory_malloc(MemCategory* category, size_t size);
+void* memCategory_calloc(MemCategory* category, size_t count, size_t size);
+void* memCategory_realloc(MemCategory* category, void* ptr, size_t size);
+void memCategory_free(MemCategory* category, void* ptr);
+
+// Call |visitor| for each registered category, sorted by name.
+typedef void (*MemCategoryVisitor)(void* opaque,
+                                   const MemCategory* category);
+void memCategories_forEach(MemCategoryVisitor visitor, void* opaque);
+
+ANDROID_END_HEADER
+
+#endif  // ANDROID_UTILS_MEM_CATEGORIES_H
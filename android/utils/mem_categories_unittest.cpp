@@ -0,0 +1,104 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/utils/mem_categories.h"
+
+#include "android/base/memory/MallocUsableSize.h"
+#include "android/base/String.h"
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+namespace android {
+namespace utils {
+
+using android::base::String;
+
+namespace {
+
+// Categories are registered for the lifetime of the program, so each test
+// uses its own names, and only looks at them.
+struct Visit {
+    const char* prefix;
+    String names;
+};
+
+void visitCategory(void* opaque, const MemCategory* category) {
+    Visit* visit = static_cast<Visit*>(opaque);
+    if (strncmp(category->name, visit->prefix, strlen(visit->prefix))) {
+        return;
+    }
+    visit->names += category->name;
+    visit->names += " ";
+}
+
+}  // namespace
+
+TEST(MemCategories, RegisteredOnFirstUseSortedByName) {
+    static MemCategory b = MEM_CATEGORY_INIT("memtest1.b");
+    static MemCategory a = MEM_CATEGORY_INIT("memtest1.a");
+    static MemCategory unused = MEM_CATEGORY_INIT("memtest1.c");
+
+    memCategory_add(&b, 100);
+    memCategory_add(&a, 10);
+
+    Visit visit = { "memtest1.", String() };
+    memCategories_forEach(visitCategory, &visit);
+    EXPECT_STREQ("memtest1.a memtest1.b ", visit.names.c_str());
+    EXPECT_EQ(0, memCategory_live(&unused));
+}
+
+TEST(MemCategories, LiveAndPeak) {
+    static MemCategory category = MEM_CATEGORY_INIT("memtest2.mapping");
+
+    memCategory_add(&category, 4096);
+    memCategory_add(&category, 8192);
+    memCategory_add(&category, -4096);
+    EXPECT_EQ(8192, memCategory_live(&category));
+    EXPECT_EQ(12288, memCategory_peak(&category));
+
+    memCategory_add(&category, -8192);
+    EXPECT_EQ(0, memCategory_live(&category));
+    EXPECT_EQ(12288, memCategory_peak(&category));
+}
+
+TEST(MemCategories, HeapBlocks) {
+    static MemCategory category = MEM_CATEGORY_INIT("memtest3.heap");
+
+    void* block = memCategory_malloc(&category, 1000);
+    ASSERT_TRUE(block);
+    void* zeroed = memCategory_calloc(&category, 10, 100);
+    ASSERT_TRUE(zeroed);
+    for (size_t n = 0; n < 1000; ++n) {
+        EXPECT_EQ(0, static_cast<char*>(zeroed)[n]);
+    }
+
+#if USE_MALLOC_USABLE_SIZE
+    EXPECT_LE(2000, memCategory_live(&category));
+#endif
+    block = memCategory_realloc(&category, block, 100000);
+    ASSERT_TRUE(block);
+#if USE_MALLOC_USABLE_SIZE
+    EXPECT_LE(101000, memCategory_live(&category));
+#endif
+
+    memCategory_free(&category, block);
+    memCategory_free(&category, zeroed);
+    memCategory_free(&category, NULL);
+    EXPECT_EQ(0, memCategory_live(&category));
+#if USE_MALLOC_USABLE_SIZE
+    EXPECT_LE(101000, memCategory_peak(&category));
+#endif
+}
+
+}  // namespace utils
+}  // namespace android
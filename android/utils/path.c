@@ -36,6 +36,17 @@
 #include <signal.h>
 #endif
 
+#ifdef __linux__
+#include <sys/ioctl.h>
+#ifndef FICLONE
+#define FICLONE  _IOW(0x94, 9, int)
+#endif
+#endif
+
+#ifdef __APPLE__
+#include <dlfcn.h>
+#endif
+
 #define  D(...)  VERBOSE_PRINT(init,__VA_ARGS__)
 
 /** PATH HANDLING ROUTINES
@@ -488,7 +499,7 @@ path_get_absolute( const char* path )
  **  path_empty_file() creates an empty file at a given path location.
  **  if the file already exists, it is truncated without warning
  **
- **  path_copy_file() copies one file into another.
+ **  path_copy_file() copies one file into another, see path_copy_fd()
  **
  **  both functions return 0 on success, and -1 on error
  **/
@@ -510,45 +521,225 @@ path_empty_file( const char*  path )
     return -1;
 }
 
+/* Data is copied in chunks of this size, and blocks of zeroes in them
+ * are skipped to leave holes in the destination. */
+#define  COPY_CHUNK_SIZE  (1024*1024)
+#define  COPY_BLOCK_SIZE  4096
+
+#ifdef _WIN32
+#define  copy_lseek(fd, offset, whence)  _lseeki64(fd, offset, whence)
+#define  copy_truncate(fd, size)         (_chsize_s(fd, size) ? -1 : 0)
+#else
+#define  copy_lseek(fd, offset, whence)  lseek(fd, offset, whence)
+#define  copy_truncate(fd, size)         ftruncate(fd, size)
+#endif
+
+static int
+_is_zero_block( const char*  p, size_t  len )
+{
+    return p[0] == 0 && !memcmp(p, p + 1, len - 1);
+}
+
+static APosixStatus
+_write_at( int  fd, const char*  buf, size_t  len, int64_t  pos )
+{
+    if (copy_lseek(fd, pos, SEEK_SET) != pos) {
+        return -1;
+    }
+    while (len > 0) {
+        ssize_t  n = HANDLE_EINTR(write(fd, buf, len));
+        if (n <= 0) {
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Copy [pos, end) of 'source_fd' to the same offsets of 'dest_fd', or up
+ * to the end of the source if 'end' is negative. */
+static APosixStatus
+_copy_range( int  dest_fd, int  source_fd, char*  buf,
+             int64_t  pos, int64_t  end )
+{
+    if (copy_lseek(source_fd, pos, SEEK_SET) != pos) {
+        return -1;
+    }
+    while (end < 0 || pos < end) {
+        size_t   len = COPY_CHUNK_SIZE;
+        ssize_t  n;
+        size_t   off, run;
+
+        if (end >= 0 && (int64_t)len > end - pos) {
+            len = (size_t)(end - pos);
+        }
+        n = HANDLE_EINTR(read(source_fd, buf, len));
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        /* Write each run of non-zero blocks at once */
+        for (off = 0; off < (size_t)n; off += run) {
+            run = (size_t)n - off;
+            if (run > COPY_BLOCK_SIZE) {
+                run = COPY_BLOCK_SIZE;
+            }
+            if (_is_zero_block(buf + off, run)) {
+                continue;
+            }
+            while (off + run < (size_t)n) {
+                size_t  block = (size_t)n - off - run;
+                if (block > COPY_BLOCK_SIZE) {
+                    block = COPY_BLOCK_SIZE;
+                }
+                if (_is_zero_block(buf + off + run, block)) {
+                    break;
+                }
+                run += block;
+            }
+            if (_write_at(dest_fd, buf + off, run, pos + off) < 0) {
+                return -1;
+            }
+        }
+        pos += n;
+    }
+    return 0;
+}
+
 APosixStatus
-path_copy_file( const char*  dest, const char*  source )
+path_copy_fd( int  dest_fd, int  source_fd )
 {
-    int  fd, fs, result = -1;
+    int64_t  size, pos;
+    char*    buf;
+    int      result = 0;
 
-    /* if the destination doesn't exist, create it */
-    if ( access(source, F_OK)  < 0 ||
-         path_empty_file(dest) < 0) {
+    size = copy_lseek(source_fd, 0, SEEK_END);
+    if (size < 0 || copy_truncate(dest_fd, 0) < 0) {
         return -1;
     }
 
+#ifdef __linux__
+    /* Share the extents of the source when the file system supports it,
+     * e.g. btrfs or XFS, until either file is modified. */
+    if (ioctl(dest_fd, FICLONE, source_fd) == 0) {
+        return 0;
+    }
+#endif
+#ifdef _WIN32
+    {
+        /* Skipped blocks only stay unallocated in sparse files */
+        DWORD  returned;
+        DeviceIoControl((HANDLE)_get_osfhandle(dest_fd), FSCTL_SET_SPARSE,
+                        NULL, 0, NULL, 0, &returned, NULL);
+    }
+#endif
+
+    buf = malloc(COPY_CHUNK_SIZE);
+    if (buf == NULL) {
+        return -1;
+    }
+
+    pos = 0;
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+    /* Only read the data regions of a sparse source */
+    while (pos < size) {
+        int64_t  data = lseek(source_fd, pos, SEEK_DATA);
+        int64_t  hole;
+
+        if (data < 0) {
+            if (errno == ENXIO) {
+                pos = size;     /* only a hole remains */
+            }
+            break;
+        }
+        hole = lseek(source_fd, data, SEEK_HOLE);
+        if (hole < 0) {
+            break;
+        }
+        if (_copy_range(dest_fd, source_fd, buf, data, hole) < 0) {
+            result = -1;
+            break;
+        }
+        pos = hole;
+    }
+#endif
+    /* Copy what remains if the whole source couldn't be walked above */
+    if (result == 0 && pos < size) {
+        result = _copy_range(dest_fd, source_fd, buf, pos, -1);
+    }
+    free(buf);
+
+    /* Trailing holes aren't written, set the size explicitly */
+    if (result == 0 && copy_truncate(dest_fd, size) < 0) {
+        result = -1;
+    }
+    return result;
+}
+
+#ifdef __APPLE__
+/* Clone 'source' to a new file 'dest' with clonefile(), which is only
+ * available from OS X 10.12 and on APFS volumes. */
+static APosixStatus
+_clone_file( const char*  dest, const char*  source )
+{
+    typedef int (*CloneFileFunc)(const char*, const char*, uint32_t);
+    static CloneFileFunc  clone_func;
+    static int            clone_probed;
+
+    if (!clone_probed) {
+        clone_func = (CloneFileFunc)dlsym(RTLD_DEFAULT, "clonefile");
+        clone_probed = 1;
+    }
+    if (clone_func == NULL) {
+        return -1;
+    }
+    unlink(dest);
+    if (clone_func(source, dest, 0) < 0) {
+        return -1;
+    }
+    /* same permissions as path_empty_file() */
+    chmod(dest, S_IRUSR | S_IWUSR);
+    return 0;
+}
+#endif
+
+APosixStatus
+path_copy_file( const char*  dest, const char*  source )
+{
+    int  fd, fs, result = -1;
+
     if ( access(source, R_OK) < 0 ) {
         D("%s: source file is un-readable: %s\n",
           __FUNCTION__, source);
         return -1;
     }
 
+#ifdef __APPLE__
+    if (_clone_file(dest, source) == 0) {
+        return 0;
+    }
+#endif
+
+    /* if the destination doesn't exist, create it */
+    if ( path_empty_file(dest) < 0 ) {
+        return -1;
+    }
+
 #ifdef _WIN32
     fd = _open(dest, _O_RDWR | _O_BINARY);
     fs = _open(source, _O_RDONLY |  _O_BINARY);
 #else
-    fd = creat(dest, S_IRUSR | S_IWUSR);
-    fs = open(source, S_IREAD);
+    fd = open(dest, O_WRONLY);
+    fs = open(source, O_RDONLY);
 #endif
     if (fs >= 0 && fd >= 0) {
-        char buf[4096];
-        ssize_t total = 0;
-        ssize_t n;
-        result = 0; /* success */
-        while ((n = read(fs, buf, 4096)) > 0) {
-            if (write(fd, buf, n) != n) {
-                /* write failed. Make it return -1 so that an
-                 * empty file be created. */
-                D("Failed to copy '%s' to '%s': %s (%d)",
-                       source, dest, strerror(errno), errno);
-                result = -1;
-                break;
-            }
-            total += n;
+        result = path_copy_fd(fd, fs);
+        if (result < 0) {
+            D("Failed to copy '%s' to '%s': %s (%d)",
+                   source, dest, strerror(errno), errno);
         }
     }
 
@@ -561,7 +752,6 @@ path_copy_file( const char*  dest, const char*  source )
     return result;
 }
 
-
 APosixStatus
 path_delete_file( const char*  path )
 {
@@ -155,6 +155,14 @@ extern APosixStatus   path_empty_file( const char*  path );
  * (error code in errno). Does not work on directories */
 extern APosixStatus   path_copy_file( const char*  dest, const char*  source );
 
+/* replaces the content of the file opened as 'dest_fd' with the one of
+ * 'source_fd'. The copy shares the blocks of the source when the file
+ * system supports it (reflinks on btrfs or XFS, clones on APFS through
+ * path_copy_file()). Otherwise only the data is copied: holes of the
+ * source and blocks of zeroes are left as holes in the destination.
+ * 0 on success, -1 on failure (error code in errno) */
+extern APosixStatus   path_copy_fd( int  dest_fd, int  source_fd );
+
 /* unlink/delete a given file. Note that on Win32, this will
  * fail if the program has an opened handle to the file
  */
@@ -10,11 +10,48 @@
 // GNU General Public License for more details.
 
 #include "android/utils/path.h"
-#include "gtest/gtest.h"
+
+#include "android/base/String.h"
+#include "android/base/testing/TestTempDir.h"
+
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
 namespace android {
 namespace path {
 
+using android::base::String;
+using android::base::TestTempDir;
+
+namespace {
+
+void writeFile(const String& path, const char* data, size_t size) {
+    FILE* file = fopen(path.c_str(), "wb");
+    ASSERT_TRUE(file);
+    EXPECT_EQ(size, fwrite(data, 1, size, file));
+    fclose(file);
+}
+
+void expectFileContent(const String& path, const char* data, size_t size) {
+    size_t fileSize = 0;
+    char* content = static_cast<char*>(path_load_file(path.c_str(),
+                                                      &fileSize));
+    ASSERT_TRUE(content);
+    EXPECT_EQ(size, fileSize);
+    EXPECT_EQ(0, memcmp(data, content, size < fileSize ? size : fileSize));
+    free(content);
+}
+
+}  // namespace
+
 TEST(Path, EscapePath) {
     const char linuxInputPath[]    = "/Linux/style_with/various,special==character%s";
     const char linuxOutputPath[]   = "/Linux/style_with/various%Cspecial%E%Echaracter%Ps";
@@ -47,5 +84,60 @@ TEST(Path, EscapePath) {
     free(result);
 }
 
+TEST(Path, CopyFile) {
+    TestTempDir dir("path_test");
+    String source = dir.makeSubPath("source");
+    String dest = dir.makeSubPath("dest");
+
+    // Blocks of zeroes, which are skipped, in the middle of the data and at
+    // its end, and a partial block.
+    const size_t kSize = 3 * 1024 * 1024 + 1000;
+    char* data = static_cast<char*>(calloc(1, kSize));
+    memset(data, 0x55, 10000);
+    memset(data + 2 * 1024 * 1024 + 100, 0xaa, 4096);
+    data[2 * 1024 * 1024 + 8192 + 17] = 1;
+
+    writeFile(source, data, kSize);
+    writeFile(dest, "previous content", 16);
+    EXPECT_EQ(0, path_copy_file(dest.c_str(), source.c_str()));
+    expectFileContent(dest, data, kSize);
+
+    free(data);
+}
+
+TEST(Path, CopyEmptyFile) {
+    TestTempDir dir("path_test");
+    String source = dir.makeSubPath("source");
+    String dest = dir.makeSubPath("dest");
+
+    writeFile(source, "", 0);
+    EXPECT_EQ(0, path_copy_file(dest.c_str(), source.c_str()));
+    expectFileContent(dest, "", 0);
+
+    EXPECT_EQ(-1, path_copy_file(dest.c_str(),
+                                 dir.makeSubPath("missing").c_str()));
+}
+
+TEST(Path, CopyFd) {
+    TestTempDir dir("path_test");
+    String source = dir.makeSubPath("source");
+    String dest = dir.makeSubPath("dest");
+    static const char kData[] = "new content";
+    static const char kPrevious[] = "a longer previous content";
+
+    writeFile(source, kData, sizeof(kData));
+    writeFile(dest, kPrevious, sizeof(kPrevious));
+
+    int sourceFd = open(source.c_str(), O_RDONLY);
+    int destFd = open(dest.c_str(), O_RDWR);
+    ASSERT_GE(sourceFd, 0);
+    ASSERT_GE(destFd, 0);
+    EXPECT_EQ(0, path_copy_fd(destFd, sourceFd));
+    close(sourceFd);
+    close(destFd);
+
+    expectFileContent(dest, kData, sizeof(kData));
+}
+
 }  // namespace path
 }  // namespace android
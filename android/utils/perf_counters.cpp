@@ -0,0 +1,60 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/utils/perf_counters.h"
+
+#include "android/base/memory/LazyInstance.h"
+#include "android/base/synchronization/Lock.h"
+
+#include <string.h>
+
+namespace {
+
+using android::base::AutoLock;
+using android::base::LazyInstance;
+using android::base::Lock;
+
+// The registered counters, sorted by name. Counters are never removed,
+// and only the registration takes the lock.
+struct Registry {
+    Registry() : lock(), head(NULL) {}
+
+    Lock lock;
+    PerfCounter* head;
+};
+
+LazyInstance<Registry> sRegistry = LAZY_INSTANCE_INIT;
+
+}  // namespace
+
+void perfCounter_register(PerfCounter* counter) {
+    Registry* registry = sRegistry.ptr();
+    AutoLock lock(registry->lock);
+    if (counter->registered) {
+        return;
+    }
+    PerfCounter** link = &registry->head;
+    while (*link && strcmp((*link)->name, counter->name) < 0) {
+        link = &(*link)->next;
+    }
+    counter->next = *link;
+    *link = counter;
+    __atomic_store_n(&counter->registered, 1, __ATOMIC_RELEASE);
+}
+
+void perfCounters_forEach(PerfCounterVisitor visitor, void* opaque) {
+    Registry* registry = sRegistry.ptr();
+    AutoLock lock(registry->lock);
+    for (const PerfCounter* counter = registry->head; counter;
+         counter = counter->next) {
+        visitor(opaque, counter);
+    }
+}
@@ -0,0 +1,73 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#ifndef ANDROID_UTILS_PERF_COUNTERS_H
+#define ANDROID_UTILS_PERF_COUNTERS_H
+
+#include "android/utils/compiler.h"
+
+#include <stdint.h>
+
+ANDROID_BEGIN_HEADER
+
+// Performance counters that any subsystem can define, and that are all
+// listed by the 'perfstats' console command, or periodically dumped to
+// a file with '-perf-stats <file>'.
+//
+// A counter is a static variable, that registers itself the first time
+// it is incremented, e.g.:
+//
+//     static PerfCounter sPacketsCounter =
+//             PERF_COUNTER_INIT("slirp.packets_in", "packets");
+//     ...
+//     perfCounter_add(&sPacketsCounter, 1);
+//
+// Incrementing a counter is a relaxed atomic addition, so they can be
+// used from any thread, including in hot paths.
+
+typedef struct PerfCounter PerfCounter;
+
+struct PerfCounter {
+    uint64_t value;
+    // Dotted name, the prefix being the subsystem, e.g. 'pipe.commands'.
+    const char* name;
+    // Unit of the value, e.g. 'bytes'.
+    const char* unit;
+    // Private, the registry.
+    int registered;
+    PerfCounter* next;
+};
+
+#define PERF_COUNTER_INIT(name, unit)  { 0, (name), (unit), 0, NULL }
+
+// Add |counter| to the registry, done on its first increment.
+void perfCounter_register(PerfCounter* counter);
+
+// Add |delta| to the value of |counter|.
+static inline void perfCounter_add(PerfCounter* counter, uint64_t delta) {
+    if (!__atomic_load_n(&counter->registered, __ATOMIC_ACQUIRE)) {
+        perfCounter_register(counter);
+    }
+    __atomic_fetch_add(&counter->value, delta, __ATOMIC_RELAXED);
+}
+
+// Return the current value of |counter|.
+static inline uint64_t perfCounter_get(const PerfCounter* counter) {
+    return __atomic_load_n(&counter->value, __ATOMIC_RELAXED);
+}
+
+// Call |visitor| for each registered counter, sorted by name.
+typedef void (*PerfCounterVisitor)(void* opaque, const PerfCounter* counter);
+void perfCounters_forEach(PerfCounterVisitor visitor, void* opaque);
+
+ANDROID_END_HEADER
+
+#endif  // ANDROID_UTILS_PERF_COUNTERS_H
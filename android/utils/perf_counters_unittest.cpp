@@ -0,0 +1,110 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/utils/perf_counters.h"
+
+#include "android/base/String.h"
+#include "android/base/threads/Thread.h"
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+namespace android {
+namespace utils {
+
+using android::base::String;
+using android::base::Thread;
+
+namespace {
+
+// Counters are registered for the lifetime of the program, so each test
+// uses its own names, and only looks at them.
+struct Visit {
+    const char* prefix;
+    String names;
+    uint64_t total;
+};
+
+void visitCounter(void* opaque, const PerfCounter* counter) {
+    Visit* visit = static_cast<Visit*>(opaque);
+    if (strncmp(counter->name, visit->prefix, strlen(visit->prefix))) {
+        return;
+    }
+    visit->names += counter->name;
+    visit->names += " ";
+    visit->total += perfCounter_get(counter);
+}
+
+class AddThread : public Thread {
+public:
+    AddThread(PerfCounter* counter, int count) :
+            mCounter(counter), mCount(count) {}
+
+    virtual intptr_t main() {
+        for (int n = 0; n < mCount; ++n) {
+            perfCounter_add(mCounter, 1);
+        }
+        return 0;
+    }
+
+private:
+    PerfCounter* mCounter;
+    int mCount;
+};
+
+}  // namespace
+
+TEST(PerfCounters, RegisteredOnFirstUseSortedByName) {
+    static PerfCounter b = PERF_COUNTER_INIT("test1.b", "bytes");
+    static PerfCounter a = PERF_COUNTER_INIT("test1.a", "bytes");
+    static PerfCounter unused = PERF_COUNTER_INIT("test1.c", "bytes");
+
+    Visit visit = { "test1.", String(), 0 };
+    perfCounters_forEach(visitCounter, &visit);
+    EXPECT_STREQ("", visit.names.c_str());
+
+    perfCounter_add(&b, 3);
+    perfCounter_add(&a, 1);
+    perfCounter_add(&b, 4);
+    EXPECT_EQ(7U, perfCounter_get(&b));
+
+    visit.total = 0;
+    perfCounters_forEach(visitCounter, &visit);
+    EXPECT_STREQ("test1.a test1.b ", visit.names.c_str());
+    EXPECT_EQ(8U, visit.total);
+    EXPECT_EQ(0U, perfCounter_get(&unused));
+}
+
+TEST(PerfCounters, ConcurrentAdds) {
+    static PerfCounter counter = PERF_COUNTER_INIT("test2.counter", "ops");
+    const int kThreads = 4;
+    const int kCount = 100000;
+    AddThread* threads[kThreads];
+
+    for (int n = 0; n < kThreads; ++n) {
+        threads[n] = new AddThread(&counter, kCount);
+        EXPECT_TRUE(threads[n]->start());
+    }
+    for (int n = 0; n < kThreads; ++n) {
+        EXPECT_TRUE(threads[n]->wait(NULL));
+        delete threads[n];
+    }
+    EXPECT_EQ(static_cast<uint64_t>(kThreads * kCount),
+              perfCounter_get(&counter));
+
+    Visit visit = { "test2.", String(), 0 };
+    perfCounters_forEach(visitCounter, &visit);
+    EXPECT_STREQ("test2.counter ", visit.names.c_str());
+}
+
+}  // namespace utils
+}  // namespace android
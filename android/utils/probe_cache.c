@@ -0,0 +1,226 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/utils/probe_cache.h"
+
+#include "android/utils/bufprint.h"
+#include "android/utils/path.h"
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef PATH_MAX
+#define PATH_MAX  1024
+#endif
+
+#define DEBUG 0
+
+#if DEBUG
+#define D(...)  fprintf(stderr, __VA_ARGS__)
+#else
+#define D(...)  do {} while (0)
+#endif
+
+// An entry is a file named after a hash of its key, which is the probe
+// kind and the path separated by a NUL byte. It is made of a header, the
+// key, and the result. It uses the host byte order, the magic doesn't
+// match on a host with another one.
+#define CACHE_MAGIC    0x43425250  // 'PRBC'
+#define CACHE_VERSION  1
+
+// Entries hold small results, anything larger is corrupted.
+#define CACHE_MAX_DATA  (1024 * 1024)
+
+// Files modified since less than that aren't stored, because they could
+// change again without changing their modification time.
+#define CACHE_RACY_SECONDS  2
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t file_size;
+    int64_t file_mtime;
+    uint32_t key_len;
+    uint32_t data_len;
+} CacheHeader;
+
+static char sCacheDir[PATH_MAX];
+static int sCacheDirSet;
+
+void probeCache_setDir(const char* dir) {
+    sCacheDirSet = 1;
+    if (dir == NULL || strlen(dir) >= sizeof(sCacheDir)) {
+        sCacheDir[0] = 0;
+        return;
+    }
+    strcpy(sCacheDir, dir);
+}
+
+static const char* cacheGetDir(void) {
+    if (!sCacheDirSet) {
+        char* end = sCacheDir + sizeof(sCacheDir);
+        char* p = bufprint_config_file(sCacheDir, end, "probe-cache");
+
+        sCacheDirSet = 1;
+        if (p >= end) {
+            sCacheDir[0] = 0;
+        }
+    }
+    return sCacheDir[0] ? sCacheDir : NULL;
+}
+
+// Print the key of an entry into |key|, and the path of its file into
+// |entry|. Return the length of the key, or 0 if the cache is disabled.
+static size_t cacheGetEntry(const char* kind,
+                            const char* path,
+                            char* key,
+                            char* entry) {
+    const char* dir = cacheGetDir();
+    size_t kindLen = strlen(kind);
+    size_t pathLen = strlen(path);
+    size_t keyLen = kindLen + 1 + pathLen;
+    uint64_t hash = 14695981039346656037ULL;
+    char* end = entry + PATH_MAX;
+    size_t n;
+
+    if (dir == NULL || keyLen >= PATH_MAX) {
+        return 0;
+    }
+    memcpy(key, kind, kindLen + 1);
+    memcpy(key + kindLen + 1, path, pathLen);
+
+    // FNV-1a
+    for (n = 0; n < keyLen; n++) {
+        hash ^= (unsigned char)key[n];
+        hash *= 1099511628211ULL;
+    }
+    if (bufprint(entry, end, "%s%c%08x%08x.probe", dir, PATH_SEP_C,
+                 (unsigned)(hash >> 32), (unsigned)hash) >= end) {
+        return 0;
+    }
+    return keyLen;
+}
+
+char* probeCache_load(const char* kind, const char* path, size_t* size) {
+    char key[PATH_MAX];
+    char entry[PATH_MAX];
+    char entryKey[PATH_MAX];
+    size_t keyLen = cacheGetEntry(kind, path, key, entry);
+    CacheHeader header;
+    struct stat st;
+    char* data = NULL;
+    FILE* f;
+
+    if (keyLen == 0 || stat(path, &st) < 0) {
+        return NULL;
+    }
+    f = fopen(entry, "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+
+    if (fread(&header, sizeof(header), 1, f) != 1 ||
+        header.magic != CACHE_MAGIC ||
+        header.version != CACHE_VERSION ||
+        header.file_size != (uint64_t)st.st_size ||
+        header.file_mtime != (int64_t)st.st_mtime ||
+        header.key_len != keyLen ||
+        header.data_len > CACHE_MAX_DATA ||
+        fread(entryKey, 1, keyLen, f) != keyLen ||
+        memcmp(entryKey, key, keyLen) != 0) {
+        D("probe cache: no valid %s entry for '%s'\n", kind, path);
+        fclose(f);
+        return NULL;
+    }
+
+    data = malloc(header.data_len + 1);
+    if (data != NULL) {
+        if (fread(data, 1, header.data_len, f) != header.data_len) {
+            D("probe cache: truncated %s entry for '%s'\n", kind, path);
+            free(data);
+            data = NULL;
+        } else {
+            data[header.data_len] = 0;
+            *size = header.data_len;
+            D("probe cache: loaded %s of '%s'\n", kind, path);
+        }
+    }
+    fclose(f);
+    return data;
+}
+
+void probeCache_store(const char* kind,
+                      const char* path,
+                      const void* data,
+                      size_t size) {
+    char key[PATH_MAX];
+    char entry[PATH_MAX];
+    char temp[PATH_MAX];
+    char* end = temp + sizeof(temp);
+    size_t keyLen = cacheGetEntry(kind, path, key, entry);
+    CacheHeader header;
+    struct stat st;
+    FILE* f;
+    int ok;
+
+    if (keyLen == 0 || size > CACHE_MAX_DATA) {
+        return;
+    }
+    if (stat(path, &st) < 0 ||
+        (int64_t)time(NULL) - (int64_t)st.st_mtime < CACHE_RACY_SECONDS) {
+        return;
+    }
+    if (path_mkdir_if_needed(cacheGetDir(), 0755) < 0) {
+        return;
+    }
+
+    // Write a temporary file then rename it, so that concurrent emulators
+    // never see a partial entry.
+    if (bufprint(temp, end, "%s.%d.tmp", entry, (int)getpid()) >= end) {
+        return;
+    }
+    f = fopen(temp, "wb");
+    if (f == NULL) {
+        return;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic = CACHE_MAGIC;
+    header.version = CACHE_VERSION;
+    header.file_size = st.st_size;
+    header.file_mtime = st.st_mtime;
+    header.key_len = keyLen;
+    header.data_len = size;
+
+    ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+         fwrite(key, 1, keyLen, f) == keyLen &&
+         fwrite(data, 1, size, f) == size;
+    if (fclose(f) != 0) {
+        ok = 0;
+    }
+
+#ifdef _WIN32
+    // rename() doesn't replace an existing file on Windows.
+    if (ok) {
+        unlink(entry);
+    }
+#endif
+    if (!ok || rename(temp, entry) < 0) {
+        D("probe cache: could not store %s of '%s'\n", kind, path);
+        unlink(temp);
+    }
+}
@@ -0,0 +1,51 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#ifndef ANDROID_UTILS_PROBE_CACHE_H
+#define ANDROID_UTILS_PROBE_CACHE_H
+
+#include "android/utils/compiler.h"
+
+#include <stddef.h>
+
+ANDROID_BEGIN_HEADER
+
+// A cache of the results of startup probes that read whole files, like
+// finding the version of a kernel image, kept on disk across emulator
+// launches.
+//
+// Each entry holds the result of one kind of probe of one file or
+// directory, and is only valid for the size and modification time that
+// it had when probed. Since modification times only have a resolution of
+// one second, files modified in the last two seconds are never stored.
+// Any error just results in a cache miss.
+
+// Set the directory of the cache, NULL disables the cache. By default,
+// it is the 'probe-cache' directory of the user's configuration
+// directory, created when needed.
+void probeCache_setDir(const char* dir);
+
+// Return the result of the probe named |kind| of the file or directory
+// at |path| as a heap-allocated buffer, to be released with free(), and
+// set |*size| to its size. The buffer is always NUL-terminated, past its
+// |*size| bytes. Return NULL if the cache has no valid entry.
+char* probeCache_load(const char* kind, const char* path, size_t* size);
+
+// Store the |size| bytes of |data| as the result of the probe named
+// |kind| of the file or directory at |path|.
+void probeCache_store(const char* kind,
+                      const char* path,
+                      const void* data,
+                      size_t size);
+
+ANDROID_END_HEADER
+
+#endif  // ANDROID_UTILS_PROBE_CACHE_H
@@ -0,0 +1,190 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/utils/probe_cache.h"
+
+#include "android/base/String.h"
+#include "android/base/testing/TestTempDir.h"
+#include "android/utils/path.h"
+
+#include <gtest/gtest.h>
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <utime.h>
+
+namespace android {
+namespace utils {
+
+using android::base::String;
+using android::base::TestTempDir;
+
+namespace {
+
+class ProbeCacheTest : public ::testing::Test {
+public:
+    ProbeCacheTest() : mTempDir("probe_cache") {
+        mCacheDir = mTempDir.pathString();
+        mCacheDir += "/cache";
+        mFile = mTempDir.pathString();
+        mFile += "/kernel";
+        probeCache_setDir(mCacheDir.c_str());
+        writeFile(mFile.c_str(), "not really a kernel");
+        setAge(mFile.c_str(), 60);
+    }
+
+    ~ProbeCacheTest() {
+        probeCache_setDir(NULL);
+    }
+
+    static void writeFile(const char* path, const char* content) {
+        FILE* f = fopen(path, "wb");
+        ASSERT_TRUE(f);
+        fputs(content, f);
+        fclose(f);
+    }
+
+    // Make the file at |path| look like it was last modified |seconds|
+    // ago, since recently modified files are not stored.
+    static void setAge(const char* path, int seconds) {
+        struct utimbuf times;
+        times.actime = time(NULL) - seconds;
+        times.modtime = times.actime;
+        ASSERT_EQ(0, utime(path, &times));
+    }
+
+protected:
+    TestTempDir mTempDir;
+    String mCacheDir;
+    String mFile;
+};
+
+}  // namespace
+
+TEST_F(ProbeCacheTest, MissingEntry) {
+    size_t size = 0;
+    EXPECT_FALSE(probeCache_load("version", mFile.c_str(), &size));
+}
+
+TEST_F(ProbeCacheTest, StoreAndLoad) {
+    probeCache_store("version", mFile.c_str(), "3.10.0", 6);
+
+    size_t size = 0;
+    char* data = probeCache_load("version", mFile.c_str(), &size);
+    ASSERT_TRUE(data);
+    EXPECT_EQ(6U, size);
+    EXPECT_STREQ("3.10.0", data);
+    free(data);
+}
+
+TEST_F(ProbeCacheTest, EmptyResult) {
+    probeCache_store("version", mFile.c_str(), "", 0);
+
+    size_t size = 1;
+    char* data = probeCache_load("version", mFile.c_str(), &size);
+    ASSERT_TRUE(data);
+    EXPECT_EQ(0U, size);
+    EXPECT_STREQ("", data);
+    free(data);
+}
+
+TEST_F(ProbeCacheTest, Directory) {
+    String dir = mTempDir.pathString();
+    dir += "/lib";
+    ASSERT_EQ(0, path_mkdir_if_needed(dir.c_str(), 0755));
+    probeCache_store("scan", dir.c_str(), "a\nb", 3);
+
+    size_t size = 0;
+    char* data = probeCache_load("scan", dir.c_str(), &size);
+    // The directory was just created, so nothing was stored.
+    EXPECT_FALSE(data);
+
+    setAge(dir.c_str(), 60);
+    probeCache_store("scan", dir.c_str(), "a\nb", 3);
+    data = probeCache_load("scan", dir.c_str(), &size);
+    ASSERT_TRUE(data);
+    EXPECT_STREQ("a\nb", data);
+    free(data);
+}
+
+TEST_F(ProbeCacheTest, OtherKindOrPath) {
+    String other = mTempDir.pathString();
+    other += "/other";
+    writeFile(other.c_str(), "not really a kernel");
+    setAge(other.c_str(), 60);
+    probeCache_store("version", mFile.c_str(), "3.10.0", 6);
+
+    size_t size = 0;
+    EXPECT_FALSE(probeCache_load("version", other.c_str(), &size));
+    EXPECT_FALSE(probeCache_load("config", mFile.c_str(), &size));
+}
+
+TEST_F(ProbeCacheTest, ModifiedFile) {
+    probeCache_store("version", mFile.c_str(), "3.10.0", 6);
+
+    // Change the modification time.
+    setAge(mFile.c_str(), 30);
+    size_t size = 0;
+    EXPECT_FALSE(probeCache_load("version", mFile.c_str(), &size));
+
+    // Then the size.
+    probeCache_store("version", mFile.c_str(), "3.10.0", 6);
+    writeFile(mFile.c_str(), "a kernel of another size");
+    setAge(mFile.c_str(), 30);
+    EXPECT_FALSE(probeCache_load("version", mFile.c_str(), &size));
+}
+
+TEST_F(ProbeCacheTest, RecentFile) {
+    setAge(mFile.c_str(), 0);
+    probeCache_store("version", mFile.c_str(), "3.10.0", 6);
+
+    size_t size = 0;
+    EXPECT_FALSE(probeCache_load("version", mFile.c_str(), &size));
+}
+
+TEST_F(ProbeCacheTest, TruncatedEntry) {
+    probeCache_store("version", mFile.c_str(), "3.10.0", 6);
+
+    // Replace the only entry of the cache with a truncated one.
+    String entry;
+    DIR* dir = opendir(mCacheDir.c_str());
+    ASSERT_TRUE(dir);
+    while (struct dirent* d = readdir(dir)) {
+        if (d->d_name[0] != '.') {
+            entry = mCacheDir;
+            entry += "/";
+            entry += d->d_name;
+        }
+    }
+    closedir(dir);
+    ASSERT_TRUE(entry.size());
+    writeFile(entry.c_str(), "PRBC");
+
+    size_t size = 0;
+    EXPECT_FALSE(probeCache_load("version", mFile.c_str(), &size));
+}
+
+TEST_F(ProbeCacheTest, Disabled) {
+    probeCache_setDir(NULL);
+    probeCache_store("version", mFile.c_str(), "3.10.0", 6);
+
+    struct stat st;
+    EXPECT_NE(0, stat(mCacheDir.c_str(), &st));
+    size_t size = 0;
+    EXPECT_FALSE(probeCache_load("version", mFile.c_str(), &size));
+}
+
+}  // namespace utils
+}  // namespace android
@@ -0,0 +1,228 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/utils/startup_trace.h"
+
+#include "android/base/memory/LazyInstance.h"
+#include "android/base/String.h"
+#include "android/base/StringFormat.h"
+#include "android/base/synchronization/Lock.h"
+#include "android/base/system/System.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+using android::base::AutoLock;
+using android::base::LazyInstance;
+using android::base::Lock;
+using android::base::String;
+using android::base::StringAppendFormat;
+using android::base::System;
+
+// The milestones recorded by a launcher, as a list of "<time> <name>;".
+const char kEnvVar[] = "ANDROID_STARTUP_TRACE_EVENTS";
+
+struct Event {
+    uint64_t timeUs;
+    char name[STARTUP_TRACE_MAX_NAME + 1];
+};
+
+struct TraceState {
+    TraceState() : lock(), path(), count(0) {}
+
+    // Return true if a milestone named |name| was already recorded.
+    bool has(const char* name) const {
+        for (int n = 0; n < count; ++n) {
+            if (!strcmp(events[n].name, name)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Record a milestone, unless it already was or there's no room left.
+    // Return true if it was recorded.
+    bool add(const char* name, size_t nameLen, uint64_t timeUs) {
+        char copy[STARTUP_TRACE_MAX_NAME + 1];
+        if (nameLen > STARTUP_TRACE_MAX_NAME) {
+            nameLen = STARTUP_TRACE_MAX_NAME;
+        }
+        // Keep the names safe for both the environment and JSON.
+        for (size_t n = 0; n < nameLen; ++n) {
+            char c = name[n];
+            copy[n] = (c == ';' || c == '"' || c == '\\' ||
+                       (unsigned char)c < 0x20) ? '_' : c;
+        }
+        copy[nameLen] = '\0';
+
+        if (count == STARTUP_TRACE_MAX_EVENTS || has(copy)) {
+            return false;
+        }
+        // Launcher milestones are imported after the engine recorded its
+        // first ones, keep the list sorted.
+        int pos = count;
+        while (pos > 0 && events[pos - 1].timeUs > timeUs) {
+            events[pos] = events[pos - 1];
+            --pos;
+        }
+        events[pos].timeUs = timeUs;
+        memcpy(events[pos].name, copy, nameLen + 1);
+        ++count;
+        return true;
+    }
+
+    // Rewrite the whole trace file, if enabled.
+    void write() const;
+
+    Lock lock;
+    String path;
+    int count;
+    Event events[STARTUP_TRACE_MAX_EVENTS];
+};
+
+LazyInstance<TraceState> sState = LAZY_INSTANCE_INIT;
+
+int currentPid() {
+#ifdef _WIN32
+    return static_cast<int>(::GetCurrentProcessId());
+#else
+    return static_cast<int>(::getpid());
+#endif
+}
+
+void TraceState::write() const {
+    if (path.empty() || count == 0) {
+        return;
+    }
+    // Each milestone is a complete slice that starts at the previous one.
+    // The first one is an instant, at the origin of the timeline.
+    String json("{\"traceEvents\":[\n");
+    int pid = currentPid();
+    uint64_t origin = events[0].timeUs;
+    for (int n = 0; n < count; ++n) {
+        const Event& event = events[n];
+        if (n == 0) {
+            StringAppendFormat(&json,
+                    "{\"name\":\"%s\",\"cat\":\"startup\",\"ph\":\"i\","
+                    "\"s\":\"g\",\"ts\":0,\"pid\":%d,\"tid\":0}",
+                    event.name, pid);
+        } else {
+            uint64_t start = events[n - 1].timeUs - origin;
+            StringAppendFormat(&json,
+                    ",\n{\"name\":\"%s\",\"cat\":\"startup\",\"ph\":\"X\","
+                    "\"ts\":%" PRIu64 ",\"dur\":%" PRIu64 ","
+                    "\"pid\":%d,\"tid\":0}",
+                    event.name, start, event.timeUs - origin - start, pid);
+        }
+    }
+    json += "\n]}\n";
+
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f) {
+        return;
+    }
+    fwrite(json.c_str(), 1, json.size(), f);
+    fclose(f);
+}
+
+}  // namespace
+
+uint64_t startupTrace_now(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return static_cast<uint64_t>(now.QuadPart * 1000000.0 / freq.QuadPart);
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return static_cast<uint64_t>(tv.tv_sec) * 1000000U + tv.tv_usec;
+#endif
+}
+
+void startupTrace_markAt(const char* name, uint64_t timeUs) {
+    TraceState* state = sState.ptr();
+    AutoLock lock(state->lock);
+    if (state->add(name, strlen(name), timeUs)) {
+        state->write();
+    }
+}
+
+void startupTrace_mark(const char* name) {
+    startupTrace_markAt(name, startupTrace_now());
+}
+
+void startupTrace_init(const char* path) {
+    TraceState* state = sState.ptr();
+    AutoLock lock(state->lock);
+    state->path = path;
+
+    System* system = System::get();
+    const char* env = system->envGet(kEnvVar);
+    if (env) {
+        const char* p = env;
+        while (*p) {
+            char* end;
+            uint64_t timeUs = strtoull(p, &end, 10);
+            if (end == p || *end != ' ') {
+                break;
+            }
+            const char* name = end + 1;
+            const char* next = strchr(name, ';');
+            if (!next) {
+                break;
+            }
+            state->add(name, next - name, timeUs);
+            p = next + 1;
+        }
+        // Don't pass them along to the processes started by this one.
+        system->envSet(kEnvVar, NULL);
+    }
+    state->write();
+}
+
+void startupTrace_exportToEnv(void) {
+    TraceState* state = sState.ptr();
+    AutoLock lock(state->lock);
+    String value;
+    for (int n = 0; n < state->count; ++n) {
+        StringAppendFormat(&value, "%" PRIu64 " %s;",
+                           state->events[n].timeUs, state->events[n].name);
+    }
+    System::get()->envSet(kEnvVar, value.c_str());
+}
+
+void startupTrace_forEach(StartupTraceVisitor visitor, void* opaque) {
+    TraceState* state = sState.ptr();
+    AutoLock lock(state->lock);
+    for (int n = 0; n < state->count; ++n) {
+        visitor(opaque, state->events[n].name, state->events[n].timeUs);
+    }
+}
+
+void startupTrace_reset(void) {
+    TraceState* state = sState.ptr();
+    AutoLock lock(state->lock);
+    state->path.clear();
+    state->count = 0;
+}
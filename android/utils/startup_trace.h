@@ -0,0 +1,69 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#ifndef ANDROID_UTILS_STARTUP_TRACE_H
+#define ANDROID_UTILS_STARTUP_TRACE_H
+
+#include "android/utils/compiler.h"
+
+#include <stdint.h>
+
+ANDROID_BEGIN_HEADER
+
+// A timeline of the emulator startup, from the launcher to the end of the
+// guest boot, enabled with '-startup-trace <file>'.
+//
+// Each milestone is recorded once, the first time it is reached, even
+// before the trace is enabled, so that nothing is missed while parsing
+// options. Once enabled, the trace is written again after each new
+// milestone as Chrome trace JSON, i.e. it can be opened with
+// chrome://tracing. Each milestone appears as a slice that starts at the
+// previous one. All functions are thread-safe.
+
+// Maximum number of milestones, the following ones are ignored.
+#define STARTUP_TRACE_MAX_EVENTS  32
+
+// Maximum length of a milestone name, longer ones are truncated.
+#define STARTUP_TRACE_MAX_NAME  47
+
+// Record that the milestone |name| was reached now, unless it already
+// was. |name| must not contain ';' or '"'.
+void startupTrace_mark(const char* name);
+
+// Same as startupTrace_mark(), with the timestamp |timeUs| in
+// microseconds, as returned by startupTrace_now().
+void startupTrace_markAt(const char* name, uint64_t timeUs);
+
+// Return the current time in microseconds. Timestamps can be compared
+// across processes started by a launcher.
+uint64_t startupTrace_now(void);
+
+// Enable the trace, written to |path|. This first imports the milestones
+// exported by the launcher, if any.
+void startupTrace_init(const char* path);
+
+// Store the milestones recorded so far in the environment, for the
+// program that this one is about to execute.
+void startupTrace_exportToEnv(void);
+
+// Call |visitor| for each milestone recorded so far, in time order, with
+// its name and timestamp in microseconds. |visitor| must not record new
+// milestones.
+typedef void (*StartupTraceVisitor)(void* opaque, const char* name,
+                                    uint64_t timeUs);
+void startupTrace_forEach(StartupTraceVisitor visitor, void* opaque);
+
+// Forget all milestones and disable the trace, for unit tests.
+void startupTrace_reset(void);
+
+ANDROID_END_HEADER
+
+#endif  // ANDROID_UTILS_STARTUP_TRACE_H
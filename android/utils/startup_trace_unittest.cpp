@@ -0,0 +1,184 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/utils/startup_trace.h"
+
+#include "android/base/String.h"
+#include "android/base/testing/TestSystem.h"
+#include "android/base/testing/TestTempDir.h"
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <string.h>
+
+namespace android {
+namespace utils {
+
+using android::base::String;
+using android::base::TestSystem;
+using android::base::TestTempDir;
+
+namespace {
+
+const char kEnvVar[] = "ANDROID_STARTUP_TRACE_EVENTS";
+
+class StartupTraceTest : public ::testing::Test {
+public:
+    StartupTraceTest() :
+            mSystem("/bin", 32),
+            mTempDir("startup_trace"),
+            mPath(mTempDir.pathString()) {
+        mPath += "/trace.json";
+        startupTrace_reset();
+    }
+
+    ~StartupTraceTest() {
+        startupTrace_reset();
+    }
+
+    String readTrace() {
+        String result;
+        FILE* f = fopen(mPath.c_str(), "rb");
+        if (f) {
+            char buf[256];
+            size_t n;
+            while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+                result.append(buf, n);
+            }
+            fclose(f);
+        }
+        return result;
+    }
+
+    static int countOf(const String& text, const char* what) {
+        int count = 0;
+        for (const char* p = strstr(text.c_str(), what); p;
+             p = strstr(p + 1, what)) {
+            ++count;
+        }
+        return count;
+    }
+
+protected:
+    TestSystem mSystem;
+    TestTempDir mTempDir;
+    String mPath;
+};
+
+}  // namespace
+
+TEST_F(StartupTraceTest, NothingWrittenUntilEnabled) {
+    startupTrace_markAt("engine start", 1000);
+    EXPECT_TRUE(readTrace().empty());
+
+    startupTrace_init(mPath.c_str());
+    String trace = readTrace();
+    EXPECT_EQ(0, strncmp("{\"traceEvents\":[", trace.c_str(), 16));
+    EXPECT_TRUE(strstr(trace.c_str(), "\"name\":\"engine start\""));
+    EXPECT_TRUE(strstr(trace.c_str(), "\"ph\":\"i\""));
+}
+
+TEST_F(StartupTraceTest, SlicesStartAtPreviousMilestone) {
+    startupTrace_init(mPath.c_str());
+    startupTrace_markAt("engine start", 1000);
+    startupTrace_markAt("config parsed", 1500);
+    startupTrace_markAt("guest started", 4000);
+
+    String trace = readTrace();
+    EXPECT_TRUE(strstr(trace.c_str(),
+            "\"name\":\"config parsed\",\"cat\":\"startup\",\"ph\":\"X\","
+            "\"ts\":0,\"dur\":500"));
+    EXPECT_TRUE(strstr(trace.c_str(),
+            "\"name\":\"guest started\",\"cat\":\"startup\",\"ph\":\"X\","
+            "\"ts\":500,\"dur\":2500"));
+}
+
+TEST_F(StartupTraceTest, MilestonesRecordedOnce) {
+    startupTrace_init(mPath.c_str());
+    startupTrace_markAt("engine start", 1000);
+    startupTrace_markAt("engine start", 2000);
+    EXPECT_EQ(1, countOf(readTrace(), "engine start"));
+}
+
+TEST_F(StartupTraceTest, NamesAreSanitized) {
+    startupTrace_init(mPath.c_str());
+    startupTrace_markAt("a \"quoted\"; name", 1000);
+    EXPECT_TRUE(strstr(readTrace().c_str(), "\"a _quoted__ name\""));
+}
+
+TEST_F(StartupTraceTest, EventsLimit) {
+    startupTrace_init(mPath.c_str());
+    for (int n = 0; n < STARTUP_TRACE_MAX_EVENTS + 4; ++n) {
+        char name[16];
+        snprintf(name, sizeof(name), "event %d", n);
+        startupTrace_markAt(name, 1000 + n);
+    }
+    EXPECT_EQ(STARTUP_TRACE_MAX_EVENTS,
+              countOf(readTrace(), "\"cat\":\"startup\""));
+}
+
+TEST_F(StartupTraceTest, ImportFromLauncher) {
+    startupTrace_markAt("launcher start", 100);
+    startupTrace_markAt("launcher exec", 300);
+    startupTrace_exportToEnv();
+    EXPECT_STREQ("100 launcher start;300 launcher exec;",
+                 mSystem.envGet(kEnvVar));
+
+    // The engine is a new process, which records its own first milestone
+    // before enabling the trace.
+    startupTrace_reset();
+    startupTrace_markAt("engine start", 400);
+    startupTrace_init(mPath.c_str());
+    EXPECT_FALSE(mSystem.envGet(kEnvVar));
+
+    String trace = readTrace();
+    const char* launcherStart = strstr(trace.c_str(), "launcher start");
+    const char* launcherExec = strstr(trace.c_str(), "launcher exec");
+    const char* engineStart = strstr(trace.c_str(), "engine start");
+    ASSERT_TRUE(launcherStart);
+    ASSERT_TRUE(launcherExec);
+    ASSERT_TRUE(engineStart);
+    EXPECT_LT(launcherStart, launcherExec);
+    EXPECT_LT(launcherExec, engineStart);
+    EXPECT_TRUE(strstr(trace.c_str(),
+            "\"name\":\"engine start\",\"cat\":\"startup\",\"ph\":\"X\","
+            "\"ts\":200,\"dur\":100"));
+}
+
+static void appendMilestone(void* opaque, const char* name, uint64_t timeUs) {
+    char line[80];
+    snprintf(line, sizeof(line), "%llu %s;", (unsigned long long)timeUs,
+             name);
+    static_cast<String*>(opaque)->append(line);
+}
+
+TEST_F(StartupTraceTest, ForEachInTimeOrder) {
+    startupTrace_markAt("guest started", 4000);
+    startupTrace_markAt("engine start", 1000);
+    startupTrace_markAt("engine start", 5000);
+
+    String milestones;
+    startupTrace_forEach(appendMilestone, &milestones);
+    EXPECT_STREQ("1000 engine start;4000 guest started;", milestones.c_str());
+}
+
+TEST_F(StartupTraceTest, MalformedEnvironmentIgnored) {
+    mSystem.envSet(kEnvVar, "100 launcher start;garbage");
+    startupTrace_init(mPath.c_str());
+    String trace = readTrace();
+    EXPECT_TRUE(strstr(trace.c_str(), "launcher start"));
+    EXPECT_FALSE(strstr(trace.c_str(), "garbage"));
+    EXPECT_FALSE(mSystem.envGet(kEnvVar));
+}
+
+}  // namespace utils
+}  // namespace android
@@ -44,7 +44,8 @@ class PairUpWearPhoneImpl {
 public:
     PairUpWearPhoneImpl(Looper* looper,
                         const StringVector& devices,
-                        int adbHostPort);
+                        int adbHostPort,
+                        WearDeviceCache* cache);
 
     ~PairUpWearPhoneImpl();
 
@@ -115,6 +116,7 @@ private:
     FdWatch mConsoleWatch;
 
     // device categories
+    WearDeviceCache* mCache;
     String mDeviceInProbing;
     StrQueue mUnprobedDevices;
     StrQueue mWearDevices;
@@ -132,6 +134,7 @@ private:
     // whenever device list changes, call the following
     void updateDevices(const StringVector& devices);
     void startProbeNextDevice();
+    bool takeCachedDevices();
 
     // socket connection methods
     bool openConnection(int port,
@@ -333,6 +336,9 @@ bool PairUpWearPhoneImpl::checkForWearDevice() {
     if (isWearDevice) {
         DPRINT("found wear %s\n\n", mDeviceInProbing.c_str());
         mWearDevices.push_back(mDeviceInProbing);
+        if (mCache) {
+            mCache->set(mDeviceInProbing.c_str(), WearDeviceCache::kWear);
+        }
     }
 
     return isWearDevice;
@@ -344,11 +350,18 @@ bool PairUpWearPhoneImpl::checkForCompatiblePhone() {
     if (isCompatiblePhone) {
         DPRINT("found compatible phone %s\n\n", mDeviceInProbing.c_str());
         mPhoneDevices.push_back(mDeviceInProbing);
+        if (mCache) {
+            mCache->set(mDeviceInProbing.c_str(), WearDeviceCache::kPhone);
+        }
     } else {
         const bool shouldTryAgainLater = mReply.contains("Error:") &&
             mReply.contains("Is the system running?");
 
-        if (shouldTryAgainLater) mUnprobedDevices.push_back(mDeviceInProbing);
+        if (shouldTryAgainLater) {
+            mUnprobedDevices.push_back(mDeviceInProbing);
+        } else if (mCache) {
+            mCache->set(mDeviceInProbing.c_str(), WearDeviceCache::kOther);
+        }
     }
 
     return isCompatiblePhone;
@@ -467,12 +480,14 @@ bool PairUpWearPhoneImpl::completeReadAllDataFromAdb() {
 
 PairUpWearPhoneImpl::PairUpWearPhoneImpl(Looper* looper,
                                          const StringVector& devices,
-                                         int adbHostPort) :
+                                         int adbHostPort,
+                                         WearDeviceCache* cache) :
         mLooper(looper),
         mAdbHostPort(adbHostPort),
         mAdbWatch(),
         mConsolePort(-1),
         mConsoleWatch(),
+        mCache(cache),
         mUnprobedDevices(),
         mWearDevices(),
         mPhoneDevices(),
@@ -495,10 +510,42 @@ PairUpWearPhoneImpl::~PairUpWearPhoneImpl() {
     mLooper = 0;
 }
 
+// Move the devices at the head of |mUnprobedDevices| whose kind is
+// already known to the wear or phone lists, until one must be probed.
+// Return true if this started connecting a wear and a phone.
+bool PairUpWearPhoneImpl::takeCachedDevices() {
+    if (!mCache) {
+        return false;
+    }
+    while (!mUnprobedDevices.empty()) {
+        const WearDeviceCache::Kind kind =
+                mCache->find(mUnprobedDevices[0].c_str());
+        if (kind == WearDeviceCache::kUnknown) {
+            return false;
+        }
+        if (kind == WearDeviceCache::kWear) {
+            mWearDevices.push_back(mUnprobedDevices[0]);
+        } else if (kind == WearDeviceCache::kPhone) {
+            mPhoneDevices.push_back(mUnprobedDevices[0]);
+        }
+        mUnprobedDevices.pop();
+
+        if (!mWearDevices.empty() && !mPhoneDevices.empty()) {
+            startConnectWearAndPhone();
+            return true;
+        }
+    }
+    return false;
+}
+
 void PairUpWearPhoneImpl::startProbeNextDevice() {
     closeConnection(&mAdbWatch);
     closeConnection(&mConsoleWatch);
 
+    if (takeCachedDevices()) {
+        return;
+    }
+
     if (mUnprobedDevices.empty()) {
         mState = PAIRUP_ERROR;
         return;
@@ -630,6 +677,69 @@ bool PairUpWearPhoneImpl::openConnection(int port,
     return true;
 }
 
+// ------------------------------------------------------------------
+//
+//       WearDeviceCache  implementation
+//
+// ------------------------------------------------------------------
+
+static bool findSerial(const StringVector& list, const char* serial) {
+    for (size_t n = 0; n < list.size(); ++n) {
+        if (list[n] == serial) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void retainSerials(StringVector* list, const StringVector& devices) {
+    StringVector kept;
+    for (size_t n = 0; n < list->size(); ++n) {
+        if (findSerial(devices, (*list)[n].c_str())) {
+            kept.push_back((*list)[n]);
+        }
+    }
+    list->swap(&kept);
+}
+
+WearDeviceCache::Kind WearDeviceCache::find(const char* serial) const {
+    if (findSerial(mWears, serial)) {
+        return kWear;
+    }
+    if (findSerial(mPhones, serial)) {
+        return kPhone;
+    }
+    if (findSerial(mOthers, serial)) {
+        return kOther;
+    }
+    return kUnknown;
+}
+
+void WearDeviceCache::set(const char* serial, Kind kind) {
+    if (find(serial) != kUnknown) {
+        return;
+    }
+    switch (kind) {
+        case kWear:
+            mWears.push_back(String(serial));
+            break;
+        case kPhone:
+            mPhones.push_back(String(serial));
+            break;
+        case kOther:
+            mOthers.push_back(String(serial));
+            break;
+        default:
+            break;
+    }
+}
+
+void WearDeviceCache::retain(const StringVector& devices) {
+    retainSerials(&mWears, devices);
+    retainSerials(&mPhones, devices);
+    retainSerials(&mOthers, devices);
+}
+
 // ------------------------------------------------------------------
 //
 //       PairUpWearPhone  implementation
@@ -638,10 +748,12 @@ bool PairUpWearPhoneImpl::openConnection(int port,
 
 PairUpWearPhone::PairUpWearPhone(Looper* looper,
                                  const StringVector& devices,
-                                 int adbHostPort) :
+                                 int adbHostPort,
+                                 WearDeviceCache* cache) :
     mPairUpWearPhoneImpl (new PairUpWearPhoneImpl(looper,
                                                   devices,
-                                                  adbHostPort)) {
+                                                  adbHostPort,
+                                                  cache)) {
     //VERBOSE_ENABLE(adb);
 }
 
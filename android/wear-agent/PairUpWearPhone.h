@@ -13,12 +13,12 @@
 #define ANDROID_WEAR_AGENT_PAIR_UP_WEAR_PHONE_H
 
 #include "android/base/Compiler.h"
+#include "android/base/containers/StringVector.h"
 
 namespace android {
 
 namespace base {
 class Looper;
-class StringVector;
 }  // namespace base
 
 namespace wear {
@@ -36,14 +36,52 @@ namespace wear {
  *  returns true to avoid aborting the pairing up process.
  */
 
+// The kind of each device probed by PairUpWearPhone. The WearAgent keeps
+// one across device list updates, so that each device is only probed
+// once, instead of every device being probed again after each update.
+// A device that disconnects or goes offline is forgotten, and probed
+// again when it comes back.
+class WearDeviceCache {
+public:
+    enum Kind {
+        kUnknown = 0,  // not probed yet.
+        kWear,         // an emulated wear.
+        kPhone,        // a device with the wearable app.
+        kOther         // any other device.
+    };
+
+    WearDeviceCache() : mWears(), mPhones(), mOthers() {}
+
+    Kind find(const char* serial) const;
+
+    void set(const char* serial, Kind kind);
+
+    // Forget the devices that are not in |devices|.
+    void retain(const ::android::base::StringVector& devices);
+
+    size_t size() const {
+        return mWears.size() + mPhones.size() + mOthers.size();
+    }
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(WearDeviceCache);
+
+    ::android::base::StringVector mWears;
+    ::android::base::StringVector mPhones;
+    ::android::base::StringVector mOthers;
+};
+
 class PairUpWearPhoneImpl;
 
 class PairUpWearPhone {
 public:
     // "devices" is a list of serial-ids, could contain both emulators and real devices.
+    // If |cache| is not NULL, the devices it knows are not probed, and
+    // the kinds of the other ones are added to it.
     PairUpWearPhone(::android::base::Looper* looper,
                     const ::android::base::StringVector& devices,
-                    int adbHostPort);
+                    int adbHostPort,
+                    WearDeviceCache* cache = NULL);
 
     ~PairUpWearPhone();
 
@@ -0,0 +1,79 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// Micro-benchmarks of the pairing work done for each device list update
+// once all devices were probed, which is what a host running many
+// emulators pays most of the time. The argument is the number of
+// simulated devices, none of which is a compatible phone, so that no
+// connection to the adb server is ever made.
+
+#include "android/wear-agent/PairUpWearPhone.h"
+
+#include "android/base/async/Looper.h"
+#include "android/base/containers/StringVector.h"
+#include "android/base/testing/Benchmark.h"
+
+#include <stdio.h>
+
+using android::base::Looper;
+using android::base::StringVector;
+using android::wear::PairUpWearPhone;
+using android::wear::WearDeviceCache;
+
+namespace {
+
+volatile size_t sSink;
+
+class PairUpWearPhoneBenchmark : public android::base::Benchmark {
+public:
+    virtual void setUp(int64_t arg) {
+        mLooper = Looper::create();
+        for (int64_t n = 0; n < arg; ++n) {
+            char serial[32];
+            snprintf(serial, sizeof(serial), "emulator-%d",
+                     5554 + 2 * static_cast<int>(n));
+            mDevices.push_back(serial);
+            mCache.set(serial, n == 0 ? WearDeviceCache::kWear
+                                      : WearDeviceCache::kOther);
+        }
+    }
+
+    virtual void tearDown() {
+        mCache.retain(StringVector());
+        mDevices.resize(0U);
+        delete mLooper;
+    }
+
+protected:
+    Looper* mLooper;
+    StringVector mDevices;
+    WearDeviceCache mCache;
+};
+
+}  // namespace
+
+// A new pairing session, started for each device list change.
+BENCHMARK_F(PairUpWearPhoneBenchmark, CachedUpdate) {
+    for (size_t n = 0; n < state->iterations(); ++n) {
+        PairUpWearPhone pairUp(mLooper, mDevices, 5037, &mCache);
+        sSink += pairUp.isDone();
+    }
+}
+BENCHMARK_ARGS(PairUpWearPhoneBenchmark, CachedUpdate, 16, 64, 256);
+
+// Dropping the disconnected devices from the cache, done for each change.
+BENCHMARK_F(PairUpWearPhoneBenchmark, CacheRetain) {
+    for (size_t n = 0; n < state->iterations(); ++n) {
+        mCache.retain(mDevices);
+        sSink += mCache.size();
+    }
+}
+BENCHMARK_ARGS(PairUpWearPhoneBenchmark, CacheRetain, 16, 64, 256);
@@ -39,14 +39,41 @@ namespace wear {
 using namespace ::android::base;
 using namespace ::android::wear::testing;
 
+TEST(WearDeviceCache, FindSetRetain) {
+    WearDeviceCache cache;
+    EXPECT_EQ(0U, cache.size());
+    EXPECT_EQ(WearDeviceCache::kUnknown, cache.find("emulator-5554"));
+
+    cache.set("emulator-5554", WearDeviceCache::kWear);
+    cache.set("emulator-5556", WearDeviceCache::kPhone);
+    cache.set("070fe93a0b2c1fdb", WearDeviceCache::kOther);
+    // A device keeps the first kind it was given.
+    cache.set("emulator-5554", WearDeviceCache::kOther);
+    EXPECT_EQ(3U, cache.size());
+    EXPECT_EQ(WearDeviceCache::kWear, cache.find("emulator-5554"));
+    EXPECT_EQ(WearDeviceCache::kPhone, cache.find("emulator-5556"));
+    EXPECT_EQ(WearDeviceCache::kOther, cache.find("070fe93a0b2c1fdb"));
+
+    StringVector devices;
+    devices.push_back("emulator-5556");
+    devices.push_back("emulator-5558");
+    cache.retain(devices);
+    EXPECT_EQ(1U, cache.size());
+    EXPECT_EQ(WearDeviceCache::kUnknown, cache.find("emulator-5554"));
+    EXPECT_EQ(WearDeviceCache::kPhone, cache.find("emulator-5556"));
+    EXPECT_EQ(WearDeviceCache::kUnknown, cache.find("070fe93a0b2c1fdb"));
+}
+
 // This doesn't run on Windows because the test currently relies on
 // fork() to run the pairing agent in a child process.
 #ifndef _WIN32
 
-static void runPairUp(const StringVector& deviceList, int adbHostPort) {
+static void runPairUp(const StringVector& deviceList,
+                      int adbHostPort,
+                      WearDeviceCache* cache = NULL) {
     Looper* looper = Looper::create();
     {
-        PairUpWearPhone pairUp(looper, deviceList, adbHostPort);
+        PairUpWearPhone pairUp(looper, deviceList, adbHostPort, cache);
         looper->run();
     }
     delete looper;
@@ -108,6 +135,43 @@ TEST(PairUpWearPhone, TestEmulatorPhone) {
     EXPECT_TRUE(testWrapper(false));
 }
 
+// Devices whose kind is in the cache are not probed again: only the port
+// forwarding request reaches the adb server.
+TEST(PairUpWearPhone, CachedDevicesAreNotProbed) {
+    int adbMockServerPort = -1;
+    ScopedSocket adbMockServerSocket(
+            testStartMockServer(&adbMockServerPort));
+    ASSERT_TRUE(adbMockServerSocket.valid());
+
+    const char kUsbPhoneDevice[] = "070fe93a0b2c1fdb";
+    const char kWearDevice[] = "emulator-6558";
+    const char kOtherDevice[] = "emulator-6560";
+
+    StringVector deviceList;
+    deviceList.push_back(kOtherDevice);
+    deviceList.push_back(kWearDevice);
+    deviceList.push_back(kUsbPhoneDevice);
+
+    int childpid = fork();
+    if (childpid == 0) {
+        WearDeviceCache cache;
+        cache.set(kOtherDevice, WearDeviceCache::kOther);
+        cache.set(kWearDevice, WearDeviceCache::kWear);
+        cache.set(kUsbPhoneDevice, WearDeviceCache::kPhone);
+        runPairUp(deviceList, adbMockServerPort, &cache);
+        _exit(0);
+    }
+    ASSERT_GT(childpid, 0);
+
+    ScopedSocket s(socketAcceptAny(adbMockServerSocket.get()));
+    ASSERT_TRUE(s.valid());
+    char buf[128];
+    snprintf(buf, sizeof(buf), "host-serial:%s:forward:tcp:5601;tcp:5601",
+             kUsbPhoneDevice);
+    EXPECT_TRUE(testExpectMessageFromSocket(s.get(), buf));
+    EXPECT_TRUE(testSendToSocket(s.get(), "OKAY"));
+}
+
 #endif  // !_WIN32
 
 } // namespace wear
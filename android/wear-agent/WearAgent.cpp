@@ -39,9 +39,11 @@ using namespace ::android::base;
 
 /*
  * Wear Agent listens to adb host server for device list update.
- * Whenever it receives an update, it will abort current pairing process
- * and start a new one. When adb host dies, Wear Agent will try to reconnect
- * every two seconds.
+ * Whenever the list of online devices changes, it will abort current
+ * pairing process and start a new one, which only probes the devices that
+ * are not in |mDeviceCache| yet. Updates that don't change the list, e.g.
+ * a device going from "offline" to "unauthorized", are ignored. When adb
+ * host dies, Wear Agent will try to reconnect every two seconds.
  */
 
 class WearAgentImpl {
@@ -68,6 +70,8 @@ private:
     char         mWriteBuffer[WRITE_BUFFER_SIZE];
     int          mExpectReplayType;
     PairUpWearPhone   *mPairUpWearPhone;
+    StringVector mDevices;
+    WearDeviceCache mDeviceCache;
 
     enum ExpectMessage {
         OKAY = 0,
@@ -82,6 +86,8 @@ private:
     void connectLater();
     bool isValidHexNumber(const char* str, const int sz);
     void parseAdbDevices(char* buf, StringVector* devices);
+    bool sameDevices(const StringVector& devices) const;
+    void onDevicesUpdate(const StringVector& devices);
 };
 
 // This callback is called whenever an I/O event happens on the socket
@@ -120,6 +126,7 @@ void WearAgentImpl::onRead() {
                 if (msgsize < 0) {
                     isError = true;
                 } else if (0 == msgsize) { //this is not error: just no devices
+                    onDevicesUpdate(StringVector());
                     mExpectReplayType = LENGTH;
                     mReadBuffer[msgsize] = '\0';
                     mAsyncReader.reset(mReadBuffer, 4, mFdWatch.get());
@@ -139,17 +146,9 @@ void WearAgentImpl::onRead() {
 
             } else if (expectMsg()) {
                 DPRINT("message received from ADB:\n%s", mReadBuffer);
-                if (mPairUpWearPhone) {
-                    delete mPairUpWearPhone;
-                    mPairUpWearPhone = 0;
-                }
                 StringVector devices;
                 parseAdbDevices(mReadBuffer, &devices);
-                if (devices.size() >= 2) {
-                    mPairUpWearPhone = new PairUpWearPhone(mLooper,
-                                                           devices,
-                                                           mAdbHostPort);
-                }
+                onDevicesUpdate(devices);
                 // prepare for next adb devices message
                 mReadBuffer[4] = '\0';
                 mAsyncReader.reset(mReadBuffer, 4, mFdWatch.get());
@@ -236,6 +235,45 @@ void WearAgentImpl::cleanupConnection() {
         delete mPairUpWearPhone;
         mPairUpWearPhone = 0;
     }
+
+    // The first list after reconnecting starts a new pairing.
+    mDevices.resize(0U);
+    mDeviceCache.retain(mDevices);
+}
+
+bool WearAgentImpl::sameDevices(const StringVector& devices) const {
+    if (devices.size() != mDevices.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < devices.size(); ++i) {
+        bool found = false;
+        for (size_t j = 0; j < mDevices.size() && !found; ++j) {
+            found = (devices[i] == mDevices[j]);
+        }
+        if (!found) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void WearAgentImpl::onDevicesUpdate(const StringVector& devices) {
+    if (sameDevices(devices)) {
+        return;
+    }
+    mDevices = devices;
+    mDeviceCache.retain(devices);
+
+    if (mPairUpWearPhone) {
+        delete mPairUpWearPhone;
+        mPairUpWearPhone = 0;
+    }
+    if (devices.size() >= 2) {
+        mPairUpWearPhone = new PairUpWearPhone(mLooper,
+                                               devices,
+                                               mAdbHostPort,
+                                               &mDeviceCache);
+    }
 }
 
 void WearAgentImpl::parseAdbDevices(char* buf, StringVector* devices) {
@@ -281,7 +319,9 @@ WearAgentImpl::WearAgentImpl(Looper* looper, int adbHostPort) :
         mReadBuffer(0),
         mWriteBuffer(),
         mExpectReplayType(OKAY),
-        mPairUpWearPhone(0) {
+        mPairUpWearPhone(0),
+        mDevices(),
+        mDeviceCache() {
 
     mReadBuffer = (char*)calloc(mSizeOfReadBuffer,sizeof(char));
     mTimer.reset(looper->createTimer(_on_reconnect_timeout, this));
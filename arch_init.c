@@ -43,6 +43,9 @@
 #include "exec/gdbstub.h"
 #include "exec/ram_addr.h"
 #include "hw/i386/smbios.h"
+#include "qemu/thread.h"
+
+#include <zlib.h>
 
 #ifdef TARGET_SPARC
 int graphic_width = 1024;
@@ -94,6 +97,31 @@ const uint32_t arch_type = QEMU_ARCH;
 #define RAM_SAVE_FLAG_PAGE     0x08
 #define RAM_SAVE_FLAG_EOS      0x10
 #define RAM_SAVE_FLAG_CONTINUE 0x20
+#define RAM_SAVE_FLAG_INDEX    0x40 /* Version 5 only */
+#define RAM_SAVE_FLAG_ZINDEX   0x80 /* Version 5 only */
+#define RAM_SAVE_FLAG_SPARSE   0x100 /* Version 5 only, with FLAG_INDEX */
+
+/* Per-page entries of a RAM_SAVE_FLAG_INDEX record. */
+#define RAM_INDEX_FILL         0    /* followed by the fill byte */
+#define RAM_INDEX_RAW          1    /* followed by 0, page stored in the data */
+
+/* Maximum number of bytes read or written at once for raw pages. */
+#define RAM_INDEX_MAX_RUN      (1024 * 1024)
+
+/* Pages of a RAM_SAVE_FLAG_ZINDEX record are compressed in chunks of this
+ * many bytes of a block, each chunk being a separate zlib stream. */
+#define RAM_COMPRESS_CHUNK     (1024 * 1024)
+#define RAM_COMPRESS_STORED    0x80000000U /* chunk header for raw data */
+#define RAM_COMPRESS_MAX_THREADS  8
+
+/* zlib compression level of saved snapshots, 0 for none. */
+int ram_compress_level;
+
+/* Stream offset of the pages of the last RAM_SAVE_FLAG_SPARSE record saved
+ * or loaded, or -1. While it is set, the snapshot vmstate holds the content
+ * of every page that isn't dirty for DIRTY_MEMORY_MIGRATION, so that the
+ * next save only has to write the dirty pages. */
+static int64_t ram_sparse_base = -1;
 
 static int is_dup_page(uint8_t *page, uint8_t ch)
 {
@@ -130,6 +158,7 @@ static int ram_save_block(QEMUFile *f)
                                           DIRTY_MEMORY_MIGRATION)) {
             uint8_t *p;
             int cont = (block == last_block) ? RAM_SAVE_FLAG_CONTINUE : 0;
+            int discarded;
 
             cpu_physical_memory_reset_dirty(current_addr,
                                             TARGET_PAGE_SIZE,
@@ -137,14 +166,20 @@ static int ram_save_block(QEMUFile *f)
 
             p = block->host + offset;
 
-            if (is_dup_page(p, *p)) {
+            /* Checked after resetting the dirty bit, so that a page the
+             * guest writes from now on is sent again. Free pages aren't
+             * faulted in by reading them. */
+            qemu_ram_sync_discarded(block, offset, TARGET_PAGE_SIZE);
+            discarded = qemu_ram_page_discarded(block, offset);
+
+            if (discarded || is_dup_page(p, *p)) {
                 qemu_put_be64(f, offset | cont | RAM_SAVE_FLAG_COMPRESS);
                 if (!cont) {
                     qemu_put_byte(f, strlen(block->idstr));
                     qemu_put_buffer(f, (uint8_t *)block->idstr,
                                     strlen(block->idstr));
                 }
-                qemu_put_byte(f, *p);
+                qemu_put_byte(f, discarded ? 0 : *p);
                 bytes_sent = 1;
             } else {
                 qemu_put_be64(f, offset | cont | RAM_SAVE_FLAG_PAGE);
@@ -253,6 +288,559 @@ static void sort_ram_list(void)
     g_free(blocks);
 }
 
+/* Statistics of the last snapshot save and load, for 'info snapshots'. */
+static RamSnapshotStats ram_save_stats;
+static RamSnapshotStats ram_load_stats;
+
+enum {
+    RAM_JOB_IDLE,
+    RAM_JOB_PENDING,
+    RAM_JOB_DONE,
+    RAM_JOB_QUIT,
+};
+
+/* A chunk of pages compressed, or decompressed, by a pool thread. The
+ * main thread only touches a job while it isn't RAM_JOB_PENDING. */
+typedef struct RamCompressJob {
+    QemuThread thread;
+    QemuMutex lock;
+    QemuCond cond;
+    int state;
+    int decompress;
+    z_stream zs;
+    uint8_t *host;              /* first page of the chunk */
+    const uint8_t *entries;     /* index entries of the chunk */
+    ram_addr_t num_pages;       /* 0 if the job holds no chunk */
+    uint8_t *buf;               /* RAM_COMPRESS_CHUNK bytes */
+    uint8_t *page;              /* decompressed page, over a RAM template */
+    uint32_t len;               /* compressed bytes in buf */
+    int stored;                 /* the chunk doesn't compress, save it raw */
+    int ret;
+} RamCompressJob;
+
+typedef struct RamCompressPool {
+    RamCompressJob jobs[RAM_COMPRESS_MAX_THREADS];
+    int num_threads;
+} RamCompressPool;
+
+static uint32_t ram_chunk_raw_bytes(const uint8_t *entries,
+                                    ram_addr_t num_pages)
+{
+    uint32_t raw = 0;
+    ram_addr_t n;
+
+    for (n = 0; n < num_pages; n++) {
+        if (entries[2 * n] == RAM_INDEX_RAW) {
+            raw += TARGET_PAGE_SIZE;
+        }
+    }
+    return raw;
+}
+
+static int ram_compress_chunk(RamCompressJob *job)
+{
+    z_stream *zs = &job->zs;
+    uint32_t raw = ram_chunk_raw_bytes(job->entries, job->num_pages);
+    ram_addr_t n;
+
+    job->len = 0;
+    job->stored = 0;
+    if (raw == 0) {
+        return 0;
+    }
+
+    deflateReset(zs);
+    zs->next_out = job->buf;
+    zs->avail_out = RAM_COMPRESS_CHUNK;
+    for (n = 0; n < job->num_pages; n++) {
+        if (job->entries[2 * n] != RAM_INDEX_RAW) {
+            continue;
+        }
+        zs->next_in = job->host + n * TARGET_PAGE_SIZE;
+        zs->avail_in = TARGET_PAGE_SIZE;
+        while (zs->avail_in > 0 && zs->avail_out > 0) {
+            if (deflate(zs, Z_NO_FLUSH) != Z_OK) {
+                break;
+            }
+        }
+        if (zs->avail_in > 0) {
+            /* Bigger than the raw pages, store them instead. */
+            job->stored = 1;
+            return 0;
+        }
+    }
+    if (deflate(zs, Z_FINISH) != Z_STREAM_END || zs->total_out >= raw) {
+        job->stored = 1;
+        return 0;
+    }
+    job->len = zs->total_out;
+    return 0;
+}
+
+/* Copy a loaded page to guest RAM. Over a RAM template, a page that
+ * already holds the same data is left alone so that it stays shared. */
+static void ram_put_page(uint8_t *host, const uint8_t *page)
+{
+    if (!ram_template_mapped || memcmp(host, page, TARGET_PAGE_SIZE)) {
+        memcpy(host, page, TARGET_PAGE_SIZE);
+    }
+}
+
+/* Fill a loaded page, unless it is already filled with 'ch'. Most pages
+ * are still zero when restoring at boot, or are the same as in the RAM
+ * template: checking first avoids writing, and thus allocating them. */
+static int ram_fill_page(uint8_t *host, uint8_t ch)
+{
+    if (ch == 0) {
+        if (buffer_is_zero(host, TARGET_PAGE_SIZE)) {
+            return 0;
+        }
+    } else if (ram_template_mapped && host[0] == ch &&
+               !memcmp(host, host + 1, TARGET_PAGE_SIZE - 1)) {
+        return 0;
+    }
+    memset(host, ch, TARGET_PAGE_SIZE);
+    return 1;
+}
+
+static int ram_decompress_chunk(RamCompressJob *job)
+{
+    z_stream *zs = &job->zs;
+    ram_addr_t n;
+
+    inflateReset(zs);
+    zs->next_in = job->buf;
+    zs->avail_in = job->len;
+    for (n = 0; n < job->num_pages; n++) {
+        uint8_t *host = job->host + n * TARGET_PAGE_SIZE;
+
+        if (job->entries[2 * n] != RAM_INDEX_RAW) {
+            continue;
+        }
+        zs->next_out = job->page ? job->page : host;
+        zs->avail_out = TARGET_PAGE_SIZE;
+        while (zs->avail_out > 0) {
+            int ret = inflate(zs, Z_NO_FLUSH);
+
+            if (ret != Z_OK && !(ret == Z_STREAM_END && zs->avail_out == 0)) {
+                return -EINVAL;
+            }
+        }
+        if (job->page) {
+            ram_put_page(host, job->page);
+        }
+    }
+    return 0;
+}
+
+static void *ram_compress_thread(void *opaque)
+{
+    RamCompressJob *job = opaque;
+
+    qemu_mutex_lock(&job->lock);
+    for (;;) {
+        int ret;
+
+        while (job->state != RAM_JOB_PENDING && job->state != RAM_JOB_QUIT) {
+            qemu_cond_wait(&job->cond, &job->lock);
+        }
+        if (job->state == RAM_JOB_QUIT) {
+            break;
+        }
+        qemu_mutex_unlock(&job->lock);
+
+        if (job->decompress) {
+            ret = ram_decompress_chunk(job);
+        } else {
+            ret = ram_compress_chunk(job);
+        }
+
+        qemu_mutex_lock(&job->lock);
+        job->ret = ret;
+        job->state = RAM_JOB_DONE;
+        qemu_cond_broadcast(&job->cond);
+    }
+    qemu_mutex_unlock(&job->lock);
+    return NULL;
+}
+
+static int ram_compress_thread_count(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    long count;
+
+    GetSystemInfo(&info);
+    count = info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+    if (count < 1) {
+        return 1;
+    }
+    return MIN(count, RAM_COMPRESS_MAX_THREADS);
+}
+
+static void ram_compress_pool_init(RamCompressPool *pool, int decompress)
+{
+    int n;
+
+    memset(pool, 0, sizeof(*pool));
+    pool->num_threads = ram_compress_thread_count();
+    for (n = 0; n < pool->num_threads; n++) {
+        RamCompressJob *job = &pool->jobs[n];
+
+        job->decompress = decompress;
+        job->buf = g_malloc(RAM_COMPRESS_CHUNK);
+        if (decompress) {
+            inflateInit(&job->zs);
+            if (ram_template_mapped) {
+                job->page = g_malloc(TARGET_PAGE_SIZE);
+            }
+        } else {
+            deflateInit(&job->zs, ram_compress_level);
+        }
+        qemu_mutex_init(&job->lock);
+        qemu_cond_init(&job->cond);
+        qemu_thread_create(&job->thread, ram_compress_thread, job,
+                           QEMU_THREAD_JOINABLE);
+    }
+}
+
+static void ram_compress_job_submit(RamCompressJob *job)
+{
+    qemu_mutex_lock(&job->lock);
+    job->state = RAM_JOB_PENDING;
+    qemu_cond_broadcast(&job->cond);
+    qemu_mutex_unlock(&job->lock);
+}
+
+/* Wait for the chunk held by 'job', if any, and return its result. */
+static int ram_compress_job_wait(RamCompressJob *job)
+{
+    qemu_mutex_lock(&job->lock);
+    while (job->state == RAM_JOB_PENDING) {
+        qemu_cond_wait(&job->cond, &job->lock);
+    }
+    qemu_mutex_unlock(&job->lock);
+    return job->ret;
+}
+
+static void ram_compress_pool_destroy(RamCompressPool *pool)
+{
+    int n;
+
+    for (n = 0; n < pool->num_threads; n++) {
+        RamCompressJob *job = &pool->jobs[n];
+
+        ram_compress_job_wait(job);
+        qemu_mutex_lock(&job->lock);
+        job->state = RAM_JOB_QUIT;
+        qemu_cond_broadcast(&job->cond);
+        qemu_mutex_unlock(&job->lock);
+        qemu_thread_join(&job->thread);
+
+        if (job->decompress) {
+            inflateEnd(&job->zs);
+        } else {
+            deflateEnd(&job->zs);
+        }
+        qemu_cond_destroy(&job->cond);
+        qemu_mutex_destroy(&job->lock);
+        g_free(job->buf);
+        g_free(job->page);
+    }
+}
+
+/* Write the raw pages of a range, as consecutive runs. The pages are
+ * referenced rather than copied by the file, the VM must stay stopped
+ * until it is flushed. */
+static void ram_put_raw_pages(QEMUFile *f, uint8_t *host,
+                              const uint8_t *entries, ram_addr_t num_pages)
+{
+    ram_addr_t page = 0;
+
+    while (page < num_pages) {
+        ram_addr_t run = 0;
+
+        while (page + run < num_pages &&
+               run * TARGET_PAGE_SIZE < RAM_INDEX_MAX_RUN &&
+               entries[2 * (page + run)] == RAM_INDEX_RAW) {
+            run++;
+        }
+        if (run > 0) {
+            qemu_put_buffer_async(f, host + page * TARGET_PAGE_SIZE,
+                                  run * TARGET_PAGE_SIZE);
+            page += run;
+        } else {
+            page++;
+        }
+    }
+}
+
+static int ram_sparse_page_needed(RAMBlock *block, const uint8_t *entries,
+                                  ram_addr_t page, int incremental)
+{
+    if (entries[2 * page] != RAM_INDEX_RAW) {
+        return 0;
+    }
+    return !incremental ||
+           cpu_physical_memory_get_dirty(block->offset +
+                                         page * TARGET_PAGE_SIZE,
+                                         TARGET_PAGE_SIZE,
+                                         DIRTY_MEMORY_MIGRATION);
+}
+
+/* Write the raw pages of a block in their slots of a RAM_SAVE_FLAG_SPARSE
+ * record, only the dirty ones if 'incremental' is set. Return the number
+ * of bytes skipped. */
+static uint64_t ram_put_sparse_pages(QEMUFile *f, RAMBlock *block,
+                                     const uint8_t *entries, int incremental)
+{
+    ram_addr_t num_pages = block->length / TARGET_PAGE_SIZE;
+    ram_addr_t page = 0;
+    uint64_t skipped = 0;
+
+    while (page < num_pages) {
+        int needed = ram_sparse_page_needed(block, entries, page, incremental);
+        ram_addr_t run = 1;
+
+        while (page + run < num_pages &&
+               run * TARGET_PAGE_SIZE < RAM_INDEX_MAX_RUN &&
+               ram_sparse_page_needed(block, entries, page + run,
+                                      incremental) == needed) {
+            run++;
+        }
+        if (needed) {
+            qemu_put_buffer_async(f, block->host + page * TARGET_PAGE_SIZE,
+                                  run * TARGET_PAGE_SIZE);
+        } else {
+            qemu_fskip(f, run * TARGET_PAGE_SIZE);
+            skipped += run * TARGET_PAGE_SIZE;
+        }
+        page += run;
+    }
+    return skipped;
+}
+
+/* Write the result of a compression job, in submission order. */
+static void ram_save_chunk(QEMUFile *f, RamCompressJob *job)
+{
+    if (job->num_pages == 0) {
+        return;
+    }
+    ram_compress_job_wait(job);
+
+    if (job->stored) {
+        uint32_t raw = ram_chunk_raw_bytes(job->entries, job->num_pages);
+
+        qemu_put_be32(f, raw | RAM_COMPRESS_STORED);
+        ram_put_raw_pages(f, job->host, job->entries, job->num_pages);
+    } else {
+        qemu_put_be32(f, job->len);
+        qemu_put_buffer(f, job->buf, job->len);
+    }
+    job->num_pages = 0;
+}
+
+/* Write the pages of a RAM_SAVE_FLAG_ZINDEX record. Each block is split
+ * in chunks of RAM_COMPRESS_CHUNK bytes, which are compressed in
+ * parallel and written in order as:
+ *
+ *     be32 length of the zlib stream of the chunk raw pages, 0 if there
+ *          are none, or their length | RAM_COMPRESS_STORED if the raw
+ *          pages follow as is
+ *     data
+ */
+static int ram_save_compressed(QEMUFile *f, const uint8_t *index)
+{
+    RamCompressPool pool;
+    RAMBlock *block;
+    const uint8_t *entries = index;
+    ram_addr_t chunk_pages = RAM_COMPRESS_CHUNK / TARGET_PAGE_SIZE;
+    int seq = 0;
+    int threads, n;
+
+    ram_compress_pool_init(&pool, 0);
+
+    QTAILQ_FOREACH(block, &ram_list.blocks, next) {
+        ram_addr_t num_pages = block->length / TARGET_PAGE_SIZE;
+        ram_addr_t page;
+
+        for (page = 0; page < num_pages; page += chunk_pages) {
+            RamCompressJob *job = &pool.jobs[seq++ % pool.num_threads];
+
+            /* The job still holds the oldest chunk in flight. */
+            ram_save_chunk(f, job);
+            job->host = block->host + page * TARGET_PAGE_SIZE;
+            job->entries = entries + 2 * page;
+            job->num_pages = MIN(chunk_pages, num_pages - page);
+            ram_compress_job_submit(job);
+        }
+        entries += 2 * num_pages;
+    }
+    for (n = 0; n < pool.num_threads; n++) {
+        ram_save_chunk(f, &pool.jobs[seq++ % pool.num_threads]);
+    }
+
+    threads = pool.num_threads;
+    ram_compress_pool_destroy(&pool);
+    return threads;
+}
+
+/* Save all RAM blocks as a page index followed by the raw pages. Pages
+ * filled with a single byte value are only recorded in the index. This
+ * can only be used when the VM is stopped, since pages dirtied after the
+ * index is written would be lost.
+ *
+ * Layout, after the be64 RAM_SAVE_FLAG_INDEX or RAM_SAVE_FLAG_ZINDEX
+ * header:
+ *
+ *     be32 number of blocks
+ *     for each block:
+ *         byte length of the block id, block id
+ *         be64 number of pages
+ *         2 bytes per page: RAM_INDEX_FILL + fill byte, or RAM_INDEX_RAW + 0
+ *
+ * For RAM_SAVE_FLAG_INDEX:
+ *     be32 padding length, padding bytes
+ *     raw pages of all blocks, in index order, which start at a
+ *     TARGET_PAGE_SIZE aligned offset in the stream
+ *
+ * With RAM_SAVE_FLAG_SPARSE as well, which is used for snapshot files,
+ * every page has a slot after the padding, and the slots of fill pages
+ * are skipped. A page is thus always at the same offset of the vmstate,
+ * and the pages that haven't changed since the last save or load don't
+ * need to be written again: the vmstate of a loaded snapshot is shared
+ * with the current image until it is overwritten.
+ *
+ * For RAM_SAVE_FLAG_ZINDEX, the chunks described in ram_save_compressed().
+ */
+static void ram_save_indexed(QEMUFile *f)
+{
+    RAMBlock *block;
+    uint8_t *index, *entry;
+    int64_t start = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    int64_t start_pos = qemu_ftell(f);
+    uint32_t num_blocks = 0;
+    int64_t base = -1;
+    uint64_t skipped = 0;
+    int sparse = ram_compress_level == 0 && qemu_file_can_skip(f);
+    int incremental = 0;
+    int threads = 0;
+
+    QTAILQ_FOREACH(block, &ram_list.blocks, next) {
+        num_blocks++;
+    }
+    index = g_malloc(ram_bytes_total() / TARGET_PAGE_SIZE * 2);
+
+    if (ram_compress_level > 0) {
+        qemu_put_be64(f, RAM_SAVE_FLAG_ZINDEX);
+    } else if (sparse) {
+        qemu_put_be64(f, RAM_SAVE_FLAG_INDEX | RAM_SAVE_FLAG_SPARSE);
+    } else {
+        qemu_put_be64(f, RAM_SAVE_FLAG_INDEX);
+    }
+    qemu_put_be32(f, num_blocks);
+
+    memset(&ram_save_stats, 0, sizeof(ram_save_stats));
+    entry = index;
+    QTAILQ_FOREACH(block, &ram_list.blocks, next) {
+        ram_addr_t num_pages = block->length / TARGET_PAGE_SIZE;
+        ram_addr_t n;
+
+        qemu_ram_sync_discarded(block, 0, block->length);
+        for (n = 0; n < num_pages; n++) {
+            uint8_t *p = block->host + n * TARGET_PAGE_SIZE;
+
+            if (qemu_ram_page_discarded(block, n * TARGET_PAGE_SIZE)) {
+                /* Free page given back to the host, which reads as zero:
+                 * don't fault it in again by reading it. */
+                entry[2 * n] = RAM_INDEX_FILL;
+                entry[2 * n + 1] = 0;
+                ram_save_stats.zero_pages++;
+                ram_save_stats.free_pages++;
+            } else if (is_dup_page(p, *p)) {
+                entry[2 * n] = RAM_INDEX_FILL;
+                entry[2 * n + 1] = *p;
+                if (*p == 0) {
+                    ram_save_stats.zero_pages++;
+                } else {
+                    ram_save_stats.fill_pages++;
+                }
+            } else {
+                entry[2 * n] = RAM_INDEX_RAW;
+                entry[2 * n + 1] = 0;
+                ram_save_stats.raw_pages++;
+            }
+        }
+        qemu_put_byte(f, strlen(block->idstr));
+        qemu_put_buffer(f, (uint8_t *)block->idstr, strlen(block->idstr));
+        qemu_put_be64(f, num_pages);
+        qemu_put_buffer(f, entry, num_pages * 2);
+        entry += num_pages * 2;
+    }
+
+    if (ram_compress_level > 0) {
+        threads = ram_save_compressed(f, index);
+    } else {
+        /* Align the raw pages on a page boundary. */
+        int64_t pos = qemu_ftell(f) + 4;
+        uint32_t padding = (TARGET_PAGE_SIZE - (pos & (TARGET_PAGE_SIZE - 1))) &
+                           (TARGET_PAGE_SIZE - 1);
+
+        qemu_put_be32(f, padding);
+        while (padding-- > 0) {
+            qemu_put_byte(f, 0);
+        }
+        base = qemu_ftell(f);
+        incremental = sparse && base == ram_sparse_base;
+
+        entry = index;
+        QTAILQ_FOREACH(block, &ram_list.blocks, next) {
+            ram_addr_t num_pages = block->length / TARGET_PAGE_SIZE;
+
+            if (sparse) {
+                skipped += ram_put_sparse_pages(f, block, entry, incremental);
+            } else {
+                ram_put_raw_pages(f, block->host, entry, num_pages);
+            }
+            entry += num_pages * 2;
+        }
+    }
+    g_free(index);
+
+    if (sparse && !qemu_file_get_error(f)) {
+        ram_sparse_base = base;
+        /* Keep tracking writes for the next incremental save. */
+        cpu_physical_memory_set_dirty_tracking(1);
+    } else {
+        ram_sparse_base = -1;
+    }
+
+    QTAILQ_FOREACH(block, &ram_list.blocks, next) {
+        cpu_physical_memory_reset_dirty(block->offset, block->length,
+                                        DIRTY_MEMORY_MIGRATION);
+    }
+    bytes_transferred += qemu_ftell(f) - start_pos - skipped;
+
+    ram_save_stats.ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - start;
+    ram_save_stats.ram_bytes = ram_bytes_total();
+    ram_save_stats.stream_bytes = qemu_ftell(f) - start_pos - skipped;
+    ram_save_stats.threads = threads;
+    ram_save_stats.incremental = incremental;
+    if (incremental) {
+        /* the slots of fill pages are skipped as well */
+        ram_save_stats.clean_pages = skipped / TARGET_PAGE_SIZE -
+            ram_save_stats.zero_pages - ram_save_stats.fill_pages;
+    }
+
+    /* ram_save_block() needs a starting point to scan for dirty pages. */
+    last_block = QTAILQ_FIRST(&ram_list.blocks);
+    last_offset = 0;
+}
+
 int ram_save_live(QEMUFile *f, int stage, void *opaque)
 {
     ram_addr_t addr;
@@ -261,6 +849,7 @@ int ram_save_live(QEMUFile *f, int stage, void *opaque)
     uint64_t expected_time = 0;
 
     if (stage < 0) {
+        ram_sparse_base = -1;
         cpu_physical_memory_set_dirty_tracking(0);
         return 0;
     }
@@ -277,20 +866,27 @@ int ram_save_live(QEMUFile *f, int stage, void *opaque)
         last_offset = 0;
         sort_ram_list();
 
-        /* Make sure all dirty bits are set */
-        QTAILQ_FOREACH(block, &ram_list.blocks, next) {
-            for (addr = block->offset; addr < block->offset + block->length;
-                 addr += TARGET_PAGE_SIZE) {
-                if (!cpu_physical_memory_get_dirty(addr, TARGET_PAGE_SIZE,
-                                                   DIRTY_MEMORY_MIGRATION)) {
-                    cpu_physical_memory_set_dirty_flag(
-                            addr, DIRTY_MEMORY_MIGRATION);
+        /* ram_save_indexed() saves everything at once, and needs the dirty
+         * bits for incremental saves. */
+        if (vm_running) {
+            ram_sparse_base = -1;
+
+            /* Make sure all dirty bits are set */
+            QTAILQ_FOREACH(block, &ram_list.blocks, next) {
+                for (addr = block->offset;
+                     addr < block->offset + block->length;
+                     addr += TARGET_PAGE_SIZE) {
+                    if (!cpu_physical_memory_get_dirty(addr, TARGET_PAGE_SIZE,
+                                                       DIRTY_MEMORY_MIGRATION)) {
+                        cpu_physical_memory_set_dirty_flag(
+                                addr, DIRTY_MEMORY_MIGRATION);
+                    }
                 }
             }
-        }
 
-        /* Enable dirty memory tracking */
-        cpu_physical_memory_set_dirty_tracking(1);
+            /* Enable dirty memory tracking */
+            cpu_physical_memory_set_dirty_tracking(1);
+        }
 
         qemu_put_be64(f, ram_bytes_total() | RAM_SAVE_FLAG_MEM_SIZE);
 
@@ -299,6 +895,11 @@ int ram_save_live(QEMUFile *f, int stage, void *opaque)
             qemu_put_buffer(f, (uint8_t *)block->idstr, strlen(block->idstr));
             qemu_put_be64(f, block->length);
         }
+
+        /* Snapshots are taken with the VM stopped, save everything now. */
+        if (!vm_running) {
+            ram_save_indexed(f);
+        }
     }
 
     bytes_transferred_last = bytes_transferred;
@@ -331,7 +932,9 @@ int ram_save_live(QEMUFile *f, int stage, void *opaque)
         while ((bytes_sent = ram_save_block(f)) != 0) {
             bytes_transferred += bytes_sent;
         }
-        cpu_physical_memory_set_dirty_tracking(0);
+        if (ram_sparse_base < 0) {
+            cpu_physical_memory_set_dirty_tracking(0);
+        }
     }
 
     qemu_put_be64(f, RAM_SAVE_FLAG_EOS);
@@ -371,12 +974,382 @@ static inline void *host_from_stream_offset(QEMUFile *f,
     return NULL;
 }
 
+/* Read pages into guest RAM, see ram_put_page(). */
+static void ram_get_pages(QEMUFile *f, uint8_t *host, size_t size)
+{
+    uint8_t page[TARGET_PAGE_SIZE];
+    size_t offset;
+
+    if (!ram_template_mapped) {
+        qemu_get_buffer(f, host, size);
+        return;
+    }
+    for (offset = 0; offset < size; offset += TARGET_PAGE_SIZE) {
+        qemu_get_buffer(f, page, TARGET_PAGE_SIZE);
+        ram_put_page(host + offset, page);
+    }
+}
+
+/* Read the raw pages of a range, as consecutive runs. */
+static void ram_get_raw_pages(QEMUFile *f, uint8_t *host,
+                              const uint8_t *entries, ram_addr_t num_pages)
+{
+    ram_addr_t page = 0;
+
+    while (page < num_pages) {
+        ram_addr_t run = 0;
+
+        while (page + run < num_pages &&
+               run * TARGET_PAGE_SIZE < RAM_INDEX_MAX_RUN &&
+               entries[2 * (page + run)] == RAM_INDEX_RAW) {
+            run++;
+        }
+        if (run > 0) {
+            ram_get_pages(f, host + page * TARGET_PAGE_SIZE,
+                          run * TARGET_PAGE_SIZE);
+            page += run;
+        } else {
+            page++;
+        }
+    }
+}
+
+/* Read the raw pages of a block from their slots of a RAM_SAVE_FLAG_SPARSE
+ * record. Return the number of bytes skipped. */
+static uint64_t ram_get_sparse_pages(QEMUFile *f, RAMBlock *block,
+                                     const uint8_t *entries)
+{
+    ram_addr_t num_pages = block->length / TARGET_PAGE_SIZE;
+    ram_addr_t page = 0;
+    uint64_t skipped = 0;
+
+    while (page < num_pages) {
+        int raw = entries[2 * page] == RAM_INDEX_RAW;
+        ram_addr_t run = 1;
+
+        while (page + run < num_pages &&
+               run * TARGET_PAGE_SIZE < RAM_INDEX_MAX_RUN &&
+               (entries[2 * (page + run)] == RAM_INDEX_RAW) == raw) {
+            run++;
+        }
+        if (raw) {
+            ram_get_pages(f, block->host + page * TARGET_PAGE_SIZE,
+                          run * TARGET_PAGE_SIZE);
+        } else {
+            qemu_fskip(f, run * TARGET_PAGE_SIZE);
+            skipped += run * TARGET_PAGE_SIZE;
+        }
+        page += run;
+    }
+    return skipped;
+}
+
+/* Read the chunks written by ram_save_compressed(), and decompress them
+ * in parallel. Return the number of threads used, or a negative error. */
+static int ram_load_compressed(QEMUFile *f, RAMBlock **blocks,
+                               uint8_t **indexes, uint32_t num_blocks)
+{
+    RamCompressPool pool;
+    ram_addr_t chunk_pages = RAM_COMPRESS_CHUNK / TARGET_PAGE_SIZE;
+    int seq = 0;
+    int ret = 0;
+    uint32_t n;
+    int i;
+
+    ram_compress_pool_init(&pool, 1);
+
+    for (n = 0; n < num_blocks && ret == 0; n++) {
+        RAMBlock *block = blocks[n];
+        ram_addr_t num_pages = block->length / TARGET_PAGE_SIZE;
+        ram_addr_t page;
+
+        for (page = 0; page < num_pages; page += chunk_pages) {
+            const uint8_t *entries = indexes[n] + 2 * page;
+            ram_addr_t count = MIN(chunk_pages, num_pages - page);
+            uint32_t raw = ram_chunk_raw_bytes(entries, count);
+            uint32_t len = qemu_get_be32(f);
+            RamCompressJob *job;
+
+            if (len == (raw | RAM_COMPRESS_STORED)) {
+                ram_get_raw_pages(f, block->host + page * TARGET_PAGE_SIZE,
+                                  entries, count);
+                continue;
+            }
+            if (len == 0 && raw == 0) {
+                continue;
+            }
+            if (len == 0 || len >= raw || qemu_file_get_error(f)) {
+                fprintf(stderr, "Invalid compressed RAM chunk in \"%s\"\n",
+                        block->idstr);
+                ret = -EINVAL;
+                break;
+            }
+
+            job = &pool.jobs[seq++ % pool.num_threads];
+            if (job->num_pages > 0) {
+                ret = ram_compress_job_wait(job);
+                if (ret < 0) {
+                    break;
+                }
+            }
+            qemu_get_buffer(f, job->buf, len);
+            job->len = len;
+            job->host = block->host + page * TARGET_PAGE_SIZE;
+            job->entries = entries;
+            job->num_pages = count;
+            ram_compress_job_submit(job);
+        }
+    }
+
+    for (i = 0; i < pool.num_threads; i++) {
+        RamCompressJob *job = &pool.jobs[i];
+
+        if (job->num_pages > 0 && ram_compress_job_wait(job) < 0 &&
+            ret == 0) {
+            ret = -EINVAL;
+        }
+    }
+    if (ret == 0) {
+        ret = pool.num_threads;
+    }
+    ram_compress_pool_destroy(&pool);
+    return ret;
+}
+
+/* Load RAM saved by ram_save_indexed(). */
+static int ram_load_indexed(QEMUFile *f, int flags)
+{
+    RAMBlock **blocks;
+    uint8_t **indexes;
+    uint32_t num_blocks, padding, n;
+    int64_t start = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    int64_t start_pos = qemu_ftell(f) - 8;
+    int64_t base = -1;
+    uint64_t skipped = 0;
+    int sparse = flags & RAM_SAVE_FLAG_SPARSE;
+    int threads = 0;
+    int ret = -EINVAL;
+
+    if (sparse && !qemu_file_can_skip(f)) {
+        return -EINVAL;
+    }
+
+    memset(&ram_load_stats, 0, sizeof(ram_load_stats));
+    num_blocks = qemu_get_be32(f);
+    blocks = g_malloc0(num_blocks * sizeof(*blocks));
+    indexes = g_malloc0(num_blocks * sizeof(*indexes));
+
+    for (n = 0; n < num_blocks; n++) {
+        RAMBlock *block;
+        char id[256];
+        uint8_t len;
+        uint64_t num_pages, page;
+
+        len = qemu_get_byte(f);
+        qemu_get_buffer(f, (uint8_t *)id, len);
+        id[len] = 0;
+        num_pages = qemu_get_be64(f);
+
+        QTAILQ_FOREACH(block, &ram_list.blocks, next) {
+            if (!strncmp(id, block->idstr, sizeof(id))) {
+                break;
+            }
+        }
+        if (!block || num_pages != block->length / TARGET_PAGE_SIZE) {
+            fprintf(stderr, "Invalid RAM index for block \"%s\"\n", id);
+            goto out;
+        }
+        blocks[n] = block;
+        indexes[n] = g_malloc(num_pages * 2);
+        qemu_get_buffer(f, indexes[n], num_pages * 2);
+
+        /* Fill pages now, raw ones come after the index. */
+        for (page = 0; page < num_pages; page++) {
+            uint8_t *host = block->host + page * TARGET_PAGE_SIZE;
+            uint8_t ch = indexes[n][2 * page + 1];
+
+            if (indexes[n][2 * page] != RAM_INDEX_FILL) {
+                ram_load_stats.raw_pages++;
+                continue;
+            }
+            if (ch == 0) {
+                ram_load_stats.zero_pages++;
+            } else {
+                ram_load_stats.fill_pages++;
+            }
+            ram_fill_page(host, ch);
+        }
+        if (qemu_file_get_error(f)) {
+            ret = -EIO;
+            goto out;
+        }
+    }
+
+    if (flags & RAM_SAVE_FLAG_ZINDEX) {
+        threads = ram_load_compressed(f, blocks, indexes, num_blocks);
+        if (threads < 0) {
+            ret = threads;
+            goto out;
+        }
+    } else {
+        padding = qemu_get_be32(f);
+        if (padding >= TARGET_PAGE_SIZE) {
+            goto out;
+        }
+        while (padding-- > 0) {
+            qemu_get_byte(f);
+        }
+        base = qemu_ftell(f);
+
+        for (n = 0; n < num_blocks; n++) {
+            if (sparse) {
+                skipped += ram_get_sparse_pages(f, blocks[n], indexes[n]);
+            } else {
+                ram_get_raw_pages(f, blocks[n]->host, indexes[n],
+                                  blocks[n]->length / TARGET_PAGE_SIZE);
+            }
+        }
+    }
+    ret = qemu_file_get_error(f) ? -EIO : 0;
+
+    /* The vmstate now matches RAM, start tracking changes for the next
+     * incremental save. */
+    if (ret == 0 && sparse) {
+        for (n = 0; n < num_blocks; n++) {
+            cpu_physical_memory_reset_dirty(blocks[n]->offset,
+                                            blocks[n]->length,
+                                            DIRTY_MEMORY_MIGRATION);
+        }
+        cpu_physical_memory_set_dirty_tracking(1);
+        ram_sparse_base = base;
+    }
+
+    ram_load_stats.ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - start;
+    ram_load_stats.ram_bytes = ram_bytes_total();
+    ram_load_stats.stream_bytes = qemu_ftell(f) - start_pos - skipped;
+    ram_load_stats.threads = threads;
+
+out:
+    for (n = 0; n < num_blocks; n++) {
+        g_free(indexes[n]);
+    }
+    g_free(indexes);
+    g_free(blocks);
+    return ret;
+}
+
+static void ram_print_stats(Monitor *mon, const char *what,
+                            const RamSnapshotStats *stats)
+{
+    double seconds = stats->ns / 1e9;
+
+    if (stats->ns <= 0) {
+        return;
+    }
+    monitor_printf(mon, "Last RAM %s: %" PRIu64 " MB in %" PRId64 " ms "
+                   "(%.1f MB/s), %" PRIu64 " MB of snapshot data",
+                   what, stats->ram_bytes >> 20, stats->ns / 1000000,
+                   stats->ram_bytes / 1048576.0 / seconds,
+                   stats->stream_bytes >> 20);
+    if (stats->threads > 0) {
+        monitor_printf(mon, ", compressed, %d threads", stats->threads);
+    }
+    if (stats->incremental) {
+        monitor_printf(mon, ", incremental");
+    }
+    monitor_printf(mon, "\n");
+    monitor_printf(mon, "    pages: %" PRIu64 " zero", stats->zero_pages);
+    if (stats->free_pages) {
+        monitor_printf(mon, " (%" PRIu64 " free)", stats->free_pages);
+    }
+    monitor_printf(mon, ", %" PRIu64 " filled, %" PRIu64 " raw",
+                   stats->fill_pages, stats->raw_pages);
+    if (stats->incremental) {
+        monitor_printf(mon, " (%" PRIu64 " unchanged)", stats->clean_pages);
+    }
+    monitor_printf(mon, "\n");
+}
+
+void ram_print_snapshot_stats(Monitor *mon)
+{
+    ram_print_stats(mon, "save", &ram_save_stats);
+    ram_print_stats(mon, "load", &ram_load_stats);
+}
+
+void ram_get_snapshot_stats(RamSnapshotStats *save, RamSnapshotStats *load)
+{
+    if (save) {
+        *save = ram_save_stats;
+    }
+    if (load) {
+        *load = ram_load_stats;
+    }
+}
+
+/* Fill all RAM blocks with pseudo-random pages for the snapshot benchmark:
+ * about 45% zero pages, 10% filled with another byte, 25% of compressible
+ * text and 20% of random bytes. */
+void ram_bench_fill(uint32_t seed)
+{
+    RAMBlock *block;
+    uint32_t x = seed ? seed : 1;
+
+#define RAM_BENCH_NEXT()  (x ^= x << 13, x ^= x >> 17, x ^= x << 5)
+
+    QTAILQ_FOREACH(block, &ram_list.blocks, next) {
+        ram_addr_t num_pages = block->length / TARGET_PAGE_SIZE;
+        ram_addr_t n;
+
+        for (n = 0; n < num_pages; n++) {
+            uint8_t *p = block->host + n * TARGET_PAGE_SIZE;
+            uint32_t kind = RAM_BENCH_NEXT() % 100;
+            int i;
+
+            if (kind < 45) {
+                memset(p, 0, TARGET_PAGE_SIZE);
+            } else if (kind < 55) {
+                memset(p, (RAM_BENCH_NEXT() % 255) + 1, TARGET_PAGE_SIZE);
+            } else if (kind < 80) {
+                for (i = 0; i < TARGET_PAGE_SIZE; i++) {
+                    p[i] = "etaoin shrdlu\n.,"[RAM_BENCH_NEXT() % 16];
+                }
+            } else {
+                for (i = 0; i < TARGET_PAGE_SIZE; i += 4) {
+                    RAM_BENCH_NEXT();
+                    memcpy(p + i, &x, 4);
+                }
+            }
+        }
+    }
+#undef RAM_BENCH_NEXT
+
+    /* RAM was changed behind the dirty tracking, the next save can't be
+     * incremental. */
+    ram_sparse_base = -1;
+}
+
+uint32_t ram_bench_checksum(void)
+{
+    RAMBlock *block;
+    uLong crc = crc32(0L, Z_NULL, 0);
+
+    QTAILQ_FOREACH(block, &ram_list.blocks, next) {
+        ram_addr_t pos;
+
+        for (pos = 0; pos < block->length; pos += RAM_COMPRESS_CHUNK) {
+            crc = crc32(crc, block->host + pos,
+                        MIN(RAM_COMPRESS_CHUNK, block->length - pos));
+        }
+    }
+    return (uint32_t)crc;
+}
+
 int ram_load(QEMUFile *f, void *opaque, int version_id)
 {
     ram_addr_t addr;
     int flags;
 
-    if (version_id < 3 || version_id > 4) {
+    if (version_id < 3 || version_id > 5) {
         return -EINVAL;
     }
 
@@ -386,8 +1359,24 @@ int ram_load(QEMUFile *f, void *opaque, int version_id)
         flags = addr & ~TARGET_PAGE_MASK;
         addr &= TARGET_PAGE_MASK;
 
-        if (flags & RAM_SAVE_FLAG_MEM_SIZE) {
-            if (version_id != 3) {
+        /* Loaded pages aren't in the current vmstate, until
+         * ram_load_indexed() loads a sparse record. */
+        if (flags != RAM_SAVE_FLAG_EOS) {
+            ram_sparse_base = -1;
+        }
+
+        if (flags & (RAM_SAVE_FLAG_INDEX | RAM_SAVE_FLAG_ZINDEX)) {
+            int ret;
+
+            if (version_id != 5) {
+                return -EINVAL;
+            }
+            ret = ram_load_indexed(f, flags);
+            if (ret < 0) {
+                return ret;
+            }
+        } else if (flags & RAM_SAVE_FLAG_MEM_SIZE) {
+            if (version_id == 4) {
                 if (addr != ram_bytes_total()) {
                     return -EINVAL;
                 }
@@ -427,7 +1416,7 @@ int ram_load(QEMUFile *f, void *opaque, int version_id)
             void *host;
             uint8_t ch;
 
-            if (version_id != 3)
+            if (version_id == 4)
                 host = qemu_get_ram_ptr(addr);
             else
                 host = host_from_stream_offset(f, addr, flags);
@@ -436,22 +1425,27 @@ int ram_load(QEMUFile *f, void *opaque, int version_id)
             }
 
             ch = qemu_get_byte(f);
-            memset(host, ch, TARGET_PAGE_SIZE);
+            if (ram_fill_page(host, ch)) {
 #ifndef _WIN32
-            if (ch == 0 &&
-                (!kvm_enabled() || kvm_has_sync_mmu())) {
-                qemu_madvise(host, TARGET_PAGE_SIZE, QEMU_MADV_DONTNEED);
-            }
+                /* this would bring back the page of a RAM template */
+                if (ch == 0 && !ram_template_mapped &&
+                    (!kvm_enabled() || kvm_has_sync_mmu())) {
+                    qemu_madvise(host, TARGET_PAGE_SIZE, QEMU_MADV_DONTNEED);
+                }
 #endif
+            }
         } else if (flags & RAM_SAVE_FLAG_PAGE) {
             void *host;
 
-            if (version_id != 3)
+            if (version_id == 4)
                 host = qemu_get_ram_ptr(addr);
             else
                 host = host_from_stream_offset(f, addr, flags);
+            if (!host) {
+                return -EINVAL;
+            }
 
-            qemu_get_buffer(f, host, TARGET_PAGE_SIZE);
+            ram_get_pages(f, host, TARGET_PAGE_SIZE);
         }
         if (qemu_file_get_error(f)) {
             return -EIO;
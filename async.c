@@ -24,6 +24,7 @@
 
 #include "qemu-common.h"
 #include "block/aio.h"
+#include "qemu/atomic.h"
 
 /*
  * An AsyncContext protects the callbacks of AIO requests and Bottom Halves
@@ -48,9 +49,6 @@ struct AsyncContext {
     /* Consecutive number of the AsyncContext (position in the stack) */
     int id;
 
-    /* Anchor of the list of Bottom Halves belonging to the context */
-    struct QEMUBH *first_bh;
-
     /* Link to parent context */
     struct AsyncContext *parent;
 };
@@ -115,51 +113,126 @@ int get_async_context_id(void)
 /***********************************************************/
 /* bottom halves (can be seen as timers which expire ASAP) */
 
+/*
+ * Bottom halves can be scheduled from any thread. A scheduled bottom half
+ * is pushed on bh_queue, a lock-free stack, and the main loop is woken up
+ * (qemu_notify_event() only writes once per main loop iteration). They
+ * are only taken from the stack with the global mutex held, so that
+ * qemu_bh_poll() only visits the scheduled ones. Creating, deleting and
+ * running bottom halves still needs the global mutex.
+ *
+ * |scheduled| tells whether the bottom half must run, while |queued| tells
+ * whether it is on bh_queue or in a batch being run, so that cancelling
+ * and rescheduling never adds it twice.
+ */
 struct QEMUBH {
     QEMUBHFunc *cb;
     void *opaque;
+    int ctx_id;       /* AsyncContext that runs it */
     int scheduled;
     int idle;
     int deleted;
-    QEMUBH *next;
+    int queued;
+    QEMUBH *next;         /* in bh_queue, in a batch or in bh_waiting */
+    QEMUBH *next_deleted;
 };
 
+static QEMUBH *bh_queue;
+
+/* Taken from bh_queue, but belonging to a parent AsyncContext */
+static QEMUBH *bh_waiting;
+
+/* Deleted, freed once they are not queued any more */
+static QEMUBH *bh_deleted;
+
+static int bh_poll_depth;
+
 QEMUBH *qemu_bh_new(QEMUBHFunc *cb, void *opaque)
 {
     QEMUBH *bh;
     bh = g_malloc0(sizeof(QEMUBH));
     bh->cb = cb;
     bh->opaque = opaque;
-    bh->next = async_context->first_bh;
-    async_context->first_bh = bh;
+    bh->ctx_id = async_context->id;
     return bh;
 }
 
+static void qemu_bh_enqueue(QEMUBH *bh)
+{
+    QEMUBH *head;
+
+    if (atomic_xchg(&bh->scheduled, 1))
+        return;
+    if (atomic_xchg(&bh->queued, 1))
+        return;
+    do {
+        head = atomic_read(&bh_queue);
+        bh->next = head;
+    } while (atomic_cmpxchg(&bh_queue, head, bh) != head);
+}
+
+/* Take the scheduled bottom halves, oldest first */
+static QEMUBH *qemu_bh_take(void)
+{
+    QEMUBH *bh, *next, *batch = NULL;
+
+    bh = atomic_xchg(&bh_queue, NULL);
+    for (; bh; bh = next) {
+        next = bh->next;
+        bh->next = batch;
+        batch = bh;
+    }
+    return batch;
+}
+
 int qemu_bh_poll(void)
 {
-    QEMUBH *bh, **bhp;
-    int ret;
+    QEMUBH *bh, *next, **tail, *batch;
+    int ret, ctx_id = async_context->id;
 
     ret = 0;
-    for (bh = async_context->first_bh; bh; bh = bh->next) {
-        if (!bh->deleted && bh->scheduled) {
-            bh->scheduled = 0;
-            if (!bh->idle)
-                ret = 1;
-            bh->idle = 0;
-            bh->cb(bh->opaque);
+    bh_poll_depth++;
+
+    /* the waiting ones first, they were scheduled earlier */
+    batch = bh_waiting;
+    bh_waiting = NULL;
+    for (tail = &batch; *tail; tail = &(*tail)->next)
+        ;
+    *tail = qemu_bh_take();
+
+    for (bh = batch; bh; bh = next) {
+        next = bh->next;
+        if (!bh->deleted && bh->ctx_id < ctx_id) {
+            /* still queued, it can't be scheduled twice */
+            bh->next = bh_waiting;
+            bh_waiting = bh;
+            continue;
         }
+        /* the context it was created in was left */
+        bh->ctx_id = ctx_id;
+
+        atomic_set(&bh->queued, 0);
+        smp_mb();
+        if (bh->deleted || !atomic_xchg(&bh->scheduled, 0))
+            continue;
+        if (!bh->idle)
+            ret = 1;
+        bh->idle = 0;
+        bh->cb(bh->opaque);
     }
 
-    /* remove deleted bhs */
-    bhp = &async_context->first_bh;
-    while (*bhp) {
-        bh = *bhp;
-        if (bh->deleted) {
-            *bhp = bh->next;
-            g_free(bh);
-        } else
-            bhp = &bh->next;
+    /* free deleted bhs, unless an outer call still has them in its batch */
+    if (--bh_poll_depth == 0) {
+        QEMUBH **bhp = &bh_deleted;
+
+        while (*bhp) {
+            bh = *bhp;
+            if (!atomic_read(&bh->queued)) {
+                *bhp = bh->next_deleted;
+                g_free(bh);
+            } else
+                bhp = &bh->next_deleted;
+        }
     }
 
     return ret;
@@ -167,39 +240,45 @@ int qemu_bh_poll(void)
 
 void qemu_bh_schedule_idle(QEMUBH *bh)
 {
-    if (bh->scheduled)
+    if (atomic_read(&bh->scheduled))
         return;
-    bh->scheduled = 1;
     bh->idle = 1;
+    qemu_bh_enqueue(bh);
 }
 
 void qemu_bh_schedule(QEMUBH *bh)
 {
-    if (bh->scheduled)
+    if (atomic_read(&bh->scheduled))
         return;
-    bh->scheduled = 1;
     bh->idle = 0;
-    /* stop the currently executing CPU to execute the BH ASAP */
+    qemu_bh_enqueue(bh);
+    /* wake up the main loop to execute the BH ASAP */
     qemu_notify_event();
 }
 
 void qemu_bh_cancel(QEMUBH *bh)
 {
-    bh->scheduled = 0;
+    atomic_set(&bh->scheduled, 0);
 }
 
 void qemu_bh_delete(QEMUBH *bh)
 {
-    bh->scheduled = 0;
+    if (bh->deleted)
+        return;
+    atomic_set(&bh->scheduled, 0);
     bh->deleted = 1;
+    bh->next_deleted = bh_deleted;
+    bh_deleted = bh;
 }
 
 void qemu_bh_update_timeout(int *timeout)
 {
     QEMUBH *bh;
 
-    for (bh = async_context->first_bh; bh; bh = bh->next) {
-        if (!bh->deleted && bh->scheduled) {
+    /* bh_queue only grows at its head, and is only taken by us */
+    for (bh = atomic_read(&bh_queue); bh; bh = bh->next) {
+        if (!bh->deleted && atomic_read(&bh->scheduled) &&
+            bh->ctx_id >= async_context->id) {
             if (bh->idle) {
                 /* idle bottom halves will be polled at least
                  * every 10ms */
@@ -213,4 +292,3 @@ void qemu_bh_update_timeout(int *timeout)
         }
     }
 }
-
@@ -33,6 +33,9 @@
 
 #define AUDIO_CAP "alsa"
 #include "audio_int.h"
+#include "audio_pt_int.h"
+#include "audio_ll_int.h"
+#include "qemu/atomic.h"
 #include <dlfcn.h>
 #include <pthread.h>
 #include "android/qemu-debug.h"
@@ -68,6 +71,14 @@ typedef struct ALSAVoiceOut {
     void *pcm_buf;
     snd_pcm_t *handle;
     struct pollhlp pollhlp;
+
+    /* Low latency mode, the thread owns the handle. */
+    int ll_enabled;
+    int ll_samples;
+    struct audio_ll_out ll;
+    struct audio_pt pt;
+    int ll_active;
+    int ll_done;
 } ALSAVoiceOut;
 
 typedef struct ALSAVoiceIn {
@@ -797,6 +808,10 @@ static int alsa_run_out (HWVoiceOut *hw, int live)
     int decr;
     snd_pcm_sframes_t avail;
 
+    if (alsa->ll_enabled) {
+        return audio_ll_out_run (&alsa->ll, hw, live);
+    }
+
     avail = alsa_get_avail (alsa->handle);
     if (avail < 0) {
         dolog ("Could not get number of available playback frames\n");
@@ -810,11 +825,175 @@ static int alsa_run_out (HWVoiceOut *hw, int live)
     return decr;
 }
 
+static int alsa_voice_ctl (snd_pcm_t *handle, const char *typ, int pause)
+{
+    int err;
+
+    if (pause) {
+        err = snd_pcm_drop (handle);
+        if (err < 0) {
+            alsa_logerr (err, "Could not stop %s\n", typ);
+            return -1;
+        }
+    }
+    else {
+        err = snd_pcm_prepare (handle);
+        if (err < 0) {
+            alsa_logerr (err, "Could not prepare handle for %s\n", typ);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Low latency mode: writes the frames of pcm_buf, returns -1 on failure. */
+static int alsa_ll_write (ALSAVoiceOut *alsa, int len)
+{
+    HWVoiceOut *hw = &alsa->hw;
+    char *src = alsa->pcm_buf;
+
+    while (len) {
+        snd_pcm_sframes_t written = snd_pcm_writei (alsa->handle, src, len);
+
+        if (written <= 0) {
+            switch (written) {
+            case 0:
+            case -EAGAIN:
+                return 0;
+
+            case -EPIPE:
+                if (alsa_recover (alsa->handle)) {
+                    return -1;
+                }
+                continue;
+
+            case -ESTRPIPE:
+                if (alsa_resume (alsa->handle)) {
+                    return -1;
+                }
+                continue;
+
+            default:
+                alsa_logerr (written, "Failed to write %d frames\n", len);
+                return -1;
+            }
+        }
+
+        src += written << hw->info.shift;
+        len -= written;
+    }
+    return 0;
+}
+
+/* Low latency mode: plays the voice while it is enabled, returns -1 if the
+ * device fails. */
+static int alsa_ll_play (ALSAVoiceOut *alsa)
+{
+    snd_pcm_t *handle = alsa->handle;
+
+    if (alsa_voice_ctl (handle, "playback", 0)) {
+        return -1;
+    }
+
+    while (atomic_mb_read (&alsa->ll_active) &&
+           !atomic_mb_read (&alsa->ll_done)) {
+        snd_pcm_sframes_t avail, delay;
+        int frames;
+
+        /* Wakes up every period, on timeouts as well in case of xruns. */
+        snd_pcm_wait (handle, audio_ll_conf.period_ms * 4);
+
+        avail = alsa_get_avail (handle);
+        if (avail < 0) {
+            return -1;
+        }
+        if (avail < alsa->ll.period) {
+            continue;
+        }
+
+        if (snd_pcm_delay (handle, &delay) < 0) {
+            delay = -1;
+        }
+
+        frames = audio_MIN (avail, alsa->ll_samples);
+        audio_ll_out_pull (&alsa->ll, alsa->pcm_buf, frames, delay);
+        if (alsa_ll_write (alsa, frames)) {
+            return -1;
+        }
+    }
+
+    return alsa_voice_ctl (handle, "playback", 1);
+}
+
+static void *alsa_ll_thread_out (void *arg)
+{
+    ALSAVoiceOut *alsa = arg;
+    int failed = 0;
+
+    audio_ll_set_thread_priority (AUDIO_CAP);
+
+    if (audio_pt_lock (&alsa->pt, AUDIO_FUNC)) {
+        return NULL;
+    }
+
+    for (;;) {
+        /* After a failure, waits for the voice to be enabled again. */
+        while (!alsa->ll_done && (!alsa->ll_active || failed)) {
+            if (!alsa->ll_active) {
+                failed = 0;
+            }
+            if (audio_pt_wait (&alsa->pt, AUDIO_FUNC)) {
+                goto exit;
+            }
+        }
+
+        if (alsa->ll_done) {
+            break;
+        }
+
+        if (audio_pt_unlock (&alsa->pt, AUDIO_FUNC)) {
+            return NULL;
+        }
+
+        failed = alsa_ll_play (alsa) != 0;
+
+        if (audio_pt_lock (&alsa->pt, AUDIO_FUNC)) {
+            return NULL;
+        }
+    }
+
+ exit:
+    audio_pt_unlock (&alsa->pt, AUDIO_FUNC);
+    return NULL;
+}
+
+static void alsa_ll_ctl (ALSAVoiceOut *alsa, int active)
+{
+    if (audio_pt_lock (&alsa->pt, AUDIO_FUNC)) {
+        return;
+    }
+    atomic_mb_set (&alsa->ll_active, active);
+    audio_pt_unlock_and_signal (&alsa->pt, AUDIO_FUNC);
+}
+
 static void alsa_fini_out (HWVoiceOut *hw)
 {
     ALSAVoiceOut *alsa = (ALSAVoiceOut *) hw;
 
     ldebug ("alsa_fini\n");
+    if (alsa->ll_enabled) {
+        void *ret;
+
+        if (!audio_pt_lock (&alsa->pt, AUDIO_FUNC)) {
+            atomic_mb_set (&alsa->ll_done, 1);
+            audio_pt_unlock_and_signal (&alsa->pt, AUDIO_FUNC);
+        }
+        audio_pt_join (&alsa->pt, &ret, AUDIO_FUNC);
+        audio_pt_fini (&alsa->pt, AUDIO_FUNC);
+        audio_ll_out_fini (&alsa->ll);
+        alsa->ll_enabled = 0;
+    }
     alsa_anal_close (&alsa->handle, &alsa->pollhlp);
 
     if (alsa->pcm_buf) {
@@ -846,6 +1025,15 @@ static int alsa_init_out (HWVoiceOut *hw, struct audsettings *as)
         (conf.period_size_out_overridden ? 1 : 0) |
         (conf.buffer_size_out_overridden ? 2 : 0);
 
+    /* In low latency mode, the device only holds two periods, unless its
+     * sizes are set explicitly. */
+    if (audio_ll_conf.enabled && !req.override_mask) {
+        req.size_in_usec = 1;
+        req.period_size = audio_ll_conf.period_ms * 1000;
+        req.buffer_size = 2 * req.period_size;
+        req.override_mask = 3;
+    }
+
     if (alsa_open (0, &req, &obt, &handle)) {
         goto Exit;
     }
@@ -869,6 +1057,29 @@ static int alsa_init_out (HWVoiceOut *hw, struct audsettings *as)
     alsa->handle = handle;
     result       = 0;  /* success */
 
+    if (audio_ll_conf.enabled) {
+        alsa->ll_samples = obt.samples;
+        alsa->ll_active = 0;
+        alsa->ll_done = 0;
+        if (audio_ll_out_init (&alsa->ll, hw, NULL, 0)) {
+            result = -1;
+        }
+        else if (audio_pt_init (&alsa->pt, alsa_ll_thread_out, alsa,
+                                AUDIO_CAP, AUDIO_FUNC)) {
+            audio_ll_out_fini (&alsa->ll);
+            result = -1;
+        }
+        else {
+            alsa->ll_enabled = 1;
+        }
+
+        if (result) {
+            g_free (alsa->pcm_buf);
+            alsa->pcm_buf = NULL;
+            alsa_anal_close1 (&alsa->handle);
+        }
+    }
+
 Exit:
     if (!D_ACTIVE)
         stdio_enable();
@@ -876,28 +1087,6 @@ Exit:
     return result;
 }
 
-static int alsa_voice_ctl (snd_pcm_t *handle, const char *typ, int pause)
-{
-    int err;
-
-    if (pause) {
-        err = snd_pcm_drop (handle);
-        if (err < 0) {
-            alsa_logerr (err, "Could not stop %s\n", typ);
-            return -1;
-        }
-    }
-    else {
-        err = snd_pcm_prepare (handle);
-        if (err < 0) {
-            alsa_logerr (err, "Could not prepare handle for %s\n", typ);
-            return -1;
-        }
-    }
-
-    return 0;
-}
-
 static int alsa_ctl_out (HWVoiceOut *hw, int cmd, ...)
 {
     ALSAVoiceOut *alsa = (ALSAVoiceOut *) hw;
@@ -913,6 +1102,11 @@ static int alsa_ctl_out (HWVoiceOut *hw, int cmd, ...)
             va_end (ap);
 
             ldebug ("enabling voice\n");
+            if (alsa->ll_enabled) {
+                hw->poll_mode = 0;
+                alsa_ll_ctl (alsa, 1);
+                return 0;
+            }
             if (poll_mode && alsa_poll_out (hw)) {
                 poll_mode = 0;
             }
@@ -922,6 +1116,10 @@ static int alsa_ctl_out (HWVoiceOut *hw, int cmd, ...)
 
     case VOICE_DISABLE:
         ldebug ("disabling voice\n");
+        if (alsa->ll_enabled) {
+            alsa_ll_ctl (alsa, 0);
+            return 0;
+        }
         return alsa_voice_ctl (alsa->handle, "playback", 1);
     }
 
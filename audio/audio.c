@@ -30,6 +30,9 @@
 
 #define AUDIO_CAP "audio"
 #include "audio_int.h"
+#include "audio_ll_int.h"
+#include "android/utils/mem_categories.h"
+#include "android/utils/perf_counters.h"
 #include "android/utils/system.h"
 #include "android/qemu-debug.h"
 #include "android/android.h"
@@ -1185,6 +1188,24 @@ static void audio_pcm_print_info (const char *cap, struct audio_pcm_info *info)
 }
 #endif
 
+/* The sample buffers of the voices, used by audio_template.h */
+static MemCategory audio_buffer_memory = MEM_CATEGORY_INIT("audio.buffers");
+
+static struct st_sample *audio_buffer_alloc (const char *funcname,
+                                             int samples)
+{
+    if (audio_bug (funcname, samples <= 0)) {
+        return NULL;
+    }
+    return memCategory_calloc (&audio_buffer_memory, samples,
+                               sizeof (struct st_sample));
+}
+
+static void audio_buffer_free (struct st_sample *buf)
+{
+    memCategory_free (&audio_buffer_memory, buf);
+}
+
 #define DAC
 #include "audio_template.h"
 #undef DAC
@@ -1475,6 +1496,10 @@ static void audio_capture_mix_and_clear (HWVoiceOut *hw, int rpos, int samples)
     mixeng_clear (hw->mix_buf, samples - n);
 }
 
+/* Output ticks where an enabled voice had no guest samples to play. */
+static PerfCounter audio_underruns_counter =
+    PERF_COUNTER_INIT("audio.underruns", "ticks");
+
 static void audio_run_out (AudioState *s)
 {
     HWVoiceOut *hw = NULL;
@@ -1510,14 +1535,19 @@ static void audio_run_out (AudioState *s)
         }
 
         if (!live) {
+            int starved = 0;
             for (sw = hw->sw_head.lh_first; sw; sw = sw->entries.le_next) {
                 if (sw->active) {
+                    starved = 1;
                     free = audio_get_free (sw);
                     if (free > 0) {
                         sw->callback.fn (sw->callback.opaque, free);
                     }
                 }
             }
+            if (starved) {
+                perfCounter_add (&audio_underruns_counter, 1);
+            }
             continue;
         }
 
@@ -1778,6 +1808,31 @@ static struct audio_option audio_options[] = {
         .valp  = &conf.log_to_monitor,
         .descr = "Print logging messages to monitor instead of stderr"
     },
+    /* Low latency output */
+    {
+        .name  = "LOW_LATENCY",
+        .tag   = AUD_OPT_BOOL,
+        .valp  = &audio_ll_conf.enabled,
+        .descr = "Let the backend pull the samples from its own thread"
+    },
+    {
+        .name  = "LL_BUFFER_MS",
+        .tag   = AUD_OPT_INT,
+        .valp  = &audio_ll_conf.buffer_ms,
+        .descr = "Samples queued for the backend in low latency mode, in ms"
+    },
+    {
+        .name  = "LL_PERIOD_MS",
+        .tag   = AUD_OPT_INT,
+        .valp  = &audio_ll_conf.period_ms,
+        .descr = "Backend period in low latency mode, in ms"
+    },
+    {
+        .name  = "LL_REPORT",
+        .tag   = AUD_OPT_INT,
+        .valp  = &audio_ll_conf.report_secs,
+        .descr = "Seconds between output latency reports (0 - none)"
+    },
     { /* End of list */ }
 };
 
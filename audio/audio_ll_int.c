@@ -0,0 +1,188 @@
+#include "qemu-common.h"
+#include "qemu/atomic.h"
+#include "qemu/timer.h"
+#include "audio.h"
+
+#define AUDIO_CAP "audio-ll"
+#include "audio_int.h"
+#include "audio_ll_int.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+struct audio_ll_settings audio_ll_conf = {
+    .enabled = 0,
+    .buffer_ms = 20,
+    .period_ms = 5,
+    .report_secs = 0,
+};
+
+int audio_ll_out_init (struct audio_ll_out *ll, HWVoiceOut *hw,
+                       f_sample *clip, int shift)
+{
+    int freq = hw->info.freq;
+    int period_ms = audio_MAX (audio_ll_conf.period_ms, 1);
+    int buffer_ms = audio_MAX (audio_ll_conf.buffer_ms, 2 * period_ms);
+
+    memset (ll, 0, sizeof (*ll));
+    ll->period = audio_MAX (period_ms * freq / 1000, 1);
+    ll->target = audio_MAX (buffer_ms * freq / 1000, 2 * ll->period);
+    ll->clip = clip;
+    ll->shift = clip ? shift : hw->info.shift;
+    ll->info = clip ? NULL : &hw->info;
+    ll->backend_delay = -1;
+
+    ll->size = 1;
+    while (ll->size < (unsigned int) ll->target) {
+        ll->size <<= 1;
+    }
+
+    ll->buf = audio_calloc (AUDIO_FUNC, ll->size, 1 << ll->shift);
+    if (!ll->buf) {
+        dolog ("Could not allocate ring buffer (%u frames)\n", ll->size);
+        return -1;
+    }
+
+    hw->samples = ll->target;
+    return 0;
+}
+
+void audio_ll_out_fini (struct audio_ll_out *ll)
+{
+    g_free (ll->buf);
+    ll->buf = NULL;
+}
+
+static void audio_ll_out_measure (struct audio_ll_out *ll, HWVoiceOut *hw,
+                                  int queued)
+{
+    int delay = atomic_read (&ll->backend_delay);
+    int latency_ms;
+    int64_t now;
+
+    if (!audio_ll_conf.report_secs) {
+        return;
+    }
+
+    latency_ms = (int) ((int64_t) (queued + audio_MAX (delay, 0)) * 1000 /
+                        hw->info.freq);
+    ll->latency_sum += latency_ms;
+    ll->latency_max = audio_MAX (ll->latency_max, latency_ms);
+    ll->latency_count++;
+
+    now = qemu_clock_get_ms (QEMU_CLOCK_REALTIME);
+    if (!ll->report_time) {
+        ll->report_time = now;
+    }
+    else if (now - ll->report_time >= audio_ll_conf.report_secs * 1000LL) {
+        unsigned int underruns = atomic_read (&ll->underruns);
+
+        dolog ("output latency %d ms average, %d ms max%s, %u underruns\n",
+               (int) (ll->latency_sum / ll->latency_count), ll->latency_max,
+               delay < 0 ? " (without the backend)" : "",
+               underruns - ll->reported_underruns);
+        ll->reported_underruns = underruns;
+        ll->report_time = now;
+        ll->latency_sum = 0;
+        ll->latency_max = 0;
+        ll->latency_count = 0;
+    }
+}
+
+int audio_ll_out_run (struct audio_ll_out *ll, HWVoiceOut *hw, int live)
+{
+    f_sample *clip = ll->clip ? ll->clip : hw->clip;
+    unsigned int wpos = ll->wpos;
+    int fill = wpos - atomic_mb_read (&ll->rpos);
+    int decr = audio_MIN (live, audio_MAX (ll->target - fill, 0));
+    int left = decr;
+
+    while (left) {
+        int pos = wpos & (ll->size - 1);
+        int chunk = audio_MIN (left, (int) ll->size - pos);
+
+        chunk = audio_MIN (chunk, hw->samples - hw->rpos);
+        clip (ll->buf + (pos << ll->shift), hw->mix_buf + hw->rpos, chunk);
+
+        hw->rpos = (hw->rpos + chunk) % hw->samples;
+        wpos += chunk;
+        left -= chunk;
+    }
+
+    /* Publish the frames once they are in the ring. */
+    smp_wmb ();
+    atomic_set (&ll->wpos, wpos);
+
+    audio_ll_out_measure (ll, hw, live + fill);
+    return decr;
+}
+
+int audio_ll_out_pull (struct audio_ll_out *ll, void *buf, int frames,
+                       int delay)
+{
+    unsigned int rpos = ll->rpos;
+    int avail = atomic_read (&ll->wpos) - rpos;
+    int taken = audio_MIN (frames, avail);
+    uint8_t *dst = buf;
+    int left = taken;
+
+    /* Read the frames only once they are published. */
+    smp_rmb ();
+    while (left) {
+        int pos = rpos & (ll->size - 1);
+        int chunk = audio_MIN (left, (int) ll->size - pos);
+
+        memcpy (dst, ll->buf + (pos << ll->shift), chunk << ll->shift);
+        dst += chunk << ll->shift;
+        rpos += chunk;
+        left -= chunk;
+    }
+
+    /* And let the timer overwrite them once they are copied. */
+    atomic_mb_set (&ll->rpos, rpos);
+
+    if (taken < frames) {
+        if (ll->info) {
+            audio_pcm_info_clear_buf (ll->info, dst, frames - taken);
+        }
+        else {
+            memset (dst, 0, (frames - taken) << ll->shift);
+        }
+        /* The end of a stream counts as well. */
+        if (ll->running) {
+            atomic_inc (&ll->underruns);
+        }
+    }
+    ll->running = taken == frames;
+
+    if (delay >= 0) {
+        atomic_set (&ll->backend_delay, delay);
+    }
+    return taken;
+}
+
+void audio_ll_set_thread_priority (const char *cap)
+{
+#ifdef _WIN32
+    if (!SetThreadPriority (GetCurrentThread (),
+                            THREAD_PRIORITY_TIME_CRITICAL)) {
+        ldebug ("Could not raise the priority of the %s thread\n", cap);
+    }
+#else
+    struct sched_param param;
+    int err;
+
+    memset (&param, 0, sizeof (param));
+    param.sched_priority = sched_get_priority_min (SCHED_FIFO);
+    err = pthread_setschedparam (pthread_self (), SCHED_FIFO, &param);
+    if (err) {
+        /* Most hosts only allow it to privileged users. */
+        ldebug ("Could not make the %s thread real-time\nReason: %s\n",
+                cap, strerror (err));
+    }
+#endif
+}
@@ -0,0 +1,89 @@
+#ifndef QEMU_AUDIO_LL_INT_H
+#define QEMU_AUDIO_LL_INT_H
+
+/*
+ * Low latency output mode.
+ *
+ * Instead of being pushed to the backend from the audio timer, the mixed
+ * samples of a voice are clipped by the timer into a lock-free ring, that a
+ * callback of the backend pulls them from, on a thread that doesn't depend
+ * on the main loop: a real-time priority thread of the backend, or the one
+ * of the audio server. The ring and the buffer of the voice only hold a few
+ * milliseconds of samples, so that they bound the latency, and the callback
+ * plays silence when the ring runs dry.
+ *
+ * The ring has a single producer, the audio timer, and a single consumer,
+ * the callback. Each side only writes its own position.
+ */
+
+/* Settings of the low latency mode, set with the QEMU_AUDIO_LOW_LATENCY,
+ * QEMU_AUDIO_LL_BUFFER_MS, QEMU_AUDIO_LL_PERIOD_MS and QEMU_AUDIO_LL_REPORT
+ * environment variables. */
+struct audio_ll_settings {
+    int enabled;
+    /* Samples kept in the ring, in milliseconds. */
+    int buffer_ms;
+    /* Samples pulled by each call of the callback, in milliseconds. */
+    int period_ms;
+    /* Seconds between two latency reports, 0 for none. */
+    int report_secs;
+};
+
+extern struct audio_ll_settings audio_ll_conf;
+
+struct audio_ll_out {
+    uint8_t *buf;
+    /* Size of the ring in frames, a power of 2. */
+    unsigned int size;
+    /* Frames the timer keeps in the ring. */
+    int target;
+    /* Frames pulled by each call of the callback. */
+    int period;
+    /* Frame size of the ring, log2. */
+    int shift;
+    f_sample *clip;
+    /* Format of the frames of the ring for silence, NULL for zeroes. */
+    struct audio_pcm_info *info;
+
+    /* Free running frame counters, written by the timer and the callback,
+     * respectively. */
+    unsigned int wpos;
+    unsigned int rpos;
+
+    /* Written by the callback. */
+    unsigned int underruns;
+    int backend_delay;
+    int running;
+
+    /* Latency measurements of the timer since the last report. */
+    int64_t report_time;
+    int64_t latency_sum;
+    int latency_max;
+    int latency_count;
+    unsigned int reported_underruns;
+};
+
+/* Initializes the low latency mode of an output voice, once its info is
+ * set, and sets hw->samples. 'clip' converts the mixed samples into the
+ * frames of the ring, of 1 << shift bytes and with zeroes as silence, or is
+ * NULL for the frames of the voice, converted with hw->clip. */
+int audio_ll_out_init (struct audio_ll_out *ll, HWVoiceOut *hw,
+                       f_sample *clip, int shift);
+void audio_ll_out_fini (struct audio_ll_out *ll);
+
+/* Clips the mixed samples of the voice into the ring, from the run_out
+ * callback of the backend. Returns the number of samples played. */
+int audio_ll_out_run (struct audio_ll_out *ll, HWVoiceOut *hw, int live);
+
+/* Pulls frames out of the ring, from the callback of the backend, and
+ * completes them with silence. 'delay' is the number of frames queued in the
+ * backend, for the latency reports, or -1 if unknown. Returns the number of
+ * frames taken from the ring. */
+int audio_ll_out_pull (struct audio_ll_out *ll, void *buf, int frames,
+                       int delay);
+
+/* Raises the priority of the calling thread, the thread of the backend
+ * running the callback, to real-time if the host allows it. */
+void audio_ll_set_thread_priority (const char *cap);
+
+#endif /* audio_ll_int.h */
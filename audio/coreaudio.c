@@ -32,6 +32,7 @@
 
 #define AUDIO_CAP "coreaudio"
 #include "audio_int.h"
+#include "audio_ll_int.h"
 
 #if 0
 #  define  D(...)  fprintf(stderr, __VA_ARGS__)
@@ -457,9 +458,44 @@ coreaudio_voice_init (coreaudioVoice*    core,
 typedef struct coreaudioVoiceOut {
     HWVoiceOut                   hw;
     coreaudioVoice               core[1];
+    /* Low latency mode, the callback pulls float frames from the ring
+     * instead of locking the voice. */
+    int                          ll_enabled;
+    struct audio_ll_out          ll;
 } coreaudioVoiceOut;
 
 #define  CORE_OUT(hw)  ((coreaudioVoiceOut*)(hw))->core
+#define  LL_OUT(hw)    ((coreaudioVoiceOut*)(hw))
+
+/* converts mixed samples to the float stereo frames of the device */
+static void coreaudio_clip_float (void *dst, const struct st_sample *src,
+                                  int samples)
+{
+    float *out = dst;
+    int frame;
+#ifndef FLOAT_MIXENG
+#ifdef RECIPROCAL
+    const float scale = 1.f / UINT_MAX;
+#else
+    const float scale = UINT_MAX;
+#endif
+#endif
+
+    for (frame = 0; frame < samples; frame++) {
+#ifdef FLOAT_MIXENG
+        *out++ = src[frame].l; /* left channel */
+        *out++ = src[frame].r; /* right channel */
+#else
+#ifdef RECIPROCAL
+        *out++ = src[frame].l * scale; /* left channel */
+        *out++ = src[frame].r * scale; /* right channel */
+#else
+        *out++ = src[frame].l / scale; /* left channel */
+        *out++ = src[frame].r / scale; /* right channel */
+#endif
+#endif
+    }
+}
 
 
 static int coreaudio_run_out (HWVoiceOut *hw, int live)
@@ -467,6 +503,10 @@ static int coreaudio_run_out (HWVoiceOut *hw, int live)
     int decr;
     coreaudioVoice *core = CORE_OUT(hw);
 
+    if (LL_OUT(hw)->ll_enabled) {
+        return audio_ll_out_run (&LL_OUT(hw)->ll, hw, live);
+    }
+
     if (coreaudio_voice_lock (core, "coreaudio_run_out")) {
         return 0;
     }
@@ -498,19 +538,19 @@ static OSStatus audioOutDeviceIOProc(
     const AudioTimeStamp* inOutputTime,
     void* hwptr)
 {
-    UInt32 frame, frameCount;
+    UInt32 frameCount;
     float *out = outOutputData->mBuffers[0].mData;
     HWVoiceOut *hw = hwptr;
     coreaudioVoice *core = CORE_OUT(hw);
     int rpos, live;
     struct st_sample *src;
-#ifndef FLOAT_MIXENG
-#ifdef RECIPROCAL
-    const float scale = 1.f / UINT_MAX;
-#else
-    const float scale = UINT_MAX;
-#endif
-#endif
+
+    if (LL_OUT(hw)->ll_enabled) {
+        int frames = outOutputData->mBuffers[0].mDataByteSize >> 3;
+
+        audio_ll_out_pull (&LL_OUT(hw)->ll, out, frames, core->bufferFrameSize);
+        return 0;
+    }
 
     if (coreaudio_voice_lock (core, "audioDeviceIOProc")) {
         inInputTime = 0;
@@ -531,20 +571,7 @@ static OSStatus audioOutDeviceIOProc(
     src = hw->mix_buf + rpos;
 
     /* fill buffer */
-    for (frame = 0; frame < frameCount; frame++) {
-#ifdef FLOAT_MIXENG
-        *out++ = src[frame].l; /* left channel */
-        *out++ = src[frame].r; /* right channel */
-#else
-#ifdef RECIPROCAL
-        *out++ = src[frame].l * scale; /* left channel */
-        *out++ = src[frame].r * scale; /* right channel */
-#else
-        *out++ = src[frame].l / scale; /* left channel */
-        *out++ = src[frame].r / scale; /* right channel */
-#endif
-#endif
-    }
+    coreaudio_clip_float (out, src, frameCount);
 
     rpos = (rpos + frameCount) % hw->samples;
     core->decr += frameCount;
@@ -562,15 +589,33 @@ static int coreaudio_write (SWVoiceOut *sw, void *buf, int len)
 static int coreaudio_init_out (HWVoiceOut *hw, struct audsettings *as)
 {
     coreaudioVoice*  core = CORE_OUT(hw);
+    int frameSize = conf.out_buffer_frames;
     int err;
 
     audio_pcm_init_info (&hw->info, as);
 
-    err = coreaudio_voice_init (core, as, conf.out_buffer_frames, audioOutDeviceIOProc, hw, 0);
-    if (err < 0)
+    /* the callback may run as soon as the voice is initialized */
+    if (audio_ll_conf.enabled) {
+        if (audio_ll_out_init (&LL_OUT(hw)->ll, hw, coreaudio_clip_float,
+                               3 /* float stereo */) < 0) {
+            return -1;
+        }
+        LL_OUT(hw)->ll_enabled = 1;
+        frameSize = audio_MAX (audio_ll_conf.period_ms * as->freq / 1000, 1);
+    }
+
+    err = coreaudio_voice_init (core, as, frameSize, audioOutDeviceIOProc, hw, 0);
+    if (err < 0) {
+        if (LL_OUT(hw)->ll_enabled) {
+            LL_OUT(hw)->ll_enabled = 0;
+            audio_ll_out_fini (&LL_OUT(hw)->ll);
+        }
         return err;
+    }
 
-    hw->samples = core->bufferFrameSize * conf.out_nbuffers;
+    if (!LL_OUT(hw)->ll_enabled) {
+        hw->samples = core->bufferFrameSize * conf.out_nbuffers;
+    }
     return 0;
 }
 
@@ -579,6 +624,11 @@ static void coreaudio_fini_out (HWVoiceOut *hw)
     coreaudioVoice *core = CORE_OUT(hw);
 
     coreaudio_voice_fini (core);
+
+    if (LL_OUT(hw)->ll_enabled) {
+        LL_OUT(hw)->ll_enabled = 0;
+        audio_ll_out_fini (&LL_OUT(hw)->ll);
+    }
 }
 
 static int
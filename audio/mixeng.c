@@ -143,6 +143,220 @@
 #undef IN_T
 #undef SHIFT
 
+/*
+ * SSE2 versions of the conversions of signed 16 bit samples in host byte
+ * order, the format nearly all guests and backends use. They produce the
+ * same samples as the template ones, which handle the remaining samples.
+ */
+#if defined(__SSE2__) && !defined(CONFIG_MIXEMU)
+#ifdef FLOAT_MIXENG
+
+/* Converts 8 samples into floats. */
+static inline void conv_s16x8_sse2 (float *out, __m128i v)
+{
+#ifdef RECIPROCAL
+    const __m128 scale = _mm_set1_ps (1.f / (mixeng_real) (SHRT_MAX - SHRT_MIN));
+#define SCALE_S16(x) _mm_mul_ps (x, scale)
+#else
+    const __m128 scale = _mm_set1_ps ((mixeng_real) SHRT_MAX -
+                                      (mixeng_real) SHRT_MIN);
+#define SCALE_S16(x) _mm_div_ps (x, scale)
+#endif
+    /* Sign extended to 32 bit. */
+    __m128i lo = _mm_srai_epi32 (_mm_unpacklo_epi16 (v, v), 16);
+    __m128i hi = _mm_srai_epi32 (_mm_unpackhi_epi16 (v, v), 16);
+
+    _mm_storeu_ps (out, SCALE_S16 (_mm_cvtepi32_ps (lo)));
+    _mm_storeu_ps (out + 4, SCALE_S16 (_mm_cvtepi32_ps (hi)));
+#undef SCALE_S16
+}
+
+/* Clips 4 floats into 32 bit values in the range of 16 bit samples. */
+static inline __m128i clip_s16x4_sse2 (__m128 v)
+{
+    const __m128i high = _mm_castps_si128 (_mm_cmpge_ps (v, _mm_set1_ps (0.5)));
+    const __m128i low = _mm_castps_si128 (_mm_cmplt_ps (v, _mm_set1_ps (-0.5)));
+    __m128i r = _mm_cvttps_epi32 (
+        _mm_mul_ps (v, _mm_set1_ps ((mixeng_real) (SHRT_MAX - SHRT_MIN))));
+
+    r = _mm_or_si128 (_mm_andnot_si128 (high, r),
+                      _mm_and_si128 (high, _mm_set1_epi32 (SHRT_MAX)));
+    return _mm_or_si128 (_mm_andnot_si128 (low, r),
+                         _mm_and_si128 (low, _mm_set1_epi32 (SHRT_MIN)));
+}
+
+static void conv_natural_int16_t_to_stereo_sse2
+    (struct st_sample *dst, const void *src, int samples, struct mixeng_volume *vol)
+{
+    const int16_t *in = src;
+    int i;
+
+    for (i = 0; i + 4 <= samples; i += 4) {
+        conv_s16x8_sse2 (&dst[i].l,
+                         _mm_loadu_si128 ((const __m128i *) (in + i * 2)));
+    }
+    conv_natural_int16_t_to_stereo (dst + i, in + i * 2, samples - i, vol);
+}
+
+static void conv_natural_int16_t_to_mono_sse2
+    (struct st_sample *dst, const void *src, int samples, struct mixeng_volume *vol)
+{
+    const int16_t *in = src;
+    int i;
+
+    for (i = 0; i + 4 <= samples; i += 4) {
+        __m128i v = _mm_loadl_epi64 ((const __m128i *) (in + i));
+        conv_s16x8_sse2 (&dst[i].l, _mm_unpacklo_epi16 (v, v));
+    }
+    conv_natural_int16_t_to_mono (dst + i, in + i, samples - i, vol);
+}
+
+static void clip_natural_int16_t_from_stereo_sse2
+    (void *dst, const struct st_sample *src, int samples)
+{
+    int16_t *out = dst;
+    int i;
+
+    for (i = 0; i + 4 <= samples; i += 4) {
+        __m128i lo = clip_s16x4_sse2 (_mm_loadu_ps (&src[i].l));
+        __m128i hi = clip_s16x4_sse2 (_mm_loadu_ps (&src[i + 2].l));
+        _mm_storeu_si128 ((__m128i *) (out + i * 2), _mm_packs_epi32 (lo, hi));
+    }
+    clip_natural_int16_t_from_stereo (out + i * 2, src + i, samples - i);
+}
+
+static void clip_natural_int16_t_from_mono_sse2
+    (void *dst, const struct st_sample *src, int samples)
+{
+    int16_t *out = dst;
+    int i;
+
+    for (i = 0; i + 4 <= samples; i += 4) {
+        __m128 v0 = _mm_loadu_ps (&src[i].l);
+        __m128 v1 = _mm_loadu_ps (&src[i + 2].l);
+        __m128 sum = _mm_add_ps (_mm_shuffle_ps (v0, v1, _MM_SHUFFLE (2, 0, 2, 0)),
+                                 _mm_shuffle_ps (v0, v1, _MM_SHUFFLE (3, 1, 3, 1)));
+        __m128i r = clip_s16x4_sse2 (sum);
+        _mm_storel_epi64 ((__m128i *) (out + i), _mm_packs_epi32 (r, r));
+    }
+    clip_natural_int16_t_from_mono (out + i, src + i, samples - i);
+}
+
+#else  /* !FLOAT_MIXENG */
+
+/* Converts 8 samples into 64 bit values. */
+static inline void conv_s16x8_sse2 (int64_t *out, __m128i v)
+{
+    /* The samples shifted left by 16 bits, then sign extended to 64 bit. */
+    const __m128i lo = _mm_unpacklo_epi16 (_mm_setzero_si128 (), v);
+    const __m128i hi = _mm_unpackhi_epi16 (_mm_setzero_si128 (), v);
+    const __m128i lo_sign = _mm_srai_epi32 (lo, 31);
+    const __m128i hi_sign = _mm_srai_epi32 (hi, 31);
+
+    _mm_storeu_si128 ((__m128i *) out, _mm_unpacklo_epi32 (lo, lo_sign));
+    _mm_storeu_si128 ((__m128i *) (out + 2), _mm_unpackhi_epi32 (lo, lo_sign));
+    _mm_storeu_si128 ((__m128i *) (out + 4), _mm_unpacklo_epi32 (hi, hi_sign));
+    _mm_storeu_si128 ((__m128i *) (out + 6), _mm_unpackhi_epi32 (hi, hi_sign));
+}
+
+/* Clips 4 64 bit values, 2 in each argument, into 32 bit values in the range
+ * of 16 bit samples, as clip_natural_int16_t does. */
+static inline __m128i clip_s16x4_sse2 (__m128i a, __m128i b)
+{
+    /* Low and high halves of the values. */
+    const __m128i a_split = _mm_shuffle_epi32 (a, _MM_SHUFFLE (3, 1, 2, 0));
+    const __m128i b_split = _mm_shuffle_epi32 (b, _MM_SHUFFLE (3, 1, 2, 0));
+    const __m128i lo = _mm_unpacklo_epi64 (a_split, b_split);
+    const __m128i hi = _mm_unpackhi_epi64 (a_split, b_split);
+    /* Saturate the values that don't fit in 32 bit. */
+    const __m128i fits = _mm_cmpeq_epi32 (hi, _mm_srai_epi32 (lo, 31));
+    const __m128i sat = _mm_xor_si128 (_mm_srai_epi32 (hi, 31),
+                                       _mm_set1_epi32 (INT32_MAX));
+    const __m128i v = _mm_or_si128 (_mm_and_si128 (fits, lo),
+                                    _mm_andnot_si128 (fits, sat));
+    /* Values from 0x7f000000 are clipped to SHRT_MAX. */
+    const __m128i high = _mm_cmpgt_epi32 (v, _mm_set1_epi32 (0x7effffff));
+
+    return _mm_or_si128 (_mm_srai_epi32 (v, 16),
+                         _mm_and_si128 (high, _mm_set1_epi32 (SHRT_MAX)));
+}
+
+static void conv_natural_int16_t_to_stereo_sse2
+    (struct st_sample *dst, const void *src, int samples, struct mixeng_volume *vol)
+{
+    const int16_t *in = src;
+    int i;
+
+    for (i = 0; i + 4 <= samples; i += 4) {
+        conv_s16x8_sse2 (&dst[i].l,
+                         _mm_loadu_si128 ((const __m128i *) (in + i * 2)));
+    }
+    conv_natural_int16_t_to_stereo (dst + i, in + i * 2, samples - i, vol);
+}
+
+static void conv_natural_int16_t_to_mono_sse2
+    (struct st_sample *dst, const void *src, int samples, struct mixeng_volume *vol)
+{
+    const int16_t *in = src;
+    int i;
+
+    for (i = 0; i + 4 <= samples; i += 4) {
+        __m128i v = _mm_loadl_epi64 ((const __m128i *) (in + i));
+        conv_s16x8_sse2 (&dst[i].l, _mm_unpacklo_epi16 (v, v));
+    }
+    conv_natural_int16_t_to_mono (dst + i, in + i, samples - i, vol);
+}
+
+static void clip_natural_int16_t_from_stereo_sse2
+    (void *dst, const struct st_sample *src, int samples)
+{
+    const __m128i *in = (const __m128i *) src;
+    int16_t *out = dst;
+    int i;
+
+    for (i = 0; i + 4 <= samples; i += 4) {
+        __m128i lo = clip_s16x4_sse2 (_mm_loadu_si128 (in + i),
+                                      _mm_loadu_si128 (in + i + 1));
+        __m128i hi = clip_s16x4_sse2 (_mm_loadu_si128 (in + i + 2),
+                                      _mm_loadu_si128 (in + i + 3));
+        _mm_storeu_si128 ((__m128i *) (out + i * 2), _mm_packs_epi32 (lo, hi));
+    }
+    clip_natural_int16_t_from_stereo (out + i * 2, src + i, samples - i);
+}
+
+static void clip_natural_int16_t_from_mono_sse2
+    (void *dst, const struct st_sample *src, int samples)
+{
+    const __m128i *in = (const __m128i *) src;
+    int16_t *out = dst;
+    int i;
+
+    for (i = 0; i + 4 <= samples; i += 4) {
+        __m128i s0 = _mm_loadu_si128 (in + i);
+        __m128i s1 = _mm_loadu_si128 (in + i + 1);
+        __m128i s2 = _mm_loadu_si128 (in + i + 2);
+        __m128i s3 = _mm_loadu_si128 (in + i + 3);
+        __m128i r = clip_s16x4_sse2 (
+            _mm_add_epi64 (_mm_unpacklo_epi64 (s0, s1), _mm_unpackhi_epi64 (s0, s1)),
+            _mm_add_epi64 (_mm_unpacklo_epi64 (s2, s3), _mm_unpackhi_epi64 (s2, s3)));
+        _mm_storel_epi64 ((__m128i *) (out + i), _mm_packs_epi32 (r, r));
+    }
+    clip_natural_int16_t_from_mono (out + i, src + i, samples - i);
+}
+
+#endif  /* !FLOAT_MIXENG */
+
+#define CONV_S16_TO_MONO    conv_natural_int16_t_to_mono_sse2
+#define CONV_S16_TO_STEREO  conv_natural_int16_t_to_stereo_sse2
+#define CLIP_S16_FROM_MONO  clip_natural_int16_t_from_mono_sse2
+#define CLIP_S16_FROM_STEREO clip_natural_int16_t_from_stereo_sse2
+#else
+#define CONV_S16_TO_MONO    conv_natural_int16_t_to_mono
+#define CONV_S16_TO_STEREO  conv_natural_int16_t_to_stereo
+#define CLIP_S16_FROM_MONO  clip_natural_int16_t_from_mono
+#define CLIP_S16_FROM_STEREO clip_natural_int16_t_from_stereo
+#endif
+
 t_sample *mixeng_conv[2][2][2][3] = {
     {
         {
@@ -160,7 +374,7 @@ t_sample *mixeng_conv[2][2][2][3] = {
         {
             {
                 conv_natural_int8_t_to_mono,
-                conv_natural_int16_t_to_mono,
+                CONV_S16_TO_MONO,
                 conv_natural_int32_t_to_mono
             },
             {
@@ -186,7 +400,7 @@ t_sample *mixeng_conv[2][2][2][3] = {
         {
             {
                 conv_natural_int8_t_to_stereo,
-                conv_natural_int16_t_to_stereo,
+                CONV_S16_TO_STEREO,
                 conv_natural_int32_t_to_stereo
             },
             {
@@ -215,7 +429,7 @@ f_sample *mixeng_clip[2][2][2][3] = {
         {
             {
                 clip_natural_int8_t_from_mono,
-                clip_natural_int16_t_from_mono,
+                CLIP_S16_FROM_MONO,
                 clip_natural_int32_t_from_mono
             },
             {
@@ -241,7 +455,7 @@ f_sample *mixeng_clip[2][2][2][3] = {
         {
             {
                 clip_natural_int8_t_from_stereo,
-                clip_natural_int16_t_from_stereo,
+                CLIP_S16_FROM_STEREO,
                 clip_natural_int32_t_from_stereo
             },
             {
@@ -316,12 +530,36 @@ void *st_rate_start (int inrate, int outrate)
     return rate;
 }
 
+/* Adds n samples of src to dst. */
+static void mixeng_mix (struct st_sample *dst, const struct st_sample *src, int n)
+{
+    int i = 0;
+#if defined(__SSE2__) && defined(FLOAT_MIXENG)
+    for (; i + 2 <= n; i += 2) {
+        _mm_storeu_ps (&dst[i].l, _mm_add_ps (_mm_loadu_ps (&dst[i].l),
+                                              _mm_loadu_ps (&src[i].l)));
+    }
+#elif defined(__SSE2__)
+    for (; i < n; i++) {
+        __m128i *d = (__m128i *) (dst + i);
+        _mm_storeu_si128 (d, _mm_add_epi64 (_mm_loadu_si128 (d),
+                          _mm_loadu_si128 ((const __m128i *) (src + i))));
+    }
+#endif
+    for (; i < n; i++) {
+        dst[i].l += src[i].l;
+        dst[i].r += src[i].r;
+    }
+}
+
 #define NAME st_rate_flow_mix
 #define OP(a, b) a += b
+#define OP_BLOCK(dst, src, n) mixeng_mix (dst, src, n)
 #include "rate_template.h"
 
 #define NAME st_rate_flow
 #define OP(a, b) a = b
+#define OP_BLOCK(dst, src, n) memcpy (dst, src, (n) * sizeof (struct st_sample))
 #include "rate_template.h"
 
 void st_rate_stop (void *opaque)
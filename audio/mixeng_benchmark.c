@@ -0,0 +1,172 @@
+/*
+ * QEMU Mixing engine micro-benchmark
+ *
+ * Copyright (c) 2015 The Android Open Source Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Feeds synthetic PCM through the mixing engine, the way audio.c does: the
+ * samples of a voice are converted, resampled and mixed into the buffer of
+ * the backend, that is then clipped into the backend format. For each
+ * format, reports the time per frame of each step, for 1 second of audio.
+ *
+ * Usage: emulator_mixeng_benchmark [<iterations>]
+ */
+
+#include "qemu-common.h"
+#include "audio.h"
+
+#define AUDIO_CAP "mixeng_benchmark"
+#include "audio_int.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+/* mixeng.c only needs these from audio.c. */
+void *audio_calloc (const char *funcname, int nmemb, size_t size)
+{
+    return g_malloc0 (nmemb * size);
+}
+
+void AUD_log (const char *cap, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start (ap, fmt);
+    if (cap) {
+        fprintf (stderr, "%s: ", cap);
+    }
+    vfprintf (stderr, fmt, ap);
+    va_end (ap);
+}
+
+static double now_us (void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency (&freq);
+    QueryPerformanceCounter (&now);
+    return (double) now.QuadPart * 1e6 / (double) freq.QuadPart;
+#else
+    struct timeval tv;
+    gettimeofday (&tv, NULL);
+    return tv.tv_sec * 1e6 + tv.tv_usec;
+#endif
+}
+
+enum {
+    VOICE_FREQ = 44100,
+    HW_FREQ = 48000,
+    /* Frames of the backend buffer for 1 second of audio. */
+    HW_FRAMES = HW_FREQ,
+};
+
+static const char *bits_names[3] = { "8", "16", "32" };
+
+int main (int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi (argv[1]) : 50;
+    struct mixeng_volume vol;
+    struct st_sample *voice = g_malloc0 (VOICE_FREQ * sizeof (*voice));
+    struct st_sample *mix = g_malloc0 (HW_FRAMES * sizeof (*mix));
+    /* Room for 1 second of 32 bit stereo frames. */
+    uint8_t *pcm = g_malloc (HW_FRAMES * 8);
+    uint8_t *out = g_malloc (HW_FRAMES * 8);
+    int stereo, sign, swap, bits, n, it;
+
+    vol.mute = 0;
+#ifdef FLOAT_MIXENG
+    vol.l = vol.r = 1.0;
+#else
+    vol.l = vol.r = 1ULL << 32;
+#endif
+    if (iterations <= 0) {
+        iterations = 1;
+    }
+    /* A 1 kHz square wave with some noise, in any format. */
+    for (n = 0; n < HW_FRAMES * 8; n++) {
+        pcm[n] = ((n / 44) & 1 ? 0xc0 : 0x40) ^ (n * 31 & 7);
+    }
+
+    printf ("%-24s %10s %10s %10s %10s\n", "format (ns/frame)",
+            "conv", "resample", "mix", "clip");
+    for (stereo = 0; stereo < 2; stereo++) {
+        for (sign = 0; sign < 2; sign++) {
+            for (bits = 0; bits < 3; bits++) {
+                for (swap = 0; swap < 2; swap++) {
+                    t_sample *conv = mixeng_conv[stereo][sign][swap][bits];
+                    f_sample *clip = mixeng_clip[stereo][sign][swap][bits];
+                    double conv_us = 0, rate_us = 0, mix_us = 0, clip_us = 0;
+                    char name[32];
+
+                    if (bits == 0 && swap) {
+                        continue;
+                    }
+                    for (it = 0; it < iterations; it++) {
+                        void *rate = st_rate_start (VOICE_FREQ, HW_FREQ);
+                        void *same = st_rate_start (HW_FREQ, HW_FREQ);
+                        int isamp = VOICE_FREQ, osamp = HW_FRAMES;
+                        double t0, t1, t2, t3, t4;
+
+                        t0 = now_us ();
+                        conv (voice, pcm, VOICE_FREQ, &vol);
+                        t1 = now_us ();
+                        mixeng_clear (mix, HW_FRAMES);
+                        st_rate_flow_mix (rate, voice, mix, &isamp, &osamp);
+                        t2 = now_us ();
+                        /* A second voice, at the backend rate. */
+                        isamp = VOICE_FREQ;
+                        osamp = HW_FRAMES;
+                        st_rate_flow_mix (same, voice, mix, &isamp, &osamp);
+                        t3 = now_us ();
+                        clip (out, mix, HW_FRAMES);
+                        t4 = now_us ();
+
+                        conv_us += t1 - t0;
+                        rate_us += t2 - t1;
+                        mix_us += t3 - t2;
+                        clip_us += t4 - t3;
+                        st_rate_stop (rate);
+                        st_rate_stop (same);
+                    }
+                    snprintf (name, sizeof (name), "%s%s%s %s",
+                              sign ? "s" : "u", bits_names[bits],
+                              bits == 0 ? "" : (swap ? "-swap" : "-host"),
+                              stereo ? "stereo" : "mono");
+                    printf ("%-24s %10.2f %10.2f %10.2f %10.2f\n", name,
+                            conv_us * 1e3 / iterations / VOICE_FREQ,
+                            rate_us * 1e3 / iterations / VOICE_FREQ,
+                            mix_us * 1e3 / iterations / VOICE_FREQ,
+                            clip_us * 1e3 / iterations / HW_FRAMES);
+                }
+            }
+        }
+    }
+
+    g_free (out);
+    g_free (pcm);
+    g_free (mix);
+    g_free (voice);
+    return 0;
+}
@@ -8,6 +8,7 @@
 #define AUDIO_CAP "pulseaudio"
 #include "audio_int.h"
 #include "audio_pt_int.h"
+#include "audio_ll_int.h"
 
 typedef struct {
     HWVoiceOut hw;
@@ -18,6 +19,9 @@ typedef struct {
     pa_stream *stream;
     void *pcm_buf;
     struct audio_pt pt;
+    int ll_enabled;
+    int ll_priority_set;
+    struct audio_ll_out ll;
 } PAVoiceOut;
 
 typedef struct {
@@ -266,6 +270,10 @@ static int qpa_run_out (HWVoiceOut *hw, int live)
     int decr;
     PAVoiceOut *pa = (PAVoiceOut *) hw;
 
+    if (pa->ll_enabled) {
+        return audio_ll_out_run (&pa->ll, hw, live);
+    }
+
     if (audio_pt_lock (&pa->pt, AUDIO_FUNC)) {
         return 0;
     }
@@ -473,6 +481,38 @@ static void stream_request_cb (pa_stream *s, size_t length, void *userdata)
     pa_threaded_mainloop_signal (g->mainloop, 0);
 }
 
+/* Low latency mode: called by the thread of the mainloop whenever the
+ * server can take more samples. */
+static void qpa_ll_request_out (pa_stream *s, size_t length, void *userdata)
+{
+    PAVoiceOut *pa = userdata;
+    HWVoiceOut *hw = &pa->hw;
+    int frames = length >> hw->info.shift;
+    int delay = -1;
+    pa_usec_t usec;
+    int negative;
+
+    if (!pa->ll_priority_set) {
+        audio_ll_set_thread_priority (AUDIO_CAP);
+        pa->ll_priority_set = 1;
+    }
+
+    if (pa_stream_get_latency (s, &usec, &negative) == 0) {
+        delay = negative ? 0 : (int) (usec * hw->info.freq / 1000000);
+    }
+
+    while (frames > 0) {
+        int chunk = audio_MIN (frames, hw->samples);
+
+        audio_ll_out_pull (&pa->ll, pa->pcm_buf, chunk, delay);
+        if (pa_stream_write (s, pa->pcm_buf, chunk << hw->info.shift, NULL,
+                             0LL, PA_SEEK_RELATIVE) < 0) {
+            break;
+        }
+        frames -= chunk;
+    }
+}
+
 static pa_stream *qpa_simple_new (
         const char *server,
         const char *name,
@@ -482,6 +522,8 @@ static pa_stream *qpa_simple_new (
         const pa_sample_spec *ss,
         const pa_channel_map *map,
         const pa_buffer_attr *attr,
+        pa_stream_request_cb_t request_cb,
+        void *userdata,
         int *rerror)
 {
     paaudio *g = &glob_paaudio;
@@ -496,8 +538,8 @@ static pa_stream *qpa_simple_new (
     }
 
     pa_stream_set_state_callback (stream, stream_state_cb, g);
-    pa_stream_set_read_callback (stream, stream_request_cb, g);
-    pa_stream_set_write_callback (stream, stream_request_cb, g);
+    pa_stream_set_read_callback (stream, request_cb, userdata);
+    pa_stream_set_write_callback (stream, request_cb, userdata);
 
     if (dir == PA_STREAM_PLAYBACK) {
         r = pa_stream_connect_playback (stream, dev, attr,
@@ -535,6 +577,66 @@ fail:
     return NULL;
 }
 
+static int qpa_init_out_ll (PAVoiceOut *pa, pa_sample_spec *ss,
+                            struct audsettings *obt_as)
+{
+    HWVoiceOut *hw = &pa->hw;
+    pa_buffer_attr ba;
+    int error;
+
+    audio_pcm_init_info (&hw->info, obt_as);
+    if (audio_ll_out_init (&pa->ll, hw, NULL, 0)) {
+        return -1;
+    }
+
+    pa->pcm_buf = audio_calloc (AUDIO_FUNC, hw->samples, 1 << hw->info.shift);
+    if (!pa->pcm_buf) {
+        dolog ("Could not allocate buffer (%d bytes)\n",
+               hw->samples << hw->info.shift);
+        goto fail1;
+    }
+
+    /*
+     * The server keeps two periods of samples, and asks for another one each
+     * time it plays one: that's enough since the callback doesn't wait for
+     * the main loop.
+     */
+    ba.tlength = pa_usec_to_bytes (2 * audio_ll_conf.period_ms * 1000, ss);
+    ba.minreq = pa_usec_to_bytes (audio_ll_conf.period_ms * 1000, ss);
+    ba.maxlength = -1;
+    ba.prebuf = -1;
+    ba.fragsize = -1;
+
+    pa->ll_enabled = 1;
+    pa->stream = qpa_simple_new (
+        glob_paaudio.server,
+        "qemu",
+        PA_STREAM_PLAYBACK,
+        glob_paaudio.sink,
+        "pcm.playback",
+        ss,
+        NULL,                   /* channel map */
+        &ba,                    /* buffering attributes */
+        qpa_ll_request_out,
+        pa,
+        &error
+        );
+    if (!pa->stream) {
+        qpa_logerr (error, "pa_simple_new for playback failed\n");
+        goto fail2;
+    }
+
+    return 0;
+
+ fail2:
+    pa->ll_enabled = 0;
+    g_free (pa->pcm_buf);
+    pa->pcm_buf = NULL;
+ fail1:
+    audio_ll_out_fini (&pa->ll);
+    return -1;
+}
+
 static int qpa_init_out (HWVoiceOut *hw, struct audsettings *as)
 {
     int error;
@@ -558,6 +660,10 @@ static int qpa_init_out (HWVoiceOut *hw, struct audsettings *as)
 
     obt_as.fmt = pa_to_audfmt (ss.format, &obt_as.endianness);
 
+    if (audio_ll_conf.enabled) {
+        return qpa_init_out_ll (pa, &ss, &obt_as);
+    }
+
     pa->stream = qpa_simple_new (
         glob_paaudio.server,
         "qemu",
@@ -567,6 +673,8 @@ static int qpa_init_out (HWVoiceOut *hw, struct audsettings *as)
         &ss,
         NULL,                   /* channel map */
         &ba,                    /* buffering attributes */
+        stream_request_cb,
+        &glob_paaudio,
         &error
         );
     if (!pa->stream) {
@@ -624,6 +732,8 @@ static int qpa_init_in (HWVoiceIn *hw, struct audsettings *as)
         &ss,
         NULL,                   /* channel map */
         NULL,                   /* buffering attributes */
+        stream_request_cb,
+        &glob_paaudio,
         &error
         );
     if (!pa->stream) {
@@ -664,6 +774,22 @@ static void qpa_fini_out (HWVoiceOut *hw)
     void *ret;
     PAVoiceOut *pa = (PAVoiceOut *) hw;
 
+    if (pa->ll_enabled) {
+        paaudio *g = &glob_paaudio;
+
+        pa_threaded_mainloop_lock (g->mainloop);
+        pa_stream_set_write_callback (pa->stream, NULL, NULL);
+        pa_threaded_mainloop_unlock (g->mainloop);
+
+        pa_stream_unref (pa->stream);
+        pa->stream = NULL;
+        audio_ll_out_fini (&pa->ll);
+        g_free (pa->pcm_buf);
+        pa->pcm_buf = NULL;
+        pa->ll_enabled = 0;
+        return;
+    }
+
     audio_pt_lock (&pa->pt, AUDIO_FUNC);
     pa->done = 1;
     audio_pt_unlock_and_signal (&pa->pt, AUDIO_FUNC);
@@ -34,6 +34,8 @@ void NAME (void *opaque, struct st_sample *ibuf, struct st_sample *obuf,
     struct st_sample *istart, *iend;
     struct st_sample *ostart, *oend;
     struct st_sample ilast, icur, out;
+    uint64_t opos, opos_inc;
+    uint32_t ipos;
 #ifdef FLOAT_MIXENG
     mixeng_real t;
 #else
@@ -49,16 +51,19 @@ void NAME (void *opaque, struct st_sample *ibuf, struct st_sample *obuf,
     oend = obuf + *osamp;
 
     if (rate->opos_inc == (1ULL + UINT_MAX)) {
-        int i, n = *isamp > *osamp ? *osamp : *isamp;
-        for (i = 0; i < n; i++) {
-            OP (obuf[i].l, ibuf[i].l);
-            OP (obuf[i].r, ibuf[i].r);
-        }
+        int n = *isamp > *osamp ? *osamp : *isamp;
+        OP_BLOCK (obuf, ibuf, n);
         *isamp = n;
         *osamp = n;
         return;
     }
 
+    /* Keep the state in locals: with -fno-strict-aliasing, the compiler
+     * would reload it after each store to obuf otherwise. */
+    opos = rate->opos;
+    opos_inc = rate->opos_inc;
+    ipos = rate->ipos;
+
     while (obuf < oend) {
 
         /* Safety catch to make sure we have input samples.  */
@@ -68,9 +73,9 @@ void NAME (void *opaque, struct st_sample *ibuf, struct st_sample *obuf,
 
         /* read as many input samples so that ipos > opos */
 
-        while (rate->ipos <= (rate->opos >> 32)) {
+        while (ipos <= (opos >> 32)) {
             ilast = *ibuf++;
-            rate->ipos++;
+            ipos++;
             /* See if we finished the input buffer yet */
             if (ibuf >= iend) {
                 goto the_end;
@@ -82,14 +87,14 @@ void NAME (void *opaque, struct st_sample *ibuf, struct st_sample *obuf,
         /* interpolate */
 #ifdef FLOAT_MIXENG
 #ifdef RECIPROCAL
-        t = (rate->opos & UINT_MAX) * (1.f / UINT_MAX);
+        t = (opos & UINT_MAX) * (1.f / UINT_MAX);
 #else
-        t = (rate->opos & UINT_MAX) / (mixeng_real) UINT_MAX;
+        t = (opos & UINT_MAX) / (mixeng_real) UINT_MAX;
 #endif
         out.l = (ilast.l * (1.0 - t)) + icur.l * t;
         out.r = (ilast.r * (1.0 - t)) + icur.r * t;
 #else
-        t = rate->opos & 0xffffffff;
+        t = opos & 0xffffffff;
         out.l = (ilast.l * ((int64_t) UINT_MAX - t) + icur.l * t) >> 32;
         out.r = (ilast.r * ((int64_t) UINT_MAX - t) + icur.r * t) >> 32;
 #endif
@@ -98,14 +103,17 @@ void NAME (void *opaque, struct st_sample *ibuf, struct st_sample *obuf,
         OP (obuf->l, out.l);
         OP (obuf->r, out.r);
         obuf += 1;
-        rate->opos += rate->opos_inc;
+        opos += opos_inc;
     }
 
 the_end:
     *isamp = ibuf - istart;
     *osamp = obuf - ostart;
+    rate->opos = opos;
+    rate->ipos = ipos;
     rate->ilast = ilast;
 }
 
 #undef NAME
 #undef OP
+#undef OP_BLOCK
@@ -1,7 +1,27 @@
 #include <stdio.h>
 #include "monitor/monitor.h"
+#include "qemu/thread.h"
 #include "audio.h"
 
+/*
+ * The capture callback runs in the mixer, so it never touches the file:
+ * it only copies the samples into a ring of a fixed size, that a thread
+ * writes to the file, compressing them if asked to. If the disk falls
+ * behind by more than the ring holds, the samples that don't fit are
+ * dropped, and counted, rather than stalling the audio.
+ */
+
+/* Seconds of captured audio that the ring holds. */
+#define WAV_RING_SECONDS 2
+
+/* Bytes per channel of an IMA ADPCM block, of 1017 frames. */
+#define WAV_ADPCM_BLOCK 512
+
+typedef struct {
+    int pred;
+    int index;
+} ADPCMChannel;
+
 typedef struct {
     FILE *f;
     int bytes;
@@ -10,6 +30,30 @@ typedef struct {
     int bits;
     int nchannels;
     CaptureVoiceOut *cap;
+
+    /* Written by the capture callback and the writer thread, under the
+     * lock: a ring of 'size' bytes, a power of 2, with free running
+     * positions. */
+    uint8_t *buf;
+    unsigned int size;
+    unsigned int wpos;
+    unsigned int rpos;
+    int dropped;
+    int error;
+    int exit;
+    QemuMutex lock;
+    QemuCond cond;
+    QemuThread thread;
+
+    /* IMA ADPCM state of the writer thread. */
+    int adpcm;
+    int block_frames;
+    int block_align;
+    int16_t *block;
+    int block_len;
+    uint8_t *packed;
+    ADPCMChannel chan[2];
+    uint32_t frames;
 } WAVState;
 
 /* VICE code: Store number as little endian. */
@@ -22,6 +66,152 @@ static void le_store (uint8_t *buf, uint32_t val, int len)
     }
 }
 
+static const int adpcm_index_table[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8,
+    -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+static const int adpcm_step_table[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+    19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+    130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+    5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static int adpcm_encode_sample (ADPCMChannel *c, int sample)
+{
+    int step = adpcm_step_table[c->index];
+    int diff = sample - c->pred;
+    int vpdiff = step >> 3;
+    int nibble = 0;
+
+    if (diff < 0) {
+        nibble = 8;
+        diff = -diff;
+    }
+    if (diff >= step) {
+        nibble |= 4;
+        diff -= step;
+        vpdiff += step;
+    }
+    step >>= 1;
+    if (diff >= step) {
+        nibble |= 2;
+        diff -= step;
+        vpdiff += step;
+    }
+    step >>= 1;
+    if (diff >= step) {
+        nibble |= 1;
+        vpdiff += step;
+    }
+
+    c->pred += (nibble & 8) ? -vpdiff : vpdiff;
+    c->pred = audio_MIN (audio_MAX (c->pred, -32768), 32767);
+    c->index = audio_MIN (audio_MAX (c->index + adpcm_index_table[nibble], 0),
+                          88);
+    return nibble;
+}
+
+/* Encodes a block in the Microsoft IMA ADPCM layout: a header per
+ * channel with its first sample, then groups of 8 samples of each
+ * channel in turn, 2 per byte. */
+static void adpcm_encode_block (WAVState *wav)
+{
+    int nch = wav->nchannels;
+    uint8_t *out = wav->packed;
+    int ch, n, k;
+
+    for (ch = 0; ch < nch; ch++) {
+        ADPCMChannel *c = &wav->chan[ch];
+
+        c->pred = wav->block[ch];
+        le_store (out, (uint16_t) c->pred, 2);
+        out[2] = c->index;
+        out[3] = 0;
+        out += 4;
+    }
+
+    for (n = 1; n < wav->block_frames; n += 8) {
+        for (ch = 0; ch < nch; ch++) {
+            for (k = 0; k < 8; k += 2) {
+                int lo = adpcm_encode_sample (&wav->chan[ch],
+                                              wav->block[(n + k) * nch + ch]);
+                int hi = adpcm_encode_sample (&wav->chan[ch],
+                                              wav->block[(n + k + 1) * nch + ch]);
+                *out++ = lo | (hi << 4);
+            }
+        }
+    }
+}
+
+/* Runs in the writer thread, returns the number of bytes written. */
+static int wav_write (WAVState *wav, const uint8_t *buf, int size)
+{
+    int frame = wav->nchannels * 2;
+    int written = 0;
+
+    if (!wav->adpcm) {
+        return fwrite (buf, 1, size, wav->f);
+    }
+
+    while (size >= frame) {
+        int len = audio_MIN (size / frame, wav->block_frames - wav->block_len);
+
+        memcpy (wav->block + wav->block_len * wav->nchannels, buf, len * frame);
+        wav->block_len += len;
+        wav->frames += len;
+        buf += len * frame;
+        size -= len * frame;
+
+        if (wav->block_len == wav->block_frames) {
+            adpcm_encode_block (wav);
+            written += fwrite (wav->packed, 1, wav->block_align, wav->f);
+            wav->block_len = 0;
+        }
+    }
+    return written;
+}
+
+static void *wav_writer_thread (void *opaque)
+{
+    WAVState *wav = opaque;
+
+    qemu_mutex_lock (&wav->lock);
+    for (;;) {
+        unsigned int rpos = wav->rpos;
+        unsigned int pos = rpos & (wav->size - 1);
+        int len = wav->wpos - rpos;
+        int written;
+
+        if (!len) {
+            if (wav->exit) {
+                break;
+            }
+            qemu_cond_wait (&wav->cond, &wav->lock);
+            continue;
+        }
+        qemu_mutex_unlock (&wav->lock);
+
+        len = audio_MIN (len, (int) (wav->size - pos));
+        written = wav->error ? 0 : wav_write (wav, wav->buf + pos, len);
+
+        qemu_mutex_lock (&wav->lock);
+        if (!wav->error && ferror (wav->f)) {
+            wav->error = errno ? errno : EIO;
+        }
+        wav->rpos = rpos + len;
+        wav->bytes += written;
+    }
+    qemu_mutex_unlock (&wav->lock);
+    return NULL;
+}
+
 static void wav_notify (void *opaque, audcnotification_e cmd)
 {
     (void) opaque;
@@ -33,30 +223,91 @@ static void wav_destroy (void *opaque)
     WAVState *wav = opaque;
     uint8_t rlen[4];
     uint8_t dlen[4];
-    uint32_t datalen = wav->bytes;
-    uint32_t rifflen = datalen + 36;
+    uint32_t datalen;
+    uint32_t rifflen;
+
+    qemu_mutex_lock (&wav->lock);
+    wav->exit = 1;
+    qemu_cond_signal (&wav->cond);
+    qemu_mutex_unlock (&wav->lock);
+    qemu_thread_join (&wav->thread);
 
     if (wav->f) {
-        le_store (rlen, rifflen, 4);
-        le_store (dlen, datalen, 4);
+        if (wav->adpcm) {
+            uint8_t fact[4];
+
+            /* Pad the last block with silence. */
+            if (wav->block_len) {
+                memset (wav->block + wav->block_len * wav->nchannels, 0,
+                        (wav->block_frames - wav->block_len) *
+                        wav->nchannels * 2);
+                adpcm_encode_block (wav);
+                wav->bytes += fwrite (wav->packed, 1, wav->block_align,
+                                      wav->f);
+            }
+            datalen = wav->bytes;
+            rifflen = datalen + 52;
+            le_store (rlen, rifflen, 4);
+            le_store (fact, wav->frames, 4);
+            le_store (dlen, datalen, 4);
+
+            fseek (wav->f, 4, SEEK_SET);
+            fwrite(rlen, 4, 1, wav->f);
+
+            fseek (wav->f, 48, SEEK_SET);
+            fwrite(fact, 4, 1, wav->f);
+
+            fseek (wav->f, 56, SEEK_SET);
+            fwrite(dlen, 4, 1, wav->f);
+        }
+        else {
+            datalen = wav->bytes;
+            rifflen = datalen + 36;
+            le_store (rlen, rifflen, 4);
+            le_store (dlen, datalen, 4);
 
-        fseek (wav->f, 4, SEEK_SET);
-        fwrite(rlen, 4, 1, wav->f);
+            fseek (wav->f, 4, SEEK_SET);
+            fwrite(rlen, 4, 1, wav->f);
 
-        fseek (wav->f, 32, SEEK_CUR);
-        fwrite(dlen, 4, 1, wav->f);
+            fseek (wav->f, 32, SEEK_CUR);
+            fwrite(dlen, 4, 1, wav->f);
+        }
         fclose (wav->f);
     }
 
+    qemu_cond_destroy (&wav->cond);
+    qemu_mutex_destroy (&wav->lock);
+    g_free (wav->packed);
+    g_free (wav->block);
+    g_free (wav->buf);
     g_free (wav->path);
 }
 
 static void wav_capture (void *opaque, void *buf, int size)
 {
     WAVState *wav = opaque;
+    unsigned int wpos = wav->wpos;
+    unsigned int pos = wpos & (wav->size - 1);
+    int avail, chunk;
 
-    fwrite(buf, size, 1, wav->f);
-    wav->bytes += size;
+    qemu_mutex_lock (&wav->lock);
+    avail = wav->size - (wpos - wav->rpos);
+    qemu_mutex_unlock (&wav->lock);
+
+    if (size > avail) {
+        wav->dropped += size - avail;
+        size = avail;
+    }
+
+    /* The writer doesn't look at the free part of the ring. */
+    chunk = audio_MIN (size, (int) (wav->size - pos));
+    memcpy (wav->buf + pos, buf, chunk);
+    memcpy (wav->buf, (uint8_t *) buf + chunk, size - chunk);
+
+    qemu_mutex_lock (&wav->lock);
+    wav->wpos = wpos + size;
+    qemu_cond_signal (&wav->cond);
+    qemu_mutex_unlock (&wav->lock);
 }
 
 static void wav_capture_destroy (void *opaque)
@@ -70,10 +321,23 @@ static void wav_capture_info (void *opaque)
 {
     WAVState *wav = opaque;
     char *path = wav->path;
+    int bytes, error;
+
+    qemu_mutex_lock (&wav->lock);
+    bytes = wav->bytes;
+    error = wav->error;
+    qemu_mutex_unlock (&wav->lock);
 
     monitor_printf(cur_mon, "Capturing audio(%d,%d,%d) to %s: %d bytes\n",
                    wav->freq, wav->bits, wav->nchannels,
-                   path ? path : "<not available>", wav->bytes);
+                   path ? path : "<not available>", bytes);
+    if (wav->dropped) {
+        monitor_printf(cur_mon, "%d bytes dropped, the disk is too slow\n",
+                       wav->dropped);
+    }
+    if (error) {
+        monitor_printf(cur_mon, "Failed to write: %s\n", strerror (error));
+    }
 }
 
 static struct capture_ops wav_capture_ops = {
@@ -81,6 +345,8 @@ static struct capture_ops wav_capture_ops = {
     .info = wav_capture_info
 };
 
+/* 'bits' is 8 or 16 for PCM, or 4 for IMA ADPCM, which compresses 16
+ * bit samples 4 to 1. */
 int wav_start_capture (CaptureState *s, const char *path, int freq,
                        int bits, int nchannels)
 {
@@ -92,13 +358,25 @@ int wav_start_capture (CaptureState *s, const char *path, int freq,
         0x02, 0x00, 0x44, 0xac, 0x00, 0x00, 0x10, 0xb1, 0x02, 0x00, 0x04,
         0x00, 0x10, 0x00, 0x64, 0x61, 0x74, 0x61, 0x00, 0x00, 0x00, 0x00
     };
+    /* The same, with a larger fmt chunk and a fact chunk for the number
+     * of frames. */
+    uint8_t adpcm_hdr[] = {
+        0x52, 0x49, 0x46, 0x46, 0x00, 0x00, 0x00, 0x00, 0x57, 0x41, 0x56,
+        0x45, 0x66, 0x6d, 0x74, 0x20, 0x14, 0x00, 0x00, 0x00, 0x11, 0x00,
+        0x02, 0x00, 0x44, 0xac, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x04, 0x04, 0x00, 0x02, 0x00, 0x00, 0x00, 0x66, 0x61, 0x63, 0x74,
+        0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x64, 0x61, 0x74,
+        0x61, 0x00, 0x00, 0x00, 0x00
+    };
     struct audsettings as;
     struct audio_capture_ops ops;
-    int stereo, bits16, shift;
+    int stereo, bits16, shift, adpcm;
+    unsigned int ring;
     CaptureVoiceOut *cap;
 
-    if (bits != 8 && bits != 16) {
-        monitor_printf(mon, "incorrect bit count %d, must be 8 or 16\n", bits);
+    if (bits != 4 && bits != 8 && bits != 16) {
+        monitor_printf(mon, "incorrect bit count %d, must be 4, 8 or 16\n",
+                       bits);
         return -1;
     }
 
@@ -109,12 +387,14 @@ int wav_start_capture (CaptureState *s, const char *path, int freq,
     }
 
     stereo = nchannels == 2;
-    bits16 = bits == 16;
+    adpcm = bits == 4;
+    bits16 = bits == 16 || adpcm;
 
     as.freq = freq;
     as.nchannels = 1 << stereo;
     as.fmt = bits16 ? AUD_FMT_S16 : AUD_FMT_U8;
-    as.endianness = 0;
+    /* The encoder takes native samples. */
+    as.endianness = adpcm ? AUDIO_HOST_ENDIANNESS : 0;
 
     ops.notify = wav_notify;
     ops.capture = wav_capture;
@@ -123,17 +403,35 @@ int wav_start_capture (CaptureState *s, const char *path, int freq,
     wav = g_malloc0 (sizeof (*wav));
 
     shift = bits16 + stereo;
-    hdr[34] = bits16 ? 0x10 : 0x08;
+    if (adpcm) {
+        wav->adpcm = 1;
+        wav->block_align = WAV_ADPCM_BLOCK * nchannels;
+        wav->block_frames = (WAV_ADPCM_BLOCK - 4) * 2 + 1;
+        wav->block = g_malloc (wav->block_frames * nchannels * 2);
+        wav->packed = g_malloc (wav->block_align);
 
-    le_store (hdr + 22, as.nchannels, 2);
-    le_store (hdr + 24, freq, 4);
-    le_store (hdr + 28, freq << shift, 4);
-    le_store (hdr + 32, 1 << shift, 2);
+        le_store (adpcm_hdr + 22, as.nchannels, 2);
+        le_store (adpcm_hdr + 24, freq, 4);
+        le_store (adpcm_hdr + 28, (uint64_t) freq * wav->block_align /
+                  wav->block_frames, 4);
+        le_store (adpcm_hdr + 32, wav->block_align, 2);
+        le_store (adpcm_hdr + 38, wav->block_frames, 2);
+    }
+    else {
+        hdr[34] = bits16 ? 0x10 : 0x08;
+
+        le_store (hdr + 22, as.nchannels, 2);
+        le_store (hdr + 24, freq, 4);
+        le_store (hdr + 28, freq << shift, 4);
+        le_store (hdr + 32, 1 << shift, 2);
+    }
 
     wav->f = fopen (path, "wb");
     if (!wav->f) {
         monitor_printf(mon, "Failed to open wave file `%s'\nReason: %s\n",
                        path, strerror (errno));
+        g_free (wav->packed);
+        g_free (wav->block);
         g_free (wav);
         return -1;
     }
@@ -143,13 +441,28 @@ int wav_start_capture (CaptureState *s, const char *path, int freq,
     wav->nchannels = nchannels;
     wav->freq = freq;
 
-    fwrite(hdr, sizeof(hdr), 1, wav->f);
+    if (adpcm) {
+        fwrite(adpcm_hdr, sizeof(adpcm_hdr), 1, wav->f);
+    }
+    else {
+        fwrite(hdr, sizeof(hdr), 1, wav->f);
+    }
+
+    ring = ((unsigned int) freq << shift) * WAV_RING_SECONDS;
+    wav->size = 1;
+    while (wav->size < ring) {
+        wav->size <<= 1;
+    }
+    wav->buf = g_malloc (wav->size);
+    qemu_mutex_init (&wav->lock);
+    qemu_cond_init (&wav->cond);
+    qemu_thread_create (&wav->thread, wav_writer_thread, wav,
+                        QEMU_THREAD_JOINABLE);
 
     cap = AUD_add_capture (&as, &ops, wav);
     if (!cap) {
         monitor_printf(mon, "Failed to add audio capture\n");
-        g_free (wav->path);
-        fclose (wav->f);
+        wav_destroy (wav);
         g_free (wav);
         return -1;
     }
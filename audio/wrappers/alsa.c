@@ -10,6 +10,7 @@
 
 static snd_pcm_sframes_t (*__dll_snd_pcm_avail_update)(snd_pcm_t * pcm) = 0;
 static int (*__dll_snd_pcm_close)(snd_pcm_t * pcm) = 0;
+static int (*__dll_snd_pcm_delay)(snd_pcm_t * pcm, snd_pcm_sframes_t * delayp) = 0;
 static int (*__dll_snd_pcm_drop)(snd_pcm_t * pcm) = 0;
 static int (*__dll_snd_pcm_hw_params)(snd_pcm_t * pcm, snd_pcm_hw_params_t * params) = 0;
 static int (*__dll_snd_pcm_hw_params_any)(snd_pcm_t * pcm, snd_pcm_hw_params_t * params) = 0;
@@ -36,6 +37,7 @@ static int (*__dll_snd_pcm_sw_params)(snd_pcm_t * pcm, snd_pcm_sw_params_t * par
 static int (*__dll_snd_pcm_sw_params_current)(snd_pcm_t * pcm, snd_pcm_sw_params_t * params) = 0;
 static int (*__dll_snd_pcm_sw_params_set_start_threshold)(snd_pcm_t * pcm, snd_pcm_sw_params_t * params, snd_pcm_uframes_t val) = 0;
 static size_t (*__dll_snd_pcm_sw_params_sizeof)() = 0;
+static int (*__dll_snd_pcm_wait)(snd_pcm_t * pcm, int timeout) = 0;
 static snd_pcm_sframes_t (*__dll_snd_pcm_writei)(snd_pcm_t * pcm, const void * buffer, snd_pcm_uframes_t size) = 0;
 static const char * (*__dll_snd_strerror)(int errnum) = 0;
 
@@ -51,6 +53,10 @@ int snd_pcm_close(snd_pcm_t * pcm) {
   return __dll_snd_pcm_close(pcm);
 }
 
+int snd_pcm_delay(snd_pcm_t * pcm, snd_pcm_sframes_t * delayp) {
+  return __dll_snd_pcm_delay(pcm, delayp);
+}
+
 int snd_pcm_drop(snd_pcm_t * pcm) {
   return __dll_snd_pcm_drop(pcm);
 }
@@ -155,6 +161,10 @@ size_t snd_pcm_sw_params_sizeof() {
   return __dll_snd_pcm_sw_params_sizeof();
 }
 
+int snd_pcm_wait(snd_pcm_t * pcm, int timeout) {
+  return __dll_snd_pcm_wait(pcm, timeout);
+}
+
 snd_pcm_sframes_t snd_pcm_writei(snd_pcm_t * pcm, const void * buffer, snd_pcm_uframes_t size) {
   return __dll_snd_pcm_writei(pcm, buffer, size);
 }
@@ -173,6 +183,8 @@ int alsa_dynlink_init(void* lib) {
   if (!__dll_snd_pcm_avail_update) return -1;
   __dll_snd_pcm_close = (int(*)(snd_pcm_t * pcm))dlsym(lib, "snd_pcm_close");
   if (!__dll_snd_pcm_close) return -1;
+  __dll_snd_pcm_delay = (int(*)(snd_pcm_t * pcm, snd_pcm_sframes_t * delayp))dlsym(lib, "snd_pcm_delay");
+  if (!__dll_snd_pcm_delay) return -1;
   __dll_snd_pcm_drop = (int(*)(snd_pcm_t * pcm))dlsym(lib, "snd_pcm_drop");
   if (!__dll_snd_pcm_drop) return -1;
   __dll_snd_pcm_hw_params = (int(*)(snd_pcm_t * pcm, snd_pcm_hw_params_t * params))dlsym(lib, "snd_pcm_hw_params");
@@ -225,6 +237,8 @@ int alsa_dynlink_init(void* lib) {
   if (!__dll_snd_pcm_sw_params_set_start_threshold) return -1;
   __dll_snd_pcm_sw_params_sizeof = (size_t(*)())dlsym(lib, "snd_pcm_sw_params_sizeof");
   if (!__dll_snd_pcm_sw_params_sizeof) return -1;
+  __dll_snd_pcm_wait = (int(*)(snd_pcm_t * pcm, int timeout))dlsym(lib, "snd_pcm_wait");
+  if (!__dll_snd_pcm_wait) return -1;
   __dll_snd_pcm_writei = (snd_pcm_sframes_t(*)(snd_pcm_t * pcm, const void * buffer, snd_pcm_uframes_t size))dlsym(lib, "snd_pcm_writei");
   if (!__dll_snd_pcm_writei) return -1;
   __dll_snd_strerror = (const char *(*)(int errnum))dlsym(lib, "snd_strerror");
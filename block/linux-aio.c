@@ -0,0 +1,370 @@
+/*
+ * Linux native AIO support.
+ *
+ * Copyright (C) 2009 IBM, Corp.
+ * Copyright (C) 2009 Red Hat, Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include "qemu-common.h"
+#include "qemu/queue.h"
+#include "block/aio.h"
+#include "block/block_int.h"
+#include "block/raw-posix-aio.h"
+
+#include <linux/aio_abi.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/*
+ * Queue size (per-device).
+ *
+ * XXX: eventually we need to communicate this to the guest and/or make it
+ *      tunable by the guest.  If we get more outstanding requests at a time
+ *      than this we will get EAGAIN from io_submit which is communicated to
+ *      the guest as an I/O error.
+ */
+#define MAX_EVENTS 128
+
+/*
+ * Requests are not submitted one by one, but queued and submitted together
+ * from a bottom half, so that all the requests started by a single guest
+ * notification go to the kernel in one io_submit() call.
+ */
+#define MAX_BATCH 32
+
+struct qemu_laiocb {
+    BlockDriverAIOCB common;
+    struct qemu_laio_state *ctx;
+    struct iocb iocb;
+    ssize_t ret;
+    size_t nbytes;
+    int async_context_id;
+    int queued;
+    QTAILQ_ENTRY(qemu_laiocb) node;
+};
+
+struct qemu_laio_state {
+    aio_context_t ctx;
+    int efd;
+    int count;      /* requests submitted to the kernel */
+    int nb_queued;  /* requests waiting for io_submit() */
+    QEMUBH *submit_bh;
+    QTAILQ_HEAD(, qemu_laiocb) queued_reqs;
+    QTAILQ_HEAD(, qemu_laiocb) completed_reqs;
+};
+
+/* The kernel interface, there is no libaio in the build */
+static int io_setup(unsigned nr_events, aio_context_t *ctx)
+{
+    return syscall(SYS_io_setup, nr_events, ctx) < 0 ? -errno : 0;
+}
+
+static int io_submit(aio_context_t ctx, long nr, struct iocb **iocbs)
+{
+    long ret = syscall(SYS_io_submit, ctx, nr, iocbs);
+    return ret < 0 ? -errno : (int)ret;
+}
+
+static int io_getevents(aio_context_t ctx, long min_nr, long nr,
+                        struct io_event *events, struct timespec *timeout)
+{
+    long ret = syscall(SYS_io_getevents, ctx, min_nr, nr, events, timeout);
+    return ret < 0 ? -errno : (int)ret;
+}
+
+static int io_cancel(aio_context_t ctx, struct iocb *iocb,
+                     struct io_event *result)
+{
+    return syscall(SYS_io_cancel, ctx, iocb, result) < 0 ? -errno : 0;
+}
+
+/*
+ * Completes an AIO request (calls the callback and frees the ACB).
+ * Be sure to be in the right AsyncContext before calling this function.
+ */
+static void qemu_laio_process_completion(struct qemu_laio_state *s,
+    struct qemu_laiocb *laiocb)
+{
+    ssize_t ret;
+
+    ret = laiocb->ret;
+    if (ret != -ECANCELED) {
+        if (ret == (ssize_t)laiocb->nbytes)
+            ret = 0;
+        else if (ret >= 0)
+            ret = -EINVAL;
+
+        laiocb->common.cb(laiocb->common.opaque, ret);
+    }
+
+    qemu_aio_release(laiocb);
+}
+
+/*
+ * Processes all queued AIO requests, i.e. requests that have return from OS
+ * but their callback was not called yet. Requests that cannot have their
+ * callback called in the current AsyncContext, remain in the queue.
+ *
+ * Returns 1 if at least one request could be completed, 0 otherwise.
+ */
+static int qemu_laio_process_requests(void *opaque)
+{
+    struct qemu_laio_state *s = opaque;
+    struct qemu_laiocb *laiocb, *next;
+    int res = 0;
+
+    QTAILQ_FOREACH_SAFE (laiocb, &s->completed_reqs, node, next) {
+        if (laiocb->async_context_id == get_async_context_id()) {
+            QTAILQ_REMOVE(&s->completed_reqs, laiocb, node);
+            qemu_laio_process_completion(s, laiocb);
+            res = 1;
+        }
+    }
+
+    return res;
+}
+
+/*
+ * Puts a request in the completion queue so that its callback is called the
+ * next time when it's possible. If we already are in the right AsyncContext,
+ * the request is completed immediately instead.
+ */
+static void qemu_laio_enqueue_completed(struct qemu_laio_state *s,
+    struct qemu_laiocb* laiocb)
+{
+    if (laiocb->async_context_id == get_async_context_id()) {
+        qemu_laio_process_completion(s, laiocb);
+    } else {
+        QTAILQ_INSERT_TAIL(&s->completed_reqs, laiocb, node);
+    }
+}
+
+/*
+ * Hands the queued requests to the kernel, as many as fit in the ring.
+ * A request that is refused for another reason than a full ring is
+ * completed with the error.
+ */
+static void qemu_laio_submit_queued(struct qemu_laio_state *s)
+{
+    struct iocb *iocbs[MAX_BATCH];
+    struct qemu_laiocb *laiocb;
+    int nr, i, ret;
+
+    while (s->nb_queued > 0 && s->count < MAX_EVENTS) {
+        nr = 0;
+        QTAILQ_FOREACH(laiocb, &s->queued_reqs, node) {
+            if (nr == MAX_BATCH || s->count + nr == MAX_EVENTS)
+                break;
+            iocbs[nr++] = &laiocb->iocb;
+        }
+
+        ret = io_submit(s->ctx, nr, iocbs);
+        if (ret == -EAGAIN && s->count > 0) {
+            /* retried when the next request completes */
+            return;
+        }
+        if (ret == -EINTR) {
+            continue;
+        }
+
+        if (ret < 0) {
+            /* fail the first request, the kernel didn't take any */
+            laiocb = QTAILQ_FIRST(&s->queued_reqs);
+            QTAILQ_REMOVE(&s->queued_reqs, laiocb, node);
+            laiocb->queued = 0;
+            s->nb_queued--;
+            laiocb->ret = ret;
+            qemu_laio_enqueue_completed(s, laiocb);
+            continue;
+        }
+
+        for (i = 0; i < ret; i++) {
+            laiocb = QTAILQ_FIRST(&s->queued_reqs);
+            QTAILQ_REMOVE(&s->queued_reqs, laiocb, node);
+            laiocb->queued = 0;
+            s->nb_queued--;
+            s->count++;
+        }
+    }
+}
+
+static void qemu_laio_submit_bh(void *opaque)
+{
+    qemu_laio_submit_queued(opaque);
+}
+
+static void qemu_laio_completion_cb(void *opaque)
+{
+    struct qemu_laio_state *s = opaque;
+
+    while (1) {
+        struct io_event events[MAX_EVENTS];
+        uint64_t val;
+        ssize_t ret;
+        struct timespec ts = { 0 };
+        int nevents, i;
+
+        do {
+            ret = read(s->efd, &val, sizeof(val));
+        } while (ret == -1 && errno == EINTR);
+
+        if (ret == -1 && errno == EAGAIN)
+            break;
+
+        if (ret != 8)
+            break;
+
+        do {
+            nevents = io_getevents(s->ctx, val, MAX_EVENTS, events, &ts);
+        } while (nevents == -EINTR);
+
+        for (i = 0; i < nevents; i++) {
+            struct iocb *iocb = (struct iocb *)(uintptr_t)events[i].obj;
+            struct qemu_laiocb *laiocb =
+                    container_of(iocb, struct qemu_laiocb, iocb);
+
+            s->count--;
+            laiocb->ret = events[i].res;
+            qemu_laio_enqueue_completed(s, laiocb);
+        }
+    }
+
+    /* there is room in the ring again */
+    qemu_laio_submit_queued(s);
+}
+
+static int qemu_laio_flush_cb(void *opaque)
+{
+    struct qemu_laio_state *s = opaque;
+
+    return (s->count > 0 || s->nb_queued > 0) ? 1 : 0;
+}
+
+static void laio_cancel(BlockDriverAIOCB *blockacb)
+{
+    struct qemu_laiocb *laiocb = (struct qemu_laiocb *)blockacb;
+    struct qemu_laio_state *s = laiocb->ctx;
+    struct io_event event;
+    int ret;
+
+    if (laiocb->queued) {
+        /* not submitted yet */
+        QTAILQ_REMOVE(&s->queued_reqs, laiocb, node);
+        s->nb_queued--;
+        qemu_aio_release(laiocb);
+        return;
+    }
+
+    if (laiocb->ret != -EINPROGRESS)
+        return;
+
+    /*
+     * Note that as of Linux 2.6.31 neither the block device code nor any
+     * filesystem implements cancellation of AIO request.
+     * Thus the polling loop below is the normal code path.
+     */
+    ret = io_cancel(s->ctx, &laiocb->iocb, &event);
+    if (ret == 0) {
+        s->count--;
+        laiocb->ret = -ECANCELED;
+        qemu_aio_release(laiocb);
+        return;
+    }
+
+    /*
+     * We have to wait for the iocb to finish.
+     *
+     * The only way to get the iocb status update is by polling the io context.
+     * We might be able to do this slightly more optimal by removing the
+     * O_NONBLOCK flag.
+     */
+    while (laiocb->ret == -EINPROGRESS)
+        qemu_laio_completion_cb(s);
+}
+
+static AIOPool laio_pool = {
+    .aiocb_size         = sizeof(struct qemu_laiocb),
+    .cancel             = laio_cancel,
+};
+
+BlockDriverAIOCB *laio_submit(BlockDriverState *bs, void *aio_ctx, int fd,
+        int64_t sector_num, QEMUIOVector *qiov, int nb_sectors,
+        BlockDriverCompletionFunc *cb, void *opaque, int type)
+{
+    struct qemu_laio_state *s = aio_ctx;
+    struct qemu_laiocb *laiocb;
+    struct iocb *iocbs;
+
+    laiocb = qemu_aio_get(&laio_pool, bs, cb, opaque);
+    if (!laiocb)
+        return NULL;
+    laiocb->nbytes = nb_sectors * 512;
+    laiocb->ctx = s;
+    laiocb->ret = -EINPROGRESS;
+    laiocb->async_context_id = get_async_context_id();
+
+    iocbs = &laiocb->iocb;
+    memset(iocbs, 0, sizeof(*iocbs));
+    switch (type) {
+    case QEMU_AIO_WRITE:
+        iocbs->aio_lio_opcode = IOCB_CMD_PWRITEV;
+        break;
+    case QEMU_AIO_READ:
+        iocbs->aio_lio_opcode = IOCB_CMD_PREADV;
+        break;
+    default:
+        fprintf(stderr, "%s: invalid AIO request type 0x%x.\n",
+                        __func__, type);
+        qemu_aio_release(laiocb);
+        return NULL;
+    }
+    iocbs->aio_fildes = fd;
+    iocbs->aio_buf = (uintptr_t)qiov->iov;
+    iocbs->aio_nbytes = qiov->niov;
+    iocbs->aio_offset = sector_num * 512;
+    iocbs->aio_flags = IOCB_FLAG_RESFD;
+    iocbs->aio_resfd = s->efd;
+
+    QTAILQ_INSERT_TAIL(&s->queued_reqs, laiocb, node);
+    laiocb->queued = 1;
+    s->nb_queued++;
+
+    if (s->nb_queued >= MAX_BATCH) {
+        qemu_laio_submit_queued(s);
+    } else {
+        qemu_bh_schedule(s->submit_bh);
+    }
+    return &laiocb->common;
+}
+
+void *laio_init(void)
+{
+    struct qemu_laio_state *s;
+
+    s = g_malloc0(sizeof(*s));
+    QTAILQ_INIT(&s->queued_reqs);
+    QTAILQ_INIT(&s->completed_reqs);
+    s->efd = eventfd(0, 0);
+    if (s->efd == -1)
+        goto out_free_state;
+    fcntl(s->efd, F_SETFL, O_NONBLOCK);
+
+    if (io_setup(MAX_EVENTS, &s->ctx) != 0)
+        goto out_close_efd;
+
+    s->submit_bh = qemu_bh_new(qemu_laio_submit_bh, s);
+
+    qemu_aio_set_fd_handler(s->efd, qemu_laio_completion_cb, NULL,
+        qemu_laio_flush_cb, qemu_laio_process_requests, s);
+
+    return s;
+
+out_close_efd:
+    close(s->efd);
+out_free_state:
+    g_free(s);
+    return NULL;
+}
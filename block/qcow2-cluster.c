@@ -71,6 +71,10 @@ int qcow2_grow_l1_table(BlockDriverState *bs, int min_size)
         new_l1_table[i] = be64_to_cpu(new_l1_table[i]);
 
     /* set new table */
+    ret = qcow2_refcount_flush(bs);
+    if (ret < 0) {
+        goto fail;
+    }
     BLKDBG_EVENT(bs->file, BLKDBG_L1_GROW_ACTIVATE_TABLE);
     cpu_to_be32w((uint32_t*)data, new_l1_size);
     cpu_to_be64w((uint64_t*)(data + 4), new_l1_table_offset);
@@ -90,31 +94,164 @@ int qcow2_grow_l1_table(BlockDriverState *bs, int min_size)
     return ret;
 }
 
+static int64_t l2_cache_limit = L2_CACHE_DEFAULT_LIMIT;
+
+void bdrv_qcow2_set_l2_cache_limit(int64_t bytes)
+{
+    l2_cache_limit = bytes;
+}
+
+/*
+ * The L2 cache is an array of l2_cache_size tables. Cached tables are found
+ * through a hash of their offset, and evicted in least recently used order.
+ */
+
+static inline int l2_cache_hash(BDRVQcowState *s, uint64_t l2_offset)
+{
+    return (l2_offset >> s->cluster_bits) & (s->l2_cache_size * 2 - 1);
+}
+
+static void l2_cache_unlink(BDRVQcowState *s, int i)
+{
+    QCowL2CacheEntry *e = &s->l2_cache_entries[i];
+
+    if (e->lru_prev >= 0) {
+        s->l2_cache_entries[e->lru_prev].lru_next = e->lru_next;
+    } else {
+        s->l2_cache_mru = e->lru_next;
+    }
+    if (e->lru_next >= 0) {
+        s->l2_cache_entries[e->lru_next].lru_prev = e->lru_prev;
+    } else {
+        s->l2_cache_lru = e->lru_prev;
+    }
+}
+
+/* makes entry i the most recently used one */
+static void l2_cache_touch(BDRVQcowState *s, int i)
+{
+    QCowL2CacheEntry *e = &s->l2_cache_entries[i];
+
+    if (s->l2_cache_mru == i) {
+        return;
+    }
+    l2_cache_unlink(s, i);
+    e->lru_prev = -1;
+    e->lru_next = s->l2_cache_mru;
+    s->l2_cache_entries[s->l2_cache_mru].lru_prev = i;
+    s->l2_cache_mru = i;
+}
+
+/* sets the offset of entry i, which must not be in use */
+static void l2_cache_insert(BDRVQcowState *s, int i, uint64_t l2_offset)
+{
+    QCowL2CacheEntry *e = &s->l2_cache_entries[i];
+    int h = l2_cache_hash(s, l2_offset);
+
+    e->offset = l2_offset;
+    e->hash_next = s->l2_cache_buckets[h];
+    s->l2_cache_buckets[h] = i;
+    l2_cache_touch(s, i);
+}
+
+/*
+ * Allocates the L2 cache. Its size is the number of tables needed to map
+ * an image of image_size bytes, at least L2_CACHE_MIN_SIZE and at most
+ * the configured limit, rounded up to a power of two.
+ */
+void qcow2_l2_cache_init(BlockDriverState *bs, int64_t image_size)
+{
+    BDRVQcowState *s = bs->opaque;
+    int64_t table_size = s->l2_size * sizeof(uint64_t);
+    int64_t max_size = l2_cache_limit / table_size;
+    int64_t needed = (image_size + (table_size << s->l2_bits) - 1) /
+        (table_size << s->l2_bits);
+    int size = L2_CACHE_MIN_SIZE;
+
+    while (size < needed && size * 2 <= max_size) {
+        size *= 2;
+    }
+
+    s->l2_cache_size = size;
+    s->l2_cache = g_malloc(size * table_size);
+    s->l2_cache_entries = g_malloc(size * sizeof(QCowL2CacheEntry));
+    s->l2_cache_buckets = g_malloc(size * 2 * sizeof(int));
+    memCategory_add(&qcow2_cache_memory, size * table_size);
+    s->l2_pending_offset = 0;
+    qcow2_l2_cache_reset(bs);
+}
+
+void qcow2_l2_cache_close(BlockDriverState *bs)
+{
+    BDRVQcowState *s = bs->opaque;
+
+    if (s->l2_cache) {
+        memCategory_add(&qcow2_cache_memory,
+                        -(int64_t)s->l2_cache_size * s->l2_size *
+                        sizeof(uint64_t));
+    }
+    g_free(s->l2_cache);
+    g_free(s->l2_cache_entries);
+    g_free(s->l2_cache_buckets);
+    s->l2_cache = NULL;
+    s->l2_cache_entries = NULL;
+    s->l2_cache_buckets = NULL;
+}
+
 void qcow2_l2_cache_reset(BlockDriverState *bs)
 {
     BDRVQcowState *s = bs->opaque;
+    int i;
 
-    memset(s->l2_cache, 0, s->l2_size * L2_CACHE_SIZE * sizeof(uint64_t));
-    memset(s->l2_cache_offsets, 0, L2_CACHE_SIZE * sizeof(uint64_t));
-    memset(s->l2_cache_counts, 0, L2_CACHE_SIZE * sizeof(uint32_t));
+    /* the tables are reloaded from disk, don't lose pending updates */
+    qcow2_l2_flush(bs);
+    s->l2_pending_offset = 0;
+
+    memset(s->l2_cache, 0,
+           s->l2_size * s->l2_cache_size * sizeof(uint64_t));
+    for (i = 0; i < s->l2_cache_size; i++) {
+        s->l2_cache_entries[i].offset = 0;
+        s->l2_cache_entries[i].lru_prev = i - 1;
+        s->l2_cache_entries[i].lru_next =
+            (i + 1 < s->l2_cache_size) ? i + 1 : -1;
+        s->l2_cache_entries[i].hash_next = -1;
+    }
+    for (i = 0; i < s->l2_cache_size * 2; i++) {
+        s->l2_cache_buckets[i] = -1;
+    }
+    s->l2_cache_mru = 0;
+    s->l2_cache_lru = s->l2_cache_size - 1;
 }
 
+/*
+ * Returns the least recently used entry, removed from the hash table so
+ * that it can be filled with a new table, or -errno if its pending updates
+ * can't be written.
+ */
 static inline int l2_cache_new_entry(BlockDriverState *bs)
 {
     BDRVQcowState *s = bs->opaque;
-    uint32_t min_count;
-    int min_index, i;
-
-    /* find a new entry in the least used one */
-    min_index = 0;
-    min_count = 0xffffffff;
-    for(i = 0; i < L2_CACHE_SIZE; i++) {
-        if (s->l2_cache_counts[i] < min_count) {
-            min_count = s->l2_cache_counts[i];
-            min_index = i;
+    int i = s->l2_cache_lru;
+    QCowL2CacheEntry *e = &s->l2_cache_entries[i];
+    int *p;
+
+    if (e->offset != 0 && e->offset == s->l2_pending_offset) {
+        int ret = qcow2_l2_flush(bs);
+        if (ret < 0) {
+            return ret;
         }
     }
-    return min_index;
+
+    if (e->offset != 0) {
+        p = &s->l2_cache_buckets[l2_cache_hash(s, e->offset)];
+        while (*p != i) {
+            p = &s->l2_cache_entries[*p].hash_next;
+        }
+        *p = e->hash_next;
+        e->offset = 0;
+        e->hash_next = -1;
+    }
+    return i;
 }
 
 /*
@@ -123,24 +260,19 @@ static inline int l2_cache_new_entry(BlockDriverState *bs)
  * seek l2_offset in the l2_cache table
  * if not found, return NULL,
  * if found,
- *   increments the l2 cache hit count of the entry,
- *   if counter overflow, divide by two all counters
+ *   makes the entry the most recently used one
  *   return the pointer to the l2 cache entry
  *
  */
 
 static uint64_t *seek_l2_table(BDRVQcowState *s, uint64_t l2_offset)
 {
-    int i, j;
+    int i;
 
-    for(i = 0; i < L2_CACHE_SIZE; i++) {
-        if (l2_offset == s->l2_cache_offsets[i]) {
-            /* increment the hit count */
-            if (++s->l2_cache_counts[i] == 0xffffffff) {
-                for(j = 0; j < L2_CACHE_SIZE; j++) {
-                    s->l2_cache_counts[j] >>= 1;
-                }
-            }
+    for (i = s->l2_cache_buckets[l2_cache_hash(s, l2_offset)]; i >= 0;
+         i = s->l2_cache_entries[i].hash_next) {
+        if (s->l2_cache_entries[i].offset == l2_offset) {
+            l2_cache_touch(s, i);
             return s->l2_cache + (i << s->l2_bits);
         }
     }
@@ -174,6 +306,9 @@ static int l2_load(BlockDriverState *bs, uint64_t l2_offset,
     /* not found: load a new entry in the least used one */
 
     min_index = l2_cache_new_entry(bs);
+    if (min_index < 0) {
+        return min_index;
+    }
     *l2_table = s->l2_cache + (min_index << s->l2_bits);
 
     BLKDBG_EVENT(bs->file, BLKDBG_L2_LOAD);
@@ -183,8 +318,7 @@ static int l2_load(BlockDriverState *bs, uint64_t l2_offset,
         return ret;
     }
 
-    s->l2_cache_offsets[min_index] = l2_offset;
-    s->l2_cache_counts[min_index] = 1;
+    l2_cache_insert(s, min_index, l2_offset);
 
     return 0;
 }
@@ -206,6 +340,11 @@ static int write_l1_entry(BlockDriverState *bs, int l1_index)
         buf[i] = cpu_to_be64(s->l1_table[l1_start_index + i]);
     }
 
+    ret = qcow2_refcount_flush(bs);
+    if (ret < 0) {
+        return ret;
+    }
+
     BLKDBG_EVENT(bs->file, BLKDBG_L1_UPDATE);
     ret = bdrv_pwrite_sync(bs->file, s->l1_table_offset + 8 * l1_start_index,
         buf, sizeof(buf));
@@ -247,6 +386,10 @@ static int l2_allocate(BlockDriverState *bs, int l1_index, uint64_t **table)
     /* allocate a new entry in the l2 cache */
 
     min_index = l2_cache_new_entry(bs);
+    if (min_index < 0) {
+        ret = min_index;
+        goto fail;
+    }
     l2_table = s->l2_cache + (min_index << s->l2_bits);
 
     if (old_l2_offset == 0) {
@@ -278,8 +421,7 @@ static int l2_allocate(BlockDriverState *bs, int l1_index, uint64_t **table)
 
     /* update the l2 cache entry */
 
-    s->l2_cache_offsets[min_index] = l2_offset;
-    s->l2_cache_counts[min_index] = 1;
+    l2_cache_insert(s, min_index, l2_offset);
 
     *table = l2_table;
     return 0;
@@ -373,7 +515,8 @@ static int qcow_read(BlockDriverState *bs, int64_t sector_num,
                 memset(buf, 0, 512 * n);
             }
         } else if (cluster_offset & QCOW_OFLAG_COMPRESSED) {
-            if (qcow2_decompress_cluster(bs, cluster_offset) < 0)
+            if (qcow2_decompress_cluster(bs, sector_num << 9,
+                                         cluster_offset) < 0)
                 return -1;
             memcpy(buf, s->cluster_cache + index_in_cluster * 512, 512 * n);
         } else {
@@ -629,6 +772,9 @@ uint64_t qcow2_alloc_compressed_cluster_offset(BlockDriverState *bs,
 
     /* compressed clusters never have the copied flag */
 
+    if (qcow2_refcount_flush(bs) < 0)
+        return 0;
+
     BLKDBG_EVENT(bs->file, BLKDBG_L2_UPDATE_COMPRESSED);
     l2_table[l2_index] = cpu_to_be64(cluster_offset);
     if (bdrv_pwrite_sync(bs->file,
@@ -654,6 +800,11 @@ static int write_l2_entries(BlockDriverState *bs, uint64_t *l2_table,
     size_t len = end_offset - start_offset;
     int ret;
 
+    ret = qcow2_refcount_flush(bs);
+    if (ret < 0) {
+        return ret;
+    }
+
     BLKDBG_EVENT(bs->file, BLKDBG_L2_UPDATE);
     ret = bdrv_pwrite_sync(bs->file, l2_offset + start_offset,
         &l2_table[l2_start_index], len);
@@ -664,6 +815,119 @@ static int write_l2_entries(BlockDriverState *bs, uint64_t *l2_table,
     return 0;
 }
 
+/*
+ * Writes the pending L2 table updates, if any.
+ *
+ * Returns 0 on success, -errno in error cases.
+ */
+int qcow2_l2_flush(BlockDriverState *bs)
+{
+    BDRVQcowState *s = bs->opaque;
+    uint64_t *l2_table;
+    int ret;
+
+    if (s->l2_pending_offset == 0) {
+        return 0;
+    }
+
+    l2_table = s->l2_cache + (s->l2_pending_entry << s->l2_bits);
+    ret = write_l2_entries(bs, l2_table, s->l2_pending_offset,
+        s->l2_pending_first, s->l2_pending_last - s->l2_pending_first + 1);
+    if (ret < 0) {
+        return ret;
+    }
+
+    s->l2_pending_offset = 0;
+    return 0;
+}
+
+/*
+ * Records that num entries starting at l2_index of a cached L2 table were
+ * modified. Updates of neighbouring sectors of the same table are merged,
+ * so that sequential writes cost one L2 write instead of one per request;
+ * other updates write the pending ones first. The updates are written at
+ * the latest when the table leaves the cache or the image is flushed.
+ */
+static int l2_update_entries(BlockDriverState *bs, uint64_t *l2_table,
+    uint64_t l2_offset, int l2_index, int num)
+{
+    BDRVQcowState *s = bs->opaque;
+    int first = l2_index;
+    int last = l2_index + num - 1;
+    int ret;
+
+    if (s->l2_pending_offset == l2_offset &&
+        first / L2_ENTRIES_PER_SECTOR <=
+            s->l2_pending_last / L2_ENTRIES_PER_SECTOR + 1 &&
+        last / L2_ENTRIES_PER_SECTOR + 1 >=
+            s->l2_pending_first / L2_ENTRIES_PER_SECTOR) {
+        s->l2_pending_first = MIN(first, s->l2_pending_first);
+        s->l2_pending_last = MAX(last, s->l2_pending_last);
+        return 0;
+    }
+
+    ret = qcow2_l2_flush(bs);
+    if (ret < 0) {
+        return ret;
+    }
+
+    s->l2_pending_offset = l2_offset;
+    s->l2_pending_entry = (l2_table - s->l2_cache) >> s->l2_bits;
+    s->l2_pending_first = first;
+    s->l2_pending_last = last;
+    return 0;
+}
+
+/*
+ * Allocates nb_clusters contiguous data clusters. They are taken from a run
+ * reserved ahead by a single refcount update, so that sequential writes get
+ * contiguous clusters without updating refcounts for each of them.
+ *
+ * Sets *unwritten if the clusters have never been written to.
+ */
+static int64_t alloc_data_clusters(BlockDriverState *bs, int nb_clusters,
+    int *unwritten)
+{
+    BDRVQcowState *s = bs->opaque;
+    int64_t offset;
+
+    if (nb_clusters > s->prealloc_clusters) {
+        int n = nb_clusters +
+            MAX(1, QCOW2_PREALLOC_SIZE >> s->cluster_bits);
+        int64_t file_end;
+
+        qcow2_release_prealloc(bs);
+
+        file_end = bdrv_getlength(bs->file);
+        offset = qcow2_alloc_clusters(bs, (int64_t)n << s->cluster_bits);
+        if (offset < 0) {
+            return offset;
+        }
+        s->prealloc_offset = offset;
+        s->prealloc_clusters = n;
+        s->prealloc_unwritten = file_end < 0 ? INT64_MAX :
+            MAX(file_end, offset);
+    }
+
+    offset = s->prealloc_offset;
+    s->prealloc_offset += (int64_t)nb_clusters << s->cluster_bits;
+    s->prealloc_clusters -= nb_clusters;
+    *unwritten = offset >= s->prealloc_unwritten;
+    return offset;
+}
+
+/* Returns the reserved data clusters that were not used */
+void qcow2_release_prealloc(BlockDriverState *bs)
+{
+    BDRVQcowState *s = bs->opaque;
+
+    if (s->prealloc_clusters > 0) {
+        qcow2_free_clusters(bs, s->prealloc_offset,
+            (int64_t)s->prealloc_clusters << s->cluster_bits);
+    }
+    s->prealloc_clusters = 0;
+}
+
 int qcow2_alloc_cluster_link_l2(BlockDriverState *bs, QCowL2Meta *m)
 {
     BDRVQcowState *s = bs->opaque;
@@ -676,9 +940,10 @@ int qcow2_alloc_cluster_link_l2(BlockDriverState *bs, QCowL2Meta *m)
 
     old_cluster = g_malloc(m->nb_clusters * sizeof(uint64_t));
 
-    /* copy content of unmodified sectors */
+    /* copy content of unmodified sectors, unless they read as zeroes and
+     * the new clusters already do */
     start_sect = (m->offset & ~(s->cluster_size - 1)) >> 9;
-    if (m->n_start) {
+    if (m->n_start && !m->cow_zeroes) {
         ret = copy_sectors(bs, start_sect, cluster_offset, 0, m->n_start);
         if (ret < 0)
             goto err;
@@ -686,8 +951,16 @@ int qcow2_alloc_cluster_link_l2(BlockDriverState *bs, QCowL2Meta *m)
 
     if (m->nb_available & (s->cluster_sectors - 1)) {
         uint64_t end = m->nb_available & ~(uint64_t)(s->cluster_sectors - 1);
-        ret = copy_sectors(bs, start_sect + end, cluster_offset + (end << 9),
+        if (m->cow_zeroes) {
+            /* reads must not go past the end of the image file */
+            memset(s->cluster_data, 0, 512);
+            ret = bdrv_write(bs->file, (cluster_offset >> 9) + end +
+                s->cluster_sectors - 1, s->cluster_data, 1);
+        } else {
+            ret = copy_sectors(bs, start_sect + end,
+                cluster_offset + (end << 9),
                 m->nb_available - end, s->cluster_sectors);
+        }
         if (ret < 0)
             goto err;
     }
@@ -712,7 +985,15 @@ int qcow2_alloc_cluster_link_l2(BlockDriverState *bs, QCowL2Meta *m)
                     (i << s->cluster_bits)) | QCOW_OFLAG_COPIED);
      }
 
-    ret = write_l2_entries(bs, l2_table, l2_offset, l2_index, m->nb_clusters);
+    /* the old clusters can only be freed once nothing references them on
+     * disk */
+    if (j == 0) {
+        ret = l2_update_entries(bs, l2_table, l2_offset, l2_index,
+            m->nb_clusters);
+    } else {
+        ret = write_l2_entries(bs, l2_table, l2_offset, l2_index,
+            m->nb_clusters);
+    }
     if (ret < 0) {
         qcow2_l2_cache_reset(bs);
         goto err;
@@ -756,6 +1037,7 @@ int qcow2_alloc_cluster_offset(BlockDriverState *bs, uint64_t offset,
     int64_t cluster_offset;
     unsigned int nb_clusters, i = 0;
     QCowL2Meta *old_alloc;
+    int unwritten;
 
     ret = get_cluster_table(bs, offset, &l2_table, &l2_offset, &l2_index);
     if (ret < 0) {
@@ -776,6 +1058,7 @@ int qcow2_alloc_cluster_offset(BlockDriverState *bs, uint64_t offset,
 
         cluster_offset &= ~QCOW_OFLAG_COPIED;
         m->nb_clusters = 0;
+        m->cow_zeroes = 0;
         m->depends_on = NULL;
 
         goto out;
@@ -848,13 +1131,19 @@ int qcow2_alloc_cluster_offset(BlockDriverState *bs, uint64_t offset,
 
     QLIST_INSERT_HEAD(&s->cluster_allocs, m, next_in_flight);
 
+    /* the clusters that are partially written need a COW, which has nothing
+     * to copy if they had no data nor backing file */
+    m->cow_zeroes = !bs->backing_hd && !s->crypt_method &&
+        l2_table[l2_index] == 0 && l2_table[l2_index + nb_clusters - 1] == 0;
+
     /* allocate a new cluster */
 
-    cluster_offset = qcow2_alloc_clusters(bs, nb_clusters * s->cluster_size);
+    cluster_offset = alloc_data_clusters(bs, nb_clusters, &unwritten);
     if (cluster_offset < 0) {
         QLIST_REMOVE(m, next_in_flight);
         return cluster_offset;
     }
+    m->cow_zeroes &= unwritten;
 
     /* save info needed for meta data update */
     m->offset = offset;
@@ -897,27 +1186,320 @@ static int decompress_buffer(uint8_t *out_buf, int out_buf_size,
     return 0;
 }
 
-int qcow2_decompress_cluster(BlockDriverState *bs, uint64_t cluster_offset)
+/*
+ * The decompressed cluster cache. Entries are found by the offset of their
+ * compressed data, which never changes while the cluster is allocated, and
+ * evicted in least recently used order.
+ *
+ * On sequential reads, the next compressed clusters of the image are read
+ * and queued for decompression by a pool of threads, so that they are ready
+ * when the guest gets to them. The threads only inflate buffers, all the
+ * block layer I/O is done by the caller.
+ */
+
+static void *zcache_thread(void *opaque)
+{
+    BDRVQcowState *s = opaque;
+
+    qemu_mutex_lock(&s->zcache_lock);
+    while (!s->zcache_quit) {
+        QCowZCacheEntry *e = NULL;
+        int i, ret;
+
+        for (i = 0; i < QCOW2_ZCACHE_SIZE; i++) {
+            if (s->zcache[i].state == QCOW2_ZCACHE_PENDING) {
+                e = &s->zcache[i];
+                break;
+            }
+        }
+        if (e == NULL) {
+            qemu_cond_wait(&s->zcache_work_cond, &s->zcache_lock);
+            continue;
+        }
+
+        e->state = QCOW2_ZCACHE_BUSY;
+        qemu_mutex_unlock(&s->zcache_lock);
+
+        ret = decompress_buffer(e->data, s->cluster_size, e->zdata, e->zsize);
+
+        qemu_mutex_lock(&s->zcache_lock);
+        e->state = ret < 0 ? QCOW2_ZCACHE_FAILED : QCOW2_ZCACHE_READY;
+        qemu_cond_broadcast(&s->zcache_done_cond);
+    }
+    qemu_mutex_unlock(&s->zcache_lock);
+    return NULL;
+}
+
+void qcow2_zcache_init(BlockDriverState *bs)
+{
+    BDRVQcowState *s = bs->opaque;
+    int i;
+
+    for (i = 0; i < QCOW2_ZCACHE_SIZE; i++) {
+        s->zcache[i].offset = -1;
+        s->zcache[i].data = g_malloc(s->cluster_size);
+        s->zcache[i].zdata = NULL;
+        s->zcache[i].last_use = 0;
+        s->zcache[i].state = QCOW2_ZCACHE_READY;
+    }
+    memCategory_add(&qcow2_cache_memory,
+                    (int64_t)QCOW2_ZCACHE_SIZE * s->cluster_size);
+    s->zcache_clock = 0;
+    s->zcache_next_cluster = -1;
+    s->zcache_nb_threads = 0;
+    s->zcache_quit = 0;
+    s->cluster_cache = s->zcache[0].data;
+    qemu_mutex_init(&s->zcache_lock);
+    qemu_cond_init(&s->zcache_work_cond);
+    qemu_cond_init(&s->zcache_done_cond);
+}
+
+void qcow2_zcache_close(BlockDriverState *bs)
+{
+    BDRVQcowState *s = bs->opaque;
+    int i;
+
+    if (s->zcache[0].data == NULL) {
+        return;
+    }
+
+    qemu_mutex_lock(&s->zcache_lock);
+    s->zcache_quit = 1;
+    qemu_cond_broadcast(&s->zcache_work_cond);
+    qemu_mutex_unlock(&s->zcache_lock);
+    for (i = 0; i < s->zcache_nb_threads; i++) {
+        qemu_thread_join(&s->zcache_threads[i]);
+    }
+    s->zcache_nb_threads = 0;
+
+    memCategory_add(&qcow2_cache_memory,
+                    -(int64_t)QCOW2_ZCACHE_SIZE * s->cluster_size);
+    for (i = 0; i < QCOW2_ZCACHE_SIZE; i++) {
+        g_free(s->zcache[i].data);
+        g_free(s->zcache[i].zdata);
+        s->zcache[i].data = NULL;
+        s->zcache[i].zdata = NULL;
+    }
+    s->cluster_cache = NULL;
+    qemu_cond_destroy(&s->zcache_work_cond);
+    qemu_cond_destroy(&s->zcache_done_cond);
+    qemu_mutex_destroy(&s->zcache_lock);
+}
+
+/*
+ * Drops all the decompressed clusters, when compressed data may be written
+ * where other compressed clusters used to be.
+ */
+void qcow2_zcache_reset(BlockDriverState *bs)
+{
+    BDRVQcowState *s = bs->opaque;
+    int i;
+
+    qemu_mutex_lock(&s->zcache_lock);
+    for (i = 0; i < QCOW2_ZCACHE_SIZE; i++) {
+        s->zcache[i].offset = -1;
+    }
+    qemu_mutex_unlock(&s->zcache_lock);
+    s->zcache_next_cluster = -1;
+}
+
+/* Called with zcache_lock held */
+static int zcache_find(BDRVQcowState *s, uint64_t coffset)
+{
+    int i;
+
+    for (i = 0; i < QCOW2_ZCACHE_SIZE; i++) {
+        if (s->zcache[i].offset == coffset) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Returns the least recently used entry that isn't being decompressed, or
+ * -1 if there is none. Called with zcache_lock held.
+ */
+static int zcache_victim(BDRVQcowState *s)
+{
+    int i, victim = -1;
+
+    for (i = 0; i < QCOW2_ZCACHE_SIZE; i++) {
+        QCowZCacheEntry *e = &s->zcache[i];
+
+        if (e->state == QCOW2_ZCACHE_PENDING ||
+            e->state == QCOW2_ZCACHE_BUSY || e->data == s->cluster_cache) {
+            continue;
+        }
+        if (victim < 0 || e->last_use < s->zcache[victim].last_use) {
+            victim = i;
+        }
+    }
+    return victim;
+}
+
+/* Reads the compressed data of a cluster into s->cluster_data */
+static int read_compressed_cluster(BlockDriverState *bs,
+    uint64_t cluster_offset, int *csize)
+{
+    BDRVQcowState *s = bs->opaque;
+    uint64_t coffset = cluster_offset & s->cluster_offset_mask;
+    int nb_csectors, sector_offset, ret;
+
+    nb_csectors = ((cluster_offset >> s->csize_shift) & s->csize_mask) + 1;
+    sector_offset = coffset & 511;
+    *csize = nb_csectors * 512 - sector_offset;
+    BLKDBG_EVENT(bs->file, BLKDBG_READ_COMPRESSED);
+    ret = bdrv_read(bs->file, coffset >> 9, s->cluster_data, nb_csectors);
+    if (ret < 0) {
+        return ret;
+    }
+    return sector_offset;
+}
+
+/* Queues the compressed clusters following guest cluster 'cluster' */
+static void zcache_read_ahead(BlockDriverState *bs, int64_t cluster)
+{
+    BDRVQcowState *s = bs->opaque;
+    int64_t nb_clusters = (bs->total_sectors + s->cluster_sectors - 1) /
+        s->cluster_sectors;
+    int i, queued = 0;
+
+    for (i = 1; i <= QCOW2_READAHEAD_CLUSTERS; i++) {
+        uint64_t cluster_offset, coffset;
+        QCowZCacheEntry *e;
+        int num = s->cluster_sectors;
+        int index, sector_offset, csize;
+
+        if (cluster + i >= nb_clusters) {
+            break;
+        }
+        if (qcow2_get_cluster_offset(bs, (cluster + i) << s->cluster_bits,
+                                     &num, &cluster_offset) < 0 ||
+            !(cluster_offset & QCOW_OFLAG_COMPRESSED)) {
+            break;
+        }
+
+        coffset = cluster_offset & s->cluster_offset_mask;
+        qemu_mutex_lock(&s->zcache_lock);
+        index = zcache_find(s, coffset);
+        if (index < 0) {
+            index = zcache_victim(s);
+            if (index >= 0) {
+                s->zcache[index].offset = -1;
+            }
+        } else {
+            index = -1;
+        }
+        qemu_mutex_unlock(&s->zcache_lock);
+        if (index < 0) {
+            continue;
+        }
+
+        sector_offset = read_compressed_cluster(bs, cluster_offset, &csize);
+        if (sector_offset < 0) {
+            break;
+        }
+
+        e = &s->zcache[index];
+        if (e->zdata == NULL) {
+            e->zdata = g_malloc(2 * s->cluster_size);
+        }
+        memcpy(e->zdata, s->cluster_data + sector_offset, csize);
+        e->zsize = csize;
+
+        qemu_mutex_lock(&s->zcache_lock);
+        e->offset = coffset;
+        e->last_use = ++s->zcache_clock;
+        e->state = QCOW2_ZCACHE_PENDING;
+        qemu_mutex_unlock(&s->zcache_lock);
+        queued++;
+    }
+
+    if (queued == 0) {
+        return;
+    }
+
+    if (s->zcache_nb_threads == 0) {
+        for (i = 0; i < QCOW2_DECOMPRESS_THREADS; i++) {
+            qemu_thread_create(&s->zcache_threads[i], zcache_thread, s,
+                               QEMU_THREAD_JOINABLE);
+        }
+        s->zcache_nb_threads = QCOW2_DECOMPRESS_THREADS;
+    }
+
+    qemu_mutex_lock(&s->zcache_lock);
+    qemu_cond_broadcast(&s->zcache_work_cond);
+    qemu_mutex_unlock(&s->zcache_lock);
+}
+
+/*
+ * Makes s->cluster_cache point to the decompressed data of the compressed
+ * cluster described by cluster_offset, which maps the guest offset 'offset'.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int qcow2_decompress_cluster(BlockDriverState *bs, uint64_t offset,
+                             uint64_t cluster_offset)
 {
     BDRVQcowState *s = bs->opaque;
-    int ret, csize, nb_csectors, sector_offset;
+    int64_t cluster = offset >> s->cluster_bits;
+    int index, csize, sector_offset;
     uint64_t coffset;
+    QCowZCacheEntry *e;
 
     coffset = cluster_offset & s->cluster_offset_mask;
-    if (s->cluster_cache_offset != coffset) {
-        nb_csectors = ((cluster_offset >> s->csize_shift) & s->csize_mask) + 1;
-        sector_offset = coffset & 511;
-        csize = nb_csectors * 512 - sector_offset;
-        BLKDBG_EVENT(bs->file, BLKDBG_READ_COMPRESSED);
-        ret = bdrv_read(bs->file, coffset >> 9, s->cluster_data, nb_csectors);
-        if (ret < 0) {
+
+    qemu_mutex_lock(&s->zcache_lock);
+    index = zcache_find(s, coffset);
+    if (index >= 0) {
+        e = &s->zcache[index];
+        while (e->state == QCOW2_ZCACHE_PENDING ||
+               e->state == QCOW2_ZCACHE_BUSY) {
+            qemu_cond_wait(&s->zcache_done_cond, &s->zcache_lock);
+        }
+        if (e->state == QCOW2_ZCACHE_FAILED) {
+            /* decompress it again below to report the error */
+            e->offset = -1;
+            e->state = QCOW2_ZCACHE_READY;
+            index = -1;
+        }
+    }
+    if (index < 0) {
+        index = zcache_victim(s);
+        if (index < 0) {
+            /* all the other entries are being read ahead */
+            index = s->zcache[0].data == s->cluster_cache;
+            while (s->zcache[index].state == QCOW2_ZCACHE_PENDING ||
+                   s->zcache[index].state == QCOW2_ZCACHE_BUSY) {
+                qemu_cond_wait(&s->zcache_done_cond, &s->zcache_lock);
+            }
+        }
+        s->zcache[index].offset = -1;
+        s->zcache[index].state = QCOW2_ZCACHE_READY;
+    }
+    e = &s->zcache[index];
+    e->last_use = ++s->zcache_clock;
+    qemu_mutex_unlock(&s->zcache_lock);
+
+    if (e->offset != coffset) {
+        sector_offset = read_compressed_cluster(bs, cluster_offset, &csize);
+        if (sector_offset < 0) {
             return -1;
         }
-        if (decompress_buffer(s->cluster_cache, s->cluster_size,
+        if (decompress_buffer(e->data, s->cluster_size,
                               s->cluster_data + sector_offset, csize) < 0) {
             return -1;
         }
-        s->cluster_cache_offset = coffset;
+        qemu_mutex_lock(&s->zcache_lock);
+        e->offset = coffset;
+        qemu_mutex_unlock(&s->zcache_lock);
+    }
+    s->cluster_cache = e->data;
+
+    if (cluster == s->zcache_next_cluster) {
+        zcache_read_ahead(bs, cluster);
     }
+    s->zcache_next_cluster = cluster + 1;
     return 0;
 }
@@ -32,24 +32,140 @@ static int QEMU_WARN_UNUSED_RESULT update_refcount(BlockDriverState *bs,
                             int addend);
 
 
-static int cache_refcount_updates = 0;
+/*
+ * The last REFCOUNT_CACHE_SIZE refcount blocks used are cached, and updates
+ * are only written back when a block is evicted or qcow2_refcount_flush() is
+ * called. The current block is always available as s->refcount_block_cache.
+ */
 
-static int write_refcount_block(BlockDriverState *bs)
+#define REFCOUNTS_PER_SECTOR (512 >> REFCOUNT_SHIFT)
+
+/* Writes the modified sectors of a cached refcount block to disk */
+static int refcount_cache_write(BlockDriverState *bs, int i)
 {
     BDRVQcowState *s = bs->opaque;
-    size_t size = s->cluster_size;
+    QCowRefcountCacheEntry *e = &s->refcount_cache[i];
+    int first_index, last_index;
+    size_t size;
+    int ret;
 
-    if (s->refcount_block_cache_offset == 0) {
+    if (e->dirty_first < 0) {
         return 0;
     }
 
-    BLKDBG_EVENT(bs->file, BLKDBG_REFBLOCK_UPDATE);
-    if (bdrv_pwrite_sync(bs->file, s->refcount_block_cache_offset,
-            s->refcount_block_cache, size) < 0)
-    {
-        return -EIO;
+    first_index = e->dirty_first & ~(REFCOUNTS_PER_SECTOR - 1);
+    last_index = (e->dirty_last + REFCOUNTS_PER_SECTOR)
+        & ~(REFCOUNTS_PER_SECTOR - 1);
+
+    size = (last_index - first_index) << REFCOUNT_SHIFT;
+
+    BLKDBG_EVENT(bs->file, BLKDBG_REFBLOCK_UPDATE_PART);
+    ret = bdrv_pwrite(bs->file, e->offset + (first_index << REFCOUNT_SHIFT),
+        &e->block[first_index], size);
+    if (ret < 0) {
+        return ret;
     }
 
+    e->dirty_first = -1;
+    e->dirty_last = -1;
+    s->refcount_cache_unflushed = 1;
+    return 0;
+}
+
+/* Makes entry i the current refcount block */
+static void refcount_cache_select(BDRVQcowState *s, int i)
+{
+    QCowRefcountCacheEntry *e = &s->refcount_cache[i];
+
+    e->last_use = ++s->refcount_cache_clock;
+    s->refcount_cache_current = i;
+    s->refcount_block_cache = e->block;
+    s->refcount_block_cache_offset = e->offset;
+}
+
+/*
+ * Returns the cache entry of the refcount block at the given offset. If it
+ * isn't cached, the least recently used entry is written back if needed and
+ * emptied, and *found is set to 0.
+ */
+static int refcount_cache_get(BlockDriverState *bs, int64_t offset,
+                              int *found)
+{
+    BDRVQcowState *s = bs->opaque;
+    int i, victim = 0;
+    int ret;
+
+    for (i = 0; i < REFCOUNT_CACHE_SIZE; i++) {
+        if (s->refcount_cache[i].offset == offset) {
+            *found = 1;
+            return i;
+        }
+        if (s->refcount_cache[i].last_use <
+            s->refcount_cache[victim].last_use) {
+            victim = i;
+        }
+    }
+
+    ret = refcount_cache_write(bs, victim);
+    if (ret < 0) {
+        return ret;
+    }
+
+    s->refcount_cache[victim].offset = 0;
+    if (victim == s->refcount_cache_current) {
+        s->refcount_block_cache_offset = 0;
+    }
+    *found = 0;
+    return victim;
+}
+
+/* Records that the entry at block_index of the current block was modified */
+static void refcount_cache_set_dirty(BDRVQcowState *s, int block_index)
+{
+    QCowRefcountCacheEntry *e = &s->refcount_cache[s->refcount_cache_current];
+
+    if (e->dirty_first < 0 || block_index < e->dirty_first) {
+        e->dirty_first = block_index;
+    }
+    if (block_index > e->dirty_last) {
+        e->dirty_last = block_index;
+    }
+}
+
+/* Drops the current refcount block from the cache, without writing it */
+static void refcount_cache_discard_current(BDRVQcowState *s)
+{
+    QCowRefcountCacheEntry *e = &s->refcount_cache[s->refcount_cache_current];
+
+    e->offset = 0;
+    e->dirty_first = -1;
+    e->dirty_last = -1;
+    s->refcount_block_cache_offset = 0;
+}
+
+/*
+ * Writes all the modified refcount blocks to disk. This must be called before
+ * any metadata referencing newly allocated clusters is written, so that the
+ * image never references clusters with a zero refcount.
+ *
+ * Returns 0 on success, -errno in error cases.
+ */
+int qcow2_refcount_flush(BlockDriverState *bs)
+{
+    BDRVQcowState *s = bs->opaque;
+    int i, ret;
+
+    for (i = 0; i < REFCOUNT_CACHE_SIZE; i++) {
+        ret = refcount_cache_write(bs, i);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    if (s->refcount_cache_unflushed) {
+        bdrv_flush(bs->file);
+        s->refcount_cache_unflushed = 0;
+    }
     return 0;
 }
 
@@ -61,7 +177,19 @@ int qcow2_refcount_init(BlockDriverState *bs)
     BDRVQcowState *s = bs->opaque;
     int ret, refcount_table_size2, i;
 
-    s->refcount_block_cache = g_malloc(s->cluster_size);
+    for (i = 0; i < REFCOUNT_CACHE_SIZE; i++) {
+        s->refcount_cache[i].offset = 0;
+        s->refcount_cache[i].block = g_malloc(s->cluster_size);
+        s->refcount_cache[i].last_use = 0;
+        s->refcount_cache[i].dirty_first = -1;
+        s->refcount_cache[i].dirty_last = -1;
+    }
+    s->refcount_cache_clock = 0;
+    s->refcount_cache_unflushed = 0;
+    refcount_cache_select(s, 0);
+    memCategory_add(&qcow2_cache_memory,
+                    (int64_t)REFCOUNT_CACHE_SIZE * s->cluster_size);
+
     refcount_table_size2 = s->refcount_table_size * sizeof(uint64_t);
     s->refcount_table = g_malloc(refcount_table_size2);
     if (s->refcount_table_size > 0) {
@@ -81,7 +209,17 @@ int qcow2_refcount_init(BlockDriverState *bs)
 void qcow2_refcount_close(BlockDriverState *bs)
 {
     BDRVQcowState *s = bs->opaque;
-    g_free(s->refcount_block_cache);
+    int i;
+
+    if (s->refcount_block_cache) {
+        memCategory_add(&qcow2_cache_memory,
+                        -(int64_t)REFCOUNT_CACHE_SIZE * s->cluster_size);
+    }
+    for (i = 0; i < REFCOUNT_CACHE_SIZE; i++) {
+        g_free(s->refcount_cache[i].block);
+        s->refcount_cache[i].block = NULL;
+    }
+    s->refcount_block_cache = NULL;
     g_free(s->refcount_table);
 }
 
@@ -90,23 +228,46 @@ static int load_refcount_block(BlockDriverState *bs,
                                int64_t refcount_block_offset)
 {
     BDRVQcowState *s = bs->opaque;
-    int ret;
+    int i, found, ret;
+
+    i = refcount_cache_get(bs, refcount_block_offset, &found);
+    if (i < 0) {
+        return i;
+    }
 
-    if (cache_refcount_updates) {
-        ret = write_refcount_block(bs);
+    if (!found) {
+        BLKDBG_EVENT(bs->file, BLKDBG_REFBLOCK_LOAD);
+        ret = bdrv_pread(bs->file, refcount_block_offset,
+                         s->refcount_cache[i].block, s->cluster_size);
         if (ret < 0) {
             return ret;
         }
+        s->refcount_cache[i].offset = refcount_block_offset;
     }
 
-    BLKDBG_EVENT(bs->file, BLKDBG_REFBLOCK_LOAD);
-    ret = bdrv_pread(bs->file, refcount_block_offset, s->refcount_block_cache,
-                     s->cluster_size);
-    if (ret < 0) {
-        return ret;
+    refcount_cache_select(s, i);
+    return 0;
+}
+
+/*
+ * Makes a new, zeroed refcount block at the given offset the current one.
+ * It is up to the caller to write it to disk.
+ */
+static int new_refcount_block(BlockDriverState *bs, int64_t offset)
+{
+    BDRVQcowState *s = bs->opaque;
+    int i, found;
+
+    i = refcount_cache_get(bs, offset, &found);
+    if (i < 0) {
+        return i;
     }
 
-    s->refcount_block_cache_offset = refcount_block_offset;
+    memset(s->refcount_cache[i].block, 0, s->cluster_size);
+    s->refcount_cache[i].offset = offset;
+    s->refcount_cache[i].dirty_first = -1;
+    s->refcount_cache[i].dirty_last = -1;
+    refcount_cache_select(s, i);
     return 0;
 }
 
@@ -225,13 +386,6 @@ static int64_t alloc_refcount_block(BlockDriverState *bs, int64_t cluster_index)
      *   refcount block into the cache
      */
 
-    if (cache_refcount_updates) {
-        ret = write_refcount_block(bs);
-        if (ret < 0) {
-            return ret;
-        }
-    }
-
     /* Allocate the refcount block itself and mark it as used */
     int64_t new_block = alloc_clusters_noref(bs, s->cluster_size);
     if (new_block < 0) {
@@ -246,8 +400,10 @@ static int64_t alloc_refcount_block(BlockDriverState *bs, int64_t cluster_index)
 
     if (in_same_refcount_block(s, new_block, cluster_index << s->cluster_bits)) {
         /* Zero the new refcount block before updating it */
-        memset(s->refcount_block_cache, 0, s->cluster_size);
-        s->refcount_block_cache_offset = new_block;
+        ret = new_refcount_block(bs, new_block);
+        if (ret < 0) {
+            return ret;
+        }
 
         /* The block describes itself, need to update the cache */
         int block_index = (new_block >> s->cluster_bits) &
@@ -263,8 +419,10 @@ static int64_t alloc_refcount_block(BlockDriverState *bs, int64_t cluster_index)
 
         /* Initialize the new refcount block only after updating its refcount,
          * update_refcount uses the refcount cache itself */
-        memset(s->refcount_block_cache, 0, s->cluster_size);
-        s->refcount_block_cache_offset = new_block;
+        ret = new_refcount_block(bs, new_block);
+        if (ret < 0) {
+            goto fail_block;
+        }
     }
 
     /* Now the new refcount block needs to be written to disk */
@@ -275,6 +433,13 @@ static int64_t alloc_refcount_block(BlockDriverState *bs, int64_t cluster_index)
         goto fail_block;
     }
 
+    /* The refcount of the new block may be in another cached block, which
+     * must be on disk before the new block is referenced */
+    ret = qcow2_refcount_flush(bs);
+    if (ret < 0) {
+        goto fail_block;
+    }
+
     /* If the refcount table is big enough, just hook the block up there */
     if (refcount_table_index < s->refcount_table_size) {
         uint64_t data64 = cpu_to_be64(new_block);
@@ -417,52 +582,17 @@ static int64_t alloc_refcount_block(BlockDriverState *bs, int64_t cluster_index)
 fail_table:
     g_free(new_table);
 fail_block:
-    s->refcount_block_cache_offset = 0;
-    return ret;
-}
-
-#define REFCOUNTS_PER_SECTOR (512 >> REFCOUNT_SHIFT)
-static int write_refcount_block_entries(BlockDriverState *bs,
-    int64_t refcount_block_offset, int first_index, int last_index)
-{
-    BDRVQcowState *s = bs->opaque;
-    size_t size;
-    int ret;
-
-    if (cache_refcount_updates) {
-        return 0;
-    }
-
-    if (first_index < 0) {
-        return 0;
-    }
-
-    first_index &= ~(REFCOUNTS_PER_SECTOR - 1);
-    last_index = (last_index + REFCOUNTS_PER_SECTOR)
-        & ~(REFCOUNTS_PER_SECTOR - 1);
-
-    size = (last_index - first_index) << REFCOUNT_SHIFT;
-
-    BLKDBG_EVENT(bs->file, BLKDBG_REFBLOCK_UPDATE_PART);
-    ret = bdrv_pwrite_sync(bs->file,
-        refcount_block_offset + (first_index << REFCOUNT_SHIFT),
-        &s->refcount_block_cache[first_index], size);
-    if (ret < 0) {
-        return ret;
+    if (s->refcount_block_cache_offset == new_block) {
+        refcount_cache_discard_current(s);
     }
-
-    return 0;
+    return ret;
 }
 
-/* XXX: cache several refcount block clusters ? */
 static int QEMU_WARN_UNUSED_RESULT update_refcount(BlockDriverState *bs,
     int64_t offset, int64_t length, int addend)
 {
     BDRVQcowState *s = bs->opaque;
     int64_t start, last, cluster_offset;
-    int64_t refcount_block_offset = 0;
-    int64_t table_index = -1, old_table_index;
-    int first_index = -1, last_index = -1;
     int ret;
 
 #ifdef DEBUG_ALLOC2
@@ -484,39 +614,16 @@ static int QEMU_WARN_UNUSED_RESULT update_refcount(BlockDriverState *bs,
         int64_t cluster_index = cluster_offset >> s->cluster_bits;
         int64_t new_block;
 
-        /* Only write refcount block to disk when we are done with it */
-        old_table_index = table_index;
-        table_index = cluster_index >> (s->cluster_bits - REFCOUNT_SHIFT);
-        if ((old_table_index >= 0) && (table_index != old_table_index)) {
-
-            ret = write_refcount_block_entries(bs, refcount_block_offset,
-                first_index, last_index);
-            if (ret < 0) {
-                return ret;
-            }
-
-            first_index = -1;
-            last_index = -1;
-        }
-
         /* Load the refcount block and allocate it if needed */
         new_block = alloc_refcount_block(bs, cluster_index);
         if (new_block < 0) {
             ret = new_block;
             goto fail;
         }
-        refcount_block_offset = new_block;
 
-        /* we can update the count and save it */
+        /* we can update the count, it is written back with the block */
         block_index = cluster_index &
             ((1 << (s->cluster_bits - REFCOUNT_SHIFT)) - 1);
-        if (first_index == -1 || block_index < first_index) {
-            first_index = block_index;
-        }
-        if (block_index > last_index) {
-            last_index = block_index;
-        }
-
         refcount = be16_to_cpu(s->refcount_block_cache[block_index]);
         refcount += addend;
         if (refcount < 0 || refcount > 0xffff) {
@@ -527,21 +634,12 @@ static int QEMU_WARN_UNUSED_RESULT update_refcount(BlockDriverState *bs,
             s->free_cluster_index = cluster_index;
         }
         s->refcount_block_cache[block_index] = cpu_to_be16(refcount);
+        refcount_cache_set_dirty(s, block_index);
     }
 
     ret = 0;
 fail:
 
-    /* Write last changed block to disk */
-    if (refcount_block_offset != 0) {
-        int wret;
-        wret = write_refcount_block_entries(bs, refcount_block_offset,
-            first_index, last_index);
-        if (wret < 0) {
-            return ret < 0 ? ret : wret;
-        }
-    }
-
     /*
      * Try do undo any updates if an error is returned (This may succeed in
      * some cases like ENOSPC for allocating a new refcount block)
@@ -750,8 +848,11 @@ int qcow2_update_snapshot_refcount(BlockDriverState *bs,
     int64_t old_offset, old_l2_offset;
     int l2_size, i, j, l1_modified, l2_modified, nb_csectors, refcount;
 
+    /* the L2 tables are read from disk below */
+    if (qcow2_l2_flush(bs) < 0) {
+        return -EIO;
+    }
     qcow2_l2_cache_reset(bs);
-    cache_refcount_updates = 1;
 
     l2_table = NULL;
     l1_table = NULL;
@@ -859,15 +960,12 @@ int qcow2_update_snapshot_refcount(BlockDriverState *bs,
     if (l1_allocated)
         g_free(l1_table);
     g_free(l2_table);
-    cache_refcount_updates = 0;
-    write_refcount_block(bs);
-    return 0;
+    return qcow2_refcount_flush(bs);
  fail:
     if (l1_allocated)
         g_free(l1_table);
     g_free(l2_table);
-    cache_refcount_updates = 0;
-    write_refcount_block(bs);
+    qcow2_refcount_flush(bs);
     return -EIO;
 }
 
@@ -1110,6 +1208,14 @@ int qcow2_check_refcounts(BlockDriverState *bs, BdrvCheckResult *res)
     uint16_t *refcount_table;
     int ret;
 
+    /* reserved clusters would show up as leaks, and the tables are read
+     * from disk */
+    qcow2_release_prealloc(bs);
+    ret = qcow2_l2_flush(bs);
+    if (ret < 0) {
+        return ret;
+    }
+
     size = bdrv_getlength(bs->file);
     nb_clusters = size_to_clusters(s, size);
     refcount_table = g_malloc0(nb_clusters * sizeof(uint16_t));
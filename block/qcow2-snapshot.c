@@ -143,6 +143,9 @@ static int qcow_write_snapshots(BlockDriverState *bs)
         return offset;
     }
 
+    if (qcow2_refcount_flush(bs) < 0)
+        goto fail;
+
     for(i = 0; i < s->nb_snapshots; i++) {
         sn = s->snapshots + i;
         memset(&h, 0, sizeof(h));
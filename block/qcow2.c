@@ -28,6 +28,8 @@
 #include "qemu/aes.h"
 #include "block/qcow2.h"
 
+MemCategory qcow2_cache_memory = MEM_CATEGORY_INIT("qcow2.caches");
+
 /*
   Differences with QCOW:
 
@@ -204,12 +206,11 @@ static int qcow_open(BlockDriverState *bs, int flags)
         }
     }
     /* alloc L2 cache */
-    s->l2_cache = g_malloc(s->l2_size * L2_CACHE_SIZE * sizeof(uint64_t));
-    s->cluster_cache = g_malloc(s->cluster_size);
+    qcow2_l2_cache_init(bs, header.size);
+    qcow2_zcache_init(bs);
     /* one more sector for decompressed data alignment */
     s->cluster_data = g_malloc(QCOW_MAX_CRYPT_CLUSTERS * s->cluster_size
                                   + 512);
-    s->cluster_cache_offset = -1;
 
     if (qcow2_refcount_init(bs) < 0)
         goto fail;
@@ -245,8 +246,8 @@ static int qcow_open(BlockDriverState *bs, int flags)
     qcow2_free_snapshots(bs);
     qcow2_refcount_close(bs);
     g_free(s->l1_table);
-    g_free(s->l2_cache);
-    g_free(s->cluster_cache);
+    qcow2_l2_cache_close(bs);
+    qcow2_zcache_close(bs);
     g_free(s->cluster_data);
     return -1;
 }
@@ -452,7 +453,8 @@ static void qcow_aio_read_cb(void *opaque, int ret)
         }
     } else if (acb->cluster_offset & QCOW_OFLAG_COMPRESSED) {
         /* add AIO support for compressed blocks ? */
-        if (qcow2_decompress_cluster(bs, acb->cluster_offset) < 0)
+        if (qcow2_decompress_cluster(bs, acb->sector_num << 9,
+                                     acb->cluster_offset) < 0)
             goto done;
         memcpy(acb->buf, s->cluster_cache + index_in_cluster * 512,
                512 * acb->cur_nr_sectors);
@@ -645,11 +647,8 @@ static BlockDriverAIOCB *qcow_aio_writev(BlockDriverState *bs,
         int64_t sector_num, QEMUIOVector *qiov, int nb_sectors,
         BlockDriverCompletionFunc *cb, void *opaque)
 {
-    BDRVQcowState *s = bs->opaque;
     QCowAIOCB *acb;
 
-    s->cluster_cache_offset = -1; /* disable compressed cache */
-
     acb = qcow_aio_setup(bs, sector_num, qiov, nb_sectors, cb, opaque, 1);
     if (!acb)
         return NULL;
@@ -661,9 +660,12 @@ static BlockDriverAIOCB *qcow_aio_writev(BlockDriverState *bs,
 static void qcow_close(BlockDriverState *bs)
 {
     BDRVQcowState *s = bs->opaque;
+    qcow2_release_prealloc(bs);
+    qcow2_l2_flush(bs);
+    qcow2_refcount_flush(bs);
     g_free(s->l1_table);
-    g_free(s->l2_cache);
-    g_free(s->cluster_cache);
+    qcow2_l2_cache_close(bs);
+    qcow2_zcache_close(bs);
     g_free(s->cluster_data);
     qcow2_refcount_close(bs);
 }
@@ -1167,6 +1169,9 @@ static int qcow_write_compressed(BlockDriverState *bs, int64_t sector_num,
     if (nb_sectors != s->cluster_sectors)
         return -EINVAL;
 
+    /* the new cluster may be stored where a freed one used to be */
+    qcow2_zcache_reset(bs);
+
     out_buf = g_malloc(s->cluster_size + (s->cluster_size / 1000) + 128);
 
     /* best compression, small window, no zlib header */
@@ -1216,12 +1221,16 @@ static int qcow_write_compressed(BlockDriverState *bs, int64_t sector_num,
 
 static void qcow_flush(BlockDriverState *bs)
 {
+    qcow2_l2_flush(bs);
+    qcow2_refcount_flush(bs);
     bdrv_flush(bs->file);
 }
 
 static BlockDriverAIOCB *qcow_aio_flush(BlockDriverState *bs,
          BlockDriverCompletionFunc *cb, void *opaque)
 {
+    qcow2_l2_flush(bs);
+    qcow2_refcount_flush(bs);
     return bdrv_aio_flush(bs->file, cb, opaque);
 }
 
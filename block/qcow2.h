@@ -25,7 +25,9 @@
 #ifndef BLOCK_QCOW2_H
 #define BLOCK_QCOW2_H
 
+#include "android/utils/mem_categories.h"
 #include "qemu/aes.h"
+#include "qemu/thread.h"
 
 //#define DEBUG_ALLOC
 //#define DEBUG_ALLOC2
@@ -49,7 +51,24 @@
 #define MIN_CLUSTER_BITS 9
 #define MAX_CLUSTER_BITS 21
 
-#define L2_CACHE_SIZE 16
+/* The L2 cache holds enough tables to map the whole image, within these
+ * bounds. The upper one can be changed with bdrv_qcow2_set_l2_cache_limit().
+ */
+#define L2_CACHE_MIN_SIZE 16
+#define L2_CACHE_DEFAULT_LIMIT (4 * 1024 * 1024)
+
+/* Number of cached refcount blocks */
+#define REFCOUNT_CACHE_SIZE 4
+
+/* Data clusters are allocated from runs of at least this size */
+#define QCOW2_PREALLOC_SIZE (1024 * 1024)
+
+/* Number of decompressed clusters cached, and of compressed clusters
+ * decompressed ahead by QCOW2_DECOMPRESS_THREADS threads on sequential
+ * reads */
+#define QCOW2_ZCACHE_SIZE 16
+#define QCOW2_READAHEAD_CLUSTERS 4
+#define QCOW2_DECOMPRESS_THREADS 2
 
 typedef struct QCowHeader {
     uint32_t magic;
@@ -78,6 +97,37 @@ typedef struct QCowSnapshot {
     uint64_t vm_clock_nsec;
 } QCowSnapshot;
 
+typedef struct QCowL2CacheEntry {
+    uint64_t offset;    /* offset of the cached table, 0 if unused */
+    int lru_prev;       /* more recently used entry, or -1 */
+    int lru_next;       /* less recently used entry, or -1 */
+    int hash_next;      /* next entry of the same hash bucket, or -1 */
+} QCowL2CacheEntry;
+
+typedef struct QCowRefcountCacheEntry {
+    uint64_t offset;    /* offset of the cached block, 0 if unused */
+    uint16_t *block;
+    uint32_t last_use;
+    int dirty_first;    /* range of modified entries, -1 if clean */
+    int dirty_last;
+} QCowRefcountCacheEntry;
+
+enum {
+    QCOW2_ZCACHE_READY,     /* data is valid, or offset is -1 */
+    QCOW2_ZCACHE_PENDING,   /* waiting for a decompression thread */
+    QCOW2_ZCACHE_BUSY,      /* being decompressed */
+    QCOW2_ZCACHE_FAILED,
+};
+
+typedef struct QCowZCacheEntry {
+    uint64_t offset;    /* offset of the compressed data, -1 if unused */
+    uint8_t *data;      /* decompressed cluster */
+    uint8_t *zdata;     /* compressed data read ahead */
+    int zsize;
+    uint32_t last_use;
+    int state;
+} QCowZCacheEntry;
+
 typedef struct BDRVQcowState {
     BlockDriverState *hd;
     int cluster_bits;
@@ -93,20 +143,48 @@ typedef struct BDRVQcowState {
     uint64_t l1_table_offset;
     uint64_t *l1_table;
     uint64_t *l2_cache;
-    uint64_t l2_cache_offsets[L2_CACHE_SIZE];
-    uint32_t l2_cache_counts[L2_CACHE_SIZE];
+    QCowL2CacheEntry *l2_cache_entries;
+    int *l2_cache_buckets;
+    int l2_cache_size;
+    int l2_cache_mru;
+    int l2_cache_lru;
+    /* range of an L2 table modified in the cache but not written yet */
+    uint64_t l2_pending_offset;
+    int l2_pending_entry;
+    int l2_pending_first;
+    int l2_pending_last;
+    /* the cluster last decompressed, in zcache */
     uint8_t *cluster_cache;
     uint8_t *cluster_data;
-    uint64_t cluster_cache_offset;
+    QCowZCacheEntry zcache[QCOW2_ZCACHE_SIZE];
+    uint32_t zcache_clock;
+    int64_t zcache_next_cluster;    /* guest cluster of a sequential read */
+    /* the decompression threads, started on the first read-ahead */
+    QemuThread zcache_threads[QCOW2_DECOMPRESS_THREADS];
+    int zcache_nb_threads;
+    int zcache_quit;
+    QemuMutex zcache_lock;
+    QemuCond zcache_work_cond;
+    QemuCond zcache_done_cond;
     QLIST_HEAD(QCowClusterAlloc, QCowL2Meta) cluster_allocs;
 
     uint64_t *refcount_table;
     uint64_t refcount_table_offset;
     uint32_t refcount_table_size;
+    /* the refcount block last loaded, in refcount_cache[refcount_cache_current] */
     uint64_t refcount_block_cache_offset;
     uint16_t *refcount_block_cache;
+    QCowRefcountCacheEntry refcount_cache[REFCOUNT_CACHE_SIZE];
+    int refcount_cache_current;
+    uint32_t refcount_cache_clock;
+    int refcount_cache_unflushed;
     int64_t free_cluster_index;
     int64_t free_byte_offset;
+    /* clusters reserved for data, with their refcount already set. Those
+     * at or after prealloc_unwritten have never been written. */
+    int64_t prealloc_offset;
+    int prealloc_clusters;
+    int64_t prealloc_unwritten;
 
     uint32_t crypt_method; /* current crypt method, 0 if no key yet */
     uint32_t crypt_method_header;
@@ -139,6 +217,7 @@ typedef struct QCowL2Meta
     int n_start;
     int nb_available;
     int nb_clusters;
+    int cow_zeroes;  /* the COW areas read as zeroes and are unwritten */
     struct QCowL2Meta *depends_on;
     QLIST_HEAD(QCowAioDependencies, QCowAIOCB) dependent_requests;
 
@@ -170,6 +249,9 @@ int qcow2_backing_read1(BlockDriverState *bs,
                   int64_t sector_num, uint8_t *buf, int nb_sectors);
 
 /* qcow2-refcount.c functions */
+/* The L2, refcount block and decompressed cluster caches of all images */
+extern MemCategory qcow2_cache_memory;
+
 int qcow2_refcount_init(BlockDriverState *bs);
 void qcow2_refcount_close(BlockDriverState *bs);
 
@@ -186,11 +268,20 @@ int qcow2_update_snapshot_refcount(BlockDriverState *bs,
     int64_t l1_table_offset, int l1_size, int addend);
 
 int qcow2_check_refcounts(BlockDriverState *bs, BdrvCheckResult *res);
+int qcow2_refcount_flush(BlockDriverState *bs);
 
 /* qcow2-cluster.c functions */
 int qcow2_grow_l1_table(BlockDriverState *bs, int min_size);
+void qcow2_l2_cache_init(BlockDriverState *bs, int64_t image_size);
+void qcow2_l2_cache_close(BlockDriverState *bs);
 void qcow2_l2_cache_reset(BlockDriverState *bs);
-int qcow2_decompress_cluster(BlockDriverState *bs, uint64_t cluster_offset);
+int qcow2_l2_flush(BlockDriverState *bs);
+void qcow2_release_prealloc(BlockDriverState *bs);
+void qcow2_zcache_init(BlockDriverState *bs);
+void qcow2_zcache_close(BlockDriverState *bs);
+void qcow2_zcache_reset(BlockDriverState *bs);
+int qcow2_decompress_cluster(BlockDriverState *bs, uint64_t offset,
+                             uint64_t cluster_offset);
 void qcow2_encrypt_sectors(BDRVQcowState *s, int64_t sector_num,
                      uint8_t *out_buf, const uint8_t *in_buf,
                      int nb_sectors, int enc,
@@ -20,3 +20,5 @@
 CodeProfileRecordFunc code_profile_record_func = NULL;
 
 const char *code_profile_dirname = NULL;
+
+int code_profile_sample_rate = 0;
@@ -155,7 +155,8 @@ static TranslationBlock *tb_find_slow(CPUArchState *env,
     }
  not_found:
    /* if no translated code available, then translate it now */
-    tb = tb_gen_code(env, pc, cs_base, flags, 0);
+    tb = tb_gen_code(env, pc, cs_base, flags,
+                     tb_hot_threshold > 0 ? CF_COLD : 0);
 
  found:
     /* Move the last found TB to the head of the list */
@@ -169,6 +170,15 @@ static TranslationBlock *tb_find_slow(CPUArchState *env,
     return tb;
 }
 
+/* Record the execution of a TB for the choice of the region to evict.
+   Chained jumps don't come here, but code that keeps running still goes
+   through cpu_exec() at each interrupt or exit request. */
+static inline void tb_region_touch(TranslationBlock *tb)
+{
+    tcg_ctx.tb_ctx.regions[tb->region].last_used =
+            ++tcg_ctx.tb_ctx.region_clock;
+}
+
 static inline TranslationBlock *tb_find_fast(CPUArchState *env)
 {
     TranslationBlock *tb;
@@ -187,6 +197,26 @@ static inline TranslationBlock *tb_find_fast(CPUArchState *env)
     return tb;
 }
 
+void *tb_lookup_ptr(CPUArchState *env)
+{
+    TranslationBlock *tb;
+    target_ulong cs_base, pc;
+    int flags;
+
+    cpu_get_tb_cpu_state(env, &pc, &cs_base, &flags);
+    tb = env->tb_jmp_cache[tb_jmp_cache_hash_func(pc)];
+    /* executions of cold TBs are counted by cpu_exec() */
+    if (unlikely(!tb || tb->pc != pc || tb->cs_base != cs_base ||
+                 tb->flags != flags || (tb->cflags & CF_COLD))) {
+        tcg_ctx.tb_ctx.tb_lookup_ptr_misses++;
+        return tcg_ctx.code_gen_epilogue;
+    }
+    tcg_ctx.tb_ctx.tb_lookup_ptr_hits++;
+    tb_region_touch(tb);
+    env->current_tb = tb;
+    return tb->tc_ptr;
+}
+
 static CPUDebugExcpHandler *debug_excp_handler;
 
 void cpu_set_debug_excp_handler(CPUDebugExcpHandler *handler)
@@ -560,6 +590,14 @@ int cpu_exec(CPUOldState *env)
 #endif /* DEBUG_DISAS || CONFIG_DEBUG_EXEC */
                 spin_lock(&tcg_ctx.tb_ctx.tb_lock);
                 tb = tb_find_fast(env);
+                if (unlikely(tb->cflags & CF_COLD)) {
+                    tb = tb_run_cold(env, tb);
+                    /* jumps to a cold TB are not patched, so that all its
+                       executions are counted here. After a promotion,
+                       next_tb may also be the TB that was replaced. */
+                    next_tb = 0;
+                }
+                tb_region_touch(tb);
                 /* Note: we do it here to avoid a gcc bug on Mac OS X when
                    doing it in tb_find_slow */
                 if (tcg_ctx.tb_ctx.tb_invalidated_flag) {
@@ -569,10 +607,17 @@ int cpu_exec(CPUOldState *env)
                     next_tb = 0;
                     tcg_ctx.tb_ctx.tb_invalidated_flag = 0;
                 }
+                if (qemu_log_binary_mask(CPU_LOG_EXEC)) {
+                    qemu_log_binary(QEMU_LOG_REC_EXEC, tb->pc, tb->size);
+                    /* don't chain TBs, so that each execution is traced */
+                    next_tb = 0;
+                }
 #ifdef CONFIG_DEBUG_EXEC
-                qemu_log_mask(CPU_LOG_EXEC, "Trace 0x%08lx [" TARGET_FMT_lx "] %s\n",
-                             (long)tb->tc_ptr, tb->pc,
-                             lookup_symbol(tb->pc));
+                else {
+                    qemu_log_mask(CPU_LOG_EXEC, "Trace 0x%08lx [" TARGET_FMT_lx "] %s\n",
+                                 (long)tb->tc_ptr, tb->pc,
+                                 lookup_symbol(tb->pc));
+                }
 #endif
                 /* see if we can patch the calling TB. When the TB
                    spans two pages, we cannot safely do a direct
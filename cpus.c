@@ -33,12 +33,38 @@
 #include "sysemu/kvm.h"
 #include "exec/exec-all.h"
 #include "exec/hax.h"
+#include "qemu/thread.h"
 
 #include "sysemu/cpus.h"
+#include "android/governor.h"
+
+#ifdef CONFIG_KVM
+#include <signal.h>
+
+/* Kicks a KVM vCPU thread out of KVM_RUN. The signal is blocked in the
+ * thread, and only unblocked by the kernel while the guest runs, so that
+ * a kick sent just before KVM_RUN is not lost. */
+#define SIG_IPI (SIGRTMIN+4)
+#endif
 
-static CPUState *cur_cpu;
 static CPUState *next_cpu;
 
+/* The global mutex, held by whoever touches the device or timer state:
+ * the main loop outside of select(), the TCG thread, or a KVM/HAX vCPU
+ * thread outside of the hypervisor. */
+static QemuMutex qemu_global_mutex;
+static QemuCond qemu_cpu_cond;      /* a vCPU thread started */
+static QemuCond qemu_pause_cond;    /* a vCPU thread stopped */
+static QemuCond qemu_io_proceeded_cond;
+static int iothread_requesting_mutex;
+
+/* All the TCG vCPUs run in turn on a single thread, which only drops the
+ * global mutex when it has nothing to do or when the main loop asks for
+ * it. With KVM or HAX, each vCPU has its own thread. */
+static QemuThread *tcg_cpu_thread;
+static QemuCond *tcg_halt_cond;
+static CPUState *tcg_current_cpu;
+
 /***********************************************************/
 void hw_error(const char *fmt, ...)
 {
@@ -81,22 +107,215 @@ static int cpu_can_run(CPUArchState *env)
     return 1;
 }
 
-int tcg_has_work(void)
+void qemu_init_cpu_loop(void)
+{
+    qemu_mutex_init(&qemu_global_mutex);
+    qemu_cond_init(&qemu_cpu_cond);
+    qemu_cond_init(&qemu_pause_cond);
+    qemu_cond_init(&qemu_io_proceeded_cond);
+    qemu_mutex_lock(&qemu_global_mutex);
+}
+
+bool qemu_cpu_is_self(CPUState *cpu)
+{
+    /* without vCPU threads, everything runs on the main thread */
+    if (!cpu->thread)
+        return true;
+    return qemu_thread_is_self(cpu->thread);
+}
+
+static bool qemu_in_vcpu_thread(void)
+{
+    return current_cpu && current_cpu->thread &&
+           qemu_thread_is_self(current_cpu->thread);
+}
+
+static void qemu_vcpu_stop(CPUState *cpu)
+{
+    cpu->stop = 0;
+    cpu->stopped = 1;
+    cpu_exit(cpu);
+    qemu_cond_signal(&qemu_pause_cond);
+}
+
+static bool cpu_thread_is_idle(CPUState *cpu)
+{
+    if (cpu->stop)
+        return false;
+    if (cpu->stopped || !vm_running)
+        return true;
+    if (!cpu->halted || cpu_has_work(cpu))
+        return false;
+    return true;
+}
+
+static bool all_cpu_threads_idle(void)
 {
     CPUState *cpu;
 
+    CPU_FOREACH(cpu) {
+        if (!cpu_thread_is_idle(cpu))
+            return false;
+    }
+    return true;
+}
+
+static void qemu_tcg_wait_io_event(void)
+{
+    CPUState *cpu;
+
+    while (all_cpu_threads_idle())
+        qemu_cond_wait(tcg_halt_cond, &qemu_global_mutex);
+
+    /* let the main loop in */
+    while (iothread_requesting_mutex)
+        qemu_cond_wait(&qemu_io_proceeded_cond, &qemu_global_mutex);
+
     CPU_FOREACH(cpu) {
         if (cpu->stop)
-            return 1;
-        if (cpu->stopped)
-            return 0;
-        if (!cpu->halted)
-            return 1;
-        if (cpu_has_work(cpu))
-            return 1;
-        return 0;
+            qemu_vcpu_stop(cpu);
+        cpu->thread_kicked = 0;
     }
-    return 0;
+}
+
+static void qemu_vcpu_wait_io_event(CPUState *cpu)
+{
+    while (cpu_thread_is_idle(cpu))
+        qemu_cond_wait(cpu->halt_cond, &qemu_global_mutex);
+
+    if (cpu->stop)
+        qemu_vcpu_stop(cpu);
+    cpu->thread_kicked = 0;
+}
+
+#ifdef CONFIG_KVM
+static void dummy_signal(int sig)
+{
+}
+
+static void qemu_kvm_init_cpu_signals(CPUState *cpu)
+{
+    struct sigaction sigact;
+    sigset_t set;
+
+    memset(&sigact, 0, sizeof(sigact));
+    sigact.sa_handler = dummy_signal;
+    sigaction(SIG_IPI, &sigact, NULL);
+
+    /* qemu_thread_create() started the thread with all signals blocked */
+    pthread_sigmask(SIG_BLOCK, NULL, &set);
+    sigdelset(&set, SIG_IPI);
+    if (kvm_set_signal_mask(cpu, &set) < 0) {
+        fprintf(stderr, "kvm: can't set the vCPU signal mask\n");
+        exit(1);
+    }
+}
+
+/* drop the kicks that made KVM_RUN return, they were only wake-ups */
+static void qemu_kvm_eat_signals(void)
+{
+    struct timespec ts = { 0, 0 };
+    sigset_t set;
+
+    sigemptyset(&set);
+    sigaddset(&set, SIG_IPI);
+    while (sigtimedwait(&set, NULL, &ts) > 0) {
+    }
+}
+#endif
+
+static void *qemu_vcpu_thread_fn(void *arg)
+{
+    CPUState *cpu = arg;
+    int ret;
+
+    qemu_mutex_lock(&qemu_global_mutex);
+    qemu_thread_get_self(cpu->thread);
+    android_governor_register_vcpu_thread();
+#ifdef CONFIG_KVM
+    if (kvm_enabled())
+        qemu_kvm_init_cpu_signals(cpu);
+#endif
+
+    cpu->created = 1;
+    qemu_cond_signal(&qemu_cpu_cond);
+
+    for (;;) {
+        if (cpu_can_run(cpu->env_ptr)) {
+            ret = cpu_exec(cpu->env_ptr);
+#ifdef CONFIG_KVM
+            if (kvm_enabled())
+                qemu_kvm_eat_signals();
+#endif
+            if (ret == EXCP_DEBUG) {
+                gdb_set_stop_cpu(cpu);
+                debug_requested = 1;
+                qemu_notify_event();
+                qemu_vcpu_stop(cpu);
+            }
+        }
+        qemu_vcpu_wait_io_event(cpu);
+    }
+    return NULL;
+}
+
+static void tcg_exec_all(void);
+
+static void *qemu_tcg_cpu_thread_fn(void *arg)
+{
+    CPUState *cpu = arg;
+
+    qemu_mutex_lock(&qemu_global_mutex);
+    qemu_thread_get_self(cpu->thread);
+    android_governor_register_vcpu_thread();
+
+    cpu->created = 1;
+    qemu_cond_signal(&qemu_cpu_cond);
+
+    for (;;) {
+        tcg_exec_all();
+        qemu_tcg_wait_io_event();
+    }
+    return NULL;
+}
+
+static void qemu_tcg_start_thread(CPUState *cpu)
+{
+    /* the thread waits for vm_start() */
+    cpu->stopped = 1;
+
+    if (tcg_cpu_thread) {
+        /* the other vCPUs share the thread of the first one */
+        cpu->thread = tcg_cpu_thread;
+        cpu->halt_cond = tcg_halt_cond;
+        cpu->created = 1;
+        return;
+    }
+
+    tcg_cpu_thread = g_malloc0(sizeof(QemuThread));
+    tcg_halt_cond = g_malloc0(sizeof(QemuCond));
+    qemu_cond_init(tcg_halt_cond);
+    cpu->thread = tcg_cpu_thread;
+    cpu->halt_cond = tcg_halt_cond;
+
+    qemu_thread_create(cpu->thread, qemu_tcg_cpu_thread_fn, cpu,
+                       QEMU_THREAD_JOINABLE);
+    while (!cpu->created)
+        qemu_cond_wait(&qemu_cpu_cond, &qemu_global_mutex);
+}
+
+static void qemu_vcpu_start_thread(CPUState *cpu)
+{
+    cpu->thread = g_malloc0(sizeof(QemuThread));
+    cpu->halt_cond = g_malloc0(sizeof(QemuCond));
+    qemu_cond_init(cpu->halt_cond);
+
+    /* the thread waits for vm_start() */
+    cpu->stopped = 1;
+    qemu_thread_create(cpu->thread, qemu_vcpu_thread_fn, cpu,
+                       QEMU_THREAD_JOINABLE);
+    while (!cpu->created)
+        qemu_cond_wait(&qemu_cpu_cond, &qemu_global_mutex);
 }
 
 void qemu_init_vcpu(CPUState *cpu)
@@ -107,71 +326,131 @@ void qemu_init_vcpu(CPUState *cpu)
     if (hax_enabled())
         hax_init_vcpu(cpu);
 #endif
-    return;
+    if (kvm_enabled() || hax_enabled())
+        qemu_vcpu_start_thread(cpu);
+    else
+        qemu_tcg_start_thread(cpu);
 }
 
-bool qemu_cpu_is_self(CPUState *cpu)
+/* make the TCG thread leave the translated code */
+static void qemu_tcg_kick(void)
 {
-    return true;
+    CPUState *cpu;
+
+    exit_request = 1;
+    smp_mb();
+    cpu = tcg_current_cpu;
+    if (cpu)
+        cpu_exit(cpu);
 }
 
-void resume_all_vcpus(void)
+static void qemu_cpu_kick_thread(CPUState *cpu)
 {
+    if (cpu->thread == tcg_cpu_thread) {
+        qemu_tcg_kick();
+        return;
+    }
+    cpu_exit(cpu);
+#ifdef CONFIG_HAX
+    /* the HAX module checks this on its way back to the guest, and on
+     * every host interrupt while the guest runs */
+    if (hax_enabled())
+        hax_raise_event(cpu);
+#endif
+#ifdef CONFIG_KVM
+    if (kvm_enabled())
+        pthread_kill(cpu->thread->thread, SIG_IPI);
+#endif
 }
 
-void pause_all_vcpus(void)
+void qemu_cpu_kick(CPUState *cpu)
 {
+    if (!cpu->thread)
+        return;
+
+    qemu_cond_broadcast(cpu->halt_cond);
+    if (!cpu->thread_kicked) {
+        qemu_cpu_kick_thread(cpu);
+        cpu->thread_kicked = 1;
+    }
 }
 
-void qemu_cpu_kick(CPUState *cpu)
+static bool all_vcpus_paused(void)
+{
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        if (!cpu->stopped)
+            return false;
+    }
+    return true;
+}
+
+void pause_all_vcpus(void)
 {
-    return;
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        cpu->stop = 1;
+        qemu_cpu_kick(cpu);
+    }
+    while (!all_vcpus_paused()) {
+        qemu_cond_wait(&qemu_pause_cond, &qemu_global_mutex);
+        CPU_FOREACH(cpu) {
+            qemu_cpu_kick(cpu);
+        }
+    }
 }
 
-// In main-loop.c
-#ifdef _WIN32
-extern HANDLE qemu_event_handle;
-#endif
+void resume_all_vcpus(void)
+{
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        cpu->stop = 0;
+        cpu->stopped = 0;
+        qemu_cpu_kick(cpu);
+    }
+}
 
+/* The vCPUs don't run the main loop, so there is nothing to interrupt
+ * for it to handle an event: it only needs to be woken up. */
 void qemu_notify_event(void)
 {
-    CPUState *cpu = current_cpu;
-
-    if (cpu) {
-        cpu_exit(cpu);
-    /*
-     * This is mainly for the Windows host, where the timer may be in
-     * a different thread with vcpu. Thus the timer function needs to
-     * notify the vcpu thread of more than simply cpu_exit.  If env is
-     * not NULL, it means that the vcpu is in execute state, we need
-     * only to set the flags.  If the guest is in execute state, the
-     * HAX kernel module will exit to qemu.  If env is NULL, vcpu is
-     * in main_loop_wait, and we need a event to notify it.
-     */
-#ifdef CONFIG_HAX
-        if (hax_enabled())
-            hax_raise_event(cpu);
-     } else {
-#ifdef _WIN32
-         if(hax_enabled())
-             SetEvent(qemu_event_handle);
-#endif
-     }
-#else
-     }
-#endif
+    qemu_main_loop_wakeup();
 }
 
 void qemu_mutex_lock_iothread(void)
 {
+    /* the TCG thread only drops the mutex when it is asked to */
+    if (!tcg_cpu_thread) {
+        qemu_mutex_lock(&qemu_global_mutex);
+        return;
+    }
+
+    iothread_requesting_mutex = 1;
+    if (qemu_mutex_trylock(&qemu_global_mutex)) {
+        qemu_tcg_kick();
+        qemu_mutex_lock(&qemu_global_mutex);
+    }
+    iothread_requesting_mutex = 0;
+    qemu_cond_broadcast(&qemu_io_proceeded_cond);
 }
 
 void qemu_mutex_unlock_iothread(void)
 {
+    qemu_mutex_unlock(&qemu_global_mutex);
 }
 
 void vm_stop(int reason)
 {
+    if (qemu_in_vcpu_thread()) {
+        /* pause_all_vcpus() would wait for this thread, let the main
+         * loop stop the others */
+        qemu_system_vmstop_request(reason);
+        qemu_vcpu_stop(current_cpu);
+        return;
+    }
     do_vm_stop(reason);
 }
 
@@ -216,29 +495,35 @@ static int qemu_cpu_exec(CPUOldState *env)
     return ret;
 }
 
-void tcg_cpu_exec(void)
+/* Run the vCPUs in turn, until the main loop wants the global mutex or
+ * a vCPU stops. The round robin resumes where it left off. */
+static void tcg_exec_all(void)
 {
-    int ret = 0;
+    int ret;
 
     if (next_cpu == NULL)
-        next_cpu = QTAILQ_FIRST(&cpus);
-    for (; next_cpu != NULL; next_cpu = QTAILQ_NEXT(next_cpu, node)) {\
-        cur_cpu = next_cpu;
-        CPUOldState *env = cur_cpu->env_ptr;
-
-        if (!vm_running)
-            break;
-        if (qemu_timer_alarm_pending()) {
-            break;
-        }
-        if (cpu_can_run(env))
+        next_cpu = first_cpu;
+    for (; next_cpu != NULL && !exit_request; next_cpu = CPU_NEXT(next_cpu)) {
+        CPUState *cpu = next_cpu;
+        CPUOldState *env = cpu->env_ptr;
+
+        if (cpu_can_run(env)) {
+            tcg_current_cpu = cpu;
+            smp_mb();
             ret = qemu_cpu_exec(env);
-        if (ret == EXCP_DEBUG) {
-            gdb_set_stop_cpu(cur_cpu);
-            debug_requested = 1;
+            tcg_current_cpu = NULL;
+            if (ret == EXCP_DEBUG) {
+                gdb_set_stop_cpu(cpu);
+                debug_requested = 1;
+                qemu_notify_event();
+                qemu_vcpu_stop(cpu);
+                break;
+            }
+        } else if (cpu->stop || cpu->stopped) {
             break;
         }
     }
+    exit_request = 0;
 }
 
 /***********************************************************/
@@ -22,9 +22,11 @@
 #include "exec/exec-all.h"
 #include "exec/cputlb.h"
 #include "exec/ram_addr.h"
+#include "android/utils/perf_counters.h"
 
 /* statistics */
 int tlb_flush_count;
+int tlb_victim_hit_count;
 
 static const CPUTLBEntry s_cputlb_empty_entry = {
     .addr_read  = -1,
@@ -45,10 +47,14 @@ static const CPUTLBEntry s_cputlb_empty_entry = {
  * entries from the TLB at any time, so flushing more entries than
  * required is only an efficiency issue, not a correctness issue.
  */
+static PerfCounter tlb_flushes_counter =
+    PERF_COUNTER_INIT("tcg.tlb_flushes", "flushes");
+
 void tlb_flush(CPUArchState *env, int flush_global)
 {
     int i;
 
+    perfCounter_add(&tlb_flushes_counter, 1);
 #if defined(DEBUG_TLB)
     printf("tlb_flush:\n");
 #endif
@@ -63,6 +69,14 @@ void tlb_flush(CPUArchState *env, int flush_global)
             env->tlb_table[mmu_idx][i] = s_cputlb_empty_entry;
         }
     }
+    for (i = 0; i < CPU_VTLB_SIZE; i++) {
+        int mmu_idx;
+
+        for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+            env->tlb_v_table[mmu_idx][i] = s_cputlb_empty_entry;
+        }
+    }
+    env->vtlb_index = 0;
 
     memset(env->tb_jmp_cache, 0, TB_JMP_CACHE_SIZE * sizeof (void *));
 
@@ -71,14 +85,20 @@ void tlb_flush(CPUArchState *env, int flush_global)
     tlb_flush_count++;
 }
 
+static inline bool tlb_entry_is_page(const CPUTLBEntry *tlb_entry,
+                                     target_ulong addr)
+{
+    return addr == (tlb_entry->addr_read &
+                    (TARGET_PAGE_MASK | TLB_INVALID_MASK)) ||
+           addr == (tlb_entry->addr_write &
+                    (TARGET_PAGE_MASK | TLB_INVALID_MASK)) ||
+           addr == (tlb_entry->addr_code &
+                    (TARGET_PAGE_MASK | TLB_INVALID_MASK));
+}
+
 static inline void tlb_flush_entry(CPUTLBEntry *tlb_entry, target_ulong addr)
 {
-    if (addr == (tlb_entry->addr_read &
-                 (TARGET_PAGE_MASK | TLB_INVALID_MASK)) ||
-        addr == (tlb_entry->addr_write &
-                 (TARGET_PAGE_MASK | TLB_INVALID_MASK)) ||
-        addr == (tlb_entry->addr_code &
-                 (TARGET_PAGE_MASK | TLB_INVALID_MASK))) {
+    if (tlb_entry_is_page(tlb_entry, addr)) {
         *tlb_entry = s_cputlb_empty_entry;
     }
 }
@@ -111,6 +131,14 @@ void tlb_flush_page(CPUArchState *env, target_ulong addr)
         tlb_flush_entry(&env->tlb_table[mmu_idx][i], addr);
     }
 
+    /* check whether there are entries that need to be flushed in the vtlb */
+    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        int k;
+        for (k = 0; k < CPU_VTLB_SIZE; k++) {
+            tlb_flush_entry(&env->tlb_v_table[mmu_idx][k], addr);
+        }
+    }
+
     tb_flush_jmp_cache(env, addr);
 }
 
@@ -165,6 +193,10 @@ void cpu_tlb_reset_dirty_all(ram_addr_t start1, ram_addr_t length)
                 tlb_reset_dirty_range(&env->tlb_table[mmu_idx][i],
                                       start1, length);
             }
+            for (i = 0; i < CPU_VTLB_SIZE; i++) {
+                tlb_reset_dirty_range(&env->tlb_v_table[mmu_idx][i],
+                                      start1, length);
+            }
         }
     }
 }
@@ -188,6 +220,40 @@ void tlb_set_dirty(CPUArchState *env, target_ulong vaddr)
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
         tlb_set_dirty1(&env->tlb_table[mmu_idx][i], vaddr);
     }
+
+    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        int k;
+        for (k = 0; k < CPU_VTLB_SIZE; k++) {
+            tlb_set_dirty1(&env->tlb_v_table[mmu_idx][k], vaddr);
+        }
+    }
+}
+
+bool tlb_victim_hit(CPUArchState *env, int mmu_idx, int index,
+                    size_t elt_ofs, target_ulong addr)
+{
+    int vidx;
+
+    addr &= TARGET_PAGE_MASK;
+    for (vidx = 0; vidx < CPU_VTLB_SIZE; vidx++) {
+        CPUTLBEntry *vtlb = &env->tlb_v_table[mmu_idx][vidx];
+        target_ulong cmp = *(target_ulong *)((uintptr_t)vtlb + elt_ofs);
+
+        if ((cmp & (TARGET_PAGE_MASK | TLB_INVALID_MASK)) == addr) {
+            /* swap the entries, so that the one that was in tlb_table
+               is not lost either */
+            CPUTLBEntry tmptlb = env->tlb_table[mmu_idx][index];
+            hwaddr tmpiotlb = env->iotlb[mmu_idx][index];
+
+            env->tlb_table[mmu_idx][index] = *vtlb;
+            env->iotlb[mmu_idx][index] = env->iotlb_v[mmu_idx][vidx];
+            *vtlb = tmptlb;
+            env->iotlb_v[mmu_idx][vidx] = tmpiotlb;
+            tlb_victim_hit_count++;
+            return true;
+        }
+    }
+    return false;
 }
 
 /* Our TLB does not support large pages, so remember the area covered by
@@ -287,8 +353,22 @@ void tlb_set_page(CPUArchState *env, target_ulong vaddr,
     }
 
     index = (vaddr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
-    env->iotlb[mmu_idx][index] = iotlb - vaddr;
     te = &env->tlb_table[mmu_idx][index];
+
+    /* keep the entry that is replaced in the victim TLB, unless it is
+       empty or for the same page */
+    if (te->addr_read != (target_ulong)-1 ||
+        te->addr_write != (target_ulong)-1 ||
+        te->addr_code != (target_ulong)-1) {
+        if (!tlb_entry_is_page(te, vaddr & TARGET_PAGE_MASK)) {
+            unsigned vidx = env->vtlb_index++ % CPU_VTLB_SIZE;
+
+            env->tlb_v_table[mmu_idx][vidx] = *te;
+            env->iotlb_v[mmu_idx][vidx] = env->iotlb[mmu_idx][index];
+        }
+    }
+
+    env->iotlb[mmu_idx][index] = iotlb - vaddr;
     te->addend = addend - vaddr;
     if (prot & PAGE_READ) {
         te->addr_read = address;
@@ -32,6 +32,13 @@ ifneq (,$(strip $(EMUGL_BUILD_DEBUG)))
 EMUGL_COMMON_CFLAGS += -O0 -g -DEMUGL_DEBUG=1
 endif
 
+# Define EMUGL_LOCK_PROFILING=1 in your environment to record the
+# contention of the named emugl::Mutex instances, see
+# shared/emugl/common/mutex.h.
+ifneq (,$(strip $(EMUGL_LOCK_PROFILING)))
+EMUGL_COMMON_CFLAGS += -DEMUGL_LOCK_PROFILING=1
+endif
+
 EMUGL_COMMON_CFLAGS += -DEMUGL_BUILD=1
 ifeq (linux,$(HOST_OS))
 EMUGL_COMMON_CFLAGS += -fvisibility=internal
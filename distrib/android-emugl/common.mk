@@ -238,6 +238,39 @@ LOCAL_GENERATED_SOURCES += $$(GEN)
 LOCAL_C_INCLUDES += $$1
 endef
 
+# This function can be called to generate the stream replayer source files
+# of a given API. Just like emugl-gen-decoder, the files are stored in the
+# local intermediates directory. The module must also import the
+# corresponding decoder library, whose headers are needed.
+#
+# Usage:
+#    $(call emugl-gen-replayer,<input-dir>,<basename>)
+#
+emugl-gen-replayer = \
+    $(eval _emugl_out := $(call local-intermediates-dir))\
+    $(call emugl-gen-replayer-generic,$(_emugl_out),$1,$2)
+
+# DO NOT CALL DIRECTLY, USE emugl-gen-replayer instead.
+#
+#  $(call emugl-gen-replayer-generic,<dst-dir>,<src-dir>,<basename>)
+#
+emugl-gen-replayer-generic = $(eval $(emugl-gen-replayer-generic-ev))
+
+define emugl-gen-replayer-generic-ev
+_emugl_rep := $$1/$$3
+_emugl_src := $$2/$$3
+GEN := $$(_emugl_rep)_replay.cpp \
+       $$(_emugl_rep)_replay.h
+
+$$(GEN): PRIVATE_PATH := $$(LOCAL_PATH)
+$$(GEN): PRIVATE_CUSTOM_TOOL := $$(EMUGL_EMUGEN) -R $$1 -i $$2 $$3
+$$(GEN): $$(EMUGL_EMUGEN) $$(_emugl_src).attrib $$(_emugl_src).in $$(_emugl_src).types
+	$$(transform-generated-source)
+
+LOCAL_GENERATED_SOURCES += $$(GEN)
+LOCAL_C_INCLUDES += $$1
+endef
+
 # Call this function when your shared library must be placed in a non-standard
 # library path (i.e. not under /system/lib
 # $1: library sub-path,relative to /system/lib
@@ -61,6 +61,19 @@ int GLESv1Decoder::initGL(get_proc_func_t getProcFunc, void *getProcFuncData)
         this->initDispatchByName(getProcFunc, getProcFuncData);
     }
 
+    initDecoderFuncs();
+    return 0;
+}
+
+int GLESv1Decoder::initGL(const gles1_server_base_t& dispatch)
+{
+    *static_cast<gles1_server_base_t*>(this) = dispatch;
+    initDecoderFuncs();
+    return 0;
+}
+
+void GLESv1Decoder::initDecoderFuncs()
+{
     glGetCompressedTextureFormats = s_glGetCompressedTextureFormats;
     glVertexPointerOffset = s_glVertexPointerOffset;
     glColorPointerOffset = s_glColorPointerOffset;
@@ -81,8 +94,6 @@ int GLESv1Decoder::initGL(get_proc_func_t getProcFunc, void *getProcFuncData)
     glDrawElementsOffset = s_glDrawElementsOffset;
     glDrawElementsData = s_glDrawElementsData;
     glFinishRoundTrip = s_glFinishRoundTrip;
-
-    return 0;
 }
 
 int GLESv1Decoder::s_glFinishRoundTrip(void *self)
@@ -33,9 +33,14 @@ public:
     GLESv1Decoder();
     ~GLESv1Decoder();
     int initGL(get_proc_func_t getProcFunc = NULL, void *getProcFuncData = NULL);
+    // Same as initGL(), but copies the entry points of |dispatch|, which
+    // must already be initialized, instead of looking them up by name.
+    int initGL(const gles1_server_base_t& dispatch);
     void setContextData(GLDecoderContextData *contextData) { m_contextData = contextData; }
 
 private:
+    void initDecoderFuncs();
+
     static void gles1_APIENTRY s_glGetCompressedTextureFormats(void * self, GLint cont, GLint *data);
     static void gles1_APIENTRY s_glVertexPointerData(void *self, GLint size, GLenum type, GLsizei stride, void *data, GLuint datalen);
     static void gles1_APIENTRY s_glVertexPointerOffset(void *self, GLint size, GLenum type, GLsizei stride, GLuint offset);
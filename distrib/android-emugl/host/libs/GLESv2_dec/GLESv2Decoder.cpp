@@ -74,6 +74,19 @@ int GLESv2Decoder::initGL(get_proc_func_t getProcFunc, void *getProcFuncData)
         this->initDispatchByName(getProcFunc, getProcFuncData);
     }
 
+    initDecoderFuncs();
+    return 0;
+}
+
+int GLESv2Decoder::initGL(const gles2_server_base_t& dispatch)
+{
+    *static_cast<gles2_server_base_t*>(this) = dispatch;
+    initDecoderFuncs();
+    return 0;
+}
+
+void GLESv2Decoder::initDecoderFuncs()
+{
     glGetCompressedTextureFormats = s_glGetCompressedTextureFormats;
     glVertexAttribPointerData = s_glVertexAttribPointerData;
     glVertexAttribPointerOffset = s_glVertexAttribPointerOffset;
@@ -82,8 +95,6 @@ int GLESv2Decoder::initGL(get_proc_func_t getProcFunc, void *getProcFuncData)
     glDrawElementsData = s_glDrawElementsData;
     glShaderString = s_glShaderString;
     glFinishRoundTrip = s_glFinishRoundTrip;
-    return 0;
-
 }
 
 int GLESv2Decoder::s_glFinishRoundTrip(void *self)
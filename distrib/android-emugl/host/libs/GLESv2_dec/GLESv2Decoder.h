@@ -31,8 +31,13 @@ public:
     GLESv2Decoder();
     ~GLESv2Decoder();
     int initGL(get_proc_func_t getProcFunc = NULL, void *getProcFuncData = NULL);
+    // Same as initGL(), but copies the entry points of |dispatch|, which
+    // must already be initialized, instead of looking them up by name.
+    int initGL(const gles2_server_base_t& dispatch);
     void setContextData(GLDecoderContextData *contextData) { m_contextData = contextData; }
 private:
+    void initDecoderFuncs();
+
     GLDecoderContextData *m_contextData;
     emugl::SharedLibrary* m_GL2library;
 
@@ -43,6 +43,12 @@ EglDisplay::~EglDisplay() {
         m_idpy->destroyContext(m_globalSharedContext);
     }
 
+    for (std::map<EglConfig*, EglOS::Surface*>::iterator it =
+            m_anchorPbuffers.begin(); it != m_anchorPbuffers.end(); ++it) {
+        m_idpy->releasePbuffer(it->second);
+        delete it->second;
+    }
+
     m_idpy->release();
 
     for(ConfigsList::iterator it = m_configs.begin();
@@ -404,3 +410,39 @@ void EglDisplay::addConfig(void* opaque, const EglOS::ConfigInfo* info) {
 
     display->m_configs.push_back(config);
 }
+
+EglOS::Surface* EglDisplay::getAnchorPbuffer(EglConfig* cfg) {
+    emugl::Mutex::AutoLock mutex(m_lock);
+    std::map<EglConfig*, EglOS::Surface*>::iterator it =
+            m_anchorPbuffers.find(cfg);
+    if (it != m_anchorPbuffers.end()) {
+        return it->second;
+    }
+
+    EglOS::PbufferInfo info;
+    info.width = 1;
+    info.height = 1;
+    info.largest = EGL_FALSE;
+    info.target = EGL_NO_TEXTURE;
+    info.format = EGL_NO_TEXTURE;
+    info.hasMipmap = EGL_FALSE;
+    EglOS::Surface* pb = m_idpy->createPbufferSurface(cfg->nativeFormat(),
+                                                      &info);
+    if (pb) {
+        m_anchorPbuffers[cfg] = pb;
+    }
+    return pb;
+}
+
+void EglDisplay::addOrphanRenderbuffers(const unsigned int* names,
+                                        int count) {
+    emugl::Mutex::AutoLock mutex(m_lock);
+    m_orphanRenderbuffers.insert(m_orphanRenderbuffers.end(),
+                                 names, names + count);
+}
+
+void EglDisplay::takeOrphanRenderbuffers(std::vector<unsigned int>* names) {
+    emugl::Mutex::AutoLock mutex(m_lock);
+    names->swap(m_orphanRenderbuffers);
+    m_orphanRenderbuffers.clear();
+}
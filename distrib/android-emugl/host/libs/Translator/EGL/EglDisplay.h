@@ -18,6 +18,7 @@
 
 #include <list>
 #include <map>
+#include <vector>
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 #include "emugl/common/mutex.h"
@@ -88,6 +89,18 @@ public:
     bool destroyImageKHR(EGLImageKHR img);
     EglOS::Context* getGlobalSharedContext() const;
 
+    // Return the native pbuffer that all the FBO-backed pbuffer surfaces
+    // of |cfg| are made current with, see EglPbufferSurface.h, creating
+    // it on first use. Return NULL on failure.
+    EglOS::Surface* getAnchorPbuffer(EglConfig* cfg);
+
+    // Queue the |count| host renderbuffers of a destroyed FBO-backed
+    // surface, to be deleted once a context is current.
+    void addOrphanRenderbuffers(const unsigned int* names, int count);
+
+    // Move the queued renderbuffers to |names|, for deletion by the caller.
+    void takeOrphanRenderbuffers(std::vector<unsigned int>* names);
+
 private:
    static void addConfig(void* opaque, const EglOS::ConfigInfo* configInfo);
 
@@ -108,6 +121,8 @@ private:
    ImagesHndlMap           m_eglImages;
    unsigned int            m_nextEglImageId;
    mutable EglOS::Context* m_globalSharedContext;
+   std::map<EglConfig*, EglOS::Surface*> m_anchorPbuffers;
+   std::vector<unsigned int> m_orphanRenderbuffers;
 };
 
 #endif
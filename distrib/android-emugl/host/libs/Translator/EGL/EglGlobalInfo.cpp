@@ -20,6 +20,9 @@
 #include "EglOsApi.h"
 
 #include "emugl/common/lazy_instance.h"
+#include "OpenglCodecCommon/ErrorLog.h"
+
+#include <stdlib.h>
 
 #include <string.h>
 
@@ -40,8 +43,19 @@ EglGlobalInfo::EglGlobalInfo() :
         m_engine(NULL),
         m_display(NULL),
         m_lock() {
-    // TODO(digit): Choose alternate engine based on env. variable?
-    m_engine = EglOS::Engine::getHostInstance();
+    // ANDROID_GL_HEADLESS=1 selects the engine that doesn't need a window
+    // system, see emuglConfig_setupEnv().
+    const char* env = getenv("ANDROID_GL_HEADLESS");
+    if (env && !strcmp(env, "1")) {
+        m_engine = EglOS::Engine::getHeadlessInstance();
+        if (!m_engine) {
+            ERR("%s: Headless rendering is not available, using the "
+                "default engine\n", __FUNCTION__);
+        }
+    }
+    if (!m_engine) {
+        m_engine = EglOS::Engine::getHostInstance();
+    }
     m_display = m_engine->getDefaultDisplay();
 
     memset(m_gles_ifaces, 0, sizeof(m_gles_ifaces));
@@ -586,6 +586,15 @@ EGLAPI EGLSurface EGLAPIENTRY eglCreatePbufferSurface(
 
     tmpPbSurfacePtr->getAttrib(EGL_MIPMAP_TEXTURE, &pbinfo.hasMipmap);
 
+    if (EglPbufferSurface::fboSurfacesEnabled() &&
+        tmpPbSurfacePtr->canBeFramebufferBacked()) {
+        EglOS::Surface* anchor = dpy->getAnchorPbuffer(cfg);
+        if (anchor) {
+            tmpPbSurfacePtr->setFramebufferBacked(anchor);
+            return dpy->addSurface(pbSurface);
+        }
+    }
+
     EglOS::Surface* pb = dpy->nativeType()->createPbufferSurface(
             cfg->nativeFormat(), &pbinfo);
     if(!pb) {
@@ -683,11 +692,51 @@ EGLAPI EGLContext EGLAPIENTRY eglCreateContext(EGLDisplay display, EGLConfig con
 return EGL_NO_CONTEXT;
 }
 
+// Delete the host objects owned by the GLES context of |ctx|, which was
+// destroyed and isn't current on the calling thread. The objects are shared
+// with the global context of the display, so they are not released with the
+// native context. This binds the native context to the anchor pbuffer of its
+// config, and restores the binding of the thread. Nothing is done if |ctx| is
+// still current on another thread, which will do it when releasing it.
+static void destroyContextGLObjects(EglDisplay* dpy, ContextPtr ctx) {
+    const GLESiface* iface = g_eglInfo->getIface(ctx->version());
+    if (!iface->hasGLObjects(ctx->getGlesContext())) {
+        return;
+    }
+    EglOS::Surface* pbuffer = dpy->getAnchorPbuffer(ctx->getConfig());
+    if (!pbuffer) {
+        return;
+    }
+
+    ContextPtr prevCtx = getThreadInfo()->eglContext;
+    if (prevCtx.Ptr()) {
+        g_eglInfo->getIface(prevCtx->version())->flush();
+    }
+    if (!dpy->nativeType()->makeCurrent(pbuffer, pbuffer, ctx->nativeType())) {
+        return;
+    }
+    iface->destroyGLObjects(ctx->getGlesContext());
+    iface->flush();
+
+    if (prevCtx.Ptr() && prevCtx->read().Ptr() && prevCtx->draw().Ptr()) {
+        dpy->nativeType()->makeCurrent(prevCtx->read()->native(),
+                                       prevCtx->draw()->native(),
+                                       prevCtx->nativeType());
+    } else {
+        dpy->nativeType()->makeCurrent(NULL, NULL, NULL);
+    }
+}
+
 EGLAPI EGLBoolean EGLAPIENTRY eglDestroyContext(EGLDisplay display, EGLContext context) {
     VALIDATE_DISPLAY(display);
     VALIDATE_CONTEXT(context);
 
     dpy->removeContext(context);
+    // A context current on this thread is cleaned up when it is released,
+    // see eglMakeCurrent().
+    if (getThreadInfo()->eglContext.Ptr() != ctx.Ptr()) {
+        destroyContextGLObjects(dpy, ctx);
+    }
     return EGL_TRUE;
 }
 
@@ -705,8 +754,17 @@ EGLAPI EGLBoolean EGLAPIENTRY eglMakeCurrent(EGLDisplay display,
     ThreadInfo* thread = getThreadInfo();
     ContextPtr prevCtx = thread->eglContext;
 
+    // The host objects of a destroyed context must be deleted while it is
+    // still current, see destroyContextGLObjects().
+    bool prevDestroyed = prevCtx.Ptr() && prevCtx.Ptr() != dpy->getContext(
+            reinterpret_cast<EGLContext>(prevCtx->getHndl())).Ptr();
+
     if(releaseContext) { //releasing current context
        if(prevCtx.Ptr()) {
+           if (prevDestroyed) {
+               g_eglInfo->getIface(prevCtx->version())->destroyGLObjects(
+                       prevCtx->getGlesContext());
+           }
            g_eglInfo->getIface(prevCtx->version())->flush();
            if(!dpy->nativeType()->makeCurrent(NULL,NULL,NULL)) {
                RETURN_ERROR(EGL_FALSE,EGL_BAD_ACCESS);
@@ -755,21 +813,45 @@ EGLAPI EGLBoolean EGLAPIENTRY eglMakeCurrent(EGLDisplay display,
             RETURN_ERROR(EGL_FALSE,EGL_BAD_NATIVE_WINDOW);
         }
 
-        if(prevCtx.Ptr()) {
-            g_eglInfo->getIface(prevCtx->version())->flush();
-        }
-        if (!dpy->nativeType()->makeCurrent(
-                newReadPtr->native(),
-                newDrawPtr->native(),
-                newCtx->nativeType())) {
-               RETURN_ERROR(EGL_FALSE,EGL_BAD_ACCESS);
+        // FBO-backed surfaces of a config share their native pbuffer, so
+        // the native context and drawables may be current already.
+        bool sameNative = newCtx.Ptr() == prevCtx.Ptr() &&
+                          prevCtx->read().Ptr() && prevCtx->draw().Ptr() &&
+                          prevCtx->read()->native() == nativeRead &&
+                          prevCtx->draw()->native() == nativeDraw;
+        if (!sameNative) {
+            if(prevCtx.Ptr()) {
+                if (prevDestroyed) {
+                    g_eglInfo->getIface(prevCtx->version())->destroyGLObjects(
+                            prevCtx->getGlesContext());
+                }
+                g_eglInfo->getIface(prevCtx->version())->flush();
+            }
+            if (!dpy->nativeType()->makeCurrent(
+                    newReadPtr->native(),
+                    newDrawPtr->native(),
+                    newCtx->nativeType())) {
+                   RETURN_ERROR(EGL_FALSE,EGL_BAD_ACCESS);
+            }
         }
         //TODO: handle the following errors
         // EGL_BAD_CURRENT_SURFACE , EGL_CONTEXT_LOST  , EGL_BAD_ACCESS
 
         thread->updateInfo(newCtx,dpy,newCtx->getGlesContext(),newCtx->getShareGroup(),dpy->getManager(newCtx->version()));
         newCtx->setSurfaces(newReadSrfc,newDrawSrfc);
-        g_eglInfo->getIface(newCtx->version())->initContext(newCtx->getGlesContext(),newCtx->getShareGroup());
+        const GLESiface* iface = g_eglInfo->getIface(newCtx->version());
+        iface->initContext(newCtx->getGlesContext(),newCtx->getShareGroup());
+
+        // An FBO-backed draw surface is also used for reading, since the
+        // framebuffer objects have a single binding.
+        iface->setSurfaceFramebuffer(newCtx->getGlesContext(),
+                                     newDrawPtr->framebuffer());
+
+        std::vector<unsigned int> orphans;
+        dpy->takeOrphanRenderbuffers(&orphans);
+        if (!orphans.empty()) {
+            iface->deleteRenderbuffers(orphans.size(), &orphans[0]);
+        }
 
         // Initialize the GLES extension function table used in
         // eglGetProcAddress for the context's GLES version if not
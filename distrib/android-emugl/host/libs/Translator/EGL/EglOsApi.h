@@ -181,6 +181,12 @@ public:
     // Retrieve the implementation for the current host. This can be called
     // multiple times, and will initialize the engine on first call.
     static Engine* getHostInstance();
+
+    // Retrieve an implementation that renders to pbuffers through the
+    // host's EGL, without any window system (e.g. on a GPU server without
+    // an X display), or NULL if the host doesn't support it. Its displays
+    // have no window-capable configs. Only available on Linux.
+    static Engine* getHeadlessInstance();
 };
 
 }  // namespace EglOS
@@ -393,3 +393,8 @@ emugl::LazyInstance<MacEngine> sHostEngine = LAZY_INSTANCE_INIT;
 EglOS::Engine* EglOS::Engine::getHostInstance() {
     return sHostEngine.ptr();
 }
+
+// static
+EglOS::Engine* EglOS::Engine::getHeadlessInstance() {
+    return NULL;
+}
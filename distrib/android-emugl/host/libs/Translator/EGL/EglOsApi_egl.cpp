@@ -0,0 +1,494 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// An EglOS::Engine implementation that renders through the host's own EGL
+// library, without a window system. It uses either the Mesa 'surfaceless'
+// platform, or the first GPU returned by the EGL device enumeration
+// extension (e.g. NVIDIA drivers), and only supports pbuffer surfaces,
+// which is all the renderer needs when the emulator runs with -no-window.
+//
+// The host library is loaded at runtime, and its entry points are only
+// called through function pointers, since the names clash with the ones
+// exported by the translator itself.
+
+#include "EglOsApi.h"
+
+#include "emugl/common/lazy_instance.h"
+#include "emugl/common/shared_library.h"
+#include "GLcommon/GLLibrary.h"
+
+#include "OpenglCodecCommon/ErrorLog.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#ifndef EGL_PLATFORM_DEVICE_EXT
+#define EGL_PLATFORM_DEVICE_EXT 0x313F
+#endif
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+namespace {
+
+typedef void* HostEGLDeviceEXT;
+
+// The subset of the host's EGL API used by this engine.
+#define LIST_HOST_EGL_FUNCTIONS(X) \
+  X(EGLint, eglGetError, (void)) \
+  X(EGLBoolean, eglInitialize, (EGLDisplay dpy, EGLint* major, EGLint* minor)) \
+  X(const char*, eglQueryString, (EGLDisplay dpy, EGLint name)) \
+  X(EGLBoolean, eglBindAPI, (EGLenum api)) \
+  X(EGLBoolean, eglChooseConfig, (EGLDisplay dpy, const EGLint* attribs, EGLConfig* configs, EGLint configSize, EGLint* numConfig)) \
+  X(EGLBoolean, eglGetConfigAttrib, (EGLDisplay dpy, EGLConfig config, EGLint attribute, EGLint* value)) \
+  X(EGLContext, eglCreateContext, (EGLDisplay dpy, EGLConfig config, EGLContext shareContext, const EGLint* attribs)) \
+  X(EGLBoolean, eglDestroyContext, (EGLDisplay dpy, EGLContext ctx)) \
+  X(EGLSurface, eglCreatePbufferSurface, (EGLDisplay dpy, EGLConfig config, const EGLint* attribs)) \
+  X(EGLBoolean, eglDestroySurface, (EGLDisplay dpy, EGLSurface surface)) \
+  X(EGLBoolean, eglMakeCurrent, (EGLDisplay dpy, EGLSurface draw, EGLSurface read, EGLContext ctx)) \
+  X(GlLibrary::GlFunctionPointer, eglGetProcAddress, (const char* name)) \
+
+// Extensions, resolved with eglGetProcAddress().
+#define LIST_HOST_EGL_EXTENSIONS(X) \
+  X(EGLDisplay, eglGetPlatformDisplayEXT, (EGLenum platform, void* nativeDisplay, const EGLint* attribs)) \
+  X(EGLBoolean, eglQueryDevicesEXT, (EGLint maxDevices, HostEGLDeviceEXT* devices, EGLint* numDevices)) \
+
+#define HOST_EGL_DECLARE_MEMBER(ret, name, sig) ret (*name) sig;
+
+struct HostEgl {
+    LIST_HOST_EGL_FUNCTIONS(HOST_EGL_DECLARE_MEMBER)
+    LIST_HOST_EGL_EXTENSIONS(HOST_EGL_DECLARE_MEMBER)
+};
+
+// Return true iff |extension| appears in the space-separated |list|.
+bool hasExtension(const char* list, const char* extension) {
+    if (!list) {
+        return false;
+    }
+    size_t len = strlen(extension);
+    for (const char* p = list; (p = strstr(p, extension)) != NULL; p += len) {
+        if ((p == list || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Implementation of EglOS::PixelFormat based on a host EGLConfig.
+class SurfacelessPixelFormat : public EglOS::PixelFormat {
+public:
+    explicit SurfacelessPixelFormat(EGLConfig config) : mConfig(config) {}
+
+    virtual EglOS::PixelFormat* clone() {
+        return new SurfacelessPixelFormat(mConfig);
+    }
+
+    static EGLConfig from(const EglOS::PixelFormat* f) {
+        return static_cast<const SurfacelessPixelFormat*>(f)->mConfig;
+    }
+
+private:
+    EGLConfig mConfig;
+};
+
+// Implementation of EglOS::Surface based on a host pbuffer.
+class SurfacelessSurface : public EglOS::Surface {
+public:
+    explicit SurfacelessSurface(EGLSurface surface) :
+            Surface(PBUFFER), mSurface(surface) {}
+
+    static EGLSurface from(EglOS::Surface* s) {
+        return static_cast<SurfacelessSurface*>(s)->mSurface;
+    }
+
+private:
+    EGLSurface mSurface;
+};
+
+// Implementation of EglOS::Context based on a host EGLContext.
+class SurfacelessContext : public EglOS::Context {
+public:
+    explicit SurfacelessContext(EGLContext context) : mContext(context) {}
+
+    static EGLContext from(EglOS::Context* c) {
+        return static_cast<SurfacelessContext*>(c)->mContext;
+    }
+
+private:
+    EGLContext mContext;
+};
+
+// Implementation of EglOS::Display based on a host EGLDisplay.
+//
+// The current client API is per-thread EGL state, so eglBindAPI() is
+// called before each call that depends on it, since the renderer uses
+// this display from many threads.
+class SurfacelessDisplay : public EglOS::Display {
+public:
+    SurfacelessDisplay(const HostEgl* egl, EGLDisplay display) :
+            mEgl(egl), mDisplay(display) {}
+
+    virtual bool release() {
+        // The host display is owned by the engine, and kept initialized
+        // until the process exits.
+        return true;
+    }
+
+    virtual void queryConfigs(int renderableType,
+                              EglOS::AddConfigCallback* addConfigFunc,
+                              void* addConfigOpaque) {
+        static const EGLint kAttribs[] = {
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_COLOR_BUFFER_TYPE, EGL_RGB_BUFFER,
+            EGL_NONE
+        };
+        EGLint count = 0;
+        if (!mEgl->eglChooseConfig(mDisplay, kAttribs, NULL, 0, &count) ||
+            count <= 0) {
+            ERR("%s: No host EGL config with desktop GL pbuffers [0x%x]\n",
+                __FUNCTION__, mEgl->eglGetError());
+            return;
+        }
+        EGLConfig* configs = new EGLConfig[count];
+        mEgl->eglChooseConfig(mDisplay, kAttribs, configs, count, &count);
+        for (EGLint n = 0; n < count; ++n) {
+            addConfig(configs[n], renderableType,
+                      addConfigFunc, addConfigOpaque);
+        }
+        delete [] configs;
+    }
+
+    virtual bool isValidNativeWin(EglOS::Surface* win) {
+        return false;
+    }
+
+    virtual bool isValidNativeWin(EGLNativeWindowType win) {
+        return false;
+    }
+
+    virtual bool checkWindowPixelFormatMatch(
+            EGLNativeWindowType win,
+            const EglOS::PixelFormat* pixelFormat,
+            unsigned int* width,
+            unsigned int* height) {
+        return false;
+    }
+
+    virtual EglOS::Context* createContext(
+            const EglOS::PixelFormat* pixelFormat,
+            EglOS::Context* sharedContext) {
+        mEgl->eglBindAPI(EGL_OPENGL_API);
+        EGLContext ctx = mEgl->eglCreateContext(
+                mDisplay,
+                SurfacelessPixelFormat::from(pixelFormat),
+                sharedContext ? SurfacelessContext::from(sharedContext)
+                              : EGL_NO_CONTEXT,
+                NULL);
+        if (ctx == EGL_NO_CONTEXT) {
+            ERR("%s: Could not create host context [0x%x]\n",
+                __FUNCTION__, mEgl->eglGetError());
+            return NULL;
+        }
+        return new SurfacelessContext(ctx);
+    }
+
+    virtual bool destroyContext(EglOS::Context* context) {
+        mEgl->eglDestroyContext(mDisplay, SurfacelessContext::from(context));
+        delete context;
+        return true;
+    }
+
+    virtual EglOS::Surface* createPbufferSurface(
+            const EglOS::PixelFormat* pixelFormat,
+            const EglOS::PbufferInfo* info) {
+        const EGLint attribs[] = {
+            EGL_WIDTH, info->width,
+            EGL_HEIGHT, info->height,
+            EGL_LARGEST_PBUFFER, info->largest,
+            EGL_NONE
+        };
+        EGLSurface pb = mEgl->eglCreatePbufferSurface(
+                mDisplay, SurfacelessPixelFormat::from(pixelFormat), attribs);
+        return pb != EGL_NO_SURFACE ? new SurfacelessSurface(pb) : NULL;
+    }
+
+    virtual bool releasePbuffer(EglOS::Surface* pb) {
+        if (!pb) {
+            return false;
+        }
+        mEgl->eglDestroySurface(mDisplay, SurfacelessSurface::from(pb));
+        return true;
+    }
+
+    virtual bool makeCurrent(EglOS::Surface* read,
+                             EglOS::Surface* draw,
+                             EglOS::Context* context) {
+        mEgl->eglBindAPI(EGL_OPENGL_API);
+        if (!context && !read && !draw) {
+            // unbind
+            return mEgl->eglMakeCurrent(mDisplay, EGL_NO_SURFACE,
+                                        EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        }
+        if (!context || !read || !draw) {
+            return false;
+        }
+        return mEgl->eglMakeCurrent(mDisplay,
+                                    SurfacelessSurface::from(draw),
+                                    SurfacelessSurface::from(read),
+                                    SurfacelessContext::from(context));
+    }
+
+    virtual void swapBuffers(EglOS::Surface* srfc) {
+        // Pbuffers are single-buffered, there is nothing to swap.
+    }
+
+private:
+    void addConfig(EGLConfig config,
+                   int renderableType,
+                   EglOS::AddConfigCallback* addConfigFunc,
+                   void* addConfigOpaque) {
+        EglOS::ConfigInfo info;
+        memset(&info, 0, sizeof(info));
+
+        static const struct {
+            EGLint attrib;
+            size_t offset;
+        } kAttribs[] = {
+#define CONFIG_ATTRIB(attrib, field) \
+            { attrib, offsetof(EglOS::ConfigInfo, field) }
+            CONFIG_ATTRIB(EGL_RED_SIZE, red_size),
+            CONFIG_ATTRIB(EGL_GREEN_SIZE, green_size),
+            CONFIG_ATTRIB(EGL_BLUE_SIZE, blue_size),
+            CONFIG_ATTRIB(EGL_ALPHA_SIZE, alpha_size),
+            CONFIG_ATTRIB(EGL_DEPTH_SIZE, depth_size),
+            CONFIG_ATTRIB(EGL_STENCIL_SIZE, stencil_size),
+            CONFIG_ATTRIB(EGL_CONFIG_ID, config_id),
+            CONFIG_ATTRIB(EGL_LEVEL, frame_buffer_level),
+            CONFIG_ATTRIB(EGL_MAX_PBUFFER_WIDTH, max_pbuffer_width),
+            CONFIG_ATTRIB(EGL_MAX_PBUFFER_HEIGHT, max_pbuffer_height),
+            CONFIG_ATTRIB(EGL_MAX_PBUFFER_PIXELS, max_pbuffer_size),
+            CONFIG_ATTRIB(EGL_SAMPLES, samples_per_pixel),
+            CONFIG_ATTRIB(EGL_TRANSPARENT_RED_VALUE, trans_red_val),
+            CONFIG_ATTRIB(EGL_TRANSPARENT_GREEN_VALUE, trans_green_val),
+            CONFIG_ATTRIB(EGL_TRANSPARENT_BLUE_VALUE, trans_blue_val),
+#undef CONFIG_ATTRIB
+        };
+        for (size_t n = 0; n < sizeof(kAttribs) / sizeof(kAttribs[0]); ++n) {
+            EGLint* field = reinterpret_cast<EGLint*>(
+                    reinterpret_cast<char*>(&info) + kAttribs[n].offset);
+            if (!mEgl->eglGetConfigAttrib(
+                    mDisplay, config, kAttribs[n].attrib, field)) {
+                return;
+            }
+        }
+
+        EGLint value = 0;
+        if (!mEgl->eglGetConfigAttrib(
+                mDisplay, config, EGL_CONFIG_CAVEAT, &value)) {
+            return;
+        }
+        info.caveat = value;
+        if (!mEgl->eglGetConfigAttrib(
+                mDisplay, config, EGL_TRANSPARENT_TYPE, &value)) {
+            return;
+        }
+        info.transparent_type = value;
+
+        info.renderable_type = renderableType;
+        info.native_renderable = EGL_FALSE;
+        info.native_visual_id = 0;
+        info.native_visual_type = EGL_NONE;
+        info.surface_type = EGL_PBUFFER_BIT;
+        info.frmt = new SurfacelessPixelFormat(config);
+
+        (*addConfigFunc)(addConfigOpaque, &info);
+    }
+
+    const HostEgl* mEgl;
+    EGLDisplay mDisplay;
+};
+
+// Implementation of GlLibrary for the host's desktop GL entry points.
+// eglGetProcAddress() is tried first, then the library exports, since
+// EGL 1.4 implementations only return extension functions.
+class SurfacelessGlLibrary : public GlLibrary {
+public:
+    SurfacelessGlLibrary() : mEgl(NULL), mLib(NULL) {}
+
+    ~SurfacelessGlLibrary() {
+        delete mLib;
+    }
+
+    bool init(const HostEgl* egl) {
+        // libOpenGL.so.0 is the GLVND library without any GLX dependency,
+        // libGL.so.1 is the vendor library on older systems.
+        static const char* const kLibNames[] = {
+            "libOpenGL.so.0",
+            "libGL.so.1",
+        };
+        mEgl = egl;
+        for (size_t n = 0; n < sizeof(kLibNames) / sizeof(kLibNames[0]);
+             ++n) {
+            char error[256];
+            mLib = emugl::SharedLibrary::open(
+                    kLibNames[n], error, sizeof(error));
+            if (mLib) {
+                return true;
+            }
+        }
+        ERR("%s: Could not open the host desktop GL library\n",
+            __FUNCTION__);
+        return false;
+    }
+
+    // override
+    virtual GlFunctionPointer findSymbol(const char* name) {
+        if (!mLib) {
+            return NULL;
+        }
+        GlFunctionPointer ret = mEgl->eglGetProcAddress(name);
+        if (!ret) {
+            ret = reinterpret_cast<GlFunctionPointer>(mLib->findSymbol(name));
+        }
+        return ret;
+    }
+
+private:
+    const HostEgl* mEgl;
+    emugl::SharedLibrary* mLib;
+};
+
+class SurfacelessEngine : public EglOS::Engine {
+public:
+    SurfacelessEngine() :
+            mLib(NULL), mEgl(), mDisplay(EGL_NO_DISPLAY), mGlLib() {
+        memset(&mEgl, 0, sizeof(mEgl));
+        mDisplay = openDisplay();
+        if (mDisplay != EGL_NO_DISPLAY && !mGlLib.init(&mEgl)) {
+            mDisplay = EGL_NO_DISPLAY;
+        }
+    }
+
+    ~SurfacelessEngine() {
+        delete mLib;
+    }
+
+    bool isValid() const { return mDisplay != EGL_NO_DISPLAY; }
+
+    virtual EglOS::Display* getDefaultDisplay() {
+        if (!isValid()) {
+            return NULL;
+        }
+        return new SurfacelessDisplay(&mEgl, mDisplay);
+    }
+
+    virtual GlLibrary* getGlLibrary() {
+        return &mGlLib;
+    }
+
+    virtual EglOS::Surface* createWindowSurface(EGLNativeWindowType wnd) {
+        return NULL;
+    }
+
+private:
+    // Load the host EGL library, and return an initialized display that
+    // doesn't need a window system, or EGL_NO_DISPLAY.
+    EGLDisplay openDisplay() {
+        static const char kLibName[] = "libEGL.so.1";
+        char error[256];
+        mLib = emugl::SharedLibrary::open(kLibName, error, sizeof(error));
+        if (!mLib) {
+            ERR("%s: Could not open EGL library %s [%s]\n",
+                __FUNCTION__, kLibName, error);
+            return EGL_NO_DISPLAY;
+        }
+
+#define HOST_EGL_LOAD_FUNCTION(ret, name, sig) \
+        mEgl.name = reinterpret_cast<ret (*) sig>(mLib->findSymbol(#name)); \
+        if (!mEgl.name) { \
+            ERR("%s: Could not find %s in %s\n", \
+                __FUNCTION__, #name, kLibName); \
+            return EGL_NO_DISPLAY; \
+        }
+        LIST_HOST_EGL_FUNCTIONS(HOST_EGL_LOAD_FUNCTION)
+#undef HOST_EGL_LOAD_FUNCTION
+
+#define HOST_EGL_LOAD_EXTENSION(ret, name, sig) \
+        mEgl.name = reinterpret_cast<ret (*) sig>(mEgl.eglGetProcAddress(#name));
+        LIST_HOST_EGL_EXTENSIONS(HOST_EGL_LOAD_EXTENSION)
+#undef HOST_EGL_LOAD_EXTENSION
+
+        // Client extensions are queried without a display.
+        const char* exts = mEgl.eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+        if (!mEgl.eglGetPlatformDisplayEXT ||
+            !hasExtension(exts, "EGL_EXT_platform_base")) {
+            ERR("%s: Host EGL doesn't support EGL_EXT_platform_base\n",
+                __FUNCTION__);
+            return EGL_NO_DISPLAY;
+        }
+
+        EGLDisplay display = EGL_NO_DISPLAY;
+        if (hasExtension(exts, "EGL_MESA_platform_surfaceless")) {
+            display = mEgl.eglGetPlatformDisplayEXT(
+                    EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        }
+        if (display == EGL_NO_DISPLAY && mEgl.eglQueryDevicesEXT &&
+            hasExtension(exts, "EGL_EXT_platform_device")) {
+            HostEGLDeviceEXT device = NULL;
+            EGLint numDevices = 0;
+            if (mEgl.eglQueryDevicesEXT(1, &device, &numDevices) &&
+                numDevices > 0) {
+                display = mEgl.eglGetPlatformDisplayEXT(
+                        EGL_PLATFORM_DEVICE_EXT, device, NULL);
+            }
+        }
+        if (display == EGL_NO_DISPLAY) {
+            ERR("%s: No surfaceless or device EGL platform on this host\n",
+                __FUNCTION__);
+            return EGL_NO_DISPLAY;
+        }
+
+        EGLint major = 0, minor = 0;
+        if (!mEgl.eglInitialize(display, &major, &minor)) {
+            ERR("%s: Could not initialize host EGL display [0x%x]\n",
+                __FUNCTION__, mEgl.eglGetError());
+            return EGL_NO_DISPLAY;
+        }
+        if (!mEgl.eglBindAPI(EGL_OPENGL_API)) {
+            ERR("%s: Host EGL %d.%d doesn't support desktop GL\n",
+                __FUNCTION__, major, minor);
+            return EGL_NO_DISPLAY;
+        }
+        return display;
+    }
+
+    emugl::SharedLibrary* mLib;
+    HostEgl mEgl;
+    EGLDisplay mDisplay;
+    SurfacelessGlLibrary mGlLib;
+};
+
+emugl::LazyInstance<SurfacelessEngine> sHeadlessEngine = LAZY_INSTANCE_INIT;
+
+}  // namespace
+
+// static
+EglOS::Engine* EglOS::Engine::getHeadlessInstance() {
+    SurfacelessEngine* engine = sHeadlessEngine.ptr();
+    return engine->isValid() ? engine : NULL;
+}
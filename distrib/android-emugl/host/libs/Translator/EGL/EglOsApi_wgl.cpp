@@ -1004,3 +1004,8 @@ emugl::LazyInstance<WinEngine> sHostEngine = LAZY_INSTANCE_INIT;
 EglOS::Engine* EglOS::Engine::getHostInstance() {
     return sHostEngine.ptr();
 }
+
+// static
+EglOS::Engine* EglOS::Engine::getHeadlessInstance() {
+    return NULL;
+}
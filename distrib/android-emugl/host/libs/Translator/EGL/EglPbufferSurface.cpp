@@ -15,6 +15,61 @@
 */
 #include "EglPbufferSurface.h"
 
+#include "EglDisplay.h"
+
+#include <GLES/glext.h>
+
+#include <stdlib.h>
+
+EglPbufferSurface::~EglPbufferSurface() {
+    if (!m_fboBacked) {
+        return;
+    }
+    // No context may be current here, so the renderbuffers are deleted
+    // by the next eglMakeCurrent(). The anchor belongs to the display.
+    const unsigned int names[2] = {
+        m_framebuffer.colorRenderbuffer,
+        m_framebuffer.depthStencilRenderbuffer,
+    };
+    if (names[0]) {
+        m_dpy->addOrphanRenderbuffers(names, names[1] ? 2 : 1);
+    }
+    m_native = NULL;
+}
+
+// static
+bool EglPbufferSurface::fboSurfacesEnabled() {
+    static int enabled = -1;
+    if (enabled < 0) {
+        const char* env = getenv("ANDROID_GL_FBO_SURFACES");
+        enabled = (env && strcmp(env, "0") != 0) ? 1 : 0;
+    }
+    return enabled != 0;
+}
+
+bool EglPbufferSurface::canBeFramebufferBacked() const {
+    EGLint samples = 0;
+    m_config->getConfAttrib(EGL_SAMPLES, &samples);
+    return m_width > 0 && m_height > 0 && samples <= 0 &&
+           m_texFormat == EGL_NO_TEXTURE && m_texTarget == EGL_NO_TEXTURE;
+}
+
+void EglPbufferSurface::setFramebufferBacked(EglOS::Surface* anchor) {
+    EGLint alpha = 0, depth = 0, stencil = 0;
+    m_config->getConfAttrib(EGL_ALPHA_SIZE, &alpha);
+    m_config->getConfAttrib(EGL_DEPTH_SIZE, &depth);
+    m_config->getConfAttrib(EGL_STENCIL_SIZE, &stencil);
+
+    m_framebuffer.id = getHndl();
+    m_framebuffer.width = m_width;
+    m_framebuffer.height = m_height;
+    m_framebuffer.colorFormat = alpha > 0 ? GL_RGBA8_OES : GL_RGB8_OES;
+    m_framebuffer.depthStencilFormat =
+            (depth > 0 || stencil > 0) ? GL_DEPTH24_STENCIL8_OES : 0;
+    m_native = anchor;
+    m_fboBacked = true;
+}
+
 bool EglPbufferSurface::setAttrib(EGLint attrib,EGLint val) {
     switch(attrib) {
     case EGL_WIDTH:
@@ -18,8 +18,24 @@
 
 #include "EglSurface.h"
 
+#include <GLcommon/TranslatorIfaces.h>
+
+#include <string.h>
+
 class EglDisplay;
 
+// A pbuffer surface is normally a native pbuffer of its own, so making a
+// context current with another pbuffer is a full native make-current,
+// e.g. glXMakeCurrent() with another drawable.
+//
+// If the ANDROID_GL_FBO_SURFACES environment variable is set to a non-0
+// value, pbuffers are instead backed by renderbuffers, attached to a host
+// framebuffer object which stands for the framebuffer 0 of the contexts
+// they are current with. All the surfaces of a config then share a tiny
+// native anchor pbuffer, so switching between them keeps the same native
+// drawable and only rebinds the framebuffer object. Multisampled configs
+// and pbuffers bound to textures keep a native pbuffer.
+
 class EglPbufferSurface:public EglSurface {
 public:
     EglPbufferSurface(EglDisplay *dpy, EglConfig* config):
@@ -27,7 +43,28 @@ public:
                                          m_texFormat(EGL_NO_TEXTURE),
                                          m_texTarget(EGL_NO_TEXTURE),
                                          m_texMipmap(EGL_FALSE),
-                                         m_largest(EGL_FALSE){};
+                                         m_largest(EGL_FALSE),
+                                         m_fboBacked(false) {
+        memset(&m_framebuffer, 0, sizeof(m_framebuffer));
+    }
+
+    ~EglPbufferSurface();
+
+    // Return true if FBO-backed pbuffers are enabled, see above.
+    static bool fboSurfacesEnabled();
+
+    // Return true if the surface can be FBO-backed, once its attributes
+    // are set.
+    bool canBeFramebufferBacked() const;
+
+    // Back the surface with renderbuffers, created by the first context
+    // made current with it, on the native pbuffer |anchor| which is owned
+    // by the display.
+    void setFramebufferBacked(EglOS::Surface* anchor);
+
+    virtual SurfaceFramebuffer* framebuffer() {
+        return m_fboBacked ? &m_framebuffer : NULL;
+    }
 
     void  setNativePbuffer(EglOS::Surface* srfc) { m_native = srfc; }
     bool  setAttrib(EGLint attrib,EGLint val);
@@ -45,5 +82,7 @@ private:
     EGLint               m_texTarget;
     EGLint               m_texMipmap;
     EGLint               m_largest;
+    bool                 m_fboBacked;
+    SurfaceFramebuffer   m_framebuffer;
 };
 #endif
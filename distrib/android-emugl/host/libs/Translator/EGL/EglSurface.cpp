@@ -22,7 +22,7 @@ unsigned int EglSurface::s_nextSurfaceHndl = 0;
 
 EglSurface::~EglSurface(){ 
 
-    if(m_type == EglSurface::PBUFFER) {
+    if(m_type == EglSurface::PBUFFER && m_native) {
         m_dpy->nativeType()->releasePbuffer(m_native);
     }
 
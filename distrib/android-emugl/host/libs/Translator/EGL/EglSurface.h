@@ -29,6 +29,7 @@ class EglSurface;
 typedef emugl::SmartPtr<EglSurface> SurfacePtr;
 
 class EglDisplay;
+struct SurfaceFramebuffer;
 
 class EglSurface {
 public:
@@ -54,6 +55,10 @@ public:
 
     unsigned int getHndl() const { return m_hndl; }
 
+    // Return the renderbuffers backing the surface if it is FBO-backed,
+    // see EglPbufferSurface.h, or NULL if it is a native surface.
+    virtual SurfaceFramebuffer* framebuffer() { return NULL; }
+
     virtual ~EglSurface();
 
 private:
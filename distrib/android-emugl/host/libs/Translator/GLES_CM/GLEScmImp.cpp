@@ -44,6 +44,10 @@ static void initGLESx();
 static void initContext(GLEScontext* ctx,ShareGroupPtr grp);
 static void deleteGLESContext(GLEScontext* ctx);
 static void setShareGroup(GLEScontext* ctx,ShareGroupPtr grp);
+static void setSurfaceFramebuffer(GLEScontext* ctx,SurfaceFramebuffer* fb);
+static void deleteRenderbuffers(int n,const unsigned int* renderbuffers);
+static bool hasGLObjects(GLEScontext* ctx);
+static void destroyGLObjects(GLEScontext* ctx);
 static GLEScontext* createGLESContext();
 static __translatorMustCastToProperFunctionPointerType getProcAddress(const char* procName);
 
@@ -64,7 +68,11 @@ static GLESiface  s_glesIface = {
     .flush             = (FUNCPTR)glFlush,
     .finish            = (FUNCPTR)glFinish,
     .setShareGroup     = setShareGroup,
-    .getProcAddress    = getProcAddress
+    .getProcAddress    = getProcAddress,
+    .setSurfaceFramebuffer = setSurfaceFramebuffer,
+    .deleteRenderbuffers   = deleteRenderbuffers,
+    .hasGLObjects      = hasGLObjects,
+    .destroyGLObjects  = destroyGLObjects
 };
 
 #include <GLcommon/GLESmacros.h>
@@ -98,6 +106,22 @@ static void setShareGroup(GLEScontext* ctx,ShareGroupPtr grp) {
         ctx->setShareGroup(grp);
     }
 }
+static void setSurfaceFramebuffer(GLEScontext* ctx,SurfaceFramebuffer* fb) {
+    if(ctx) {
+        ctx->setSurfaceFramebuffer(fb);
+    }
+}
+static void deleteRenderbuffers(int n,const unsigned int* renderbuffers) {
+    GLEScontext::dispatcher().glDeleteRenderbuffersEXT(n,renderbuffers);
+}
+static bool hasGLObjects(GLEScontext* ctx) {
+    return ctx && ctx->hasGLObjects();
+}
+static void destroyGLObjects(GLEScontext* ctx) {
+    if(ctx) {
+        ctx->destroyGLObjects();
+    }
+}
 static __translatorMustCastToProperFunctionPointerType getProcAddress(const char* procName) {
     GET_CTX_RET(NULL)
     ctx->getGlobalLock();
@@ -569,7 +593,7 @@ GL_API void GL_APIENTRY  glDrawArrays( GLenum mode, GLint first, GLsizei count)
 
     if(!ctx->isArrEnabled(GL_VERTEX_ARRAY)) return;
 
-    GLESConversionArrays tmpArrs;
+    GLESConversionArrays& tmpArrs = ctx->getConversionArrays();
     ctx->setupArraysPointers(tmpArrs,first,count,0,NULL,true);
     if(mode == GL_POINTS && ctx->isArrEnabled(GL_POINT_SIZE_ARRAY_OES)){
         ctx->drawPointsArrs(tmpArrs,first,count);
@@ -589,7 +613,7 @@ GL_API void GL_APIENTRY  glDrawElements( GLenum mode, GLsizei count, GLenum type
     ctx->drawValidate();
 
     const GLvoid* indices = elementsIndices;
-    GLESConversionArrays tmpArrs;
+    GLESConversionArrays& tmpArrs = ctx->getConversionArrays();
     if(ctx->isBindedBuffer(GL_ELEMENT_ARRAY_BUFFER)) { // if vbo is binded take the indices from the vbo
         const unsigned char* buf = static_cast<unsigned char *>(ctx->getBindedBuffer(GL_ELEMENT_ARRAY_BUFFER));
         indices = buf + SafeUIntFromPointer(elementsIndices);
@@ -1731,7 +1755,9 @@ GL_API void GL_APIENTRY glEGLImageTargetRenderbufferStorageOES(GLenum target, GL
                                                     rbData->attachedPoint,
                                                     GL_TEXTURE_2D,
                                                     img->globalTexName,0);
-        if (prevFB != rbData->attachedFB) {
+        if (!prevFB) {
+            ctx->bindDefaultFramebuffer();
+        } else if (prevFB != rbData->attachedFB) {
             ctx->dispatcher().glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 
                                                    prevFB);
         }
@@ -1923,7 +1949,7 @@ GL_API void GLAPIENTRY glBindFramebufferOES(GLenum target, GLuint framebuffer) {
         ctx->shareGroup()->setObjectData(FRAMEBUFFER, framebuffer,
                                          ObjectDataPtr(new FramebufferData(framebuffer)));
     }
-    int globalBufferName = (framebuffer!=0) ? ctx->shareGroup()->getGlobalName(FRAMEBUFFER,framebuffer) : 0;
+    int globalBufferName = (framebuffer!=0) ? ctx->shareGroup()->getGlobalName(FRAMEBUFFER,framebuffer) : ctx->getDefaultFramebuffer();
     ctx->dispatcher().glBindFramebufferEXT(target,globalBufferName);
 
     // update framebuffer binding state
@@ -1936,6 +1962,11 @@ GL_API void GLAPIENTRY glDeleteFramebuffersOES(GLsizei n, const GLuint *framebuf
     for (int i=0;i<n;++i) {
         GLuint globalBufferName = ctx->shareGroup()->getGlobalName(FRAMEBUFFER,framebuffers[i]);
         ctx->dispatcher().glDeleteFramebuffersEXT(1,&globalBufferName);
+        if (framebuffers[i] && framebuffers[i] == ctx->getFramebufferBinding()) {
+            // The host reverted to its framebuffer 0.
+            ctx->setFramebufferBinding(0);
+            ctx->bindDefaultFramebuffer();
+        }
     }
 }
 
@@ -5,7 +5,8 @@ host_common_SRC_FILES := \
      GLESv2Context.cpp   \
      GLESv2Validate.cpp  \
      ShaderParser.cpp    \
-     ProgramData.cpp
+     ProgramData.cpp     \
+     ProgramBinaryCache.cpp
 
 
 ### GLES_V2 host implementation (On top of OpenGL) ########################
@@ -31,6 +31,7 @@
 #include "GLESv2Validate.h"
 #include "ShaderParser.h"
 #include "ProgramData.h"
+#include "ProgramBinaryCache.h"
 #include <GLcommon/TextureUtils.h>
 #include <GLcommon/FramebufferData.h>
 
@@ -41,6 +42,10 @@ static void initGLESx();
 static void initContext(GLEScontext* ctx,ShareGroupPtr grp);
 static void deleteGLESContext(GLEScontext* ctx);
 static void setShareGroup(GLEScontext* ctx,ShareGroupPtr grp);
+static void setSurfaceFramebuffer(GLEScontext* ctx,SurfaceFramebuffer* fb);
+static void deleteRenderbuffers(int n,const unsigned int* renderbuffers);
+static bool hasGLObjects(GLEScontext* ctx);
+static void destroyGLObjects(GLEScontext* ctx);
 static GLEScontext* createGLESContext();
 static __translatorMustCastToProperFunctionPointerType getProcAddress(const char* procName);
 
@@ -61,7 +66,11 @@ static GLESiface  s_glesIface = {
     .flush             = (FUNCPTR)glFlush,
     .finish            = (FUNCPTR)glFinish,
     .setShareGroup     = setShareGroup,
-    .getProcAddress    = getProcAddress
+    .getProcAddress    = getProcAddress,
+    .setSurfaceFramebuffer = setSurfaceFramebuffer,
+    .deleteRenderbuffers   = deleteRenderbuffers,
+    .hasGLObjects      = hasGLObjects,
+    .destroyGLObjects  = destroyGLObjects
 };
 
 #include <GLcommon/GLESmacros.h>
@@ -94,6 +103,22 @@ static void setShareGroup(GLEScontext* ctx,ShareGroupPtr grp) {
         ctx->setShareGroup(grp);
     }
 }
+static void setSurfaceFramebuffer(GLEScontext* ctx,SurfaceFramebuffer* fb) {
+    if(ctx) {
+        ctx->setSurfaceFramebuffer(fb);
+    }
+}
+static void deleteRenderbuffers(int n,const unsigned int* renderbuffers) {
+    GLEScontext::dispatcher().glDeleteRenderbuffersEXT(n,renderbuffers);
+}
+static bool hasGLObjects(GLEScontext* ctx) {
+    return ctx && ctx->hasGLObjects();
+}
+static void destroyGLObjects(GLEScontext* ctx) {
+    if(ctx) {
+        ctx->destroyGLObjects();
+    }
+}
 
 static __translatorMustCastToProperFunctionPointerType getProcAddress(const char* procName) {
     GET_CTX_RET(NULL)
@@ -147,6 +172,63 @@ static void s_detachShader(GLEScontext* ctx, GLuint shader) {
     }
 }
 
+// Compile a shader on the host, and keep its info log.
+static void s_compileShader(GLEScontext* ctx, GLuint globalShaderName, ShaderParser* sp) {
+    sp->setCompileDeferred(false);
+    ctx->dispatcher().glCompileShader(globalShaderName);
+
+    GLsizei infoLogLength=0;
+    GLchar* infoLog;
+    ctx->dispatcher().glGetShaderiv(globalShaderName,GL_INFO_LOG_LENGTH,&infoLogLength);
+    infoLog = new GLchar[infoLogLength+1];
+    ctx->dispatcher().glGetShaderInfoLog(globalShaderName,infoLogLength,NULL,infoLog);
+    sp->setInfoLog(infoLog);
+}
+
+// Return the ProgramBinaryCache key of a program linked from |vs| and |fs|.
+static uint64_t s_programBinaryKey(ShaderParser* vs, ShaderParser* fs, ProgramData* programData) {
+    uint64_t hashes[2] = { vs->getSrcHash(), fs->getSrcHash() };
+    const std::string& bindings = programData->getAttribBindings();
+    uint64_t key = ProgramBinaryCache::hash(hashes, sizeof(hashes));
+    return ProgramBinaryCache::hash(bindings.c_str(), bindings.size(), key);
+}
+
+// Link a program from the binary cached for |key|, if any.
+static bool s_loadProgramBinary(GLEScontext* ctx, GLuint globalProgramName, uint64_t key) {
+    ProgramBinaryCache* cache = ProgramBinaryCache::get();
+    GLenum format = 0;
+    std::vector<unsigned char> binary;
+    if (!cache->find(key, &format, &binary)) {
+        return false;
+    }
+    GLint linkStatus = GL_FALSE;
+    ctx->dispatcher().glProgramBinary(globalProgramName, format, &binary[0], binary.size());
+    ctx->dispatcher().glGetProgramiv(globalProgramName, GL_LINK_STATUS, &linkStatus);
+    if (!linkStatus) {
+        // e.g. the driver was updated without changing its version string.
+        cache->remove(key);
+        return false;
+    }
+    return true;
+}
+
+static void s_storeProgramBinary(GLEScontext* ctx, GLuint globalProgramName, uint64_t key,
+                                 ShaderParser* vs, ShaderParser* fs) {
+    GLint length = 0;
+    ctx->dispatcher().glGetProgramiv(globalProgramName, GL_PROGRAM_BINARY_LENGTH_OES, &length);
+    if (length <= 0) {
+        return;
+    }
+    std::vector<unsigned char> binary(length);
+    GLenum format = 0;
+    ctx->dispatcher().glGetProgramBinary(globalProgramName, length, &length, &format, &binary[0]);
+    if (length <= 0) {
+        return;
+    }
+    binary.resize(length);
+    ProgramBinaryCache::get()->store(key, vs->getSrcHash(), fs->getSrcHash(), format, binary);
+}
+
 static ObjectLocalName TextureLocalName(GLenum target,unsigned int tex) {
     GET_CTX_RET(0);
     return (tex!=0? tex : ctx->getDefaultTextureName(target));
@@ -211,6 +293,7 @@ GL_APICALL void  GL_APIENTRY glBindAttribLocation(GLuint program, GLuint index,
         ObjectDataPtr objData = ctx->shareGroup()->getObjectData(SHADER,program);
         SET_ERROR_IF(objData.Ptr()->getDataType()!=PROGRAM_DATA,GL_INVALID_OPERATION);
 
+        ((ProgramData*)objData.Ptr())->addAttribBinding(index,name);
         ctx->dispatcher().glBindAttribLocation(globalProgramName,index,name);
     }
 }
@@ -245,6 +328,9 @@ GL_APICALL void  GL_APIENTRY glBindFramebuffer(GLenum target, GLuint framebuffer
             globalFrameBufferName = ctx->shareGroup()->getGlobalName(FRAMEBUFFER,framebuffer);
         }
     }
+    if(!framebuffer){
+        globalFrameBufferName = ctx->getDefaultFramebuffer();
+    }
     ctx->dispatcher().glBindFramebufferEXT(target,globalFrameBufferName);
 
     // update framebuffer binding state
@@ -388,14 +474,17 @@ GL_APICALL void  GL_APIENTRY glCompileShader(GLuint shader){
         ObjectDataPtr objData = ctx->shareGroup()->getObjectData(SHADER,shader);
         SET_ERROR_IF(objData.Ptr()->getDataType()!= SHADER_DATA,GL_INVALID_OPERATION);
         ShaderParser* sp = (ShaderParser*)objData.Ptr();
-        ctx->dispatcher().glCompileShader(globalShaderName);
-
-        GLsizei infoLogLength=0;
-        GLchar* infoLog;
-        ctx->dispatcher().glGetShaderiv(globalShaderName,GL_INFO_LOG_LENGTH,&infoLogLength);
-        infoLog = new GLchar[infoLogLength+1];
-        ctx->dispatcher().glGetShaderInfoLog(globalShaderName,infoLogLength,NULL,infoLog);
-        sp->setInfoLog(infoLog);
+        // A shader that is part of a cached program is known to compile,
+        // so only compile it if glLinkProgram() can't use the cache.
+        ProgramBinaryCache* cache = ProgramBinaryCache::get();
+        if (cache->isEnabled(ctx->dispatcher()) && cache->isKnownShader(sp->getSrcHash())) {
+            GLchar* infoLog = new GLchar[1];
+            infoLog[0] = '\0';
+            sp->setInfoLog(infoLog);
+            sp->setCompileDeferred(true);
+            return;
+        }
+        s_compileShader(ctx, globalShaderName, sp);
     }
 }
 
@@ -486,6 +575,11 @@ GL_APICALL void  GL_APIENTRY glDeleteFramebuffers(GLsizei n, const GLuint* frame
            const GLuint globalFrameBufferName = ctx->shareGroup()->getGlobalName(FRAMEBUFFER,framebuffers[i]);
            ctx->shareGroup()->deleteName(FRAMEBUFFER,framebuffers[i]);
            ctx->dispatcher().glDeleteFramebuffersEXT(1,&globalFrameBufferName);
+           if(framebuffers[i] && framebuffers[i] == ctx->getFramebufferBinding()){
+               // The host reverted to its framebuffer 0.
+               ctx->setFramebufferBinding(0);
+               ctx->bindDefaultFramebuffer();
+           }
         }
     }
 }
@@ -642,7 +736,7 @@ GL_APICALL void  GL_APIENTRY glDrawArrays(GLenum mode, GLint first, GLsizei coun
 
     ctx->drawValidate();
 
-    GLESConversionArrays tmpArrs;
+    GLESConversionArrays& tmpArrs = ctx->getConversionArrays();
     ctx->setupArraysPointers(tmpArrs,first,count,0,NULL,true);
 
     ctx->validateAtt0PreDraw(count);
@@ -677,7 +771,7 @@ GL_APICALL void  GL_APIENTRY glDrawElements(GLenum mode, GLsizei count, GLenum t
         indices = buf + SafeUIntFromPointer(elementsIndices);
     }
 
-    GLESConversionArrays tmpArrs;
+    GLESConversionArrays& tmpArrs = ctx->getConversionArrays();
     ctx->setupArraysPointers(tmpArrs,0,count,type,indices,false);
 
     int maxIndex = ctx->findMaxIndex(count, type, indices);
@@ -1353,6 +1447,19 @@ GL_APICALL void  GL_APIENTRY glGetShaderiv(GLuint shader, GLenum pname, GLint* p
                 params[0] = (logLength>0) ? logLength+1 : 0;
             }
             break;
+        case GL_COMPILE_STATUS:
+            {
+                ObjectDataPtr objData = ctx->shareGroup()->getObjectData(SHADER,shader);
+                SET_ERROR_IF(!objData.Ptr() ,GL_INVALID_OPERATION);
+                SET_ERROR_IF(objData.Ptr()->getDataType()!=SHADER_DATA,GL_INVALID_OPERATION);
+                ShaderParser* sp = (ShaderParser*)objData.Ptr();
+                if (sp->isCompileDeferred()) {
+                    params[0] = GL_TRUE;
+                } else {
+                    ctx->dispatcher().glGetShaderiv(globalShaderName,pname,params);
+                }
+            }
+            break;
         default:
             ctx->dispatcher().glGetShaderiv(globalShaderName,pname,params);
         }
@@ -1705,17 +1812,47 @@ GL_APICALL void  GL_APIENTRY glLinkProgram(GLuint program){
         GLint fragmentShader   = programData->getAttachedFragmentShader();
         GLint vertexShader =  programData->getAttachedVertexShader();
         if (vertexShader != 0 && fragmentShader!=0) {
-            /* validating that the fragment & vertex shaders were compiled successfuly*/
-            GLint fCompileStatus = GL_FALSE;
-            GLint vCompileStatus = GL_FALSE;
             GLuint fragmentShaderGlobal = ctx->shareGroup()->getGlobalName(SHADER,fragmentShader);
             GLuint vertexShaderGlobal = ctx->shareGroup()->getGlobalName(SHADER,vertexShader);
-            ctx->dispatcher().glGetShaderiv(fragmentShaderGlobal,GL_COMPILE_STATUS,&fCompileStatus);
-            ctx->dispatcher().glGetShaderiv(vertexShaderGlobal,GL_COMPILE_STATUS,&vCompileStatus);
+            ShaderParser* fs = (ShaderParser*)ctx->shareGroup()->getObjectData(SHADER,fragmentShader).Ptr();
+            ShaderParser* vs = (ShaderParser*)ctx->shareGroup()->getObjectData(SHADER,vertexShader).Ptr();
+
+            /* try the program binary cache first */
+            ProgramBinaryCache* cache = ProgramBinaryCache::get();
+            bool useCache = fs && vs && cache->isEnabled(ctx->dispatcher());
+            uint64_t key = 0;
+            if (useCache) {
+                key = s_programBinaryKey(vs, fs, programData);
+                if (s_loadProgramBinary(ctx, globalProgramName, key)) {
+                    linkStatus = GL_TRUE;
+                }
+                cache->recordLink(linkStatus != GL_FALSE);
+            }
 
-            if(fCompileStatus != 0 && vCompileStatus != 0){
-                ctx->dispatcher().glLinkProgram(globalProgramName);
-                ctx->dispatcher().glGetProgramiv(globalProgramName,GL_LINK_STATUS,&linkStatus);
+            if (!linkStatus) {
+                if (fs && fs->isCompileDeferred()) {
+                    s_compileShader(ctx, fragmentShaderGlobal, fs);
+                }
+                if (vs && vs->isCompileDeferred()) {
+                    s_compileShader(ctx, vertexShaderGlobal, vs);
+                }
+
+                /* validating that the fragment & vertex shaders were compiled successfuly*/
+                GLint fCompileStatus = GL_FALSE;
+                GLint vCompileStatus = GL_FALSE;
+                ctx->dispatcher().glGetShaderiv(fragmentShaderGlobal,GL_COMPILE_STATUS,&fCompileStatus);
+                ctx->dispatcher().glGetShaderiv(vertexShaderGlobal,GL_COMPILE_STATUS,&vCompileStatus);
+
+                if(fCompileStatus != 0 && vCompileStatus != 0){
+                    if (useCache && ctx->dispatcher().glProgramParameteri) {
+                        ctx->dispatcher().glProgramParameteri(globalProgramName,GL_PROGRAM_BINARY_RETRIEVABLE_HINT,GL_TRUE);
+                    }
+                    ctx->dispatcher().glLinkProgram(globalProgramName);
+                    ctx->dispatcher().glGetProgramiv(globalProgramName,GL_LINK_STATUS,&linkStatus);
+                    if (useCache && linkStatus) {
+                        s_storeProgramBinary(ctx, globalProgramName, key, vs, fs);
+                    }
+                }
             }
         }
         programData->setLinkStatus(linkStatus);
@@ -1833,6 +1970,11 @@ GL_APICALL void  GL_APIENTRY glShaderSource(GLuint shader, GLsizei count, const
             SET_ERROR_IF(!objData.Ptr(),GL_INVALID_OPERATION);
             SET_ERROR_IF(objData.Ptr()->getDataType()!=SHADER_DATA,GL_INVALID_OPERATION);
             ShaderParser* sp = (ShaderParser*)objData.Ptr();
+            if (sp->isCompileDeferred()) {
+                // Programs linked from now on still use the last compiled
+                // source, until the next glCompileShader() call.
+                s_compileShader(ctx, globalShaderName, sp);
+            }
             sp->setSrc(ctx->glslVersion(),count,string,length);
             ctx->dispatcher().glShaderSource(globalShaderName,1,sp->parsedLines(),NULL);
     }
@@ -2247,7 +2389,9 @@ GL_APICALL void GL_APIENTRY glEGLImageTargetRenderbufferStorageOES(GLenum target
                                                     rbData->attachedPoint,
                                                     GL_TEXTURE_2D,
                                                     img->globalTexName,0);
-        if (prevFB != rbData->attachedFB) {
+        if (!prevFB) {
+            ctx->bindDefaultFramebuffer();
+        } else if (prevFB != rbData->attachedFB) {
             ctx->dispatcher().glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 
                                                    prevFB);
         }
@@ -0,0 +1,421 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#include "ProgramBinaryCache.h"
+
+#include "GLcommon/GLDispatch.h"
+
+#include <GLES2/gl2ext.h>
+
+#include <algorithm>
+#include <utility>
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+
+// The file starts with kMagic, the format version, and the host identity
+// (the GL vendor, renderer and version strings), followed by one record
+// per program, each a RecordHeader followed by the binary. Values use the
+// host byte order, since the binaries are host-specific anyway. If the same
+// key appears more than once, the last record is the valid one, and a record
+// without binary removes the program.
+//
+// Increment kVersion when changing the format or the cache key.
+const char kMagic[8] = { 'E', 'G', 'L', 'P', 'B', 'C', 'A', 'C' };
+const uint32_t kVersion = 1;
+
+struct RecordHeader {
+    uint64_t key;
+    uint64_t vertexHash;
+    uint64_t fragmentHash;
+    uint64_t checksum;  // hash of the binary.
+    uint32_t format;
+    uint32_t size;
+};
+
+const uint64_t kDefaultMaxMB = 32;
+
+emugl::LazyInstance<ProgramBinaryCache> sCache = LAZY_INSTANCE_INIT;
+
+bool readFully(FILE* file, void* data, size_t size) {
+    return fread(data, 1, size, file) == size;
+}
+
+bool writeFully(FILE* file, const void* data, size_t size) {
+    return fwrite(data, 1, size, file) == size;
+}
+
+std::string getGLString(GLDispatch& dispatcher, GLenum name) {
+    const GLubyte* s = dispatcher.glGetString(name);
+    return s ? reinterpret_cast<const char*>(s) : "";
+}
+
+}  // namespace
+
+// static
+ProgramBinaryCache* ProgramBinaryCache::get() {
+    return sCache.ptr();
+}
+
+// static
+uint64_t ProgramBinaryCache::hash(const void* data, size_t size,
+                                  uint64_t seed) {
+    // 64-bit FNV-1a.
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    uint64_t h = seed;
+    for (size_t n = 0; n < size; ++n) {
+        h ^= p[n];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+ProgramBinaryCache::ProgramBinaryCache() :
+        m_lock(),
+        m_initialized(false),
+        m_enabled(false),
+        m_showStats(getenv("SHOW_PROGRAM_CACHE_STATS") != NULL),
+        m_path(),
+        m_identity(),
+        m_file(NULL),
+        m_fileBytes(0),
+        m_maxBytes(kDefaultMaxMB << 20),
+        m_bytes(0),
+        m_useCounter(0),
+        m_entries(),
+        m_shaders() {
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+ProgramBinaryCache::~ProgramBinaryCache() {
+    if (m_file) {
+        fclose(m_file);
+    }
+}
+
+bool ProgramBinaryCache::isEnabled(GLDispatch& dispatcher) {
+    emugl::Mutex::AutoLock lock(m_lock);
+    if (!m_initialized) {
+        init_locked(dispatcher);
+        m_initialized = true;
+    }
+    return m_enabled;
+}
+
+void ProgramBinaryCache::init_locked(GLDispatch& dispatcher) {
+    const char* path = getenv("ANDROID_GL_PROGRAM_CACHE");
+    if (!path || !path[0]) {
+        return;
+    }
+    if (!dispatcher.glGetProgramBinary || !dispatcher.glProgramBinary) {
+        return;
+    }
+    GLint numFormats = 0;
+    dispatcher.glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS_OES, &numFormats);
+    if (numFormats <= 0) {
+        return;
+    }
+    const char* maxMB = getenv("ANDROID_GL_PROGRAM_CACHE_MB");
+    if (maxMB) {
+        m_maxBytes = (uint64_t)strtoul(maxMB, NULL, 10) << 20;
+        if (!m_maxBytes) {
+            return;
+        }
+    }
+
+    m_path = path;
+    m_identity = getGLString(dispatcher, GL_VENDOR);
+    m_identity += '\n';
+    m_identity += getGLString(dispatcher, GL_RENDERER);
+    m_identity += '\n';
+    m_identity += getGLString(dispatcher, GL_VERSION);
+
+    // Rewrite the file if it doesn't match, or holds too many dead records.
+    bool loaded = load_locked();
+    evict_locked();
+    if (!loaded || m_fileBytes > 2 * m_bytes + 4096) {
+        if (!rewrite_locked()) {
+            fprintf(stderr, "%s: Could not write %s\n", __FUNCTION__,
+                    m_path.c_str());
+            return;
+        }
+    }
+    m_file = fopen(m_path.c_str(), "ab");
+    m_enabled = (m_file != NULL);
+}
+
+bool ProgramBinaryCache::load_locked() {
+    FILE* file = fopen(m_path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    char magic[sizeof(kMagic)];
+    uint32_t version = 0, identitySize = 0;
+    std::string identity;
+    bool ok = readFully(file, magic, sizeof(magic)) &&
+              !memcmp(magic, kMagic, sizeof(kMagic)) &&
+              readFully(file, &version, sizeof(version)) &&
+              version == kVersion &&
+              readFully(file, &identitySize, sizeof(identitySize)) &&
+              identitySize == m_identity.size();
+    if (ok) {
+        identity.resize(identitySize);
+        ok = readFully(file, &identity[0], identitySize) &&
+             identity == m_identity;
+    }
+    if (!ok) {
+        fclose(file);
+        return false;
+    }
+
+    // Stop at the first truncated or corrupted record, e.g. after a crash
+    // in the middle of an append.
+    RecordHeader header;
+    while (readFully(file, &header, sizeof(header))) {
+        if (!header.size) {
+            EntryMap::iterator it = m_entries.find(header.key);
+            if (it != m_entries.end()) {
+                erase_locked(it);
+            }
+            m_fileBytes += sizeof(header);
+            continue;
+        }
+        if (header.size > m_maxBytes) {
+            break;
+        }
+        Entry entry;
+        entry.binary.resize(header.size);
+        if (!readFully(file, &entry.binary[0], header.size) ||
+            hash(&entry.binary[0], header.size) != header.checksum) {
+            break;
+        }
+        entry.vertexHash = header.vertexHash;
+        entry.fragmentHash = header.fragmentHash;
+        entry.format = header.format;
+        insert_locked(header.key, &entry);
+        m_fileBytes += sizeof(header) + header.size;
+    }
+    fclose(file);
+    return true;
+}
+
+bool ProgramBinaryCache::rewrite_locked() {
+    // Write the live entries to a new file, least recently used first so
+    // that the record order keeps the LRU order for the next run.
+    std::vector<std::pair<uint64_t, uint64_t> > order;
+    for (EntryMap::iterator it = m_entries.begin(); it != m_entries.end();
+            ++it) {
+        order.push_back(std::make_pair(it->second.lastUse, it->first));
+    }
+    std::sort(order.begin(), order.end());
+
+    if (m_file) {
+        fclose(m_file);
+        m_file = NULL;
+    }
+    std::string tmpPath = m_path + ".tmp";
+    FILE* file = fopen(tmpPath.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    uint32_t identitySize = m_identity.size();
+    bool ok = writeFully(file, kMagic, sizeof(kMagic)) &&
+              writeFully(file, &kVersion, sizeof(kVersion)) &&
+              writeFully(file, &identitySize, sizeof(identitySize)) &&
+              writeFully(file, m_identity.c_str(), identitySize);
+    m_fileBytes = 0;
+    for (size_t n = 0; ok && n < order.size(); ++n) {
+        ok = appendRecord_locked(file, order[n].second,
+                                 m_entries[order[n].second]);
+    }
+    ok = (fclose(file) == 0) && ok;
+    // rename() doesn't replace an existing file on Windows. Another
+    // emulator appending to the old file loses its new records, which is
+    // fine for a cache.
+    ::remove(m_path.c_str());
+    if (!ok || rename(tmpPath.c_str(), m_path.c_str()) != 0) {
+        ::remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool ProgramBinaryCache::appendRecord_locked(FILE* file, uint64_t key,
+                                             const Entry& entry) {
+    // Write each record with a single call, so that concurrent emulators
+    // appending to the same file don't interleave their records.
+    RecordHeader header;
+    header.key = key;
+    header.vertexHash = entry.vertexHash;
+    header.fragmentHash = entry.fragmentHash;
+    header.format = entry.format;
+    header.size = entry.binary.size();
+    header.checksum = header.size ? hash(&entry.binary[0], header.size) : 0;
+    std::vector<unsigned char> record(sizeof(header) + header.size);
+    memcpy(&record[0], &header, sizeof(header));
+    if (header.size) {
+        memcpy(&record[sizeof(header)], &entry.binary[0], header.size);
+    }
+    if (!writeFully(file, &record[0], record.size()) || fflush(file) != 0) {
+        return false;
+    }
+    m_fileBytes += record.size();
+    return true;
+}
+
+void ProgramBinaryCache::insert_locked(uint64_t key, Entry* entry) {
+    EntryMap::iterator it = m_entries.find(key);
+    if (it != m_entries.end()) {
+        erase_locked(it);
+    }
+    Entry& newEntry = m_entries[key];
+    newEntry.vertexHash = entry->vertexHash;
+    newEntry.fragmentHash = entry->fragmentHash;
+    newEntry.format = entry->format;
+    newEntry.lastUse = ++m_useCounter;
+    newEntry.binary.swap(entry->binary);
+    m_bytes += newEntry.binary.size();
+    m_shaders[newEntry.vertexHash]++;
+    m_shaders[newEntry.fragmentHash]++;
+}
+
+void ProgramBinaryCache::erase_locked(EntryMap::iterator it) {
+    const uint64_t shaderHashes[2] = {
+        it->second.vertexHash, it->second.fragmentHash
+    };
+    for (int n = 0; n < 2; ++n) {
+        std::map<uint64_t, int>::iterator shader =
+                m_shaders.find(shaderHashes[n]);
+        if (shader != m_shaders.end() && --shader->second == 0) {
+            m_shaders.erase(shader);
+        }
+    }
+    m_bytes -= it->second.binary.size();
+    m_entries.erase(it);
+}
+
+void ProgramBinaryCache::evict_locked() {
+    while (m_bytes > m_maxBytes && !m_entries.empty()) {
+        EntryMap::iterator oldest = m_entries.begin();
+        for (EntryMap::iterator it = m_entries.begin();
+                it != m_entries.end(); ++it) {
+            if (it->second.lastUse < oldest->second.lastUse) {
+                oldest = it;
+            }
+        }
+        erase_locked(oldest);
+    }
+}
+
+bool ProgramBinaryCache::isKnownShader(uint64_t shaderHash) {
+    emugl::Mutex::AutoLock lock(m_lock);
+    return m_enabled && m_shaders.find(shaderHash) != m_shaders.end();
+}
+
+bool ProgramBinaryCache::find(uint64_t key, GLenum* format,
+                              std::vector<unsigned char>* binary) {
+    emugl::Mutex::AutoLock lock(m_lock);
+    EntryMap::iterator it = m_entries.find(key);
+    if (!m_enabled || it == m_entries.end()) {
+        return false;
+    }
+    it->second.lastUse = ++m_useCounter;
+    *format = it->second.format;
+    *binary = it->second.binary;
+    return true;
+}
+
+void ProgramBinaryCache::recordLink(bool hit) {
+    emugl::Mutex::AutoLock lock(m_lock);
+    if (hit) {
+        m_stats.hits++;
+    } else {
+        m_stats.misses++;
+    }
+    printStats_locked();
+}
+
+void ProgramBinaryCache::remove(uint64_t key) {
+    emugl::Mutex::AutoLock lock(m_lock);
+    EntryMap::iterator it = m_entries.find(key);
+    if (it == m_entries.end()) {
+        return;
+    }
+    erase_locked(it);
+    m_stats.failures++;
+    if (m_file) {
+        Entry removed;
+        removed.vertexHash = removed.fragmentHash = 0;
+        removed.format = 0;
+        appendRecord_locked(m_file, key, removed);
+    }
+}
+
+void ProgramBinaryCache::store(uint64_t key, uint64_t vertexHash,
+                               uint64_t fragmentHash, GLenum format,
+                               const std::vector<unsigned char>& binary) {
+    emugl::Mutex::AutoLock lock(m_lock);
+    if (!m_enabled || binary.empty() || binary.size() > m_maxBytes) {
+        return;
+    }
+    Entry entry;
+    entry.vertexHash = vertexHash;
+    entry.fragmentHash = fragmentHash;
+    entry.format = format;
+    entry.binary = binary;
+    if (!appendRecord_locked(m_file, key, entry)) {
+        fprintf(stderr, "%s: Could not write %s, disabling the cache\n",
+                __FUNCTION__, m_path.c_str());
+        fclose(m_file);
+        m_file = NULL;
+        m_enabled = false;
+        return;
+    }
+    insert_locked(key, &entry);
+    evict_locked();
+
+    if (m_fileBytes > 2 * m_maxBytes) {
+        if (!rewrite_locked() ||
+            !(m_file = fopen(m_path.c_str(), "ab"))) {
+            m_enabled = false;
+        }
+    }
+}
+
+ProgramBinaryCache::Stats ProgramBinaryCache::getStats() {
+    emugl::Mutex::AutoLock lock(m_lock);
+    Stats stats = m_stats;
+    stats.entries = m_entries.size();
+    stats.bytes = m_bytes;
+    return stats;
+}
+
+void ProgramBinaryCache::printStats_locked() {
+    if (!m_showStats) {
+        return;
+    }
+    uint64_t links = m_stats.hits + m_stats.misses;
+    fprintf(stderr,
+            "Program cache: %llu hits, %llu misses (%.1f%% hit rate), "
+            "%llu rejected, %u programs, %llu KB\n",
+            (unsigned long long)m_stats.hits,
+            (unsigned long long)m_stats.misses,
+            links ? 100.0 * m_stats.hits / links : 0.0,
+            (unsigned long long)m_stats.failures,
+            (unsigned)m_entries.size(),
+            (unsigned long long)(m_bytes / 1024));
+}
@@ -0,0 +1,133 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#ifndef PROGRAM_BINARY_CACHE_H
+#define PROGRAM_BINARY_CACHE_H
+
+#include "emugl/common/lazy_instance.h"
+#include "emugl/common/mutex.h"
+
+#include <GLES2/gl2.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <stdio.h>
+
+class GLDispatch;
+
+// A persistent cache of the host program binaries linked by the GLES 2.0
+// translator, so that the shaders of an application are not compiled and
+// linked again by the host driver each time it starts.
+//
+// The cache is a single file, set by the ANDROID_GL_PROGRAM_CACHE
+// environment variable, that is only used if the host GL implementation
+// supports glGetProgramBinary() / glProgramBinary(). The file is discarded
+// when the host GL vendor, renderer or version strings change. Its maximum
+// size is set by ANDROID_GL_PROGRAM_CACHE_MB (32 MiB by default), and the
+// least recently used programs are evicted first.
+//
+// Programs are keyed by a hash of the translated source of their shaders
+// and of their attribute bindings. Since a shader whose source is in the
+// cache is known to compile, glCompileShader() defers the host compilation
+// of such shaders, which is only done if the program binary can't be used.
+//
+// New programs are appended to the file as they are linked, so that the
+// cache survives crashes, and the file is rewritten when it holds too many
+// evicted or replaced programs.
+class ProgramBinaryCache {
+public:
+    struct Stats {
+        uint64_t hits;      // links done with a cached binary.
+        uint64_t misses;    // links done by the host driver.
+        uint64_t failures;  // cached binaries rejected by the driver.
+        size_t entries;
+        uint64_t bytes;
+    };
+
+    // Return the process-wide instance.
+    static ProgramBinaryCache* get();
+
+    // Return a 64-bit hash of |size| bytes at |data|, continuing from
+    // |seed|, which is the value returned for the previous bytes, if any.
+    static uint64_t hash(const void* data, size_t size,
+                         uint64_t seed = kHashSeed);
+    static const uint64_t kHashSeed = 14695981039346656037ULL;
+
+    // Return true iff the cache can be used. The first call loads the cache
+    // file, and queries the host implementation with |dispatcher|, so there
+    // must be a current context.
+    bool isEnabled(GLDispatch& dispatcher);
+
+    // Return true iff a cached program uses a shader of hash |shaderHash|.
+    bool isKnownShader(uint64_t shaderHash);
+
+    // Look for the program |key|, and copy its binary and format on
+    // success. Call recordLink() with the outcome, and remove() if the
+    // driver rejects the binary.
+    bool find(uint64_t key, GLenum* format, std::vector<unsigned char>* binary);
+    void recordLink(bool hit);
+    void remove(uint64_t key);
+
+    // Add the program |key|, linked from shaders of hash |vertexHash| and
+    // |fragmentHash|, with its binary.
+    void store(uint64_t key, uint64_t vertexHash, uint64_t fragmentHash,
+               GLenum format, const std::vector<unsigned char>& binary);
+
+    Stats getStats();
+
+private:
+    friend struct emugl::LazyInstance<ProgramBinaryCache>;
+
+    ProgramBinaryCache();
+    ~ProgramBinaryCache();
+
+    struct Entry {
+        uint64_t vertexHash;
+        uint64_t fragmentHash;
+        GLenum format;
+        uint64_t lastUse;
+        std::vector<unsigned char> binary;
+    };
+    typedef std::map<uint64_t, Entry> EntryMap;
+
+    void init_locked(GLDispatch& dispatcher);
+    bool load_locked();
+    bool rewrite_locked();
+    bool appendRecord_locked(FILE* file, uint64_t key, const Entry& entry);
+    void insert_locked(uint64_t key, Entry* entry);
+    void erase_locked(EntryMap::iterator it);
+    void evict_locked();
+    void printStats_locked();
+
+    emugl::Mutex m_lock;
+    bool m_initialized;
+    bool m_enabled;
+    bool m_showStats;
+    std::string m_path;
+    std::string m_identity;
+    FILE* m_file;            // opened for appending, or NULL.
+    uint64_t m_fileBytes;    // size of the records in the file.
+    uint64_t m_maxBytes;
+    uint64_t m_bytes;        // size of the binaries in m_entries.
+    uint64_t m_useCounter;
+    EntryMap m_entries;
+    std::map<uint64_t, int> m_shaders;  // hash -> number of programs.
+    Stats m_stats;
+};
+
+#endif
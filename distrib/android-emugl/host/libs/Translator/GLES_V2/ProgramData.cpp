@@ -17,6 +17,8 @@
 #include <GLcommon/objectNameManager.h>
 #include "ProgramData.h"
 
+#include <stdio.h>
+
 ProgramData::ProgramData() :  ObjectData(PROGRAM_DATA),
                               AttachedVertexShader(0),
                               AttachedFragmentShader(0),
@@ -96,3 +98,11 @@ void ProgramData::setLinkStatus(GLint status) {
 GLint ProgramData::getLinkStatus() {
     return LinkStatus;
 }
+
+void ProgramData::addAttribBinding(GLuint index, const char* name) {
+    char indexStr[16];
+    snprintf(indexStr, sizeof(indexStr), "%u=", index);
+    AttribBindings += indexStr;
+    AttribBindings += name;
+    AttribBindings += ';';
+}
@@ -16,6 +16,8 @@
 #ifndef PROGRAM_DATA_H
 #define PROGRAM_DATA_H
 
+#include <string>
+
 class ProgramData:public ObjectData{
 public:
     ProgramData();
@@ -40,6 +42,11 @@ public:
 
     bool getDeleteStatus() const { return DeleteStatus; }
     void setDeleteStatus(bool status) { DeleteStatus = status; }
+
+    // Record a glBindAttribLocation() call, which affects the next link,
+    // and return all the calls so far, as part of the program binary key.
+    void addAttribBinding(GLuint index, const char* name);
+    const std::string& getAttribBindings() const { return AttribBindings; }
 private:
     GLuint AttachedVertexShader;
     GLuint AttachedFragmentShader;
@@ -47,5 +54,6 @@ private:
     GLchar* infoLog;
     bool    IsInUse;
     bool    DeleteStatus;
+    std::string AttribBindings;
 };
 #endif
@@ -15,6 +15,7 @@
 */
 
 #include "ShaderParser.h"
+#include "ProgramBinaryCache.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -23,7 +24,9 @@ ShaderParser::ShaderParser():ObjectData(SHADER_DATA),
                              m_originalSrc(NULL),
                              m_parsedLines(NULL),
                              m_deleteStatus(false),
-                             m_program(0) {
+                             m_program(0),
+                             m_srcHash(0),
+                             m_compileDeferred(false) {
     m_infoLog = new GLchar[1];
     m_infoLog[0] = '\0';
 };
@@ -33,7 +36,9 @@ ShaderParser::ShaderParser(GLenum type):ObjectData(SHADER_DATA),
                                         m_originalSrc(NULL),
                                         m_parsedLines(NULL),
                                         m_deleteStatus(false),
-                                        m_program(0) {
+                                        m_program(0),
+                                        m_srcHash(0),
+                                        m_compileDeferred(false) {
 
     m_infoLog = new GLchar[1];
     m_infoLog[0] = '\0';
@@ -73,6 +78,10 @@ void ShaderParser::setSrc(const Version& ver,GLsizei count,const GLchar* const*
 #endif
     parseLineNumbers();
     parseOriginalSrc();
+
+    m_srcHash = ProgramBinaryCache::hash(&m_type, sizeof(m_type));
+    m_srcHash = ProgramBinaryCache::hash(m_parsedSrc.c_str(),
+                                         m_parsedSrc.size(), m_srcHash);
 }
 const GLchar** ShaderParser::parsedLines() {
       m_parsedLines = (GLchar*)m_parsedSrc.c_str();
@@ -19,6 +19,7 @@
 
 #include "GLESv2Context.h"
 #include <string>
+#include <stdint.h>
 #include <GLES2/gl2.h>
 #include <GLcommon/objectNameManager.h>
 
@@ -40,6 +41,14 @@ public:
 
     void setAttachedProgram(GLuint program) { m_program = program; }
     GLuint getAttachedProgram() const { return m_program; }
+
+    // Hash of the type and translated source, for the ProgramBinaryCache.
+    uint64_t getSrcHash() const { return m_srcHash; }
+
+    // True if glCompileShader() was called, but the host compilation was
+    // deferred because the program binary cache knows the source.
+    void setCompileDeferred(bool val) { m_compileDeferred = val; }
+    bool isCompileDeferred() const { return m_compileDeferred; }
 private:
     void parseOriginalSrc();
     void parseGLSLversion();
@@ -57,5 +66,7 @@ private:
     GLchar*     m_infoLog;
     bool        m_deleteStatus;
     GLuint      m_program;
+    uint64_t    m_srcHash;
+    bool        m_compileDeferred;
 };
 #endif
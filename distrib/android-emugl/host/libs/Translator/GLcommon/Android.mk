@@ -11,6 +11,8 @@ host_common_SRC_FILES :=     \
      TextureUtils.cpp        \
      PaletteTexture.cpp      \
      etc1.cpp                \
+     Etc1Decoder.cpp         \
+     GpuTextureDecoder.cpp   \
      objectNameManager.cpp   \
      FramebufferData.cpp
 
@@ -29,6 +31,23 @@ ifeq ($(HOST_OS),windows)
     host_common_LDFLAGS += -Wl,--add-stdcall-alias
 endif
 
+### SSSE3 ETC1 block decoder #######################
+# Built separately since it needs -mssse3, which must not be used for
+# the rest of the library. Only called when the host CPU supports SSSE3.
+
+$(call emugl-begin-host-static-library,libGLcommon_ssse3)
+LOCAL_SRC_FILES := Etc1DecoderSsse3.cpp
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/../include
+LOCAL_CFLAGS += -mssse3
+$(call emugl-end-module)
+
+$(call emugl-begin-host64-static-library,lib64GLcommon_ssse3)
+LOCAL_SRC_FILES := Etc1DecoderSsse3.cpp
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/../include
+LOCAL_CFLAGS += -mssse3
+$(call emugl-end-module)
+
+
 ### EGL host implementation ########################
 
 $(call emugl-begin-host-static-library,libGLcommon)
@@ -38,7 +57,7 @@ LOCAL_SRC_FILES := $(host_common_SRC_FILES)
 $(call emugl-export,LDLIBS,$(host_common_LDLIBS))
 $(call emugl-export,LDFLAGS,$(host_common_LDFLAGS))
 $(call emugl-export,C_INCLUDES,$(LOCAL_PATH)/../include $(EMUGL_PATH)/shared)
-$(call emugl-export,STATIC_LIBRARIES, libemugl_common)
+$(call emugl-export,STATIC_LIBRARIES, libGLcommon_ssse3 libemugl_common)
 
 $(call emugl-end-module)
 
@@ -51,6 +70,21 @@ LOCAL_SRC_FILES := $(host_common_SRC_FILES)
 $(call emugl-export,LDLIBS,$(host_common_LDLIBS))
 $(call emugl-export,LDFLAGS,$(host_common_LDFLAGS))
 $(call emugl-export,C_INCLUDES,$(LOCAL_PATH)/../include $(EMUGL_PATH)/shared)
-$(call emugl-export,STATIC_LIBRARIES, lib64emugl_common)
+$(call emugl-export,STATIC_LIBRARIES, lib64GLcommon_ssse3 lib64emugl_common)
+
+$(call emugl-end-module)
+
+
+### emugl_etc1_decoder_benchmark ##################
+
+$(call emugl-begin-host-executable,emugl_etc1_decoder_benchmark)
+LOCAL_SRC_FILES := Etc1DecoderBenchmark.cpp Etc1Decoder.cpp etc1.cpp
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/../include
+$(call emugl-import,libGLcommon_ssse3 libemugl_common)
+$(call emugl-end-module)
 
+$(call emugl-begin-host64-executable,emugl64_etc1_decoder_benchmark)
+LOCAL_SRC_FILES := Etc1DecoderBenchmark.cpp Etc1Decoder.cpp etc1.cpp
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/../include
+$(call emugl-import,lib64GLcommon_ssse3 lib64emugl_common)
 $(call emugl-end-module)
@@ -0,0 +1,257 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#include <GLcommon/Etc1Decoder.h>
+
+#include "emugl/common/thread.h"
+
+#include <string.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#define ETC1_X86 1
+#endif
+
+#ifdef __SSE2__
+#include "Etc1DecoderSimd.h"
+#endif
+
+namespace {
+
+typedef void (*Etc1BlockDecodeFunc)(const etc1_byte* pIn, etc1_byte* pOut);
+
+#ifdef __SSE2__
+void etc1DecodeBlockSse2(const etc1_byte* pIn, etc1_byte* pOut) {
+    __m128i r, g, b;
+    etc1SimdDecodeBlock(pIn, &r, &g, &b);
+
+    // Interleave into R, G, B, 0 pixels, then drop the padding bytes.
+    __m128i zero = _mm_setzero_si128();
+    __m128i rgLo = _mm_unpacklo_epi8(r, g);
+    __m128i rgHi = _mm_unpackhi_epi8(r, g);
+    __m128i b0Lo = _mm_unpacklo_epi8(b, zero);
+    __m128i b0Hi = _mm_unpackhi_epi8(b, zero);
+    etc1_byte pixels[64];
+    _mm_storeu_si128((__m128i*)(pixels + 0), _mm_unpacklo_epi16(rgLo, b0Lo));
+    _mm_storeu_si128((__m128i*)(pixels + 16), _mm_unpackhi_epi16(rgLo, b0Lo));
+    _mm_storeu_si128((__m128i*)(pixels + 32), _mm_unpacklo_epi16(rgHi, b0Hi));
+    _mm_storeu_si128((__m128i*)(pixels + 48), _mm_unpackhi_epi16(rgHi, b0Hi));
+    for (int n = 0; n < 16; ++n) {
+        memcpy(pOut + 3 * n, pixels + 4 * n, 3);
+    }
+}
+#endif  // __SSE2__
+
+}  // namespace
+
+#ifdef ETC1_X86
+// Implemented in Etc1DecoderSsse3.cpp.
+void etc1DecodeBlockSsse3(const etc1_byte* pIn, etc1_byte* pOut);
+#endif
+
+namespace {
+
+#ifdef ETC1_X86
+bool hostHasSsse3() {
+    static int result = -1;
+    if (result < 0) {
+        unsigned eax, ebx, ecx, edx;
+        result = __get_cpuid(1, &eax, &ebx, &ecx, &edx) &&
+                 (ecx & bit_SSSE3) != 0;
+    }
+    return result != 0;
+}
+#endif
+
+// Return the block decoding function for |decoder|, or NULL if it is not
+// supported by the host CPU.
+Etc1BlockDecodeFunc getBlockDecodeFunc(Etc1Decoder decoder) {
+    switch (decoder) {
+        case ETC1_DECODER_AUTO:
+#ifdef ETC1_X86
+            if (hostHasSsse3()) {
+                return etc1DecodeBlockSsse3;
+            }
+#endif
+#ifdef __SSE2__
+            return etc1DecodeBlockSse2;
+#else
+            return etc1_decode_block;
+#endif
+        case ETC1_DECODER_SCALAR:
+            return etc1_decode_block;
+#ifdef __SSE2__
+        case ETC1_DECODER_SSE2:
+            return etc1DecodeBlockSse2;
+#endif
+#ifdef ETC1_X86
+        case ETC1_DECODER_SSSE3:
+            return hostHasSsse3() ? etc1DecodeBlockSsse3 : NULL;
+#endif
+        default:
+            return NULL;
+    }
+}
+
+int getCpuCount() {
+    static int result = 0;
+    if (!result) {
+#ifdef _WIN32
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        result = static_cast<int>(info.dwNumberOfProcessors);
+#else
+        result = static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN));
+#endif
+        if (result < 1) {
+            result = 1;
+        }
+    }
+    return result;
+}
+
+// Images with less than this many blocks per thread are not worth
+// splitting, considering the cost of starting a thread.
+const etc1_uint32 kMinBlocksPerThread = 4096;
+
+const int kMaxThreads = 8;
+
+// A stripe of 4-pixel block rows to decode.
+struct Etc1Stripe {
+    const etc1_byte* in;
+    etc1_byte* out;
+    etc1_uint32 width;
+    etc1_uint32 height;
+    etc1_uint32 stride;
+    Etc1BlockDecodeFunc decodeBlock;
+};
+
+void decodeStripe(const Etc1Stripe& stripe) {
+    const etc1_byte* pIn = stripe.in;
+    etc1_byte block[ETC1_DECODED_BLOCK_SIZE];
+    for (etc1_uint32 y = 0; y < stripe.height; y += 4) {
+        etc1_uint32 yEnd = stripe.height - y;
+        if (yEnd > 4) {
+            yEnd = 4;
+        }
+        etc1_byte* row = stripe.out + stripe.stride * y;
+        for (etc1_uint32 x = 0; x < stripe.width; x += 4) {
+            etc1_uint32 xEnd = stripe.width - x;
+            if (xEnd > 4) {
+                xEnd = 4;
+            }
+            stripe.decodeBlock(pIn, block);
+            pIn += ETC1_ENCODED_BLOCK_SIZE;
+            for (etc1_uint32 cy = 0; cy < yEnd; cy++) {
+                memcpy(row + 3 * x + stripe.stride * cy,
+                       block + cy * 4 * 3,
+                       xEnd * 3);
+            }
+        }
+    }
+}
+
+class Etc1StripeThread : public emugl::Thread {
+public:
+    explicit Etc1StripeThread(const Etc1Stripe& stripe) : mStripe(stripe) {}
+
+    virtual intptr_t main() {
+        decodeStripe(mStripe);
+        return 0;
+    }
+
+private:
+    Etc1Stripe mStripe;
+};
+
+}  // namespace
+
+bool etc1IsDecoderSupported(Etc1Decoder decoder) {
+    return getBlockDecodeFunc(decoder) != NULL;
+}
+
+int etc1DecodeImage(const etc1_byte* pIn, etc1_byte* pOut,
+                    etc1_uint32 width, etc1_uint32 height,
+                    etc1_uint32 stride,
+                    Etc1Decoder decoder,
+                    int maxThreads) {
+    Etc1BlockDecodeFunc decodeBlock = getBlockDecodeFunc(decoder);
+    if (!decodeBlock) {
+        return -1;
+    }
+
+    etc1_uint32 blocksPerRow = (width + 3) / 4;
+    etc1_uint32 blockRows = (height + 3) / 4;
+
+    etc1_uint32 numThreads = (blocksPerRow * blockRows) / kMinBlocksPerThread;
+    if (numThreads > 1) {
+        if (maxThreads <= 0) {
+            maxThreads = getCpuCount();
+        }
+        if (maxThreads > kMaxThreads) {
+            maxThreads = kMaxThreads;
+        }
+        if (numThreads > (etc1_uint32)maxThreads) {
+            numThreads = maxThreads;
+        }
+    }
+    if (numThreads > blockRows) {
+        numThreads = blockRows;
+    }
+    if (numThreads < 1) {
+        numThreads = 1;
+    }
+
+    // Split the image in |numThreads| stripes of block rows. The first one
+    // is decoded by the current thread.
+    Etc1StripeThread* threads[kMaxThreads] = { NULL };
+    Etc1Stripe first = { pIn, pOut, width, 0, stride, decodeBlock };
+    etc1_uint32 startRow = 0;
+    for (etc1_uint32 n = 0; n < numThreads; ++n) {
+        etc1_uint32 endRow = blockRows * (n + 1) / numThreads;
+        Etc1Stripe stripe;
+        stripe.in = pIn + ETC1_ENCODED_BLOCK_SIZE * blocksPerRow * startRow;
+        stripe.out = pOut + stride * 4 * startRow;
+        stripe.width = width;
+        stripe.height = (endRow == blockRows ? height : 4 * endRow) -
+                4 * startRow;
+        stripe.stride = stride;
+        stripe.decodeBlock = decodeBlock;
+        startRow = endRow;
+        if (n == 0) {
+            first = stripe;
+            continue;
+        }
+        threads[n] = new Etc1StripeThread(stripe);
+        if (!threads[n]->start()) {
+            // NOTE: An emugl::Thread that was never started cannot be
+            // deleted, so leak it in this unlikely case.
+            threads[n] = NULL;
+            decodeStripe(stripe);
+        }
+    }
+    decodeStripe(first);
+    for (etc1_uint32 n = 1; n < numThreads; ++n) {
+        if (threads[n]) {
+            threads[n]->wait(NULL);
+            delete threads[n];
+        }
+    }
+    return 0;
+}
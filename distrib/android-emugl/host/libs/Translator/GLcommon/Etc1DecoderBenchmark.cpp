@@ -0,0 +1,122 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// A small benchmark comparing the ETC1 decoders available through
+// etc1DecodeImage() with the original scalar etc1_decode_image(), on
+// random block data (every 64-bit value is a valid ETC1 block). It also
+// checks that all of them produce the same pixels.
+//
+// Usage: emugl_etc1_decoder_benchmark [<iterations> [<width> <height>]]
+
+#include <GLcommon/Etc1Decoder.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+namespace {
+
+double nowSec() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    int iterations = 20;
+    etc1_uint32 width = 2048;
+    etc1_uint32 height = 2048;
+    if (argc > 1) {
+        iterations = atoi(argv[1]);
+    }
+    if (argc > 3) {
+        width = static_cast<etc1_uint32>(atol(argv[2]));
+        height = static_cast<etc1_uint32>(atol(argv[3]));
+    }
+    if (iterations <= 0 || width == 0 || height == 0) {
+        fprintf(stderr, "Invalid parameters\n");
+        return 1;
+    }
+
+    etc1_uint32 inSize = etc1_get_encoded_data_size(width, height);
+    etc1_uint32 stride = 3 * width;
+    etc1_byte* in = static_cast<etc1_byte*>(malloc(inSize));
+    etc1_byte* expected = static_cast<etc1_byte*>(malloc(stride * height));
+    etc1_byte* out = static_cast<etc1_byte*>(malloc(stride * height));
+    if (!in || !expected || !out) {
+        fprintf(stderr, "Could not allocate buffers\n");
+        return 1;
+    }
+    unsigned seed = 12345;
+    for (etc1_uint32 n = 0; n < inSize; ++n) {
+        seed = seed * 1103515245U + 12345U;
+        in[n] = static_cast<etc1_byte>(seed >> 16);
+    }
+
+    double mpixels = (double)width * height * iterations / 1e6;
+    printf("%d decodes of %ux%u pixels:\n", iterations, width, height);
+
+    double start = nowSec();
+    for (int n = 0; n < iterations; ++n) {
+        etc1_decode_image(in, expected, width, height, 3, stride);
+    }
+    printf("  %-24s: %8.1f Mpixels/s\n", "etc1_decode_image",
+           mpixels / (nowSec() - start));
+
+    static const struct {
+        Etc1Decoder decoder;
+        const char* name;
+    } kDecoders[] = {
+        { ETC1_DECODER_SCALAR, "scalar" },
+        { ETC1_DECODER_SSE2, "sse2" },
+        { ETC1_DECODER_SSSE3, "ssse3" },
+        { ETC1_DECODER_AUTO, "auto" },
+    };
+    int result = 0;
+    for (size_t d = 0; d < sizeof(kDecoders) / sizeof(kDecoders[0]); ++d) {
+        if (!etc1IsDecoderSupported(kDecoders[d].decoder)) {
+            printf("  %-24s: not supported\n", kDecoders[d].name);
+            continue;
+        }
+        // One thread, then as many as etc1DecodeImage() wants.
+        for (int threads = 1; threads >= 0; --threads) {
+            memset(out, 0, stride * height);
+            start = nowSec();
+            for (int n = 0; n < iterations; ++n) {
+                etc1DecodeImage(in, out, width, height, stride,
+                                kDecoders[d].decoder, threads);
+            }
+            double elapsed = nowSec() - start;
+            char label[32];
+            snprintf(label, sizeof(label), "%s, %s", kDecoders[d].name,
+                     threads ? "1 thread" : "all threads");
+            bool ok = !memcmp(out, expected, stride * height);
+            printf("  %-24s: %8.1f Mpixels/s%s\n", label, mpixels / elapsed,
+                   ok ? "" : " MISMATCH");
+            if (!ok) {
+                result = 1;
+            }
+        }
+    }
+
+    free(out);
+    free(expected);
+    free(in);
+    return result;
+}
@@ -0,0 +1,147 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#ifndef _ETC1_DECODER_SIMD_H
+#define _ETC1_DECODER_SIMD_H
+
+// Internal header shared by the SSE2 and SSSE3 ETC1 block decoders.
+// Everything here is static, since the including sources are compiled with
+// different instruction set flags.
+
+#include <GLcommon/etc1.h>
+
+#include <emmintrin.h>
+
+// Intensity modifiers (a, b) for each table codeword, see etc1.cpp.
+static const short kEtc1SimdModifiers[8][2] = {
+    { 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 },
+    { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 },
+};
+
+static const int kEtc1SimdLookup[8] = { 0, 1, 2, 3, -4, -3, -2, -1 };
+
+static inline int etc1SimdConvert4To8(int b) {
+    int c = b & 0xf;
+    return (c << 4) | c;
+}
+
+static inline int etc1SimdConvert5To8(int b) {
+    int c = b & 0x1f;
+    return (c << 3) | (c >> 2);
+}
+
+static inline int etc1SimdConvertDiff(int base, int diff) {
+    return etc1SimdConvert5To8((0x1f & base) + kEtc1SimdLookup[0x7 & diff]);
+}
+
+// Return |mask| ? |b| : |a| for each 16-bit lane.
+static inline __m128i etc1SimdSelect(__m128i mask, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_and_si128(mask, b), _mm_andnot_si128(mask, a));
+}
+
+// Decode 8 pixels of a block, i.e. two rows, into 16-bit values.
+// |second| has all bits set for pixels of the second sub-block, and |bits|
+// has the bit of each pixel's index in the low and high halves of the
+// block's pixel index word (which are broadcast in |lsb| and |msb|).
+static inline void etc1SimdDecodeHalf(__m128i second, __m128i bits,
+                                      __m128i lsb, __m128i msb,
+                                      const int* base1, const int* base2,
+                                      const short* mod1, const short* mod2,
+                                      __m128i* r, __m128i* g, __m128i* b) {
+    __m128i lsbSet = _mm_cmpeq_epi16(_mm_and_si128(lsb, bits), bits);
+    __m128i msbSet = _mm_cmpeq_epi16(_mm_and_si128(msb, bits), bits);
+
+    // The modifier is a or b depending on the index's low bit, and is
+    // negated if its high bit is set.
+    __m128i small = etc1SimdSelect(second, _mm_set1_epi16(mod1[0]),
+                                   _mm_set1_epi16(mod2[0]));
+    __m128i large = etc1SimdSelect(second, _mm_set1_epi16(mod1[1]),
+                                   _mm_set1_epi16(mod2[1]));
+    __m128i delta = etc1SimdSelect(lsbSet, small, large);
+    delta = _mm_sub_epi16(_mm_xor_si128(delta, msbSet), msbSet);
+
+    *r = _mm_add_epi16(etc1SimdSelect(second, _mm_set1_epi16(base1[0]),
+                                      _mm_set1_epi16(base2[0])), delta);
+    *g = _mm_add_epi16(etc1SimdSelect(second, _mm_set1_epi16(base1[1]),
+                                      _mm_set1_epi16(base2[1])), delta);
+    *b = _mm_add_epi16(etc1SimdSelect(second, _mm_set1_epi16(base1[2]),
+                                      _mm_set1_epi16(base2[2])), delta);
+}
+
+// Decode the ETC1 block at |pIn| into three vectors holding the 16 red,
+// green and blue values of the block's pixels, in raster order (i.e. pixel
+// (x,y) is at index x + 4 * y). This computes the same values as
+// etc1_decode_block(); in particular _mm_packus_epi16() implements the
+// clamping to [0..255].
+static inline void etc1SimdDecodeBlock(const etc1_byte* pIn,
+                                       __m128i* pR,
+                                       __m128i* pG,
+                                       __m128i* pB) {
+    etc1_uint32 high = (pIn[0] << 24) | (pIn[1] << 16) | (pIn[2] << 8) | pIn[3];
+    etc1_uint32 low = (pIn[4] << 24) | (pIn[5] << 16) | (pIn[6] << 8) | pIn[7];
+    int base1[3], base2[3];
+    if (high & 2) {
+        // differential
+        int rBase = high >> 27;
+        int gBase = high >> 19;
+        int bBase = high >> 11;
+        base1[0] = etc1SimdConvert5To8(rBase);
+        base2[0] = etc1SimdConvertDiff(rBase, high >> 24);
+        base1[1] = etc1SimdConvert5To8(gBase);
+        base2[1] = etc1SimdConvertDiff(gBase, high >> 16);
+        base1[2] = etc1SimdConvert5To8(bBase);
+        base2[2] = etc1SimdConvertDiff(bBase, high >> 8);
+    } else {
+        // not differential
+        base1[0] = etc1SimdConvert4To8(high >> 28);
+        base2[0] = etc1SimdConvert4To8(high >> 24);
+        base1[1] = etc1SimdConvert4To8(high >> 20);
+        base2[1] = etc1SimdConvert4To8(high >> 16);
+        base1[2] = etc1SimdConvert4To8(high >> 12);
+        base2[2] = etc1SimdConvert4To8(high >> 8);
+    }
+    const short* mod1 = kEtc1SimdModifiers[7 & (high >> 5)];
+    const short* mod2 = kEtc1SimdModifiers[7 & (high >> 2)];
+
+    // The index bits of pixel (x,y) are at position y + 4 * x.
+    const __m128i bits0 = _mm_set_epi16(1 << 13, 1 << 9, 1 << 5, 1 << 1,
+                                        1 << 12, 1 << 8, 1 << 4, 1 << 0);
+    const __m128i bits1 = _mm_set_epi16((short)(1 << 15), 1 << 11, 1 << 7,
+                                        1 << 3, 1 << 14, 1 << 10, 1 << 6,
+                                        1 << 2);
+    __m128i second0, second1;
+    if (high & 1) {
+        // flipped: the second sub-block is the bottom half.
+        second0 = _mm_setzero_si128();
+        second1 = _mm_set1_epi16(-1);
+    } else {
+        // the second sub-block is the right half.
+        second0 = _mm_set_epi16(-1, -1, 0, 0, -1, -1, 0, 0);
+        second1 = second0;
+    }
+    __m128i lsb = _mm_set1_epi16((short)(low & 0xffff));
+    __m128i msb = _mm_set1_epi16((short)(low >> 16));
+
+    __m128i r0, g0, b0, r1, g1, b1;
+    etc1SimdDecodeHalf(second0, bits0, lsb, msb, base1, base2, mod1, mod2,
+                       &r0, &g0, &b0);
+    etc1SimdDecodeHalf(second1, bits1, lsb, msb, base1, base2, mod1, mod2,
+                       &r1, &g1, &b1);
+    *pR = _mm_packus_epi16(r0, r1);
+    *pG = _mm_packus_epi16(g0, g1);
+    *pB = _mm_packus_epi16(b0, b1);
+}
+
+#endif
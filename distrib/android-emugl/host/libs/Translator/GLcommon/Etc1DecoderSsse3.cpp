@@ -0,0 +1,67 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// This source file is built with -mssse3 in its own module, see
+// Android.mk; etc1DecodeImage() only calls it when the host CPU supports
+// SSSE3.
+
+#include <GLcommon/etc1.h>
+
+#ifdef __SSSE3__
+
+#include "Etc1DecoderSimd.h"
+
+#include <tmmintrin.h>
+
+#define Z -128
+
+// _mm_shuffle_epi8() masks used to interleave the red, green and blue
+// vectors into the three 16-byte parts of the 48-byte decoded block.
+static const signed char kInterleaveMasks[3][3][16] = {
+    {
+        { 0, Z, Z, 1, Z, Z, 2, Z, Z, 3, Z, Z, 4, Z, Z, 5 },
+        { Z, 0, Z, Z, 1, Z, Z, 2, Z, Z, 3, Z, Z, 4, Z, Z },
+        { Z, Z, 0, Z, Z, 1, Z, Z, 2, Z, Z, 3, Z, Z, 4, Z },
+    },
+    {
+        { Z, Z, 6, Z, Z, 7, Z, Z, 8, Z, Z, 9, Z, Z, 10, Z },
+        { 5, Z, Z, 6, Z, Z, 7, Z, Z, 8, Z, Z, 9, Z, Z, 10 },
+        { Z, 5, Z, Z, 6, Z, Z, 7, Z, Z, 8, Z, Z, 9, Z, Z },
+    },
+    {
+        { Z, 11, Z, Z, 12, Z, Z, 13, Z, Z, 14, Z, Z, 15, Z, Z },
+        { Z, Z, 11, Z, Z, 12, Z, Z, 13, Z, Z, 14, Z, Z, 15, Z },
+        { 10, Z, Z, 11, Z, Z, 12, Z, Z, 13, Z, Z, 14, Z, Z, 15 },
+    },
+};
+
+#undef Z
+
+void etc1DecodeBlockSsse3(const etc1_byte* pIn, etc1_byte* pOut) {
+    __m128i rgb[3];
+    etc1SimdDecodeBlock(pIn, &rgb[0], &rgb[1], &rgb[2]);
+    for (int n = 0; n < 3; ++n) {
+        __m128i out = _mm_setzero_si128();
+        for (int c = 0; c < 3; ++c) {
+            __m128i mask = _mm_loadu_si128(
+                    (const __m128i*)kInterleaveMasks[n][c]);
+            out = _mm_or_si128(out, _mm_shuffle_epi8(rgb[c], mask));
+        }
+        _mm_storeu_si128((__m128i*)(pOut + 16 * n), out);
+    }
+}
+
+#endif  // __SSSE3__
@@ -206,7 +206,7 @@ void FramebufferData::validate(GLEScontext* ctx)
         // drivers (e.g. ATI's) - after the framebuffer attachments
         // have changed, and before the next draw, unbind and rebind
         // the framebuffer to sort things out.
-        ctx->dispatcher().glBindFramebufferEXT(GL_FRAMEBUFFER,0);
+        ctx->dispatcher().glBindFramebufferEXT(GL_FRAMEBUFFER,ctx->getDefaultFramebuffer());
         ctx->dispatcher().glBindFramebufferEXT(GL_FRAMEBUFFER,ctx->shareGroup()->getGlobalName(FRAMEBUFFER,m_fbName));
 
         m_dirty = false;
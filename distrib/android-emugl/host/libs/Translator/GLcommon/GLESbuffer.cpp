@@ -23,6 +23,11 @@ bool  GLESbuffer::setBuffer(GLuint size,GLuint usage,const GLvoid* data) {
         delete [] m_data;
         m_data = NULL;
     }
+    if(m_converted) {
+        delete [] m_converted;
+        m_converted = NULL;
+    }
+    m_generation++;
     m_data = new unsigned char[size];
     if(m_data) {
         if(data) {
@@ -38,6 +43,7 @@ bool  GLESbuffer::setBuffer(GLuint size,GLuint usage,const GLvoid* data) {
 bool  GLESbuffer::setSubBuffer(GLint offset,GLuint size,const GLvoid* data) {
     if(offset + size > m_size) return false;
     memcpy(m_data+offset,data,size);
+    m_generation++;
     m_conversionManager.addRange(Range(offset,size));
     m_conversionManager.merge();
     return true;
@@ -48,8 +54,18 @@ void  GLESbuffer::getConversions(const RangeList& rIn,RangeList& rOut) {
         rOut.merge();
 }
 
+GLvoid* GLESbuffer::getConvertedData() {
+    if(!m_converted && m_size) {
+        m_converted = new unsigned char[m_size];
+    }
+    return m_converted;
+}
+
 GLESbuffer::~GLESbuffer() {
     if(m_data) {
         delete [] m_data;
     }
+    if(m_converted) {
+        delete [] m_converted;
+    }
 }
@@ -22,9 +22,14 @@
 #include <GLcommon/GLESvalidate.h>
 #include <GLcommon/TextureUtils.h>
 #include <GLcommon/FramebufferData.h>
+#include <GLcommon/TranslatorIfaces.h>
 #include <strings.h>
 #include <string.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 //decleration
 static void convertFixedDirectLoop(const char* dataIn,unsigned int strideIn,void* dataOut,unsigned int nBytes,unsigned int strideOut,int attribSize);
 static void convertFixedIndirectLoop(const char* dataIn,unsigned int strideIn,void* dataOut,GLsizei count,GLenum indices_type,const GLvoid* indices,unsigned int strideOut,int attribSize);
@@ -33,28 +38,34 @@ static void convertByteIndirectLoop(const char* dataIn,unsigned int strideIn,voi
 
 GLESConversionArrays::~GLESConversionArrays() {
     for(std::map<GLenum,ArrayData>::iterator it = m_arrays.begin(); it != m_arrays.end();it++) {
-        if((*it).second.allocated){
-            if((*it).second.type == GL_FLOAT){
-                GLfloat* p = (GLfloat *)((*it).second.data);
-                if(p) delete[] p;
-            } else if((*it).second.type == GL_SHORT){
-                GLshort* p = (GLshort *)((*it).second.data);
-                if(p) delete[] p;
-            }
-        }
+        delete[] static_cast<unsigned char*>((*it).second.buffer);
     }
 }
 
 void GLESConversionArrays::allocArr(unsigned int size,GLenum type){
+    ArrayData& arr = m_arrays[m_current];
+    unsigned int bytes;
     if(type == GL_FIXED){
-        m_arrays[m_current].data = new GLfloat[size];
-        m_arrays[m_current].type = GL_FLOAT;
+        arr.type = GL_FLOAT;
+        bytes = size*sizeof(GLfloat);
     } else if(type == GL_BYTE){
-        m_arrays[m_current].data = new GLshort[size];
-        m_arrays[m_current].type = GL_SHORT;
+        arr.type = GL_SHORT;
+        bytes = size*sizeof(GLshort);
+    } else {
+        return;
     }
-    m_arrays[m_current].stride = 0;
-    m_arrays[m_current].allocated = true;
+    if(arr.bufferSize < bytes) {
+        delete[] static_cast<unsigned char*>(arr.buffer);
+        arr.buffer = new unsigned char[bytes];
+        arr.bufferSize = bytes;
+    }
+    arr.data = arr.buffer;
+    arr.stride = 0;
+    arr.allocated = true;
+}
+
+void GLESConversionArrays::reset(){
+    m_current = 0;
 }
 
 void GLESConversionArrays::setArr(void* data,unsigned int stride,GLenum type){
@@ -162,7 +173,11 @@ GLEScontext::GLEScontext():
                            m_arrayBuffer(0)        ,
                            m_elementBuffer(0),
                            m_renderbuffer(0),
-                           m_framebuffer(0)
+                           m_framebuffer(0),
+                           m_surfaceFbo(0),
+                           m_surfaceFboBound(false),
+                           m_surfaceFboId(0),
+                           m_gpuTextureDecoder(NULL)
 {
 };
 
@@ -187,6 +202,102 @@ GLEScontext::~GLEScontext() {
     }
     delete[] m_texState;
     m_texState = NULL;
+    delete m_gpuTextureDecoder;
+}
+
+void GLEScontext::setSurfaceFramebuffer(SurfaceFramebuffer* fb) {
+    GLDispatch& gl = s_glDispatch;
+    if (!fb) {
+        if (m_surfaceFboBound && !m_framebuffer) {
+            gl.glBindFramebufferEXT(GL_FRAMEBUFFER_OES, 0);
+        }
+        m_surfaceFboBound = false;
+        return;
+    }
+    if (!gl.glGenFramebuffersEXT || !gl.glGenRenderbuffersEXT) {
+        return;
+    }
+
+    if (!fb->colorRenderbuffer) {
+        GLint prevRb = 0;
+        gl.glGetIntegerv(GL_RENDERBUFFER_BINDING_OES, &prevRb);
+        gl.glGenRenderbuffersEXT(1, &fb->colorRenderbuffer);
+        gl.glBindRenderbufferEXT(GL_RENDERBUFFER_OES, fb->colorRenderbuffer);
+        gl.glRenderbufferStorageEXT(GL_RENDERBUFFER_OES, fb->colorFormat,
+                                    fb->width, fb->height);
+        if (fb->depthStencilFormat) {
+            gl.glGenRenderbuffersEXT(1, &fb->depthStencilRenderbuffer);
+            gl.glBindRenderbufferEXT(GL_RENDERBUFFER_OES,
+                                     fb->depthStencilRenderbuffer);
+            gl.glRenderbufferStorageEXT(GL_RENDERBUFFER_OES,
+                                        fb->depthStencilFormat,
+                                        fb->width, fb->height);
+        }
+        gl.glBindRenderbufferEXT(GL_RENDERBUFFER_OES, prevRb);
+    }
+
+    // The first time the context is made current with a surface, its
+    // viewport and scissor box are set to the size of the surface. The
+    // host driver did that for the tiny anchor pbuffer instead.
+    bool firstSurface = (m_surfaceFbo == 0);
+    if (firstSurface) {
+        gl.glGenFramebuffersEXT(1, &m_surfaceFbo);
+    }
+    gl.glBindFramebufferEXT(GL_FRAMEBUFFER_OES, m_surfaceFbo);
+    if (m_surfaceFboId != fb->id) {
+        gl.glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_OES,
+                                        GL_COLOR_ATTACHMENT0_OES,
+                                        GL_RENDERBUFFER_OES,
+                                        fb->colorRenderbuffer);
+        gl.glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_OES,
+                                        GL_DEPTH_ATTACHMENT_OES,
+                                        GL_RENDERBUFFER_OES,
+                                        fb->depthStencilRenderbuffer);
+        gl.glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_OES,
+                                        GL_STENCIL_ATTACHMENT_OES,
+                                        GL_RENDERBUFFER_OES,
+                                        fb->depthStencilRenderbuffer);
+        m_surfaceFboId = fb->id;
+    }
+    if (firstSurface) {
+        gl.glViewport(0, 0, fb->width, fb->height);
+        gl.glScissor(0, 0, fb->width, fb->height);
+    }
+    m_surfaceFboBound = true;
+
+    // Keep the framebuffer object the guest has bound, if any.
+    if (m_framebuffer && m_shareGroup.Ptr()) {
+        gl.glBindFramebufferEXT(
+                GL_FRAMEBUFFER_OES,
+                m_shareGroup->getGlobalName(FRAMEBUFFER, m_framebuffer));
+    }
+}
+
+void GLEScontext::bindDefaultFramebuffer() {
+    s_glDispatch.glBindFramebufferEXT(GL_FRAMEBUFFER_OES,
+                                      getDefaultFramebuffer());
+}
+
+GLESConversionArrays& GLEScontext::getConversionArrays() {
+    m_conversionArrays.reset();
+    return m_conversionArrays;
+}
+
+GpuTextureDecoder* GLEScontext::getGpuTextureDecoder() {
+    if (!m_gpuTextureDecoder && GpuTextureDecoder::isEnabled()) {
+        m_gpuTextureDecoder = new GpuTextureDecoder();
+    }
+    return m_gpuTextureDecoder;
+}
+
+bool GLEScontext::hasGLObjects() const {
+    return m_gpuTextureDecoder && m_gpuTextureDecoder->hasGLObjects();
+}
+
+void GLEScontext::destroyGLObjects() {
+    if (m_gpuTextureDecoder) {
+        m_gpuTextureDecoder->destroyGLObjects();
+    }
 }
 
 const GLvoid* GLEScontext::setPointer(GLenum arrType,GLint size,GLenum type,GLsizei stride,const GLvoid* data,bool normalize) {
@@ -214,14 +325,51 @@ const GLESpointer* GLEScontext::getPointer(GLenum arrType) {
     return NULL;
 }
 
+// Convert |count| consecutive GLfixed values to GLfloat. |dataIn| and
+// |dataOut| may be the same.
+static void convertFixedArray(const GLfixed* dataIn,GLfloat* dataOut,unsigned int count) {
+    unsigned int i = 0;
+#ifdef __SSE2__
+    // Same results as X2F(), since scaling by a power of two is exact.
+    const __m128 scale = _mm_set1_ps(1.0f / 65536.0f);
+    for(; i + 4 <= count; i += 4) {
+        __m128i fixed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dataIn + i));
+        _mm_storeu_ps(dataOut + i, _mm_mul_ps(_mm_cvtepi32_ps(fixed), scale));
+    }
+#endif
+    for(; i < count; i++) {
+        dataOut[i] = X2F(dataIn[i]);
+    }
+}
+
+// Convert |count| consecutive GLbyte values to GLshort.
+static void convertByteArray(const GLbyte* dataIn,GLshort* dataOut,unsigned int count) {
+    unsigned int i = 0;
+#ifdef __SSE2__
+    for(; i + 16 <= count; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dataIn + i));
+        // Sign-extend by moving each byte to the high half of a word.
+        __m128i lo = _mm_srai_epi16(_mm_unpacklo_epi8(bytes, bytes), 8);
+        __m128i hi = _mm_srai_epi16(_mm_unpackhi_epi8(bytes, bytes), 8);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dataOut + i), lo);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dataOut + i + 8), hi);
+    }
+#endif
+    for(; i < count; i++) {
+        dataOut[i] = B2S(dataIn[i]);
+    }
+}
+
 static void convertFixedDirectLoop(const char* dataIn,unsigned int strideIn,void* dataOut,unsigned int nBytes,unsigned int strideOut,int attribSize) {
 
+    if(strideIn == strideOut) { //tightly packed, convert everything at once
+        convertFixedArray((const GLfixed*)dataIn,static_cast<GLfloat*>(dataOut),nBytes/sizeof(GLfloat));
+        return;
+    }
     for(unsigned int i = 0; i < nBytes;i+=strideOut) {
         const GLfixed* fixed_data = (const GLfixed *)dataIn;
         //filling attrib
-        for(int j=0;j<attribSize;j++) {
-            reinterpret_cast<GLfloat*>(&static_cast<unsigned char*>(dataOut)[i])[j] = X2F(fixed_data[j]);
-        }
+        convertFixedArray(fixed_data,reinterpret_cast<GLfloat*>(&static_cast<unsigned char*>(dataOut)[i]),attribSize);
         dataIn += strideIn;
     }
 }
@@ -233,20 +381,20 @@ static void convertFixedIndirectLoop(const char* dataIn,unsigned int strideIn,vo
         const GLfixed* fixed_data = (GLfixed *)(dataIn  + index*strideIn);
         GLfloat* float_data = reinterpret_cast<GLfloat*>(static_cast<unsigned char*>(dataOut) + index*strideOut);
 
-        for(int j=0;j<attribSize;j++) {
-            float_data[j] = X2F(fixed_data[j]);
-         }
+        convertFixedArray(fixed_data,float_data,attribSize);
     }
 }
 
 static void convertByteDirectLoop(const char* dataIn,unsigned int strideIn,void* dataOut,unsigned int nBytes,unsigned int strideOut,int attribSize) {
 
+    if(strideIn * sizeof(GLshort) == strideOut) { //tightly packed, convert everything at once
+        convertByteArray((const GLbyte*)dataIn,static_cast<GLshort*>(dataOut),nBytes/sizeof(GLshort));
+        return;
+    }
     for(unsigned int i = 0; i < nBytes;i+=strideOut) {
         const GLbyte* byte_data = (const GLbyte *)dataIn;
         //filling attrib
-        for(int j=0;j<attribSize;j++) {
-            reinterpret_cast<GLshort*>(&static_cast<unsigned char*>(dataOut)[i])[j] = B2S(byte_data[j]);
-        }
+        convertByteArray(byte_data,reinterpret_cast<GLshort*>(&static_cast<unsigned char*>(dataOut)[i]),attribSize);
         dataIn += strideIn;
     }
 }
@@ -258,16 +406,14 @@ static void convertByteIndirectLoop(const char* dataIn,unsigned int strideIn,voi
         const GLbyte* bytes_data = (GLbyte *)(dataIn  + index*strideIn);
         GLshort* short_data = reinterpret_cast<GLshort*>(static_cast<unsigned char*>(dataOut) + index*strideOut);
 
-        for(int j=0;j<attribSize;j++) {
-            short_data[j] = B2S(bytes_data[j]);
-         }
+        convertByteArray(bytes_data,short_data,attribSize);
     }
 }
 static void directToBytesRanges(GLint first,GLsizei count,GLESpointer* p,RangeList& list) {
 
     int attribSize = p->getSize()*4; //4 is the sizeof GLfixed or GLfloat in bytes
     int stride = p->getStride()?p->getStride():attribSize;
-    int start  = p->getBufferOffset()+first*attribSize;
+    int start  = p->getBufferOffset()+first*stride;
     if(!p->getStride()) {
         list.addRange(Range(start,count*attribSize));
     } else {
@@ -277,35 +423,37 @@ static void directToBytesRanges(GLint first,GLsizei count,GLESpointer* p,RangeLi
     }
 }
 
-static void indirectToBytesRanges(const GLvoid* indices,GLenum indices_type,GLsizei count,GLESpointer* p,RangeList& list) {
+// Make sure the GL_FIXED vertices [first,first+count) of the VBO used by |p|
+// are converted in the buffer's shadow copy. This does nothing if they were
+// already converted since the last change to the buffer.
+static void convertFixedVBORange(GLint first,GLsizei count,GLESpointer* p) {
 
-    int attribSize = p->getSize() * 4; //4 is the sizeof GLfixed or GLfloat in bytes
-    int stride = p->getStride()?p->getStride():attribSize;
-    int start  = p->getBufferOffset();
-    for(int i=0 ; i < count; i++) {
-        GLushort index = (indices_type == GL_UNSIGNED_SHORT?
-                         static_cast<const GLushort*>(indices)[i]:
-                         static_cast<const GLubyte*>(indices)[i]);
-        list.addRange(Range(start+index*stride,attribSize));
+    if(count <= 0 || p->bufferRangeConverted(first,count)) return;
 
-    }
-}
-
-int bytesRangesToIndices(RangeList& ranges,GLESpointer* p,GLushort* indices) {
+    if(p->bufferNeedConversion()) {
+        RangeList ranges;
+        RangeList conversions;
+        directToBytesRanges(first,count,p,ranges); //converting indices range to buffer bytes ranges by offset
+        p->getBufferConversions(ranges,conversions); // getting from the buffer the relevant ranges that still needs to be converted
 
-    int attribSize = p->getSize() * 4; //4 is the sizeof GLfixed or GLfloat in bytes
-    int stride = p->getStride()?p->getStride():attribSize;
-    int offset = p->getBufferOffset();
-
-    int n = 0;
-    for(int i=0;i<ranges.size();i++) {
-        int startIndex = (ranges[i].getStart() - offset) / stride;
-        int nElements = ranges[i].getSize()/attribSize;
-        for(int j=0;j<nElements;j++) {
-            indices[n++] = startIndex+j;
+        int attribSize = p->getSize();
+        int stride = p->getStride()?p->getStride():sizeof(GLfixed)*attribSize;
+        int offset = p->getBufferOffset();
+        const char* dataIn = static_cast<const char*>(p->getBufferData());
+        char* dataOut = static_cast<char*>(p->getConvertedBufferData());
+        for(int i = 0; i < conversions.size(); i++) {
+            // A range may only cover a part of a vertex if the buffer was
+            // partially updated; converting from the original data again
+            // is harmless.
+            int startIndex = (conversions[i].getStart() - offset) / stride;
+            int endIndex = (conversions[i].getEnd() - offset + stride - 1) / stride;
+            for(int j = startIndex; j < endIndex; j++) {
+                convertFixedArray((const GLfixed*)(dataIn + j*stride),
+                                  (GLfloat*)(dataOut + j*stride),attribSize);
+            }
         }
     }
-    return n;
+    p->setBufferRangeConverted(first,count);
 }
 
 void GLEScontext::convertDirect(GLESConversionArrays& cArrs,GLint first,GLsizei count,GLenum array_id,GLESpointer* p) {
@@ -327,25 +475,8 @@ void GLEScontext::convertDirect(GLESConversionArrays& cArrs,GLint first,GLsizei
 
 void GLEScontext::convertDirectVBO(GLESConversionArrays& cArrs,GLint first,GLsizei count,GLenum array_id,GLESpointer* p) {
 
-    RangeList ranges;
-    RangeList conversions;
-    GLushort* indices = NULL;
-    int attribSize = p->getSize();
-    int stride = p->getStride()?p->getStride():sizeof(GLfixed)*attribSize;
-    char* data = (char*)p->getBufferData() + (first*stride);
-
-    if(p->bufferNeedConversion()) {
-        directToBytesRanges(first,count,p,ranges); //converting indices range to buffer bytes ranges by offset
-        p->getBufferConversions(ranges,conversions); // getting from the buffer the relevant ranges that still needs to be converted
-
-        if(conversions.size()) { // there are some elements to convert
-           indices = new GLushort[count];
-           int nIndices = bytesRangesToIndices(conversions,p,indices); //converting bytes ranges by offset to indices in this array
-           convertFixedIndirectLoop(data,stride,data,nIndices,GL_UNSIGNED_SHORT,indices,stride,attribSize);
-        }
-    }
-    if(indices) delete[] indices;
-    cArrs.setArr(data,p->getStride(),GL_FLOAT);
+    convertFixedVBORange(first,count,p);
+    cArrs.setArr(p->getConvertedBufferData(),p->getStride(),GL_FLOAT);
 }
 
 int GLEScontext::findMaxIndex(GLsizei count,GLenum type,const GLvoid* indices) {
@@ -384,27 +515,15 @@ void GLEScontext::convertIndirect(GLESConversionArrays& cArrs,GLsizei count,GLen
 }
 
 void GLEScontext::convertIndirectVBO(GLESConversionArrays& cArrs,GLsizei count,GLenum indices_type,const GLvoid* indices,GLenum array_id,GLESpointer* p) {
-    RangeList ranges;
-    RangeList conversions;
-    GLushort* conversionIndices = NULL;
-    int attribSize = p->getSize();
-    int stride = p->getStride()?p->getStride():sizeof(GLfixed)*attribSize;
-    char* data = static_cast<char*>(p->getBufferData());
-    if(p->bufferNeedConversion()) {
-        indirectToBytesRanges(indices,indices_type,count,p,ranges); //converting indices range to buffer bytes ranges by offset
-        p->getBufferConversions(ranges,conversions); // getting from the buffer the relevant ranges that still needs to be converted
-        if(conversions.size()) { // there are some elements to convert
-            conversionIndices = new GLushort[count];
-            int nIndices = bytesRangesToIndices(conversions,p,conversionIndices); //converting bytes ranges by offset to indices in this array
-            convertFixedIndirectLoop(data,stride,data,nIndices,GL_UNSIGNED_SHORT,conversionIndices,stride,attribSize);
-        }
+
+    // Convert all the vertices up to the largest index, which makes the
+    // result cacheable like for direct draws.
+    if(count > 0) {
+        convertFixedVBORange(0,findMaxIndex(count,indices_type,indices) + 1,p);
     }
-    if(conversionIndices) delete[] conversionIndices;
-    cArrs.setArr(data,p->getStride(),GL_FLOAT);
+    cArrs.setArr(p->getConvertedBufferData(),p->getStride(),GL_FLOAT);
 }
 
-
-
 void GLEScontext::bindBuffer(GLenum target,GLuint buffer) {
     if(target == GL_ARRAY_BUFFER) {
         m_arrayBuffer = buffer;
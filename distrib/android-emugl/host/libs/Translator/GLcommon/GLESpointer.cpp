@@ -25,7 +25,10 @@ GLESpointer::GLESpointer():m_size(4),
                            m_buffer(NULL),
                            m_bufferName(0),
                            m_buffOffset(0),
-                           m_isVBO(false){};
+                           m_isVBO(false),
+                           m_convertedGeneration(0),
+                           m_convertedFirst(0),
+                           m_convertedCount(0){};
 
 
 GLenum GLESpointer:: getType() const {
@@ -48,6 +51,10 @@ GLvoid* GLESpointer::getBufferData() const {
     return  m_buffer ? static_cast<unsigned char*>(m_buffer->getData()) + m_buffOffset : NULL;
 }
 
+GLvoid* GLESpointer::getConvertedBufferData() const {
+    return  m_buffer ? static_cast<unsigned char*>(m_buffer->getConvertedData()) + m_buffOffset : NULL;
+}
+
 const GLvoid* GLESpointer::getData() const{
     return m_isVBO ? getBufferData():getArrayData();
 }
@@ -90,6 +97,7 @@ void GLESpointer::setArray(GLint size,GLenum type,GLsizei stride,const GLvoid* d
     m_bufferName = 0;
     m_normalize = normalize;
     m_isVBO = false;
+    m_convertedGeneration = 0;
 }
 
 void GLESpointer::setBuffer(GLint size,GLenum type,GLsizei stride,GLESbuffer* buf,GLuint bufferName,int offset,bool normalize) {
@@ -102,8 +110,35 @@ void GLESpointer::setBuffer(GLint size,GLenum type,GLsizei stride,GLESbuffer* bu
     m_buffOffset = offset;
     m_normalize = normalize;
     m_isVBO = true;
+    m_convertedGeneration = 0;
 }
 
 void GLESpointer::getBufferConversions(const RangeList& rl,RangeList& rlOut) {
     m_buffer->getConversions(rl,rlOut);
 }
+
+bool GLESpointer::bufferRangeConverted(GLint first,GLsizei count) const {
+    return m_buffer && m_convertedGeneration == m_buffer->getGeneration() &&
+           first >= m_convertedFirst &&
+           first + count <= m_convertedFirst + m_convertedCount;
+}
+
+void GLESpointer::setBufferRangeConverted(GLint first,GLsizei count) {
+    if(m_buffer) {
+        if(m_convertedGeneration == m_buffer->getGeneration()) {
+            // extend the cached range if possible, so that alternating
+            // draws of different parts of the buffer don't reset it.
+            GLint end = m_convertedFirst + m_convertedCount;
+            if(first <= end && first + count >= m_convertedFirst) {
+                GLint newFirst = first < m_convertedFirst ? first : m_convertedFirst;
+                GLint newEnd = first + count > end ? first + count : end;
+                m_convertedFirst = newFirst;
+                m_convertedCount = newEnd - newFirst;
+                return;
+            }
+        }
+        m_convertedGeneration = m_buffer->getGeneration();
+        m_convertedFirst = first;
+        m_convertedCount = count;
+    }
+}
@@ -0,0 +1,473 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#include <GLcommon/GpuTextureDecoder.h>
+
+#include <GLcommon/GLEScontext.h>
+#include <GLcommon/PaletteTexture.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Desktop GL enums used to save and restore the host state.
+#define GL_CLIENT_PIXEL_STORE_BIT   0x00000001
+#define GL_TEXTURE_BIT              0x00040000
+#define GL_VIEWPORT_BIT             0x00000800
+#define GL_ENABLE_BIT               0x00002000
+#define GL_ALPHA_TEST               0x0BC0
+#define GL_COLOR_LOGIC_OP           0x0BF2
+
+namespace {
+
+const char kVertexShader[] =
+    "attribute vec2 position;\n"
+    "void main() {\n"
+    "    gl_Position = vec4(position, 0.0, 1.0);\n"
+    "}\n";
+
+// All shaders below work on integer values stored in floats, which is
+// exact for the small values involved. The host GLSL version may be as
+// old as 1.10, so there are no integer textures or bitwise operators.
+#define GPU_DECODER_COMMON_SOURCE \
+    "uniform sampler2D u_src;\n" \
+    "uniform vec2 u_srcSize;\n" \
+    "// Return the four bytes stored in texel |p| of u_src.\n" \
+    "vec4 fetchBytes(vec2 p) {\n" \
+    "    return floor(texture2D(u_src, (p + 0.5) / u_srcSize) * 255.0 + 0.5);\n" \
+    "}\n" \
+    "// Return |count| bits of |v| starting at bit |shift|.\n" \
+    "float bits(float v, float shift, float count) {\n" \
+    "    return mod(floor((v + 0.5) / exp2(shift)), exp2(count));\n" \
+    "}\n"
+
+// Each 8-byte ETC1 block is stored as two RGBA8 texels of u_src, in the
+// same order as the compressed data; see etc1.cpp for the format.
+const char kEtc1FragmentShader[] =
+    GPU_DECODER_COMMON_SOURCE
+    "uniform float u_modA[8];\n"
+    "uniform float u_modB[8];\n"
+    "void main() {\n"
+    "    vec2 p = floor(gl_FragCoord.xy);\n"
+    "    vec2 block = floor(p / 4.0);\n"
+    "    vec2 local = p - 4.0 * block;\n"
+    "    vec4 q0 = fetchBytes(vec2(2.0 * block.x, block.y));\n"
+    "    vec4 q1 = fetchBytes(vec2(2.0 * block.x + 1.0, block.y));\n"
+    "    float flags = q0.a;\n"
+    "    bool second = bits(flags, 0.0, 1.0) > 0.5 ? local.y >= 2.0\n"
+    "                                              : local.x >= 2.0;\n"
+    "    vec3 base;\n"
+    "    if (bits(flags, 1.0, 1.0) > 0.5) {\n"
+    "        vec3 b5 = floor((q0.rgb + 0.5) / 8.0);\n"
+    "        if (second) {\n"
+    "            vec3 d = mod(q0.rgb, 8.0);\n"
+    "            b5 = mod(b5 + d - 8.0 * step(4.0, d), 32.0);\n"
+    "        }\n"
+    "        base = b5 * 8.0 + floor((b5 + 0.5) / 4.0);\n"
+    "    } else {\n"
+    "        base = 17.0 * (second ? mod(q0.rgb, 16.0)\n"
+    "                              : floor((q0.rgb + 0.5) / 16.0));\n"
+    "    }\n"
+    "    int table = int(second ? bits(flags, 2.0, 3.0)\n"
+    "                           : bits(flags, 5.0, 3.0));\n"
+    "    float k = local.y + 4.0 * local.x;\n"
+    "    float bit = mod(k, 8.0);\n"
+    "    float lsb = bits(k < 8.0 ? q1.a : q1.b, bit, 1.0);\n"
+    "    float msb = bits(k < 8.0 ? q1.g : q1.r, bit, 1.0);\n"
+    "    float delta = lsb > 0.5 ? u_modB[table] : u_modA[table];\n"
+    "    if (msb > 0.5) {\n"
+    "        delta = -delta;\n"
+    "    }\n"
+    "    gl_FragColor = vec4(clamp(base + delta, 0.0, 255.0) / 255.0, 1.0);\n"
+    "}\n";
+
+// The color indices are stored as a luminance texture, with two pixels
+// per texel for 4-bit indices (high nibble first), and the RGBA8 palette
+// as a single row texture.
+const char kPaletteFragmentShader[] =
+    GPU_DECODER_COMMON_SOURCE
+    "uniform sampler2D u_palette;\n"
+    "uniform float u_nibbles;\n"
+    "uniform float u_paletteSize;\n"
+    "void main() {\n"
+    "    vec2 p = floor(gl_FragCoord.xy);\n"
+    "    float v;\n"
+    "    if (u_nibbles > 0.5) {\n"
+    "        v = fetchBytes(vec2(floor((p.x + 0.5) / 2.0), p.y)).r;\n"
+    "        v = mod(p.x, 2.0) < 0.5 ? bits(v, 4.0, 4.0) : bits(v, 0.0, 4.0);\n"
+    "    } else {\n"
+    "        v = fetchBytes(p).r;\n"
+    "    }\n"
+    "    gl_FragColor = texture2D(u_palette,\n"
+    "                             vec2((v + 0.5) / u_paletteSize, 0.5));\n"
+    "}\n";
+
+// Intensity modifiers (a, b) for each table codeword, see etc1.cpp.
+const GLfloat kEtc1ModifiersA[8] = { 2, 5, 9, 13, 18, 24, 33, 47 };
+const GLfloat kEtc1ModifiersB[8] = { 8, 17, 29, 42, 60, 80, 106, 183 };
+
+const GLfloat kQuad[] = { -1.f, -1.f, 1.f, -1.f, -1.f, 1.f, 1.f, 1.f };
+
+GLuint compileShader(GLenum type, const char* source) {
+    GLDispatch& gl = GLEScontext::dispatcher();
+    GLuint shader = gl.glCreateShader(type);
+    gl.glShaderSource(shader, 1, &source, NULL);
+    gl.glCompileShader(shader);
+    GLint status = GL_FALSE;
+    gl.glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (status != GL_TRUE) {
+        char log[512];
+        gl.glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        fprintf(stderr, "GpuTextureDecoder: could not compile shader: %s\n",
+                log);
+        gl.glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+// Return a new program made of kVertexShader and |fragmentShader|, or 0 on
+// failure.
+GLuint createProgram(const char* fragmentShader) {
+    GLDispatch& gl = GLEScontext::dispatcher();
+    GLuint vs = compileShader(GL_VERTEX_SHADER, kVertexShader);
+    GLuint fs = compileShader(GL_FRAGMENT_SHADER, fragmentShader);
+    GLuint program = 0;
+    if (vs && fs) {
+        program = gl.glCreateProgram();
+        gl.glAttachShader(program, vs);
+        gl.glAttachShader(program, fs);
+        gl.glBindAttribLocation(program, 0, "position");
+        gl.glLinkProgram(program);
+        GLint status = GL_FALSE;
+        gl.glGetProgramiv(program, GL_LINK_STATUS, &status);
+        if (status != GL_TRUE) {
+            fprintf(stderr, "GpuTextureDecoder: could not link program\n");
+            gl.glDeleteProgram(program);
+            program = 0;
+        }
+    }
+    // The shaders are deleted along with the program.
+    if (vs) {
+        gl.glDeleteShader(vs);
+    }
+    if (fs) {
+        gl.glDeleteShader(fs);
+    }
+    return program;
+}
+
+// Return the host name of the texture bound to |target| in the active
+// texture unit, or 0 if it cannot be used as a color attachment.
+GLuint getBoundTexture(GLenum target) {
+    GLenum binding;
+    switch (target) {
+        case GL_TEXTURE_2D:
+            binding = GL_TEXTURE_BINDING_2D;
+            break;
+        case GL_TEXTURE_CUBE_MAP_POSITIVE_X:
+        case GL_TEXTURE_CUBE_MAP_NEGATIVE_X:
+        case GL_TEXTURE_CUBE_MAP_POSITIVE_Y:
+        case GL_TEXTURE_CUBE_MAP_NEGATIVE_Y:
+        case GL_TEXTURE_CUBE_MAP_POSITIVE_Z:
+        case GL_TEXTURE_CUBE_MAP_NEGATIVE_Z:
+            binding = GL_TEXTURE_BINDING_CUBE_MAP;
+            break;
+        default:
+            return 0;
+    }
+    GLint tex = 0;
+    GLEScontext::dispatcher().glGetIntegerv(binding, &tex);
+    return static_cast<GLuint>(tex);
+}
+
+// Upload a |width| x |height| source texture to |tex|, in the active
+// texture unit.
+void uploadSource(GLuint tex, GLenum format, GLsizei width, GLsizei height,
+                  const GLvoid* pixels) {
+    GLDispatch& gl = GLEScontext::dispatcher();
+    gl.glBindTexture(GL_TEXTURE_2D, tex);
+    gl.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    gl.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    gl.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    gl.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    gl.glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format,
+                    GL_UNSIGNED_BYTE, pixels);
+}
+
+}  // namespace
+
+// Saves the host GL state modified by the decoder, and restores it on
+// destruction.
+class GpuTextureDecoder::ScopedState {
+public:
+    ScopedState() : mProgram(0), mFramebuffer(0), mArrayBuffer(0) {
+        GLDispatch& gl = GLEScontext::dispatcher();
+        gl.glGetIntegerv(GL_CURRENT_PROGRAM, &mProgram);
+        gl.glGetIntegerv(GL_FRAMEBUFFER_BINDING, &mFramebuffer);
+        gl.glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &mArrayBuffer);
+        gl.glPushAttrib(GL_ENABLE_BIT | GL_VIEWPORT_BIT |
+                        GL_COLOR_BUFFER_BIT | GL_TEXTURE_BIT);
+        gl.glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT |
+                              GL_CLIENT_PIXEL_STORE_BIT);
+    }
+
+    ~ScopedState() {
+        GLDispatch& gl = GLEScontext::dispatcher();
+        gl.glPopClientAttrib();
+        gl.glPopAttrib();
+        gl.glBindBuffer(GL_ARRAY_BUFFER, mArrayBuffer);
+        gl.glBindFramebufferEXT(GL_FRAMEBUFFER, mFramebuffer);
+        gl.glUseProgram(mProgram);
+    }
+
+private:
+    GLint mProgram;
+    GLint mFramebuffer;
+    GLint mArrayBuffer;
+};
+
+GpuTextureDecoder::GpuTextureDecoder() :
+        m_state(NOT_INITIALIZED),
+        m_fbo(0),
+        m_srcTex(0),
+        m_paletteTex(0),
+        m_etc1Program(0),
+        m_etc1SrcSize(-1),
+        m_paletteProgram(0),
+        m_paletteSrcSize(-1),
+        m_paletteNibbles(-1),
+        m_paletteSize(-1) {}
+
+// static
+bool GpuTextureDecoder::isEnabled() {
+    static int enabled = -1;
+    if (enabled < 0) {
+        const char* env = getenv("ANDROID_GL_GPU_TEXTURE_DECODE");
+        enabled = (env && strcmp(env, "0") != 0) ? 1 : 0;
+    }
+    return enabled != 0;
+}
+
+bool GpuTextureDecoder::init() {
+    if (m_state != NOT_INITIALIZED) {
+        return m_state == INITIALIZED;
+    }
+    m_state = FAILED;
+    if (!isEnabled()) {
+        return false;
+    }
+
+    // The shader and framebuffer object entry points are not available
+    // with all host GL implementations.
+    GLDispatch& gl = GLEScontext::dispatcher();
+    if (!gl.glCreateShader || !gl.glShaderSource || !gl.glCompileShader ||
+        !gl.glGetShaderiv || !gl.glGetShaderInfoLog || !gl.glDeleteShader ||
+        !gl.glCreateProgram || !gl.glAttachShader ||
+        !gl.glBindAttribLocation || !gl.glLinkProgram ||
+        !gl.glGetProgramiv || !gl.glDeleteProgram || !gl.glUseProgram ||
+        !gl.glGetUniformLocation || !gl.glUniform1i || !gl.glUniform1f ||
+        !gl.glUniform1fv || !gl.glUniform2f ||
+        !gl.glVertexAttribPointer || !gl.glEnableVertexAttribArray ||
+        !gl.glGenFramebuffersEXT || !gl.glDeleteFramebuffersEXT ||
+        !gl.glBindFramebufferEXT ||
+        !gl.glFramebufferTexture2DEXT || !gl.glCheckFramebufferStatusEXT ||
+        !gl.glPushAttrib || !gl.glPopAttrib ||
+        !gl.glPushClientAttrib || !gl.glPopClientAttrib) {
+        return false;
+    }
+
+    m_etc1Program = createProgram(kEtc1FragmentShader);
+    m_paletteProgram = createProgram(kPaletteFragmentShader);
+    if (!m_etc1Program || !m_paletteProgram) {
+        return false;
+    }
+
+    // Set the uniforms that never change.
+    GLint program = 0;
+    gl.glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+
+    gl.glUseProgram(m_etc1Program);
+    gl.glUniform1i(gl.glGetUniformLocation(m_etc1Program, "u_src"), 0);
+    gl.glUniform1fv(gl.glGetUniformLocation(m_etc1Program, "u_modA"),
+                    8, kEtc1ModifiersA);
+    gl.glUniform1fv(gl.glGetUniformLocation(m_etc1Program, "u_modB"),
+                    8, kEtc1ModifiersB);
+    m_etc1SrcSize = gl.glGetUniformLocation(m_etc1Program, "u_srcSize");
+
+    gl.glUseProgram(m_paletteProgram);
+    gl.glUniform1i(gl.glGetUniformLocation(m_paletteProgram, "u_src"), 0);
+    gl.glUniform1i(gl.glGetUniformLocation(m_paletteProgram, "u_palette"), 1);
+    m_paletteSrcSize = gl.glGetUniformLocation(m_paletteProgram, "u_srcSize");
+    m_paletteNibbles = gl.glGetUniformLocation(m_paletteProgram, "u_nibbles");
+    m_paletteSize = gl.glGetUniformLocation(m_paletteProgram, "u_paletteSize");
+
+    gl.glUseProgram(program);
+
+    gl.glGenFramebuffersEXT(1, &m_fbo);
+    gl.glGenTextures(1, &m_srcTex);
+    gl.glGenTextures(1, &m_paletteTex);
+    m_state = INITIALIZED;
+    return true;
+}
+
+void GpuTextureDecoder::destroyGLObjects() {
+    GLDispatch& gl = GLEScontext::dispatcher();
+    // The names are only set if the corresponding entry points exist.
+    if (m_fbo) {
+        gl.glDeleteFramebuffersEXT(1, &m_fbo);
+    }
+    if (m_srcTex) {
+        gl.glDeleteTextures(1, &m_srcTex);
+    }
+    if (m_paletteTex) {
+        gl.glDeleteTextures(1, &m_paletteTex);
+    }
+    if (m_etc1Program) {
+        gl.glDeleteProgram(m_etc1Program);
+    }
+    if (m_paletteProgram) {
+        gl.glDeleteProgram(m_paletteProgram);
+    }
+    m_fbo = 0;
+    m_srcTex = 0;
+    m_paletteTex = 0;
+    m_etc1Program = 0;
+    m_paletteProgram = 0;
+    m_state = FAILED;
+}
+
+bool GpuTextureDecoder::render(GLenum target, GLint level, GLuint dstTex,
+                               GLsizei width, GLsizei height) {
+    GLDispatch& gl = GLEScontext::dispatcher();
+    gl.glBindFramebufferEXT(GL_FRAMEBUFFER, m_fbo);
+    gl.glFramebufferTexture2DEXT(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                 target, dstTex, level);
+    bool complete = gl.glCheckFramebufferStatusEXT(GL_FRAMEBUFFER) ==
+            GL_FRAMEBUFFER_COMPLETE;
+    if (complete) {
+        gl.glViewport(0, 0, width, height);
+        gl.glDisable(GL_SCISSOR_TEST);
+        gl.glDisable(GL_BLEND);
+        gl.glDisable(GL_DEPTH_TEST);
+        gl.glDisable(GL_STENCIL_TEST);
+        gl.glDisable(GL_CULL_FACE);
+        gl.glDisable(GL_DITHER);
+        gl.glDisable(GL_ALPHA_TEST);
+        gl.glDisable(GL_COLOR_LOGIC_OP);
+        gl.glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+        gl.glBindBuffer(GL_ARRAY_BUFFER, 0);
+        gl.glEnableVertexAttribArray(0);
+        gl.glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, kQuad);
+        gl.glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    }
+    // Don't keep a reference to the destination texture.
+    gl.glFramebufferTexture2DEXT(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                 target, 0, level);
+    return complete;
+}
+
+bool GpuTextureDecoder::decodeEtc1(glTexImage2DPtr_t texImage2D,
+                                   GLenum target, GLint level,
+                                   GLsizei width, GLsizei height,
+                                   GLint border, const GLvoid* data) {
+    if (!data || width <= 0 || height <= 0 || !init()) {
+        return false;
+    }
+
+    // Allocate the destination level through the translator, so that it
+    // keeps track of the texture's format and size.
+    texImage2D(target, level, GL_RGB, width, height, border, GL_RGB,
+               GL_UNSIGNED_BYTE, NULL);
+    GLuint dstTex = getBoundTexture(target);
+    if (!dstTex) {
+        return false;
+    }
+
+    GLsizei srcWidth = 2 * ((width + 3) / 4);
+    GLsizei srcHeight = (height + 3) / 4;
+
+    ScopedState state;
+    GLDispatch& gl = GLEScontext::dispatcher();
+    gl.glActiveTexture(GL_TEXTURE0);
+    gl.glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    uploadSource(m_srcTex, GL_RGBA, srcWidth, srcHeight, data);
+
+    gl.glUseProgram(m_etc1Program);
+    gl.glUniform2f(m_etc1SrcSize, srcWidth, srcHeight);
+    return render(target, level, dstTex, width, height);
+}
+
+bool GpuTextureDecoder::decodePalette(glTexImage2DPtr_t texImage2D,
+                                      GLenum target, GLenum internalformat,
+                                      GLint level, GLsizei width,
+                                      GLsizei height, GLint border,
+                                      GLsizei imageSize, const GLvoid* data) {
+    if (!data || imageSize < 0 || !init()) {
+        return false;
+    }
+
+    unsigned int indexSizeBits;
+    unsigned int colorSizeBytes;
+    GLenum format;
+    getPaletteInfo(internalformat, indexSizeBits, colorSizeBytes, format);
+    int nColors = 1 << indexSizeBits;
+
+    // Find the level's color indices, like uncompressTexture() does.
+    size_t offset = nColors * colorSizeBytes;
+    for (GLint i = 0; i < level; i++) {
+        offset += ((size_t)width * height * indexSizeBits) / 8;
+        width >>= 1;
+        height >>= 1;
+    }
+    if (width <= 0 || height <= 0) {
+        return false;
+    }
+    // 4-bit indices are packed across rows, so only even widths map to
+    // a texture. Truncated data is left to the CPU path too.
+    if (indexSizeBits == 4 && (width & 1)) {
+        return false;
+    }
+    GLsizei srcWidth = (indexSizeBits == 4) ? width / 2 : width;
+    if (offset + (size_t)srcWidth * height > (size_t)imageSize) {
+        return false;
+    }
+
+    texImage2D(target, level, format, width, height, border, format,
+               GL_UNSIGNED_BYTE, NULL);
+    GLuint dstTex = getBoundTexture(target);
+    if (!dstTex) {
+        return false;
+    }
+
+    unsigned char palette[256 * 4];
+    uncompressPalette(internalformat, data, palette);
+
+    ScopedState state;
+    GLDispatch& gl = GLEScontext::dispatcher();
+    gl.glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    gl.glActiveTexture(GL_TEXTURE1);
+    uploadSource(m_paletteTex, GL_RGBA, nColors, 1, palette);
+    gl.glActiveTexture(GL_TEXTURE0);
+    uploadSource(m_srcTex, GL_LUMINANCE, srcWidth, height,
+                 static_cast<const unsigned char*>(data) + offset);
+
+    gl.glUseProgram(m_paletteProgram);
+    gl.glUniform2f(m_paletteSrcSize, srcWidth, height);
+    gl.glUniform1f(m_paletteNibbles, indexSizeBits == 4 ? 1.f : 0.f);
+    gl.glUniform1f(m_paletteSize, nColors);
+    return render(target, level, dstTex, width, height);
+}
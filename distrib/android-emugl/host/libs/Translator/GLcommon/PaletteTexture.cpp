@@ -168,3 +168,23 @@ unsigned char* uncompressTexture(GLenum internalformat,GLenum& formatOut,GLsizei
     return pixelsOut;
 }
 
+
+int uncompressPalette(GLenum internalformat,const GLvoid* data,unsigned char* pixelsOut) {
+
+    unsigned int indexSizeBits;
+    unsigned int colorSizeBytes;
+    GLenum colorFrmt;
+
+    getPaletteInfo(internalformat,indexSizeBits,colorSizeBytes,colorFrmt);
+
+    const unsigned char* palette = static_cast<const unsigned char *>(data);
+    int nColors = 2 << (indexSizeBits -1); //2^indexSizeBits
+    for(int i = 0; i < nColors; i++) {
+        Color c = paletteColor(palette,i*colorSizeBytes,internalformat);
+        pixelsOut[4*i] = c.red;
+        pixelsOut[4*i+1] = c.green;
+        pixelsOut[4*i+2] = c.blue;
+        pixelsOut[4*i+3] = c.alpha;
+    }
+    return nColors*colorSizeBytes;
+}
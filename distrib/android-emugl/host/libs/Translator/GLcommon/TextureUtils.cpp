@@ -14,6 +14,7 @@
 * limitations under the License.
 */
 #include <GLcommon/TextureUtils.h>
+#include <GLcommon/Etc1Decoder.h>
 #include <GLcommon/GLESmacros.h>
 #include <GLcommon/GLDispatch.h>
 #include <GLcommon/GLESvalidate.h>
@@ -46,7 +47,6 @@ void  doCompressedTexImage2D(GLEScontext * ctx, GLenum target, GLint level,
 {
     /* XXX: This is just a hack to fix the resolve of glTexImage2D problem
        It will be removed when we'll no longer link against ligGL */
-    typedef void (GLAPIENTRY *glTexImage2DPtr_t ) (GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const GLvoid *pixels);
     glTexImage2DPtr_t glTexImage2DPtr;
     glTexImage2DPtr =  (glTexImage2DPtr_t)funcPtr; 
 
@@ -59,12 +59,19 @@ void  doCompressedTexImage2D(GLEScontext * ctx, GLenum target, GLint level,
                 GLsizei compressedSize = etc1_get_encoded_data_size(width, height);
                 SET_ERROR_IF((compressedSize > imageSize), GL_INVALID_VALUE);
 
+                GpuTextureDecoder* gpuDecoder = ctx->getGpuTextureDecoder();
+                if (gpuDecoder &&
+                    gpuDecoder->decodeEtc1(glTexImage2DPtr, target, level,
+                                           width, height, border, data)) {
+                    break;
+                }
+
                 const int32_t align = ctx->getUnpackAlignment()-1;
                 const int32_t bpr = ((width * 3) + align) & ~align;
                 const size_t size = bpr * height;
 
                 etc1_byte* pOut = new etc1_byte[size];
-                int res = etc1_decode_image((const etc1_byte*)data, pOut, width, height, 3, bpr);
+                int res = etc1DecodeImage((const etc1_byte*)data, pOut, width, height, bpr);
                 SET_ERROR_IF(res!=0, GL_INVALID_VALUE);
                 glTexImage2DPtr(target,level,format,width,height,border,format,type,pOut);
                 delete [] pOut;
@@ -90,8 +97,18 @@ void  doCompressedTexImage2D(GLEScontext * ctx, GLenum target, GLint level,
                 GLsizei tmpWidth  = width;
                 GLsizei tmpHeight = height;
 
+                GpuTextureDecoder* gpuDecoder = ctx->getGpuTextureDecoder();
                 for(int i = 0; i < nMipmaps ; i++)
                 {
+                   if (gpuDecoder &&
+                       gpuDecoder->decodePalette(glTexImage2DPtr, target,
+                                                 internalformat, i, width,
+                                                 height, border, imageSize,
+                                                 data)) {
+                       tmpWidth/=2;
+                       tmpHeight/=2;
+                       continue;
+                   }
                    GLenum uncompressedFrmt;
                    unsigned char* uncompressed = uncompressTexture(internalformat,uncompressedFrmt,width,height,imageSize,data,i);
                    glTexImage2DPtr(target,i,uncompressedFrmt,tmpWidth,tmpHeight,border,uncompressedFrmt,GL_UNSIGNED_BYTE,uncompressed);
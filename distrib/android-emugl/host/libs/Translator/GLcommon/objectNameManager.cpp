@@ -49,6 +49,7 @@ NameSpace::genName(ObjectLocalName p_localName,
     if (genGlobal) {
         unsigned int globalName = m_globalNameSpace->genName(m_type);
         m_localToGlobalMap[localName] = globalName;
+        m_globalNames.set(localName, globalName);
     }
 
     return localName;
@@ -62,16 +63,11 @@ NameSpace::genGlobalName(void)
 }
 
 unsigned int
-NameSpace::getGlobalName(ObjectLocalName p_localName)
+NameSpace::getGlobalName(ObjectLocalName p_localName) const
 {
-    NamesMap::iterator n( m_localToGlobalMap.find(p_localName) );
-    if (n != m_localToGlobalMap.end()) {
-        // object found - return its global name map
-        return (*n).second;
-    }
-
-    // object does not exist;
-    return 0;
+    unsigned int globalName = 0;
+    m_globalNames.find(p_localName, &globalName);
+    return globalName;
 }
 
 ObjectLocalName
@@ -95,13 +91,15 @@ NameSpace::deleteName(ObjectLocalName p_localName)
     if (n != m_localToGlobalMap.end()) {
         m_globalNameSpace->deleteName(m_type, (*n).second);
         m_localToGlobalMap.erase(p_localName);
+        m_globalNames.erase(p_localName);
     }
 }
 
 bool
-NameSpace::isObject(ObjectLocalName p_localName)
+NameSpace::isObject(ObjectLocalName p_localName) const
 {
-    return (m_localToGlobalMap.find(p_localName) != m_localToGlobalMap.end() );
+    unsigned int globalName;
+    return m_globalNames.find(p_localName, &globalName);
 }
 
 void
@@ -111,6 +109,7 @@ NameSpace::replaceGlobalName(ObjectLocalName p_localName, unsigned int p_globalN
     if (n != m_localToGlobalMap.end()) {
         m_globalNameSpace->deleteName(m_type, (*n).second);
         (*n).second = p_globalName;
+        m_globalNames.set(p_localName, p_globalName);
     }
 }
 
@@ -200,7 +199,7 @@ ShareGroup::getGlobalName(NamedObjectType p_type,
 {
     if (p_type >= NUM_OBJECT_TYPES) return 0;
 
-    emugl::Mutex::AutoLock _lock(m_lock);
+    // No lock needed, see NameSpace::getGlobalName().
     return m_nameSpace[p_type]->getGlobalName(p_localName);
 }
 
@@ -232,7 +231,7 @@ ShareGroup::isObject(NamedObjectType p_type, ObjectLocalName p_localName)
 {
     if (p_type >= NUM_OBJECT_TYPES) return 0;
 
-    emugl::Mutex::AutoLock _lock(m_lock);
+    // No lock needed, see NameSpace::isObject().
     return m_nameSpace[p_type]->isObject(p_localName);
 }
 
@@ -0,0 +1,47 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#ifndef _ETC1_DECODER_H
+#define _ETC1_DECODER_H
+
+#include "etc1.h"
+
+// List of ETC1 block decoders that can be used by etc1DecodeImage().
+// ETC1_DECODER_AUTO selects the fastest one supported by the host CPU.
+// ETC1_DECODER_SCALAR is etc1_decode_block(), which is always supported.
+enum Etc1Decoder {
+    ETC1_DECODER_AUTO = 0,
+    ETC1_DECODER_SCALAR,
+    ETC1_DECODER_SSE2,
+    ETC1_DECODER_SSSE3,
+};
+
+// Return true iff |decoder| can be used on the host CPU.
+bool etc1IsDecoderSupported(Etc1Decoder decoder);
+
+// Decode an entire ETC1 image into 3-byte R, G, B pixels. This produces
+// the same result as etc1_decode_image() with a |pixelSize| of 3, i.e.
+// pixel (x,y) is written at pOut + 3 * x + stride * y, but uses the block
+// decoder selected by |decoder|. Large images are split in stripes of
+// block rows that are decoded in parallel by up to |maxThreads| threads,
+// or by a number of threads that depends on the host CPU count if it is 0.
+// Returns non-zero if there is an error, e.g. if |decoder| is not supported.
+int etc1DecodeImage(const etc1_byte* pIn, etc1_byte* pOut,
+                    etc1_uint32 width, etc1_uint32 height,
+                    etc1_uint32 stride,
+                    Etc1Decoder decoder = ETC1_DECODER_AUTO,
+                    int maxThreads = 0);
+
+#endif
@@ -23,10 +23,16 @@
 
 class GLESbuffer: public ObjectData {
 public:
-   GLESbuffer():ObjectData(BUFFER_DATA),m_size(0),m_usage(GL_STATIC_DRAW),m_data(NULL),m_wasBound(false){}
+   GLESbuffer():ObjectData(BUFFER_DATA),m_size(0),m_usage(GL_STATIC_DRAW),m_data(NULL),m_converted(NULL),m_generation(1),m_wasBound(false){}
    GLuint getSize(){return m_size;};
    GLuint getUsage(){return m_usage;};
    GLvoid* getData(){ return m_data;}
+   // Shadow copy of the data holding the GL_FIXED values converted to
+   // floats. Only the ranges removed from the conversion list through
+   // getConversions() are meaningful.
+   GLvoid* getConvertedData();
+   // Changes each time the data is modified.
+   unsigned int getGeneration() const {return m_generation;};
    bool  setBuffer(GLuint size,GLuint usage,const GLvoid* data);
    bool  setSubBuffer(GLint offset,GLuint size,const GLvoid* data);
    void  getConversions(const RangeList& rIn,RangeList& rOut);
@@ -39,6 +45,8 @@ private:
     GLuint         m_size;
     GLuint         m_usage;
     unsigned char* m_data;
+    unsigned char* m_converted;
+    unsigned int   m_generation;
     RangeList      m_conversionManager;
     bool           m_wasBound;
 };
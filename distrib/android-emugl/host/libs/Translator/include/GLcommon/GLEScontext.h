@@ -19,6 +19,7 @@
 
 #include "GLDispatch.h"
 #include "GLESpointer.h"
+#include "GpuTextureDecoder.h"
 #include "objectNameManager.h"
 #include "emugl/common/mutex.h"
 #include <string>
@@ -91,12 +92,17 @@ struct ArrayData{
     ArrayData():data(NULL),
                 type(0),
                 stride(0),
-                allocated(false){};
+                allocated(false),
+                buffer(NULL),
+                bufferSize(0){};
 
     void*        data;
     GLenum       type;
     unsigned int stride;
     bool         allocated;
+    // scratch memory used by allocArr(), kept between draw calls.
+    void*        buffer;
+    unsigned int bufferSize;
 };
 
 class GLESConversionArrays
@@ -105,6 +111,8 @@ public:
     GLESConversionArrays():m_current(0){};
     void setArr(void* data,unsigned int stride,GLenum type);
     void allocArr(unsigned int size,GLenum type);
+    // Start over from the first array, keeping the scratch buffers.
+    void reset();
     ArrayData& operator[](int i);
     void* getCurrentData();
     ArrayData& getCurrentArray();
@@ -117,6 +125,8 @@ private:
     unsigned int m_current;
 };
 
+struct SurfaceFramebuffer;
+
 class GLEScontext{
 public:
     virtual void init(GlLibrary* glLib);
@@ -124,7 +134,8 @@ public:
     GLenum getGLerror();
     void setGLerror(GLenum err);
     void setShareGroup(ShareGroupPtr grp){m_shareGroup = grp;};
-    ShareGroupPtr shareGroup() const { return m_shareGroup; }
+    // Borrowed, since this is called by almost every GL call.
+    const ShareGroupPtr& shareGroup() const { return m_shareGroup; }
     virtual void setActiveTexture(GLenum tex);
     unsigned int getBindedTexture(GLenum target);
     unsigned int getBindedTexture(GLenum unit,GLenum target);
@@ -166,6 +177,37 @@ public:
     void setFramebufferBinding(GLuint fb) { m_framebuffer = fb; }
     GLuint getFramebufferBinding() const { return m_framebuffer; }
 
+    // Make the renderbuffers of |fb| the framebuffer 0 of this context,
+    // through a host framebuffer object of the context, or the native
+    // surface if |fb| is NULL. Must be called while the context is current.
+    void setSurfaceFramebuffer(SurfaceFramebuffer* fb);
+
+    // Return the host name of the framebuffer object standing for the
+    // framebuffer 0, i.e. 0 unless the current surface is FBO-backed.
+    GLuint getDefaultFramebuffer() const {
+        return m_surfaceFboBound ? m_surfaceFbo : 0;
+    }
+
+    // Bind the host framebuffer object of framebuffer 0, after some code
+    // temporarily bound another one.
+    void bindDefaultFramebuffer();
+
+    // Return the conversion arrays to use for a draw call. They are reset
+    // on each call, but their memory is reused across draw calls.
+    GLESConversionArrays& getConversionArrays();
+
+    // Return the GPU texture decoder of this context, or NULL if it is
+    // disabled, see GpuTextureDecoder.h.
+    GpuTextureDecoder* getGpuTextureDecoder();
+
+    // Return true iff the context owns host GL objects that must be
+    // deleted by destroyGLObjects() before it is destroyed.
+    bool hasGLObjects() const;
+
+    // Delete the host GL objects owned by the context, which must be
+    // current, before it is destroyed.
+    void destroyGLObjects();
+
     static GLDispatch& dispatcher(){return s_glDispatch;};
 
     static int getMaxLights(){return s_glSupport.maxLights;}
@@ -212,6 +254,11 @@ private:
     unsigned int          m_elementBuffer;
     GLuint                m_renderbuffer;
     GLuint                m_framebuffer;
+    GLuint                m_surfaceFbo;
+    bool                  m_surfaceFboBound;
+    unsigned int          m_surfaceFboId;
+    GpuTextureDecoder*    m_gpuTextureDecoder;
+    GLESConversionArrays  m_conversionArrays;
 
     static std::string    s_glVendor;
     static std::string    s_glRenderer;
@@ -34,8 +34,13 @@ public:
     const GLvoid* getData() const;
     unsigned int  getBufferOffset() const;
     void          redirectPointerData();
+    GLvoid*       getConvertedBufferData() const;
     void          getBufferConversions(const RangeList& rl,RangeList& rlOut);
     bool          bufferNeedConversion(){ return !m_buffer->fullyConverted();}
+    // Return true if vertices [first,first+count) were converted since the
+    // buffer's last change, see setBufferRangeConverted().
+    bool          bufferRangeConverted(GLint first,GLsizei count) const;
+    void          setBufferRangeConverted(GLint first,GLsizei count);
     void          setArray (GLint size,GLenum type,GLsizei stride,const GLvoid* data,bool normalize = false);
     void          setBuffer(GLint size,GLenum type,GLsizei stride,GLESbuffer* buf,GLuint bufferName,int offset,bool normalize = false);
     bool          isEnable() const;
@@ -54,5 +59,8 @@ private:
     GLuint        m_bufferName;
     unsigned int  m_buffOffset;
     bool          m_isVBO;
+    unsigned int  m_convertedGeneration;
+    GLint         m_convertedFirst;
+    GLsizei       m_convertedCount;
 };
 #endif
@@ -0,0 +1,104 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#ifndef _GPU_TEXTURE_DECODER_H
+#define _GPU_TEXTURE_DECODER_H
+
+#include <GLES/gl.h>
+
+// Type of the glTexImage2D() implementation passed to
+// doCompressedTexImage2D().
+typedef void (GL_APIENTRY *glTexImage2DPtr_t)(GLenum target, GLint level,
+        GLint internalformat, GLsizei width, GLsizei height, GLint border,
+        GLenum format, GLenum type, const GLvoid* pixels);
+
+// A GpuTextureDecoder expands ETC1 and paletted textures on the host GPU
+// instead of the CPU. The compressed data is uploaded as-is into a
+// temporary texture, and a fragment shader renders the decoded pixels
+// into the destination texture level through a framebuffer object, so
+// the full RGB(A) image never crosses the bus.
+//
+// This is disabled by default, and only used when the
+// ANDROID_GL_GPU_TEXTURE_DECODE environment variable is set to a value
+// other than "0". On any failure (e.g. missing shader or framebuffer
+// object support, or incomplete framebuffer), the decode methods return
+// false and the caller must use the CPU decoders instead. Once such a
+// failure happens, the instance doesn't try again.
+//
+// There is one instance per GLEScontext, see
+// GLEScontext::getGpuTextureDecoder(), and its methods must be called with
+// the corresponding context current. All host GL state it modifies is
+// restored before returning.
+class GpuTextureDecoder {
+public:
+    GpuTextureDecoder();
+
+    // NOTE: This doesn't delete the GL objects, since the context may not
+    // be current anymore, see destroyGLObjects().
+    ~GpuTextureDecoder() {}
+
+    // Return true iff the decoder created host GL objects.
+    bool hasGLObjects() const {
+        return m_fbo || m_srcTex || m_paletteTex ||
+               m_etc1Program || m_paletteProgram;
+    }
+
+    // Delete the host GL objects of the decoder, with its context current.
+    // Host contexts share their objects with the global context of the
+    // display, so they are not released with the host context. The decoder
+    // must not be used anymore after this.
+    void destroyGLObjects();
+
+    // Return true iff the GPU decoding path was enabled by the user.
+    static bool isEnabled();
+
+    // Decode the ETC1 image in |data| into level |level| of the texture
+    // bound to |target|, after allocating it through |texImage2D|.
+    // Returns true on success.
+    bool decodeEtc1(glTexImage2DPtr_t texImage2D, GLenum target, GLint level,
+                    GLsizei width, GLsizei height, GLint border,
+                    const GLvoid* data);
+
+    // Decode mipmap level |level| of the paletted image in |data|, whose
+    // size in bytes is |imageSize|, into the same level of the texture
+    // bound to |target|. |internalformat| is one of the GL_PALETTEx_xxx_OES
+    // values, and |width| and |height| are the dimensions of level 0.
+    // Returns true on success.
+    bool decodePalette(glTexImage2DPtr_t texImage2D, GLenum target,
+                       GLenum internalformat, GLint level,
+                       GLsizei width, GLsizei height, GLint border,
+                       GLsizei imageSize, const GLvoid* data);
+
+private:
+    class ScopedState;
+
+    bool init();
+    bool render(GLenum target, GLint level, GLuint dstTex,
+                GLsizei width, GLsizei height);
+
+    enum InitState { NOT_INITIALIZED, INITIALIZED, FAILED };
+    InitState m_state;
+    GLuint m_fbo;
+    GLuint m_srcTex;
+    GLuint m_paletteTex;
+    GLuint m_etc1Program;
+    GLint m_etc1SrcSize;
+    GLuint m_paletteProgram;
+    GLint m_paletteSrcSize;
+    GLint m_paletteNibbles;
+    GLint m_paletteSize;
+};
+
+#endif
@@ -22,4 +22,11 @@
 
 unsigned char* uncompressTexture(GLenum internalformat,GLenum& formatOut,GLsizei width,GLsizei height,GLsizei imageSize, const GLvoid* data,GLint level);
 
+void getPaletteInfo(GLenum internalFormat,unsigned int& indexSizeBits,unsigned int& colorSizeBytes,GLenum& colorFrmt);
+
+// Convert the palette at the start of |data| to 2^indexSizeBits RGBA8
+// colors in |pixelsOut|. Returns the size of the palette in bytes, i.e.
+// the offset of the color indices in |data|.
+int uncompressPalette(GLenum internalformat,const GLvoid* data,unsigned char* pixelsOut);
+
 #endif
@@ -79,6 +79,21 @@ struct EglImage
 typedef emugl::SmartPtr<EglImage> ImagePtr;
 typedef std::map< unsigned int, ImagePtr>       ImagesHndlMap;
 
+// The host renderbuffers that back a pbuffer surface in the FBO surface
+// mode, instead of a native pbuffer, see EglPbufferSurface.h. They are
+// created by the first context made current with the surface, and are
+// shared by all contexts since these all share with the global context.
+struct SurfaceFramebuffer
+{
+    unsigned int id;                  // unique, never reused
+    unsigned int width;
+    unsigned int height;
+    unsigned int colorFormat;         // e.g. GL_RGBA8_OES
+    unsigned int depthStencilFormat;  // GL_DEPTH24_STENCIL8_OES, or 0
+    unsigned int colorRenderbuffer;   // host names, 0 until created
+    unsigned int depthStencilRenderbuffer;
+};
+
 class GLEScontext;
 
 typedef struct {
@@ -90,6 +105,16 @@ typedef struct {
     void                                            (*finish)();
     void                                            (*setShareGroup)(GLEScontext*,ShareGroupPtr);
     __translatorMustCastToProperFunctionPointerType (*getProcAddress)(const char*);
+    // Make the renderbuffers of a surface, or the native surface if NULL,
+    // the framebuffer 0 of the current context.
+    void                                            (*setSurfaceFramebuffer)(GLEScontext*,SurfaceFramebuffer*);
+    // Delete host renderbuffers of destroyed surfaces.
+    void                                            (*deleteRenderbuffers)(int,const unsigned int*);
+    // Return true iff a context owns host objects that must be deleted,
+    // with the context current, before destroying it.
+    bool                                            (*hasGLObjects)(GLEScontext*);
+    // Delete these host objects, the context being current.
+    void                                            (*destroyGLObjects)(GLEScontext*);
 }GLESiface;
 
 class GlLibrary;
@@ -8,6 +8,9 @@
   X(void, glGetShaderPrecisionFormat, (GLenum shadertype, GLenum precisiontype, GLint* range, GLint* precision), (shadertype, precisiontype, range, precision)) \
   X(void, glReleaseShaderCompiler, (), ()) \
   X(void, glShaderBinary, (GLsizei n, const GLuint* shaders, GLenum binaryformat, const GLvoid* binary, GLsizei length), (n, shaders, binaryformat, binary, length)) \
+  X(void, glGetProgramBinary, (GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, GLvoid* binary), (program, bufSize, length, binaryFormat, binary)) \
+  X(void, glProgramBinary, (GLuint program, GLenum binaryFormat, const GLvoid* binary, GLsizei length), (program, binaryFormat, binary, length)) \
+  X(void, glProgramParameteri, (GLuint program, GLenum pname, GLint value), (program, pname, value)) \
 
 
 #endif  // GLES2_EXTENSIONS_FUNCTIONS_H
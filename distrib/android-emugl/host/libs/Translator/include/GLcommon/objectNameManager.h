@@ -18,6 +18,8 @@
 
 #include <map>
 #include "emugl/common/mutex.h"
+#include "emugl/common/seqlock_hash_map.h"
+#include "emugl/common/ref_counted.h"
 #include "emugl/common/smart_ptr.h"
 
 enum NamedObjectType {
@@ -87,9 +89,10 @@ private:
 
     //
     // getGlobalName - returns the global name of an object or 0 if the object
-    //                 does not exist.
+    //                 does not exist. This can be called without holding the
+    //                 lock serializing the other calls.
     //
-    unsigned int getGlobalName(ObjectLocalName p_localName);
+    unsigned int getGlobalName(ObjectLocalName p_localName) const;
 
     //
     // getLocaalName - returns the local name of an object or 0 if the object
@@ -104,9 +107,10 @@ private:
     void deleteName(ObjectLocalName p_localName);
 
     //
-    // isObject - returns true if the named object exist.
+    // isObject - returns true if the named object exist. This can be called
+    //            without holding the lock serializing the other calls.
     //
-    bool isObject(ObjectLocalName p_localName);
+    bool isObject(ObjectLocalName p_localName) const;
 
     //
     // replaces an object to map to an existing global object
@@ -116,6 +120,8 @@ private:
 private:
     ObjectLocalName m_nextName;
     NamesMap m_localToGlobalMap;
+    // Copy of m_localToGlobalMap for lock-free lookups.
+    emugl::SeqLockHashMap<ObjectLocalName, unsigned int> m_globalNames;
     const NamedObjectType m_type;
     GlobalNameSpace *m_globalNameSpace;
 };
@@ -138,12 +144,14 @@ private:
 //   there will be one inctance of ShareGroup for each user OpenGL context
 //   unless the user context share with another user context. In that case they
 //   both will share the same ShareGroup instance.
-//   calls into that class gets serialized through a lock so it is thread safe.
+//   calls into that class gets serialized through a lock so it is thread safe,
+//   except getGlobalName() and isObject() which never block, since they are
+//   called on almost every GL call.
 //
-class ShareGroup
+class ShareGroup : public emugl::RefCounted
 {
     friend class ObjectNameManager;
-    friend class emugl::SmartPtr<ShareGroup>;  // to allow destructing when ShareGroupPtr refcount reaches zero
+    friend class emugl::RefPtr<ShareGroup>;  // to allow destructing when ShareGroupPtr refcount reaches zero
 
 public:
 
@@ -209,7 +217,7 @@ private:
     void *m_objectsData;
 };
 
-typedef emugl::SmartPtr<ShareGroup> ShareGroupPtr;
+typedef emugl::RefPtr<ShareGroup> ShareGroupPtr;
 typedef std::multimap<void *, ShareGroupPtr> ShareGroupsMap;
 
 //
@@ -20,12 +20,17 @@ endif
 host_common_SRC_FILES := \
     $(host_OS_SRCS) \
     ColorBuffer.cpp \
+    DecoderStats.cpp \
     EGLDispatch.cpp \
     FbConfig.cpp \
+    FbConfigCache.cpp \
     FrameBuffer.cpp \
+    FrameStats.cpp \
     GLESv1Dispatch.cpp \
     GLESv2Dispatch.cpp \
+    ProfiledMutex.cpp \
     ReadBuffer.cpp \
+    RenderChannel.cpp \
     RenderContext.cpp \
     RenderControl.cpp \
     RenderServer.cpp \
@@ -33,7 +38,9 @@ host_common_SRC_FILES := \
     RenderThreadInfo.cpp \
     render_api.cpp \
     RenderWindow.cpp \
+    SkinCompositor.cpp \
     TextureDraw.cpp \
+    VideoRecorder.cpp \
     WindowSurface.cpp \
 
 host_common_CFLAGS :=
@@ -84,3 +91,50 @@ LOCAL_STATIC_LIBRARIES += lib64emugl_common
 $(call emugl-export,CFLAGS,$(host_common_CFLAGS))
 
 $(call emugl-end-module)
+
+
+
+### emugl_replay #########################################################
+# Replays streams dumped with RENDERER_DUMP_DIR, see StreamReplayer.cpp.
+# This is built from the library sources since it uses internal classes.
+$(call emugl-begin-host-executable,emugl_replay)
+
+$(call emugl-import,libGLESv1_dec libGLESv2_dec lib_renderControl_dec libOpenglCodecCommon)
+
+$(call emugl-gen-replayer,$(EMUGL_PATH)/host/libs/GLESv1_dec,gles1)
+$(call emugl-gen-replayer,$(EMUGL_PATH)/host/libs/GLESv2_dec,gles2)
+$(call emugl-gen-replayer,$(EMUGL_PATH)/host/libs/renderControl_dec,renderControl)
+
+LOCAL_LDLIBS += $(host_common_LDLIBS)
+
+LOCAL_SRC_FILES := $(host_common_SRC_FILES) StreamReplayer.cpp
+LOCAL_CFLAGS += $(host_common_CFLAGS)
+
+# use Translator's egl/gles headers
+LOCAL_C_INCLUDES += $(EMUGL_PATH)/host/libs/Translator/include
+
+LOCAL_STATIC_LIBRARIES += libemugl_common
+
+$(call emugl-end-module)
+
+
+### emugl_replay, 64-bit #################################################
+$(call emugl-begin-host64-executable,emugl64_replay)
+
+$(call emugl-import,lib64GLESv1_dec lib64GLESv2_dec lib64_renderControl_dec lib64OpenglCodecCommon)
+
+$(call emugl-gen-replayer,$(EMUGL_PATH)/host/libs/GLESv1_dec,gles1)
+$(call emugl-gen-replayer,$(EMUGL_PATH)/host/libs/GLESv2_dec,gles2)
+$(call emugl-gen-replayer,$(EMUGL_PATH)/host/libs/renderControl_dec,renderControl)
+
+LOCAL_LDLIBS += $(host_common_LDLIBS)
+
+LOCAL_SRC_FILES := $(host_common_SRC_FILES) StreamReplayer.cpp
+LOCAL_CFLAGS += $(host_common_CFLAGS)
+
+# use Translator's egl/gles headers
+LOCAL_C_INCLUDES += $(EMUGL_PATH)/host/libs/Translator/include
+
+LOCAL_STATIC_LIBRARIES += lib64emugl_common
+
+$(call emugl-end-module)
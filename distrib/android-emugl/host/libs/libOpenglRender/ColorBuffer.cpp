@@ -21,6 +21,7 @@
 #include "GLESv2Dispatch.h"
 #include "RenderThreadInfo.h"
 #include "TextureDraw.h"
+#include "VideoRecorder.h"
 
 #include <stdio.h>
 
@@ -58,6 +59,24 @@ void unbindFbo() {
     s_gles2.glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
+// Return the host texture format used for the ColorBuffer internal format
+// |internalFormat|, or 0 if it is not supported.
+GLenum getTextureFormat(GLenum internalFormat) {
+    switch (internalFormat) {
+        case GL_RGB:
+        case GL_RGB565_OES:
+            return GL_RGB;
+
+        case GL_RGBA:
+        case GL_RGB5_A1_OES:
+        case GL_RGBA4_OES:
+            return GL_RGBA;
+
+        default:
+            return 0;
+    }
+}
+
 // Helper class to use a ColorBuffer::Helper context.
 // Usage is pretty simple:
 //
@@ -102,23 +121,9 @@ ColorBuffer* ColorBuffer::create(EGLDisplay p_display,
                                  GLenum p_internalFormat,
                                  bool has_eglimage_texture_2d,
                                  Helper* helper) {
-    GLenum texInternalFormat = 0;
-
-    switch (p_internalFormat) {
-        case GL_RGB:
-        case GL_RGB565_OES:
-            texInternalFormat = GL_RGB;
-            break;
-
-        case GL_RGBA:
-        case GL_RGB5_A1_OES:
-        case GL_RGBA4_OES:
-            texInternalFormat = GL_RGBA;
-            break;
-
-        default:
-            return NULL;
-            break;
+    GLenum texInternalFormat = getTextureFormat(p_internalFormat);
+    if (!texInternalFormat) {
+        return NULL;
     }
 
     ScopedHelperContext context(helper);
@@ -173,6 +178,7 @@ ColorBuffer* ColorBuffer::create(EGLDisplay p_display,
     cb->m_width = p_width;
     cb->m_height = p_height;
     cb->m_internalFormat = texInternalFormat;
+    cb->addDamage(0, 0, p_width, p_height);
 
     if (has_eglimage_texture_2d) {
         cb->m_eglImage = s_egl.eglCreateImageKHR(
@@ -200,7 +206,12 @@ ColorBuffer::ColorBuffer(EGLDisplay display, Helper* helper) :
         m_fbo(0),
         m_internalFormat(0),
         m_display(display),
-        m_helper(helper) {}
+        m_helper(helper),
+        m_damageX0(0),
+        m_damageY0(0),
+        m_damageX1(0),
+        m_damageY1(0),
+        m_guestRenderTarget(false) {}
 
 ColorBuffer::~ColorBuffer() {
     ScopedHelperContext context(m_helper);
@@ -254,6 +265,7 @@ void ColorBuffer::subUpdate(int x,
     s_gles2.glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
     s_gles2.glTexSubImage2D(
             GL_TEXTURE_2D, 0, x, y, width, height, p_format, p_type, pixels);
+    addDamage(x, y, width, height);
 }
 
 bool ColorBuffer::blitFromCurrentReadBuffer()
@@ -306,6 +318,7 @@ bool ColorBuffer::blitFromCurrentReadBuffer()
 
     // render m_blitTex
     m_helper->getTextureDraw()->draw(m_blitTex, 0.);
+    addDamage(0, 0, m_width, m_height);
 
     // Restore previous viewport.
     s_gles2.glViewport(vport[0], vport[1], vport[2], vport[3]);
@@ -328,6 +341,8 @@ bool ColorBuffer::bindToTexture() {
     else {
         s_gles1.glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, m_eglImage);
     }
+    // The texture could be attached to a guest framebuffer object.
+    m_guestRenderTarget = true;
     return true;
 }
 
@@ -345,12 +360,21 @@ bool ColorBuffer::bindToRenderbuffer() {
     else {
         s_gles1.glEGLImageTargetRenderbufferStorageOES(GL_RENDERBUFFER_OES, m_eglImage);
     }
+    m_guestRenderTarget = true;
     return true;
 }
 
-bool ColorBuffer::post(float rotation) {
+bool ColorBuffer::post(TextureDraw* textureDraw, float rotation) {
     // NOTE: Do not call m_helper->setupContext() here!
-    return m_helper->getTextureDraw()->draw(m_tex, rotation);
+    return textureDraw->draw(m_tex, rotation);
+}
+
+bool ColorBuffer::record(VideoRecorder* recorder) {
+    ScopedHelperContext context(m_helper);
+    if (!context.isOk()) {
+        return false;
+    }
+    return recorder->addFrame(m_tex);
 }
 
 void ColorBuffer::readback(unsigned char* img) {
@@ -364,3 +388,86 @@ void ColorBuffer::readback(unsigned char* img) {
         unbindFbo();
     }
 }
+
+bool ColorBuffer::readbackAsync(GLuint pbo) {
+    ScopedHelperContext context(m_helper);
+    if (!context.isOk()) {
+        return false;
+    }
+    if (!bindFbo(&m_fbo, m_tex)) {
+        return false;
+    }
+    s_gles2.glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+    // With a pixel-pack buffer bound, the last parameter is an offset into
+    // the buffer object, and glReadPixels() returns without waiting for the
+    // GPU to complete.
+    s_gles2.glReadPixels(
+            0, 0, m_width, m_height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    s_gles2.glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    unbindFbo();
+    return s_gles2.glGetError() == GL_NO_ERROR;
+}
+
+bool ColorBuffer::canReuseFor(int p_width,
+                              int p_height,
+                              GLenum p_internalFormat) const {
+    return (GLuint)p_width == m_width && (GLuint)p_height == m_height &&
+           getTextureFormat(p_internalFormat) == m_internalFormat;
+}
+
+uint64_t ColorBuffer::getMemorySize() const {
+    // Two textures, the main one and the blit one.
+    int nComp = (m_internalFormat == GL_RGB ? 3 : 4);
+    return 2ULL * nComp * m_width * m_height;
+}
+
+bool ColorBuffer::recycle() {
+    m_guestRenderTarget = false;
+
+    ScopedHelperContext context(m_helper);
+    if (!context.isOk() || !bindFbo(&m_fbo, m_tex)) {
+        return false;
+    }
+    s_gles2.glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    s_gles2.glClear(GL_COLOR_BUFFER_BIT);
+    unbindFbo();
+    addDamage(0, 0, m_width, m_height);
+    return s_gles2.glGetError() == GL_NO_ERROR;
+}
+
+void ColorBuffer::addDamage(int x, int y, int width, int height) {
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+    if (m_damageX1 <= m_damageX0) {
+        m_damageX0 = x;
+        m_damageY0 = y;
+        m_damageX1 = x + width;
+        m_damageY1 = y + height;
+        return;
+    }
+    if (x < m_damageX0) m_damageX0 = x;
+    if (y < m_damageY0) m_damageY0 = y;
+    if (x + width > m_damageX1) m_damageX1 = x + width;
+    if (y + height > m_damageY1) m_damageY1 = y + height;
+}
+
+void ColorBuffer::takeDamage(int* x, int* y, int* width, int* height) {
+    if (m_guestRenderTarget) {
+        addDamage(0, 0, m_width, m_height);
+    }
+    // Clip to the buffer's bounds.
+    int x0 = m_damageX0 < 0 ? 0 : m_damageX0;
+    int y0 = m_damageY0 < 0 ? 0 : m_damageY0;
+    int x1 = m_damageX1 > (int)m_width ? (int)m_width : m_damageX1;
+    int y1 = m_damageY1 > (int)m_height ? (int)m_height : m_damageY1;
+    if (x1 <= x0 || y1 <= y0) {
+        *x = *y = *width = *height = 0;
+    } else {
+        *x = x0;
+        *y = y0;
+        *width = x1 - x0;
+        *height = y1 - y0;
+    }
+    m_damageX0 = m_damageY0 = m_damageX1 = m_damageY1 = 0;
+}
@@ -19,9 +19,12 @@
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 #include <GLES/gl.h>
-#include "emugl/common/smart_ptr.h"
+#include "emugl/common/ref_counted.h"
+
+#include <stdint.h>
 
 class TextureDraw;
+class VideoRecorder;
 
 // A class used to model a guest color buffer, and used to implement several
 // related things:
@@ -51,7 +54,7 @@ class TextureDraw;
 //
 // As an additional twist.
 
-class ColorBuffer {
+class ColorBuffer : public emugl::RefCounted {
 public:
     // Helper interface class used during ColorBuffer operations. This is
     // introduced to remove coupling from the FrameBuffer class implementation.
@@ -109,10 +112,14 @@ public:
     // framebuffer object / window surface. This doesn't display anything.
     bool draw();
 
-    // Post this ColorBuffer to the host native sub-window.
-    // |rotation| is the rotation angle in degrees, clockwise in the GL
-    // coordinate space.
-    bool post(float rotation);
+    // Post this ColorBuffer to the host native sub-window, drawing it with
+    // |textureDraw|. |rotation| is the rotation angle in degrees, clockwise
+    // in the GL coordinate space.
+    bool post(TextureDraw* textureDraw, float rotation);
+
+    // Record the content of this ColorBuffer with |recorder|, as the frame
+    // displayed from now on. Return true on success, false on failure.
+    bool record(VideoRecorder* recorder);
 
     // Bind the current context's EGL_TEXTURE_2D texture to this ColorBuffer's
     // EGLImage. This is intended to implement glEGLImageTargetTexture2DOES()
@@ -133,11 +140,43 @@ public:
     // |img| must be a buffer large enough (i.e. width * height * 4).
     void readback(unsigned char* img);
 
+    // Start an asynchronous read of the whole ColorBuffer as 32-bit RGBA
+    // pixels into the pixel-pack buffer object |pbo|, which must have been
+    // allocated with at least width * height * 4 bytes. The pixels can be
+    // retrieved later by mapping the buffer object. This requires GLES 3.x
+    // support from the underlying implementation.
+    // Return true on success, false on failure.
+    bool readbackAsync(GLuint pbo);
+
+    // Return the bounding rectangle of the pixels that were modified since
+    // the last call to this method, and reset it. |*x|, |*y|, |*width| and
+    // |*height| are in GL texture coordinates, i.e. y == 0 is the first row
+    // returned by readback(). On return, |*width| and |*height| are 0 if
+    // nothing was modified.
+    //
+    // Note that once the buffer has been bound to a guest texture or
+    // renderbuffer, the guest can render into it directly, so that the
+    // whole buffer is always reported as modified.
+    void takeDamage(int* x, int* y, int* width, int* height);
+
+    // Recycling support, used by the FrameBuffer's pool of released
+    // buffers. canReuseFor() returns true iff this buffer can replace a new
+    // one created with the same parameters, and getMemorySize() returns the
+    // approximate GPU memory it uses, in bytes. recycle() clears the content
+    // to transparent black and resets the state as if the buffer was just
+    // created. Return true on success, false on failure.
+    bool canReuseFor(int p_width, int p_height, GLenum p_internalFormat) const;
+    uint64_t getMemorySize() const;
+    bool recycle();
+
 private:
     ColorBuffer();  // no default constructor.
 
     explicit ColorBuffer(EGLDisplay display, Helper* helper);
 
+    // Add a rectangle to the damaged area.
+    void addDamage(int x, int y, int width, int height);
+
 private:
     GLuint m_tex;
     GLuint m_blitTex;
@@ -149,8 +188,15 @@ private:
     GLenum m_internalFormat;
     EGLDisplay m_display;
     Helper* m_helper;
+    // Bounding box of the damaged area, empty if m_damageX1 <= m_damageX0.
+    int m_damageX0;
+    int m_damageY0;
+    int m_damageX1;
+    int m_damageY1;
+    // True if the guest can render into the buffer directly.
+    bool m_guestRenderTarget;
 };
 
-typedef emugl::SmartPtr<ColorBuffer> ColorBufferPtr;
+typedef emugl::RefPtr<ColorBuffer> ColorBufferPtr;
 
 #endif
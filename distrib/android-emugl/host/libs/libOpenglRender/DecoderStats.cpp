@@ -0,0 +1,179 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#include "DecoderStats.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+emugl::LazyInstance<DecoderStats> sInstance = LAZY_INSTANCE_INIT;
+
+template <typename STATS>
+void addStats(STATS* to, const STATS* from, size_t count) {
+    for (size_t n = 0; n < count; ++n) {
+        to[n].calls += from[n].calls;
+        to[n].bytes += from[n].bytes;
+        to[n].timeNs += from[n].timeNs;
+    }
+}
+
+struct OpEntry {
+    const char* name;
+    uint64_t calls;
+    uint64_t bytes;
+    uint64_t timeNs;
+
+    bool operator<(const OpEntry& other) const {
+        return timeNs > other.timeNs;
+    }
+};
+
+template <typename DECODER>
+void collectEntries(const typename DECODER::OpStats* stats,
+                    std::vector<OpEntry>* entries) {
+    for (unsigned n = 0; n < DECODER::OPCODE_COUNT; ++n) {
+        if (!stats[n].calls) {
+            continue;
+        }
+        OpEntry entry = {
+            DECODER::opcodeName(DECODER::OPCODE_BASE + n),
+            stats[n].calls,
+            stats[n].bytes,
+            stats[n].timeNs,
+        };
+        entries->push_back(entry);
+    }
+}
+
+void appendLine(std::string* out, const char* format, ...) {
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    out->append(line);
+}
+
+}  // namespace
+
+// static
+DecoderStats* DecoderStats::get() {
+    return sInstance.ptr();
+}
+
+DecoderStats::DecoderStats() : m_lock(), m_generation(0), m_lastGeneration(0) {
+    memset(m_gles1, 0, sizeof(m_gles1));
+    memset(m_gles2, 0, sizeof(m_gles2));
+    memset(m_rc, 0, sizeof(m_rc));
+}
+
+void DecoderStats::setEnabled(bool enabled) {
+    emugl::Mutex::AutoLock lock(m_lock);
+    if (enabled) {
+        memset(m_gles1, 0, sizeof(m_gles1));
+        memset(m_gles2, 0, sizeof(m_gles2));
+        memset(m_rc, 0, sizeof(m_rc));
+        m_generation = ++m_lastGeneration;
+    } else {
+        m_generation = 0;
+    }
+}
+
+int DecoderStats::add(const ThreadStats& stats, int generation) {
+    emugl::Mutex::AutoLock lock(m_lock);
+    if (generation && generation == m_generation) {
+        addStats(m_gles1, stats.m_gles1, GLESv1Decoder::OPCODE_COUNT);
+        addStats(m_gles2, stats.m_gles2, GLESv2Decoder::OPCODE_COUNT);
+        addStats(m_rc, stats.m_rc,
+                 renderControl_decoder_context_t::OPCODE_COUNT);
+    }
+    return m_generation;
+}
+
+size_t DecoderStats::print(char* buffer, size_t bufferSize) {
+    std::vector<OpEntry> entries;
+    {
+        emugl::Mutex::AutoLock lock(m_lock);
+        collectEntries<GLESv1Decoder>(m_gles1, &entries);
+        collectEntries<GLESv2Decoder>(m_gles2, &entries);
+        collectEntries<renderControl_decoder_context_t>(m_rc, &entries);
+    }
+    std::sort(entries.begin(), entries.end());
+
+    uint64_t totalNs = 0;
+    for (size_t n = 0; n < entries.size(); ++n) {
+        totalNs += entries[n].timeNs;
+    }
+
+    std::string out;
+    appendLine(&out, "%-32s %10s %12s %10s %8s %6s\n",
+               "opcode", "calls", "bytes", "total ms", "avg us", "%");
+    for (size_t n = 0; n < entries.size(); ++n) {
+        const OpEntry& e = entries[n];
+        appendLine(&out, "%-32s %10llu %12llu %10.3f %8.3f %6.2f\n",
+                   e.name,
+                   (unsigned long long)e.calls,
+                   (unsigned long long)e.bytes,
+                   e.timeNs / 1e6,
+                   e.timeNs / 1e3 / e.calls,
+                   totalNs ? 100. * e.timeNs / totalNs : 0.);
+    }
+
+    if (bufferSize > 0) {
+        size_t count = std::min(out.size(), bufferSize - 1);
+        memcpy(buffer, out.c_str(), count);
+        buffer[count] = '\0';
+    }
+    return out.size();
+}
+
+DecoderStats::ThreadStats::ThreadStats(RenderThreadInfo* info) :
+        m_info(info),
+        m_generation(0) {
+    clear();
+    update();
+}
+
+DecoderStats::ThreadStats::~ThreadStats() {
+    DecoderStats::get()->add(*this, m_generation);
+    m_info->m_glDec.setOpStats(NULL);
+    m_info->m_gl2Dec.setOpStats(NULL);
+    m_info->m_rcDec.setOpStats(NULL);
+}
+
+void DecoderStats::ThreadStats::update() {
+    int generation = DecoderStats::get()->add(*this, m_generation);
+    clear();
+    if (generation == m_generation) {
+        return;
+    }
+    m_generation = generation;
+    m_info->m_glDec.setOpStats(generation ? m_gles1 : NULL);
+    m_info->m_gl2Dec.setOpStats(generation ? m_gles2 : NULL);
+    m_info->m_rcDec.setOpStats(generation ? m_rc : NULL);
+}
+
+void DecoderStats::ThreadStats::clear() {
+    memset(m_gles1, 0, sizeof(m_gles1));
+    memset(m_gles2, 0, sizeof(m_gles2));
+    memset(m_rc, 0, sizeof(m_rc));
+}
@@ -0,0 +1,95 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#ifndef _LIB_OPENGL_RENDER_DECODER_STATS_H
+#define _LIB_OPENGL_RENDER_DECODER_STATS_H
+
+#include "RenderThreadInfo.h"
+
+#include "emugl/common/lazy_instance.h"
+#include "emugl/common/mutex.h"
+
+#include <stddef.h>
+
+// The per-opcode statistics (calls, bytes and time) of the decoders of all
+// render threads, see the 'decoder_stats' emugen attribute.
+//
+// Collection is disabled by default since it reads the clock twice per
+// packet. Each render thread accumulates the statistics of its own
+// decoders in a ThreadStats instance without any synchronization, and
+// adds them to the global ones about once per second, so these can lag a
+// little behind.
+class DecoderStats {
+public:
+    // Return the global instance.
+    static DecoderStats* get();
+
+    // Start or stop collecting statistics. Starting resets them.
+    void setEnabled(bool enabled);
+
+    // Print the collected statistics into |buffer| as a zero-terminated
+    // table, sorted by decreasing time. Return the length of the whole
+    // table, which is truncated if it's larger than |bufferSize| - 1.
+    size_t print(char* buffer, size_t bufferSize);
+
+    // The statistics of a single render thread.
+    class ThreadStats {
+    public:
+        // Collect the statistics of the decoders in |info|.
+        explicit ThreadStats(RenderThreadInfo* info);
+
+        // Stop collecting, after adding the pending statistics to the
+        // global ones.
+        ~ThreadStats();
+
+        // Add the statistics collected since the last call to the global
+        // ones, and start or stop collecting if needed. Call this
+        // periodically from the render thread.
+        void update();
+
+    private:
+        void clear();
+
+        RenderThreadInfo* m_info;
+        int m_generation;
+        GLESv1Decoder::OpStats m_gles1[GLESv1Decoder::OPCODE_COUNT];
+        GLESv2Decoder::OpStats m_gles2[GLESv2Decoder::OPCODE_COUNT];
+        renderControl_decoder_context_t::OpStats
+                m_rc[renderControl_decoder_context_t::OPCODE_COUNT];
+
+        friend class DecoderStats;
+    };
+
+private:
+    friend struct emugl::LazyInstance<DecoderStats>;
+
+    DecoderStats();
+
+    // Add |stats| to the global statistics if it was collected during
+    // |generation|. Return the current generation, or 0 if collection is
+    // disabled.
+    int add(const ThreadStats& stats, int generation);
+
+    emugl::Mutex m_lock;
+    // Incremented each time collection starts, and 0 while disabled.
+    int m_generation;
+    int m_lastGeneration;
+    GLESv1Decoder::OpStats m_gles1[GLESv1Decoder::OPCODE_COUNT];
+    GLESv2Decoder::OpStats m_gles2[GLESv2Decoder::OPCODE_COUNT];
+    renderControl_decoder_context_t::OpStats
+            m_rc[renderControl_decoder_context_t::OPCODE_COUNT];
+};
+
+#endif
@@ -15,6 +15,7 @@
 #include "FbConfig.h"
 
 #include "EGLDispatch.h"
+#include "FbConfigCache.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -111,7 +112,13 @@ FbConfig::FbConfig(EGLConfig hostConfig, EGLDisplay hostDisplay) :
     }
 }
 
-FbConfigList::FbConfigList(EGLDisplay display) :
+FbConfig::FbConfig(EGLConfig hostConfig, const GLint* attribValues) :
+        mEglConfig(hostConfig), mAttribValues(NULL) {
+    mAttribValues = new GLint[kConfigAttributesLen];
+    memcpy(mAttribValues, attribValues, kConfigAttributesLen * sizeof(GLint));
+}
+
+FbConfigList::FbConfigList(EGLDisplay display, const FbConfigCache* cache) :
         mCount(0), mConfigs(NULL), mDisplay(display) {
     if (display == EGL_NO_DISPLAY) {
         E("%s: Invalid display value %p (EGL_NO_DISPLAY)\n",
@@ -119,6 +126,10 @@ FbConfigList::FbConfigList(EGLDisplay display) :
         return;
     }
 
+    if (cache && cache->isLoaded() && initFromCache(cache)) {
+        return;
+    }
+
     EGLint numHostConfigs = 0;
     if (!s_egl.eglGetConfigs(display, NULL, 0, &numHostConfigs)) {
         E("%s: Could not get number of host EGL configs\n", __FUNCTION__);
@@ -140,6 +151,73 @@ FbConfigList::FbConfigList(EGLDisplay display) :
     delete [] hostConfigs;
 }
 
+bool FbConfigList::initFromCache(const FbConfigCache* cache) {
+    const std::vector<GLint>& attribs = cache->getConfigAttribs();
+    const std::vector<GLint>& values = cache->getConfigValues();
+    if (attribs.size() != kConfigAttributesLen ||
+        memcmp(&attribs[0], kConfigAttributes,
+               kConfigAttributesLen * sizeof(GLint)) != 0) {
+        return false;
+    }
+
+    // Only EGL_CONFIG_ID is needed to find the host config of each cached
+    // one.
+    EGLint numHostConfigs = 0;
+    if (!s_egl.eglGetConfigs(mDisplay, NULL, 0, &numHostConfigs)) {
+        return false;
+    }
+    EGLConfig* hostConfigs = new EGLConfig[numHostConfigs];
+    EGLint* hostConfigIds = new EGLint[numHostConfigs];
+    s_egl.eglGetConfigs(mDisplay, hostConfigs, numHostConfigs,
+                        &numHostConfigs);
+    for (EGLint i = 0; i < numHostConfigs; ++i) {
+        hostConfigIds[i] = 0;
+        s_egl.eglGetConfigAttrib(mDisplay, hostConfigs[i], EGL_CONFIG_ID,
+                                 &hostConfigIds[i]);
+    }
+
+    int count = static_cast<int>(values.size() / kConfigAttributesLen);
+    mConfigs = new FbConfig*[count];
+    for (int n = 0; n < count; ++n) {
+        const GLint* configValues = &values[n * kConfigAttributesLen];
+        // See getConfigId().
+        GLint configId = configValues[4];
+        EGLint i = 0;
+        while (i < numHostConfigs && hostConfigIds[i] != configId) {
+            i++;
+        }
+        if (i == numHostConfigs) {
+            break;
+        }
+        mConfigs[mCount++] = new FbConfig(hostConfigs[i], configValues);
+    }
+
+    delete [] hostConfigIds;
+    delete [] hostConfigs;
+
+    if (mCount < count) {
+        // A cached config disappeared.
+        for (int n = 0; n < mCount; ++n) {
+            delete mConfigs[n];
+        }
+        delete [] mConfigs;
+        mConfigs = NULL;
+        mCount = 0;
+        return false;
+    }
+    return true;
+}
+
+void FbConfigList::saveToCache(FbConfigCache* cache) const {
+    std::vector<GLint> values;
+    for (int n = 0; n < mCount; ++n) {
+        values.insert(values.end(),
+                      mConfigs[n]->mAttribValues,
+                      mConfigs[n]->mAttribValues + kConfigAttributesLen);
+    }
+    cache->setConfigs(kConfigAttributes, kConfigAttributesLen, values);
+}
+
 FbConfigList::~FbConfigList() {
     for (int n = 0; n < mCount; ++n) {
         delete mConfigs[n];
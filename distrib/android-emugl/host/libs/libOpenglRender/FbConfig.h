@@ -20,6 +20,8 @@
 
 #include <stddef.h>
 
+class FbConfigCache;
+
 // A class used to model a guest EGL config.
 // This really wraps a host EGLConfig handle, and provides a few cached
 // attributes that can be retrieved through direct accessors, like
@@ -62,6 +64,9 @@ private:
 
     explicit FbConfig(EGLConfig hostConfig, EGLDisplay hostDisplay);
 
+    // Create an instance from previously queried |attribValues|.
+    FbConfig(EGLConfig hostConfig, const GLint* attribValues);
+
     friend class FbConfigList;
 
     GLuint getAttribValue(int n) const {
@@ -97,9 +102,14 @@ public:
     // host configs from |display|. A compatible config is one that supports
     // Pbuffers and RGB pixel values.
     //
+    // If |cache| is not NULL and was loaded, the attribute values of the
+    // configs are taken from it instead, provided that the host still has
+    // all the cached configs.
+    //
     // After construction, call empty() to check if there are items.
     // An empty list means there was an error during construction.
-    explicit FbConfigList(EGLDisplay display);
+    explicit FbConfigList(EGLDisplay display,
+                          const FbConfigCache* cache = NULL);
 
     // Destructor.
     ~FbConfigList();
@@ -151,10 +161,17 @@ public:
     // On success, this returns
     EGLint packConfigs(GLuint bufferByteSize, GLuint* buffer) const;
 
+    // Store the attribute values of all configs into |cache|.
+    void saveToCache(FbConfigCache* cache) const;
+
 private:
     FbConfigList();
     FbConfigList(const FbConfigList& other);
 
+    // Create the list from the values in |cache|. Return false if they
+    // don't match the host configs.
+    bool initFromCache(const FbConfigCache* cache);
+
     int mCount;
     FbConfig** mConfigs;
     EGLDisplay mDisplay;
@@ -0,0 +1,270 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "FbConfigCache.h"
+
+#include "EGLDispatch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+
+#define E(...)  fprintf(stderr, __VA_ARGS__)
+
+// The file is made of text lines, each one a key followed by a space and
+// its value, in this order:
+//
+//   emugl-config-cache <version>
+//   egl-vendor <string>
+//   egl-version <string>
+//   egl-extensions <string>
+//   egl-configs <number of host configs>
+//   gl-vendor <string>
+//   gl-renderer <string>
+//   gl-version <string>
+//   gles1-extensions <string>
+//   attribs <name> <name> ...
+//   config <value> <value> ...     (once per config)
+//
+// Increment the version when changing the format or the data collected.
+const int kVersion = 1;
+
+std::string sCachePath;
+
+std::string queryEglString(EGLDisplay display, EGLint name) {
+    const char* s = s_egl.eglQueryString(display, name);
+    return s ? s : "";
+}
+
+// Parse a line of space-separated integers into |*values|, and return
+// their count, or -1 on error.
+int parseInts(const char* line, std::vector<GLint>* values) {
+    int count = 0;
+    for (;;) {
+        while (*line == ' ') {
+            line++;
+        }
+        if (!*line) {
+            return count;
+        }
+        char* end;
+        long value = strtol(line, &end, 10);
+        if (end == line) {
+            return -1;
+        }
+        values->push_back(static_cast<GLint>(value));
+        count++;
+        line = end;
+    }
+}
+
+}  // namespace
+
+// static
+void FbConfigCache::setPath(const char* path) {
+    sCachePath = path ? path : "";
+}
+
+FbConfigCache::FbConfigCache(EGLDisplay display) :
+        mLoaded(false),
+        mEglVendor(queryEglString(display, EGL_VENDOR)),
+        mEglVersion(queryEglString(display, EGL_VERSION)),
+        mEglExtensions(queryEglString(display, EGL_EXTENSIONS)),
+        mNumHostConfigs(0) {
+    if (!s_egl.eglGetConfigs(display, NULL, 0, &mNumHostConfigs)) {
+        mNumHostConfigs = 0;
+        return;
+    }
+    if (!sCachePath.empty()) {
+        mLoaded = load(sCachePath.c_str());
+        if (!mLoaded) {
+            clear();
+        }
+    }
+}
+
+bool FbConfigCache::load(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    std::string content;
+    char buffer[4096];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        content.append(buffer, count);
+    }
+    fclose(file);
+
+    // Split the content into lines, and their keys and values.
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    size_t pos = 0;
+    while (pos < content.size()) {
+        size_t end = content.find('\n', pos);
+        if (end == std::string::npos) {
+            // Truncated file.
+            return false;
+        }
+        size_t space = content.find(' ', pos);
+        if (space == std::string::npos || space > end) {
+            space = end;
+        }
+        keys.push_back(content.substr(pos, space - pos));
+        values.push_back(space < end ?
+                content.substr(space + 1, end - space - 1) : std::string());
+        pos = end + 1;
+    }
+
+    static const char* const kKeys[] = {
+        "emugl-config-cache",
+        "egl-vendor",
+        "egl-version",
+        "egl-extensions",
+        "egl-configs",
+        "gl-vendor",
+        "gl-renderer",
+        "gl-version",
+        "gles1-extensions",
+        "attribs",
+    };
+    const size_t kNumKeys = sizeof(kKeys) / sizeof(kKeys[0]);
+    if (keys.size() < kNumKeys) {
+        return false;
+    }
+    for (size_t n = 0; n < kNumKeys; ++n) {
+        if (keys[n] != kKeys[n]) {
+            return false;
+        }
+    }
+    if (atoi(values[0].c_str()) != kVersion ||
+        values[1] != mEglVendor ||
+        values[2] != mEglVersion ||
+        values[3] != mEglExtensions ||
+        atoi(values[4].c_str()) != mNumHostConfigs) {
+        return false;
+    }
+    mGLVendor = values[5];
+    mGLRenderer = values[6];
+    mGLVersion = values[7];
+    mGles1Extensions = values[8];
+    int numAttribs = parseInts(values[9].c_str(), &mAttribs);
+    if (numAttribs <= 0) {
+        return false;
+    }
+    for (size_t n = kNumKeys; n < keys.size(); ++n) {
+        if (keys[n] != "config" ||
+            parseInts(values[n].c_str(), &mValues) != numAttribs) {
+            return false;
+        }
+    }
+    return !mValues.empty();
+}
+
+bool FbConfigCache::matchesGLStrings(const char* vendor,
+                                     const char* renderer,
+                                     const char* version) const {
+    return mGLVendor == (vendor ? vendor : "") &&
+           mGLRenderer == (renderer ? renderer : "") &&
+           mGLVersion == (version ? version : "");
+}
+
+void FbConfigCache::clear() {
+    mLoaded = false;
+    mGLVendor.clear();
+    mGLRenderer.clear();
+    mGLVersion.clear();
+    mGles1Extensions.clear();
+    mAttribs.clear();
+    mValues.clear();
+}
+
+void FbConfigCache::setGles1Extensions(const char* extensions) {
+    mGles1Extensions = extensions ? extensions : "";
+}
+
+void FbConfigCache::setGLStrings(const char* vendor,
+                                 const char* renderer,
+                                 const char* version) {
+    mGLVendor = vendor ? vendor : "";
+    mGLRenderer = renderer ? renderer : "";
+    mGLVersion = version ? version : "";
+}
+
+void FbConfigCache::setConfigs(const GLuint* attribs,
+                               size_t numAttribs,
+                               const std::vector<GLint>& values) {
+    mAttribs.assign(attribs, attribs + numAttribs);
+    mValues = values;
+}
+
+bool FbConfigCache::save() const {
+    if (sCachePath.empty() || mAttribs.empty()) {
+        return false;
+    }
+    // Strings that contain newlines can't be stored. Drivers don't return
+    // such strings in practice.
+    const std::string* const strings[] = {
+        &mEglVendor, &mEglVersion, &mEglExtensions,
+        &mGLVendor, &mGLRenderer, &mGLVersion, &mGles1Extensions,
+    };
+    for (size_t n = 0; n < sizeof(strings) / sizeof(strings[0]); ++n) {
+        if (strings[n]->find('\n') != std::string::npos) {
+            return false;
+        }
+    }
+
+    // Write to a temporary file first, so that concurrent emulator
+    // instances never read a partial file.
+    std::string tmpPath = sCachePath + ".tmp";
+    FILE* file = fopen(tmpPath.c_str(), "wb");
+    if (!file) {
+        E("%s: Could not create %s\n", __FUNCTION__, tmpPath.c_str());
+        return false;
+    }
+    fprintf(file, "emugl-config-cache %d\n", kVersion);
+    fprintf(file, "egl-vendor %s\n", mEglVendor.c_str());
+    fprintf(file, "egl-version %s\n", mEglVersion.c_str());
+    fprintf(file, "egl-extensions %s\n", mEglExtensions.c_str());
+    fprintf(file, "egl-configs %d\n", mNumHostConfigs);
+    fprintf(file, "gl-vendor %s\n", mGLVendor.c_str());
+    fprintf(file, "gl-renderer %s\n", mGLRenderer.c_str());
+    fprintf(file, "gl-version %s\n", mGLVersion.c_str());
+    fprintf(file, "gles1-extensions %s\n", mGles1Extensions.c_str());
+    fprintf(file, "attribs");
+    for (size_t n = 0; n < mAttribs.size(); ++n) {
+        fprintf(file, " %d", mAttribs[n]);
+    }
+    for (size_t n = 0; n < mValues.size(); ++n) {
+        fprintf(file, "%s %d",
+                (n % mAttribs.size()) ? "" : "\nconfig", mValues[n]);
+    }
+    fprintf(file, "\n");
+    bool ok = !ferror(file);
+    ok = (fclose(file) == 0) && ok;
+#ifdef _WIN32
+    // rename() doesn't replace existing files on Windows.
+    if (ok) {
+        remove(sCachePath.c_str());
+    }
+#endif
+    if (!ok || rename(tmpPath.c_str(), sCachePath.c_str()) != 0) {
+        E("%s: Could not write %s\n", __FUNCTION__, sCachePath.c_str());
+        remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,108 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _LIBRENDER_FB_CONFIG_CACHE_H
+#define _LIBRENDER_FB_CONFIG_CACHE_H
+
+#include <EGL/egl.h>
+#include <GLES/gl.h>
+
+#include <string>
+#include <vector>
+
+#include <stddef.h>
+
+// A file that persists the host GPU information collected by
+// FrameBuffer::initialize() across runs: the GLES 1.x extensions, which
+// require creating a temporary context to be queried, and the attribute
+// values of the filtered host EGL configs.
+//
+// The cache is keyed by the identity of the host driver, in two steps:
+//
+// - The EGL vendor, version and extension strings, and the number of host
+//   configs, which are checked when loading the file.
+//
+// - The GL vendor, renderer and version strings, which identify the host
+//   GPU and driver version, but require a current context. FrameBuffer
+//   checks them with matchesGLStrings() once its own context is created,
+//   and calls clear() if they changed.
+//
+// Usage is:
+//
+// 1) Call setPath() once, before FrameBuffer::initialize().
+//
+// 2) Create an instance for an initialized EGLDisplay, and check
+//    isLoaded() to know if the cache file existed and matched it.
+//
+// 3) If it didn't, collect the information, store it with the setters and
+//    call save().
+class FbConfigCache {
+public:
+    // Set the path of the cache file. NULL or an empty string, which is
+    // the default, disables caching.
+    static void setPath(const char* path);
+
+    // Create a new instance for |display|, and try to load the cache file.
+    explicit FbConfigCache(EGLDisplay display);
+
+    // Return true iff the cache file was loaded and matches the display.
+    bool isLoaded() const { return mLoaded; }
+
+    // Return true iff the cached GL strings are equal to the parameters.
+    bool matchesGLStrings(const char* vendor,
+                          const char* renderer,
+                          const char* version) const;
+
+    // Forget the loaded data, e.g. because the GL strings changed.
+    void clear();
+
+    // Cached GLES 1.x extension string.
+    const char* getGles1Extensions() const { return mGles1Extensions.c_str(); }
+    void setGles1Extensions(const char* extensions);
+
+    void setGLStrings(const char* vendor,
+                      const char* renderer,
+                      const char* version);
+
+    // The list of config attribute names, and for each config, the values
+    // of these attributes, in FbConfigList order.
+    const std::vector<GLint>& getConfigAttribs() const { return mAttribs; }
+    const std::vector<GLint>& getConfigValues() const { return mValues; }
+    void setConfigs(const GLuint* attribs,
+                    size_t numAttribs,
+                    const std::vector<GLint>& values);
+
+    // Write the cache file. Return true on success.
+    bool save() const;
+
+private:
+    bool load(const char* path);
+
+    bool mLoaded;
+    // Key checked on load.
+    std::string mEglVendor;
+    std::string mEglVersion;
+    std::string mEglExtensions;
+    EGLint mNumHostConfigs;
+    // Key checked by matchesGLStrings().
+    std::string mGLVendor;
+    std::string mGLRenderer;
+    std::string mGLVersion;
+    // Cached data.
+    std::string mGles1Extensions;
+    std::vector<GLint> mAttribs;
+    std::vector<GLint> mValues;
+};
+
+#endif  // _LIBRENDER_FB_CONFIG_CACHE_H
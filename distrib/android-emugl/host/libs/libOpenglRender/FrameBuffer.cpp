@@ -17,16 +17,25 @@
 #include "FrameBuffer.h"
 
 #include "EGLDispatch.h"
+#include "FbConfigCache.h"
+#include "FrameStats.h"
 #include "GLESv1Dispatch.h"
 #include "GLESv2Dispatch.h"
 #include "NativeSubWindow.h"
 #include "RenderThreadInfo.h"
 #include "TimeUtils.h"
 
+#include "emugl/common/thread.h"
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 namespace {
 
+// Default maximum size of the pool of released ColorBuffers, in MiB.
+const uint64_t kDefaultColorBufferPoolMB = 64;
+
 // Helper class to call the bind_locked() / unbind_locked() properly.
 class ScopedBind {
 public:
@@ -82,9 +91,25 @@ private:
 
 }  // namespace
 
+// The thread used to display posted color buffers, see presentLoop().
+class FrameBuffer::Presenter : public emugl::Thread {
+public:
+    explicit Presenter(FrameBuffer* fb) : mFb(fb) {}
+
+    virtual intptr_t main() {
+        mFb->presentLoop();
+        return 0;
+    }
+
+private:
+    FrameBuffer* mFb;
+};
+
 FrameBuffer *FrameBuffer::s_theFrameBuffer = NULL;
-HandleType FrameBuffer::s_nextHandle = 0;
 
+// Return the GLES 1.x extension string of |p_dpy|, which requires creating
+// a temporary context. The context that was current on entry, if any, is
+// current again on return.
 static char* getGLES1ExtensionString(EGLDisplay p_dpy)
 {
     EGLConfig config;
@@ -131,6 +156,9 @@ static char* getGLES1ExtensionString(EGLDisplay p_dpy)
         return NULL;
     }
 
+    EGLContext prevContext = s_egl.eglGetCurrentContext();
+    EGLSurface prevDrawSurface = s_egl.eglGetCurrentSurface(EGL_DRAW);
+    EGLSurface prevReadSurface = s_egl.eglGetCurrentSurface(EGL_READ);
     if (!s_egl.eglMakeCurrent(p_dpy, surface, surface, ctx)) {
         ERR("%s: Could not make GLES 1.x context current!\n", __FUNCTION__);
         s_egl.eglDestroySurface(p_dpy, surface);
@@ -142,15 +170,54 @@ static char* getGLES1ExtensionString(EGLDisplay p_dpy)
     const char* s = (const char*)s_gles1.glGetString(GL_EXTENSIONS);
     char* extString = strdup(s ? s : "");
 
-    s_egl.eglMakeCurrent(p_dpy, NULL, NULL, NULL);
+    s_egl.eglMakeCurrent(p_dpy, prevDrawSurface, prevReadSurface,
+                         prevContext);
     s_egl.eglDestroyContext(p_dpy, ctx);
     s_egl.eglDestroySurface(p_dpy, surface);
 
     return extString;
 }
 
+// Return true iff |version| is a GL_VERSION string for OpenGL ES 3.0 or
+// higher, which is required to use pixel-pack buffer objects.
+static bool isGLES3Version(const char* version) {
+    static const char kPrefix[] = "OpenGL ES ";
+    if (!version || strncmp(version, kPrefix, sizeof(kPrefix) - 1) != 0) {
+        return false;
+    }
+    return atoi(version + sizeof(kPrefix) - 1) >= 3;
+}
+
 void FrameBuffer::finalize(){
+    if (m_presenter) {
+        m_postLock.lock();
+        m_postExit = true;
+        m_postCond.signal();
+        m_postLock.unlock();
+        m_presenter->wait(NULL);
+        delete m_presenter;
+        m_presenter = NULL;
+    }
+    if (m_videoRecorder) {
+        uint64_t writtenFrames, droppedFrames;
+        stopVideoRecording(&writtenFrames, &droppedFrames);
+    }
+    if (m_readbackPbos[0]) {
+        ScopedBind bind(this);
+        if (bind.isValid()) {
+            s_gles2.glDeleteBuffers(kNumReadbackPbos, m_readbackPbos);
+        }
+        memset(m_readbackPbos, 0, sizeof(m_readbackPbos));
+    }
+    {
+        ScopedBind bind(this);
+        if (bind.isValid()) {
+            m_skinCompositor.releaseGL();
+        }
+    }
     m_colorbuffers.clear();
+    m_colorBufferPool.clear();
+    m_colorBufferPoolBytes = 0;
     if (m_useSubWindow) {
         removeSubWindow();
     }
@@ -199,16 +266,20 @@ bool FrameBuffer::initialize(int width, int height, bool useSubWindow)
     s_egl.eglBindAPI(EGL_OPENGL_ES_API);
 
     //
-    // if GLES2 plugin has loaded - try to make GLES2 context and
-    // get GLES2 extension string
+    // Load the information cached by a previous run, if any, for the same
+    // EGL implementation. Otherwise, get the GLES 1.x extension string,
+    // which requires a temporary context.
     //
+    FbConfigCache cache(fb->m_eglDisplay);
     char* gles1Extensions = NULL;
-    gles1Extensions = getGLES1ExtensionString(fb->m_eglDisplay);
-    if (!gles1Extensions) {
-        // Could not create GLES2 context - drop GL2 capability
-        ERR("Failed to obtain GLES 1.x extensions string!\n");
-        delete fb;
-        return false;
+    if (!cache.isLoaded()) {
+        gles1Extensions = getGLES1ExtensionString(fb->m_eglDisplay);
+        if (!gles1Extensions) {
+            // Could not create GLES2 context - drop GL2 capability
+            ERR("Failed to obtain GLES 1.x extensions string!\n");
+            delete fb;
+            return false;
+        }
     }
 
     //
@@ -298,6 +369,35 @@ bool FrameBuffer::initialize(int width, int height, bool useSubWindow)
         return false;
     }
 
+    //
+    // Cache the GL strings so we don't have to think about threading or
+    // current-context when asked for them.
+    //
+    fb->m_glVendor = (const char*)s_gles2.glGetString(GL_VENDOR);
+    fb->m_glRenderer = (const char*)s_gles2.glGetString(GL_RENDERER);
+    fb->m_glVersion = (const char*)s_gles2.glGetString(GL_VERSION);
+
+    //
+    // The GL strings identify the host GPU and driver, discard the cached
+    // information if they changed.
+    //
+    if (cache.isLoaded()) {
+        if (cache.matchesGLStrings(fb->m_glVendor,
+                                   fb->m_glRenderer,
+                                   fb->m_glVersion)) {
+            gles1Extensions = strdup(cache.getGles1Extensions());
+        } else {
+            cache.clear();
+            gles1Extensions = getGLES1ExtensionString(fb->m_eglDisplay);
+        }
+        if (!gles1Extensions) {
+            ERR("Failed to obtain GLES 1.x extensions string!\n");
+            bind.release();
+            delete fb;
+            return false;
+        }
+    }
+
     //
     // Initilize framebuffer capabilities
     //
@@ -312,6 +412,9 @@ bool FrameBuffer::initialize(int width, int height, bool useSubWindow)
     if (has_gl_oes_image) {
         has_gl_oes_image &= strstr(gles1Extensions, "GL_OES_EGL_image") != NULL;
     }
+    if (!cache.isLoaded()) {
+        cache.setGles1Extensions(gles1Extensions);
+    }
     free((void*)gles1Extensions);
     gles1Extensions = NULL;
 
@@ -329,6 +432,12 @@ bool FrameBuffer::initialize(int width, int height, bool useSubWindow)
         fb->m_caps.has_eglimage_renderbuffer = false;
     }
 
+    // Partial swaps are only used to tell the window system which part of
+    // the sub-window changed, the whole surface is still redrawn on post.
+    fb->m_caps.has_swap_buffers_with_damage =
+            eglExtensions && s_egl.eglSwapBuffersWithDamageEXT &&
+            strstr(eglExtensions, "EGL_EXT_swap_buffers_with_damage") != NULL;
+
     //
     // Fail initialization if not all of the following extensions
     // exist:
@@ -345,7 +454,7 @@ bool FrameBuffer::initialize(int width, int height, bool useSubWindow)
     //
     // Initialize set of configs
     //
-    fb->m_configs = new FbConfigList(fb->m_eglDisplay);
+    fb->m_configs = new FbConfigList(fb->m_eglDisplay, &cache);
     if (fb->m_configs->empty()) {
         ERR("Failed: Initialize set of configs\n");
         bind.release();
@@ -389,12 +498,21 @@ bool FrameBuffer::initialize(int width, int height, bool useSubWindow)
     }
 
     //
-    // Cache the GL strings so we don't have to think about threading or
-    // current-context when asked for them.
+    // Save the collected information for the next run.
     //
-    fb->m_glVendor = (const char*)s_gles2.glGetString(GL_VENDOR);
-    fb->m_glRenderer = (const char*)s_gles2.glGetString(GL_RENDERER);
-    fb->m_glVersion = (const char*)s_gles2.glGetString(GL_VERSION);
+    if (!cache.isLoaded()) {
+        cache.setGLStrings(fb->m_glVendor, fb->m_glRenderer, fb->m_glVersion);
+        fb->m_configs->saveToCache(&cache);
+        cache.save();
+    }
+
+    //
+    // Asynchronous readback of posted frames requires pixel-pack buffer
+    // objects, which are only available with GLES 3.x.
+    //
+    fb->m_pboReadbackEnabled = s_gles2_extra.glMapBufferRange &&
+                               s_gles2_extra.glUnmapBuffer &&
+                               isGLES3Version(fb->m_glVersion);
 
     fb->m_textureDraw = new TextureDraw(fb->m_eglDisplay);
     if (!fb->m_textureDraw) {
@@ -404,9 +522,31 @@ bool FrameBuffer::initialize(int width, int height, bool useSubWindow)
         return false;
     }
 
+    // The presenter thread draws without |m_lock|, so it needs its own
+    // program, whose uniforms can't be changed by a render thread blitting
+    // a ColorBuffer at the same time.
+    fb->m_presentTextureDraw = new TextureDraw(fb->m_eglDisplay);
+    if (!fb->m_presentTextureDraw) {
+        ERR("Failed: creation of TextureDraw instance\n");
+        bind.release();
+        delete fb;
+        return false;
+    }
+
     // release the FB context
     bind.release();
 
+    //
+    // Start the thread that displays posted color buffers. Without it,
+    // post() displays them synchronously.
+    //
+    fb->m_presenter = new Presenter(fb);
+    if (!fb->m_presenter->start()) {
+        ERR("Failed to start presenter thread, posting synchronously\n");
+        delete fb->m_presenter;
+        fb->m_presenter = NULL;
+    }
+
     //
     // Keep the singleton framebuffer pointer
     //
@@ -418,18 +558,32 @@ FrameBuffer::FrameBuffer(int p_width, int p_height, bool useSubWindow) :
     m_width(p_width),
     m_height(p_height),
     m_useSubWindow(useSubWindow),
+    m_lock("FrameBuffer::m_lock"),
     m_configs(NULL),
     m_eglDisplay(EGL_NO_DISPLAY),
+    m_handleSpace(),
+    m_contexts(&m_handleSpace),
+    m_windows(&m_handleSpace),
+    m_colorbuffers(&m_handleSpace),
     m_colorBufferHelper(new ColorBufferHelper(this)),
+    m_colorBufferPool(),
+    m_colorBufferPoolBytes(0),
+    m_colorBufferPoolMaxBytes(kDefaultColorBufferPoolMB << 20),
+    m_colorBufferPoolHits(0),
+    m_colorBufferPoolMisses(0),
     m_eglSurface(EGL_NO_SURFACE),
     m_eglContext(EGL_NO_CONTEXT),
     m_pbufContext(EGL_NO_CONTEXT),
     m_prevContext(EGL_NO_CONTEXT),
     m_prevReadSurf(EGL_NO_SURFACE),
     m_prevDrawSurf(EGL_NO_SURFACE),
+    m_nestedBinds(0),
     m_subWin((EGLNativeWindowType)0),
     m_textureDraw(NULL),
+    m_presentTextureDraw(NULL),
     m_lastPostedColorBuffer(0),
+    m_windowWidth(0),
+    m_windowHeight(0),
     m_zRot(0.0f),
     m_eglContextInitialized(false),
     m_statsNumFrames(0),
@@ -437,15 +591,40 @@ FrameBuffer::FrameBuffer(int p_width, int p_height, bool useSubWindow) :
     m_onPost(NULL),
     m_onPostContext(NULL),
     m_fbImage(NULL),
+    m_readbackIndex(0),
+    m_readbackCount(0),
+    m_pboReadbackEnabled(false),
+    m_skinCompositor(),
+    m_subwinComposited(false),
+    m_videoRecorder(NULL),
+    m_presenter(NULL),
+    m_postLock("FrameBuffer::m_postLock"),
+    m_postCond(),
+    m_postHandle(0),
+    m_postTimeNs(0LL),
+    m_postRotation(0.0f),
+    m_postPending(false),
+    m_postRepaint(false),
+    m_postRotationChanged(false),
+    m_postExit(false),
+    m_postIntervalNs(0LL),
+    m_presentLock("FrameBuffer::m_presentLock"),
     m_glVendor(NULL),
     m_glRenderer(NULL),
     m_glVersion(NULL)
 {
     m_fpsStats = getenv("SHOW_FPS_STATS") != NULL;
+    const char* poolMB = getenv("ANDROID_GL_COLORBUFFER_POOL_MB");
+    if (poolMB) {
+        m_colorBufferPoolMaxBytes = (uint64_t)strtoul(poolMB, NULL, 10) << 20;
+    }
+    memset(m_readbackPbos, 0, sizeof(m_readbackPbos));
+    memset(m_readbackDamage, 0, sizeof(m_readbackDamage));
 }
 
 FrameBuffer::~FrameBuffer() {
     delete m_textureDraw;
+    delete m_presentTextureDraw;
     delete m_configs;
     delete m_colorBufferHelper;
     free(m_fbImage);
@@ -453,9 +632,11 @@ FrameBuffer::~FrameBuffer() {
 
 void FrameBuffer::setPostCallback(OnPostFn onPost, void* onPostContext)
 {
-    emugl::Mutex::AutoLock mutex(m_lock);
+    ProfiledMutex::AutoLock mutex(m_lock);
     m_onPost = onPost;
     m_onPostContext = onPostContext;
+    // Drop any frame that was read back for the previous callback.
+    m_readbackCount = 0;
     if (m_onPost && !m_fbImage) {
         m_fbImage = (unsigned char*)malloc(4 * m_width * m_height);
         if (!m_fbImage) {
@@ -467,6 +648,129 @@ void FrameBuffer::setPostCallback(OnPostFn onPost, void* onPostContext)
     }
 }
 
+uint64_t FrameBuffer::getReadbackMemory()
+{
+    ProfiledMutex::AutoLock mutex(m_lock);
+    uint64_t ret = m_fbImage ? 4ULL * m_width * m_height : 0;
+    for (size_t n = 0; n < m_secondaryDisplays.size(); ++n) {
+        ret += m_secondaryDisplays[n].image.size();
+    }
+    return ret;
+}
+
+int FrameBuffer::addDisplay(int width, int height)
+{
+    if (width <= 0 || height <= 0) {
+        return 0;
+    }
+    ProfiledMutex::AutoLock mutex(m_lock);
+    SecondaryDisplay display;
+    display.width = width;
+    display.height = height;
+    m_secondaryDisplays.push_back(display);
+    return (int)m_secondaryDisplays.size();
+}
+
+int FrameBuffer::getDisplayCount()
+{
+    ProfiledMutex::AutoLock mutex(m_lock);
+    return 1 + (int)m_secondaryDisplays.size();
+}
+
+bool FrameBuffer::getDisplaySize(int display, int* width, int* height)
+{
+    ProfiledMutex::AutoLock mutex(m_lock);
+    if (display == 0) {
+        *width = m_width;
+        *height = m_height;
+        return true;
+    }
+    if (display < 0 || display > (int)m_secondaryDisplays.size()) {
+        return false;
+    }
+    *width = m_secondaryDisplays[display - 1].width;
+    *height = m_secondaryDisplays[display - 1].height;
+    return true;
+}
+
+bool FrameBuffer::setDisplayPostCallback(int display,
+                                         OnPostFn onPost,
+                                         void* onPostContext)
+{
+    if (display == 0) {
+        setPostCallback(onPost, onPostContext);
+        return true;
+    }
+    ProfiledMutex::AutoLock mutex(m_lock);
+    if (display < 0 || display > (int)m_secondaryDisplays.size()) {
+        return false;
+    }
+    SecondaryDisplay& d = m_secondaryDisplays[display - 1];
+    d.onPost = onPost;
+    d.onPostContext = onPostContext;
+    // Send the whole content of the next posted buffer.
+    d.colorBuffer = 0;
+    if (onPost) {
+        d.image.resize(4U * d.width * d.height);
+    } else {
+        std::vector<unsigned char>().swap(d.image);
+    }
+    return true;
+}
+
+bool FrameBuffer::postDisplay(int display, HandleType p_colorbuffer)
+{
+    if (display == 0) {
+        return post(p_colorbuffer);
+    }
+    ProfiledMutex::AutoLock mutex(m_lock);
+    if (display < 0 || display > (int)m_secondaryDisplays.size()) {
+        return false;
+    }
+    ColorBufferRef* c = m_colorbuffers.get(p_colorbuffer);
+    if (!c) {
+        return false;
+    }
+    SecondaryDisplay& d = m_secondaryDisplays[display - 1];
+    bool repaint = (p_colorbuffer != d.colorBuffer);
+    d.colorBuffer = p_colorbuffer;
+    if (!d.onPost) {
+        return true;
+    }
+
+    // Each display posts the buffers of its own guest surface, so the
+    // damage of a buffer is only taken by the display it is posted to.
+    int dx, dy, dw, dh;
+    c->cb->takeDamage(&dx, &dy, &dw, &dh);
+    if (repaint) {
+        dx = dy = 0;
+        dw = c->cb->getWidth();
+        dh = c->cb->getHeight();
+    }
+    if (dw <= 0 || dh <= 0) {
+        return true;
+    }
+    if ((int)c->cb->getWidth() != d.width ||
+        (int)c->cb->getHeight() != d.height) {
+        ERR("%s: Buffer 0x%x doesn't match the size of display %d\n",
+            __FUNCTION__, p_colorbuffer, display);
+        return false;
+    }
+    c->cb->readback(&d.image[0]);
+    d.onPost(d.onPostContext,
+             d.width,
+             d.height,
+             -1,
+             GL_RGBA,
+             GL_UNSIGNED_BYTE,
+             &d.image[0],
+             dx,
+             dy,
+             dw,
+             dh);
+    return true;
+}
+
 bool FrameBuffer::setupSubWindow(FBNativeWindowType p_window,
                                  int p_x,
                                  int p_y,
@@ -481,6 +785,7 @@ bool FrameBuffer::setupSubWindow(FBNativeWindowType p_window,
         return false;
     }
 
+    m_presentLock.lock();
     m_lock.lock();
     if (!m_subWin) {
         // create native subwindow for FB display output
@@ -504,14 +809,19 @@ bool FrameBuffer::setupSubWindow(FBNativeWindowType p_window,
                     // update viewport and z rotation and draw
                     // the last posted color buffer.
                     s_gles2.glViewport(0, 0, p_width, p_height);
+                    m_windowWidth = p_width;
+                    m_windowHeight = p_height;
                     m_zRot = zRot;
+                    // Don't let a pending setDisplayRotation() override
+                    // this one.
+                    m_postLock.lock();
+                    m_postRotationChanged = false;
+                    m_postLock.unlock();
                     if (m_lastPostedColorBuffer) {
-                        post(m_lastPostedColorBuffer, false);
+                        postImpl(m_lastPostedColorBuffer, false, true);
                     } else {
-                        s_gles2.glClear(GL_COLOR_BUFFER_BIT |
-                                        GL_DEPTH_BUFFER_BIT |
-                                        GL_STENCIL_BUFFER_BIT);
-                        s_egl.eglSwapBuffers(m_eglDisplay, m_eglSurface);
+                        int damage[4] = { 0, 0, m_width, m_height };
+                        drawSubwin_locked(NULL, damage);
                     }
                     unbind_locked();
                     success = true;
@@ -520,6 +830,7 @@ bool FrameBuffer::setupSubWindow(FBNativeWindowType p_window,
         }
     }
     m_lock.unlock();
+    m_presentLock.unlock();
     return success;
 }
 
@@ -530,6 +841,7 @@ bool FrameBuffer::removeSubWindow() {
         return false;
     }
     bool removed = false;
+    m_presentLock.lock();
     m_lock.lock();
     if (m_subWin) {
         s_egl.eglMakeCurrent(m_eglDisplay, NULL, NULL, NULL);
@@ -541,38 +853,46 @@ bool FrameBuffer::removeSubWindow() {
         removed = true;
     }
     m_lock.unlock();
+    m_presentLock.unlock();
     return removed;
 }
 
-HandleType FrameBuffer::genHandle()
-{
-    HandleType id;
-    do {
-        id = ++s_nextHandle;
-    } while( id == 0 ||
-             m_contexts.find(id) != m_contexts.end() ||
-             m_windows.find(id) != m_windows.end() );
-
-    return id;
-}
-
 HandleType FrameBuffer::createColorBuffer(int p_width, int p_height,
                                           GLenum p_internalFormat)
 {
-    emugl::Mutex::AutoLock mutex(m_lock);
+    ProfiledMutex::AutoLock mutex(m_lock);
     HandleType ret = 0;
 
-    ColorBufferPtr cb(ColorBuffer::create(
-            getDisplay(),
-            p_width,
-            p_height,
-            p_internalFormat,
-            getCaps().has_eglimage_texture_2d,
-            m_colorBufferHelper));
+    ColorBufferPtr cb;
+    for (std::list<ColorBufferPtr>::iterator it = m_colorBufferPool.begin();
+            it != m_colorBufferPool.end(); ++it) {
+        if ((*it)->canReuseFor(p_width, p_height, p_internalFormat)) {
+            cb.swap(*it);
+            m_colorBufferPool.erase(it);
+            m_colorBufferPoolBytes -= cb->getMemorySize();
+            if (!cb->recycle()) {
+                cb = ColorBufferPtr();
+            }
+            break;
+        }
+    }
     if (cb.Ptr() != NULL) {
-        ret = genHandle();
-        m_colorbuffers[ret].cb = cb;
-        m_colorbuffers[ret].refcount = 1;
+        m_colorBufferPoolHits++;
+    } else {
+        m_colorBufferPoolMisses++;
+        cb = ColorBufferPtr(ColorBuffer::create(
+                getDisplay(),
+                p_width,
+                p_height,
+                p_internalFormat,
+                getCaps().has_eglimage_texture_2d,
+                m_colorBufferHelper));
+    }
+    if (cb.Ptr() != NULL) {
+        ColorBufferRef ref;
+        ref.cb = cb;
+        ref.refcount = 1;
+        ret = m_colorbuffers.add(ref);
     }
     return ret;
 }
@@ -580,7 +900,7 @@ HandleType FrameBuffer::createColorBuffer(int p_width, int p_height,
 HandleType FrameBuffer::createRenderContext(int p_config, HandleType p_share,
                                             bool p_isGL2)
 {
-    emugl::Mutex::AutoLock mutex(m_lock);
+    ProfiledMutex::AutoLock mutex(m_lock);
     HandleType ret = 0;
 
     const FbConfig* config = getConfigs()->get(p_config);
@@ -590,11 +910,11 @@ HandleType FrameBuffer::createRenderContext(int p_config, HandleType p_share,
 
     RenderContextPtr share(NULL);
     if (p_share != 0) {
-        RenderContextMap::iterator s(m_contexts.find(p_share));
-        if (s == m_contexts.end()) {
+        RenderContextPtr* s = m_contexts.get(p_share);
+        if (!s) {
             return ret;
         }
-        share = (*s).second;
+        share = *s;
     }
     EGLContext sharedContext =
             share.Ptr() ? share->getEGLContext() : EGL_NO_CONTEXT;
@@ -602,8 +922,7 @@ HandleType FrameBuffer::createRenderContext(int p_config, HandleType p_share,
     RenderContextPtr rctx(RenderContext::create(
         m_eglDisplay, config->getEglConfig(), sharedContext, p_isGL2));
     if (rctx.Ptr() != NULL) {
-        ret = genHandle();
-        m_contexts[ret] = rctx;
+        ret = m_contexts.add(rctx);
         RenderThreadInfo *tinfo = RenderThreadInfo::get();
         tinfo->m_contextSet.insert(ret);
     }
@@ -612,7 +931,7 @@ HandleType FrameBuffer::createRenderContext(int p_config, HandleType p_share,
 
 HandleType FrameBuffer::createWindowSurface(int p_config, int p_width, int p_height)
 {
-    emugl::Mutex::AutoLock mutex(m_lock);
+    ProfiledMutex::AutoLock mutex(m_lock);
 
     HandleType ret = 0;
 
@@ -624,8 +943,7 @@ HandleType FrameBuffer::createWindowSurface(int p_config, int p_width, int p_hei
     WindowSurfacePtr win(WindowSurface::create(
             getDisplay(), config->getEglConfig(), p_width, p_height));
     if (win.Ptr() != NULL) {
-        ret = genHandle();
-        m_windows[ret] = std::pair<WindowSurfacePtr, HandleType>(win,0);
+        ret = m_windows.add(std::pair<WindowSurfacePtr, HandleType>(win,0));
         RenderThreadInfo *tinfo = RenderThreadInfo::get();
         tinfo->m_windowSet.insert(ret);
     }
@@ -635,34 +953,37 @@ HandleType FrameBuffer::createWindowSurface(int p_config, int p_width, int p_hei
 
 void FrameBuffer::drainRenderContext()
 {
-    emugl::Mutex::AutoLock mutex(m_lock);
+    ProfiledMutex::AutoLock mutex(m_lock);
     RenderThreadInfo *tinfo = RenderThreadInfo::get();
     if (tinfo->m_contextSet.empty()) return;
     for (std::set<HandleType>::iterator it = tinfo->m_contextSet.begin();
             it != tinfo->m_contextSet.end(); ++it) {
         HandleType contextHandle = *it;
-        m_contexts.erase(contextHandle);
+        m_contexts.remove(contextHandle);
     }
     tinfo->m_contextSet.clear();
 }
 
 void FrameBuffer::drainWindowSurface()
 {
-    emugl::Mutex::AutoLock mutex(m_lock);
+    ProfiledMutex::AutoLock mutex(m_lock);
     RenderThreadInfo *tinfo = RenderThreadInfo::get();
     if (tinfo->m_windowSet.empty()) return;
     for (std::set<HandleType>::iterator it = tinfo->m_windowSet.begin();
             it != tinfo->m_windowSet.end(); ++it) {
         HandleType windowHandle = *it;
-        if (m_windows.find(windowHandle) != m_windows.end()) {
-            HandleType oldColorBufferHandle = m_windows[windowHandle].second;
+        std::pair<WindowSurfacePtr, HandleType>* w = m_windows.get(windowHandle);
+        if (w) {
+            HandleType oldColorBufferHandle = w->second;
             if (oldColorBufferHandle) {
-                ColorBufferMap::iterator cit(m_colorbuffers.find(oldColorBufferHandle));
-                if (cit != m_colorbuffers.end()) {
-                    if (--(*cit).second.refcount == 0) { m_colorbuffers.erase(cit); }
+                ColorBufferRef* c = m_colorbuffers.get(oldColorBufferHandle);
+                if (c) {
+                    if (--c->refcount == 0) {
+                        releaseColorBuffer_locked(oldColorBufferHandle);
+                    }
                 }
             }
-            m_windows.erase(windowHandle);
+            m_windows.remove(windowHandle);
         }
     }
     tinfo->m_windowSet.clear();
@@ -670,8 +991,8 @@ void FrameBuffer::drainWindowSurface()
 
 void FrameBuffer::DestroyRenderContext(HandleType p_context)
 {
-    emugl::Mutex::AutoLock mutex(m_lock);
-    m_contexts.erase(p_context);
+    ProfiledMutex::AutoLock mutex(m_lock);
+    m_contexts.remove(p_context);
     RenderThreadInfo *tinfo = RenderThreadInfo::get();
     if (tinfo->m_contextSet.empty()) return;
     tinfo->m_contextSet.erase(p_context);
@@ -679,9 +1000,8 @@ void FrameBuffer::DestroyRenderContext(HandleType p_context)
 
 void FrameBuffer::DestroyWindowSurface(HandleType p_surface)
 {
-    emugl::Mutex::AutoLock mutex(m_lock);
-    if (m_windows.find(p_surface) != m_windows.end()) {
-        m_windows.erase(p_surface);
+    ProfiledMutex::AutoLock mutex(m_lock);
+    if (m_windows.remove(p_surface)) {
         RenderThreadInfo *tinfo = RenderThreadInfo::get();
         if (tinfo->m_windowSet.empty()) return;
         tinfo->m_windowSet.erase(p_surface);
@@ -690,45 +1010,81 @@ void FrameBuffer::DestroyWindowSurface(HandleType p_surface)
 
 int FrameBuffer::openColorBuffer(HandleType p_colorbuffer)
 {
-    emugl::Mutex::AutoLock mutex(m_lock);
-    ColorBufferMap::iterator c(m_colorbuffers.find(p_colorbuffer));
-    if (c == m_colorbuffers.end()) {
+    ProfiledMutex::AutoLock mutex(m_lock);
+    ColorBufferRef* c = m_colorbuffers.get(p_colorbuffer);
+    if (!c) {
         // bad colorbuffer handle
         ERR("FB: openColorBuffer cb handle %#x not found\n", p_colorbuffer);
         return -1;
     }
-    (*c).second.refcount++;
+    c->refcount++;
     return 0;
 }
 
 void FrameBuffer::closeColorBuffer(HandleType p_colorbuffer)
 {
-    emugl::Mutex::AutoLock mutex(m_lock);
-    ColorBufferMap::iterator c(m_colorbuffers.find(p_colorbuffer));
-    if (c == m_colorbuffers.end()) {
+    ProfiledMutex::AutoLock mutex(m_lock);
+    ColorBufferRef* c = m_colorbuffers.get(p_colorbuffer);
+    if (!c) {
         // This is harmless: it is normal for guest system to issue
         // closeColorBuffer command when the color buffer is already
         // garbage collected on the host. (we dont have a mechanism
         // to give guest a notice yet)
         return;
     }
-    if (--(*c).second.refcount == 0) {
-        m_colorbuffers.erase(c);
+    if (--c->refcount == 0) {
+        releaseColorBuffer_locked(p_colorbuffer);
     }
 }
 
+void FrameBuffer::releaseColorBuffer_locked(HandleType p_colorbuffer)
+{
+    ColorBufferRef* c = m_colorbuffers.get(p_colorbuffer);
+    if (!c) {
+        return;
+    }
+    // Only pool buffers that nothing else references, e.g. not those still
+    // attached to a window surface. All references are taken with m_lock.
+    ColorBufferPtr cb;
+    cb.swap(c->cb);
+    m_colorbuffers.remove(p_colorbuffer);
+
+    uint64_t size = cb->getMemorySize();
+    if (cb->getRefCount() != 1 || size > m_colorBufferPoolMaxBytes) {
+        return;
+    }
+    m_colorBufferPool.push_front(ColorBufferPtr());
+    m_colorBufferPool.front().swap(cb);
+    m_colorBufferPoolBytes += size;
+    while (m_colorBufferPoolBytes > m_colorBufferPoolMaxBytes) {
+        m_colorBufferPoolBytes -= m_colorBufferPool.back()->getMemorySize();
+        m_colorBufferPool.pop_back();
+    }
+}
+
+void FrameBuffer::getColorBufferPoolStats(uint64_t* hits, uint64_t* misses,
+                                          uint64_t* pooledBytes,
+                                          uint64_t* maxBytes)
+{
+    ProfiledMutex::AutoLock mutex(m_lock);
+    *hits = m_colorBufferPoolHits;
+    *misses = m_colorBufferPoolMisses;
+    *pooledBytes = m_colorBufferPoolBytes;
+    *maxBytes = m_colorBufferPoolMaxBytes;
+}
+
 bool FrameBuffer::flushWindowSurfaceColorBuffer(HandleType p_surface)
 {
-    emugl::Mutex::AutoLock mutex(m_lock);
+    ProfiledMutex::AutoLock mutex(m_lock);
 
-    WindowSurfaceMap::iterator w( m_windows.find(p_surface) );
-    if (w == m_windows.end()) {
+    std::pair<WindowSurfacePtr, HandleType>* w = m_windows.get(p_surface);
+    if (!w) {
         ERR("FB::flushWindowSurfaceColorBuffer: window handle %#x not found\n", p_surface);
         // bad surface handle
         return false;
     }
 
-    WindowSurface* surface = (*w).second.first.Ptr();
+    WindowSurface* surface = w->first.Ptr();
     surface->flushColorBuffer();
 
     return true;
@@ -737,24 +1093,24 @@ bool FrameBuffer::flushWindowSurfaceColorBuffer(HandleType p_surface)
 bool FrameBuffer::setWindowSurfaceColorBuffer(HandleType p_surface,
                                               HandleType p_colorbuffer)
 {
-    emugl::Mutex::AutoLock mutex(m_lock);
+    ProfiledMutex::AutoLock mutex(m_lock);
 
-    WindowSurfaceMap::iterator w( m_windows.find(p_surface) );
-    if (w == m_windows.end()) {
+    std::pair<WindowSurfacePtr, HandleType>* w = m_windows.get(p_surface);
+    if (!w) {
         // bad surface handle
         ERR("%s: bad window surface handle %#x\n", __FUNCTION__, p_surface);
         return false;
     }
 
-    ColorBufferMap::iterator c( m_colorbuffers.find(p_colorbuffer) );
-    if (c == m_colorbuffers.end()) {
+    ColorBufferRef* c = m_colorbuffers.get(p_colorbuffer);
+    if (!c) {
         DBG("%s: bad color buffer handle %#x\n", __FUNCTION__, p_colorbuffer);
         // bad colorbuffer handle
         return false;
     }
 
-    (*w).second.first->setColorBuffer((*c).second.cb);
-    (*w).second.second = p_colorbuffer;
+    w->first->setColorBuffer(c->cb);
+    w->second = p_colorbuffer;
     return true;
 }
 
@@ -762,100 +1118,109 @@ void FrameBuffer::readColorBuffer(HandleType p_colorbuffer,
                                     int x, int y, int width, int height,
                                     GLenum format, GLenum type, void *pixels)
 {
-    emugl::Mutex::AutoLock mutex(m_lock);
+    ProfiledMutex::AutoLock mutex(m_lock);
 
-    ColorBufferMap::iterator c( m_colorbuffers.find(p_colorbuffer) );
-    if (c == m_colorbuffers.end()) {
+    ColorBufferRef* c = m_colorbuffers.get(p_colorbuffer);
+    if (!c) {
         // bad colorbuffer handle
         return;
     }
 
-    (*c).second.cb->readPixels(x, y, width, height, format, type, pixels);
+    c->cb->readPixels(x, y, width, height, format, type, pixels);
 }
 
 bool FrameBuffer::updateColorBuffer(HandleType p_colorbuffer,
                                     int x, int y, int width, int height,
                                     GLenum format, GLenum type, void *pixels)
 {
-    emugl::Mutex::AutoLock mutex(m_lock);
+    ProfiledMutex::AutoLock mutex(m_lock);
 
-    ColorBufferMap::iterator c( m_colorbuffers.find(p_colorbuffer) );
-    if (c == m_colorbuffers.end()) {
+    ColorBufferRef* c = m_colorbuffers.get(p_colorbuffer);
+    if (!c) {
         // bad colorbuffer handle
         return false;
     }
 
-    (*c).second.cb->subUpdate(x, y, width, height, format, type, pixels);
+    c->cb->subUpdate(x, y, width, height, format, type, pixels);
 
     return true;
 }
 
 bool FrameBuffer::bindColorBufferToTexture(HandleType p_colorbuffer)
 {
-    emugl::Mutex::AutoLock mutex(m_lock);
+    ProfiledMutex::AutoLock mutex(m_lock);
 
-    ColorBufferMap::iterator c( m_colorbuffers.find(p_colorbuffer) );
-    if (c == m_colorbuffers.end()) {
+    ColorBufferRef* c = m_colorbuffers.get(p_colorbuffer);
+    if (!c) {
         // bad colorbuffer handle
         return false;
     }
 
-    return (*c).second.cb->bindToTexture();
+    return c->cb->bindToTexture();
 }
 
 bool FrameBuffer::bindColorBufferToRenderbuffer(HandleType p_colorbuffer)
 {
-    emugl::Mutex::AutoLock mutex(m_lock);
+    ProfiledMutex::AutoLock mutex(m_lock);
 
-    ColorBufferMap::iterator c( m_colorbuffers.find(p_colorbuffer) );
-    if (c == m_colorbuffers.end()) {
+    ColorBufferRef* c = m_colorbuffers.get(p_colorbuffer);
+    if (!c) {
         // bad colorbuffer handle
         return false;
     }
 
-    return (*c).second.cb->bindToRenderbuffer();
+    return c->cb->bindToRenderbuffer();
 }
 
 bool FrameBuffer::bindContext(HandleType p_context,
                               HandleType p_drawSurface,
                               HandleType p_readSurface)
 {
-    emugl::Mutex::AutoLock mutex(m_lock);
+    ProfiledMutex::AutoLock mutex(m_lock);
 
     WindowSurfacePtr draw(NULL), read(NULL);
     RenderContextPtr ctx(NULL);
+    RenderThreadInfo *tinfo = RenderThreadInfo::get();
 
     //
     // if this is not an unbind operation - make sure all handles are good
     //
     if (p_context || p_drawSurface || p_readSurface) {
-        RenderContextMap::iterator r( m_contexts.find(p_context) );
-        if (r == m_contexts.end()) {
+        RenderContextPtr* r = m_contexts.get(p_context);
+        if (!r) {
             // bad context handle
             return false;
         }
 
-        ctx = (*r).second;
-        WindowSurfaceMap::iterator w( m_windows.find(p_drawSurface) );
-        if (w == m_windows.end()) {
+        ctx = *r;
+        std::pair<WindowSurfacePtr, HandleType>* w = m_windows.get(p_drawSurface);
+        if (!w) {
             // bad surface handle
             return false;
         }
-        draw = (*w).second.first;
+        draw = w->first;
 
         if (p_readSurface != p_drawSurface) {
-            WindowSurfaceMap::iterator w( m_windows.find(p_readSurface) );
-            if (w == m_windows.end()) {
+            std::pair<WindowSurfacePtr, HandleType>* w = m_windows.get(p_readSurface);
+            if (!w) {
                 // bad surface handle
                 return false;
             }
-            read = (*w).second.first;
+            read = w->first;
         }
         else {
             read = draw;
         }
     }
 
+    // Guests make the same context and surfaces current over and over,
+    // e.g. before each frame, so skip the switch if nothing changes.
+    if (ctx.Ptr() == tinfo->currContext.Ptr() &&
+        draw.Ptr() == tinfo->currDrawSurf.Ptr() &&
+        read.Ptr() == tinfo->currReadSurf.Ptr()) {
+        return true;
+    }
+
     if (!s_egl.eglMakeCurrent(m_eglDisplay,
                               draw ? draw->getEGLSurface() : EGL_NO_SURFACE,
                               read ? read->getEGLSurface() : EGL_NO_SURFACE,
@@ -867,7 +1232,6 @@ bool FrameBuffer::bindContext(HandleType p_context,
     //
     // Bind the surface(s) to the context
     //
-    RenderThreadInfo *tinfo = RenderThreadInfo::get();
     WindowSurfacePtr bindDraw, bindRead;
     if (draw.Ptr() == NULL && read.Ptr() == NULL) {
         // Unbind the current read and draw surfaces from the context
@@ -891,9 +1255,6 @@ bool FrameBuffer::bindContext(HandleType p_context,
     //
     // update thread info with current bound context
     //
-    tinfo->currContext = ctx;
-    tinfo->currDrawSurf = draw;
-    tinfo->currReadSurf = read;
     if (ctx) {
         if (ctx->isGL2()) tinfo->m_gl2Dec.setContextData(&ctx->decoderContextData());
         else tinfo->m_glDec.setContextData(&ctx->decoderContextData());
@@ -902,6 +1263,11 @@ bool FrameBuffer::bindContext(HandleType p_context,
         tinfo->m_glDec.setContextData(NULL);
         tinfo->m_gl2Dec.setContextData(NULL);
     }
+    // Transfer the references, the previous ones are released below with
+    // the lock held.
+    tinfo->currContext.swap(ctx);
+    tinfo->currDrawSurf.swap(draw);
+    tinfo->currReadSurf.swap(read);
     return true;
 }
 
@@ -909,13 +1275,30 @@ bool FrameBuffer::bindContext(HandleType p_context,
 // The framebuffer lock should be held when calling this function !
 //
 bool FrameBuffer::bind_locked()
+{
+    return makeCurrent_locked(m_pbufSurface, m_pbufContext);
+}
+
+//
+// Make |context| current with |surface|, saving the previous binding for
+// unbind_locked(). If they are current already, e.g. for nested binds or
+// a thread that only does FrameBuffer work, nothing is switched, and the
+// matching unbind_locked() doesn't switch back either.
+// The framebuffer lock should be held when calling this function !
+//
+bool FrameBuffer::makeCurrent_locked(EGLSurface surface, EGLContext context)
 {
     EGLContext prevContext = s_egl.eglGetCurrentContext();
     EGLSurface prevReadSurf = s_egl.eglGetCurrentSurface(EGL_READ);
     EGLSurface prevDrawSurf = s_egl.eglGetCurrentSurface(EGL_DRAW);
 
-    if (!s_egl.eglMakeCurrent(m_eglDisplay, m_pbufSurface,
-                              m_pbufSurface, m_pbufContext)) {
+    if (prevContext == context && prevReadSurf == surface &&
+        prevDrawSurf == surface) {
+        m_nestedBinds++;
+        return true;
+    }
+
+    if (!s_egl.eglMakeCurrent(m_eglDisplay, surface, surface, context)) {
         ERR("eglMakeCurrent failed\n");
         return false;
     }
@@ -928,13 +1311,7 @@ bool FrameBuffer::bind_locked()
 
 bool FrameBuffer::bindSubwin_locked()
 {
-    EGLContext prevContext = s_egl.eglGetCurrentContext();
-    EGLSurface prevReadSurf = s_egl.eglGetCurrentSurface(EGL_READ);
-    EGLSurface prevDrawSurf = s_egl.eglGetCurrentSurface(EGL_DRAW);
-
-    if (!s_egl.eglMakeCurrent(m_eglDisplay, m_eglSurface,
-                              m_eglSurface, m_eglContext)) {
-        ERR("eglMakeCurrent failed\n");
+    if (!makeCurrent_locked(m_eglSurface, m_eglContext)) {
         return false;
     }
 
@@ -944,15 +1321,16 @@ bool FrameBuffer::bindSubwin_locked()
     if (!m_eglContextInitialized) {
         m_eglContextInitialized = true;
     }
-
-    m_prevContext = prevContext;
-    m_prevReadSurf = prevReadSurf;
-    m_prevDrawSurf = prevDrawSurf;
     return true;
 }
 
 bool FrameBuffer::unbind_locked()
 {
+    if (m_nestedBinds > 0) {
+        m_nestedBinds--;
+        return true;
+    }
+
     if (!s_egl.eglMakeCurrent(m_eglDisplay, m_prevDrawSurf,
                               m_prevReadSurf, m_prevContext)) {
         return false;
@@ -966,42 +1344,133 @@ bool FrameBuffer::unbind_locked()
 
 bool FrameBuffer::post(HandleType p_colorbuffer, bool needLock)
 {
+    if (!needLock || !m_presenter) {
+        return postImpl(p_colorbuffer, needLock, false);
+    }
+    // Reject invalid handles here, since the presenter thread can't report
+    // them to the caller. If the buffer is closed before it is displayed,
+    // the presenter just skips it.
+    {
+        ProfiledMutex::AutoLock mutex(m_lock);
+        if (!m_colorbuffers.get(p_colorbuffer)) {
+            return false;
+        }
+    }
+    // Replace any buffer the presenter thread didn't pick up yet.
+    emugl::Mutex::AutoLock lock(m_postLock);
+    m_postHandle = p_colorbuffer;
+    if (!m_postTimeNs) {
+        m_postTimeNs = GetCurrentTimeNS();
+    }
+    m_postPending = true;
+    m_postCond.signal();
+    return true;
+}
+
+//
+// Display |p_colorbuffer| and send it to m_onPost synchronously, see
+// preparePost_locked() for the meaning of |repaint|. If |p_colorbuffer| is
+// 0, only the skin layers are displayed, if any.
+// |m_presentLock| must be held when calling this function with |needLock|
+// set to false.
+//
+bool FrameBuffer::postImpl(HandleType p_colorbuffer,
+                           bool needLock,
+                           bool repaint)
+{
+    long long postTimeNs = GetCurrentTimeNS();
     if (needLock) {
+        m_presentLock.lock();
         m_lock.lock();
     }
-    bool ret = false;
+    bool ret;
+    {
+        ColorBufferPtr cb;
+        int damage[4] = { 0, 0, m_width, m_height };
+        if (p_colorbuffer) {
+            ret = preparePost_locked(p_colorbuffer, repaint, &cb, damage);
+        } else {
+            ret = m_skinCompositor.hasLayers();
+        }
+        bool display = ret && damage[2] && damage[3];
+        if (display && m_subWin) {
+            // bind the subwindow eglSurface
+            if (!bindSubwin_locked()) {
+                ERR("FrameBuffer::post(): eglMakeCurrent failed\n");
+                ret = false;
+            } else {
+                //
+                // render the color buffer to the window
+                //
+                ret = drawSubwin_locked(cb.Ptr(), damage);
 
-    ColorBufferMap::iterator c( m_colorbuffers.find(p_colorbuffer) );
-    if (c == m_colorbuffers.end()) {
-        goto EXIT;
+                // restore previous binding
+                unbind_locked();
+            }
+        }
+        if (display && p_colorbuffer && !repaint) {
+            FrameStats::get()->addFrame(postTimeNs, GetCurrentTimeNS());
+        }
+        // NOTE: |cb| must be released with the lock held, since it may
+        // destroy the ColorBuffer.
     }
+    if (needLock) {
+        m_lock.unlock();
+        m_presentLock.unlock();
+    }
+    return ret;
+}
 
-    m_lastPostedColorBuffer = p_colorbuffer;
-
-    if (m_subWin) {
-        // bind the subwindow eglSurface
-        if (!bindSubwin_locked()) {
-            ERR("FrameBuffer::post(): eglMakeCurrent failed\n");
-            goto EXIT;
-        }
+//
+// Prepare the display of |p_colorbuffer|: collect its damaged area into
+// |damage| (x, y, width, height), update the FPS statistics, and send
+// its content to m_onPost. If |repaint| is false and the buffer is the one
+// that was posted last, only its damaged area is reported, and the width
+// and height are 0 if it wasn't modified, meaning that nothing should be
+// displayed. On success, |*cb| is set to the buffer, which the caller must
+// draw to the sub-window, if any. Returns false if the handle is invalid.
+// The framebuffer lock should be held when calling this function !
+//
+bool FrameBuffer::preparePost_locked(HandleType p_colorbuffer,
+                                     bool repaint,
+                                     ColorBufferPtr* cb,
+                                     int* damage)
+{
+    ColorBufferRef* c = m_colorbuffers.get(p_colorbuffer);
+    if (!c) {
+        return false;
+    }
+    *cb = c->cb;
 
-        //
-        // render the color buffer to the window
-        //
-        if (m_zRot != 0.0f) {
-            s_gles2.glClear(GL_COLOR_BUFFER_BIT);
+    // Always collect the damage, so it doesn't accumulate across buffers
+    // that were not posted in a while.
+    int dx, dy, dw, dh;
+    c->cb->takeDamage(&dx, &dy, &dw, &dh);
+    if (repaint || p_colorbuffer != m_lastPostedColorBuffer) {
+        dx = 0;
+        dy = 0;
+        dw = m_width;
+        dh = m_height;
+    }
+    m_lastPostedColorBuffer = p_colorbuffer;
+    damage[0] = dx;
+    damage[1] = dy;
+    damage[2] = dw;
+    damage[3] = dh;
+
+    if (!dw || !dh) {
+        // Nothing changed since the last post, but flush any frame that is
+        // still pending in the asynchronous readback path.
+        if (m_onPost) {
+            postReadback_locked(NULL, 0, 0, 0, 0);
         }
-        ret = (*c).second.cb->post(m_zRot);
-        if (ret) {
-            s_egl.eglSwapBuffers(m_eglDisplay, m_eglSurface);
+        if (m_videoRecorder) {
+            ScopedBind bind(this);
+            if (bind.isValid()) {
+                m_videoRecorder->addFrame(0);
+            }
         }
-
-        // restore previous binding
-        unbind_locked();
-    } else {
-        // If there is no sub-window, don't display anything, the client will
-        // rely on m_onPost to get the pixels instead.
-        ret = true;
+        return true;
     }
 
     //
@@ -1018,30 +1487,410 @@ bool FrameBuffer::post(HandleType p_colorbuffer, bool needLock)
         }
     }
 
+    if (m_videoRecorder) {
+        c->cb->record(m_videoRecorder);
+    }
+
     //
     // Send framebuffer (without FPS overlay) to callback
     //
-    if (m_onPost) {
-        (*c).second.cb->readback(m_fbImage);
+    if (m_onPost && !postReadback_locked(c->cb.Ptr(), dx, dy, dw, dh)) {
+        c->cb->readback(m_fbImage);
         m_onPost(m_onPostContext,
                  m_width,
                  m_height,
                  -1,
                  GL_RGBA,
                  GL_UNSIGNED_BYTE,
-                 m_fbImage);
+                 m_fbImage,
+                 dx,
+                 dy,
+                 dw,
+                 dh);
     }
+    return true;
+}
 
-EXIT:
-    if (needLock) {
+//
+// Main loop of the presenter thread. Waits for the next request queued by
+// post(), repost() or setDisplayRotation(), and displays the corresponding
+// buffer. The swap happens without holding |m_lock|, so that render threads
+// only wait for it if they need to change the sub-window. If the swap
+// blocks on the host display refresh, requests that arrive in the meantime
+// are merged, and only the latest buffer is displayed.
+//
+void FrameBuffer::presentLoop()
+{
+    long long lastPresentNs = 0LL;
+    for (;;) {
+        m_postLock.lock();
+        while (!m_postPending && !m_postExit) {
+            m_postCond.wait(&m_postLock);
+        }
+        if (m_postExit) {
+            m_postLock.unlock();
+            break;
+        }
+        if (m_postIntervalNs && lastPresentNs) {
+            // Wait for the end of the interval without the lock, so that
+            // further posts replace this request.
+            long long waitNs = lastPresentNs + m_postIntervalNs -
+                               GetCurrentTimeNS();
+            if (waitNs > 0) {
+                m_postLock.unlock();
+                TimeSleepMS((int)((waitNs + 999999LL) / 1000000LL));
+                continue;
+            }
+        }
+        lastPresentNs = GetCurrentTimeNS();
+        HandleType handle = m_postHandle;
+        long long postTimeNs = m_postTimeNs;
+        bool repaint = m_postRepaint;
+        bool rotationChanged = m_postRotationChanged;
+        float rotation = m_postRotation;
+        m_postHandle = 0;
+        m_postTimeNs = 0LL;
+        m_postPending = false;
+        m_postRepaint = false;
+        m_postRotationChanged = false;
+        m_postLock.unlock();
+
+        // NOTE: The sub-window, |m_zRot| and the window dimensions can only
+        // change with |m_presentLock| held.
+        m_presentLock.lock();
+        if (rotationChanged) {
+            m_zRot = rotation;
+        }
+
+        ColorBufferPtr cb;
+        int damage[4] = { 0, 0, m_width, m_height };
+        m_lock.lock();
+        if (!handle) {
+            handle = m_lastPostedColorBuffer;
+        }
+        bool display;
+        if (handle) {
+            display = preparePost_locked(handle, repaint, &cb, damage) &&
+                      damage[2] && damage[3];
+        } else {
+            // The skin is displayed before the guest posts anything.
+            display = repaint && m_skinCompositor.hasLayers();
+        }
         m_lock.unlock();
+
+        if (display && m_subWin) {
+            // |m_eglContext| is only used here, and by setupSubWindow() with
+            // |m_presentLock| held, so it can be made current without
+            // |m_lock|, unlike |m_pbufContext|.
+            if (!s_egl.eglMakeCurrent(m_eglDisplay, m_eglSurface,
+                                      m_eglSurface, m_eglContext)) {
+                ERR("%s: eglMakeCurrent failed\n", __FUNCTION__);
+            } else {
+                drawSubwin_locked(cb.Ptr(), damage);
+                s_egl.eglMakeCurrent(m_eglDisplay, EGL_NO_SURFACE,
+                                     EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            }
+        }
+        if (display && postTimeNs) {
+            FrameStats::get()->addFrame(postTimeNs, GetCurrentTimeNS());
+        }
+
+        if (cb.Ptr()) {
+            // Releasing the last reference destroys the ColorBuffer, which
+            // requires the lock.
+            m_lock.lock();
+            cb = ColorBufferPtr();
+            m_lock.unlock();
+        }
+        m_presentLock.unlock();
+    }
+}
+
+void FrameBuffer::setFrameRateLimit(int fps)
+{
+    emugl::Mutex::AutoLock lock(m_postLock);
+    m_postIntervalNs = fps > 0 ? 1000000000LL / fps : 0LL;
+}
+
+//
+// Draw |cb|, which can be NULL, with the skin layers around it if there are
+// any, and swap the sub-window surface, see swapSubwin_locked() for the
+// meaning of |damage|. Returns false if the buffer could not be drawn.
+// |m_presentLock| should be held, and the sub-window surface bound, when
+// calling this function !
+//
+bool FrameBuffer::drawSubwin_locked(ColorBuffer* cb, const int* damage)
+{
+    bool ret = true;
+    m_subwinComposited = m_skinCompositor.hasLayers();
+    if (m_subwinComposited) {
+        ret = m_skinCompositor.draw(m_presentTextureDraw, cb, m_zRot,
+                                    m_windowWidth, m_windowHeight);
+    } else if (cb) {
+        if (m_zRot != 0.0f) {
+            s_gles2.glClear(GL_COLOR_BUFFER_BIT);
+        }
+        // NOTE: The content of the back buffer is undefined after a swap,
+        // so always redraw the whole texture.
+        ret = cb->post(m_presentTextureDraw, m_zRot);
+    } else {
+        s_gles2.glClear(GL_COLOR_BUFFER_BIT |
+                        GL_DEPTH_BUFFER_BIT |
+                        GL_STENCIL_BUFFER_BIT);
+    }
+    if (ret) {
+        swapSubwin_locked(damage[0], damage[1], damage[2], damage[3]);
     }
     return ret;
 }
 
+//
+// Swap the sub-window surface. |x|, |y|, |width| and |height| define the
+// damaged area of the posted color buffer, which is passed to the window
+// system when EGL_EXT_swap_buffers_with_damage is available.
+// |m_presentLock| should be held, and the sub-window surface bound, when
+// calling this function !
+//
+void FrameBuffer::swapSubwin_locked(int x, int y, int width, int height)
+{
+    // Damage rectangles are not rotated, fall back to a full swap when the
+    // display is, or when it doesn't fill the sub-window.
+    if (!m_caps.has_swap_buffers_with_damage || m_zRot != 0.0f ||
+        m_subwinComposited || !m_windowWidth || !m_windowHeight) {
+        s_egl.eglSwapBuffers(m_eglDisplay, m_eglSurface);
+        return;
+    }
+
+    // Scale the rectangle to window coordinates, with a one pixel margin to
+    // account for texture filtering. Both use a bottom-left origin.
+    EGLint rect[4];
+    int x0 = x * m_windowWidth / m_width - 1;
+    int y0 = y * m_windowHeight / m_height - 1;
+    int x1 = ((x + width) * m_windowWidth + m_width - 1) / m_width + 1;
+    int y1 = ((y + height) * m_windowHeight + m_height - 1) / m_height + 1;
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 > m_windowWidth) x1 = m_windowWidth;
+    if (y1 > m_windowHeight) y1 = m_windowHeight;
+    rect[0] = x0;
+    rect[1] = y0;
+    rect[2] = x1 - x0;
+    rect[3] = y1 - y0;
+    if (!s_egl.eglSwapBuffersWithDamageEXT(
+            m_eglDisplay, m_eglSurface, rect, 1)) {
+        s_egl.eglSwapBuffers(m_eglDisplay, m_eglSurface);
+    }
+}
+
+//
+// Read back the content of |cb| into the next pixel-pack buffer object,
+// without waiting for the GPU, then send the oldest frame read so far to
+// m_onPost. With two buffer objects, this means the callback receives frame
+// N-1 while frame N is still being transferred. |x|, |y|, |width| and
+// |height| are the damaged area of |cb|, passed along with its frame.
+// If |cb| is NULL, nothing new is read back, but the oldest pending frame,
+// if any, is still sent, so that the last frame doesn't remain stuck in a
+// buffer object when the display stops changing.
+// Returns false if buffer objects cannot be used, in which case the caller
+// should fall back to a synchronous ColorBuffer::readback().
+// The framebuffer lock should be held when calling this function !
+//
+bool FrameBuffer::postReadback_locked(ColorBuffer* cb,
+                                      int x, int y, int width, int height)
+{
+    if (!m_pboReadbackEnabled) {
+        return false;
+    }
+
+    GLsizeiptr size = 4 * m_width * m_height;
+
+    if (!m_readbackPbos[0]) {
+        ScopedBind bind(this);
+        if (!bind.isValid()) {
+            return false;
+        }
+        s_gles2.glGenBuffers(kNumReadbackPbos, m_readbackPbos);
+        for (int n = 0; n < kNumReadbackPbos; ++n) {
+            s_gles2.glBindBuffer(GL_PIXEL_PACK_BUFFER, m_readbackPbos[n]);
+            s_gles2.glBufferData(
+                    GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+        }
+        s_gles2.glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        if (s_gles2.glGetError() != GL_NO_ERROR) {
+            ERR("%s: Could not create pixel-pack buffers, using "
+                "synchronous readback\n", __FUNCTION__);
+            s_gles2.glDeleteBuffers(kNumReadbackPbos, m_readbackPbos);
+            memset(m_readbackPbos, 0, sizeof(m_readbackPbos));
+            m_pboReadbackEnabled = false;
+            return false;
+        }
+        m_readbackIndex = 0;
+        m_readbackCount = 0;
+    }
+
+    if (cb) {
+        // NOTE: ColorBuffer::readbackAsync() binds the FrameBuffer context
+        // itself, so don't hold a ScopedBind here.
+        if (!cb->readbackAsync(m_readbackPbos[m_readbackIndex])) {
+            ERR("%s: Asynchronous readback failed, using synchronous "
+                "readback\n", __FUNCTION__);
+            m_pboReadbackEnabled = false;
+            return false;
+        }
+        int* damage = m_readbackDamage[m_readbackIndex];
+        damage[0] = x;
+        damage[1] = y;
+        damage[2] = width;
+        damage[3] = height;
+
+        m_readbackIndex = (m_readbackIndex + 1) % kNumReadbackPbos;
+        if (++m_readbackCount < kNumReadbackPbos) {
+            // Not enough frames in flight yet.
+            return true;
+        }
+    } else if (!m_readbackCount) {
+        return true;
+    }
+
+    // Send the oldest frame in flight.
+    int oldest = (m_readbackIndex + kNumReadbackPbos - m_readbackCount) %
+            kNumReadbackPbos;
+    ScopedBind bind(this);
+    if (!bind.isValid()) {
+        return false;
+    }
+    s_gles2.glBindBuffer(GL_PIXEL_PACK_BUFFER, m_readbackPbos[oldest]);
+    void* pixels = s_gles2_extra.glMapBufferRange(
+            GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+    if (pixels) {
+        const int* damage = m_readbackDamage[oldest];
+        m_onPost(m_onPostContext,
+                 m_width,
+                 m_height,
+                 -1,
+                 GL_RGBA,
+                 GL_UNSIGNED_BYTE,
+                 (unsigned char*)pixels,
+                 damage[0],
+                 damage[1],
+                 damage[2],
+                 damage[3]);
+        s_gles2_extra.glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    s_gles2.glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    m_readbackCount--;
+
+    if (!pixels) {
+        ERR("%s: Could not map pixel-pack buffer, using synchronous "
+            "readback\n", __FUNCTION__);
+        m_pboReadbackEnabled = false;
+        return false;
+    }
+    return true;
+}
+
+bool FrameBuffer::startVideoRecording(const char* path, int fps)
+{
+    // NOTE: Opening a named pipe blocks until a reader opens it, so don't
+    // hold the lock yet.
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        ERR("%s: Could not open %s\n", __FUNCTION__, path);
+        return false;
+    }
+
+    ProfiledMutex::AutoLock mutex(m_lock);
+    if (m_videoRecorder) {
+        ERR("%s: Already recording\n", __FUNCTION__);
+        fclose(file);
+        return false;
+    }
+    ScopedBind bind(this);
+    if (!bind.isValid()) {
+        fclose(file);
+        return false;
+    }
+    m_videoRecorder = VideoRecorder::create(
+            file, m_width, m_height, fps, m_pboReadbackEnabled);
+    bind.release();
+    if (!m_videoRecorder) {
+        return false;
+    }
+
+    // Start with the current display content, since the next post may
+    // take a while.
+    ColorBufferRef* c = m_colorbuffers.get(m_lastPostedColorBuffer);
+    if (c) {
+        c->cb->record(m_videoRecorder);
+    }
+    return true;
+}
+
+bool FrameBuffer::stopVideoRecording(uint64_t* writtenFrames,
+                                     uint64_t* droppedFrames)
+{
+    VideoRecorder* recorder = NULL;
+    {
+        ProfiledMutex::AutoLock mutex(m_lock);
+        recorder = m_videoRecorder;
+        if (!recorder) {
+            return false;
+        }
+        m_videoRecorder = NULL;
+        ScopedBind bind(this);
+        recorder->stop();
+    }
+    // The final writes may block on the file, so don't hold the lock while
+    // waiting for them.
+    recorder->finish();
+    recorder->getStats(writtenFrames, droppedFrames);
+    delete recorder;
+    return true;
+}
+
 bool FrameBuffer::repost() {
-    if (m_lastPostedColorBuffer) {
-        return post(m_lastPostedColorBuffer);
+    if (!m_presenter) {
+        if (m_lastPostedColorBuffer || m_skinCompositor.hasLayers()) {
+            return postImpl(m_lastPostedColorBuffer, true, true);
+        }
+        return false;
     }
-    return false;
+    // Keep any pending buffer, which is displayed in full.
+    emugl::Mutex::AutoLock lock(m_postLock);
+    m_postRepaint = true;
+    m_postPending = true;
+    m_postCond.signal();
+    return true;
+}
+
+void FrameBuffer::setDisplayRotation(float zRot) {
+    if (!m_presenter) {
+        m_zRot = zRot;
+        repost();
+        return;
+    }
+    emugl::Mutex::AutoLock lock(m_postLock);
+    m_postRotation = zRot;
+    m_postRotationChanged = true;
+    m_postRepaint = true;
+    m_postPending = true;
+    m_postCond.signal();
+}
+
+void FrameBuffer::setSkinLayer(int id, const void* pixels,
+                               int width, int height, int x, int y,
+                               int dstWidth, int dstHeight) {
+    m_skinCompositor.setLayer(id, pixels, width, height,
+                              x, y, dstWidth, dstHeight);
+    repost();
+}
+
+void FrameBuffer::showSkinLayer(int id, bool visible) {
+    m_skinCompositor.showLayer(id, visible);
+    repost();
+}
+
+void FrameBuffer::setSkinDisplayRect(int x, int y, int width, int height) {
+    m_skinCompositor.setDisplayRect(x, y, width, height);
+    repost();
 }
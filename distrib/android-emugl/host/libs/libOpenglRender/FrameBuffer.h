@@ -17,16 +17,23 @@
 #define _LIBRENDER_FRAMEBUFFER_H
 
 #include "ColorBuffer.h"
+#include "emugl/common/condition_variable.h"
+#include "emugl/common/handle_table.h"
 #include "emugl/common/mutex.h"
 #include "FbConfig.h"
+#include "ProfiledMutex.h"
 #include "RenderContext.h"
 #include "render_api.h"
+#include "SkinCompositor.h"
 #include "TextureDraw.h"
+#include "VideoRecorder.h"
 #include "WindowSurface.h"
 
 #include <EGL/egl.h>
 
-#include <map>
+#include <list>
+#include <utility>
+#include <vector>
 
 #include <stdint.h>
 
@@ -38,9 +45,11 @@ struct ColorBufferRef {
     ColorBufferPtr cb;
     uint32_t refcount;  // number of client-side references
 };
-typedef std::map<HandleType, RenderContextPtr> RenderContextMap;
-typedef std::map<HandleType, std::pair<WindowSurfacePtr, HandleType> > WindowSurfaceMap;
-typedef std::map<HandleType, ColorBufferRef> ColorBufferMap;
+// The handle tables used to map handles to objects. These provide O(1)
+// lookups, and reject stale handles, see emugl/common/handle_table.h.
+typedef emugl::HandleTable<RenderContextPtr> RenderContextMap;
+typedef emugl::HandleTable<std::pair<WindowSurfacePtr, HandleType> > WindowSurfaceMap;
+typedef emugl::HandleTable<ColorBufferRef> ColorBufferMap;
 
 // A structure used to list the capabilities of the underlying EGL
 // implementation that the FrameBuffer instance depends on.
@@ -48,11 +57,14 @@ typedef std::map<HandleType, ColorBufferRef> ColorBufferMap;
 // extension is supported.
 // |has_eglimage_renderbuffer| is true iff the EGL_KHR_gl_renderbuffer_image
 // extension is supported.
+// |has_swap_buffers_with_damage| is true iff the
+// EGL_EXT_swap_buffers_with_damage extension is supported.
 // |eglMajor| and |eglMinor| are the major and minor version numbers of
 // the underlying EGL implementation.
 struct FrameBufferCaps {
     bool has_eglimage_texture_2d;
     bool has_eglimage_renderbuffer;
+    bool has_swap_buffers_with_damage;
     EGLint eglMajor;
     EGLint eglMinor;
 };
@@ -113,6 +125,15 @@ public:
     // Return the list of configs available from this display.
     const FbConfigList* getConfigs() const { return m_configs; }
 
+    // Return the contention on the lock that protects the FrameBuffer's
+    // objects since the last resetLockStats(), for emugl_replay.
+    ProfiledMutex::Stats getLockStats() { return m_lock.stats(); }
+    void resetLockStats() { m_lock.resetStats(); }
+
+    // Return the size of the host image that frames are read back into
+    // for the post callback, or 0 if it isn't allocated.
+    uint64_t getReadbackMemory();
+
     // Set a callback that will be called each time the emulated GPU content
     // is updated. This can be relatively slow with host-based GPU emulation,
     // so only do this when you need to.
@@ -150,6 +171,12 @@ public:
     // list of valid values. Note that ColorBuffer instances are reference-
     // counted. Use openColorBuffer / closeColorBuffer to operate on the
     // internal count.
+    //
+    // Released instances are kept in a pool, up to a total size set by the
+    // ANDROID_GL_COLORBUFFER_POOL_MB environment variable (64 MiB by
+    // default, 0 to disable it), so that a new buffer with the same size and
+    // format can reuse one instead of allocating new host textures. The
+    // least recently released buffers are destroyed first.
     HandleType createColorBuffer(
         int p_width, int p_height, GLenum p_internalFormat);
 
@@ -182,6 +209,13 @@ public:
     // the instance is destroyed automatically.
     void closeColorBuffer(HandleType p_colorbuffer);
 
+    // Return the statistics of the pool of released ColorBuffers: the
+    // number of createColorBuffer() calls that reused a pooled buffer or
+    // had to create one, and the current and maximum size of the pool,
+    // in bytes.
+    void getColorBufferPoolStats(uint64_t* hits, uint64_t* misses,
+                                 uint64_t* pooledBytes, uint64_t* maxBytes);
+
     // Equivalent for eglMakeCurrent() for the current display.
     // |p_context|, |p_drawSurface| and |p_readSurface| are the handle values
     // of the context, the draw surface and the read surface, respectively.
@@ -250,8 +284,32 @@ public:
     // |needLock| is used to indicate whether the operation requires
     // acquiring/releasing the FrameBuffer instance's lock. It should be
     // false only when called internally.
+    // If |p_colorbuffer| is the last posted buffer, only the area that was
+    // modified since then is reported to the sub-window swap and to the
+    // post callback. Nothing is displayed if nothing changed.
+    // When |needLock| is true, the buffer is only handed to the presenter
+    // thread, which displays the latest posted buffer once the previous
+    // swap completes. Buffers posted in the meantime are dropped, so the
+    // caller never waits for the swap.
+    // Return false if |p_colorbuffer| is not a valid ColorBuffer handle.
     bool post(HandleType p_colorbuffer, bool needLock = true);
 
+    // Secondary displays, numbered from 1, display 0 being the one above.
+    // They have no sub-window: a buffer posted to one is only read back
+    // and sent to the display's post callback, if it has one, so nothing
+    // is read back for displays nobody is viewing.
+    //
+    // addDisplay() adds a display of |width| x |height| pixels and returns
+    // its number, or 0 on failure. getDisplayCount() includes display 0.
+    // postDisplay(0, ...) is the same as post().
+    int addDisplay(int width, int height);
+    int getDisplayCount();
+    bool getDisplaySize(int display, int* width, int* height);
+    bool setDisplayPostCallback(int display,
+                                OnPostFn onPost,
+                                void* onPostContext);
+    bool postDisplay(int display, HandleType p_colorbuffer);
+
     // Re-post the last ColorBuffer that was displayed through post().
     // This is useful if you detect that the sub-window content needs to
     // be re-displayed for any reason.
@@ -260,11 +318,38 @@ public:
     // Return the host EGLDisplay used by this instance.
     EGLDisplay getDisplay() const { return m_eglDisplay; }
 
-    // Change the rotation of the displayed GPU sub-window.
-    void setDisplayRotation(float zRot) {
-        m_zRot = zRot;
-        repost();
-    }
+    // Change the rotation of the displayed GPU sub-window. Like repost(),
+    // this only queues a repaint for the presenter thread.
+    void setDisplayRotation(float zRot);
+
+    // Display at most |fps| frames per second in the sub-window, or as
+    // many as are posted if |fps| is 0. The presenter thread waits between
+    // frames, so that buffers posted in the meantime are dropped.
+    void setFrameRateLimit(int fps);
+
+    // Add, replace or remove (if |pixels| is NULL) the skin layer |id|,
+    // drawn around the GPU display in the sub-window, see
+    // SkinCompositor::setLayer(). As long as there is a layer, the
+    // sub-window is expected to cover the whole UI window, and the display
+    // is drawn in the rectangle given to setSkinDisplayRect(). Like
+    // repost(), these only queue a repaint.
+    void setSkinLayer(int id, const void* pixels, int width, int height,
+                      int x, int y, int dstWidth, int dstHeight);
+    void showSkinLayer(int id, bool visible);
+    void setSkinDisplayRect(int x, int y, int width, int height);
+
+    // Start recording the posted frames to |path| as a YUV4MPEG2 stream at
+    // |fps| frames per second, see VideoRecorder.h. If |path| is a named
+    // pipe, this blocks until a reader opens it. Returns false on failure,
+    // or if a recording is already in progress.
+    bool startVideoRecording(const char* path, int fps);
+
+    // Stop the recording started by startVideoRecording(), and wait until
+    // the last frames are written. On success, return true and set
+    // |*writtenFrames| and |*droppedFrames| to the number of frames that
+    // were written to the file and dropped. Return false if no recording
+    // was in progress.
+    bool stopVideoRecording(uint64_t* writtenFrames, uint64_t* droppedFrames);
 
     // Return a TextureDraw instance that can be used with this surfaces
     // and windows created by this instance.
@@ -277,28 +362,49 @@ public:
 private:
     FrameBuffer(int p_width, int p_height, bool useSubWindow);
     ~FrameBuffer();
-    HandleType genHandle();
+
+    class Presenter;
 
     bool bindSubwin_locked();
+    bool makeCurrent_locked(EGLSurface surface, EGLContext context);
+    bool postImpl(HandleType p_colorbuffer, bool needLock, bool repaint);
+    bool preparePost_locked(HandleType p_colorbuffer, bool repaint,
+                            ColorBufferPtr* cb, int* damage);
+    void presentLoop();
+    bool drawSubwin_locked(ColorBuffer* cb, const int* damage);
+    void swapSubwin_locked(int x, int y, int width, int height);
+    bool postReadback_locked(ColorBuffer* cb,
+                             int x, int y, int width, int height);
+    void releaseColorBuffer_locked(HandleType p_colorbuffer);
 
 private:
     static FrameBuffer *s_theFrameBuffer;
-    static HandleType s_nextHandle;
     int m_x;
     int m_y;
     int m_width;
     int m_height;
     bool m_useSubWindow;
-    emugl::Mutex m_lock;
+    ProfiledMutex m_lock;
     FbConfigList* m_configs;
     FBNativeWindowType m_nativeWindow;
     FrameBufferCaps m_caps;
     EGLDisplay m_eglDisplay;
+    // All handles are allocated from the same space, so that a handle of
+    // one type of object is never mistaken for a handle of another type.
+    emugl::HandleSpace m_handleSpace;
     RenderContextMap m_contexts;
     WindowSurfaceMap m_windows;
     ColorBufferMap m_colorbuffers;
     ColorBuffer::Helper* m_colorBufferHelper;
 
+    // The pool of released ColorBuffers, most recently released first,
+    // see createColorBuffer().
+    std::list<ColorBufferPtr> m_colorBufferPool;
+    uint64_t m_colorBufferPoolBytes;
+    uint64_t m_colorBufferPoolMaxBytes;
+    uint64_t m_colorBufferPoolHits;
+    uint64_t m_colorBufferPoolMisses;
+
     EGLSurface m_eglSurface;
     EGLContext m_eglContext;
     EGLSurface m_pbufSurface;
@@ -307,10 +413,14 @@ private:
     EGLContext m_prevContext;
     EGLSurface m_prevReadSurf;
     EGLSurface m_prevDrawSurf;
+    int        m_nestedBinds;
     EGLNativeWindowType m_subWin;
     TextureDraw* m_textureDraw;
+    TextureDraw* m_presentTextureDraw;  // only used by drawSubwin_locked().
     EGLConfig  m_eglConfig;
     HandleType m_lastPostedColorBuffer;
+    int        m_windowWidth;
+    int        m_windowHeight;
     float      m_zRot;
     bool       m_eglContextInitialized;
 
@@ -322,6 +432,62 @@ private:
     void* m_onPostContext;
     unsigned char* m_fbImage;
 
+    // Pixel-pack buffer objects used to read back posted frames
+    // asynchronously for m_onPost, see postReadback_locked().
+    static const int kNumReadbackPbos = 2;
+    GLuint m_readbackPbos[kNumReadbackPbos];
+    // Damage rectangle (x, y, width, height) of the frame held by each
+    // buffer object.
+    int m_readbackDamage[kNumReadbackPbos][4];
+    int m_readbackIndex;
+    int m_readbackCount;
+    bool m_pboReadbackEnabled;
+
+    // The skin layers drawn around the display, and whether the last
+    // sub-window frame was drawn with them, which requires a full swap.
+    SkinCompositor m_skinCompositor;
+    bool m_subwinComposited;
+
+    // Records posted frames, if not NULL.
+    VideoRecorder* m_videoRecorder;
+
+    // The secondary displays, display N being at index N - 1.
+    struct SecondaryDisplay {
+        SecondaryDisplay() :
+                width(0), height(0), colorBuffer(0),
+                onPost(NULL), onPostContext(NULL), image() {}
+        int width;
+        int height;
+        HandleType colorBuffer;  // last posted buffer, or 0.
+        OnPostFn onPost;
+        void* onPostContext;
+        std::vector<unsigned char> image;  // only allocated with onPost.
+    };
+    std::vector<SecondaryDisplay> m_secondaryDisplays;
+
+    // The presenter thread, and the mailbox used to hand it the latest
+    // post() / repost() / setDisplayRotation() request, protected by
+    // |m_postLock|. A |m_postHandle| of 0 means the last posted buffer.
+    // |m_postTimeNs| is the time of the oldest guest post that wasn't
+    // presented yet, or 0, for the FrameStats. |m_postIntervalNs| is the
+    // minimum time between two displayed frames, see setFrameRateLimit().
+    Presenter* m_presenter;
+    emugl::Mutex m_postLock;
+    emugl::ConditionVariable m_postCond;
+    HandleType m_postHandle;
+    long long m_postTimeNs;
+    float m_postRotation;
+    bool m_postPending;
+    bool m_postRepaint;
+    bool m_postRotationChanged;
+    bool m_postExit;
+    long long m_postIntervalNs;
+
+    // Serializes all uses of the sub-window surface and |m_eglContext|,
+    // which only the presenter thread uses outside of setupSubWindow() and
+    // removeSubWindow(). Must be acquired before |m_lock|.
+    emugl::Mutex m_presentLock;
+
     const char* m_glVendor;
     const char* m_glRenderer;
     const char* m_glVersion;
@@ -0,0 +1,100 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#include "FrameStats.h"
+
+#include <algorithm>
+#include <string>
+
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+emugl::LazyInstance<FrameStats> sInstance = LAZY_INSTANCE_INIT;
+
+void appendHistogram(std::string* out,
+                     const char* name,
+                     const emugl::LatencyHistogram& h) {
+    char line[256];
+    snprintf(line, sizeof(line),
+             "%-24s %8llu %8.2f %8.2f %8.2f %8.2f %8.2f\n",
+             name,
+             (unsigned long long)h.count(),
+             h.average() / 1e3,
+             h.percentile(50.) / 1e3,
+             h.percentile(90.) / 1e3,
+             h.percentile(99.) / 1e3,
+             h.max() / 1e3);
+    out->append(line);
+}
+
+}  // namespace
+
+// static
+FrameStats* FrameStats::get() {
+    return sInstance.ptr();
+}
+
+FrameStats::FrameStats() :
+        m_lock(),
+        m_enabled(false),
+        m_lastPresentNs(0LL),
+        m_interval(),
+        m_latency() {}
+
+void FrameStats::setEnabled(bool enabled) {
+    emugl::Mutex::AutoLock lock(m_lock);
+    if (enabled) {
+        m_interval.clear();
+        m_latency.clear();
+        m_lastPresentNs = 0LL;
+    }
+    m_enabled = enabled;
+}
+
+void FrameStats::addFrame(long long postTimeNs, long long presentTimeNs) {
+    emugl::Mutex::AutoLock lock(m_lock);
+    if (!m_enabled) {
+        return;
+    }
+    if (m_lastPresentNs) {
+        m_interval.add((presentTimeNs - m_lastPresentNs) / 1000);
+    }
+    m_lastPresentNs = presentTimeNs;
+    if (postTimeNs && presentTimeNs >= postTimeNs) {
+        m_latency.add((presentTimeNs - postTimeNs) / 1000);
+    }
+}
+
+size_t FrameStats::print(char* buffer, size_t bufferSize) {
+    std::string out;
+    char line[256];
+    snprintf(line, sizeof(line), "%-24s %8s %8s %8s %8s %8s %8s\n",
+             "renderer (ms)", "count", "avg", "p50", "p90", "p99", "max");
+    out.append(line);
+    {
+        emugl::Mutex::AutoLock lock(m_lock);
+        appendHistogram(&out, "frame interval", m_interval);
+        appendHistogram(&out, "guest post to present", m_latency);
+    }
+
+    if (bufferSize > 0) {
+        size_t count = std::min(out.size(), bufferSize - 1);
+        memcpy(buffer, out.c_str(), count);
+        buffer[count] = '\0';
+    }
+    return out.size();
+}
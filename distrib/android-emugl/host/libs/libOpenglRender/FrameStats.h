@@ -0,0 +1,65 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#ifndef _LIB_OPENGL_RENDER_FRAME_STATS_H
+#define _LIB_OPENGL_RENDER_FRAME_STATS_H
+
+#include "emugl/common/latency_histogram.h"
+#include "emugl/common/lazy_instance.h"
+#include "emugl/common/mutex.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The distribution of the frame times of the guest display, and of the
+// delay between the guest posting a frame and the renderer presenting it,
+// see enableOpenGLFrameStats().
+//
+// Collection is disabled by default. The FrameBuffer adds the timings of
+// each displayed frame, from the presenter thread or the render thread
+// that posted it.
+class FrameStats {
+public:
+    // Return the global instance.
+    static FrameStats* get();
+
+    // Start or stop collecting statistics. Starting resets them.
+    void setEnabled(bool enabled);
+
+    // Record a frame with content that was posted by the guest at
+    // |postTimeNs| and presented at |presentTimeNs|, both from
+    // GetCurrentTimeNS().
+    void addFrame(long long postTimeNs, long long presentTimeNs);
+
+    // Print the statistics into |buffer| as a zero-terminated table, with
+    // times in milliseconds. Return the length of the whole table, which is
+    // truncated if it's larger than |bufferSize| - 1.
+    size_t print(char* buffer, size_t bufferSize);
+
+private:
+    friend struct emugl::LazyInstance<FrameStats>;
+
+    FrameStats();
+
+    emugl::Mutex m_lock;
+    bool m_enabled;
+    long long m_lastPresentNs;
+    // Time between two presented frames, in microseconds.
+    emugl::LatencyHistogram m_interval;
+    // Time from the guest post to the present, in microseconds.
+    emugl::LatencyHistogram m_latency;
+};
+
+#endif
@@ -21,6 +21,7 @@
 #include "emugl/common/shared_library.h"
 
 gles2_decoder_context_t s_gles2;
+GLESv2ExtraDispatch s_gles2_extra;
 
 static emugl::SharedLibrary *s_gles2_lib = NULL;
 
@@ -50,6 +51,14 @@ bool init_gles2_dispatch()
     // init the GLES dispatch table
     //
     s_gles2.initDispatchByName(gles2_dispatch_get_proc_func, NULL);
+
+    //
+    // init the optional GLES 3.x entry points, these can be NULL.
+    //
+    s_gles2_extra.glMapBufferRange = (glMapBufferRange_t)
+            gles2_dispatch_get_proc_func("glMapBufferRange", NULL);
+    s_gles2_extra.glUnmapBuffer = (glUnmapBuffer_t)
+            gles2_dispatch_get_proc_func("glUnmapBuffer", NULL);
     return true;
 }
 
@@ -23,4 +23,30 @@ void *gles2_dispatch_get_proc_func(const char *name, void *userData);
 
 extern gles2_decoder_context_t s_gles2;
 
+// A few GLES 3.x entry points that are not part of the GLESv2 decoder
+// dispatch table, but that libOpenglRender can use internally when the
+// underlying GLES library provides them (e.g. for asynchronous pixel
+// readback through pixel-pack buffer objects). Each member is NULL if the
+// corresponding symbol could not be found, callers must check this.
+#ifndef GL_PIXEL_PACK_BUFFER
+#define GL_PIXEL_PACK_BUFFER 0x88EB
+#endif
+#ifndef GL_STREAM_READ
+#define GL_STREAM_READ 0x88E1
+#endif
+#ifndef GL_MAP_READ_BIT
+#define GL_MAP_READ_BIT 0x0001
+#endif
+
+typedef void* (gles2_APIENTRY *glMapBufferRange_t)(
+        GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access);
+typedef GLboolean (gles2_APIENTRY *glUnmapBuffer_t)(GLenum target);
+
+struct GLESv2ExtraDispatch {
+    glMapBufferRange_t glMapBufferRange;
+    glUnmapBuffer_t glUnmapBuffer;
+};
+
+extern GLESv2ExtraDispatch s_gles2_extra;
+
 #endif  // _GLES_V2_DISPATCH_H
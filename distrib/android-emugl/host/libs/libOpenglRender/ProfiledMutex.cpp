@@ -0,0 +1,46 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#include "ProfiledMutex.h"
+
+#include "TimeUtils.h"
+
+void ProfiledMutex::lock() {
+    if (m_lock.tryLock()) {
+        m_stats.acquisitions++;
+        return;
+    }
+    long long t0 = GetCurrentTimeNS();
+    m_lock.lock();
+    m_stats.acquisitions++;
+    m_stats.contentions++;
+    m_stats.waitNs += (uint64_t)(GetCurrentTimeNS() - t0);
+}
+
+ProfiledMutex::Stats ProfiledMutex::stats() {
+    AutoLock lock(*this);
+    Stats result = m_stats;
+    // Don't count the acquisition made to read them.
+    result.acquisitions--;
+    return result;
+}
+
+void ProfiledMutex::resetStats() {
+    m_lock.lock();
+    m_stats.acquisitions = 0;
+    m_stats.contentions = 0;
+    m_stats.waitNs = 0;
+    m_lock.unlock();
+}
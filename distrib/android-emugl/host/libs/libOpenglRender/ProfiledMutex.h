@@ -0,0 +1,63 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#ifndef _LIB_OPENGL_RENDER_PROFILED_MUTEX_H
+#define _LIB_OPENGL_RENDER_PROFILED_MUTEX_H
+
+#include "emugl/common/mutex.h"
+
+#include <stdint.h>
+
+// A mutex that counts how often it is acquired, and how often and how long
+// threads waited for it, to measure the contention on the FrameBuffer lock.
+//
+// Uncontended acquisitions only cost a successful tryLock() and a counter
+// increment, the clock is only read when a thread has to wait. All counters
+// are updated by the thread that holds the mutex.
+class ProfiledMutex {
+public:
+    struct Stats {
+        uint64_t acquisitions;
+        uint64_t contentions;
+        uint64_t waitNs;
+    };
+
+    // |name| is the name of the underlying emugl::Mutex, see its
+    // constructor.
+    explicit ProfiledMutex(const char* name) : m_lock(name) { resetStats(); }
+
+    void lock();
+
+    void unlock() { m_lock.unlock(); }
+
+    // Return the statistics since the last resetStats().
+    Stats stats();
+
+    void resetStats();
+
+    class AutoLock {
+    public:
+        AutoLock(ProfiledMutex& mutex) : m_mutex(&mutex) { m_mutex->lock(); }
+        ~AutoLock() { m_mutex->unlock(); }
+    private:
+        ProfiledMutex* m_mutex;
+    };
+
+private:
+    emugl::Mutex m_lock;
+    Stats m_stats;
+};
+
+#endif
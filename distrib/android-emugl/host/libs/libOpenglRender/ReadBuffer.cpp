@@ -22,10 +22,13 @@
 ReadBuffer::ReadBuffer(IOStream *stream, size_t bufsize)
 {
     m_size = bufsize;
+    m_initialSize = bufsize;
     m_stream = stream;
     m_buf = (unsigned char*)malloc(m_size*sizeof(unsigned char));
     m_validData = 0;
     m_readPtr = m_buf;
+    m_totalBytesRead = 0;
+    m_totalBytesMoved = 0;
 }
 
 ReadBuffer::~ReadBuffer()
@@ -35,13 +38,35 @@ ReadBuffer::~ReadBuffer()
 
 int ReadBuffer::getData()
 {
-    if ((m_validData > 0) && (m_readPtr > m_buf)) {
+    if (m_validData == 0) {
+        // Everything was consumed, rewind for free.
+        m_readPtr = m_buf;
+        if (m_size > m_initialSize) {
+            // A previous large packet forced the buffer to grow, release
+            // the extra memory now that it is no longer needed.
+            unsigned char* new_buf =
+                    (unsigned char*)realloc(m_buf, m_initialSize);
+            if (new_buf) {
+                m_buf = new_buf;
+                m_readPtr = m_buf;
+                m_size = m_initialSize;
+            }
+        }
+    }
+
+    // Only compact the unconsumed data when the room left after it is
+    // less than a quarter of the buffer. This bounds the amount of data
+    // moved per received byte.
+    size_t len = (m_buf + m_size) - (m_readPtr + m_validData);
+    if (len < m_size / 4 && m_readPtr > m_buf) {
         memmove(m_buf, m_readPtr, m_validData);
+        m_totalBytesMoved += m_validData;
+        m_readPtr = m_buf;
+        len = m_size - m_validData;
     }
-    // get fresh data into the buffer;
-    size_t len = m_size - m_validData;
+
     if (len==0) {
-        //we need to inc our buffer
+        // A single pending packet doesn't fit in the buffer, so grow it.
         size_t new_size = m_size*2;
         unsigned char* new_buf;
         if (new_size < m_size) { // overflow check
@@ -55,11 +80,12 @@ int ReadBuffer::getData()
         }
         m_size = new_size;
         m_buf  = new_buf;
+        m_readPtr = m_buf;
         len    = m_size - m_validData;
     }
-    m_readPtr = m_buf;
-    if (NULL != m_stream->read(m_buf + m_validData, &len)) {
+    if (NULL != m_stream->read(m_readPtr + m_validData, &len)) {
         m_validData += len;
+        m_totalBytesRead += len;
         return len;
     }
     return -1;
@@ -18,6 +18,19 @@
 
 #include "IOStream.h"
 
+#include <stdint.h>
+
+// A ReadBuffer is used by a RenderThread to receive command bytes from its
+// IOStream. The decoders need each command packet to be contiguous in
+// memory, so data is always appended after the unconsumed bytes.
+//
+// To avoid copying data around:
+//   - The read position is simply rewound when all data has been consumed.
+//   - Unconsumed bytes are moved to the front of the buffer only when there
+//     is not enough room left after them for a reasonably-sized read.
+//   - The buffer only grows when a single pending packet doesn't fit in it,
+//     and is shrunk back to its initial size once that packet has been
+//     consumed.
 class ReadBuffer {
 public:
     ReadBuffer(IOStream *stream, size_t bufSize);
@@ -26,11 +39,23 @@ public:
     unsigned char *buf() { return m_readPtr; } // return the next read location
     size_t validData() { return m_validData; } // return the amount of valid data in readptr
     void consume(size_t amount); // notify that 'amount' data has been consumed;
+
+    // Total number of bytes received from the stream so far.
+    uint64_t totalBytesRead() const { return m_totalBytesRead; }
+
+    // Total number of bytes moved inside the buffer to make room for
+    // new data so far. Ideally, this should remain small compared to
+    // totalBytesRead().
+    uint64_t totalBytesMoved() const { return m_totalBytesMoved; }
+
 private:
     unsigned char *m_buf;
     unsigned char *m_readPtr;
     size_t m_size;
+    size_t m_initialSize;
     size_t m_validData;
     IOStream *m_stream;
+    uint64_t m_totalBytesRead;
+    uint64_t m_totalBytesMoved;
 };
 #endif
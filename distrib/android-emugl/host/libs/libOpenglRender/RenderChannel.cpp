@@ -0,0 +1,334 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "RenderChannel.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+RenderChannel::RenderChannel(size_t ringSize, Callback callback, void* opaque) :
+        m_lock("RenderChannel::m_lock"),
+        m_canHostRead(),
+        m_canHostWrite(),
+        m_toHost(),
+        m_toGuest(),
+        m_callback(callback),
+        m_opaque(opaque),
+        m_wakeWanted(0),
+        m_guestClosed(false),
+        m_hostClosed(false),
+        m_hostStopped(false),
+        m_refCount(2) {
+    size_t size = 4096;
+    while (size < ringSize) {
+        size <<= 1;
+    }
+    m_toHost.data = static_cast<unsigned char*>(malloc(size));
+    m_toHost.mask = size - 1;
+    m_toGuest.data = static_cast<unsigned char*>(malloc(size));
+    m_toGuest.mask = size - 1;
+}
+
+RenderChannel::~RenderChannel() {
+    free(m_toHost.data);
+    free(m_toGuest.data);
+}
+
+// static
+void RenderChannel::copyToRing(Ring* ring, size_t pos, const void* buf,
+                               size_t size) {
+    size_t offset = pos & ring->mask;
+    size_t chunk = ring->mask + 1 - offset;
+    if (chunk > size) {
+        chunk = size;
+    }
+    memcpy(ring->data + offset, buf, chunk);
+    memcpy(ring->data, static_cast<const unsigned char*>(buf) + chunk,
+           size - chunk);
+}
+
+// static
+void RenderChannel::copyFromRing(const Ring* ring, size_t pos, void* buf,
+                                 size_t size) {
+    size_t offset = pos & ring->mask;
+    size_t chunk = ring->mask + 1 - offset;
+    if (chunk > size) {
+        chunk = size;
+    }
+    memcpy(buf, ring->data + offset, chunk);
+    memcpy(static_cast<unsigned char*>(buf) + chunk, ring->data,
+           size - chunk);
+}
+
+unsigned RenderChannel::pollLocked() const {
+    unsigned events = 0;
+    if (m_toGuest.used() > 0) {
+        events |= kCanRead;
+    }
+    if (m_hostClosed || m_hostStopped) {
+        events |= kClosed;
+    } else if (m_toHost.avail() > 0) {
+        events |= kCanWrite;
+    }
+    return events;
+}
+
+void RenderChannel::checkWakeLocked() {
+    if (!m_wakeWanted || m_guestClosed) {
+        return;
+    }
+    unsigned events = pollLocked() & (m_wakeWanted | kClosed);
+    if (events) {
+        m_wakeWanted = 0;
+        if (m_callback) {
+            m_callback(m_opaque, events);
+        }
+    }
+}
+
+void RenderChannel::unref() {
+    // NOTE: Called with |m_lock| held.
+    if (--m_refCount == 0) {
+        m_lock.unlock();
+        delete this;
+        return;
+    }
+    m_lock.unlock();
+}
+
+int RenderChannel::guestWriteBuffers(const Buffer* buffers, int numBuffers) {
+    m_lock.lock();
+    if (m_hostClosed || m_hostStopped) {
+        m_lock.unlock();
+        return -1;
+    }
+    size_t avail = m_toHost.avail();
+    size_t pos = m_toHost.writePos;
+    m_lock.unlock();
+
+    // Copy each buffer directly into the ring, without flattening them.
+    size_t total = 0;
+    for (int n = 0; n < numBuffers && total < avail; ++n) {
+        size_t size = buffers[n].size;
+        if (size > avail - total) {
+            size = avail - total;
+        }
+        copyToRing(&m_toHost, pos + total, buffers[n].data, size);
+        total += size;
+    }
+    if (!total) {
+        return 0;
+    }
+
+    emugl::Mutex::AutoLock lock(m_lock);
+    m_toHost.writePos += total;
+    m_canHostRead.signal();
+    return static_cast<int>(total);
+}
+
+int RenderChannel::guestReadBuffers(const Buffer* buffers, int numBuffers) {
+    m_lock.lock();
+    size_t used = m_toGuest.used();
+    if (!used && (m_hostClosed || m_hostStopped)) {
+        m_lock.unlock();
+        return -1;
+    }
+    size_t pos = m_toGuest.readPos;
+    m_lock.unlock();
+
+    size_t total = 0;
+    for (int n = 0; n < numBuffers && total < used; ++n) {
+        size_t size = buffers[n].size;
+        if (size > used - total) {
+            size = used - total;
+        }
+        copyFromRing(&m_toGuest, pos + total, buffers[n].data, size);
+        total += size;
+    }
+    if (!total) {
+        return 0;
+    }
+
+    emugl::Mutex::AutoLock lock(m_lock);
+    m_toGuest.readPos += total;
+    m_canHostWrite.signal();
+    return static_cast<int>(total);
+}
+
+int RenderChannel::guestWrite(const void* data, size_t size) {
+    Buffer buffer;
+    buffer.data = const_cast<void*>(data);
+    buffer.size = size;
+    return guestWriteBuffers(&buffer, 1);
+}
+
+int RenderChannel::guestRead(void* data, size_t size) {
+    Buffer buffer;
+    buffer.data = data;
+    buffer.size = size;
+    return guestReadBuffers(&buffer, 1);
+}
+
+unsigned RenderChannel::guestPoll() {
+    emugl::Mutex::AutoLock lock(m_lock);
+    return pollLocked();
+}
+
+void RenderChannel::guestWakeOn(unsigned events) {
+    emugl::Mutex::AutoLock lock(m_lock);
+    m_wakeWanted |= events;
+    checkWakeLocked();
+}
+
+void RenderChannel::guestClose() {
+    m_lock.lock();
+    m_guestClosed = true;
+    m_callback = NULL;
+    m_opaque = NULL;
+    // Wake up the RenderThread if it is blocked.
+    m_canHostRead.signal();
+    m_canHostWrite.signal();
+    unref();
+}
+
+bool RenderChannel::hostWrite(const void* data, size_t size) {
+    const unsigned char* src = static_cast<const unsigned char*>(data);
+    while (size > 0) {
+        m_lock.lock();
+        size_t avail;
+        while ((avail = m_toGuest.avail()) == 0 &&
+               !m_guestClosed && !m_hostStopped) {
+            m_canHostWrite.wait(&m_lock);
+        }
+        if (m_guestClosed || m_hostStopped) {
+            m_lock.unlock();
+            return false;
+        }
+        size_t pos = m_toGuest.writePos;
+        m_lock.unlock();
+
+        size_t chunk = (size < avail) ? size : avail;
+        copyToRing(&m_toGuest, pos, src, chunk);
+        src += chunk;
+        size -= chunk;
+
+        emugl::Mutex::AutoLock lock(m_lock);
+        m_toGuest.writePos += chunk;
+        checkWakeLocked();
+    }
+    return true;
+}
+
+bool RenderChannel::hostRead(void* data, size_t* inout_len) {
+    m_lock.lock();
+    size_t used;
+    while ((used = m_toHost.used()) == 0 &&
+           !m_guestClosed && !m_hostStopped) {
+        m_canHostRead.wait(&m_lock);
+    }
+    if (!used || m_hostStopped) {
+        m_lock.unlock();
+        return false;
+    }
+    size_t pos = m_toHost.readPos;
+    m_lock.unlock();
+
+    size_t size = *inout_len;
+    if (size > used) {
+        size = used;
+    }
+    copyFromRing(&m_toHost, pos, data, size);
+
+    emugl::Mutex::AutoLock lock(m_lock);
+    m_toHost.readPos += size;
+    checkWakeLocked();
+    *inout_len = size;
+    return true;
+}
+
+void RenderChannel::hostStop() {
+    emugl::Mutex::AutoLock lock(m_lock);
+    m_hostStopped = true;
+    m_canHostRead.signal();
+    m_canHostWrite.signal();
+    checkWakeLocked();
+}
+
+void RenderChannel::hostClose() {
+    m_lock.lock();
+    m_hostClosed = true;
+    checkWakeLocked();
+    unref();
+}
+
+ChannelStream::ChannelStream(RenderChannel* channel, size_t bufSize) :
+        IOStream(bufSize),
+        m_channel(channel),
+        m_buf(NULL),
+        m_bufSize(bufSize) {}
+
+ChannelStream::~ChannelStream() {
+    m_channel->hostClose();
+    free(m_buf);
+}
+
+void* ChannelStream::allocBuffer(size_t minSize) {
+    if (!m_buf || m_bufSize < minSize) {
+        size_t allocSize = (m_bufSize < minSize ? minSize : m_bufSize);
+        unsigned char* p = static_cast<unsigned char*>(
+                realloc(m_buf, allocSize));
+        if (!p) {
+            ERR("%s: realloc (%zu) failed\n", __FUNCTION__, allocSize);
+            return NULL;
+        }
+        m_buf = p;
+        m_bufSize = allocSize;
+    }
+    return m_buf;
+}
+
+int ChannelStream::commitBuffer(size_t size) {
+    return writeFully(m_buf, size);
+}
+
+int ChannelStream::writeFully(const void* buf, size_t len) {
+    return m_channel->hostWrite(buf, len) ? 0 : -1;
+}
+
+const unsigned char* ChannelStream::readFully(void* buf, size_t len) {
+    if (!buf) {
+        return NULL;
+    }
+    unsigned char* dst = static_cast<unsigned char*>(buf);
+    while (len > 0) {
+        size_t chunk = len;
+        if (!m_channel->hostRead(dst, &chunk)) {
+            return NULL;
+        }
+        dst += chunk;
+        len -= chunk;
+    }
+    return static_cast<const unsigned char*>(buf);
+}
+
+const unsigned char* ChannelStream::read(void* buf, size_t* inout_len) {
+    if (!buf || !m_channel->hostRead(buf, inout_len)) {
+        return NULL;
+    }
+    return static_cast<const unsigned char*>(buf);
+}
+
+void ChannelStream::forceStop() {
+    m_channel->hostStop();
+}
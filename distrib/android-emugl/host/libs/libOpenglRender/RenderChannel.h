@@ -0,0 +1,187 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RENDER_CHANNEL_H
+#define RENDER_CHANNEL_H
+
+#include "IOStream.h"
+
+#include "emugl/common/condition_variable.h"
+#include "emugl/common/mutex.h"
+
+#include <stddef.h>
+
+// A RenderChannel is a bi-directional byte pipe between a client running
+// in the same process as the renderer (e.g. the emulator's 'opengles' pipe
+// service), and a RenderThread. It is backed by two ring buffers in memory
+// shared by both threads, which avoids going through the kernel's socket
+// layer, and the corresponding copies, for each command buffer.
+//
+// The client side (the 'guest' methods below) is non-blocking, and can
+// register a callback to be notified when the channel's state changes,
+// similar to the PIPE_WAKE_XXX semantics of goldfish pipes. The renderer
+// side is blocking, and is accessed through a ChannelStream instance, which
+// implements the IOStream interface expected by RenderThread.
+//
+// Each side must call its close method exactly once. The instance is
+// deleted when both sides are closed.
+class RenderChannel {
+public:
+    // Event flags returned by guestPoll() and passed to the callback.
+    enum {
+        kCanRead = 1 << 0,
+        kCanWrite = 1 << 1,
+        kClosed = 1 << 2,
+    };
+
+    // Type of callback invoked when an event requested by guestWakeOn()
+    // happens. NOTE: This is called from the RenderThread, or from the
+    // caller of guestWakeOn(), with the channel's lock held, so it must
+    // not call any of the guest methods. It is never called once
+    // guestClose() returns.
+    typedef void (*Callback)(void* opaque, unsigned events);
+
+    // Buffer descriptor used for scatter/gather transfers. Same layout as
+    // GoldfishPipeBuffer, so that the emulator's pipe service can pass its
+    // arrays directly.
+    struct Buffer {
+        void* data;
+        size_t size;
+    };
+
+    // Create a new instance. |ringSize| is the size in bytes of each one of
+    // the two rings, and will be rounded up to a power of 2.
+    RenderChannel(size_t ringSize, Callback callback, void* opaque);
+
+    // Client-side methods, all of them are non-blocking.
+
+    // Write the content of the |numBuffers| buffers in |buffers| into the
+    // channel, in order, until it is full. Returns the number of bytes
+    // written, which is 0 if the channel is full, or -1 if the renderer side
+    // was closed.
+    int guestWriteBuffers(const Buffer* buffers, int numBuffers);
+
+    // Fill the |numBuffers| buffers in |buffers| with data from the channel,
+    // in order. Returns the number of bytes read, which is 0 if there is
+    // nothing to read, or -1 if the renderer side was closed and the channel
+    // is drained.
+    int guestReadBuffers(const Buffer* buffers, int numBuffers);
+
+    // Single-buffer versions of the methods above.
+    int guestWrite(const void* data, size_t size);
+    int guestRead(void* data, size_t size);
+
+    // Return the current set of kCanRead/kCanWrite/kClosed flags.
+    unsigned guestPoll();
+
+    // Ask for the callback to be invoked once when any of the events in
+    // |events| happens. If one of them is already true, the callback is
+    // invoked immediately.
+    void guestWakeOn(unsigned events);
+
+    // Close the client side of the channel. |this| can be deleted by the
+    // call, and must not be used anymore.
+    void guestClose();
+
+    // Renderer-side methods, all of them are blocking.
+
+    // Write |size| bytes from |data|, waiting for room in the ring as
+    // needed. Returns false if the channel was closed.
+    bool hostWrite(const void* data, size_t size);
+
+    // Read at least 1 and at most |*inout_len| bytes from the channel into
+    // |data|, waiting for data as needed. On success, return true and set
+    // |*inout_len| to the number of bytes read. Returns false if the
+    // channel was closed and is drained.
+    bool hostRead(void* data, size_t* inout_len);
+
+    // Make all current and future host-side calls fail. Used to implement
+    // IOStream::forceStop().
+    void hostStop();
+
+    // Close the renderer side of the channel. |this| can be deleted by the
+    // call, and must not be used anymore.
+    void hostClose();
+
+private:
+    // A simple single-producer / single-consumer ring buffer. Indices are
+    // protected by the channel's lock, but data is copied without holding
+    // it, since the producer and consumer only touch disjoint ranges.
+    struct Ring {
+        Ring() : data(NULL), mask(0), readPos(0), writePos(0) {}
+        size_t used() const { return writePos - readPos; }
+        size_t avail() const { return mask + 1 - used(); }
+
+        unsigned char* data;
+        size_t mask;
+        size_t readPos;  // Only modified by the consumer.
+        size_t writePos;  // Only modified by the producer.
+    };
+
+    ~RenderChannel();
+
+    // Copy |size| bytes between |buf| and |ring| at position |pos|, handling
+    // wrapping.
+    static void copyToRing(Ring* ring, size_t pos, const void* buf,
+                           size_t size);
+    static void copyFromRing(const Ring* ring, size_t pos, void* buf,
+                             size_t size);
+
+    // Compute current events, must be called with |m_lock| held.
+    unsigned pollLocked() const;
+
+    // Invoke the callback if a requested event happened. Must be called with
+    // |m_lock| held.
+    void checkWakeLocked();
+
+    // Release one reference, deleting the instance when both sides are
+    // closed.
+    void unref();
+
+    emugl::Mutex m_lock;
+    emugl::ConditionVariable m_canHostRead;
+    emugl::ConditionVariable m_canHostWrite;
+    Ring m_toHost;
+    Ring m_toGuest;
+    Callback m_callback;
+    void* m_opaque;
+    unsigned m_wakeWanted;
+    bool m_guestClosed;
+    bool m_hostClosed;
+    bool m_hostStopped;
+    int m_refCount;
+};
+
+// An IOStream implementation used by a RenderThread to talk to the
+// client of a RenderChannel. Takes ownership of the renderer side of the
+// channel, which is closed by the destructor.
+class ChannelStream : public IOStream {
+public:
+    ChannelStream(RenderChannel* channel, size_t bufSize);
+    virtual ~ChannelStream();
+
+    virtual void* allocBuffer(size_t minSize);
+    virtual int commitBuffer(size_t size);
+    virtual const unsigned char* readFully(void* buf, size_t len);
+    virtual const unsigned char* read(void* buf, size_t* inout_len);
+    virtual int writeFully(const void* buf, size_t len);
+    virtual void forceStop();
+
+private:
+    RenderChannel* m_channel;
+    unsigned char* m_buf;
+    size_t m_bufSize;
+};
+
+#endif  // RENDER_CHANNEL_H
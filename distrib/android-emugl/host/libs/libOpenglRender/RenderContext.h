@@ -16,7 +16,7 @@
 #ifndef _LIBRENDER_RENDER_CONTEXT_H
 #define _LIBRENDER_RENDER_CONTEXT_H
 
-#include "emugl/common/smart_ptr.h"
+#include "emugl/common/ref_counted.h"
 #include "GLDecoderContextData.h"
 
 #include <EGL/egl.h>
@@ -24,7 +24,7 @@
 // A class used to model a guest EGLContext. This simply wraps a host
 // EGLContext, associated with an GLDecoderContextData instance that is
 // used to store copies of guest-side arrays.
-class RenderContext {
+class RenderContext : public emugl::RefCounted {
 public:
     // Create a new RenderContext instance.
     // |display| is the host EGLDisplay handle.
@@ -64,6 +64,6 @@ private:
     GLDecoderContextData mContextData;
 };
 
-typedef emugl::SmartPtr<RenderContext> RenderContextPtr;
+typedef emugl::RefPtr<RenderContext> RenderContextPtr;
 
 #endif  // _LIBRENDER_RENDER_CONTEXT_H
@@ -152,6 +152,9 @@ static EGLint rcGetFBParam(EGLint param)
         case FB_MAX_SWAP_INTERVAL:
             ret = 1; // XXX: should be implemented
             break;
+        case FB_DISPLAY_COUNT:
+            ret = fb->getDisplayCount();
+            break;
         default:
             break;
     }
@@ -283,6 +286,37 @@ static void rcFBPost(uint32_t colorBuffer)
     fb->post(colorBuffer);
 }
 
+// Return the FB_WIDTH or FB_HEIGHT of |display|, or 0 if it doesn't
+// exist. Other parameters are the same for all displays.
+static EGLint rcGetDisplayParam(uint32_t display, EGLint param)
+{
+    FrameBuffer *fb = FrameBuffer::getFB();
+    if (!fb) {
+        return 0;
+    }
+    int width, height;
+    if (!fb->getDisplaySize((int)display, &width, &height)) {
+        return 0;
+    }
+    switch (param) {
+        case FB_WIDTH:
+            return width;
+        case FB_HEIGHT:
+            return height;
+        default:
+            return rcGetFBParam(param);
+    }
+}
+
+static int rcFBPostDisplay(uint32_t display, uint32_t colorBuffer)
+{
+    FrameBuffer *fb = FrameBuffer::getFB();
+    if (!fb) {
+        return -1;
+    }
+    return fb->postDisplay((int)display, colorBuffer) ? 0 : -1;
+}
+
 static void rcFBSetSwapInterval(EGLint interval)
 {
    // XXX: TBD - should be implemented
@@ -370,4 +404,6 @@ void initRenderControlContext(renderControl_decoder_context_t *dec)
     dec->rcReadColorBuffer = rcReadColorBuffer;
     dec->rcUpdateColorBuffer = rcUpdateColorBuffer;
     dec->rcOpenColorBuffer2 = rcOpenColorBuffer2;
+    dec->rcGetDisplayParam = rcGetDisplayParam;
+    dec->rcFBPostDisplay = rcFBPostDisplay;
 }
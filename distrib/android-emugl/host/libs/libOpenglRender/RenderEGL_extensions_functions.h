@@ -10,6 +10,7 @@
 #define LIST_RENDER_EGL_EXTENSIONS_FUNCTIONS(X) \
   X(EGLImageKHR, eglCreateImageKHR, (EGLDisplay display, EGLContext context, EGLenum target, EGLClientBuffer buffer, const EGLint* attrib_list)) \
   X(EGLBoolean, eglDestroyImageKHR, (EGLDisplay display, EGLImageKHR image)) \
+  X(EGLBoolean, eglSwapBuffersWithDamageEXT, (EGLDisplay display, EGLSurface surface, EGLint* rects, EGLint n_rects)) \
 
 
 #endif  // RENDER_EGL_EXTENSIONS_FUNCTIONS_H
@@ -29,20 +29,30 @@
 
 #include <set>
 
+#include <stdlib.h>
 #include <string.h>
 
 typedef std::set<RenderThread *> RenderThreadsSet;
 
+// Size of each ring buffer of a RenderChannel.
+static const size_t kChannelRingSize = 1024 * 1024;
+
 RenderServer::RenderServer() :
-    m_lock(),
+    m_lock("RenderServer::m_lock"),
     m_listenSock(NULL),
-    m_exiting(false)
+    m_exiting(false),
+    m_channelLock("RenderServer::m_channelLock"),
+    m_channelCond(),
+    m_pendingChannels()
 {
 }
 
 RenderServer::~RenderServer()
 {
     delete m_listenSock;
+    for (size_t n = 0; n < m_pendingChannels.size(); ++n) {
+        delete m_pendingChannels[n];
+    }
 }
 
 
@@ -55,6 +65,17 @@ RenderServer *RenderServer::create(char* addr, size_t addrLen)
         return NULL;
     }
 
+    if (gRendererStreamMode == STREAM_MODE_SHMEM) {
+        // Clients use openChannel(), there is no address to connect to.
+        if (addrLen < 1) {
+            ERR("RenderServer address buffer too small\n");
+            delete server;
+            return NULL;
+        }
+        addr[0] = '\0';
+        return server;
+    }
+
     if (gRendererStreamMode == STREAM_MODE_TCP) {
         server->m_listenSock = new TcpStream();
     } else {
@@ -84,6 +105,36 @@ RenderServer *RenderServer::create(char* addr, size_t addrLen)
     return server;
 }
 
+RenderChannel* RenderServer::openChannel(RenderChannel::Callback callback,
+                                         void* opaque)
+{
+    if (m_listenSock) {
+        return NULL;
+    }
+    RenderChannel* channel =
+            new RenderChannel(kChannelRingSize, callback, opaque);
+    IOStream* stream = new ChannelStream(channel, 10000);
+
+    emugl::Mutex::AutoLock lock(m_channelLock);
+    m_pendingChannels.push_back(stream);
+    m_channelCond.signal();
+    return channel;
+}
+
+IOStream* RenderServer::acceptStream()
+{
+    if (m_listenSock) {
+        return m_listenSock->accept();
+    }
+    emugl::Mutex::AutoLock lock(m_channelLock);
+    while (m_pendingChannels.empty()) {
+        m_channelCond.wait(&m_channelLock);
+    }
+    IOStream* stream = m_pendingChannels.front();
+    m_pendingChannels.erase(m_pendingChannels.begin());
+    return stream;
+}
+
 intptr_t RenderServer::main()
 {
     RenderThreadsSet threads;
@@ -95,7 +146,7 @@ intptr_t RenderServer::main()
 #endif
 
     while(1) {
-        SocketStream *stream = m_listenSock->accept();
+        IOStream *stream = acceptStream();
         if (!stream) {
             fprintf(stderr,"Error accepting connection, aborting\n");
             break;
@@ -117,7 +168,11 @@ intptr_t RenderServer::main()
             break;
         }
 
-        RenderThread *rt = RenderThread::create(stream, &m_lock);
+        // Decoding runs concurrently in all render threads, unless
+        // RENDERER_SERIALIZE_DECODING is defined in the environment, which
+        // can be useful to debug thread-safety issues in host GL drivers.
+        RenderThread *rt = RenderThread::create(
+                stream, getenv("RENDERER_SERIALIZE_DECODING") ? &m_lock : NULL);
         if (!rt) {
             fprintf(stderr,"Failed to create RenderThread\n");
             delete stream;
@@ -16,10 +16,14 @@
 #ifndef _LIB_OPENGL_RENDER_RENDER_SERVER_H
 #define _LIB_OPENGL_RENDER_RENDER_SERVER_H
 
+#include "RenderChannel.h"
 #include "SocketStream.h"
+#include "emugl/common/condition_variable.h"
 #include "emugl/common/mutex.h"
 #include "emugl/common/thread.h"
 
+#include <vector>
+
 class RenderServer : public emugl::Thread
 {
 public:
@@ -30,13 +34,28 @@ public:
 
     bool isExiting() const { return m_exiting; }
 
+    // Create a new in-process channel to the server, which will be handled
+    // by a new RenderThread. Only works in STREAM_MODE_SHMEM mode, returns
+    // NULL otherwise. See RenderChannel.h for details.
+    RenderChannel* openChannel(RenderChannel::Callback callback,
+                               void* opaque);
+
 private:
     RenderServer();
 
+    // Wait for the next client stream, either from the listening socket,
+    // or from openChannel().
+    IOStream* acceptStream();
+
 private:
     emugl::Mutex m_lock;
     SocketStream *m_listenSock;
     bool m_exiting;
+
+    // Streams created by openChannel() that were not accepted yet.
+    emugl::Mutex m_channelLock;
+    emugl::ConditionVariable m_channelCond;
+    std::vector<IOStream*> m_pendingChannels;
 };
 
 #endif
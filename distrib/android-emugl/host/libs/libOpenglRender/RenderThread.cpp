@@ -15,6 +15,7 @@
 */
 #include "RenderThread.h"
 
+#include "DecoderStats.h"
 #include "EGLDispatch.h"
 #include "FrameBuffer.h"
 #include "GLESv2Dispatch.h"
@@ -50,13 +51,21 @@ intptr_t RenderThread::main() {
     //
     // initialize decoders
     //
-    tInfo.m_glDec.initGL(gles1_dispatch_get_proc_func, NULL);
-    tInfo.m_gl2Dec.initGL(gles2_dispatch_get_proc_func, NULL);
+    tInfo.m_glDec.initGL(s_gles1);
+    tInfo.m_gl2Dec.initGL(s_gles2);
     initRenderControlContext(&tInfo.m_rcDec);
 
     ReadBuffer readBuf(m_stream, STREAM_BUFFER_SIZE);
 
-    int stats_totalBytes = 0;
+    // Per-opcode statistics, only collected while enabled through
+    // enableOpenGLDecoderStats().
+    DecoderStats::ThreadStats decoderStats(&tInfo);
+
+    // Set SHOW_BANDWIDTH_STATS in the environment to periodically print
+    // the bandwidth used by this thread's stream.
+    bool showBandwidthStats = getenv("SHOW_BANDWIDTH_STATS") != NULL;
+    uint64_t stats_bytesRead0 = 0;
+    uint64_t stats_bytesMoved0 = 0;
     long long stats_t0 = GetCurrentTimeMS();
 
     //
@@ -83,14 +92,24 @@ intptr_t RenderThread::main() {
         }
 
         //
-        // log received bandwidth statistics
+        // log received bandwidth statistics, and publish the decoder ones
         //
-        stats_totalBytes += readBuf.validData();
         long long dt = GetCurrentTimeMS() - stats_t0;
         if (dt > 1000) {
-            //float dts = (float)dt / 1000.0f;
-            //printf("Used Bandwidth %5.3f MB/s\n", ((float)stats_totalBytes / dts) / (1024.0f*1024.0f));
-            stats_totalBytes = 0;
+            decoderStats.update();
+            if (showBandwidthStats) {
+                float dts = (float)dt / 1000.0f;
+                uint64_t bytesRead =
+                        readBuf.totalBytesRead() - stats_bytesRead0;
+                uint64_t bytesMoved =
+                        readBuf.totalBytesMoved() - stats_bytesMoved0;
+                printf("RenderThread %p: Used Bandwidth %5.3f MB/s "
+                       "(%5.3f MB/s moved)\n", this,
+                       ((float)bytesRead / dts) / (1024.0f*1024.0f),
+                       ((float)bytesMoved / dts) / (1024.0f*1024.0f));
+            }
+            stats_bytesRead0 = readBuf.totalBytesRead();
+            stats_bytesMoved0 = readBuf.totalBytesMoved();
             stats_t0 = GetCurrentTimeMS();
         }
 
@@ -103,43 +122,56 @@ intptr_t RenderThread::main() {
             fflush(dumpFP);
         }
 
+        //
+        // Each packet starts with a 32-bit opcode, whose value range tells
+        // which decoder handles it. Dispatch directly to it, instead of
+        // trying each decoder in turn. Each decode() call processes all
+        // consecutive packets for its API.
+        //
         bool progress;
+        bool badStream = false;
         do {
             progress = false;
-
-            m_lock->lock();
-            //
-            // try to process some of the command buffer using the GLESv1 decoder
-            //
-            size_t last = tInfo.m_glDec.decode(readBuf.buf(), readBuf.validData(), m_stream);
-            if (last > 0) {
-                progress = true;
-                readBuf.consume(last);
+            if (readBuf.validData() < sizeof(uint32_t)) {
+                break;
             }
+            uint32_t opcode = *(const uint32_t*)readBuf.buf();
 
-            //
-            // try to process some of the command buffer using the GLESv2 decoder
-            //
-            last = tInfo.m_gl2Dec.decode(readBuf.buf(), readBuf.validData(), m_stream);
-            if (last > 0) {
-                progress = true;
-                readBuf.consume(last);
+            if (m_lock) {
+                m_lock->lock();
+            }
+            size_t last = 0;
+            if (GLESv2Decoder::isDecoderOpcode(opcode)) {
+                last = tInfo.m_gl2Dec.decode(
+                        readBuf.buf(), readBuf.validData(), m_stream);
+            } else if (GLESv1Decoder::isDecoderOpcode(opcode)) {
+                last = tInfo.m_glDec.decode(
+                        readBuf.buf(), readBuf.validData(), m_stream);
+            } else if (renderControl_decoder_context_t::isDecoderOpcode(
+                    opcode)) {
+                last = tInfo.m_rcDec.decode(
+                        readBuf.buf(), readBuf.validData(), m_stream);
+            } else {
+                // The stream is corrupted, and no decoder will ever make
+                // progress on it again.
+                ERR("RenderThread %p: Unknown opcode %u, closing stream\n",
+                    this, opcode);
+                badStream = true;
+            }
+            if (m_lock) {
+                m_lock->unlock();
             }
 
-            //
-            // try to process some of the command buffer using the
-            // renderControl decoder
-            //
-            last = tInfo.m_rcDec.decode(readBuf.buf(), readBuf.validData(), m_stream);
             if (last > 0) {
                 readBuf.consume(last);
                 progress = true;
             }
-
-            m_lock->unlock();
-
         } while( progress );
 
+        if (badStream) {
+            break;
+        }
+
     }
 
     if (dumpFP) {
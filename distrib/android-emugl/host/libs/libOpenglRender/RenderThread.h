@@ -28,10 +28,11 @@ public:
     // Create a new RenderThread instance.
     // |stream| is an input stream that will be read from the thread,
     // and deleted by it when it exits.
-    // |mutex| is a pointer to a shared mutex used to serialize
-    // decoding operations between all threads.
-    // TODO(digit): Why is this needed here? Shouldn't this be handled
-    //              by the decoders themselves or at a lower-level?
+    // |mutex| is either NULL, or a pointer to a shared mutex used to
+    // serialize decoding operations between all threads. This is normally
+    // not needed because the FrameBuffer protects its own shared state
+    // (color buffers, window surfaces and contexts) with its lock, and
+    // other GL calls only operate on the thread's current context.
     static RenderThread* create(IOStream* stream, emugl::Mutex* mutex);
 
     // Destructor.
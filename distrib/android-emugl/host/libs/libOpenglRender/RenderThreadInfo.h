@@ -41,7 +41,8 @@ struct RenderThreadInfo {
     // Return the current thread's instance, if any, or NULL.
     static RenderThreadInfo* get();
 
-    // Current EGL context, draw surface and read surface.
+    // Current EGL context, draw surface and read surface, as bound by
+    // FrameBuffer::bindContext(), which skips the switch if they match.
     RenderContextPtr currContext;
     WindowSurfacePtr currDrawSurf;
     WindowSurfacePtr currReadSurf;
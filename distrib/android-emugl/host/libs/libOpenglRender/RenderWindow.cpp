@@ -333,6 +333,46 @@ bool RenderWindow::getHardwareStrings(const char** vendor,
     return true;
 }
 
+// NOTE: These don't go through the render window thread, since the
+// FrameBuffer methods are thread-safe, and only queue a repaint.
+void RenderWindow::setSkinLayer(int id, const void* pixels, int width,
+                                int height, int x, int y, int dstWidth,
+                                int dstHeight) {
+    FrameBuffer* fb = FrameBuffer::getFB();
+    if (fb) {
+        fb->setSkinLayer(id, pixels, width, height,
+                         x, y, dstWidth, dstHeight);
+    }
+}
+
+void RenderWindow::showSkinLayer(int id, bool visible) {
+    FrameBuffer* fb = FrameBuffer::getFB();
+    if (fb) {
+        fb->showSkinLayer(id, visible);
+    }
+}
+
+void RenderWindow::setSkinDisplayRect(int x, int y, int width, int height) {
+    FrameBuffer* fb = FrameBuffer::getFB();
+    if (fb) {
+        fb->setSkinDisplayRect(x, y, width, height);
+    }
+}
+
+// NOTE: These don't go through the render window thread, since the
+// FrameBuffer methods are thread-safe, and opening or closing the file may
+// block for a while.
+bool RenderWindow::startVideoRecording(const char* path, int fps) {
+    FrameBuffer* fb = FrameBuffer::getFB();
+    return fb && fb->startVideoRecording(path, fps);
+}
+
+bool RenderWindow::stopVideoRecording(uint64_t* writtenFrames,
+                                      uint64_t* droppedFrames) {
+    FrameBuffer* fb = FrameBuffer::getFB();
+    return fb && fb->stopVideoRecording(writtenFrames, droppedFrames);
+}
+
 void RenderWindow::setPostCallback(OnPostFn onPost, void* onPostContext) {
     D("Entering\n");
     RenderWindowMessage msg;
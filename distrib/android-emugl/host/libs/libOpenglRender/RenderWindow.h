@@ -107,6 +107,19 @@ public:
     // Force a repaint of the whole content into the sub-window.
     void repaint();
 
+    // Change the skin layers drawn around the display in the sub-window,
+    // see FrameBuffer::setSkinLayer().
+    void setSkinLayer(int id, const void* pixels, int width, int height,
+                      int x, int y, int dstWidth, int dstHeight);
+    void showSkinLayer(int id, bool visible);
+    void setSkinDisplayRect(int x, int y, int width, int height);
+
+    // Start or stop recording the displayed frames to a file, see
+    // FrameBuffer::startVideoRecording() and
+    // FrameBuffer::stopVideoRecording().
+    bool startVideoRecording(const char* path, int fps);
+    bool stopVideoRecording(uint64_t* writtenFrames, uint64_t* droppedFrames);
+
 private:
     bool processMessage(const RenderWindowMessage& msg);
 
@@ -0,0 +1,215 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#include "SkinCompositor.h"
+
+#include "ColorBuffer.h"
+#include "GLESv2Dispatch.h"
+#include "TextureDraw.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+SkinCompositor::SkinCompositor() : m_lock("SkinCompositor::m_lock"), m_layers(), m_deadTextures() {
+    memset(m_displayRect, 0, sizeof(m_displayRect));
+}
+
+SkinCompositor::~SkinCompositor() {
+    for (size_t n = 0; n < m_layers.size(); ++n) {
+        free(m_layers[n].pixels);
+    }
+}
+
+size_t SkinCompositor::findLayer(int id) const {
+    size_t lo = 0;
+    size_t hi = m_layers.size();
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (m_layers[mid].id < id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+void SkinCompositor::setLayer(int id, const void* pixels, int width,
+                              int height, int x, int y, int dstWidth,
+                              int dstHeight) {
+    emugl::Mutex::AutoLock lock(m_lock);
+    size_t n = findLayer(id);
+    bool found = n < m_layers.size() && m_layers[n].id == id;
+
+    if (!pixels || width <= 0 || height <= 0) {
+        if (found) {
+            if (m_layers[n].texture) {
+                m_deadTextures.push_back(m_layers[n].texture);
+            }
+            free(m_layers[n].pixels);
+            m_layers.erase(m_layers.begin() + n);
+        }
+        return;
+    }
+
+    size_t size = 4 * (size_t)width * height;
+    unsigned char* copy = static_cast<unsigned char*>(malloc(size));
+    if (!copy) {
+        return;
+    }
+    memcpy(copy, pixels, size);
+
+    if (!found) {
+        Layer layer;
+        memset(&layer, 0, sizeof(layer));
+        layer.id = id;
+        layer.visible = true;
+        m_layers.insert(m_layers.begin() + n, layer);
+    }
+    Layer& layer = m_layers[n];
+    layer.x = x;
+    layer.y = y;
+    layer.width = dstWidth;
+    layer.height = dstHeight;
+    free(layer.pixels);
+    layer.pixels = copy;
+    layer.pixelsWidth = width;
+    layer.pixelsHeight = height;
+}
+
+void SkinCompositor::showLayer(int id, bool visible) {
+    emugl::Mutex::AutoLock lock(m_lock);
+    size_t n = findLayer(id);
+    if (n < m_layers.size() && m_layers[n].id == id) {
+        m_layers[n].visible = visible;
+    }
+}
+
+void SkinCompositor::setDisplayRect(int x, int y, int width, int height) {
+    emugl::Mutex::AutoLock lock(m_lock);
+    m_displayRect[0] = x;
+    m_displayRect[1] = y;
+    m_displayRect[2] = width;
+    m_displayRect[3] = height;
+}
+
+bool SkinCompositor::hasLayers() {
+    emugl::Mutex::AutoLock lock(m_lock);
+    return !m_layers.empty();
+}
+
+// Set the viewport to a sub-window rectangle with a top-left origin.
+void SkinCompositor::setViewport(int x, int y, int width, int height,
+                                 int windowHeight) {
+    s_gles2.glViewport(x, windowHeight - y - height, width, height);
+}
+
+// Draw the visible layers below the display, or above it if |aboveDisplay|
+// is true, uploading their pending pixels first. |m_lock| must be held.
+bool SkinCompositor::drawLayers(TextureDraw* textureDraw, bool aboveDisplay,
+                                int windowHeight) {
+    bool ret = true;
+    for (size_t n = 0; n < m_layers.size(); ++n) {
+        Layer& layer = m_layers[n];
+        if ((layer.id >= 0) != aboveDisplay) {
+            continue;
+        }
+        if (layer.pixels) {
+            if (!layer.texture) {
+                s_gles2.glGenTextures(1, &layer.texture);
+                s_gles2.glBindTexture(GL_TEXTURE_2D, layer.texture);
+                s_gles2.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                                        GL_LINEAR);
+                s_gles2.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
+                                        GL_LINEAR);
+                s_gles2.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,
+                                        GL_CLAMP_TO_EDGE);
+                s_gles2.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T,
+                                        GL_CLAMP_TO_EDGE);
+            } else {
+                s_gles2.glBindTexture(GL_TEXTURE_2D, layer.texture);
+            }
+            s_gles2.glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            s_gles2.glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
+                                 layer.pixelsWidth, layer.pixelsHeight, 0,
+                                 GL_RGBA, GL_UNSIGNED_BYTE, layer.pixels);
+            free(layer.pixels);
+            layer.pixels = NULL;
+        }
+        if (!layer.visible || layer.width <= 0 || layer.height <= 0) {
+            continue;
+        }
+        setViewport(layer.x, layer.y, layer.width, layer.height,
+                    windowHeight);
+        ret = textureDraw->draw(layer.texture, 0.) && ret;
+    }
+    return ret;
+}
+
+bool SkinCompositor::draw(TextureDraw* textureDraw, ColorBuffer* display,
+                          float rotation, int windowWidth, int windowHeight) {
+    emugl::Mutex::AutoLock lock(m_lock);
+
+    if (!m_deadTextures.empty()) {
+        s_gles2.glDeleteTextures(m_deadTextures.size(), &m_deadTextures[0]);
+        m_deadTextures.clear();
+    }
+
+    s_gles2.glViewport(0, 0, windowWidth, windowHeight);
+    s_gles2.glClearColor(0., 0., 0., 1.);
+    s_gles2.glClear(GL_COLOR_BUFFER_BIT);
+
+    // Skin images are not premultiplied.
+    s_gles2.glEnable(GL_BLEND);
+    s_gles2.glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    bool ret = drawLayers(textureDraw, false, windowHeight);
+
+    // The display is opaque, and overwrites the layers below it.
+    s_gles2.glDisable(GL_BLEND);
+    if (display) {
+        if (m_displayRect[2] > 0 && m_displayRect[3] > 0) {
+            setViewport(m_displayRect[0], m_displayRect[1],
+                        m_displayRect[2], m_displayRect[3], windowHeight);
+        } else {
+            s_gles2.glViewport(0, 0, windowWidth, windowHeight);
+        }
+        ret = display->post(textureDraw, rotation) && ret;
+    }
+
+    s_gles2.glEnable(GL_BLEND);
+    ret = drawLayers(textureDraw, true, windowHeight) && ret;
+    s_gles2.glDisable(GL_BLEND);
+
+    s_gles2.glViewport(0, 0, windowWidth, windowHeight);
+    return ret;
+}
+
+void SkinCompositor::releaseGL() {
+    emugl::Mutex::AutoLock lock(m_lock);
+    for (size_t n = 0; n < m_layers.size(); ++n) {
+        Layer& layer = m_layers[n];
+        if (layer.texture) {
+            m_deadTextures.push_back(layer.texture);
+            layer.texture = 0;
+        }
+        free(layer.pixels);
+        layer.pixels = NULL;
+    }
+    m_layers.clear();
+    if (!m_deadTextures.empty()) {
+        s_gles2.glDeleteTextures(m_deadTextures.size(), &m_deadTextures[0]);
+        m_deadTextures.clear();
+    }
+}
@@ -0,0 +1,110 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#ifndef _LIB_OPENGL_RENDER_SKIN_COMPOSITOR_H
+#define _LIB_OPENGL_RENDER_SKIN_COMPOSITOR_H
+
+#include "emugl/common/mutex.h"
+
+#include <GLES2/gl2.h>
+
+#include <vector>
+
+class ColorBuffer;
+class TextureDraw;
+
+// Draws the emulator skin (device frame, buttons, onion overlay...) into
+// the GPU sub-window, around the emulated display, so that the UI doesn't
+// have to compose it in software and the posted frames never leave the GPU.
+//
+// The skin is a list of layers, each one an RGBA image stretched over a
+// rectangle of the sub-window, and drawn as a textured quad with alpha
+// blending. Layers are drawn in increasing id order. Those with a negative
+// id are drawn below the emulated display, the others above it. The
+// display itself is drawn in the rectangle given to setDisplayRect().
+//
+// The UI thread changes the layers, and the presenter thread draws them,
+// so all methods are thread-safe. Layer pixels are copied, and only
+// uploaded to textures by the next draw().
+class SkinCompositor {
+public:
+    SkinCompositor();
+
+    // releaseGL() must have been called before.
+    ~SkinCompositor();
+
+    // Add or replace the layer |id|, with the |width| x |height| RGBA
+    // |pixels|, drawn at |x|, |y| and scaled to |dstWidth| x |dstHeight|
+    // sub-window pixels, with a top-left origin. If |pixels| is NULL, the
+    // layer is removed instead. New layers are visible.
+    void setLayer(int id, const void* pixels, int width, int height,
+                  int x, int y, int dstWidth, int dstHeight);
+
+    // Show or hide the layer |id|, if it exists.
+    void showLayer(int id, bool visible);
+
+    // Set the sub-window rectangle of the emulated display, with a top-left
+    // origin. If |width| or |height| is 0, the display fills the sub-window,
+    // which is the default.
+    void setDisplayRect(int x, int y, int width, int height);
+
+    // Return true if there is at least one layer, i.e. if draw() should be
+    // used instead of drawing the display texture alone.
+    bool hasLayers();
+
+    // Clear the |windowWidth| x |windowHeight| sub-window, then draw the
+    // layers with |textureDraw|, and |display| rotated by |rotation| degrees
+    // in the display rectangle. If |display| is NULL, the display rectangle
+    // is left black. The viewport is restored to the whole sub-window on
+    // return. The sub-window context must be current.
+    bool draw(TextureDraw* textureDraw, ColorBuffer* display,
+              float rotation, int windowWidth, int windowHeight);
+
+    // Remove all layers and delete their textures. A context sharing them
+    // must be current.
+    void releaseGL();
+
+private:
+    struct Layer {
+        int id;
+        int x;
+        int y;
+        int width;
+        int height;
+        bool visible;
+        GLuint texture;
+        // Pixels waiting to be uploaded to |texture|, or NULL.
+        unsigned char* pixels;
+        int pixelsWidth;
+        int pixelsHeight;
+    };
+
+    // Return the position of the layer |id| in |m_layers|, or the position
+    // where it should be inserted, keeping the list sorted.
+    size_t findLayer(int id) const;
+
+    void setViewport(int x, int y, int width, int height, int windowHeight);
+
+    bool drawLayers(TextureDraw* textureDraw, bool aboveDisplay,
+                    int windowHeight);
+
+    emugl::Mutex m_lock;
+    std::vector<Layer> m_layers;
+    // Textures of removed layers, deleted by the next draw().
+    std::vector<GLuint> m_deadTextures;
+    int m_displayRect[4];
+};
+
+#endif  // _LIB_OPENGL_RENDER_SKIN_COMPOSITOR_H
@@ -0,0 +1,485 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A standalone tool that replays renderer streams, as dumped by
+// RenderThread when RENDERER_DUMP_DIR is defined, through the host
+// decoders as fast as possible, then prints the number of calls, bytes and
+// cumulative decoding time of each opcode, the frame rate and frame times
+// of each stream, and the contention on the FrameBuffer lock. This allows
+// benchmarking host GPU drivers and renderer changes reproducibly, without
+// booting a guest. The FrameBuffer has no sub-window, so frames are
+// composed but never displayed.
+//
+// Usage: emugl_replay [-w <width>] [-h <height>] [-j] <stream-file>...
+//
+// By default, each file is replayed in turn on the current thread. With
+// -j, all files are replayed concurrently, each on its own thread, like
+// the render threads of as many guest clients.
+//
+// Since the guest refers to host objects by the handles the host returned,
+// this only works reliably for dumps where a single stream created
+// objects, or where the files are given in the order their streams were
+// opened. With -j, this also requires that no stream uses the objects of
+// another one before these are created.
+//
+// A frame ends with each rcFlushWindowColorBuffer() or rcFBPost() call,
+// i.e. an eglSwapBuffers() or a post of the guest composer. Frame CPU
+// times are those of the replaying thread, where the platform can measure
+// them, and otherwise wall times.
+//
+// NOTE: Times only cover the host driver's CPU side of each call,
+// except for calls that wait for the GPU, like glFinish().
+
+#include "EGLDispatch.h"
+#include "FrameBuffer.h"
+#include "GLESv1Dispatch.h"
+#include "GLESv2Dispatch.h"
+#include "IOStream.h"
+#include "RenderControl.h"
+#include "RenderThreadInfo.h"
+#include "TimeUtils.h"
+
+#include "gles1_replay.h"
+#include "gles2_replay.h"
+#include "renderControl_replay.h"
+
+#include "emugl/common/latency_histogram.h"
+#include "emugl/common/thread.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+namespace {
+
+// An IOStream that discards everything written by the decoders, since
+// there's no guest to read the replies.
+class NullStream : public IOStream {
+public:
+    NullStream() : IOStream(kBufferSize), mBuf(NULL), mBufSize(0) {}
+
+    virtual ~NullStream() { free(mBuf); }
+
+    virtual void* allocBuffer(size_t minSize) {
+        if (minSize > mBufSize) {
+            free(mBuf);
+            mBuf = malloc(minSize);
+            mBufSize = mBuf ? minSize : 0;
+        }
+        return mBuf;
+    }
+
+    virtual int commitBuffer(size_t size) { return static_cast<int>(size); }
+
+    virtual const unsigned char* readFully(void* buf, size_t len) {
+        return NULL;
+    }
+
+    virtual const unsigned char* read(void* buf, size_t* inout_len) {
+        *inout_len = 0;
+        return NULL;
+    }
+
+    virtual int writeFully(const void* buf, size_t len) { return 0; }
+
+    virtual void forceStop() {}
+
+private:
+    static const size_t kBufferSize = 64 * 1024;
+
+    void* mBuf;
+    size_t mBufSize;
+};
+
+struct Replayers {
+    gles1_replay_t gles1;
+    gles2_replay_t gles2;
+    renderControl_replay_t rc;
+};
+
+// Read the whole content of |path| into a new heap block, and set
+// |*size|. Return NULL on failure.
+unsigned char* readFile(const char* path, size_t* size) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    unsigned char* data = NULL;
+    size_t capacity = 0;
+    *size = 0;
+    for (;;) {
+        if (*size == capacity) {
+            capacity = capacity ? capacity * 2 : 1024 * 1024;
+            unsigned char* newData =
+                    static_cast<unsigned char*>(realloc(data, capacity));
+            if (!newData) {
+                free(data);
+                fclose(file);
+                return NULL;
+            }
+            data = newData;
+        }
+        size_t count = fread(data + *size, 1, capacity - *size, file);
+        if (count == 0) {
+            break;
+        }
+        *size += count;
+    }
+    fclose(file);
+    return data;
+}
+
+// Return the CPU time of the calling thread in nanoseconds, or the wall
+// time where it can't be measured.
+long long threadCpuTimeNs() {
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if (GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) {
+        // FILETIME values are in units of 100 ns.
+        return ((((long long)kernel.dwHighDateTime << 32) |
+                 kernel.dwLowDateTime) +
+                (((long long)user.dwHighDateTime << 32) |
+                 user.dwLowDateTime)) * 100;
+    }
+#elif defined(CLOCK_THREAD_CPUTIME_ID)
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0) {
+        return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    }
+#endif
+    return GetCurrentTimeNS();
+}
+
+// Return the renderControl opcode named |name|.
+unsigned findRcOpcode(const char* name) {
+    typedef renderControl_replay_t R;
+    for (unsigned n = 0; n < R::OPCODE_COUNT; ++n) {
+        if (!strcmp(R::opcodeName(R::OPCODE_BASE + n), name)) {
+            return R::OPCODE_BASE + n;
+        }
+    }
+    return 0;
+}
+
+// A replayed stream, and what was measured while replaying it.
+struct Client {
+    Client() :
+            path(NULL),
+            data(NULL),
+            size(0),
+            replayed(0),
+            frames(0),
+            wallTimeNs(0),
+            cpuTimeNs(0),
+            frameTimeUs(),
+            frameCpuUs() {}
+
+    const char* path;
+    unsigned char* data;
+    size_t size;
+    Replayers replayers;
+    size_t replayed;
+    uint64_t frames;
+    long long wallTimeNs;
+    long long cpuTimeNs;
+    emugl::LatencyHistogram frameTimeUs;
+    emugl::LatencyHistogram frameCpuUs;
+};
+
+unsigned sFlushOpcode = 0;
+unsigned sPostOpcode = 0;
+
+uint64_t frameCount(const renderControl_replay_t& rc) {
+    return (sFlushOpcode ? rc.stats(sFlushOpcode).calls : 0) +
+           (sPostOpcode ? rc.stats(sPostOpcode).calls : 0);
+}
+
+// Replay the stream of |client|, using the decoders of a new
+// RenderThreadInfo, just like RenderThread::main() does. Set the number
+// of bytes replayed, which is smaller than the stream size if it is
+// truncated or corrupted.
+void replayStream(Client* client) {
+    RenderThreadInfo tInfo;
+    tInfo.m_glDec.initGL(s_gles1);
+    tInfo.m_gl2Dec.initGL(s_gles2);
+    initRenderControlContext(&tInfo.m_rcDec);
+
+    Replayers* replayers = &client->replayers;
+    unsigned char* data = client->data;
+    size_t size = client->size;
+    NullStream stream;
+    size_t pos = 0;
+    long long startNs = GetCurrentTimeNS();
+    long long startCpuNs = threadCpuTimeNs();
+    long long frameNs = startNs;
+    long long frameCpuNs = startCpuNs;
+    uint64_t frames = frameCount(replayers->rc);
+    while (size - pos >= 8) {
+        uint32_t opcode = *(const uint32_t*)(data + pos);
+        size_t last = 0;
+        if (GLESv2Decoder::isDecoderOpcode(opcode)) {
+            last = replayers->gles2.replay(
+                    &tInfo.m_gl2Dec, data + pos, size - pos, &stream);
+        } else if (GLESv1Decoder::isDecoderOpcode(opcode)) {
+            last = replayers->gles1.replay(
+                    &tInfo.m_glDec, data + pos, size - pos, &stream);
+        } else if (renderControl_decoder_context_t::isDecoderOpcode(
+                opcode)) {
+            last = replayers->rc.replay(
+                    &tInfo.m_rcDec, data + pos, size - pos, &stream);
+            // Consecutive frames without any GL call in between are
+            // recorded as a single one.
+            uint64_t newFrames = frameCount(replayers->rc);
+            if (newFrames != frames) {
+                long long nowNs = GetCurrentTimeNS();
+                long long nowCpuNs = threadCpuTimeNs();
+                client->frameTimeUs.add((nowNs - frameNs) / 1000);
+                client->frameCpuUs.add((nowCpuNs - frameCpuNs) / 1000);
+                client->frames += newFrames - frames;
+                frames = newFrames;
+                frameNs = nowNs;
+                frameCpuNs = nowCpuNs;
+            }
+        }
+        if (!last) {
+            break;
+        }
+        pos += last;
+    }
+
+    FrameBuffer::getFB()->bindContext(0, 0, 0);
+    FrameBuffer::getFB()->drainWindowSurface();
+    FrameBuffer::getFB()->drainRenderContext();
+    client->wallTimeNs = GetCurrentTimeNS() - startNs;
+    client->cpuTimeNs = threadCpuTimeNs() - startCpuNs;
+    client->replayed = pos;
+}
+
+class ClientThread : public emugl::Thread {
+public:
+    explicit ClientThread(Client* client) : Thread(), mClient(client) {}
+
+    virtual intptr_t main() {
+        replayStream(mClient);
+        return 0;
+    }
+
+private:
+    Client* mClient;
+};
+
+struct OpEntry {
+    const char* name;
+    uint64_t calls;
+    uint64_t bytes;
+    uint64_t timeNs;
+
+    bool operator<(const OpEntry& other) const {
+        return timeNs > other.timeNs;
+    }
+};
+
+// Add the statistics of the |REPLAYER| of all |clients| to |entries|.
+template <typename REPLAYER>
+void collectStats(const std::vector<Client*>& clients,
+                  REPLAYER Replayers::*member,
+                  std::vector<OpEntry>* entries) {
+    for (unsigned n = 0; n < REPLAYER::OPCODE_COUNT; ++n) {
+        unsigned opcode = REPLAYER::OPCODE_BASE + n;
+        OpEntry entry = { REPLAYER::opcodeName(opcode), 0, 0, 0 };
+        for (size_t c = 0; c < clients.size(); ++c) {
+            const typename REPLAYER::OpStats& stats =
+                    (clients[c]->replayers.*member).stats(opcode);
+            entry.calls += stats.calls;
+            entry.bytes += stats.bytes;
+            entry.timeNs += stats.timeNs;
+        }
+        if (entry.calls) {
+            entries->push_back(entry);
+        }
+    }
+}
+
+void printOpStats(const std::vector<Client*>& clients,
+                  long long wallTimeNs) {
+    std::vector<OpEntry> entries;
+    collectStats(clients, &Replayers::gles1, &entries);
+    collectStats(clients, &Replayers::gles2, &entries);
+    collectStats(clients, &Replayers::rc, &entries);
+    std::sort(entries.begin(), entries.end());
+
+    uint64_t totalNs = 0;
+    uint64_t totalCalls = 0;
+    for (size_t n = 0; n < entries.size(); ++n) {
+        totalNs += entries[n].timeNs;
+        totalCalls += entries[n].calls;
+    }
+
+    printf("%-40s %10s %12s %10s %8s %6s\n",
+           "opcode", "calls", "bytes", "total ms", "avg us", "%");
+    for (size_t n = 0; n < entries.size(); ++n) {
+        const OpEntry& e = entries[n];
+        printf("%-40s %10llu %12llu %10.3f %8.3f %6.2f\n",
+               e.name,
+               (unsigned long long)e.calls,
+               (unsigned long long)e.bytes,
+               e.timeNs / 1e6,
+               e.timeNs / 1e3 / e.calls,
+               totalNs ? 100. * e.timeNs / totalNs : 0.);
+    }
+    printf("\n%llu calls, %.3f ms in decoders, %.3f ms wall time\n",
+           (unsigned long long)totalCalls, totalNs / 1e6, wallTimeNs / 1e6);
+}
+
+void printFrameStats(const std::vector<Client*>& clients,
+                     long long wallTimeNs) {
+    printf("\n%-32s %8s %9s %9s %9s %9s %9s\n",
+           "stream", "frames", "fps", "avg ms", "p50 ms", "p99 ms",
+           "cpu ms");
+    uint64_t totalFrames = 0;
+    for (size_t n = 0; n < clients.size(); ++n) {
+        const Client* c = clients[n];
+        const char* name = strrchr(c->path, '/');
+        name = name ? name + 1 : c->path;
+        printf("%-32s %8llu %9.1f %9.3f %9.3f %9.3f %9.3f\n",
+               name,
+               (unsigned long long)c->frames,
+               c->wallTimeNs > 0 ? c->frames * 1e9 / c->wallTimeNs : 0.,
+               c->frameTimeUs.average() / 1e3,
+               c->frameTimeUs.percentile(50) / 1e3,
+               c->frameTimeUs.percentile(99) / 1e3,
+               c->frameCpuUs.average() / 1e3);
+        totalFrames += c->frames;
+    }
+    printf("\n%llu frames, %.1f frames/s overall\n",
+           (unsigned long long)totalFrames,
+           wallTimeNs > 0 ? totalFrames * 1e9 / wallTimeNs : 0.);
+
+    ProfiledMutex::Stats lock = FrameBuffer::getFB()->getLockStats();
+    printf("FrameBuffer lock: %llu acquisitions, %llu contended (%.2f%%), "
+           "%.3f ms waiting\n",
+           (unsigned long long)lock.acquisitions,
+           (unsigned long long)lock.contentions,
+           lock.acquisitions ? 100. * lock.contentions / lock.acquisitions
+                             : 0.,
+           lock.waitNs / 1e6);
+}
+
+void usage(const char* progName) {
+    fprintf(stderr,
+            "Usage: %s [-w <width>] [-h <height>] [-j] <stream-file>...\n",
+            progName);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    int width = 1280;
+    int height = 720;
+    bool concurrent = false;
+    int argn = 1;
+    for (; argn < argc && argv[argn][0] == '-'; ++argn) {
+        if (argn + 1 < argc && !strcmp(argv[argn], "-w")) {
+            width = atoi(argv[++argn]);
+        } else if (argn + 1 < argc && !strcmp(argv[argn], "-h")) {
+            height = atoi(argv[++argn]);
+        } else if (!strcmp(argv[argn], "-j")) {
+            concurrent = true;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (argn >= argc || width <= 0 || height <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (!init_egl_dispatch() ||
+        !init_gles1_dispatch() ||
+        !init_gles2_dispatch()) {
+        fprintf(stderr, "Could not load the host EGL/GLES libraries\n");
+        return 1;
+    }
+    if (!FrameBuffer::initialize(width, height, false)) {
+        fprintf(stderr, "Could not initialize the emulated framebuffer\n");
+        return 1;
+    }
+    sFlushOpcode = findRcOpcode("rcFlushWindowColorBuffer");
+    sPostOpcode = findRcOpcode("rcFBPost");
+
+    // Read all streams first, so that -j replays them at the same time.
+    std::vector<Client*> clients;
+    int result = 0;
+    for (; argn < argc; ++argn) {
+        Client* client = new Client();
+        client->path = argv[argn];
+        client->data = readFile(client->path, &client->size);
+        clients.push_back(client);
+        if (!client->data) {
+            fprintf(stderr, "Could not read %s\n", client->path);
+            result = 1;
+            break;
+        }
+    }
+
+    long long wallTimeNs = 0;
+    if (!result) {
+        FrameBuffer::getFB()->resetLockStats();
+        long long t0 = GetCurrentTimeNS();
+        if (concurrent) {
+            std::vector<ClientThread*> threads;
+            for (size_t n = 0; n < clients.size(); ++n) {
+                threads.push_back(new ClientThread(clients[n]));
+                threads.back()->start();
+            }
+            for (size_t n = 0; n < threads.size(); ++n) {
+                threads[n]->wait(NULL);
+                delete threads[n];
+            }
+        } else {
+            for (size_t n = 0; n < clients.size(); ++n) {
+                replayStream(clients[n]);
+            }
+        }
+        wallTimeNs = GetCurrentTimeNS() - t0;
+
+        for (size_t n = 0; n < clients.size(); ++n) {
+            const Client* c = clients[n];
+            if (c->replayed < c->size) {
+                fprintf(stderr,
+                        "%s: stopped at offset %zu of %zu, the stream is "
+                        "truncated or corrupted\n",
+                        c->path, c->replayed, c->size);
+            }
+        }
+        printOpStats(clients, wallTimeNs);
+        printFrameStats(clients, wallTimeNs);
+    }
+
+    for (size_t n = 0; n < clients.size(); ++n) {
+        free(clients[n]->data);
+        delete clients[n];
+    }
+    FrameBuffer::getFB()->finalize();
+    return result;
+}
@@ -0,0 +1,508 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#include "VideoRecorder.h"
+
+#include "GLESv2Dispatch.h"
+#include "TimeUtils.h"
+
+#include "emugl/common/thread.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ERR(...)  fprintf(stderr, __VA_ARGS__)
+
+namespace {
+
+// Trivial vertex shader for a quad that fills the viewport.
+const char kVertexShaderSource[] =
+    "attribute vec2 position;\n"
+
+    "void main(void) {\n"
+    "  gl_Position = vec4(position, 0.0, 1.0);\n"
+    "}\n";
+
+// Converts the frame to I420 (BT.601, limited range), laid out so that
+// reading back the (width / 4) x (height * 3 / 2) RGBA target returns the
+// Y, U and V planes in this order: each target pixel holds 4 consecutive
+// bytes of a plane. Each chroma sample is the average of a 2x2 pixel
+// block, which linear filtering computes when sampling at its center.
+const char kFragmentShaderSource[] =
+    "precision highp float;\n"
+    "uniform sampler2D texture;\n"
+    // Frame dimensions before and after cropping, in pixels.
+    "uniform vec2 frameSize;\n"
+    "uniform vec2 yuvSize;\n"
+
+    "const vec3 kY = vec3(0.257, 0.504, 0.098);\n"
+    "const vec3 kU = vec3(-0.148, -0.291, 0.439);\n"
+    "const vec3 kV = vec3(0.439, -0.368, -0.071);\n"
+
+    "vec3 rgbAt(float x, float y) {\n"
+    "  return texture2D(texture, vec2(x, y) / frameSize).rgb;\n"
+    "}\n"
+
+    "void main(void) {\n"
+    "  vec2 pos = floor(gl_FragCoord.xy);\n"
+    "  float x = pos.x * 4.0;\n"
+    "  if (pos.y < yuvSize.y) {\n"
+    "    float y = pos.y + 0.5;\n"
+    "    gl_FragColor = vec4(dot(kY, rgbAt(x + 0.5, y)),\n"
+    "                        dot(kY, rgbAt(x + 1.5, y)),\n"
+    "                        dot(kY, rgbAt(x + 2.5, y)),\n"
+    "                        dot(kY, rgbAt(x + 3.5, y))) + 16.0 / 255.0;\n"
+    "    return;\n"
+    "  }\n"
+    // Each row of the chroma planes holds two rows of half-width samples.
+    "  float row = pos.y - yuvSize.y;\n"
+    "  vec3 k = kU;\n"
+    "  if (row >= yuvSize.y / 4.0) {\n"
+    "    row -= yuvSize.y / 4.0;\n"
+    "    k = kV;\n"
+    "  }\n"
+    "  row *= 2.0;\n"
+    "  if (x >= yuvSize.x / 2.0) {\n"
+    "    x -= yuvSize.x / 2.0;\n"
+    "    row += 1.0;\n"
+    "  }\n"
+    "  x = x * 2.0 + 1.0;\n"
+    "  float y = row * 2.0 + 1.0;\n"
+    "  gl_FragColor = vec4(dot(k, rgbAt(x, y)),\n"
+    "                      dot(k, rgbAt(x + 2.0, y)),\n"
+    "                      dot(k, rgbAt(x + 4.0, y)),\n"
+    "                      dot(k, rgbAt(x + 6.0, y))) + 128.0 / 255.0;\n"
+    "}\n";
+
+const GLfloat kQuad[] = { -1, -1, +1, -1, -1, +1, +1, +1 };
+
+GLuint createShader(GLenum shaderType, const char* shaderText) {
+    GLuint shader = s_gles2.glCreateShader(shaderType);
+    if (!shader) {
+        return 0;
+    }
+    const GLchar* text = static_cast<const GLchar*>(shaderText);
+    const GLint textLen = ::strlen(shaderText);
+    s_gles2.glShaderSource(shader, 1, &text, &textLen);
+
+    GLint success;
+    s_gles2.glCompileShader(shader);
+    s_gles2.glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (success == GL_FALSE) {
+        GLchar messages[256];
+        s_gles2.glGetShaderInfoLog(shader, sizeof(messages), 0, messages);
+        ERR("%s: Could not compile shader: %s\n", __FUNCTION__, messages);
+        s_gles2.glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+}  // namespace
+
+class VideoRecorder::Writer : public emugl::Thread {
+public:
+    explicit Writer(VideoRecorder* recorder) : mRecorder(recorder) {}
+
+    virtual intptr_t main() {
+        mRecorder->writeLoop();
+        return 0;
+    }
+
+private:
+    VideoRecorder* mRecorder;
+};
+
+// static
+VideoRecorder* VideoRecorder::create(FILE* file,
+                                     int width,
+                                     int height,
+                                     int fps,
+                                     bool usePbos) {
+    if ((width & ~7) <= 0 || (height & ~3) <= 0 || fps <= 0) {
+        ERR("%s: Invalid frame dimensions or rate: %dx%d at %d fps\n",
+            __FUNCTION__, width, height, fps);
+        fclose(file);
+        return NULL;
+    }
+    VideoRecorder* recorder =
+            new VideoRecorder(file, width, height, fps, usePbos);
+    bool ok = true;
+    for (int n = 0; n < kNumFrames && ok; ++n) {
+        recorder->m_frames[n].data =
+                static_cast<unsigned char*>(malloc(recorder->m_frameSize));
+        ok = recorder->m_frames[n].data != NULL;
+    }
+    // The 'C420jpeg' chroma siting matches the 2x2 block averages.
+    ok = ok && fprintf(file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n",
+                       recorder->m_frameWidth, recorder->m_frameHeight,
+                       fps) > 0;
+    ok = ok && recorder->initGL();
+    if (ok) {
+        recorder->m_writer = new Writer(recorder);
+        if (!recorder->m_writer->start()) {
+            delete recorder->m_writer;
+            recorder->m_writer = NULL;
+            ok = false;
+        }
+    }
+    if (!ok) {
+        ERR("%s: Could not start recording\n", __FUNCTION__);
+        recorder->releaseGL();
+        delete recorder;
+        return NULL;
+    }
+    return recorder;
+}
+
+VideoRecorder::VideoRecorder(FILE* file,
+                             int width,
+                             int height,
+                             int fps,
+                             bool usePbos) :
+        m_file(file),
+        m_width(width),
+        m_height(height),
+        m_frameWidth(width & ~7),
+        m_frameHeight(height & ~3),
+        m_fps(fps),
+        m_frameSize(m_frameWidth * m_frameHeight * 3 / 2),
+        m_startTimeNs(GetCurrentTimeNS()),
+        m_program(0),
+        m_vertexBuffer(0),
+        m_yuvTexture(0),
+        m_yuvFbo(0),
+        m_positionSlot(-1),
+        m_textureSlot(-1),
+        m_pboNext(0),
+        m_pboCount(0),
+        m_usePbos(usePbos),
+        m_writer(NULL),
+        m_lock("VideoRecorder::m_lock"),
+        m_cond(),
+        m_pending(-1),
+        m_current(-1),
+        m_writing(-1),
+        m_stopped(false),
+        m_failed(false),
+        m_writtenFrames(0),
+        m_droppedFrames(0) {
+    memset(m_pbos, 0, sizeof(m_pbos));
+    memset(m_frames, 0, sizeof(m_frames));
+}
+
+VideoRecorder::~VideoRecorder() {
+    finish();
+    for (int n = 0; n < kNumFrames; ++n) {
+        free(m_frames[n].data);
+    }
+    fclose(m_file);
+}
+
+void VideoRecorder::finish() {
+    if (!m_writer) {
+        return;
+    }
+    m_lock.lock();
+    m_stopped = true;
+    m_cond.signal();
+    m_lock.unlock();
+    m_writer->wait(NULL);
+    delete m_writer;
+    m_writer = NULL;
+}
+
+bool VideoRecorder::initGL() {
+    GLuint vertexShader = createShader(GL_VERTEX_SHADER, kVertexShaderSource);
+    GLuint fragmentShader =
+            createShader(GL_FRAGMENT_SHADER, kFragmentShaderSource);
+    if (!vertexShader || !fragmentShader) {
+        s_gles2.glDeleteShader(vertexShader);
+        s_gles2.glDeleteShader(fragmentShader);
+        return false;
+    }
+    m_program = s_gles2.glCreateProgram();
+    s_gles2.glAttachShader(m_program, vertexShader);
+    s_gles2.glAttachShader(m_program, fragmentShader);
+    s_gles2.glLinkProgram(m_program);
+    // The shaders are only deleted once the program is.
+    s_gles2.glDeleteShader(vertexShader);
+    s_gles2.glDeleteShader(fragmentShader);
+
+    GLint success;
+    s_gles2.glGetProgramiv(m_program, GL_LINK_STATUS, &success);
+    if (success == GL_FALSE) {
+        GLchar messages[256];
+        s_gles2.glGetProgramInfoLog(m_program, sizeof(messages), 0, messages);
+        ERR("%s: Could not link program: %s\n", __FUNCTION__, messages);
+        return false;
+    }
+    m_positionSlot = s_gles2.glGetAttribLocation(m_program, "position");
+    m_textureSlot = s_gles2.glGetUniformLocation(m_program, "texture");
+    s_gles2.glUseProgram(m_program);
+    s_gles2.glUniform2f(s_gles2.glGetUniformLocation(m_program, "frameSize"),
+                        m_width, m_height);
+    s_gles2.glUniform2f(s_gles2.glGetUniformLocation(m_program, "yuvSize"),
+                        m_frameWidth, m_frameHeight);
+
+    s_gles2.glGenBuffers(1, &m_vertexBuffer);
+    s_gles2.glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+    s_gles2.glBufferData(GL_ARRAY_BUFFER, sizeof(kQuad), kQuad,
+                         GL_STATIC_DRAW);
+    s_gles2.glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // The conversion target, see kFragmentShaderSource.
+    s_gles2.glGenTextures(1, &m_yuvTexture);
+    s_gles2.glBindTexture(GL_TEXTURE_2D, m_yuvTexture);
+    s_gles2.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    s_gles2.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    s_gles2.glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
+                         m_frameWidth / 4, m_frameHeight * 3 / 2, 0,
+                         GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    s_gles2.glBindTexture(GL_TEXTURE_2D, 0);
+
+    s_gles2.glGenFramebuffers(1, &m_yuvFbo);
+    s_gles2.glBindFramebuffer(GL_FRAMEBUFFER, m_yuvFbo);
+    s_gles2.glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                   GL_TEXTURE_2D, m_yuvTexture, 0);
+    GLenum status = s_gles2.glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    s_gles2.glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        ERR("%s: FBO not complete: %#x\n", __FUNCTION__, status);
+        return false;
+    }
+
+    if (m_usePbos) {
+        s_gles2.glGenBuffers(kNumPbos, m_pbos);
+        for (int n = 0; n < kNumPbos; ++n) {
+            s_gles2.glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pbos[n]);
+            s_gles2.glBufferData(GL_PIXEL_PACK_BUFFER, m_frameSize, NULL,
+                                 GL_STREAM_READ);
+        }
+        s_gles2.glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        if (s_gles2.glGetError() != GL_NO_ERROR) {
+            ERR("%s: Could not create pixel-pack buffers, using "
+                "synchronous readback\n", __FUNCTION__);
+            s_gles2.glDeleteBuffers(kNumPbos, m_pbos);
+            memset(m_pbos, 0, sizeof(m_pbos));
+            m_usePbos = false;
+        }
+    }
+    return s_gles2.glGetError() == GL_NO_ERROR;
+}
+
+void VideoRecorder::releaseGL() {
+    if (m_usePbos) {
+        s_gles2.glDeleteBuffers(kNumPbos, m_pbos);
+        memset(m_pbos, 0, sizeof(m_pbos));
+        m_pboCount = 0;
+    }
+    if (m_yuvFbo) {
+        s_gles2.glDeleteFramebuffers(1, &m_yuvFbo);
+        m_yuvFbo = 0;
+    }
+    if (m_yuvTexture) {
+        s_gles2.glDeleteTextures(1, &m_yuvTexture);
+        m_yuvTexture = 0;
+    }
+    if (m_vertexBuffer) {
+        s_gles2.glDeleteBuffers(1, &m_vertexBuffer);
+        m_vertexBuffer = 0;
+    }
+    if (m_program) {
+        s_gles2.glDeleteProgram(m_program);
+        m_program = 0;
+    }
+}
+
+int64_t VideoRecorder::currentFrameIndex() const {
+    return (GetCurrentTimeNS() - m_startTimeNs) * m_fps / 1000000000LL;
+}
+
+bool VideoRecorder::addFrame(GLuint texture) {
+    if (!m_program) {
+        return false;
+    }
+    if (!texture) {
+        if (m_pboCount) {
+            flushPbo();
+        }
+        return true;
+    }
+    int64_t index = currentFrameIndex();
+
+    GLint prevFbo = 0;
+    GLint prevViewport[4];
+    s_gles2.glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prevFbo);
+    s_gles2.glGetIntegerv(GL_VIEWPORT, prevViewport);
+
+    GLsizei width = m_frameWidth / 4;
+    GLsizei height = m_frameHeight * 3 / 2;
+    s_gles2.glBindFramebuffer(GL_FRAMEBUFFER, m_yuvFbo);
+    s_gles2.glViewport(0, 0, width, height);
+    s_gles2.glUseProgram(m_program);
+    s_gles2.glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+    s_gles2.glEnableVertexAttribArray(m_positionSlot);
+    s_gles2.glVertexAttribPointer(m_positionSlot, 2, GL_FLOAT, GL_FALSE,
+                                  0, 0);
+    s_gles2.glActiveTexture(GL_TEXTURE0);
+    s_gles2.glBindTexture(GL_TEXTURE_2D, texture);
+    s_gles2.glUniform1i(m_textureSlot, 0);
+    s_gles2.glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    s_gles2.glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    if (m_usePbos) {
+        // With a pixel-pack buffer bound, glReadPixels() returns without
+        // waiting for the GPU, and the frame is sent once the next one is
+        // read back.
+        s_gles2.glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pbos[m_pboNext]);
+        s_gles2.glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE,
+                             NULL);
+        s_gles2.glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        m_pboIndices[m_pboNext] = index;
+        m_pboNext = (m_pboNext + 1) % kNumPbos;
+        if (++m_pboCount == kNumPbos) {
+            flushPbo();
+        }
+    } else {
+        int n = acquireFrame();
+        if (n >= 0) {
+            s_gles2.glReadPixels(0, 0, width, height, GL_RGBA,
+                                 GL_UNSIGNED_BYTE, m_frames[n].data);
+            submitFrame(n, index);
+        }
+    }
+
+    s_gles2.glBindFramebuffer(GL_FRAMEBUFFER, prevFbo);
+    s_gles2.glViewport(prevViewport[0], prevViewport[1],
+                       prevViewport[2], prevViewport[3]);
+    return s_gles2.glGetError() == GL_NO_ERROR;
+}
+
+void VideoRecorder::flushPbo() {
+    int oldest = (m_pboNext + kNumPbos - m_pboCount) % kNumPbos;
+    m_pboCount--;
+    int n = acquireFrame();
+    if (n < 0) {
+        return;
+    }
+    s_gles2.glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pbos[oldest]);
+    void* pixels = s_gles2_extra.glMapBufferRange(
+            GL_PIXEL_PACK_BUFFER, 0, m_frameSize, GL_MAP_READ_BIT);
+    if (pixels) {
+        memcpy(m_frames[n].data, pixels, m_frameSize);
+        s_gles2_extra.glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        submitFrame(n, m_pboIndices[oldest]);
+    } else {
+        ERR("%s: Could not map pixel-pack buffer\n", __FUNCTION__);
+    }
+    s_gles2.glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void VideoRecorder::stop() {
+    if (m_pboCount) {
+        flushPbo();
+    }
+    releaseGL();
+}
+
+int VideoRecorder::acquireFrame() {
+    emugl::Mutex::AutoLock lock(m_lock);
+    if (m_failed) {
+        return -1;
+    }
+    // The writer only uses |m_pending|, |m_current| and |m_writing|, so
+    // the other frames stay free until submitFrame() is called.
+    for (int n = 0; n < kNumFrames; ++n) {
+        if (n != m_pending && n != m_current && n != m_writing) {
+            return n;
+        }
+    }
+    return -1;
+}
+
+void VideoRecorder::submitFrame(int n, int64_t index) {
+    emugl::Mutex::AutoLock lock(m_lock);
+    m_frames[n].index = index;
+    if (m_pending >= 0) {
+        m_droppedFrames++;
+    }
+    m_pending = n;
+    m_cond.signal();
+}
+
+void VideoRecorder::getStats(uint64_t* writtenFrames,
+                             uint64_t* droppedFrames) {
+    emugl::Mutex::AutoLock lock(m_lock);
+    *writtenFrames = m_writtenFrames;
+    *droppedFrames = m_droppedFrames;
+}
+
+bool VideoRecorder::writeFrame(const Frame& frame) {
+    static const char kFrameHeader[] = "FRAME\n";
+    return fwrite(kFrameHeader, sizeof(kFrameHeader) - 1, 1, m_file) == 1 &&
+           fwrite(frame.data, m_frameSize, 1, m_file) == 1;
+}
+
+// Each frame is written once the next one arrives, as many times as the
+// number of frame intervals between them. The last one is written once,
+// when recording stops.
+void VideoRecorder::writeLoop() {
+    m_lock.lock();
+    for (;;) {
+        while (m_pending < 0 && !m_stopped) {
+            m_cond.wait(&m_lock);
+        }
+        int next = m_pending;
+        int previous = m_current;
+        int64_t count = 1;
+        if (previous >= 0 && next >= 0) {
+            count = m_frames[next].index - m_frames[previous].index;
+            if (!count) {
+                // Both frames were displayed during the same interval.
+                m_droppedFrames++;
+            }
+        }
+        m_pending = -1;
+        m_current = next;
+        m_writing = previous;
+        m_lock.unlock();
+
+        bool ok = true;
+        int64_t written = 0;
+        if (previous >= 0) {
+            while (written < count && (ok = writeFrame(m_frames[previous]))) {
+                written++;
+            }
+        }
+
+        m_lock.lock();
+        m_writing = -1;
+        m_writtenFrames += written;
+        if (!ok) {
+            ERR("%s: Could not write frame, recording stopped\n",
+                __FUNCTION__);
+            m_failed = true;
+            m_current = -1;
+            break;
+        }
+        if (next < 0) {
+            // Stopped, and the last frame was written.
+            break;
+        }
+    }
+    m_lock.unlock();
+    fflush(m_file);
+}
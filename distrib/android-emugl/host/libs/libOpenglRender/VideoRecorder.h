@@ -0,0 +1,155 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#ifndef _LIB_OPENGL_RENDER_VIDEO_RECORDER_H
+#define _LIB_OPENGL_RENDER_VIDEO_RECORDER_H
+
+#include "emugl/common/condition_variable.h"
+#include "emugl/common/mutex.h"
+
+#include <GLES2/gl2.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Records the frames posted to the emulated display as an uncompressed
+// YUV4MPEG2 (.y4m) stream, which external encoders can read directly, e.g.:
+//
+//     mkfifo /tmp/screen.y4m
+//     ffmpeg -i /tmp/screen.y4m -c:v libx264 screen.mp4
+//
+// Each frame is converted to planar YUV 4:2:0 on the GPU, by rendering the
+// posted texture into an offscreen buffer with a shader, so that only 12
+// bits per pixel are read back and the CPU never touches RGB pixels. When
+// pixel-pack buffer objects are supported, the readback is asynchronous
+// too, and a frame reaches the file one post later.
+//
+// The stream has a constant frame rate: a frame that stays on screen for
+// several frame intervals is repeated. Writing happens on a dedicated
+// thread, and frames are dropped if it can't keep up (e.g. because the
+// reader of a pipe is slow), so that recording never slows the display.
+//
+// Frame dimensions are rounded down to multiples of 8 x 4 pixels, by
+// cropping the right and bottom edges.
+class VideoRecorder {
+public:
+    // Create a new instance that writes to |file|, for frames of |width| x
+    // |height| pixels at |fps| frames per second. The instance takes
+    // ownership of |file|, which is closed on failure too. |usePbos| must
+    // be true only if pixel-pack buffer objects can be used for
+    // asynchronous readback. The FrameBuffer context must be current.
+    // Return NULL on failure.
+    static VideoRecorder* create(FILE* file,
+                                 int width,
+                                 int height,
+                                 int fps,
+                                 bool usePbos);
+
+    // Call finish(), and close the file.
+    ~VideoRecorder();
+
+    // Record the content of |texture|, the name of a GLES 2.x texture that
+    // is scaled to the frame dimensions, as the frame displayed from now on.
+    // If |texture| is 0, nothing new is recorded, but a frame that is still
+    // being read back is sent to the file. The FrameBuffer context must be
+    // current. Return false on failure.
+    bool addFrame(GLuint texture);
+
+    // Send the last frame that is being read back to the writer, and
+    // release the GL resources. The FrameBuffer context must be current.
+    void stop();
+
+    // Wait until all frames are written. This doesn't require a GL context,
+    // but stop() must have been called before.
+    void finish();
+
+    // Return the number of frames written to the file so far, including
+    // repeated ones, and the number of posted frames that were dropped.
+    void getStats(uint64_t* writtenFrames, uint64_t* droppedFrames);
+
+private:
+    class Writer;
+
+    // A buffer holding one frame in I420 format.
+    struct Frame {
+        unsigned char* data;
+        // Frame index, in frame intervals since recording started.
+        int64_t index;
+    };
+
+    static const int kNumFrames = 4;
+    static const int kNumPbos = 2;
+
+    VideoRecorder(FILE* file, int width, int height, int fps, bool usePbos);
+
+    bool initGL();
+    void releaseGL();
+
+    // Return the index of the frame displayed at the current time.
+    int64_t currentFrameIndex() const;
+
+    // Return the index of a frame buffer that the writer doesn't use, or
+    // -1 if writing failed.
+    int acquireFrame();
+
+    // Hand the frame buffer |n|, displayed from frame |index| on, to the
+    // writer. This replaces the pending frame, if any.
+    void submitFrame(int n, int64_t index);
+
+    // Send the frame held by the oldest pixel-pack buffer to the writer.
+    void flushPbo();
+
+    void writeLoop();
+    bool writeFrame(const Frame& frame);
+
+    FILE* m_file;
+    int m_width;
+    int m_height;
+    int m_frameWidth;
+    int m_frameHeight;
+    int m_fps;
+    size_t m_frameSize;
+    long long m_startTimeNs;
+
+    // GL resources, only used with the FrameBuffer context current.
+    GLuint m_program;
+    GLuint m_vertexBuffer;
+    GLuint m_yuvTexture;
+    GLuint m_yuvFbo;
+    GLint m_positionSlot;
+    GLint m_textureSlot;
+    GLuint m_pbos[kNumPbos];
+    int64_t m_pboIndices[kNumPbos];
+    int m_pboNext;
+    int m_pboCount;
+    bool m_usePbos;
+
+    // The writer thread, and the frames exchanged with it. |m_pending| is
+    // the latest frame to write, and |m_current| and |m_writing| are the
+    // ones the writer uses, or -1. All other frames are free.
+    Writer* m_writer;
+    emugl::Mutex m_lock;
+    emugl::ConditionVariable m_cond;
+    Frame m_frames[kNumFrames];
+    int m_pending;
+    int m_current;
+    int m_writing;
+    bool m_stopped;
+    bool m_failed;
+    uint64_t m_writtenFrames;
+    uint64_t m_droppedFrames;
+};
+
+#endif
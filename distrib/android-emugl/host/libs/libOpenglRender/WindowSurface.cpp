@@ -110,10 +110,14 @@ bool WindowSurface::flushColorBuffer() {
     EGLSurface prevReadSurf = s_egl.eglGetCurrentSurface(EGL_READ);
     EGLSurface prevDrawSurf = s_egl.eglGetCurrentSurface(EGL_DRAW);
 
-    if (!s_egl.eglMakeCurrent(mDisplay,
-                              mSurface,
-                              mSurface,
-                              mDrawContext->getEGLContext())) {
+    // This is usually called by the guest's eglSwapBuffers(), with the
+    // surface current already.
+    bool switchContext = prevContext != mDrawContext->getEGLContext() ||
+                         prevReadSurf != mSurface || prevDrawSurf != mSurface;
+    if (switchContext && !s_egl.eglMakeCurrent(mDisplay,
+                                               mSurface,
+                                               mSurface,
+                                               mDrawContext->getEGLContext())) {
         fprintf(stderr, "Error making draw context current\n");
         return false;
     }
@@ -121,7 +125,10 @@ bool WindowSurface::flushColorBuffer() {
     mAttachedColorBuffer->blitFromCurrentReadBuffer();
 
     // restore current context/surface
-    s_egl.eglMakeCurrent(mDisplay, prevDrawSurf, prevReadSurf, prevContext);
+    if (switchContext) {
+        s_egl.eglMakeCurrent(mDisplay, prevDrawSurf, prevReadSurf,
+                             prevContext);
+    }
 
     return true;
 }
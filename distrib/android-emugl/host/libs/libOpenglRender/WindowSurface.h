@@ -19,14 +19,14 @@
 #include "ColorBuffer.h"
 #include "RenderContext.h"
 
-#include "emugl/common/smart_ptr.h"
+#include "emugl/common/ref_counted.h"
 
 #include <EGL/egl.h>
 #include <GLES/gl.h>
 
 // A class used to model a guest-side window surface. The implementation
 // uses a host Pbuffer to act as the EGL rendering surface instead.
-class WindowSurface {
+class WindowSurface : public emugl::RefCounted {
 public:
     // Create a new WindowSurface instance.
     // |display| is the host EGLDisplay value.
@@ -98,6 +98,6 @@ private:
     EGLDisplay mDisplay;
 };
 
-typedef emugl::SmartPtr<WindowSurface> WindowSurfacePtr;
+typedef emugl::RefPtr<WindowSurface> WindowSurfacePtr;
 
 #endif  // _LIBRENDER_WINDOW_SURFACE_H
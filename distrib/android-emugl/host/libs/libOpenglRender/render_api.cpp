@@ -15,7 +15,12 @@
 */
 #include "render_api.h"
 
+#include "DecoderStats.h"
+#include "FbConfigCache.h"
+#include "FrameBuffer.h"
+#include "FrameStats.h"
 #include "IOStream.h"
+#include "RenderChannel.h"
 #include "RenderServer.h"
 #include "RenderWindow.h"
 #include "TimeUtils.h"
@@ -31,6 +36,8 @@
 #include "GLESv1Dispatch.h"
 #include "GLESv2Dispatch.h"
 
+#include "emugl/common/lock_profiler.h"
+
 #include <string.h>
 
 static RenderServer* s_renderThread = NULL;
@@ -41,6 +48,8 @@ static RenderWindow* s_renderWindow = NULL;
 static IOStream *createRenderThread(int p_stream_buffer_size,
                                     unsigned int clientFlags);
 
+extern "C" int gRendererStreamMode;
+
 RENDER_APICALL int RENDER_APIENTRY initLibrary(void)
 {
     //
@@ -154,8 +163,18 @@ RENDER_APICALL int RENDER_APIENTRY stopOpenGLRenderer(void)
     // open a dummy connection to the renderer to make it
     // realize the exit request.
     // (send the exit request in clientFlags)
-    IOStream *dummy = createRenderThread(8, IOSTREAM_CLIENT_EXIT_SERVER);
-    if (!dummy) return false;
+    IOStream *dummy = NULL;
+    RenderChannel *dummyChannel = NULL;
+    if (gRendererStreamMode == STREAM_MODE_SHMEM) {
+        if (!s_renderThread) return false;
+        dummyChannel = s_renderThread->openChannel(NULL, NULL);
+        if (!dummyChannel) return false;
+        unsigned int clientFlags = IOSTREAM_CLIENT_EXIT_SERVER;
+        dummyChannel->guestWrite(&clientFlags, sizeof(clientFlags));
+    } else {
+        dummy = createRenderThread(8, IOSTREAM_CLIENT_EXIT_SERVER);
+        if (!dummy) return false;
+    }
 
     if (s_renderThread) {
         // wait for the thread to exit
@@ -181,6 +200,9 @@ RENDER_APICALL int RENDER_APIENTRY stopOpenGLRenderer(void)
     // }
 
     delete dummy;
+    if (dummyChannel) {
+        dummyChannel->guestClose();
+    }
 
     return ret;
 }
@@ -249,6 +271,186 @@ RENDER_APICALL void RENDER_APIENTRY repaintOpenGLDisplay(void)
 }
 
 
+RENDER_APICALL void RENDER_APIENTRY setOpenGLSkinLayer(
+        int id, const void* pixels, int width, int height,
+        int x, int y, int dstWidth, int dstHeight)
+{
+    RenderWindow* window = s_renderWindow;
+
+    if (window) {
+        window->setSkinLayer(id, pixels, width, height,
+                             x, y, dstWidth, dstHeight);
+        return;
+    }
+    ERR("%s not implemented for separate renderer process !!!\n",
+            __FUNCTION__);
+}
+
+RENDER_APICALL void RENDER_APIENTRY showOpenGLSkinLayer(int id, bool visible)
+{
+    RenderWindow* window = s_renderWindow;
+
+    if (window) {
+        window->showSkinLayer(id, visible);
+        return;
+    }
+    ERR("%s not implemented for separate renderer process !!!\n",
+            __FUNCTION__);
+}
+
+RENDER_APICALL void RENDER_APIENTRY setOpenGLSkinDisplayRect(
+        int x, int y, int width, int height)
+{
+    RenderWindow* window = s_renderWindow;
+
+    if (window) {
+        window->setSkinDisplayRect(x, y, width, height);
+        return;
+    }
+    ERR("%s not implemented for separate renderer process !!!\n",
+            __FUNCTION__);
+}
+
+RENDER_APICALL bool RENDER_APIENTRY startOpenGLVideoRecording(
+        const char* path, int fps)
+{
+    RenderWindow* window = s_renderWindow;
+
+    if (window) {
+        return window->startVideoRecording(path, fps);
+    }
+    ERR("%s not implemented for separate renderer process !!!\n",
+            __FUNCTION__);
+    return false;
+}
+
+RENDER_APICALL bool RENDER_APIENTRY stopOpenGLVideoRecording(
+        uint64_t* writtenFrames, uint64_t* droppedFrames)
+{
+    RenderWindow* window = s_renderWindow;
+
+    if (window) {
+        return window->stopVideoRecording(writtenFrames, droppedFrames);
+    }
+    ERR("%s not implemented for separate renderer process !!!\n",
+            __FUNCTION__);
+    return false;
+}
+
+RENDER_APICALL void RENDER_APIENTRY enableOpenGLDecoderStats(bool enable)
+{
+    DecoderStats::get()->setEnabled(enable);
+}
+
+RENDER_APICALL size_t RENDER_APIENTRY getOpenGLDecoderStats(
+        char* buffer, size_t bufferSize)
+{
+    return DecoderStats::get()->print(buffer, bufferSize);
+}
+
+RENDER_APICALL void RENDER_APIENTRY enableOpenGLFrameStats(bool enable)
+{
+    FrameStats::get()->setEnabled(enable);
+}
+
+RENDER_APICALL size_t RENDER_APIENTRY getOpenGLFrameStats(
+        char* buffer, size_t bufferSize)
+{
+    return FrameStats::get()->print(buffer, bufferSize);
+}
+
+RENDER_APICALL size_t RENDER_APIENTRY getOpenGLLockStats(
+        char* buffer, size_t bufferSize)
+{
+    return emugl::LockSite::printAll(buffer, bufferSize);
+}
+
+RENDER_APICALL void RENDER_APIENTRY resetOpenGLLockStats(void)
+{
+    emugl::LockSite::resetAll();
+}
+
+RENDER_APICALL uint64_t RENDER_APIENTRY getOpenGLReadbackMemory(void)
+{
+    FrameBuffer* fb = FrameBuffer::getFB();
+    return fb ? fb->getReadbackMemory() : 0;
+}
+
+RENDER_APICALL void RENDER_APIENTRY getOpenGLColorBufferPoolStats(
+        uint64_t* hits, uint64_t* misses, uint64_t* pooledBytes,
+        uint64_t* maxBytes)
+{
+    FrameBuffer* fb = FrameBuffer::getFB();
+    if (!fb) {
+        *hits = *misses = *pooledBytes = *maxBytes = 0;
+        return;
+    }
+    fb->getColorBufferPoolStats(hits, misses, pooledBytes, maxBytes);
+}
+
+RENDER_APICALL int RENDER_APIENTRY createOpenGLDisplay(int width, int height)
+{
+    FrameBuffer* fb = FrameBuffer::getFB();
+    return fb ? fb->addDisplay(width, height) : 0;
+}
+
+RENDER_APICALL bool RENDER_APIENTRY setOpenGLDisplayPostCallback(
+        int display, OnPostFn onPost, void* onPostContext)
+{
+    FrameBuffer* fb = FrameBuffer::getFB();
+    return fb && fb->setDisplayPostCallback(display, onPost, onPostContext);
+}
+
+RENDER_APICALL void RENDER_APIENTRY setOpenGLFrameRateLimit(int fps)
+{
+    FrameBuffer* fb = FrameBuffer::getFB();
+    if (fb) {
+        fb->setFrameRateLimit(fps);
+    }
+}
+
+RENDER_APICALL void* RENDER_APIENTRY openRenderChannel(
+        RenderChannelCallback callback, void* opaque)
+{
+    if (!s_renderThread) {
+        ERR("%s: renderer is not started\n", __FUNCTION__);
+        return NULL;
+    }
+    return s_renderThread->openChannel(callback, opaque);
+}
+
+RENDER_APICALL int RENDER_APIENTRY writeRenderChannel(
+        void* channel, const RenderChannelBuffer* buffers, int numBuffers)
+{
+    return static_cast<RenderChannel*>(channel)->guestWriteBuffers(
+            reinterpret_cast<const RenderChannel::Buffer*>(buffers),
+            numBuffers);
+}
+
+RENDER_APICALL int RENDER_APIENTRY readRenderChannel(
+        void* channel, const RenderChannelBuffer* buffers, int numBuffers)
+{
+    return static_cast<RenderChannel*>(channel)->guestReadBuffers(
+            reinterpret_cast<const RenderChannel::Buffer*>(buffers),
+            numBuffers);
+}
+
+RENDER_APICALL unsigned RENDER_APIENTRY pollRenderChannel(void* channel)
+{
+    return static_cast<RenderChannel*>(channel)->guestPoll();
+}
+
+RENDER_APICALL void RENDER_APIENTRY wakeOnRenderChannel(
+        void* channel, unsigned events)
+{
+    static_cast<RenderChannel*>(channel)->guestWakeOn(events);
+}
+
+RENDER_APICALL void RENDER_APIENTRY closeRenderChannel(void* channel)
+{
+    static_cast<RenderChannel*>(channel)->guestClose();
+}
+
 /* NOTE: For now, always use TCP mode by default, until the emulator
  *        has been updated to support Unix and Win32 pipes
  */
@@ -308,6 +510,8 @@ RENDER_APICALL int RENDER_APIENTRY setStreamMode(int mode)
         case STREAM_MODE_PIPE:
             break;
 #endif /* _WIN32 */
+        case STREAM_MODE_SHMEM:
+            break;
         default:
             // Invalid stream mode
             return false;
@@ -315,3 +519,8 @@ RENDER_APICALL int RENDER_APIENTRY setStreamMode(int mode)
     gRendererStreamMode = mode;
     return true;
 }
+
+RENDER_APICALL void RENDER_APIENTRY setOpenGLConfigCachePath(const char* path)
+{
+    FbConfigCache::setPath(path);
+}
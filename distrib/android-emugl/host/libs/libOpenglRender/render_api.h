@@ -44,6 +44,12 @@ extern "C" {
 #define STREAM_MODE_TCP       1
 #define STREAM_MODE_UNIX      2
 #define STREAM_MODE_PIPE      3
+#define STREAM_MODE_SHMEM     4
+
+/* list of event flags used with render channels */
+#define RENDER_CHANNEL_CAN_READ   (1 << 0)
+#define RENDER_CHANNEL_CAN_WRITE  (1 << 1)
+#define RENDER_CHANNEL_CLOSED     (1 << 2)
 
 
 #define RENDER_API_DECLARE(return_type, func_name, signature) \
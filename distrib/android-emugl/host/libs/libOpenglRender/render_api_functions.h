@@ -8,11 +8,19 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+typedef void (*RenderChannelCallback)(void* opaque, unsigned events);
+typedef struct {
+    void* data;
+    size_t size;
+} RenderChannelBuffer;
 typedef void (*OnPostFn)(void* context, int width, int height, int ydir,
-                         int format, int type, unsigned char* pixels);
+                         int format, int type, unsigned char* pixels,
+                         int damageX, int damageY,
+                         int damageWidth, int damageHeight);
 #define LIST_RENDER_API_FUNCTIONS(X) \
   X(int, initLibrary, ()) \
   X(int, setStreamMode, (int mode)) \
+  X(void, setOpenGLConfigCachePath, (const char* path)) \
   X(int, initOpenGLRenderer, (int width, int height, bool useSubWindow, char* addr, size_t addrLen)) \
   X(void, getHardwareStrings, (const char** vendor, const char** renderer, const char** version)) \
   X(void, setPostCallback, (OnPostFn onPost, void* onPostContext)) \
@@ -20,6 +28,28 @@ typedef void (*OnPostFn)(void* context, int width, int height, int ydir,
   X(bool, destroyOpenGLSubwindow, ()) \
   X(void, setOpenGLDisplayRotation, (float zRot)) \
   X(void, repaintOpenGLDisplay, ()) \
+  X(void, setOpenGLSkinLayer, (int id, const void* pixels, int width, int height, int x, int y, int dstWidth, int dstHeight)) \
+  X(void, showOpenGLSkinLayer, (int id, bool visible)) \
+  X(void, setOpenGLSkinDisplayRect, (int x, int y, int width, int height)) \
+  X(bool, startOpenGLVideoRecording, (const char* path, int fps)) \
+  X(bool, stopOpenGLVideoRecording, (uint64_t* writtenFrames, uint64_t* droppedFrames)) \
+  X(void, enableOpenGLDecoderStats, (bool enable)) \
+  X(size_t, getOpenGLDecoderStats, (char* buffer, size_t bufferSize)) \
+  X(void, enableOpenGLFrameStats, (bool enable)) \
+  X(size_t, getOpenGLFrameStats, (char* buffer, size_t bufferSize)) \
+  X(size_t, getOpenGLLockStats, (char* buffer, size_t bufferSize)) \
+  X(void, resetOpenGLLockStats, (void)) \
+  X(uint64_t, getOpenGLReadbackMemory, (void)) \
+  X(void, getOpenGLColorBufferPoolStats, (uint64_t* hits, uint64_t* misses, uint64_t* pooledBytes, uint64_t* maxBytes)) \
+  X(int, createOpenGLDisplay, (int width, int height)) \
+  X(bool, setOpenGLDisplayPostCallback, (int display, OnPostFn onPost, void* onPostContext)) \
+  X(void, setOpenGLFrameRateLimit, (int fps)) \
+  X(void*, openRenderChannel, (RenderChannelCallback callback, void* opaque)) \
+  X(int, writeRenderChannel, (void* channel, const RenderChannelBuffer* buffers, int numBuffers)) \
+  X(int, readRenderChannel, (void* channel, const RenderChannelBuffer* buffers, int numBuffers)) \
+  X(unsigned, pollRenderChannel, (void* channel)) \
+  X(void, wakeOnRenderChannel, (void* channel, unsigned events)) \
+  X(void, closeRenderChannel, (void* channel)) \
   X(int, stopOpenGLRenderer, ()) \
 
 
@@ -730,9 +730,42 @@ int ApiGen::genDecoderHeader(const std::string &filename)
     }
     fprintf(fp, "\n");
 
+    if (m_decoderStats) {
+        fprintf(fp, "#include <stdint.h>\n\n");
+    }
+
     fprintf(fp, "struct %s : public %s_%s_context_t {\n\n",
             classname.c_str(), m_basename.c_str(), sideString(SERVER_SIDE));
+    if (m_decoderStats) {
+        fprintf(fp, "\t%s() : m_opStats(NULL) {}\n\n", classname.c_str());
+    }
     fprintf(fp, "\tsize_t decode(void *buf, size_t bufsize, IOStream *stream);\n");
+    fprintf(fp, "\n\t// Return true iff |opcode| is handled by this decoder.\n");
+    fprintf(fp, "\tstatic bool isDecoderOpcode(unsigned int opcode) {\n");
+    fprintf(fp, "\t\treturn opcode >= %uU && opcode < %uU;\n",
+            (unsigned int)m_baseOpcode,
+            (unsigned int)size() + m_baseOpcode);
+    fprintf(fp, "\t}\n");
+    if (m_decoderStats) {
+        fprintf(fp, "\n\tenum {\n");
+        fprintf(fp, "\t\tOPCODE_BASE = %u,\n", (unsigned int)m_baseOpcode);
+        fprintf(fp, "\t\tOPCODE_COUNT = %u\n", (unsigned int)size());
+        fprintf(fp, "\t};\n\n");
+        fprintf(fp, "\t// Statistics of an opcode. The time covers both decoding and dispatch.\n");
+        fprintf(fp, "\tstruct OpStats {\n");
+        fprintf(fp, "\t\tuint64_t calls;\n");
+        fprintf(fp, "\t\tuint64_t bytes;\n");
+        fprintf(fp, "\t\tuint64_t timeNs;\n");
+        fprintf(fp, "\t};\n\n");
+        fprintf(fp, "\t// Start adding the statistics of each decoded packet to |stats|, an\n");
+        fprintf(fp, "\t// array of OPCODE_COUNT items indexed by (opcode - OPCODE_BASE), or stop\n");
+        fprintf(fp, "\t// if it is NULL.\n");
+        fprintf(fp, "\tvoid setOpStats(OpStats *stats) { m_opStats = stats; }\n\n");
+        fprintf(fp, "\t// Return the name of |opcode|, or NULL if it's not handled by this decoder.\n");
+        fprintf(fp, "\tstatic const char *opcodeName(unsigned int opcode);\n\n");
+        fprintf(fp, "private:\n");
+        fprintf(fp, "\tOpStats *m_opStats;\n");
+    }
     fprintf(fp, "\n};\n\n");
     fprintf(fp, "#endif  // GUARD_%s\n", classname.c_str());
 
@@ -789,6 +822,9 @@ int ApiGen::genDecoderImpl(const std::string &filename)
     fprintf(fp, "#include \"%s_opcodes.h\"\n\n", m_basename.c_str());
     fprintf(fp, "#include \"%s_dec.h\"\n\n\n", m_basename.c_str());
     fprintf(fp, "#include \"ProtocolUtils.h\"\n\n");
+    if (m_decoderStats) {
+        fprintf(fp, "#include \"TimeUtils.h\"\n\n");
+    }
     fprintf(fp, "#include <stdio.h>\n\n");
     fprintf(fp, "typedef unsigned int tsize_t; // Target \"size_t\", which is 32-bit for now. It may or may not be the same as host's size_t when emugen is compiled.\n\n");
 
@@ -810,6 +846,19 @@ int ApiGen::genDecoderImpl(const std::string &filename)
     // helper templates
     fprintf(fp, "using namespace emugl;\n\n");
 
+    if (m_decoderStats) {
+        fprintf(fp, "static const char *const kOpcodeNames[] = {\n");
+        for (size_t i = 0; i < size(); i++) {
+            fprintf(fp, "\t\"%s\",\n", at(i).name().c_str());
+        }
+        fprintf(fp, "};\n\n");
+
+        fprintf(fp, "const char *%s::opcodeName(unsigned int opcode)\n{\n", classname.c_str());
+        fprintf(fp, "\tif (!isDecoderOpcode(opcode)) return NULL;\n");
+        fprintf(fp, "\treturn kOpcodeNames[opcode - OPCODE_BASE];\n");
+        fprintf(fp, "}\n\n");
+    }
+
     // decoder switch;
     fprintf(fp, "size_t %s::decode(void *buf, size_t len, IOStream *stream)\n{\n", classname.c_str());
     fprintf(fp,
@@ -824,8 +873,11 @@ int ApiGen::genDecoderImpl(const std::string &filename)
 \twhile ((len - pos >= 8) && !unknownOpcode) {   \n\
 \t\tuint32_t opcode = *(uint32_t *)ptr;   \n\
 \t\tsize_t packetLen = *(uint32_t *)(ptr + 4);\n\
-\t\tif (len - pos < packetLen)  return pos; \n\
-\t\tswitch(opcode) {\n");
+\t\tif (len - pos < packetLen)  return pos; \n");
+    if (m_decoderStats) {
+        fprintf(fp, "\t\tlong long statsTime = m_opStats ? GetCurrentTimeNS() : 0;\n");
+    }
+    fprintf(fp, "\t\tswitch(opcode) {\n");
 
     for (size_t f = 0; f < n; f++) {
         enum Pass_t {
@@ -936,11 +988,18 @@ int ApiGen::genDecoderImpl(const std::string &filename)
                     v->pointerDir() == Var::POINTER_INOUT) {
                     if (pass == PASS_VariableDeclarations) {
 #if USE_ALIGNED_BUFFERS
+                        // Large input buffers (e.g. texture pixels) are only
+                        // read by the backend, and don't need to be aligned.
+                        // Pass a direct pointer into the stream buffer for
+                        // them instead of a heap-allocated aligned copy.
+                        bool direct = v->isLarge() &&
+                                v->pointerDir() == Var::POINTER_IN;
                         fprintf(fp,
-                                "\t\t\tInputBuffer inptr_%s(ptr + %s + 4, size_%s);\n",
+                                "\t\t\tInputBuffer inptr_%s(ptr + %s + 4, size_%s%s);\n",
                                 var_name,
                                 varoffset.c_str(),
-                                var_name);
+                                var_name,
+                                direct ? ", 1" : "");
                     }
                     if (pass == PASS_FunctionCall) {
                         if (v->nullAllowed()) {
@@ -1121,6 +1180,14 @@ int ApiGen::genDecoderImpl(const std::string &filename)
     }
 
     fprintf(fp, "\t\tif (!unknownOpcode) {\n");
+    if (m_decoderStats) {
+        fprintf(fp, "\t\t\tif (m_opStats) {\n");
+        fprintf(fp, "\t\t\t\tOpStats *s = &m_opStats[opcode - OPCODE_BASE];\n");
+        fprintf(fp, "\t\t\t\ts->calls++;\n");
+        fprintf(fp, "\t\t\t\ts->bytes += packetLen;\n");
+        fprintf(fp, "\t\t\t\ts->timeNs += (uint64_t)(GetCurrentTimeNS() - statsTime);\n");
+        fprintf(fp, "\t\t\t}\n");
+    }
     fprintf(fp, "\t\t\tpos += packetLen;\n");
     fprintf(fp, "\t\t\tptr += packetLen;\n");
     fprintf(fp, "\t\t}\n");
@@ -1132,6 +1199,112 @@ int ApiGen::genDecoderImpl(const std::string &filename)
     return 0;
 }
 
+int ApiGen::genReplayHeader(const std::string &filename)
+{
+    FILE *fp = fopen(filename.c_str(), "wt");
+    if (fp == NULL) {
+        perror(filename.c_str());
+        return -1;
+    }
+
+    printHeader(fp);
+    std::string classname = m_basename + "_replay_t";
+
+    fprintf(fp, "\n#ifndef GUARD_%s\n", classname.c_str());
+    fprintf(fp, "#define GUARD_%s\n\n", classname.c_str());
+
+    fprintf(fp, "#include \"IOStream.h\"\n");
+    fprintf(fp, "#include \"%s_dec.h\"\n\n", m_basename.c_str());
+    fprintf(fp, "#include <stdint.h>\n\n");
+
+    fprintf(fp, "// Feeds packets to a %s_decoder_context_t one at a time, and records\n", m_basename.c_str());
+    fprintf(fp, "// the number of calls, bytes and decoding time of each opcode.\n");
+    fprintf(fp, "struct %s {\n\n", classname.c_str());
+    fprintf(fp, "\tenum {\n");
+    fprintf(fp, "\t\tOPCODE_BASE = %u,\n", (unsigned int)m_baseOpcode);
+    fprintf(fp, "\t\tOPCODE_COUNT = %u\n", (unsigned int)size());
+    fprintf(fp, "\t};\n\n");
+    fprintf(fp, "\tstruct OpStats {\n");
+    fprintf(fp, "\t\tuint64_t calls;\n");
+    fprintf(fp, "\t\tuint64_t bytes;\n");
+    fprintf(fp, "\t\tuint64_t timeNs;\n");
+    fprintf(fp, "\t};\n\n");
+    fprintf(fp, "\t%s() { reset(); }\n\n", classname.c_str());
+    fprintf(fp, "\t// Decode all consecutive complete packets of this API at the start of\n");
+    fprintf(fp, "\t// |buf|, and return the number of bytes consumed.\n");
+    fprintf(fp, "\tsize_t replay(%s_decoder_context_t *decoder, void *buf, size_t bufsize, IOStream *stream);\n\n",
+            m_basename.c_str());
+    fprintf(fp, "\t// Return the statistics of |opcode|, which must be handled by this API.\n");
+    fprintf(fp, "\tconst OpStats &stats(unsigned int opcode) const { return m_stats[opcode - OPCODE_BASE]; }\n\n");
+    fprintf(fp, "\tvoid reset();\n\n");
+    fprintf(fp, "\t// Return the name of |opcode|, or NULL if it's not handled by this API.\n");
+    fprintf(fp, "\tstatic const char *opcodeName(unsigned int opcode);\n\n");
+    fprintf(fp, "private:\n");
+    fprintf(fp, "\tOpStats m_stats[OPCODE_COUNT];\n");
+    fprintf(fp, "};\n\n");
+    fprintf(fp, "#endif  // GUARD_%s\n", classname.c_str());
+
+    fclose(fp);
+    return 0;
+}
+
+int ApiGen::genReplayImpl(const std::string &filename)
+{
+    FILE *fp = fopen(filename.c_str(), "wt");
+    if (fp == NULL) {
+        perror(filename.c_str());
+        return -1;
+    }
+
+    printHeader(fp);
+    std::string classname = m_basename + "_replay_t";
+
+    fprintf(fp, "\n\n#include <string.h>\n");
+    fprintf(fp, "#include \"%s_replay.h\"\n\n", m_basename.c_str());
+    fprintf(fp, "#include \"TimeUtils.h\"\n\n");
+
+    fprintf(fp, "static const char *const kOpcodeNames[] = {\n");
+    for (size_t i = 0; i < size(); i++) {
+        fprintf(fp, "\t\"%s\",\n", at(i).name().c_str());
+    }
+    fprintf(fp, "};\n\n");
+
+    fprintf(fp, "const char *%s::opcodeName(unsigned int opcode)\n{\n", classname.c_str());
+    fprintf(fp, "\tif (!%s_decoder_context_t::isDecoderOpcode(opcode)) return NULL;\n", m_basename.c_str());
+    fprintf(fp, "\treturn kOpcodeNames[opcode - OPCODE_BASE];\n");
+    fprintf(fp, "}\n\n");
+
+    fprintf(fp, "void %s::reset()\n{\n", classname.c_str());
+    fprintf(fp, "\tmemset(m_stats, 0, sizeof(m_stats));\n");
+    fprintf(fp, "}\n\n");
+
+    fprintf(fp, "size_t %s::replay(%s_decoder_context_t *decoder, void *buf, size_t bufsize, IOStream *stream)\n{\n",
+            classname.c_str(), m_basename.c_str());
+    fprintf(fp, "\tsize_t pos = 0;\n");
+    fprintf(fp, "\tunsigned char *ptr = (unsigned char *)buf;\n");
+    fprintf(fp, "\twhile (bufsize - pos >= 8) {\n");
+    fprintf(fp, "\t\tuint32_t opcode = *(uint32_t *)ptr;\n");
+    fprintf(fp, "\t\tsize_t packetLen = *(uint32_t *)(ptr + 4);\n");
+    fprintf(fp, "\t\tif (!%s_decoder_context_t::isDecoderOpcode(opcode)) break;\n", m_basename.c_str());
+    fprintf(fp, "\t\tif (packetLen < 8 || bufsize - pos < packetLen) break;\n");
+    fprintf(fp, "\t\tlong long t0 = GetCurrentTimeNS();\n");
+    fprintf(fp, "\t\tsize_t last = decoder->decode(ptr, packetLen, stream);\n");
+    fprintf(fp, "\t\tlong long t1 = GetCurrentTimeNS();\n");
+    fprintf(fp, "\t\tif (last != packetLen) break;\n");
+    fprintf(fp, "\t\tOpStats *s = &m_stats[opcode - OPCODE_BASE];\n");
+    fprintf(fp, "\t\ts->calls++;\n");
+    fprintf(fp, "\t\ts->bytes += packetLen;\n");
+    fprintf(fp, "\t\ts->timeNs += (uint64_t)(t1 - t0);\n");
+    fprintf(fp, "\t\tpos += packetLen;\n");
+    fprintf(fp, "\t\tptr += packetLen;\n");
+    fprintf(fp, "\t}\n");
+    fprintf(fp, "\treturn pos;\n");
+    fprintf(fp, "}\n");
+
+    fclose(fp);
+    return 0;
+}
+
 int ApiGen::readSpec(const std::string & filename)
 {
     FILE *specfp = fopen(filename.c_str(), "rt");
@@ -1221,6 +1394,8 @@ int ApiGen::setGlobalAttribute(const std::string & line, size_t lc)
         } else {
             setBaseOpcode(atoi(str.c_str()));
         }
+    } else if (token == "decoder_stats") {
+        setDecoderStats(true);
     } else  if (token == "encoder_headers") {
         std::string str = getNextToken(line, pos, &last, WHITESPACE);
         pos = last;
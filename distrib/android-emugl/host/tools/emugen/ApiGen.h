@@ -30,7 +30,8 @@ public:
     ApiGen(const std::string & basename) :
         m_basename(basename),
         m_maxEntryPointsParams(0),
-        m_baseOpcode(0)
+        m_baseOpcode(0),
+        m_decoderStats(false)
     { }
     virtual ~ApiGen() {}
     int readSpec(const std::string & filename);
@@ -41,6 +42,8 @@ public:
     }
     int baseOpcode() { return m_baseOpcode; }
     void setBaseOpcode(int base) { m_baseOpcode = base; }
+    bool decoderStats() const { return m_decoderStats; }
+    void setDecoderStats(bool enabled) { m_decoderStats = enabled; }
 
     const char *sideString(SideType side) {
         const char *retval;
@@ -83,6 +86,9 @@ public:
     int genDecoderHeader(const std::string &filename);
     int genDecoderImpl(const std::string &filename);
 
+    int genReplayHeader(const std::string &filename);
+    int genReplayImpl(const std::string &filename);
+
 protected:
     virtual void printHeader(FILE *fp) const;
     std::string m_basename;
@@ -92,6 +98,7 @@ protected:
     StringVec m_decoderHeaders;
     size_t m_maxEntryPointsParams; // record the maximum number of parameters in the entry points;
     int m_baseOpcode;
+    bool m_decoderStats; // generate per-opcode statistics in the decoder
     int setGlobalAttribute(const std::string & line, size_t lc);
 };
 
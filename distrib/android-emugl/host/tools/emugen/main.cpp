@@ -36,6 +36,7 @@ void usage(const char *filename)
     fprintf(stderr, "\t-i: input dir, local directory by default\n");
     fprintf(stderr, "\t-T : generate attribute template into the input directory\n\t\tno other files are generated\n");
     fprintf(stderr, "\t-W : generate wrapper into dir\n");
+    fprintf(stderr, "\t-R <dir>: generate stream replayer into dir\n");
 }
 
 int main(int argc, char *argv[])
@@ -43,15 +44,19 @@ int main(int argc, char *argv[])
     std::string encoderDir = "";
     std::string decoderDir = "";
     std::string wrapperDir = "";
+    std::string replayDir = "";
     std::string inDir = ".";
     bool generateAttributesTemplate = false;
 
     int c;
-    while((c = getopt(argc, argv, "TE:D:i:hW:")) != -1) {
+    while((c = getopt(argc, argv, "TE:D:i:hW:R:")) != -1) {
         switch(c) {
         case 'W':
             wrapperDir = std::string(optarg);
             break;
+        case 'R':
+            replayDir = std::string(optarg);
+            break;
         case 'T':
             generateAttributesTemplate = true;
             break;
@@ -85,7 +90,8 @@ int main(int argc, char *argv[])
     if (encoderDir.size() == 0 &&
         decoderDir.size() == 0 &&
         generateAttributesTemplate == false &&
-        wrapperDir.size() == 0) {
+        wrapperDir.size() == 0 &&
+        replayDir.size() == 0) {
         fprintf(stderr, "No output specified - aborting\n");
         return BAD_USAGE;
     }
@@ -152,6 +158,11 @@ int main(int argc, char *argv[])
         apiEntries.genEntryPoints(wrapperDir + "/" + baseName + "_wrapper_entry.cpp", ApiGen::WRAPPER_SIDE);
     }
 
+    if (replayDir.size() != 0) {
+        apiEntries.genReplayHeader(replayDir + "/" + baseName + "_replay.h");
+        apiEntries.genReplayImpl(replayDir + "/" + baseName + "_replay.cpp");
+    }
+
 #ifdef DEBUG_DUMP
     int withPointers = 0;
     printf("%d functions found\n", int(apiEntries.size()));
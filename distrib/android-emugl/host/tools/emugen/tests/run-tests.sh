@@ -110,9 +110,10 @@ for TEST_DIR in $TEST_DIRS; do
     mkdir -p "$OUT/encoder"
     mkdir -p "$OUT/decoder"
     mkdir -p "$OUT/wrapper"
+    mkdir -p "$OUT/replay"
     for PREFIX in $PREFIXES; do
         echo "Processing $IN/foo.*"
-        $EMUGEN -i "$PROGDIR/$TEST_DIR/input" -D "$OUT/decoder" -E "$OUT/encoder" -W "$OUT/wrapper" $PREFIX
+        $EMUGEN -i "$PROGDIR/$TEST_DIR/input" -D "$OUT/decoder" -E "$OUT/encoder" -W "$OUT/wrapper" -R "$OUT/replay" $PREFIX
     done
     if ! diff -qr "$PROGDIR/$TEST_DIR/expected" "$OUT"; then
         if [ "$OPT_TOOL" ]; then
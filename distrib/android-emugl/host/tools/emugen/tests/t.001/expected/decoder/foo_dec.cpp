@@ -10,6 +10,8 @@
 
 #include "ProtocolUtils.h"
 
+#include "TimeUtils.h"
+
 #include <stdio.h>
 
 typedef unsigned int tsize_t; // Target "size_t", which is 32-bit for now. It may or may not be the same as host's size_t when emugen is compiled.
@@ -28,6 +30,20 @@ typedef unsigned int tsize_t; // Target "size_t", which is 32-bit for now. It ma
 
 using namespace emugl;
 
+static const char *const kOpcodeNames[] = {
+	"fooAlphaFunc",
+	"fooIsBuffer",
+	"fooUnsupported",
+	"fooDoEncoderFlush",
+	"fooTakeConstVoidPtrConstPtr",
+};
+
+const char *foo_decoder_context_t::opcodeName(unsigned int opcode)
+{
+	if (!isDecoderOpcode(opcode)) return NULL;
+	return kOpcodeNames[opcode - OPCODE_BASE];
+}
+
 size_t foo_decoder_context_t::decode(void *buf, size_t len, IOStream *stream)
 {
                            
@@ -42,6 +58,7 @@ size_t foo_decoder_context_t::decode(void *buf, size_t len, IOStream *stream)
 		uint32_t opcode = *(uint32_t *)ptr;   
 		size_t packetLen = *(uint32_t *)(ptr + 4);
 		if (len - pos < packetLen)  return pos; 
+		long long statsTime = m_opStats ? GetCurrentTimeNS() : 0;
 		switch(opcode) {
 		case OP_fooAlphaFunc: {
 			FooInt var_func = Unpack<FooInt,uint32_t>(ptr + 8);
@@ -89,6 +106,12 @@ size_t foo_decoder_context_t::decode(void *buf, size_t len, IOStream *stream)
 				unknownOpcode = true;
 		} //switch
 		if (!unknownOpcode) {
+			if (m_opStats) {
+				OpStats *s = &m_opStats[opcode - OPCODE_BASE];
+				s->calls++;
+				s->bytes += packetLen;
+				s->timeNs += (uint64_t)(GetCurrentTimeNS() - statsTime);
+			}
 			pos += packetLen;
 			ptr += packetLen;
 		}
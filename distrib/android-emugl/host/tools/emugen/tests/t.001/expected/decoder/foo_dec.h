@@ -9,10 +9,42 @@
 
 
 
+#include <stdint.h>
+
 struct foo_decoder_context_t : public foo_server_context_t {
 
+	foo_decoder_context_t() : m_opStats(NULL) {}
+
 	size_t decode(void *buf, size_t bufsize, IOStream *stream);
 
+	// Return true iff |opcode| is handled by this decoder.
+	static bool isDecoderOpcode(unsigned int opcode) {
+		return opcode >= 200U && opcode < 205U;
+	}
+
+	enum {
+		OPCODE_BASE = 200,
+		OPCODE_COUNT = 5
+	};
+
+	// Statistics of an opcode. The time covers both decoding and dispatch.
+	struct OpStats {
+		uint64_t calls;
+		uint64_t bytes;
+		uint64_t timeNs;
+	};
+
+	// Start adding the statistics of each decoded packet to |stats|, an
+	// array of OPCODE_COUNT items indexed by (opcode - OPCODE_BASE), or stop
+	// if it is NULL.
+	void setOpStats(OpStats *stats) { m_opStats = stats; }
+
+	// Return the name of |opcode|, or NULL if it's not handled by this decoder.
+	static const char *opcodeName(unsigned int opcode);
+
+private:
+	OpStats *m_opStats;
+
 };
 
 #endif  // GUARD_foo_decoder_context_t
@@ -0,0 +1,50 @@
+// Generated Code - DO NOT EDIT !!
+// generated by 'emugen'
+
+
+#include <string.h>
+#include "foo_replay.h"
+
+#include "TimeUtils.h"
+
+static const char *const kOpcodeNames[] = {
+	"fooAlphaFunc",
+	"fooIsBuffer",
+	"fooUnsupported",
+	"fooDoEncoderFlush",
+	"fooTakeConstVoidPtrConstPtr",
+};
+
+const char *foo_replay_t::opcodeName(unsigned int opcode)
+{
+	if (!foo_decoder_context_t::isDecoderOpcode(opcode)) return NULL;
+	return kOpcodeNames[opcode - OPCODE_BASE];
+}
+
+void foo_replay_t::reset()
+{
+	memset(m_stats, 0, sizeof(m_stats));
+}
+
+size_t foo_replay_t::replay(foo_decoder_context_t *decoder, void *buf, size_t bufsize, IOStream *stream)
+{
+	size_t pos = 0;
+	unsigned char *ptr = (unsigned char *)buf;
+	while (bufsize - pos >= 8) {
+		uint32_t opcode = *(uint32_t *)ptr;
+		size_t packetLen = *(uint32_t *)(ptr + 4);
+		if (!foo_decoder_context_t::isDecoderOpcode(opcode)) break;
+		if (packetLen < 8 || bufsize - pos < packetLen) break;
+		long long t0 = GetCurrentTimeNS();
+		size_t last = decoder->decode(ptr, packetLen, stream);
+		long long t1 = GetCurrentTimeNS();
+		if (last != packetLen) break;
+		OpStats *s = &m_stats[opcode - OPCODE_BASE];
+		s->calls++;
+		s->bytes += packetLen;
+		s->timeNs += (uint64_t)(t1 - t0);
+		pos += packetLen;
+		ptr += packetLen;
+	}
+	return pos;
+}
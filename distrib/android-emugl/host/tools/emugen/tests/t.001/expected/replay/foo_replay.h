@@ -0,0 +1,45 @@
+// Generated Code - DO NOT EDIT !!
+// generated by 'emugen'
+
+#ifndef GUARD_foo_replay_t
+#define GUARD_foo_replay_t
+
+#include "IOStream.h"
+#include "foo_dec.h"
+
+#include <stdint.h>
+
+// Feeds packets to a foo_decoder_context_t one at a time, and records
+// the number of calls, bytes and decoding time of each opcode.
+struct foo_replay_t {
+
+	enum {
+		OPCODE_BASE = 200,
+		OPCODE_COUNT = 5
+	};
+
+	struct OpStats {
+		uint64_t calls;
+		uint64_t bytes;
+		uint64_t timeNs;
+	};
+
+	foo_replay_t() { reset(); }
+
+	// Decode all consecutive complete packets of this API at the start of
+	// |buf|, and return the number of bytes consumed.
+	size_t replay(foo_decoder_context_t *decoder, void *buf, size_t bufsize, IOStream *stream);
+
+	// Return the statistics of |opcode|, which must be handled by this API.
+	const OpStats &stats(unsigned int opcode) const { return m_stats[opcode - OPCODE_BASE]; }
+
+	void reset();
+
+	// Return the name of |opcode|, or NULL if it's not handled by this API.
+	static const char *opcodeName(unsigned int opcode);
+
+private:
+	OpStats m_stats[OPCODE_COUNT];
+};
+
+#endif  // GUARD_foo_replay_t
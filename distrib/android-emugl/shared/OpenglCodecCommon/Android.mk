@@ -42,3 +42,14 @@ $(call emugl-export,C_INCLUDES,$(EMUGL_PATH)/host/include/libOpenglRender $(LOCA
 $(call emugl-export,LDLIBS,$(host_commonLdLibs))
 $(call emugl-end-module)
 
+
+
+### emugl_texture_upload_benchmark ######################################
+
+$(call emugl-begin-host-executable,emugl_texture_upload_benchmark)
+LOCAL_SRC_FILES := TextureUploadBenchmark.cpp
+$(call emugl-end-module)
+
+$(call emugl-begin-host64-executable,emugl64_texture_upload_benchmark)
+LOCAL_SRC_FILES := TextureUploadBenchmark.cpp
+$(call emugl-end-module)
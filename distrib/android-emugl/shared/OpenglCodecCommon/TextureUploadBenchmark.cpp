@@ -0,0 +1,98 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A small micro-benchmark used to measure the decoder-side throughput of
+// 4K glTexImage2D() uploads, comparing the aligned heap copy that the
+// generated decoders used to make for every 'pixels' payload with the
+// direct pointer into the stream buffer used for 'isLarge' parameters.
+//
+// The final copy into |texture| stands for the upload performed by the
+// GL backend, which happens in both cases.
+//
+// Usage: emugl_texture_upload_benchmark [<uploads> [<width> <height>]]
+
+#include "ProtocolUtils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+namespace {
+
+// Offset of the 'pixels' payload in a glTexImage2D packet: an 8-byte
+// opcode/size header, 8 32-bit arguments, and the 32-bit payload size.
+const size_t kPixelsOffset = 8 + 8 * 4 + 4;
+
+double elapsedSec(clock_t start) {
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+double uploadLoop(const unsigned char* packet, size_t size,
+                  unsigned char* texture, size_t uploads, size_t align,
+                  unsigned* checksum) {
+    clock_t start = clock();
+    for (size_t n = 0; n < uploads; ++n) {
+        emugl::InputBuffer pixels(packet + kPixelsOffset, size, align);
+        memcpy(texture, pixels.get(), size);
+        *checksum += texture[n % size];
+    }
+    return elapsedSec(start);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    size_t uploads = 100;
+    size_t width = 3840;
+    size_t height = 2160;
+    if (argc > 1) {
+        uploads = static_cast<size_t>(atol(argv[1]));
+    }
+    if (argc > 3) {
+        width = static_cast<size_t>(atol(argv[2]));
+        height = static_cast<size_t>(atol(argv[3]));
+    }
+    if (uploads == 0 || width == 0 || height == 0) {
+        fprintf(stderr, "Invalid parameters\n");
+        return 1;
+    }
+
+    size_t size = width * height * 4;
+    unsigned char* packet =
+            static_cast<unsigned char*>(malloc(kPixelsOffset + size));
+    unsigned char* texture = static_cast<unsigned char*>(malloc(size));
+    if (!packet || !texture) {
+        fprintf(stderr, "Could not allocate %zu bytes\n", size);
+        return 1;
+    }
+    for (size_t n = 0; n < kPixelsOffset + size; ++n) {
+        packet[n] = static_cast<unsigned char>(n * 31);
+    }
+
+    unsigned checksum = 0;
+    double copySec = uploadLoop(packet, size, texture, uploads, 8, &checksum);
+    double directSec = uploadLoop(packet, size, texture, uploads, 1,
+                                  &checksum);
+
+    double mb = (double)size * uploads / (1024. * 1024.);
+    printf("%zu uploads of %zux%zu RGBA pixels (checksum %u):\n",
+           uploads, width, height, checksum);
+    printf("  aligned copy   : %8.1f MB/s\n", mb / copySec);
+    printf("  direct pointer : %8.1f MB/s\n", mb / directSec);
+
+    free(texture);
+    free(packet);
+    return 0;
+}
@@ -17,6 +17,10 @@
 #define _TIME_UTILS_H
 
 long long GetCurrentTimeMS();
+
+// Return a monotonic time in nanoseconds, for measuring short intervals.
+long long GetCurrentTimeNS();
+
 void TimeSleepMS(int p_mili);
 
 #endif
@@ -31,24 +31,49 @@
  */
 #define NAMED_PIPE_MAX 256
 
+/* Size of the pipe buffers. Large ones let the writer run ahead of the
+ * reader instead of blocking for each command buffer.
+ */
+#define NAMED_PIPE_BUFFER_SIZE (1024 * 1024)
+
 Win32PipeStream::Win32PipeStream(size_t bufSize) :
     SocketStream(bufSize),
     m_pipe(INVALID_HANDLE_VALUE)
 {
+    initOverlapped();
 }
 
 Win32PipeStream::Win32PipeStream(HANDLE pipe, size_t bufSize) :
     SocketStream(-1, bufSize),
     m_pipe(pipe)
 {
+    initOverlapped();
+}
+
+void Win32PipeStream::initOverlapped()
+{
+    m_bufCapacity = 0;
+    memset(&m_readOverlapped, 0, sizeof(m_readOverlapped));
+    memset(&m_writeOverlapped, 0, sizeof(m_writeOverlapped));
+    m_readOverlapped.hEvent = ::CreateEvent(NULL, TRUE, FALSE, NULL);
+    m_writeOverlapped.hEvent = ::CreateEvent(NULL, TRUE, FALSE, NULL);
+    m_writePending = false;
+    m_writeData = NULL;
+    m_writeSize = 0;
+    m_pendingBuf = NULL;
+    m_pendingCapacity = 0;
 }
 
 Win32PipeStream::~Win32PipeStream()
 {
+    finishWrite();
     if (m_pipe != INVALID_HANDLE_VALUE) {
         CloseHandle(m_pipe);
         m_pipe = INVALID_HANDLE_VALUE;
     }
+    CloseHandle(m_readOverlapped.hEvent);
+    CloseHandle(m_writeOverlapped.hEvent);
+    free(m_pendingBuf);
 }
 
 /* Initialize the pipe name corresponding to a given port
@@ -90,13 +115,14 @@ SocketStream * Win32PipeStream::accept()
 
     pipe = ::CreateNamedPipe(
                 path,                // pipe name
-                PIPE_ACCESS_DUPLEX,  // read-write access
+                PIPE_ACCESS_DUPLEX | // read-write access
+                FILE_FLAG_OVERLAPPED, // asynchronous operations
                 PIPE_TYPE_BYTE |     // byte-oriented writes
                 PIPE_READMODE_BYTE | // byte-oriented reads
                 PIPE_WAIT,           // blocking operations
                 PIPE_UNLIMITED_INSTANCES, // no limit on clients
-                4096,                // input buffer size
-                4096,                // output buffer size
+                NAMED_PIPE_BUFFER_SIZE, // input buffer size
+                NAMED_PIPE_BUFFER_SIZE, // output buffer size
                 0,                   // client time-out
                 NULL);               // default security attributes
 
@@ -108,10 +134,22 @@ SocketStream * Win32PipeStream::accept()
     // Stupid Win32 API design: If a client is already connected, then
     // ConnectNamedPipe will return 0, and GetLastError() will return
     // ERROR_PIPE_CONNECTED. This is not an error! It just means that the
-    // function didn't have to wait.
+    // function didn't have to wait. Since the pipe is overlapped, it
+    // returns ERROR_IO_PENDING while waiting for a client.
     //
-    if (::ConnectNamedPipe(pipe, NULL) == 0 && GetLastError() != ERROR_PIPE_CONNECTED) {
-        ERR("%s: ConnectNamedPipe failed: %d\n", __FUNCTION__, (int)GetLastError());
+    OVERLAPPED overlapped;
+    memset(&overlapped, 0, sizeof(overlapped));
+    overlapped.hEvent = ::CreateEvent(NULL, TRUE, FALSE, NULL);
+    BOOL connected = ::ConnectNamedPipe(pipe, &overlapped);
+    DWORD error = connected ? ERROR_SUCCESS : GetLastError();
+    if (!connected && error == ERROR_IO_PENDING) {
+        DWORD unused;
+        connected = ::GetOverlappedResult(pipe, &overlapped, &unused, TRUE);
+        error = connected ? ERROR_SUCCESS : GetLastError();
+    }
+    CloseHandle(overlapped.hEvent);
+    if (!connected && error != ERROR_PIPE_CONNECTED) {
+        ERR("%s: ConnectNamedPipe failed: %d\n", __FUNCTION__, (int)error);
         CloseHandle(pipe);
         return NULL;
     }
@@ -135,7 +173,7 @@ int Win32PipeStream::connect(const char* addr)
                     0,                             // no sharing
                     NULL,                          // default security attrs
                     OPEN_EXISTING,                 // open existing pipe
-                    0,                             // default attributes
+                    FILE_FLAG_OVERLAPPED,          // asynchronous operations
                     NULL);                         // no template file
 
         /* If we have a valid pipe handle, break from the loop */
@@ -171,24 +209,100 @@ int Win32PipeStream::connect(const char* addr)
 
 /* Special buffer methods, since we can't use socket functions here */
 
+void *Win32PipeStream::allocBuffer(size_t minSize)
+{
+    size_t allocSize = (m_bufsize < minSize ? minSize : m_bufsize);
+    if (!m_buf || m_bufCapacity < allocSize) {
+        unsigned char *p = (unsigned char *)realloc(m_buf, allocSize);
+        if (!p) {
+            ERR("%s: realloc (%zu) failed\n", __FUNCTION__, allocSize);
+            return NULL;
+        }
+        m_buf = p;
+        m_bufCapacity = allocSize;
+    }
+    return m_buf;
+}
+
+bool Win32PipeStream::startWrite(const void *buf, size_t size)
+{
+    HANDLE pipe = m_pipe;
+    if (pipe == INVALID_HANDLE_VALUE)
+        return false;
+
+    m_writeData = (const unsigned char *)buf;
+    m_writeSize = size;
+    if (!::WriteFile(pipe, buf, size, NULL, &m_writeOverlapped) &&
+        GetLastError() != ERROR_IO_PENDING) {
+        ERR("%s: failed: %d\n", __FUNCTION__, (int)GetLastError());
+        return false;
+    }
+    m_writePending = true;
+    return true;
+}
+
+bool Win32PipeStream::finishWrite()
+{
+    while (m_writePending) {
+        m_writePending = false;
+        DWORD written = 0;
+        if (!::GetOverlappedResult(m_pipe, &m_writeOverlapped, &written,
+                                   TRUE)) {
+            ERR("%s: failed: %d\n", __FUNCTION__, (int)GetLastError());
+            return false;
+        }
+        if (written < m_writeSize &&
+            !startWrite(m_writeData + written, m_writeSize - written)) {
+            return false;
+        }
+    }
+    return true;
+}
+
 int Win32PipeStream::commitBuffer(size_t size)
 {
     if (m_pipe == INVALID_HANDLE_VALUE)
         return -1;
 
-    size_t res = size;
-    int retval = 0;
+    // Wait for the previous buffer, and let the caller fill it while this
+    // one is written.
+    if (!finishWrite())
+        return -1;
 
-    while (res > 0) {
-        DWORD  written;
-        if (! ::WriteFile(m_pipe, (const char *)m_buf + (size - res), res, &written, NULL)) {
-            retval =  -1;
-            ERR("%s: failed: %d\n", __FUNCTION__, (int)GetLastError());
-            break;
-        }
-        res -= written;
+    unsigned char *buf = m_buf;
+    size_t capacity = m_bufCapacity;
+    m_buf = m_pendingBuf;
+    m_bufCapacity = m_pendingCapacity;
+    m_pendingBuf = buf;
+    m_pendingCapacity = capacity;
+
+    return startWrite(m_pendingBuf, size) ? 0 : -1;
+}
+
+int Win32PipeStream::writeFully(const void *buf, size_t len)
+{
+    if (!finishWrite() || !startWrite(buf, len) || !finishWrite())
+        return -1;
+    return 0;
+}
+
+bool Win32PipeStream::readSome(void *buf, size_t len, DWORD *readcount)
+{
+    HANDLE pipe = m_pipe;
+    if (pipe == INVALID_HANDLE_VALUE)
+        return false;
+
+    *readcount = 0;
+    if (!::ReadFile(pipe, buf, len, NULL, &m_readOverlapped) &&
+        GetLastError() != ERROR_IO_PENDING) {
+        errno = (int)GetLastError();
+        return false;
     }
-    return retval;
+    if (!::GetOverlappedResult(pipe, &m_readOverlapped, readcount, TRUE)) {
+        errno = (int)GetLastError();
+        return false;
+    }
+    return true;
 }
 
 const unsigned char *Win32PipeStream::readFully(void *buf, size_t len)
@@ -203,8 +317,7 @@ const unsigned char *Win32PipeStream::readFully(void *buf, size_t len)
     size_t res = len;
     while (res > 0) {
         DWORD  readcount = 0;
-        if (! ::ReadFile(m_pipe, (char *)buf + (len - res), res, &readcount, NULL) || readcount == 0) {
-            errno = (int)GetLastError();
+        if (!readSome((char *)buf + (len - res), res, &readcount) || readcount == 0) {
             return NULL;
         }
         res -= readcount;
@@ -224,8 +337,7 @@ const unsigned char *Win32PipeStream::read( void *buf, size_t *inout_len)
         return NULL;  // do not allow NULL buf in that implementation
     }
 
-    if (!::ReadFile(m_pipe, (char *)buf, len, &readcount, NULL)) {
-        errno = (int)GetLastError();
+    if (!readSome(buf, len, &readcount)) {
         return NULL;
     }
 
@@ -235,6 +347,8 @@ const unsigned char *Win32PipeStream::read( void *buf, size_t *inout_len)
 
 void Win32PipeStream::forceStop()
 {
+    // Closing the handle also aborts the pending operations, which makes
+    // their waits return.
     HANDLE handle = m_pipe;
     m_pipe = INVALID_HANDLE_VALUE;
     CloseHandle(handle);
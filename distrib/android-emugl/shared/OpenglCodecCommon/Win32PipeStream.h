@@ -19,6 +19,12 @@
 #include "SocketStream.h"
 #include <windows.h>
 
+// A SocketStream over a Win32 named pipe.
+//
+// The pipe is opened for overlapped I/O, so that commitBuffer() returns as
+// soon as the write is started: it is only waited for by the next write,
+// while the caller fills the other one of two alternating buffers. Errors
+// of a write are thus reported by the next one.
 class Win32PipeStream : public SocketStream {
 public:
     explicit Win32PipeStream(size_t bufsize = 10000);
@@ -27,15 +33,34 @@ public:
     virtual SocketStream *accept();
     virtual int connect(const char* addr);
 
+    virtual void *allocBuffer(size_t minSize);
     virtual int commitBuffer(size_t size);
+    virtual int writeFully(const void *buf, size_t len);
     virtual const unsigned char *readFully(void *buf, size_t len);
     virtual const unsigned char *read(void *buf, size_t *inout_len);
     virtual void forceStop();
 
 private:
     Win32PipeStream(HANDLE pipe, size_t bufSize);
+    void initOverlapped();
+    // Read at most |len| bytes, and wait for the result.
+    bool readSome(void *buf, size_t len, DWORD *readcount);
+    // Start writing |size| bytes of |buf|, which must stay valid until
+    // finishWrite() returns.
+    bool startWrite(const void *buf, size_t size);
+    // Wait for the pending write, if any, and write what it left.
+    bool finishWrite();
+
     HANDLE  m_pipe;
     int     m_port;
+    size_t  m_bufCapacity;       // of m_buf.
+    OVERLAPPED m_readOverlapped;
+    OVERLAPPED m_writeOverlapped;
+    bool    m_writePending;
+    const unsigned char *m_writeData;
+    size_t  m_writeSize;
+    unsigned char *m_pendingBuf; // written by the pending commitBuffer().
+    size_t  m_pendingCapacity;
 };
 
 
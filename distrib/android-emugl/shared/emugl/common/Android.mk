@@ -7,7 +7,9 @@ LOCAL_PATH := $(call my-dir)
 
 commonSources := \
         id_to_object_map.cpp \
+        latency_histogram.cpp \
         lazy_instance.cpp \
+        lock_profiler.cpp \
         message_channel.cpp \
         pod_vector.cpp \
         shared_library.cpp \
@@ -48,11 +50,16 @@ $(call emugl-end-module)
 
 host_commonSources := \
     condition_variable_unittest.cpp \
+    handle_table_unittest.cpp \
     id_to_object_map_unittest.cpp \
+    latency_histogram_unittest.cpp \
     lazy_instance_unittest.cpp \
+    lock_profiler_unittest.cpp \
     pod_vector_unittest.cpp \
     message_channel_unittest.cpp \
     mutex_unittest.cpp \
+    ref_counted_unittest.cpp \
+    seqlock_hash_map_unittest.cpp \
     shared_library_unittest.cpp \
     smart_ptr_unittest.cpp \
     thread_store_unittest.cpp \
@@ -70,6 +77,32 @@ $(call emugl-import,lib64emugl_common lib64emugl_gtest)
 $(call emugl-end-module)
 
 
+### emugl_handle_table_benchmark #########################################
+
+$(call emugl-begin-host-executable,emugl_handle_table_benchmark)
+LOCAL_SRC_FILES := handle_table_benchmark.cpp
+$(call emugl-import,libemugl_common)
+$(call emugl-end-module)
+
+$(call emugl-begin-host64-executable,emugl64_handle_table_benchmark)
+LOCAL_SRC_FILES := handle_table_benchmark.cpp
+$(call emugl-import,lib64emugl_common)
+$(call emugl-end-module)
+
+
+### emugl_ref_counted_benchmark ##########################################
+
+$(call emugl-begin-host-executable,emugl_ref_counted_benchmark)
+LOCAL_SRC_FILES := ref_counted_benchmark.cpp
+$(call emugl-import,libemugl_common)
+$(call emugl-end-module)
+
+$(call emugl-begin-host64-executable,emugl64_ref_counted_benchmark)
+LOCAL_SRC_FILES := ref_counted_benchmark.cpp
+$(call emugl-import,lib64emugl_common)
+$(call emugl-end-module)
+
+
 $(call emugl-begin-host-shared-library,libemugl_test_shared_library)
 LOCAL_SRC_FILES := testing/test_shared_library.cpp
 LOCAL_CFLAGS := -fvisibility=default
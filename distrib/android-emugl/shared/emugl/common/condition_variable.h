@@ -73,7 +73,19 @@ private:
     }
 
     void wait(Mutex* userLock) {
+#if EMUGL_LOCK_PROFILING
+        // The mutex isn't held while waiting.
+        if (userLock->mSite) {
+            userLock->mSite->addHold(
+                    LockSite::nowNs() - userLock->mHoldStartNs);
+        }
         pthread_cond_wait(&mCond, &userLock->mLock);
+        if (userLock->mSite) {
+            userLock->mHoldStartNs = LockSite::nowNs();
+        }
+#else
+        pthread_cond_wait(&mCond, &userLock->mLock);
+#endif
     }
 
     void signal() {
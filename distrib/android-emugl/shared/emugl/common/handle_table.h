@@ -0,0 +1,230 @@
+// Copyright (C) 2014 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef EMUGL_COMMON_HANDLE_TABLE_H
+#define EMUGL_COMMON_HANDLE_TABLE_H
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace emugl {
+
+// A HandleSpace allocates unique 32-bit handles. Each handle encodes a slot
+// index and a generation number. The generation is incremented each time a
+// handle is released, so that stale handles (i.e. released handles whose
+// slot was later recycled for a new handle) can be told apart from the
+// live ones.
+//
+// The value 0 is never used as a handle, and means 'invalid'.
+//
+// A HandleSpace can be shared by several HandleTable instances, see below,
+// so that a handle from one table is never valid in another one.
+class HandleSpace {
+public:
+    typedef uint32_t HandleType;
+
+    enum {
+        // Number of bits used to encode the slot index in a handle.
+        kIndexBits = 20,
+        // Maximum number of live handles in a space.
+        kMaxSlots = (1U << kIndexBits) - 1U,
+    };
+
+    HandleSpace() : mGenerations(), mFreeList() {}
+
+    // Return a new unique handle, or 0 if the space is full.
+    HandleType allocate() {
+        size_t index;
+        if (!mFreeList.empty()) {
+            index = mFreeList.back();
+            mFreeList.pop_back();
+        } else {
+            index = mGenerations.size();
+            if (index >= kMaxSlots) {
+                return 0;
+            }
+            mGenerations.push_back(0);
+        }
+        return makeHandle(index, mGenerations[index]);
+    }
+
+    // Release |handle|, which must have been returned by allocate(), and
+    // not released yet.
+    void release(HandleType handle) {
+        size_t index = indexOf(handle);
+        mGenerations[index] = (mGenerations[index] + 1U) & kGenerationMask;
+        mFreeList.push_back(static_cast<uint32_t>(index));
+    }
+
+    // Return the slot index encoded in |handle|, or kMaxSlots if |handle|
+    // is 0 or out of range.
+    static size_t indexOf(HandleType handle) {
+        size_t index = (handle & kIndexMask);
+        return index ? index - 1U : static_cast<size_t>(kMaxSlots);
+    }
+
+private:
+    enum {
+        kIndexMask = (1U << kIndexBits) - 1U,
+        kGenerationMask = (1U << (32 - kIndexBits)) - 1U,
+    };
+
+    static HandleType makeHandle(size_t index, uint32_t generation) {
+        // Store |index + 1| to ensure that no handle is ever 0.
+        return (generation << kIndexBits) |
+               static_cast<HandleType>(index + 1U);
+    }
+
+    std::vector<uint32_t> mGenerations;
+    std::vector<uint32_t> mFreeList;
+};
+
+// A HandleTable<T> stores values of type |T| in a dense array of slots,
+// and allocates a unique 32-bit handle for each one of them from a
+// HandleSpace. Looking up a value from its handle is O(1), and doesn't
+// require hashing or comparing keys. Stale handles are detected and
+// rejected by get(), instead of returning an unrelated value.
+//
+// By default, each table has its own HandleSpace. Tables that share one
+// never hand out the same handle, so that a handle of one type of object
+// can't be mistaken for a handle of another type. The space must outlive
+// the tables, which are then only as dense as the space.
+//
+// |T| must be default-constructible and copyable. Removing a value from the
+// table resets its slot to T(), which is useful to release smart pointers.
+//
+// Usage example:
+//
+//     HandleTable<FooPtr> table;
+//     uint32_t handle = table.add(foo);
+//     FooPtr* ptr = table.get(handle);   // O(1), NULL if |handle| is bad.
+//     table.remove(handle);
+//     CHECK(table.get(handle) == NULL);
+//
+template <typename T>
+class HandleTable {
+public:
+    typedef HandleSpace::HandleType HandleType;
+
+    enum {
+        // Maximum number of live values in a table.
+        kMaxSlots = HandleSpace::kMaxSlots,
+    };
+
+    // Create a table that allocates its handles from |space|, or from a
+    // space of its own if |space| is NULL.
+    explicit HandleTable(HandleSpace* space = NULL) :
+            mOwnSpace(),
+            mSpace(space ? space : &mOwnSpace),
+            mSlots(),
+            mCount(0) {}
+
+    ~HandleTable() { clear(); }
+
+    // Return true iff the table is empty.
+    bool empty() const { return mCount == 0; }
+
+    // Return the number of values in the table.
+    size_t size() const { return mCount; }
+
+    // Remove all values from the table. All existing handles become
+    // invalid.
+    void clear();
+
+    // Add |value| to the table and return a new unique handle for it.
+    // Returns 0 if the table, or its space, is full.
+    HandleType add(const T& value);
+
+    // Return a pointer to the value associated with |handle|, which is
+    // still owned by the table, or NULL if |handle| is 0, stale or
+    // invalid. The pointer is only valid until the next add() or clear().
+    T* get(HandleType handle);
+
+    // Remove the value associated with |handle|. Return true on success,
+    // or false if |handle| was invalid.
+    bool remove(HandleType handle);
+
+private:
+    struct Slot {
+        Slot() : value(), handle(0) {}
+        T value;
+        HandleType handle;   // 0 if the slot is free.
+    };
+
+    HandleTable(const HandleTable&);
+    HandleTable& operator=(const HandleTable&);
+
+    HandleSpace mOwnSpace;
+    HandleSpace* mSpace;
+    std::vector<Slot> mSlots;
+    size_t mCount;
+};
+
+template <typename T>
+void HandleTable<T>::clear() {
+    for (size_t n = mSlots.size(); n > 0; --n) {
+        Slot& slot = mSlots[n - 1U];
+        if (slot.handle) {
+            mSpace->release(slot.handle);
+            slot.value = T();
+            slot.handle = 0;
+        }
+    }
+    mCount = 0;
+}
+
+template <typename T>
+typename HandleTable<T>::HandleType HandleTable<T>::add(const T& value) {
+    HandleType handle = mSpace->allocate();
+    if (!handle) {
+        return 0;
+    }
+    size_t index = HandleSpace::indexOf(handle);
+    if (index >= mSlots.size()) {
+        mSlots.resize(index + 1U);
+    }
+    Slot& slot = mSlots[index];
+    slot.value = value;
+    slot.handle = handle;
+    mCount++;
+    return handle;
+}
+
+template <typename T>
+T* HandleTable<T>::get(HandleType handle) {
+    size_t index = HandleSpace::indexOf(handle);
+    if (index >= mSlots.size() || mSlots[index].handle != handle) {
+        return NULL;
+    }
+    return &mSlots[index].value;
+}
+
+template <typename T>
+bool HandleTable<T>::remove(HandleType handle) {
+    if (!get(handle)) {
+        return false;
+    }
+    Slot& slot = mSlots[HandleSpace::indexOf(handle)];
+    mSpace->release(handle);
+    slot.value = T();
+    slot.handle = 0;
+    mCount--;
+    return true;
+}
+
+}  // namespace emugl
+
+#endif  // EMUGL_COMMON_HANDLE_TABLE_H
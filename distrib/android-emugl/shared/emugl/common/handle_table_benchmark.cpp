@@ -0,0 +1,116 @@
+// Copyright (C) 2014 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A small micro-benchmark used to compare the per-call lookup overhead
+// of emugl::HandleTable<> with the std::map<> that FrameBuffer used to
+// implement its color buffer table, with thousands of live entries.
+//
+// Usage: emugl_handle_table_benchmark [<count> [<lookups>]]
+
+#include "emugl/common/handle_table.h"
+#include "emugl/common/smart_ptr.h"
+
+#include <map>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+namespace {
+
+// Mimics FrameBuffer's ColorBufferRef.
+struct Ref {
+    emugl::SmartPtr<int> cb;
+    uint32_t refcount;
+};
+
+typedef std::map<uint32_t, Ref> RefMap;
+typedef emugl::HandleTable<Ref> RefTable;
+
+double elapsedNs(clock_t start, size_t count) {
+    return ((double)(clock() - start) * 1e9 / CLOCKS_PER_SEC) / count;
+}
+
+// Return a pseudo-random sequence of indices in [0..count), used to avoid
+// measuring purely sequential lookups.
+std::vector<size_t> makeLookupOrder(size_t count, size_t lookups) {
+    std::vector<size_t> order(lookups);
+    uint32_t seed = 12345;
+    for (size_t n = 0; n < lookups; ++n) {
+        seed = seed * 1103515245U + 12345U;
+        order[n] = (seed >> 8) % count;
+    }
+    return order;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    size_t count = 4096;
+    size_t lookups = 10000000;
+    if (argc > 1) {
+        count = static_cast<size_t>(atol(argv[1]));
+    }
+    if (argc > 2) {
+        lookups = static_cast<size_t>(atol(argv[2]));
+    }
+    if (count == 0 || lookups == 0) {
+        fprintf(stderr, "Invalid parameters\n");
+        return 1;
+    }
+
+    Ref ref;
+    ref.cb = emugl::SmartPtr<int>(new int(0));
+    ref.refcount = 1;
+
+    // Populate both containers. For std::map, use increasing handles, as
+    // FrameBuffer::genHandle() did.
+    RefMap map;
+    RefTable table;
+    std::vector<uint32_t> mapHandles(count);
+    std::vector<uint32_t> tableHandles(count);
+    for (size_t n = 0; n < count; ++n) {
+        mapHandles[n] = static_cast<uint32_t>(n + 1);
+        map[mapHandles[n]] = ref;
+        tableHandles[n] = table.add(ref);
+    }
+
+    std::vector<size_t> order = makeLookupOrder(count, lookups);
+    uint32_t sum = 0;
+
+    clock_t start = clock();
+    for (size_t n = 0; n < lookups; ++n) {
+        RefMap::iterator it = map.find(mapHandles[order[n]]);
+        if (it != map.end()) {
+            sum += it->second.refcount;
+        }
+    }
+    double mapNs = elapsedNs(start, lookups);
+
+    start = clock();
+    for (size_t n = 0; n < lookups; ++n) {
+        Ref* r = table.get(tableHandles[order[n]]);
+        if (r) {
+            sum += r->refcount;
+        }
+    }
+    double tableNs = elapsedNs(start, lookups);
+
+    printf("%zu live entries, %zu random lookups (checksum %u):\n",
+           count, lookups, sum);
+    printf("  std::map<>         : %7.2f ns/lookup\n", mapNs);
+    printf("  emugl::HandleTable : %7.2f ns/lookup\n", tableNs);
+    return 0;
+}
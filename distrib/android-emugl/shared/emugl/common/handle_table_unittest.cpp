@@ -0,0 +1,161 @@
+// Copyright (C) 2014 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "emugl/common/handle_table.h"
+
+#include "emugl/common/smart_ptr.h"
+
+#include <gtest/gtest.h>
+
+namespace emugl {
+
+typedef HandleTable<int> MyTable;
+
+TEST(HandleTable, Empty) {
+    MyTable table;
+
+    EXPECT_TRUE(table.empty());
+    EXPECT_EQ(0U, table.size());
+    EXPECT_FALSE(table.get(0U));
+    EXPECT_FALSE(table.get(1U));
+    EXPECT_FALSE(table.get(0xffffffffU));
+    EXPECT_FALSE(table.remove(0U));
+    EXPECT_FALSE(table.remove(1U));
+}
+
+TEST(HandleTable, AddOne) {
+    MyTable table;
+    MyTable::HandleType handle = table.add(42);
+
+    EXPECT_NE(0U, handle);
+    EXPECT_FALSE(table.empty());
+    EXPECT_EQ(1U, table.size());
+    ASSERT_TRUE(table.get(handle));
+    EXPECT_EQ(42, *table.get(handle));
+    EXPECT_FALSE(table.get(handle + 1U));
+}
+
+TEST(HandleTable, AddMultiple) {
+    MyTable table;
+    const size_t kCount = 5000;
+    MyTable::HandleType handles[kCount];
+
+    for (size_t n = 0; n < kCount; ++n) {
+        handles[n] = table.add(static_cast<int>(n * 3));
+        EXPECT_NE(0U, handles[n]) << "#" << n;
+        for (size_t m = 0; m < n; m += 97) {
+            EXPECT_NE(handles[m], handles[n]) << "#" << m << " #" << n;
+        }
+    }
+    EXPECT_EQ(kCount, table.size());
+    for (size_t n = 0; n < kCount; ++n) {
+        ASSERT_TRUE(table.get(handles[n])) << "#" << n;
+        EXPECT_EQ(static_cast<int>(n * 3), *table.get(handles[n]));
+    }
+}
+
+TEST(HandleTable, Remove) {
+    MyTable table;
+    MyTable::HandleType h1 = table.add(1);
+    MyTable::HandleType h2 = table.add(2);
+
+    EXPECT_TRUE(table.remove(h1));
+    EXPECT_EQ(1U, table.size());
+    EXPECT_FALSE(table.get(h1));
+    EXPECT_FALSE(table.remove(h1));
+    ASSERT_TRUE(table.get(h2));
+    EXPECT_EQ(2, *table.get(h2));
+
+    EXPECT_TRUE(table.remove(h2));
+    EXPECT_TRUE(table.empty());
+}
+
+TEST(HandleTable, StaleHandlesAreRejected) {
+    MyTable table;
+    MyTable::HandleType h1 = table.add(1);
+    EXPECT_TRUE(table.remove(h1));
+
+    // The slot is recycled, but with a new generation.
+    MyTable::HandleType h2 = table.add(2);
+    EXPECT_NE(h1, h2);
+    EXPECT_FALSE(table.get(h1));
+    EXPECT_FALSE(table.remove(h1));
+    ASSERT_TRUE(table.get(h2));
+    EXPECT_EQ(2, *table.get(h2));
+}
+
+TEST(HandleTable, Clear) {
+    MyTable table;
+    MyTable::HandleType h1 = table.add(1);
+    MyTable::HandleType h2 = table.add(2);
+
+    table.clear();
+    EXPECT_TRUE(table.empty());
+    EXPECT_FALSE(table.get(h1));
+    EXPECT_FALSE(table.get(h2));
+
+    MyTable::HandleType h3 = table.add(3);
+    EXPECT_NE(h1, h3);
+    EXPECT_NE(h2, h3);
+    ASSERT_TRUE(table.get(h3));
+    EXPECT_EQ(3, *table.get(h3));
+}
+
+TEST(HandleTable, RemoveReleasesValue) {
+    HandleTable<SmartPtr<int> > table;
+    SmartPtr<int> ptr(new int(10));
+
+    HandleTable<SmartPtr<int> >::HandleType handle = table.add(ptr);
+    EXPECT_EQ(2, ptr.getRefCount());
+
+    EXPECT_TRUE(table.remove(handle));
+    EXPECT_EQ(1, ptr.getRefCount());
+}
+
+TEST(HandleTable, SharedSpace) {
+    HandleSpace space;
+    MyTable table1(&space);
+    MyTable table2(&space);
+
+    MyTable::HandleType h1 = table1.add(1);
+    MyTable::HandleType h2 = table2.add(2);
+    EXPECT_NE(h1, h2);
+    EXPECT_FALSE(table1.get(h2));
+    EXPECT_FALSE(table2.get(h1));
+    EXPECT_FALSE(table1.remove(h2));
+    EXPECT_FALSE(table2.remove(h1));
+
+    // A handle released by one table is never valid in the other one, even
+    // once its slot is reused.
+    EXPECT_TRUE(table1.remove(h1));
+    MyTable::HandleType h3 = table2.add(3);
+    EXPECT_NE(h1, h3);
+    EXPECT_NE(h2, h3);
+    EXPECT_FALSE(table1.get(h3));
+    EXPECT_FALSE(table2.get(h1));
+    ASSERT_TRUE(table2.get(h3));
+    EXPECT_EQ(3, *table2.get(h3));
+
+    table2.clear();
+    EXPECT_FALSE(table2.get(h2));
+    EXPECT_FALSE(table2.get(h3));
+    MyTable::HandleType h4 = table1.add(4);
+    EXPECT_NE(h2, h4);
+    EXPECT_NE(h3, h4);
+    EXPECT_FALSE(table2.get(h4));
+    ASSERT_TRUE(table1.get(h4));
+    EXPECT_EQ(4, *table1.get(h4));
+}
+
+}  // namespace emugl
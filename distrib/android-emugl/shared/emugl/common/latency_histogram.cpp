@@ -0,0 +1,96 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "emugl/common/latency_histogram.h"
+
+#include <string.h>
+
+namespace emugl {
+
+LatencyHistogram::LatencyHistogram() {
+    clear();
+}
+
+void LatencyHistogram::clear() {
+    memset(mBuckets, 0, sizeof(mBuckets));
+    mCount = 0;
+    mSum = 0;
+    mMax = 0;
+}
+
+// static
+int LatencyHistogram::bucketIndex(uint64_t value) {
+    const uint64_t kSubCount = 1U << kSubBits;
+    if (value < kSubCount) {
+        return static_cast<int>(value);
+    }
+    // |exp| is the index of the highest bit set, at least kSubBits.
+    int exp = kSubBits;
+    while (exp < 63 && (value >> (exp + 1))) {
+        exp++;
+    }
+    int shift = exp - kSubBits;
+    return static_cast<int>(((exp - kSubBits + 1) << kSubBits) +
+                            ((value >> shift) & (kSubCount - 1)));
+}
+
+// static
+uint64_t LatencyHistogram::bucketLimit(int index) {
+    const int kSubCount = 1 << kSubBits;
+    if (index < kSubCount) {
+        return index;
+    }
+    int shift = (index >> kSubBits) - 1;
+    uint64_t low = static_cast<uint64_t>(kSubCount + (index & (kSubCount - 1)))
+                   << shift;
+    return low + ((1ULL << shift) - 1);
+}
+
+void LatencyHistogram::add(uint64_t value) {
+    mBuckets[bucketIndex(value)]++;
+    mCount++;
+    mSum += value;
+    if (value > mMax) {
+        mMax = value;
+    }
+}
+
+double LatencyHistogram::average() const {
+    return mCount ? static_cast<double>(mSum) / mCount : 0.;
+}
+
+uint64_t LatencyHistogram::percentile(double percent) const {
+    if (!mCount) {
+        return 0;
+    }
+    // The rank of the value, starting at 1.
+    uint64_t rank = static_cast<uint64_t>(percent * mCount / 100.);
+    if (rank * 100. < percent * mCount) {
+        rank++;
+    }
+    if (rank < 1) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (int n = 0; n < kBucketCount; ++n) {
+        seen += mBuckets[n];
+        if (seen >= rank) {
+            uint64_t limit = bucketLimit(n);
+            return limit < mMax ? limit : mMax;
+        }
+    }
+    return mMax;
+}
+
+}  // namespace emugl
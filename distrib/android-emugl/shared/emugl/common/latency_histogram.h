@@ -0,0 +1,66 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef EMUGL_COMMON_LATENCY_HISTOGRAM_H
+#define EMUGL_COMMON_LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+
+namespace emugl {
+
+// A histogram of durations, e.g. in microseconds. Values below 8 have
+// their own bucket, and each power of two above is split into 8 buckets,
+// so that percentiles are reported within 12.5% of the recorded values
+// with a fixed amount of memory.
+//
+// This is not thread-safe.
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    // Remove all the values.
+    void clear();
+
+    // Record a new |value|.
+    void add(uint64_t value);
+
+    // Return the number of recorded values.
+    uint64_t count() const { return mCount; }
+
+    // Return the average and the largest recorded values, or 0 if there
+    // are none.
+    double average() const;
+    uint64_t max() const { return mMax; }
+
+    // Return an upper bound of the |percent| percentile of the recorded
+    // values, i.e. the upper limit of the bucket that contains it, without
+    // exceeding max(). Return 0 if there are no values.
+    uint64_t percentile(double percent) const;
+
+private:
+    static const int kSubBits = 3;
+    static const int kBucketCount = (64 - kSubBits + 1) << kSubBits;
+
+    static int bucketIndex(uint64_t value);
+    static uint64_t bucketLimit(int index);
+
+    uint64_t mBuckets[kBucketCount];
+    uint64_t mCount;
+    uint64_t mSum;
+    uint64_t mMax;
+};
+
+}  // namespace emugl
+
+#endif  // EMUGL_COMMON_LATENCY_HISTOGRAM_H
@@ -0,0 +1,86 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "emugl/common/latency_histogram.h"
+
+#include <gtest/gtest.h>
+
+namespace emugl {
+
+TEST(LatencyHistogram, Empty) {
+    LatencyHistogram h;
+    EXPECT_EQ(0U, h.count());
+    EXPECT_EQ(0U, h.max());
+    EXPECT_EQ(0., h.average());
+    EXPECT_EQ(0U, h.percentile(50.));
+}
+
+TEST(LatencyHistogram, SmallValuesAreExact) {
+    LatencyHistogram h;
+    for (uint64_t n = 0; n < 8; ++n) {
+        h.add(n);
+    }
+    EXPECT_EQ(8U, h.count());
+    EXPECT_EQ(7U, h.max());
+    EXPECT_DOUBLE_EQ(3.5, h.average());
+    EXPECT_EQ(0U, h.percentile(0.));
+    EXPECT_EQ(3U, h.percentile(50.));
+    EXPECT_EQ(6U, h.percentile(80.));
+    EXPECT_EQ(7U, h.percentile(100.));
+}
+
+TEST(LatencyHistogram, PercentilesAreUpperBounds) {
+    LatencyHistogram h;
+    for (uint64_t n = 1; n <= 10000; ++n) {
+        h.add(n);
+    }
+    EXPECT_EQ(10000U, h.count());
+    EXPECT_EQ(10000U, h.max());
+    EXPECT_DOUBLE_EQ(5000.5, h.average());
+
+    static const double kPercents[] = { 1., 10., 50., 90., 99., 99.9 };
+    for (size_t n = 0; n < sizeof(kPercents) / sizeof(kPercents[0]); ++n) {
+        uint64_t expected = static_cast<uint64_t>(kPercents[n] * 100.);
+        uint64_t value = h.percentile(kPercents[n]);
+        EXPECT_LE(expected, value) << kPercents[n];
+        EXPECT_GE(expected * 1.125, value) << kPercents[n];
+    }
+    EXPECT_EQ(10000U, h.percentile(100.));
+}
+
+TEST(LatencyHistogram, LargeValues) {
+    LatencyHistogram h;
+    const uint64_t kLarge = ~0ULL;
+    h.add(kLarge);
+    h.add(1ULL << 40);
+    EXPECT_EQ(kLarge, h.max());
+    EXPECT_EQ(kLarge, h.percentile(100.));
+    uint64_t low = h.percentile(50.);
+    EXPECT_LE(1ULL << 40, low);
+    EXPECT_GT((1ULL << 40) + (1ULL << 37), low);
+}
+
+TEST(LatencyHistogram, Clear) {
+    LatencyHistogram h;
+    h.add(100);
+    h.add(1000);
+    h.clear();
+    EXPECT_EQ(0U, h.count());
+    EXPECT_EQ(0U, h.max());
+    EXPECT_EQ(0U, h.percentile(99.));
+    h.add(5);
+    EXPECT_EQ(5U, h.percentile(50.));
+}
+
+}  // namespace emugl
@@ -0,0 +1,68 @@
+// Copyright 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "emugl/common/lock_profiler.h"
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+namespace emugl {
+
+TEST(LockSite, GetReturnsSameSite) {
+    LockSite* site = LockSite::get("LockSiteTest.Same");
+    EXPECT_STREQ("LockSiteTest.Same", site->name());
+    EXPECT_EQ(site, LockSite::get("LockSiteTest.Same"));
+    EXPECT_NE(site, LockSite::get("LockSiteTest.Other"));
+}
+
+TEST(LockSite, Stats) {
+    LockSite* site = LockSite::get("LockSiteTest.Stats");
+    site->reset();
+    site->addAcquisition(false, 0);
+    site->addAcquisition(true, 300);
+    site->addAcquisition(true, 100);
+    site->addHold(50);
+    site->addHold(20);
+
+    LockSite::Stats stats = site->stats();
+    EXPECT_EQ(3U, stats.acquisitions);
+    EXPECT_EQ(2U, stats.contentions);
+    EXPECT_EQ(400U, stats.waitNs);
+    EXPECT_EQ(300U, stats.maxWaitNs);
+    EXPECT_EQ(70U, stats.holdNs);
+    EXPECT_EQ(50U, stats.maxHoldNs);
+
+    site->reset();
+    stats = site->stats();
+    EXPECT_EQ(0U, stats.acquisitions);
+    EXPECT_EQ(0U, stats.maxHoldNs);
+}
+
+TEST(LockSite, NowNsIsMonotonic) {
+    uint64_t first = LockSite::nowNs();
+    EXPECT_LE(first, LockSite::nowNs());
+}
+
+TEST(LockSite, PrintAllTruncates) {
+    LockSite::get("LockSiteTest.Print");
+    size_t size = LockSite::printAll(NULL, 0);
+    EXPECT_GT(size, 0U);
+
+    char buffer[8];
+    EXPECT_EQ(size, LockSite::printAll(buffer, sizeof(buffer)));
+    EXPECT_EQ(sizeof(buffer) - 1, strlen(buffer));
+}
+
+}  // namespace emugl
@@ -22,20 +22,32 @@
 #  include <pthread.h>
 #endif
 
+#if EMUGL_LOCK_PROFILING
+#  include "emugl/common/lock_profiler.h"
+#endif
+
 namespace emugl {
 
 class ConditionVariable;
 
 // Simple wrapper class for mutexes.
+//
+// Builds with EMUGL_LOCK_PROFILING defined to 1 record, for each mutex
+// created with a name, how often and for how long threads wait for it and
+// hold it, in the emugl::LockSite of that name. Mutexes without a name,
+// and all mutexes of other builds, aren't instrumented, and the name
+// costs nothing there.
 class Mutex {
 public:
     // Constructor.
     Mutex() {
-#ifdef _WIN32
-        ::InitializeCriticalSection(&mLock);
-#else
-        ::pthread_mutex_init(&mLock, NULL);
-#endif
+        init(NULL);
+    }
+
+    // Constructor for a mutex that is profiled as |name|, which must be a
+    // string literal. Mutexes with the same name share their statistics.
+    explicit Mutex(const char* name) {
+        init(name);
     }
 
     // Destructor.
@@ -49,20 +61,46 @@ public:
 
     // Acquire the mutex.
     void lock() {
-#ifdef _WIN32
-      ::EnterCriticalSection(&mLock);
-#else
-      ::pthread_mutex_lock(&mLock);
+#if EMUGL_LOCK_PROFILING
+        if (mSite) {
+            if (rawTryLock()) {
+                mSite->addAcquisition(false, 0);
+                mHoldStartNs = LockSite::nowNs();
+                return;
+            }
+            uint64_t startNs = LockSite::nowNs();
+            rawLock();
+            mHoldStartNs = LockSite::nowNs();
+            mSite->addAcquisition(true, mHoldStartNs - startNs);
+            return;
+        }
+#endif
+        rawLock();
+    }
+
+    // Try to acquire the mutex without blocking. Return true on success,
+    // or false if another thread holds it.
+    bool tryLock() {
+        if (!rawTryLock()) {
+            return false;
+        }
+#if EMUGL_LOCK_PROFILING
+        if (mSite) {
+            mSite->addAcquisition(false, 0);
+            mHoldStartNs = LockSite::nowNs();
+        }
 #endif
+        return true;
     }
 
     // Release the mutex.
     void unlock() {
-#ifdef _WIN32
-       ::LeaveCriticalSection(&mLock);
-#else
-       ::pthread_mutex_unlock(&mLock);
+#if EMUGL_LOCK_PROFILING
+        if (mSite) {
+            mSite->addHold(LockSite::nowNs() - mHoldStartNs);
+        }
 #endif
+        rawUnlock();
     }
 
     // Helper class to lock / unlock a mutex automatically on scope
@@ -81,13 +119,54 @@ public:
     };
 
 private:
+    void init(const char* name) {
+#ifdef _WIN32
+        ::InitializeCriticalSection(&mLock);
+#else
+        ::pthread_mutex_init(&mLock, NULL);
+#endif
+#if EMUGL_LOCK_PROFILING
+        mSite = name ? LockSite::get(name) : NULL;
+        mHoldStartNs = 0;
+#else
+        (void)name;
+#endif
+    }
+
+    void rawLock() {
+#ifdef _WIN32
+        ::EnterCriticalSection(&mLock);
+#else
+        ::pthread_mutex_lock(&mLock);
+#endif
+    }
+
+    bool rawTryLock() {
+#ifdef _WIN32
+        return ::TryEnterCriticalSection(&mLock) != 0;
+#else
+        return ::pthread_mutex_trylock(&mLock) == 0;
+#endif
+    }
+
+    void rawUnlock() {
+#ifdef _WIN32
+        ::LeaveCriticalSection(&mLock);
+#else
+        ::pthread_mutex_unlock(&mLock);
+#endif
+    }
+
 #ifdef _WIN32
     CRITICAL_SECTION mLock;
 #else
     friend class ConditionVariable;
     pthread_mutex_t mLock;
 #endif
-
+#if EMUGL_LOCK_PROFILING
+    LockSite* mSite;
+    uint64_t mHoldStartNs;
+#endif
 };
 
 }  // namespace emugl
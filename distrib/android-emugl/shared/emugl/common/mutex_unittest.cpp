@@ -32,6 +32,54 @@ TEST(Mutex, LockUnlock) {
     lock.unlock();
 }
 
+// Check that tryLock() fails while another thread holds the mutex.
+struct TryLockParams {
+    Mutex mutex;
+    bool locked;
+};
+
+static void* tryLockFunction(void* param) {
+    TryLockParams* p = static_cast<TryLockParams*>(param);
+    p->locked = p->mutex.tryLock();
+    if (p->locked) {
+        p->mutex.unlock();
+    }
+    return NULL;
+}
+
+TEST(Mutex, TryLock) {
+    TryLockParams p;
+    EXPECT_TRUE(p.mutex.tryLock());
+
+    TestThread* thread = new TestThread(tryLockFunction, &p);
+    thread->join();
+    delete thread;
+    EXPECT_FALSE(p.locked);
+
+    p.mutex.unlock();
+    thread = new TestThread(tryLockFunction, &p);
+    thread->join();
+    delete thread;
+    EXPECT_TRUE(p.locked);
+}
+
+// Check that a named mutex works, and is profiled if enabled.
+TEST(Mutex, Named) {
+    Mutex mutex("MutexTest.Named");
+#if EMUGL_LOCK_PROFILING
+    LockSite* site = LockSite::get("MutexTest.Named");
+    site->reset();
+#endif
+    mutex.lock();
+    mutex.unlock();
+    EXPECT_TRUE(mutex.tryLock());
+    mutex.unlock();
+#if EMUGL_LOCK_PROFILING
+    EXPECT_EQ(2U, site->stats().acquisitions);
+    EXPECT_EQ(0U, site->stats().contentions);
+#endif
+}
+
 // Check that AutoLock compiles and doesn't crash.
 TEST(Mutex, AutoLock) {
     Mutex mutex;
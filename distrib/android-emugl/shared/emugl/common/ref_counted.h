@@ -0,0 +1,165 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef EMUGL_COMMON_REF_COUNTED_H
+#define EMUGL_COMMON_REF_COUNTED_H
+
+#include <stddef.h>
+
+namespace emugl {
+
+// Base class for objects owned by RefPtr<> instances. The reference count
+// lives in the object itself, so unlike SmartPtr<>, there is no separate
+// heap-allocated counter, and the count is updated with inline atomic
+// operations rather than out-of-line calls.
+//
+// The count starts at 0, and the object is deleted when the last RefPtr<>
+// releases it. Never delete such an object directly once it is owned.
+class RefCounted {
+public:
+    RefCounted() : mRefCount(0) {}
+
+    // Return the current reference count. Only use it for unit testing, or
+    // when no other thread can take a reference concurrently.
+    int getRefCount() const {
+        return __atomic_load_n(&mRefCount, __ATOMIC_RELAXED);
+    }
+
+    // Used by RefPtr<>.
+    void incRef() const {
+        __atomic_fetch_add(&mRefCount, 1, __ATOMIC_RELAXED);
+    }
+
+    // Used by RefPtr<>, return true if this released the last reference.
+    bool decRef() const {
+        return __atomic_sub_fetch(&mRefCount, 1, __ATOMIC_ACQ_REL) == 0;
+    }
+
+protected:
+    // Not virtual: RefPtr<T> deletes a T*, where T is the derived type.
+    ~RefCounted() {}
+
+private:
+    // Copies start with their own count.
+    RefCounted(const RefCounted&) : mRefCount(0) {}
+    RefCounted& operator=(const RefCounted&) { return *this; }
+
+    mutable int mRefCount;
+};
+
+// A smart pointer to a RefCounted-derived object, with the same interface
+// as SmartPtr<> so the two can be exchanged by changing a typedef:
+//
+//     class Foo : public emugl::RefCounted { ... };
+//     typedef emugl::RefPtr<Foo> FooPtr;
+//
+//     FooPtr ptr(new Foo());   // takes ownership.
+//     FooPtr ptr2 = ptr;       // increments the reference count.
+//
+// Since the count is in the object, wrapping the same raw pointer in two
+// unrelated RefPtr<> instances is fine, unlike with SmartPtr<>.
+//
+// Copies always touch the shared count, which is a contended cache line
+// when many threads use the same object. Code that only needs the object
+// for the duration of a call should borrow it, by passing or returning a
+// 'const RefPtr<T>&' or a raw T*, and use swap() to transfer ownership
+// without updating the count.
+template <class T>
+class RefPtr {
+public:
+    // Default constructor. The instance holds a NULL pointer.
+    RefPtr() : mPtr(NULL) {}
+
+    // Regular constructor, takes a reference to |ptr|.
+    explicit RefPtr(T* ptr) : mPtr(ptr) {
+        if (mPtr) {
+            mPtr->incRef();
+        }
+    }
+
+    // Copy-constructor, increments the reference count.
+    RefPtr(const RefPtr& other) : mPtr(other.mPtr) {
+        if (mPtr) {
+            mPtr->incRef();
+        }
+    }
+
+    // Assignment operator, same semantics as copy-constructor.
+    RefPtr& operator=(const RefPtr& other) {
+        T* oldPtr = mPtr;
+        mPtr = other.mPtr;
+        if (mPtr) {
+            mPtr->incRef();
+        }
+        releasePtr(oldPtr);
+        return *this;
+    }
+
+    // Destructor, releases the reference and destroys the object if this
+    // was the last one.
+    ~RefPtr() {
+        releasePtr(mPtr);
+    }
+
+    // Exchange the pointers of |this| and |other|, without touching the
+    // reference counts.
+    void swap(RefPtr& other) {
+        T* ptr = mPtr;
+        mPtr = other.mPtr;
+        other.mPtr = ptr;
+    }
+
+    // Used to enable 'if (ref_ptr) { ... }' properly.
+    operator void*() const {
+        return mPtr;
+    }
+
+    // Return owned object instance, or NULL.
+    T* Ptr() const {
+        return mPtr;
+    }
+
+    // Return owned object instance, or NULL.
+    const T* constPtr() const {
+        return mPtr;
+    }
+
+    // Operate directly on owned object.
+    T* operator->() const {
+        return mPtr;
+    }
+
+    // Return reference to owned object.
+    T& operator*() const {
+        return *mPtr;
+    }
+
+    // Return the object's reference count, only use for unit testing.
+    int getRefCount() const {
+        return mPtr ? mPtr->getRefCount() : 0;
+    }
+
+private:
+    static void releasePtr(T* ptr) {
+        if (ptr && ptr->decRef()) {
+            delete ptr;
+        }
+    }
+
+    T* mPtr;
+};
+
+}  // namespace emugl
+
+#endif  // EMUGL_COMMON_REF_COUNTED_H
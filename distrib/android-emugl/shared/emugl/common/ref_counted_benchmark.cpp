@@ -0,0 +1,147 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A micro-benchmark that compares the cost of taking a reference to an
+// object through emugl::SmartPtr<>, emugl::RefPtr<>, and borrowing it
+// through a const reference, as GLEScontext::shareGroup() does, from one
+// thread and from several threads sharing the same object.
+//
+// Usage: emugl_ref_counted_benchmark [<copies> [<threads>]]
+
+#include "emugl/common/ref_counted.h"
+#include "emugl/common/smart_ptr.h"
+#include "emugl/common/thread.h"
+
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+namespace {
+
+struct Object : public emugl::RefCounted {
+    Object() : value(1) {}
+    int value;
+};
+
+typedef emugl::SmartPtr<Object> ObjectSmartPtr;
+typedef emugl::RefPtr<Object> ObjectRefPtr;
+
+// Mimics a GLEScontext, whose share group is looked up by every GL call.
+struct Holder {
+    ObjectSmartPtr smart;
+    ObjectRefPtr ref;
+
+    ObjectSmartPtr getSmart() const { return smart; }
+    ObjectRefPtr getRef() const { return ref; }
+    const ObjectRefPtr& borrowRef() const { return ref; }
+};
+
+enum Mode { SMART_PTR, REF_PTR, BORROW };
+
+double nowNs() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1e9 + tv.tv_usec * 1e3;
+}
+
+// Prevent the compiler from optimizing the calls away.
+int run(const Holder* holder, Mode mode, size_t copies) {
+    volatile int sum = 0;
+    for (size_t n = 0; n < copies; ++n) {
+        switch (mode) {
+        case SMART_PTR:
+            sum += holder->getSmart()->value;
+            break;
+        case REF_PTR:
+            sum += holder->getRef()->value;
+            break;
+        case BORROW:
+            sum += holder->borrowRef()->value;
+            break;
+        }
+    }
+    return sum;
+}
+
+class BenchThread : public emugl::Thread {
+public:
+    BenchThread(const Holder* holder, Mode mode, size_t copies) :
+            mHolder(holder), mMode(mode), mCopies(copies) {}
+
+    virtual intptr_t main() {
+        return run(mHolder, mMode, mCopies);
+    }
+
+private:
+    const Holder* mHolder;
+    Mode mMode;
+    size_t mCopies;
+};
+
+// Return the average time of an access, in nanoseconds of wall time.
+double measure(const Holder* holder, Mode mode, size_t copies,
+               int threadCount) {
+    std::vector<BenchThread*> threads(threadCount);
+    for (int n = 0; n < threadCount; ++n) {
+        threads[n] = new BenchThread(holder, mode, copies);
+    }
+    double start = nowNs();
+    for (int n = 0; n < threadCount; ++n) {
+        threads[n]->start();
+    }
+    for (int n = 0; n < threadCount; ++n) {
+        threads[n]->wait(NULL);
+        delete threads[n];
+    }
+    return (nowNs() - start) / copies;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    size_t copies = 10000000;
+    int threadCount = 4;
+    if (argc > 1) {
+        copies = static_cast<size_t>(atol(argv[1]));
+    }
+    if (argc > 2) {
+        threadCount = atoi(argv[2]);
+    }
+    if (copies == 0 || threadCount <= 0) {
+        fprintf(stderr, "Invalid parameters\n");
+        return 1;
+    }
+
+    Holder holder;
+    holder.smart = ObjectSmartPtr(new Object());
+    holder.ref = ObjectRefPtr(new Object());
+
+    static const char* const kNames[] = {
+        "emugl::SmartPtr copy", "emugl::RefPtr copy", "const ref borrow",
+    };
+    static const int kThreadCounts[] = { 1, threadCount };
+
+    printf("%zu accesses per thread:\n", copies);
+    for (int t = 0; t < 2; ++t) {
+        for (int mode = SMART_PTR; mode <= BORROW; ++mode) {
+            printf("  %-22s %2d thread(s): %7.2f ns/access\n",
+                   kNames[mode], kThreadCounts[t],
+                   measure(&holder, static_cast<Mode>(mode), copies,
+                           kThreadCounts[t]));
+        }
+    }
+    return 0;
+}
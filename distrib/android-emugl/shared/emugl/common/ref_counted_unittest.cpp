@@ -0,0 +1,154 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "emugl/common/ref_counted.h"
+
+#include "emugl/common/thread.h"
+
+#include <gtest/gtest.h>
+
+namespace emugl {
+
+namespace {
+
+class MyClass : public RefCounted {
+public:
+    explicit MyClass(int* deleteCount) : mDeleteCount(deleteCount) {}
+    ~MyClass() { (*mDeleteCount)++; }
+
+    int value() const { return 42; }
+
+private:
+    int* mDeleteCount;
+};
+
+typedef RefPtr<MyClass> MyClassPtr;
+
+}  // namespace
+
+TEST(RefPtr, Empty) {
+    MyClassPtr ptr;
+    EXPECT_FALSE(ptr.Ptr());
+    EXPECT_FALSE(ptr);
+    EXPECT_EQ(0, ptr.getRefCount());
+}
+
+TEST(RefPtr, SingleRef) {
+    int deleteCount = 0;
+    MyClass* obj = new MyClass(&deleteCount);
+    {
+        MyClassPtr ptr(obj);
+        EXPECT_EQ(obj, ptr.Ptr());
+        EXPECT_EQ(1, ptr.getRefCount());
+        EXPECT_EQ(42, ptr->value());
+        EXPECT_EQ(42, (*ptr).value());
+    }
+    EXPECT_EQ(1, deleteCount);
+}
+
+TEST(RefPtr, CopyAndAssign) {
+    int deleteCount = 0;
+    MyClassPtr ptr1(new MyClass(&deleteCount));
+    MyClassPtr ptr2(new MyClass(&deleteCount));
+    {
+        MyClassPtr ptr3(ptr1);
+        EXPECT_EQ(2, ptr1.getRefCount());
+    }
+    EXPECT_EQ(1, ptr1.getRefCount());
+
+    ptr2 = ptr1;
+    EXPECT_EQ(1, deleteCount);
+    EXPECT_EQ(ptr1.Ptr(), ptr2.Ptr());
+    EXPECT_EQ(2, ptr1.getRefCount());
+
+    // Self-assignment keeps the object alive.
+    ptr1 = ptr1;
+    EXPECT_EQ(2, ptr1.getRefCount());
+
+    ptr1 = MyClassPtr();
+    ptr2 = MyClassPtr();
+    EXPECT_EQ(2, deleteCount);
+}
+
+TEST(RefPtr, SameRawPointerTwice) {
+    // Unlike SmartPtr<>, two RefPtr<> made from the same raw pointer
+    // share its count.
+    int deleteCount = 0;
+    MyClass* obj = new MyClass(&deleteCount);
+    MyClassPtr ptr1(obj);
+    {
+        MyClassPtr ptr2(obj);
+        EXPECT_EQ(2, ptr1.getRefCount());
+    }
+    EXPECT_EQ(0, deleteCount);
+    ptr1 = MyClassPtr();
+    EXPECT_EQ(1, deleteCount);
+}
+
+TEST(RefPtr, Swap) {
+    int deleteCount = 0;
+    MyClass* obj = new MyClass(&deleteCount);
+    MyClassPtr ptr1(obj);
+    MyClassPtr ptr2;
+    ptr2.swap(ptr1);
+    EXPECT_FALSE(ptr1.Ptr());
+    EXPECT_EQ(obj, ptr2.Ptr());
+    EXPECT_EQ(1, ptr2.getRefCount());
+    EXPECT_EQ(0, deleteCount);
+}
+
+namespace {
+
+const int kThreadCount = 8;
+const int kCopyCount = 10000;
+
+class CopyThread : public Thread {
+public:
+    explicit CopyThread(const MyClassPtr& ptr) : mPtr(ptr) {}
+
+    virtual intptr_t main() {
+        for (int n = 0; n < kCopyCount; ++n) {
+            MyClassPtr copy(mPtr);
+            MyClassPtr other;
+            other = copy;
+        }
+        return 0;
+    }
+
+private:
+    MyClassPtr mPtr;
+};
+
+}  // namespace
+
+TEST(RefPtr, ConcurrentCopies) {
+    int deleteCount = 0;
+    MyClassPtr ptr(new MyClass(&deleteCount));
+    CopyThread* threads[kThreadCount];
+    for (int n = 0; n < kThreadCount; ++n) {
+        threads[n] = new CopyThread(ptr);
+        EXPECT_TRUE(threads[n]->start());
+    }
+    for (int n = 0; n < kThreadCount; ++n) {
+        intptr_t result;
+        EXPECT_TRUE(threads[n]->wait(&result));
+        delete threads[n];
+    }
+    EXPECT_EQ(1, ptr.getRefCount());
+    EXPECT_EQ(0, deleteCount);
+    ptr = MyClassPtr();
+    EXPECT_EQ(1, deleteCount);
+}
+
+}  // namespace emugl
@@ -0,0 +1,270 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef EMUGL_COMMON_SEQLOCK_HASH_MAP_H
+#define EMUGL_COMMON_SEQLOCK_HASH_MAP_H
+
+#include "emugl/common/pod_vector.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+namespace emugl {
+
+// A hash map from integer keys of type |K| to integer values of type |V|,
+// optimized for read-mostly usage from several threads:
+//
+// - find() never blocks and can be called from any thread at any time,
+//   including while another thread modifies the map.
+//
+// - set(), erase() and clear() must be serialized by the caller, e.g. by
+//   always calling them with the same Mutex held.
+//
+// This uses open addressing with linear probing, protected by a sequence
+// counter: a reader retries its lookup if a writer modified the table in
+// the meantime. Since a reader may still be probing an old table after it
+// was grown, old tables are only freed when the map is destroyed. Their
+// total size is always smaller than the current table's, since the
+// capacity doubles each time, and erase() never reallocates.
+template <typename K, typename V>
+class SeqLockHashMap {
+public:
+    SeqLockHashMap() : mSeq(0), mTable(NULL), mCount(0), mRetired() {}
+
+    ~SeqLockHashMap() {
+        free(mTable);
+        for (size_t n = 0; n < mRetired.size(); ++n) {
+            free(mRetired[n]);
+        }
+    }
+
+    // Return the number of items in the map. Only call this from writers.
+    size_t size() const { return mCount; }
+
+    // Find the value associated with |key|. On success, return true and
+    // set |*value|. Otherwise return false.
+    bool find(K key, V* value) const;
+
+    // Associate |value| with |key|, replacing any previous value.
+    void set(K key, V value);
+
+    // Remove |key| from the map. Return true iff it was in it.
+    bool erase(K key);
+
+    // Remove all items from the map.
+    void clear();
+
+private:
+    struct Slot {
+        K key;
+        V value;
+        int used;
+    };
+
+    struct Table {
+        size_t capacity;  // Always a power of 2.
+        Slot slots[1];
+    };
+
+    static const size_t kMinCapacity = 16;
+
+    static size_t hashKey(K key) {
+        uint64_t h = static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ULL;
+        return static_cast<size_t>(h ^ (h >> 32));
+    }
+
+    template <typename T>
+    static T loadRelaxed(const T* ptr) {
+        return __atomic_load_n(ptr, __ATOMIC_RELAXED);
+    }
+
+    template <typename T>
+    static void storeRelaxed(T* ptr, T value) {
+        __atomic_store_n(ptr, value, __ATOMIC_RELAXED);
+    }
+
+    static void copySlot(Slot* to, const Slot* from) {
+        storeRelaxed(&to->key, from->key);
+        storeRelaxed(&to->value, from->value);
+        storeRelaxed(&to->used, from->used);
+    }
+
+    // Return the index of |key| in |table|, or -1.
+    static ptrdiff_t findIndex(const Table* table, K key);
+
+    // Begin and end a modification of the table.
+    void beginWrite() {
+        storeRelaxed(&mSeq, mSeq + 1);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+    }
+
+    void endWrite() {
+        __atomic_store_n(&mSeq, mSeq + 1, __ATOMIC_RELEASE);
+    }
+
+    // Make sure there is room for one more item.
+    void reserveOne();
+
+    unsigned mSeq;
+    Table* mTable;
+    size_t mCount;
+    PodVector<Table*> mRetired;
+};
+
+template <typename K, typename V>
+ptrdiff_t SeqLockHashMap<K, V>::findIndex(const Table* table, K key) {
+    size_t mask = table->capacity - 1;
+    size_t index = hashKey(key) & mask;
+    // The loop is bounded because the table may be modified concurrently.
+    for (size_t n = 0; n <= mask; ++n) {
+        const Slot* slot = &table->slots[index];
+        if (!loadRelaxed(&slot->used)) {
+            break;
+        }
+        if (loadRelaxed(&slot->key) == key) {
+            return static_cast<ptrdiff_t>(index);
+        }
+        index = (index + 1) & mask;
+    }
+    return -1;
+}
+
+template <typename K, typename V>
+bool SeqLockHashMap<K, V>::find(K key, V* value) const {
+    for (;;) {
+        unsigned seq = __atomic_load_n(&mSeq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            // A writer is modifying the table.
+            continue;
+        }
+        const Table* table = __atomic_load_n(&mTable, __ATOMIC_ACQUIRE);
+        ptrdiff_t index = table ? findIndex(table, key) : -1;
+        V result = V();
+        if (index >= 0) {
+            result = loadRelaxed(&table->slots[index].value);
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (loadRelaxed(&mSeq) == seq) {
+            if (index >= 0) {
+                *value = result;
+            }
+            return index >= 0;
+        }
+    }
+}
+
+template <typename K, typename V>
+void SeqLockHashMap<K, V>::reserveOne() {
+    // Keep at least one quarter of the slots empty, so that probing
+    // sequences remain short.
+    if (mTable && (mCount + 1) * 4 <= mTable->capacity * 3) {
+        return;
+    }
+    size_t capacity = mTable ? mTable->capacity * 2 : kMinCapacity;
+    size_t size = sizeof(Table) + (capacity - 1) * sizeof(Slot);
+    Table* table = static_cast<Table*>(calloc(1, size));
+    table->capacity = capacity;
+
+    // The new table is not visible to readers yet.
+    size_t mask = capacity - 1;
+    Table* oldTable = mTable;
+    if (oldTable) {
+        for (size_t n = 0; n < oldTable->capacity; ++n) {
+            const Slot& slot = oldTable->slots[n];
+            if (!slot.used) {
+                continue;
+            }
+            size_t index = hashKey(slot.key) & mask;
+            while (table->slots[index].used) {
+                index = (index + 1) & mask;
+            }
+            table->slots[index] = slot;
+        }
+        mRetired.push_back(oldTable);
+    }
+    __atomic_store_n(&mTable, table, __ATOMIC_RELEASE);
+}
+
+template <typename K, typename V>
+void SeqLockHashMap<K, V>::set(K key, V value) {
+    beginWrite();
+    ptrdiff_t index = mTable ? findIndex(mTable, key) : -1;
+    if (index >= 0) {
+        storeRelaxed(&mTable->slots[index].value, value);
+    } else {
+        reserveOne();
+        size_t mask = mTable->capacity - 1;
+        size_t pos = hashKey(key) & mask;
+        while (mTable->slots[pos].used) {
+            pos = (pos + 1) & mask;
+        }
+        Slot* slot = &mTable->slots[pos];
+        storeRelaxed(&slot->key, key);
+        storeRelaxed(&slot->value, value);
+        storeRelaxed(&slot->used, 1);
+        mCount++;
+    }
+    endWrite();
+}
+
+template <typename K, typename V>
+bool SeqLockHashMap<K, V>::erase(K key) {
+    ptrdiff_t index = mTable ? findIndex(mTable, key) : -1;
+    if (index < 0) {
+        return false;
+    }
+    beginWrite();
+    // Backward-shift deletion: move the following items of the probing
+    // sequence into the hole, so no tombstones are needed.
+    size_t mask = mTable->capacity - 1;
+    size_t hole = static_cast<size_t>(index);
+    size_t next = hole;
+    for (;;) {
+        next = (next + 1) & mask;
+        Slot* slot = &mTable->slots[next];
+        if (!slot->used) {
+            break;
+        }
+        size_t home = hashKey(slot->key) & mask;
+        // Keep the item in place if its home is cyclically in (hole, next].
+        bool stays = (hole <= next) ? (hole < home && home <= next)
+                                    : (hole < home || home <= next);
+        if (!stays) {
+            copySlot(&mTable->slots[hole], slot);
+            hole = next;
+        }
+    }
+    storeRelaxed(&mTable->slots[hole].used, 0);
+    mCount--;
+    endWrite();
+    return true;
+}
+
+template <typename K, typename V>
+void SeqLockHashMap<K, V>::clear() {
+    if (!mTable) {
+        return;
+    }
+    beginWrite();
+    for (size_t n = 0; n < mTable->capacity; ++n) {
+        storeRelaxed(&mTable->slots[n].used, 0);
+    }
+    mCount = 0;
+    endWrite();
+}
+
+}  // namespace emugl
+
+#endif  // EMUGL_COMMON_SEQLOCK_HASH_MAP_H
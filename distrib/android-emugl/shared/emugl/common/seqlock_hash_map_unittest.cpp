@@ -0,0 +1,213 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "emugl/common/seqlock_hash_map.h"
+
+#include "emugl/common/thread.h"
+
+#include <gtest/gtest.h>
+
+namespace emugl {
+
+typedef SeqLockHashMap<unsigned long long, unsigned> TestMap;
+
+TEST(SeqLockHashMap, Empty) {
+    TestMap map;
+    unsigned value = 42;
+    EXPECT_EQ(0U, map.size());
+    EXPECT_FALSE(map.find(1, &value));
+    EXPECT_EQ(42U, value);
+    EXPECT_FALSE(map.erase(1));
+    map.clear();
+    EXPECT_EQ(0U, map.size());
+}
+
+TEST(SeqLockHashMap, SetFindErase) {
+    TestMap map;
+    const unsigned long long kCount = 1000;
+    for (unsigned long long n = 0; n < kCount; ++n) {
+        map.set(n, static_cast<unsigned>(n * 3));
+    }
+    EXPECT_EQ(kCount, map.size());
+
+    for (unsigned long long n = 0; n < kCount; ++n) {
+        unsigned value = 0;
+        EXPECT_TRUE(map.find(n, &value)) << "key " << n;
+        EXPECT_EQ(n * 3, value) << "key " << n;
+    }
+
+    // Replace the odd values.
+    for (unsigned long long n = 1; n < kCount; n += 2) {
+        map.set(n, 7);
+    }
+    EXPECT_EQ(kCount, map.size());
+
+    // Erase the even ones.
+    for (unsigned long long n = 0; n < kCount; n += 2) {
+        EXPECT_TRUE(map.erase(n)) << "key " << n;
+        EXPECT_FALSE(map.erase(n)) << "key " << n;
+    }
+    EXPECT_EQ(kCount / 2, map.size());
+
+    for (unsigned long long n = 0; n < kCount; ++n) {
+        unsigned value = 0;
+        if (n & 1) {
+            EXPECT_TRUE(map.find(n, &value)) << "key " << n;
+            EXPECT_EQ(7U, value) << "key " << n;
+        } else {
+            EXPECT_FALSE(map.find(n, &value)) << "key " << n;
+        }
+    }
+
+    map.clear();
+    EXPECT_EQ(0U, map.size());
+    for (unsigned long long n = 0; n < kCount; ++n) {
+        unsigned value = 0;
+        EXPECT_FALSE(map.find(n, &value)) << "key " << n;
+    }
+}
+
+TEST(SeqLockHashMap, LargeKeys) {
+    TestMap map;
+    const unsigned long long kBase = 1ULL << 40;
+    for (unsigned long long n = 0; n < 100; ++n) {
+        map.set(kBase + (n << 32), static_cast<unsigned>(n));
+    }
+    for (unsigned long long n = 0; n < 100; ++n) {
+        unsigned value = 1000;
+        EXPECT_TRUE(map.find(kBase + (n << 32), &value));
+        EXPECT_EQ(n, value);
+        EXPECT_FALSE(map.find(n << 32, &value));
+    }
+}
+
+TEST(SeqLockHashMap, ChurnKeepsOtherItems) {
+    // Repeatedly adding and removing items must not lose the others,
+    // whatever their position in the probing sequences.
+    TestMap map;
+    for (unsigned long long n = 0; n < 50; ++n) {
+        map.set(n, static_cast<unsigned>(n + 1));
+    }
+    for (int round = 0; round < 1000; ++round) {
+        unsigned long long key = 1000 + round;
+        map.set(key, 1);
+        if (round & 1) {
+            EXPECT_TRUE(map.erase(key - 1));
+            EXPECT_TRUE(map.erase(key));
+        }
+        for (unsigned long long n = 0; n < 50; ++n) {
+            unsigned value = 0;
+            ASSERT_TRUE(map.find(n, &value)) << "round " << round;
+            ASSERT_EQ(n + 1, value) << "round " << round;
+        }
+    }
+    EXPECT_EQ(50U, map.size());
+}
+
+namespace {
+
+// The stress test below uses stable keys that are always in the map and
+// must always be found by readers, and volatile keys that are added and
+// removed by the writer. Values are always derived from keys, so readers
+// can check them.
+const unsigned long long kStableKeys = 256;
+const unsigned long long kVolatileKeys = 4096;
+const int kWriterRounds = 20;
+
+unsigned valueForKey(unsigned long long key) {
+    return static_cast<unsigned>(key * 7 + 1);
+}
+
+class WriterThread : public Thread {
+public:
+    explicit WriterThread(TestMap* map) : mMap(map), mDone(0) {}
+
+    virtual intptr_t main() {
+        for (int round = 0; round < kWriterRounds; ++round) {
+            for (unsigned long long n = 0; n < kVolatileKeys; ++n) {
+                unsigned long long key = kStableKeys + n;
+                mMap->set(key, valueForKey(key));
+            }
+            for (unsigned long long n = 0; n < kVolatileKeys; ++n) {
+                mMap->erase(kStableKeys + n);
+            }
+        }
+        __atomic_store_n(&mDone, 1, __ATOMIC_RELEASE);
+        return 0;
+    }
+
+    bool done() const { return __atomic_load_n(&mDone, __ATOMIC_ACQUIRE); }
+
+private:
+    TestMap* mMap;
+    int mDone;
+};
+
+class ReaderThread : public Thread {
+public:
+    ReaderThread(const TestMap* map, const WriterThread* writer)
+            : mMap(map), mWriter(writer) {}
+
+    // Returns the number of errors found.
+    virtual intptr_t main() {
+        intptr_t errors = 0;
+        unsigned long long key = 0;
+        while (!mWriter->done()) {
+            for (int n = 0; n < 1000; ++n) {
+                key = (key + 1) % (kStableKeys + kVolatileKeys);
+                unsigned value = 0;
+                bool found = mMap->find(key, &value);
+                if (key < kStableKeys && !found) {
+                    errors++;
+                } else if (found && value != valueForKey(key)) {
+                    errors++;
+                }
+            }
+        }
+        return errors;
+    }
+
+private:
+    const TestMap* mMap;
+    const WriterThread* mWriter;
+};
+
+}  // namespace
+
+TEST(SeqLockHashMap, ConcurrentReaders) {
+    TestMap map;
+    for (unsigned long long key = 0; key < kStableKeys; ++key) {
+        map.set(key, valueForKey(key));
+    }
+
+    const size_t kReaders = 4;
+    WriterThread writer(&map);
+    ReaderThread* readers[kReaders];
+    for (size_t n = 0; n < kReaders; ++n) {
+        readers[n] = new ReaderThread(&map, &writer);
+        EXPECT_TRUE(readers[n]->start()) << "reader " << n;
+    }
+    EXPECT_TRUE(writer.start());
+    EXPECT_TRUE(writer.wait(NULL));
+
+    for (size_t n = 0; n < kReaders; ++n) {
+        intptr_t errors = -1;
+        EXPECT_TRUE(readers[n]->wait(&errors)) << "reader " << n;
+        EXPECT_EQ(0, errors) << "reader " << n;
+        delete readers[n];
+    }
+    EXPECT_EQ(kStableKeys, map.size());
+}
+
+}  // namespace emugl
@@ -102,6 +102,10 @@ void g_strfreev(char** strings);
 gboolean g_str_equal(const void* s1, const void* s2);
 guint g_str_hash(const void* str);
 
+// Hash and equality functions for keys that point to 64-bit integers.
+gboolean g_int64_equal(const void* v1, const void* v2);
+guint g_int64_hash(const void* v);
+
 // Atomic operations
 
 void g_atomic_int_inc(int volatile* atomic);
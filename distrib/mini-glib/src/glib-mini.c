@@ -229,6 +229,17 @@ guint g_str_hash(const void* str) {
   return hash;
 }
 
+gboolean g_int64_equal(const void* v1, const void* v2) {
+  return *(const int64_t*)v1 == *(const int64_t*)v2;
+}
+
+guint g_int64_hash(const void* v) {
+  // The hash tables below only use the low bits of the hash, so mix all
+  // the bits of the value into them. Keys are often aligned addresses.
+  uint64_t hash = *(const uint64_t*)v * 0x9E3779B97F4A7C15ULL;
+  return (guint)(hash >> 32);
+}
+
 // Single-linked list
 
 static GSList* _g_slist_alloc(void) {
@@ -51,6 +51,7 @@
 #include <qemu.h>
 #endif
 #include "translate-all.h"
+#include "android/utils/mem_categories.h"
 
 //#define DEBUG_SUBPAGE
 
@@ -586,6 +587,8 @@ void cpu_tlb_update_dirty(CPUArchState *env)
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
         for(i = 0; i < CPU_TLB_SIZE; i++)
             tlb_update_dirty(&env->tlb_table[mmu_idx][i]);
+        for(i = 0; i < CPU_VTLB_SIZE; i++)
+            tlb_update_dirty(&env->tlb_v_table[mmu_idx][i]);
     }
 }
 
@@ -622,6 +625,9 @@ static void *subpage_init (hwaddr base, ram_addr_t *phys,
 
 static void *(*phys_mem_alloc)(size_t size) = qemu_anon_ram_alloc;
 
+/* Reserved size of the RAM blocks allocated here, mapped or not */
+static MemCategory guest_ram_memory = MEM_CATEGORY_INIT("guest.ram");
+
 /*
  * Set a custom physical guest memory alloator.
  * Accelerators with unusual needs may need this.  Hopefully, we can
@@ -1044,6 +1050,99 @@ static int memory_try_enable_merging(void *addr, size_t len)
 #endif  // CONFIG_ANDROID
 }
 
+int ram_template_mapped;
+
+#ifndef _WIN32
+/*
+ * Map a block of guest RAM privately from the -ram-template file, at the
+ * offset of the block in ram_addr_t space. The pages the guest never
+ * writes stay in the page cache, shared by all the emulators started
+ * from the same template.
+ */
+static void *ram_template_map(ram_addr_t offset, ram_addr_t size)
+{
+    struct stat st;
+    void *area;
+    int fd;
+
+    fd = open(ram_template, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &st) < 0 || (uint64_t)st.st_size < offset + size) {
+        close(fd);
+        return NULL;
+    }
+    area = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, offset);
+    close(fd);
+    return area == MAP_FAILED ? NULL : area;
+}
+
+/* Write guest RAM to a new template file, replacing 'path' atomically */
+int qemu_ram_template_save(const char *path)
+{
+    char *tmp = g_strdup_printf("%s.XXXXXX", path);
+    RAMBlock *block;
+    int fd, ret = 0;
+
+    fd = mkstemp(tmp);
+    if (fd < 0) {
+        g_free(tmp);
+        return -1;
+    }
+    QTAILQ_FOREACH(block, &ram_list.blocks, next) {
+        ram_addr_t done = 0;
+
+        while (done < block->length && ret == 0) {
+            ssize_t n = pwrite(fd, block->host + done, block->length - done,
+                               block->offset + done);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                ret = -1;
+                break;
+            }
+            done += n;
+        }
+    }
+    if (close(fd) < 0 || ret < 0 || rename(tmp, path) < 0) {
+        int err = errno;
+        unlink(tmp);
+        errno = err;
+        ret = -1;
+    }
+    g_free(tmp);
+    return ret;
+}
+#endif
+
+/* Print how much of guest RAM huge pages back so far, for -mem-hugepages */
+static void qemu_ram_report_hugepages(const char *name, ram_addr_t size,
+                                      size_t page_size)
+{
+    static uint64_t total_bytes, huge_bytes;
+
+    total_bytes += size;
+    if (page_size == 0) {
+        fprintf(stderr, "mem-hugepages: '%s' %" PRIu64 " MB with "
+                "transparent huge pages, best effort\n",
+                name, (uint64_t)size >> 20);
+        return;
+    }
+    if (page_size > qemu_real_host_page_size) {
+        huge_bytes += size;
+        fprintf(stderr, "mem-hugepages: '%s' %" PRIu64 " MB in %zu kB "
+                "pages\n", name, (uint64_t)size >> 20, page_size >> 10);
+    } else {
+        fprintf(stderr, "mem-hugepages: '%s' %" PRIu64 " MB in small "
+                "pages, no huge pages available\n",
+                name, (uint64_t)size >> 20);
+    }
+    fprintf(stderr, "mem-hugepages: %" PRIu64 " of %" PRIu64 " MB of guest "
+            "RAM in huge pages\n", huge_bytes >> 20, total_bytes >> 20);
+}
+
 ram_addr_t qemu_ram_alloc_from_ptr(DeviceState *dev, const char *name,
                                    ram_addr_t size, void *host)
 {
@@ -1083,8 +1182,35 @@ ram_addr_t qemu_ram_alloc_from_ptr(DeviceState *dev, const char *name,
             }
             new_block->host = file_ram_alloc(new_block, size, mem_path);
         }
+#ifndef _WIN32
+        /* HAX populates its RAM itself, see below */
+        if (!new_block->host && ram_template && !hax_enabled() &&
+            phys_mem_alloc == qemu_anon_ram_alloc) {
+            new_block->host = ram_template_map(new_block->offset, size);
+            if (new_block->host) {
+                ram_template_mapped++;
+            }
+        }
+#endif
         if (!new_block->host) {
-            new_block->host = phys_mem_alloc(size);
+            if (mem_hugepages && phys_mem_alloc == qemu_anon_ram_alloc) {
+                size_t page_size;
+
+                new_block->host = qemu_anon_ram_alloc_hugepages(size,
+                                                                &page_size);
+                if (new_block->host) {
+                    qemu_ram_report_hugepages(name, size, page_size);
+                }
+            } else {
+                new_block->host = phys_mem_alloc(size);
+#ifdef __linux__
+                /* HAX and other allocators may not let pages be dropped */
+                if (new_block->host && phys_mem_alloc == qemu_anon_ram_alloc &&
+                    !hax_enabled()) {
+                    new_block->flags |= RAM_DISCARDABLE_MASK;
+                }
+#endif
+            }
             if (!new_block->host) {
                 fprintf(stderr, "Cannot set up guest memory '%s': %s\n",
                         name, strerror(errno));
@@ -1112,6 +1238,9 @@ ram_addr_t qemu_ram_alloc_from_ptr(DeviceState *dev, const char *name,
         }
     }
     new_block->length = size;
+    if (!(new_block->flags & RAM_PREALLOC_MASK)) {
+        memCategory_add(&guest_ram_memory, size);
+    }
 
     if (dev) {
         char *id = qdev_get_dev_path(dev);
@@ -1194,6 +1323,9 @@ void qemu_ram_free(ram_addr_t addr)
             QTAILQ_REMOVE(&ram_list.blocks, block, next);
             ram_list.mru_block = NULL;
             ram_list.version++;
+            if (!(block->flags & RAM_PREALLOC_MASK)) {
+                memCategory_add(&guest_ram_memory, -(int64_t)block->length);
+            }
             if (block->flags & RAM_PREALLOC_MASK) {
                 ;
             } else if (xen_enabled()) {
@@ -1206,6 +1338,7 @@ void qemu_ram_free(ram_addr_t addr)
             } else {
                 qemu_anon_ram_free(block->host, block->length);
             }
+            g_free(block->discarded);
             g_free(block);
             break;
         }
@@ -2158,6 +2291,164 @@ void cpu_physical_memory_unmap(void *buffer, hwaddr len,
     cpu_notify_map_clients();
 }
 
+/* Discard the whole host pages in [offset, offset + length) of 'block' */
+static ram_addr_t ram_block_discard(RAMBlock *block, ram_addr_t offset,
+                                    ram_addr_t length)
+{
+    uintptr_t start = (uintptr_t)block->host + offset;
+    uintptr_t end = start + length;
+    ram_addr_t addr;
+
+    if (!(block->flags & RAM_DISCARDABLE_MASK)) {
+        return 0;
+    }
+    start = (start + qemu_real_host_page_size - 1) &
+            ~(qemu_real_host_page_size - 1);
+    end &= ~(qemu_real_host_page_size - 1);
+    if (end <= start ||
+        qemu_madvise((void *)start, end - start, QEMU_MADV_DONTNEED) < 0) {
+        return 0;
+    }
+
+    offset = start - (uintptr_t)block->host;
+    length = end - start;
+    if (!block->discarded) {
+        block->discarded = bitmap_new(block->length >> TARGET_PAGE_BITS);
+    }
+    bitmap_set(block->discarded, offset >> TARGET_PAGE_BITS,
+               length >> TARGET_PAGE_BITS);
+
+    /* The content changed: drop the translated code of the pages, and let
+     * incremental snapshots and the display see them as dirty. */
+    for (addr = block->offset + offset; addr < block->offset + offset + length;
+         addr += TARGET_PAGE_SIZE) {
+        invalidate_and_set_dirty(addr, TARGET_PAGE_SIZE);
+    }
+    return length;
+}
+
+static ram_addr_t ram_discard_range(ram_addr_t start, ram_addr_t length)
+{
+    ram_addr_t done = 0;
+
+    while (length > 0) {
+        RAMBlock *block = qemu_get_ram_block(start);
+        ram_addr_t offset = start - block->offset;
+        ram_addr_t l = MIN(length, block->length - offset);
+
+        done += ram_block_discard(block, offset, l);
+        start += l;
+        length -= l;
+    }
+    return done;
+}
+
+hwaddr cpu_physical_memory_discard(hwaddr addr, hwaddr len)
+{
+    hwaddr end = addr + len;
+    hwaddr done = 0;
+    ram_addr_t run_start = 0, run_len = 0;
+
+    if (end < addr) {
+        return 0;
+    }
+    /* Contiguous RAM pages are discarded at once. */
+    for (addr = TARGET_PAGE_ALIGN(addr); addr + TARGET_PAGE_SIZE <= end;
+         addr += TARGET_PAGE_SIZE) {
+        PhysPageDesc *p = phys_page_find(addr >> TARGET_PAGE_BITS);
+        unsigned long pd = p ? p->phys_offset : IO_MEM_UNASSIGNED;
+        ram_addr_t addr1 = pd & TARGET_PAGE_MASK;
+
+        if ((pd & ~TARGET_PAGE_MASK) != IO_MEM_RAM ||
+            (run_len && addr1 != run_start + run_len)) {
+            if (run_len) {
+                done += ram_discard_range(run_start, run_len);
+                run_len = 0;
+            }
+            if ((pd & ~TARGET_PAGE_MASK) != IO_MEM_RAM) {
+                continue;
+            }
+        }
+        if (!run_len) {
+            run_start = addr1;
+        }
+        run_len += TARGET_PAGE_SIZE;
+    }
+    if (run_len) {
+        done += ram_discard_range(run_start, run_len);
+    }
+    return done;
+}
+
+#ifdef __linux__
+/* Bits of the /proc/self/pagemap entries */
+#define PAGEMAP_PRESENT  (1ULL << 63)
+#define PAGEMAP_SWAPPED  (1ULL << 62)
+
+static int pagemap_fd = -2;
+
+/* Return true if the host page containing 'p' was neither faulted in nor
+ * swapped out since it was discarded, and thus reads as zero. 'entries'
+ * caches the pagemap entries of the host pages from '*first'. */
+static bool ram_page_untouched(uint8_t *p, uint64_t *entries, int count,
+                               uintptr_t *first, int *valid)
+{
+    uintptr_t page = (uintptr_t)p / qemu_real_host_page_size;
+    ssize_t n;
+
+    if (page < *first || page >= *first + *valid) {
+        n = pread(pagemap_fd, entries, count * sizeof(*entries),
+                  (off_t)page * sizeof(*entries));
+        if (n < (ssize_t)sizeof(*entries)) {
+            return false;
+        }
+        *first = page;
+        *valid = n / sizeof(*entries);
+    }
+    return !(entries[page - *first] & (PAGEMAP_PRESENT | PAGEMAP_SWAPPED));
+}
+#endif
+
+void qemu_ram_sync_discarded(RAMBlock *block, ram_addr_t offset,
+                             ram_addr_t length)
+{
+    unsigned long page = offset >> TARGET_PAGE_BITS;
+    unsigned long end = TARGET_PAGE_ALIGN(offset + length) >> TARGET_PAGE_BITS;
+#ifdef __linux__
+    uint64_t entries[512];
+    uintptr_t first = 0;
+    int valid = 0;
+#endif
+
+    if (!block->discarded) {
+        return;
+    }
+#ifdef __linux__
+    if (pagemap_fd == -2) {
+        pagemap_fd = open("/proc/self/pagemap", O_RDONLY);
+    }
+#endif
+    for (page = find_next_bit(block->discarded, end, page); page < end;
+         page = find_next_bit(block->discarded, end, page + 1)) {
+#ifdef __linux__
+        uint8_t *p = block->host + ((ram_addr_t)page << TARGET_PAGE_BITS);
+        ram_addr_t l;
+        bool untouched = pagemap_fd >= 0;
+
+        /* a target page may span several host pages */
+        for (l = 0; untouched && l < TARGET_PAGE_SIZE;
+             l += qemu_real_host_page_size) {
+            untouched = ram_page_untouched(p + l, entries, ARRAY_SIZE(entries),
+                                           &first, &valid);
+        }
+        if (untouched) {
+            continue;
+        }
+#endif
+        clear_bit(page, block->discarded);
+    }
+}
+
 /* warning: addr must be aligned */
 static inline uint32_t ldl_phys_internal(hwaddr addr,
                                          enum device_endian endian)
@@ -37,7 +37,13 @@
 #include "exec/exec-all.h"
 #endif
 
-#define MAX_PACKET_LENGTH 4096
+/* This is also the largest PacketSize gdb accepts by default, which lets it
+   read and write memory in 16 KiB chunks with the binary 'x'/'X' packets.  */
+#define MAX_PACKET_LENGTH 16384
+
+/* Registers are cached while the CPU is stopped for targets with at most
+   this many registers in 'g' packets.  */
+#define MAX_CACHED_REGS 128
 
 #include "qemu/sockets.h"
 #include "sysemu/kvm.h"
@@ -278,12 +284,16 @@ typedef struct GDBState {
     CPUArchState *g_cpu; /* current CPU for other ops */
     CPUArchState *query_cpu; /* for q{f|s}ThreadInfo */
     enum RSState state; /* parsing state */
-    char line_buf[MAX_PACKET_LENGTH];
+    char line_buf[MAX_PACKET_LENGTH + 1];
     int line_buf_index;
     int line_csum;
     uint8_t last_packet[MAX_PACKET_LENGTH + 4];
     int last_packet_len;
     int signal;
+    /* Registers of regs_cpu in 'g' packet layout, read once per stop.  */
+    CPUArchState *regs_cpu;
+    int regs_offset[MAX_CACHED_REGS + 1];
+    uint8_t regs_buf[MAX_PACKET_LENGTH / 4];
 #ifdef CONFIG_USER_ONLY
     int fd;
     int running_state;
@@ -352,9 +362,16 @@ int use_gdb_syscalls(void)
     return gdb_syscall_mode == GDB_SYS_ENABLED;
 }
 
+/* Drop the cached registers, which must be done whenever they may change.  */
+static inline void gdb_invalidate_regs(GDBState *s)
+{
+    s->regs_cpu = NULL;
+}
+
 /* Resume execution.  */
 static inline void gdb_continue(GDBState *s)
 {
+    gdb_invalidate_regs(s);
 #ifdef CONFIG_USER_ONLY
     s->running_state = 1;
 #else
@@ -1315,28 +1332,57 @@ static int cpu_gdb_write_register(CPUArchState *env, uint8_t *mem_buf, int n)
 
 static int num_g_regs = NUM_CORE_REGS;
 
-#ifdef GDB_CORE_XML
-/* Encode data using the encoding for 'x' packets.  */
-static int memtox(char *buf, const char *mem, int len)
+/* Encode data using the encoding for 'x' packets.  At most |size| bytes
+   are written to |buf|, and |*len| is updated to the number of bytes of
+   |mem| that fit.  Return the length of the encoded data.  */
+static int memtox(char *buf, int size, const char *mem, int *len)
 {
     char *p = buf;
     char c;
+    int i;
 
-    while (len--) {
-        c = *(mem++);
+    for (i = 0; i < *len; i++) {
+        c = mem[i];
         switch (c) {
         case '#': case '$': case '*': case '}':
+            if (p + 2 > buf + size)
+                goto out;
             *(p++) = '}';
             *(p++) = c ^ 0x20;
             break;
         default:
+            if (p + 1 > buf + size)
+                goto out;
             *(p++) = c;
             break;
         }
     }
+out:
+    *len = i;
     return p - buf;
 }
 
+/* Decode the |len| bytes of binary data of an 'X' packet into |mem|.
+   Return the decoded length, or -1 if it is larger than |size|.  */
+static int xtomem(uint8_t *mem, int size, const char *buf, int len)
+{
+    const char *end = buf + len;
+    int n = 0;
+
+    while (buf < end) {
+        if (n == size)
+            return -1;
+        if (*buf == '}' && buf + 1 < end) {
+            mem[n++] = buf[1] ^ 0x20;
+            buf += 2;
+        } else {
+            mem[n++] = *(buf++);
+        }
+    }
+    return n;
+}
+
+#ifdef GDB_CORE_XML
 static const char *get_feature_xml(const char *p, const char **newp)
 {
     extern const char *const xml_builtin[][2];
@@ -1413,6 +1459,27 @@ static int gdb_write_register(CPUArchState *env, uint8_t *mem_buf, int reg)
     return 0;
 }
 
+/* Return the registers of the 'g' packet of s->g_cpu, and their length in
+   |*len|.  They are only read once while the CPU is stopped, since gdb
+   fetches all or some of them again for each frame when unwinding.  */
+static const uint8_t *gdb_get_regs(GDBState *s, int *len)
+{
+    CPUArchState *env = s->g_cpu;
+    int reg, size = 0;
+
+    if (s->regs_cpu != env) {
+        cpu_synchronize_state(ENV_GET_CPU(env), 0);
+        for (reg = 0; reg < num_g_regs; reg++) {
+            s->regs_offset[reg] = size;
+            size += gdb_read_register(env, s->regs_buf + size, reg);
+        }
+        s->regs_offset[num_g_regs] = size;
+        s->regs_cpu = env;
+    }
+    *len = s->regs_offset[num_g_regs];
+    return s->regs_buf;
+}
+
 /* Register a supplemental set of CPU registers.  If g_pos is nonzero it
    specifies the first register number and these registers are included in
    a standard "g" packet.  Direction is relative to gdb, i.e. get_reg is
@@ -1547,6 +1614,7 @@ static void gdb_breakpoint_remove_all(void)
 
 static void gdb_set_cpu_pc(GDBState *s, target_ulong pc)
 {
+    gdb_invalidate_regs(s);
 #if defined(TARGET_I386)
     s->c_cpu->eip = pc;
     cpu_synchronize_state(ENV_GET_CPU(s->c_cpu), 1);
@@ -1592,7 +1660,7 @@ static CPUArchState *find_cpu(uint32_t thread_id)
     return NULL;
 }
 
-static int gdb_handle_packet(GDBState *s, const char *line_buf)
+static int gdb_handle_packet(GDBState *s, const char *line_buf, int line_len)
 {
     CPUArchState *env;
     const char *p;
@@ -1601,6 +1669,7 @@ static int gdb_handle_packet(GDBState *s, const char *line_buf)
     char buf[MAX_PACKET_LENGTH];
     uint8_t mem_buf[MAX_PACKET_LENGTH];
     uint8_t *registers;
+    const uint8_t *regs;
     target_ulong addr, len;
 
 #ifdef DEBUG_GDB
@@ -1667,6 +1736,7 @@ static int gdb_handle_packet(GDBState *s, const char *line_buf)
             if (*p == ',')
                 p++;
             type = *p;
+            gdb_invalidate_regs(s);
             if (gdb_current_syscall_cb)
                 gdb_current_syscall_cb(ENV_GET_CPU(s->c_cpu), ret, err);
             if (type == 'C') {
@@ -1677,6 +1747,12 @@ static int gdb_handle_packet(GDBState *s, const char *line_buf)
         }
         break;
     case 'g':
+        if (num_g_regs <= MAX_CACHED_REGS) {
+            regs = gdb_get_regs(s, &reg_size);
+            memtohex(buf, regs, reg_size);
+            put_packet(s, buf);
+            break;
+        }
         cpu_synchronize_state(ENV_GET_CPU(s->g_cpu), 0);
         len = 0;
         for (addr = 0; addr < num_g_regs; addr++) {
@@ -1687,6 +1763,7 @@ static int gdb_handle_packet(GDBState *s, const char *line_buf)
         put_packet(s, buf);
         break;
     case 'G':
+        gdb_invalidate_regs(s);
         registers = mem_buf;
         len = strlen(p) / 2;
         hextomem((uint8_t *)registers, p, len);
@@ -1703,6 +1780,10 @@ static int gdb_handle_packet(GDBState *s, const char *line_buf)
         if (*p == ',')
             p++;
         len = strtoull(p, NULL, 16);
+        /* gdb never asks for more than fits in PacketSize, but the reply
+           may be shorter than requested anyway.  */
+        if (len > (MAX_PACKET_LENGTH - 5) / 2)
+            len = (MAX_PACKET_LENGTH - 5) / 2;
         if (cpu_memory_rw_debug(ENV_GET_CPU(s->g_cpu), addr, mem_buf, len, 0) != 0) {
             put_packet (s, "E14");
         } else {
@@ -1710,6 +1791,27 @@ static int gdb_handle_packet(GDBState *s, const char *line_buf)
             put_packet(s, buf);
         }
         break;
+    case 'x':
+        /* Binary read, advertised as binary-upload in qSupported.  The
+           data is prefixed with 'b', and is cut short if its escaped
+           form doesn't fit in a packet.  */
+        addr = strtoull(p, (char **)&p, 16);
+        if (*p == ',')
+            p++;
+        len = strtoull(p, NULL, 16);
+        if (len > MAX_PACKET_LENGTH - 5)
+            len = MAX_PACKET_LENGTH - 5;
+        if (cpu_memory_rw_debug(ENV_GET_CPU(s->g_cpu), addr, mem_buf, len, 0) != 0) {
+            put_packet (s, "E14");
+        } else {
+            int mem_len = len;
+
+            buf[0] = 'b';
+            res = memtox(buf + 1, sizeof(buf) - 1, (const char *)mem_buf,
+                         &mem_len);
+            put_packet_binary(s, buf, res + 1);
+        }
+        break;
     case 'M':
         addr = strtoull(p, (char **)&p, 16);
         if (*p == ',')
@@ -1717,12 +1819,38 @@ static int gdb_handle_packet(GDBState *s, const char *line_buf)
         len = strtoull(p, (char **)&p, 16);
         if (*p == ':')
             p++;
+        if (len > strlen(p) / 2) {
+            put_packet(s, "E22");
+            break;
+        }
         hextomem(mem_buf, p, len);
         if (cpu_memory_rw_debug(ENV_GET_CPU(s->g_cpu), addr, mem_buf, len, 1) != 0)
             put_packet(s, "E14");
         else
             put_packet(s, "OK");
         break;
+    case 'X':
+        /* Binary write.  gdb probes for it with an empty write, and falls
+           back to 'M' if it gets an empty reply.  */
+        addr = strtoull(p, (char **)&p, 16);
+        if (*p == ',')
+            p++;
+        len = strtoull(p, (char **)&p, 16);
+        if (*p != ':') {
+            put_packet(s, "E22");
+            break;
+        }
+        p++;
+        res = xtomem(mem_buf, sizeof(mem_buf), p, line_buf + line_len - p);
+        if (res < 0 || res != len) {
+            put_packet(s, "E22");
+        } else if (len == 0 ||
+                   cpu_memory_rw_debug(ENV_GET_CPU(s->g_cpu), addr, mem_buf, len, 1) == 0) {
+            put_packet(s, "OK");
+        } else {
+            put_packet(s, "E14");
+        }
+        break;
     case 'p':
         /* Older gdb are really dumb, and don't use 'g' if 'p' is avaialable.
            This works, but can be very slow.  Anything new enough to
@@ -1730,7 +1858,13 @@ static int gdb_handle_packet(GDBState *s, const char *line_buf)
         if (!gdb_has_xml)
             goto unknown_command;
         addr = strtoull(p, (char **)&p, 16);
-        reg_size = gdb_read_register(s->g_cpu, mem_buf, addr);
+        if (addr < num_g_regs && num_g_regs <= MAX_CACHED_REGS) {
+            regs = gdb_get_regs(s, &reg_size);
+            reg_size = s->regs_offset[addr + 1] - s->regs_offset[addr];
+            memcpy(mem_buf, regs + s->regs_offset[addr], reg_size);
+        } else {
+            reg_size = gdb_read_register(s->g_cpu, mem_buf, addr);
+        }
         if (reg_size) {
             memtohex(buf, mem_buf, reg_size);
             put_packet(s, buf);
@@ -1746,6 +1880,7 @@ static int gdb_handle_packet(GDBState *s, const char *line_buf)
             p++;
         reg_size = strlen(p) / 2;
         hextomem(mem_buf, p, reg_size);
+        gdb_invalidate_regs(s);
         gdb_write_register(s->g_cpu, mem_buf, addr);
         put_packet(s, "OK");
         break;
@@ -1884,13 +2019,16 @@ static int gdb_handle_packet(GDBState *s, const char *line_buf)
             hextomem(mem_buf, p + 5, len);
             len = len / 2;
             mem_buf[len++] = 0;
+            /* Monitor commands may change the registers.  */
+            gdb_invalidate_regs(s);
             qemu_chr_read(s->mon_chr, mem_buf, len);
             put_packet(s, "OK");
             break;
         }
 #endif /* !CONFIG_USER_ONLY */
         if (strncmp(p, "Supported", 9) == 0) {
-            snprintf(buf, sizeof(buf), "PacketSize=%x", MAX_PACKET_LENGTH);
+            snprintf(buf, sizeof(buf), "PacketSize=%x;binary-upload+",
+                     MAX_PACKET_LENGTH);
 #ifdef GDB_CORE_XML
             pstrcat(buf, sizeof(buf), ";qXfer:features:read+");
 #endif
@@ -1901,6 +2039,7 @@ static int gdb_handle_packet(GDBState *s, const char *line_buf)
         if (strncmp(p, "Xfer:features:read:", 19) == 0) {
             const char *xml;
             target_ulong total_len;
+            int xml_len;
 
             gdb_has_xml = 1;
             p += 19;
@@ -1928,11 +2067,12 @@ static int gdb_handle_packet(GDBState *s, const char *line_buf)
                 len = (MAX_PACKET_LENGTH - 5) / 2;
             if (len < total_len - addr) {
                 buf[0] = 'm';
-                len = memtox(buf + 1, xml + addr, len);
+                xml_len = len;
             } else {
                 buf[0] = 'l';
-                len = memtox(buf + 1, xml + addr, total_len - addr);
+                xml_len = total_len - addr;
             }
+            len = memtox(buf + 1, sizeof(buf) - 1, xml + addr, &xml_len);
             put_packet_binary(s, buf, len + 1);
             break;
         }
@@ -1952,6 +2092,7 @@ static int gdb_handle_packet(GDBState *s, const char *line_buf)
 
 void gdb_set_stop_cpu(CPUState *cpu)
 {
+    gdb_invalidate_regs(gdbserver_state);
     gdbserver_state->c_cpu = cpu->env_ptr;
     gdbserver_state->g_cpu = cpu->env_ptr;
 }
@@ -1966,6 +2107,9 @@ static void gdb_vm_state_change(void *opaque, int running, int reason)
     const char *type;
     int ret;
 
+    /* The registers may have been changed since the previous stop, even
+       without going through gdb.  */
+    gdb_invalidate_regs(s);
     if (running || (reason != EXCP_DEBUG && reason != EXCP_INTERRUPT) ||
         s->state == RS_INACTIVE || s->state == RS_SYSCALL)
         return;
@@ -2136,7 +2280,8 @@ static void gdb_read_byte(GDBState *s, int ch)
             } else {
                 reply = '+';
                 put_buffer(s, &reply, 1);
-                s->state = gdb_handle_packet(s, s->line_buf);
+                s->state = gdb_handle_packet(s, s->line_buf,
+                                             s->line_buf_index);
             }
             break;
         default:
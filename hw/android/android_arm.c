@@ -131,6 +131,8 @@ static void android_arm_init_(ram_addr_t ram_size,
             (androidHwConfig_getKernelDeviceNaming(android_hw) >= 1);
     pipe_dev_init(newDeviceNaming);
 
+    goldfish_free_pages_init();
+
     memset(&info, 0, sizeof info);
     info.ram_size        = ram_size;
     info.kernel_filename = kernel_filename;
@@ -229,6 +229,8 @@ static void android_mips_init_(ram_addr_t ram_size,
             (androidHwConfig_getKernelDeviceNaming(android_hw) >= 1);
     pipe_dev_init(newDeviceNaming);
 
+    goldfish_free_pages_init();
+
     android_load_kernel(env, ram_size, kernel_filename, kernel_cmdline, initrd_filename);
 }
 
@@ -14,6 +14,7 @@
 #include "hw/android/goldfish/device.h"
 #include "hw/hw.h"
 #include "audio/audio.h"
+#include "qemu/atomic.h"
 #include "android/qemu-debug.h"
 #include "android/globals.h"
 
@@ -69,11 +70,30 @@ enum {
     AUDIO_INT_READ_BUFFER_FULL     = 1U << 2,
 };
 
+/* size of the output ring, must be a power of 2. 16 KiB is about 93 ms of
+ * 44.1 kHz stereo 16-bit samples.
+ */
+#define  AUDIO_RING_SIZE  16384
+
+/* a lock-free single-producer / single-consumer ring buffer. the device
+ * copies guest buffers into it, straight from guest memory, as soon as it
+ * has room, and the voice
+ * callback drains it, so that the guest can queue more samples than its
+ * two buffers hold. |head| is only written by the producer and |tail| by
+ * the consumer; both are free-running counters.
+ */
+struct goldfish_audio_ring {
+    uint8*    data;
+    uint32_t  head;
+    uint32_t  tail;
+};
+
+/* a guest buffer, that is only accessed in place: the guest doesn't
+ * touch it until the device reports it empty, or full for the read
+ * buffer. */
 struct goldfish_audio_buff {
     uint64_t  address;
     uint32_t  length;
-    uint8*    data;
-    uint32_t  capacity;
     uint32_t  offset;
 };
 
@@ -109,6 +129,9 @@ struct goldfish_audio_state {
     struct goldfish_audio_buff  out_buff2[1];
     struct goldfish_audio_buff  in_buff[1];
 
+    // samples waiting to be sent to the output voice
+    struct goldfish_audio_ring  out_ring[1];
+
     // for QEMU sound output
     QEMUSoundCard card;
     SWVoiceOut *voice;
@@ -117,13 +140,89 @@ struct goldfish_audio_state {
 #endif
 };
 
+static void
+goldfish_audio_ring_init( struct goldfish_audio_ring*  r )
+{
+    r->data = g_malloc(AUDIO_RING_SIZE);
+    r->head = 0;
+    r->tail = 0;
+}
+
+/* only call this when neither side is using the ring */
+static void
+goldfish_audio_ring_reset( struct goldfish_audio_ring*  r )
+{
+    r->head = 0;
+    r->tail = 0;
+}
+
+static uint32_t
+goldfish_audio_ring_count( struct goldfish_audio_ring*  r )
+{
+    return atomic_read(&r->head) - atomic_read(&r->tail);
+}
+
+/* producer side: copy up to |len| bytes from |src|, return the number
+ * of bytes copied */
+static uint32_t
+goldfish_audio_ring_put( struct goldfish_audio_ring*  r, const uint8*  src, uint32_t  len )
+{
+    uint32_t  head  = r->head;
+    uint32_t  space = AUDIO_RING_SIZE - (head - atomic_read(&r->tail));
+    uint32_t  pos   = head & (AUDIO_RING_SIZE - 1);
+    uint32_t  chunk;
+
+    /* the consumer must be done reading the free space before we write it */
+    smp_mb();
+
+    if (len > space)
+        len = space;
+
+    chunk = AUDIO_RING_SIZE - pos;
+    if (chunk > len)
+        chunk = len;
+
+    memcpy(r->data + pos, src, chunk);
+    memcpy(r->data, src + chunk, len - chunk);
+
+    /* publish the data before the new head */
+    smp_wmb();
+    atomic_set(&r->head, head + len);
+    return len;
+}
+
+/* consumer side: return a pointer to the oldest contiguous bytes, and
+ * their count in |*len| */
+static uint8*
+goldfish_audio_ring_peek( struct goldfish_audio_ring*  r, uint32_t*  len )
+{
+    uint32_t  tail  = r->tail;
+    uint32_t  count = atomic_read(&r->head) - tail;
+    uint32_t  pos   = tail & (AUDIO_RING_SIZE - 1);
+
+    /* read the data only after the head that published it */
+    smp_rmb();
+
+    if (count > AUDIO_RING_SIZE - pos)
+        count = AUDIO_RING_SIZE - pos;
+
+    *len = count;
+    return r->data + pos;
+}
+
+/* consumer side: release the |len| oldest bytes */
+static void
+goldfish_audio_ring_consume( struct goldfish_audio_ring*  r, uint32_t  len )
+{
+    smp_mb();
+    atomic_set(&r->tail, r->tail + len);
+}
+
 static void
 goldfish_audio_buff_init( struct goldfish_audio_buff*  b )
 {
     b->address  = 0;
     b->length   = 0;
-    b->data     = NULL;
-    b->capacity = 0;
     b->offset   = 0;
 }
 
@@ -140,15 +239,6 @@ goldfish_audio_buff_length( struct goldfish_audio_buff*  b )
     return b->length;
 }
 
-static void
-goldfish_audio_buff_ensure( struct goldfish_audio_buff*  b, uint32_t  size )
-{
-    if (b->capacity < size) {
-        b->data     = g_realloc(b->data, size);
-        b->capacity = size;
-    }
-}
-
 static void
 goldfish_audio_buff_set_address( struct goldfish_audio_buff*  b, uint32_t  addr )
 {
@@ -166,33 +256,34 @@ goldfish_audio_buff_set_length( struct goldfish_audio_buff*  b, uint32_t  len )
 {
     b->length = len;
     b->offset = 0;
-    goldfish_audio_buff_ensure(b, len);
 }
 
-static void
-goldfish_audio_buff_read( struct goldfish_audio_buff*  b )
+/* move as much of the buffer's remaining data as possible to the ring,
+ * mapping the guest memory instead of copying it first. a mapping can be
+ * shorter than asked, e.g. at a page that isn't RAM. */
+static int
+goldfish_audio_buff_push( struct goldfish_audio_buff*  b, struct goldfish_audio_ring*  r )
 {
-    cpu_physical_memory_read(b->address, b->data, b->length);
-}
+    int  total = 0;
 
-static void
-goldfish_audio_buff_write( struct goldfish_audio_buff*  b )
-{
-    cpu_physical_memory_write(b->address, b->data, b->length);
-}
+    while (b->length > 0) {
+        hwaddr    len  = b->length;
+        uint8*    data = cpu_physical_memory_map(b->address + b->offset, &len, 0);
+        uint32_t  ret;
 
-static int
-goldfish_audio_buff_send( struct goldfish_audio_buff*  b, int  free, struct goldfish_audio_state*  s )
-{
-    int  ret, write = b->length;
+        if (data == NULL)
+            break;
 
-    if (write > free)
-        write = free;
+        ret = goldfish_audio_ring_put(r, data, len);
+        cpu_physical_memory_unmap(data, len, 0, ret);
 
-    ret = AUD_write(s->voice, b->data + b->offset, write);
-    b->offset += ret;
-    b->length -= ret;
-    return ret;
+        b->offset += ret;
+        b->length -= ret;
+        total     += ret;
+        if (ret < len)
+            break;
+    }
+    return total;
 }
 
 static int
@@ -206,23 +297,33 @@ goldfish_audio_buff_recv( struct goldfish_audio_buff*  b, int  avail, struct gol
 {
     int     missing = b->length - b->offset;
     int     avail2 = (avail > missing) ? missing : avail;
+    hwaddr  len = avail2;
+    uint8*  data;
     int     read;
 
-    read = AUD_read(s->voicein, b->data + b->offset, avail2 );
+    /* the voice converts the samples straight into guest memory */
+    data = cpu_physical_memory_map(b->address + b->offset, &len, 1);
+    if (data == NULL)
+        return 0;
+
+    read = AUD_read(s->voicein, data, len );
+    cpu_physical_memory_unmap(data, len, 1, read);
     if (read == 0)
         return 0;
 
     if (avail2 > 0)
-        D("%s: AUD_read(%d) returned %d", __FUNCTION__, avail2, read);
+        D("%s: AUD_read(%d) returned %d", __FUNCTION__, (int)len, read);
 
-    cpu_physical_memory_write( b->address + b->offset, b->data, read );
     b->offset += read;
 
     return read;
 }
 
 /* update this whenever you change the goldfish_audio_state structure */
-#define  AUDIO_STATE_SAVE_VERSION  3
+#define  AUDIO_STATE_SAVE_VERSION  5
+#define  AUDIO_STATE_SAVE_VERSION_BUFF_DATA   4
+#define  AUDIO_STATE_SAVE_VERSION_NO_RING     3
+#define  AUDIO_STATE_SAVE_VERSION_32BIT_ADDR  2
 
 #define  QFIELD_STRUCT   struct goldfish_audio_state
 QFIELD_BEGIN(audio_state_fields)
@@ -238,20 +339,30 @@ goldfish_audio_buff_put( struct goldfish_audio_buff*  b, QEMUFile*  f )
     qemu_put_be64(f, b->address );
     qemu_put_be32(f, b->length );
     qemu_put_be32(f, b->offset );
-    qemu_put_buffer(f, b->data, b->length );
 }
 
+/* older versions also saved the device's copy of the buffer. it only
+ * matters for the read buffer, whose samples were only copied to the
+ * guest when it asked for them. */
 static void
-goldfish_audio_buff_get( struct goldfish_audio_buff*  b, QEMUFile*  f, int version_id )
+goldfish_audio_buff_get( struct goldfish_audio_buff*  b, QEMUFile*  f, int version_id, int  is_read )
 {
-    if (version_id ==  (AUDIO_STATE_SAVE_VERSION - 1))
+    if (version_id == AUDIO_STATE_SAVE_VERSION_32BIT_ADDR)
         b->address = (uint64_t)qemu_get_be32(f);
     else
         b->address = qemu_get_be64(f);
     b->length  = qemu_get_be32(f);
     b->offset  = qemu_get_be32(f);
-    goldfish_audio_buff_ensure(b, b->length);
-    qemu_get_buffer(f, b->data, b->length);
+
+    if (version_id <= AUDIO_STATE_SAVE_VERSION_BUFF_DATA && b->length > 0) {
+        uint8*  data = g_malloc(b->length);
+
+        qemu_get_buffer(f, data, b->length);
+        if (is_read)
+            cpu_physical_memory_write(b->address, data,
+                                      b->offset < b->length ? b->offset : b->length);
+        g_free(data);
+    }
 }
 
 static void  audio_state_save( QEMUFile*  f, void* opaque )
@@ -263,6 +374,20 @@ static void  audio_state_save( QEMUFile*  f, void* opaque )
     goldfish_audio_buff_put (s->out_buff1, f);
     goldfish_audio_buff_put (s->out_buff2, f);
     goldfish_audio_buff_put (s->in_buff, f);
+
+    {
+        struct goldfish_audio_ring*  r = s->out_ring;
+        uint32_t  count = goldfish_audio_ring_count(r);
+        uint32_t  pos   = r->tail & (AUDIO_RING_SIZE - 1);
+        uint32_t  chunk = AUDIO_RING_SIZE - pos;
+
+        if (chunk > count)
+            chunk = count;
+
+        qemu_put_be32(f, count);
+        qemu_put_buffer(f, r->data + pos, chunk);
+        qemu_put_buffer(f, r->data, count - chunk);
+    }
 }
 
 static int   audio_state_load( QEMUFile*  f, void*  opaque, int  version_id )
@@ -270,15 +395,26 @@ static int   audio_state_load( QEMUFile*  f, void*  opaque, int  version_id )
     struct goldfish_audio_state*  s = opaque;
     int                           ret;
 
-    if ((version_id != AUDIO_STATE_SAVE_VERSION) && 
-        (version_id != (AUDIO_STATE_SAVE_VERSION - 1))) {
+    if ((version_id != AUDIO_STATE_SAVE_VERSION) &&
+        (version_id != AUDIO_STATE_SAVE_VERSION_BUFF_DATA) &&
+        (version_id != AUDIO_STATE_SAVE_VERSION_NO_RING) &&
+        (version_id != AUDIO_STATE_SAVE_VERSION_32BIT_ADDR)) {
         return -1;
     }
     ret = qemu_get_struct(f, audio_state_fields, s);
     if (!ret) {
-        goldfish_audio_buff_get( s->out_buff1, f, version_id);
-        goldfish_audio_buff_get( s->out_buff2, f, version_id);
-        goldfish_audio_buff_get (s->in_buff, f, version_id);
+        goldfish_audio_buff_get( s->out_buff1, f, version_id, 0);
+        goldfish_audio_buff_get( s->out_buff2, f, version_id, 0);
+        goldfish_audio_buff_get (s->in_buff, f, version_id, 1);
+    }
+
+    goldfish_audio_ring_reset( s->out_ring );
+    if (!ret && version_id >= AUDIO_STATE_SAVE_VERSION_BUFF_DATA) {
+        uint32_t  count = qemu_get_be32(f);
+        if (count > AUDIO_RING_SIZE)
+            return -1;
+        qemu_get_buffer(f, s->out_ring->data, count);
+        s->out_ring->head = count;
     }
 
     // Similar to enable_audio - without the buffer reset.
@@ -301,6 +437,7 @@ static void enable_audio(struct goldfish_audio_state *s, int enable)
         AUD_set_active_out(s->voice,   (enable & (AUDIO_INT_WRITE_BUFFER_1_EMPTY | AUDIO_INT_WRITE_BUFFER_2_EMPTY)) != 0);
         goldfish_audio_buff_reset( s->out_buff1 );
         goldfish_audio_buff_reset( s->out_buff2 );
+        goldfish_audio_ring_reset( s->out_ring );
     }
 
     if (s->voicein) {
@@ -390,6 +527,39 @@ try_again:
 }
 #endif
 
+static void goldfish_audio_set_status(struct goldfish_audio_state *s, int new_status)
+{
+    if (new_status && new_status != s->int_status) {
+        s->int_status |= new_status;
+        goldfish_device_set_irq(&s->dev, 0, (s->int_status & s->int_enable));
+    }
+}
+
+/* move the pending write buffers to the output ring, in order, and
+ * return the AUDIO_INT_WRITE_BUFFER_x_EMPTY bits of the ones that were
+ * fully moved */
+static int goldfish_audio_fill_ring(struct goldfish_audio_state *s)
+{
+    int new_status = 0;
+
+    while (s->current_buffer) {
+        if (s->current_buffer == 1) {
+            goldfish_audio_buff_push( s->out_buff1, s->out_ring );
+            if (goldfish_audio_buff_length( s->out_buff1 ) != 0)
+                break;
+            new_status |= AUDIO_INT_WRITE_BUFFER_1_EMPTY;
+            s->current_buffer = (goldfish_audio_buff_length( s->out_buff2 ) ? 2 : 0);
+        } else {
+            goldfish_audio_buff_push( s->out_buff2, s->out_ring );
+            if (goldfish_audio_buff_length( s->out_buff2 ) != 0)
+                break;
+            new_status |= AUDIO_INT_WRITE_BUFFER_2_EMPTY;
+            s->current_buffer = (goldfish_audio_buff_length( s->out_buff1 ) ? 1 : 0);
+        }
+    }
+    return new_status;
+}
+
 static uint32_t goldfish_audio_read(void *opaque, hwaddr offset)
 {
     uint32_t ret;
@@ -415,7 +585,6 @@ static uint32_t goldfish_audio_read(void *opaque, hwaddr offset)
 	case AUDIO_READ_BUFFER_AVAILABLE:
             D("%s: AUDIO_READ_BUFFER_AVAILABLE returns %d", __FUNCTION__,
                s->read_buffer_available);
-            goldfish_audio_buff_write( s->in_buff );
 	    return s->read_buffer_available;
 
         default:
@@ -464,16 +633,16 @@ static void goldfish_audio_write(void *opaque, hwaddr offset, uint32_t val)
             //D( "%s: AUDIO_WRITE_BUFFER_1 %08x", __FUNCTION__, val);
             if (s->current_buffer == 0) s->current_buffer = 1;
             goldfish_audio_buff_set_length( s->out_buff1, val );
-            goldfish_audio_buff_read( s->out_buff1 );
             s->int_status &= ~AUDIO_INT_WRITE_BUFFER_1_EMPTY;
+            goldfish_audio_set_status(s, goldfish_audio_fill_ring(s));
             break;
         case AUDIO_WRITE_BUFFER_2:
             /* record that data in buffer 2 is ready to write */
             //D( "%s: AUDIO_WRITE_BUFFER_2 %08x", __FUNCTION__, val);
             if (s->current_buffer == 0) s->current_buffer = 2;
             goldfish_audio_buff_set_length( s->out_buff2, val );
-            goldfish_audio_buff_read( s->out_buff2 );
             s->int_status &= ~AUDIO_INT_WRITE_BUFFER_2_EMPTY;
+            goldfish_audio_set_status(s, goldfish_audio_fill_ring(s));
             break;
 
         case AUDIO_SET_READ_BUFFER:
@@ -505,48 +674,33 @@ static void goldfish_audio_write(void *opaque, hwaddr offset, uint32_t val)
 static void goldfish_audio_callback(void *opaque, int free)
 {
     struct goldfish_audio_state *s = opaque;
-    int new_status = 0;
+    /* buffers restored from an older snapshot may not be in the ring yet */
+    int new_status = goldfish_audio_fill_ring(s);
 
-    /* loop until free is zero or both buffers are empty */
-    while (free && s->current_buffer) {
-
-        /* write data in buffer 1 */
-        while (free && s->current_buffer == 1) {
-            int  written = goldfish_audio_buff_send( s->out_buff1, free, s );
-            if (written) {
-                D("%s: sent %5d bytes to audio output (buffer 1)", __FUNCTION__, written);
-                free -= written;
-
-                if (goldfish_audio_buff_length( s->out_buff1 ) == 0) {
-                    new_status |= AUDIO_INT_WRITE_BUFFER_1_EMPTY;
-                    s->current_buffer = (goldfish_audio_buff_length( s->out_buff2 ) ? 2 : 0);
-                }
-            } else {
-                break;
-            }
-        }
+    /* loop until free is zero or the ring is empty */
+    while (free > 0) {
+        uint32_t  len;
+        uint8*    data = goldfish_audio_ring_peek( s->out_ring, &len );
+        int       written;
 
-        /* write data in buffer 2 */
-        while (free && s->current_buffer == 2) {
-            int  written = goldfish_audio_buff_send( s->out_buff2, free, s );
-            if (written) {
-                D("%s: sent %5d bytes to audio output (buffer 2)", __FUNCTION__, written);
-                free -= written;
-
-                if (goldfish_audio_buff_length( s->out_buff2 ) == 0) {
-                    new_status |= AUDIO_INT_WRITE_BUFFER_2_EMPTY;
-                    s->current_buffer = (goldfish_audio_buff_length( s->out_buff1 ) ? 1 : 0);
-                }
-            } else {
-                break;
-            }
-        }
-    }
+        if (len == 0)
+            break;
+        if (len > (uint32_t)free)
+            len = free;
 
-    if (new_status && new_status != s->int_status) {
-        s->int_status |= new_status;
-        goldfish_device_set_irq(&s->dev, 0, (s->int_status & s->int_enable));
+        written = AUD_write(s->voice, data, len);
+        if (!written)
+            break;
+
+        D("%s: sent %5d bytes to audio output", __FUNCTION__, written);
+        goldfish_audio_ring_consume( s->out_ring, written );
+        free -= written;
+
+        /* refill the ring from the guest buffers as it drains */
+        new_status |= goldfish_audio_fill_ring(s);
     }
+
+    goldfish_audio_set_status(s, new_status);
 }
 
 #if USE_QEMU_AUDIO_IN
@@ -574,10 +728,7 @@ goldfish_audio_in_callback(void *opaque, int avail)
         }
     }
 
-    if (new_status && new_status != s->int_status) {
-        s->int_status |= new_status;
-        goldfish_device_set_irq(&s->dev, 0, (s->int_status & s->int_enable));
-    }
+    goldfish_audio_set_status(s, new_status);
 }
 #endif /* USE_QEMU_AUDIO_IN */
 
@@ -666,8 +817,16 @@ void goldfish_audio_init(uint32_t base, int id, const char* input_source)
     goldfish_audio_buff_init( s->out_buff1 );
     goldfish_audio_buff_init( s->out_buff2 );
     goldfish_audio_buff_init( s->in_buff );
+    goldfish_audio_ring_init( s->out_ring );
 
     goldfish_device_add(&s->dev, goldfish_audio_readfn, goldfish_audio_writefn, s);
+    /* the buffer addresses are used by the AUDIO_WRITE_BUFFER_x and
+     * AUDIO_START_READ writes */
+    goldfish_device_coalesce_mmio(&s->dev, AUDIO_SET_WRITE_BUFFER_1, 8);
+    goldfish_device_coalesce_mmio(&s->dev, AUDIO_SET_READ_BUFFER, 4);
+    goldfish_device_coalesce_mmio(&s->dev, AUDIO_SET_WRITE_BUFFER_1_HIGH,
+                                  AUDIO_SET_READ_BUFFER_HIGH + 4 -
+                                  AUDIO_SET_WRITE_BUFFER_1_HIGH);
 
     register_savevm(NULL,
                     "audio_state",
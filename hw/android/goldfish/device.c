@@ -108,6 +108,12 @@ int goldfish_device_add(struct goldfish_device *dev,
     return 0;
 }
 
+void goldfish_device_coalesce_mmio(struct goldfish_device *dev,
+                                   uint32_t offset, uint32_t size)
+{
+    qemu_register_coalesced_mmio(dev->base + offset, size);
+}
+
 static uint32_t goldfish_bus_read(void *opaque, hwaddr offset)
 {
     struct bus_state *s = (struct bus_state *)opaque;
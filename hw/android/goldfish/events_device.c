@@ -31,6 +31,17 @@ enum {
     REG_LEN         = 0x04,
     REG_DATA        = 0x08,
 
+    /* Batch read mode. These are above the page data offsets. The guest
+     * driver writes the guest physical address of a buffer and its size
+     * in events, then each read of REG_BATCH_READ copies as many queued
+     * events as possible into it, as (type, code, value) 32-bit triplets,
+     * and returns their count. Reading REG_BATCH_SIZE returns 0 on devices
+     * without batch support. */
+    REG_BATCH_ADDR_LOW  = 0xf00,
+    REG_BATCH_ADDR_HIGH = 0xf04,
+    REG_BATCH_SIZE      = 0xf08,
+    REG_BATCH_READ      = 0xf0c,
+
     PAGE_NAME       = 0x00000,
     PAGE_EVBITS     = 0x10000,
     PAGE_ABSDATA    = 0x20000 | EV_ABS,
@@ -63,6 +74,10 @@ typedef struct
     unsigned last;
     unsigned state;
 
+    uint32_t batch_addr_low;
+    uint32_t batch_addr_high;
+    uint32_t batch_size;
+
     const char *name;
 
     struct {
@@ -89,7 +104,7 @@ typedef struct ABSEntry {
 /* modify this each time you change the events_device structure. you
  * will also need to upadte events_state_load and events_state_save
  */
-#define  EVENTS_STATE_SAVE_VERSION  2
+#define  EVENTS_STATE_SAVE_VERSION  3
 
 #undef  QFIELD_STRUCT
 #define QFIELD_STRUCT  events_state
@@ -103,21 +118,78 @@ QFIELD_BEGIN(events_state_fields)
     QFIELD_INT32(state),
 QFIELD_END
 
+/* added in version 3 */
+QFIELD_BEGIN(events_batch_fields)
+    QFIELD_INT32(batch_addr_low),
+    QFIELD_INT32(batch_addr_high),
+    QFIELD_INT32(batch_size),
+QFIELD_END
+
 static void  events_state_save(QEMUFile*  f, void*  opaque)
 {
     events_state*  s = opaque;
 
     qemu_put_struct(f, events_state_fields, s);
+    qemu_put_struct(f, events_batch_fields, s);
 }
 
 static int  events_state_load(QEMUFile*  f, void* opaque, int  version_id)
 {
     events_state*  s = opaque;
+    int ret;
 
-    if (version_id != EVENTS_STATE_SAVE_VERSION)
+    if (version_id != EVENTS_STATE_SAVE_VERSION && version_id != 2)
         return -1;
 
-    return qemu_get_struct(f, events_state_fields, s);
+    ret = qemu_get_struct(f, events_state_fields, s);
+    if (ret != 0 || version_id < 3)
+        return ret;
+
+    return qemu_get_struct(f, events_batch_fields, s);
+}
+
+/* Maximum number of queued events scanned when coalescing a new one. */
+#define MAX_COALESCE_EVENTS 16
+
+/* Try to merge an EV_ABS event with a queued one of the same frame, i.e.
+ * after the last queued EV_SYN, and for the same multi-touch slot. The
+ * guest would only see the last value anyway. Return 1 on success.
+ */
+static int coalesce_event(events_state *s, unsigned int code, int value)
+{
+    int  enqueued = s->last - s->first;
+    int  count, nn;
+    unsigned pos = s->last;
+
+    if (enqueued < 0)
+        enqueued += MAX_EVENTS;
+
+    /* Only consider complete events, the first one may be partially read */
+    count = enqueued / 3;
+    if (count > MAX_COALESCE_EVENTS)
+        count = MAX_COALESCE_EVENTS;
+
+    for (nn = 0; nn < count; nn++) {
+        unsigned type;
+        unsigned ecode;
+
+        pos = (pos - 3) & (MAX_EVENTS - 1);
+        type  = s->events[pos];
+        ecode = s->events[(pos + 1) & (MAX_EVENTS - 1)];
+
+        if (type == EV_SYN)
+            break;
+        if (type != EV_ABS)
+            continue;
+        if (ecode == code) {
+            s->events[(pos + 2) & (MAX_EVENTS - 1)] = value;
+            return 1;
+        }
+        /* Don't merge across slot changes */
+        if (ecode == ABS_MT_SLOT)
+            break;
+    }
+    return 0;
 }
 
 static void enqueue_event(events_state *s, unsigned int type, unsigned int code, int value)
@@ -127,6 +199,12 @@ static void enqueue_event(events_state *s, unsigned int type, unsigned int code,
     if (enqueued < 0)
         enqueued += MAX_EVENTS;
 
+    /* Tracking id changes start or end a touch, and must not be merged */
+    if (type == EV_ABS && code != ABS_MT_SLOT && code != ABS_MT_TRACKING_ID &&
+        enqueued >= 3 && coalesce_event(s, code, value)) {
+        return;
+    }
+
     if (enqueued + 3 > MAX_EVENTS) {
         fprintf(stderr, "##KBD: Full queue, lose event\n");
         return;
@@ -185,6 +263,45 @@ static unsigned dequeue_event(events_state *s)
     return n;
 }
 
+/* Copy queued events to the guest batch buffer, return their count */
+static unsigned read_event_batch(events_state *s)
+{
+    hwaddr   addr = ((hwaddr)s->batch_addr_high << 32) | s->batch_addr_low;
+    unsigned count = 0;
+    uint32_t buff[3 * 64];
+
+    /* The first event may have been partially read with REG_READ */
+    while ((s->last - s->first) & (MAX_EVENTS - 1) &&
+           ((s->last - s->first) & (MAX_EVENTS - 1)) % 3 != 0) {
+        dequeue_event(s);
+    }
+
+    while (s->first != s->last && count < s->batch_size) {
+        unsigned n = 0;
+        unsigned max = s->batch_size - count;
+
+        if (max > sizeof(buff) / sizeof(buff[0]) / 3)
+            max = sizeof(buff) / sizeof(buff[0]) / 3;
+
+        for (; n < max && s->first != s->last; n++) {
+            int i;
+            for (i = 0; i < 3; i++) {
+                buff[n * 3 + i] = cpu_to_le32(s->events[s->first]);
+                s->first = (s->first + 1) & (MAX_EVENTS - 1);
+            }
+        }
+        cpu_physical_memory_write(addr + count * 12, (uint8_t*)buff, n * 12);
+        count += n;
+    }
+
+    /* A single interrupt for the whole batch */
+    qemu_irq_lower(s->irq);
+    if (s->first != s->last)
+        qemu_irq_raise(s->irq);
+
+    return count;
+}
+
 static int get_page_len(events_state *s)
 {
     int page = s->page;
@@ -232,6 +349,13 @@ static uint32_t events_read(void *x, hwaddr off)
 	s->state = STATE_LIVE;
     }
 
+    if (offset == REG_BATCH_SIZE)
+        return s->batch_size;
+    if (offset == REG_BATCH_READ)
+        return s->batch_size ? read_event_batch(s) : 0;
+    if (offset >= REG_BATCH_ADDR_LOW)
+        return 0;
+
     if (offset == REG_READ)
         return dequeue_event(s);
     else if (offset == REG_LEN)
@@ -247,6 +371,12 @@ static void events_write(void *x, hwaddr off, uint32_t val)
     int offset = off; // - s->base;
     if (offset == REG_SET_PAGE)
         s->page = val;
+    else if (offset == REG_BATCH_ADDR_LOW)
+        s->batch_addr_low = val;
+    else if (offset == REG_BATCH_ADDR_HIGH)
+        s->batch_addr_high = val;
+    else if (offset == REG_BATCH_SIZE)
+        s->batch_size = val;
 }
 
 static CPUReadMemoryFunc *events_readfn[] = {
@@ -521,6 +651,10 @@ void events_dev_init(uint32_t base, qemu_irq irq)
     iomemtype = cpu_register_io_memory(events_readfn, events_writefn, s);
 
     cpu_register_physical_memory(base, 0xfff, iomemtype);
+    /* these writes only select what the next reads return */
+    qemu_register_coalesced_mmio(base + REG_SET_PAGE, 4);
+    qemu_register_coalesced_mmio(base + REG_BATCH_ADDR_LOW,
+                                 REG_BATCH_READ - REG_BATCH_ADDR_LOW);
 
     qemu_add_kbd_event_handler(events_put_keycode, s);
     qemu_add_mouse_event_handler(events_put_mouse, s, 1, "goldfish-events");
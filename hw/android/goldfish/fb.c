@@ -17,8 +17,16 @@
 #include "exec/ram_addr.h"
 #include "hw/android/goldfish/device.h"
 #include "hw/hw.h"
+#include "sysemu/kvm.h"
 #include "ui/console.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FB_USE_NEON 1
+#endif
+
 /* These values *must* match the platform definitions found under
  * hardware/libhardware/include/hardware/hardware.h
  */
@@ -63,10 +71,55 @@ struct goldfish_fb_state {
     uint32_t int_enable;
     int      rotation;   /* 0, 1, 2 or 3 */
     int      dpi;
+    uint8_t* dirty_tiles;      /* see compute_fb_update_rect_linear() */
+    int      dirty_tiles_size;
+    /* guest RAM range logged by KVM, see goldfish_fb_kvm_log() */
+    uint32_t kvm_log_base;
+    uint32_t kvm_log_size;
+    int      kvm_log_ranges;
 };
 
 #define  GOLDFISH_FB_SAVE_VERSION  2
 
+/* each logged range splits a KVM memory slot, and there are few of them */
+#define  FB_KVM_MAX_LOG_RANGES     4
+
+static uint32_t goldfish_fb_size(struct goldfish_fb_state *s)
+{
+    DisplaySurface *surface = s->ds->surface;
+
+    return surface->width * surface->height * surface->pf.bytes_per_pixel;
+}
+
+static int goldfish_fb_kvm_logged(struct goldfish_fb_state *s, uint32_t base)
+{
+    return s->kvm_log_size != 0 && base >= s->kvm_log_base &&
+           base + goldfish_fb_size(s) <= s->kvm_log_base + s->kvm_log_size;
+}
+
+/* Under KVM, guest writes to the framebuffer don't mark its VGA dirty bits,
+ * they must be fetched from the kernel at each refresh. Give the pages of
+ * the framebuffer a KVM slot of their own, so that this only fetches their
+ * bitmap. Two buffers are covered, for guests that flip between consecutive
+ * buffers. Called when the vcpus don't run guest code. */
+static void goldfish_fb_kvm_log(struct goldfish_fb_state *s, uint32_t base)
+{
+    uint32_t size = goldfish_fb_size(s);
+
+    if (!kvm_enabled() || base == 0 || goldfish_fb_kvm_logged(s, base) ||
+        s->kvm_log_ranges == FB_KVM_MAX_LOG_RANGES) {
+        return;
+    }
+    s->kvm_log_ranges++;
+    if (kvm_log_range_start(base, 2 * size) == 0) {
+        s->kvm_log_base = base;
+        s->kvm_log_size = 2 * size;
+    } else if (kvm_log_range_start(base, size) == 0) {
+        s->kvm_log_base = base;
+        s->kvm_log_size = size;
+    }
+}
+
 static void goldfish_fb_save(QEMUFile*  f, void*  opaque)
 {
     struct goldfish_fb_state*  s = opaque;
@@ -129,6 +182,7 @@ static int  goldfish_fb_load(QEMUFile*  f, void*  opaque, int  version_id)
 
     /* force a refresh */
     s->need_update = 1;
+    goldfish_fb_kvm_log(s, s->fb_base);
 
     ret = 0;
 Exit:
@@ -234,10 +288,26 @@ static int   stats_full_updates;
 static long  stats_total_full_updates;
 #endif
 
+/* Whether guest pixels must be byte-swapped when copied to the host surface */
+#if defined(HOST_WORDS_BIGENDIAN) != defined(TARGET_WORDS_BIGENDIAN)
+#define FB_SWAP_PIXELS  1
+#else
+#define FB_SWAP_PIXELS  0
+#endif
+
+/* Size of the tiles of the dirty map, in pixels */
+#define FB_TILE_WIDTH   64
+#define FB_TILE_HEIGHT  16
+
+/* Maximum number of rectangles reported for a single update. Updates that
+ * would need more are reported as their bounding rectangle. */
+#define FB_MAX_UPDATE_RECTS  32
+
 /* This structure is used to hold the inputs for
  * compute_fb_update_rect_linear below.
  * This corresponds to the source framebuffer and destination
- * surface pixel buffers.
+ * surface pixel buffers, and to the map of dirty tiles, which has
+ * one byte per tile, row after row.
  */
 typedef struct {
     int            width;
@@ -247,8 +317,110 @@ typedef struct {
     int            src_pitch;
     uint8_t*       dst_pixels;
     int            dst_pitch;
+    uint8_t*       tiles;
+    int            tiles_per_line;
 } FbUpdateState;
 
+/* Return the offset of the first byte that differs between |a| and |b|,
+ * or |len| if they are equal. */
+static int
+fb_find_first_diff(const uint8_t* a, const uint8_t* b, int len)
+{
+    int n = 0;
+#if defined(__SSE2__)
+#define FB_CMPEQ(off) \
+    _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + (off))), \
+                   _mm_loadu_si128((const __m128i*)(b + (off))))
+    for (; n + 64 <= len; n += 64) {
+        __m128i eq = _mm_and_si128(_mm_and_si128(FB_CMPEQ(n), FB_CMPEQ(n + 16)),
+                                   _mm_and_si128(FB_CMPEQ(n + 32), FB_CMPEQ(n + 48)));
+        if (_mm_movemask_epi8(eq) != 0xffff)
+            break;
+    }
+    for (; n + 16 <= len; n += 16) {
+        int mask = _mm_movemask_epi8(FB_CMPEQ(n)) ^ 0xffff;
+        if (mask)
+            return n + __builtin_ctz(mask);
+    }
+#elif FB_USE_NEON
+    for (; n + 16 <= len; n += 16) {
+        uint64x2_t eq = vreinterpretq_u64_u8(vceqq_u8(vld1q_u8(a + n),
+                                                      vld1q_u8(b + n)));
+        if ((vgetq_lane_u64(eq, 0) & vgetq_lane_u64(eq, 1)) != ~(uint64_t)0)
+            break;
+    }
+#endif
+    for (; n < len; n++) {
+        if (a[n] != b[n])
+            break;
+    }
+    return n;
+}
+
+/* Return the offset following the last byte that differs between |a| and
+ * |b|, or 0 if they are equal. */
+static int
+fb_find_last_diff(const uint8_t* a, const uint8_t* b, int len)
+{
+    int n = len;
+#if defined(__SSE2__)
+    for (; n >= 64; n -= 64) {
+        __m128i eq = _mm_and_si128(_mm_and_si128(FB_CMPEQ(n - 64), FB_CMPEQ(n - 48)),
+                                   _mm_and_si128(FB_CMPEQ(n - 32), FB_CMPEQ(n - 16)));
+        if (_mm_movemask_epi8(eq) != 0xffff)
+            break;
+    }
+    for (; n >= 16; n -= 16) {
+        int mask = _mm_movemask_epi8(FB_CMPEQ(n - 16)) ^ 0xffff;
+        if (mask)
+            return n - 16 + (32 - __builtin_clz(mask));
+    }
+#undef FB_CMPEQ
+#elif FB_USE_NEON
+    for (; n >= 16; n -= 16) {
+        uint64x2_t eq = vreinterpretq_u64_u8(vceqq_u8(vld1q_u8(a + n - 16),
+                                                      vld1q_u8(b + n - 16)));
+        if ((vgetq_lane_u64(eq, 0) & vgetq_lane_u64(eq, 1)) != ~(uint64_t)0)
+            break;
+    }
+#endif
+    for (; n > 0; n--) {
+        if (a[n - 1] != b[n - 1])
+            break;
+    }
+    return n;
+}
+
+/* Copy the pixels that changed in [xx1, xx2] of a line from 'src' to
+ * 'dst', where xx1 and xx2 are known to differ, and mark the tiles of the
+ * line that changed in 'tiles'. */
+static void
+fb_update_line_tiles(FbUpdateState* fbs, const uint8_t* src, uint8_t* dst,
+                     uint8_t* tiles, int xx1, int xx2)
+{
+    int bpp = fbs->bytes_per_pixel;
+    int tile_first = xx1 / FB_TILE_WIDTH;
+    int tile_last = xx2 / FB_TILE_WIDTH;
+    int tt;
+
+    for (tt = tile_first; tt <= tile_last; tt++) {
+        int start = (tt == tile_first) ? xx1 : tt * FB_TILE_WIDTH;
+        int end = (tt == tile_last) ? xx2 + 1 : (tt + 1) * FB_TILE_WIDTH;
+        /* Only the tiles in the middle may be unchanged */
+        if (tt != tile_first && tt != tile_last) {
+            int first = fb_find_first_diff(src + start * bpp, dst + start * bpp,
+                                           (end - start) * bpp);
+            if (first == (end - start) * bpp)
+                continue;
+            start += first / bpp;
+            end = start + (fb_find_last_diff(src + start * bpp, dst + start * bpp,
+                                             (end - start) * bpp) + bpp - 1) / bpp;
+        }
+        memcpy(dst + start * bpp, src + start * bpp, (end - start) * bpp);
+        tiles[tt] = 1;
+    }
+}
+
 /* This structure is used to hold the outputs for
  * compute_fb_update_rect_linear below.
  * This corresponds to the smalled bounding rectangle of the
@@ -269,6 +441,9 @@ typedef struct {
  * used to speed-up the check using the VGA dirty bits. In practice
  * this is only used if your kernel driver does not implement.
  *
+ * The tiles of FB_TILE_WIDTH x FB_TILE_HEIGHT pixels that changed are
+ * also marked in fbs->tiles, which must be cleared by the caller.
+ *
  * This function assumes that the framebuffers are in linear memory.
  * This may change later when we want to support larger framebuffers
  * that exceed the max DMA aperture size though.
@@ -283,6 +458,7 @@ compute_fb_update_rect_linear(FbUpdateState*  fbs,
     const uint8_t* src_line = fbs->src_pixels;
     uint8_t*       dst_line = fbs->dst_pixels;
     uint32_t       dirty_addr = dirty_base;
+    int            bpp = fbs->bytes_per_pixel;
     rect->xmin = rect->ymin = INT_MAX;
     rect->xmax = rect->ymax = INT_MIN;
     for (yy = 0; yy < fbs->height; yy++) {
@@ -300,10 +476,24 @@ compute_fb_update_rect_linear(FbUpdateState*  fbs,
             }
         }
 
+        uint8_t* tiles = fbs->tiles +
+                (yy / FB_TILE_HEIGHT) * fbs->tiles_per_line;
+
+#if !FB_SWAP_PIXELS
+        /* Compare the lines as bytes, and copy only the changed spans */
+        if (bpp < 2 || bpp > 4) {
+            return 0;
+        }
+        xx1 = fb_find_first_diff(src_line, dst_line, width * bpp) / bpp;
+        if (xx1 < width) {
+            xx2 = (fb_find_last_diff(src_line, dst_line, width * bpp) - 1) / bpp;
+            fb_update_line_tiles(fbs, src_line, dst_line, tiles, xx1, xx2);
+        }
+#else
         /* Then compute actual bounds of the changed pixels, while
          * copying them from 'src' to 'dst'. This depends on the pixel depth.
          */
-        switch (fbs->bytes_per_pixel) {
+        switch (bpp) {
         case 2:
         {
             const uint16_t* src = (const uint16_t*) src_line;
@@ -416,6 +606,11 @@ compute_fb_update_rect_linear(FbUpdateState*  fbs,
         default:
             return 0;
         }
+        if (xx1 < width) {
+            memset(tiles + xx1 / FB_TILE_WIDTH, 1,
+                   xx2 / FB_TILE_WIDTH - xx1 / FB_TILE_WIDTH + 1);
+        }
+#endif /* FB_SWAP_PIXELS */
         /* Update bounds if pixels on this line were modified */
         if (xx1 < width) {
             if (xx1 < rect->xmin) rect->xmin = xx1;
@@ -439,6 +634,65 @@ compute_fb_update_rect_linear(FbUpdateState*  fbs,
     return 1;
 }
 
+/* Turn the map of dirty tiles into at most FB_MAX_UPDATE_RECTS rectangles
+ * of consecutive dirty tiles, clipped to 'bounds', and return their count,
+ * or 0 if more are needed. Each rectangle spans a horizontal run of tiles,
+ * and grows downwards while the tile lines below have the same run. The
+ * xmax and ymax fields are exclusive.
+ */
+static int
+fb_get_update_rects(const FbUpdateState* fbs, const FbUpdateRect* bounds,
+                    FbUpdateRect* rects)
+{
+    int count = 0;
+    int ty, tx, nn;
+    int ty_first = bounds->ymin / FB_TILE_HEIGHT;
+    int ty_last = (bounds->ymax - 1) / FB_TILE_HEIGHT;
+
+    for (ty = ty_first; ty <= ty_last; ty++) {
+        const uint8_t* tiles = fbs->tiles + ty * fbs->tiles_per_line;
+        int ymin = ty * FB_TILE_HEIGHT;
+        int ymax = ymin + FB_TILE_HEIGHT;
+
+        if (ymin < bounds->ymin) ymin = bounds->ymin;
+        if (ymax > bounds->ymax) ymax = bounds->ymax;
+
+        for (tx = 0; tx < fbs->tiles_per_line; tx++) {
+            if (!tiles[tx]) {
+                continue;
+            }
+            int xmin = tx * FB_TILE_WIDTH;
+            while (tx + 1 < fbs->tiles_per_line && tiles[tx + 1]) {
+                tx++;
+            }
+            int xmax = (tx + 1) * FB_TILE_WIDTH;
+
+            if (xmin < bounds->xmin) xmin = bounds->xmin;
+            if (xmax > bounds->xmax) xmax = bounds->xmax;
+
+            /* Extend a rectangle that ends on the tile line above */
+            for (nn = 0; nn < count; nn++) {
+                if (rects[nn].xmin == xmin && rects[nn].xmax == xmax &&
+                    rects[nn].ymax == ymin) {
+                    rects[nn].ymax = ymax;
+                    break;
+                }
+            }
+            if (nn < count) {
+                continue;
+            }
+            if (count == FB_MAX_UPDATE_RECTS) {
+                return 0;
+            }
+            rects[count].xmin = xmin;
+            rects[count].ymin = ymin;
+            rects[count].xmax = xmax;
+            rects[count].ymax = ymax;
+            count++;
+        }
+    }
+    return count;
+}
 
 static void goldfish_fb_update_display(void *opaque)
 {
@@ -488,6 +742,15 @@ static void goldfish_fb_update_display(void *opaque)
     fbs.src_pixels = src_line;
     fbs.src_pitch  = width*s->ds->surface->pf.bytes_per_pixel;
 
+    fbs.tiles_per_line = (width + FB_TILE_WIDTH - 1) / FB_TILE_WIDTH;
+    int tiles_size = fbs.tiles_per_line *
+                     ((height + FB_TILE_HEIGHT - 1) / FB_TILE_HEIGHT);
+    if (tiles_size > s->dirty_tiles_size) {
+        s->dirty_tiles = g_realloc(s->dirty_tiles, tiles_size);
+        s->dirty_tiles_size = tiles_size;
+    }
+    fbs.tiles = s->dirty_tiles;
+
 
 #if STATS
     if (full_update)
@@ -505,6 +768,10 @@ static void goldfish_fb_update_display(void *opaque)
     }
 #endif /* STATS */
 
+    FbUpdateRect   rects[FB_MAX_UPDATE_RECTS];
+    int            count = 0;
+    int            nn;
+
     if (s->blank)
     {
         memset( dst_line, 0, height*pitch );
@@ -518,6 +785,15 @@ static void goldfish_fb_update_display(void *opaque)
         if (full_update) { /* don't use dirty-bits optimization */
             base = 0;
         }
+        if (kvm_enabled() && base != 0) {
+            if (goldfish_fb_kvm_logged(s, base)) {
+                cpu_physical_sync_dirty_bitmap(base,
+                                               base + goldfish_fb_size(s));
+            } else {
+                base = 0;  /* no dirty bits, compare all the lines */
+            }
+        }
+        memset(fbs.tiles, 0, tiles_size);
         if (compute_fb_update_rect_linear(&fbs, base, &rect) == 0) {
             return;
         }
@@ -530,7 +806,20 @@ static void goldfish_fb_update_display(void *opaque)
            rect.ymin, rect.ymax-rect.ymin, rect.xmin, rect.xmax-rect.xmin);
 #endif
 
-    dpy_update(s->ds, rect.xmin, rect.ymin, rect.xmax-rect.xmin, rect.ymax-rect.ymin);
+    /* Report small separate changes, e.g. a clock and a cursor, as
+     * separate rectangles instead of their bounding one */
+    if (!s->blank) {
+        count = fb_get_update_rects(&fbs, &rect, rects);
+    }
+    if (count == 0) {
+        rects[0] = rect;
+        count = 1;
+    }
+    for (nn = 0; nn < count; nn++) {
+        dpy_update(s->ds, rects[nn].xmin, rects[nn].ymin,
+                   rects[nn].xmax - rects[nn].xmin,
+                   rects[nn].ymax - rects[nn].ymin);
+    }
 }
 
 static void goldfish_fb_invalidate_display(void * opaque)
@@ -598,8 +887,11 @@ static void goldfish_fb_write(void *opaque, hwaddr offset,
         case FB_SET_BASE: {
             int need_resize = !s->base_valid;
             s->fb_base = val;
+            goldfish_fb_kvm_log(s, val);
             s->int_status &= ~FB_INT_BASE_UPDATE_DONE;
             s->need_update = 1;
+            /* The guest waits for the next refresh to complete the post. */
+            gui_notify_activity();
             s->need_int = 1;
             s->base_valid = 1;
             if(s->set_rotation != s->rotation) {
@@ -665,6 +957,8 @@ void goldfish_fb_init(int id)
     s->pixel_format    = -1;
 
     goldfish_device_add(&s->dev, goldfish_fb_readfn, goldfish_fb_writefn, s);
+    /* the rotation is applied by the next FB_SET_BASE */
+    goldfish_device_coalesce_mmio(&s->dev, FB_SET_ROTATION, 4);
 
     register_savevm(NULL,
                     "goldfish_fb",
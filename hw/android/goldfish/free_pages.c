@@ -0,0 +1,169 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#include "cpu.h"
+#include "migration/qemu-file.h"
+#include "hw/android/goldfish/device.h"
+#include "hw/hw.h"
+#include "qemu/bswap.h"
+
+/* A device used by the guest kernel to report the pages it has free, which
+ * are given back to the host so that idle memory doesn't stay resident in
+ * the emulator process. See docs/GOLDFISH-VIRTUAL-HARDWARE.TXT. */
+
+enum {
+    FREE_PAGES_VERSION      = 0x00,
+    FREE_PAGES_PAGE_SIZE    = 0x04,
+    FREE_PAGES_LIST_LOW     = 0x08,
+    FREE_PAGES_LIST_HIGH    = 0x0c,
+    FREE_PAGES_REPORT       = 0x10,
+    FREE_PAGES_DISCARDED    = 0x14,
+};
+
+#define  FREE_PAGES_DEVICE_VERSION  1
+
+/* Maximum number of ranges per report, i.e. a page of list entries */
+#define  FREE_PAGES_MAX_RANGES      256
+
+struct goldfish_free_pages_state {
+    struct goldfish_device dev;
+    uint64_t list_addr;
+    uint32_t discarded;     /* pages discarded by the last report */
+};
+
+/* update this each time you update the goldfish_free_pages_state struct */
+#define  FREE_PAGES_STATE_SAVE_VERSION  1
+
+#define  QFIELD_STRUCT  struct goldfish_free_pages_state
+QFIELD_BEGIN(goldfish_free_pages_fields)
+    QFIELD_INT64(list_addr),
+    QFIELD_INT32(discarded),
+QFIELD_END
+
+static void goldfish_free_pages_save(QEMUFile* f, void* opaque)
+{
+    struct goldfish_free_pages_state* s = opaque;
+
+    qemu_put_struct(f, goldfish_free_pages_fields, s);
+}
+
+static int goldfish_free_pages_load(QEMUFile* f, void* opaque, int version_id)
+{
+    struct goldfish_free_pages_state* s = opaque;
+
+    if (version_id != FREE_PAGES_STATE_SAVE_VERSION)
+        return -1;
+
+    return qemu_get_struct(f, goldfish_free_pages_fields, s);
+}
+
+/* Discard the 'count' ranges listed at s->list_addr. Each entry is a guest
+ * physical address and a length in bytes, as two little-endian 64-bit
+ * values. */
+static void goldfish_free_pages_report(struct goldfish_free_pages_state* s,
+                                       uint32_t count)
+{
+    uint64_t ranges[FREE_PAGES_MAX_RANGES][2];
+    hwaddr discarded = 0;
+    uint32_t n;
+
+    if (count > FREE_PAGES_MAX_RANGES)
+        count = FREE_PAGES_MAX_RANGES;
+
+    cpu_physical_memory_read(s->list_addr, ranges, count * sizeof(ranges[0]));
+    for (n = 0; n < count; n++) {
+        discarded += cpu_physical_memory_discard(le64_to_cpu(ranges[n][0]),
+                                                 le64_to_cpu(ranges[n][1]));
+    }
+    s->discarded = discarded >> TARGET_PAGE_BITS;
+}
+
+static uint32_t goldfish_free_pages_read(void* opaque, hwaddr offset)
+{
+    struct goldfish_free_pages_state* s = opaque;
+
+    switch (offset) {
+        case FREE_PAGES_VERSION:
+            return FREE_PAGES_DEVICE_VERSION;
+        case FREE_PAGES_PAGE_SIZE:
+            return TARGET_PAGE_SIZE;
+        case FREE_PAGES_LIST_LOW:
+            return (uint32_t)s->list_addr;
+        case FREE_PAGES_LIST_HIGH:
+            return (uint32_t)(s->list_addr >> 32);
+        case FREE_PAGES_DISCARDED:
+            return s->discarded;
+
+        default:
+            cpu_abort(cpu_single_env,
+                      "goldfish_free_pages_read: Bad offset %" HWADDR_PRIx "\n",
+                      offset);
+            return 0;
+    }
+}
+
+static void goldfish_free_pages_write(void* opaque, hwaddr offset,
+                                      uint32_t val)
+{
+    struct goldfish_free_pages_state* s = opaque;
+
+    switch (offset) {
+        case FREE_PAGES_LIST_LOW:
+            s->list_addr = (s->list_addr & 0xffffffff00000000ULL) | val;
+            break;
+        case FREE_PAGES_LIST_HIGH:
+            s->list_addr = (s->list_addr & 0xffffffffULL) |
+                           ((uint64_t)val << 32);
+            break;
+        case FREE_PAGES_REPORT:
+            goldfish_free_pages_report(s, val);
+            break;
+
+        default:
+            cpu_abort(cpu_single_env,
+                      "goldfish_free_pages_write: Bad offset %" HWADDR_PRIx "\n",
+                      offset);
+    }
+}
+
+static CPUReadMemoryFunc* goldfish_free_pages_readfn[] = {
+    goldfish_free_pages_read,
+    goldfish_free_pages_read,
+    goldfish_free_pages_read
+};
+
+static CPUWriteMemoryFunc* goldfish_free_pages_writefn[] = {
+    goldfish_free_pages_write,
+    goldfish_free_pages_write,
+    goldfish_free_pages_write
+};
+
+void goldfish_free_pages_init(void)
+{
+    struct goldfish_free_pages_state* s;
+
+    s = (struct goldfish_free_pages_state*)g_malloc0(sizeof(*s));
+    s->dev.name = "goldfish_free_pages";
+    s->dev.base = 0;    // will be allocated dynamically
+    s->dev.size = 0x1000;
+    s->dev.irq_count = 0;
+
+    goldfish_device_add(&s->dev, goldfish_free_pages_readfn,
+                        goldfish_free_pages_writefn, s);
+
+    register_savevm(NULL,
+                    "goldfish_free_pages",
+                    0,
+                    FREE_PAGES_STATE_SAVE_VERSION,
+                    goldfish_free_pages_save,
+                    goldfish_free_pages_load,
+                    s);
+}
@@ -20,9 +20,16 @@ enum {
     INTERRUPT_NUMBER        = 0x04,
     INTERRUPT_DISABLE_ALL   = 0x08,
     INTERRUPT_DISABLE       = 0x0c,
-    INTERRUPT_ENABLE        = 0x10
+    INTERRUPT_ENABLE        = 0x10,
+    INTERRUPT_FEATURES      = 0x14, // INTERRUPT_FEATURE_XXX bit-flags
+    INTERRUPT_PENDING_MASK  = 0x18, // bitmask of pending interrupts
+    INTERRUPT_DISABLE_MASK  = 0x1c, // disable a bitmask of interrupts
+    INTERRUPT_ENABLE_MASK   = 0x20  // enable a bitmask of interrupts
 };
 
+/* Bit-flags returned by INTERRUPT_FEATURES */
+#define INTERRUPT_FEATURE_MASKS  (1 << 0)  /* the *_MASK registers exist */
+
 struct goldfish_int_state {
     struct goldfish_device dev;
     uint32_t level;
@@ -71,6 +78,23 @@ static void goldfish_int_update(struct goldfish_int_state *s)
     qemu_set_irq(s->parent_fiq, flags != 0);
 }
 
+/* Enable or disable all the interrupts of |mask| at once. */
+static void goldfish_int_set_enabled(struct goldfish_int_state *s,
+                                     uint32_t mask, int enable)
+{
+    uint32_t pending;
+
+    if (enable)
+        s->irq_enabled |= mask;
+    else
+        s->irq_enabled &= ~mask;
+
+    for (s->pending_count = 0, pending = s->level & s->irq_enabled;
+         pending != 0; pending &= pending - 1) {
+        s->pending_count++;
+    }
+}
+
 static void goldfish_int_set_irq(void *opaque, int irq, int level)
 {
     struct goldfish_int_state *s = (struct goldfish_int_state *)opaque;
@@ -109,6 +133,10 @@ static uint32_t goldfish_int_read(void *opaque, hwaddr offset)
         }
         return 0;
     }
+    case INTERRUPT_FEATURES:
+        return INTERRUPT_FEATURE_MASKS;
+    case INTERRUPT_PENDING_MASK:
+        return s->level & s->irq_enabled;
     default:
         cpu_abort(cpu_single_env,
                   "goldfish_int_read: Bad offset %" HWADDR_PRIx "\n",
@@ -129,18 +157,17 @@ static void goldfish_int_write(void *opaque, hwaddr offset, uint32_t value)
             break;
 
         case INTERRUPT_DISABLE:
-            if(s->irq_enabled & mask) {
-                if(s->level & mask)
-                    s->pending_count--;
-                s->irq_enabled &= ~mask;
-            }
+            goldfish_int_set_enabled(s, mask, 0);
             break;
         case INTERRUPT_ENABLE:
-            if(!(s->irq_enabled & mask)) {
-                s->irq_enabled |= mask;
-                if(s->level & mask)
-                    s->pending_count++;
-            }
+            goldfish_int_set_enabled(s, mask, 1);
+            break;
+
+        case INTERRUPT_DISABLE_MASK:
+            goldfish_int_set_enabled(s, value, 0);
+            break;
+        case INTERRUPT_ENABLE_MASK:
+            goldfish_int_set_enabled(s, value, 1);
             break;
 
     default:
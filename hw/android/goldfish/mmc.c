@@ -15,6 +15,7 @@
 #include "hw/android/goldfish/device.h"
 #include "hw/hw.h"
 #include "hw/mmc.h"
+#include "block/aio.h"
 #include "block/block.h"
 
 // These constants come from $KERNEL/include/linux/mmc/sd.h
@@ -115,8 +116,18 @@ struct goldfish_mmc_state {
     int is_SDHC;
 
     uint8_t* buf;
+
+    // The pending asynchronous transfer, if any, and the guest memory
+    // that it reads or writes directly.
+    BlockDriverAIOCB* aiocb;
+    QEMUIOVector qiov;
+    int qiov_to_guest;
 };
 
+// Maximum number of guest memory mappings of an asynchronous transfer,
+// which is done synchronously through |buf| if it needs more.
+#define  GOLDFISH_MMC_MAX_MAPPINGS  64
+
 #define  GOLDFISH_MMC_SAVE_VERSION  3
 #define  GOLDFISH_MMC_SAVE_VERSION_LEGACY  2
 
@@ -142,6 +153,10 @@ static void  goldfish_mmc_save(QEMUFile*  f, void*  opaque)
 {
     struct goldfish_mmc_state*  s = opaque;
 
+    // Complete the pending transfer, whose end is then part of the state.
+    if (s->aiocb)
+        qemu_aio_flush();
+
     qemu_put_be64(f, s->buffer_address);
     qemu_put_struct(f, goldfish_mmc_fields, s);
 }
@@ -150,6 +165,10 @@ static int  goldfish_mmc_load(QEMUFile*  f, void*  opaque, int  version_id)
 {
     struct goldfish_mmc_state*  s = opaque;
 
+    // Don't let a transfer of the current state complete in the new one.
+    if (s->aiocb)
+        qemu_aio_flush();
+
     if (version_id == GOLDFISH_MMC_SAVE_VERSION) {
         s->buffer_address = qemu_get_be64(f);
     } else if (version_id == GOLDFISH_MMC_SAVE_VERSION_LEGACY) {
@@ -255,12 +274,108 @@ static int  goldfish_mmc_bdrv_write(struct goldfish_mmc_state *s,
     return 0;
 }
 
+static void goldfish_mmc_set_status(struct goldfish_mmc_state *s, int new_status)
+{
+    s->int_status |= new_status;
+
+    if ((s->int_status & s->int_enable)) {
+        goldfish_device_set_irq(&s->dev, 0, (s->int_status & s->int_enable));
+    }
+}
+
+static void goldfish_mmc_unmap(struct goldfish_mmc_state *s)
+{
+    int  nn;
+
+    for (nn = 0; nn < s->qiov.niov; nn++) {
+        cpu_physical_memory_unmap(s->qiov.iov[nn].iov_base,
+                                  s->qiov.iov[nn].iov_len,
+                                  s->qiov_to_guest,
+                                  s->qiov.iov[nn].iov_len);
+    }
+    qemu_iovec_reset(&s->qiov);
+}
+
+// Map |size| bytes of guest memory at |address| into |s->qiov|. Return 0
+// on success, or -1 if the memory can't be mapped with at most
+// GOLDFISH_MMC_MAX_MAPPINGS ranges.
+static int goldfish_mmc_map(struct goldfish_mmc_state *s,
+                            hwaddr                     address,
+                            hwaddr                     size,
+                            int                        to_guest)
+{
+    s->qiov_to_guest = to_guest;
+    while (size > 0) {
+        hwaddr  len = size;
+        void*   ptr;
+
+        if (s->qiov.niov == GOLDFISH_MMC_MAX_MAPPINGS)
+            break;
+        ptr = cpu_physical_memory_map(address, &len, to_guest);
+        if (!ptr)
+            break;
+        qemu_iovec_add(&s->qiov, ptr, len);
+        address += len;
+        size    -= len;
+    }
+    if (size > 0) {
+        goldfish_mmc_unmap(s);
+        return -1;
+    }
+    return 0;
+}
+
+static void goldfish_mmc_transfer_done(void* opaque, int ret)
+{
+    struct goldfish_mmc_state *s = opaque;
+
+    s->aiocb = NULL;
+    goldfish_mmc_unmap(s);
+    goldfish_mmc_set_status(s, MMC_STAT_END_OF_DATA);
+}
+
+// Start reading or writing |num_sectors| sectors from |sector_number|
+// directly from or to the guest memory at |address|, in a single block
+// request. Return 1 if the transfer was started, and then raises
+// MMC_STAT_END_OF_DATA when done, or 0 if it was done synchronously.
+static int  goldfish_mmc_transfer(struct goldfish_mmc_state *s,
+                                  int64_t                    sector_number,
+                                  hwaddr                     address,
+                                  int                        num_sectors,
+                                  int                        is_read)
+{
+    if (goldfish_mmc_map(s, address, (hwaddr)num_sectors * 512,
+                         is_read) == 0) {
+        if (is_read)
+            s->aiocb = bdrv_aio_readv(s->bs, sector_number, &s->qiov,
+                                      num_sectors,
+                                      goldfish_mmc_transfer_done, s);
+        else
+            s->aiocb = bdrv_aio_writev(s->bs, sector_number, &s->qiov,
+                                       num_sectors,
+                                       goldfish_mmc_transfer_done, s);
+        if (s->aiocb)
+            return 1;
+        goldfish_mmc_unmap(s);
+    }
+
+    if (is_read)
+        goldfish_mmc_bdrv_read(s, sector_number, address, num_sectors);
+    else
+        goldfish_mmc_bdrv_write(s, sector_number, address, num_sectors);
+    return 0;
+}
 
 static void goldfish_mmc_do_command(struct goldfish_mmc_state *s, uint32_t cmd, uint32_t arg)
 {
     int new_status = MMC_STAT_END_OF_CMD;
     int opcode = cmd & 63;
 
+    // Commands are only sent once the previous transfer is done, but
+    // don't let two of them overlap anyway.
+    if (s->aiocb)
+        qemu_aio_flush();
+
 // fprintf(stderr, "goldfish_mmc_do_command opcode: %s (0x%04X), arg: %d\n", get_command_name(opcode), cmd, arg);
 
     s->resp[0] = 0;
@@ -418,8 +533,9 @@ static void goldfish_mmc_do_command(struct goldfish_mmc_state *s, uint32_t cmd,
                 if (arg & 511) fprintf(stderr, "offset %d is not multiple of 512 when reading\n", arg);
                 arg /= s->block_length;
             }
-            goldfish_mmc_bdrv_read(s, arg, s->buffer_address, s->block_count);
-            new_status |= MMC_STAT_END_OF_DATA;
+            if (!goldfish_mmc_transfer(s, arg, s->buffer_address,
+                                       s->block_count, 1))
+                new_status |= MMC_STAT_END_OF_DATA;
             s->resp[0] = SET_R1_CURRENT_STATE(4) | R1_READY_FOR_DATA; // 2304
             break;
         }
@@ -436,9 +552,10 @@ static void goldfish_mmc_do_command(struct goldfish_mmc_state *s, uint32_t cmd,
                 arg /= s->block_length;
             }
             // arg is byte offset
-            goldfish_mmc_bdrv_write(s, arg, s->buffer_address, s->block_count);
+            if (!goldfish_mmc_transfer(s, arg, s->buffer_address,
+                                       s->block_count, 0))
+                new_status |= MMC_STAT_END_OF_DATA;
 //            bdrv_flush(s->bs);
-            new_status |= MMC_STAT_END_OF_DATA;
             s->resp[0] = SET_R1_CURRENT_STATE(4) | R1_READY_FOR_DATA; // 2304
             break;
         }
@@ -452,11 +569,7 @@ static void goldfish_mmc_do_command(struct goldfish_mmc_state *s, uint32_t cmd,
             break;
      }
 
-    s->int_status |= new_status;
-
-    if ((s->int_status & s->int_enable)) {
-        goldfish_device_set_irq(&s->dev, 0, (s->int_status & s->int_enable));
-    }
+    goldfish_mmc_set_status(s, new_status);
 }
 
 static uint32_t goldfish_mmc_read(void *opaque, hwaddr offset)
@@ -566,6 +679,7 @@ void goldfish_mmc_init(uint32_t base, int id, BlockDriverState* bs)
     s->dev.irq_count = 1;
     s->bs = bs;
     s->buf = qemu_memalign(512,512);
+    qemu_iovec_init(&s->qiov, GOLDFISH_MMC_MAX_MAPPINGS);
 
     goldfish_device_add(&s->dev, goldfish_mmc_readfn, goldfish_mmc_writefn, s);
 
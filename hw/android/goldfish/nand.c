@@ -15,11 +15,25 @@
 #include "hw/android/goldfish/nand.h"
 #include "hw/android/goldfish/vmem.h"
 #include "hw/hw.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+#include "android/filesystems/nand_block_map.h"
+#include "android/utils/mapfile.h"
 #include "android/utils/path.h"
+#include "android/utils/perf_counters.h"
 #include "android/utils/tempfile.h"
 #include "android/qemu-debug.h"
 #include "android/android.h"
 
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#include <winioctl.h>
+#elif defined(__linux__)
+/* Defines fallocate() and FALLOC_FL_PUNCH_HOLE with recent C libraries */
+#include <fcntl.h>
+#endif
+
 #define  DEBUG  1
 #if DEBUG
 #  define  D(...)    VERBOSE_PRINT(init,__VA_ARGS__)
@@ -60,6 +74,22 @@ typedef struct {
     size_t     devname_len;
     uint8_t*   data;         /* buffer for read/write actions to underlying image */
     int        fd;
+    uint8_t*   map;          /* shared mapping of the first map_size bytes of the
+                              * image, or NULL, see nand_dev_map() */
+    uint64_t   map_size;
+    int        map_failed;
+    uint64_t   file_size;    /* current size of the underlying file */
+    NandBlockMap erased;     /* erase blocks which read as 0xff whatever the
+                              * file holds, see nand_dev_erase_file() */
+    uint32_t   block_count;
+    int        base_fd;      /* read-only base image, or -1 */
+    uint8_t*   base_map;     /* shared mapping of the base image, or NULL */
+    uint64_t   base_map_size;
+    uint64_t   base_size;
+    NandBlockMap cow;        /* with a base image, erase blocks whose content
+                              * is in the file, see nand_dev_copy_block() */
+    uint8_t*   async_buffer; /* buffer that replaces guest memory while an
+                              * asynchronous command runs, or NULL */
     uint32_t   flags;
     uint32_t   page_size;
     uint32_t   extra_size;
@@ -114,6 +144,108 @@ nand_threshold_update( nand_threshold*  t, uint32_t  len )
 
 #endif /* !NAND_THRESHOLD */
 
+#ifdef CONFIG_NAND_LIMITS
+
+/* A rate limit for reads or writes. |free_ns| is the host time at which
+ * the previous transfers would have completed at |rate| bytes per second.
+ * Both are protected by nand_rate_lock, since the limits are changed from
+ * the main loop, and each controller has its own worker thread. */
+typedef struct {
+    uint64_t  rate;
+    int64_t   free_ns;
+} nand_rate_limit;
+
+static nand_rate_limit  nand_read_rate;
+static nand_rate_limit  nand_write_rate;
+static QemuMutex        nand_rate_lock;
+static int              nand_rate_lock_inited;
+
+/* Called on the main thread, before any worker thread is started */
+static void
+nand_rate_lock_init( void )
+{
+    if (!nand_rate_lock_inited) {
+        qemu_mutex_init(&nand_rate_lock);
+        nand_rate_lock_inited = 1;
+    }
+}
+
+/* Transfers below the limit are not delayed until they add up to this
+ * much time, so that short bursts run at full speed. */
+#define  NAND_RATE_BURST_NS  100000000LL
+
+/* Block the caller until |len| bytes can be transferred under the rate
+ * limit. This must only run on a NAND worker thread: synchronous commands
+ * complete on the vCPU thread with the global mutex held, and sleeping
+ * there would stall the whole main loop. So only the guests that use
+ * asynchronous commands, see NAND_DEV_FLAG_ASYNC_CAP, are limited. */
+static void
+nand_rate_limit_wait( nand_rate_limit*  r, uint32_t  len )
+{
+    int64_t   now, wait_ns = 0;
+
+    qemu_mutex_lock(&nand_rate_lock);
+    if (r->rate != 0) {
+        now = get_clock();
+        if (r->free_ns < now - NAND_RATE_BURST_NS)
+            r->free_ns = now - NAND_RATE_BURST_NS;
+        r->free_ns += (int64_t)((uint64_t)len * 1000000000ULL / r->rate);
+        wait_ns = r->free_ns - now;
+    }
+    qemu_mutex_unlock(&nand_rate_lock);
+
+    if (wait_ns > 0) {
+#ifdef _WIN32
+        Sleep((DWORD)((wait_ns + 999999) / 1000000));
+#else
+        usleep((useconds_t)((wait_ns + 999) / 1000));
+#endif
+    }
+}
+
+void
+nand_set_rate_limits( uint64_t  read_rate, uint64_t  write_rate )
+{
+    nand_rate_lock_init();
+    qemu_mutex_lock(&nand_rate_lock);
+    nand_read_rate.rate  = read_rate;
+    nand_write_rate.rate = write_rate;
+    qemu_mutex_unlock(&nand_rate_lock);
+}
+
+void
+nand_get_rate_limits( uint64_t*  read_rate, uint64_t*  write_rate )
+{
+    nand_rate_lock_init();
+    qemu_mutex_lock(&nand_rate_lock);
+    *read_rate  = nand_read_rate.rate;
+    *write_rate = nand_write_rate.rate;
+    qemu_mutex_unlock(&nand_rate_lock);
+}
+
+/* dev->async_buffer is only set while the worker thread runs a command */
+#define  NAND_READ_RATE_LIMIT(dev, len)  \
+    do { \
+        if ((dev)->async_buffer != NULL) \
+            nand_rate_limit_wait( &nand_read_rate, (uint32_t)(len) ); \
+    } while (0)
+
+#define  NAND_WRITE_RATE_LIMIT(dev, len)  \
+    do { \
+        if ((dev)->async_buffer != NULL) \
+            nand_rate_limit_wait( &nand_write_rate, (uint32_t)(len) ); \
+    } while (0)
+
+#else /* !CONFIG_NAND_LIMITS */
+
+#define  NAND_READ_RATE_LIMIT(dev, len)  \
+    do {} while (0)
+
+#define  NAND_WRITE_RATE_LIMIT(dev, len)  \
+    do {} while (0)
+
+#endif /* !CONFIG_NAND_LIMITS */
+
 static nand_dev *nand_devs = NULL;
 static uint32_t nand_dev_count = 0;
 
@@ -133,14 +265,33 @@ typedef struct {
     uint32_t batch_addr_low;
     uint32_t batch_addr_high;
     uint32_t result;
+
+    // asynchronous command state, see nand_dev_async_submit()
+    QemuThread async_thread;
+    int        async_started;
+    QemuMutex  async_lock;
+    QemuCond   async_cond;
+    int        async_state;  /* NAND_ASYNC_IDLE, _RUNNING or _DONE */
+    uint32_t   async_cmd;
+    nand_dev*  async_dev;
+    uint64_t   async_addr;
+    uint32_t   async_size;
+    uint64_t   async_data;
+    uint32_t   async_result;
+    uint8_t*   async_buffer;
+    uint32_t   async_buffer_size;
 } nand_dev_controller_state;
 
 /* update this everytime you change the nand_dev_controller_state structure
  * 1: initial version, saving only nand_dev_controller_state fields
  * 2: saving actual disk contents as well
  * 3: use the correct data length and truncate to avoid padding.
+ * 6: save the bitmap of erased blocks after the contents of each disk.
+ * 7: save the bitmap of blocks copied from the base image too, if any.
  */
-#define  NAND_DEV_STATE_SAVE_VERSION  5
+#define  NAND_DEV_STATE_SAVE_VERSION  7
+#define  NAND_DEV_STATE_SAVE_VERSION_NO_COW  6
+#define  NAND_DEV_STATE_SAVE_VERSION_NO_ERASED  5
 #define  NAND_DEV_STATE_SAVE_VERSION_LEGACY  4
 
 #define  QFIELD_STRUCT  nand_dev_controller_state
@@ -203,6 +354,40 @@ static off_t do_lseek(int  fd, off_t offset, int whence)
     return ret;
 }
 
+/* EINTR-proof positioned read and write - due to SIGALRM in use elsewhere.
+ * These don't move the file position on POSIX systems. */
+static int  do_pread(int  fd, void*  buf, size_t  size, uint64_t  offset)
+{
+#ifdef _WIN32
+    if (do_lseek(fd, offset, SEEK_SET) == -1)
+        return -1;
+    return do_read(fd, buf, size);
+#else
+    int  ret;
+    do {
+        ret = pread(fd, buf, size, offset);
+    } while (ret < 0 && errno == EINTR);
+
+    return ret;
+#endif
+}
+
+static int  do_pwrite(int  fd, const void*  buf, size_t  size, uint64_t  offset)
+{
+#ifdef _WIN32
+    if (do_lseek(fd, offset, SEEK_SET) == -1)
+        return -1;
+    return do_write(fd, buf, size);
+#else
+    int  ret;
+    do {
+        ret = pwrite(fd, buf, size, offset);
+    } while (ret < 0 && errno == EINTR);
+
+    return ret;
+#endif
+}
+
 /* EINTR-proof ftruncate - due to SIGALRM in use elsewhere */
 static int  do_ftruncate(int  fd, size_t  size)
 {
@@ -214,6 +399,183 @@ static int  do_ftruncate(int  fd, size_t  size)
     return ret;
 }
 
+/* Whether to map images in memory */
+#if UINTPTR_MAX > 0xffffffffU
+#  define NAND_DEV_USE_MAP  1
+#else
+/* Large images would exhaust the address space of 32-bit hosts */
+#  define NAND_DEV_USE_MAP  0
+#endif
+
+/* Read and write commands copy data directly between guest memory and a
+ * shared mapping of the image file when possible, instead of going through
+ * the dev->data buffer with read() and write() system calls.
+ *
+ * Only the current content of the file is mapped, since the file may be
+ * smaller than the device, and its missing tail must read as 0xff; accesses
+ * beyond the mapping use the file descriptor. The image is mapped again
+ * when a read finds that the file grew since. If mapping fails, the device
+ * simply keeps using the file descriptor.
+ */
+#if NAND_DEV_USE_MAP
+static MapFile*  nand_fd_to_mapfile(int fd)
+{
+#ifdef _WIN32
+    return (MapFile*)_get_osfhandle(fd);
+#else
+    return (MapFile*)(ptrdiff_t)fd;
+#endif
+}
+#endif
+
+static void  nand_dev_unmap(nand_dev *dev)
+{
+    if (dev->map != NULL) {
+        mapfile_unmap(dev->map, (size_t)dev->map_size);
+        dev->map = NULL;
+        dev->map_size = 0;
+    }
+}
+
+static void  nand_dev_map(nand_dev *dev)
+{
+    off_t file_size;
+
+    nand_dev_unmap(dev);
+
+    file_size = do_lseek(dev->fd, 0, SEEK_END);
+    if (file_size == -1)
+        return;
+    dev->file_size = file_size;
+
+#if NAND_DEV_USE_MAP
+    uint64_t size = dev->file_size;
+    if (size > dev->max_size)
+        size = dev->max_size;
+    if (size == 0)
+        return;
+
+    MapFile* handle = nand_fd_to_mapfile(dev->fd);
+    int prot = PROT_READ;
+    if (!(dev->flags & NAND_DEV_FLAG_READ_ONLY))
+        prot |= PROT_WRITE;
+
+    void* mapped_offset;
+    size_t mapped_size;
+    void* mapped = mapfile_map(handle, 0, (size_t)size, prot,
+                               &mapped_offset, &mapped_size);
+    if (mapped == NULL) {
+        D("could not map %.*s NAND image: %s", (int)dev->devname_len,
+          dev->devname, strerror(errno));
+        dev->map_failed = 1;
+        return;
+    }
+    dev->map = mapped_offset;
+    dev->map_size = mapped_size;
+#endif
+}
+
+/* Return true iff [addr, addr + len) is mapped. If |remap| is true, map
+ * the image again first if it grew. */
+static int  nand_dev_is_mapped(nand_dev *dev, uint64_t addr, uint32_t len,
+                               int remap)
+{
+    if (remap && NAND_DEV_USE_MAP && !dev->map_failed &&
+        addr + len > dev->map_size && dev->file_size > dev->map_size) {
+        nand_dev_map(dev);
+    }
+    return dev->map != NULL && addr + len <= dev->map_size;
+}
+
+/* A device can have a read-only base image, see nand_add_dev(). The image
+ * file then only holds the erase blocks that were written since it was
+ * created, and the other ones are read from the base, which is mapped in
+ * memory once. Since all the emulators that use the same base map the same
+ * file, they share its pages in the host page cache.
+ *
+ * The image file is as large as the device, but sparse. The first write to
+ * a block copies it from the base to the file, and sets its bit in the
+ * dev->cow bitmap.
+ */
+static void  nand_dev_map_base(nand_dev *dev)
+{
+#if NAND_DEV_USE_MAP
+    uint64_t size = dev->base_size;
+    if (size > dev->max_size)
+        size = dev->max_size;
+    if (size == 0)
+        return;
+
+    void* mapped_offset;
+    size_t mapped_size;
+    void* mapped = mapfile_map(nand_fd_to_mapfile(dev->base_fd), 0,
+                               (size_t)size, PROT_READ,
+                               &mapped_offset, &mapped_size);
+    if (mapped == NULL) {
+        D("could not map %.*s NAND base image: %s", (int)dev->devname_len,
+          dev->devname, strerror(errno));
+        return;
+    }
+    dev->base_map = mapped_offset;
+    dev->base_map_size = mapped_size;
+#endif
+}
+
+/* Copy [addr, addr + len) of the base image to |buffer|. The part beyond
+ * the end of the base reads as 0xff. */
+static void  nand_dev_read_base(nand_dev *dev, uint8_t *buffer,
+                                uint64_t addr, uint32_t len)
+{
+    uint32_t avail = 0;
+    int ret;
+
+    if (addr < dev->base_size) {
+        avail = (dev->base_size - addr < len) ? (uint32_t)(dev->base_size - addr) : len;
+        if (dev->base_map != NULL && addr + avail <= dev->base_map_size) {
+            memcpy(buffer, dev->base_map + addr, avail);
+        } else {
+            ret = do_pread(dev->base_fd, buffer, avail, addr);
+            avail = (ret < 0) ? 0 : ret;
+        }
+    }
+    memset(buffer + avail, 0xff, len - avail);
+}
+
+/* Erasing a block doesn't write 0xff bytes over it. Instead, the block is
+ * marked in the dev->erased bitmap, and reads of marked blocks return 0xff
+ * without looking at the file. The block is then removed from the file
+ * with a hole, when the host supports it, so that erasing a large image is
+ * cheap and frees disk space. The first write to a marked block fills it
+ * with 0xff bytes before clearing its bit.
+ *
+ * Devices with a base image, see nand_add_dev(), similarly use the dev->cow
+ * bitmap to know which blocks were copied from the base to the file.
+ *
+ * Since the file alone doesn't describe the content of the device anymore,
+ * the bitmaps of persistent images are kept up to date in companion files,
+ * see android/filesystems/nand_block_map.h, and they are saved in snapshots.
+ */
+
+/* Release the storage of [addr, addr + len) in the image file, if possible.
+ * The content of the range becomes undefined. */
+static void  nand_dev_punch_hole(nand_dev *dev, uint64_t addr, uint64_t len)
+{
+    if (addr >= dev->file_size)
+        return;
+    if (len > dev->file_size - addr)
+        len = dev->file_size - addr;
+#if defined(__linux__) && defined(FALLOC_FL_PUNCH_HOLE)
+    fallocate(dev->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, addr, len);
+#elif defined(_WIN32)
+    FILE_ZERO_DATA_INFORMATION info;
+    DWORD returned;
+    info.FileOffset.QuadPart = addr;
+    info.BeyondFinalZero.QuadPart = addr + len;
+    DeviceIoControl((HANDLE)_get_osfhandle(dev->fd), FSCTL_SET_ZERO_DATA,
+                    &info, sizeof(info), NULL, 0, &returned, NULL);
+#endif
+}
+
 #define NAND_DEV_SAVE_DISK_BUF_SIZE 2048
 
 
@@ -264,6 +626,12 @@ static void  nand_dev_save_disk_state(QEMUFile *f, nand_dev *dev)
     while (ret == buf_size && total_copied < dev->max_size);
 
     /* TODO Maybe check that we've written total_size bytes */
+
+    qemu_put_be32(f, dev->block_count);
+    qemu_put_buffer(f, dev->erased.bits, nandBlockMap_size(&dev->erased));
+    qemu_put_byte(f, dev->base_fd >= 0);
+    if (dev->base_fd >= 0)
+        qemu_put_buffer(f, dev->cow.bits, nandBlockMap_size(&dev->cow));
 }
 
 
@@ -282,7 +650,7 @@ static void nand_dev_save_disks(QEMUFile *f)
  * Overwrites the contents of the disk image managed by this device with the
  * contents as they were at the point the snapshot was made.
  */
-static int  nand_dev_load_disk_state(QEMUFile *f, nand_dev *dev)
+static int  nand_dev_load_disk_state(QEMUFile *f, nand_dev *dev, int version_id)
 {
     int buf_size = NAND_DEV_SAVE_DISK_BUF_SIZE;
     uint8_t buffer[NAND_DEV_SAVE_DISK_BUF_SIZE] = {0};
@@ -326,23 +694,65 @@ static int  nand_dev_load_disk_state(QEMUFile *f, nand_dev *dev)
         next_offset += buf_size;
     }
 
+    /* Windows can't truncate a mapped file */
+    nand_dev_unmap(dev);
     ret = do_ftruncate(dev->fd, total_size);
+    nand_dev_map(dev);
     if (ret < 0) {
         XLOG("%s ftruncate failed: %s\n", __FUNCTION__, strerror(errno));
         return -EIO;
     }
 
+    /* Older snapshots only contain real data */
+    size_t bitmap_size = nandBlockMap_size(&dev->erased);
+    if (version_id == NAND_DEV_STATE_SAVE_VERSION_NO_ERASED ||
+        version_id == NAND_DEV_STATE_SAVE_VERSION_LEGACY) {
+        memset(dev->erased.bits, 0, bitmap_size);
+    } else {
+        uint32_t block_count = qemu_get_be32(f);
+        if (block_count != dev->block_count) {
+            XLOG("%s, restore failed: %u erase blocks instead of %u\n",
+                 __FUNCTION__, block_count, dev->block_count);
+            return -EIO;
+        }
+        if (qemu_get_buffer(f, dev->erased.bits, bitmap_size) != (int)bitmap_size) {
+            XLOG("%s read failed: incomplete erased block map\n", __FUNCTION__);
+            return -EIO;
+        }
+    }
+    nandBlockMap_update(&dev->erased);
+
+    /* Without a bitmap of copied blocks, the snapshot holds all of them */
+    int has_cow = 0;
+    if (version_id == NAND_DEV_STATE_SAVE_VERSION)
+        has_cow = qemu_get_byte(f);
+    if (has_cow && dev->base_fd < 0) {
+        XLOG("%s, restore failed: %.*s has no base image\n",
+             __FUNCTION__, (int)dev->devname_len, dev->devname);
+        return -EIO;
+    }
+    if (dev->base_fd >= 0) {
+        if (!has_cow) {
+            nandBlockMap_fill(&dev->cow, 1);
+        } else if (qemu_get_buffer(f, dev->cow.bits, bitmap_size) != (int)bitmap_size) {
+            XLOG("%s read failed: incomplete copied block map\n", __FUNCTION__);
+            return -EIO;
+        } else {
+            nandBlockMap_update(&dev->cow);
+        }
+    }
+
     return 0;
 }
 
 /**
  * Restores the state of all disks managed by this driver from a snapshot file.
  */
-static int nand_dev_load_disks(QEMUFile *f)
+static int nand_dev_load_disks(QEMUFile *f, int version_id)
 {
     int i, ret;
     for (i = 0; i < nand_dev_count; i++) {
-        ret = nand_dev_load_disk_state(f, nand_devs + i);
+        ret = nand_dev_load_disk_state(f, nand_devs + i, version_id);
         if (ret)
             return ret; // abort on error
     }
@@ -350,10 +760,13 @@ static int nand_dev_load_disks(QEMUFile *f)
     return 0;
 }
 
+static void nand_dev_async_wait(nand_dev_controller_state *s);
+
 static void  nand_dev_controller_state_save(QEMUFile *f, void  *opaque)
 {
     nand_dev_controller_state* s = opaque;
 
+    nand_dev_async_wait(s);
     qemu_put_struct(f, nand_dev_controller_state_fields, s);
 
     /* The guest will continue writing to the disk image after the state has
@@ -368,7 +781,10 @@ static int   nand_dev_controller_state_load(QEMUFile *f, void  *opaque, int  ver
     nand_dev_controller_state*  s = opaque;
     int ret;
 
-    if (version_id == NAND_DEV_STATE_SAVE_VERSION) {
+    nand_dev_async_wait(s);
+    if (version_id == NAND_DEV_STATE_SAVE_VERSION ||
+        version_id == NAND_DEV_STATE_SAVE_VERSION_NO_COW ||
+        version_id == NAND_DEV_STATE_SAVE_VERSION_NO_ERASED) {
         ret = qemu_get_struct(f, nand_dev_controller_state_fields, s);
     } else if (version_id == NAND_DEV_STATE_SAVE_VERSION_LEGACY) {
         ret = qemu_get_struct(f, nand_dev_controller_state_legacy_1_fields, s);
@@ -382,36 +798,222 @@ static int   nand_dev_controller_state_load(QEMUFile *f, void  *opaque, int  ver
         // Invalid encoding.
         ret = -1;
     }
-    return ret ? ret : nand_dev_load_disks(f);
+    return ret ? ret : nand_dev_load_disks(f, version_id);
 }
 
-static uint32_t nand_dev_read_file(nand_dev *dev, target_ulong data, uint64_t addr, uint32_t total_len)
+/* Copy |len| bytes between |buf| and guest memory at virtual address |data|,
+ * to guest memory if |is_write| is true, like safe_memory_rw_debug(). While
+ * an asynchronous command runs, |data| is an offset in dev->async_buffer
+ * instead. */
+static void nand_dev_copy_guest(nand_dev *dev, target_ulong data, uint8_t *buf,
+                                uint32_t len, int is_write)
+{
+    if (dev->async_buffer == NULL) {
+        safe_memory_rw_debug(current_cpu, data, buf, len, is_write);
+    } else if (is_write) {
+        memcpy(dev->async_buffer + data, buf, len);
+    } else {
+        memcpy(buf, dev->async_buffer + data, len);
+    }
+}
+
+/* Read [addr, addr + total_len) from the image file, ignoring the bitmap
+ * of erased blocks. */
+static void nand_dev_read_range(nand_dev *dev, target_ulong data, uint64_t addr, uint32_t total_len)
 {
     uint32_t len = total_len;
     size_t read_len = dev->erase_size;
-    int eof = 0;
+    int ret;
 
-    NAND_UPDATE_READ_THRESHOLD(total_len);
+    if (nand_dev_is_mapped(dev, addr, total_len, 1)) {
+        nand_dev_copy_guest(dev, data, dev->map + addr, total_len, 1);
+        return;
+    }
 
-    do_lseek(dev->fd, addr, SEEK_SET);
     while(len > 0) {
-        if(read_len < dev->erase_size) {
-            memset(dev->data, 0xff, dev->erase_size);
-            read_len = dev->erase_size;
-            eof = 1;
-        }
         if(len < read_len)
             read_len = len;
-        if(!eof) {
-            read_len = do_read(dev->fd, dev->data, read_len);
+        ret = do_pread(dev->fd, dev->data, read_len, addr);
+        if(ret < 0)
+            ret = 0;
+        if(ret < read_len) {
+            /* Past the end of the file */
+            memset(dev->data + ret, 0xff, read_len - ret);
         }
-        safe_memory_rw_debug(current_cpu, data, dev->data, read_len, 1);
+        nand_dev_copy_guest(dev, data, dev->data, read_len, 1);
         data += read_len;
+        addr += read_len;
         len -= read_len;
     }
+}
+
+/* Where the content of an erase block comes from */
+enum {
+    NAND_BLOCK_FILE,
+    NAND_BLOCK_ERASED,
+    NAND_BLOCK_BASE,
+};
+
+static int nand_dev_block_source(nand_dev *dev, uint32_t block)
+{
+    if (nandBlockMap_get(&dev->erased, block))
+        return NAND_BLOCK_ERASED;
+    if (dev->base_fd >= 0 && !nandBlockMap_get(&dev->cow, block))
+        return NAND_BLOCK_BASE;
+    return NAND_BLOCK_FILE;
+}
+
+static uint32_t nand_dev_read_file(nand_dev *dev, target_ulong data, uint64_t addr, uint32_t total_len)
+{
+    uint32_t len = total_len;
+
+    NAND_UPDATE_READ_THRESHOLD(total_len);
+    NAND_READ_RATE_LIMIT(dev, total_len);
+
+    if (dev->erased.count == 0 &&
+        (dev->base_fd < 0 || dev->cow.count == dev->block_count)) {
+        nand_dev_read_range(dev, data, addr, total_len);
+        return total_len;
+    }
+
+    /* Split the range into runs of blocks that have the same source */
+    while(len > 0) {
+        uint32_t block = addr / dev->erase_size;
+        int source = nand_dev_block_source(dev, block);
+        uint64_t end = (uint64_t)(block + 1) * dev->erase_size;
+        while (end < addr + len &&
+               nand_dev_block_source(dev, end / dev->erase_size) == source) {
+            end += dev->erase_size;
+        }
+        uint32_t run_len = (end < addr + len) ? (uint32_t)(end - addr) : len;
+
+        if (source == NAND_BLOCK_FILE) {
+            nand_dev_read_range(dev, data, addr, run_len);
+            data += run_len;
+        } else if (source == NAND_BLOCK_BASE && dev->base_map != NULL &&
+                   addr + run_len <= dev->base_map_size) {
+            nand_dev_copy_guest(dev, data, dev->base_map + addr, run_len, 1);
+            data += run_len;
+        } else {
+            uint32_t remaining = run_len;
+            uint64_t chunk_addr = addr;
+            if (source == NAND_BLOCK_ERASED)
+                memset(dev->data, 0xff, dev->erase_size);
+            while (remaining > 0) {
+                uint32_t chunk = remaining < dev->erase_size ? remaining : dev->erase_size;
+                if (source == NAND_BLOCK_BASE)
+                    nand_dev_read_base(dev, dev->data, chunk_addr, chunk);
+                nand_dev_copy_guest(dev, data, dev->data, chunk, 1);
+                data += chunk;
+                chunk_addr += chunk;
+                remaining -= chunk;
+            }
+        }
+        addr += run_len;
+        len -= run_len;
+    }
     return total_len;
 }
 
+/* Write the content of erase block |block| to the image file, from
+ * dev->data, or directly to the mapping if |mapped| is true. Return 0 on
+ * success, or -1 on failure. */
+static int nand_dev_write_block(nand_dev *dev, uint32_t block, int mapped)
+{
+    uint64_t addr = (uint64_t)block * dev->erase_size;
+
+    if (mapped)
+        return 0;
+    if (do_pwrite(dev->fd, dev->data, dev->erase_size, addr) !=
+        (int)dev->erase_size) {
+        XLOG("%s, write failed: %s\n", __FUNCTION__, strerror(errno));
+        return -1;
+    }
+    if (addr + dev->erase_size > dev->file_size)
+        dev->file_size = addr + dev->erase_size;
+    return 0;
+}
+
+/* Write 0xff bytes over erase block |block| of the image file, and clear
+ * its bit in the bitmap of erased blocks. Return 0 on success, or -1 on
+ * failure. */
+static int nand_dev_fill_block(nand_dev *dev, uint32_t block)
+{
+    uint64_t addr = (uint64_t)block * dev->erase_size;
+    int mapped = nand_dev_is_mapped(dev, addr, dev->erase_size, 0);
+
+    memset(mapped ? dev->map + addr : dev->data, 0xff, dev->erase_size);
+    if (nand_dev_write_block(dev, block, mapped) < 0)
+        return -1;
+    if (dev->base_fd >= 0)
+        nandBlockMap_set(&dev->cow, block, 1);
+    nandBlockMap_set(&dev->erased, block, 0);
+    return 0;
+}
+
+/* Copy erase block |block| of the base image to the image file, and set
+ * its bit in the bitmap of copied blocks. Return 0 on success, or -1 on
+ * failure. */
+static int nand_dev_copy_block(nand_dev *dev, uint32_t block)
+{
+    uint64_t addr = (uint64_t)block * dev->erase_size;
+    int mapped = nand_dev_is_mapped(dev, addr, dev->erase_size, 0);
+
+    nand_dev_read_base(dev, mapped ? dev->map + addr : dev->data,
+                       addr, dev->erase_size);
+    if (nand_dev_write_block(dev, block, mapped) < 0)
+        return -1;
+    nandBlockMap_set(&dev->cow, block, 1);
+    return 0;
+}
+
+/* Prepare a write to [addr, addr + len) of the image file, by filling the
+ * erased blocks it touches, and copying the ones that are still in the
+ * base image. Return 0 on success, or -1 on failure. */
+static int nand_dev_prepare_write(nand_dev *dev, uint64_t addr, uint32_t len)
+{
+    uint32_t block = addr / dev->erase_size;
+    uint32_t last = (addr + len - 1) / dev->erase_size;
+
+    if (len == 0 || (dev->erased.count == 0 &&
+        (dev->base_fd < 0 || dev->cow.count == dev->block_count))) {
+        return 0;
+    }
+    for (; block <= last; block++) {
+        int source = nand_dev_block_source(dev, block);
+        if (source == NAND_BLOCK_ERASED && nand_dev_fill_block(dev, block) < 0)
+            return -1;
+        if (source == NAND_BLOCK_BASE && nand_dev_copy_block(dev, block) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/* Prepare a write at |addr|, beyond the end of the image file, which would
+ * otherwise leave a gap of zeroes: fill the end of the last block of the
+ * file with 0xff bytes, and mark the following blocks up to the one that
+ * contains |addr| as erased. Return 0 on success, or -1 on failure. */
+static int nand_dev_extend_file(nand_dev *dev, uint64_t addr)
+{
+    uint64_t end = dev->file_size + dev->erase_size - 1;
+    end -= end % dev->erase_size;
+    if (end > dev->file_size) {
+        size_t len = (size_t)(end - dev->file_size);
+        memset(dev->data, 0xff, len);
+        if (do_pwrite(dev->fd, dev->data, len, dev->file_size) != (int)len) {
+            XLOG("%s, write failed: %s\n", __FUNCTION__, strerror(errno));
+            return -1;
+        }
+        dev->file_size = end;
+    }
+    uint32_t block = end / dev->erase_size;
+    uint32_t last = addr / dev->erase_size;
+    for (; block <= last; block++) {
+        nandBlockMap_set(&dev->erased, block, 1);
+    }
+    return 0;
+}
+
 static uint32_t nand_dev_write_file(nand_dev *dev, target_ulong data, uint64_t addr, uint32_t total_len)
 {
     uint32_t len = total_len;
@@ -419,20 +1021,34 @@ static uint32_t nand_dev_write_file(nand_dev *dev, target_ulong data, uint64_t a
     int ret;
 
     NAND_UPDATE_WRITE_THRESHOLD(total_len);
+    NAND_WRITE_RATE_LIMIT(dev, total_len);
+
+    if (addr > dev->file_size && nand_dev_extend_file(dev, addr) < 0)
+        return 0;
+
+    if (nand_dev_prepare_write(dev, addr, total_len) < 0)
+        return 0;
+
+    if (nand_dev_is_mapped(dev, addr, total_len, 0)) {
+        nand_dev_copy_guest(dev, data, dev->map + addr, total_len, 0);
+        return total_len;
+    }
 
-    do_lseek(dev->fd, addr, SEEK_SET);
     while(len > 0) {
         if(len < write_len)
             write_len = len;
-        safe_memory_rw_debug(current_cpu, data, dev->data, write_len, 0);
-        ret = do_write(dev->fd, dev->data, write_len);
+        nand_dev_copy_guest(dev, data, dev->data, write_len, 0);
+        ret = do_pwrite(dev->fd, dev->data, write_len, addr);
         if(ret < write_len) {
             XLOG("nand_dev_write_file, write failed: %s\n", strerror(errno));
             break;
         }
         data += write_len;
+        addr += write_len;
         len -= write_len;
     }
+    if (addr > dev->file_size)
+        dev->file_size = addr;
     return total_len - len;
 }
 
@@ -442,21 +1058,162 @@ static uint32_t nand_dev_erase_file(nand_dev *dev, uint64_t addr, uint32_t total
     size_t write_len = dev->erase_size;
     int ret;
 
-    do_lseek(dev->fd, addr, SEEK_SET);
+    /* Mark whole blocks as erased. Persist the bit before punching the
+     * hole, so that they never read as zeroes. */
+    if (addr % dev->erase_size == 0 && len % dev->erase_size == 0) {
+        uint32_t block = addr / dev->erase_size;
+        for (; len > 0; block++, len -= dev->erase_size) {
+            nandBlockMap_set(&dev->erased, block, 1);
+        }
+        nand_dev_punch_hole(dev, addr, total_len);
+        return total_len;
+    }
+
+    if (addr > dev->file_size && nand_dev_extend_file(dev, addr) < 0)
+        return 0;
+
+    if (nand_dev_prepare_write(dev, addr, total_len) < 0)
+        return 0;
+
+    if (nand_dev_is_mapped(dev, addr, total_len, 0)) {
+        memset(dev->map + addr, 0xff, total_len);
+        return total_len;
+    }
+
     memset(dev->data, 0xff, dev->erase_size);
     while(len > 0) {
         if(len < write_len)
             write_len = len;
-        ret = do_write(dev->fd, dev->data, write_len);
+        ret = do_pwrite(dev->fd, dev->data, write_len, addr);
         if(ret < write_len) {
             XLOG( "nand_dev_write_file, write failed: %s\n", strerror(errno));
             break;
         }
+        addr += write_len;
         len -= write_len;
     }
+    if (addr > dev->file_size)
+        dev->file_size = addr;
     return total_len - len;
 }
 
+/* Guests that set NAND_DEV_FLAG_ASYNC_CAP can start reads and writes with
+ * NAND_ASYNC_COMMAND instead of NAND_COMMAND. The file I/O then runs on a
+ * worker thread, so that a slow host disk doesn't stall the vCPU, and
+ * NAND_STATUS reports NAND_STATUS_BUSY until it completes. Reading
+ * NAND_RESULT or starting another command waits for completion.
+ *
+ * The worker can't translate guest virtual addresses, so the data goes
+ * through s->async_buffer: it is copied from guest memory when a write
+ * starts, and to guest memory when a read completes, on the vCPU thread.
+ * The guest must not release the buffer before the command completes.
+ */
+enum {
+    NAND_ASYNC_IDLE,
+    NAND_ASYNC_RUNNING,
+    NAND_ASYNC_DONE,
+};
+
+/* Larger transfers run synchronously, to bound the size of the buffer */
+#define NAND_ASYNC_MAX_TRANSFER_SIZE  (1024 * 1024)
+
+static void* nand_dev_async_thread(void *opaque)
+{
+    nand_dev_controller_state *s = opaque;
+
+    qemu_mutex_lock(&s->async_lock);
+    for (;;) {
+        while (s->async_state != NAND_ASYNC_RUNNING)
+            qemu_cond_wait(&s->async_cond, &s->async_lock);
+        qemu_mutex_unlock(&s->async_lock);
+
+        nand_dev *dev = s->async_dev;
+        uint32_t result;
+        dev->async_buffer = s->async_buffer;
+        if (s->async_cmd == NAND_CMD_READ)
+            result = nand_dev_read_file(dev, 0, s->async_addr, s->async_size);
+        else
+            result = nand_dev_write_file(dev, 0, s->async_addr, s->async_size);
+        dev->async_buffer = NULL;
+
+        qemu_mutex_lock(&s->async_lock);
+        s->async_result = result;
+        s->async_state = NAND_ASYNC_DONE;
+        qemu_cond_broadcast(&s->async_cond);
+    }
+    return NULL;
+}
+
+static void nand_dev_async_submit(nand_dev_controller_state *s, nand_dev *dev,
+                                  uint32_t cmd, uint64_t addr, uint32_t size)
+{
+    if (size > s->async_buffer_size) {
+        s->async_buffer = g_realloc(s->async_buffer, size);
+        s->async_buffer_size = size;
+    }
+    if (cmd == NAND_CMD_WRITE)
+        safe_memory_rw_debug(current_cpu, s->data, s->async_buffer, size, 0);
+    if (!s->async_started) {
+        qemu_thread_create(&s->async_thread, nand_dev_async_thread, s,
+                           QEMU_THREAD_DETACHED);
+        s->async_started = 1;
+    }
+    s->async_cmd = cmd;
+    s->async_dev = dev;
+    s->async_addr = addr;
+    s->async_size = size;
+    s->async_data = s->data;
+
+    qemu_mutex_lock(&s->async_lock);
+    s->async_state = NAND_ASYNC_RUNNING;
+    qemu_cond_broadcast(&s->async_cond);
+    qemu_mutex_unlock(&s->async_lock);
+}
+
+/* Deliver the result of a completed command. Only the vCPU thread leaves
+ * the NAND_ASYNC_DONE state, so this doesn't need the lock. */
+static void nand_dev_async_finish(nand_dev_controller_state *s)
+{
+    if (s->async_state != NAND_ASYNC_DONE)
+        return;
+    if (s->async_cmd == NAND_CMD_READ) {
+        /* Snapshots are saved outside of the vCPU thread */
+        CPUState *cpu = current_cpu ? current_cpu : first_cpu;
+        safe_memory_rw_debug(cpu, s->async_data, s->async_buffer,
+                             s->async_result, 1);
+    }
+    s->result = s->async_result;
+    s->async_state = NAND_ASYNC_IDLE;
+}
+
+/* Return true iff an asynchronous command is still running */
+static int nand_dev_async_poll(nand_dev_controller_state *s)
+{
+    int running;
+
+    qemu_mutex_lock(&s->async_lock);
+    running = (s->async_state == NAND_ASYNC_RUNNING);
+    qemu_mutex_unlock(&s->async_lock);
+    if (!running)
+        nand_dev_async_finish(s);
+    return running;
+}
+
+/* Wait until no asynchronous command runs */
+static void nand_dev_async_wait(nand_dev_controller_state *s)
+{
+    qemu_mutex_lock(&s->async_lock);
+    while (s->async_state == NAND_ASYNC_RUNNING)
+        qemu_cond_wait(&s->async_cond, &s->async_lock);
+    qemu_mutex_unlock(&s->async_lock);
+    nand_dev_async_finish(s);
+}
+
+static PerfCounter nand_bytes_read_counter =
+    PERF_COUNTER_INIT("nand.bytes_read", "bytes");
+static PerfCounter nand_bytes_written_counter =
+    PERF_COUNTER_INIT("nand.bytes_written", "bytes");
+
 /* this is a huge hack required to make the PowerPC emulator binary usable
  * on Mac OS X. If you define this function as 'static', the emulated kernel
  * will panic when attempting to mount the /data partition.
@@ -470,12 +1227,14 @@ static uint32_t nand_dev_erase_file(nand_dev *dev, uint64_t addr, uint32_t total
 #if !(defined __APPLE__ && defined __powerpc__)
 static
 #endif
-uint32_t nand_dev_do_cmd(nand_dev_controller_state *s, uint32_t cmd)
+uint32_t nand_dev_do_cmd(nand_dev_controller_state *s, uint32_t cmd, int async)
 {
     uint32_t size;
     uint64_t addr;
     nand_dev *dev;
 
+    nand_dev_async_wait(s);
+
     if (cmd == NAND_CMD_WRITE_BATCH || cmd == NAND_CMD_READ_BATCH ||
         cmd == NAND_CMD_ERASE_BATCH) {
         struct batch_data bd;
@@ -515,6 +1274,12 @@ uint32_t nand_dev_do_cmd(nand_dev_controller_state *s, uint32_t cmd)
             return 0;
         if(size > dev->max_size - addr)
             size = dev->max_size - addr;
+        perfCounter_add(&nand_bytes_read_counter, size);
+        if(dev->fd >= 0 && async && cmd == NAND_CMD_READ &&
+           size <= NAND_ASYNC_MAX_TRANSFER_SIZE) {
+            nand_dev_async_submit(s, dev, cmd, addr, size);
+            return 0;
+        }
         if(dev->fd >= 0)
             return nand_dev_read_file(dev, s->data, addr, size);
         safe_memory_rw_debug(current_cpu, s->data, &dev->data[addr], size, 1);
@@ -527,6 +1292,12 @@ uint32_t nand_dev_do_cmd(nand_dev_controller_state *s, uint32_t cmd)
             return 0;
         if(size > dev->max_size - addr)
             size = dev->max_size - addr;
+        perfCounter_add(&nand_bytes_written_counter, size);
+        if(dev->fd >= 0 && async && cmd == NAND_CMD_WRITE &&
+           size <= NAND_ASYNC_MAX_TRANSFER_SIZE) {
+            nand_dev_async_submit(s, dev, cmd, addr, size);
+            return 0;
+        }
         if(dev->fd >= 0)
             return nand_dev_write_file(dev, s->data, addr, size);
         safe_memory_rw_debug(current_cpu, s->data, &dev->data[addr], size, 0);
@@ -589,7 +1360,8 @@ static void nand_dev_write(void *opaque, hwaddr offset, uint32_t value)
         uint64_set_high(&s->data, value);
         break;
     case NAND_COMMAND:
-        s->result = nand_dev_do_cmd(s, value);
+    case NAND_ASYNC_COMMAND:
+        s->result = nand_dev_do_cmd(s, value, offset == NAND_ASYNC_COMMAND);
         if (value == NAND_CMD_WRITE_BATCH || value == NAND_CMD_READ_BATCH ||
             value == NAND_CMD_ERASE_BATCH) {
             struct batch_data bd;
@@ -624,7 +1396,10 @@ static uint32_t nand_dev_read(void *opaque, hwaddr offset)
     case NAND_NUM_DEV:
         return nand_dev_count;
     case NAND_RESULT:
+        nand_dev_async_wait(s);
         return s->result;
+    case NAND_STATUS:
+        return nand_dev_async_poll(s) ? NAND_STATUS_BUSY : 0;
     }
 
     if(s->dev >= nand_dev_count)
@@ -685,6 +1460,25 @@ static CPUWriteMemoryFunc *nand_dev_writefn[] = {
    nand_dev_write
 };
 
+static nand_dev_controller_state **nand_controllers = NULL;
+static uint32_t nand_controller_count = 0;
+
+/* Record the identity of the images in their companion files once they are
+ * not modified anymore, see nandBlockMap_close(). The mappings are dropped
+ * first, since writes through them can still move the modification time. */
+static void nand_dev_close_all(void)
+{
+    uint32_t i;
+
+    for (i = 0; i < nand_controller_count; i++)
+        nand_dev_async_wait(nand_controllers[i]);
+    for (i = 0; i < nand_dev_count; i++) {
+        nand_dev_unmap(nand_devs + i);
+        nandBlockMap_close(&nand_devs[i].erased);
+        nandBlockMap_close(&nand_devs[i].cow);
+    }
+}
+
 /* initialize the QFB device */
 void nand_dev_init(uint32_t base)
 {
@@ -696,6 +1490,14 @@ void nand_dev_init(uint32_t base)
     iomemtype = cpu_register_io_memory(nand_dev_readfn, nand_dev_writefn, s);
     cpu_register_physical_memory(base, 0x00000fff, iomemtype);
     s->base = base;
+    qemu_mutex_init(&s->async_lock);
+    qemu_cond_init(&s->async_cond);
+#ifdef CONFIG_NAND_LIMITS
+    nand_rate_lock_init();
+#endif
+    nand_controllers = g_renew(nand_dev_controller_state *, nand_controllers,
+                               nand_controller_count + 1);
+    nand_controllers[nand_controller_count++] = s;
 
     register_savevm(NULL,
                     "nand_dev",
@@ -715,6 +1517,12 @@ static int arg_match(const char *a, const char *b, size_t b_len)
     return b_len == 0;
 }
 
+/* Add a device described by |arg|, a device name followed by comma-separated
+ * options. With "basefile=<path>", the device starts with the content of the
+ * image at <path>, which is never modified, and "file=" only receives the
+ * blocks that are written, see nand_dev_map_base(). Unlike "initfile=", this
+ * doesn't copy the image.
+ */
 void nand_add_dev(const char *arg)
 {
     uint64_t dev_size = 0;
@@ -725,12 +1533,15 @@ void nand_add_dev(const char *arg)
     char *devname = NULL;
     size_t devname_len = 0;
     char *initfilename = NULL;
+    char *basefilename = NULL;
     char *rwfilename = NULL;
     int initfd = -1;
+    int basefd = -1;
     int rwfd = -1;
     int read_only = 0;
+    int temporary = 0;
+    int reset;
     int pad;
-    ssize_t read_size;
     uint32_t page_size = 2048;
     uint32_t extra_size = 64;
     uint32_t erase_pages = 64;
@@ -810,6 +1621,15 @@ void nand_add_dev(const char *arg)
                 // Restore unusual characters that confuse parsing
                 path_unescape_path(initfilename);
             }
+            else if(arg_match("basefile", arg, arg_len)) {
+                basefilename = malloc(value_len + 1);
+                if(basefilename == NULL)
+                    goto out_of_memory;
+                memcpy(basefilename, value, value_len);
+                basefilename[value_len] = '\0';
+                // Restore unusual characters that confuse parsing
+                path_unescape_path(basefilename);
+            }
             else if(arg_match("file", arg, arg_len)) {
                 rwfilename = malloc(value_len + 1);
                 if(rwfilename == NULL)
@@ -837,12 +1657,22 @@ void nand_add_dev(const char *arg)
             exit(1);
         }
         rwfilename = (char*) tempfile_path(tmp);
+        temporary = 1;
         if (VERBOSE_CHECK(init))
             dprint( "mapping '%.*s' NAND image to %s", devname_len, devname, rwfilename);
     }
 
     if(rwfilename) {
-        if (initfilename) {
+        if (basefilename) {
+            /* The file only holds the changes made to the base image */
+            if (read_only || initfilename) {
+                XLOG("incompatible %s option is requested with the %.*s base image %s\n",
+                     read_only ? "read only" : "initfile", devname_len, devname,
+                     basefilename);
+                exit(1);
+            }
+            rwfd = open(rwfilename, O_BINARY | O_RDWR | O_CREAT, 0666);
+        } else if (initfilename) {
             /* Overwrite with content of the 'initfilename'. */
             if (read_only) {
                 /* Cannot be readonly when initializing the device from another file. */
@@ -877,6 +1707,17 @@ void nand_add_dev(const char *arg)
         }
     }
 
+    if(basefilename) {
+        basefd = open(basefilename, O_BINARY | O_RDONLY);
+        if(basefd < 0) {
+            XLOG("could not open file %s, %s\n", basefilename, strerror(errno));
+            exit(1);
+        }
+        atexit_close_fd(basefd);
+        if(dev_size == 0)
+            dev_size = do_lseek(basefd, 0, SEEK_END);
+    }
+
     new_devs = realloc(nand_devs, sizeof(nand_devs[0]) * (nand_dev_count + 1));
     if(new_devs == NULL)
         goto out_of_memory;
@@ -901,24 +1742,69 @@ void nand_add_dev(const char *arg)
 #ifdef TARGET_I386
     dev->flags |= NAND_DEV_FLAG_BATCH_CAP;
 #endif
+    dev->flags |= NAND_DEV_FLAG_ASYNC_CAP;
+    dev->async_buffer = NULL;
 
     if (initfd >= 0) {
-        do {
-            read_size = do_read(initfd, dev->data, dev->erase_size);
-            if(read_size < 0) {
-                XLOG("could not read file %s, %s\n", initfilename, strerror(errno));
-                exit(1);
-            }
-            if(do_write(rwfd, dev->data, read_size) != read_size) {
-                XLOG("could not write file %s, %s\n", rwfilename, strerror(errno));
-                exit(1);
-            }
-        } while(read_size == dev->erase_size);
+        /* Clones or sparse copies, see path_copy_fd() */
+        if (path_copy_fd(rwfd, initfd) < 0) {
+            XLOG("could not copy file %s to %s, %s\n", initfilename,
+                 rwfilename, strerror(errno));
+            exit(1);
+        }
         close(initfd);
     }
     dev->fd = rwfd;
+    dev->map = NULL;
+    dev->map_size = 0;
+    dev->map_failed = 0;
+    dev->file_size = 0;
+
+    dev->block_count = dev->max_size / dev->erase_size;
+    if (nandBlockMap_init(&dev->erased, dev->block_count) < 0 ||
+        nandBlockMap_init(&dev->cow, dev->block_count) < 0) {
+        goto out_of_memory;
+    }
+    dev->base_fd = basefd;
+    dev->base_map = NULL;
+    dev->base_map_size = 0;
+    dev->base_size = 0;
+#ifdef _WIN32
+    /* FSCTL_SET_ZERO_DATA only releases storage in sparse files */
+    if (!read_only) {
+        DWORD returned;
+        DeviceIoControl((HANDLE)_get_osfhandle(rwfd), FSCTL_SET_SPARSE,
+                        NULL, 0, NULL, 0, &returned, NULL);
+    }
+#endif
+    reset = (initfilename != NULL);
+    if (basefd >= 0) {
+        off_t base_size = do_lseek(basefd, 0, SEEK_END);
+        dev->base_size = (base_size < 0) ? 0 : base_size;
+        nand_dev_map_base(dev);
+        /* The changes are only valid with the bitmap of copied blocks, and
+         * with the base they were made to, which is identified by its size,
+         * modification time and inode. */
+        if (temporary ||
+            !nandBlockMap_open(&dev->cow, NAND_BLOCK_MAP_COW, rwfilename,
+                               dev->erase_size,
+                               nandBlockMap_imageKey(basefilename), 0, 0)) {
+            do_ftruncate(rwfd, 0);
+            reset = 1;
+        }
+        /* Extending the file is cheap since it's sparse, and it avoids
+         * growing the mapping later */
+        if ((uint64_t)do_lseek(rwfd, 0, SEEK_END) < dev->max_size)
+            do_ftruncate(rwfd, dev->max_size);
+    }
+    /* Temporary images don't outlive the emulator, their bitmaps neither */
+    if (!temporary)
+        nandBlockMap_open(&dev->erased, NAND_BLOCK_MAP_ERASED, rwfilename,
+                          dev->erase_size, 0, reset, read_only);
+    nand_dev_map(dev);
 
-    nand_dev_count++;
+    if (nand_dev_count++ == 0)
+        atexit(nand_dev_close_all);
 
     return;
 
@@ -961,6 +1847,7 @@ parse_nand_limits(char*  limits)
 {
     int      pid = -1, signal = -1;
     int64_t  reads = 0, writes = 0;
+    uint64_t read_rate = 0, write_rate = 0;
     char*    item = limits;
 
     /* parse over comma-separated items */
@@ -1004,22 +1891,32 @@ parse_nand_limits(char*  limits)
         else if ( !memcmp(item, "writes=", 7) ) {
             writes = parse_nand_rw_limit(item+7);
         }
+        else if ( !memcmp(item, "read-rate=", 10) ) {
+            read_rate = parse_nand_rw_limit(item+10);
+        }
+        else if ( !memcmp(item, "write-rate=", 11) ) {
+            write_rate = parse_nand_rw_limit(item+11);
+        }
         else {
             derror( "bad parameter '%s' (see -help-nand-limits)", item );
             exit(1);
         }
         item = next;
     }
-    if (pid < 0) {
+    nand_set_rate_limits(read_rate, write_rate);
+
+    /* The signal target is only needed for thresholds. */
+    if (reads == 0 && writes == 0) {
+        if (read_rate == 0 && write_rate == 0)
+            dwarning( "no read or write limit specified. ignoring -nand-limits" );
+    }
+    else if (pid < 0) {
         derror( "bad paramater: missing pid=<number>" );
         exit(1);
     }
     else if (signal < 0) {
         derror( "bad parameter: missing signal=<number>" );
         exit(1);
-    }
-    else if (reads == 0 && writes == 0) {
-        dwarning( "no read or write limit specified. ignoring -nand-limits" );
     } else {
         nand_threshold*  t;
 
@@ -44,7 +44,12 @@ struct batch_data_64 {
 
 enum nand_dev_flags {
     NAND_DEV_FLAG_READ_ONLY = 0x00000001,
-    NAND_DEV_FLAG_BATCH_CAP = 0x00000002
+    NAND_DEV_FLAG_BATCH_CAP = 0x00000002,
+    NAND_DEV_FLAG_ASYNC_CAP = 0x00000004  // NAND_ASYNC_COMMAND and NAND_STATUS
+};
+
+enum nand_status {
+    NAND_STATUS_BUSY = 0x00000001  // A NAND_ASYNC_COMMAND is still running
 };
 
 #define NAND_VERSION_CURRENT (1)
@@ -73,6 +78,9 @@ enum nand_reg {
     NAND_ADDR_HIGH      = 0x054,
     NAND_BATCH_ADDR_LOW = 0x058,
     NAND_BATCH_ADDR_HIGH= 0x05c,
+    NAND_STATUS         = 0x060,  // Read-only, see nand_status
+    NAND_ASYNC_COMMAND  = 0x064,  // Like NAND_COMMAND, but doesn't wait for
+                                  // reads and writes to complete
 
     NAND_DATA_HIGH      = 0x100,  // For 64-bit guest CPUs.
 };
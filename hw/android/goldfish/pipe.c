@@ -14,8 +14,11 @@
 #include "hw/android/goldfish/pipe.h"
 #include "hw/android/goldfish/device.h"
 #include "hw/android/goldfish/vmem.h"
+#include "exec/hax.h"
 #include "exec/ram_addr.h"
+#include "qemu/queue.h"
 #include "qemu/timer.h"
+#include "android/utils/perf_counters.h"
 
 #define  DEBUG 0
 
@@ -51,6 +54,9 @@
 /* Set to 1 to enable the 'throttle' pipe type, useful for debugging */
 #define DEBUG_THROTTLE_PIPE 1
 
+/* Set to 1 to run a pipe command microbenchmark at startup */
+#define DEBUG_PIPE_BENCHMARK 0
+
 /* Maximum length of pipe service name, in characters (excluding final 0) */
 #define MAX_PIPE_SERVICE_NAME_SIZE  255
 
@@ -129,8 +135,9 @@ goldfish_pipe_find_type(const char*  pipeName)
 typedef struct PipeDevice  PipeDevice;
 
 typedef struct Pipe {
-    struct Pipe*              next;
-    struct Pipe*              next_waked;
+    QTAILQ_ENTRY(Pipe)         entry;
+    QTAILQ_ENTRY(Pipe)         waked_entry;
+    char                       waked;
     PipeDevice*                device;
     uint64_t                   channel;
     void*                      opaque;
@@ -162,63 +169,6 @@ pipe_new(uint64_t channel, PipeDevice* dev)
     return pipe;
 }
 
-static Pipe**
-pipe_list_findp_channel( Pipe** list, uint64_t channel )
-{
-    Pipe** pnode = list;
-    for (;;) {
-        Pipe* node = *pnode;
-        if (node == NULL || node->channel == channel) {
-            break;
-        }
-        pnode = &node->next;
-    }
-    return pnode;
-}
-
-#if 0
-static Pipe**
-pipe_list_findp_opaque( Pipe** list, void* opaque )
-{
-    Pipe** pnode = list;
-    for (;;) {
-        Pipe* node = *pnode;
-        if (node == NULL || node->opaque == opaque) {
-            break;
-        }
-        pnode = &node->next;
-    }
-    return pnode;
-}
-#endif
-
-static Pipe**
-pipe_list_findp_waked( Pipe** list, Pipe* pipe )
-{
-    Pipe** pnode = list;
-    for (;;) {
-        Pipe* node = *pnode;
-        if (node == NULL || node == pipe) {
-            break;
-        }
-        pnode = &node->next_waked;
-    }
-    return pnode;
-}
-
-
-static void
-pipe_list_remove_waked( Pipe** list, Pipe*  pipe )
-{
-    Pipe** lookup = pipe_list_findp_waked(list, pipe);
-    Pipe*  node   = *lookup;
-
-    if (node != NULL) {
-        (*lookup) = node->next_waked;
-        node->next_waked = NULL;
-    }
-}
-
 static void
 pipe_save( Pipe* pipe, QEMUFile* file )
 {
@@ -955,10 +905,13 @@ struct PipeDevice {
     struct goldfish_device dev;
 
     /* the list of all pipes */
-    Pipe*  pipes;
+    QTAILQ_HEAD(, Pipe)  pipes;
+
+    /* all pipes, indexed by channel */
+    GHashTable*  pipes_by_channel;
 
-    /* the list of signalled pipes */
-    Pipe*  signaled_pipes;
+    /* the queue of signalled pipes, in the order they were signalled */
+    QTAILQ_HEAD(, Pipe)  signaled_pipes;
 
     /* i/o registers */
     uint64_t  address;
@@ -969,12 +922,141 @@ struct PipeDevice {
     uint64_t  params_addr;
 };
 
+static void
+pipeDevice_init( PipeDevice* dev )
+{
+    QTAILQ_INIT(&dev->pipes);
+    QTAILQ_INIT(&dev->signaled_pipes);
+    /* Keys point to the channel of each pipe */
+    dev->pipes_by_channel = g_hash_table_new(g_int64_hash, g_int64_equal);
+}
+
+static Pipe*
+pipeDevice_findPipe( PipeDevice* dev, uint64_t channel )
+{
+    return g_hash_table_lookup(dev->pipes_by_channel, &channel);
+}
+
+static void
+pipeDevice_addPipe( PipeDevice* dev, Pipe* pipe )
+{
+    QTAILQ_INSERT_HEAD(&dev->pipes, pipe, entry);
+    g_hash_table_insert(dev->pipes_by_channel, &pipe->channel, pipe);
+}
+
+/* Add |pipe| at the end of the queue of signalled pipes, if not there yet */
+static void
+pipeDevice_signalPipe( PipeDevice* dev, Pipe* pipe )
+{
+    if (!pipe->waked) {
+        QTAILQ_INSERT_TAIL(&dev->signaled_pipes, pipe, waked_entry);
+        pipe->waked = 1;
+    }
+}
+
+static void
+pipeDevice_unsignalPipe( PipeDevice* dev, Pipe* pipe )
+{
+    if (pipe->waked) {
+        QTAILQ_REMOVE(&dev->signaled_pipes, pipe, waked_entry);
+        pipe->waked = 0;
+    }
+}
+
+static void
+pipeDevice_removePipe( PipeDevice* dev, Pipe* pipe )
+{
+    QTAILQ_REMOVE(&dev->pipes, pipe, entry);
+    g_hash_table_remove(dev->pipes_by_channel, &pipe->channel);
+    pipeDevice_unsignalPipe(dev, pipe);
+}
+
+/* Maximum number of guest pages transferred by a single command */
+#define PIPE_MAX_TRANSFER_PAGES  32
+
+/* Transfer the guest buffer of dev->size bytes at virtual address
+ * dev->address to or from |pipe|, and return the pipe's status.
+ *
+ * The buffer is handed to the pipe service in place, with one
+ * GoldfishPipeBuffer per guest page, which may span several pages.
+ * cpu_physical_memory_map() only provides a bounce buffer for a single
+ * page that isn't RAM, so the transfer is cut short at such a page if it
+ * isn't the first one, as well as after PIPE_MAX_TRANSFER_PAGES pages,
+ * and the guest sends the rest with another command.
+ */
+static int
+pipeDevice_transfer( PipeDevice* dev, Pipe* pipe, int isRead )
+{
+    GoldfishPipeBuffer  buffers[PIPE_MAX_TRANSFER_PAGES];
+    CPUState*           cpu     = ENV_GET_CPU(cpu_single_env);
+    target_ulong        address = dev->address;
+    uint32_t            size    = dev->size;
+    int                 count   = 0;
+    int                 status, nn;
+
+    while (size > 0 && count < PIPE_MAX_TRANSFER_PAGES) {
+        /* Translate virtual address into physical one, into emulator memory. */
+        target_ulong page = address & TARGET_PAGE_MASK;
+        hwaddr phys = safe_get_phys_page_debug(cpu, page);
+        if (phys == (hwaddr)-1) {
+            break;
+        }
+#ifdef TARGET_X86_64
+        phys = phys & TARGET_PTE_MASK;
+#endif
+        hwaddr len = TARGET_PAGE_SIZE - (address - page);
+        if (len > size) {
+            len = size;
+        }
+        hwaddr mapped = len;
+        void* data = cpu_physical_memory_map(phys + (address - page), &mapped,
+                                             isRead);
+        if (data == NULL) {
+            break;
+        }
+        buffers[count].data = data;
+        buffers[count].size = mapped;
+        count++;
+        if (mapped < len) {
+            break;
+        }
+        address += len;
+        size    -= len;
+    }
+
+    if (count == 0) {
+        return PIPE_ERROR_INVAL;
+    }
+
+    if (isRead) {
+        status = pipe->funcs->recvBuffers(pipe->opaque, buffers, count);
+    } else {
+        status = pipe->funcs->sendBuffers(pipe->opaque, buffers, count);
+    }
+
+    /* Unmapping marks the received pages dirty, or copies the bounce
+     * buffer back to guest memory. */
+    size_t done = (status > 0) ? (size_t)status : 0;
+    for (nn = 0; nn < count; nn++) {
+        size_t accessed = (done < buffers[nn].size) ? done : buffers[nn].size;
+        cpu_physical_memory_unmap(buffers[nn].data, buffers[nn].size,
+                                  isRead, accessed);
+        done -= accessed;
+    }
+    return status;
+}
+
+static PerfCounter pipe_commands_counter =
+        PERF_COUNTER_INIT("pipe.commands", "commands");
+static PerfCounter pipe_bytes_from_guest_counter =
+        PERF_COUNTER_INIT("pipe.bytes_from_guest", "bytes");
+static PerfCounter pipe_bytes_to_guest_counter =
+        PERF_COUNTER_INIT("pipe.bytes_to_guest", "bytes");
+
 static void
 pipeDevice_doCommand( PipeDevice* dev, uint32_t command )
 {
-    Pipe** lookup = pipe_list_findp_channel(&dev->pipes, dev->channel);
-    Pipe*  pipe   = *lookup;
-    CPUOldState* env = cpu_single_env;
+    Pipe*  pipe = pipeDevice_findPipe(dev, dev->channel);
 
     /* Check that we're referring a known pipe channel */
     if (command != PIPE_CMD_OPEN && pipe == NULL) {
@@ -988,6 +1070,8 @@ pipeDevice_doCommand( PipeDevice* dev, uint32_t command )
         return;
     }
 
+    perfCounter_add(&pipe_commands_counter, 1);
+
     switch (command) {
     case PIPE_CMD_OPEN:
         DD("%s: CMD_OPEN channel=0x%llx", __FUNCTION__, (unsigned long long)dev->channel);
@@ -996,17 +1080,14 @@ pipeDevice_doCommand( PipeDevice* dev, uint32_t command )
             break;
         }
         pipe = pipe_new(dev->channel, dev);
-        pipe->next = dev->pipes;
-        dev->pipes = pipe;
+        pipeDevice_addPipe(dev, pipe);
         dev->status = 0;
         break;
 
     case PIPE_CMD_CLOSE:
         DD("%s: CMD_CLOSE channel=0x%llx", __FUNCTION__, (unsigned long long)dev->channel);
         /* Remove from device's lists */
-        *lookup = pipe->next;
-        pipe->next = NULL;
-        pipe_list_remove_waked(&dev->signaled_pipes, pipe);
+        pipeDevice_removePipe(dev, pipe);
         pipe_free(pipe);
         break;
 
@@ -1015,43 +1096,23 @@ pipeDevice_doCommand( PipeDevice* dev, uint32_t command )
         DD("%s: CMD_POLL > status=%d", __FUNCTION__, dev->status);
         break;
 
-    case PIPE_CMD_READ_BUFFER: {
-        /* Translate virtual address into physical one, into emulator memory. */
-        GoldfishPipeBuffer  buffer;
-        target_ulong        address = dev->address;
-        target_ulong        page    = address & TARGET_PAGE_MASK;
-        hwaddr  phys;
-        phys = safe_get_phys_page_debug(ENV_GET_CPU(env), page);
-#ifdef TARGET_X86_64
-        phys = phys & TARGET_PTE_MASK;
-#endif
-        buffer.data = qemu_get_ram_ptr(phys) + (address - page);
-        buffer.size = dev->size;
-        dev->status = pipe->funcs->recvBuffers(pipe->opaque, &buffer, 1);
+    case PIPE_CMD_READ_BUFFER:
+        dev->status = pipeDevice_transfer(dev, pipe, 1);
+        if ((int)dev->status > 0)
+            perfCounter_add(&pipe_bytes_to_guest_counter, dev->status);
         DD("%s: CMD_READ_BUFFER channel=0x%llx address=0x%16llx size=%d > status=%d",
            __FUNCTION__, (unsigned long long)dev->channel, (unsigned long long)dev->address,
            dev->size, dev->status);
         break;
-    }
 
-    case PIPE_CMD_WRITE_BUFFER: {
-        /* Translate virtual address into physical one, into emulator memory. */
-        GoldfishPipeBuffer  buffer;
-        target_ulong        address = dev->address;
-        target_ulong        page    = address & TARGET_PAGE_MASK;
-        hwaddr  phys;
-        phys = safe_get_phys_page_debug(ENV_GET_CPU(env), page);
-#ifdef TARGET_X86_64
-        phys = phys & TARGET_PTE_MASK;
-#endif
-        buffer.data = qemu_get_ram_ptr(phys) + (address - page);
-        buffer.size = dev->size;
-        dev->status = pipe->funcs->sendBuffers(pipe->opaque, &buffer, 1);
+    case PIPE_CMD_WRITE_BUFFER:
+        dev->status = pipeDevice_transfer(dev, pipe, 0);
+        if ((int)dev->status > 0)
+            perfCounter_add(&pipe_bytes_from_guest_counter, dev->status);
         DD("%s: CMD_WRITE_BUFFER channel=0x%llx address=0x%16llx size=%d > status=%d",
            __FUNCTION__, (unsigned long long)dev->channel, (unsigned long long)dev->address,
            dev->size, dev->status);
         break;
-    }
 
     case PIPE_CMD_WAKE_ON_READ:
         DD("%s: CMD_WAKE_ON_READ channel=0x%llx", __FUNCTION__, (unsigned long long)dev->channel);
@@ -1076,6 +1137,48 @@ pipeDevice_doCommand( PipeDevice* dev, uint32_t command )
     }
 }
 
+/* Process the |count| transfer descriptors that the guest stored at
+ * dev->params_addr, see PipeBatchDescriptor. This sets dev->status to the
+ * number of processed descriptors.
+ */
+static void
+pipeDevice_doBatch( PipeDevice* dev, uint32_t count )
+{
+    PipeBatchDescriptor desc;
+    hwaddr addr = dev->params_addr;
+    uint32_t nn;
+
+    if (addr == 0 || count > PIPE_BATCH_MAX_DESCRIPTORS) {
+        dev->status = PIPE_ERROR_INVAL;
+        return;
+    }
+
+    for (nn = 0; nn < count; nn++, addr += sizeof(desc)) {
+        cpu_physical_memory_read(addr, (void*)&desc, sizeof(desc));
+
+        if (desc.cmd == PIPE_CMD_READ_BUFFER ||
+            desc.cmd == PIPE_CMD_WRITE_BUFFER) {
+            dev->channel = desc.channel;
+            dev->address = desc.address;
+            dev->size    = desc.size;
+            pipeDevice_doCommand(dev, desc.cmd);
+            desc.status = (int32_t)dev->status;
+        } else {
+            desc.status = PIPE_ERROR_INVAL;
+        }
+
+        cpu_physical_memory_write(addr + offsetof(PipeBatchDescriptor, status),
+                                  (void*)&desc.status, sizeof(desc.status));
+
+        if (desc.status != (int32_t)desc.size) {
+            nn++;
+            break;
+        }
+    }
+    DD("%s: processed %d/%d descriptors", __FUNCTION__, nn, count);
+    dev->status = nn;
+}
+
 static void pipe_dev_write(void *opaque, hwaddr offset, uint32_t value)
 {
     PipeDevice *s = (PipeDevice *)opaque;
@@ -1165,6 +1268,11 @@ static void pipe_dev_write(void *opaque, hwaddr offset, uint32_t value)
     }
     break;
 
+    case PIPE_REG_ACCESS_BATCH:
+        DR("%s: access_batch=%d", __FUNCTION__, value);
+        pipeDevice_doBatch(s, value);
+        break;
+
     default:
         D("%s: offset=%d (0x%x) value=%d (0x%x)\n", __FUNCTION__, offset,
             offset, value, value);
@@ -1183,15 +1291,14 @@ static uint32_t pipe_dev_read(void *opaque, hwaddr offset)
         return dev->status;
 
     case PIPE_REG_CHANNEL:
-        if (dev->signaled_pipes != NULL) {
-            Pipe* pipe = dev->signaled_pipes;
+        if (!QTAILQ_EMPTY(&dev->signaled_pipes)) {
+            Pipe* pipe = QTAILQ_FIRST(&dev->signaled_pipes);
             DR("%s: channel=0x%llx wanted=%d", __FUNCTION__,
                (unsigned long long)pipe->channel, pipe->wanted);
             dev->wakes = pipe->wanted;
             pipe->wanted = 0;
-            dev->signaled_pipes = pipe->next_waked;
-            pipe->next_waked = NULL;
-            if (dev->signaled_pipes == NULL) {
+            pipeDevice_unsignalPipe(dev, pipe);
+            if (QTAILQ_EMPTY(&dev->signaled_pipes)) {
                 goldfish_device_set_irq(&dev->dev, 0, 0);
                 DD("%s: lowering IRQ", __FUNCTION__);
             }
@@ -1201,8 +1308,8 @@ static uint32_t pipe_dev_read(void *opaque, hwaddr offset)
         return 0;
 
     case PIPE_REG_CHANNEL_HIGH:
-        if (dev->signaled_pipes != NULL) {
-            Pipe* pipe = dev->signaled_pipes;
+        if (!QTAILQ_EMPTY(&dev->signaled_pipes)) {
+            Pipe* pipe = QTAILQ_FIRST(&dev->signaled_pipes);
             DR("%s: channel_high=0x%llx wanted=%d", __FUNCTION__,
                (unsigned long long)pipe->channel, pipe->wanted);
             return (uint32_t)(pipe->channel >> 32);
@@ -1220,6 +1327,9 @@ static uint32_t pipe_dev_read(void *opaque, hwaddr offset)
     case PIPE_REG_PARAMS_ADDR_LOW:
         return (uint32_t)(dev->params_addr & 0xFFFFFFFFUL);
 
+    case PIPE_REG_FEATURES:
+        return PIPE_FEATURE_BATCH;
+
     default:
         D("%s: offset=%d (0x%x)\n", __FUNCTION__, offset, offset);
     }
@@ -1253,13 +1363,13 @@ goldfish_pipe_save( QEMUFile* file, void* opaque )
 
     /* Count the number of pipe connections */
     int count = 0;
-    for ( pipe = dev->pipes; pipe; pipe = pipe->next )
+    QTAILQ_FOREACH(pipe, &dev->pipes, entry)
         count++;
 
     qemu_put_sbe32(file, count);
 
     /* Now save each pipe one after the other */
-    for ( pipe = dev->pipes; pipe; pipe = pipe->next ) {
+    QTAILQ_FOREACH(pipe, &dev->pipes, entry) {
         pipe_save(pipe, file);
     }
 }
@@ -1298,12 +1408,11 @@ goldfish_pipe_load( QEMUFile* file, void* opaque, int version_id )
         if (pipe == NULL) {
             return -EIO;
         }
-        pipe->next = dev->pipes;
-        dev->pipes = pipe;
+        pipeDevice_addPipe(dev, pipe);
     }
 
     /* Now we need to wake/close all relevant pipes */
-    for ( pipe = dev->pipes; pipe; pipe = pipe->next ) {
+    QTAILQ_FOREACH(pipe, &dev->pipes, entry) {
         if (pipe->wanted != 0)
             goldfish_pipe_wake(pipe, pipe->wanted);
         if (pipe->closed != 0)
@@ -1312,12 +1421,75 @@ goldfish_pipe_load( QEMUFile* file, void* opaque, int version_id )
     return 0;
 }
 
+#if DEBUG_PIPE_BENCHMARK
+
+/* Measure the host cost of the pipe commands that don't access guest
+ * memory, on a scratch device with an increasing number of open pipes.
+ * Channels are spaced like the kernel addresses the guest driver uses.
+ */
+static void
+pipeDevice_benchmark(void)
+{
+    static const int kPipeCounts[] = { 4, 32, 256, 2048 };
+    const int kIterations = 1000000;
+    PipeDevice* dev;
+    int nn, count, ii, wakes;
+
+    for (nn = 0; nn < (int)(sizeof(kPipeCounts)/sizeof(kPipeCounts[0])); nn++) {
+        count = kPipeCounts[nn];
+        dev = (PipeDevice *) g_malloc0(sizeof(*dev));
+        pipeDevice_init(dev);
+
+        for (ii = 0; ii < count; ii++) {
+            dev->channel = 0xffff880000000000ULL + (uint64_t)ii * 128;
+            pipeDevice_doCommand(dev, PIPE_CMD_OPEN);
+        }
+
+        /* Poll the pipes in turn */
+        int64_t start = get_clock();
+        for (ii = 0; ii < kIterations; ii++) {
+            dev->channel = 0xffff880000000000ULL + (uint64_t)(ii % count) * 128;
+            pipeDevice_doCommand(dev, PIPE_CMD_POLL);
+        }
+        int64_t pollNs = get_clock() - start;
+
+        /* Signal all pipes, then dequeue them like the guest driver does */
+        start = get_clock();
+        wakes = 0;
+        while (wakes < kIterations) {
+            Pipe* pipe;
+            QTAILQ_FOREACH(pipe, &dev->pipes, entry) {
+                pipeDevice_signalPipe(dev, pipe);
+                wakes++;
+            }
+            while (!QTAILQ_EMPTY(&dev->signaled_pipes)) {
+                pipeDevice_unsignalPipe(dev, QTAILQ_FIRST(&dev->signaled_pipes));
+            }
+        }
+        int64_t wakeNs = get_clock() - start;
+
+        fprintf(stderr, "pipe benchmark: %5d pipes: poll %.1f ns/cmd, "
+                "wake %.1f ns/pipe\n", count,
+                (double)pollNs / kIterations, (double)wakeNs / wakes);
+
+        for (ii = 0; ii < count; ii++) {
+            dev->channel = 0xffff880000000000ULL + (uint64_t)ii * 128;
+            pipeDevice_doCommand(dev, PIPE_CMD_CLOSE);
+        }
+        g_hash_table_destroy(dev->pipes_by_channel);
+        g_free(dev);
+    }
+}
+
+#endif /* DEBUG_PIPE_BENCHMARK */
+
 /* initialize the trace device */
 void pipe_dev_init(bool newDeviceNaming)
 {
     PipeDevice *s;
 
     s = (PipeDevice *) g_malloc0(sizeof(*s));
+    pipeDevice_init(s);
 
     s->dev.name = newDeviceNaming ? "goldfish_pipe" : "qemu_pipe";
     s->dev.id = -1;
@@ -1327,6 +1499,19 @@ void pipe_dev_init(bool newDeviceNaming)
     s->dev.irq_count = 1;
 
     goldfish_device_add(&s->dev, pipe_dev_readfn, pipe_dev_writefn, s);
+    /* only PIPE_REG_COMMAND, PIPE_REG_ACCESS_PARAMS and
+     * PIPE_REG_ACCESS_BATCH writes need to trap */
+    goldfish_device_coalesce_mmio(&s->dev, PIPE_REG_CHANNEL,
+                                  PIPE_REG_ACCESS_PARAMS - PIPE_REG_CHANNEL);
+    goldfish_device_coalesce_mmio(&s->dev, PIPE_REG_CHANNEL_HIGH,
+                                  PIPE_REG_ADDRESS_HIGH + 4 -
+                                  PIPE_REG_CHANNEL_HIGH);
+#ifdef CONFIG_HAX
+    /* the pipe gets most of the MMIO exits under HAXM, with GL */
+    if (hax_enabled())
+        hax_register_fast_mmio(s->dev.base, s->dev.size,
+                               pipe_dev_readfn, pipe_dev_writefn, s);
+#endif
 
     register_savevm(NULL,
                     "goldfish_pipe",
@@ -1345,23 +1530,21 @@ void pipe_dev_init(bool newDeviceNaming)
 #if DEBUG_THROTTLE_PIPE
     goldfish_pipe_add_type("throttle", NULL, &throttlePipe_funcs);
 #endif
+#if DEBUG_PIPE_BENCHMARK
+    pipeDevice_benchmark();
+#endif
 }
 
 void
 goldfish_pipe_wake( void* hwpipe, unsigned flags )
 {
     Pipe*  pipe = hwpipe;
-    Pipe** lookup;
     PipeDevice*  dev = pipe->device;
 
     DD("%s: channel=0x%llx flags=%d", __FUNCTION__, (unsigned long long)pipe->channel, flags);
 
     /* If not already there, add to the list of signaled pipes */
-    lookup = pipe_list_findp_waked(&dev->signaled_pipes, pipe);
-    if (!*lookup) {
-        pipe->next_waked = dev->signaled_pipes;
-        dev->signaled_pipes = pipe;
-    }
+    pipeDevice_signalPipe(dev, pipe);
     pipe->wanted |= (unsigned)flags;
 
     /* Raise IRQ to indicate there are items on our list ! */
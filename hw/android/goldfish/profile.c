@@ -13,6 +13,7 @@
 #include "hw/android/goldfish/profile.h"
 #include "exec/code-profile.h"
 #include "cpu.h"
+#include "qemu/timer.h"
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -22,41 +23,108 @@
 #define SAMPLE_BURST 100
 #define OUTPUT_THRESHOLD 100
 
+/* A mapping of a binary in the address space of a process. */
 typedef struct MmapData {
   target_ulong start;
   target_ulong end;
   target_ulong offset;
   char *name;
-  struct MmapData *next;
+  /* The profile of the binary, resolved on first use. */
+  struct BinaryProfile *profile;
 } MmapData;
 
-typedef struct RangeProfile {
-  uint64_t start;
-  uint64_t size;
-  uint64_t count;
-  struct RangeProfile *next;
-} RangeProfile;
+/* The mappings of a process, sorted by address. They never overlap, a new
+   mapping replaces the parts of the older ones that it covers. */
+typedef struct MmapTable {
+  MmapData *entries;
+  int count;
+} MmapTable;
 
-typedef struct BranchProfile {
-  uint64_t from;
-  uint64_t to;
+/* A count for a pair of addresses, which is a range as (start, size), or a
+   branch as (from, to). */
+typedef struct CountEntry {
+  uint64_t a;
+  uint64_t b;
   uint64_t count;
-  struct BranchProfile *next;
-} BranchProfile;
+} CountEntry;
+
+/* An open addressing hash table of counts. Unused entries have a zero
+   count, and the capacity is a power of 2. */
+typedef struct CountTable {
+  CountEntry *entries;
+  uint32_t size;
+  uint32_t capacity;
+} CountTable;
 
 typedef struct BinaryProfile {
   char *name;
-  RangeProfile *range;
-  BranchProfile *branch;
+  CountTable ranges;
+  CountTable branches;
   struct BinaryProfile *next;
 } BinaryProfile;
 
 extern unsigned get_current_pid();
 
-static MmapData *mmaps[65536];
+static MmapTable *mmaps[65536];
 static BinaryProfile *head_binary = NULL;
 
+/* The mapping of the bbs of the current burst of samples, NULL between
+   bursts, or when the mappings changed since the start of the burst. */
+static const MmapData *sample_mmap;
+
 #define BUF_SIZE 4096
+#define COUNT_TABLE_MIN_CAPACITY 256
+
+static uint32_t count_table_hash(uint64_t a, uint64_t b) {
+  uint64_t h = (a ^ (b * 0x9e3779b97f4a7c15ULL)) * 0xff51afd7ed558ccdULL;
+  return (uint32_t)(h ^ (h >> 32));
+}
+
+static void count_table_grow(CountTable *table);
+
+static void count_table_add(CountTable *table, uint64_t a, uint64_t b) {
+  uint32_t mask, n;
+
+  if (2 * (table->size + 1) > table->capacity) {
+    count_table_grow(table);
+  }
+  mask = table->capacity - 1;
+  for (n = count_table_hash(a, b) & mask;; n = (n + 1) & mask) {
+    CountEntry *entry = &table->entries[n];
+    if (entry->count == 0) {
+      entry->a = a;
+      entry->b = b;
+      entry->count = 1;
+      table->size++;
+      return;
+    }
+    if (entry->a == a && entry->b == b) {
+      entry->count++;
+      return;
+    }
+  }
+}
+
+static void count_table_grow(CountTable *table) {
+  CountEntry *old = table->entries;
+  uint32_t old_capacity = table->capacity;
+  uint32_t mask, n;
+
+  table->capacity = old_capacity ? 2 * old_capacity : COUNT_TABLE_MIN_CAPACITY;
+  table->entries = (CountEntry *)calloc(table->capacity, sizeof(CountEntry));
+  mask = table->capacity - 1;
+  for (n = 0; n < old_capacity; n++) {
+    uint32_t pos;
+    if (old[n].count == 0)
+      continue;
+    pos = count_table_hash(old[n].a, old[n].b) & mask;
+    while (table->entries[pos].count != 0) {
+      pos = (pos + 1) & mask;
+    }
+    table->entries[pos] = old[n];
+  }
+  free(old);
+}
 
 static void dump_profile() {
   BinaryProfile *curr = head_binary;
@@ -69,6 +137,7 @@ static void dump_profile() {
 
   while (curr) {
     char *i;
+    uint32_t n;
 
     assert(len + strlen(curr->name) + 2 < BUF_SIZE);
     strcpy(filename + len + 1, curr->name);
@@ -83,41 +152,34 @@ static void dump_profile() {
     *(i + 4) = 0;
     FILE *f = fopen(filename, "w");
 
-    RangeProfile *r = curr->range;
-    int range_size = 0;
-    while (r) {
-      range_size++;
-      r = r->next;
-    }
-    fprintf(f, "%d\n", range_size);
-    r = curr->range;
-    while (r) {
-      fprintf(f, "%llx-%llx:%llu\n", (unsigned long long)r->start,
-              (unsigned long long)(r->start + r->size),
+    const CountTable *ranges = &curr->ranges;
+    fprintf(f, "%d\n", (int)ranges->size);
+    for (n = 0; n < ranges->capacity; n++) {
+      const CountEntry *r = &ranges->entries[n];
+      if (r->count == 0)
+        continue;
+      fprintf(f, "%llx-%llx:%llu\n", (unsigned long long)r->a,
+              (unsigned long long)(r->a + r->b),
               (unsigned long long)r->count);
-      r = r->next;
     }
 
-    fprintf(f, "%d\n", range_size);
-    r = curr->range;
-    while (r) {
-      fprintf(f, "%llx:%llu\n", (unsigned long long)r->start,
+    fprintf(f, "%d\n", (int)ranges->size);
+    for (n = 0; n < ranges->capacity; n++) {
+      const CountEntry *r = &ranges->entries[n];
+      if (r->count == 0)
+        continue;
+      fprintf(f, "%llx:%llu\n", (unsigned long long)r->a,
               (unsigned long long)r->count);
-      r = r->next;
     }
 
-    BranchProfile *b = curr->branch;
-    int branch_size = 0;
-    while (b) {
-      branch_size++;
-      b = b->next;
-    }
-    fprintf(f, "%d\n", branch_size);
-    b = curr->branch;
-    while (b) {
-      fprintf(f, "%llx->%llx:%llu\n", (unsigned long long)b->from,
-              (unsigned long long)b->to, (unsigned long long)b->count);
-      b = b->next;
+    const CountTable *branches = &curr->branches;
+    fprintf(f, "%d\n", (int)branches->size);
+    for (n = 0; n < branches->capacity; n++) {
+      const CountEntry *b = &branches->entries[n];
+      if (b->count == 0)
+        continue;
+      fprintf(f, "%llx->%llx:%llu\n", (unsigned long long)b->a,
+              (unsigned long long)b->b, (unsigned long long)b->count);
     }
     fclose(f);
     curr = curr->next;
@@ -132,89 +194,137 @@ static BinaryProfile *get_binary_profile(const char *name) {
     }
     curr = curr->next;
   }
-  curr = (BinaryProfile *)malloc(sizeof(BinaryProfile));
+  curr = (BinaryProfile *)calloc(1, sizeof(BinaryProfile));
   curr->name = strdup(name);
-  curr->range = NULL;
-  curr->branch = NULL;
   curr->next = head_binary;
   head_binary = curr;
   return curr;
 }
 
-static void add_branch_count(BinaryProfile *profile, target_ulong from,
-                             target_ulong to) {
-  BranchProfile *curr = profile->branch;
-  while (curr) {
-    if (curr->from == from && curr->to == to) {
-      curr->count++;
-      return;
-    }
-    curr = curr->next;
+static MmapData *get_mmap_data(target_ulong pc, int pid) {
+  const MmapTable *table = mmaps[pid];
+  int lo, hi;
+  if (table == NULL) {
+    return NULL;
   }
-  BranchProfile *b = (BranchProfile *)malloc(sizeof(BranchProfile));
-  b->from = from;
-  b->to = to;
-  b->count = 1;
-  b->next = profile->branch;
-  profile->branch = b;
-}
-
-static void add_range_count(BinaryProfile *profile, target_ulong start,
-                            target_ulong size) {
-  RangeProfile *curr = profile->range;
-  while (curr) {
-    if (curr->start == start && curr->size == size) {
-      curr->count++;
-      return;
+  /* Find the last mapping that starts at or before pc. */
+  lo = 0;
+  hi = table->count;
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (table->entries[mid].start <= pc) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
     }
-    curr = curr->next;
   }
-  RangeProfile *r = (RangeProfile *)malloc(sizeof(RangeProfile));
-  r->start = start;
-  r->size = size;
-  r->count = 1;
-  r->next = profile->range;
-  profile->range = r;
-}
-
-static const MmapData *get_mmap_data(target_ulong pc, int pid) {
-  const MmapData *data = mmaps[pid];
-  while (data) {
-    if (pc >= data->start && pc < data->end) {
-      return data;
-    }
-    data = data->next;
+  if (lo > 0 && pc < table->entries[lo - 1].end) {
+    return &table->entries[lo - 1];
   }
   return NULL;
 }
 
 void record_mmap(target_ulong vstart, target_ulong vend, target_ulong offset,
                  const char *path, unsigned pid) {
-  MmapData *data = (MmapData *)malloc(sizeof(MmapData));
-  data->start = vstart;
-  data->end = vend;
-  data->offset = offset;
-  data->name = strdup(path);
-  data->next = mmaps[pid];
-  mmaps[pid] = data;
+  MmapTable *table = mmaps[pid];
+  MmapData *entries;
+  int count = 0;
+  int added = 0;
+  int n;
+
+  if (vend <= vstart) {
+    return;
+  }
+  sample_mmap = NULL;
+  if (table == NULL) {
+    table = (MmapTable *)calloc(1, sizeof(MmapTable));
+    mmaps[pid] = table;
+  }
+
+  /* Rebuild the table, mmap calls are rare enough. An older mapping that
+     overlaps the new one is split into the pieces that remain visible on
+     each side, at most one new entry. */
+  entries = (MmapData *)malloc((table->count + 2) * sizeof(MmapData));
+  for (n = 0; n < table->count; n++) {
+    MmapData *old = &table->entries[n];
+    if (old->end <= vstart || old->start >= vend) {
+      if (!added && old->start >= vend) {
+        entries[count].start = vstart;
+        entries[count].end = vend;
+        entries[count].offset = offset;
+        entries[count].name = strdup(path);
+        entries[count].profile = NULL;
+        count++;
+        added = 1;
+      }
+      entries[count++] = *old;
+      continue;
+    }
+    int keep_left = old->start < vstart;
+    int keep_right = old->end > vend;
+    if (keep_left) {
+      entries[count] = *old;
+      entries[count].end = vstart;
+      count++;
+    }
+    if (!added) {
+      entries[count].start = vstart;
+      entries[count].end = vend;
+      entries[count].offset = offset;
+      entries[count].name = strdup(path);
+      entries[count].profile = NULL;
+      count++;
+      added = 1;
+    }
+    if (keep_right) {
+      entries[count] = *old;
+      entries[count].start = vend;
+      entries[count].offset = old->offset + (vend - old->start);
+      if (keep_left) {
+        entries[count].name = strdup(old->name);
+      }
+      count++;
+    }
+    if (!keep_left && !keep_right) {
+      free(old->name);
+    }
+  }
+  if (!added) {
+    entries[count].start = vstart;
+    entries[count].end = vend;
+    entries[count].offset = offset;
+    entries[count].name = strdup(path);
+    entries[count].profile = NULL;
+    count++;
+  }
+  free(table->entries);
+  table->entries = entries;
+  table->count = count;
 }
 
+static void sampler_release_process(unsigned pid);
+
 void release_mmap(unsigned pid) {
-  MmapData *curr = mmaps[pid];
-  while (curr) {
-    MmapData *next = curr->next;
-    free(curr->name);
-    free(curr);
-    curr = next;
+  MmapTable *table = mmaps[pid];
+  int n;
+  /* Write the samples of the process while its mappings are known. */
+  sampler_release_process(pid);
+  if (table == NULL) {
+    return;
   }
-  mmaps[pid] = 0;
+  sample_mmap = NULL;
+  for (n = 0; n < table->count; n++) {
+    free(table->entries[n].name);
+  }
+  free(table->entries);
+  free(table);
+  mmaps[pid] = NULL;
 }
 
 void profile_bb_helper(target_ulong pc, uint32_t size) {
   static int bb_counter = 0;
   static int output_counter = 0;
   static int prev_pid;
-  static const MmapData *prev_mmap;
   static target_ulong prev_pc;
   static BinaryProfile *curr_profile;
   if (code_profile_dirname == NULL)
@@ -227,33 +337,223 @@ void profile_bb_helper(target_ulong pc, uint32_t size) {
      range of [pc, pc+size] all belong to the current bb.  */
   size--;
   if (bb_counter++ == SAMPLE_PERIOD) {
+    MmapData *data;
     prev_pid = get_current_pid();
-    prev_mmap = get_mmap_data(pc, prev_pid);
-    if (prev_mmap == NULL) {
+    data = get_mmap_data(pc, prev_pid);
+    if (data == NULL) {
       bb_counter = 0;
       return;
     }
     prev_pc = pc + size;
-    curr_profile = get_binary_profile(prev_mmap->name);
+    if (data->profile == NULL) {
+      data->profile = get_binary_profile(data->name);
+    }
+    curr_profile = data->profile;
+    sample_mmap = data;
 
     if (output_counter++ == OUTPUT_THRESHOLD) {
       dump_profile();
       output_counter = 0;
     }
   } else if (bb_counter > SAMPLE_PERIOD) {
-    if (bb_counter > SAMPLE_PERIOD + SAMPLE_BURST ||
+    /* A burst only follows a single mapping of a single process, so
+       checking the bounds of that mapping replaces the table lookup. */
+    const MmapData *data = sample_mmap;
+    if (bb_counter > SAMPLE_PERIOD + SAMPLE_BURST || data == NULL ||
+        pc < data->start || pc >= data->end ||
         get_current_pid() != prev_pid) {
       bb_counter = 0;
+      sample_mmap = NULL;
       return;
     }
-    const MmapData *data = get_mmap_data(pc, prev_pid);
-    if (data != prev_mmap) {
-      bb_counter = 0;
+    count_table_add(&curr_profile->ranges,
+                    pc + data->offset - data->start, size);
+    count_table_add(&curr_profile->branches,
+                    prev_pc + data->offset - data->start,
+                    pc + data->offset - data->start);
+    prev_pc = pc + size;
+  }
+}
+
+/* The statistical profiler samples the pc of the current process from a
+   timer, instead of instrumenting every bb. The samples are buffered, then
+   counted per process and written as CPU profiles in the legacy format of
+   gperftools, followed by the mappings of the process, which pprof uses
+   to symbolize the samples offline. */
+
+#define SAMPLER_BUFFER_SIZE 4096
+#define SAMPLER_FLUSH_SECONDS 10
+
+typedef struct PcSample {
+  unsigned pid;
+  target_ulong pc;
+} PcSample;
+
+typedef struct ProcessSamples {
+  unsigned pid;
+  /* Distinguishes processes that reused the same pid. */
+  unsigned generation;
+  /* Sample counts, keyed by (pc, 0). */
+  CountTable pcs;
+  struct ProcessSamples *next;
+} ProcessSamples;
+
+static struct {
+  QEMUTimer *timer;
+  int64_t period_ns;
+  int flush_ticks;
+  int ticks;
+  unsigned generation;
+  int count;
+  PcSample buffer[SAMPLER_BUFFER_SIZE];
+  ProcessSamples *processes;
+} sampler;
+
+static ProcessSamples *sampler_get_process(unsigned pid) {
+  ProcessSamples *curr;
+  for (curr = sampler.processes; curr; curr = curr->next) {
+    if (curr->pid == pid) {
+      return curr;
+    }
+  }
+  curr = (ProcessSamples *)calloc(1, sizeof(ProcessSamples));
+  curr->pid = pid;
+  curr->generation = sampler.generation++;
+  curr->next = sampler.processes;
+  sampler.processes = curr;
+  return curr;
+}
+
+/* Count the buffered samples. */
+static void sampler_drain(void) {
+  ProcessSamples *process = NULL;
+  int n;
+  for (n = 0; n < sampler.count; n++) {
+    const PcSample *sample = &sampler.buffer[n];
+    if (process == NULL || process->pid != sample->pid) {
+      process = sampler_get_process(sample->pid);
+    }
+    count_table_add(&process->pcs, sample->pc, 0);
+  }
+  sampler.count = 0;
+}
+
+static void sampler_write_word(FILE *f, uint64_t word) {
+  fwrite(&word, sizeof(word), 1, f);
+}
+
+static void sampler_write_process(const ProcessSamples *process) {
+  const MmapTable *table = mmaps[process->pid];
+  char filename[BUF_SIZE];
+  uint32_t n;
+  int i;
+  FILE *f;
+
+  if (process->pcs.size == 0) {
+    return;
+  }
+  snprintf(filename, sizeof(filename), "%s/samples-%u-%u.prof",
+           code_profile_dirname, process->pid, process->generation);
+  f = fopen(filename, "wb");
+  if (f == NULL) {
+    return;
+  }
+  /* Header: header size in words, version, and sampling period in us. */
+  sampler_write_word(f, 0);
+  sampler_write_word(f, 3);
+  sampler_write_word(f, 0);
+  sampler_write_word(f, sampler.period_ns / 1000);
+  sampler_write_word(f, 0);
+  /* Each record is a count, then a stack of a single pc. */
+  for (n = 0; n < process->pcs.capacity; n++) {
+    const CountEntry *entry = &process->pcs.entries[n];
+    if (entry->count == 0)
+      continue;
+    sampler_write_word(f, entry->count);
+    sampler_write_word(f, 1);
+    sampler_write_word(f, entry->a);
+  }
+  /* Trailer. */
+  sampler_write_word(f, 0);
+  sampler_write_word(f, 1);
+  sampler_write_word(f, 0);
+  /* The mappings, in the format of /proc/<pid>/maps. */
+  for (i = 0; table && i < table->count; i++) {
+    const MmapData *data = &table->entries[i];
+    fprintf(f, "%08llx-%08llx r-xp %08llx 00:00 0 %s\n",
+            (unsigned long long)data->start, (unsigned long long)data->end,
+            (unsigned long long)data->offset, data->name);
+  }
+  fclose(f);
+}
+
+static void sampler_flush(void) {
+  const ProcessSamples *curr;
+  sampler_drain();
+  for (curr = sampler.processes; curr; curr = curr->next) {
+    sampler_write_process(curr);
+  }
+}
+
+static void sampler_release_process(unsigned pid) {
+  ProcessSamples **link;
+  if (sampler.timer == NULL) {
+    return;
+  }
+  sampler_drain();
+  for (link = &sampler.processes; *link; link = &(*link)->next) {
+    ProcessSamples *process = *link;
+    if (process->pid == pid) {
+      sampler_write_process(process);
+      *link = process->next;
+      free(process->pcs.entries);
+      free(process);
       return;
     }
-    add_range_count(curr_profile, pc + data->offset - data->start, size);
-    add_branch_count(curr_profile, prev_pc + data->offset - data->start,
-                     pc + data->offset - data->start);
-    prev_pc = pc + size;
   }
 }
+
+static void sampler_tick(void *opaque) {
+  CPUState *cpu = first_cpu;
+  int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+
+  timer_mod(sampler.timer, now + sampler.period_ns);
+
+  /* Guest state is synchronized between bbs, when timers run. Idle time
+     isn't attributed to any process. */
+  if (cpu != NULL && !cpu->halted) {
+    CPUArchState *env = (CPUArchState *)cpu->env_ptr;
+    target_ulong pc, cs_base;
+    int flags;
+    PcSample *sample;
+
+    cpu_get_tb_cpu_state(env, &pc, &cs_base, &flags);
+    if (sampler.count == SAMPLER_BUFFER_SIZE) {
+      sampler_drain();
+    }
+    sample = &sampler.buffer[sampler.count++];
+    sample->pid = get_current_pid();
+    sample->pc = pc;
+  }
+
+  if (++sampler.ticks >= sampler.flush_ticks) {
+    sampler.ticks = 0;
+    sampler_flush();
+  }
+}
+
+static void sampler_at_exit(void) {
+  sampler_flush();
+}
+
+void profile_sampler_start(int rate) {
+  if (sampler.timer != NULL || rate <= 0) {
+    return;
+  }
+  sampler.period_ns = 1000000000LL / rate;
+  sampler.flush_ticks = rate * SAMPLER_FLUSH_SECONDS;
+  sampler.timer = timer_new(QEMU_CLOCK_VIRTUAL, SCALE_NS, sampler_tick, NULL);
+  timer_mod(sampler.timer,
+            qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + sampler.period_ns);
+  atexit(sampler_at_exit);
+}
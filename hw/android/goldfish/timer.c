@@ -246,6 +246,8 @@ void goldfish_timer_and_rtc_init(uint32_t timerbase, int timerirq)
     timer_state.dev.irq = timerirq;
     timer_state.timer = timer_new(QEMU_CLOCK_VIRTUAL, SCALE_NS, goldfish_timer_tick, &timer_state);
     goldfish_device_add(&timer_state.dev, goldfish_timer_readfn, goldfish_timer_writefn, &timer_state);
+    /* the alarm is armed by the TIMER_ALARM_LOW write */
+    goldfish_device_coalesce_mmio(&timer_state.dev, TIMER_ALARM_HIGH, 4);
     register_savevm(NULL,
                     "goldfish_timer",
                     0,
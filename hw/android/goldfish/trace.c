@@ -20,6 +20,7 @@
 #include "sysemu/sysemu.h"
 #include "exec/softmmu_exec.h"
 #include "exec/code-profile.h"
+#include "qemu/timer.h"
 
 /* Set to 1 to debug tracing */
 #define DEBUG   0
@@ -84,14 +85,34 @@ static size_t get_guest_kernel_string(char* qemu_str,
     return copied;
 }
 
-/* I/O write */
-static void trace_dev_write(void *opaque, hwaddr offset, uint32_t value)
+/* Copy the string argument of an event into |qemu_str|. Events written
+ * to the ring carry their strings in |payload|, otherwise |value| is the
+ * address of the string in guest kernel memory.
+ */
+static size_t trace_dev_get_string(char* qemu_str, uint32_t value,
+                                   const char* payload, size_t payload_len,
+                                   size_t qemu_buffer_size)
 {
-    trace_dev_state *s = (trace_dev_state *)opaque;
+    if (!payload) {
+        return get_guest_kernel_string(qemu_str, value, qemu_buffer_size);
+    }
+    if (payload_len > qemu_buffer_size - 1) {
+        payload_len = qemu_buffer_size - 1;
+    }
+    memcpy(qemu_str, payload, payload_len);
+    qemu_str[payload_len] = '\0';
+    return strlen(qemu_str);
+}
 
-    (void)s;
+static void trace_ring_drain(trace_dev_state *s);
 
-    switch (offset >> 2) {
+/* Handle the event |reg|, written either to the I/O registers, or to the
+ * ring with a |payload|.
+ */
+static void trace_dev_event(trace_dev_state *s, int reg, uint32_t value,
+                            const char* payload, size_t payload_len)
+{
+    switch (reg) {
     case TRACE_DEV_REG_SWITCH:  // context switch, switch to pid
         DPID("QEMU.trace: context switch tid=%u\n", value);
         if (trace_filename != NULL) {
@@ -128,7 +149,8 @@ static void trace_dev_write(void *opaque, hwaddr offset, uint32_t value)
         eoff = value;
         break;
     case TRACE_DEV_REG_EXECVE_EXEPATH:  // init exec, path of EXE
-        get_guest_kernel_string(exec_path, value, CLIENT_PAGE_SIZE);
+        trace_dev_get_string(exec_path, value, payload, payload_len,
+                             CLIENT_PAGE_SIZE);
         if (trace_filename != NULL) {
             D("QEMU.trace: kernel, init exec [%lx,%lx]@%lx [%s]\n",
               vstart, vend, eoff, exec_path);
@@ -139,7 +161,16 @@ static void trace_dev_write(void *opaque, hwaddr offset, uint32_t value)
         cmdlen = value;
         break;
     case TRACE_DEV_REG_CMDLINE:         // execve, process cmdline
-        safe_memory_rw_debug(current_cpu, value, (uint8_t*)exec_arg, cmdlen, 0);
+        if (cmdlen > CLIENT_PAGE_SIZE) {
+            cmdlen = CLIENT_PAGE_SIZE;
+        }
+        if (payload) {
+            cmdlen = payload_len < cmdlen ? payload_len : cmdlen;
+            memcpy(exec_arg, payload, cmdlen);
+        } else {
+            safe_memory_rw_debug(current_cpu, value, (uint8_t*)exec_arg,
+                                 cmdlen, 0);
+        }
         if (trace_filename != NULL) {
             D("QEMU.trace: kernel, execve [%.*s]\n", cmdlen, exec_arg);
         }
@@ -162,12 +193,13 @@ static void trace_dev_write(void *opaque, hwaddr offset, uint32_t value)
         }
         break;
     case TRACE_DEV_REG_NAME:            // record thread name
-        get_guest_kernel_string(exec_path, value, CLIENT_PAGE_SIZE);
+        trace_dev_get_string(exec_path, value, payload, payload_len,
+                             CLIENT_PAGE_SIZE);
         DPID("QEMU.trace: thread name=%s\n", exec_path);
 
         // Remove the trailing newline if it exists
         int len = strlen(exec_path);
-        if (exec_path[len - 1] == '\n') {
+        if (len > 0 && exec_path[len - 1] == '\n') {
             exec_path[len - 1] = 0;
         }
         if (trace_filename != NULL) {
@@ -175,7 +207,8 @@ static void trace_dev_write(void *opaque, hwaddr offset, uint32_t value)
         }
         break;
     case TRACE_DEV_REG_MMAP_EXEPATH:    // mmap, path of EXE, the others are same as execve
-        get_guest_kernel_string(exec_path, value, CLIENT_PAGE_SIZE);
+        trace_dev_get_string(exec_path, value, payload, payload_len,
+                             CLIENT_PAGE_SIZE);
         if (exec_path != NULL)
           record_mmap(vstart, vend, eoff, exec_path, tid);
         DPID("QEMU.trace: mmap exe=%s\n", exec_path);
@@ -189,7 +222,8 @@ static void trace_dev_write(void *opaque, hwaddr offset, uint32_t value)
         DPID("QEMU.trace: pid=%d\n", value);
         break;
     case TRACE_DEV_REG_INIT_NAME:       // init, the comm of the init pid
-        get_guest_kernel_string(exec_path, value, CLIENT_PAGE_SIZE);
+        trace_dev_get_string(exec_path, value, payload, payload_len,
+                             CLIENT_PAGE_SIZE);
         DPID("QEMU.trace: tgid=%d pid=%d name=%s\n", tgid, pid, exec_path);
         if (trace_filename != NULL) {
             D("QEMU.trace: kernel, init name %u [%s]\n", pid, exec_path);
@@ -201,7 +235,8 @@ static void trace_dev_write(void *opaque, hwaddr offset, uint32_t value)
         dsaddr = value;
         break;
     case TRACE_DEV_REG_DYN_SYM:         // add dynamic symbol
-        get_guest_kernel_string(exec_arg, value, CLIENT_PAGE_SIZE);
+        trace_dev_get_string(exec_arg, value, payload, payload_len,
+                             CLIENT_PAGE_SIZE);
         if (trace_filename != NULL) {
             D("QEMU.trace: dynamic symbol %lx:%s\n", dsaddr, exec_arg);
         }
@@ -214,7 +249,8 @@ static void trace_dev_write(void *opaque, hwaddr offset, uint32_t value)
         break;
 
     case TRACE_DEV_REG_PRINT_STR:       // print string
-        get_guest_kernel_string(exec_arg, value, CLIENT_PAGE_SIZE);
+        trace_dev_get_string(exec_arg, value, payload, payload_len,
+                             CLIENT_PAGE_SIZE);
         printf("%s", exec_arg);
         exec_arg[0] = 0;
         break;
@@ -226,6 +262,11 @@ static void trace_dev_write(void *opaque, hwaddr offset, uint32_t value)
         break;
 
     case TRACE_DEV_REG_STOP_EMU:        // stop the VM execution
+        if (payload) {
+            // not in the middle of a guest instruction
+            qemu_system_shutdown_request();
+            break;
+        }
         cpu_single_env->exception_index = EXCP_HLT;
         current_cpu->halted = 1;
         qemu_system_shutdown_request();
@@ -241,6 +282,29 @@ static void trace_dev_write(void *opaque, hwaddr offset, uint32_t value)
     case TRACE_DEV_REG_UNMAP_END:
         break;
 
+    case TRACE_DEV_REG_RING_ADDR:
+        s->ring_addr_pending = value;
+        break;
+    case TRACE_DEV_REG_RING_SIZE:
+        trace_ring_drain(s);
+        if (value != 0 && (value < TRACE_DEV_RING_MIN_SIZE ||
+                           (value & (value - 1)) != 0)) {
+            fprintf(stderr, "QEMU.trace: invalid ring size %u\n", value);
+            value = 0;
+        }
+        s->ring_addr = s->ring_addr_pending;
+        s->ring_size = value;
+        if (value) {
+            timer_mod(s->ring_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                                     TRACE_DEV_RING_DRAIN_NS);
+        } else {
+            timer_del(s->ring_timer);
+        }
+        break;
+    case TRACE_DEV_REG_RING_FLUSH:
+        trace_ring_drain(s);
+        break;
+
     case TRACE_DEV_REG_METHOD_ENTRY:
     case TRACE_DEV_REG_METHOD_EXIT:
     case TRACE_DEV_REG_METHOD_EXCEPTION:
@@ -249,25 +313,110 @@ static void trace_dev_write(void *opaque, hwaddr offset, uint32_t value)
     case TRACE_DEV_REG_NATIVE_EXCEPTION:
         if (trace_filename != NULL) {
             if (tracing) {
-                int __attribute__((unused)) call_type = (offset - 4096) >> 2;
+                int __attribute__((unused)) call_type =
+                        reg - TRACE_DEV_REG_METHOD_ENTRY;
                 //trace_interpreted_method(value, call_type);
             }
         }
         break;
 
     default:
-        if (offset < 4096) {
+        if (reg < 1024) {
+            if (payload) {
+                // a guest bug, not worth stopping the emulation
+                D("QEMU.trace: ring event with bad register %d\n", reg);
+                break;
+            }
             cpu_abort(cpu_single_env,
-                      "trace_dev_write: Bad offset %" HWADDR_PRIx "\n",
-                      offset);
+                      "trace_dev_write: Bad offset %x\n", reg << 2);
         } else {
-            D("%s: offset=%d (0x%x) value=%d (0x%x)\n", __FUNCTION__, offset,
-              offset, value, value);
+            D("%s: reg=%d value=%d (0x%x)\n", __FUNCTION__, reg,
+              value, value);
         }
         break;
     }
 }
 
+/* Process all the events that the guest wrote to the ring. */
+static void trace_ring_drain(trace_dev_state *s)
+{
+    uint32_t head, tail;
+    uint8_t header[TRACE_DEV_RING_ENTRY_HEADER];
+    static char payload[CLIENT_PAGE_SIZE];
+
+    if (!s->ring_size) {
+        return;
+    }
+    head = ldl_phys(s->ring_addr + TRACE_DEV_RING_HEAD);
+    tail = ldl_phys(s->ring_addr + TRACE_DEV_RING_TAIL);
+    if (head - tail > s->ring_size) {
+        fprintf(stderr, "QEMU.trace: corrupted ring (head=%u tail=%u), "
+                "disabling it\n", head, tail);
+        s->ring_size = 0;
+        timer_del(s->ring_timer);
+        return;
+    }
+    while (tail != head) {
+        hwaddr data = s->ring_addr + TRACE_DEV_RING_DATA;
+        uint32_t mask = s->ring_size - 1;
+        uint32_t pos, entry_size, first;
+        int reg, len;
+        uint32_t value;
+
+        // Entries are 8-byte aligned, so headers are never split.
+        cpu_physical_memory_read(data + (tail & mask), header,
+                                 sizeof(header));
+        reg = lduw_p(header);
+        len = lduw_p(header + 2);
+        value = ldl_p(header + 4);
+        entry_size = (TRACE_DEV_RING_ENTRY_HEADER + len + 7) & ~7U;
+        if (len >= CLIENT_PAGE_SIZE || entry_size > head - tail) {
+            fprintf(stderr, "QEMU.trace: bad ring entry (reg=%d len=%d), "
+                    "disabling the ring\n", reg, len);
+            s->ring_size = 0;
+            timer_del(s->ring_timer);
+            return;
+        }
+        pos = (tail + TRACE_DEV_RING_ENTRY_HEADER) & mask;
+        first = s->ring_size - pos;
+        if (first > (uint32_t)len) {
+            first = len;
+        }
+        cpu_physical_memory_read(data + pos, (uint8_t*)payload, first);
+        cpu_physical_memory_read(data, (uint8_t*)payload + first, len - first);
+
+        tail += entry_size;
+        stl_phys(s->ring_addr + TRACE_DEV_RING_TAIL, tail);
+        if (reg == TRACE_DEV_REG_RING_ADDR || reg == TRACE_DEV_REG_RING_SIZE ||
+            reg == TRACE_DEV_REG_RING_FLUSH) {
+            D("QEMU.trace: ignoring ring register %d in the ring\n", reg);
+            continue;
+        }
+        trace_dev_event(s, reg, value, payload, len);
+    }
+}
+
+static void trace_ring_tick(void *opaque)
+{
+    trace_dev_state *s = opaque;
+
+    trace_ring_drain(s);
+    if (s->ring_size) {
+        timer_mod(s->ring_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                                 TRACE_DEV_RING_DRAIN_NS);
+    }
+}
+
+/* I/O write */
+static void trace_dev_write(void *opaque, hwaddr offset, uint32_t value)
+{
+    trace_dev_state *s = (trace_dev_state *)opaque;
+
+    // Keep the events ordered, those of the ring come first.
+    trace_ring_drain(s);
+    trace_dev_event(s, offset >> 2, value, NULL, 0);
+}
+
 /* I/O read */
 static uint32_t trace_dev_read(void *opaque, hwaddr offset)
 {
@@ -279,6 +428,9 @@ static uint32_t trace_dev_read(void *opaque, hwaddr offset)
     case TRACE_DEV_REG_ENABLE:          // tracing enable
         return tracing;
 
+    case TRACE_DEV_REG_RING_SIZE:       // current ring size, 0 if disabled
+        return s->ring_size;
+
     default:
         if (offset < 4096) {
             cpu_abort(cpu_single_env,
@@ -310,7 +462,10 @@ void trace_dev_init()
     if (code_profile_dirname == NULL)
       return;
 
-    code_profile_record_func = profile_bb_helper;
+    if (code_profile_sample_rate > 0)
+      profile_sampler_start(code_profile_sample_rate);
+    else
+      code_profile_record_func = profile_bb_helper;
     trace_dev_state *s;
 
     s = (trace_dev_state *)g_malloc0(sizeof(trace_dev_state));
@@ -321,6 +476,9 @@ void trace_dev_init()
     s->dev.irq = 0;
     s->dev.irq_count = 0;
 
+    s->ring_timer = timer_new(QEMU_CLOCK_VIRTUAL, SCALE_NS,
+                              trace_ring_tick, s);
+
     goldfish_device_add(&s->dev, trace_dev_readfn, trace_dev_writefn, s);
 
     exec_path[0] = exec_arg[0] = '\0';
@@ -9,6 +9,7 @@
 ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
 ** GNU General Public License for more details.
 */
+#include "android/utils/startup_trace.h"
 #include "migration/qemu-file.h"
 #include "sysemu/char.h"
 #include "hw/android/goldfish/device.h"
@@ -59,6 +60,18 @@ struct tty_state {
 
 #define E(...)  cpu_abort(cpu_single_env, __VA_ARGS__)
 
+/* The first output of the guest kernel on any tty is its first sign of
+ * life, recorded as a startup milestone. */
+static int tty_output_seen;
+
+static void tty_mark_output(void)
+{
+    if (!tty_output_seen) {
+        tty_output_seen = 1;
+        startupTrace_mark("guest kernel start");
+    }
+}
+
 static void  goldfish_tty_save(QEMUFile*  f, void*  opaque)
 {
     struct tty_state*  s = opaque;
@@ -117,6 +130,7 @@ static void goldfish_tty_write(void *opaque, hwaddr offset, uint32_t value)
     switch(offset) {
         case TTY_PUT_CHAR: {
             uint8_t ch = value;
+            tty_mark_output();
             if(s->cs)
                 qemu_chr_write(s->cs, &ch, 1);
         } break;
@@ -140,6 +154,7 @@ static void goldfish_tty_write(void *opaque, hwaddr offset, uint32_t value)
                     break;
 
                 case TTY_CMD_WRITE_BUFFER:
+                    tty_mark_output();
                     if(s->cs) {
                         int len;
                         target_ulong  buf;
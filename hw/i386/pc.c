@@ -1048,6 +1048,8 @@ static void pc_init1(ram_addr_t ram_size,
             (androidHwConfig_getKernelDeviceNaming(android_hw) >= 1);
     pipe_dev_init(newDeviceNaming);
 
+    goldfish_free_pages_init();
+
     {
         DriveInfo* info = drive_get( IF_IDE, 0, 0 );
         if (info != NULL) {
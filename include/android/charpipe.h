@@ -30,4 +30,8 @@ extern CharDriverState*  qemu_chr_open_buffer( CharDriverState*  endpoint );
 /* must be called from the main event loop to poll all charpipes */
 extern void charpipe_poll( void );
 
+/* return 1 if some data is still waiting for a reader, in which case the
+ * main loop must call charpipe_poll() again soon */
+extern int charpipe_has_pending( void );
+
 #endif /* _CHARPIPE_H */
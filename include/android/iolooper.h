@@ -24,7 +24,10 @@ enum {
     IOLOOPER_READ = (1<<0),
     IOLOOPER_WRITE = (1<<1),
 };
-void       iolooper_modify( IoLooper*  iol, int fd, int oldflags, int newflags);
+/* Sets the events watched on |fd| to |newflags|. Returns 0 on success, or
+ * -1 if the backend can't watch this descriptor (e.g. epoll refuses regular
+ * files), in which case its previous events are kept. */
+int        iolooper_modify( IoLooper*  iol, int fd, int oldflags, int newflags);
 
 int        iolooper_poll( IoLooper*  iol );
 /* Wrapper around select()
@@ -38,6 +41,18 @@ int        iolooper_is_read( IoLooper*  iol, int  fd );
 int        iolooper_is_write( IoLooper*  iol, int  fd );
 /* Returns 1 if this IoLooper has one or more file descriptor to interact with */
 int        iolooper_has_operations( IoLooper*  iol );
+
+/* Returns the next file descriptor with pending I/O after the last
+ * iolooper_wait(), and sets |*flags| to its IOLOOPER_READ/WRITE bits.
+ * Returns -1 once all of them were returned. Unlike iolooper_is_read()
+ * and iolooper_is_write(), this only visits the ready descriptors. */
+int        iolooper_next_pending( IoLooper*  iol, int*  flags );
+
+/* Returns a file descriptor that becomes readable when iolooper_wait()
+ * would report I/O, so that another loop can select() on it instead of
+ * on each watched descriptor. Returns -1 if the host backend has no such
+ * descriptor (e.g. on Windows). */
+int        iolooper_fd( IoLooper*  iol );
 /* Gets current time in milliseconds.
  * Return:
  *  Number of milliseconds corresponded to the current time on success, or -1
@@ -372,6 +372,54 @@ int   socket_send  ( int  fd, const void*  buf, int  buflen );
 int   socket_send_oob( int  fd, const void*  buf, int  buflen );
 int   socket_sendto( int  fd, const void*  buf, int  buflen, const SockAddress*  to );
 
+/* vectored versions of socket_send() and socket_recv(), which transfer
+ * data from/to up to SOCKET_MAX_BUFFERS buffers with a single system call.
+ * 'count' must be <= SOCKET_MAX_BUFFERS. Return the number of bytes
+ * transferred, or -1 on error (with errno set).
+ */
+typedef struct {
+    void*   data;
+    size_t  size;
+} SockBuffer;
+
+#define  SOCKET_MAX_BUFFERS  16
+
+int   socket_sendv( int  fd, const SockBuffer*  buffers, int  count );
+int   socket_recvv( int  fd, const SockBuffer*  buffers, int  count );
+
+/* batched versions of socket_sendto() and socket_recvfrom(), which transfer
+ * up to SOCKET_MAX_DATAGRAMS datagrams with a single system call when the
+ * host supports it (i.e. sendmmsg() and recvmmsg() on Linux), and with one
+ * call per datagram otherwise.
+ *
+ * For each datagram, 'buffers' and 'count' describe the data to send or the
+ * space to receive it, as for socket_sendv(), and 'address' is its
+ * destination or its source. 'size' is set to the number of bytes
+ * transferred, and 'truncated' to 1 if a received datagram was larger
+ * than its buffers.
+ */
+typedef struct {
+    const SockBuffer*  buffers;
+    int                count;
+    SockAddress        address;
+    int                size;
+    int                truncated;
+} SockDatagram;
+
+#define  SOCKET_MAX_DATAGRAMS  16
+
+/* send the first 'count' datagrams. Return the number of datagrams sent,
+ * which can be less than 'count', or -1 on error (with errno set) if none
+ * could be sent.
+ */
+int   socket_send_batch( int  fd, SockDatagram*  datagrams, int  count );
+
+/* receive up to 'count' datagrams. This only blocks until the first one is
+ * received, if the socket is in blocking mode. Return the number of
+ * datagrams received, or -1 on error (with errno set) if none was.
+ */
+int   socket_recv_batch( int  fd, SockDatagram*  datagrams, int  count );
+
 int   socket_connect( int  fd, const SockAddress*  address );
 int   socket_bind( int  fd, const SockAddress*  address );
 int   socket_get_address( int  fd, SockAddress*  address );
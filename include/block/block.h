@@ -143,6 +143,9 @@ BlockDriverAIOCB *bdrv_aio_ioctl(BlockDriverState *bs,
 
 /* Ensure contents are flushed to disk.  */
 void bdrv_flush(BlockDriverState *bs);
+/* Sets the maximum size in bytes of the L2 cache of qcow2 images opened
+ * afterwards */
+void bdrv_qcow2_set_l2_cache_limit(int64_t bytes);
 void bdrv_flush_all(void);
 void bdrv_close_all(void);
 
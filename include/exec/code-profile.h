@@ -30,4 +30,9 @@ extern CodeProfileRecordFunc code_profile_record_func;
 // A string to indicate where profile will be stored. Profiling will
 // be turned off if its value is NULL.
 extern const char *code_profile_dirname;
+
+// If positive, the number of times per second that the current guest pc
+// is sampled. The profile is then written as pprof CPU profiles, instead
+// of recording the execution of every translated block.
+extern int code_profile_sample_rate;
 #endif
@@ -462,6 +462,10 @@ extern ram_addr_t ram_size;
 /* RAM is pre-allocated and passed into qemu_ram_alloc_from_ptr */
 #define RAM_PREALLOC_MASK   (1 << 0)
 
+/* RAM is private anonymous memory, whose pages read as zero once given
+ * back to the host with cpu_physical_memory_discard() */
+#define RAM_DISCARDABLE_MASK (1 << 1)
+
 typedef struct RAMBlock {
     uint8_t *host;
     ram_addr_t offset;
@@ -473,6 +477,9 @@ typedef struct RAMBlock {
      */
     QTAILQ_ENTRY(RAMBlock) next;
     int fd;
+    /* Pages given back to the host by cpu_physical_memory_discard(), or
+     * NULL if there are none. */
+    unsigned long *discarded;
 } RAMBlock;
 
 #define DIRTY_MEMORY_VGA       0
@@ -491,6 +498,11 @@ extern RAMList ram_list;
 
 extern const char *mem_path;
 extern int mem_prealloc;
+extern int mem_hugepages;
+extern const char *ram_template;
+/* number of RAM blocks mapped from the ram_template file */
+extern int ram_template_mapped;
+int qemu_ram_template_save(const char *path);
 
 /* physical memory access */
 
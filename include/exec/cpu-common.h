@@ -104,6 +104,11 @@ void *cpu_physical_memory_map(hwaddr addr,
                               int is_write);
 void cpu_physical_memory_unmap(void *buffer, hwaddr len,
                                int is_write, hwaddr access_len);
+/* Give the host memory of the guest RAM pages in [addr, addr + len) back to
+ * the host, for pages whose content the guest doesn't need anymore. They
+ * read as zero afterwards. Only whole host pages of RAM that supports it
+ * are discarded, and the number of discarded bytes is returned. */
+hwaddr cpu_physical_memory_discard(hwaddr addr, hwaddr len);
 void *cpu_register_map_client(void *opaque, void (*callback)(void *opaque));
 
 uint32_t ldub_phys(hwaddr addr);
@@ -154,9 +154,11 @@ struct TranslationBlock {
     uint64_t flags; /* flags defining in which context the code was generated */
     uint16_t size;      /* size of target code for this block (1 <=
                            size <= TARGET_PAGE_SIZE) */
-    uint16_t cflags;    /* compile flags */
+    uint32_t cflags;    /* compile flags */
 #define CF_COUNT_MASK  0x7fff
 #define CF_LAST_IO     0x8000 /* Last insn may be an IO access.  */
+#define CF_COLD        0x10000 /* translated without the optimizer */
+#define CF_INVALID     0x20000 /* removed by tb_phys_invalidate() */
 
     uint8_t *tc_ptr;    /* pointer to the translated code */
     /* next matching tb for physical address. */
@@ -181,10 +183,25 @@ struct TranslationBlock {
     struct TranslationBlock *jmp_next[2];
     struct TranslationBlock *jmp_first;
     uint32_t icount;
+    uint32_t exec_count; /* executions of a CF_COLD block */
+    uint32_t region;     /* index in tb_ctx.regions */
 };
 
 #include "exec/spinlock.h"
 
+/* The code buffer and the tbs array are split into regions, filled one
+   after the other. When the current region is full, only the least
+   recently executed one is evicted instead of flushing the whole buffer. */
+#define TB_REGION_COUNT 8
+
+typedef struct TBRegion {
+    uint8_t *code_start;
+    uint8_t *code_ptr;      /* end of the code, unless it's the current one */
+    int first_tb;           /* index in tbs */
+    int nb_tbs;
+    uint64_t last_used;     /* region_clock of the last execution */
+} TBRegion;
+
 typedef struct TBContext TBContext;
 
 struct TBContext {
@@ -192,12 +209,23 @@ struct TBContext {
     TranslationBlock *tbs;
     TranslationBlock *tb_phys_hash[CODE_GEN_PHYS_HASH_SIZE];
     int nb_tbs;
+    TBRegion regions[TB_REGION_COUNT];
+    int nb_regions;
+    int cur_region;
+    size_t region_size;
+    int region_max_tbs;
+    uint64_t region_clock;
     /* any access to the tbs or the page table must use this lock */
     spinlock_t tb_lock;
 
     /* statistics */
     int tb_flush_count;
+    int tb_region_evict_count;
+    int tb_region_evicted_tbs;
     int tb_phys_invalidate_count;
+    /* indirect jumps from generated code, see tb_lookup_ptr() */
+    int tb_lookup_ptr_hits;
+    int tb_lookup_ptr_misses;
 
     int tb_invalidated_flag;
 };
@@ -228,6 +256,26 @@ void tb_link_phys(TranslationBlock *tb,
                   target_ulong phys_pc, target_ulong phys_page2);
 void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr);
 void tb_invalidate_phys_page_fast0(hwaddr start, int len);
+/* -tb-index: load the index of the TBs translated by previous runs, and
+ * write it back on exit. tb_index_load() returns the number of entries. */
+int tb_index_load(const char *path);
+int tb_index_save(void);
+/* -tb-hot: new TBs are translated quickly without the optimizer, and
+ * translated again with it once they have run tb_hot_threshold times.
+ * 0 disables this. */
+extern int tb_hot_threshold;
+TranslationBlock *tb_run_cold(CPUArchState *env, TranslationBlock *tb);
+/* Return the host code for the current CPU state, so that an indirect
+ * jump from generated code goes to a TB that is already translated
+ * without going back to cpu_exec(). Otherwise, return the epilogue. */
+void *tb_lookup_ptr(CPUArchState *env);
+/* Frontends that translate through direct forward branches within the
+ * page count the branches and the TBs they went into here. */
+extern int tb_stitch_count;
+extern int tb_stitched_tbs;
+/* -tcg-stats: count the TCG ops removed by the optimizer and liveness
+ * analysis, reported by "info jit". */
+extern int tb_op_stats;
 
 extern uint8_t *code_gen_ptr;
 extern int code_gen_max_blocks;
@@ -359,6 +407,11 @@ extern void *io_mem_opaque[IO_MEM_NB_ENTRIES];
 
 void tlb_fill(CPUArchState *env1, target_ulong addr, int is_write, int mmu_idx,
               uintptr_t retaddr);
+/* Called by the softmmu helpers before tlb_fill(): if the page of 'addr'
+   is in the victim TLB, swap it with tlb_table[mmu_idx][index] and return
+   true. 'elt_ofs' is the offset of addr_read, addr_write or addr_code. */
+bool tlb_victim_hit(CPUArchState *env, int mmu_idx, int index,
+                    size_t elt_ofs, target_ulong addr);
 
 uint8_t helper_ldb_cmmu(CPUArchState *env, target_ulong addr, int mmu_idx);
 uint16_t helper_ldw_cmmu(CPUArchState *env, target_ulong addr, int mmu_idx);
@@ -27,8 +27,20 @@ int hax_vcpu_emulation_mode(CPUState *cpu);
 int hax_stop_emulation(CPUState *cpu);
 int hax_stop_translate(CPUState *cpu);
 int hax_arch_get_registers(CPUState *cpu);
+/* Register groups fetched on demand while emulating one MMIO instruction,
+ * the general and segment registers are always fetched */
+#define HAX_SYNC_FPU    0x1
+#define HAX_SYNC_MSRS   0x2
+#define HAX_SYNC_ALL    (HAX_SYNC_FPU | HAX_SYNC_MSRS)
+int hax_vcpu_load_regs(CPUState *cpu, int groups);
 void hax_raise_event(CPUState *cpu);
 void hax_reset_vcpu_state(void *opaque);
+/* Dispatch the fast MMIO exits in [base, base + size) directly to the
+ * handlers of a device, without the lookup of cpu_physical_memory_rw() */
+int hax_register_fast_mmio(hwaddr base, hwaddr size,
+                           CPUReadMemoryFunc **read,
+                           CPUWriteMemoryFunc **write, void *opaque);
+void hax_dump_stats(FILE *f, fprintf_function cpu_fprintf);
 
 #include "target-i386/hax-interface.h"
 
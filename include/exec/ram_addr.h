@@ -40,6 +40,21 @@ void qemu_ram_free(ram_addr_t addr);
 void qemu_ram_remap(ram_addr_t addr, ram_addr_t length);
 ram_addr_t qemu_ram_addr_from_host_nofail(void *ptr);
 
+/* Forget the discarded pages in [offset, offset + length) of 'block' that
+ * may not read as zero anymore, because the guest accessed them since they
+ * were discarded, or because this can't be checked on this host. */
+void qemu_ram_sync_discarded(RAMBlock *block, ram_addr_t offset,
+                             ram_addr_t length);
+
+/* Return true if the page at 'offset' of 'block' is discarded, i.e. reads
+ * as zero unless it was accessed since the last qemu_ram_sync_discarded()
+ * call that covered it. */
+static inline bool qemu_ram_page_discarded(RAMBlock *block, ram_addr_t offset)
+{
+    return block->discarded &&
+           test_bit(offset >> TARGET_PAGE_BITS, block->discarded);
+}
+
 static inline int cpu_physical_memory_get_dirty(ram_addr_t start,
                                                 ram_addr_t length,
                                                 unsigned client)
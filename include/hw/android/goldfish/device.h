@@ -37,6 +37,13 @@ int goldfish_device_add(struct goldfish_device *dev,
 
 int goldfish_add_device_no_io(struct goldfish_device *dev);
 
+/* Under KVM, buffer the guest writes to [offset, offset + size) of an added
+ * device instead of exiting for each of them. Only for setup registers whose
+ * value is used when another, trapping, register is accessed: the buffered
+ * writes are replayed before any other MMIO exit is handled. */
+void goldfish_device_coalesce_mmio(struct goldfish_device *dev,
+                                   uint32_t offset, uint32_t size);
+
 void goldfish_device_init(qemu_irq *pic, uint32_t base, uint32_t size, uint32_t irq, uint32_t irq_count);
 int goldfish_device_bus_init(uint32_t base, uint32_t irq);
 
@@ -50,6 +57,7 @@ void goldfish_battery_init(int has_battery);
 void goldfish_battery_set_prop(int ac, int property, int value);
 void goldfish_battery_display(void (* callback)(void *data, const char* string), void *data);
 void goldfish_mmc_init(uint32_t base, int id, BlockDriverState* bs);
+void goldfish_free_pages_init(void);
 int goldfish_guest_is_64bit();
 
 // these do not add a device
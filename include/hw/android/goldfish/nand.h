@@ -16,6 +16,15 @@ void nand_dev_init(uint32_t base);
 void nand_add_dev(const char *arg);
 void parse_nand_limits(char*  limits);
 
+/* Limit the NAND reads and writes of the guest to |read_rate| and
+ * |write_rate| bytes per second, or remove the limit if 0. These are
+ * also set by the read-rate= and write-rate= items of -nand-limits.
+ * Only the asynchronous commands of guests that set
+ * NAND_DEV_FLAG_ASYNC_CAP are limited, the other ones would stall the
+ * main loop. */
+void nand_set_rate_limits(uint64_t  read_rate, uint64_t  write_rate);
+void nand_get_rate_limits(uint64_t*  read_rate, uint64_t*  write_rate);
+
 typedef struct {
     uint64_t     limit;
     uint64_t     counter;
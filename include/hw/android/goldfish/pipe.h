@@ -159,6 +159,12 @@ extern void goldfish_pipe_wake( void* hwpipe, unsigned flags );
 #define PIPE_REG_PARAMS_ADDR_HIGH    0x1c
 /* write: access with paremeter buffer */
 #define PIPE_REG_ACCESS_PARAMS       0x20
+/* write: value = number of PipeBatchDescriptors at the parameter buffer
+ * address to process. Reading PIPE_REG_STATUS then returns the number of
+ * descriptors that were processed. */
+#define PIPE_REG_ACCESS_BATCH        0x24
+/* read: combination of PIPE_FEATURE_XXX flags, 0 on older emulators */
+#define PIPE_REG_FEATURES            0x28
 #define PIPE_REG_CHANNEL_HIGH        0x30 /* read/write: high 32 bit channel id */
 #define PIPE_REG_ADDRESS_HIGH        0x34 /* write: high 32 bit physical address */
 
@@ -181,7 +187,7 @@ extern void goldfish_pipe_wake( void* hwpipe, unsigned flags );
  * will use (CMD_READ_BUFFER - CMD_WRITE_BUFFER) as a special offset
  * in qemu_pipe_read_write() below.
  */
-#define PIPE_CMD_READ_BUFFER        6  /* receive a page-contained buffer from the emulator */
+#define PIPE_CMD_READ_BUFFER        6  /* receive a user buffer from the emulator */
 #define PIPE_CMD_WAKE_ON_READ       7  /* tell the emulator to wake us when reading is possible */
 
 /* Possible status values used to signal errors - see qemu_pipe_error_convert */
@@ -190,6 +196,9 @@ extern void goldfish_pipe_wake( void* hwpipe, unsigned flags );
 #define PIPE_ERROR_NOMEM       -3
 #define PIPE_ERROR_IO          -4
 
+/* Bit-flags returned by PIPE_REG_FEATURES */
+#define PIPE_FEATURE_BATCH     (1 << 0)  /* PIPE_REG_ACCESS_BATCH is supported */
+
 /* Bit-flags used to signal events from the emulator */
 #define PIPE_WAKE_CLOSED       (1 << 0)  /* emulator closed pipe */
 #define PIPE_WAKE_READ         (1 << 1)  /* pipe can now be read from */
@@ -217,4 +226,27 @@ struct access_params_64 {
     uint32_t flags;
 };
 
+/* A transfer submitted with PIPE_REG_ACCESS_BATCH. The guest driver writes
+ * an array of these at the parameter buffer address. The layout is the same
+ * for 32-bit and 64-bit guests.
+ *
+ * Descriptors are processed in order, and the emulator writes the result
+ * of each transfer into its 'status' field, with the same meaning as the
+ * status of a single PIPE_CMD_READ_BUFFER or PIPE_CMD_WRITE_BUFFER command.
+ * Processing stops after the first transfer that doesn't complete fully,
+ * so that data is never reordered within a channel, and the driver must
+ * submit the following descriptors again.
+ */
+#define PIPE_BATCH_MAX_DESCRIPTORS  256
+
+typedef struct PipeBatchDescriptor {
+    uint64_t channel;
+    uint64_t address;  /* guest virtual address of the buffer */
+    uint32_t size;
+    uint32_t cmd;      /* PIPE_CMD_READ_BUFFER or PIPE_CMD_WRITE_BUFFER */
+    int32_t  status;   /* written by the emulator */
+    /* reserved for future extension */
+    uint32_t flags;
+} PipeBatchDescriptor;
+
 #endif /* _HW_GOLDFISH_PIPE_H */
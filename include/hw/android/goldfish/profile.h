@@ -26,4 +26,10 @@ void record_mmap(target_ulong vstart, target_ulong vend,
 void release_mmap(unsigned pid);
 
 void profile_bb_helper(target_ulong pc, uint32_t size);
+
+// Start sampling the pc of the current process |rate| times per second of
+// guest time, instead of recording every basic block with
+// profile_bb_helper(). The samples of each process are written to
+// code_profile_dirname as a pprof CPU profile.
+void profile_sampler_start(int rate);
 #endif
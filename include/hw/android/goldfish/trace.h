@@ -41,6 +41,9 @@
 #define TRACE_DEV_REG_UNMAP_END         15
 #define TRACE_DEV_REG_NAME              16
 #define TRACE_DEV_REG_TGID              17
+#define TRACE_DEV_REG_RING_ADDR         20
+#define TRACE_DEV_REG_RING_SIZE         21
+#define TRACE_DEV_REG_RING_FLUSH        22
 #define TRACE_DEV_REG_DYN_SYM           50
 #define TRACE_DEV_REG_DYN_SYM_ADDR      51
 #define TRACE_DEV_REG_REMOVE_ADDR       52
@@ -90,9 +93,52 @@
 #define TRACE_DEV_REG_PRINT_USER_STR        (TRACE_DEV_REG_MEMCHECK + MEMCHECK_EVENT_PRINT_USER_STR)
 #endif
 
+/* Instead of writing each event to the registers above, which exits the
+ * VM every time, the guest kernel can append them to a ring buffer in its
+ * own memory, that the device drains periodically:
+ *
+ *   - write the guest physical address of the ring to
+ *     TRACE_DEV_REG_RING_ADDR, then the size of its data area to
+ *     TRACE_DEV_REG_RING_SIZE, a power of 2 of at least
+ *     TRACE_DEV_RING_MIN_SIZE. Writing 0 disables the ring, after
+ *     processing the pending events. Reading it returns the current
+ *     size, i.e. 0 if the ring was disabled because of invalid data.
+ *
+ *   - the ring starts with two 32-bit counters of bytes, that only grow:
+ *     'head', written by the guest after appending an event, and 'tail',
+ *     written by the device after processing one. The data area follows,
+ *     at offset TRACE_DEV_RING_DATA.
+ *
+ *   - each event is made of a 16-bit register index, a 16-bit payload
+ *     length, the 32-bit register value, then the payload, padded to a
+ *     multiple of 8 bytes. Events may wrap around the end of the data
+ *     area. The payload replaces the guest kernel strings that the
+ *     registers expect, e.g. the path of TRACE_DEV_REG_MMAP_EXEPATH, and
+ *     needs no terminating zero.
+ *
+ *   - when the ring is full, write to TRACE_DEV_REG_RING_FLUSH to have
+ *     it drained immediately. Writing to any other register also drains
+ *     the ring first, so events stay in order.
+ *
+ * All fields are in guest byte order.
+ */
+#define TRACE_DEV_RING_HEAD             0
+#define TRACE_DEV_RING_TAIL             4
+#define TRACE_DEV_RING_DATA             64
+#define TRACE_DEV_RING_ENTRY_HEADER     8
+#define TRACE_DEV_RING_MIN_SIZE         4096
+
+/* Period of the ring drain, in virtual nanoseconds */
+#define TRACE_DEV_RING_DRAIN_NS         (10 * 1000 * 1000)
+
 /* the virtual trace device state */
 typedef struct {
     struct goldfish_device dev;
+    /* shared-memory ring, see above */
+    uint32_t ring_addr_pending;
+    hwaddr ring_addr;
+    uint32_t ring_size;
+    QEMUTimer *ring_timer;
 } trace_dev_state;
 
 /*
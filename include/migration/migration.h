@@ -109,4 +109,32 @@ uint64_t ram_bytes_total(void);
 int ram_save_live(QEMUFile *f, int stage, void *opaque);
 int ram_load(QEMUFile *f, void *opaque, int version_id);
 
+/* zlib level used to compress RAM in saved snapshots, 0 for none */
+extern int ram_compress_level;
+
+typedef struct RamSnapshotStats {
+    int64_t ns;             /* duration */
+    uint64_t ram_bytes;     /* guest RAM covered */
+    uint64_t stream_bytes;  /* bytes written or read, without skipped ones */
+    int threads;            /* compression threads, 0 if uncompressed */
+    int incremental;        /* only dirty pages were written */
+    uint64_t zero_pages;    /* pages only recorded in the index */
+    uint64_t free_pages;    /* zero pages discarded by the guest, not read */
+    uint64_t fill_pages;    /* same, with a non-zero fill byte */
+    uint64_t raw_pages;     /* pages with their data in the stream */
+    uint64_t clean_pages;   /* raw pages not rewritten by an incremental save */
+} RamSnapshotStats;
+
+/* print the duration and throughput of the last snapshot save and load */
+void ram_print_snapshot_stats(Monitor *mon);
+
+/* copy the statistics of the last snapshot save and load, either may be
+ * NULL */
+void ram_get_snapshot_stats(RamSnapshotStats *save, RamSnapshotStats *load);
+
+/* Fill RAM with synthetic pages derived from 'seed', and checksum it, for
+ * the snapshot benchmark. */
+void ram_bench_fill(uint32_t seed);
+uint32_t ram_bench_checksum(void);
+
 #endif
@@ -147,6 +147,8 @@ void qemu_put_float(QEMUFile *f, float v);
 #endif
 
 void qemu_update_position(QEMUFile *f, size_t size);
+bool qemu_file_can_skip(QEMUFile *f);
+int qemu_fskip(QEMUFile *f, int64_t size);
 
 static inline unsigned int qemu_get_ubyte(QEMUFile *f)
 {
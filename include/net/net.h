@@ -124,6 +124,9 @@ void net_slirp_smb(const char *exported_dir);
 void net_slirp_redir(Monitor *mon, const char *redir_str, const char *redir_opt2);
 void net_cleanup(void);
 int slirp_is_inited(void);
+int slirp_is_threaded(void);
+void slirp_lock(void);
+void slirp_unlock(void);
 void net_client_check(void);
 void net_host_device_add(Monitor *mon, const char *device, const char *opts);
 void net_host_device_remove(Monitor *mon, int vlan_id, const char *device);
@@ -118,12 +118,15 @@ void async_context_pop(void);
 int get_async_context_id(void);
 
 QEMUBH *qemu_bh_new(QEMUBHFunc *cb, void *opaque);
+/* qemu_bh_schedule(), qemu_bh_schedule_idle() and qemu_bh_cancel() can be
+ * called from any thread, without the global mutex.
+ */
 void qemu_bh_schedule(QEMUBH *bh);
-/* Bottom halfs that are scheduled from a bottom half handler are instantly
- * invoked.  This can create an infinite loop if a bottom half handler
- * schedules itself.  qemu_bh_schedule_idle() avoids this infinite loop by
- * ensuring that the bottom half isn't executed until the next main loop
- * iteration.
+/* Bottom halfs that are scheduled from a bottom half handler are invoked
+ * by the next qemu_bh_poll(), and the main loop doesn't sleep before it.
+ * This can create an infinite loop if a bottom half handler schedules
+ * itself.  qemu_bh_schedule_idle() avoids this infinite loop by ensuring
+ * that the bottom half isn't executed until the next main loop iteration.
  */
 void qemu_bh_schedule_idle(QEMUBH *bh);
 void qemu_bh_cancel(QEMUBH *bh);
@@ -3,8 +3,10 @@
 
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include "qemu/compiler.h"
+#include "qemu/tls.h"
 #ifdef NEED_CPU_H
 // TODO(digit): #include "qom/cpu.h"
 #include "disas/disas.h"
@@ -40,6 +42,8 @@ static inline bool qemu_log_enabled(void)
 #define CPU_LOG_RESET      (1 << 9)
 #define LOG_UNIMP          (1 << 10)
 #define LOG_GUEST_ERROR    (1 << 11)
+/* Write the exec and in_asm traces as binary records, see below */
+#define CPU_LOG_BINARY     (1 << 12)
 
 /* Returns true if a bit is set in the current loglevel mask
  */
@@ -184,4 +188,90 @@ int qemu_str_to_log_mask(const char *str);
  */
 void qemu_print_log_usage(FILE *f);
 
+/* Binary traces:
+ *
+ * With '-d binary', the exec and in_asm traces are not formatted, but
+ * written as fixed-size QEMULogRecord to '<logfile>.bin', so that minutes
+ * of guest execution can be traced. Each thread appends its records to
+ * a chunk of its own, without locking, and full chunks are written by a
+ * background thread. scripts/qemu-binlog-decode.py prints such a file.
+ *
+ * The file starts with a QEMULogBinaryHeader, followed by chunks, each
+ * made of a QEMULogChunkHeader and its records. All fields are in host
+ * byte order. Records are timestamped by chunk only, the decoder spreads
+ * them evenly between the chunk start and end times.
+ */
+
+#define QEMU_LOG_BINARY_MAGIC    "QEMULOGB"
+#define QEMU_LOG_BINARY_VERSION  1
+#define QEMU_LOG_CHUNK_MAGIC     0x4b4e4843  /* 'CHNK' */
+
+typedef struct QEMULogBinaryHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t chunk_header_size;
+    uint32_t reserved;
+} QEMULogBinaryHeader;
+
+typedef struct QEMULogChunkHeader {
+    uint32_t magic;
+    uint32_t thread;        /* index of the writing thread, from 0 */
+    uint32_t count;         /* number of records that follow */
+    uint32_t reserved;
+    uint64_t start_ns;      /* host time of the first record */
+    uint64_t end_ns;        /* host time of the last record */
+} QEMULogChunkHeader;
+
+enum {
+    QEMU_LOG_REC_EXEC = 1,       /* a TB is executed */
+    QEMU_LOG_REC_TRANSLATE = 2,  /* a TB is translated */
+};
+
+typedef struct QEMULogRecord {
+    uint64_t pc;            /* guest address of the TB */
+    uint32_t type;          /* QEMU_LOG_REC_xxx */
+    uint32_t size;          /* size of the TB guest code, in bytes */
+} QEMULogRecord;
+
+/* Private per-thread variables, don't use */
+DECLARE_TLS(QEMULogRecord *, qemu_log_rec_next);
+DECLARE_TLS(QEMULogRecord *, qemu_log_rec_end);
+QEMULogRecord *qemu_log_binary_next_chunk(void);
+
+/* Returns true if the events of @mask are traced as binary records */
+static inline bool qemu_log_binary_mask(int mask)
+{
+    return (qemu_loglevel & (mask | CPU_LOG_BINARY)) ==
+           (mask | CPU_LOG_BINARY);
+}
+
+/* Append a record to the binary trace of the calling thread. Only call
+ * this when qemu_log_binary_mask() returns true.
+ */
+static inline void qemu_log_binary(uint32_t type, uint64_t pc, uint32_t size)
+{
+    QEMULogRecord *rec = tls_var(qemu_log_rec_next);
+
+    if (rec == tls_var(qemu_log_rec_end)) {
+        rec = qemu_log_binary_next_chunk();
+    }
+    rec->pc = pc;
+    rec->type = type;
+    rec->size = size;
+    tls_var(qemu_log_rec_next) = rec + 1;
+}
+
+/* Start writing binary records to @filename. Exits on error. */
+void qemu_log_binary_open(const char *filename);
+
+/* Write all pending records, then close the binary trace */
+void qemu_log_binary_close(void);
+
+/* Truncate the binary trace. Records appended by the calling thread
+ * before this call are written to the old contents, the following ones
+ * to the new contents.
+ */
+void qemu_log_binary_rotate(void);
+
 #endif
@@ -98,6 +98,10 @@ int qemu_daemon(int nochdir, int noclose);
 void *qemu_memalign(size_t alignment, size_t size);
 void *qemu_vmalloc(size_t size);
 void *qemu_anon_ram_alloc(size_t size);
+/* Like qemu_anon_ram_alloc(), but try to back the memory with huge pages.
+ * '*page_size' is set to the size of the pages backing the memory, or to
+ * 0 if the kernel was only asked to use transparent huge pages. */
+void *qemu_anon_ram_alloc_hugepages(size_t size, size_t *page_size);
 void qemu_vfree(void *ptr);
 void qemu_anon_ram_free(void *ptr, size_t size);
 
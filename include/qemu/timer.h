@@ -59,7 +59,8 @@ struct QEMUTimer {
     QEMUTimerList *timer_list;
     QEMUTimerCB *cb;
     void *opaque;
-    QEMUTimer *next;
+    uint64_t seq;               /* orders the timers with the same expiry */
+    int heap_index;             /* in the timer list heap, -1 if inactive */
     int scale;
 };
 
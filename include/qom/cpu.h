@@ -67,6 +67,7 @@ struct CPUState {
     uint32_t created;
     uint32_t stop;   /* Stop request */
     uint32_t stopped; /* Artificially stopped */
+    uint32_t thread_kicked; /* a kick is pending since the last wait */
 
     volatile sig_atomic_t exit_request;
     volatile sig_atomic_t tcg_exit_req;
@@ -24,7 +24,6 @@
 #ifndef QEMU_CPUS_H
 #define QEMU_CPUS_H
 
-void tcg_cpu_exec(void);
 void vm_state_notify(int running, int reason);
 extern int tbflush_requested;
 extern int debug_requested;
@@ -34,4 +33,9 @@ void pause_all_vcpus(void);
 int qemu_init_main_loop(void);
 void main_loop(void);
 
+/* Set up the global mutex, and take it for the main thread. */
+void qemu_init_cpu_loop(void);
+/* Wake up the main loop from another thread or a signal handler. */
+void qemu_main_loop_wakeup(void);
+
 #endif /* QEMU_CPUS_H */
@@ -48,19 +48,20 @@ void cpu_disable_ticks(void);
 
 void configure_icount(const char* opts);
 void configure_alarms(const char* opts);
+/* Coalesce the timer wakeups of the main loop within 'slack_ns' */
+void configure_timer_slack(int64_t slack_ns);
 int init_timer_alarm(void);
-int qemu_timer_alarm_pending(void);
 void quit_timers(void);
 
 int64_t qemu_icount;
 int64_t qemu_icount_bias;
 int icount_time_shift;
 
-int tcg_has_work(void);
 
 void qemu_system_reset_request(void);
 void qemu_system_shutdown_request(void);
 void qemu_system_powerdown_request(void);
+void qemu_system_vmstop_request(int reason);
 int qemu_shutdown_requested(void);
 int qemu_reset_requested(void);
 int qemu_vmstop_requested(void);
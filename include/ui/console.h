@@ -279,6 +279,11 @@ static inline void register_displayupdatelistener(DisplayState *ds, DisplayUpdat
 }
 
 void unregister_displayupdatelistener(DisplayState *ds, DisplayUpdateListener *dul);
+
+/* The GUI timer slows down after a while without display updates nor
+ * user input, see gui_update(). Call this on any activity that must be
+ * handled at the full refresh rate, e.g. a guest framebuffer post. */
+void gui_notify_activity(void);
 #endif
 
 static inline void dpy_update(DisplayState *s, int x, int y, int w, int h)
@@ -465,6 +470,9 @@ int vnc_display_open(DisplayState *ds, const char *display);
 int vnc_display_password(DisplayState *ds, const char *password);
 void do_info_vnc(Monitor *mon);
 char *vnc_display_local_addr(DisplayState *ds);
+/* Receives GPU frames, see gpu_frame_set_damage_post_callback() */
+void vnc_display_gpu_frame(void *opaque, int width, int height,
+                           const void *pixels, int x, int y, int w, int h);
 
 /* curses.c */
 void curses_display_init(DisplayState *ds, int full_screen);
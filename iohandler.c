@@ -26,6 +26,7 @@
 #include "qemu-common.h"
 #include "sysemu/char.h"
 #include "qemu/queue.h"
+#include "android/iolooper.h"
 
 #ifndef _WIN32
 #include <sys/wait.h>
@@ -38,12 +39,115 @@ typedef struct IOHandlerRecord {
     IOHandler *fd_write;
     int deleted;
     void *opaque;
+    int events;       /* IOLOOPER_* events registered with io_looper */
+    int use_select;   /* io_looper can't watch fd, use the fd_sets */
+    int polled;       /* in io_handlers_polled */
     QLIST_ENTRY(IOHandlerRecord) next;
+    QLIST_ENTRY(IOHandlerRecord) next_polled;
 } IOHandlerRecord;
 
 static QLIST_HEAD(, IOHandlerRecord) io_handlers =
     QLIST_HEAD_INITIALIZER(io_handlers);
 
+/*
+ * When the host supports epoll or kqueue, the handlers stay registered
+ * with io_looper, which only talks to the kernel when their events change.
+ * qemu_iohandler_fill() then adds the single descriptor of the looper to
+ * the fd_sets, and qemu_iohandler_poll() only dispatches the handlers that
+ * have pending events.
+ *
+ * The records that need work at each iteration are kept in
+ * io_handlers_polled: those with an fd_read_poll callback, whose result
+ * decides whether to watch for reads, and those that go through the
+ * fd_sets. Without a looper (e.g. on Windows), this is all of them.
+ */
+static IoLooper *io_looper;
+static int io_looper_fd = -1;
+static int io_looper_inited;
+
+static QLIST_HEAD(, IOHandlerRecord) io_handlers_polled =
+    QLIST_HEAD_INITIALIZER(io_handlers_polled);
+
+/* Record of each descriptor, only used with io_looper */
+static IOHandlerRecord **io_handlers_by_fd;
+static int io_handlers_by_fd_size;
+
+static int io_handlers_deleted;
+
+static void qemu_iohandler_init(void)
+{
+    if (io_looper_inited)
+        return;
+    io_looper_inited = 1;
+
+    io_looper = iolooper_new();
+    io_looper_fd = iolooper_fd(io_looper);
+    if (io_looper_fd < 0) {
+        iolooper_free(io_looper);
+        io_looper = NULL;
+    }
+}
+
+static IOHandlerRecord *qemu_iohandler_lookup(int fd)
+{
+    IOHandlerRecord *ioh;
+
+    if (io_looper) {
+        if (fd < 0 || fd >= io_handlers_by_fd_size)
+            return NULL;
+        return io_handlers_by_fd[fd];
+    }
+    QLIST_FOREACH(ioh, &io_handlers, next) {
+        if (ioh->fd == fd)
+            return ioh;
+    }
+    return NULL;
+}
+
+/*
+ * Records stay in io_handlers_polled until they are freed, so that the
+ * handlers dispatched while it is walked can't unlink the next one.
+ */
+static void qemu_iohandler_set_polled(IOHandlerRecord *ioh)
+{
+    if (ioh->polled)
+        return;
+    if (!io_looper || ioh->use_select || ioh->fd_read_poll) {
+        QLIST_INSERT_HEAD(&io_handlers_polled, ioh, next_polled);
+        ioh->polled = 1;
+    }
+}
+
+static void qemu_iohandler_unregister(IOHandlerRecord *ioh)
+{
+    if (ioh->events) {
+        iolooper_modify(io_looper, ioh->fd, ioh->events, 0);
+        ioh->events = 0;
+    }
+}
+
+/* Tell io_looper which events |ioh| currently wants */
+static void qemu_iohandler_update(IOHandlerRecord *ioh)
+{
+    int events = 0;
+
+    if (ioh->fd_read &&
+        (!ioh->fd_read_poll || ioh->fd_read_poll(ioh->opaque) != 0))
+        events |= IOLOOPER_READ;
+    if (ioh->fd_write)
+        events |= IOLOOPER_WRITE;
+
+    if (events == ioh->events)
+        return;
+    if (iolooper_modify(io_looper, ioh->fd, ioh->events, events) < 0) {
+        /* e.g. a regular file, which epoll refuses */
+        qemu_iohandler_unregister(ioh);
+        ioh->use_select = 1;
+        qemu_iohandler_set_polled(ioh);
+        return;
+    }
+    ioh->events = events;
+}
 
 /* XXX: fd_read_poll should be suppressed, but an API change is
    necessary in the character devices to suppress fd_can_read(). */
@@ -55,27 +159,53 @@ int qemu_set_fd_handler2(int fd,
 {
     IOHandlerRecord *ioh;
 
+    qemu_iohandler_init();
+
+    ioh = qemu_iohandler_lookup(fd);
     if (!fd_read && !fd_write) {
-        QLIST_FOREACH(ioh, &io_handlers, next) {
-            if (ioh->fd == fd) {
-                ioh->deleted = 1;
-                break;
-            }
+        if (ioh && !ioh->deleted) {
+            ioh->deleted = 1;
+            io_handlers_deleted++;
+            /* before the caller closes fd, its number may be reused */
+            qemu_iohandler_unregister(ioh);
         }
     } else {
-        QLIST_FOREACH(ioh, &io_handlers, next) {
-            if (ioh->fd == fd)
-                goto found;
+        if (!ioh) {
+            ioh = g_malloc0(sizeof(IOHandlerRecord));
+            ioh->fd = fd;
+            QLIST_INSERT_HEAD(&io_handlers, ioh, next);
+            if (io_looper && fd >= 0) {
+                if (fd >= io_handlers_by_fd_size) {
+                    int size = io_handlers_by_fd_size ?
+                               io_handlers_by_fd_size : 64;
+
+                    while (size <= fd)
+                        size *= 2;
+                    io_handlers_by_fd = g_realloc(io_handlers_by_fd,
+                                                  size * sizeof(*io_handlers_by_fd));
+                    memset(io_handlers_by_fd + io_handlers_by_fd_size, 0,
+                           (size - io_handlers_by_fd_size) *
+                           sizeof(*io_handlers_by_fd));
+                    io_handlers_by_fd_size = size;
+                }
+                io_handlers_by_fd[fd] = ioh;
+            }
+        } else if (ioh->deleted) {
+            /* the descriptor may be another file now */
+            ioh->use_select = 0;
+            io_handlers_deleted--;
         }
-        ioh = g_malloc0(sizeof(IOHandlerRecord));
-        QLIST_INSERT_HEAD(&io_handlers, ioh, next);
-    found:
-        ioh->fd = fd;
         ioh->fd_read_poll = fd_read_poll;
         ioh->fd_read = fd_read;
         ioh->fd_write = fd_write;
         ioh->opaque = opaque;
         ioh->deleted = 0;
+        if (io_looper && fd < 0)
+            ioh->use_select = 1;
+        qemu_iohandler_set_polled(ioh);
+        /* fd_read_poll is only called from qemu_iohandler_fill() */
+        if (io_looper && !ioh->use_select && !fd_read_poll)
+            qemu_iohandler_update(ioh);
     }
     return 0;
 }
@@ -92,9 +222,16 @@ void qemu_iohandler_fill(int *pnfds, fd_set *readfds, fd_set *writefds, fd_set *
 {
     IOHandlerRecord *ioh;
 
-    QLIST_FOREACH(ioh, &io_handlers, next) {
+    qemu_iohandler_init();
+
+    QLIST_FOREACH(ioh, &io_handlers_polled, next_polled) {
         if (ioh->deleted)
             continue;
+        if (io_looper && !ioh->use_select) {
+            qemu_iohandler_update(ioh);
+            if (!ioh->use_select)
+                continue;
+        }
         if (ioh->fd_read &&
             (!ioh->fd_read_poll ||
              ioh->fd_read_poll(ioh->opaque) != 0)) {
@@ -108,27 +245,72 @@ void qemu_iohandler_fill(int *pnfds, fd_set *readfds, fd_set *writefds, fd_set *
                 *pnfds = ioh->fd;
         }
     }
+
+    if (io_looper) {
+        FD_SET(io_looper_fd, readfds);
+        if (io_looper_fd > *pnfds)
+            *pnfds = io_looper_fd;
+    }
+}
+
+/* Dispatch the events reported by io_looper */
+static void qemu_iohandler_poll_looper(void)
+{
+    IOHandlerRecord *ioh;
+    int fd, flags;
+
+    if (iolooper_wait(io_looper, 0) <= 0)
+        return;
+
+    while ((fd = iolooper_next_pending(io_looper, &flags)) >= 0) {
+        ioh = qemu_iohandler_lookup(fd);
+        if (!ioh || ioh->use_select)
+            continue;
+        /* the handlers of an earlier descriptor may have changed ioh */
+        flags &= ioh->events;
+        if (!ioh->deleted && ioh->fd_read && (flags & IOLOOPER_READ)) {
+            ioh->fd_read(ioh->opaque);
+        }
+        if (!ioh->deleted && ioh->fd_write && (flags & IOLOOPER_WRITE)) {
+            ioh->fd_write(ioh->opaque);
+        }
+    }
 }
 
 void qemu_iohandler_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds, int ret)
 {
+    IOHandlerRecord *pioh, *ioh;
+
     if (ret > 0) {
-        IOHandlerRecord *pioh, *ioh;
+        if (io_looper && FD_ISSET(io_looper_fd, readfds)) {
+            qemu_iohandler_poll_looper();
+        }
 
-        QLIST_FOREACH_SAFE(ioh, &io_handlers, next, pioh) {
+        QLIST_FOREACH_SAFE(ioh, &io_handlers_polled, next_polled, pioh) {
+            if (io_looper && !ioh->use_select)
+                continue;
             if (!ioh->deleted && ioh->fd_read && FD_ISSET(ioh->fd, readfds)) {
                 ioh->fd_read(ioh->opaque);
             }
             if (!ioh->deleted && ioh->fd_write && FD_ISSET(ioh->fd, writefds)) {
                 ioh->fd_write(ioh->opaque);
             }
+        }
+    }
 
-            /* Do this last in case read/write handlers marked it for deletion */
-            if (ioh->deleted) {
-                QLIST_REMOVE(ioh, next);
-                g_free(ioh);
-            }
+    /* Do this last in case read/write handlers marked them for deletion */
+    if (io_handlers_deleted > 0) {
+        QLIST_FOREACH_SAFE(ioh, &io_handlers, next, pioh) {
+            if (!ioh->deleted)
+                continue;
+            QLIST_REMOVE(ioh, next);
+            if (ioh->polled)
+                QLIST_REMOVE(ioh, next_polled);
+            if (io_looper && qemu_iohandler_lookup(ioh->fd) == ioh)
+                io_handlers_by_fd[ioh->fd] = NULL;
+            g_free(ioh);
         }
+        io_handlers_deleted = 0;
     }
 }
 
@@ -278,6 +278,37 @@ int kvm_log_stop(hwaddr phys_addr, ram_addr_t size)
                                           KVM_MEM_LOG_DIRTY_PAGES);
 }
 
+/*
+ * Move the guest RAM range [phys_addr, phys_addr + size) to a slot of its
+ * own and log its dirty pages, so that kvm_physical_sync_dirty_bitmap()
+ * over the range only fetches the bitmap of these pages instead of the
+ * one of the whole RAM slot. The range must be inside a single slot; it
+ * is not mapped while the slot is split, so no vcpu should be running.
+ */
+int kvm_log_range_start(hwaddr phys_addr, ram_addr_t size)
+{
+    KVMState *s = kvm_state;
+    KVMSlot *mem;
+    ram_addr_t phys_offset;
+
+    size = TARGET_PAGE_ALIGN(phys_addr + size) -
+           (phys_addr & TARGET_PAGE_MASK);
+    phys_addr &= TARGET_PAGE_MASK;
+
+    if (!kvm_lookup_matching_slot(s, phys_addr, size)) {
+        mem = kvm_lookup_overlapping_slot(s, phys_addr, size);
+        if (mem == NULL || phys_addr < mem->start_addr ||
+            phys_addr + size > mem->start_addr + mem->memory_size) {
+            return -EINVAL;
+        }
+        phys_offset = mem->phys_offset + (phys_addr - mem->start_addr);
+        /* the first call only splits the slot around the range */
+        kvm_set_phys_mem(phys_addr, size, IO_MEM_UNASSIGNED);
+        kvm_set_phys_mem(phys_addr, size, phys_offset);
+    }
+    return kvm_log_start(phys_addr, size);
+}
+
 int kvm_set_migration_log(int enable)
 {
     KVMState *s = kvm_state;
@@ -609,7 +640,9 @@ int kvm_cpu_exec(CPUState *cpu)
         }
 
         kvm_arch_pre_run(cpu, run);
+        qemu_mutex_unlock_iothread();
         ret = kvm_arch_vcpu_run(cpu);
+        qemu_mutex_lock_iothread();
         kvm_arch_post_run(cpu, run);
 
         if (ret == -EINTR || ret == -EAGAIN) {
@@ -876,6 +909,22 @@ int kvm_vcpu_ioctl(CPUState *cpu, int type, ...)
     return ret;
 }
 
+int kvm_set_signal_mask(CPUState *cpu, const sigset_t *sigset)
+{
+    struct kvm_signal_mask *sigmask;
+    int r;
+
+    sigmask = g_malloc(sizeof(*sigmask) + sizeof(*sigset));
+
+    /* the kernel's sigset_t, not the libc one */
+    sigmask->len = 8;
+    memcpy(sigmask->sigset, sigset, sizeof(*sigset));
+    r = kvm_vcpu_ioctl(cpu, KVM_SET_SIGNAL_MASK, sigmask);
+    g_free(sigmask);
+
+    return r;
+}
+
 int kvm_has_sync_mmu(void)
 {
 #ifdef KVM_CAP_SYNC_MMU
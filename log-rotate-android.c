@@ -11,6 +11,7 @@
 
 #include "android/log-rotate.h"
 #include "net/net.h"
+#include "qemu/log.h"
 #include "slirp-android/libslirp.h"
 #include "sysemu/sysemu.h"
 
@@ -81,12 +82,15 @@ void qemu_log_rotation_poll(void) {
     if (!rotate_logs_requested)
         return;
 
+    slirp_lock();
     FILE* new_dns_log_fd = rotate_log(get_slirp_dns_log_fd(),
                                       dns_log_filename);
     FILE* new_drop_log_fd = rotate_log(get_slirp_drop_log_fd(),
                                        drop_log_filename);
     slirp_dns_log_fd(new_dns_log_fd);
     slirp_drop_log_fd(new_drop_log_fd);
+    slirp_unlock();
+    qemu_log_binary_rotate();
     rotate_logs_requested = 0;
 }
 
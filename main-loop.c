@@ -31,6 +31,7 @@
 #include "monitor/monitor.h"
 #include "net/net.h"
 #include "qemu-common.h"
+#include "qemu/atomic.h"
 #include "qemu/sockets.h"
 #include "qemu/timer.h"
 #include "slirp-android/libslirp.h"
@@ -39,6 +40,7 @@
 
 #ifdef __linux__
 #include <sys/ioctl.h>
+#include <sys/prctl.h>
 #endif
 
 #ifdef _WIN32
@@ -60,12 +62,20 @@ static QEMUTimer *icount_vm_timer;
 #ifndef _WIN32
 static int io_thread_fd = -1;
 
+/* Set once the main loop was woken up, until it handles the wakeup */
+static int io_thread_notified;
+
 static void qemu_event_read(void *opaque)
 {
     int fd = (unsigned long)opaque;
     ssize_t len;
 
-    /* Drain the notify pipe */
+    /* The events that follow must write again. This is done before the
+     * drain, since the rest of the iteration (timers, bottom halves)
+     * handles the earlier ones. */
+    atomic_mb_set(&io_thread_notified, 0);
+
+    /* Drain the notify pipe or eventfd */
     do {
         char buffer[512];
         len = read(fd, buffer, sizeof(buffer));
@@ -77,7 +87,7 @@ static int qemu_main_loop_event_init(void)
     int err;
     int fds[2];
 
-    err = pipe(fds);
+    err = qemu_eventfd(fds);
     if (err == -1)
         return -errno;
 
@@ -103,8 +113,11 @@ fail:
 #else
 HANDLE qemu_event_handle;
 
+static int io_thread_notified;
+
 static void dummy_event_handler(void *opaque)
 {
+    atomic_mb_set(&io_thread_notified, 0);
 }
 
 static int qemu_main_loop_event_init(void)
@@ -121,9 +134,35 @@ static int qemu_main_loop_event_init(void)
 
 int qemu_init_main_loop(void)
 {
+    qemu_init_cpu_loop();
     return qemu_main_loop_event_init();
 }
 
+/* Only the first wakeup of an iteration needs a system call */
+static int qemu_main_loop_notified(void)
+{
+    return atomic_read(&io_thread_notified) ||
+           atomic_xchg(&io_thread_notified, 1);
+}
+
+void qemu_main_loop_wakeup(void)
+{
+#ifndef _WIN32
+    /* Write 8 bytes to be compatible with eventfd, a full pipe is fine */
+    static const uint64_t val = 1;
+    ssize_t ret;
+
+    if (io_thread_fd == -1 || qemu_main_loop_notified())
+        return;
+    do {
+        ret = write(io_thread_fd, &val, sizeof(val));
+    } while (ret < 0 && errno == EINTR);
+#else
+    if (qemu_event_handle && !qemu_main_loop_notified())
+        SetEvent(qemu_event_handle);
+#endif
+}
+
 #ifndef _WIN32
 
 static inline void os_host_main_loop_wait(int *timeout)
@@ -259,18 +298,30 @@ void os_host_main_loop_wait(int *timeout)
 
 static void qemu_run_alarm_timer(void);  // forward
 
+/* Exact timer deadline behind the last qemu_calculate_timeout(), -1 if none */
+static int64_t main_loop_timeout_ns = -1;
+
+/* Timer deadlines are rounded up to a multiple of this, 0 for none */
+static int64_t timer_slack_ns;
+
 void main_loop_wait(int timeout)
 {
     fd_set rfds, wfds, xfds;
     int ret, nfds;
     struct timeval tv;
+    int64_t timeout_ns;
 
     qemu_bh_update_timeout(&timeout);
 
     os_host_main_loop_wait(&timeout);
 
-    tv.tv_sec = timeout / 1000;
-    tv.tv_usec = (timeout % 1000) * 1000;
+    /* Sleep until the timer deadline itself, not the next millisecond,
+     * unless a bottom half or a host event shortened the timeout. */
+    timeout_ns = (int64_t)timeout * SCALE_MS;
+    if (main_loop_timeout_ns >= 0 && main_loop_timeout_ns < timeout_ns) {
+        timeout_ns = main_loop_timeout_ns;
+    }
+    main_loop_timeout_ns = -1;
 
     /* poll any events */
 
@@ -280,15 +331,23 @@ void main_loop_wait(int timeout)
     FD_ZERO(&wfds);
     FD_ZERO(&xfds);
     qemu_iohandler_fill(&nfds, &rfds, &wfds, &xfds);
-    if (slirp_is_inited()) {
+    if (slirp_is_inited() && !slirp_is_threaded()) {
         slirp_select_fill(&nfds, &rfds, &wfds, &xfds);
+        slirp_update_timeout(&timeout_ns);
     }
+    /* without a periodic alarm, nothing else would retry the delivery */
+    if (charpipe_has_pending() && timeout_ns > SCALE_MS) {
+        timeout_ns = SCALE_MS;
+    }
+
+    tv.tv_sec = timeout_ns / 1000000000LL;
+    tv.tv_usec = (timeout_ns % 1000000000LL + 999) / 1000;
 
     qemu_mutex_unlock_iothread();
     ret = select(nfds + 1, &rfds, &wfds, &xfds, &tv);
     qemu_mutex_lock_iothread();
     qemu_iohandler_poll(&rfds, &wfds, &xfds, ret);
-    if (slirp_is_inited()) {
+    if (slirp_is_inited() && !slirp_is_threaded()) {
         if (ret < 0) {
             FD_ZERO(&rfds);
             FD_ZERO(&wfds);
@@ -313,8 +372,13 @@ void main_loop(void)
     int r;
 
 #ifdef CONFIG_HAX
-    if (hax_enabled())
+    if (hax_enabled()) {
+        /* the vCPU threads may already be in the guest */
+        pause_all_vcpus();
         hax_sync_vcpus();
+        if (vm_running)
+            resume_all_vcpus();
+    }
 #endif
 
     for (;;) {
@@ -322,7 +386,6 @@ void main_loop(void)
 #ifdef CONFIG_PROFILER
             int64_t ti;
 #endif
-            tcg_cpu_exec();
 #ifdef CONFIG_PROFILER
             ti = profile_getclock();
 #endif
@@ -517,7 +580,20 @@ int64_t qemu_icount_round(int64_t count)
     return (count + (1 << icount_time_shift) - 1) >> icount_time_shift;
 }
 
+/* No host alarm at all: main_loop_wait() sleeps until the next timer
+ * deadline, and timer_mod() wakes it up when that deadline moves
+ * earlier, so an idle emulator doesn't wake up every millisecond. */
+static int tickless_start_timer(struct qemu_alarm_timer *t)
+{
+    return 0;
+}
+
+static void tickless_stop_timer(struct qemu_alarm_timer *t)
+{
+}
+
 static struct qemu_alarm_timer alarm_timers[] = {
+    {"tickless", tickless_start_timer, tickless_stop_timer, NULL},
 #ifndef _WIN32
     {"unix", unix_start_timer, unix_stop_timer, NULL},
 #ifdef __linux__
@@ -601,16 +677,15 @@ next:
     }
 }
 
-// This variable is used to notify the qemu_timer_alarm_pending() caller
-// (really tcg_cpu_exec()) that an alarm has expired. It is set in the
-// timer callback, which can be a signal handler on non-Windows platforms.
-static volatile sig_atomic_t timer_alarm_pending = 1;
-
-int qemu_timer_alarm_pending(void)
+void configure_timer_slack(int64_t slack_ns)
 {
-    int ret = timer_alarm_pending;
-    timer_alarm_pending = 0;
-    return ret;
+    timer_slack_ns = slack_ns;
+#ifdef __linux__
+    /* let the kernel coalesce the wakeups as much */
+    if (slack_ns > 0) {
+        prctl(PR_SET_TIMERSLACK, (unsigned long)slack_ns, 0, 0, 0);
+    }
+#endif
 }
 
 #if defined(__linux__) || defined(_WIN32)
@@ -645,17 +720,13 @@ static void host_alarm_handler(int host_signum)
     if (!t)
         return;
 
-    // It's not possible to call qemu_next_alarm_deadline() to know
-    // if a timer has really expired, in the case of non-dynamic alarms,
-    // so just signal and let the main loop thread do the checks instead.
-    timer_alarm_pending = 1;
-
     // Ensure a dynamic alarm will be properly rescheduled.
     if (alarm_has_dynticks(t))
         t->expired = 1;
 
-    // This forces a cpu_exit() call that will end the current CPU
-    // execution ASAP.
+    // It's not possible to call qemu_next_alarm_deadline() to know
+    // if a timer has really expired, in the case of non-dynamic alarms,
+    // so just wake up the main loop thread and let it do the checks.
     qemu_notify_event();
 }
 
@@ -799,7 +870,6 @@ static void CALLBACK mm_alarm_handler(UINT uTimerID, UINT uMsg,
     // doesn't run in a signal handler, but a different thread.
     if (alarm_has_dynticks(t) || qemu_next_alarm_deadline() <= 0) {
         t->expired = 1;
-        timer_alarm_pending = 1;
         qemu_notify_event();
     }
 }
@@ -970,7 +1040,6 @@ int init_timer_alarm(void)
 
     /* first event is at time 0 */
     alarm_timer = t;
-    timer_alarm_pending = 1;
     qemu_add_vm_change_state_handler(alarm_timer_on_change_state_rearm, t);
 
     return 0;
@@ -992,8 +1061,6 @@ int qemu_calculate_timeout(void)
 
     if (!vm_running)
         timeout = 5000;
-    else if (tcg_has_work())
-        timeout = 0;
     else {
 #ifdef WIN32
         /* This corresponds to the case where the emulated system is
@@ -1010,8 +1077,16 @@ int qemu_calculate_timeout(void)
         timeout = 5000;
 #endif
         int64_t timeout_ns = (int64_t)timeout * 1000000LL;
-        timeout_ns = qemu_soonest_timeout(
-                timeout_ns, timerlistgroup_deadline_ns(&main_loop_tlg));
+        int64_t deadline_ns = timerlistgroup_deadline_ns(&main_loop_tlg);
+
+        /* Timers expiring in the same slack period run in one wakeup */
+        if (timer_slack_ns > 0 && deadline_ns > 0) {
+            int64_t now = get_clock();
+            deadline_ns = QEMU_ALIGN_UP(now + deadline_ns, timer_slack_ns) -
+                          now;
+        }
+        timeout_ns = qemu_soonest_timeout(timeout_ns, deadline_ns);
+        main_loop_timeout_ns = timeout_ns;
         timeout = (int)((timeout_ns + 999999LL) / 1000000LL);
     }
 
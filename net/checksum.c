@@ -17,22 +17,16 @@
 
 #include "hw/hw.h"
 #include "net/net.h"
+#include "android/utils/ip_checksum.h"
 
 #define PROTO_TCP  6
 #define PROTO_UDP 17
 
 uint32_t net_checksum_add(int len, uint8_t *buf)
 {
-    uint32_t sum = 0;
-    int i;
-
-    for (i = 0; i < len; i++) {
-	if (i & 1)
-	    sum += (uint32_t)buf[i];
-	else
-	    sum += (uint32_t)buf[i] << 8;
-    }
-    return sum;
+    if (len <= 0)
+        return 0;
+    return ip_checksum_add(buf, len);
 }
 
 uint16_t net_checksum_finish(uint32_t sum)
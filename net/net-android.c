@@ -122,6 +122,7 @@
 #include "audio/audio.h"
 #include "qemu/sockets.h"
 #include "qemu/log.h"
+#include "qemu/thread.h"
 
 #if defined(CONFIG_SLIRP)
 #include "libslirp.h"
@@ -132,6 +133,7 @@
 #endif
 
 #include "android/android.h"
+#include "android/utils/perf_counters.h"
 #include "telephony/modem_driver.h"
 
 static VLANState *first_vlan;
@@ -712,12 +714,14 @@ NetShaper  slirp_shaper_in;
 NetShaper  slirp_shaper_out;
 NetDelay   slirp_delay_in;
 
+static void slirp_send_input(const uint8_t *pkt, int pkt_len);
+
 static void
 slirp_delay_in_cb( void*   data,
                    size_t  size,
                    void*   opaque )
 {
-    slirp_input( (const uint8_t*)data, (int)size );
+    slirp_send_input( (const uint8_t*)data, (int)size );
     (void)opaque;
 }
 
@@ -751,9 +755,246 @@ slirp_init_shapers( void )
 
 #endif /* CONFIG_ANDROID */
 
+/*
+ * Threaded slirp: if ANDROID_SLIRP_THREAD is set in the environment,
+ * slirp and its host sockets run on a dedicated thread instead of the
+ * main loop. Packets are passed between the NIC and slirp through two
+ * single-producer/single-consumer rings, and each side wakes up the
+ * other through a socket pair. Other calls into slirp from the main
+ * thread must be done between slirp_lock() and slirp_unlock().
+ */
+
+/* Must be a power of 2 */
+#define SLIRP_QUEUE_SIZE  512
+
+/* Select timeout of the slirp thread, enough for the TCP timers */
+#define SLIRP_THREAD_TIMEOUT_MS  100
+
+typedef struct {
+    int      len;
+    uint8_t  data[1];
+} SlirpPacket;
+
+typedef struct {
+    unsigned     head;  /* only written by the producer */
+    char         padding[64 - sizeof(unsigned)];
+    unsigned     tail;  /* only written by the consumer */
+    SlirpPacket* items[SLIRP_QUEUE_SIZE];
+} SlirpPacketQueue;
+
+typedef struct {
+    int  fds[2];   /* fds[0] is watched by the thread to wake up */
+    int  pending;  /* set when a byte was sent and not read yet */
+} SlirpWakeup;
+
+static int               slirp_threaded;
+static int               slirp_exec_count;
+static QemuThread        slirp_thread;
+static QemuMutex         slirp_mutex;
+static SlirpPacketQueue  slirp_queue_in;   /* main thread -> slirp */
+static SlirpPacketQueue  slirp_queue_out;  /* slirp -> main thread */
+static SlirpWakeup       slirp_wakeup_in;  /* wakes up the slirp thread */
+static SlirpWakeup       slirp_wakeup_out; /* wakes up the main loop */
+static int               slirp_out_blocked;
+
+static int slirp_queue_full(SlirpPacketQueue *q)
+{
+    return q->head - __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) >=
+           SLIRP_QUEUE_SIZE;
+}
+
+/* Copy a packet into |q|. Return 0 if it is full. */
+static int slirp_queue_push(SlirpPacketQueue *q, const uint8_t *pkt, int len)
+{
+    SlirpPacket *p;
+
+    if (slirp_queue_full(q))
+        return 0;
+    p = g_malloc(offsetof(SlirpPacket, data) + len);
+    p->len = len;
+    memcpy(p->data, pkt, len);
+    q->items[q->head % SLIRP_QUEUE_SIZE] = p;
+    __atomic_store_n(&q->head, q->head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+/* Return the next packet of |q|, to be g_free()-ed, or NULL */
+static SlirpPacket *slirp_queue_pop(SlirpPacketQueue *q)
+{
+    SlirpPacket *p;
+
+    if (__atomic_load_n(&q->head, __ATOMIC_ACQUIRE) == q->tail)
+        return NULL;
+    p = q->items[q->tail % SLIRP_QUEUE_SIZE];
+    __atomic_store_n(&q->tail, q->tail + 1, __ATOMIC_RELEASE);
+    return p;
+}
+
+static int slirp_wakeup_init(SlirpWakeup *w)
+{
+    if (socket_pair(&w->fds[0], &w->fds[1]) < 0)
+        return -1;
+    socket_set_nonblock(w->fds[0]);
+    socket_set_nonblock(w->fds[1]);
+    w->pending = 0;
+    return 0;
+}
+
+static void slirp_wakeup_signal(SlirpWakeup *w)
+{
+    char c = 0;
+
+    if (!__atomic_exchange_n(&w->pending, 1, __ATOMIC_ACQ_REL))
+        socket_send(w->fds[1], &c, 1);
+}
+
+/* Must be called before looking at the queue, so that
+ * packets pushed later send a new wake-up */
+static void slirp_wakeup_clear(SlirpWakeup *w)
+{
+    char buf[16];
+
+    __atomic_store_n(&w->pending, 0, __ATOMIC_SEQ_CST);
+    while (socket_recv(w->fds[0], buf, sizeof(buf)) > 0)
+        ;
+}
+
+static void slirp_deliver_output(const uint8_t *pkt, int pkt_len);
+
+/* Main loop handler, sends the packets of the slirp thread to the NIC */
+static void slirp_thread_output(void *opaque)
+{
+    SlirpPacket *p;
+
+    slirp_wakeup_clear(&slirp_wakeup_out);
+    while ((p = slirp_queue_pop(&slirp_queue_out)) != NULL) {
+        slirp_deliver_output(p->data, p->len);
+        g_free(p);
+    }
+    /* Let the slirp thread send the packets it held back */
+    if (__atomic_exchange_n(&slirp_out_blocked, 0, __ATOMIC_ACQ_REL))
+        slirp_wakeup_signal(&slirp_wakeup_in);
+    (void)opaque;
+}
+
+static void slirp_thread_input(void)
+{
+    SlirpPacket *p;
+
+    slirp_wakeup_clear(&slirp_wakeup_in);
+    while ((p = slirp_queue_pop(&slirp_queue_in)) != NULL) {
+        slirp_input(p->data, p->len);
+        g_free(p);
+    }
+}
+
+static void *slirp_thread_main(void *opaque)
+{
+    fd_set rfds, wfds, xfds;
+    struct timeval tv;
+    int nfds, ret;
+
+    for (;;) {
+        nfds = -1;
+        FD_ZERO(&rfds);
+        FD_ZERO(&wfds);
+        FD_ZERO(&xfds);
+
+        qemu_mutex_lock(&slirp_mutex);
+        slirp_thread_input();
+        slirp_select_fill(&nfds, &rfds, &wfds, &xfds);
+        qemu_mutex_unlock(&slirp_mutex);
+
+        FD_SET(slirp_wakeup_in.fds[0], &rfds);
+        if (slirp_wakeup_in.fds[0] > nfds)
+            nfds = slirp_wakeup_in.fds[0];
+
+        tv.tv_sec = 0;
+        tv.tv_usec = SLIRP_THREAD_TIMEOUT_MS * 1000;
+        ret = select(nfds + 1, &rfds, &wfds, &xfds, &tv);
+        if (ret < 0) {
+            FD_ZERO(&rfds);
+            FD_ZERO(&wfds);
+            FD_ZERO(&xfds);
+        }
+
+        qemu_mutex_lock(&slirp_mutex);
+        slirp_select_poll(&rfds, &wfds, &xfds);
+        qemu_mutex_unlock(&slirp_mutex);
+    }
+    (void)opaque;
+    return NULL;
+}
+
+/* Start the slirp thread if requested. Called once all network
+ * clients are set up. */
+static void slirp_thread_start(void)
+{
+    const char *env = getenv("ANDROID_SLIRP_THREAD");
+
+    if (!slirp_inited || !env || !env[0] || !strcmp(env, "0"))
+        return;
+
+    /* Forwarding to local commands or character devices needs
+     * the main loop */
+    if (slirp_exec_count > 0) {
+        fprintf(stderr, "Warning: guest forwarding in use, "
+                        "running slirp on the main loop\n");
+        return;
+    }
+
+    if (slirp_wakeup_init(&slirp_wakeup_in) < 0 ||
+        slirp_wakeup_init(&slirp_wakeup_out) < 0) {
+        fprintf(stderr, "Warning: could not create slirp thread sockets\n");
+        return;
+    }
+
+    qemu_mutex_init(&slirp_mutex);
+    qemu_set_fd_handler(slirp_wakeup_out.fds[0], slirp_thread_output,
+                        NULL, NULL);
+    slirp_threaded = 1;
+    qemu_thread_create(&slirp_thread, slirp_thread_main, NULL,
+                       QEMU_THREAD_DETACHED);
+}
+
+int slirp_is_threaded(void)
+{
+    return slirp_threaded;
+}
+
+void slirp_lock(void)
+{
+    if (slirp_threaded)
+        qemu_mutex_lock(&slirp_mutex);
+}
+
+void slirp_unlock(void)
+{
+    if (slirp_threaded)
+        qemu_mutex_unlock(&slirp_mutex);
+}
+
+/* Pass a packet from the NIC to slirp */
+static void slirp_send_input(const uint8_t *pkt, int pkt_len)
+{
+    if (!slirp_threaded) {
+        slirp_input(pkt, pkt_len);
+        return;
+    }
+    /* Drop the packet if the queue is full, as a real NIC would */
+    if (slirp_queue_push(&slirp_queue_in, pkt, pkt_len))
+        slirp_wakeup_signal(&slirp_wakeup_in);
+}
 
 int slirp_can_output(void)
 {
+    if (slirp_threaded) {
+        if (!slirp_queue_full(&slirp_queue_out))
+            return 1;
+        __atomic_store_n(&slirp_out_blocked, 1, __ATOMIC_SEQ_CST);
+        /* The queue may have been drained in the meantime */
+        return !slirp_queue_full(&slirp_queue_out);
+    }
 #ifdef CONFIG_ANDROID
     return !slirp_vc ||
            ( netshaper_can_send(slirp_shaper_out) &&
@@ -763,7 +1004,21 @@ int slirp_can_output(void)
 #endif
 }
 
+static PerfCounter slirp_packets_to_guest_counter =
+    PERF_COUNTER_INIT("slirp.packets_to_guest", "packets");
+
 void slirp_output(const uint8_t *pkt, int pkt_len)
+{
+    perfCounter_add(&slirp_packets_to_guest_counter, 1);
+    if (slirp_threaded) {
+        if (slirp_queue_push(&slirp_queue_out, pkt, pkt_len))
+            slirp_wakeup_signal(&slirp_wakeup_out);
+        return;
+    }
+    slirp_deliver_output(pkt, pkt_len);
+}
+
+static void slirp_deliver_output(const uint8_t *pkt, int pkt_len)
 {
 #ifdef DEBUG_SLIRP
     printf("slirp output:\n");
@@ -799,7 +1054,7 @@ static ssize_t slirp_receive(VLANClientState *vc, const uint8_t *buf, size_t siz
 #ifdef CONFIG_ANDROID
     netshaper_send(slirp_shaper_in, (char*)buf, size);
 #else
-    slirp_input(buf, size);
+    slirp_send_input(buf, size);
 #endif
     return size;
 }
@@ -880,7 +1135,9 @@ static void net_slirp_redir_list(Monitor *mon)
 
     monitor_printf(mon, " Prot |    Host Addr    | HPort |    Guest Addr   | GPort\n");
     monitor_printf(mon, "      |                 |       |                 |      \n");
+    slirp_lock();
     slirp_redir_loop(net_slirp_redir_print, mon);
+    slirp_unlock();
 }
 
 static void net_slirp_redir_rm(Monitor *mon, const char *port_str)
@@ -909,7 +1166,9 @@ static void net_slirp_redir_rm(Monitor *mon, const char *port_str)
 
     host_port = atoi(p);
 
+    slirp_lock();
     n = slirp_redir_rm(is_udp, host_port);
+    slirp_unlock();
 
     monitor_printf(mon, "removed %d redirections to %s port %d\n", n,
                         is_udp ? "udp" : "tcp", host_port);
@@ -925,7 +1184,7 @@ static void slirp_redirection(Monitor *mon, const char *redir_str)
     int host_port, guest_port;
     const char *p;
     char buf[256], *r;
-    int is_udp;
+    int is_udp, ret;
 
     p = redir_str;
     if (get_str_sep(buf, sizeof(buf), &p, ':') < 0) {
@@ -962,7 +1221,10 @@ static void slirp_redirection(Monitor *mon, const char *redir_str)
         goto fail_syntax;
     }
 
-    if (slirp_redir(is_udp, host_port, guest_addr, guest_port) < 0) {
+    slirp_lock();
+    ret = slirp_redir(is_udp, host_port, guest_addr, guest_port);
+    slirp_unlock();
+    if (ret < 0) {
         config_error(mon, "could not set up redirection '%s'\n", redir_str);
     }
     return;
@@ -1082,6 +1344,7 @@ static void slirp_smb(const char *exported_dir)
              SMBD_COMMAND, smb_conf);
 
     slirp_add_exec(0, smb_cmdline, 4, 139);
+    slirp_exec_count++;
 }
 
 /* automatic user mode samba server configuration */
@@ -2284,6 +2547,7 @@ int net_client_init(Monitor *mon, const char *device, const char *p)
         }
         vmc->port = port;
         slirp_add_exec(3, vmc->hd, 4, port);
+        slirp_exec_count++;
         qemu_chr_add_handlers(vmc->hd, vmchannel_can_read, vmchannel_read,
                 NULL, vmc);
         ret = 0;
@@ -2611,6 +2875,9 @@ void net_client_check(void)
                     "Warning: vlan %d is not connected to host network\n",
                     vlan->id);
     }
+#if defined(CONFIG_SLIRP)
+    slirp_thread_start();
+#endif
 }
 
 int
@@ -0,0 +1,296 @@
+/*
+ * Binary trace output
+ *
+ * Copyright (c) 2015 The Android Open Source Project
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu-common.h"
+#include "qemu/log.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+
+/* 64 KiB of records per chunk */
+#define CHUNK_RECORDS  4096
+
+/* Producers wait for the writer when that many chunks are in flight,
+ * rather than dropping records or using unbounded memory.
+ */
+#define MAX_CHUNKS  64
+
+typedef struct LogChunk LogChunk;
+
+struct LogChunk {
+    LogChunk *next;
+    uint64_t seq;
+    QEMULogChunkHeader header;
+    QEMULogRecord records[CHUNK_RECORDS];
+};
+
+DEFINE_TLS(QEMULogRecord *, qemu_log_rec_next);
+DEFINE_TLS(QEMULogRecord *, qemu_log_rec_end);
+static DEFINE_TLS(LogChunk *, log_chunk);
+/* index of the calling thread in the trace, plus one */
+static DEFINE_TLS(int, log_thread);
+
+/* Records appended while the trace is closed, and discarded */
+static QEMULogRecord discarded_records[CHUNK_RECORDS];
+
+static struct {
+    bool running;
+    char *filename;
+    FILE *file;
+    QemuThread thread;
+    QemuMutex lock;
+    QemuCond work_cond;
+    QemuCond free_cond;
+    /* all fields below are protected by lock */
+    LogChunk *full_head;
+    LogChunk **full_tail;
+    LogChunk *free_list;
+    int num_chunks;
+    int num_threads;
+    uint64_t next_seq;
+    bool rotate_pending;
+    uint64_t rotate_seq;
+    bool quit;
+} binlog;
+
+static FILE *binlog_fopen(const char *filename)
+{
+    QEMULogBinaryHeader header;
+    FILE *f = fopen(filename, "wb");
+
+    if (!f) {
+        return NULL;
+    }
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, QEMU_LOG_BINARY_MAGIC, sizeof(header.magic));
+    header.version = QEMU_LOG_BINARY_VERSION;
+    header.record_size = sizeof(QEMULogRecord);
+    header.chunk_header_size = sizeof(QEMULogChunkHeader);
+    fwrite(&header, sizeof(header), 1, f);
+    return f;
+}
+
+static void binlog_write(LogChunk *chunk)
+{
+    size_t size = chunk->header.count * sizeof(QEMULogRecord);
+
+    if (!binlog.file) {
+        return;
+    }
+    if (fwrite(&chunk->header, sizeof(chunk->header), 1, binlog.file) != 1 ||
+        fwrite(chunk->records, 1, size, binlog.file) != size) {
+        fprintf(stderr, "Cannot write binary log %s, stopping the trace\n",
+                binlog.filename);
+        fclose(binlog.file);
+        binlog.file = NULL;
+    }
+}
+
+static void binlog_reopen(void)
+{
+    if (binlog.file) {
+        fclose(binlog.file);
+    }
+    binlog.file = binlog_fopen(binlog.filename);
+    if (!binlog.file) {
+        perror(binlog.filename);
+    }
+}
+
+/* The writer thread, the only one to touch binlog.file once started */
+static void *binlog_writer(void *opaque)
+{
+    LogChunk *chunk;
+
+    qemu_mutex_lock(&binlog.lock);
+    for (;;) {
+        while (!binlog.full_head && !binlog.rotate_pending && !binlog.quit) {
+            qemu_cond_wait(&binlog.work_cond, &binlog.lock);
+        }
+        if (binlog.rotate_pending &&
+            (!binlog.full_head || binlog.full_head->seq >= binlog.rotate_seq)) {
+            binlog.rotate_pending = false;
+            qemu_mutex_unlock(&binlog.lock);
+            binlog_reopen();
+            qemu_mutex_lock(&binlog.lock);
+            continue;
+        }
+        chunk = binlog.full_head;
+        if (!chunk) {
+            break;
+        }
+        binlog.full_head = chunk->next;
+        if (!binlog.full_head) {
+            binlog.full_tail = &binlog.full_head;
+        }
+        qemu_mutex_unlock(&binlog.lock);
+
+        binlog_write(chunk);
+
+        qemu_mutex_lock(&binlog.lock);
+        chunk->next = binlog.free_list;
+        binlog.free_list = chunk;
+        qemu_cond_signal(&binlog.free_cond);
+    }
+    qemu_mutex_unlock(&binlog.lock);
+    if (binlog.file) {
+        fflush(binlog.file);
+    }
+    return NULL;
+}
+
+/* Queue the chunk of the calling thread, if any. Called with the lock. */
+static void binlog_submit_locked(void)
+{
+    LogChunk *chunk = tls_var(log_chunk);
+
+    if (!chunk) {
+        return;
+    }
+    chunk->header.count = tls_var(qemu_log_rec_next) - chunk->records;
+    chunk->header.end_ns = get_clock();
+    chunk->seq = binlog.next_seq++;
+    chunk->next = NULL;
+    *binlog.full_tail = chunk;
+    binlog.full_tail = &chunk->next;
+    qemu_cond_signal(&binlog.work_cond);
+
+    tls_var(log_chunk) = NULL;
+    tls_var(qemu_log_rec_next) = NULL;
+    tls_var(qemu_log_rec_end) = NULL;
+}
+
+QEMULogRecord *qemu_log_binary_next_chunk(void)
+{
+    LogChunk *chunk;
+
+    if (!binlog.running) {
+        tls_var(qemu_log_rec_next) = discarded_records;
+        tls_var(qemu_log_rec_end) = discarded_records + CHUNK_RECORDS;
+        return discarded_records;
+    }
+    qemu_mutex_lock(&binlog.lock);
+    if (!tls_var(log_thread)) {
+        tls_var(log_thread) = ++binlog.num_threads;
+    }
+    binlog_submit_locked();
+    while (!binlog.free_list && binlog.num_chunks >= MAX_CHUNKS) {
+        qemu_cond_wait(&binlog.free_cond, &binlog.lock);
+    }
+    chunk = binlog.free_list;
+    if (chunk) {
+        binlog.free_list = chunk->next;
+    } else {
+        chunk = g_malloc(sizeof(*chunk));
+        binlog.num_chunks++;
+    }
+    qemu_mutex_unlock(&binlog.lock);
+
+    chunk->header.magic = QEMU_LOG_CHUNK_MAGIC;
+    chunk->header.thread = tls_var(log_thread) - 1;
+    chunk->header.count = 0;
+    chunk->header.reserved = 0;
+    chunk->header.start_ns = get_clock();
+    tls_var(log_chunk) = chunk;
+    tls_var(qemu_log_rec_next) = chunk->records;
+    tls_var(qemu_log_rec_end) = chunk->records + CHUNK_RECORDS;
+    return chunk->records;
+}
+
+static void binlog_atexit(void)
+{
+    qemu_log_binary_close();
+}
+
+void qemu_log_binary_open(const char *filename)
+{
+    static bool atexit_done;
+
+    if (binlog.running) {
+        return;
+    }
+    binlog.filename = g_strdup(filename);
+    binlog.file = binlog_fopen(filename);
+    if (!binlog.file) {
+        perror(filename);
+        _exit(1);
+    }
+    qemu_mutex_init(&binlog.lock);
+    qemu_cond_init(&binlog.work_cond);
+    qemu_cond_init(&binlog.free_cond);
+    binlog.full_head = NULL;
+    binlog.full_tail = &binlog.full_head;
+    binlog.rotate_pending = false;
+    binlog.quit = false;
+    qemu_thread_create(&binlog.thread, binlog_writer, NULL,
+                       QEMU_THREAD_JOINABLE);
+    binlog.running = true;
+    if (!atexit_done) {
+        atexit(binlog_atexit);
+        atexit_done = true;
+    }
+}
+
+void qemu_log_binary_close(void)
+{
+    LogChunk *chunk;
+
+    if (!binlog.running) {
+        return;
+    }
+    /* Only the chunk of the calling thread is written, the records still
+     * in the chunks of other threads are lost. In practice, the only
+     * producer is the TCG thread, which is also the one that changes the
+     * log level and exits.
+     */
+    qemu_mutex_lock(&binlog.lock);
+    binlog_submit_locked();
+    binlog.quit = true;
+    qemu_cond_signal(&binlog.work_cond);
+    qemu_mutex_unlock(&binlog.lock);
+    qemu_thread_join(&binlog.thread);
+    binlog.running = false;
+
+    if (binlog.file) {
+        fclose(binlog.file);
+        binlog.file = NULL;
+    }
+    while ((chunk = binlog.free_list) != NULL) {
+        binlog.free_list = chunk->next;
+        g_free(chunk);
+    }
+    binlog.num_chunks = 0;
+    qemu_cond_destroy(&binlog.free_cond);
+    qemu_cond_destroy(&binlog.work_cond);
+    qemu_mutex_destroy(&binlog.lock);
+    g_free(binlog.filename);
+    binlog.filename = NULL;
+}
+
+void qemu_log_binary_rotate(void)
+{
+    if (!binlog.running) {
+        return;
+    }
+    qemu_mutex_lock(&binlog.lock);
+    binlog_submit_locked();
+    binlog.rotate_pending = true;
+    binlog.rotate_seq = binlog.next_seq;
+    qemu_cond_signal(&binlog.work_cond);
+    qemu_mutex_unlock(&binlog.lock);
+}
@@ -80,6 +80,14 @@ void do_qemu_set_log(int log_flags, bool use_own_buffers)
     if (!qemu_loglevel && qemu_logfile) {
         qemu_log_close();
     }
+    if (qemu_loglevel & CPU_LOG_BINARY) {
+        char *filename = g_strdup_printf("%s.bin",
+                                         logfilename ? logfilename : "qemu");
+        qemu_log_binary_open(filename);
+        g_free(filename);
+    } else {
+        qemu_log_binary_close();
+    }
 }
 
 void qemu_set_log_filename(const char *filename)
@@ -87,6 +95,7 @@ void qemu_set_log_filename(const char *filename)
     g_free(logfilename);
     logfilename = g_strdup(filename);
     qemu_log_close();
+    qemu_log_binary_close();
     qemu_set_log(qemu_loglevel);
 }
 
@@ -117,6 +126,9 @@ const QEMULogItem qemu_log_items[] = {
     { LOG_GUEST_ERROR, "guest_errors",
       "log when the guest OS does something invalid (eg accessing a\n"
       "non-existent register)" },
+    { CPU_LOG_BINARY, "binary",
+      "write the exec and in_asm traces as binary records to\n"
+      "<logfile>.bin, see scripts/qemu-binlog-decode.py" },
     { 0, NULL, NULL },
 };
 
@@ -143,8 +155,11 @@ int qemu_str_to_log_mask(const char *str)
             p1 = p + strlen(p);
         }
         if (cmp1(p,p1-p,"all")) {
+            /* binary only changes the format of other items */
             for (item = qemu_log_items; item->mask != 0; item++) {
-                mask |= item->mask;
+                if (item->mask != CPU_LOG_BINARY) {
+                    mask |= item->mask;
+                }
             }
         } else {
             for (item = qemu_log_items; item->mask != 0; item++) {
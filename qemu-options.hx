@@ -92,6 +92,7 @@ DEF("drive", HAS_ARG, QEMU_OPTION_drive,
     "-drive [file=file][,if=type][,bus=n][,unit=m][,media=d][,index=i]\n"
     "       [,cyls=c,heads=h,secs=s[,trans=t]][,snapshot=on|off]\n"
     "       [,cache=writethrough|writeback|none][,format=f][,serial=s]\n"
+    "       [,aio=threads|native]\n"
     "                use 'file' as a drive image\n")
 STEXI
 @item -drive @var{option}[,@var{option}[,@var{option}[,...]]]
@@ -120,6 +121,9 @@ These options have the same definition as they have in @option{-hdachs}.
 @var{snapshot} is "on" or "off" and allows to enable snapshot for given drive (see @option{-snapshot}).
 @item cache=@var{cache}
 @var{cache} is "none", "writeback", or "writethrough" and controls how the host cache is used to access block data.
+@item aio=@var{aio}
+@var{aio} is "threads", or "native" and selects between pthread based disk I/O and native Linux AIO.
+Native AIO is only used with @option{cache=none}, other drives always use the thread pool.
 @item format=@var{format}
 Specify which disk @var{format} will be used rather than detecting
 the format.  Can be used to specifiy format=raw to avoid interpreting
@@ -1425,6 +1429,15 @@ Force the use of the given methods for timer alarm. To see what timers
 are available use -clock ?.
 ETEXI
 
+DEF("timer-slack", HAS_ARG, QEMU_OPTION_timer_slack, \
+    "-timer-slack <us> run the timers expiring within <us> microseconds together\n")
+STEXI
+@item -timer-slack @var{us}
+Round the timer deadlines of the main loop up to a multiple of @var{us}
+microseconds, so that the timers expiring close to each other run in a
+single wakeup. 0, the default, keeps the exact deadlines.
+ETEXI
+
 DEF("localtime", 0, QEMU_OPTION_localtime, \
     "-localtime      set the real time clock to local time [default=utc]\n")
 STEXI
@@ -1635,6 +1648,24 @@ DEF("tb-size", HAS_ARG, QEMU_OPTION_tb_size, \
 STEXI
 ETEXI
 
+DEF("tb-hot", HAS_ARG, QEMU_OPTION_tb_hot, \
+    "-tb-hot n       translate blocks without the optimizer until they\n"
+    "                have run n times, then translate them again with it\n")
+STEXI
+ETEXI
+
+DEF("tcg-stats", 0, QEMU_OPTION_tcg_stats, \
+    "-tcg-stats      count the TCG ops of each translated block before and\n"
+    "                after optimization, reported by 'info jit'\n")
+STEXI
+ETEXI
+
+DEF("tb-index", HAS_ARG, QEMU_OPTION_tb_index, \
+    "-tb-index file  keep an index of the translated blocks in 'file', to\n"
+    "                measure how much translation repeats across runs\n")
+STEXI
+ETEXI
+
 DEF("incoming", HAS_ARG, QEMU_OPTION_incoming, \
     "-incoming p     prepare for incoming migration, listen on port p\n")
 STEXI
@@ -1688,6 +1719,12 @@ DEF("code-profile", HAS_ARG, QEMU_OPTION_code_profile, \
     "which can be used to drive feedback directed optimizations. " \
     "More details can be found from https://gcc.gnu.org/wiki/AutoFDO.\n")
 
+DEF("code-profile-rate", HAS_ARG, QEMU_OPTION_code_profile_rate, \
+    "-code-profile-rate hz\n" \
+    "Sample the guest pc hz times per second for -code-profile, instead of\n" \
+    "recording every basic block. The samples of each process are stored\n" \
+    "as pprof CPU profiles.\n")
+
 #ifdef CONFIG_ANDROID
 DEF("savevm-on-exit", HAS_ARG, QEMU_OPTION_savevm_on_exit, \
     "savevm-on-exit [tag|id]\n" \
@@ -1712,6 +1749,18 @@ DEF("android-report-console", HAS_ARG, QEMU_OPTION_android_report_console, \
     "-android-report-console <socket>"
     " report console port to remote socket\n")
 
+DEF("gpu-record", HAS_ARG, QEMU_OPTION_gpu_record, \
+    "-gpu-record <file>"
+    " record the GPU-emulated display to a YUV4MPEG2 file\n")
+
+DEF("perf-stats", HAS_ARG, QEMU_OPTION_perf_stats, \
+    "-perf-stats <file>"
+    " append the performance counters to a file every 10 seconds\n")
+
+DEF("benchmark-boot", HAS_ARG, QEMU_OPTION_benchmark_boot, \
+    "-benchmark-boot <file>"
+    " write a boot time report to a file once the guest booted, then exit\n")
+
 DEF("http-proxy", HAS_ARG, QEMU_OPTION_http_proxy, \
     "-http-proxy <proxy>"
     " make TCP connections through a HTTP/HTTPS proxy\n")
@@ -1785,7 +1834,25 @@ DEF("audio-test-out", 0, QEMU_OPTION_audio_test_out, \
 DEF("snapshot-no-time-update", 0, QEMU_OPTION_snapshot_no_time_update, \
     "-snapshot-no-time-update Disable time update when restoring snapshots\n")
 
+DEF("snapshot-compress", HAS_ARG, QEMU_OPTION_snapshot_compress, \
+    "-snapshot-compress <level> Compress RAM in saved snapshots (zlib level 0-9)\n")
+
+DEF("qcow2-l2-cache", HAS_ARG, QEMU_OPTION_qcow2_l2_cache, \
+    "-qcow2-l2-cache <KB> Maximum size of the L2 table cache of each qcow2 image\n")
+
+DEF("snapshot-bench", HAS_ARG, QEMU_OPTION_snapshot_bench, \
+    "-snapshot-bench <dir> Benchmark snapshot save/load with synthetic RAM, then exit\n")
+
+DEF("sdcard-aio", HAS_ARG, QEMU_OPTION_sdcard_aio, \
+    "-sdcard-aio threads|native Access the SD Card image with native Linux AIO and O_DIRECT\n")
+
 DEF("list-webcam", 0, QEMU_OPTION_list_webcam, \
     "-list-webcam List web cameras available for emulation\n")
 
+DEF("mem-hugepages", 0, QEMU_OPTION_mem_hugepages, \
+    "-mem-hugepages Back guest RAM with huge pages (large pages on Windows)\n")
+
+DEF("ram-template", HAS_ARG, QEMU_OPTION_ram_template, \
+    "-ram-template <file> Share the pages of the -loadvm snapshot with other emulators through <file>\n")
+
 #endif /* ANDROID */
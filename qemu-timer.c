@@ -66,10 +66,18 @@ QEMUClock qemu_clocks[QEMU_CLOCK_MAX];
  * reenabling the clock can call all the notifiers.
  */
 
+/* The active timers of a list are kept in a binary min-heap ordered by
+ * expire_time, then by arming order, so that timer_mod() is O(log n)
+ * and timers with the same expiry still run in the order they were
+ * armed, like with the sorted list this replaced.
+ */
 struct QEMUTimerList {
     QEMUClock *clock;
     QemuMutex active_timers_lock;
-    QEMUTimer *active_timers;
+    QEMUTimer **active_timers;  /* active_timers[0] expires first */
+    int nb_active_timers;
+    int max_active_timers;
+    uint64_t next_seq;
     QLIST_ENTRY(QEMUTimerList) list;
     QEMUTimerListNotifyCB *notify_cb;
     void *notify_opaque;
@@ -96,6 +104,79 @@ static bool timer_expired_ns(QEMUTimer *timer_head, int64_t current_time)
     return timer_head && (timer_head->expire_time <= current_time);
 }
 
+static inline QEMUTimer *timerlist_first(QEMUTimerList *timer_list)
+{
+    return timer_list->nb_active_timers ? timer_list->active_timers[0] : NULL;
+}
+
+static inline bool timer_heap_less(QEMUTimer *a, QEMUTimer *b)
+{
+    return a->expire_time < b->expire_time ||
+           (a->expire_time == b->expire_time && a->seq < b->seq);
+}
+
+static inline void timer_heap_set(QEMUTimerList *timer_list, int index,
+                                  QEMUTimer *ts)
+{
+    timer_list->active_timers[index] = ts;
+    ts->heap_index = index;
+}
+
+/* move the timer at 'index' to its place in the heap */
+static void timer_heap_fix(QEMUTimerList *timer_list, int index)
+{
+    QEMUTimer **heap = timer_list->active_timers;
+    QEMUTimer *ts = heap[index];
+    int n = timer_list->nb_active_timers;
+
+    while (index > 0 && timer_heap_less(ts, heap[(index - 1) / 2])) {
+        timer_heap_set(timer_list, index, heap[(index - 1) / 2]);
+        index = (index - 1) / 2;
+    }
+    for (;;) {
+        int child = 2 * index + 1;
+
+        if (child >= n) {
+            break;
+        }
+        if (child + 1 < n && timer_heap_less(heap[child + 1], heap[child])) {
+            child++;
+        }
+        if (!timer_heap_less(heap[child], ts)) {
+            break;
+        }
+        timer_heap_set(timer_list, index, heap[child]);
+        index = child;
+    }
+    timer_heap_set(timer_list, index, ts);
+}
+
+static void timer_heap_insert(QEMUTimerList *timer_list, QEMUTimer *ts)
+{
+    if (timer_list->nb_active_timers == timer_list->max_active_timers) {
+        timer_list->max_active_timers =
+            MAX(16, 2 * timer_list->max_active_timers);
+        timer_list->active_timers =
+            g_realloc(timer_list->active_timers,
+                      timer_list->max_active_timers * sizeof(QEMUTimer *));
+    }
+    ts->seq = timer_list->next_seq++;
+    timer_heap_set(timer_list, timer_list->nb_active_timers++, ts);
+    timer_heap_fix(timer_list, ts->heap_index);
+}
+
+static void timer_heap_remove(QEMUTimerList *timer_list, QEMUTimer *ts)
+{
+    int index = ts->heap_index;
+    int last = --timer_list->nb_active_timers;
+
+    ts->heap_index = -1;
+    if (index != last) {
+        timer_heap_set(timer_list, index, timer_list->active_timers[last]);
+        timer_heap_fix(timer_list, index);
+    }
+}
+
 QEMUTimerList *timerlist_new(QEMUClockType type,
                              QEMUTimerListNotifyCB *cb,
                              void *opaque)
@@ -120,6 +201,7 @@ void timerlist_free(QEMUTimerList *timer_list)
         QLIST_REMOVE(timer_list, list);
     }
     qemu_mutex_destroy(&timer_list->active_timers_lock);
+    g_free(timer_list->active_timers);
     g_free(timer_list);
 }
 
@@ -173,7 +255,7 @@ void qemu_clock_enable(QEMUClockType type, bool enabled)
 
 bool timerlist_has_timers(QEMUTimerList *timer_list)
 {
-    return !!timer_list->active_timers;
+    return timer_list->nb_active_timers > 0;
 }
 
 bool qemu_clock_has_timers(QEMUClockType type)
@@ -187,11 +269,11 @@ bool timerlist_expired(QEMUTimerList *timer_list)
     int64_t expire_time;
 
     qemu_mutex_lock(&timer_list->active_timers_lock);
-    if (!timer_list->active_timers) {
+    if (!timerlist_has_timers(timer_list)) {
         qemu_mutex_unlock(&timer_list->active_timers_lock);
         return false;
     }
-    expire_time = timer_list->active_timers->expire_time;
+    expire_time = timerlist_first(timer_list)->expire_time;
     qemu_mutex_unlock(&timer_list->active_timers_lock);
 
     return expire_time < qemu_clock_get_ns(timer_list->clock->type);
@@ -222,11 +304,11 @@ int64_t timerlist_deadline_ns(QEMUTimerList *timer_list)
      * the caller should notice the change and there is no race condition.
      */
     qemu_mutex_lock(&timer_list->active_timers_lock);
-    if (!timer_list->active_timers) {
+    if (!timerlist_has_timers(timer_list)) {
         qemu_mutex_unlock(&timer_list->active_timers_lock);
         return -1;
     }
-    expire_time = timer_list->active_timers->expire_time;
+    expire_time = timerlist_first(timer_list)->expire_time;
     qemu_mutex_unlock(&timer_list->active_timers_lock);
 
     delta = expire_time - qemu_clock_get_ns(timer_list->clock->type);
@@ -331,6 +413,7 @@ void timer_init(QEMUTimer *ts,
     ts->opaque = opaque;
     ts->scale = scale;
     ts->expire_time = -1;
+    ts->heap_index = -1;
 }
 
 void timer_free(QEMUTimer *ts)
@@ -340,41 +423,22 @@ void timer_free(QEMUTimer *ts)
 
 static void timer_del_locked(QEMUTimerList *timer_list, QEMUTimer *ts)
 {
-    QEMUTimer **pt, *t;
+    int index = ts->heap_index;
 
     ts->expire_time = -1;
-    pt = &timer_list->active_timers;
-    for(;;) {
-        t = *pt;
-        if (!t)
-            break;
-        if (t == ts) {
-            *pt = t->next;
-            break;
-        }
-        pt = &t->next;
+    if (index >= 0 && index < timer_list->nb_active_timers &&
+        timer_list->active_timers[index] == ts) {
+        timer_heap_remove(timer_list, ts);
     }
 }
 
 static bool timer_mod_ns_locked(QEMUTimerList *timer_list,
                                 QEMUTimer *ts, int64_t expire_time)
 {
-    QEMUTimer **pt, *t;
-
-    /* add the timer in the sorted list */
-    pt = &timer_list->active_timers;
-    for (;;) {
-        t = *pt;
-        if (!timer_expired_ns(t, expire_time)) {
-            break;
-        }
-        pt = &t->next;
-    }
     ts->expire_time = MAX(expire_time, 0);
-    ts->next = *pt;
-    *pt = ts;
+    timer_heap_insert(timer_list, ts);
 
-    return pt == &timer_list->active_timers;
+    return ts->heap_index == 0;
 }
 
 static void timerlist_rearm(QEMUTimerList *timer_list)
@@ -471,15 +535,14 @@ bool timerlist_run_timers(QEMUTimerList *timer_list)
     current_time = qemu_clock_get_ns(timer_list->clock->type);
     for(;;) {
         qemu_mutex_lock(&timer_list->active_timers_lock);
-        ts = timer_list->active_timers;
+        ts = timerlist_first(timer_list);
         if (!timer_expired_ns(ts, current_time)) {
             qemu_mutex_unlock(&timer_list->active_timers_lock);
             break;
         }
 
         /* remove timer from the list before calling the callback */
-        timer_list->active_timers = ts->next;
-        ts->next = NULL;
+        timer_heap_remove(timer_list, ts);
         ts->expire_time = -1;
         cb = ts->cb;
         opaque = ts->opaque;
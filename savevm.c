@@ -167,6 +167,7 @@ void qemu_announce_self(void)
 void yield_until_fd_readable(int fd);
 
 #define IO_BUF_SIZE 32768
+#define IO_BUF_MAX_SIZE (1024 * 1024)
 #define MAX_IOV_SIZE MIN(IOV_MAX, 64)
 
 struct QEMUFile {
@@ -180,7 +181,8 @@ struct QEMUFile {
                     when reading */
     int buf_index;
     int buf_size; /* 0 when writing */
-    uint8_t buf[IO_BUF_SIZE];
+    int buf_capacity; /* grows up to IO_BUF_MAX_SIZE for large writes */
+    uint8_t *buf;
 
     struct iovec iov[MAX_IOV_SIZE];
     unsigned int iovcnt;
@@ -271,6 +273,18 @@ static int stdio_put_buffer(void *opaque, const uint8_t *buf, int64_t pos, int s
     return fwrite(buf, 1, size, s->stdio_file);
 }
 
+static ssize_t fd_writev_all(int fd, struct iovec *iov, int iovcnt);
+
+/* Only used for files written with writev_buffer, so nothing is ever
+ * buffered by stdio itself. */
+static ssize_t stdio_writev_buffer(void *opaque, struct iovec *iov, int iovcnt,
+                                   int64_t pos)
+{
+    QEMUFileStdio *s = opaque;
+
+    return fd_writev_all(fileno(s->stdio_file), iov, iovcnt);
+}
+
 static int stdio_get_buffer(void *opaque, uint8_t *buf, int64_t pos, int size)
 {
     QEMUFileStdio *s = opaque;
@@ -388,14 +402,13 @@ static const QEMUFileOps stdio_file_read_ops = {
 
 static const QEMUFileOps stdio_file_write_ops = {
     .get_fd =     stdio_get_fd,
-    .put_buffer = stdio_put_buffer,
+    .writev_buffer = stdio_writev_buffer,
     .close =      stdio_fclose
 };
 
-static ssize_t unix_writev_buffer(void *opaque, struct iovec *iov, int iovcnt,
-                                  int64_t pos)
+/* Write a whole I/O vector, with as many writev() calls as needed. */
+static ssize_t fd_writev_all(int fd, struct iovec *iov, int iovcnt)
 {
-    QEMUFileSocket *s = opaque;
     ssize_t len, offset;
     ssize_t size = iov_size(iov, iovcnt);
     ssize_t total = 0;
@@ -415,7 +428,7 @@ static ssize_t unix_writev_buffer(void *opaque, struct iovec *iov, int iovcnt,
         iov[0].iov_len -= offset;
 
         do {
-            len = writev(s->fd, iov, iovcnt);
+            len = writev(fd, iov, iovcnt);
         } while (len == -1 && errno == EINTR);
         if (len == -1) {
             return -errno;
@@ -434,6 +447,14 @@ static ssize_t unix_writev_buffer(void *opaque, struct iovec *iov, int iovcnt,
     return total;
 }
 
+static ssize_t unix_writev_buffer(void *opaque, struct iovec *iov, int iovcnt,
+                                  int64_t pos)
+{
+    QEMUFileSocket *s = opaque;
+
+    return fd_writev_all(s->fd, iov, iovcnt);
+}
+
 static int unix_get_buffer(void *opaque, uint8_t *buf, int64_t pos, int size)
 {
     QEMUFileSocket *s = opaque;
@@ -592,9 +613,49 @@ static int block_put_buffer(void *opaque, const uint8_t *buf,
     return size;
 }
 
+/* Snapshots are loaded sequentially, read the vmstate in large chunks to
+ * reduce the number of calls to the block driver. */
+#define BDRV_READAHEAD_SIZE (1024 * 1024)
+
+typedef struct QEMUFileBdrvReader {
+    BlockDriverState *bs;
+    uint8_t *buf;
+    int64_t buf_pos;
+    int buf_len;
+} QEMUFileBdrvReader;
+
 static int block_get_buffer(void *opaque, uint8_t *buf, int64_t pos, int size)
 {
-    return bdrv_load_vmstate(opaque, buf, pos, size);
+    QEMUFileBdrvReader *r = opaque;
+    int avail;
+
+    if (pos < r->buf_pos || pos >= r->buf_pos + r->buf_len) {
+        int len = bdrv_load_vmstate(r->bs, r->buf, pos, BDRV_READAHEAD_SIZE);
+        if (len <= 0) {
+            /* Reading past the end of the vmstate may fail, fall back to
+             * the requested size. */
+            r->buf_len = 0;
+            return bdrv_load_vmstate(r->bs, buf, pos, size);
+        }
+        r->buf_pos = pos;
+        r->buf_len = len;
+    }
+
+    avail = r->buf_pos + r->buf_len - pos;
+    if (size > avail) {
+        size = avail;
+    }
+    memcpy(buf, r->buf + (pos - r->buf_pos), size);
+    return size;
+}
+
+static int block_reader_fclose(void *opaque)
+{
+    QEMUFileBdrvReader *r = opaque;
+
+    g_free(r->buf);
+    g_free(r);
+    return 0;
 }
 
 static int bdrv_fclose(void *opaque)
@@ -606,7 +667,7 @@ static int bdrv_fclose(void *opaque)
 
 static const QEMUFileOps bdrv_read_ops = {
     .get_buffer = block_get_buffer,
-    .close =      bdrv_fclose
+    .close =      block_reader_fclose
 };
 
 static const QEMUFileOps bdrv_write_ops = {
@@ -617,9 +678,15 @@ static const QEMUFileOps bdrv_write_ops = {
 
 static QEMUFile *qemu_fopen_bdrv(BlockDriverState *bs, int is_writable)
 {
+    QEMUFileBdrvReader *r;
+
     if (is_writable)
         return qemu_fopen_ops(bs, &bdrv_write_ops);
-    return qemu_fopen_ops(bs, &bdrv_read_ops);
+
+    r = g_malloc0(sizeof(*r));
+    r->bs = bs;
+    r->buf = g_malloc(BDRV_READAHEAD_SIZE);
+    return qemu_fopen_ops(r, &bdrv_read_ops);
 }
 
 QEMUFile *qemu_fopen_ops(void *opaque, const QEMUFileOps *ops)
@@ -630,6 +697,8 @@ QEMUFile *qemu_fopen_ops(void *opaque, const QEMUFileOps *ops)
 
     f->opaque = opaque;
     f->ops = ops;
+    f->buf_capacity = IO_BUF_SIZE;
+    f->buf = g_malloc(f->buf_capacity);
     return f;
 }
 
@@ -767,7 +836,7 @@ static void qemu_fill_buffer(QEMUFile *f)
     f->buf_size = pending;
 
     len = f->ops->get_buffer(f->opaque, f->buf + pending, f->pos,
-                        IO_BUF_SIZE - pending);
+                        f->buf_capacity - pending);
     if (len > 0) {
         f->buf_size += len;
         f->pos += len;
@@ -790,6 +859,39 @@ void qemu_update_position(QEMUFile *f, size_t size)
     f->pos += size;
 }
 
+/* Only snapshot files, which address the vmstate by position, can skip. */
+bool qemu_file_can_skip(QEMUFile *f)
+{
+    return f->ops == &bdrv_read_ops || f->ops == &bdrv_write_ops;
+}
+
+/* Move 'size' bytes forward in a snapshot file. When writing, the skipped
+ * bytes keep what the vmstate already holds. Return -ENOTSUP if the file
+ * can't skip. */
+int qemu_fskip(QEMUFile *f, int64_t size)
+{
+    int64_t pending;
+
+    if (!qemu_file_can_skip(f)) {
+        return -ENOTSUP;
+    }
+    if (qemu_file_is_writable(f)) {
+        qemu_fflush(f);
+        f->pos += size;
+        return 0;
+    }
+
+    pending = f->buf_size - f->buf_index;
+    if (size <= pending) {
+        f->buf_index += size;
+    } else {
+        f->pos += size - pending;
+        f->buf_index = 0;
+        f->buf_size = 0;
+    }
+    return 0;
+}
+
 /** Closes the file
  *
  * Returns negative error value if any error happened on previous operations or
@@ -816,6 +918,7 @@ int qemu_fclose(QEMUFile *f)
     if (f->last_error) {
         ret = f->last_error;
     }
+    g_free(f->buf);
     g_free(f);
     return ret;
 }
@@ -860,7 +963,7 @@ void qemu_put_buffer(QEMUFile *f, const uint8_t *buf, int size)
     }
 
     while (size > 0) {
-        l = IO_BUF_SIZE - f->buf_index;
+        l = f->buf_capacity - f->buf_index;
         if (l > size)
             l = size;
         memcpy(f->buf + f->buf_index, buf, l);
@@ -869,8 +972,15 @@ void qemu_put_buffer(QEMUFile *f, const uint8_t *buf, int size)
             add_to_iovec(f, f->buf + f->buf_index, l);
         }
         f->buf_index += l;
-        if (f->buf_index == IO_BUF_SIZE) {
+        if (f->buf_index == f->buf_capacity) {
             qemu_fflush(f);
+            /* Still more than a buffer to go, write larger chunks. Nothing
+             * points to the buffer after a flush. */
+            if (size - l >= f->buf_capacity &&
+                f->buf_capacity < IO_BUF_MAX_SIZE) {
+                f->buf_capacity *= 2;
+                f->buf = g_realloc(f->buf, f->buf_capacity);
+            }
         }
         if (qemu_file_get_error(f)) {
             break;
@@ -892,7 +1002,7 @@ void qemu_put_byte(QEMUFile *f, int v)
         add_to_iovec(f, f->buf + f->buf_index, 1);
     }
     f->buf_index++;
-    if (f->buf_index == IO_BUF_SIZE) {
+    if (f->buf_index == f->buf_capacity) {
         qemu_fflush(f);
     }
 }
@@ -1009,6 +1119,10 @@ char* qemu_get_string(QEMUFile *f)
 int64_t qemu_ftell(QEMUFile *f)
 {
     qemu_fflush(f);
+    if (!qemu_file_is_writable(f)) {
+        /* Don't count the data buffered but not read yet. */
+        return f->pos - (f->buf_size - f->buf_index);
+    }
     return f->pos;
 }
 
@@ -2720,4 +2834,5 @@ void do_info_snapshots(Monitor* out, Monitor* err)
         monitor_printf(out, "%s\n", bdrv_snapshot_dump(buf, sizeof(buf), sn));
     }
     g_free(sn_tab);
+    ram_print_snapshot_stats(out);
 }
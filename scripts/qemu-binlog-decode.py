@@ -0,0 +1,124 @@
+#!/usr/bin/env python
+#
+# Decode a binary trace written with '-d binary', see include/qemu/log.h
+#
+# Copyright (c) 2015 The Android Open Source Project
+#
+# This work is licensed under the terms of the GNU GPLv2.
+# See the COPYING.LIB file in the top-level directory.
+#
+# Usage:
+#   qemu-binlog-decode.py <file>.bin            print all records
+#   qemu-binlog-decode.py --summary <file>.bin  print the hottest TBs
+
+import struct
+import sys
+
+MAGIC = b'QEMULOGB'
+VERSION = 1
+CHUNK_MAGIC = 0x4b4e4843
+
+REC_EXEC = 1
+REC_TRANSLATE = 2
+
+rec_names = {
+    REC_EXEC:      'exec',
+    REC_TRANSLATE: 'translate',
+}
+
+class DecodeError(Exception):
+    pass
+
+def read_exact(f, size, what):
+    data = f.read(size)
+    if len(data) != size:
+        raise DecodeError('truncated %s' % what)
+    return data
+
+def records(f):
+    '''Yield (time_ns, thread, type, pc, size) for each record of f'''
+    header = f.read(24)
+    if len(header) != 24 or header[:8] != MAGIC:
+        raise DecodeError('not a binary trace')
+    # All fields are in the byte order of the host that wrote the trace
+    for order in ('<', '>'):
+        version, record_size, chunk_header_size, _ = \
+            struct.unpack(order + 'IIII', header[8:])
+        if version == VERSION:
+            break
+    else:
+        raise DecodeError('unsupported version')
+    if record_size < 16 or chunk_header_size < 32:
+        raise DecodeError('bad header')
+
+    while True:
+        chunk_header = f.read(chunk_header_size)
+        if not chunk_header:
+            return
+        if len(chunk_header) != chunk_header_size:
+            raise DecodeError('truncated chunk header')
+        magic, thread, count, _, start_ns, end_ns = \
+            struct.unpack(order + 'IIIIQQ', chunk_header[:32])
+        if magic != CHUNK_MAGIC:
+            raise DecodeError('bad chunk at offset %d' %
+                              (f.tell() - chunk_header_size))
+        data = read_exact(f, count * record_size, 'chunk')
+        for n in range(count):
+            pc, rec_type, size = struct.unpack_from(order + 'QII', data,
+                                                    n * record_size)
+            # Records are only timestamped by chunk
+            time_ns = start_ns + (end_ns - start_ns) * n // count
+            yield time_ns, thread, rec_type, pc, size
+
+def print_records(f, out):
+    origin = None
+    for time_ns, thread, rec_type, pc, size in records(f):
+        if origin is None:
+            origin = time_ns
+        out.write('%14.6f %2d %-9s 0x%08x %d\n' %
+                  ((time_ns - origin) / 1e6, thread,
+                   rec_names.get(rec_type, str(rec_type)), pc, size))
+
+def print_summary(f, out, top=50):
+    execs = {}
+    translations = {}
+    sizes = {}
+    total = 0
+    for _, _, rec_type, pc, size in records(f):
+        if rec_type == REC_EXEC:
+            execs[pc] = execs.get(pc, 0) + 1
+            total += 1
+        elif rec_type == REC_TRANSLATE:
+            translations[pc] = translations.get(pc, 0) + 1
+        sizes[pc] = size
+    out.write('%d TB executions, %d distinct TBs, %d translations\n' %
+              (total, len(execs), sum(translations.values())))
+    out.write('%12s %7s %-10s %5s %6s\n' %
+              ('execs', '%', 'pc', 'size', 'trans'))
+    hottest = sorted(execs.items(), key=lambda item: -item[1])[:top]
+    for pc, count in hottest:
+        out.write('%12d %6.2f%% 0x%08x %5d %6d\n' %
+                  (count, 100.0 * count / total, pc, sizes[pc],
+                   translations.get(pc, 0)))
+
+def main(args):
+    summary = False
+    if args and args[0] == '--summary':
+        summary = True
+        args = args[1:]
+    if len(args) != 1:
+        sys.stderr.write('usage: qemu-binlog-decode.py [--summary] <file>\n')
+        return 2
+    try:
+        with open(args[0], 'rb') as f:
+            if summary:
+                print_summary(f, sys.stdout)
+            else:
+                print_records(f, sys.stdout)
+    except (IOError, DecodeError) as e:
+        sys.stderr.write('%s: %s\n' % (args[0], e))
+        return 1
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
@@ -30,6 +30,9 @@ void slirp_select_fill(int *pnfds,
 
 void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds);
 
+/* Lower *timeout_ns to the next TCP timer as of the last slirp_select_fill() */
+void slirp_update_timeout(int64_t *timeout_ns);
+
 void slirp_input(const uint8_t *pkt, int pkt_len);
 
 /* you must provide the following functions: */
@@ -114,6 +117,18 @@ extern char slirp_hostname[33];
 extern const char *bootp_filename;
 
 void slirp_stats(void);
+
+/* Counters of the mbuf pools */
+typedef struct SlirpMbufStats {
+    int alloced;                /* mbufs in use */
+    int max;                    /* maximum number of mbufs in use */
+    unsigned long hits;         /* mbufs taken from the free list */
+    unsigned long misses;       /* mbufs that needed an allocation */
+    unsigned long ext_hits;     /* large data buffers reused */
+    unsigned long ext_misses;   /* large data buffers allocated */
+} SlirpMbufStats;
+
+void slirp_get_mbuf_stats(SlirpMbufStats *stats);
 void slirp_socket_recv(int addr_low_byte, int guest_port, const uint8_t *buf,
 		int size);
 size_t slirp_socket_can_recv(int addr_low_byte, int guest_port);
@@ -50,6 +50,7 @@ extern int tcp_keepintvl;
 extern uint8_t client_ethaddr[6];
 extern const char *slirp_special_ip;
 extern int slirp_restrict;
+extern int slirp_verify_checksums;
 
 #define PROTO_SLIP 0x1
 #ifdef USE_PPP
@@ -58,3 +59,4 @@ extern int slirp_restrict;
 
 void if_encap(const uint8_t *ip_data, int ip_data_len);
 ssize_t slirp_send(struct socket *so, const void *buf, size_t len, int flags);
+void slirp_poll_remove(struct socket *so);
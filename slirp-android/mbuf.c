@@ -16,10 +16,10 @@
  */
 
 #include <slirp.h>
+#include "android/utils/mem_categories.h"
 
 int mbuf_alloced = 0;
 struct mbuf m_freelist, m_usedlist;
-#define MBUF_THRESH 30
 int mbuf_max = 0;
 
 /*
@@ -28,6 +28,41 @@ int mbuf_max = 0;
  */
 #define SLIRP_MSIZE (IF_MTU + IF_MAXLINKHDR + sizeof(struct m_hdr ) + 6)
 
+/*
+ * mbufs are allocated MBUF_BATCH at a time in a single block, until
+ * there are MBUF_POOL_MAX of them. These are never freed, m_free()
+ * puts them back on the free list. Past that, mbufs are malloced one
+ * by one and marked M_DOFREE.
+ */
+#define MBUF_BATCH	16
+#define MBUF_POOL_MAX	512
+#define MBUF_STRIDE	((SLIRP_MSIZE + 15) & ~15)
+static int mbuf_pooled;
+
+/*
+ * m_ext buffers are rounded up to a power of 2 between M_EXT_MIN_SIZE
+ * and M_EXT_MAX_SIZE, and up to M_EXT_POOL_MAX free ones of each size
+ * are kept for reuse. Larger buffers are malloced as before.
+ */
+#define M_EXT_MIN_SHIFT	13	/* 8 KiB */
+#define M_EXT_MAX_SHIFT	16	/* 64 KiB */
+#define M_EXT_CLASSES	(M_EXT_MAX_SHIFT - M_EXT_MIN_SHIFT + 1)
+#define M_EXT_POOL_MAX	8
+
+struct m_ext_free {
+	struct m_ext_free *next;
+};
+
+static struct {
+	struct m_ext_free *head;
+	int count;
+} m_ext_pools[M_EXT_CLASSES];
+
+static SlirpMbufStats mbuf_stats;
+
+/* All mbufs and m_ext buffers, pooled or not */
+static MemCategory mbuf_memory = MEM_CATEGORY_INIT("slirp.mbufs");
+
 void
 m_init(void)
 {
@@ -35,12 +70,36 @@ m_init(void)
 	m_usedlist.m_next = m_usedlist.m_prev = &m_usedlist;
 }
 
+/*
+ * Add a new block of MBUF_BATCH mbufs to the free list.
+ * Return 0 on success, -1 on failure.
+ */
+static int
+m_refill(void)
+{
+	char *block;
+	int i;
+
+	block = (char *)memCategory_malloc(&mbuf_memory, MBUF_BATCH * MBUF_STRIDE);
+	if (block == NULL)
+		return -1;
+
+	for (i = 0; i < MBUF_BATCH; i++) {
+		struct mbuf *m = (struct mbuf *)(block + i * MBUF_STRIDE);
+		m->m_flags = M_FREELIST;
+		insque(m, &m_freelist);
+	}
+	mbuf_pooled += MBUF_BATCH;
+	return 0;
+}
+
 /*
  * Get an mbuf from the free list, if there are none
- * malloc one
+ * allocate a new batch of them, or malloc a single one
+ * once the pool is full.
  *
  * Because fragmentation can occur if we alloc new mbufs and
- * free old mbufs, we mark all mbufs above mbuf_thresh as M_DOFREE,
+ * free old mbufs, we mark the single ones as M_DOFREE,
  * which tells m_free to actually free() it
  */
 struct mbuf *
@@ -52,17 +111,23 @@ m_get(void)
 	DEBUG_CALL("m_get");
 
 	if (m_freelist.m_next == &m_freelist) {
-		m = (struct mbuf *)malloc(SLIRP_MSIZE);
-		if (m == NULL) goto end_error;
-		mbuf_alloced++;
-		if (mbuf_alloced > MBUF_THRESH)
+		mbuf_stats.misses++;
+		if (mbuf_pooled < MBUF_POOL_MAX && m_refill() == 0) {
+			m = m_freelist.m_next;
+			remque(m);
+		} else {
+			m = (struct mbuf *)memCategory_malloc(&mbuf_memory, SLIRP_MSIZE);
+			if (m == NULL) goto end_error;
 			flags = M_DOFREE;
-		if (mbuf_alloced > mbuf_max)
-			mbuf_max = mbuf_alloced;
+		}
 	} else {
+		mbuf_stats.hits++;
 		m = m_freelist.m_next;
 		remque(m);
 	}
+	mbuf_alloced++;
+	if (mbuf_alloced > mbuf_max)
+		mbuf_max = mbuf_alloced;
 
 	/* Insert it in the used list */
 	insque(m,&m_usedlist);
@@ -79,6 +144,68 @@ end_error:
 	return m;
 }
 
+/*
+ * Return the size class of a m_ext buffer of |size| bytes,
+ * or -1 if it is too large for the pools.
+ */
+static int
+m_ext_class(int size)
+{
+	int cls = 0;
+
+	while ((1 << (M_EXT_MIN_SHIFT + cls)) < size) {
+		if (++cls == M_EXT_CLASSES)
+			return -1;
+	}
+	return cls;
+}
+
+/*
+ * Allocate a m_ext buffer of at least *psize bytes, and set *psize
+ * to its actual size.
+ */
+static char *
+m_ext_alloc(int *psize)
+{
+	int cls = m_ext_class(*psize);
+	struct m_ext_free *buf;
+
+	if (cls < 0) {
+		mbuf_stats.ext_misses++;
+		return (char *)memCategory_malloc(&mbuf_memory, *psize);
+	}
+
+	*psize = 1 << (M_EXT_MIN_SHIFT + cls);
+	buf = m_ext_pools[cls].head;
+	if (buf != NULL) {
+		m_ext_pools[cls].head = buf->next;
+		m_ext_pools[cls].count--;
+		mbuf_stats.ext_hits++;
+		return (char *)buf;
+	}
+	mbuf_stats.ext_misses++;
+	return (char *)memCategory_malloc(&mbuf_memory, *psize);
+}
+
+/*
+ * Release a m_ext buffer of |size| bytes returned by m_ext_alloc()
+ */
+static void
+m_ext_release(char *ext, int size)
+{
+	int cls = m_ext_class(size);
+	struct m_ext_free *buf = (struct m_ext_free *)ext;
+
+	if (cls < 0 || size != (1 << (M_EXT_MIN_SHIFT + cls)) ||
+	    m_ext_pools[cls].count >= M_EXT_POOL_MAX) {
+		memCategory_free(&mbuf_memory, ext);
+		return;
+	}
+	buf->next = m_ext_pools[cls].head;
+	m_ext_pools[cls].head = buf;
+	m_ext_pools[cls].count++;
+}
+
 void
 m_free(struct mbuf *m)
 {
@@ -91,19 +218,20 @@ m_free(struct mbuf *m)
 	if (m->m_flags & M_USEDLIST)
 	   remque(m);
 
-	/* If it's M_EXT, free() it */
+	/* If it's M_EXT, release it */
 	if (m->m_flags & M_EXT)
-	   free(m->m_ext);
+	   m_ext_release(m->m_ext, m->m_size);
 
 	/*
 	 * Either free() it or put it on the free list
 	 */
 	if (m->m_flags & M_DOFREE) {
-		free(m);
+		memCategory_free(&mbuf_memory, m);
 		mbuf_alloced--;
 	} else if ((m->m_flags & M_FREELIST) == 0) {
 		insque(m,&m_freelist);
 		m->m_flags = M_FREELIST; /* Clobber other flags */
+		mbuf_alloced--;
 	}
   } /* if(m) */
 }
@@ -139,16 +267,20 @@ m_inc(struct mbuf *m, int size)
         if(m->m_size>size) return;
 
         if (m->m_flags & M_EXT) {
+	  char *ext;
 	  datasize = m->m_data - m->m_ext;
-	  m->m_ext = (char *)realloc(m->m_ext,size);
-/*		if (m->m_ext == NULL)
+	  ext = m_ext_alloc(&size);
+/*		if (ext == NULL)
  *			return (struct mbuf *)NULL;
  */
+	  memcpy(ext, m->m_ext, m->m_size);
+	  m_ext_release(m->m_ext, m->m_size);
+	  m->m_ext = ext;
 	  m->m_data = m->m_ext + datasize;
         } else {
 	  char *dat;
 	  datasize = m->m_data - m->m_dat;
-	  dat = (char *)malloc(size);
+	  dat = m_ext_alloc(&size);
 /*		if (dat == NULL)
  *			return (struct mbuf *)NULL;
  */
@@ -225,3 +357,11 @@ dtom(void *dat)
 
 	return (struct mbuf *)0;
 }
+
+void
+slirp_get_mbuf_stats(SlirpMbufStats *stats)
+{
+	*stats = mbuf_stats;
+	stats->alloced = mbuf_alloced;
+	stats->max = mbuf_max;
+}
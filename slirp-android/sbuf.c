@@ -124,6 +124,24 @@ sbappend(struct socket *so, struct mbuf *m)
 	m_free(m);
 }
 
+/*
+ * Same as sbappend, but for in-sequence bulk data: segments without
+ * PSH are only queued while the buffer is less than half full, so
+ * that they are written to the socket with a single writev() by
+ * sowrite, instead of one send() per segment.
+ */
+void
+sbappend_coalesce(struct socket *so, struct mbuf *m, int push)
+{
+	if (!push && !so->so_urgc && m->m_len > 0 &&
+	    so->so_rcv.sb_cc + m->m_len <= so->so_rcv.sb_datalen / 2) {
+		sbappendsb(&so->so_rcv, m);
+		m_free(m);
+		return;
+	}
+	sbappend(so, m);
+}
+
 /*
  * Copy the data from m into sb
  * The caller is responsible to make sure there's enough room
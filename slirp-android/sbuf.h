@@ -25,6 +25,7 @@ void sbfree _P((struct sbuf *));
 void sbdrop _P((struct sbuf *, int));
 void sbreserve _P((struct sbuf *, int));
 void sbappend _P((struct socket *, struct mbuf *));
+void sbappend_coalesce _P((struct socket *, struct mbuf *, int));
 void sbcopy _P((struct sbuf *, int, int, char *));
 
 #endif
@@ -26,16 +26,21 @@
 #include "slirp.h"
 #include "proxy_common.h"
 #include "hw/hw.h"
+#include "net/net.h"
 
 #include "android/utils/debug.h"  /* for dprint */
 #include "android/utils/bufprint.h"
+#include "android/utils/perf_counters.h"
 #include "android/android.h"
 #include "android/sockets.h"
+#include "android/iolooper.h"
+#include "android/utils/ip_rules.h"
 
 #include "qemu/queue.h"
 
 /* proto types */
 static void slirp_net_forward_init(void);
+static void slirp_poll_init(void);
 
 
 #define  D(...)   VERBOSE_PRINT(slirp,__VA_ARGS__)
@@ -68,7 +73,9 @@ static const uint8_t zero_ethaddr[6] = { 0, 0, 0, 0, 0, 0 };
 
 const char *slirp_special_ip = CTL_SPECIAL;
 int slirp_restrict;
+int slirp_verify_checksums;
 static int do_slowtimo;
+static int slirp_timeout_us = -1; /* computed by slirp_select_fill() */
 int link_up;
 struct timeval tt;
 FILE *lfd;
@@ -243,6 +250,12 @@ void slirp_init(int restricted, const char *special_ip)
     link_up = 1;
     slirp_restrict = restricted;
 
+    /* Packets from the guest are copied from its memory by the NIC
+     * emulation, they can't be corrupted on the way. The TCP and UDP
+     * checksums are only verified on request, as this is a significant
+     * part of the cost of bulk uploads. */
+    slirp_verify_checksums = (getenv("ANDROID_SLIRP_VERIFY_CHECKSUMS") != NULL);
+
     if_init();
     ip_init();
 
@@ -264,6 +277,7 @@ void slirp_init(int restricted, const char *special_ip)
 
     alias_addr_ip = special_addr_ip | CTL_ALIAS;
     getouraddr();
+    slirp_poll_init();
     register_savevm(NULL, "slirp", 0, 1, slirp_state_save, slirp_state_load, NULL);
 
     slirp_net_forward_init();
@@ -298,6 +312,165 @@ static void updtime(void)
 }
 #endif
 
+/*
+ * When the host supports epoll or kqueue, the slirp sockets register the
+ * events they want with |slirp_looper|, which only talks to the kernel
+ * when they change. slirp_select_fill() then adds the single descriptor
+ * of the looper to the fd_sets, and slirp_select_poll() only visits the
+ * sockets that have pending events. Otherwise, each socket is added to
+ * the fd_sets, and all of them are checked after select().
+ */
+static IoLooper*        slirp_looper;
+static int              slirp_looper_fd = -1;
+
+/* Registered socket of each descriptor */
+static struct socket**  slirp_poll_sockets;
+static int              slirp_poll_sockets_size;
+
+static void slirp_poll_init(void)
+{
+    slirp_looper = iolooper_new();
+    slirp_looper_fd = iolooper_fd(slirp_looper);
+    if (slirp_looper_fd < 0) {
+        iolooper_free(slirp_looper);
+        slirp_looper = NULL;
+    }
+}
+
+static struct socket *slirp_poll_lookup(int fd)
+{
+    if (fd < 0 || fd >= slirp_poll_sockets_size)
+        return NULL;
+    return slirp_poll_sockets[fd];
+}
+
+/*
+ * Unregister |so| from the looper. Called before it is freed, so that
+ * pending events are never reported for a stale socket.
+ */
+void slirp_poll_remove(struct socket *so)
+{
+    int fd = so->so_poll_fd;
+
+    /* The descriptor may have been closed and reused by another socket */
+    if (slirp_poll_lookup(fd) == so) {
+        slirp_poll_sockets[fd] = NULL;
+        iolooper_modify(slirp_looper, fd, 0, 0);
+    }
+    so->so_poll_fd = -1;
+    so->so_poll_events = 0;
+    so->so_revents = 0;
+}
+
+/*
+ * Tell the looper, or the fd_sets, that |so| wants the SO_POLL_* |events|.
+ */
+static void slirp_poll_update(struct socket *so, int events, int *pnfds,
+                              fd_set *readfds, fd_set *writefds, fd_set *xfds)
+{
+    int fd = so->s;
+    int flags = 0;
+
+    if (!slirp_looper) {
+        if (fd < 0)
+            return;
+        if (events & SO_POLL_READ)
+            FD_SET(fd, readfds);
+        if (events & SO_POLL_WRITE)
+            FD_SET(fd, writefds);
+        if (events & SO_POLL_EXCEPT)
+            FD_SET(fd, xfds);
+        if (events && *pnfds < fd)
+            *pnfds = fd;
+        return;
+    }
+
+    if (so->so_poll_fd == fd && so->so_poll_events == events)
+        return;
+    if (so->so_poll_fd != fd || !events)
+        slirp_poll_remove(so);
+    if (!events || fd < 0)
+        return;
+
+    if (fd >= slirp_poll_sockets_size) {
+        int size = slirp_poll_sockets_size ? slirp_poll_sockets_size : 64;
+        struct socket **sockets;
+
+        while (size <= fd)
+            size *= 2;
+        sockets = (struct socket **)realloc(slirp_poll_sockets,
+                                            size * sizeof(*sockets));
+        if (!sockets)
+            return;
+        memset(sockets + slirp_poll_sockets_size, 0,
+               (size - slirp_poll_sockets_size) * sizeof(*sockets));
+        slirp_poll_sockets = sockets;
+        slirp_poll_sockets_size = size;
+    }
+    slirp_poll_sockets[fd] = so;
+    so->so_poll_fd = fd;
+    so->so_poll_events = events;
+
+    /*
+     * Urgent data is received inline (SO_OOBINLINE), and the looper has
+     * no exception events, so SO_POLL_EXCEPT is only used with select().
+     */
+    if (events & SO_POLL_READ)
+        flags |= IOLOOPER_READ;
+    if (events & SO_POLL_WRITE)
+        flags |= IOLOOPER_WRITE;
+    iolooper_modify(slirp_looper, fd, 0, flags);
+}
+
+/*
+ * Return the SO_POLL_* events that a TCP socket waits for
+ */
+static int slirp_tcp_events(struct socket *so)
+{
+	int events = 0;
+
+	/*
+	 * NOFDREF can include still connecting to local-host,
+	 * newly socreated() sockets etc. Don't want to select these.
+	 */
+	if (so->so_state & SS_NOFDREF || so->s == -1)
+	   return 0;
+
+	/*
+	 * don't register proxified socked connections here
+	 */
+	if ((so->so_state & SS_PROXIFIED) != 0)
+	   return 0;
+
+	/*
+	 * Set for reading sockets which are accepting
+	 */
+	if (so->so_state & SS_FACCEPTCONN)
+	   return SO_POLL_READ;
+
+	/*
+	 * Set for writing sockets which are connecting
+	 */
+	if (so->so_state & SS_ISFCONNECTING)
+	   return SO_POLL_WRITE;
+
+	/*
+	 * Set for writing if we are connected, can send more, and
+	 * we have something to send
+	 */
+	if (CONN_CANFSEND(so) && so->so_rcv.sb_cc)
+	   events |= SO_POLL_WRITE;
+
+	/*
+	 * Set for reading (and urgent data) if we are connected, can
+	 * receive more, and we have room for it XXX /2 ?
+	 */
+	if (CONN_CANFRCV(so) && (so->so_snd.sb_cc < (so->so_snd.sb_datalen/2)))
+	   events |= SO_POLL_READ | SO_POLL_EXCEPT;
+
+	return events;
+}
+
 void slirp_select_fill(int *pnfds,
                        fd_set *readfds, fd_set *writefds, fd_set *xfds)
 {
@@ -305,6 +478,7 @@ void slirp_select_fill(int *pnfds,
     struct timeval timeout;
     int nfds;
     int tmp_time;
+    int events;
 
     /* fail safe */
     global_readfds = NULL;
@@ -333,55 +507,8 @@ void slirp_select_fill(int *pnfds,
 			if (time_fasttimo == 0 && so->so_tcpcb->t_flags & TF_DELACK)
 			   time_fasttimo = curtime; /* Flag when we want a fasttimo */
 
-			/*
-			 * NOFDREF can include still connecting to local-host,
-			 * newly socreated() sockets etc. Don't want to select these.
-	 		 */
-			if (so->so_state & SS_NOFDREF || so->s == -1)
-			   continue;
-
-            /*
-             * don't register proxified socked connections here
-             */
-            if ((so->so_state & SS_PROXIFIED) != 0)
-	            continue;
-
-			/*
-			 * Set for reading sockets which are accepting
-			 */
-			if (so->so_state & SS_FACCEPTCONN) {
-                                FD_SET(so->s, readfds);
-				UPD_NFDS(so->s);
-				continue;
-			}
-
-			/*
-			 * Set for writing sockets which are connecting
-			 */
-			if (so->so_state & SS_ISFCONNECTING) {
-				FD_SET(so->s, writefds);
-				UPD_NFDS(so->s);
-				continue;
-			}
-
-			/*
-			 * Set for writing if we are connected, can send more, and
-			 * we have something to send
-			 */
-			if (CONN_CANFSEND(so) && so->so_rcv.sb_cc) {
-				FD_SET(so->s, writefds);
-				UPD_NFDS(so->s);
-			}
-
-			/*
-			 * Set for reading (and urgent data) if we are connected, can
-			 * receive more, and we have room for it XXX /2 ?
-			 */
-			if (CONN_CANFRCV(so) && (so->so_snd.sb_cc < (so->so_snd.sb_datalen/2))) {
-				FD_SET(so->s, readfds);
-				FD_SET(so->s, xfds);
-				UPD_NFDS(so->s);
-			}
+			slirp_poll_update(so, slirp_tcp_events(so), &nfds,
+			                  readfds, writefds, xfds);
 		}
 
 		/*
@@ -390,13 +517,10 @@ void slirp_select_fill(int *pnfds,
 		for (so = udb.so_next; so != &udb; so = so_next) {
 			so_next = so->so_next;
 
-            if ((so->so_state & SS_PROXIFIED) != 0)
-                continue;
-
 			/*
 			 * See if it's timed out
 			 */
-			if (so->so_expire) {
+			if ((so->so_state & SS_PROXIFIED) == 0 && so->so_expire) {
 				if (so->so_expire <= curtime) {
 					udp_detach(so);
 					continue;
@@ -414,10 +538,19 @@ void slirp_select_fill(int *pnfds,
 			 * if the packets needed to be fragmented
 			 * (XXX <= 4 ?)
 			 */
-			if ((so->so_state & SS_ISFCONNECTED) && so->so_queued <= 4) {
-				FD_SET(so->s, readfds);
-				UPD_NFDS(so->s);
-			}
+			events = 0;
+			if ((so->so_state & SS_PROXIFIED) == 0 &&
+			    (so->so_state & SS_ISFCONNECTED) && so->so_queued <= 4)
+				events = SO_POLL_READ;
+			slirp_poll_update(so, events, &nfds, readfds, writefds, xfds);
+		}
+
+		/*
+		 * All registered sockets are watched through the looper
+		 */
+		if (slirp_looper) {
+			FD_SET(slirp_looper_fd, readfds);
+			UPD_NFDS(slirp_looper_fd);
 		}
 	}
 
@@ -454,6 +587,7 @@ void slirp_select_fill(int *pnfds,
 			   timeout.tv_usec = (u_int)tmp_time;
 		}
 	}
+	slirp_timeout_us = timeout.tv_usec;
     /*
      * now, the proxified sockets
      */
@@ -462,10 +596,172 @@ void slirp_select_fill(int *pnfds,
         *pnfds = nfds;
 }
 
+void slirp_update_timeout(int64_t *timeout_ns)
+{
+    int64_t ns = (int64_t)slirp_timeout_us * 1000;
+
+    if (slirp_timeout_us >= 0 && ns < *timeout_ns)
+        *timeout_ns = ns;
+}
+
+/*
+ * Handle the events of |so->so_revents| on a TCP socket
+ */
+static void slirp_poll_tcp(struct socket *so)
+{
+	int ret;
+
+	/*
+	 * FD_ISSET is meaningless on these sockets
+	 * (and they can crash the program)
+	 */
+	if (so->so_state & SS_NOFDREF || so->s == -1)
+	   return;
+
+	/*
+	 * proxified sockets are polled later in
+	 * slirp_select_poll().
+	 */
+	if ((so->so_state & SS_PROXIFIED) != 0)
+	   return;
+
+	/*
+	 * Check for URG data
+	 * This will soread as well, so no need to
+	 * test for readfds below if this succeeds
+	 */
+	if (so->so_revents & SO_POLL_EXCEPT)
+	   sorecvoob(so);
+	/*
+	 * Check sockets for reading
+	 */
+	else if (so->so_revents & SO_POLL_READ) {
+		/*
+		 * Check for incoming connections
+		 */
+		if (so->so_state & SS_FACCEPTCONN) {
+			tcp_connect(so);
+			return;
+		} /* else */
+		ret = soread(so);
+
+		/* Output it if we read something */
+		if (ret > 0)
+		   tcp_output(sototcpcb(so));
+	}
+
+	/*
+	 * Check sockets for writing
+	 */
+	if (so->so_revents & SO_POLL_WRITE) {
+	  /*
+	   * Check for non-blocking, still-connecting sockets
+	   */
+	  if (so->so_state & SS_ISFCONNECTING) {
+	    /* Connected */
+	    so->so_state &= ~SS_ISFCONNECTING;
+
+	    ret = socket_send(so->s, (const void *)&ret, 0);
+	    if (ret < 0) {
+	      /* XXXXX Must fix, zero bytes is a NOP */
+	      if (errno == EAGAIN || errno == EWOULDBLOCK ||
+		  errno == EINPROGRESS || errno == ENOTCONN)
+		return;
+
+	      /* else failed */
+	      so->so_state = SS_NOFDREF;
+	    }
+	    /* else so->so_state &= ~SS_ISFCONNECTING; */
+
+	    /*
+	     * Continue tcp_input
+	     */
+	    tcp_input((struct mbuf *)NULL, sizeof(struct ip), so);
+	    /* continue; */
+	  } else {
+	    ret = sowrite(so);
+	    /*
+	     * If we wrote something, the receive window opened,
+	     * send a window update if needed. Otherwise the guest
+	     * would stall until it sends a window probe.
+	     */
+	    if (ret > 0)
+	      tcp_output(sototcpcb(so));
+	  }
+	}
+
+	/*
+	 * Probe a still-connecting, non-blocking socket
+	 * to check if it's still alive
+ 	 	 */
+#ifdef PROBE_CONN
+	if (so->so_state & SS_ISFCONNECTING) {
+	  ret = socket_recv(so->s, (char *)&ret, 0);
+
+	  if (ret < 0) {
+	    /* XXX */
+	    if (errno == EAGAIN || errno == EWOULDBLOCK ||
+		errno == EINPROGRESS || errno == ENOTCONN)
+	      return; /* Still connecting, continue */
+
+	    /* else failed */
+	    so->so_state = SS_NOFDREF;
+
+	    /* tcp_input will take care of it */
+	  } else {
+	    ret = socket_send(so->s, &ret, 0);
+	    if (ret < 0) {
+	      /* XXX */
+	      if (errno == EAGAIN || errno == EWOULDBLOCK ||
+		  errno == EINPROGRESS || errno == ENOTCONN)
+		return;
+	      /* else failed */
+	      so->so_state = SS_NOFDREF;
+	    } else
+	      so->so_state &= ~SS_ISFCONNECTING;
+
+	  }
+	  tcp_input((struct mbuf *)NULL, sizeof(struct ip),so);
+	} /* SS_ISFCONNECTING */
+#endif
+}
+
+/*
+ * Handle the events of |so->so_revents| on a UDP socket.
+ * Incoming packets are sent straight away, they're not buffered.
+ * Incoming UDP data isn't buffered either.
+ */
+static void slirp_poll_udp(struct socket *so)
+{
+	if ((so->so_state & SS_PROXIFIED) != 0)
+	   return;
+
+	if (so->s != -1 && (so->so_revents & SO_POLL_READ))
+	   sorecvfrom(so);
+}
+
+/*
+ * Return the SO_POLL_* events of |fd| in the fd_sets
+ */
+static int slirp_fd_events(int fd, fd_set *readfds, fd_set *writefds,
+                           fd_set *xfds)
+{
+	int events = 0;
+
+	if (fd < 0)
+	   return 0;
+	if (FD_ISSET(fd, readfds))
+	   events |= SO_POLL_READ;
+	if (FD_ISSET(fd, writefds))
+	   events |= SO_POLL_WRITE;
+	if (FD_ISSET(fd, xfds))
+	   events |= SO_POLL_EXCEPT;
+	return events;
+}
+
 void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds)
 {
     struct socket *so, *so_next;
-    int ret;
 
     global_readfds = readfds;
     global_writefds = writefds;
@@ -493,139 +789,50 @@ void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds)
 	 * Check sockets
 	 */
 	if (link_up) {
-		/*
-		 * Check TCP sockets
-		 */
-		for (so = tcb.so_next; so != &tcb; so = so_next) {
-			so_next = so->so_next;
-
+		if (slirp_looper) {
 			/*
-			 * FD_ISSET is meaningless on these sockets
-			 * (and they can crash the program)
+			 * Only visit the sockets with pending events
 			 */
-			if (so->so_state & SS_NOFDREF || so->s == -1)
-			   continue;
-
-            /*
-             * proxified sockets are polled later in this
-             * function.
-             */
-            if ((so->so_state & SS_PROXIFIED) != 0)
-                continue;
-
-			/*
-			 * Check for URG data
-			 * This will soread as well, so no need to
-			 * test for readfds below if this succeeds
-			 */
-			if (FD_ISSET(so->s, xfds))
-			   sorecvoob(so);
+			if (FD_ISSET(slirp_looper_fd, readfds) &&
+			    iolooper_wait(slirp_looper, 0) > 0) {
+				int fd, flags;
+
+				while ((fd = iolooper_next_pending(slirp_looper, &flags)) >= 0) {
+					/* NULL if freed while handling another one */
+					so = slirp_poll_lookup(fd);
+					if (!so)
+					   continue;
+					so->so_revents = 0;
+					if (flags & IOLOOPER_READ)
+					   so->so_revents |= SO_POLL_READ;
+					if (flags & IOLOOPER_WRITE)
+					   so->so_revents |= SO_POLL_WRITE;
+					if (so->so_tcpcb)
+					   slirp_poll_tcp(so);
+					else
+					   slirp_poll_udp(so);
+				}
+			}
+		} else {
 			/*
-			 * Check sockets for reading
+			 * Check TCP sockets
 			 */
-			else if (FD_ISSET(so->s, readfds)) {
-				/*
-				 * Check for incoming connections
-				 */
-				if (so->so_state & SS_FACCEPTCONN) {
-					tcp_connect(so);
-					continue;
-				} /* else */
-				ret = soread(so);
-
-				/* Output it if we read something */
-				if (ret > 0)
-				   tcp_output(sototcpcb(so));
+			for (so = tcb.so_next; so != &tcb; so = so_next) {
+				so_next = so->so_next;
+				so->so_revents = slirp_fd_events(so->s, readfds,
+				                                 writefds, xfds);
+				slirp_poll_tcp(so);
 			}
 
 			/*
-			 * Check sockets for writing
+			 * Now UDP sockets.
 			 */
-			if (FD_ISSET(so->s, writefds)) {
-			  /*
-			   * Check for non-blocking, still-connecting sockets
-			   */
-			  if (so->so_state & SS_ISFCONNECTING) {
-			    /* Connected */
-			    so->so_state &= ~SS_ISFCONNECTING;
-
-			    ret = socket_send(so->s, (const void *)&ret, 0);
-			    if (ret < 0) {
-			      /* XXXXX Must fix, zero bytes is a NOP */
-			      if (errno == EAGAIN || errno == EWOULDBLOCK ||
-				  errno == EINPROGRESS || errno == ENOTCONN)
-				continue;
-
-			      /* else failed */
-			      so->so_state = SS_NOFDREF;
-			    }
-			    /* else so->so_state &= ~SS_ISFCONNECTING; */
-
-			    /*
-			     * Continue tcp_input
-			     */
-			    tcp_input((struct mbuf *)NULL, sizeof(struct ip), so);
-			    /* continue; */
-			  } else
-			    ret = sowrite(so);
-			  /*
-			   * XXXXX If we wrote something (a lot), there
-			   * could be a need for a window update.
-			   * In the worst case, the remote will send
-			   * a window probe to get things going again
-			   */
+			for (so = udb.so_next; so != &udb; so = so_next) {
+				so_next = so->so_next;
+				so->so_revents = slirp_fd_events(so->s, readfds,
+				                                 writefds, xfds);
+				slirp_poll_udp(so);
 			}
-
-			/*
-			 * Probe a still-connecting, non-blocking socket
-			 * to check if it's still alive
-	 	 	 */
-#ifdef PROBE_CONN
-			if (so->so_state & SS_ISFCONNECTING) {
-			  ret = socket_recv(so->s, (char *)&ret, 0);
-
-			  if (ret < 0) {
-			    /* XXX */
-			    if (errno == EAGAIN || errno == EWOULDBLOCK ||
-				errno == EINPROGRESS || errno == ENOTCONN)
-			      continue; /* Still connecting, continue */
-
-			    /* else failed */
-			    so->so_state = SS_NOFDREF;
-
-			    /* tcp_input will take care of it */
-			  } else {
-			    ret = socket_send(so->s, &ret, 0);
-			    if (ret < 0) {
-			      /* XXX */
-			      if (errno == EAGAIN || errno == EWOULDBLOCK ||
-				  errno == EINPROGRESS || errno == ENOTCONN)
-				continue;
-			      /* else failed */
-			      so->so_state = SS_NOFDREF;
-			    } else
-			      so->so_state &= ~SS_ISFCONNECTING;
-
-			  }
-			  tcp_input((struct mbuf *)NULL, sizeof(struct ip),so);
-			} /* SS_ISFCONNECTING */
-#endif
-		}
-
-		/*
-		 * Now UDP sockets.
-		 * Incoming packets are sent straight away, they're not buffered.
-		 * Incoming UDP data isn't buffered either.
-		 */
-		for (so = udb.so_next; so != &udb; so = so_next) {
-			so_next = so->so_next;
-
-            if ((so->so_state & SS_PROXIFIED) != 0)
-                continue;
-
-			if (so->s != -1 && FD_ISSET(so->s, readfds)) {
-                            sorecvfrom(so);
-                        }
 		}
 	}
 
@@ -742,6 +949,9 @@ static void arp_input(const uint8_t *pkt, int pkt_len)
     }
 }
 
+static PerfCounter slirp_packets_from_guest_counter =
+    PERF_COUNTER_INIT("slirp.packets_from_guest", "packets");
+
 void slirp_input(const uint8_t *pkt, int pkt_len)
 {
     struct mbuf *m;
@@ -750,6 +960,8 @@ void slirp_input(const uint8_t *pkt, int pkt_len)
     if (pkt_len < ETH_HLEN)
         return;
 
+    perfCounter_add(&slirp_packets_from_guest_counter, 1);
+
     proto = ntohs(*(uint16_t *)(pkt + 12));
     switch(proto) {
     case ETH_P_ARP:
@@ -830,19 +1042,11 @@ void if_encap(const uint8_t *ip_data, int ip_data_len)
 
 /*---------------------------------------------------*/
 /* User mode network stack restrictions */
-struct fw_allow_entry {
-    struct fw_allow_entry* next;
-    unsigned long dst_addr;   /* host byte order */
-    /* Allowed port range. dst_lport should be the same as dst_hport for a
-     * single port. */
-    unsigned short dst_lport; /* host byte order */
-    unsigned short dst_hport; /* host byte order */
-};
-
 static int drop_udp = 0;
 static int drop_tcp = 0;
-static struct fw_allow_entry* allow_tcp_entries = NULL;
-static struct fw_allow_entry* allow_udp_entries = NULL;
+/* The allow rules are indexed by destination, values are unused */
+static AIpRuleSet* allow_tcp_entries = NULL;
+static AIpRuleSet* allow_udp_entries = NULL;
 static FILE* drop_log_fd = NULL;
 static FILE* dns_log_fd = NULL;
 static int max_dns_conns = -1;   /* unlimited max DNS connections by default */
@@ -887,7 +1091,7 @@ void slirp_add_allow(unsigned long dst_addr,
                      int dst_lport, int dst_hport,
                      u_int8_t proto) {
 
-    struct fw_allow_entry** ate;
+    AIpRuleSet** ate;
     switch (proto) {
       case IPPROTO_TCP:
           ate = &allow_tcp_entries;
@@ -899,20 +1103,12 @@ void slirp_add_allow(unsigned long dst_addr,
           return; // unknown protocol for the FW
     }
 
-    while(*ate != NULL)
-        ate = &(*ate)->next;
+    if (*ate == NULL)
+        *ate = aipRuleSet_new();
 
-    *ate = malloc(sizeof(**ate));
-    if (*ate == NULL) {
-        DEBUG_MISC((dfd,
-                    "Unable to create new firewall record, malloc failed\n"));
-        exit(-1);
-    }
-
-    (*ate)->next = NULL;
-    (*ate)->dst_addr = dst_addr;
-    (*ate)->dst_lport = dst_lport;
-    (*ate)->dst_hport = dst_hport;
+    // allow any destination if 0
+    aipRuleSet_add(*ate, dst_addr, dst_addr ? 0xffffffff : 0,
+                   dst_lport, dst_hport, NULL);
 }
 
 void slirp_drop_log_fd(FILE* fd) {
@@ -936,7 +1132,7 @@ int slirp_should_drop(unsigned long dst_addr,
                       int dst_port,
                       u_int8_t proto) {
 
-    struct fw_allow_entry* ate;
+    AIpRuleSet* ate;
 
     switch (proto) {
         case IPPROTO_TCP:
@@ -955,14 +1151,8 @@ int slirp_should_drop(unsigned long dst_addr,
             return 1;  // unknown protocol for the FW
     }
 
-    while(ate) {
-        if ((ate->dst_lport <= dst_port) && (dst_port <= ate->dst_hport)) {
-            // allow any destination if 0
-            if (ate->dst_addr == 0 || ate->dst_addr == dst_addr)
-                return 0;
-        }
-        ate = ate->next;
-    }
+    if (ate && aipRuleSet_find(ate, dst_addr, dst_port, NULL))
+        return 0;
 
     return 1;
 }
@@ -1052,7 +1242,6 @@ int slirp_get_max_dns_conns() {
 
 /* generic guest network redirection functionality for ipv4 */
 struct net_forward_entry {
-    QTAILQ_ENTRY(net_forward_entry) next;
     /* ip addresses are also in host byte order */
     unsigned long dest_ip;            /* the destination address they try to contact */
     unsigned long dest_mask;          /* the mask to apply to the address for matching */
@@ -1065,12 +1254,13 @@ struct net_forward_entry {
     int redirect_port; /* Host byte order */
 };
 
-static QTAILQ_HEAD(net_forwardq, net_forward_entry) net_forwards;
+/* The forwarding entries, indexed by destination */
+static AIpRuleSet* net_forwards;
 
 static void slirp_net_forward_init(void)
 {
     if (!slirp_net_forward_inited) {
-      QTAILQ_INIT(&net_forwards);
+      net_forwards = aipRuleSet_new();
       slirp_net_forward_inited = 1;
     }
 }
@@ -1095,7 +1285,8 @@ void slirp_add_net_forward(unsigned long dest_ip, unsigned long dest_mask,
     entry->redirect_ip = redirect_ip;
     entry->redirect_port = redirect_port;
 
-    QTAILQ_INSERT_TAIL(&net_forwards, entry, next);
+    aipRuleSet_add(net_forwards, dest_ip, dest_mask,
+                   dest_lport, dest_hport, entry);
 }
 
 /* remote_port and redir_port arguments
@@ -1105,21 +1296,14 @@ int slirp_should_net_forward(unsigned long remote_ip, int remote_port,
 {
     struct net_forward_entry *entry;
 
-    for (entry = net_forwards.tqh_first;
-         entry != NULL; entry = entry->next.tqe_next) {
-
-        if ((entry->dest_lport <= remote_port)
-            && (remote_port <= entry->dest_hport)) {
-            if ((entry->dest_ip & entry->dest_mask)
-                == (remote_ip & entry->dest_mask)) {
-              *redirect_ip = entry->redirect_ip;
-              *redirect_port = entry->redirect_port;
-              return 1;
-            }
-        }
-    }
+    if (!net_forwards ||
+        !aipRuleSet_find(net_forwards, remote_ip, remote_port,
+                         (void**)&entry))
+        return 0;
 
-    return 0;
+    *redirect_ip = entry->redirect_ip;
+    *redirect_port = entry->redirect_port;
+    return 1;
 }
 
 /*---------------------------------------------------*/
@@ -1342,7 +1526,7 @@ static void slirp_socket_save(QEMUFile *f, struct socket *so)
     slirp_tcp_save(f, so->so_tcpcb);
 }
 
-static void slirp_state_save(QEMUFile *f, void *opaque)
+static void slirp_state_save_locked(QEMUFile *f)
 {
     struct ex_list *ex_ptr;
 
@@ -1359,6 +1543,16 @@ static void slirp_state_save(QEMUFile *f, void *opaque)
     qemu_put_byte(f, 0);
 }
 
+/* savevm runs on the main thread, while the slirp thread may be walking
+ * or changing the socket lists.
+ */
+static void slirp_state_save(QEMUFile *f, void *opaque)
+{
+    slirp_lock();
+    slirp_state_save_locked(f);
+    slirp_unlock();
+}
+
 static void slirp_tcp_load(QEMUFile *f, struct tcpcb *tp)
 {
     int i;
@@ -1453,7 +1647,7 @@ static int slirp_socket_load(QEMUFile *f, struct socket *so)
     return 0;
 }
 
-static int slirp_state_load(QEMUFile *f, void *opaque, int version_id)
+static int slirp_state_load_locked(QEMUFile *f)
 {
     struct ex_list *ex_ptr;
     int r;
@@ -1487,3 +1681,13 @@ static int slirp_state_load(QEMUFile *f, void *opaque, int version_id)
 
     return 0;
 }
+
+static int slirp_state_load(QEMUFile *f, void *opaque, int version_id)
+{
+    int ret;
+
+    slirp_lock();
+    ret = slirp_state_load_locked(f);
+    slirp_unlock();
+    return ret;
+}
@@ -63,6 +63,7 @@ socreate(void)
     memset(so, 0, sizeof(struct socket));
     so->so_state = SS_NOFDREF;
     so->s = -1;
+    so->so_poll_fd = -1;
   }
   return(so);
 }
@@ -76,6 +77,8 @@ sofree(struct socket *so)
   if (so->so_state & SS_PROXIFIED)
     proxy_manager_del(so);
 
+  slirp_poll_remove(so);
+
   if (so->so_emu==EMU_RSH && so->extra) {
 	sofree(so->extra);
 	so->extra=NULL;
@@ -446,6 +449,15 @@ sowrite(struct socket *so)
 	return nn;
 }
 
+/* Number of datagrams read at once by sorecvfrom() */
+#define SO_RECV_BATCH 8
+
+/*
+ * Receives the part of each datagram that doesn't fit in its mbuf. This is
+ * only touched for large datagrams.
+ */
+static char sorecv_overflow[SO_RECV_BATCH][65536];
+
 /*
  * recvfrom() a UDP socket
  */
@@ -480,32 +492,36 @@ sorecvfrom(struct socket *so)
 	  /* No need for this socket anymore, udp_detach it */
 	  udp_detach(so);
 	} else {                            	/* A "normal" UDP packet */
+	  struct mbuf *mbufs[SO_RECV_BATCH];
+	  SockBuffer buffers[SO_RECV_BATCH][2];
+	  SockDatagram datagrams[SO_RECV_BATCH];
 	  struct mbuf *m;
-          int len;
-		  int n;
-
-	  if (!(m = m_get())) return;
-	  m->m_data += IF_MAXLINKHDR;
+	  int count, received, room, n;
 
 	  /*
-	   * XXX Shouldn't FIONREAD packets destined for port 53,
-	   * but I don't know the max packet size for DNS lookups
+	   * Drain up to SO_RECV_BATCH datagrams with a single system call,
+	   * e.g. for bursts of DNS replies. Each one is received in its own
+	   * mbuf, and the part of a large one that doesn't fit is received
+	   * in an overflow buffer, then copied to the grown mbuf.
 	   */
-	  len = M_FREEROOM(m);
-	  /* if (so->so_fport != htons(53)) { */
-	  n = socket_can_read(so->s);
-
-	  if (n > len) {
-	    n = (m->m_data - m->m_dat) + m->m_len + n + 1;
-	    m_inc(m, n);
-	    len = M_FREEROOM(m);
+	  for (count = 0; count < SO_RECV_BATCH; count++) {
+	    if (!(m = m_get()))
+	      break;
+	    m->m_data += IF_MAXLINKHDR;
+	    mbufs[count] = m;
+	    buffers[count][0].data = m->m_data;
+	    buffers[count][0].size = M_FREEROOM(m);
+	    buffers[count][1].data = sorecv_overflow[count];
+	    buffers[count][1].size = sizeof(sorecv_overflow[count]);
+	    datagrams[count].buffers = buffers[count];
+	    datagrams[count].count = 2;
 	  }
-	  /* } */
+	  if (count == 0) return;
 
-	  m->m_len = socket_recvfrom(so->s, m->m_data, len, &addr);
-	  DEBUG_MISC((dfd, " did recvfrom %d, errno = %d-%s\n",
-		      m->m_len, errno,errno_str));
-	  if(m->m_len<0) {
+	  received = socket_recv_batch(so->s, datagrams, count);
+	  DEBUG_MISC((dfd, " did recvfrom %d datagrams, errno = %d-%s\n",
+		      received, errno,errno_str));
+	  if(received<0) {
 	    u_char code=ICMP_UNREACH_PORT;
 
 	    if(errno == EHOSTUNREACH) code=ICMP_UNREACH_HOST;
@@ -513,8 +529,19 @@ sorecvfrom(struct socket *so)
 
 	    DEBUG_MISC((dfd," rx error, tx icmp ICMP_UNREACH:%i\n", code));
 	    icmp_error(so->so_m, ICMP_UNREACH,code, 0,errno_str);
-	    m_free(m);
-	  } else {
+	    received = 0;
+	  }
+	  for (n = received; n < count; n++)
+	    m_free(mbufs[n]);
+
+	  for (n = 0; n < received; n++) {
+	    m = mbufs[n];
+	    m->m_len = datagrams[n].size;
+	    room = buffers[n][0].size;
+	    if (m->m_len > room) {
+	      m_inc(m, (m->m_data - m->m_dat) + m->m_len + 1);
+	      memcpy(m->m_data + room, sorecv_overflow[n], m->m_len - room);
+	    }
 	  /*
 	   * Hack: domain name lookup will be used the most for UDP,
 	   * and since they'll only be used once there's no need
@@ -528,18 +555,12 @@ sorecvfrom(struct socket *so)
 		so->so_expire = curtime + SO_EXPIRE;
 	    }
 
-	    /*		if (m->m_len == len) {
-	     *			m_inc(m, MINCSIZE);
-	     *			m->m_len = 0;
-	     *		}
-	     */
-
 	    /*
 	     * If this packet was destined for CTL_ADDR,
 	     * make it look like that's where it came from, done by udp_output
 	     */
-	    udp_output_(so, m, &addr);
-	  } /* rx error */
+	    udp_output_(so, m, &datagrams[n].address);
+	  }
 	} /* if ping packet */
 }
 
@@ -751,6 +772,7 @@ sofcantrcvmore(struct socket *so)
 		if(global_writefds) {
 		  FD_CLR(so->s,global_writefds);
 		}
+		so->so_revents &= ~SO_POLL_WRITE;
 	}
 	so->so_state &= ~(SS_ISFCONNECTING);
 	if (so->so_state & SS_FCANTSENDMORE)
@@ -770,6 +792,7 @@ sofcantsendmore(struct socket *so)
             if (global_xfds) {
                 FD_CLR(so->s,global_xfds);
             }
+            so->so_revents &= ~(SO_POLL_READ|SO_POLL_EXCEPT);
 	}
 	so->so_state &= ~(SS_ISFCONNECTING);
 	if (so->so_state & SS_FCANTRCVMORE)
@@ -52,8 +52,19 @@ struct socket {
   struct sbuf so_rcv;		/* Receive buffer */
   struct sbuf so_snd;		/* Send buffer */
   void * extra;			/* Extra pointer */
+
+  int	so_poll_fd;		/* Descriptor registered with the poller, or -1 */
+  int	so_poll_events;		/* SO_POLL_* events registered with the poller */
+  int	so_revents;		/* SO_POLL_* events pending for this socket */
 };
 
+/*
+ * Events a socket is polled for, see slirp_select_fill()
+ */
+#define SO_POLL_READ		0x1
+#define SO_POLL_WRITE		0x2
+#define SO_POLL_EXCEPT		0x4
+
 
 /*
  * Socket state bits. (peer means the host on the Internet,
@@ -46,8 +46,13 @@ typedef	u_int32_t	tcp_seq;
 
 extern struct socket *tcp_last_so;
 
-#define TCP_SNDSPACE 8192
-#define TCP_RCVSPACE 8192
+/*
+ * Socket buffer sizes. These are large enough for a full 64KB window, so
+ * that a single host recv()/writev() moves as much data as possible, with
+ * tcp_output() splitting it into MSS-sized segments for the guest.
+ */
+#define TCP_SNDSPACE 65536
+#define TCP_RCVSPACE 65536
 
 /*
  * TCP header.
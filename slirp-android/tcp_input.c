@@ -303,7 +303,7 @@ tcp_input(struct mbuf *m, int iphlen, struct socket *inso)
 	/* keep checksum for ICMP reply
 	 * ti->ti_sum = cksum(m, len);
 	 * if (ti->ti_sum) { */
-	if(cksum(m, len)) {
+	if(slirp_verify_checksums && cksum(m, len)) {
 	  STAT(tcpstat.tcps_rcvbadsum++);
 	  goto drop;
 	}
@@ -576,7 +576,7 @@ findso:
 			if (so->so_emu) {
 				if (tcp_emu(so,m)) sbappend(so, m);
 			} else
-				sbappend(so, m);
+				sbappend_coalesce(so, m, ti->ti_flags & TH_PUSH);
 
 			/*
 			 * XXX This is called when data arrives.  Later, check
@@ -90,6 +90,11 @@ void tlb_fill(CPUARMState *env, target_ulong addr, int is_write, int mmu_idx,
     }
 }
 
+void *HELPER(lookup_tb_ptr)(CPUARMState *env)
+{
+    return tb_lookup_ptr(env);
+}
+
 void HELPER(set_cp)(CPUARMState *env, uint32_t insn, uint32_t val)
 {
     int cp_num = (insn >> 8) & 0xf;
@@ -18,6 +18,7 @@
 
 #include <inttypes.h>
 #include "hw/hw.h"
+#include "qemu/timer.h"
 #include "target-i386/hax-i386.h"
 
 #define HAX_EMUL_ONE    0x1
@@ -34,6 +35,31 @@ struct hax_state hax_global;
 
 int hax_support = -1;
 
+/* devices registered with hax_register_fast_mmio() */
+#define HAX_MAX_FAST_MMIO 4
+
+typedef struct {
+    hwaddr base;
+    hwaddr size;
+    CPUReadMemoryFunc **read;
+    CPUWriteMemoryFunc **write;
+    void *opaque;
+} HaxFastMmio;
+
+static HaxFastMmio hax_fast_mmio[HAX_MAX_FAST_MMIO];
+static int hax_fast_mmio_count;
+
+/* vcpu exits since hax_init(), see hax_dump_stats() */
+static struct {
+    int64_t start_ns;
+    uint64_t exits;
+    uint64_t io;
+    uint64_t mmio;
+    uint64_t fast_mmio;
+    uint64_t fast_mmio_direct;
+    uint64_t hlt;
+} hax_stats;
+
 /* Called after hax_init */
 int hax_enabled()
 {
@@ -47,13 +73,25 @@ int hax_vcpu_emulation_mode(CPUState *cpu)
     return !(env->cr[0] & CR0_PG_MASK);
 }
 
+static int hax_arch_get_registers_lazy(CPUState *cpu);
+static int hax_arch_set_registers(CPUState *cpu, int groups);
+
 static int hax_prepare_emulation(CPUX86State *env)
 {
+    CPUState *cpu = ENV_GET_CPU(env);
+
     /* Flush all emulation states */
     tlb_flush(env, 1);
     tb_flush(env);
-    /* Sync the vcpu state from hax kernel module */
-    hax_vcpu_sync_state(ENV_GET_CPU(env), 0);
+    /*
+     * Sync the vcpu state from hax kernel module. A single MMIO
+     * instruction rarely needs more than the general registers, the
+     * FPU is fetched when such an instruction is translated
+     */
+    if (cpu->hax_vcpu->emulation_state == HAX_EMULATE_STATE_MMIO)
+        hax_arch_get_registers_lazy(cpu);
+    else
+        hax_vcpu_sync_state(cpu, 0);
     return 0;
 }
 
@@ -88,9 +126,11 @@ int hax_stop_emulation(CPUState *cpu)
         cpu->hax_vcpu->emulation_state =  HAX_EMULATE_STATE_NONE;
         /*
          * QEMU emulation changes vcpu state,
-         * Sync the vcpu state to HAX kernel module
+         * Sync the vcpu state to HAX kernel module,
+         * only the register groups that were fetched
          */
-        hax_vcpu_sync_state(cpu, 1);
+        hax_arch_set_registers(cpu, cpu->hax_vcpu->sync_groups);
+        cpu->hax_vcpu->sync_groups = HAX_SYNC_ALL;
         return 1;
     }
 
@@ -281,6 +321,7 @@ int hax_init_vcpu(CPUState *cpu)
 
     cpu->hax_vcpu = hax_global.vm->vcpus[cpu->cpu_index];
     cpu->hax_vcpu->emulation_state = HAX_EMULATE_STATE_INITIAL;
+    cpu->hax_vcpu->sync_groups = HAX_SYNC_ALL;
 
     return ret;
 }
@@ -396,6 +437,7 @@ int hax_init(int smp_cpus)
     hax_notify_qemu_version(hax->vm->fd, &qversion);
     hax_support = 1;
     qemu_register_reset( hax_reset_vcpu_state, 0, NULL);
+    hax_stats.start_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
 
     return 0;
 error:
@@ -407,9 +449,43 @@ error:
     return ret;
 }
 
+int hax_register_fast_mmio(hwaddr base, hwaddr size,
+                           CPUReadMemoryFunc **read,
+                           CPUWriteMemoryFunc **write, void *opaque)
+{
+    HaxFastMmio *m;
+
+    if (hax_fast_mmio_count == HAX_MAX_FAST_MMIO)
+        return -ENOSPC;
+
+    m = &hax_fast_mmio[hax_fast_mmio_count++];
+    m->base = base;
+    m->size = size;
+    m->read = read;
+    m->write = write;
+    m->opaque = opaque;
+    return 0;
+}
+
+void hax_dump_stats(FILE *f, fprintf_function cpu_fprintf)
+{
+    double seconds = (qemu_clock_get_ns(QEMU_CLOCK_REALTIME) -
+                      hax_stats.start_ns) / 1e9;
+
+    if (seconds <= 0)
+        seconds = 1;
+    cpu_fprintf(f, "HAX exits           %" PRIu64 " (%.0f/s)\n",
+                hax_stats.exits, hax_stats.exits / seconds);
+    cpu_fprintf(f, "HAX exit reasons    io=%" PRIu64 " mmio=%" PRIu64
+                " fast mmio=%" PRIu64 " (%" PRIu64 " direct) hlt=%" PRIu64
+                "\n", hax_stats.io, hax_stats.mmio, hax_stats.fast_mmio,
+                hax_stats.fast_mmio_direct, hax_stats.hlt);
+}
+
 int  hax_handle_fastmmio(CPUX86State *env, struct hax_fastmmio *hft)
 {
     uint64_t buf = 0;
+    int i;
 
     /*
      * With fast MMIO, QEMU need not sync vCPU state with HAXM
@@ -424,6 +500,28 @@ int  hax_handle_fastmmio(CPUX86State *env, struct hax_fastmmio *hft)
     env->cr[3] = hft->_cr3;
     env->cr[4] = hft->_cr4;
 
+    for (i = 0; i < hax_fast_mmio_count; i++) {
+        HaxFastMmio *m = &hax_fast_mmio[i];
+        hwaddr offset = hft->gpa - m->base;
+        int index;
+
+        if (offset >= m->size) {
+            continue;
+        }
+        /* the handlers are indexed by log2 of the access size */
+        if (hft->size != 1 && hft->size != 2 && hft->size != 4) {
+            break;
+        }
+        index = hft->size >> 1;
+        if (hft->direction) {
+            m->write[index](m->opaque, offset, hft->value);
+        } else {
+            hft->value = m->read[index](m->opaque, offset);
+        }
+        hax_stats.fast_mmio_direct++;
+        return 0;
+    }
+
     buf = hft->value;
     cpu_physical_memory_rw(hft->gpa, &buf, hft->size, hft->direction);
     if (hft->direction == 0)
@@ -556,7 +654,9 @@ static int hax_vcpu_hax_exec(CPUState *cpu)
 
         hax_vcpu_interrupt(cpu);
 
+        qemu_mutex_unlock_iothread();
         hax_ret = hax_vcpu_run(vcpu);
+        qemu_mutex_lock_iothread();
 
         /* Simply continue the vcpu_run if system call interrupted */
         if (hax_ret == -EINTR || hax_ret == -EAGAIN) {
@@ -569,19 +669,23 @@ static int hax_vcpu_hax_exec(CPUState *cpu)
             dprint("vcpu run failed for vcpu  %x\n", vcpu->vcpu_id);
             abort();
         }
+        hax_stats.exits++;
         switch (ht->_exit_status)
         {
             case HAX_EXIT_IO:
                 {
+                    hax_stats.io++;
                     ret = hax_handle_io(env, ht->pio._df, ht->pio._port,
                       ht->pio._direction,
                       ht->pio._size, ht->pio._count, vcpu->iobuf);
                 }
                 break;
             case HAX_EXIT_MMIO:
+                hax_stats.mmio++;
                 ret = HAX_EMUL_ONE;
                 break;
             case HAX_EXIT_FAST_MMIO:
+                hax_stats.fast_mmio++;
                 ret = hax_handle_fastmmio(env,
                         (struct hax_fastmmio *)vcpu->iobuf);
                 break;
@@ -604,6 +708,7 @@ static int hax_vcpu_hax_exec(CPUState *cpu)
                 ret = HAX_EMUL_EXITLOOP;
                 break;
             case HAX_EXIT_HLT:
+                hax_stats.hlt++;
                 if (!(cpu->interrupt_request & CPU_INTERRUPT_HARD) &&
                   !(cpu->interrupt_request & CPU_INTERRUPT_NMI)) {
                     /* hlt instruction with interrupt disabled is shutdown */
@@ -1058,10 +1163,52 @@ int hax_arch_get_registers(CPUState *cpu)
     if (ret < 0)
         return ret;
 
+    cpu->hax_vcpu->sync_groups = HAX_SYNC_ALL;
+    return 0;
+}
+
+/* Fetch the general and segment registers only, see hax_vcpu_load_regs() */
+static int hax_arch_get_registers_lazy(CPUState *cpu)
+{
+    int ret;
+
+    ret = hax_sync_vcpu_register(cpu->env_ptr, 0);
+    if (ret < 0)
+        return ret;
+
+    cpu->hax_vcpu->sync_groups = 0;
+    return 0;
+}
+
+/*
+ * Fetch the register groups not fetched yet by the MMIO emulation,
+ * called by the translator before it translates an instruction that
+ * uses them. The emulated instruction is the one that faulted on an
+ * MMIO access, so an MSR instruction never gets there; the FPU is
+ * needed by the SSE and x87 moves to and from the framebuffer.
+ */
+int hax_vcpu_load_regs(CPUState *cpu, int groups)
+{
+    CPUX86State *env = cpu->env_ptr;
+    struct hax_vcpu_state *vcpu = cpu->hax_vcpu;
+    int ret;
+
+    groups &= ~vcpu->sync_groups;
+    if (groups & HAX_SYNC_FPU) {
+        ret = hax_get_fpu(env);
+        if (ret < 0)
+            return ret;
+    }
+    if (groups & HAX_SYNC_MSRS) {
+        ret = hax_get_msrs(env);
+        if (ret < 0)
+            return ret;
+    }
+    vcpu->sync_groups |= groups;
     return 0;
 }
 
-static int hax_arch_set_registers(CPUState *cpu)
+static int hax_arch_set_registers(CPUState *cpu, int groups)
 {
     int ret;
     CPUX86State *env = cpu->env_ptr;
@@ -1072,17 +1219,23 @@ static int hax_arch_set_registers(CPUState *cpu)
         dprint("Failed to sync vcpu reg\n");
         return ret;
     }
-    ret = hax_set_fpu(env);
-    if (ret < 0)
+    if (groups & HAX_SYNC_FPU)
     {
-        dprint("FPU failed\n");
-        return ret;
+        ret = hax_set_fpu(env);
+        if (ret < 0)
+        {
+            dprint("FPU failed\n");
+            return ret;
+        }
     }
-    ret = hax_set_msrs(env);
-    if (ret < 0)
+    if (groups & HAX_SYNC_MSRS)
     {
-        dprint("MSR failed\n");
-        return ret;
+        ret = hax_set_msrs(env);
+        if (ret < 0)
+        {
+            dprint("MSR failed\n");
+            return ret;
+        }
     }
 
     return 0;
@@ -1092,7 +1245,7 @@ void hax_vcpu_sync_state(CPUState *cpu, int modified)
 {
     if (hax_enabled()) {
         if (modified)
-            hax_arch_set_registers(cpu);
+            hax_arch_set_registers(cpu, HAX_SYNC_ALL);
         else
             hax_arch_get_registers(cpu);
     }
@@ -1108,7 +1261,7 @@ int hax_sync_vcpus(void)
         CPUState *cpu;
 
         CPU_FOREACH(cpu) {
-            int ret = hax_arch_set_registers(cpu);
+            int ret = hax_arch_set_registers(cpu, HAX_SYNC_ALL);
             if (ret < 0) {
                 dprint("Failed to sync HAX vcpu context\n");
                 exit(1);
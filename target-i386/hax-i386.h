@@ -31,6 +31,8 @@ struct hax_vcpu_state
     hax_fd fd;
     int vcpu_id;
     int emulation_state;
+    /* HAX_SYNC_* register groups held in env, see hax_vcpu_load_regs() */
+    int sync_groups;
     struct hax_tunnel *tunnel;
     unsigned char *iobuf;
 };
@@ -3282,6 +3282,88 @@ static const struct SSEOpHelper_eppi sse_op_table7[256] = {
     [0x63] = SSE42_OP(pcmpistri),
 };
 
+/* The bitwise ops and the 64-bit adds and subtracts work on 64-bit
+   lanes, so they are generated inline on the halves of the MMX or XMM
+   registers instead of calling the ops_sse.h helpers.  Returns false
+   for the other ops.  */
+static bool gen_sse_inline(int b, int is_xmm, int op1_offset, int op2_offset)
+{
+    TCGv_i64 t0, t1;
+    int i;
+
+    switch (b) {
+    case 0x54: /* andps, andpd */
+    case 0x55: /* andnps, andnpd */
+    case 0x56: /* orps, orpd */
+    case 0x57: /* xorps, xorpd */
+    case 0xd4: /* paddq */
+    case 0xdb: /* pand */
+    case 0xdf: /* pandn */
+    case 0xeb: /* por */
+    case 0xef: /* pxor */
+    case 0xfb: /* psubq */
+        break;
+    default:
+        return false;
+    }
+
+    t0 = tcg_temp_new_i64();
+    t1 = tcg_temp_new_i64();
+    for (i = 0; i < (is_xmm ? 2 : 1); i++) {
+        int ofs = i * sizeof(uint64_t);
+
+        if (op1_offset == op2_offset &&
+            (b == 0x55 || b == 0x57 || b == 0xdf || b == 0xef ||
+             b == 0xfb)) {
+            /* xor reg, reg and friends clear the register */
+            tcg_gen_movi_i64(t0, 0);
+            tcg_gen_st_i64(t0, cpu_env, op1_offset + ofs);
+            continue;
+        }
+        tcg_gen_ld_i64(t0, cpu_env, op1_offset + ofs);
+        tcg_gen_ld_i64(t1, cpu_env, op2_offset + ofs);
+        switch (b) {
+        case 0x54:
+        case 0xdb:
+            tcg_gen_and_i64(t0, t0, t1);
+            break;
+        case 0x55:
+        case 0xdf:
+            tcg_gen_andc_i64(t0, t1, t0);
+            break;
+        case 0x56:
+        case 0xeb:
+            tcg_gen_or_i64(t0, t0, t1);
+            break;
+        case 0x57:
+        case 0xef:
+            tcg_gen_xor_i64(t0, t0, t1);
+            break;
+        case 0xd4:
+            tcg_gen_add_i64(t0, t0, t1);
+            break;
+        case 0xfb:
+            tcg_gen_sub_i64(t0, t0, t1);
+            break;
+        }
+        tcg_gen_st_i64(t0, cpu_env, op1_offset + ofs);
+    }
+    tcg_temp_free_i64(t1);
+    tcg_temp_free_i64(t0);
+    return true;
+}
+
+#ifdef CONFIG_HAX
+/* the HAX MMIO emulation fetches the FPU state on demand */
+static inline void gen_hax_load_regs(CPUX86State *env, int groups)
+{
+    if (hax_enabled())
+        hax_vcpu_load_regs(ENV_GET_CPU(env), groups);
+}
+#else
+#define gen_hax_load_regs(env, groups) do { } while (0)
+#endif
+
 static void gen_sse(CPUX86State *env, DisasContext *s, int b,
                     target_ulong pc_start, int rex_r)
 {
@@ -3292,6 +3374,7 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
     SSEFunc_0_ppi sse_fn_ppi;
     SSEFunc_0_eppt sse_fn_eppt;
 
+    gen_hax_load_regs(env, HAX_SYNC_FPU);
     b &= 0xff;
     if (s->prefix & PREFIX_DATA)
         b1 = 1;
@@ -4255,6 +4338,9 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
             sse_fn_eppt(cpu_env, cpu_ptr0, cpu_ptr1, cpu_A0);
             break;
         default:
+            if (gen_sse_inline(b, is_xmm, op1_offset, op2_offset)) {
+                break;
+            }
             tcg_gen_addi_ptr(cpu_ptr0, cpu_env, op1_offset);
             tcg_gen_addi_ptr(cpu_ptr1, cpu_env, op2_offset);
             sse_fn_epp(cpu_env, cpu_ptr0, cpu_ptr1);
@@ -5650,6 +5736,7 @@ static target_ulong disas_insn(CPUX86State *env, DisasContext *s, target_ulong p
         /************************/
         /* floats */
     case 0xd8 ... 0xdf:
+        gen_hax_load_regs(env, HAX_SYNC_FPU);
         if (s->flags & (HF_EM_MASK | HF_TS_MASK)) {
             /* if CR0.EM or CR0.TS are set, generate an FPU exception */
             /* XXX: what to do if illegal op ? */
@@ -7609,6 +7696,7 @@ static target_ulong disas_insn(CPUX86State *env, DisasContext *s, target_ulong p
         gen_ldst_modrm(env, s, modrm, ot, reg, 1);
         break;
     case 0x1ae:
+        gen_hax_load_regs(env, HAX_SYNC_FPU);
         modrm = cpu_ldub_code(env, s->pc++);
         mod = (modrm >> 6) & 3;
         op = (modrm >> 3) & 7;
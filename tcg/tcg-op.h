@@ -2647,6 +2647,13 @@ static inline void tcg_gen_goto_tb(unsigned idx)
     tcg_gen_op1i(INDEX_op_goto_tb, idx);
 }
 
+/* Jump to host code, a TB or tcg_ctx.code_gen_epilogue. Only available
+   if TCG_TARGET_HAS_goto_ptr. */
+static inline void tcg_gen_goto_ptr(TCGv_ptr ptr)
+{
+    tcg_gen_op1i(INDEX_op_goto_ptr, GET_TCGV_PTR(ptr));
+}
+
 
 void tcg_gen_qemu_ld_i32(TCGv_i32, TCGv, TCGArg, TCGMemOp);
 void tcg_gen_qemu_st_i32(TCGv_i32, TCGv, TCGArg, TCGMemOp);
@@ -2452,6 +2452,30 @@ static void dump_op_count(void)
 #endif
 
 
+/* Count the ops that generate code, for -tcg-stats.  */
+static int64_t tcg_count_ops(TCGContext *s)
+{
+    const uint16_t *opc;
+    int64_t n = 0;
+
+    for (opc = s->gen_opc_buf; opc < s->gen_opc_ptr; opc++) {
+        switch (*opc) {
+        case INDEX_op_nop:
+        case INDEX_op_nop1:
+        case INDEX_op_nop2:
+        case INDEX_op_nop3:
+        case INDEX_op_nopn:
+        case INDEX_op_debug_insn_start:
+        case INDEX_op_end:
+            break;
+        default:
+            n++;
+            break;
+        }
+    }
+    return n;
+}
+
 static inline int tcg_gen_code_common(TCGContext *s, uint8_t *gen_code_buf,
                                       long search_pc)
 {
@@ -2472,11 +2496,22 @@ static inline int tcg_gen_code_common(TCGContext *s, uint8_t *gen_code_buf,
     s->opt_time -= profile_getclock();
 #endif
 
+    if (unlikely(s->op_stats) && search_pc < 0) {
+        s->op_stats_tbs++;
+        s->op_stats_gen += tcg_count_ops(s);
+    }
+
 #ifdef USE_TCG_OPTIMIZATIONS
-    s->gen_opparam_ptr =
-        tcg_optimize(s, s->gen_opc_ptr, s->gen_opparam_buf, tcg_op_defs);
+    if (!s->no_optimize) {
+        s->gen_opparam_ptr =
+            tcg_optimize(s, s->gen_opc_ptr, s->gen_opparam_buf, tcg_op_defs);
+    }
 #endif
 
+    if (unlikely(s->op_stats) && search_pc < 0) {
+        s->op_stats_opt += tcg_count_ops(s);
+    }
+
 #ifdef CONFIG_PROFILER
     s->opt_time += profile_getclock();
     s->la_time -= profile_getclock();
@@ -2488,6 +2523,10 @@ static inline int tcg_gen_code_common(TCGContext *s, uint8_t *gen_code_buf,
     s->la_time += profile_getclock();
 #endif
 
+    if (unlikely(s->op_stats) && search_pc < 0) {
+        s->op_stats_live += tcg_count_ops(s);
+    }
+
 #ifdef DEBUG_DISAS
     if (unlikely(qemu_loglevel_mask(CPU_LOG_TB_OP_OPT))) {
         qemu_log("OP after optimization and liveness analysis:\n");
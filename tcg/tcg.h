@@ -484,6 +484,16 @@ struct TCGContext {
 
     GHashTable *helpers;
 
+    bool no_optimize; /* skip tcg_optimize() for the current TB */
+
+    /* -tcg-stats: ops of the translated TBs as generated by the frontend,
+       after tcg_optimize() and after liveness analysis */
+    bool op_stats;
+    int64_t op_stats_tbs;
+    int64_t op_stats_gen;
+    int64_t op_stats_opt;
+    int64_t op_stats_live;
+
 #ifdef CONFIG_PROFILER
     /* profiling info */
     int64_t tb_count1;
@@ -520,6 +530,8 @@ struct TCGContext {
     /* Code generation */
     int code_gen_max_blocks;
     uint8_t *code_gen_prologue;
+    /* exit to cpu_exec() as exit_tb(0) does, target of goto_ptr */
+    uint8_t *code_gen_epilogue;
     uint8_t *code_gen_buffer;
     size_t code_gen_buffer_size;
     /* threshold to flush the translated code buffer */
@@ -271,6 +271,11 @@ typedef struct AModemRec_
     AModemUnsolFunc     unsol_func;
     void*               unsol_opaque;
 
+    /* unsolicited messages that were not sent yet, see amodem_unsol_queue() */
+    SysTimer            unsol_timer;
+    int                 unsol_size;
+    char                unsol_buff[4096];
+
     SmsReceiver         sms_receiver;
 
     int                 out_size;
@@ -301,6 +306,54 @@ typedef struct AModemRec_
 } AModemRec;
 
 
+/* Unsolicited messages are not sent one by one, but batched until the
+ * main loop runs again, so that bursts of them (e.g. SMS floods or
+ * registration changes) reach the device in a single write. Messages
+ * are always sent before the answer of the next command, to keep their
+ * order with respect to it.
+ */
+static void
+amodem_unsol_flush( AModem  modem )
+{
+    if (modem->unsol_size > 0) {
+        modem->unsol_buff[ modem->unsol_size ] = 0;
+        modem->unsol_size = 0;
+        modem->unsol_func( modem->unsol_opaque, modem->unsol_buff );
+    }
+}
+
+static void
+amodem_unsol_timer( void*  opaque )
+{
+    amodem_unsol_flush( (AModem) opaque );
+}
+
+static void
+amodem_unsol_queue( AModem  modem, const char*  message )
+{
+    int  len = strlen(message);
+
+    if (!modem->unsol_func)
+        return;
+
+    if (modem->unsol_size + len >= (int)sizeof(modem->unsol_buff))
+        amodem_unsol_flush( modem );
+
+    if (len >= (int)sizeof(modem->unsol_buff)) {
+        modem->unsol_func( modem->unsol_opaque, message );
+        return;
+    }
+
+    if (modem->unsol_size == 0) {
+        if (!modem->unsol_timer)
+            modem->unsol_timer = sys_timer_create();
+        sys_timer_set( modem->unsol_timer, sys_time_ms(),
+                       amodem_unsol_timer, modem );
+    }
+    memcpy( modem->unsol_buff + modem->unsol_size, message, len );
+    modem->unsol_size += len;
+}
+
 static void
 amodem_unsol( AModem  modem, const char* format, ... )
 {
@@ -310,7 +363,7 @@ amodem_unsol( AModem  modem, const char* format, ... )
         vsnprintf( modem->out_buff, sizeof(modem->out_buff), format, args );
         va_end(args);
 
-        modem->unsol_func( modem->unsol_opaque, modem->out_buff );
+        amodem_unsol_queue( modem, modem->out_buff );
     }
 }
 
@@ -335,7 +388,7 @@ amodem_receive_sms( AModem  modem, SmsPDU  sms )
 
         R( "SMS>> %s\n", p );
 
-        modem->unsol_func( modem->unsol_opaque, modem->out_buff );
+        amodem_unsol_queue( modem, modem->out_buff );
     }
 }
 
@@ -619,6 +672,11 @@ amodem_destroy( AModem  modem )
 {
     asimcard_destroy( modem->sim );
     modem->sim = NULL;
+    if (modem->unsol_timer) {
+        sys_timer_destroy( modem->unsol_timer );
+        modem->unsol_timer = NULL;
+    }
+    modem->unsol_size = 0;
 }
 
 
@@ -751,7 +809,7 @@ amodem_set_data_network_type( AModem  modem, ADataNetworkType   type )
     modemTech = tech_from_network_type(type);
     if (modem->unsol_func && modemTech != A_TECH_UNKNOWN) {
         if (_amodem_switch_technology( modem, modemTech, modem->preferred_mask )) {
-            modem->unsol_func( modem->unsol_opaque, modem->out_buff );
+            amodem_unsol_queue( modem, modem->out_buff );
         }
     }
 }
@@ -2475,12 +2533,140 @@ static const struct {
 };
 
 
+/* A trie of the commands of sDefaultResponses, so that each command is
+ * matched in a single pass over its characters, instead of being compared
+ * to every entry in turn. It is built in static storage on first use. When
+ * several entries match, the first one in the table wins, as with a linear
+ * search.
+ */
+#define  RESPONSE_TRIE_MAX_NODES  1024
+
+typedef struct {
+    char   c;
+    short  child;    /* first child node, or -1 */
+    short  sibling;  /* next child of the same parent, or -1 */
+    short  full;     /* first entry fully matched at this node, or -1 */
+    short  prefix;   /* first prefix entry matched at this node, or -1 */
+} ResponseTrieNode;
+
+static ResponseTrieNode  sResponseTrie[ RESPONSE_TRIE_MAX_NODES ];
+static int               sResponseTrieSize;  /* -1 if the table is too large */
+
+static int
+response_trie_new_node( char  c )
+{
+    ResponseTrieNode*  node;
+
+    if (sResponseTrieSize >= RESPONSE_TRIE_MAX_NODES)
+        return -1;
+
+    node = &sResponseTrie[ sResponseTrieSize ];
+    node->c       = c;
+    node->child   = -1;
+    node->sibling = -1;
+    node->full    = -1;
+    node->prefix  = -1;
+    return sResponseTrieSize++;
+}
+
+static int
+response_trie_child( int  node, char  c )
+{
+    int  child;
+
+    for (child = sResponseTrie[node].child; child >= 0;
+         child = sResponseTrie[child].sibling) {
+        if (sResponseTrie[child].c == c)
+            break;
+    }
+    return child;
+}
+
+static void
+response_trie_build( void )
+{
+    int  nn;
+
+    response_trie_new_node( 0 );  /* root */
+
+    for (nn = 0; sDefaultResponses[nn].cmd != NULL; nn++) {
+        const char*  scmd      = sDefaultResponses[nn].cmd;
+        int          is_prefix = (scmd[0] == '!');
+        int          node      = 0;
+
+        for (scmd += is_prefix; *scmd; scmd++) {
+            int  child = response_trie_child( node, *scmd );
+            if (child < 0) {
+                child = response_trie_new_node( *scmd );
+                if (child < 0) {
+                    sResponseTrieSize = -1;
+                    return;
+                }
+                sResponseTrie[child].sibling = sResponseTrie[node].child;
+                sResponseTrie[node].child    = child;
+            }
+            node = child;
+        }
+        if (is_prefix) {
+            if (sResponseTrie[node].prefix < 0)
+                sResponseTrie[node].prefix = nn;
+        } else {
+            if (sResponseTrie[node].full < 0)
+                sResponseTrie[node].full = nn;
+        }
+    }
+}
+
+/* Return the index of the entry of sDefaultResponses matching |cmd|, or -1 */
+static int
+amodem_find_response( const char*  cmd )
+{
+    int  node, found = -1;
+
+    if (sResponseTrieSize == 0)
+        response_trie_build();
+
+    if (sResponseTrieSize < 0) {  /* linear search */
+        int  nn;
+        for (nn = 0; sDefaultResponses[nn].cmd != NULL; nn++) {
+            const char*  scmd = sDefaultResponses[nn].cmd;
+
+            if (scmd[0] == '!') { /* prefix match */
+                if ( !memcmp( scmd + 1, cmd, strlen(scmd + 1) ) )
+                    return nn;
+            } else { /* full match */
+                if ( !strcmp( scmd, cmd ) )
+                    return nn;
+            }
+        }
+        return -1;
+    }
+
+    for (node = 0; node >= 0; node = response_trie_child( node, *cmd++ )) {
+        const ResponseTrieNode*  n = &sResponseTrie[node];
+
+        if (n->prefix >= 0 && (found < 0 || n->prefix < found))
+            found = n->prefix;
+
+        if (*cmd == 0) {
+            if (n->full >= 0 && (found < 0 || n->full < found))
+                found = n->full;
+            break;
+        }
+    }
+    return found;
+}
+
+
 #define  REPLY(str)  do { const char*  s = (str); R(">> %s\n", quote(s)); return s; } while (0)
 
 const char*  amodem_send( AModem  modem, const char*  cmd )
 {
     const char*  answer;
 
+    /* send the pending unsolicited messages before the answer */
+    amodem_unsol_flush( modem );
+
     if ( modem->wait_sms != 0 ) {
         modem->wait_sms = 0;
         R( "SMS<< %s\n", quote(cmd) );
@@ -2499,30 +2685,9 @@ const char*  amodem_send( AModem  modem, const char*  cmd )
 
     /* TODO: implement command handling */
     {
-        int  nn, found = 0;
-
-        for (nn = 0; ; nn++) {
-            const char*  scmd = sDefaultResponses[nn].cmd;
-
-            if (!scmd) /* end of list */
-                break;
-
-            if (scmd[0] == '!') { /* prefix match */
-                int  len = strlen(++scmd);
-
-                if ( !memcmp( scmd, cmd, len ) ) {
-                    found = 1;
-                    break;
-                }
-            } else { /* full match */
-                if ( !strcmp( scmd, cmd ) ) {
-                    found = 1;
-                    break;
-                }
-            }
-        }
+        int  nn = amodem_find_response( cmd );
 
-        if ( !found )
+        if ( nn < 0 )
         {
             D( "** UNSUPPORTED COMMAND **\n" );
             REPLY( "ERROR: UNSUPPORTED" );
@@ -38,8 +38,13 @@
 #include "disas/disas.h"
 #include "tcg.h"
 #include "exec/cputlb.h"
+#include "exec/hax.h"
 #include "translate-all.h"
 #include "qemu/timer.h"
+#include "exec/ram_addr.h"
+#include "elf.h"
+#include "android/utils/mem_categories.h"
+#include "android/utils/perf_counters.h"
 
 //#define DEBUG_TB_INVALIDATE
 //#define DEBUG_FLUSH
@@ -150,6 +155,7 @@ int cpu_gen_code(CPUArchState *env, TranslationBlock *tb, int *gen_code_size_ptr
     ti = profile_getclock();
 #endif
     tcg_func_start(s);
+    s->no_optimize = (tb->cflags & CF_COLD) != 0;
 
     gen_intermediate_code(env, tb);
 
@@ -210,6 +216,8 @@ static int cpu_restore_state_from_tb(TranslationBlock *tb, CPUArchState *env,
     ti = profile_getclock();
 #endif
     tcg_func_start(s);
+    /* the code must be generated again exactly as it was */
+    s->no_optimize = (tb->cflags & CF_COLD) != 0;
 
     gen_intermediate_code_pc(env, tb);
 
@@ -602,6 +610,37 @@ static inline void *alloc_code_gen_buffer(void)
 }
 #endif /* USE_STATIC_CODE_GEN_BUFFER, USE_MMAP */
 
+/* Each region loses room for one maximal TB at its end, so small buffers
+   get fewer regions. With a single region, a full buffer is flushed. */
+static void tb_regions_init(void)
+{
+    TBContext *ctx = &tcg_ctx.tb_ctx;
+    size_t margin = TCG_MAX_OP_SIZE * OPC_BUF_SIZE;
+    int i;
+
+    ctx->nb_regions = tcg_ctx.code_gen_buffer_size / (8 * margin);
+    if (ctx->nb_regions < 1) {
+        ctx->nb_regions = 1;
+    } else if (ctx->nb_regions > TB_REGION_COUNT) {
+        ctx->nb_regions = TB_REGION_COUNT;
+    }
+    ctx->region_size = tcg_ctx.code_gen_buffer_size / ctx->nb_regions;
+    ctx->region_max_tbs = tcg_ctx.code_gen_max_blocks / ctx->nb_regions;
+    for (i = 0; i < ctx->nb_regions; i++) {
+        ctx->regions[i].code_start = tcg_ctx.code_gen_buffer +
+                i * ctx->region_size;
+        ctx->regions[i].code_ptr = ctx->regions[i].code_start;
+        ctx->regions[i].first_tb = i * ctx->region_max_tbs;
+        ctx->regions[i].nb_tbs = 0;
+        ctx->regions[i].last_used = 0;
+    }
+    ctx->cur_region = 0;
+    tcg_ctx.code_gen_buffer_max_size = ctx->nb_regions *
+            (ctx->region_size - margin);
+}
+
+static MemCategory code_gen_memory = MEM_CATEGORY_INIT("tcg.code_buffer");
+
 static inline void code_gen_alloc(size_t tb_size)
 {
     tcg_ctx.code_gen_buffer_size = size_code_gen_buffer(tb_size);
@@ -623,12 +662,13 @@ static inline void code_gen_alloc(size_t tb_size)
             tcg_ctx.code_gen_buffer_size - 1024;
     tcg_ctx.code_gen_buffer_size -= 1024;
 
-    tcg_ctx.code_gen_buffer_max_size = tcg_ctx.code_gen_buffer_size -
-        (TCG_MAX_OP_SIZE * OPC_BUF_SIZE);
     tcg_ctx.code_gen_max_blocks = tcg_ctx.code_gen_buffer_size /
             CODE_GEN_AVG_BLOCK_SIZE;
     tcg_ctx.tb_ctx.tbs =
             g_malloc(tcg_ctx.code_gen_max_blocks * sizeof(TranslationBlock));
+    memCategory_add(&code_gen_memory, tcg_ctx.code_gen_buffer_size + 1024 +
+                    tcg_ctx.code_gen_max_blocks * sizeof(TranslationBlock));
+    tb_regions_init();
 }
 
 /* Must be called before using the QEMU cpus. 'tb_size' is the size
@@ -640,6 +680,7 @@ void tcg_exec_init(unsigned long tb_size)
     code_gen_alloc(tb_size);
     tcg_ctx.code_gen_ptr = tcg_ctx.code_gen_buffer;
     page_init();
+    tcg_ctx.op_stats = tb_op_stats != 0;
 #if !defined(CONFIG_USER_ONLY) || !defined(CONFIG_USE_GUEST_BASE)
     /* There's no guest base to take into account, so go ahead and
        initialize the prologue now.  */
@@ -652,31 +693,39 @@ bool tcg_enabled(void)
     return tcg_ctx.code_gen_buffer != NULL;
 }
 
-/* Allocate a new translation block. Flush the translation buffer if
-   too many translation blocks or too much generated code. */
+/* Allocate a new translation block in the current region. Return NULL
+   if the region has too many translation blocks or too much generated
+   code. */
 static TranslationBlock *tb_alloc(target_ulong pc)
 {
+    TBContext *ctx = &tcg_ctx.tb_ctx;
+    TBRegion *r = &ctx->regions[ctx->cur_region];
     TranslationBlock *tb;
 
-    if (tcg_ctx.tb_ctx.nb_tbs >= tcg_ctx.code_gen_max_blocks ||
-        (tcg_ctx.code_gen_ptr - tcg_ctx.code_gen_buffer) >=
-         tcg_ctx.code_gen_buffer_max_size) {
+    if (r->nb_tbs >= ctx->region_max_tbs ||
+        (tcg_ctx.code_gen_ptr - r->code_start) >=
+         ctx->region_size - (TCG_MAX_OP_SIZE * OPC_BUF_SIZE)) {
         return NULL;
     }
-    tb = &tcg_ctx.tb_ctx.tbs[tcg_ctx.tb_ctx.nb_tbs++];
+    tb = &ctx->tbs[r->first_tb + r->nb_tbs++];
+    ctx->nb_tbs++;
     tb->pc = pc;
     tb->cflags = 0;
+    tb->region = ctx->cur_region;
     return tb;
 }
 
 void tb_free(TranslationBlock *tb)
 {
+    TBRegion *r = &tcg_ctx.tb_ctx.regions[tcg_ctx.tb_ctx.cur_region];
+
     /* In practice this is mostly used for single use temporary TB
        Ignore the hard cases and just back up if this TB happens to
        be the last one generated.  */
-    if (tcg_ctx.tb_ctx.nb_tbs > 0 &&
-            tb == &tcg_ctx.tb_ctx.tbs[tcg_ctx.tb_ctx.nb_tbs - 1]) {
+    if (r->nb_tbs > 0 &&
+            tb == &tcg_ctx.tb_ctx.tbs[r->first_tb + r->nb_tbs - 1]) {
         tcg_ctx.code_gen_ptr = tb->tc_ptr;
+        r->nb_tbs--;
         tcg_ctx.tb_ctx.nb_tbs--;
     }
 }
@@ -728,6 +777,7 @@ static void page_flush_tb(void)
 void tb_flush(CPUArchState *env1)
 {
     CPUState *cpu;
+    int i;
 #if defined(DEBUG_FLUSH)
     printf("qemu: flush code_size=%ld nb_tbs=%d avg_tb_size=%ld\n",
            (unsigned long)(tcg_ctx.code_gen_ptr - tcg_ctx.code_gen_buffer),
@@ -740,6 +790,12 @@ void tb_flush(CPUArchState *env1)
         cpu_abort(env1, "Internal error: code buffer overflow\n");
     }
     tcg_ctx.tb_ctx.nb_tbs = 0;
+    for (i = 0; i < tcg_ctx.tb_ctx.nb_regions; i++) {
+        tcg_ctx.tb_ctx.regions[i].nb_tbs = 0;
+        tcg_ctx.tb_ctx.regions[i].code_ptr =
+                tcg_ctx.tb_ctx.regions[i].code_start;
+    }
+    tcg_ctx.tb_ctx.cur_region = 0;
 
     CPU_FOREACH(cpu) {
         CPUArchState *env = cpu->env_ptr;
@@ -756,6 +812,53 @@ void tb_flush(CPUArchState *env1)
     tcg_ctx.tb_ctx.tb_flush_count++;
 }
 
+/* Called when the current region is full: invalidate the TBs of the least
+   recently executed other region, and continue the translation there. */
+static void tb_region_evict(CPUArchState *env)
+{
+    TBContext *ctx = &tcg_ctx.tb_ctx;
+    TBRegion *r;
+    int i, lru, invalidate_count;
+
+    if (ctx->nb_regions == 1) {
+        tb_flush(env);
+        return;
+    }
+    ctx->regions[ctx->cur_region].code_ptr = tcg_ctx.code_gen_ptr;
+
+    lru = -1;
+    for (i = 0; i < ctx->nb_regions; i++) {
+        if (i != ctx->cur_region &&
+            (lru < 0 || ctx->regions[i].last_used <
+                        ctx->regions[lru].last_used)) {
+            lru = i;
+        }
+    }
+    r = &ctx->regions[lru];
+
+    /* evictions are not guest code modifications */
+    invalidate_count = ctx->tb_phys_invalidate_count;
+    for (i = 0; i < r->nb_tbs; i++) {
+        TranslationBlock *tb = &ctx->tbs[r->first_tb + i];
+
+        if (!(tb->cflags & CF_INVALID)) {
+            tb_phys_invalidate(tb, -1);
+        }
+    }
+    ctx->tb_phys_invalidate_count = invalidate_count;
+
+    if (r->nb_tbs > 0) {
+        ctx->tb_region_evict_count++;
+        ctx->tb_region_evicted_tbs += r->nb_tbs;
+    }
+    ctx->nb_tbs -= r->nb_tbs;
+    r->nb_tbs = 0;
+    r->code_ptr = r->code_start;
+    r->last_used = ++ctx->region_clock;
+    ctx->cur_region = lru;
+    tcg_ctx.code_gen_ptr = r->code_start;
+}
+
 #ifdef DEBUG_TB_CHECK
 
 static void tb_invalidate_check(target_ulong address)
@@ -919,6 +1022,7 @@ void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
         tb1 = tb2;
     }
     tb->jmp_first = (TranslationBlock *)((uintptr_t)tb | 2); /* fail safe */
+    tb->cflags |= CF_INVALID;
 
     tcg_ctx.tb_ctx.tb_phys_invalidate_count++;
 }
@@ -979,6 +1083,212 @@ static void build_page_bitmap(PageDesc *p)
     }
 }
 
+/*
+ * Translation index.
+ *
+ * With -tb-index <file>, the TBs translated by a run are written to the
+ * file on exit, and read back by the next run. Each entry is keyed by the
+ * guest pc, cs_base and flags of the TB, and records a hash of the guest
+ * code it covered. When a TB is translated, its key and hash are looked
+ * up: a hit means the exact same code was translated before, by this run
+ * (after a flush) or a previous one, a stale
+ * entry means the code at that address changed since, e.g. a page that
+ * was rewritten and invalidated with tb_invalidate_phys_page_range(), or
+ * a different system image. Since entries are matched on the content of
+ * the code rather than on its address, a stale entry can never be taken
+ * for a hit, and it is simply replaced.
+ *
+ * Only the index is stored, not the host code: the generated code embeds
+ * addresses that change from run to run (helpers, TB pointers returned by
+ * exit_tb, return addresses of the slow paths). The hit rate, shown by
+ * "info jit", measures how much translation a warm boot repeats.
+ */
+#define TB_INDEX_MAGIC        "TBX1"
+#define TB_INDEX_MAX_ENTRIES  (1 << 20)
+
+typedef struct TBIndexEntry {
+    uint64_t pc;
+    uint64_t cs_base;
+    uint32_t flags;
+    uint32_t size;
+    uint64_t hash;
+} TBIndexEntry;
+
+static GHashTable *tb_index;
+static char *tb_index_path;
+static struct {
+    int loaded;     /* entries read from the file */
+    int hits;       /* translations of code already seen */
+    int stale;      /* same key, but the code changed */
+    int misses;     /* new keys */
+} tb_index_stats;
+
+static guint tb_index_key_hash(gconstpointer key)
+{
+    const TBIndexEntry *e = key;
+
+    return (guint)(e->pc ^ (e->pc >> 32) ^ e->cs_base ^ e->flags);
+}
+
+static gboolean tb_index_key_equal(gconstpointer a, gconstpointer b)
+{
+    const TBIndexEntry *ea = a, *eb = b;
+
+    return ea->pc == eb->pc && ea->cs_base == eb->cs_base &&
+           ea->flags == eb->flags;
+}
+
+/* FNV-1a over the guest code, which may span two physical pages */
+static uint64_t tb_code_hash(TranslationBlock *tb, tb_page_addr_t phys_pc,
+                             tb_page_addr_t phys_page2)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    uint32_t len1 = tb->size;
+    const uint8_t *p;
+    uint32_t i;
+
+    if (phys_page2 != -1) {
+        len1 = TARGET_PAGE_SIZE - (tb->pc & ~TARGET_PAGE_MASK);
+    }
+    p = qemu_get_ram_ptr(phys_pc);
+    for (i = 0; i < len1; i++) {
+        hash = (hash ^ p[i]) * 0x100000001b3ULL;
+    }
+    if (phys_page2 != -1) {
+        p = qemu_get_ram_ptr(phys_page2);
+        for (i = 0; i < tb->size - len1; i++) {
+            hash = (hash ^ p[i]) * 0x100000001b3ULL;
+        }
+    }
+    return hash;
+}
+
+static void tb_index_record(TranslationBlock *tb, tb_page_addr_t phys_pc,
+                            tb_page_addr_t phys_page2)
+{
+    TBIndexEntry key, *e;
+    uint64_t hash;
+
+    if (tb->size == 0) {
+        return;
+    }
+    hash = tb_code_hash(tb, phys_pc, phys_page2);
+    key.pc = tb->pc;
+    key.cs_base = tb->cs_base;
+    key.flags = tb->flags;
+
+    e = g_hash_table_lookup(tb_index, &key);
+    if (e == NULL) {
+        tb_index_stats.misses++;
+        if (g_hash_table_size(tb_index) >= TB_INDEX_MAX_ENTRIES) {
+            return;
+        }
+        e = g_malloc(sizeof(*e));
+        *e = key;
+        g_hash_table_insert(tb_index, e, e);
+    } else if (e->hash == hash && e->size == tb->size) {
+        tb_index_stats.hits++;
+    } else {
+        tb_index_stats.stale++;
+    }
+    e->size = tb->size;
+    e->hash = hash;
+}
+
+int tb_index_load(const char *path)
+{
+    TBIndexEntry *e;
+    uint8_t header[12];
+    uint32_t machine;
+    FILE *f;
+
+    tb_index = g_hash_table_new(tb_index_key_hash, tb_index_key_equal);
+    tb_index_path = g_strdup(path);
+
+    f = fopen(path, "rb");
+    if (f == NULL) {
+        /* first run, the file is created on exit */
+        return 0;
+    }
+    /* an index of another target is ignored, and overwritten on exit */
+    machine = ELF_MACHINE;
+    if (fread(header, sizeof(header), 1, f) != 1 ||
+        memcmp(header, TB_INDEX_MAGIC, 4) ||
+        memcmp(header + 4, &machine, 4)) {
+        fclose(f);
+        return 0;
+    }
+    while (g_hash_table_size(tb_index) < TB_INDEX_MAX_ENTRIES) {
+        e = g_malloc(sizeof(*e));
+        if (fread(e, sizeof(*e), 1, f) != 1) {
+            g_free(e);
+            break;
+        }
+        g_hash_table_insert(tb_index, e, e);
+        tb_index_stats.loaded++;
+    }
+    fclose(f);
+    return tb_index_stats.loaded;
+}
+
+static void tb_index_write_entry(gpointer key, gpointer value, gpointer opaque)
+{
+    fwrite(value, sizeof(TBIndexEntry), 1, opaque);
+}
+
+int tb_index_save(void)
+{
+    uint32_t machine = ELF_MACHINE, count;
+    FILE *f;
+
+    if (tb_index == NULL) {
+        return 0;
+    }
+    f = fopen(tb_index_path, "wb");
+    if (f == NULL) {
+        return -errno;
+    }
+    count = g_hash_table_size(tb_index);
+    fwrite(TB_INDEX_MAGIC, 4, 1, f);
+    fwrite(&machine, 4, 1, f);
+    fwrite(&count, 4, 1, f);
+    g_hash_table_foreach(tb_index, tb_index_write_entry, f);
+    if (fclose(f) != 0) {
+        return -errno;
+    }
+    return 0;
+}
+
+int tb_hot_threshold;
+static int tb_cold_count;
+static int tb_promoted_count;
+int tb_stitch_count;
+int tb_stitched_tbs;
+int tb_op_stats;
+
+/* Count an execution of a CF_COLD TB, and replace it with an optimized
+ * translation once it is hot. Returns the TB to execute. */
+TranslationBlock *tb_run_cold(CPUArchState *env, TranslationBlock *tb)
+{
+    target_ulong pc, cs_base;
+    uint64_t flags;
+    int cflags;
+
+    if (++tb->exec_count < tb_hot_threshold) {
+        return tb;
+    }
+    pc = tb->pc;
+    cs_base = tb->cs_base;
+    flags = tb->flags;
+    cflags = tb->cflags & ~CF_COLD;
+    tb_phys_invalidate(tb, -1);
+    tb_promoted_count++;
+    return tb_gen_code(env, pc, cs_base, flags, cflags);
+}
+
+static PerfCounter tb_translations_counter =
+    PERF_COUNTER_INIT("tcg.translations", "blocks");
+
 TranslationBlock *tb_gen_code(CPUArchState *env,
                               target_ulong pc, target_ulong cs_base,
                               int flags, int cflags)
@@ -989,11 +1299,12 @@ TranslationBlock *tb_gen_code(CPUArchState *env,
     target_ulong virt_page2;
     int code_gen_size;
 
+    perfCounter_add(&tb_translations_counter, 1);
     phys_pc = get_page_addr_code(env, pc);
     tb = tb_alloc(pc);
     if (!tb) {
-        /* flush must be done */
-        tb_flush(env);
+        /* make room by evicting a region */
+        tb_region_evict(env);
         /* cannot fail at this point */
         tb = tb_alloc(pc);
         /* Don't forget to invalidate previous TB info.  */
@@ -1004,7 +1315,11 @@ TranslationBlock *tb_gen_code(CPUArchState *env,
     tb->cs_base = cs_base;
     tb->flags = flags;
     tb->cflags = cflags;
+    tb->exec_count = 0;
     cpu_gen_code(env, tb, &code_gen_size);
+    if (qemu_log_binary_mask(CPU_LOG_TB_IN_ASM)) {
+        qemu_log_binary(QEMU_LOG_REC_TRANSLATE, pc, tb->size);
+    }
     tcg_ctx.code_gen_ptr = (void *)(((uintptr_t)tcg_ctx.code_gen_ptr +
             code_gen_size + CODE_GEN_ALIGN - 1) & ~(CODE_GEN_ALIGN - 1));
 
@@ -1014,6 +1329,12 @@ TranslationBlock *tb_gen_code(CPUArchState *env,
     if ((pc & TARGET_PAGE_MASK) != virt_page2) {
         phys_page2 = get_page_addr_code(env, virt_page2);
     }
+    if (tb_index != NULL) {
+        tb_index_record(tb, phys_pc, phys_page2);
+    }
+    if (cflags & CF_COLD) {
+        tb_cold_count++;
+    }
     tb_link_page(tb, phys_pc, phys_page2);
     return tb;
 }
@@ -1358,23 +1679,32 @@ static void tb_link_page(TranslationBlock *tb, tb_page_addr_t phys_pc,
    tb[1].tc_ptr. Return NULL if not found */
 TranslationBlock *tb_find_pc(uintptr_t tc_ptr)
 {
+    TBContext *ctx = &tcg_ctx.tb_ctx;
+    TBRegion *r;
     int m_min, m_max, m;
-    uintptr_t v;
+    uintptr_t v, end;
     TranslationBlock *tb;
 
-    if (tcg_ctx.tb_ctx.nb_tbs <= 0) {
+    if (tc_ptr < (uintptr_t)tcg_ctx.code_gen_buffer) {
         return NULL;
     }
-    if (tc_ptr < (uintptr_t)tcg_ctx.code_gen_buffer ||
-        tc_ptr >= (uintptr_t)tcg_ctx.code_gen_ptr) {
+    /* the TBs are sorted by tc_ptr inside each region */
+    m = (tc_ptr - (uintptr_t)tcg_ctx.code_gen_buffer) / ctx->region_size;
+    if (m >= ctx->nb_regions) {
+        return NULL;
+    }
+    r = &ctx->regions[m];
+    end = (uintptr_t)(m == ctx->cur_region ? tcg_ctx.code_gen_ptr
+                                           : r->code_ptr);
+    if (r->nb_tbs <= 0 || tc_ptr >= end) {
         return NULL;
     }
     /* binary search (cf Knuth) */
-    m_min = 0;
-    m_max = tcg_ctx.tb_ctx.nb_tbs - 1;
+    m_min = r->first_tb;
+    m_max = r->first_tb + r->nb_tbs - 1;
     while (m_min <= m_max) {
         m = (m_min + m_max) >> 1;
-        tb = &tcg_ctx.tb_ctx.tbs[m];
+        tb = &ctx->tbs[m];
         v = (uintptr_t)tb->tc_ptr;
         if (v == tc_ptr) {
             return tb;
@@ -1384,7 +1714,7 @@ TranslationBlock *tb_find_pc(uintptr_t tc_ptr)
             m_min = m + 1;
         }
     }
-    return &tcg_ctx.tb_ctx.tbs[m_max];
+    return &ctx->tbs[m_max];
 }
 
 #ifndef CONFIG_ANDROID
@@ -1527,8 +1857,9 @@ void tb_flush_jmp_cache(CPUArchState *env, target_ulong addr)
 
 void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
 {
-    int i, target_code_size, max_target_code_size;
+    int i, j, target_code_size, max_target_code_size;
     int direct_jmp_count, direct_jmp2_count, cross_page;
+    ptrdiff_t host_code_size;
     TranslationBlock *tb;
 
     target_code_size = 0;
@@ -1536,27 +1867,33 @@ void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
     cross_page = 0;
     direct_jmp_count = 0;
     direct_jmp2_count = 0;
-    for (i = 0; i < tcg_ctx.tb_ctx.nb_tbs; i++) {
-        tb = &tcg_ctx.tb_ctx.tbs[i];
-        target_code_size += tb->size;
-        if (tb->size > max_target_code_size) {
-            max_target_code_size = tb->size;
-        }
-        if (tb->page_addr[1] != -1) {
-            cross_page++;
-        }
-        if (tb->tb_next_offset[0] != 0xffff) {
-            direct_jmp_count++;
-            if (tb->tb_next_offset[1] != 0xffff) {
-                direct_jmp2_count++;
+    host_code_size = 0;
+    for (j = 0; j < tcg_ctx.tb_ctx.nb_regions; j++) {
+        TBRegion *r = &tcg_ctx.tb_ctx.regions[j];
+
+        host_code_size += (j == tcg_ctx.tb_ctx.cur_region ?
+                           tcg_ctx.code_gen_ptr : r->code_ptr) - r->code_start;
+        for (i = r->first_tb; i < r->first_tb + r->nb_tbs; i++) {
+            tb = &tcg_ctx.tb_ctx.tbs[i];
+            target_code_size += tb->size;
+            if (tb->size > max_target_code_size) {
+                max_target_code_size = tb->size;
+            }
+            if (tb->page_addr[1] != -1) {
+                cross_page++;
+            }
+            if (tb->tb_next_offset[0] != 0xffff) {
+                direct_jmp_count++;
+                if (tb->tb_next_offset[1] != 0xffff) {
+                    direct_jmp2_count++;
+                }
             }
         }
     }
     /* XXX: avoid using doubles ? */
     cpu_fprintf(f, "Translation buffer state:\n");
     cpu_fprintf(f, "gen code size       %td/%zd\n",
-                tcg_ctx.code_gen_ptr - tcg_ctx.code_gen_buffer,
-                tcg_ctx.code_gen_buffer_max_size);
+                host_code_size, tcg_ctx.code_gen_buffer_max_size);
     cpu_fprintf(f, "TB count            %d/%d\n",
             tcg_ctx.tb_ctx.nb_tbs, tcg_ctx.code_gen_max_blocks);
     cpu_fprintf(f, "TB avg target size  %d max=%d bytes\n",
@@ -1564,12 +1901,10 @@ void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
                     tcg_ctx.tb_ctx.nb_tbs : 0,
             max_target_code_size);
     cpu_fprintf(f, "TB avg host size    %td bytes (expansion ratio: %0.1f)\n",
-            tcg_ctx.tb_ctx.nb_tbs ? (tcg_ctx.code_gen_ptr -
-                                     tcg_ctx.code_gen_buffer) /
-                                     tcg_ctx.tb_ctx.nb_tbs : 0,
-                target_code_size ? (double) (tcg_ctx.code_gen_ptr -
-                                             tcg_ctx.code_gen_buffer) /
-                                             target_code_size : 0);
+            tcg_ctx.tb_ctx.nb_tbs ? host_code_size /
+                                    tcg_ctx.tb_ctx.nb_tbs : 0,
+                target_code_size ? (double) host_code_size /
+                                            target_code_size : 0);
     cpu_fprintf(f, "cross page TB count %d (%d%%)\n", cross_page,
             tcg_ctx.tb_ctx.nb_tbs ? (cross_page * 100) /
                                     tcg_ctx.tb_ctx.nb_tbs : 0);
@@ -1582,9 +1917,51 @@ void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
                         tcg_ctx.tb_ctx.nb_tbs : 0);
     cpu_fprintf(f, "\nStatistics:\n");
     cpu_fprintf(f, "TB flush count      %d\n", tcg_ctx.tb_ctx.tb_flush_count);
+    cpu_fprintf(f, "TB region evictions %d TBs=%d (%d regions)\n",
+            tcg_ctx.tb_ctx.tb_region_evict_count,
+            tcg_ctx.tb_ctx.tb_region_evicted_tbs, tcg_ctx.tb_ctx.nb_regions);
     cpu_fprintf(f, "TB invalidate count %d\n",
             tcg_ctx.tb_ctx.tb_phys_invalidate_count);
     cpu_fprintf(f, "TLB flush count     %d\n", tlb_flush_count);
+    cpu_fprintf(f, "TLB victim hits     %d\n", tlb_victim_hit_count);
+#ifdef CONFIG_HAX
+    if (hax_enabled()) {
+        hax_dump_stats(f, cpu_fprintf);
+    }
+#endif
+    if (tb_hot_threshold > 0) {
+        cpu_fprintf(f, "TB cold count       %d promoted=%d (threshold %d)\n",
+                    tb_cold_count, tb_promoted_count, tb_hot_threshold);
+    }
+    cpu_fprintf(f, "TB lookup ptr count %d hits=%d\n",
+                tcg_ctx.tb_ctx.tb_lookup_ptr_hits +
+                        tcg_ctx.tb_ctx.tb_lookup_ptr_misses,
+                tcg_ctx.tb_ctx.tb_lookup_ptr_hits);
+    if (tb_stitched_tbs > 0) {
+        cpu_fprintf(f, "TB stitch count     %d branches in %d TBs\n",
+                    tb_stitch_count, tb_stitched_tbs);
+    }
+    if (tcg_ctx.op_stats) {
+        int64_t tbs = tcg_ctx.op_stats_tbs ? tcg_ctx.op_stats_tbs : 1;
+
+        cpu_fprintf(f, "TCG ops/TB          %0.1f optimized=%0.1f "
+                    "live=%0.1f (%" PRId64 " TBs)\n",
+                    (double)tcg_ctx.op_stats_gen / tbs,
+                    (double)tcg_ctx.op_stats_opt / tbs,
+                    (double)tcg_ctx.op_stats_live / tbs,
+                    tcg_ctx.op_stats_tbs);
+    }
+    if (tb_index != NULL) {
+        int lookups = tb_index_stats.hits + tb_index_stats.stale +
+                      tb_index_stats.misses;
+
+        cpu_fprintf(f, "TB index entries    %d (%d loaded)\n",
+                    g_hash_table_size(tb_index), tb_index_stats.loaded);
+        cpu_fprintf(f, "TB index hits       %d (%d%%) stale=%d new=%d\n",
+                    tb_index_stats.hits,
+                    lookups ? (tb_index_stats.hits * 100) / lookups : 0,
+                    tb_index_stats.stale, tb_index_stats.misses);
+    }
     tcg_dump_info(f, cpu_fprintf);
 }
 
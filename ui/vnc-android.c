@@ -28,6 +28,7 @@
 #include "sysemu/sysemu.h"
 #include "qemu/sockets.h"
 #include "qemu/timer.h"
+#include "qemu/host-utils.h"
 #ifdef CONFIG_VNC_TLS
 #include "qemu/acl.h"
 #endif
@@ -259,15 +260,9 @@ static inline int vnc_get_bit(const uint32_t *d, int k)
     return (d[k >> 5] >> (k & 0x1f)) & 1;
 }
 
-static inline int vnc_and_bits(const uint32_t *d1, const uint32_t *d2,
-                               int nb_words)
+static inline void vnc_set_row(struct VncSurface *s, int y)
 {
-    int i;
-    for(i = 0; i < nb_words; i++) {
-        if ((d1[i] & d2[i]) != 0)
-            return 1;
-    }
-    return 0;
+    vnc_set_bit(s->dirty_rows, y);
 }
 
 static void vnc_update(VncState *vs, int x, int y, int w, int h)
@@ -289,9 +284,11 @@ static void vnc_update(VncState *vs, int x, int y, int w, int h)
     w = MIN(x + w, s->ds->width) - x;
     h = MIN(h, s->ds->height);
 
-    for (; y < h; y++)
+    for (; y < h; y++) {
         for (i = 0; i < w; i += 16)
             vnc_set_bit(s->dirty[y], (x + i) / 16);
+        vnc_set_row(s, y);
+    }
 }
 
 static void vnc_dpy_update(DisplayState *ds, int x, int y, int w, int h)
@@ -304,8 +301,54 @@ static void vnc_dpy_update(DisplayState *ds, int x, int y, int w, int h)
     }
 }
 
-static void vnc_framebuffer_update(VncState *vs, int x, int y, int w, int h,
-                                   int32_t encoding)
+/* Copy the damaged area of a GPU frame to the display surface, and report
+ * only that area as updated, so the clients only compare and encode its
+ * tiles. The frame has bottom-up RGBA rows, and the damage rectangle uses
+ * their row indices. */
+void vnc_display_gpu_frame(void *opaque, int width, int height,
+                           const void *pixels, int x, int y, int w, int h)
+{
+    DisplayState *ds = opaque;
+    DisplaySurface *s = ds->surface;
+    PixelFormat *pf = &s->pf;
+    int x1, y1;
+    int i, j;
+
+    y = height - y - h;
+    x1 = MIN(x + w, MIN(width, s->width));
+    y1 = MIN(y + h, MIN(height, s->height));
+    x = MAX(x, 0);
+    y = MAX(y, 0);
+    if (x >= x1 || y >= y1)
+        return;
+
+    for (j = y; j < y1; j++) {
+        const uint8_t *src = (const uint8_t *)pixels +
+                             ((height - 1 - j) * width + x) * 4;
+        uint8_t *dst = s->data + j * s->linesize + x * pf->bytes_per_pixel;
+
+        for (i = x; i < x1; i++, src += 4, dst += pf->bytes_per_pixel) {
+            uint32_t v = ((src[0] >> (8 - pf->rbits)) << pf->rshift) |
+                         ((src[1] >> (8 - pf->gbits)) << pf->gshift) |
+                         ((src[2] >> (8 - pf->bbits)) << pf->bshift);
+            switch (pf->bytes_per_pixel) {
+            case 1:
+                *dst = v;
+                break;
+            case 2:
+                *(uint16_t *)dst = v;
+                break;
+            default:
+                *(uint32_t *)dst = v;
+                break;
+            }
+        }
+    }
+    dpy_update(ds, x, y, x1 - x, y1 - y);
+}
+
+void vnc_framebuffer_update(VncState *vs, int x, int y, int w, int h,
+                            int32_t encoding)
 {
     vnc_write_u16(vs, x);
     vnc_write_u16(vs, y);
@@ -353,6 +396,9 @@ static void vnc_resize(VncState *vs)
     DisplayState *ds = vs->ds;
     int size_changed;
 
+    /* the encoder may be reading the server surface */
+    vnc_worker_join(vs->worker);
+
     /* guest surface */
     if (!vs->guest.ds)
         vs->guest.ds = g_malloc0(sizeof(*vs->guest.ds));
@@ -373,6 +419,7 @@ static void vnc_resize(VncState *vs)
         }
     }
     memset(vs->guest.dirty, 0xFF, sizeof(vs->guest.dirty));
+    memset(vs->guest.dirty_rows, 0xFF, sizeof(vs->guest.dirty_rows));
 
     /* server surface */
     if (!vs->server.ds)
@@ -382,7 +429,8 @@ static void vnc_resize(VncState *vs)
     *(vs->server.ds) = *(ds->surface);
     vs->server.ds->data = g_malloc0(vs->server.ds->linesize *
                                        vs->server.ds->height);
-    memset(vs->server.dirty, 0xFF, sizeof(vs->guest.dirty));
+    memset(vs->server.dirty, 0xFF, sizeof(vs->server.dirty));
+    memset(vs->server.dirty_rows, 0xFF, sizeof(vs->server.dirty_rows));
 }
 
 static void vnc_dpy_resize(DisplayState *ds)
@@ -402,7 +450,7 @@ static void vnc_write_pixels_copy(VncState *vs, void *pixels, int size)
 }
 
 /* slowest but generic code. */
-static void vnc_convert_pixel(VncState *vs, uint8_t *buf, uint32_t v)
+void vnc_convert_pixel(VncState *vs, uint8_t *buf, uint32_t v)
 {
     uint8_t r, g, b;
 
@@ -547,14 +595,7 @@ static void send_framebuffer_update_hextile(VncState *vs, int x, int y, int w, i
 
 }
 
-static void vnc_zlib_init(VncState *vs)
-{
-    int i;
-    for (i=0; i < (int)(sizeof(vs->zlib_stream) / sizeof(z_stream)); i++)
-        vs->zlib_stream[i].opaque = NULL;
-}
-
-static void vnc_zlib_start(VncState *vs)
+void vnc_zlib_start(VncState *vs)
 {
     buffer_reset(&vs->zlib);
 
@@ -563,7 +604,7 @@ static void vnc_zlib_start(VncState *vs)
     vs->output = vs->zlib;
 }
 
-static int vnc_zlib_stop(VncState *vs, int stream_id)
+int vnc_zlib_stop(VncState *vs, int stream_id)
 {
     z_streamp zstream = &vs->zlib_stream[stream_id];
     int previous_out;
@@ -631,7 +672,7 @@ static void send_framebuffer_update_zlib(VncState *vs, int x, int y, int w, int
     // compress the stream
     vnc_zlib_start(vs);
     send_framebuffer_update_raw(vs, x, y, w, h);
-    bytes_written = vnc_zlib_stop(vs, 0);
+    bytes_written = vnc_zlib_stop(vs, VNC_ZLIB_STREAM_ZLIB);
 
     if (bytes_written == -1)
         return;
@@ -643,9 +684,14 @@ static void send_framebuffer_update_zlib(VncState *vs, int x, int y, int w, int
     vs->output.offset = new_offset;
 }
 
-static void send_framebuffer_update(VncState *vs, int x, int y, int w, int h)
+/* Runs on the encoding thread of the client, see vnc-jobs.c */
+int vnc_send_framebuffer_update(VncState *vs, int x, int y, int w, int h)
 {
     switch(vs->vnc_encoding) {
+        case VNC_ENCODING_TIGHT:
+            return vnc_tight_send_framebuffer_update(vs, x, y, w, h);
+        case VNC_ENCODING_ZRLE:
+            return vnc_zrle_send_framebuffer_update(vs, x, y, w, h);
         case VNC_ENCODING_ZLIB:
             send_framebuffer_update_zlib(vs, x, y, w, h);
             break;
@@ -658,10 +704,13 @@ static void send_framebuffer_update(VncState *vs, int x, int y, int w, int h)
             send_framebuffer_update_raw(vs, x, y, w, h);
             break;
     }
+    return 1;
 }
 
 static void vnc_copy(VncState *vs, int src_x, int src_y, int dst_x, int dst_y, int w, int h)
 {
+    /* the pending update must reach the client before the copy */
+    vnc_worker_join(vs->worker);
     vnc_write_u8(vs, 0);  /* msg id */
     vnc_write_u8(vs, 0);
     vnc_write_u16(vs, 1); /* number of rects */
@@ -694,11 +743,11 @@ static void vnc_dpy_copy(DisplayState *ds, int src_x, int src_y, int dst_x, int
 }
 
 static int find_and_clear_dirty_height(struct VncSurface *s,
-                                       int y, int last_x, int x)
+                                       int y, int last_x, int x, int max_y)
 {
     int h;
 
-    for (h = 1; h < (s->ds->height - y); h++) {
+    for (h = 1; h < (max_y - y); h++) {
         int tmp_x;
         if (!vnc_get_bit(s->dirty[y + h], last_x))
             break;
@@ -712,15 +761,12 @@ static int find_and_clear_dirty_height(struct VncSurface *s,
 static void vnc_update_client(void *opaque)
 {
     VncState *vs = opaque;
-    if (vs->need_update && vs->csock != -1) {
-        int y;
-        uint8_t *guest_row;
-        uint8_t *server_row;
+    if ((vs->need_update || vs->continuous_updates) && vs->csock != -1) {
+        int y, word;
         int cmp_bytes;
-        uint32_t width_mask[VNC_DIRTY_WORDS];
         int n_rectangles;
-        int saved_offset;
         int has_dirty = 0;
+        int x0, x1, y0, y1;
 
         if (vs->output.offset && !vs->audio_cap && !vs->force_update) {
             /* kernel send buffers are full -> drop frames to throttle */
@@ -728,25 +774,40 @@ static void vnc_update_client(void *opaque)
             return;
         }
 
+        if (vnc_worker_busy(vs->worker)) {
+            if (!vs->force_update) {
+                /* the previous update is still being encoded */
+                timer_mod(vs->timer, qemu_clock_get_ms(QEMU_CLOCK_REALTIME) + VNC_REFRESH_INTERVAL);
+                return;
+            }
+            vnc_worker_join(vs->worker);
+        }
+
         vga_hw_update();
 
         /*
-         * Walk through the guest dirty map.
+         * Walk through the dirty rows of the guest dirty map.
          * Check and copy modified bits from guest to server surface.
          * Update server dirty map.
          */
-        vnc_set_bits(width_mask, (ds_get_width(vs->ds) / 16), VNC_DIRTY_WORDS);
         cmp_bytes = 16 * ds_get_bytes_per_pixel(vs->ds);
-        guest_row  = vs->guest.ds->data;
-        server_row = vs->server.ds->data;
-        for (y = 0; y < vs->guest.ds->height; y++) {
-            if (vnc_and_bits(vs->guest.dirty[y], width_mask, VNC_DIRTY_WORDS)) {
+        for (word = 0; word < VNC_DIRTY_ROW_WORDS; word++) {
+            uint32_t rows = vs->guest.dirty_rows[word];
+
+            vs->guest.dirty_rows[word] = 0;
+            while (rows) {
                 int x;
+                int row_dirty = 0;
                 uint8_t *guest_ptr;
                 uint8_t *server_ptr;
 
-                guest_ptr  = guest_row;
-                server_ptr = server_row;
+                y = word * 32 + ctz32(rows);
+                rows &= rows - 1;
+                if (y >= vs->guest.ds->height)
+                    break;
+
+                guest_ptr  = vs->guest.ds->data + y * ds_get_linesize(vs->ds);
+                server_ptr = vs->server.ds->data + y * ds_get_linesize(vs->ds);
 
                 for (x = 0; x < vs->guest.ds->width;
                      x += 16, guest_ptr += cmp_bytes, server_ptr += cmp_bytes) {
@@ -757,11 +818,12 @@ static void vnc_update_client(void *opaque)
                         continue;
                     memcpy(server_ptr, guest_ptr, cmp_bytes);
                     vnc_set_bit(vs->server.dirty[y], (x / 16));
+                    row_dirty = 1;
                     has_dirty++;
                 }
+                if (row_dirty)
+                    vnc_set_row(&vs->server, y);
             }
-            guest_row  += ds_get_linesize(vs->ds);
-            server_row += ds_get_linesize(vs->ds);
         }
 
         if (!has_dirty && !vs->audio_cap && !vs->force_update) {
@@ -769,47 +831,67 @@ static void vnc_update_client(void *opaque)
             return;
         }
 
+        /* Without a request, only the continuous updates area is sent. */
+        x0 = 0;
+        x1 = vs->server.ds->width / 16;
+        y0 = 0;
+        y1 = vs->server.ds->height;
+        if (!vs->need_update) {
+            x0 = MIN(vs->cu_x / 16, x1);
+            x1 = MIN((vs->cu_x + vs->cu_w + 15) / 16, x1);
+            y0 = MIN(vs->cu_y, y1);
+            y1 = MIN(vs->cu_y + vs->cu_h, y1);
+        }
+
         /*
-         * Send screen updates to the vnc client using the server
-         * surface and server dirty map.  guest surface updates
-         * happening in parallel don't disturb us, the next pass will
-         * send them to the client.
+         * Queue the dirty rectangles of the server surface to the
+         * encoding thread.  guest surface updates happening in parallel
+         * don't disturb us, the next pass will send them to the client.
          */
         n_rectangles = 0;
-        vnc_write_u8(vs, 0);  /* msg id */
-        vnc_write_u8(vs, 0);
-        saved_offset = vs->output.offset;
-        vnc_write_u16(vs, 0);
+        for (word = 0; word < VNC_DIRTY_ROW_WORDS; word++) {
+            uint32_t rows = vs->server.dirty_rows[word];
 
-        for (y = 0; y < vs->server.ds->height; y++) {
-            int x;
-            int last_x = -1;
-            for (x = 0; x < vs->server.ds->width / 16; x++) {
-                if (vnc_get_bit(vs->server.dirty[y], x)) {
-                    if (last_x == -1) {
-                        last_x = x;
-                    }
-                    vnc_clear_bit(vs->server.dirty[y], x);
-                } else {
-                    if (last_x != -1) {
-                        int h = find_and_clear_dirty_height(&vs->server, y, last_x, x);
-                        send_framebuffer_update(vs, last_x * 16, y, (x - last_x) * 16, h);
-                        n_rectangles++;
+            while (rows) {
+                int x;
+                int last_x = -1;
+
+                y = word * 32 + ctz32(rows);
+                rows &= rows - 1;
+                if (y < y0 || y >= y1)
+                    continue;
+                /* bits outside of [x0, x1) stay for the next pass */
+                if (x0 == 0 && x1 == vs->server.ds->width / 16)
+                    vnc_clear_bit(vs->server.dirty_rows, y);
+
+                for (x = x0; x < x1; x++) {
+                    if (vnc_get_bit(vs->server.dirty[y], x)) {
+                        if (last_x == -1) {
+                            last_x = x;
+                        }
+                        vnc_clear_bit(vs->server.dirty[y], x);
+                    } else {
+                        if (last_x != -1) {
+                            int h = find_and_clear_dirty_height(&vs->server, y, last_x, x, y1);
+                            vnc_worker_add_rect(vs->worker, last_x * 16, y, (x - last_x) * 16, h);
+                            n_rectangles++;
+                        }
+                        last_x = -1;
                     }
-                    last_x = -1;
                 }
-            }
-            if (last_x != -1) {
-                int h = find_and_clear_dirty_height(&vs->server, y, last_x, x);
-                send_framebuffer_update(vs, last_x * 16, y, (x - last_x) * 16, h);
-                n_rectangles++;
+                if (last_x != -1) {
+                    int h = find_and_clear_dirty_height(&vs->server, y, last_x, x, y1);
+                    vnc_worker_add_rect(vs->worker, last_x * 16, y, (x - last_x) * 16, h);
+                    n_rectangles++;
+                }
             }
         }
-        vs->output.buffer[saved_offset] = (n_rectangles >> 8) & 0xFF;
-        vs->output.buffer[saved_offset + 1] = n_rectangles & 0xFF;
-        vnc_flush(vs);
-        vs->force_update = 0;
 
+        if (n_rectangles || vs->audio_cap || vs->force_update) {
+            vnc_worker_start(vs->worker);
+            vs->need_update = 0;
+            vs->force_update = 0;
+        }
     }
 
     if (vs->csock != -1) {
@@ -897,6 +979,7 @@ static void vnc_disconnect_start(VncState *vs)
 
 static void vnc_disconnect_finish(VncState *vs)
 {
+    vnc_worker_free(vs->worker);
     timer_del(vs->timer);
     timer_free(vs->timer);
     if (vs->input.buffer) g_free(vs->input.buffer);
@@ -1506,10 +1589,40 @@ static void framebuffer_update_request(VncState *vs, int incremental,
                          (ds_get_width(vs->ds) / 16), VNC_DIRTY_WORDS);
             vnc_set_bits(vs->server.dirty[y_position + i],
                          (ds_get_width(vs->ds) / 16), VNC_DIRTY_WORDS);
+            vnc_set_row(&vs->guest, y_position + i);
+            vnc_set_row(&vs->server, y_position + i);
         }
     }
 }
 
+static void send_end_of_continuous_updates(VncState *vs)
+{
+    vnc_write_u8(vs, VNC_MSG_CONTINUOUS_UPDATES);
+    vnc_flush(vs);
+}
+
+static void enable_continuous_updates(VncState *vs, int enable,
+                                      int x, int y, int w, int h)
+{
+    if (!vnc_has_feature(vs, VNC_FEATURE_CONTINUOUS_UPDATES)) {
+        vnc_client_error(vs);
+        return;
+    }
+
+    if (enable) {
+        vs->continuous_updates = 1;
+        vs->cu_x = x;
+        vs->cu_y = y;
+        vs->cu_w = w;
+        vs->cu_h = h;
+    } else if (vs->continuous_updates) {
+        vs->continuous_updates = 0;
+        /* the client waits for this before sending requests again */
+        vnc_worker_join(vs->worker);
+        send_end_of_continuous_updates(vs);
+    }
+}
+
 static void send_ext_key_event_ack(VncState *vs)
 {
     vnc_write_u8(vs, 0);
@@ -1534,12 +1647,12 @@ static void set_encodings(VncState *vs, int32_t *encodings, size_t n_encodings)
 {
     int i;
     unsigned int enc = 0;
+    uint32_t old_features = vs->features;
 
-    vnc_zlib_init(vs);
     vs->features = 0;
     vs->vnc_encoding = 0;
     vs->tight_compression = 9;
-    vs->tight_quality = 9;
+    vs->tight_quality = -1;
     vs->absolute = -1;
 
     for (i = n_encodings - 1; i >= 0; i--) {
@@ -1559,6 +1672,17 @@ static void set_encodings(VncState *vs, int32_t *encodings, size_t n_encodings)
             vs->features |= VNC_FEATURE_ZLIB_MASK;
             vs->vnc_encoding = enc;
             break;
+        case VNC_ENCODING_TIGHT:
+            vs->features |= VNC_FEATURE_TIGHT_MASK;
+            vs->vnc_encoding = enc;
+            break;
+        case VNC_ENCODING_ZRLE:
+            vs->features |= VNC_FEATURE_ZRLE_MASK;
+            vs->vnc_encoding = enc;
+            break;
+        case VNC_ENCODING_CONTINUOUS_UPDATES:
+            vs->features |= VNC_FEATURE_CONTINUOUS_UPDATES_MASK;
+            break;
         case VNC_ENCODING_DESKTOPRESIZE:
             vs->features |= VNC_FEATURE_RESIZE_MASK;
             break;
@@ -1586,6 +1710,11 @@ static void set_encodings(VncState *vs, int32_t *encodings, size_t n_encodings)
         }
     }
 
+    /* tell the client that the server supports continuous updates */
+    if (vnc_has_feature(vs, VNC_FEATURE_CONTINUOUS_UPDATES) &&
+        !(old_features & VNC_FEATURE_CONTINUOUS_UPDATES_MASK))
+        send_end_of_continuous_updates(vs);
+
     check_pointer_type_change(vs, kbd_mouse_is_absolute());
 }
 
@@ -1775,6 +1904,14 @@ static int protocol_client_msg(VncState *vs, uint8_t *data, size_t len)
 
         client_cut_text(vs, read_u32(data, 4), data + 8);
         break;
+    case VNC_MSG_CONTINUOUS_UPDATES:
+        if (len == 1)
+            return 10;
+
+        enable_continuous_updates(vs, read_u8(data, 1),
+                                  read_u16(data, 2), read_u16(data, 4),
+                                  read_u16(data, 6), read_u16(data, 8));
+        break;
     case 255:
         if (len == 1)
             return 2;
@@ -2083,6 +2220,9 @@ static void vnc_connect(VncDisplay *vd, int csock)
     vs->as.fmt = AUD_FMT_S16;
     vs->as.endianness = 0;
 
+    vs->tight_quality = -1;
+    vs->worker = vnc_worker_new(vs);
+
     vnc_resize(vs);
     vnc_write(vs, "RFB 003.008\n", 12);
     vnc_flush(vs);
@@ -0,0 +1,269 @@
+/*
+ * QEMU VNC display driver: Tight encoding
+ *
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "vnc.h"
+#include "android/utils/jpeg-compress.h"
+
+/*
+ * Tight sends solid rectangles with the fill subencoding, and the others
+ * with the basic subencoding (copy filter, zlib stream 0). When the client
+ * asked for a JPEG quality level, rectangles with many colors are sent as
+ * JPEG instead. The palette and gradient filters aren't implemented.
+ */
+
+#define TIGHT_MAX_RECT_WIDTH    2048
+#define TIGHT_MAX_RECT_SIZE     65536
+#define TIGHT_MIN_TO_COMPRESS   12
+/* Smaller rectangles, or ones with less colors, are sent losslessly. */
+#define TIGHT_JPEG_MIN_SIZE     4096
+#define TIGHT_JPEG_MIN_COLORS   64
+#define TIGHT_HASH_SIZE         256
+
+static const int tight_jpeg_quality[10] = {
+    5, 10, 15, 25, 37, 50, 60, 70, 75, 80
+};
+
+static inline uint32_t tight_get_pixel(const uint8_t *p, int bpp)
+{
+    switch (bpp) {
+    case 1:
+        return *p;
+    case 2:
+        return *(const uint16_t *)p;
+    default:
+        return *(const uint32_t *)p;
+    }
+}
+
+/* Pixels are sent as 3 bytes R, G, B when the client uses 32 bit pixels
+ * with 8 bit components. */
+static int tight_pixel24(VncState *vs)
+{
+    PixelFormat *pf = &vs->clientds.pf;
+
+    return pf->bytes_per_pixel == 4 &&
+           pf->rmax == 0xFF && pf->gmax == 0xFF && pf->bmax == 0xFF;
+}
+
+static void tight_get_rgb(VncState *vs, uint32_t v, uint8_t *rgb)
+{
+    PixelFormat *pf = &vs->server.ds->pf;
+
+    rgb[0] = ((v & pf->rmask) >> pf->rshift) << (8 - pf->rbits);
+    rgb[1] = ((v & pf->gmask) >> pf->gshift) << (8 - pf->gbits);
+    rgb[2] = ((v & pf->bmask) >> pf->bshift) << (8 - pf->bbits);
+}
+
+static void tight_write_pixel(VncState *vs, uint32_t v, int pixel24)
+{
+    uint8_t buf[4];
+
+    if (pixel24) {
+        tight_get_rgb(vs, v, buf);
+        vnc_write(vs, buf, 3);
+    } else {
+        vnc_convert_pixel(vs, buf, v);
+        vnc_write(vs, buf, vs->clientds.pf.bytes_per_pixel);
+    }
+}
+
+/* Insert the compact length of the |len| bytes at |offset| of the
+ * output before them. */
+static void tight_insert_compact_length(VncState *vs, size_t offset, int len)
+{
+    uint8_t buf[3];
+    int n = 0;
+
+    buf[n++] = len & 0x7F;
+    if (len > 0x7F) {
+        buf[n - 1] |= 0x80;
+        buf[n++] = (len >> 7) & 0x7F;
+        if (len > 0x3FFF) {
+            buf[n - 1] |= 0x80;
+            buf[n++] = (len >> 14) & 0xFF;
+        }
+    }
+
+    buffer_reserve(&vs->output, n);
+    memmove(vs->output.buffer + offset + n, vs->output.buffer + offset, len);
+    memcpy(vs->output.buffer + offset, buf, n);
+    vs->output.offset += n;
+}
+
+/* Count the colors of a rectangle, up to |max|. */
+static int tight_count_colors(VncState *vs, int x, int y, int w, int h,
+                              int max)
+{
+    uint32_t colors[TIGHT_HASH_SIZE];
+    uint8_t used[TIGHT_HASH_SIZE];
+    int bpp = ds_get_bytes_per_pixel(vs->ds);
+    int linesize = ds_get_linesize(vs->ds);
+    int count = 0;
+    int i, j;
+
+    memset(used, 0, sizeof(used));
+    for (j = 0; j < h; j++) {
+        const uint8_t *row = vs->server.ds->data + (y + j) * linesize + x * bpp;
+        uint32_t last = tight_get_pixel(row, bpp);
+
+        for (i = 0; i < w; i++) {
+            uint32_t v = tight_get_pixel(row + i * bpp, bpp);
+            int k;
+
+            if (i > 0 && v == last)
+                continue;
+            last = v;
+            k = (v * 2654435761U) >> 24;
+            while (used[k] && colors[k] != v)
+                k = (k + 1) & (TIGHT_HASH_SIZE - 1);
+            if (!used[k]) {
+                if (++count > max)
+                    return count;
+                used[k] = 1;
+                colors[k] = v;
+            }
+        }
+    }
+    return count;
+}
+
+static void tight_send_fill(VncState *vs, uint32_t v)
+{
+    vnc_write_u8(vs, VNC_TIGHT_CCB_TYPE_FILL);
+    tight_write_pixel(vs, v, tight_pixel24(vs));
+}
+
+static void tight_send_jpeg(VncState *vs, int x, int y, int w, int h)
+{
+    int bpp = ds_get_bytes_per_pixel(vs->ds);
+    int linesize = ds_get_linesize(vs->ds);
+    uint8_t *rgbx;
+    size_t offset;
+    int size;
+    int i, j;
+
+    /* The compressor takes RGBX pixels. */
+    buffer_reset(&vs->tight);
+    buffer_reserve(&vs->tight, w * h * 4);
+    rgbx = vs->tight.buffer;
+    for (j = 0; j < h; j++) {
+        const uint8_t *row = vs->server.ds->data + (y + j) * linesize + x * bpp;
+        for (i = 0; i < w; i++, rgbx += 4) {
+            tight_get_rgb(vs, tight_get_pixel(row + i * bpp, bpp), rgbx);
+            rgbx[3] = 0;
+        }
+    }
+
+    if (!vs->tight_jpeg)
+        vs->tight_jpeg = jpeg_compressor_create(0, 64 * 1024);
+    jpeg_compressor_compress_fb(vs->tight_jpeg, 0, 0, w, h, h, 4, w * 4,
+                                vs->tight.buffer,
+                                tight_jpeg_quality[vs->tight_quality], 1);
+    size = jpeg_compressor_get_jpeg_size(vs->tight_jpeg);
+
+    vnc_write_u8(vs, VNC_TIGHT_CCB_TYPE_JPEG);
+    offset = vs->output.offset;
+    vnc_write(vs, jpeg_compressor_get_buffer(vs->tight_jpeg), size);
+    tight_insert_compact_length(vs, offset, size);
+}
+
+static void tight_send_basic(VncState *vs, int x, int y, int w, int h)
+{
+    int bpp = ds_get_bytes_per_pixel(vs->ds);
+    int linesize = ds_get_linesize(vs->ds);
+    int pixel24 = tight_pixel24(vs);
+    int size = w * h * (pixel24 ? 3 : vs->clientds.pf.bytes_per_pixel);
+    int bytes_written;
+    int i, j;
+
+    /* stream 0, no filter */
+    vnc_write_u8(vs, 0);
+
+    if (size >= TIGHT_MIN_TO_COMPRESS)
+        vnc_zlib_start(vs);
+    for (j = 0; j < h; j++) {
+        const uint8_t *row = vs->server.ds->data + (y + j) * linesize + x * bpp;
+        for (i = 0; i < w; i++)
+            tight_write_pixel(vs, tight_get_pixel(row + i * bpp, bpp), pixel24);
+    }
+    if (size < TIGHT_MIN_TO_COMPRESS)
+        return;
+
+    bytes_written = vnc_zlib_stop(vs, VNC_ZLIB_STREAM_TIGHT);
+    if (bytes_written == -1)
+        return;
+    tight_insert_compact_length(vs, vs->output.offset - bytes_written,
+                                bytes_written);
+}
+
+static void tight_send_rect(VncState *vs, int x, int y, int w, int h)
+{
+    int max = TIGHT_JPEG_MIN_COLORS;
+    int colors;
+
+    vnc_framebuffer_update(vs, x, y, w, h, VNC_ENCODING_TIGHT);
+
+    if (vs->tight_quality < 0 || vs->clientds.pf.bytes_per_pixel == 1 ||
+        w * h < TIGHT_JPEG_MIN_SIZE)
+        max = 1;
+    colors = tight_count_colors(vs, x, y, w, h, max);
+
+    if (colors == 1) {
+        const uint8_t *p = vs->server.ds->data + y * ds_get_linesize(vs->ds) +
+                           x * ds_get_bytes_per_pixel(vs->ds);
+        tight_send_fill(vs, tight_get_pixel(p, ds_get_bytes_per_pixel(vs->ds)));
+    } else if (colors > TIGHT_JPEG_MIN_COLORS) {
+        tight_send_jpeg(vs, x, y, w, h);
+    } else {
+        tight_send_basic(vs, x, y, w, h);
+    }
+}
+
+int vnc_tight_send_framebuffer_update(VncState *vs, int x, int y, int w, int h)
+{
+    int n = 0;
+    int dx, dy;
+
+    /* Tight limits the size of a rectangle. */
+    for (dx = 0; dx < w; dx += TIGHT_MAX_RECT_WIDTH) {
+        int rw = MIN(TIGHT_MAX_RECT_WIDTH, w - dx);
+        int rows = MAX(1, TIGHT_MAX_RECT_SIZE / rw);
+
+        for (dy = 0; dy < h; dy += rows) {
+            tight_send_rect(vs, x + dx, y + dy, rw, MIN(rows, h - dy));
+            n++;
+        }
+    }
+    return n;
+}
+
+void vnc_tight_clear(VncState *vs)
+{
+    if (vs->tight_jpeg) {
+        jpeg_compressor_destroy(vs->tight_jpeg);
+        vs->tight_jpeg = NULL;
+    }
+    g_free(vs->tight.buffer);
+    memset(&vs->tight, 0, sizeof(vs->tight));
+}
@@ -0,0 +1,267 @@
+/*
+ * QEMU VNC display driver: ZRLE encoding
+ *
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "vnc.h"
+
+/*
+ * ZRLE sends 64x64 tiles through a zlib stream that lasts as long as the
+ * connection. Each tile picks the smallest of the raw, solid, packed
+ * palette, plain RLE and palette RLE subencodings.
+ */
+
+#define ZRLE_TILE           64
+#define ZRLE_MAX_PALETTE    127
+#define ZRLE_HASH_SIZE      256
+
+typedef struct ZrlePalette {
+    int size;
+    uint32_t colors[ZRLE_MAX_PALETTE];
+    /* open addressing, index + 1 of the color, or 0 */
+    uint8_t hash[ZRLE_HASH_SIZE];
+} ZrlePalette;
+
+static inline int zrle_hash(uint32_t v)
+{
+    return (v * 2654435761U) >> 24;
+}
+
+static void zrle_palette_init(ZrlePalette *p)
+{
+    p->size = 0;
+    memset(p->hash, 0, sizeof(p->hash));
+}
+
+/* Return the index of |v|, or -1 if the palette is full. */
+static int zrle_palette_index(ZrlePalette *p, uint32_t v)
+{
+    int h = zrle_hash(v);
+
+    while (p->hash[h]) {
+        if (p->colors[p->hash[h] - 1] == v)
+            return p->hash[h] - 1;
+        h = (h + 1) & (ZRLE_HASH_SIZE - 1);
+    }
+    if (p->size == ZRLE_MAX_PALETTE)
+        return -1;
+    p->colors[p->size] = v;
+    p->hash[h] = ++p->size;
+    return p->size - 1;
+}
+
+/* Number of bytes of a CPIXEL: 3 when the client pixels are 32 bits with
+ * all the color bits in the low or high 3 bytes. */
+static int zrle_cpixel_size(VncState *vs, int *offset)
+{
+    PixelFormat *pf = &vs->clientds.pf;
+    uint32_t mask = pf->rmask | pf->gmask | pf->bmask;
+    int big_endian = (vs->clientds.flags & QEMU_BIG_ENDIAN_FLAG) != 0;
+
+    *offset = 0;
+    if (pf->bytes_per_pixel != 4 || pf->depth > 24)
+        return pf->bytes_per_pixel;
+    if (!(mask & 0xFF000000)) {
+        *offset = big_endian ? 1 : 0;
+        return 3;
+    }
+    if (!(mask & 0x000000FF)) {
+        *offset = big_endian ? 0 : 1;
+        return 3;
+    }
+    return 4;
+}
+
+static inline uint32_t zrle_get_pixel(const uint8_t *p, int bpp)
+{
+    switch (bpp) {
+    case 1:
+        return *p;
+    case 2:
+        return *(const uint16_t *)p;
+    default:
+        return *(const uint32_t *)p;
+    }
+}
+
+static inline void zrle_write_cpixel(VncState *vs, uint32_t v,
+                                     int cpixel, int offset)
+{
+    uint8_t buf[4];
+
+    vnc_convert_pixel(vs, buf, v);
+    vnc_write(vs, buf + offset, cpixel);
+}
+
+static void zrle_write_run_length(VncState *vs, int len)
+{
+    len--;
+    while (len >= 255) {
+        vnc_write_u8(vs, 255);
+        len -= 255;
+    }
+    vnc_write_u8(vs, len);
+}
+
+static void zrle_send_tile(VncState *vs, const uint32_t *pixels, int w, int h,
+                           int cpixel, int offset)
+{
+    ZrlePalette palette;
+    int n = w * h;
+    int runs = 0;
+    int rle_bytes = 0;      /* run lengths of plain RLE */
+    int palette_rle_bytes = 0;
+    int raw_size, rle_size, palette_rle_size, packed_size;
+    int bits;
+    int i, j;
+
+    /* Count the colors and the runs. */
+    zrle_palette_init(&palette);
+    for (i = 0; i < n; i = j) {
+        int len;
+
+        for (j = i + 1; j < n && pixels[j] == pixels[i]; j++) {
+        }
+        len = j - i;
+        runs++;
+        rle_bytes += (len - 1) / 255 + 1;
+        palette_rle_bytes += len == 1 ? 1 : 1 + (len - 1) / 255 + 1;
+        if (palette.size >= 0 && zrle_palette_index(&palette, pixels[i]) < 0)
+            palette.size = -1;
+    }
+
+    if (palette.size == 1) {
+        vnc_write_u8(vs, 1);
+        zrle_write_cpixel(vs, pixels[0], cpixel, offset);
+        return;
+    }
+
+    raw_size = n * cpixel;
+    rle_size = runs * cpixel + rle_bytes;
+    palette_rle_size = INT_MAX;
+    packed_size = INT_MAX;
+    bits = 0;
+    if (palette.size > 0) {
+        palette_rle_size = palette.size * cpixel + palette_rle_bytes;
+        if (palette.size <= 16) {
+            bits = palette.size <= 2 ? 1 : palette.size <= 4 ? 2 : 4;
+            packed_size = palette.size * cpixel + ((w * bits + 7) / 8) * h;
+        }
+    }
+
+    if (packed_size <= palette_rle_size && packed_size <= rle_size &&
+        packed_size < raw_size) {
+        /* packed palette, each row starts on a byte boundary */
+        vnc_write_u8(vs, palette.size);
+        for (i = 0; i < palette.size; i++)
+            zrle_write_cpixel(vs, palette.colors[i], cpixel, offset);
+        for (j = 0; j < h; j++) {
+            uint8_t byte = 0;
+            int nbits = 0;
+
+            for (i = 0; i < w; i++) {
+                byte = (byte << bits) |
+                       zrle_palette_index(&palette, pixels[j * w + i]);
+                nbits += bits;
+                if (nbits == 8) {
+                    vnc_write_u8(vs, byte);
+                    byte = 0;
+                    nbits = 0;
+                }
+            }
+            if (nbits)
+                vnc_write_u8(vs, byte << (8 - nbits));
+        }
+    } else if (palette_rle_size <= rle_size && palette_rle_size < raw_size) {
+        vnc_write_u8(vs, 128 + palette.size);
+        for (i = 0; i < palette.size; i++)
+            zrle_write_cpixel(vs, palette.colors[i], cpixel, offset);
+        for (i = 0; i < n; i = j) {
+            int index = zrle_palette_index(&palette, pixels[i]);
+
+            for (j = i + 1; j < n && pixels[j] == pixels[i]; j++) {
+            }
+            if (j - i == 1) {
+                vnc_write_u8(vs, index);
+            } else {
+                vnc_write_u8(vs, index | 128);
+                zrle_write_run_length(vs, j - i);
+            }
+        }
+    } else if (rle_size < raw_size) {
+        vnc_write_u8(vs, 128);
+        for (i = 0; i < n; i = j) {
+            for (j = i + 1; j < n && pixels[j] == pixels[i]; j++) {
+            }
+            zrle_write_cpixel(vs, pixels[i], cpixel, offset);
+            zrle_write_run_length(vs, j - i);
+        }
+    } else {
+        vnc_write_u8(vs, 0);
+        for (i = 0; i < n; i++)
+            zrle_write_cpixel(vs, pixels[i], cpixel, offset);
+    }
+}
+
+int vnc_zrle_send_framebuffer_update(VncState *vs, int x, int y, int w, int h)
+{
+    uint32_t pixels[ZRLE_TILE * ZRLE_TILE];
+    int bpp = ds_get_bytes_per_pixel(vs->ds);
+    int linesize = ds_get_linesize(vs->ds);
+    int old_offset, new_offset, bytes_written;
+    int cpixel, offset;
+    int tx, ty;
+
+    vnc_framebuffer_update(vs, x, y, w, h, VNC_ENCODING_ZRLE);
+
+    old_offset = vs->output.offset;
+    vnc_write_s32(vs, 0);
+
+    cpixel = zrle_cpixel_size(vs, &offset);
+    vnc_zlib_start(vs);
+    for (ty = y; ty < y + h; ty += ZRLE_TILE) {
+        int th = MIN(ZRLE_TILE, y + h - ty);
+
+        for (tx = x; tx < x + w; tx += ZRLE_TILE) {
+            int tw = MIN(ZRLE_TILE, x + w - tx);
+            int i, j;
+
+            for (j = 0; j < th; j++) {
+                const uint8_t *row = vs->server.ds->data +
+                                     (ty + j) * linesize + tx * bpp;
+                for (i = 0; i < tw; i++)
+                    pixels[j * tw + i] = zrle_get_pixel(row + i * bpp, bpp);
+            }
+            zrle_send_tile(vs, pixels, tw, th, cpixel, offset);
+        }
+    }
+    bytes_written = vnc_zlib_stop(vs, VNC_ZLIB_STREAM_ZRLE);
+
+    if (bytes_written == -1)
+        return 1;
+
+    new_offset = vs->output.offset;
+    vs->output.offset = old_offset;
+    vnc_write_u32(vs, bytes_written);
+    vs->output.offset = new_offset;
+    return 1;
+}
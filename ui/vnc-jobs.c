@@ -0,0 +1,241 @@
+/*
+ * QEMU VNC display driver: encoding thread
+ *
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "vnc.h"
+#include "qemu/thread.h"
+
+/*
+ * Each client has a thread that encodes its framebuffer updates.
+ *
+ * The main loop copies the guest changes to the server surface, and
+ * queues the dirty rectangles of the server surface. The thread encodes
+ * them with its own VncState, which has a snapshot of the client pixel
+ * format and encoding, and owns the zlib streams. Its update is appended
+ * to the client's output by a bottom half. There is at most one update
+ * in flight, and the main loop doesn't touch the server surface until it
+ * is collected.
+ */
+
+typedef struct VncRect {
+    int x, y, w, h;
+} VncRect;
+
+enum {
+    VNC_WORKER_IDLE,    /* no update, the rectangles are being added */
+    VNC_WORKER_QUEUED,  /* the thread encodes the update */
+    VNC_WORKER_DONE,    /* the update is in enc->output */
+};
+
+struct VncWorker {
+    VncState *vs;
+    /* encoder state, only used by the thread while an update is queued */
+    VncState *enc;
+    DisplayState ds;
+
+    VncRect *rects;
+    int n_rects;
+    int max_rects;
+
+    QemuThread thread;
+    QemuMutex mutex;
+    QemuCond cond;
+    QEMUBH *bh;
+    int state;
+    bool exit;
+};
+
+static void vnc_worker_encode(VncWorker *w)
+{
+    VncState *enc = w->enc;
+    int saved_offset;
+    int n_rectangles = 0;
+    int i;
+
+    vnc_write_u8(enc, 0);  /* msg id */
+    vnc_write_u8(enc, 0);
+    saved_offset = enc->output.offset;
+    vnc_write_u16(enc, 0);
+
+    for (i = 0; i < w->n_rects; i++) {
+        VncRect *r = &w->rects[i];
+        n_rectangles += vnc_send_framebuffer_update(enc, r->x, r->y,
+                                                    r->w, r->h);
+    }
+
+    enc->output.buffer[saved_offset] = (n_rectangles >> 8) & 0xFF;
+    enc->output.buffer[saved_offset + 1] = n_rectangles & 0xFF;
+}
+
+static void *vnc_worker_thread(void *opaque)
+{
+    VncWorker *w = opaque;
+
+    qemu_mutex_lock(&w->mutex);
+    for (;;) {
+        while (w->state != VNC_WORKER_QUEUED && !w->exit)
+            qemu_cond_wait(&w->cond, &w->mutex);
+        if (w->exit)
+            break;
+        qemu_mutex_unlock(&w->mutex);
+
+        vnc_worker_encode(w);
+
+        qemu_mutex_lock(&w->mutex);
+        w->state = VNC_WORKER_DONE;
+        qemu_cond_broadcast(&w->cond);
+        qemu_bh_schedule(w->bh);
+    }
+    qemu_mutex_unlock(&w->mutex);
+    return NULL;
+}
+
+/* Append the encoded update to the client's output, if it is ready. */
+static void vnc_worker_flush(VncWorker *w)
+{
+    VncState *enc = w->enc;
+    int state;
+
+    qemu_mutex_lock(&w->mutex);
+    state = w->state;
+    qemu_mutex_unlock(&w->mutex);
+    if (state != VNC_WORKER_DONE)
+        return;
+
+    vnc_write(w->vs, enc->output.buffer, enc->output.offset);
+    buffer_reset(&enc->output);
+    w->n_rects = 0;
+    qemu_mutex_lock(&w->mutex);
+    w->state = VNC_WORKER_IDLE;
+    qemu_mutex_unlock(&w->mutex);
+    vnc_flush(w->vs);
+}
+
+static void vnc_worker_bh(void *opaque)
+{
+    vnc_worker_flush(opaque);
+}
+
+VncWorker *vnc_worker_new(VncState *vs)
+{
+    VncWorker *w = g_malloc0(sizeof(*w));
+
+    w->vs = vs;
+    w->enc = g_malloc0(sizeof(VncState));
+    w->enc->csock = -1;
+    w->enc->ds = &w->ds;
+    w->state = VNC_WORKER_IDLE;
+    w->bh = qemu_bh_new(vnc_worker_bh, w);
+    qemu_mutex_init(&w->mutex);
+    qemu_cond_init(&w->cond);
+    qemu_thread_create(&w->thread, vnc_worker_thread, w,
+                       QEMU_THREAD_JOINABLE);
+    return w;
+}
+
+void vnc_worker_free(VncWorker *w)
+{
+    VncState *enc = w->enc;
+    int i;
+
+    qemu_mutex_lock(&w->mutex);
+    while (w->state == VNC_WORKER_QUEUED)
+        qemu_cond_wait(&w->cond, &w->mutex);
+    w->exit = true;
+    qemu_cond_signal(&w->cond);
+    qemu_mutex_unlock(&w->mutex);
+    qemu_thread_join(&w->thread);
+
+    qemu_bh_delete(w->bh);
+    qemu_cond_destroy(&w->cond);
+    qemu_mutex_destroy(&w->mutex);
+
+    for (i = 0; i < (int)(sizeof(enc->zlib_stream) / sizeof(z_stream)); i++) {
+        if (enc->zlib_stream[i].opaque == enc)
+            deflateEnd(&enc->zlib_stream[i]);
+    }
+    vnc_tight_clear(enc);
+    g_free(enc->output.buffer);
+    g_free(enc->zlib.buffer);
+    g_free(enc);
+    g_free(w->rects);
+    g_free(w);
+}
+
+bool vnc_worker_busy(VncWorker *w)
+{
+    bool busy;
+
+    qemu_mutex_lock(&w->mutex);
+    busy = w->state != VNC_WORKER_IDLE;
+    qemu_mutex_unlock(&w->mutex);
+    return busy;
+}
+
+void vnc_worker_add_rect(VncWorker *w, int x, int y, int width, int height)
+{
+    VncRect *r;
+
+    if (w->n_rects == w->max_rects) {
+        w->max_rects = w->max_rects ? w->max_rects * 2 : 64;
+        w->rects = g_realloc(w->rects, w->max_rects * sizeof(*w->rects));
+    }
+    r = &w->rects[w->n_rects++];
+    r->x = x;
+    r->y = y;
+    r->w = width;
+    r->h = height;
+}
+
+void vnc_worker_start(VncWorker *w)
+{
+    VncState *vs = w->vs;
+    VncState *enc = w->enc;
+
+    /* The server surface stays the same until the update is collected:
+     * vnc_resize() joins the worker first. */
+    w->ds = *vs->ds;
+    w->ds.surface = vs->server.ds;
+    enc->server.ds = vs->server.ds;
+    enc->clientds = vs->clientds;
+    enc->write_pixels = vs->write_pixels;
+    enc->send_hextile_tile = vs->send_hextile_tile;
+    enc->features = vs->features;
+    enc->vnc_encoding = vs->vnc_encoding;
+    enc->tight_quality = vs->tight_quality;
+    enc->tight_compression = vs->tight_compression;
+
+    qemu_mutex_lock(&w->mutex);
+    w->state = VNC_WORKER_QUEUED;
+    qemu_cond_signal(&w->cond);
+    qemu_mutex_unlock(&w->mutex);
+}
+
+void vnc_worker_join(VncWorker *w)
+{
+    qemu_mutex_lock(&w->mutex);
+    while (w->state == VNC_WORKER_QUEUED)
+        qemu_cond_wait(&w->cond, &w->mutex);
+    qemu_mutex_unlock(&w->mutex);
+    vnc_worker_flush(w);
+}
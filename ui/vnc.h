@@ -57,6 +57,7 @@ typedef struct Buffer
 } Buffer;
 
 typedef struct VncState VncState;
+typedef struct VncWorker VncWorker;
 
 typedef int VncReadEvent(VncState *vs, uint8_t *data, size_t len);
 
@@ -71,6 +72,7 @@ typedef void VncSendHextileTile(VncState *vs,
 #define VNC_MAX_WIDTH 2048
 #define VNC_MAX_HEIGHT 2048
 #define VNC_DIRTY_WORDS (VNC_MAX_WIDTH / (16 * 32))
+#define VNC_DIRTY_ROW_WORDS (VNC_MAX_HEIGHT / 32)
 
 #define VNC_AUTH_CHALLENGE_SIZE 16
 
@@ -107,6 +109,8 @@ struct VncDisplay
 struct VncSurface
 {
     uint32_t dirty[VNC_MAX_HEIGHT][VNC_DIRTY_WORDS];
+    /* one bit per row, set when the row may have dirty bits */
+    uint32_t dirty_rows[VNC_DIRTY_ROW_WORDS];
     DisplaySurface *ds;
 };
 
@@ -122,13 +126,16 @@ struct VncState
     VncDisplay *vd;
     int need_update;
     int force_update;
+    /* continuous updates extension: area pushed without requests */
+    int continuous_updates;
+    int cu_x, cu_y, cu_w, cu_h;
     uint32_t features;
     int absolute;
     int last_x;
     int last_y;
 
     uint32_t vnc_encoding;
-    uint8_t tight_quality;
+    int tight_quality;      /* -1 unless the client accepts JPEG */
     uint8_t tight_compression;
 
     int major;
@@ -161,6 +168,14 @@ struct VncState
     Buffer zlib_tmp;
     z_stream zlib_stream[4];
 
+    /* JPEG compressor and RGBX staging of the Tight encoder */
+    struct AJPEGDesc *tight_jpeg;
+    Buffer tight;
+
+    /* encodes the framebuffer updates; the streams above belong to its
+     * own VncState */
+    VncWorker *worker;
+
     VncState *next;
 };
 
@@ -224,8 +239,17 @@ enum {
 #define VNC_ENCODING_POINTER_TYPE_CHANGE  0XFFFFFEFF /* -257 */
 #define VNC_ENCODING_EXT_KEY_EVENT        0XFFFFFEFE /* -258 */
 #define VNC_ENCODING_AUDIO                0XFFFFFEFD /* -259 */
+#define VNC_ENCODING_CONTINUOUS_UPDATES   0xFFFFFEC7 /* -313 */
 #define VNC_ENCODING_WMVi                 0x574D5669
 
+/* Client and server message types of the continuous updates extension */
+#define VNC_MSG_CONTINUOUS_UPDATES        150
+
+/* zlib streams of a VncState */
+#define VNC_ZLIB_STREAM_ZLIB              0
+#define VNC_ZLIB_STREAM_ZRLE              1
+#define VNC_ZLIB_STREAM_TIGHT             2
+
 /*****************************************************************************
  *
  * Other tight constants
@@ -257,6 +281,8 @@ enum {
 #define VNC_FEATURE_TIGHT                    4
 #define VNC_FEATURE_ZLIB                     5
 #define VNC_FEATURE_COPYRECT                 6
+#define VNC_FEATURE_ZRLE                     7
+#define VNC_FEATURE_CONTINUOUS_UPDATES       8
 
 #define VNC_FEATURE_RESIZE_MASK              (1 << VNC_FEATURE_RESIZE)
 #define VNC_FEATURE_HEXTILE_MASK             (1 << VNC_FEATURE_HEXTILE)
@@ -265,6 +291,8 @@ enum {
 #define VNC_FEATURE_TIGHT_MASK               (1 << VNC_FEATURE_TIGHT)
 #define VNC_FEATURE_ZLIB_MASK                (1 << VNC_FEATURE_ZLIB)
 #define VNC_FEATURE_COPYRECT_MASK            (1 << VNC_FEATURE_COPYRECT)
+#define VNC_FEATURE_ZRLE_MASK                (1 << VNC_FEATURE_ZRLE)
+#define VNC_FEATURE_CONTINUOUS_UPDATES_MASK  (1 << VNC_FEATURE_CONTINUOUS_UPDATES)
 
 
 /*****************************************************************************
@@ -311,6 +339,32 @@ void buffer_reset(Buffer *buffer);
 void buffer_append(Buffer *buffer, const void *data, size_t len);
 
 
+/* Encodings */
+void vnc_framebuffer_update(VncState *vs, int x, int y, int w, int h,
+                            int32_t encoding);
+void vnc_convert_pixel(VncState *vs, uint8_t *buf, uint32_t v);
+void vnc_zlib_start(VncState *vs);
+int vnc_zlib_stop(VncState *vs, int stream_id);
+/* Return the number of rectangles written */
+int vnc_send_framebuffer_update(VncState *vs, int x, int y, int w, int h);
+int vnc_zrle_send_framebuffer_update(VncState *vs, int x, int y, int w, int h);
+int vnc_tight_send_framebuffer_update(VncState *vs, int x, int y, int w, int h);
+void vnc_tight_clear(VncState *vs);
+
+/* Encoding thread of a client. The framebuffer updates are encoded from
+ * the server surface, which must not change until the update is
+ * collected. */
+VncWorker *vnc_worker_new(VncState *vs);
+void vnc_worker_free(VncWorker *worker);
+/* True from vnc_worker_start() until the update is appended to the
+ * client's output */
+bool vnc_worker_busy(VncWorker *worker);
+void vnc_worker_add_rect(VncWorker *worker, int x, int y, int w, int h);
+/* Send a framebuffer update with the added rectangles */
+void vnc_worker_start(VncWorker *worker);
+/* Wait for the pending update, and append it to the client's output */
+void vnc_worker_join(VncWorker *worker);
+
 /* Misc helpers */
 
 char *vnc_socket_local_addr(const char *format, int fd);
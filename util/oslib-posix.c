@@ -62,6 +62,10 @@ extern int daemon(int, int);
 #include <sys/syscall.h>
 #endif
 
+#ifdef __APPLE__
+#include <mach/vm_statistics.h>
+#endif
+
 int qemu_get_thread_id(void)
 {
 #if defined(__linux__)
@@ -138,6 +142,82 @@ void *qemu_anon_ram_alloc(size_t size)
     return ptr;
 }
 
+#ifdef __linux__
+/* size of the hugetlbfs pages, 0 if the kernel has none */
+static size_t qemu_hugepage_size(void)
+{
+    char line[128];
+    unsigned long kb = 0;
+    FILE *f = fopen("/proc/meminfo", "r");
+
+    if (!f) {
+        return 0;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "Hugepagesize: %lu kB", &kb) == 1) {
+            break;
+        }
+    }
+    fclose(f);
+    return (size_t)kb * 1024;
+}
+
+/* madvise(MADV_HUGEPAGE) succeeds even if transparent huge pages are off */
+static int qemu_thp_disabled(void)
+{
+    char mode[64] = "";
+    FILE *f = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+
+    if (!f) {
+        return 1;
+    }
+    if (!fgets(mode, sizeof(mode), f)) {
+        mode[0] = '\0';
+    }
+    fclose(f);
+    return strstr(mode, "[never]") != NULL;
+}
+#endif
+
+void *qemu_anon_ram_alloc_hugepages(size_t size, size_t *page_size)
+{
+    void *ptr;
+
+#if defined(__linux__) && defined(MAP_HUGETLB)
+    /* pages from the hugetlbfs pool, reserved by mmap() */
+    size_t hpagesize = qemu_hugepage_size();
+
+    if (hpagesize > 0 && (size % hpagesize) == 0) {
+        ptr = mmap(0, size, PROT_READ | PROT_WRITE,
+                   MAP_ANONYMOUS | MAP_PRIVATE | MAP_HUGETLB, -1, 0);
+        if (ptr != MAP_FAILED) {
+            *page_size = hpagesize;
+            return ptr;
+        }
+    }
+#elif defined(__APPLE__) && defined(VM_FLAGS_SUPERPAGE_SIZE_2MB)
+    /* superpages are requested through the fd argument */
+    if ((size % (2 << 20)) == 0) {
+        ptr = mmap(0, size, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE,
+                   VM_FLAGS_SUPERPAGE_SIZE_2MB, 0);
+        if (ptr != MAP_FAILED) {
+            *page_size = 2 << 20;
+            return ptr;
+        }
+    }
+#endif
+
+    ptr = qemu_anon_ram_alloc(size);
+    *page_size = getpagesize();
+#ifdef __linux__
+    if (ptr && !qemu_thp_disabled() &&
+        qemu_madvise(ptr, size, QEMU_MADV_HUGEPAGE) == 0) {
+        *page_size = 0;
+    }
+#endif
+    return ptr;
+}
+
 void qemu_vfree(void *ptr)
 {
     //trace_qemu_vfree(ptr);
@@ -85,6 +85,46 @@ void *qemu_anon_ram_alloc(size_t size)
     return ptr;
 }
 
+/* large pages need the "Lock pages in memory" privilege */
+static int qemu_enable_lock_memory_privilege(void)
+{
+    HANDLE token;
+    TOKEN_PRIVILEGES tp;
+    BOOL ok;
+
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES,
+                          &token)) {
+        return 0;
+    }
+    tp.PrivilegeCount = 1;
+    tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+    ok = LookupPrivilegeValue(NULL, SE_LOCK_MEMORY_NAME,
+                              &tp.Privileges[0].Luid) &&
+         AdjustTokenPrivileges(token, FALSE, &tp, 0, NULL, NULL) &&
+         GetLastError() == ERROR_SUCCESS;
+    CloseHandle(token);
+    return ok;
+}
+
+void *qemu_anon_ram_alloc_hugepages(size_t size, size_t *page_size)
+{
+    SIZE_T large = GetLargePageMinimum();
+    void *ptr;
+
+    if (large > 0 && (size % large) == 0 &&
+        qemu_enable_lock_memory_privilege()) {
+        ptr = VirtualAlloc(NULL, size,
+                           MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,
+                           PAGE_READWRITE);
+        if (ptr) {
+            *page_size = large;
+            return ptr;
+        }
+    }
+    *page_size = 4096;
+    return qemu_anon_ram_alloc(size);
+}
+
 void qemu_vfree(void *ptr)
 {
     //trace_qemu_vfree(ptr);
@@ -53,10 +53,12 @@
 #include "android/ext4_resize.h"
 #include "android/filesystems/ext4_utils.h"
 #include "android/filesystems/fstab_parser.h"
+#include "android/filesystems/nand_block_map.h"
 #include "android/filesystems/partition_types.h"
 #include "android/filesystems/ramdisk_extractor.h"
 #include "android/globals.h"
 #include "android/gps.h"
+#include "android/hw-audio-offload.h"
 #include "android/hw-kmsg.h"
 #include "android/hw-pipe-net.h"
 #include "android/hw-qemud.h"
@@ -64,10 +66,12 @@
 #include "android/log-rotate.h"
 #include "android/multitouch-port.h"
 #include "android/multitouch-screen.h"
+#include "android/gpu_frame.h"
 #include "android/opengles.h"
 #include "android/opengl/emugl_config.h"
 #include "android/skin/charmap.h"
 #include "android/snapshot.h"
+#include "android/snapshot-bench.h"
 #include "android/tcpdump.h"
 #include "android/utils/bufprint.h"
 #include "android/utils/debug.h"
@@ -195,6 +199,7 @@ int qemu_main(int argc, char **argv, char **envp);
 #include "qemu/timer.h"
 #include "sysemu/char.h"
 #include "qemu/cache-utils.h"
+#include "qemu/thread.h"
 #include "block/block.h"
 #include "sysemu/dma.h"
 #include "audio/audio.h"
@@ -209,6 +214,9 @@ int qemu_main(int argc, char **argv, char **envp);
 #include "android/boot-properties.h"
 #include "android/hw-control.h"
 #include "android/core-init-utils.h"
+#include "android/boot-benchmark.h"
+#include "android/perf-stats.h"
+#include "android/utils/startup_trace.h"
 #include "android/audio-test.h"
 
 #include "android/snaphost-android.h"
@@ -262,6 +270,8 @@ const char *mem_path = NULL;
 #ifdef MAP_POPULATE
 int mem_prealloc = 0; /* force preallocation of physical target memory */
 #endif
+int mem_hugepages = 0; /* back guest RAM with huge pages if possible */
+const char *ram_template = NULL; /* file guest RAM is privately mapped from */
 int nb_nics;
 NICInfo nd_table[MAX_NICS];
 int vm_running;
@@ -336,6 +346,15 @@ extern char* op_http_proxy;
 // Path to the file containing specific key character map.
 char* op_charmap_file = NULL;
 
+/* Path of the file to record the GPU-emulated display to, from the
+ * -gpu-record option. */
+static const char* op_gpu_record = NULL;
+
+/* Path of the file to append the performance counters to, from the
+ * -perf-stats option. */
+static const char* op_perf_stats = NULL;
+static const char* op_benchmark_boot = NULL;
+
 /* Path to hardware initialization file passed with -android-hw option. */
 char* android_op_hwini = NULL;
 
@@ -1183,12 +1202,27 @@ static QEMUMachine *find_default_machine(void)
 /***********************************************************/
 /* main execution loop */
 
+/* After GUI_IDLE_REFRESHES refreshes without any display update nor user
+ * input, the GUI timer only runs every GUI_IDLE_REFRESH_INTERVAL ms, which
+ * still polls the UI events often enough for the first input to feel
+ * responsive. Any activity restores the regular interval. */
+#define GUI_IDLE_REFRESHES         60
+#define GUI_IDLE_REFRESH_INTERVAL  100
+
+static DisplayState *gui_display_state;
+static DisplayUpdateListener gui_activity_listener[1];
+static int gui_idle_refreshes;
+
 static void gui_update(void *opaque)
 {
     uint64_t interval = GUI_REFRESH_INTERVAL;
     DisplayState *ds = opaque;
     DisplayChangeListener *dcl = ds->listeners;
 
+    if (gui_idle_refreshes < GUI_IDLE_REFRESHES)
+        gui_idle_refreshes++;
+
+    /* This resets gui_idle_refreshes if the display changed. */
     dpy_refresh(ds);
 
     while (dcl != NULL) {
@@ -1197,9 +1231,29 @@ static void gui_update(void *opaque)
             interval = dcl->gui_timer_interval;
         dcl = dcl->next;
     }
+    if (gui_idle_refreshes == GUI_IDLE_REFRESHES &&
+        interval < GUI_IDLE_REFRESH_INTERVAL)
+        interval = GUI_IDLE_REFRESH_INTERVAL;
     timer_mod(ds->gui_timer, interval + qemu_clock_get_ms(QEMU_CLOCK_REALTIME));
 }
 
+static void gui_activity_update(void *opaque, int x, int y, int w, int h)
+{
+    gui_idle_refreshes = 0;
+}
+
+void gui_notify_activity(void)
+{
+    int idle = (gui_idle_refreshes == GUI_IDLE_REFRESHES);
+
+    gui_idle_refreshes = 0;
+    if (idle && gui_display_state && gui_display_state->gui_timer) {
+        /* Don't wait for the end of the idle interval. */
+        timer_mod(gui_display_state->gui_timer,
+                  qemu_clock_get_ms(QEMU_CLOCK_REALTIME));
+    }
+}
+
 static void nographic_update(void *opaque)
 {
     uint64_t interval = GUI_REFRESH_INTERVAL;
@@ -1355,6 +1409,12 @@ void qemu_system_shutdown_request(void)
     qemu_notify_event();
 }
 
+void qemu_system_vmstop_request(int reason)
+{
+    vmstop_requested = reason;
+    qemu_notify_event();
+}
+
 void qemu_system_powerdown_request(void)
 {
     powerdown_requested = 1;
@@ -1371,6 +1431,8 @@ int vm_can_run(void)
         return 0;
     if (debug_requested)
         return 0;
+    if (vmstop_requested)
+        return 0;
     return 1;
 }
 
@@ -1853,6 +1915,140 @@ void android_extractPartitionFormat(const char* fstab,
 }
 
 
+// A partition image that is initialized from another one in the background,
+// see android_nand_add_image(), since copying and resizing it can take a
+// while, e.g. after -wipe-data. Meanwhile the rest of the virtual hardware
+// and the renderer are set up, and the NAND devices are only added once all
+// images are ready, see android_nand_finish_images().
+typedef struct {
+    QemuThread thread;
+    const char* part_name;
+    AndroidPartitionType part_type;
+    uint64_t part_size;
+    char* part_file;
+    char* part_init_file;
+    int error;                  // errno value of the failure, or 0.
+    uint64_t copied_us;         // startupTrace_now() timestamps.
+    uint64_t resized_us;
+} AndroidImageJob;
+
+#define ANDROID_MAX_IMAGE_JOBS  4
+#define ANDROID_MAX_NAND_PENDING  8
+
+static AndroidImageJob android_image_jobs[ANDROID_MAX_IMAGE_JOBS];
+static int android_image_job_count = 0;
+
+// Arguments of the nand_add_dev() calls deferred until the images are ready,
+// so that the devices keep the order in which they were requested.
+static char* android_nand_pending[ANDROID_MAX_NAND_PENDING];
+static int android_nand_pending_count = 0;
+
+static void* android_image_job_run(void* opaque)
+{
+    AndroidImageJob* job = opaque;
+    uint64_t init_size = 0;
+
+    // A clone or a sparse copy, see path_copy_fd().
+    if (path_copy_file(job->part_file, job->part_init_file) < 0) {
+        job->error = errno;
+        return NULL;
+    }
+    // The NAND device opens the fresh image without an initfile=, drop the
+    // erased blocks of the previous one.
+    nandBlockMap_forgetImage(job->part_file);
+    job->copied_us = startupTrace_now();
+
+    // The partition can be larger than the initial image, grow the ext4
+    // file system to fill it.
+    if (job->part_type == ANDROID_PARTITION_TYPE_EXT4 &&
+        path_get_size(job->part_init_file, &init_size) == 0 &&
+        init_size < job->part_size) {
+        resizeExt4Partition(job->part_file, job->part_size);
+        job->resized_us = startupTrace_now();
+    }
+    return NULL;
+}
+
+// Start initializing |part_file| from |part_init_file| in the background.
+static void android_image_job_start(const char* part_name,
+                                    AndroidPartitionType part_type,
+                                    uint64_t part_size,
+                                    const char* part_file,
+                                    const char* part_init_file)
+{
+    if (android_image_job_count == ANDROID_MAX_IMAGE_JOBS) {
+        PANIC("Too many partition images to initialize");
+    }
+    AndroidImageJob* job = &android_image_jobs[android_image_job_count++];
+    job->part_name = part_name;
+    job->part_type = part_type;
+    job->part_size = part_size;
+    job->part_file = g_strdup(part_file);
+    job->part_init_file = g_strdup(part_init_file);
+    job->error = 0;
+    job->copied_us = 0;
+    job->resized_us = 0;
+
+    VERBOSE_PRINT(init, "Initializing %s partition image %s from %s",
+                  part_name, part_file, part_init_file);
+    qemu_thread_create(&job->thread, android_image_job_run, job,
+                       QEMU_THREAD_JOINABLE);
+}
+
+// Add a NAND device, or defer it until the partition images are ready if
+// some are still being initialized.
+static void android_nand_add_dev(const char* arg)
+{
+    if (android_image_job_count == 0) {
+        nand_add_dev(arg);
+        return;
+    }
+    if (android_nand_pending_count == ANDROID_MAX_NAND_PENDING) {
+        PANIC("Too many NAND partitions");
+    }
+    android_nand_pending[android_nand_pending_count++] = g_strdup(arg);
+}
+
+// Wait for the partition images initialized in the background, and add
+// the NAND devices that were deferred. The time of each step is recorded
+// in the startup trace.
+static void android_nand_finish_images(void)
+{
+    uint64_t start_us = startupTrace_now();
+    int n;
+
+    for (n = 0; n < android_image_job_count; n++) {
+        AndroidImageJob* job = &android_image_jobs[n];
+        char name[STARTUP_TRACE_MAX_NAME + 1];
+
+        qemu_thread_join(&job->thread);
+        if (job->error) {
+            PANIC("Could not initialize %s partition image %s from %s: %s",
+                  job->part_name, job->part_file, job->part_init_file,
+                  strerror(job->error));
+        }
+        snprintf(name, sizeof(name), "%s image copied", job->part_name);
+        startupTrace_markAt(name, job->copied_us);
+        if (job->resized_us) {
+            snprintf(name, sizeof(name), "%s image resized", job->part_name);
+            startupTrace_markAt(name, job->resized_us);
+        }
+        g_free(job->part_file);
+        g_free(job->part_init_file);
+    }
+    if (android_image_job_count > 0) {
+        VERBOSE_PRINT(init, "Waited %d ms for the partition images",
+                      (int)((startupTrace_now() - start_us) / 1000));
+    }
+    android_image_job_count = 0;
+
+    for (n = 0; n < android_nand_pending_count; n++) {
+        nand_add_dev(android_nand_pending[n]);
+        g_free(android_nand_pending[n]);
+    }
+    android_nand_pending_count = 0;
+}
+
 // List of value describing how to handle partition images in
 // android_nand_add_image() below, when no initial partition image
 // file is provided.
@@ -1899,8 +2095,10 @@ typedef enum {
 // not exit, then the file must be created as an empty partition.
 //
 // If |part_init_file| is not NULL, its content will be used to erase
-// the content of the main partition image. This is automatically handled
-// by the NAND code though.
+// the content of the main partition image. This is done in the background,
+// and the device is only added by android_nand_finish_images(). Ext4
+// images are also grown to |part_size|. A temporary partition image only
+// records the changes made to |part_init_file| instead.
 //
 void android_nand_add_image(const char* part_name,
                             AndroidPartitionType part_type,
@@ -2021,6 +2219,8 @@ void android_nand_add_image(const char* part_name,
                           part_file,
                           strerror(errno));
                 }
+                // Don't reuse the block maps of a previous image.
+                nandBlockMap_forgetImage(part_file);
                 need_make_empty = true;
             }
         }
@@ -2068,15 +2268,23 @@ void android_nand_add_image(const char* part_name,
                   part_file,
                   strerror(-ret));
         }
+        if (!need_temp_partition) {
+            nandBlockMap_forgetImage(part_file);
+        }
     }
 
-    if (part_init_file) {
+    if (part_init_file && need_temp_partition) {
         char *escaped_part_init = path_escape_path(part_init_file);
         if (escaped_part_init) {
-            pstrcat(tmp, sizeof tmp, ",initfile=");
+            // A temporary image doesn't need to be a standalone copy of
+            // the initial one, which can be shared with other instances.
+            pstrcat(tmp, sizeof tmp, ",basefile=");
             pstrcat(tmp, sizeof tmp, escaped_part_init);
             free(escaped_part_init);
         }
+    } else if (part_init_file) {
+        android_image_job_start(part_name, part_type, part_size, part_file,
+                                part_init_file);
     }
 
     if (part_type == ANDROID_PARTITION_TYPE_EXT4) {
@@ -2085,7 +2293,7 @@ void android_nand_add_image(const char* part_name,
         pstrcat(tmp, sizeof tmp,",pagesize=512,extrasize=0");
     }
 
-    nand_add_dev(tmp);
+    android_nand_add_dev(tmp);
 }
 
 
@@ -2104,6 +2312,8 @@ int main(int argc, char **argv, char **envp)
     int cyls, heads, secs, translation;
     QemuOpts *hda_opts = NULL;
     QemuOpts *hdb_opts = NULL;
+    int sdcard_native_aio = 0;
+    const char *snapshot_bench_dir = NULL;
     const char *net_clients[MAX_NET_CLIENTS];
     int nb_net_clients;
     int optind;
@@ -2120,6 +2330,7 @@ int main(int argc, char **argv, char **envp)
     QEMUMachine *machine;
     const char *cpu_model;
     int tb_size;
+    const char *tb_index_file = NULL;
     const char *pid_file = NULL;
     const char *incoming = NULL;
     const char* log_mask = NULL;
@@ -2194,6 +2405,7 @@ int main(int argc, char **argv, char **envp)
     boot_property_init_service();
     android_hw_control_init();
     android_net_pipes_init();
+    android_audio_offload_init();
 
     socket_drainer_start(looper_newCore());
     android_wear_agent_start(looper_newCore());
@@ -2623,6 +2835,14 @@ int main(int argc, char **argv, char **envp)
                 code_profile_dirname = optarg;
                 printf("Profile will be stored in %s\n", code_profile_dirname);
                 break;
+            case QEMU_OPTION_code_profile_rate:
+                code_profile_sample_rate = atoi(optarg);
+                if (code_profile_sample_rate <= 0 ||
+                    code_profile_sample_rate > 10000) {
+                    fprintf(stderr, "Invalid -code-profile-rate: %s\n", optarg);
+                    exit(1);
+                }
+                break;
 #ifdef TARGET_I386
             case QEMU_OPTION_win2k_hack:
                 win2k_install_hack = 1;
@@ -2716,6 +2936,17 @@ int main(int argc, char **argv, char **envp)
             case QEMU_OPTION_clock:
                 configure_alarms(optarg);
                 break;
+            case QEMU_OPTION_timer_slack:
+                {
+                    char *end;
+                    long us = strtol(optarg, &end, 0);
+
+                    if (*end || us < 0) {
+                        PANIC("Invalid -timer-slack value: %s", optarg);
+                    }
+                    configure_timer_slack((int64_t)us * 1000);
+                }
+                break;
             case QEMU_OPTION_startdate:
                 {
                     struct tm tm;
@@ -2843,6 +3074,18 @@ int main(int argc, char **argv, char **envp)
                 if (tb_size < 0)
                     tb_size = 0;
                 break;
+            case QEMU_OPTION_tb_hot:
+                tb_hot_threshold = strtol(optarg, NULL, 0);
+                if (tb_hot_threshold < 0) {
+                    PANIC("Invalid -tb-hot value %s", optarg);
+                }
+                break;
+            case QEMU_OPTION_tcg_stats:
+                tb_op_stats = 1;
+                break;
+            case QEMU_OPTION_tb_index:
+                tb_index_file = optarg;
+                break;
             case QEMU_OPTION_icount:
                 icount_option = optarg;
                 break;
@@ -2891,6 +3134,18 @@ int main(int argc, char **argv, char **envp)
                 android_op_report_console = (char*)optarg;
                 break;
 
+            case QEMU_OPTION_gpu_record:
+                op_gpu_record = optarg;
+                break;
+
+            case QEMU_OPTION_perf_stats:
+                op_perf_stats = optarg;
+                break;
+
+            case QEMU_OPTION_benchmark_boot:
+                op_benchmark_boot = optarg;
+                break;
+
             case QEMU_OPTION_http_proxy:
                 op_http_proxy = (char*)optarg;
                 break;
@@ -2984,10 +3239,62 @@ int main(int argc, char **argv, char **envp)
                 android_snapshot_update_time = 0;
                 break;
 
+            case QEMU_OPTION_snapshot_compress:
+                {
+                    char* end;
+                    long level = strtol(optarg, &end, 10);
+                    if (end == optarg || *end || level < 0 || level > 9) {
+                        PANIC("Invalid -snapshot-compress level: %s", optarg);
+                    }
+                    ram_compress_level = (int)level;
+                }
+                break;
+
+            case QEMU_OPTION_qcow2_l2_cache:
+                {
+                    char* end;
+                    long kb = strtol(optarg, &end, 10);
+                    if (end == optarg || *end || kb <= 0) {
+                        PANIC("Invalid -qcow2-l2-cache size: %s", optarg);
+                    }
+                    bdrv_qcow2_set_l2_cache_limit((int64_t)kb * 1024);
+                }
+                break;
+
+            case QEMU_OPTION_snapshot_bench:
+                snapshot_bench_dir = optarg;
+                break;
+
+            case QEMU_OPTION_sdcard_aio:
+                if (!strcmp(optarg, "native")) {
+#ifdef CONFIG_LINUX_AIO
+                    sdcard_native_aio = 1;
+#else
+                    fprintf(stderr, "WARNING: native AIO is not supported "
+                            "on this host, ignoring -sdcard-aio\n");
+#endif
+                } else if (strcmp(optarg, "threads")) {
+                    PANIC("Invalid -sdcard-aio mode: %s", optarg);
+                }
+                break;
+
             case QEMU_OPTION_list_webcam:
                 android_list_web_cameras();
                 exit(0);
 
+            case QEMU_OPTION_mem_hugepages:
+                mem_hugepages = 1;
+                break;
+
+            case QEMU_OPTION_ram_template:
+#ifndef _WIN32
+                ram_template = optarg;
+#else
+                fprintf(stderr, "WARNING: -ram-template is not supported "
+                        "on this host, ignoring it\n");
+#endif
+                break;
+
             default:
                 os_parse_cmd_args(popt->index, optarg);
             }
@@ -3127,35 +3434,19 @@ int main(int argc, char **argv, char **envp)
                            android_hw->disk_systemPartition_path,
                            android_hw->disk_systemPartition_initPath);
 
-    /* For ext4, to extend an internal partition to more than the default size
-     * you need to initialize userdata-qemu.img to the desired size and restore
-     * it after moving the data in - yaffs is resilient enough for this not to
-     * matter
-    */
-    if(android_op_wipe_data &&
-            userdata_partition_type == ANDROID_PARTITION_TYPE_EXT4) {
-        androidPartitionType_makeEmptyFile(userdata_partition_type,
-                                           android_hw->disk_dataPartition_size,
-                                           android_hw->disk_dataPartition_path);
-    }
-
-    /* Initialize data partition image */
+    /* Initialize data partition image. With -wipe-data, it is copied from
+     * the initial image, and grown to the partition size for ext4, in the
+     * background, or made empty without an initial image.
+     */
     android_nand_add_image("userdata",
                            userdata_partition_type,
-                           ANDROID_PARTITION_OPEN_MODE_CREATE_IF_NEEDED,
+                           (android_op_wipe_data ?
+                                   ANDROID_PARTITION_OPEN_MODE_MUST_WIPE :
+                                   ANDROID_PARTITION_OPEN_MODE_CREATE_IF_NEEDED),
                            android_hw->disk_dataPartition_size,
                            android_hw->disk_dataPartition_path,
                            android_hw->disk_dataPartition_initPath);
 
-    /* Extend the userdata-qemu.img to the desired size - resize2fs can only
-     * extend partitions to fill available space
-    */
-    if(android_op_wipe_data &&
-            userdata_partition_type == ANDROID_PARTITION_TYPE_EXT4) {
-        resizeExt4Partition(android_hw->disk_dataPartition_path,
-                            android_hw->disk_dataPartition_size);
-    }
-
     /* Initialize cache partition image, if any. Its type depends on the
      * kernel version. For anything >= 3.10, it must be EXT4, or
      * YAFFS2 otherwise.
@@ -3199,7 +3490,14 @@ int main(int argc, char **argv, char **envp)
                  * the context of an emulator crash. The data is already
                  * synced properly when the emulator exits (either normally or through ^C).
                  */
-                qemu_opt_set(hda_opts, "cache", "unsafe");
+                if (sdcard_native_aio) {
+                    /* Native AIO needs O_DIRECT. Concurrent requests are
+                     * then submitted without a host thread for each one. */
+                    qemu_opt_set(hda_opts, "cache", "none");
+                    qemu_opt_set(hda_opts, "aio", "native");
+                } else {
+                    qemu_opt_set(hda_opts, "cache", "unsafe");
+                }
             }
         }
     }
@@ -3408,6 +3706,11 @@ int main(int argc, char **argv, char **envp)
                     android_gl_renderer, sizeof(android_gl_renderer),
                     android_gl_version, sizeof(android_gl_version));
             qemu_gles = 1;
+            startupTrace_mark("renderer started");
+            if (op_gpu_record &&
+                android_startOpenglesVideoRecording(op_gpu_record, 30) < 0) {
+                dwarning("Could not record the GPU display to %s", op_gpu_record);
+            }
         } else {
             derror("Could not initialize OpenglES emulation, use '-gpu off' to disable it.");
             exit(1);
@@ -3432,12 +3735,16 @@ int main(int argc, char **argv, char **envp)
                         " console=%s0",
                         kernelSerialDevicePrefix);
 
-    /* We always initialize the second serial port for the android-qemud
-     * character device as well */
-    serial_hds_add_at(1, "android-qemud");
-    stralloc_add_format(kernel_params,
-                        " android.qemud=%s1",
-                        kernelSerialDevicePrefix);
+    /* Initialize the second serial port for the android-qemud character
+     * device, unless the guest system only uses qemud pipes. In this case
+     * each qemud client gets its own pipe, and doesn't compete with the
+     * other services for the serial port bandwidth. */
+    if (androidHwConfig_getQemudLegacySerial(android_hw) != 0) {
+        serial_hds_add_at(1, "android-qemud");
+        stralloc_add_format(kernel_params,
+                            " android.qemud=%s1",
+                            kernelSerialDevicePrefix);
+    }
 
     if (pid_file && qemu_create_pidfile(pid_file) != 0) {
         os_pidfile_error();
@@ -3606,6 +3913,8 @@ int main(int argc, char **argv, char **envp)
 
     /* init the dynamic translator */
     cpu_exec_init_all(tb_size * 1024 * 1024);
+    if (tb_index_file)
+        tb_index_load(tb_index_file);
 
     bdrv_init();
 
@@ -3640,7 +3949,7 @@ int main(int argc, char **argv, char **envp)
     register_savevm_live(NULL,
                          "ram",
                          0,
-                         3,
+                         5,
                          ops,
                          NULL);
 
@@ -3844,6 +4153,7 @@ int main(int argc, char **argv, char **envp)
         kernel_parameters = stralloc_cstr(kernel_params);
         VERBOSE_PRINT(init, "Kernel parameters: %s", kernel_parameters);
 
+        android_nand_finish_images();
         machine->init(ram_size,
                       boot_devices,
                       kernel_filename,
@@ -3945,6 +4255,11 @@ int main(int argc, char **argv, char **envp)
         if (show_vnc_port) {
             printf("VNC server running on `%s'\n", vnc_display_local_addr(ds));
         }
+        /* The GPU frames don't go through the framebuffer device. */
+        if (qemu_gles) {
+            gpu_frame_set_damage_post_callback(looper_newCore(), ds,
+                                               vnc_display_gpu_frame);
+        }
         break;
     default:
         break;
@@ -3959,6 +4274,11 @@ int main(int argc, char **argv, char **envp)
         }
         dcl = dcl->next;
     }
+    if (ds->gui_timer) {
+        gui_display_state = ds;
+        gui_activity_listener->dpy_update = gui_activity_update;
+        register_displayupdatelistener(ds, gui_activity_listener);
+    }
 
     if (display_type == DT_NOGRAPHIC || display_type == DT_VNC) {
         nographic_timer = timer_new(QEMU_CLOCK_REALTIME, SCALE_MS, nographic_update, NULL);
@@ -4005,9 +4325,22 @@ int main(int argc, char **argv, char **envp)
 
     android_emulator_set_base_port(android_base_port);
 
+    if (snapshot_bench_dir) {
+        /* Runs before the guest starts, RAM is overwritten. */
+        exit(android_snapshot_bench(snapshot_bench_dir));
+    }
+
     if (loadvm)
         do_loadvm(cur_mon, loadvm);
 
+    /* The first emulator loading the snapshot creates the template that
+     * the next ones map their RAM from. */
+    if (ram_template && loadvm && !ram_template_mapped &&
+        qemu_ram_template_save(ram_template) < 0) {
+        fprintf(stderr, "WARNING: could not write RAM template %s: %s\n",
+                ram_template, strerror(errno));
+    }
+
     if (incoming) {
         autostart = 0; /* fixme how to deal with -daemonize */
         qemu_start_incoming_migration(incoming);
@@ -4021,10 +4354,25 @@ int main(int argc, char **argv, char **envp)
 #ifdef CONFIG_ANDROID
     // This will notify the UI that the core is successfuly initialized
     android_core_init_completed();
+    startupTrace_mark("guest started");
+
+    if (op_perf_stats &&
+        android_perf_stats_start_dump(op_perf_stats, 10000) < 0) {
+        dwarning("Could not write the performance counters to %s", op_perf_stats);
+    }
+
+    if (op_benchmark_boot) {
+        android_boot_benchmark_start(op_benchmark_boot,
+                                     kvm_enabled() ? "kvm" :
+                                     hax_enabled() ? "hax" : "none",
+                                     BOOT_BENCHMARK_TIMEOUT_SEC);
+    }
 #endif  // CONFIG_ANDROID
 
     main_loop();
     quit_timers();
+    if (tb_index_file && tb_index_save() < 0)
+        fprintf(stderr, "Could not write TB index %s\n", tb_index_file);
     net_cleanup();
     android_wear_agent_stop();
     socket_drainer_stop();